@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+'''
+Compare two result files of `bench_palladium -printer=json` and report the
+benchmarks whose timings changed significantly.
+
+A change is significant when a two-sided Mann-Whitney U test on the samples
+rejects "same distribution" at the given level and the medians differ by more
+than the threshold. The exit status is 1 if any benchmark got significantly
+slower, so that the script can gate a CI job.
+
+    bench_compare.py base.json new.json [--alpha=0.05] [--threshold=0.02]
+'''
+
+import argparse
+import json
+import math
+import sys
+from functools import lru_cache
+
+
+def median(values):
+    values = sorted(values)
+    mid = len(values) // 2
+    if len(values) % 2:
+        return values[mid]
+    return (values[mid - 1] + values[mid]) / 2
+
+
+def ranks(values):
+    '''Ranks starting at 1, ties get the mean of their ranks.'''
+    order = sorted(range(len(values)), key=lambda i: values[i])
+    result = [0.0] * len(values)
+    i = 0
+    while i < len(order):
+        j = i
+        while j + 1 < len(order) and values[order[j + 1]] == values[order[i]]:
+            j += 1
+        for k in range(i, j + 1):
+            result[order[k]] = (i + j) / 2 + 1
+        i = j + 1
+    return result
+
+
+@lru_cache(maxsize=None)
+def u_count(n1, n2, u):
+    '''Number of orderings of n1 and n2 samples with statistic U = u.'''
+    if u < 0:
+        return 0
+    if n1 == 0 or n2 == 0:
+        return 1 if u == 0 else 0
+    # The largest value is either from the first sample (beating all n2) or not.
+    return u_count(n1 - 1, n2, u - n2) + u_count(n1, n2 - 1, u)
+
+
+def mann_whitney_p(a, b):
+    '''Two-sided p-value of the Mann-Whitney U test.'''
+    n1, n2 = len(a), len(b)
+    r = ranks(a + b)
+    u1 = sum(r[:n1]) - n1 * (n1 + 1) / 2
+    u = min(u1, n1 * n2 - u1)
+    if n1 + n2 <= 40:
+        # Exact distribution, ignoring ties; benchmark timings rarely tie.
+        total = math.factorial(n1 + n2) // (math.factorial(n1) * math.factorial(n2))
+        below = sum(u_count(n1, n2, k) for k in range(int(math.floor(u)) + 1))
+        return min(1.0, 2 * below / total)
+    mean = n1 * n2 / 2
+    sd = math.sqrt(n1 * n2 * (n1 + n2 + 1) / 12)
+    z = (u - mean + 0.5) / sd
+    return min(1.0, math.erfc(-z / math.sqrt(2)))
+
+
+def load(path):
+    with open(path, encoding='utf8') as f:
+        return {b['name']: b for b in json.load(f)['benchmarks'] if b['samples']}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('base', help='results of the baseline build')
+    parser.add_argument('new', help='results of the build to check')
+    parser.add_argument('--alpha', type=float, default=0.05, help='significance level (default: %(default)s)')
+    parser.add_argument('--threshold', type=float, default=0.02, help='smallest relative change of the median to report (default: %(default)s)')
+    args = parser.parse_args()
+
+    base, new = load(args.base), load(args.new)
+    regressions = 0
+    print('{:<40} {:>12} {:>12} {:>9} {:>7}  {}'.format('benchmark', 'base', 'new', 'change', 'p', 'instructions'))
+    for name in sorted(base.keys() & new.keys()):
+        a, b = base[name]['samples'], new[name]['samples']
+        change = median(b) / median(a) - 1
+        p = mann_whitney_p(a, b)
+        verdict = ''
+        if p < args.alpha and abs(change) > args.threshold:
+            verdict = 'SLOWER' if change > 0 else 'faster'
+            regressions += change > 0
+        instructions = ''
+        if 'instructions' in base[name]['counters'] and 'instructions' in new[name]['counters']:
+            before = median(base[name]['counters']['instructions'])
+            after = median(new[name]['counters']['instructions'])
+            if before:
+                instructions = '{:+.1%}'.format(after / before - 1)
+        print('{:<40} {:>12.6g} {:>12.6g} {:>+9.1%} {:>7.3f}  {:<12} {}'.format(name, median(a), median(b), change, p, instructions, verdict))
+    for name in sorted(base.keys() - new.keys()):
+        print('{:<40} only in {}'.format(name, args.base))
+    for name in sorted(new.keys() - base.keys()):
+        print('{:<40} only in {}'.format(name, args.new))
+
+    if regressions:
+        print('{} benchmark(s) got significantly slower'.format(regressions))
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
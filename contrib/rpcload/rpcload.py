@@ -0,0 +1,264 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+'''
+Send a mix of RPC calls to a running node at a fixed rate and report the
+latency percentiles, errors and rejected requests. See README.md.
+'''
+
+import argparse
+import base64
+import http.client
+import json
+import os
+import queue
+import random
+import sys
+import threading
+import time
+
+DEFAULT_MIX = 'getblock:30,getrawtransaction:30,estimatesmartfee:25,getblocktemplate:5,sendrawtransaction:10'
+DEFAULT_PORTS = {'main': 2332, 'test': 12332, 'regtest': 12443}
+CHAIN_DIRS = {'main': '', 'test': 'testnet3', 'regtest': 'regtest'}
+
+
+class Connection:
+    '''One HTTP connection to the RPC server, reopened as needed.'''
+
+    def __init__(self, args, authhdr):
+        self.args = args
+        self.authhdr = authhdr
+        self.conn = None
+
+    def call(self, payload):
+        '''POST one request. Returns (HTTP status, parsed body or None).'''
+        if self.conn is None:
+            self.conn = http.client.HTTPConnection(self.args.rpcconnect, self.args.rpcport, timeout=self.args.timeout)
+        headers = {'Authorization': self.authhdr, 'Content-type': 'application/json'}
+        if not self.args.keepalive:
+            headers['Connection'] = 'close'
+        try:
+            self.conn.request('POST', '/', json.dumps(payload), headers)
+            response = self.conn.getresponse()
+            body = response.read()
+        except (http.client.HTTPException, OSError):
+            self.conn.close()
+            self.conn = None
+            raise
+        if not self.args.keepalive or response.getheader('Connection', '').lower() == 'close':
+            self.conn.close()
+            self.conn = None
+        try:
+            return response.status, json.loads(body.decode('utf-8'))
+        except ValueError:
+            return response.status, None
+
+
+def auth_header(args):
+    if args.rpcuser is not None:
+        authpair = '{}:{}'.format(args.rpcuser, args.rpcpassword or '')
+    else:
+        cookie = args.rpccookiefile
+        if cookie is None:
+            datadir = args.datadir or os.path.expanduser('~/.palladium')
+            cookie = os.path.join(datadir, CHAIN_DIRS[args.chain], '.cookie')
+        with open(cookie, 'r', encoding='utf8') as f:
+            authpair = f.read().strip()
+    return 'Basic ' + base64.b64encode(authpair.encode('utf-8')).decode('ascii')
+
+
+def rpc(conn, method, *params):
+    status, body = conn.call({'jsonrpc': '1.0', 'id': method, 'method': method, 'params': list(params)})
+    if body is None or body.get('error') is not None:
+        raise RuntimeError('{} failed: HTTP {} {}'.format(method, status, body and body.get('error')))
+    return body['result']
+
+
+def synthetic_calls(conn, mix, rng, blocks):
+    '''Draw calls of the mix, with arguments taken from the last blocks of the chain.'''
+    height = rpc(conn, 'getblockcount')
+    block_hashes = [rpc(conn, 'getblockhash', h) for h in range(max(height - blocks + 1, 0), height + 1)]
+    txs = []  # (txid, block hash, hex)
+    for block_hash in block_hashes:
+        block = rpc(conn, 'getblock', block_hash, 2)
+        txs += [(tx['txid'], block_hash, tx['hex']) for tx in block['tx'][1:]]
+    if not txs:
+        # Coinbase transactions only; good enough for the lookups.
+        block = rpc(conn, 'getblock', block_hashes[-1], 2)
+        txs = [(tx['txid'], block_hashes[-1], tx['hex']) for tx in block['tx']]
+
+    def tx_lookup():
+        # With the block hash, so that the node needs no -txindex
+        txid, block_hash, _ = rng.choice(txs)
+        return [txid, True, block_hash]
+
+    makers = {
+        'getblock': lambda: [rng.choice(block_hashes), 1],
+        'getrawtransaction': tx_lookup,
+        'estimatesmartfee': lambda: [rng.choice((2, 6, 12, 144))],
+        'getblocktemplate': lambda: [{'rules': ['segwit']}],
+        # Confirmed transactions: the node looks them up and refuses them.
+        'sendrawtransaction': lambda: [rng.choice(txs)[2]],
+    }
+
+    methods, weights = [], []
+    for entry in mix.split(','):
+        method, _, weight = entry.partition(':')
+        if method not in makers:
+            sys.exit('Unknown method in --mix: {} (known: {})'.format(method, ', '.join(sorted(makers))))
+        methods.append(method)
+        weights.append(float(weight or 1))
+
+    def draw():
+        while True:
+            method = rng.choices(methods, weights)[0]
+            yield method, makers[method]()
+    return draw()
+
+
+def recorded_calls(path):
+    '''Cycle through the calls of a file with one {"method": ..., "params": [...]} object per line.'''
+    with open(path, 'r', encoding='utf8') as f:
+        calls = [json.loads(line) for line in f if line.strip()]
+    if not calls:
+        sys.exit('No calls in {}'.format(path))
+
+    def cycle():
+        while True:
+            for call in calls:
+                yield call['method'], call.get('params', [])
+    return cycle()
+
+
+class Results:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.latencies = {}  # method -> seconds from the scheduled send time to the reply
+        self.errors = {}     # method -> calls answered with an error
+        self.rejected = 0    # requests the server refused (HTTP 503 when its work queue is full, or the connection)
+        self.late = 0        # requests a worker picked up more than a second after their send time
+
+    def add(self, methods, latency, errors):
+        with self.lock:
+            for method in methods:
+                self.latencies.setdefault(method, []).append(latency)
+            for method in errors:
+                self.errors[method] = self.errors.get(method, 0) + 1
+
+
+def worker(args, authhdr, requests, results):
+    conn = Connection(args, authhdr)
+    while True:
+        item = requests.get()
+        if item is None:
+            return
+        scheduled, calls = item
+        if time.monotonic() - scheduled > 1:
+            with results.lock:
+                results.late += 1
+        payload = [{'jsonrpc': '1.0', 'id': i, 'method': m, 'params': p} for i, (m, p) in enumerate(calls)]
+        try:
+            status, body = conn.call(payload if args.batch > 1 else payload[0])
+        except (http.client.HTTPException, OSError):
+            status, body = None, None
+        latency = time.monotonic() - scheduled
+        methods = [m for m, _ in calls]
+        if status is None or status == 503:
+            with results.lock:
+                results.rejected += 1
+            continue
+        replies = body if isinstance(body, list) else [body]
+        by_id = {r.get('id'): r for r in replies if isinstance(r, dict)}
+        errors = []
+        for i, method in enumerate(methods):
+            reply = by_id.get(i if args.batch > 1 else 0)
+            if reply is None or reply.get('error') is not None:
+                errors.append(method)
+        results.add(methods, latency, errors)
+
+
+def percentile(sorted_values, q):
+    return sorted_values[min(len(sorted_values) - 1, int(q * len(sorted_values)))]
+
+
+def report(results, elapsed, args):
+    print('{:<20} {:>8} {:>7} {:>9} {:>9} {:>9} {:>9}'.format('method', 'calls', 'errors', 'p50 ms', 'p99 ms', 'p999 ms', 'max ms'))
+    everything = []
+    for method in sorted(results.latencies):
+        values = sorted(results.latencies[method])
+        everything += values
+        print('{:<20} {:>8} {:>7} {:>9.2f} {:>9.2f} {:>9.2f} {:>9.2f}'.format(
+            method, len(values), results.errors.get(method, 0),
+            percentile(values, 0.5) * 1000, percentile(values, 0.99) * 1000, percentile(values, 0.999) * 1000, values[-1] * 1000))
+    if everything:
+        everything.sort()
+        print('{:<20} {:>8} {:>7} {:>9.2f} {:>9.2f} {:>9.2f} {:>9.2f}'.format(
+            'all', len(everything), sum(results.errors.values()),
+            percentile(everything, 0.5) * 1000, percentile(everything, 0.99) * 1000, percentile(everything, 0.999) * 1000, everything[-1] * 1000))
+    requests = len(everything) // args.batch + results.rejected
+    print('Requests: {} in {:.1f} s ({:.1f}/s, target {}/s), {} rejected, {} started more than 1 s late'.format(
+        requests, elapsed, requests / elapsed, args.rate, results.rejected, results.late))
+    if results.late:
+        print('The client could not keep up; raise --concurrency for the target rate.')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--rpcconnect', default='127.0.0.1', help='RPC server address (default: %(default)s)')
+    parser.add_argument('--rpcport', type=int, help='RPC server port (default: the chain\'s)')
+    parser.add_argument('--rpcuser', help='RPC user; without it the cookie file is used')
+    parser.add_argument('--rpcpassword', help='RPC password')
+    parser.add_argument('--rpccookiefile', help='RPC cookie file (default: .cookie in the datadir)')
+    parser.add_argument('--datadir', help='node data directory, for the cookie (default: ~/.palladium)')
+    parser.add_argument('--chain', choices=sorted(CHAIN_DIRS), default='main', help='chain of the node (default: %(default)s)')
+    parser.add_argument('--rate', type=float, default=100, help='requests per second (default: %(default)s)')
+    parser.add_argument('--duration', type=float, default=30, help='seconds to send requests for (default: %(default)s)')
+    parser.add_argument('--concurrency', type=int, default=8, help='requests in flight at most, one connection each (default: %(default)s)')
+    parser.add_argument('--batch', type=int, default=1, help='calls per request, sent as a JSON-RPC batch when above 1 (default: %(default)s)')
+    parser.add_argument('--no-keepalive', dest='keepalive', action='store_false', help='open a new connection for every request')
+    parser.add_argument('--timeout', type=float, default=60, help='seconds to wait for a reply (default: %(default)s)')
+    parser.add_argument('--mix', default=DEFAULT_MIX, help='methods and their weights in the synthetic mix (default: %(default)s)')
+    parser.add_argument('--blocks', type=int, default=20, help='recent blocks to take the synthetic arguments from (default: %(default)s)')
+    parser.add_argument('--replay', metavar='FILE', help='send the calls of FILE, a JSON object with "method" and "params" per line, instead of the synthetic mix')
+    parser.add_argument('--seed', type=int, default=0, help='seed of the synthetic mix (default: %(default)s)')
+    args = parser.parse_args()
+    if args.rpcport is None:
+        args.rpcport = DEFAULT_PORTS[args.chain]
+    if args.rate <= 0 or args.concurrency < 1 or args.batch < 1:
+        sys.exit('--rate, --concurrency and --batch must be positive')
+
+    authhdr = auth_header(args)
+    try:
+        calls = recorded_calls(args.replay) if args.replay else synthetic_calls(Connection(args, authhdr), args.mix, random.Random(args.seed), args.blocks)
+    except (RuntimeError, http.client.HTTPException, OSError) as e:
+        sys.exit('Error preparing the calls: {}'.format(e))
+
+    results = Results()
+    requests = queue.Queue()
+    threads = [threading.Thread(target=worker, args=(args, authhdr, requests, results), daemon=True) for _ in range(args.concurrency)]
+    for thread in threads:
+        thread.start()
+
+    # Open loop: requests go out on schedule however long the replies take,
+    # and their latency counts from the scheduled time.
+    start = time.monotonic()
+    sent = 0
+    while True:
+        scheduled = start + sent / args.rate
+        if scheduled - start >= args.duration:
+            break
+        delay = scheduled - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+        requests.put((scheduled, [next(calls) for _ in range(args.batch)]))
+        sent += 1
+    for _ in threads:
+        requests.put(None)
+    for thread in threads:
+        thread.join()
+    report(results, time.monotonic() - start, args)
+
+
+if __name__ == '__main__':
+    main()
@@ -16,14 +16,14 @@
 
 namespace {
 
-template <typename Stream, typename Data>
-bool SerializeDB(Stream& stream, const Data& data)
+template <typename Stream>
+bool SerializeDB(Stream& stream, const CDataStream& data)
 {
     // Write and commit header, data
     try {
         CHashWriter hasher(SER_DISK, CLIENT_VERSION);
-        stream << Params().MessageStart() << data;
-        hasher << Params().MessageStart() << data;
+        stream.write(data.data(), data.size());
+        hasher.write(data.data(), data.size());
         stream << hasher.GetHash();
     } catch (const std::exception& e) {
         return error("%s: Serialize or I/O error - %s", __func__, e.what());
@@ -35,6 +35,16 @@ bool SerializeDB(Stream& stream, const Data& data)
 template <typename Data>
 bool SerializeFileDB(const std::string& prefix, const fs::path& path, const Data& data)
 {
+    // Serialize into memory once, before touching the disk: for addrman this
+    // is the only step that holds its lock, while checksumming, writing and
+    // fsyncing below work on the copy.
+    CDataStream ssData(SER_DISK, CLIENT_VERSION);
+    try {
+        ssData << Params().MessageStart() << data;
+    } catch (const std::exception& e) {
+        return error("%s: Serialize error - %s", __func__, e.what());
+    }
+
     // Generate random temporary filename
     unsigned short randv = 0;
     GetRandBytes((unsigned char*)&randv, sizeof(randv));
@@ -51,7 +61,7 @@ bool SerializeFileDB(const std::string& prefix, const fs::path& path, const Data
     }
 
     // Serialize
-    if (!SerializeDB(fileout, data)) {
+    if (!SerializeDB(fileout, ssData)) {
         fileout.fclose();
         remove(pathTmp);
         return false;
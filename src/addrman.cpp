@@ -9,7 +9,7 @@
 #include <logging.h>
 #include <serialize.h>
 
-int CAddrInfo::GetTriedBucket(const uint256& nKey, const std::vector<bool> &asmap) const
+int CAddrInfo::GetTriedBucket(const uint256& nKey, const Asmap &asmap) const
 {
     uint64_t hash1 = (CHashWriter(SER_GETHASH, 0) << nKey << GetKey()).GetCheapHash();
     uint64_t hash2 = (CHashWriter(SER_GETHASH, 0) << nKey << GetGroup(asmap) << (hash1 % ADDRMAN_TRIED_BUCKETS_PER_GROUP)).GetCheapHash();
@@ -19,7 +19,7 @@ int CAddrInfo::GetTriedBucket(const uint256& nKey, const std::vector<bool> &asma
     return tried_bucket;
 }
 
-int CAddrInfo::GetNewBucket(const uint256& nKey, const CNetAddr& src, const std::vector<bool> &asmap) const
+int CAddrInfo::GetNewBucket(const uint256& nKey, const CNetAddr& src, const Asmap &asmap) const
 {
     std::vector<unsigned char> vchSourceGroupKey = src.GetGroup(asmap);
     uint64_t hash1 = (CHashWriter(SER_GETHASH, 0) << nKey << GetGroup(asmap) << vchSourceGroupKey).GetCheapHash();
@@ -78,7 +78,7 @@ CAddrInfo* CAddrMan::Find(const CNetAddr& addr, int* pnId)
         return nullptr;
     if (pnId)
         *pnId = (*it).second;
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
+    auto it2 = mapInfo.find((*it).second);
     if (it2 != mapInfo.end())
         return &(*it2).second;
     return nullptr;
@@ -138,20 +138,51 @@ void CAddrMan::ClearNew(int nUBucket, int nUBucketPos)
         CAddrInfo& infoDelete = mapInfo[nIdDelete];
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
-        vvNew[nUBucket][nUBucketPos] = -1;
+        SetNew(nUBucket, nUBucketPos, -1);
         if (infoDelete.nRefCount == 0) {
             Delete(nIdDelete);
         }
     }
 }
 
+namespace {
+//! Write an entry of a bucket table, tracking its occupied positions in occupied and their indices in index.
+template <size_t N>
+void SetBucketEntry(int (&table)[N][ADDRMAN_BUCKET_SIZE], int (&index)[N][ADDRMAN_BUCKET_SIZE], std::vector<int>& occupied, int nBucket, int nBucketPos, int nId)
+{
+    int& entry = table[nBucket][nBucketPos];
+    if (entry == -1 && nId != -1) {
+        index[nBucket][nBucketPos] = occupied.size();
+        occupied.push_back(nBucket * ADDRMAN_BUCKET_SIZE + nBucketPos);
+    } else if (entry != -1 && nId == -1) {
+        // Move the last occupied position into the freed slot.
+        int nIndex = index[nBucket][nBucketPos];
+        int nLast = occupied.back();
+        occupied[nIndex] = nLast;
+        index[nLast / ADDRMAN_BUCKET_SIZE][nLast % ADDRMAN_BUCKET_SIZE] = nIndex;
+        occupied.pop_back();
+    }
+    entry = nId;
+}
+} // namespace
+
+void CAddrMan::SetNew(int nUBucket, int nUBucketPos, int nId)
+{
+    SetBucketEntry(vvNew, vvNewOccupiedPos, vNewOccupied, nUBucket, nUBucketPos, nId);
+}
+
+void CAddrMan::SetTried(int nKBucket, int nKBucketPos, int nId)
+{
+    SetBucketEntry(vvTried, vvTriedOccupiedPos, vTriedOccupied, nKBucket, nKBucketPos, nId);
+}
+
 void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 {
     // remove the entry from all new buckets
     for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
         int pos = info.GetBucketPosition(nKey, true, bucket);
         if (vvNew[bucket][pos] == nId) {
-            vvNew[bucket][pos] = -1;
+            SetNew(bucket, pos, -1);
             info.nRefCount--;
         }
     }
@@ -172,7 +203,7 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
-        vvTried[nKBucket][nKBucketPos] = -1;
+        SetTried(nKBucket, nKBucketPos, -1);
         nTried--;
 
         // find which new bucket it belongs to
@@ -183,12 +214,12 @@ void CAddrMan::MakeTried(CAddrInfo& info, int nId)
 
         // Enter it into the new set again.
         infoOld.nRefCount = 1;
-        vvNew[nUBucket][nUBucketPos] = nIdEvict;
+        SetNew(nUBucket, nUBucketPos, nIdEvict);
         nNew++;
     }
     assert(vvTried[nKBucket][nKBucketPos] == -1);
 
-    vvTried[nKBucket][nKBucketPos] = nId;
+    SetTried(nKBucket, nKBucketPos, nId);
     nTried++;
     info.fInTried = true;
 }
@@ -322,7 +353,7 @@ bool CAddrMan::Add_(const CAddress& addr, const CNetAddr& source, int64_t nTimeP
         if (fInsert) {
             ClearNew(nUBucket, nUBucketPos);
             pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
+            SetNew(nUBucket, nUBucketPos, nId);
         } else {
             if (pinfo->nRefCount == 0) {
                 Delete(nId);
@@ -368,15 +399,12 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a tried node
         double fChanceFactor = 1.0;
         while (1) {
-            int nKBucket = insecure_rand.randrange(ADDRMAN_TRIED_BUCKET_COUNT);
-            int nKBucketPos = insecure_rand.randrange(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
-                nKBucket = (nKBucket + insecure_rand.randbits(ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) % ADDRMAN_TRIED_BUCKET_COUNT;
-                nKBucketPos = (nKBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvTried[nKBucket][nKBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
+            // Pick among the occupied positions only, however sparse the table is.
+            int nPos = vTriedOccupied[insecure_rand.randrange(vTriedOccupied.size())];
+            int nId = vvTried[nPos / ADDRMAN_BUCKET_SIZE][nPos % ADDRMAN_BUCKET_SIZE];
+            auto it = mapInfo.find(nId);
+            assert(it != mapInfo.end());
+            const CAddrInfo& info = it->second;
             if (insecure_rand.randbits(30) < fChanceFactor * info.GetChance() * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
@@ -385,15 +413,11 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
         // use a new node
         double fChanceFactor = 1.0;
         while (1) {
-            int nUBucket = insecure_rand.randrange(ADDRMAN_NEW_BUCKET_COUNT);
-            int nUBucketPos = insecure_rand.randrange(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
-                nUBucket = (nUBucket + insecure_rand.randbits(ADDRMAN_NEW_BUCKET_COUNT_LOG2)) % ADDRMAN_NEW_BUCKET_COUNT;
-                nUBucketPos = (nUBucketPos + insecure_rand.randbits(ADDRMAN_BUCKET_SIZE_LOG2)) % ADDRMAN_BUCKET_SIZE;
-            }
-            int nId = vvNew[nUBucket][nUBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo& info = mapInfo[nId];
+            int nPos = vNewOccupied[insecure_rand.randrange(vNewOccupied.size())];
+            int nId = vvNew[nPos / ADDRMAN_BUCKET_SIZE][nPos % ADDRMAN_BUCKET_SIZE];
+            auto it = mapInfo.find(nId);
+            assert(it != mapInfo.end());
+            const CAddrInfo& info = it->second;
             if (insecure_rand.randbits(30) < fChanceFactor * info.GetChance() * (1 << 30))
                 return info;
             fChanceFactor *= 1.2;
@@ -468,6 +492,17 @@ int CAddrMan::Check_()
         }
     }
 
+    if (vTriedOccupied.size() != (size_t)nTried)
+        return -20;
+    for (int nPos : vTriedOccupied) {
+        if (vvTried[nPos / ADDRMAN_BUCKET_SIZE][nPos % ADDRMAN_BUCKET_SIZE] == -1)
+            return -21;
+    }
+    for (int nPos : vNewOccupied) {
+        if (vvNew[nPos / ADDRMAN_BUCKET_SIZE][nPos % ADDRMAN_BUCKET_SIZE] == -1)
+            return -22;
+    }
+
     if (setTried.size())
         return -13;
     if (mapNew.size())
@@ -492,9 +527,10 @@ void CAddrMan::GetAddr_(std::vector<CAddress>& vAddr)
 
         int nRndPos = insecure_rand.randrange(vRandom.size() - n) + n;
         SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
+        auto it = mapInfo.find(vRandom[n]);
+        assert(it != mapInfo.end());
 
-        const CAddrInfo& ai = mapInfo[vRandom[n]];
+        const CAddrInfo& ai = it->second;
         if (!ai.IsTerrible())
             vAddr.push_back(ai);
     }
@@ -21,6 +21,7 @@
 #include <set>
 #include <stdint.h>
 #include <streams.h>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -73,13 +74,13 @@ public:
     }
 
     //! Calculate in which "tried" bucket this entry belongs
-    int GetTriedBucket(const uint256 &nKey, const std::vector<bool> &asmap) const;
+    int GetTriedBucket(const uint256 &nKey, const Asmap &asmap) const;
 
     //! Calculate in which "new" bucket this entry belongs, given a certain source
-    int GetNewBucket(const uint256 &nKey, const CNetAddr& src, const std::vector<bool> &asmap) const;
+    int GetNewBucket(const uint256 &nKey, const CNetAddr& src, const Asmap &asmap) const;
 
     //! Calculate in which "new" bucket this entry belongs, using its default source
-    int GetNewBucket(const uint256 &nKey, const std::vector<bool> &asmap) const
+    int GetNewBucket(const uint256 &nKey, const Asmap &asmap) const
     {
         return GetNewBucket(nKey, source, asmap);
     }
@@ -185,7 +186,7 @@ private:
     int nIdCount GUARDED_BY(cs);
 
     //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo GUARDED_BY(cs);
+    std::unordered_map<int, CAddrInfo> mapInfo GUARDED_BY(cs);
 
     //! find an nId based on its network address
     std::map<CNetAddr, int> mapAddr GUARDED_BY(cs);
@@ -205,6 +206,14 @@ private:
     //! list of "new" buckets
     int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
 
+    //! occupied positions (bucket * ADDRMAN_BUCKET_SIZE + position) of vvNew and vvTried, in no particular order
+    std::vector<int> vNewOccupied GUARDED_BY(cs);
+    std::vector<int> vTriedOccupied GUARDED_BY(cs);
+
+    //! index of each occupied position of vvNew and vvTried in vNewOccupied and vTriedOccupied
+    int vvNewOccupiedPos[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
+    int vvTriedOccupiedPos[ADDRMAN_TRIED_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
+
     //! last time Good was called (memory only)
     int64_t nLastGood GUARDED_BY(cs);
 
@@ -225,6 +234,12 @@ protected:
     //! nTime and nServices of the found node are updated, if necessary.
     CAddrInfo* Create(const CAddress &addr, const CNetAddr &addrSource, int *pnId = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    //! Set a position in a "new" table to nId (or -1 to clear it), keeping vNewOccupied up to date.
+    void SetNew(int nUBucket, int nUBucketPos, int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    //! Set a position in a "tried" table to nId (or -1 to clear it), keeping vTriedOccupied up to date.
+    void SetTried(int nKBucket, int nKBucketPos, int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     //! Swap two elements in vRandom.
     void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -284,7 +299,7 @@ public:
     //
     // If a new asmap was provided, the existing records
     // would be re-bucketed accordingly.
-    std::vector<bool> m_asmap;
+    Asmap m_asmap;
 
     // Read asmap from provided binary file
     static std::vector<bool> DecodeAsmap(fs::path path);
@@ -371,7 +386,7 @@ public:
         // can be ignored by older clients for backward compatibility.
         uint256 asmap_version;
         if (m_asmap.size() != 0) {
-            asmap_version = SerializeHash(m_asmap);
+            asmap_version = SerializeHash(m_asmap.GetBits());
         }
         s << asmap_version;
     }
@@ -427,7 +442,7 @@ public:
                 vRandom.push_back(nIdCount);
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
+                SetTried(nKBucket, nKBucketPos, nIdCount);
                 nIdCount++;
             } else {
                 nLost++;
@@ -452,7 +467,7 @@ public:
 
         uint256 supplied_asmap_version;
         if (m_asmap.size() != 0) {
-            supplied_asmap_version = SerializeHash(m_asmap);
+            supplied_asmap_version = SerializeHash(m_asmap.GetBits());
         }
         uint256 serialized_asmap_version;
         if (nVersion > 1) {
@@ -466,7 +481,7 @@ public:
             if (nVersion == 2 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT && vvNew[bucket][nUBucketPos] == -1 &&
                 info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS && serialized_asmap_version == supplied_asmap_version) {
                 // Bucketing has not changed, using existing bucket positions for the new table
-                vvNew[bucket][nUBucketPos] = n;
+                SetNew(bucket, nUBucketPos, n);
                 info.nRefCount++;
             } else {
                 // In case the new table data cannot be used (nVersion unknown, bucket count wrong or new asmap),
@@ -475,7 +490,7 @@ public:
                 bucket = info.GetNewBucket(nKey, m_asmap);
                 nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                 if (vvNew[bucket][nUBucketPos] == -1) {
-                    vvNew[bucket][nUBucketPos] = n;
+                    SetNew(bucket, nUBucketPos, n);
                     info.nRefCount++;
                 }
             }
@@ -483,9 +498,9 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
+        for (auto it = mapInfo.cbegin(); it != mapInfo.cend(); ) {
             if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
+                auto itCopy = it++;
                 Delete(itCopy->first);
                 nLostUnk++;
             } else {
@@ -503,6 +518,8 @@ public:
     {
         LOCK(cs);
         std::vector<int>().swap(vRandom);
+        std::vector<int>().swap(vNewOccupied);
+        std::vector<int>().swap(vTriedOccupied);
         nKey = insecure_rand.rand256();
         for (size_t bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
@@ -11,6 +11,137 @@
 #include <util/time.h>
 #include <util/translation.h>
 
+#include <algorithm>
+
+namespace {
+int GetBit(const std::array<uint8_t, 16>& key, int bit)
+{
+    return (key[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+/** Number of leading bits, up to max_length, in which two keys agree */
+int CommonPrefixLength(const std::array<uint8_t, 16>& a, const std::array<uint8_t, 16>& b, int max_length)
+{
+    int length = 0;
+    while (length < max_length) {
+        const uint8_t diff = a[length >> 3] ^ b[length >> 3];
+        if (diff == 0) {
+            length = (length & ~7) + 8;
+            continue;
+        }
+        while (!((diff >> (7 - (length & 7))) & 1)) ++length;
+        break;
+    }
+    return std::min(length, max_length);
+}
+
+std::array<uint8_t, 16> GetKey(const CNetAddr& addr)
+{
+    std::array<uint8_t, 16> key;
+    const std::vector<unsigned char> bytes = addr.GetAddrBytes();
+    std::copy(bytes.begin(), bytes.end(), key.begin());
+    return key;
+}
+
+/** A key's first length bits, the others cleared */
+std::array<uint8_t, 16> TruncateKey(const std::array<uint8_t, 16>& key, int length)
+{
+    std::array<uint8_t, 16> ret{};
+    for (int x = 0; x < 16 && x * 8 < length; ++x) {
+        ret[x] = length - x * 8 >= 8 ? key[x] : key[x] & (0xff << (8 - (length - x * 8)));
+    }
+    return ret;
+}
+} // namespace
+
+bool SubNetTrie::Insert(const CSubNet& sub_net, int64_t value)
+{
+    const int length = sub_net.GetPrefixLength();
+    if (length < 0) return false;
+    const std::array<uint8_t, 16> key = GetKey(sub_net.GetBaseAddress());
+
+    std::unique_ptr<Node>* slot = &m_root;
+    while (*slot) {
+        Node& node = **slot;
+        const int common = CommonPrefixLength(node.m_key, key, std::min(node.m_length, length));
+        if (common == node.m_length) {
+            if (common == length) {
+                if (!node.m_has_value) ++m_size;
+                node.m_has_value = true;
+                node.m_value = value;
+                return true;
+            }
+            slot = &node.m_children[GetBit(key, common)];
+            continue;
+        }
+        // The subnet branches off above this node: put a node for the
+        // common prefix, or for the subnet itself, in its place.
+        std::unique_ptr<Node> split(new Node(TruncateKey(key, common), common));
+        split->m_children[GetBit(node.m_key, common)] = std::move(*slot);
+        *slot = std::move(split);
+        if (common == length) {
+            (*slot)->m_has_value = true;
+            (*slot)->m_value = value;
+            ++m_size;
+            return true;
+        }
+        slot = &(*slot)->m_children[GetBit(key, common)];
+    }
+    slot->reset(new Node(key, length));
+    (*slot)->m_has_value = true;
+    (*slot)->m_value = value;
+    ++m_size;
+    return true;
+}
+
+bool SubNetTrie::Erase(const CSubNet& sub_net)
+{
+    const int length = sub_net.GetPrefixLength();
+    if (length < 0) return false;
+    const std::array<uint8_t, 16> key = GetKey(sub_net.GetBaseAddress());
+
+    std::unique_ptr<Node>* parent = nullptr;
+    std::unique_ptr<Node>* slot = &m_root;
+    while (*slot && (*slot)->m_length < length) {
+        if (CommonPrefixLength((*slot)->m_key, key, (*slot)->m_length) < (*slot)->m_length) return false;
+        parent = slot;
+        slot = &(*slot)->m_children[GetBit(key, (*slot)->m_length)];
+    }
+    if (!*slot || (*slot)->m_length != length || (*slot)->m_key != key || !(*slot)->m_has_value) return false;
+    (*slot)->m_has_value = false;
+    --m_size;
+
+    // Drop nodes left without a value and with fewer than two children.
+    // Only the node itself and its parent can have become such.
+    for (std::unique_ptr<Node>* s : {slot, parent}) {
+        if (!s || !*s || (*s)->m_has_value) continue;
+        std::unique_ptr<Node>* children = (*s)->m_children;
+        if (children[0] && children[1]) break;
+        std::unique_ptr<Node> child = std::move(children[0] ? children[0] : children[1]);
+        *s = std::move(child);
+    }
+    return true;
+}
+
+void SubNetTrie::Clear()
+{
+    m_root.reset();
+    m_size = 0;
+}
+
+int64_t SubNetTrie::GetMaxMatch(const CNetAddr& addr) const
+{
+    const std::array<uint8_t, 16> key = GetKey(addr);
+    int64_t ret = 0;
+    const Node* node = m_root.get();
+    while (node && CommonPrefixLength(node->m_key, key, node->m_length) == node->m_length) {
+        if (node->m_has_value) ret = std::max(ret, node->m_value);
+        if (node->m_length == 128) break;
+        node = node->m_children[GetBit(key, node->m_length)].get();
+    }
+    return ret;
+}
+
 
 BanMan::BanMan(fs::path ban_file, CClientUIInterface* client_interface, int64_t default_ban_time)
     : m_client_interface(client_interface), m_ban_db(std::move(ban_file)), m_default_ban_time(default_ban_time)
@@ -62,6 +193,9 @@ void BanMan::ClearBanned()
     {
         LOCK(m_cs_banned);
         m_banned.clear();
+        m_banned_trie.Clear();
+        m_banned_masks.clear();
+        m_ban_expiry.clear();
         m_is_dirty = true;
     }
     DumpBanlist(); //store banlist to disk
@@ -76,13 +210,12 @@ bool BanMan::IsDiscouraged(const CNetAddr& net_addr)
 
 bool BanMan::IsBanned(const CNetAddr& net_addr)
 {
+    if (!net_addr.IsValid()) return false;
     auto current_time = GetTime();
     LOCK(m_cs_banned);
-    for (const auto& it : m_banned) {
-        CSubNet sub_net = it.first;
-        CBanEntry ban_entry = it.second;
-
-        if (current_time < ban_entry.nBanUntil && sub_net.Match(net_addr)) {
+    if (current_time < m_banned_trie.GetMaxMatch(net_addr)) return true;
+    for (const CSubNet& sub_net : m_banned_masks) {
+        if (current_time < m_banned.at(sub_net).nBanUntil && sub_net.Match(net_addr)) {
             return true;
         }
     }
@@ -129,8 +262,9 @@ void BanMan::Ban(const CSubNet& sub_net, int64_t ban_time_offset, bool since_uni
 
     {
         LOCK(m_cs_banned);
-        if (m_banned[sub_net].nBanUntil < ban_entry.nBanUntil) {
-            m_banned[sub_net] = ban_entry;
+        banmap_t::const_iterator it = m_banned.find(sub_net);
+        if (it == m_banned.end() || it->second.nBanUntil < ban_entry.nBanUntil) {
+            AddBanned(sub_net, ban_entry);
             m_is_dirty = true;
         } else
             return;
@@ -151,7 +285,9 @@ bool BanMan::Unban(const CSubNet& sub_net)
 {
     {
         LOCK(m_cs_banned);
-        if (m_banned.erase(sub_net) == 0) return false;
+        banmap_t::iterator it = m_banned.find(sub_net);
+        if (it == m_banned.end()) return false;
+        RemoveBanned(it);
         m_is_dirty = true;
     }
     if (m_client_interface) m_client_interface->BannedListChanged();
@@ -170,27 +306,52 @@ void BanMan::GetBanned(banmap_t& banmap)
 void BanMan::SetBanned(const banmap_t& banmap)
 {
     LOCK(m_cs_banned);
-    m_banned = banmap;
+    m_banned.clear();
+    m_banned_trie.Clear();
+    m_banned_masks.clear();
+    m_ban_expiry.clear();
+    for (const auto& entry : banmap) {
+        AddBanned(entry.first, entry.second);
+    }
     m_is_dirty = true;
 }
 
+void BanMan::AddBanned(const CSubNet& sub_net, const CBanEntry& ban_entry)
+{
+    banmap_t::iterator it = m_banned.find(sub_net);
+    if (it != m_banned.end()) {
+        m_ban_expiry.erase({it->second.nBanUntil, sub_net});
+        it->second = ban_entry;
+    } else {
+        m_banned.emplace(sub_net, ban_entry);
+    }
+    m_ban_expiry.emplace(ban_entry.nBanUntil, sub_net);
+    if (sub_net.IsValid() && !m_banned_trie.Insert(sub_net, ban_entry.nBanUntil)) {
+        m_banned_masks.insert(sub_net);
+    }
+}
+
+void BanMan::RemoveBanned(banmap_t::iterator it)
+{
+    m_ban_expiry.erase({it->second.nBanUntil, it->first});
+    m_banned_trie.Erase(it->first);
+    m_banned_masks.erase(it->first);
+    m_banned.erase(it);
+}
+
 void BanMan::SweepBanned()
 {
     int64_t now = GetTime();
     bool notify_ui = false;
     {
         LOCK(m_cs_banned);
-        banmap_t::iterator it = m_banned.begin();
-        while (it != m_banned.end()) {
-            CSubNet sub_net = (*it).first;
-            CBanEntry ban_entry = (*it).second;
-            if (now > ban_entry.nBanUntil) {
-                m_banned.erase(it++);
-                m_is_dirty = true;
-                notify_ui = true;
-                LogPrint(BCLog::NET, "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, sub_net.ToString());
-            } else
-                ++it;
+        // Bans are ordered by expiry, so only the expired ones are visited
+        while (!m_ban_expiry.empty() && now > m_ban_expiry.begin()->first) {
+            const CSubNet sub_net = m_ban_expiry.begin()->second;
+            RemoveBanned(m_banned.find(sub_net));
+            m_is_dirty = true;
+            notify_ui = true;
+            LogPrint(BCLog::NET, "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, sub_net.ToString());
         }
     }
     // update UI
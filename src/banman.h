@@ -11,9 +11,12 @@
 #include <net_types.h> // For banmap_t
 #include <sync.h>
 
+#include <array>
 #include <chrono>
 #include <cstdint>
 #include <memory>
+#include <set>
+#include <utility>
 
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
 static constexpr unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24; // Default 24-hour ban
@@ -24,6 +27,40 @@ class CClientUIInterface;
 class CNetAddr;
 class CSubNet;
 
+/**
+ * Values keyed by subnets whose netmask is a prefix, in a binary trie over
+ * the 16 address bytes. Chains of nodes with a single child are merged, so
+ * IPv4 (::ffff:0:0/96) and Tor (fd87:d87e:eb43::/48) subnets each sit in
+ * their own subtree below a single node, and looking up an address visits
+ * at most one node per subnet length present on its path.
+ */
+class SubNetTrie
+{
+public:
+    //! Set the value of a subnet. Returns false, adding nothing, if its netmask is not a prefix.
+    bool Insert(const CSubNet& sub_net, int64_t value);
+    //! Remove a subnet. Returns whether it was present.
+    bool Erase(const CSubNet& sub_net);
+    void Clear();
+    //! The highest value of the subnets containing addr, or 0 if there are none.
+    int64_t GetMaxMatch(const CNetAddr& addr) const;
+    size_t Size() const { return m_size; }
+
+private:
+    struct Node {
+        //! Address bits before m_length, the others cleared
+        std::array<uint8_t, 16> m_key;
+        int m_length;
+        bool m_has_value{false};
+        int64_t m_value{0};
+        std::unique_ptr<Node> m_children[2];
+
+        Node(const std::array<uint8_t, 16>& key, int length) : m_key(key), m_length(length) {}
+    };
+    std::unique_ptr<Node> m_root;
+    size_t m_size{0};
+};
+
 // Banman manages two related but distinct concepts:
 //
 // 1. Banning. This is configured manually by the user, through the setban RPC.
@@ -85,9 +122,19 @@ private:
     void SetBannedSetDirty(bool dirty = true);
     //!clean unused entries (if bantime has expired)
     void SweepBanned();
+    //! Add or replace a ban in m_banned and the indexes over it
+    void AddBanned(const CSubNet& sub_net, const CBanEntry& ban_entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_banned);
+    //! Remove a ban from m_banned and the indexes over it
+    void RemoveBanned(banmap_t::iterator it) EXCLUSIVE_LOCKS_REQUIRED(m_cs_banned);
 
     RecursiveMutex m_cs_banned;
     banmap_t m_banned GUARDED_BY(m_cs_banned);
+    //! Ban expiry of the subnets in m_banned with a prefix netmask, for IsBanned(const CNetAddr&)
+    SubNetTrie m_banned_trie GUARDED_BY(m_cs_banned);
+    //! The other valid subnets in m_banned, which IsBanned(const CNetAddr&) checks one by one
+    std::set<CSubNet> m_banned_masks GUARDED_BY(m_cs_banned);
+    //! (ban expiry, subnet) of all of m_banned, soonest first, for SweepBanned
+    std::set<std::pair<int64_t, CSubNet>> m_ban_expiry GUARDED_BY(m_cs_banned);
     bool m_is_dirty GUARDED_BY(m_cs_banned);
     CClientUIInterface* m_client_interface = nullptr;
     CBanDB m_ban_db;
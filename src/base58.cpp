@@ -4,6 +4,7 @@
 
 #include <base58.h>
 
+#include <crypto/common.h>
 #include <hash.h>
 #include <uint256.h>
 #include <util/strencodings.h>
@@ -35,6 +36,34 @@ static const int8_t mapBase58[256] = {
     -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
 };
 
+/** 58^5, the base of the limbs holding base58 numbers while they are converted. */
+static constexpr uint32_t BASE58_LIMB = 58 * 58 * 58 * 58 * 58;
+static constexpr uint32_t POW58[5] = {1, 58, 58 * 58, 58 * 58 * 58, 58 * 58 * 58 * 58};
+
+/** Apply "n = n * mul + add" to a little-endian number of 32-bit limbs in base base. */
+static inline void MulAddLimbs(std::vector<uint32_t>& n, uint64_t base, uint64_t mul, uint64_t add)
+{
+    uint64_t carry = add;
+    for (uint32_t& limb : n) {
+        carry += limb * mul;
+        limb = carry % base;
+        carry /= base;
+    }
+    while (carry != 0) {
+        n.push_back(carry % base);
+        carry /= base;
+    }
+}
+
+/** Number of significant bytes of a little-endian base 2^32 number. */
+static inline int ByteLength(const std::vector<uint32_t>& n)
+{
+    if (n.empty()) return 0;
+    int length = (n.size() - 1) * 4;
+    for (uint32_t top = n.back(); top != 0; top >>= 8) length++;
+    return length;
+}
+
 bool DecodeBase58(const char* psz, std::vector<unsigned char>& vch, int max_ret_len)
 {
     // Skip leading spaces.
@@ -42,45 +71,51 @@ bool DecodeBase58(const char* psz, std::vector<unsigned char>& vch, int max_ret_
         psz++;
     // Skip and count leading '1's.
     int zeroes = 0;
-    int length = 0;
     while (*psz == '1') {
         zeroes++;
         if (zeroes > max_ret_len) return false;
         psz++;
     }
-    // Allocate enough space in big-endian base256 representation.
-    int size = strlen(psz) * 733 /1000 + 1; // log(58) / log(256), rounded up.
-    std::vector<unsigned char> b256(size);
+    // The number in base 2^32, converted five characters (one base 58^5
+    // digit) at a time. As it only grows, checking its length after every
+    // five characters rejects oversized input as early as checking after
+    // each one would, up to four characters.
+    std::vector<uint32_t> b256;
+    b256.reserve(strlen(psz) * 733 / 4000 + 1); // log(58) / log(2^32), rounded up.
     // Process the characters.
     static_assert(sizeof(mapBase58)/sizeof(mapBase58[0]) == 256, "mapBase58.size() should be 256"); // guarantee not out of range
+    uint32_t chunk = 0;
+    int chunk_len = 0;
     while (*psz && !IsSpace(*psz)) {
         // Decode base58 character
-        int carry = mapBase58[(uint8_t)*psz];
-        if (carry == -1)  // Invalid b58 character
+        int digit = mapBase58[(uint8_t)*psz];
+        if (digit == -1)  // Invalid b58 character
             return false;
-        int i = 0;
-        for (std::vector<unsigned char>::reverse_iterator it = b256.rbegin(); (carry != 0 || i < length) && (it != b256.rend()); ++it, ++i) {
-            carry += 58 * (*it);
-            *it = carry % 256;
-            carry /= 256;
+        chunk = chunk * 58 + digit;
+        if (++chunk_len == 5) {
+            MulAddLimbs(b256, uint64_t{1} << 32, BASE58_LIMB, chunk);
+            if (ByteLength(b256) + zeroes > max_ret_len) return false;
+            chunk = 0;
+            chunk_len = 0;
         }
-        assert(carry == 0);
-        length = i;
-        if (length + zeroes > max_ret_len) return false;
         psz++;
     }
+    if (chunk_len > 0) {
+        MulAddLimbs(b256, uint64_t{1} << 32, POW58[chunk_len], chunk);
+        if (ByteLength(b256) + zeroes > max_ret_len) return false;
+    }
     // Skip trailing spaces.
     while (IsSpace(*psz))
         psz++;
     if (*psz != 0)
         return false;
-    // Skip leading zeroes in b256.
-    std::vector<unsigned char>::iterator it = b256.begin() + (size - length);
-    // Copy result into output vector.
-    vch.reserve(zeroes + (b256.end() - it));
+    // Copy result into output vector, skipping leading zeroes in b256.
+    const int length = ByteLength(b256);
+    vch.reserve(zeroes + length);
     vch.assign(zeroes, 0x00);
-    while (it != b256.end())
-        vch.push_back(*(it++));
+    for (int i = length - 1; i >= 0; --i) {
+        vch.push_back(b256[i / 4] >> (8 * (i % 4)));
+    }
     return true;
 }
 
@@ -88,39 +123,39 @@ std::string EncodeBase58(const unsigned char* pbegin, const unsigned char* pend)
 {
     // Skip & count leading zeroes.
     int zeroes = 0;
-    int length = 0;
     while (pbegin != pend && *pbegin == 0) {
         pbegin++;
         zeroes++;
     }
-    // Allocate enough space in big-endian base58 representation.
-    int size = (pend - pbegin) * 138 / 100 + 1; // log(256) / log(58), rounded up.
-    std::vector<unsigned char> b58(size);
-    // Process the bytes.
-    while (pbegin != pend) {
-        int carry = *pbegin;
-        int i = 0;
-        // Apply "b58 = b58 * 256 + ch".
-        for (std::vector<unsigned char>::reverse_iterator it = b58.rbegin(); (carry != 0 || i < length) && (it != b58.rend()); it++, i++) {
-            carry += 256 * (*it);
-            *it = carry % 58;
-            carry /= 58;
-        }
-
-        assert(carry == 0);
-        length = i;
-        pbegin++;
+    // The number in base 58^5, converted four bytes at a time.
+    std::vector<uint32_t> b58;
+    b58.reserve((pend - pbegin) * 138 / 500 + 1); // log(256) / log(58^5), rounded up.
+    for (; pend - pbegin >= 4; pbegin += 4) {
+        MulAddLimbs(b58, BASE58_LIMB, uint64_t{1} << 32, ReadBE32(pbegin));
     }
-    // Skip leading zeroes in base58 result.
-    std::vector<unsigned char>::iterator it = b58.begin() + (size - length);
-    while (it != b58.end() && *it == 0)
-        it++;
-    // Translate the result into a string.
+    if (pbegin != pend) {
+        uint32_t chunk = 0;
+        int bits = 0;
+        for (; pbegin != pend; pbegin++, bits += 8) chunk = (chunk << 8) | *pbegin;
+        MulAddLimbs(b58, BASE58_LIMB, uint64_t{1} << bits, chunk);
+    }
+    // Translate the result into a string, skipping leading zeroes in the top limb.
     std::string str;
-    str.reserve(zeroes + (b58.end() - it));
+    str.reserve(zeroes + b58.size() * 5);
     str.assign(zeroes, '1');
-    while (it != b58.end())
-        str += pszBase58[*(it++)];
+    for (size_t i = b58.size(); i-- > 0;) {
+        char digits[5];
+        uint32_t limb = b58[i];
+        for (int j = 4; j >= 0; --j) {
+            digits[j] = pszBase58[limb % 58];
+            limb /= 58;
+        }
+        int skip = 0;
+        if (i == b58.size() - 1) {
+            while (digits[skip] == '1') skip++;
+        }
+        str.append(digits + skip, 5 - skip);
+    }
     return str;
 }
 
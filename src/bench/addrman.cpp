@@ -0,0 +1,139 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addrman.h>
+#include <bench/bench.h>
+#include <netbase.h>
+#include <random.h>
+#include <streams.h>
+#include <util/time.h>
+
+#include <vector>
+
+/* A "source" is a source address from which we have received a bunch of other addresses. */
+
+static constexpr size_t NUM_SOURCES = 256;
+static constexpr size_t NUM_ADDRESSES_PER_SOURCE = 256;
+
+static std::vector<CAddress> g_sources;
+static std::vector<std::vector<CAddress>> g_addresses;
+
+static void CreateAddresses()
+{
+    if (g_sources.size() > 0) { // already created
+        return;
+    }
+
+    FastRandomContext rng(uint256(std::vector<unsigned char>(32, 123)));
+
+    auto randAddr = [&rng]() {
+        // The few that land in non-routable ranges are ignored by Add().
+        in_addr addr;
+        addr.s_addr = rng.rand32();
+        uint16_t port = rng.randbits(16);
+        if (port == 0) port = 1;
+        CAddress ret(CService(addr, port), NODE_NETWORK);
+        ret.nTime = GetAdjustedTime();
+        return ret;
+    };
+
+    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+        g_sources.emplace_back(randAddr());
+        g_addresses.emplace_back();
+        for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; ++addr_i) {
+            g_addresses[source_i].emplace_back(randAddr());
+        }
+    }
+}
+
+static void AddAddressesToAddrMan(CAddrMan& addrman)
+{
+    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+        addrman.Add(g_addresses[source_i], g_sources[source_i]);
+    }
+}
+
+static void FillAddrMan(CAddrMan& addrman)
+{
+    CreateAddresses();
+
+    AddAddressesToAddrMan(addrman);
+}
+
+/* Benchmarks */
+
+static void AddrManAdd(benchmark::State& state)
+{
+    CreateAddresses();
+
+    CAddrMan addrman;
+
+    while (state.KeepRunning()) {
+        AddAddressesToAddrMan(addrman);
+        addrman.Clear();
+    }
+}
+
+static void AddrManSelect(benchmark::State& state)
+{
+    CAddrMan addrman;
+
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        const auto& address = addrman.Select();
+        assert(address.GetPort() > 0);
+    }
+}
+
+static void AddrManSelectFromAlmostEmpty(benchmark::State& state)
+{
+    CAddrMan addrman;
+
+    // Add one address to the new table and one to the tried table, so that
+    // every selection has to find a single entry in a nearly empty table.
+    CService addr = LookupNumeric("250.3.1.1", 8333);
+    addrman.Add(CAddress(addr, NODE_NONE), addr);
+    CService addr_tried = LookupNumeric("250.4.1.1", 8333);
+    addrman.Add(CAddress(addr_tried, NODE_NONE), addr_tried);
+    addrman.Good(addr_tried);
+
+    while (state.KeepRunning()) {
+        const auto& address = addrman.Select();
+        assert(address.GetPort() > 0);
+    }
+}
+
+static void AddrManGetAddr(benchmark::State& state)
+{
+    CAddrMan addrman;
+
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        const auto& addresses = addrman.GetAddr();
+        assert(addresses.size() > 0);
+    }
+}
+
+static void AddrManSerialize(benchmark::State& state)
+{
+    CAddrMan addrman;
+
+    FillAddrMan(addrman);
+
+    while (state.KeepRunning()) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << addrman;
+        CAddrMan addrman2;
+        ss >> addrman2;
+        assert(addrman2.size() == addrman.size());
+    }
+}
+
+BENCHMARK(AddrManAdd, 5);
+BENCHMARK(AddrManSelect, 1000000);
+BENCHMARK(AddrManSelectFromAlmostEmpty, 1000000);
+BENCHMARK(AddrManGetAddr, 500);
+BENCHMARK(AddrManSerialize, 5);
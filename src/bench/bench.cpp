@@ -6,15 +6,21 @@
 
 #include <chainparams.h>
 #include <test/util/setup_common.h>
+#include <util/memory.h>
 #include <validation.h>
 
 #include <algorithm>
 #include <assert.h>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <numeric>
 #include <regex>
 
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
+
 const RegTestingSetup* g_testing_setup = nullptr;
 const std::function<void(const std::string&)> G_TEST_LOG_FUN{};
 
@@ -89,6 +95,43 @@ void benchmark::PlotlyPrinter::footer()
 }
 
 
+void benchmark::JsonPrinter::header() {}
+
+void benchmark::JsonPrinter::result(const State& state)
+{
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("name", state.m_name);
+    result.pushKV("evals", state.m_num_evals);
+    result.pushKV("iterations", state.m_num_iters);
+
+    // Seconds per iteration, in the order the evaluations ran
+    UniValue samples(UniValue::VARR);
+    for (double elapsed : state.m_elapsed_results) samples.push_back(elapsed);
+    result.pushKV("samples", samples);
+
+    // Counts per iteration, one per evaluation like the samples
+    UniValue counters(UniValue::VOBJ);
+    if (state.m_counters) {
+        for (int counter = 0; counter < CpuCounters::NUM_COUNTERS; ++counter) {
+            if (!state.m_counters->Available(CpuCounters::Counter(counter))) continue;
+            UniValue values(UniValue::VARR);
+            for (const CpuCounters::Values& eval : state.m_counter_results) {
+                values.push_back(double(eval[counter]) / state.m_num_iters);
+            }
+            counters.pushKV(CpuCounters::Name(CpuCounters::Counter(counter)), values);
+        }
+    }
+    result.pushKV("counters", counters);
+    m_results.push_back(result);
+}
+
+void benchmark::JsonPrinter::footer()
+{
+    UniValue output(UniValue::VOBJ);
+    output.pushKV("benchmarks", m_results);
+    std::cout << output.write(2) << std::endl;
+}
+
 benchmark::BenchRunner::BenchmarkMap& benchmark::BenchRunner::benchmarks()
 {
     static std::map<std::string, Bench> benchmarks_map;
@@ -109,6 +152,15 @@ void benchmark::BenchRunner::RunAll(Printer& printer, uint64_t num_evals, double
     std::cerr << "WARNING: This is a debug build - may result in slower benchmarks.\n";
 #endif
 
+    std::unique_ptr<CpuCounters> counters;
+    if (printer.wants_counters()) {
+        counters = MakeUnique<CpuCounters>();
+        if (!counters->AnyAvailable()) {
+            std::cerr << "WARNING: CPU counters are not available - only timings will be reported.\n";
+            counters.reset();
+        }
+    }
+
     std::regex reFilter(filter);
     std::smatch baseMatch;
 
@@ -135,6 +187,7 @@ void benchmark::BenchRunner::RunAll(Printer& printer, uint64_t num_evals, double
             num_iters = 1;
         }
         State state(p.first, num_evals, num_iters, printer);
+        if (counters && !is_list_only) state.m_counters = counters.get();
         if (!is_list_only) {
             p.second.func(state);
         }
@@ -145,11 +198,27 @@ void benchmark::BenchRunner::RunAll(Printer& printer, uint64_t num_evals, double
     printer.footer();
 }
 
+uint64_t benchmark::GetPeakRSS()
+{
+#ifndef WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef MAC_OSX
+        return usage.ru_maxrss;
+#else
+        return uint64_t(usage.ru_maxrss) * 1024; // kilobytes elsewhere
+#endif
+    }
+#endif
+    return 0;
+}
+
 bool benchmark::State::UpdateTimer(const benchmark::time_point current_time)
 {
     if (m_start_time != time_point()) {
         std::chrono::duration<double> diff = current_time - m_start_time;
         m_elapsed_results.push_back(diff.count() / m_num_iters);
+        if (m_counters) m_counter_results.push_back(m_counters->Stop());
 
         if (m_elapsed_results.size() == m_num_evals) {
             return false;
@@ -157,5 +226,6 @@ bool benchmark::State::UpdateTimer(const benchmark::time_point current_time)
     }
 
     m_num_iters_left = m_num_iters - 1;
+    if (m_counters) m_counters->Start();
     return true;
 }
@@ -5,6 +5,10 @@
 #ifndef PALLADIUM_BENCH_BENCH_H
 #define PALLADIUM_BENCH_BENCH_H
 
+#include <bench/cpu_counters.h>
+
+#include <univalue.h>
+
 #include <functional>
 #include <map>
 #include <string>
@@ -62,6 +66,10 @@ public:
     const uint64_t m_num_evals;
     std::vector<double> m_elapsed_results;
     time_point m_start_time;
+    //! Counters to read over each evaluation, if the printer reports them
+    CpuCounters* m_counters{nullptr};
+    //! Counts over each evaluation (all its iterations), next to m_elapsed_results
+    std::vector<CpuCounters::Values> m_counter_results;
 
     bool UpdateTimer(time_point finish_time);
 
@@ -107,6 +115,8 @@ public:
     virtual void header() = 0;
     virtual void result(const State& state) = 0;
     virtual void footer() = 0;
+    //! Whether the benchmarks should read the CPU counters for this printer
+    virtual bool wants_counters() const { return false; }
 };
 
 // default printer to console, shows min, max, median.
@@ -132,6 +142,23 @@ private:
     int64_t m_width;
     int64_t m_height;
 };
+
+// prints one JSON document with every sample and the CPU counters, for
+// contrib/devtools/bench_compare.py
+class JsonPrinter : public Printer
+{
+public:
+    void header() override;
+    void result(const State& state) override;
+    void footer() override;
+    bool wants_counters() const override { return true; }
+
+private:
+    UniValue m_results{UniValue::VARR};
+};
+
+//! Peak resident set size of the process in bytes, or 0 where unknown
+uint64_t GetPeakRSS();
 }
 
 
@@ -0,0 +1,272 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/block_replay.h>
+
+#include <bench/bench.h>
+#include <arith_uint256.h>
+#include <chainparams.h>
+#include <chainparamsbase.h>
+#include <clientversion.h>
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <fs.h>
+#include <primitives/block.h>
+#include <scheduler.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <txdb.h>
+#include <util/memory.h>
+#include <util/perfstats.h>
+#include <util/system.h>
+#include <util/time.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+
+namespace benchmark {
+namespace {
+
+/**
+ * Feeds block files to ProcessNewBlock. Block files hold blocks in the order
+ * they arrived, which after a headers-first sync is not quite the chain
+ * order, so blocks are held back until their parent has been processed.
+ */
+class BlockReplayer
+{
+public:
+    explicit BlockReplayer(const CChainParams& chainparams) : m_chainparams(chainparams) {}
+
+    bool ReplayFile(const fs::path& path);
+
+    uint64_t BlocksRead() const { return m_blocks_read; }
+    size_t BlocksPending() const { return m_pending.size(); }
+
+private:
+    void Process(const std::shared_ptr<const CBlock>& block);
+
+    const CChainParams& m_chainparams;
+    //! Blocks waiting for their parent, by the hash of the parent
+    std::multimap<uint256, std::shared_ptr<const CBlock>> m_pending;
+    uint64_t m_blocks_read{0};
+};
+
+bool BlockReplayer::ReplayFile(const fs::path& path)
+{
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        tfm::format(std::cerr, "Error opening block file %s\n", path.string());
+        return false;
+    }
+    while (true) {
+        CMessageHeader::MessageStartChars magic;
+        if (fread(magic, 1, sizeof(magic), filein.Get()) < sizeof(magic)) break;
+        if (memcmp(magic, m_chainparams.MessageStart(), sizeof(magic)) != 0) {
+            // Block files are preallocated, with zeros past the last block.
+            if (std::all_of(std::begin(magic), std::end(magic), [](unsigned char c) { return c == 0; })) break;
+            tfm::format(std::cerr, "Error in block file %s: no %s network magic at offset %d\n", path.string(), Params().NetworkIDString(), ftell(filein.Get()) - sizeof(magic));
+            return false;
+        }
+        std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+        try {
+            unsigned int size;
+            filein >> size;
+            if (size < 80 || size > MAX_BLOCK_SERIALIZED_SIZE) {
+                tfm::format(std::cerr, "Error in block file %s: block size %u out of range\n", path.string(), size);
+                return false;
+            }
+            filein >> *block;
+        } catch (const std::exception& e) {
+            tfm::format(std::cerr, "Error reading block file %s: %s\n", path.string(), e.what());
+            return false;
+        }
+        ++m_blocks_read;
+        Process(block);
+    }
+    return true;
+}
+
+void BlockReplayer::Process(const std::shared_ptr<const CBlock>& block)
+{
+    {
+        LOCK(cs_main);
+        // The genesis block, or a block that was stored twice
+        if (LookupBlockIndex(block->GetHash())) return;
+        if (!LookupBlockIndex(block->hashPrevBlock)) {
+            m_pending.emplace(block->hashPrevBlock, block);
+            return;
+        }
+    }
+    std::deque<std::shared_ptr<const CBlock>> queue{block};
+    while (!queue.empty()) {
+        const std::shared_ptr<const CBlock> next = queue.front();
+        queue.pop_front();
+        if (!ProcessNewBlock(m_chainparams, next, /* fForceProcessing */ true, /* fNewBlock */ nullptr)) {
+            tfm::format(std::cerr, "Block %s was not accepted\n", next->GetHash().ToString());
+            continue;
+        }
+        const auto children = m_pending.equal_range(next->GetHash());
+        for (auto it = children.first; it != children.second; ++it) {
+            queue.push_back(it->second);
+        }
+        m_pending.erase(children.first, children.second);
+    }
+}
+
+//! Start the validation worker threads as init.cpp does for -par and -prefetchthreads
+int StartValidationThreads(boost::thread_group& threads)
+{
+    int script_threads = gArgs.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
+    if (script_threads <= 0) script_threads += GetNumCores();
+    script_threads = std::min(std::max(script_threads - 1, 0), MAX_SCRIPTCHECK_THREADS);
+    if (script_threads >= 1) {
+        g_parallel_script_checks = true;
+        for (int i = 0; i < script_threads; ++i) {
+            threads.create_thread([i]() { return ThreadScriptCheck(i); });
+            threads.create_thread([i]() { return ThreadHeaderCheck(i); });
+            threads.create_thread([i]() { return ThreadTxCheck(i); });
+        }
+    }
+
+    const int prefetch_threads = std::max(0, std::min<int>(gArgs.GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS), MAX_PREFETCH_THREADS));
+    if (prefetch_threads >= 1) {
+        g_parallel_prefetch = true;
+        for (int i = 0; i < prefetch_threads; ++i) {
+            threads.create_thread([i]() { return ThreadPrefetchCheck(i); });
+        }
+    }
+
+    if (gArgs.GetBoolArg("-asyncblockfiles", DEFAULT_ASYNC_BLOCK_FILES)) StartBlockFileWorkers();
+    return script_threads;
+}
+
+std::string Seconds(int64_t micros)
+{
+    return strprintf("%.3f s", micros * 0.000001);
+}
+
+//! Replay the -replay files on the set up chainstate and print the figures
+bool Replay(boost::thread_group& threads)
+{
+    const int script_threads = StartValidationThreads(threads);
+    tfm::format(std::cout, "Replaying blocks on %s with %d MiB of dbcache and %d script verification threads\n", Params().NetworkIDString(), gArgs.GetArg("-dbcache", nDefaultDbCache), script_threads);
+
+    const perf::HistogramStats flushes_before = perf::GetHistogram("flushstate.coins").GetStats();
+    BlockReplayer replayer(Params());
+    const int64_t start = GetTimeMicros();
+    bool ok = true;
+    for (const std::string& file : gArgs.GetArgs("-replay")) {
+        if (!replayer.ReplayFile(fs::absolute(file))) {
+            ok = false;
+            break;
+        }
+    }
+    SyncWithValidationInterfaceQueue();
+    const int64_t replay_time = GetTimeMicros() - start;
+
+    const int64_t final_flush_start = GetTimeMicros();
+    ::ChainstateActive().ForceFlushStateToDisk();
+    const int64_t final_flush_time = GetTimeMicros() - final_flush_start;
+    const perf::HistogramStats flushes = perf::GetHistogram("flushstate.coins").GetStats();
+
+    int height;
+    uint64_t txs;
+    {
+        LOCK(cs_main);
+        height = ::ChainActive().Height();
+        txs = ::ChainActive().Tip()->nChainTx - 1; // without the genesis block
+    }
+    const double seconds = std::max<int64_t>(replay_time, 1) * 0.000001;
+    tfm::format(std::cout, "Blocks read:        %d (%d never connected to the chain)\n", replayer.BlocksRead(), replayer.BlocksPending());
+    tfm::format(std::cout, "Chain height:       %d\n", height);
+    tfm::format(std::cout, "Replay time:        %s\n", Seconds(replay_time));
+    tfm::format(std::cout, "Blocks per second:  %.1f\n", height / seconds);
+    tfm::format(std::cout, "Transactions per s: %.1f\n", txs / seconds);
+    tfm::format(std::cout, "Coins flushes:      %d taking %s, plus %s for the final flush\n", flushes.count - flushes_before.count, Seconds(flushes.total - flushes_before.total), Seconds(final_flush_time));
+    tfm::format(std::cout, "Peak RSS:           %.1f MiB\n", GetPeakRSS() / 1048576.0);
+    return ok;
+}
+
+} // namespace
+
+void SetupBlockReplayArgs()
+{
+    SetupChainParamsBaseOptions();
+
+    gArgs.AddArg("-replay=<file>", "Instead of running the benchmarks, replay the blocks of <file> (in the format of the blocks/blk?????.dat files of a node) through block validation on a temporary datadir and report the throughput. Can be specified multiple times, the files are replayed in order", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbcache=<n>", strprintf("With -replay: maximum database cache size <n> MiB (%d to %d, default: %d)", nMinDbCache, nMaxDbCache, nDefaultDbCache), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-par=<n>", strprintf("With -replay: number of script verification threads (%d to %d, 0 = auto, <0 = leave that many cores free, default: %d)", -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-prefetchthreads=<n>", strprintf("With -replay: number of block input prefetching threads (0 to %d, default: %d)", MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-asyncblockfiles", strprintf("With -replay: allocate and commit block files in the background (default: %u)", DEFAULT_ASYNC_BLOCK_FILES), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-assumevalid=<hex>", "With -replay: skip script verification for the ancestors of this block (default: the chain's default, 0 to verify all)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+}
+
+int RunBlockReplay()
+{
+    std::string chain;
+    try {
+        chain = gArgs.GetChainName();
+    } catch (const std::exception& e) {
+        tfm::format(std::cerr, "Error: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    BasicTestingSetup setup{chain};
+    // The test setup turns on the block index consistency checks, nodes don't.
+    fCheckBlockIndex = false;
+    const CChainParams& chainparams = Params();
+    hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
+    nMinimumChainWork = UintToArith256(chainparams.GetConsensus().nMinimumChainWork);
+
+    // Split -dbcache like init.cpp does, without the optional indexes.
+    int64_t total_cache = gArgs.GetArg("-dbcache", nDefaultDbCache) << 20;
+    total_cache = std::max(total_cache, nMinDbCache << 20);
+    total_cache = std::min(total_cache, nMaxDbCache << 20);
+    const int64_t block_tree_cache = std::min(total_cache / 8, nMaxBlockDBCache << 20);
+    total_cache -= block_tree_cache;
+    int64_t coin_db_cache = std::min(total_cache / 2, (total_cache / 4) + (1 << 23));
+    coin_db_cache = std::min(coin_db_cache, nMaxCoinsDBCache << 20);
+    total_cache -= coin_db_cache;
+    nCoinCacheUsage = total_cache;
+
+    CScheduler scheduler;
+    boost::thread_group threads;
+    threads.create_thread([&] { scheduler.serviceQueue(); });
+    GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
+
+    pblocktree.reset(new CBlockTreeDB(block_tree_cache, /* fMemory */ false, /* fWipe */ true));
+    g_chainstate = MakeUnique<CChainState>();
+    ::ChainstateActive().InitCoinsDB(coin_db_cache, /* in_memory */ false, /* should_wipe */ true);
+    ::ChainstateActive().InitCoinsCache();
+    BlockValidationState state;
+    bool ok = LoadGenesisBlock(chainparams) && ActivateBestChain(state, chainparams);
+    if (ok) {
+        ok = Replay(threads);
+    } else {
+        tfm::format(std::cerr, "Error setting up the chain: %s\n", state.ToString());
+    }
+
+    scheduler.stop();
+    threads.interrupt_all();
+    threads.join_all();
+    StopBlockFileWorkers();
+    g_parallel_script_checks = false;
+    g_parallel_prefetch = false;
+    GetMainSignals().FlushBackgroundCallbacks();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+    UnloadBlockIndex();
+    g_chainstate.reset();
+    pblocktree.reset();
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace benchmark
@@ -0,0 +1,23 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_BENCH_BLOCK_REPLAY_H
+#define PALLADIUM_BENCH_BLOCK_REPLAY_H
+
+namespace benchmark {
+
+/** Add the options of the -replay mode. */
+void SetupBlockReplayArgs();
+
+/**
+ * Replay the blocks of the -replay files (in the format of the blk?????.dat
+ * files in a node's blocks directory) through ProcessNewBlock on a fresh
+ * datadir, the way a node connects them during initial block download, and
+ * report the throughput. Returns the exit code.
+ */
+int RunBlockReplay();
+
+} // namespace benchmark
+
+#endif // PALLADIUM_BENCH_BLOCK_REPLAY_H
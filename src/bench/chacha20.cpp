@@ -13,6 +13,7 @@ static const uint64_t BUFFER_SIZE_LARGE = 1024*1024;
 
 static void CHACHA20(benchmark::State& state, size_t buffersize)
 {
+    ChaCha20AutoDetect();
     std::vector<uint8_t> key(32,0);
     ChaCha20 ctx(key.data(), key.size());
     ctx.SetIV(0);
@@ -39,6 +40,18 @@ static void CHACHA20_1MB(benchmark::State& state)
     CHACHA20(state, BUFFER_SIZE_LARGE);
 }
 
+static void CHACHA20_KEYSTREAM_1MB(benchmark::State& state)
+{
+    ChaCha20AutoDetect();
+    std::vector<uint8_t> key(32,0);
+    ChaCha20 ctx(key.data(), key.size());
+    std::vector<uint8_t> out(BUFFER_SIZE_LARGE,0);
+    while (state.KeepRunning()) {
+        ctx.Keystream(out.data(), out.size());
+    }
+}
+
 BENCHMARK(CHACHA20_64BYTES, 500000);
 BENCHMARK(CHACHA20_256BYTES, 250000);
 BENCHMARK(CHACHA20_1MB, 340);
+BENCHMARK(CHACHA20_KEYSTREAM_1MB, 340);
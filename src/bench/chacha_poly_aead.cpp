@@ -5,7 +5,8 @@
 
 #include <bench/bench.h>
 #include <crypto/chacha_poly_aead.h>
-#include <crypto/poly1305.h> // for the POLY1305_TAGLEN constant
+#include <crypto/chacha20.h>
+#include <crypto/poly1305.h>
 #include <hash.h>
 
 #include <limits>
@@ -23,6 +24,7 @@ static ChaCha20Poly1305AEAD aead(k1, 32, k2, 32);
 
 static void CHACHA20_POLY1305_AEAD(benchmark::State& state, size_t buffersize, bool include_decryption)
 {
+    ChaCha20AutoDetect();
     std::vector<unsigned char> in(buffersize + CHACHA20_POLY1305_AEAD_AAD_LEN + POLY1305_TAGLEN, 0);
     std::vector<unsigned char> out(buffersize + CHACHA20_POLY1305_AEAD_AAD_LEN + POLY1305_TAGLEN, 0);
     uint64_t seqnr_payload = 0;
@@ -111,6 +113,25 @@ static void HASH_1MB(benchmark::State& state)
     HASH(state, BUFFER_SIZE_LARGE);
 }
 
+static void POLY1305(benchmark::State& state, size_t buffersize)
+{
+    std::vector<unsigned char> in(buffersize, 0);
+    unsigned char tag[POLY1305_TAGLEN];
+    while (state.KeepRunning()) {
+        poly1305_auth(tag, in.data(), in.size(), k1);
+    }
+}
+
+static void POLY1305_64BYTES(benchmark::State& state)
+{
+    POLY1305(state, BUFFER_SIZE_TINY);
+}
+
+static void POLY1305_1MB(benchmark::State& state)
+{
+    POLY1305(state, BUFFER_SIZE_LARGE);
+}
+
 BENCHMARK(CHACHA20_POLY1305_AEAD_64BYTES_ONLY_ENCRYPT, 500000);
 BENCHMARK(CHACHA20_POLY1305_AEAD_256BYTES_ONLY_ENCRYPT, 250000);
 BENCHMARK(CHACHA20_POLY1305_AEAD_1MB_ONLY_ENCRYPT, 340);
@@ -120,3 +141,5 @@ BENCHMARK(CHACHA20_POLY1305_AEAD_1MB_ENCRYPT_DECRYPT, 340);
 BENCHMARK(HASH_64BYTES, 500000);
 BENCHMARK(HASH_256BYTES, 250000);
 BENCHMARK(HASH_1MB, 340);
+BENCHMARK(POLY1305_64BYTES, 500000);
+BENCHMARK(POLY1305_1MB, 340);
@@ -17,33 +17,37 @@ static const size_t BATCH_SIZE = 30;
 static const int PREVECTOR_SIZE = 28;
 static const unsigned int QUEUE_BATCH_SIZE = 128;
 
+namespace {
+struct PrevectorJob {
+    prevector<PREVECTOR_SIZE, uint8_t> p;
+    PrevectorJob(){
+    }
+    explicit PrevectorJob(FastRandomContext& insecure_rand){
+        p.resize(insecure_rand.randrange(PREVECTOR_SIZE*2));
+    }
+    bool operator()()
+    {
+        return true;
+    }
+    void swap(PrevectorJob& x){p.swap(x.p);};
+};
+} // namespace
+
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
 // and there is a little bit of work done between calls to Add.
-static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+template <typename Queue>
+static void CheckQueueSpeedPrevectorJob(benchmark::State& state, int threads)
 {
-    struct PrevectorJob {
-        prevector<PREVECTOR_SIZE, uint8_t> p;
-        PrevectorJob(){
-        }
-        explicit PrevectorJob(FastRandomContext& insecure_rand){
-            p.resize(insecure_rand.randrange(PREVECTOR_SIZE*2));
-        }
-        bool operator()()
-        {
-            return true;
-        }
-        void swap(PrevectorJob& x){p.swap(x.p);};
-    };
-    CCheckQueue<PrevectorJob> queue {QUEUE_BATCH_SIZE};
+    Queue queue {QUEUE_BATCH_SIZE};
     boost::thread_group tg;
-    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+    for (auto x = 0; x < threads; ++x) {
        tg.create_thread([&]{queue.Thread();});
     }
     while (state.KeepRunning()) {
         // Make insecure_rand here so that each iteration is identical.
         FastRandomContext insecure_rand(true);
-        CCheckQueueControl<PrevectorJob> control(&queue);
+        CCheckQueueControl<PrevectorJob, Queue> control(&queue);
         std::vector<std::vector<PrevectorJob>> vBatches(BATCHES);
         for (auto& vChecks : vBatches) {
             vChecks.reserve(BATCH_SIZE);
@@ -58,4 +62,25 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.interrupt_all();
     tg.join_all();
 }
+
+static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
+{
+    CheckQueueSpeedPrevectorJob<CCheckQueue<PrevectorJob>>(state, std::max(MIN_CORES, GetNumCores()));
+}
+
+// Fixed thread counts, to compare the two queue implementations as
+// contention grows.
+static void CCheckQueueSpeedPrevectorJob4(benchmark::State& state) { CheckQueueSpeedPrevectorJob<CCheckQueue<PrevectorJob>>(state, 4); }
+static void CCheckQueueSpeedPrevectorJob16(benchmark::State& state) { CheckQueueSpeedPrevectorJob<CCheckQueue<PrevectorJob>>(state, 16); }
+static void CCheckQueueSpeedPrevectorJob32(benchmark::State& state) { CheckQueueSpeedPrevectorJob<CCheckQueue<PrevectorJob>>(state, 32); }
+static void WorkStealingCheckQueueSpeedPrevectorJob4(benchmark::State& state) { CheckQueueSpeedPrevectorJob<CWorkStealingCheckQueue<PrevectorJob>>(state, 4); }
+static void WorkStealingCheckQueueSpeedPrevectorJob16(benchmark::State& state) { CheckQueueSpeedPrevectorJob<CWorkStealingCheckQueue<PrevectorJob>>(state, 16); }
+static void WorkStealingCheckQueueSpeedPrevectorJob32(benchmark::State& state) { CheckQueueSpeedPrevectorJob<CWorkStealingCheckQueue<PrevectorJob>>(state, 32); }
+
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob4, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob16, 1400);
+BENCHMARK(CCheckQueueSpeedPrevectorJob32, 1400);
+BENCHMARK(WorkStealingCheckQueueSpeedPrevectorJob4, 1400);
+BENCHMARK(WorkStealingCheckQueueSpeedPrevectorJob16, 1400);
+BENCHMARK(WorkStealingCheckQueueSpeedPrevectorJob32, 1400);
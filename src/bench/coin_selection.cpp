@@ -62,6 +62,49 @@ static void CoinSelection(benchmark::State& state)
     }
 }
 
+// Coin selection for a wallet with hundreds of thousands of small UTXOs and a
+// few that are too large for a changeless solution, which BnB has to search
+// until it runs out of tries.
+static void CoinSelectionLargeWallet(benchmark::State& state)
+{
+    NodeContext node;
+    auto chain = interfaces::MakeChain(node);
+    CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+    wallet.SetupLegacyScriptPubKeyMan();
+    std::vector<std::unique_ptr<CWalletTx>> wtxs;
+    LOCK(wallet.cs_wallet);
+
+    // Add coins.
+    for (int i = 0; i < 300000; ++i) {
+        addCoin(1000 + (i * 7919) % 1000000, wallet, wtxs);
+    }
+    for (int i = 0; i < 100; ++i) {
+        addCoin(1000 * COIN, wallet, wtxs);
+    }
+    addCoin(1 * COIN, wallet, wtxs);
+
+    // Create groups, sorted by value as SelectCoins does
+    std::vector<OutputGroup> groups;
+    for (const auto& wtx : wtxs) {
+        COutput output(wtx.get(), 0 /* iIn */, 6 * 24 /* nDepthIn */, true /* spendable */, true /* solvable */, true /* safe */);
+        groups.emplace_back(output.GetInputCoin(), 6, false, 0, 0);
+    }
+    std::sort(groups.begin(), groups.end(), [](const OutputGroup& a, const OutputGroup& b) {
+        return a.m_value > b.m_value;
+    });
+
+    const CoinEligibilityFilter filter_standard(1, 6, 0);
+    const CoinSelectionParams coin_selection_params(true, 34, 148, CFeeRate(0), 0);
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool bnb_used;
+        bool success = wallet.SelectCoinsMinConf(1 * COIN, filter_standard, groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used);
+        assert(success);
+        assert(nValueRet == 1 * COIN);
+    }
+}
+
 typedef std::set<CInputCoin> CoinSet;
 static NodeContext testNode;
 static auto testChain = interfaces::MakeChain(testNode);
@@ -112,4 +155,5 @@ static void BnBExhaustion(benchmark::State& state)
 }
 
 BENCHMARK(CoinSelection, 650);
+BENCHMARK(CoinSelectionLargeWallet, 2);
 BENCHMARK(BnBExhaustion, 650);
@@ -0,0 +1,103 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/palladium-config.h>
+#endif
+
+#include <bench/cpu_counters.h>
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <string.h>
+#endif
+
+namespace benchmark {
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+static int OpenCounter(uint64_t config)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    const long fd = syscall(__NR_perf_event_open, &attr, /* pid: this thread */ 0, /* cpu: any */ -1, /* group_fd */ -1, 0);
+    return fd < 0 ? -1 : static_cast<int>(fd);
+}
+#endif
+
+CpuCounters::CpuCounters()
+{
+    m_fds.fill(-1);
+#ifdef HAVE_LINUX_PERF_EVENT_H
+    m_fds[CYCLES] = OpenCounter(PERF_COUNT_HW_CPU_CYCLES);
+    m_fds[INSTRUCTIONS] = OpenCounter(PERF_COUNT_HW_INSTRUCTIONS);
+    m_fds[CACHE_MISSES] = OpenCounter(PERF_COUNT_HW_CACHE_MISSES);
+#endif
+}
+
+CpuCounters::~CpuCounters()
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+    for (int fd : m_fds) {
+        if (fd != -1) close(fd);
+    }
+#endif
+}
+
+const char* CpuCounters::Name(Counter counter)
+{
+    switch (counter) {
+    case CYCLES: return "cycles";
+    case INSTRUCTIONS: return "instructions";
+    case CACHE_MISSES: return "cache_misses";
+    case NUM_COUNTERS: break;
+    }
+    return "";
+}
+
+bool CpuCounters::AnyAvailable() const
+{
+    for (int fd : m_fds) {
+        if (fd != -1) return true;
+    }
+    return false;
+}
+
+void CpuCounters::Start()
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+    for (int fd : m_fds) {
+        if (fd == -1) continue;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+}
+
+CpuCounters::Values CpuCounters::Stop()
+{
+    Values values;
+    values.fill(0);
+#ifdef HAVE_LINUX_PERF_EVENT_H
+    for (int fd : m_fds) {
+        if (fd != -1) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    for (size_t i = 0; i < m_fds.size(); ++i) {
+        uint64_t count;
+        if (m_fds[i] != -1 && read(m_fds[i], &count, sizeof(count)) == sizeof(count)) values[i] = count;
+    }
+#endif
+    return values;
+}
+
+} // namespace benchmark
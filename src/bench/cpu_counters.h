@@ -0,0 +1,50 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_BENCH_CPU_COUNTERS_H
+#define PALLADIUM_BENCH_CPU_COUNTERS_H
+
+#include <array>
+#include <stdint.h>
+
+namespace benchmark {
+
+/**
+ * Hardware event counters of the calling thread, read through perf_event on
+ * Linux. Counters the kernel or the CPU do not provide (other platforms,
+ * virtual machines, a restrictive perf_event_paranoid) are not available and
+ * read as zero. Threads the benchmark hands work to are not counted.
+ */
+class CpuCounters
+{
+public:
+    enum Counter {
+        CYCLES,
+        INSTRUCTIONS,
+        CACHE_MISSES,
+        NUM_COUNTERS,
+    };
+    using Values = std::array<uint64_t, NUM_COUNTERS>;
+
+    CpuCounters();
+    ~CpuCounters();
+    CpuCounters(const CpuCounters&) = delete;
+    CpuCounters& operator=(const CpuCounters&) = delete;
+
+    static const char* Name(Counter counter);
+    bool Available(Counter counter) const { return m_fds[counter] != -1; }
+    bool AnyAvailable() const;
+
+    //! Reset the counters and start counting.
+    void Start();
+    //! Stop counting and return the counts since Start().
+    Values Stop();
+
+private:
+    std::array<int, NUM_COUNTERS> m_fds;
+};
+
+} // namespace benchmark
+
+#endif // PALLADIUM_BENCH_CPU_COUNTERS_H
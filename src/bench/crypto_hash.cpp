@@ -58,6 +58,73 @@ static void SHA256D64_1024(benchmark::State& state)
     }
 }
 
+static void Hash160_33b_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(33 * 1024, 2);
+    std::vector<uint8_t> out(20 * 1024);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < 1024; ++i) {
+            CHash160().Write(in.data() + 33 * i, 33).Finalize(out.data() + 20 * i);
+        }
+    }
+}
+
+static void Hash160Many_1024(benchmark::State& state)
+{
+    RIPEMD160AutoDetect();
+    std::vector<uint8_t> in(33 * 1024, 2);
+    std::vector<uint8_t> out(20 * 1024);
+    while (state.KeepRunning()) {
+        Hash160Many(out.data(), in.data(), 1024);
+    }
+}
+
+static void SHA256D_250b_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(250 * 1024, 2);
+    std::vector<uint8_t> out(32 * 1024);
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 1024; ++i) {
+            CHash256().Write(in.data() + 250 * i, 250).Finalize(out.data() + 32 * i);
+        }
+    }
+}
+
+static void SHA256DMany_250b_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(250 * 1024, 2);
+    std::vector<uint8_t> out(32 * 1024);
+    std::vector<const unsigned char*> inputs(1024);
+    std::vector<size_t> sizes(1024, 250);
+    for (int i = 0; i < 1024; ++i) inputs[i] = in.data() + 250 * i;
+    while (state.KeepRunning()) {
+        SHA256DMany(out.data(), inputs.data(), sizes.data(), 1024);
+    }
+}
+
+static void BIP32Hash_1024(benchmark::State& state)
+{
+    ChainCode cc;
+    unsigned char data[32] = {0};
+    std::vector<uint8_t> out(64 * 1024);
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < 1024; ++i) {
+            BIP32Hash(cc, i, 2, data, out.data() + 64 * i);
+        }
+    }
+}
+
+static void BIP32HashMany_1024(benchmark::State& state)
+{
+    SHA512AutoDetect();
+    ChainCode cc;
+    unsigned char data[32] = {0};
+    std::vector<uint8_t> out(64 * 1024);
+    while (state.KeepRunning()) {
+        BIP32HashMany(cc, 0, 1024, 2, data, out.data());
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -75,6 +142,19 @@ static void SipHash_32b(benchmark::State& state)
     }
 }
 
+static void SipHash_32b_batch(benchmark::State& state)
+{
+    SipHashAutoDetect();
+    std::vector<uint256> x(1024);
+    std::vector<const uint256*> ptrs;
+    for (const uint256& v : x) ptrs.push_back(&v);
+    std::vector<uint64_t> out(x.size());
+    uint64_t k1 = 0;
+    while (state.KeepRunning()) {
+        SipHashUint256Batch(0, ++k1, ptrs.data(), out.data(), ptrs.size());
+    }
+}
+
 static void FastRandom_32bit(benchmark::State& state)
 {
     FastRandomContext rng(true);
@@ -98,6 +178,13 @@ BENCHMARK(SHA512, 330);
 
 BENCHMARK(SHA256_32b, 4700 * 1000);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
+BENCHMARK(SipHash_32b_batch, 40 * 1000);
 BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(Hash160_33b_1024, 1000);
+BENCHMARK(Hash160Many_1024, 2000);
+BENCHMARK(SHA256D_250b_1024, 200);
+BENCHMARK(SHA256DMany_250b_1024, 500);
+BENCHMARK(BIP32Hash_1024, 200);
+BENCHMARK(BIP32HashMany_1024, 500);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
@@ -39,5 +39,52 @@ static void MatchGCSFilter(benchmark::State& state)
     }
 }
 
+static void DecodeGCSFilter(benchmark::State& state)
+{
+    GCSFilter::ElementSet elements;
+    for (int i = 0; i < 10000; ++i) {
+        GCSFilter::Element element(32);
+        element[0] = static_cast<unsigned char>(i);
+        element[1] = static_cast<unsigned char>(i >> 8);
+        elements.insert(std::move(element));
+    }
+    GCSFilter filter({0, 0, 20, 1 << 20}, elements);
+
+    while (state.KeepRunning()) {
+        GCSFilter decoded(filter.GetParams(), filter.GetEncoded());
+    }
+}
+
+static void MatchAnyGCSFilters(benchmark::State& state)
+{
+    // A rescan of 100 blocks for 100 wallet scripts.
+    std::vector<GCSFilter> filters;
+    for (int f = 0; f < 100; ++f) {
+        GCSFilter::ElementSet elements;
+        for (int i = 0; i < 1000; ++i) {
+            GCSFilter::Element element(32);
+            element[0] = static_cast<unsigned char>(i);
+            element[1] = static_cast<unsigned char>(i >> 8);
+            elements.insert(std::move(element));
+        }
+        filters.emplace_back(GCSFilter::Params(f, 0, BASIC_FILTER_P, BASIC_FILTER_M), elements);
+    }
+    std::vector<const GCSFilter*> filter_ptrs;
+    for (const GCSFilter& filter : filters) filter_ptrs.push_back(&filter);
+
+    GCSFilter::ElementSet query;
+    for (int i = 0; i < 100; ++i) {
+        GCSFilter::Element element(32);
+        element[2] = static_cast<unsigned char>(i);
+        query.insert(std::move(element));
+    }
+
+    while (state.KeepRunning()) {
+        GCSFilter::MatchAny(filter_ptrs, query);
+    }
+}
+
 BENCHMARK(ConstructGCSFilter, 1000);
+BENCHMARK(DecodeGCSFilter, 1000);
 BENCHMARK(MatchGCSFilter, 50 * 1000);
+BENCHMARK(MatchAnyGCSFilters, 100);
@@ -0,0 +1,212 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <txdb.h>
+#include <validation.h>
+#include <versionbits.h>
+
+#include <cmath>
+#include <deque>
+#include <map>
+#include <vector>
+
+// Header and difficulty benchmarks. The header chains are generated rather
+// than recorded: mainnet headers past height 29000 cannot be mined here, so
+// the LWMA benchmarks run on a synthetic block index with mainnet consensus
+// parameters and two minute solvetimes, and the header validation benchmarks
+// on headers mined at regtest difficulty.
+
+namespace {
+
+//! Block index entries with their hashes, linked up like the node links them
+class IndexChain
+{
+public:
+    const CBlockIndex* Tip() const { return &m_entries.back(); }
+    const CBlockIndex& operator[](size_t height) const { return m_entries[height]; }
+    size_t size() const { return m_entries.size(); }
+
+    void Append(const CBlockHeader& header)
+    {
+        m_hashes.push_back(header.GetHash());
+        m_entries.emplace_back(header);
+        CBlockIndex& entry = m_entries.back();
+        entry.phashBlock = &m_hashes.back();
+        entry.nStatus = BLOCK_VALID_TREE;
+        if (m_entries.size() > 1) {
+            entry.pprev = &m_entries[m_entries.size() - 2];
+            entry.nHeight = entry.pprev->nHeight + 1;
+            entry.nChainWork = entry.pprev->nChainWork;
+        }
+        entry.nChainWork += GetBlockProof(entry);
+        entry.BuildSkip();
+    }
+
+    std::vector<const CBlockIndex*> Entries() const
+    {
+        std::vector<const CBlockIndex*> ret;
+        for (const CBlockIndex& entry : m_entries) ret.push_back(&entry);
+        return ret;
+    }
+
+private:
+    // Deques, so that the pointers between the entries stay valid
+    std::deque<uint256> m_hashes;
+    std::deque<CBlockIndex> m_entries;
+};
+
+/**
+ * A mainnet block index up to height 29000 + 4 * LWMA_WINDOW, with LWMA
+ * difficulty from height 29000 on. The first LWMA window keeps a stand-in
+ * mainnet difficulty, so that the targets that follow are not all capped at
+ * the proof of work limit.
+ */
+void MakeLwmaChain(IndexChain& chain, const Consensus::Params& params)
+{
+    const int64_t lwma_height = 29000;
+    FastRandomContext rng(/* deterministic */ true);
+    CBlockHeader header;
+    header.nVersion = VERSIONBITS_TOP_BITS;
+    header.nTime = 1577836800;
+    header.nBits = 0x1b0404cb;
+    for (int64_t height = 0; height < lwma_height + 4 * LWMA_WINDOW; ++height) {
+        if (height > 0) {
+            header.hashPrevBlock = chain.Tip()->GetBlockHash();
+            // Exponentially distributed solvetimes, two minutes on average once LWMA is in
+            const double solvetime = -std::log((rng.rand32() + 1.0) / 4294967296.0) * (height > lwma_height ? params.nPowTargetSpacingV2 : params.nPowTargetSpacing);
+            header.nTime += std::max<int64_t>(1, solvetime);
+            if (height > lwma_height + LWMA_WINDOW) header.nBits = LwmaCalculateNextWorkRequiredUncached(chain.Tip(), params);
+        }
+        header.hashMerkleRoot = rng.rand256();
+        chain.Append(header);
+    }
+}
+
+//! Headers on top of the regtest genesis block, each with valid proof of work
+void MineRegTestHeaders(IndexChain& chain, size_t count)
+{
+    // Regtest takes two hashes per header on average. It keeps the minimum
+    // difficulty without walking back through the chain if blocks are more
+    // than 20 minutes apart, and has no LWMA parameters, so stay below the
+    // heights where it would switch.
+    assert(count < 28900);
+    const Consensus::Params& params = Params().GetConsensus();
+    FastRandomContext rng(/* deterministic */ true);
+    chain.Append(Params().GenesisBlock());
+    for (size_t i = 0; i < count; ++i) {
+        CBlockHeader header;
+        header.nVersion = VERSIONBITS_TOP_BITS;
+        header.hashPrevBlock = chain.Tip()->GetBlockHash();
+        header.hashMerkleRoot = rng.rand256();
+        header.nTime = chain.Tip()->nTime + 2 * params.nPowTargetSpacing + 1;
+        header.nBits = GetNextWorkRequired(chain.Tip(), &header, params);
+        while (!CheckProofOfWork(header.GetHash(), header.nBits, params)) ++header.nNonce;
+        chain.Append(header);
+    }
+}
+
+} // namespace
+
+static void LwmaNextWork(benchmark::State& state, bool cached)
+{
+    const auto chainparams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainparams->GetConsensus();
+    IndexChain chain;
+    MakeLwmaChain(chain, params);
+
+    // Walk the tip up the chain one block at a time, as during header sync.
+    const size_t first = chain.size() - 2 * LWMA_WINDOW;
+    size_t height = first;
+    CBlockHeader header;
+    while (state.KeepRunning()) {
+        const CBlockIndex* tip = &chain[height];
+        header.nTime = tip->nTime + 120;
+        if (cached) {
+            GetNextWorkRequired(tip, &header, params);
+        } else {
+            LwmaCalculateNextWorkRequiredUncached(tip, params);
+        }
+        if (++height == chain.size()) height = first;
+    }
+    ResetLwmaCache();
+}
+
+static void LwmaNextWorkCached(benchmark::State& state) { LwmaNextWork(state, true); }
+static void LwmaNextWorkUncached(benchmark::State& state) { LwmaNextWork(state, false); }
+
+//! The checks CheckBlockHeader does: hash the header and check its proof of work
+static void HeaderCheckPoW(benchmark::State& state)
+{
+    IndexChain chain;
+    MineRegTestHeaders(chain, 2000);
+    std::vector<CBlockHeader> headers;
+    for (size_t height = 1; height < chain.size(); ++height) headers.push_back(chain[height].GetBlockHeader());
+    const Consensus::Params& params = Params().GetConsensus();
+
+    while (state.KeepRunning()) {
+        for (const CBlockHeader& header : headers) {
+            bool valid = CheckProofOfWork(header.GetHash(), header.nBits, params);
+            assert(valid);
+        }
+    }
+}
+
+//! Headers messages extending the chain
+static void HeaderProcessing(benchmark::State& state)
+{
+    const size_t batches = state.m_num_iters * state.m_num_evals;
+    const size_t batch_size = std::max<size_t>(1, std::min<size_t>(MAX_HEADERS_RESULTS, 28000 / batches));
+    IndexChain chain;
+    MineRegTestHeaders(chain, batches * batch_size);
+    std::vector<std::vector<CBlockHeader>> messages(batches);
+    for (size_t height = 1; height < chain.size(); ++height) {
+        messages[(height - 1) / batch_size].push_back(chain[height].GetBlockHeader());
+    }
+
+    // The test setup checks the whole block index after each header.
+    fCheckBlockIndex = false;
+    auto message = messages.begin();
+    while (state.KeepRunning()) {
+        BlockValidationState validation_state;
+        bool processed = ProcessNewBlockHeaders(*message++, validation_state, Params());
+        assert(processed);
+    }
+    fCheckBlockIndex = true;
+}
+
+//! Loading the block index entries from the block tree database
+static void BlockIndexLoad(benchmark::State& state)
+{
+    IndexChain chain;
+    MineRegTestHeaders(chain, 20000);
+    CBlockTreeDB blocktree(1 << 20, /* fMemory */ true);
+    bool written = blocktree.WriteBatchSync({}, 0, chain.Entries());
+    assert(written);
+
+    while (state.KeepRunning()) {
+        std::map<uint256, CBlockIndex> index;
+        const auto insert = [&index](const uint256& hash) -> CBlockIndex* {
+            if (hash.IsNull()) return nullptr;
+            const auto it = index.emplace(hash, CBlockIndex()).first;
+            it->second.phashBlock = &it->first;
+            return &it->second;
+        };
+        bool loaded = blocktree.LoadBlockIndexGuts(Params().GetConsensus(), insert);
+        assert(loaded && index.size() == chain.size());
+    }
+}
+
+BENCHMARK(LwmaNextWorkCached, 1000000);
+BENCHMARK(LwmaNextWorkUncached, 20000);
+BENCHMARK(HeaderCheckPoW, 500);
+BENCHMARK(HeaderProcessing, 50);
+BENCHMARK(BlockIndexLoad, 20);
@@ -0,0 +1,77 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <consensus/validation.h>
+#include <crypto/sha256.h>
+#include <index/blockfilterindex.h>
+#include <test/util/mining.h>
+#include <test/util/setup_common.h>
+#include <txmempool.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <vector>
+
+//! Mine a chain whose blocks have many outputs, so that building their filters takes some work.
+static void MineIndexSyncChain()
+{
+    const std::vector<unsigned char> op_true{OP_TRUE};
+    CScriptWitness witness;
+    witness.stack.push_back(op_true);
+
+    uint256 witness_program;
+    CSHA256().Write(&op_true[0], op_true.size()).Finalize(witness_program.begin());
+
+    const CScript SCRIPT_PUB{CScript(OP_0) << std::vector<unsigned char>{witness_program.begin(), witness_program.end()}};
+
+    constexpr size_t NUM_BLOCKS{200};
+    constexpr size_t OUTPUTS_PER_TX{1000};
+    std::vector<CTxIn> coinbases;
+    for (size_t b{0}; b < NUM_BLOCKS; ++b) {
+        coinbases.push_back(MineBlock(g_testing_setup->m_node, SCRIPT_PUB));
+    }
+    // Spend each mature coinbase to many distinct scripts, and mine one such transaction per block.
+    for (size_t b{0}; b + COINBASE_MATURITY < NUM_BLOCKS; ++b) {
+        CMutableTransaction tx;
+        tx.vin.push_back(coinbases[b]);
+        tx.vin.back().scriptWitness = witness;
+        for (size_t i{0}; i < OUTPUTS_PER_TX; ++i) {
+            const uint64_t n{b * OUTPUTS_PER_TX + i};
+            uint256 program;
+            CSHA256().Write(reinterpret_cast<const unsigned char*>(&n), sizeof(n)).Finalize(program.begin());
+            tx.vout.emplace_back(1337, CScript(OP_0) << std::vector<unsigned char>{program.begin(), program.begin() + 20});
+        }
+        {
+            LOCK(::cs_main); // Required for ::AcceptToMemoryPool.
+            TxValidationState state;
+            bool ret{::AcceptToMemoryPool(::mempool, state, MakeTransactionRef(tx), nullptr /* plTxnReplaced */, false /* bypass_limits */, /* nAbsurdFee */ 0)};
+            assert(ret);
+        }
+        MineBlock(g_testing_setup->m_node, SCRIPT_PUB);
+    }
+}
+
+static void IndexSync(benchmark::State& state, int sync_threads)
+{
+    MineIndexSyncChain();
+    g_index_sync_threads = sync_threads;
+
+    while (state.KeepRunning()) {
+        BlockFilterIndex index(BlockFilterType::BASIC, 1 << 20, /* f_memory */ true, /* f_wipe */ true);
+        index.Start();
+        while (!index.BlockUntilSyncedToCurrentChain()) {
+            UninterruptibleSleep(std::chrono::milliseconds{1});
+        }
+        index.Stop();
+    }
+
+    g_index_sync_threads = DEFAULT_INDEX_SYNC_THREADS;
+}
+
+static void IndexSyncSequential(benchmark::State& state) { IndexSync(state, 0); }
+static void IndexSyncParallel(benchmark::State& state) { IndexSync(state, 4); }
+
+BENCHMARK(IndexSyncSequential, 10);
+BENCHMARK(IndexSyncParallel, 10);
@@ -84,4 +84,53 @@ static void ComplexMemPool(benchmark::State& state)
     }
 }
 
+/** Replace chains of unconfirmed transactions, as a flood of RBF bumps does. */
+static void MempoolConflicts(benchmark::State& state)
+{
+    FastRandomContext det_rand{true};
+    std::vector<CTransactionRef> ordered_txs;
+    std::vector<CTransactionRef> replacements;
+    for (uint32_t x = 0; x < 200; ++x) {
+        // A funding transaction with several children, each with a child of its own
+        CMutableTransaction funding;
+        funding.vin.resize(1);
+        funding.vin[0].prevout = COutPoint(det_rand.rand256(), 0);
+        funding.vout.resize(5);
+        for (auto& out : funding.vout) {
+            out.scriptPubKey = CScript() << CScriptNum(x) << OP_EQUAL;
+            out.nValue = 10 * COIN;
+        }
+        ordered_txs.emplace_back(MakeTransactionRef(funding));
+        const uint256 funding_hash = ordered_txs.back()->GetHash();
+        for (uint32_t n = 0; n < funding.vout.size(); ++n) {
+            CMutableTransaction child;
+            child.vin.emplace_back(COutPoint(funding_hash, n));
+            child.vout.emplace_back(9 * COIN, CScript() << CScriptNum(x) << OP_EQUAL);
+            ordered_txs.emplace_back(MakeTransactionRef(child));
+            CMutableTransaction grandchild;
+            grandchild.vin.emplace_back(COutPoint(ordered_txs.back()->GetHash(), 0));
+            grandchild.vout.emplace_back(8 * COIN, CScript() << CScriptNum(x) << OP_EQUAL);
+            ordered_txs.emplace_back(MakeTransactionRef(grandchild));
+        }
+        // The replacement double-spends the funding transaction's input
+        CMutableTransaction replacement;
+        replacement.vin.emplace_back(funding.vin[0].prevout);
+        replacement.vout.emplace_back(9 * COIN, CScript() << OP_TRUE);
+        replacements.emplace_back(MakeTransactionRef(replacement));
+    }
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    while (state.KeepRunning()) {
+        for (auto& tx : ordered_txs) {
+            AddTx(tx, pool);
+        }
+        for (const auto& tx : replacements) {
+            assert(pool.GetConflictTx(tx->vin[0].prevout));
+            pool.removeConflicts(*tx);
+        }
+        assert(pool.size() == 0);
+    }
+}
+
 BENCHMARK(ComplexMemPool, 1);
+BENCHMARK(MempoolConflicts, 10);
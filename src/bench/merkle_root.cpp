@@ -7,6 +7,7 @@
 #include <uint256.h>
 #include <random.h>
 #include <consensus/merkle.h>
+#include <node/merkle.h>
 
 static void MerkleRoot(benchmark::State& state)
 {
@@ -23,4 +24,20 @@ static void MerkleRoot(benchmark::State& state)
     }
 }
 
+static void MerkleRootParallel(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    std::vector<uint256> leaves;
+    leaves.resize(9001);
+    for (auto& item : leaves) {
+        item = rng.rand256();
+    }
+    while (state.KeepRunning()) {
+        bool mutation = false;
+        uint256 hash = ParallelMerkleRoot(std::vector<uint256>(leaves), &mutation);
+        leaves[mutation] = hash;
+    }
+}
+
 BENCHMARK(MerkleRoot, 800);
+BENCHMARK(MerkleRootParallel, 800);
@@ -0,0 +1,431 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/net_load.h>
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <net.h>
+#include <net_processing.h>
+#include <netbase.h>
+#include <netmessagemaker.h>
+#include <node/context.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <protocol.h>
+#include <random.h>
+#include <scheduler.h>
+#include <script/script.h>
+#include <test/util/mining.h>
+#include <test/util/net.h>
+#include <test/util/setup_common.h>
+#include <util/perfstats.h>
+#include <util/system.h>
+#include <util/time.h>
+#include <validation.h>
+#include <version.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifndef WIN32
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// The socket pairs stand in for TCP connections: the node side is a CNode
+// served by the real socket handler and message handler threads, the other
+// side is driven from one thread here. Every peer runs rounds of an inv
+// with INVS_PER_ROUND transaction announcements, an orphan transaction, a
+// getdata for an unknown transaction, a headers message with the tip and a
+// ping, one round in flight at a time. The round latency runs from sending
+// the inv to receiving the pong, which the node sends once it processed the
+// whole round. Peers answer the node's getdata requests with notfound.
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0
+#endif
+
+static const int64_t DEFAULT_NETLOAD_TIME = 10;
+//! Transaction announcements per round, about what a busy peer sends in a few seconds
+static constexpr int INVS_PER_ROUND = 35;
+static constexpr int MESSAGES_PER_ROUND = 5;
+//! Give up if the node does not answer for this long
+static constexpr int64_t NETLOAD_TIMEOUT = 60 * 1000000;
+
+namespace benchmark {
+
+#ifndef WIN32
+namespace {
+
+/** Our end of the connection of a simulated peer */
+struct LoadPeer {
+    explicit LoadPeer(int socket) : m_socket(socket) {}
+    ~LoadPeer() { close(m_socket); }
+
+    const int m_socket;
+    V1TransportDeserializer m_deserializer{Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION};
+    std::vector<unsigned char> m_send_buffer;
+    size_t m_send_offset{0};
+    //! Whether the node has sent its verack
+    bool m_connected{false};
+    bool m_in_round{false};
+    uint64_t m_ping_nonce{0};
+    int64_t m_round_start{0};
+    //! Rounds finished in the current Run()
+    uint64_t m_rounds{0};
+};
+
+class NetLoad
+{
+public:
+    NetLoad(const NodeContext& node, size_t peers, CConnman::Options options);
+    ~NetLoad();
+
+    //! Connect the peers and complete their version handshakes
+    bool Connect();
+    //! Run up to max_rounds rounds (0 for no limit) on every peer, starting none after the deadline
+    bool Run(uint64_t max_rounds, int64_t deadline);
+
+    uint64_t MessagesSent() const { return m_messages_sent; }
+    const std::vector<int64_t>& RoundLatencies() const { return m_round_latencies; }
+
+private:
+    bool Poll(const std::function<bool()>& done, int64_t timeout);
+    void Push(LoadPeer& peer, CSerializedNetMsg&& msg);
+    bool Flush(LoadPeer& peer);
+    bool Receive(LoadPeer& peer);
+    void Handle(LoadPeer& peer, CNetMessage& msg);
+    void StartRound(LoadPeer& peer);
+
+    const size_t m_num_peers;
+    CScheduler m_scheduler;
+    std::thread m_scheduler_thread;
+    ConnmanTestMsg m_connman{0x1337, 0x1337};
+    PeerLogicValidation m_peer_logic;
+    std::vector<std::unique_ptr<LoadPeer>> m_peers;
+    FastRandomContext m_rng{/* deterministic */ true};
+    CBlock m_tip;
+
+    uint64_t m_max_rounds{0};
+    int64_t m_deadline{0};
+    uint64_t m_messages_sent{0};
+    std::vector<int64_t> m_round_latencies;
+};
+
+NetLoad::NetLoad(const NodeContext& node, size_t peers, CConnman::Options options)
+    : m_num_peers(peers), m_peer_logic(&m_connman, node.banman.get(), m_scheduler, *node.mempool)
+{
+    // net_processing ignores transaction announcements during initial block download.
+    MineBlock(node, CScript() << OP_TRUE);
+    {
+        LOCK(cs_main);
+        m_tip = ::ChainActive().Tip()->GetBlockHeader();
+    }
+
+    m_scheduler_thread = std::thread([this] { m_scheduler.serviceQueue(); });
+    // Do not bind the default port.
+    fListen = false;
+    options.nLocalServices = ServiceFlags(NODE_NETWORK | NODE_WITNESS);
+    options.nMaxConnections = std::max<int>(peers, DEFAULT_MAX_PEER_CONNECTIONS);
+    options.m_msgproc = &m_peer_logic;
+    options.m_banman = node.banman.get();
+    options.nSendBufferMaxSize = 1000 * DEFAULT_MAXSENDBUFFER;
+    options.nReceiveFloodSize = 1000 * DEFAULT_MAXRECEIVEBUFFER;
+    options.m_use_addrman_outgoing = false;
+    m_connman.Start(m_scheduler, options);
+}
+
+NetLoad::~NetLoad()
+{
+    m_connman.Interrupt();
+    m_connman.Stop();
+    m_scheduler.stop();
+    m_scheduler_thread.join();
+}
+
+bool NetLoad::Connect()
+{
+    for (size_t i = 0; i < m_num_peers; ++i) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            tfm::format(std::cerr, "Error creating socket pair %d: %s\n", i, NetworkErrorString(errno));
+            return false;
+        }
+        SetSocketNonBlocking(fds[0], true);
+        SetSocketNonBlocking(fds[1], true);
+        // Distinct addresses in distinct network groups, like peers from all over
+        struct in_addr ip;
+        ip.s_addr = htonl(0x0b000001 + (i << 8));
+        m_connman.AddInboundTestPeer(fds[0], CAddress(CService(CNetAddr(ip), Params().GetDefaultPort()), NODE_NONE));
+        m_peers.push_back(MakeUnique<LoadPeer>(fds[1]));
+
+        const CAddress addr_you(CService(), NODE_NONE);
+        const CAddress addr_me(CService(), ServiceFlags(NODE_NETWORK | NODE_WITNESS));
+        Push(*m_peers.back(), CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERSION, PROTOCOL_VERSION, uint64_t(NODE_NETWORK | NODE_WITNESS), GetTime(), addr_you, addr_me, m_rng.rand64(), std::string("/netload/"), 0, true));
+    }
+    return Poll([this] {
+        return std::all_of(m_peers.begin(), m_peers.end(), [](const std::unique_ptr<LoadPeer>& peer) { return peer->m_connected; });
+    }, GetTimeMicros() + NETLOAD_TIMEOUT);
+}
+
+bool NetLoad::Run(uint64_t max_rounds, int64_t deadline)
+{
+    m_max_rounds = max_rounds;
+    m_deadline = deadline;
+    for (const auto& peer : m_peers) {
+        peer->m_rounds = 0;
+        StartRound(*peer);
+    }
+    return Poll([this] {
+        return std::none_of(m_peers.begin(), m_peers.end(), [](const std::unique_ptr<LoadPeer>& peer) { return peer->m_in_round; });
+    }, deadline + NETLOAD_TIMEOUT);
+}
+
+bool NetLoad::Poll(const std::function<bool()>& done, int64_t timeout)
+{
+    std::vector<struct pollfd> fds(m_peers.size());
+    while (!done()) {
+        if (GetTimeMicros() > timeout) {
+            tfm::format(std::cerr, "Error: the node stopped answering\n");
+            return false;
+        }
+        for (size_t i = 0; i < m_peers.size(); ++i) {
+            fds[i].fd = m_peers[i]->m_socket;
+            fds[i].events = POLLIN | (m_peers[i]->m_send_buffer.empty() ? 0 : POLLOUT);
+            fds[i].revents = 0;
+        }
+        if (poll(fds.data(), fds.size(), 100) < 0 && errno != EINTR) {
+            tfm::format(std::cerr, "Error polling the peer sockets: %s\n", NetworkErrorString(errno));
+            return false;
+        }
+        for (size_t i = 0; i < m_peers.size(); ++i) {
+            if ((fds[i].revents & POLLOUT) && !Flush(*m_peers[i])) return false;
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !Receive(*m_peers[i])) return false;
+        }
+    }
+    return true;
+}
+
+void NetLoad::Push(LoadPeer& peer, CSerializedNetMsg&& msg)
+{
+    std::vector<unsigned char> header;
+    V1TransportSerializer().prepareForTransport(msg, header);
+    const Span<const unsigned char> payload = msg.Payload();
+    peer.m_send_buffer.insert(peer.m_send_buffer.end(), header.begin(), header.end());
+    peer.m_send_buffer.insert(peer.m_send_buffer.end(), payload.begin(), payload.end());
+}
+
+bool NetLoad::Flush(LoadPeer& peer)
+{
+    while (peer.m_send_offset < peer.m_send_buffer.size()) {
+        const ssize_t sent = send(peer.m_socket, peer.m_send_buffer.data() + peer.m_send_offset, peer.m_send_buffer.size() - peer.m_send_offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            tfm::format(std::cerr, "Error sending to the node: %s\n", NetworkErrorString(errno));
+            return false;
+        }
+        peer.m_send_offset += sent;
+    }
+    peer.m_send_buffer.clear();
+    peer.m_send_offset = 0;
+    return true;
+}
+
+bool NetLoad::Receive(LoadPeer& peer)
+{
+    char buf[0x10000];
+    const ssize_t received = recv(peer.m_socket, buf, sizeof(buf), MSG_DONTWAIT);
+    if (received == 0) {
+        tfm::format(std::cerr, "Error: the node disconnected a peer\n");
+        return false;
+    }
+    if (received < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+        tfm::format(std::cerr, "Error receiving from the node: %s\n", NetworkErrorString(errno));
+        return false;
+    }
+    const char* pch = buf;
+    unsigned int bytes = received;
+    while (bytes > 0) {
+        const int handled = peer.m_deserializer.Read(pch, bytes);
+        if (handled < 0) {
+            tfm::format(std::cerr, "Error: the node sent an oversized message\n");
+            return false;
+        }
+        pch += handled;
+        bytes -= handled;
+        if (peer.m_deserializer.Complete()) {
+            CNetMessage msg = peer.m_deserializer.GetMessage(Params().MessageStart(), GetTimeMicros());
+            Handle(peer, msg);
+        }
+    }
+    return Flush(peer);
+}
+
+void NetLoad::Handle(LoadPeer& peer, CNetMessage& msg)
+{
+    const CNetMsgMaker msg_maker(PROTOCOL_VERSION);
+    if (msg.m_command == NetMsgType::VERSION) {
+        Push(peer, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERACK));
+    } else if (msg.m_command == NetMsgType::VERACK) {
+        peer.m_connected = true;
+    } else if (msg.m_command == NetMsgType::PING) {
+        uint64_t nonce;
+        msg.m_recv >> nonce;
+        Push(peer, msg_maker.Make(NetMsgType::PONG, nonce));
+    } else if (msg.m_command == NetMsgType::GETDATA) {
+        std::vector<CInv> invs;
+        msg.m_recv >> invs;
+        Push(peer, msg_maker.Make(NetMsgType::NOTFOUND, invs));
+    } else if (msg.m_command == NetMsgType::PONG) {
+        uint64_t nonce;
+        msg.m_recv >> nonce;
+        if (!peer.m_in_round || nonce != peer.m_ping_nonce) return;
+        m_round_latencies.push_back(msg.m_time - peer.m_round_start);
+        peer.m_in_round = false;
+        ++peer.m_rounds;
+        if ((m_max_rounds == 0 || peer.m_rounds < m_max_rounds) && msg.m_time < m_deadline) StartRound(peer);
+    }
+}
+
+void NetLoad::StartRound(LoadPeer& peer)
+{
+    const CNetMsgMaker msg_maker(PROTOCOL_VERSION);
+    peer.m_round_start = GetTimeMicros();
+
+    std::vector<CInv> invs;
+    for (int i = 0; i < INVS_PER_ROUND; ++i) invs.emplace_back(MSG_TX, m_rng.rand256());
+    Push(peer, msg_maker.Make(NetMsgType::INV, invs));
+
+    // A standard transaction whose input is unknown, so it ends up in the orphan pool
+    CMutableTransaction tx;
+    tx.vin.emplace_back(COutPoint(m_rng.rand256(), 0));
+    for (int i = 0; i < 2; ++i) {
+        const uint256 program = m_rng.rand256();
+        tx.vout.emplace_back(10000, CScript() << OP_0 << std::vector<unsigned char>(program.begin(), program.begin() + 20));
+    }
+    Push(peer, msg_maker.Make(NetMsgType::TX, CTransaction(tx)));
+
+    Push(peer, msg_maker.Make(NetMsgType::GETDATA, std::vector<CInv>{CInv(MSG_TX, m_rng.rand256())}));
+    Push(peer, msg_maker.Make(NetMsgType::HEADERS, std::vector<CBlock>{m_tip}));
+    peer.m_ping_nonce = m_rng.rand64();
+    Push(peer, msg_maker.Make(NetMsgType::PING, peer.m_ping_nonce));
+    peer.m_in_round = true;
+    m_messages_sent += MESSAGES_PER_ROUND;
+    Flush(peer);
+}
+
+std::string Millis(int64_t micros)
+{
+    return strprintf("%.3f ms", micros * 0.001);
+}
+
+//! Handling time of the network messages of one type since before
+std::string HandlerTimes(const std::string& msg_type, const perf::HistogramStats& before)
+{
+    perf::HistogramStats stats = perf::GetHistogram("msg." + msg_type).GetStats();
+    stats.count -= before.count;
+    stats.total -= before.total;
+    for (size_t bucket = 0; bucket < stats.buckets.size(); ++bucket) stats.buckets[bucket] -= before.buckets[bucket];
+    return strprintf("%-8s %9d messages, mean %s, p50 < %s, p99 < %s", msg_type, stats.count, Millis(stats.count ? stats.total / int64_t(stats.count) : 0), Millis(stats.ApproxQuantile(0.5)), Millis(stats.ApproxQuantile(0.99)));
+}
+
+int64_t Percentile(const std::vector<int64_t>& sorted, double q)
+{
+    return sorted.empty() ? 0 : sorted[std::min<size_t>(sorted.size() - 1, q * sorted.size())];
+}
+
+} // namespace
+#endif // WIN32
+
+void SetupNetLoadArgs()
+{
+    gArgs.AddArg("-netload=<n>", "Instead of running the benchmarks, connect <n> in-process peers to a node over socket pairs, have them flood it with inv, tx, getdata and headers messages and report the throughput", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-netloadtime=<n>", strprintf("With -netload: seconds to send messages for (default: %d)", DEFAULT_NETLOAD_TIME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-netevents=<backend>", strprintf("With -netload: socket readiness notification backend to use, one of: %s (default: %s)", AvailableNetEventsModes(), NetEventsModeName(DEFAULT_NET_EVENTS)), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-msghandlerthreads=<n>", strprintf("With -netload: number of message handler worker threads (0 to %d, default: %d)", MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-sendcoalesce", strprintf("With -netload: send the messages generated for a peer in one go (default: %u)", DEFAULT_SEND_COALESCE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+}
+
+int RunNetLoad()
+{
+#ifdef WIN32
+    tfm::format(std::cerr, "Error: -netload needs socket pairs, which are not available on Windows\n");
+    return EXIT_FAILURE;
+#else
+    const int64_t peers = gArgs.GetArg("-netload", 0);
+    const int64_t seconds = gArgs.GetArg("-netloadtime", DEFAULT_NETLOAD_TIME);
+    if (peers < 1 || seconds < 1) {
+        tfm::format(std::cerr, "Error: -netload and -netloadtime must be positive\n");
+        return EXIT_FAILURE;
+    }
+    CConnman::Options options;
+    options.m_msghandler_threads = std::max(0, std::min<int>(gArgs.GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS), MAX_MSGHANDLER_THREADS));
+    options.m_send_coalesce = gArgs.GetBoolArg("-sendcoalesce", DEFAULT_SEND_COALESCE);
+    if (gArgs.IsArgSet("-netevents") && !ParseNetEventsMode(gArgs.GetArg("-netevents", ""), options.m_net_events)) {
+        tfm::format(std::cerr, "Error: unsupported -netevents backend. Available: %s\n", AvailableNetEventsModes());
+        return EXIT_FAILURE;
+    }
+    if (RaiseFileDescriptorLimit(2 * peers + 100) < 2 * peers + 100) {
+        tfm::format(std::cerr, "Error: not enough file descriptors for %d peers\n", peers);
+        return EXIT_FAILURE;
+    }
+
+    RegTestingSetup setup;
+    tfm::format(std::cout, "Loading the node with %d peers for %d s, using %s and %d message handler worker threads\n", peers, seconds, NetEventsModeName(options.m_net_events), options.m_msghandler_threads);
+
+    NetLoad load(setup.m_node, peers, options);
+    const uint64_t rss_before = GetPeakRSS();
+    int64_t start = GetTimeMicros();
+    if (!load.Connect()) return EXIT_FAILURE;
+    const int64_t connect_time = GetTimeMicros() - start;
+
+    static const std::vector<std::string> msg_types{NetMsgType::INV, NetMsgType::TX, NetMsgType::GETDATA, NetMsgType::HEADERS, NetMsgType::PING};
+    std::vector<perf::HistogramStats> handler_before;
+    for (const std::string& msg_type : msg_types) handler_before.push_back(perf::GetHistogram("msg." + msg_type).GetStats());
+    start = GetTimeMicros();
+    if (!load.Run(/* max_rounds */ 0, start + seconds * 1000000)) return EXIT_FAILURE;
+    const int64_t run_time = GetTimeMicros() - start;
+
+    std::vector<int64_t> latencies = load.RoundLatencies();
+    std::sort(latencies.begin(), latencies.end());
+    tfm::format(std::cout, "Handshakes:          %d peers in %s\n", peers, Millis(connect_time));
+    tfm::format(std::cout, "Rounds:              %d of %d messages\n", latencies.size(), MESSAGES_PER_ROUND);
+    tfm::format(std::cout, "Messages per second: %.1f\n", load.MessagesSent() / (std::max<int64_t>(run_time, 1) * 0.000001));
+    tfm::format(std::cout, "Round latency:       p50 %s, p90 %s, p99 %s, max %s\n", Millis(Percentile(latencies, 0.5)), Millis(Percentile(latencies, 0.9)), Millis(Percentile(latencies, 0.99)), Millis(latencies.empty() ? 0 : latencies.back()));
+    for (size_t i = 0; i < msg_types.size(); ++i) {
+        tfm::format(std::cout, "Handler time:        %s\n", HandlerTimes(msg_types[i], handler_before[i]));
+    }
+    const uint64_t rss_after = GetPeakRSS();
+    tfm::format(std::cout, "Peak RSS:            %.1f MiB, %.1f KiB per peer\n", rss_after / 1048576.0, (rss_after - std::min(rss_before, rss_after)) / 1024.0 / peers);
+    return EXIT_SUCCESS;
+#endif // WIN32
+}
+
+} // namespace benchmark
+
+#ifndef WIN32
+//! One round on each of a few peers, through the socket handler and message handler threads
+static void NetProcessingRounds(benchmark::State& state)
+{
+    benchmark::NetLoad load(g_testing_setup->m_node, 8, CConnman::Options());
+    bool connected = load.Connect();
+    assert(connected);
+    while (state.KeepRunning()) {
+        bool ok = load.Run(/* max_rounds */ 1, GetTimeMicros());
+        assert(ok);
+    }
+}
+
+BENCHMARK(NetProcessingRounds, 100);
+#endif // WIN32
@@ -0,0 +1,23 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_BENCH_NET_LOAD_H
+#define PALLADIUM_BENCH_NET_LOAD_H
+
+namespace benchmark {
+
+/** Add the options of the -netload mode. */
+void SetupNetLoadArgs();
+
+/**
+ * Connect -netload in-process peers to a running CConnman and
+ * PeerLogicValidation over socket pairs, have every peer flood inv, tx,
+ * getdata and headers messages for -netloadtime seconds, and report the
+ * message throughput, latency and memory figures. Returns the exit code.
+ */
+int RunNetLoad();
+
+} // namespace benchmark
+
+#endif // PALLADIUM_BENCH_NET_LOAD_H
@@ -0,0 +1,56 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <net.h>
+#include <netmessagemaker.h>
+#include <protocol.h>
+#include <util/memory.h>
+
+#ifndef WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+
+/** Messages queued per iteration, like a batch of pings, invs and headers from one SendMessages call. */
+static constexpr int MESSAGES_PER_BATCH = 100;
+
+static void SendSmallMessages(benchmark::State& state, bool corked)
+{
+    int fds[2];
+    int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    assert(ret == 0);
+
+    CConnman connman(0x1337, 0x1337);
+    CAddress addr(CService(), NODE_NONE);
+    // The node owns fds[0] and closes it.
+    auto node = MakeUnique<CNode>(0, NODE_NONE, 0, fds[0], addr, 0, 0, addr, "", /* fInboundIn */ false);
+    const CNetMsgMaker msg_maker(INIT_PROTO_VERSION);
+    std::vector<char> buf(1 << 16);
+
+    uint64_t nonce = 0;
+    while (state.KeepRunning()) {
+        if (corked) connman.CorkSend(node.get());
+        for (int i = 0; i < MESSAGES_PER_BATCH; ++i) {
+            connman.PushMessage(node.get(), msg_maker.Make(NetMsgType::PING, ++nonce));
+        }
+        if (corked) connman.UncorkSend(node.get());
+        // Drain the other end, so that the socket buffer never fills up.
+        while (recv(fds[1], buf.data(), buf.size(), MSG_DONTWAIT) > 0) {}
+    }
+    close(fds[1]);
+}
+
+static void NetSendSmallMessages(benchmark::State& state)
+{
+    SendSmallMessages(state, /* corked */ false);
+}
+
+static void NetSendSmallMessagesCorked(benchmark::State& state)
+{
+    SendSmallMessages(state, /* corked */ true);
+}
+
+BENCHMARK(NetSendSmallMessages, 500);
+BENCHMARK(NetSendSmallMessagesCorked, 500);
+#endif // WIN32
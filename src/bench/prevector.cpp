@@ -97,6 +97,25 @@ static void PrevectorDeserialize(benchmark::State& state)
     }
 }
 
+template <typename T>
+static void PrevectorScriptSizes(benchmark::State& state)
+{
+    // Heap storage of the sizes of P2WSH outputs (34 bytes), signature
+    // scripts (71) and 2-of-3 multisig redeem scripts (105), which the build
+    // with --enable-prevector-pool serves from its pool.
+    static const unsigned int sizes[] = {34, 71, 105};
+    while (state.KeepRunning()) {
+        std::vector<prevector<28, T>> scripts(300);
+        for (size_t i = 0; i < scripts.size(); ++i) {
+            scripts[i].resize(sizes[i % 3]);
+        }
+        for (size_t i = 0; i < scripts.size(); i += 2) {
+            scripts[i].clear();
+            scripts[i].shrink_to_fit();
+        }
+    }
+}
+
 #define PREVECTOR_TEST(name, nontrivops, trivops)                       \
     static void Prevector ## name ## Nontrivial(benchmark::State& state) { \
         Prevector ## name<nontrivial_t>(state);                         \
@@ -111,3 +130,4 @@ PREVECTOR_TEST(Clear, 28300, 88600)
 PREVECTOR_TEST(Destructor, 28800, 88900)
 PREVECTOR_TEST(Resize, 28900, 90300)
 PREVECTOR_TEST(Deserialize, 6800, 52000)
+PREVECTOR_TEST(ScriptSizes, 1000, 5000)
@@ -0,0 +1,44 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <util/strencodings.h>
+
+#include <string>
+#include <vector>
+
+/** About the size of a serialized transaction with a few inputs, as dumped by the RPCs. */
+static constexpr size_t HEX_BENCH_BYTES = 1000;
+
+static void HexStrBytes(benchmark::State& state)
+{
+    std::vector<unsigned char> data(HEX_BENCH_BYTES);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = i * 37;
+    while (state.KeepRunning()) {
+        HexStr(data);
+    }
+}
+
+static void ParseHexBytes(benchmark::State& state)
+{
+    std::vector<unsigned char> data(HEX_BENCH_BYTES);
+    for (size_t i = 0; i < data.size(); ++i) data[i] = i * 37;
+    const std::string hex = HexStr(data);
+    while (state.KeepRunning()) {
+        ParseHex(hex);
+    }
+}
+
+static void IsHexBytes(benchmark::State& state)
+{
+    const std::string hex(2 * HEX_BENCH_BYTES, 'a');
+    while (state.KeepRunning()) {
+        IsHex(hex);
+    }
+}
+
+BENCHMARK(HexStrBytes, 200 * 1000);
+BENCHMARK(ParseHexBytes, 50 * 1000);
+BENCHMARK(IsHexBytes, 200 * 1000);
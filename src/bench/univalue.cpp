@@ -0,0 +1,72 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/data.h>
+
+#include <chain.h>
+#include <primitives/block.h>
+#include <rpc/blockchain.h>
+#include <streams.h>
+#include <util/strencodings.h>
+#include <version.h>
+
+#include <univalue.h>
+
+#include <assert.h>
+
+// A submitblock request carrying a serialized block as hex, as parsed for
+// submitblock and sendrawtransaction calls.
+static void UniValueReadHexRequest(benchmark::State& state)
+{
+    const std::string request = "{\"jsonrpc\":\"1.0\",\"id\":\"bench\",\"method\":\"submitblock\",\"params\":[\"" +
+        HexStr(benchmark::data::block413567.begin(), benchmark::data::block413567.end()) + "\"]}";
+
+    while (state.KeepRunning()) {
+        UniValue val;
+        bool ok = val.read(request);
+        assert(ok);
+    }
+}
+
+static std::string VerboseBlockJSON()
+{
+    CDataStream stream(benchmark::data::block413567, SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+
+    CBlockIndex blockindex;
+    const uint256 blockHash = block.GetHash();
+    blockindex.phashBlock = &blockHash;
+    blockindex.nBits = 403014710;
+
+    return blockToJSON(block, &blockindex, &blockindex, /*verbose*/ true).write();
+}
+
+// Many small objects, numbers and strings.
+static void UniValueReadVerboseBlock(benchmark::State& state)
+{
+    const std::string json = VerboseBlockJSON();
+
+    while (state.KeepRunning()) {
+        UniValue val;
+        bool ok = val.read(json);
+        assert(ok);
+    }
+}
+
+static void UniValueWriteVerboseBlock(benchmark::State& state)
+{
+    UniValue val;
+    bool ok = val.read(VerboseBlockJSON());
+    assert(ok);
+
+    while (state.KeepRunning()) {
+        (void)val.write();
+    }
+}
+
+BENCHMARK(UniValueReadHexRequest, 200);
+BENCHMARK(UniValueReadVerboseBlock, 10);
+BENCHMARK(UniValueWriteVerboseBlock, 20);
@@ -71,6 +71,49 @@ static void VerifyScriptBench(benchmark::State& state)
     }
 }
 
+// Verification of a P2SH 3-of-5 multisig spend, which pushes and pops many
+// signature- and pubkey-sized stack elements.
+static void VerifyMultisigScriptBench(benchmark::State& state)
+{
+    const int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_NULLDUMMY;
+    const int required = 3;
+
+    std::vector<CKey> keys(5);
+    CScript redeemScript = CScript() << required;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        std::array<unsigned char, 32> vchKey{};
+        vchKey[31] = i + 1;
+        keys[i].Set(vchKey.begin(), vchKey.end(), true);
+        redeemScript << ToByteVector(keys[i].GetPubKey());
+    }
+    redeemScript << (int)keys.size() << OP_CHECKMULTISIG;
+
+    const CMutableTransaction& txCredit = BuildCreditingTransaction(GetScriptForDestination(ScriptHash(redeemScript)), 1);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), CScriptWitness(), CTransaction(txCredit));
+    const uint256 hash = SignatureHash(redeemScript, txSpend, 0, SIGHASH_ALL, txCredit.vout[0].nValue, SigVersion::BASE);
+    CScript scriptSig = CScript() << OP_0;
+    for (int i = 0; i < required; ++i) {
+        std::vector<unsigned char> sig;
+        keys[i].Sign(hash, sig);
+        sig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+        scriptSig << sig;
+    }
+    txSpend.vin[0].scriptSig = scriptSig << ToByteVector(redeemScript);
+
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool success = VerifyScript(
+            txSpend.vin[0].scriptSig,
+            txCredit.vout[0].scriptPubKey,
+            &txSpend.vin[0].scriptWitness,
+            flags,
+            MutableTransactionSignatureChecker(&txSpend, 0, txCredit.vout[0].nValue),
+            &err);
+        assert(err == SCRIPT_ERR_OK);
+        assert(success);
+    }
+}
+
 static void VerifyNestedIfScript(benchmark::State& state) {
     std::vector<std::vector<unsigned char>> stack;
     CScript script;
@@ -93,5 +136,6 @@ static void VerifyNestedIfScript(benchmark::State& state) {
 
 
 BENCHMARK(VerifyScriptBench, 6300);
+BENCHMARK(VerifyMultisigScriptBench, 2000);
 
 BENCHMARK(VerifyNestedIfScript, 100);
@@ -14,18 +14,38 @@
 #include <validation.h>
 #include <util/system.h>
 
+#include <thread>
 #include <unordered_map>
 
-CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
+/** Number of mempool transactions whose short IDs are computed together in InitData. */
+static const size_t SHORTID_CHUNK = 64;
+/** Mempool size from which InitData computes its short IDs on several threads. */
+static const size_t SHORTID_PARALLEL_MIN = 16384;
+/** Maximum number of threads InitData computes mempool short IDs on. */
+static const size_t MAX_SHORTID_SCAN_THREADS = 4;
+
+/** Position in vTxHashes of a mempool transaction, and the block index its short ID matches. */
+typedef std::pair<size_t, uint16_t> ShortIDMatch;
+
+CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const std::function<bool(const CTransaction&)>& prefill) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
-        shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
+        prefilledtxn(1), header(block) {
     FillShortTxIDSelector();
-    //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
     prefilledtxn[0] = {0, block.vtx[0]};
+    std::vector<const uint256*> txhashes;
+    txhashes.reserve(block.vtx.size() - 1);
+    size_t last_prefilled = 0;
     for (size_t i = 1; i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        shorttxids[i - 1] = GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash());
+        if (prefill && prefill(tx)) {
+            prefilledtxn.push_back({static_cast<uint16_t>(i - last_prefilled - 1), block.vtx[i]});
+            last_prefilled = i;
+        } else {
+            txhashes.push_back(fUseWTXID ? &tx.GetWitnessHash() : &tx.GetHash());
+        }
     }
+    shorttxids.resize(txhashes.size());
+    GetShortIDs(txhashes.data(), shorttxids.data(), txhashes.size());
 }
 
 void CBlockHeaderAndShortTxIDs::FillShortTxIDSelector() const {
@@ -44,7 +64,33 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256* const* txhashes, uint64_t* out, size_t n) const {
+    static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
+    SipHashUint256Batch(shorttxidk0, shorttxidk1, txhashes, out, n);
+    for (size_t i = 0; i < n; i++) {
+        out[i] &= 0xffffffffffffL;
+    }
+}
 
+/** Append the matches of the short IDs of vTxHashes[begin, end) against a block's shorttxids. */
+static void ScanShortIDs(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::unordered_map<uint64_t, uint16_t>& shorttxids,
+                         const std::vector<std::pair<uint256, CTxMemPool::txiter>>& vTxHashes, size_t begin, size_t end,
+                         std::vector<ShortIDMatch>& matches)
+{
+    const uint256* chunk_hashes[SHORTID_CHUNK];
+    uint64_t chunk_shortids[SHORTID_CHUNK];
+    for (size_t i = begin; i < end; i += SHORTID_CHUNK) {
+        const size_t chunk_size = std::min(SHORTID_CHUNK, end - i);
+        for (size_t j = 0; j < chunk_size; j++) {
+            chunk_hashes[j] = &vTxHashes[i + j].first;
+        }
+        cmpctblock.GetShortIDs(chunk_hashes, chunk_shortids, chunk_size);
+        for (size_t j = 0; j < chunk_size; j++) {
+            std::unordered_map<uint64_t, uint16_t>::const_iterator idit = shorttxids.find(chunk_shortids[j]);
+            if (idit != shorttxids.end()) matches.emplace_back(i + j, idit->second);
+        }
+    }
+}
 
 ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
     if (cmpctblock.header.IsNull() || (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty()))
@@ -103,37 +149,73 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
         return READ_STATUS_FAILED; // Short ID collision
 
     std::vector<bool> have_txn(txn_available.size());
-    {
-    LOCK(pool->cs);
-    const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
-    for (size_t i = 0; i < vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
-        std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txn_available[idit->second] = vTxHashes[i].second->GetSharedTx();
-                have_txn[idit->second]  = true;
+    // Takes the mempool matches of a range of vTxHashes, in order. Returns
+    // true once every short ID has been found.
+    auto add_matches = [&](const std::vector<ShortIDMatch>& matches, const std::vector<std::pair<uint256, CTxMemPool::txiter>>& vTxHashes) {
+        for (const ShortIDMatch& match : matches) {
+            if (!have_txn[match.second]) {
+                txn_available[match.second] = vTxHashes[match.first].second->GetSharedTx();
+                have_txn[match.second]  = true;
                 mempool_count++;
             } else {
                 // If we find two mempool txn that match the short id, just request it.
                 // This should be rare enough that the extra bandwidth doesn't matter,
                 // but eating a round-trip due to FillBlock failure would be annoying
-                if (txn_available[idit->second]) {
-                    txn_available[idit->second].reset();
+                if (txn_available[match.second]) {
+                    txn_available[match.second].reset();
                     mempool_count--;
                 }
             }
+            // Though ideally we'd continue scanning for the two-txn-match-shortid case,
+            // the performance win of an early exit here is too good to pass up and worth
+            // the extra risk.
+            if (mempool_count == shorttxids.size())
+                return true;
+        }
+        return false;
+    };
+    {
+    LOCK(pool->cs);
+    const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
+    const size_t num_threads = std::min<size_t>(std::max(GetNumCores(), 1), MAX_SHORTID_SCAN_THREADS);
+    if (num_threads > 1 && vTxHashes.size() >= SHORTID_PARALLEL_MIN) {
+        // Large mempools are split in one range per thread. The matches are
+        // then taken in mempool order, so the result is the same as that of a
+        // single pass with the early exit.
+        std::vector<std::vector<ShortIDMatch>> matches(num_threads);
+        const size_t per_thread = (vTxHashes.size() + num_threads - 1) / num_threads;
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads - 1);
+        for (size_t t = 1; t < num_threads; t++) {
+            threads.emplace_back(ScanShortIDs, std::cref(cmpctblock), std::cref(shorttxids), std::cref(vTxHashes),
+                std::min(vTxHashes.size(), t * per_thread), std::min(vTxHashes.size(), (t + 1) * per_thread), std::ref(matches[t]));
+        }
+        ScanShortIDs(cmpctblock, shorttxids, vTxHashes, 0, std::min(vTxHashes.size(), per_thread), matches[0]);
+        for (std::thread& thread : threads) thread.join();
+        for (const std::vector<ShortIDMatch>& range_matches : matches) {
+            if (add_matches(range_matches, vTxHashes)) break;
+        }
+    } else {
+        // Short IDs are computed a chunk at a time, which lets them be hashed in
+        // parallel without giving up the early exit.
+        std::vector<ShortIDMatch> matches;
+        for (size_t i = 0; i < vTxHashes.size(); i += SHORTID_CHUNK) {
+            matches.clear();
+            ScanShortIDs(cmpctblock, shorttxids, vTxHashes, i, std::min(vTxHashes.size(), i + SHORTID_CHUNK), matches);
+            if (add_matches(matches, vTxHashes)) break;
         }
-        // Though ideally we'd continue scanning for the two-txn-match-shortid case,
-        // the performance win of an early exit here is too good to pass up and worth
-        // the extra risk.
-        if (mempool_count == shorttxids.size())
-            break;
     }
     }
 
+    // The short IDs of the extra transactions are hashed all at once as well.
+    std::vector<const uint256*> extra_hashes(extra_txn.size());
+    std::vector<uint64_t> extra_shortids(extra_txn.size());
+    for (size_t i = 0; i < extra_txn.size(); i++) {
+        extra_hashes[i] = &extra_txn[i].first;
+    }
+    cmpctblock.GetShortIDs(extra_hashes.data(), extra_shortids.data(), extra_txn.size());
     for (size_t i = 0; i < extra_txn.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(extra_txn[i].first);
+        uint64_t shortid = extra_shortids[i];
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
             if (!have_txn[idit->second]) {
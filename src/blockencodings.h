@@ -7,6 +7,8 @@
 
 #include <primitives/block.h>
 
+#include <functional>
+
 
 class CTxMemPool;
 
@@ -103,9 +105,15 @@ public:
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+    /**
+     * Send the coinbase in full and all other transactions as short IDs, but
+     * those for which prefill (if set) returns true, which are sent in full too.
+     */
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const std::function<bool(const CTransaction&)>& prefill = nullptr);
 
     uint64_t GetShortID(const uint256& txhash) const;
+    /** Compute out[i] = GetShortID(*txhashes[i]) for i < n, several at a time. */
+    void GetShortIDs(const uint256* const* txhashes, uint64_t* out, size_t n) const;
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
 
@@ -7,6 +7,7 @@
 #include <set>
 
 #include <blockfilter.h>
+#include <crypto/common.h>
 #include <crypto/siphash.h>
 #include <hash.h>
 #include <primitives/transaction.h>
@@ -40,19 +41,76 @@ static void GolombRiceEncode(BitStreamWriter<OStream>& bitwriter, uint8_t P, uin
     bitwriter.Write(x, P);
 }
 
-template <typename IStream>
-static uint64_t GolombRiceDecode(BitStreamReader<IStream>& bitreader, uint8_t P)
+/**
+ * Decodes a sequence of Golomb-Rice codes from a byte buffer. Up to 64 upcoming bits are kept in a
+ * register, so unary quotients are counted a word at a time rather than bit by bit. Reading past
+ * the end of the buffer throws std::ios_base::failure, like BitStreamReader.
+ */
+class GolombRiceDecoder
 {
-    // Read unary-encoded quotient: q 1's followed by one 0.
-    uint64_t q = 0;
-    while (bitreader.Read(1) == 1) {
-        ++q;
+private:
+    const unsigned char* m_next;
+    const unsigned char* const m_end;
+    /// The upcoming bits, most significant first. Bits past m_bits are zero.
+    uint64_t m_window{0};
+    /// Number of valid bits in m_window.
+    int m_bits{0};
+    /// Number of bits consumed so far.
+    uint64_t m_consumed{0};
+
+    void Refill()
+    {
+        while (m_bits <= 56 && m_next != m_end) {
+            m_window |= static_cast<uint64_t>(*m_next++) << (56 - m_bits);
+            m_bits += 8;
+        }
+        if (m_bits == 0) {
+            throw std::ios_base::failure("GolombRiceDecoder: end of data");
+        }
+    }
+
+    void Consume(int nbits)
+    {
+        m_window = nbits == 64 ? 0 : m_window << nbits;
+        m_bits -= nbits;
+        m_consumed += nbits;
     }
 
-    uint64_t r = bitreader.Read(P);
+public:
+    GolombRiceDecoder(const unsigned char* begin, const unsigned char* end) : m_next(begin), m_end(end) {}
 
-    return (q << P) + r;
-}
+    uint64_t Decode(uint8_t P)
+    {
+        // Read unary-encoded quotient: q 1's followed by one 0.
+        uint64_t q = 0;
+        while (true) {
+            Refill();
+            const int ones = 64 - CountBits(~m_window);
+            if (ones < m_bits) {
+                q += ones;
+                Consume(ones + 1);
+                break;
+            }
+            q += m_bits;
+            Consume(m_bits);
+        }
+
+        // Read the remainder in P bits.
+        uint64_t r = 0;
+        for (int nbits = P; nbits > 0;) {
+            Refill();
+            const int take = std::min(nbits, std::min(m_bits, 32));
+            r = (r << take) | (m_window >> (64 - take));
+            Consume(take);
+            nbits -= take;
+        }
+
+        return (q << P) + r;
+    }
+
+    /// Number of bytes of the buffer that the codes decoded so far extend into.
+    size_t BytesUsed() const { return (m_consumed + 7) / 8; }
+};
 
 // Map a value x that is uniformly distributed in the range [0, 2^64) to a
 // value uniformly distributed in [0, n) by returning the upper 64 bits of
@@ -122,11 +180,12 @@ GCSFilter::GCSFilter(const Params& params, std::vector<unsigned char> encoded_fi
 
     // Verify that the encoded filter contains exactly N elements. If it has too much or too little
     // data, a std::ios_base::failure exception will be raised.
-    BitStreamReader<VectorReader> bitreader(stream);
+    const unsigned char* codes = m_encoded.data() + (m_encoded.size() - stream.size());
+    GolombRiceDecoder decoder(codes, m_encoded.data() + m_encoded.size());
     for (uint64_t i = 0; i < m_N; ++i) {
-        GolombRiceDecode(bitreader, m_params.m_P);
+        decoder.Decode(m_params.m_P);
     }
-    if (!stream.empty()) {
+    if (decoder.BytesUsed() != stream.size()) {
         throw std::ios_base::failure("encoded_filter contains excess data");
     }
 }
@@ -169,12 +228,13 @@ bool GCSFilter::MatchInternal(const uint64_t* element_hashes, size_t size) const
     uint64_t N = ReadCompactSize(stream);
     assert(N == m_N);
 
-    BitStreamReader<VectorReader> bitreader(stream);
+    const unsigned char* codes = m_encoded.data() + (m_encoded.size() - stream.size());
+    GolombRiceDecoder decoder(codes, m_encoded.data() + m_encoded.size());
 
     uint64_t value = 0;
     size_t hashes_index = 0;
     for (uint32_t i = 0; i < m_N; ++i) {
-        uint64_t delta = GolombRiceDecode(bitreader, m_params.m_P);
+        uint64_t delta = decoder.Decode(m_params.m_P);
         value += delta;
 
         while (true) {
@@ -205,6 +265,31 @@ bool GCSFilter::MatchAny(const ElementSet& elements) const
     return MatchInternal(queries.data(), queries.size());
 }
 
+std::vector<bool> GCSFilter::MatchAny(const std::vector<const GCSFilter*>& filters, const ElementSet& elements)
+{
+    // Walk the hash set once; every filter then hashes the same contiguous list.
+    std::vector<const Element*> flat_elements;
+    flat_elements.reserve(elements.size());
+    for (const Element& element : elements) {
+        flat_elements.push_back(&element);
+    }
+
+    std::vector<bool> matches(filters.size(), false);
+    std::vector<uint64_t> queries(flat_elements.size());
+    for (size_t i = 0; i < filters.size(); ++i) {
+        const GCSFilter& filter = *filters[i];
+        if (filter.m_N == 0 || flat_elements.empty()) continue;
+        const CSipHasher hasher(filter.m_params.m_siphash_k0, filter.m_params.m_siphash_k1);
+        for (size_t j = 0; j < flat_elements.size(); ++j) {
+            const Element& element = *flat_elements[j];
+            queries[j] = MapIntoRange(CSipHasher(hasher).Write(element.data(), element.size()).Finalize(), filter.m_F);
+        }
+        std::sort(queries.begin(), queries.end());
+        matches[i] = filter.MatchInternal(queries.data(), queries.size());
+    }
+    return matches;
+}
+
 const std::string& BlockFilterTypeName(BlockFilterType filter_type)
 {
     static std::string unknown_retval = "";
@@ -80,6 +80,12 @@ public:
      * efficient that checking Match on multiple elements separately.
      */
     bool MatchAny(const ElementSet& elements) const;
+
+    /**
+     * Checks the same elements against many filters, as when rescanning a range of blocks, and
+     * returns for each filter whether any of the elements may be in it.
+     */
+    static std::vector<bool> MatchAny(const std::vector<const GCSFilter*>& filters, const ElementSet& elements);
 };
 
 constexpr uint8_t BASIC_FILTER_P = 19;
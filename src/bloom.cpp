@@ -4,12 +4,17 @@
 
 #include <bloom.h>
 
+#include <crypto/common.h>
+#include <crypto/siphash.h>
 #include <primitives/transaction.h>
 #include <hash.h>
+#include <memusage.h>
 #include <script/script.h>
 #include <script/standard.h>
 #include <random.h>
 #include <streams.h>
+#include <util/memory.h>
+#include <util/time.h>
 
 #include <math.h>
 #include <stdlib.h>
@@ -19,6 +24,9 @@
 #define LN2SQUARED 0.4804530139182014246671025263266649717305529515945455
 #define LN2 0.6931471805599453094172321214581765680755001343602552
 
+/** Hash functions of a CBloomFilter evaluated together by contains(). */
+static const unsigned int BLOOM_HASH_BATCH = 4;
+
 CBloomFilter::CBloomFilter(const unsigned int nElements, const double nFPRate, const unsigned int nTweakIn, unsigned char nFlagsIn) :
     /**
      * The ideal size for a bloom filter with a given number of elements and false positive rate is:
@@ -45,61 +53,103 @@ inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const std::vector<
     return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash) % (vData.size() * 8);
 }
 
-void CBloomFilter::insert(const std::vector<unsigned char>& vKey)
+void CBloomFilter::Hashes(unsigned int first, unsigned int count, const unsigned char* key, size_t len, unsigned int* indices) const
+{
+    uint32_t seeds[MAX_HASH_FUNCS];
+    uint32_t hashes[MAX_HASH_FUNCS];
+    assert(count <= MAX_HASH_FUNCS);
+    for (unsigned int i = 0; i < count; i++) {
+        seeds[i] = (first + i) * 0xFBA4C795 + nTweak;
+    }
+    MurmurHash3Multi(seeds, count, key, len, hashes);
+    const uint32_t nBits = vData.size() * 8;
+    for (unsigned int i = 0; i < count; i++) {
+        indices[i] = hashes[i] % nBits;
+    }
+}
+
+void CBloomFilter::InsertKey(const unsigned char* key, size_t len)
 {
     if (isFull)
         return;
-    for (unsigned int i = 0; i < nHashFuncs; i++)
+    unsigned int indices[MAX_HASH_FUNCS];
+    for (unsigned int first = 0; first < nHashFuncs; first += MAX_HASH_FUNCS)
     {
-        unsigned int nIndex = Hash(i, vKey);
-        // Sets bit nIndex of vData
-        vData[nIndex >> 3] |= (1 << (7 & nIndex));
+        const unsigned int count = std::min<unsigned int>(MAX_HASH_FUNCS, nHashFuncs - first);
+        Hashes(first, count, key, len, indices);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            unsigned int nIndex = indices[i];
+            // Sets bit nIndex of vData
+            vData[nIndex >> 3] |= (1 << (7 & nIndex));
+        }
     }
     isEmpty = false;
 }
 
+bool CBloomFilter::ContainsKey(const unsigned char* key, size_t len) const
+{
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    // Most keys miss after a bit or two, so compute the hashes a few at a
+    // time rather than all of them up front.
+    unsigned int indices[BLOOM_HASH_BATCH];
+    for (unsigned int first = 0; first < nHashFuncs; first += BLOOM_HASH_BATCH)
+    {
+        const unsigned int count = std::min<unsigned int>(BLOOM_HASH_BATCH, nHashFuncs - first);
+        Hashes(first, count, key, len, indices);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            unsigned int nIndex = indices[i];
+            // Checks bit nIndex of vData
+            if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
+                return false;
+        }
+    }
+    return true;
+}
+
+/** Serialize an outpoint (as the network does) without allocating. */
+static void SerializeOutPoint(const COutPoint& outpoint, unsigned char out[36])
+{
+    memcpy(out, outpoint.hash.begin(), 32);
+    WriteLE32(out + 32, outpoint.n);
+}
+
+void CBloomFilter::insert(const std::vector<unsigned char>& vKey)
+{
+    InsertKey(vKey.data(), vKey.size());
+}
+
 void CBloomFilter::insert(const COutPoint& outpoint)
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    insert(data);
+    unsigned char data[36];
+    SerializeOutPoint(outpoint, data);
+    InsertKey(data, sizeof(data));
 }
 
 void CBloomFilter::insert(const uint256& hash)
 {
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    insert(data);
+    InsertKey(hash.begin(), hash.size());
 }
 
 bool CBloomFilter::contains(const std::vector<unsigned char>& vKey) const
 {
-    if (isFull)
-        return true;
-    if (isEmpty)
-        return false;
-    for (unsigned int i = 0; i < nHashFuncs; i++)
-    {
-        unsigned int nIndex = Hash(i, vKey);
-        // Checks bit nIndex of vData
-        if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
-            return false;
-    }
-    return true;
+    return ContainsKey(vKey.data(), vKey.size());
 }
 
 bool CBloomFilter::contains(const COutPoint& outpoint) const
 {
-    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-    stream << outpoint;
-    std::vector<unsigned char> data(stream.begin(), stream.end());
-    return contains(data);
+    unsigned char data[36];
+    SerializeOutPoint(outpoint, data);
+    return ContainsKey(data, sizeof(data));
 }
 
 bool CBloomFilter::contains(const uint256& hash) const
 {
-    std::vector<unsigned char> data(hash.begin(), hash.end());
-    return contains(data);
+    return ContainsKey(hash.begin(), hash.size());
 }
 
 void CBloomFilter::clear()
@@ -230,9 +280,10 @@ CRollingBloomFilter::CRollingBloomFilter(const unsigned int nElements, const dou
     reset();
 }
 
-/* Similar to CBloomFilter::Hash */
-static inline uint32_t RollingBloomHash(unsigned int nHashNum, uint32_t nTweak, const std::vector<unsigned char>& vDataToHash) {
-    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash);
+/* Derive the nHashNum'th hash of an item from its 64-bit hash (double hashing). The
+ * odd step keeps the hashes of an item distinct. */
+static inline uint32_t RollingBloomHash(unsigned int nHashNum, uint64_t hash) {
+    return (uint32_t)hash + nHashNum * ((uint32_t)(hash >> 32) | 1);
 }
 
 
@@ -243,7 +294,7 @@ static inline uint32_t FastMod(uint32_t x, size_t n) {
     return ((uint64_t)x * (uint64_t)n) >> 32;
 }
 
-void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
+void CRollingBloomFilter::insert(uint64_t hash)
 {
     if (nEntriesThisGeneration == nEntriesPerGeneration) {
         nEntriesThisGeneration = 0;
@@ -264,7 +315,7 @@ void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
     nEntriesThisGeneration++;
 
     for (int n = 0; n < nHashFuncs; n++) {
-        uint32_t h = RollingBloomHash(n, nTweak, vKey);
+        uint32_t h = RollingBloomHash(n, hash);
         int bit = h & 0x3F;
         /* FastMod works with the upper bits of h, so it is safe to ignore that the lower bits of h are already used for bit. */
         uint32_t pos = FastMod(h, data.size());
@@ -274,16 +325,20 @@ void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
     }
 }
 
+void CRollingBloomFilter::insert(const std::vector<unsigned char>& vKey)
+{
+    insert(CSipHasher(m_k0, m_k1).Write(vKey.data(), vKey.size()).Finalize());
+}
+
 void CRollingBloomFilter::insert(const uint256& hash)
 {
-    std::vector<unsigned char> vData(hash.begin(), hash.end());
-    insert(vData);
+    insert(SipHashUint256(m_k0, m_k1, hash));
 }
 
-bool CRollingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
+bool CRollingBloomFilter::contains(uint64_t hash) const
 {
     for (int n = 0; n < nHashFuncs; n++) {
-        uint32_t h = RollingBloomHash(n, nTweak, vKey);
+        uint32_t h = RollingBloomHash(n, hash);
         int bit = h & 0x3F;
         uint32_t pos = FastMod(h, data.size());
         /* If the relevant bit is not set in either data[pos & ~1] or data[pos | 1], the filter does not contain vKey */
@@ -294,16 +349,77 @@ bool CRollingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
     return true;
 }
 
+bool CRollingBloomFilter::contains(const std::vector<unsigned char>& vKey) const
+{
+    return contains(CSipHasher(m_k0, m_k1).Write(vKey.data(), vKey.size()).Finalize());
+}
+
 bool CRollingBloomFilter::contains(const uint256& hash) const
 {
-    std::vector<unsigned char> vData(hash.begin(), hash.end());
-    return contains(vData);
+    return contains(SipHashUint256(m_k0, m_k1, hash));
 }
 
 void CRollingBloomFilter::reset()
 {
-    nTweak = GetRand(std::numeric_limits<unsigned int>::max());
+    m_k0 = GetRand(std::numeric_limits<uint64_t>::max());
+    m_k1 = GetRand(std::numeric_limits<uint64_t>::max());
     nEntriesThisGeneration = 0;
     nGeneration = 1;
     std::fill(data.begin(), data.end(), 0);
 }
+
+size_t CRollingBloomFilter::DynamicMemoryUsage() const
+{
+    return memusage::DynamicUsage(data);
+}
+
+CAdaptiveRollingBloomFilter::CAdaptiveRollingBloomFilter(unsigned int min_elements, unsigned int max_elements, double fpRate, std::chrono::seconds min_age) :
+    m_min_elements(min_elements), m_max_elements(std::max(min_elements, max_elements)), m_fp_rate(fpRate), m_min_age(min_age),
+    m_capacity(min_elements), m_filter(MakeUnique<CRollingBloomFilter>(min_elements, fpRate)),
+    m_generation_start(GetTime<std::chrono::seconds>())
+{
+}
+
+void CAdaptiveRollingBloomFilter::Resize(unsigned int capacity)
+{
+    m_prev_filter = std::move(m_filter);
+    m_prev_capacity = m_capacity;
+    m_filter = MakeUnique<CRollingBloomFilter>(capacity, m_fp_rate);
+    m_capacity = capacity;
+    m_inserted = 0;
+}
+
+void CAdaptiveRollingBloomFilter::insert(const uint256& hash)
+{
+    m_filter->insert(hash);
+    ++m_inserted;
+    if (m_prev_filter && m_inserted >= std::min(m_capacity, m_prev_capacity)) {
+        m_prev_filter.reset();
+    }
+
+    // The filter forgets items once it has taken between two and three
+    // generations of half its capacity after them, so a generation must last
+    // at least half of m_min_age.
+    const unsigned int generation = (m_capacity + 1) / 2;
+    if (m_inserted % generation != 0) return;
+    const auto now = GetTime<std::chrono::seconds>();
+    const auto elapsed = now - m_generation_start;
+    m_generation_start = now;
+    if (elapsed * 2 < m_min_age && m_capacity < m_max_elements) {
+        Resize(std::min(m_capacity * 2, m_max_elements));
+    } else if (elapsed > m_min_age * 4 && m_capacity > m_min_elements && !m_prev_filter) {
+        Resize(std::max(m_capacity / 2, m_min_elements));
+    }
+}
+
+bool CAdaptiveRollingBloomFilter::contains(const uint256& hash) const
+{
+    return m_filter->contains(hash) || (m_prev_filter && m_prev_filter->contains(hash));
+}
+
+size_t CAdaptiveRollingBloomFilter::DynamicMemoryUsage() const
+{
+    size_t usage = memusage::DynamicUsage(m_filter) + m_filter->DynamicMemoryUsage();
+    if (m_prev_filter) usage += memusage::DynamicUsage(m_prev_filter) + m_prev_filter->DynamicMemoryUsage();
+    return usage;
+}
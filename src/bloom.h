@@ -7,6 +7,8 @@
 
 #include <serialize.h>
 
+#include <chrono>
+#include <memory>
 #include <vector>
 
 class COutPoint;
@@ -52,6 +54,10 @@ private:
     unsigned char nFlags;
 
     unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const;
+    //! Bit indices of hash functions [first, first + count) for a key, computed together.
+    void Hashes(unsigned int first, unsigned int count, const unsigned char* key, size_t len, unsigned int* indices) const;
+    void InsertKey(const unsigned char* key, size_t len);
+    bool ContainsKey(const unsigned char* key, size_t len) const;
 
 public:
     /**
@@ -101,9 +107,9 @@ public:
 /**
  * RollingBloomFilter is a probabilistic "keep track of most recently inserted" set.
  * Construct it with the number of items to keep track of, and a false-positive
- * rate. Unlike CBloomFilter, by default nTweak is set to a cryptographically
+ * rate. Unlike CBloomFilter, the hash key is set to a cryptographically
  * secure random value for you. Similarly rather than clear() the method
- * reset() is provided, which also changes nTweak to decrease the impact of
+ * reset() is provided, which also changes the key to decrease the impact of
  * false-positives.
  *
  * contains(item) will always return true if item was one of the last N to 1.5*N
@@ -111,6 +117,9 @@ public:
  *
  * It needs around 1.8 bytes per element per factor 0.1 of false positive rate.
  * (More accurately: 3/(log(256)*log(2)) * log(1/fpRate) * nElements bytes)
+ *
+ * Items are hashed once, with SipHash under that key, and the positions for
+ * all hash functions are derived from that hash by double hashing.
  */
 class CRollingBloomFilter
 {
@@ -124,13 +133,58 @@ public:
 
     void reset();
 
+    size_t DynamicMemoryUsage() const;
+
 private:
+    void insert(uint64_t hash);
+    bool contains(uint64_t hash) const;
+
     int nEntriesPerGeneration;
     int nEntriesThisGeneration;
     int nGeneration;
     std::vector<uint64_t> data;
-    unsigned int nTweak;
+    uint64_t m_k0, m_k1;
     int nHashFuncs;
 };
 
+/**
+ * A CRollingBloomFilter of hashes whose capacity follows the rate at which
+ * they are inserted, between min_elements and max_elements.
+ *
+ * Items are meant to be remembered for at least min_age. When the filter
+ * rolls over its items faster than that, its capacity doubles, and when it
+ * takes more than four times as long, its capacity halves. On a resize the
+ * previous filter is kept, and also checked by contains(), until the new one
+ * has taken as many items as the smaller of the two holds.
+ */
+class CAdaptiveRollingBloomFilter
+{
+public:
+    CAdaptiveRollingBloomFilter(unsigned int min_elements, unsigned int max_elements, double fpRate, std::chrono::seconds min_age);
+
+    void insert(const uint256& hash);
+    bool contains(const uint256& hash) const;
+
+    /** Number of items the current filter is sized for. */
+    unsigned int capacity() const { return m_capacity; }
+    size_t DynamicMemoryUsage() const;
+
+private:
+    void Resize(unsigned int capacity);
+
+    const unsigned int m_min_elements;
+    const unsigned int m_max_elements;
+    const double m_fp_rate;
+    const std::chrono::seconds m_min_age;
+    unsigned int m_capacity;
+    std::unique_ptr<CRollingBloomFilter> m_filter;
+    //! The filter in use before the last resize, while it still holds items the current one lacks
+    std::unique_ptr<CRollingBloomFilter> m_prev_filter;
+    unsigned int m_prev_capacity{0};
+    //! Items inserted since the last resize
+    unsigned int m_inserted{0};
+    //! When the current generation of the filter started
+    std::chrono::seconds m_generation_start;
+};
+
 #endif // PALLADIUM_BLOOM_H
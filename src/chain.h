@@ -129,6 +129,12 @@ enum BlockStatus: uint32_t {
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
 };
 
+//! Values memoized on a CBlockIndex, see CBlockIndex::nMemoized
+enum BlockMemo: uint8_t {
+    BLOCK_MEMO_SCRIPT_FLAGS  =    1, //!< nScriptFlags is set
+    BLOCK_MEMO_DEPLOYMENTS   =    2, //!< nChildDeploymentStates is set
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -186,6 +192,15 @@ public:
     //! (memory only) Maximum nTime in the chain up to and including this block.
     unsigned int nTimeMax{0};
 
+    //! (memory only) Script verification flags for this block, guarded by cs_main.
+    mutable unsigned int nScriptFlags{0};
+
+    //! (memory only) ThresholdState of each versionbits deployment for the children of this block, guarded by cs_main.
+    mutable uint8_t nChildDeploymentStates[Consensus::MAX_VERSION_BITS_DEPLOYMENTS]{};
+
+    //! (memory only) Which of the values above are set. See enum BlockMemo
+    mutable uint8_t nMemoized{0};
+
     CBlockIndex()
     {
     }
@@ -8,12 +8,15 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 
-template <typename T>
+template <typename T, typename Q>
 class CCheckQueueControl;
 
 /**
@@ -163,21 +166,216 @@ public:
 };
 
 /**
- * RAII-style controller object for a CCheckQueue that guarantees the passed
- * queue is finished before continuing.
+ * Drop-in alternative to CCheckQueue for machines with many cores.
+ *
+ * Instead of one queue behind one mutex, every worker (and the master) owns a
+ * deque of checks. Add() spreads the new checks over those deques; a worker
+ * takes batches from the back of its own deque and, once that is empty, steals
+ * from the front of the others'. Each deque has its own lock, which is only
+ * contended by thieves, and completion is tracked with atomics, so the shared
+ * condition variables are only touched to put idle workers to sleep and to
+ * wake them up.
+ *
+ * As with CCheckQueue, a batch of checks is destroyed before it is counted as
+ * done, so everything has been cleaned up when Wait() returns.
  */
 template <typename T>
+class CWorkStealingCheckQueue
+{
+private:
+    //! More workers than this share the last deque.
+    static constexpr unsigned int MAX_DEQUES = 128;
+    //! Add() puts at least this many checks in each deque it touches.
+    static constexpr size_t MIN_CHECKS_PER_DEQUE = 16;
+
+    struct WorkerDeque {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Deque 0 belongs to the master, the others to the workers in the order they started.
+    std::unique_ptr<WorkerDeque[]> m_deques;
+
+    //! Number of worker threads that have started (not counting the master).
+    std::atomic<unsigned int> m_num_workers{0};
+
+    //! Deque that the next single check is added to.
+    unsigned int m_next_deque{0};
+
+    //! Set to false when a check fails; remaining checks are then skipped.
+    std::atomic<bool> m_all_ok{true};
+
+    //! Number of checks that have been added but not yet run and destroyed.
+    std::atomic<unsigned int> m_todo{0};
+
+    //! Number of workers sleeping, or about to, on m_cond_worker.
+    std::atomic<int> m_num_sleeping{0};
+
+    //! Protects sleeping and waking up, not the checks.
+    boost::mutex m_sleep_mutex;
+    boost::condition_variable m_cond_worker;
+    boost::condition_variable m_cond_master;
+
+    //! The maximum number of elements to be processed in one batch
+    const unsigned int nBatchSize;
+
+    unsigned int NumDeques() const
+    {
+        return std::min(m_num_workers.load() + 1, MAX_DEQUES);
+    }
+
+    /** Move up to half the checks of deque, at most nBatchSize, into batch. */
+    bool TakeFrom(WorkerDeque& deque, bool from_back, std::vector<T>& batch)
+    {
+        boost::unique_lock<boost::mutex> lock(deque.mutex);
+        if (deque.checks.empty()) return false;
+        const size_t count = std::max<size_t>(1, std::min<size_t>(nBatchSize, deque.checks.size() / 2));
+        batch.resize(count);
+        for (T& check : batch) {
+            if (from_back) {
+                check.swap(deque.checks.back());
+                deque.checks.pop_back();
+            } else {
+                check.swap(deque.checks.front());
+                deque.checks.pop_front();
+            }
+        }
+        return true;
+    }
+
+    /** Fill batch from our own deque, or steal from another. */
+    bool TakeWork(unsigned int self, std::vector<T>& batch)
+    {
+        if (TakeFrom(m_deques[self], true, batch)) return true;
+        const unsigned int num_deques = NumDeques();
+        for (unsigned int i = 1; i < num_deques; ++i) {
+            if (TakeFrom(m_deques[(self + i) % num_deques], false, batch)) return true;
+        }
+        return false;
+    }
+
+    bool HasWork()
+    {
+        const unsigned int num_deques = NumDeques();
+        for (unsigned int i = 0; i < num_deques; ++i) {
+            boost::unique_lock<boost::mutex> lock(m_deques[i].mutex);
+            if (!m_deques[i].checks.empty()) return true;
+        }
+        return false;
+    }
+
+    /** Run and destroy batch, then count it as done. */
+    void RunBatch(std::vector<T>& batch, bool is_master)
+    {
+        bool ok = m_all_ok.load(std::memory_order_relaxed);
+        for (T& check : batch) {
+            if (ok) ok = check();
+        }
+        if (!ok) m_all_ok.store(false, std::memory_order_relaxed);
+        const unsigned int done = batch.size();
+        batch.clear();
+        if (m_todo.fetch_sub(done) == done && !is_master) {
+            // We processed the last element; inform the master it can exit and return the result
+            boost::unique_lock<boost::mutex> lock(m_sleep_mutex);
+            m_cond_master.notify_one();
+        }
+    }
+
+    bool Loop(unsigned int self, bool fMaster)
+    {
+        std::vector<T> batch;
+        batch.reserve(nBatchSize);
+        while (true) {
+            if (TakeWork(self, batch)) {
+                RunBatch(batch, fMaster);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(m_sleep_mutex);
+            if (fMaster) {
+                // Nothing is left to take and only the master adds work, so
+                // all that remains is waiting for the batches in flight.
+                while (m_todo.load() != 0) m_cond_master.wait(lock);
+                return m_all_ok.exchange(true);
+            }
+            ++m_num_sleeping;
+            // Add() checks m_num_sleeping after filling the deques, so either
+            // it sees us and notifies, or we see its checks here.
+            if (!HasWork()) m_cond_worker.wait(lock);
+            --m_num_sleeping;
+        }
+    }
+
+public:
+    //! Mutex to ensure only one concurrent CCheckQueueControl
+    boost::mutex ControlMutex;
+
+    explicit CWorkStealingCheckQueue(unsigned int nBatchSizeIn) : m_deques(new WorkerDeque[MAX_DEQUES]), nBatchSize(nBatchSizeIn) {}
+
+    //! Worker thread
+    void Thread()
+    {
+        const unsigned int self = std::min(m_num_workers.fetch_add(1) + 1, MAX_DEQUES - 1);
+        // Leaving the worker count raised on interruption is harmless: the
+        // deque stays in the stealing rotation and is simply empty.
+        Loop(self, false);
+    }
+
+    //! Wait until execution finishes, and return whether all evaluations were successful.
+    bool Wait()
+    {
+        return Loop(0, true);
+    }
+
+    //! Add a batch of checks to the queue
+    void Add(std::vector<T>& vChecks)
+    {
+        if (vChecks.empty()) return;
+        m_todo.fetch_add(vChecks.size());
+        const unsigned int num_deques = NumDeques();
+        // Don't scatter small additions over many deques: thieves balance the
+        // load anyway, and every deque touched costs a lock.
+        const size_t per_deque = std::max<size_t>(MIN_CHECKS_PER_DEQUE, (vChecks.size() + num_deques - 1) / num_deques);
+        size_t pos = 0;
+        while (pos < vChecks.size()) {
+            WorkerDeque& deque = m_deques[m_next_deque++ % num_deques];
+            boost::unique_lock<boost::mutex> lock(deque.mutex);
+            for (const size_t end = std::min(vChecks.size(), pos + per_deque); pos < end; ++pos) {
+                deque.checks.emplace_back();
+                vChecks[pos].swap(deque.checks.back());
+            }
+        }
+        if (m_num_sleeping.load() > 0) {
+            boost::unique_lock<boost::mutex> lock(m_sleep_mutex);
+            if (vChecks.size() == 1)
+                m_cond_worker.notify_one();
+            else
+                m_cond_worker.notify_all();
+        }
+    }
+};
+
+template <typename T>
+constexpr unsigned int CWorkStealingCheckQueue<T>::MAX_DEQUES;
+
+template <typename T>
+constexpr size_t CWorkStealingCheckQueue<T>::MIN_CHECKS_PER_DEQUE;
+
+/**
+ * RAII-style controller object for a CCheckQueue (or CWorkStealingCheckQueue)
+ * that guarantees the passed queue is finished before continuing.
+ */
+template <typename T, typename Q = CCheckQueue<T>>
 class CCheckQueueControl
 {
 private:
-    CCheckQueue<T> * const pqueue;
+    Q * const pqueue;
     bool fDone;
 
 public:
     CCheckQueueControl() = delete;
     CCheckQueueControl(const CCheckQueueControl&) = delete;
     CCheckQueueControl& operator=(const CCheckQueueControl&) = delete;
-    explicit CCheckQueueControl(CCheckQueue<T> * const pqueueIn) : pqueue(pqueueIn), fDone(false)
+    explicit CCheckQueueControl(Q * const pqueueIn) : pqueue(pqueueIn), fDone(false)
     {
         // passed queue is supposed to be unused, or nullptr
         if (pqueue != nullptr) {
@@ -9,12 +9,23 @@
 #include <random.h>
 #include <version.h>
 
+#include <algorithm>
+#include <limits>
+
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return nullptr; }
 
+void CCoinsView::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const
+{
+    coins.resize(outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (!GetCoin(outpoints[i], coins[i])) coins[i].Clear();
+    }
+}
+
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
 {
     Coin coin;
@@ -23,17 +34,88 @@ bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView *viewIn) : base(viewIn) { }
 bool CCoinsViewBacked::GetCoin(const COutPoint &outpoint, Coin &coin) const { return base->GetCoin(outpoint, coin); }
+void CCoinsViewBacked::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const { base->GetCoins(outpoints, coins); }
 bool CCoinsViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->HaveCoin(outpoint); }
 uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 std::vector<uint256> CCoinsViewBacked::GetHeadBlocks() const { return base->GetHeadBlocks(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+
+void CCoinsViewBacked::GetCoinsFromBase(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins, const std::vector<bool>& unknown) const
+{
+    std::vector<COutPoint> base_outpoints;
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (unknown[i]) base_outpoints.push_back(outpoints[i]);
+    }
+    if (base_outpoints.empty()) return;
+    std::vector<Coin> base_coins;
+    base->GetCoins(base_outpoints, base_coins);
+    size_t next = 0;
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (unknown[i]) coins[i] = std::move(base_coins[next++]);
+    }
+}
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CoinsReuseSampler::CoinsReuseSampler(uint32_t rate, size_t max_tracked) :
+    m_threshold(std::numeric_limits<size_t>::max() / std::max<uint32_t>(rate, 1)),
+    m_max_tracked(std::max<size_t>(max_tracked, 1)),
+    m_tree(2 * m_max_tracked + 1)
+{
+    m_stats.rate = std::max<uint32_t>(rate, 1);
+    m_stats.horizon = uint64_t{m_max_tracked} * m_stats.rate;
+}
+
+void CoinsReuseSampler::Sample(const COutPoint& outpoint, bool lookup)
+{
+    if (m_now + 1 == m_tree.size()) Compact();
+    auto it = m_last_access.find(outpoint);
+    if (it == m_last_access.end()) {
+        if (lookup) ++m_stats.cold;
+        it = m_last_access.emplace(outpoint, 0).first;
+    } else {
+        // Every followed coin has a 1 at its last access, so those after
+        // this coin's are the followed ones accessed since.
+        uint64_t earlier = 0;
+        for (size_t i = it->second + 1; i > 0; i -= i & -i) earlier += m_tree[i];
+        if (lookup) {
+            const uint64_t distance = (m_last_access.size() - earlier) * m_stats.rate;
+            size_t bucket = 0;
+            while (bucket + 1 < BUCKETS && (distance >> bucket) != 0) ++bucket;
+            ++m_stats.reuses[bucket];
+        }
+        for (size_t i = it->second + 1; i < m_tree.size(); i += i & -i) --m_tree[i];
+    }
+    for (size_t i = m_now + 1; i < m_tree.size(); i += i & -i) ++m_tree[i];
+    it->second = m_now++;
+}
+
+void CoinsReuseSampler::Compact()
+{
+    // Renumber the access times from 0, forgetting all but the most recently
+    // accessed m_max_tracked coins.
+    std::vector<std::pair<uint32_t, COutPoint>> by_time;
+    by_time.reserve(m_last_access.size());
+    for (const auto& entry : m_last_access) by_time.emplace_back(entry.second, entry.first);
+    std::sort(by_time.begin(), by_time.end());
+    const size_t forget = by_time.size() > m_max_tracked ? by_time.size() - m_max_tracked : 0;
+    m_last_access.clear();
+    std::fill(m_tree.begin(), m_tree.end(), 0);
+    m_now = 0;
+    for (size_t k = forget; k < by_time.size(); ++k) {
+        m_last_access.emplace(by_time[k].second, m_now);
+        for (size_t i = m_now + 1; i < m_tree.size(); i += i & -i) ++m_tree[i];
+        ++m_now;
+    }
+}
+
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) :
+    CCoinsViewBacked(baseIn),
+    cacheCoins(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &m_cache_coins_memory_resource),
+    cachedCoinsUsage(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -41,12 +123,18 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (m_reuse_sampler) m_reuse_sampler->Access(outpoint, true);
+    if (it != cacheCoins.end()) {
+        ++m_counters.hits;
+        it->second.accessed = true;
         return it;
+    }
+    ++m_counters.misses;
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
     CCoinsMap::iterator ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(tmp))).first;
+    ++m_counters.insertions;
     if (ret->second.coin.IsSpent()) {
         // The parent only has an empty entry for this outpoint; we can consider our
         // version as fresh.
@@ -65,6 +153,23 @@ bool CCoinsViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return false;
 }
 
+void CCoinsViewCache::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const {
+    coins.resize(outpoints.size());
+    std::vector<bool> unknown(outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (m_reuse_sampler) m_reuse_sampler->Access(outpoints[i], true);
+        CCoinsMap::const_iterator it = cacheCoins.find(outpoints[i]);
+        if (it != cacheCoins.end()) {
+            ++m_counters.hits;
+            coins[i] = it->second.coin;
+        } else {
+            ++m_counters.misses;
+            unknown[i] = true;
+        }
+    }
+    GetCoinsFromBase(outpoints, coins, unknown);
+}
+
 void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possible_overwrite) {
     assert(!coin.IsSpent());
     if (coin.out.scriptPubKey.IsUnspendable()) return;
@@ -72,9 +177,12 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
     bool inserted;
     std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::tuple<>());
     bool fresh = false;
-    if (!inserted) {
+    if (inserted) {
+        ++m_counters.insertions;
+    } else {
         cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
     }
+    if (m_reuse_sampler) m_reuse_sampler->Access(outpoint, false);
     if (!possible_overwrite) {
         if (!it->second.coin.IsSpent()) {
             throw std::logic_error("Adding new coin that replaces non-pruned entry");
@@ -83,9 +191,21 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
     }
     it->second.coin = std::move(coin);
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    it->second.accessed = true;
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
 
+void CCoinsViewCache::EmplaceCoinFromBase(const COutPoint& outpoint, Coin&& coin) {
+    assert(!coin.IsSpent());
+    CCoinsMap::iterator it;
+    bool inserted;
+    std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)));
+    if (inserted) {
+        ++m_counters.insertions;
+        cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    }
+}
+
 void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool check) {
     bool fCoinbase = tx.IsCoinBase();
     const uint256& txid = tx.GetHash();
@@ -160,6 +280,8 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 CCoinsCacheEntry& entry = cacheCoins[it->first];
                 entry.coin = std::move(it->second.coin);
                 cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
+                ++m_counters.insertions;
+                if (m_reuse_sampler && !entry.coin.IsSpent()) m_reuse_sampler->Access(it->first, false);
                 entry.flags = CCoinsCacheEntry::DIRTY;
                 // We can mark it FRESH in the parent if it was FRESH in the child
                 // Otherwise it might have just been flushed from the parent's cache
@@ -190,6 +312,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
                 itUs->second.coin = std::move(it->second.coin);
                 cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                 itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                itUs->second.accessed = true;
                 // NOTE: It is possible the child has a FRESH flag here in
                 // the event the entry we found in the parent is pruned. But
                 // we must not copy that FRESH flag to the parent as that
@@ -203,17 +326,96 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
 }
 
 bool CCoinsViewCache::Flush() {
+    // BatchWrite may consume the entries it is handed.
+    m_counters.evictions += cacheCoins.size();
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    ReallocateCache();
     return fOk;
 }
 
+bool CCoinsViewCache::PartialFlush(size_t target_usage) {
+    const size_t usage = DynamicMemoryUsage();
+    size_t to_evict = 0;
+    if (usage > target_usage) {
+        // Assume evicting an entry frees the average per-entry usage.
+        to_evict = cacheCoins.size() - static_cast<size_t>(static_cast<double>(cacheCoins.size()) * target_usage / usage);
+    }
+
+    // Collect what the base needs to see. Entries that are being evicted are
+    // moved there, the ones staying are copied and become clean.
+    CCoinsMapMemoryResource resource;
+    CCoinsMap dirty(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
+    for (int pass = 0; pass < 2; ++pass) {
+        for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+            CCoinsCacheEntry& entry = it->second;
+            // The first pass evicts cold entries and spent ones (which the base
+            // has been told about once they are written), the second whatever
+            // is still needed to reach the target.
+            const bool cold = pass == 1 || !entry.accessed;
+            const bool evict = entry.coin.IsSpent() || (cold && to_evict > 0);
+            const size_t coin_usage = entry.coin.DynamicMemoryUsage();
+            if (entry.flags & CCoinsCacheEntry::DIRTY) {
+                if (evict) {
+                    dirty.emplace(it->first, std::move(entry));
+                } else {
+                    CCoinsCacheEntry& copy = dirty[it->first];
+                    copy.coin = entry.coin;
+                    copy.flags = entry.flags;
+                    entry.flags = 0;
+                }
+            }
+            if (evict) {
+                cachedCoinsUsage -= coin_usage;
+                if (to_evict > 0) --to_evict;
+                ++m_counters.evictions;
+                it = cacheCoins.erase(it);
+            } else {
+                if (pass == 0) entry.accessed = false;
+                ++it;
+            }
+        }
+        if (to_evict == 0) break;
+    }
+
+    bool fOk = base->BatchWrite(dirty, hashBlock);
+    CompactCache();
+    return fOk;
+}
+
+void CCoinsViewCache::CompactCache()
+{
+    CCoinsMapMemoryResource resource;
+    CCoinsMap entries(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource);
+    entries.reserve(cacheCoins.size());
+    for (CCoinsMap::value_type& entry : cacheCoins) {
+        entries.emplace(entry.first, std::move(entry.second));
+    }
+    cacheCoins.clear();
+    ReallocateCache();
+    cacheCoins.reserve(entries.size());
+    for (CCoinsMap::value_type& entry : entries) {
+        cacheCoins.emplace(entry.first, std::move(entry.second));
+    }
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    // Cache should be empty when we're calling this.
+    assert(cacheCoins.size() == 0);
+    cacheCoins.~CCoinsMap();
+    m_cache_coins_memory_resource.~CCoinsMapMemoryResource();
+    ::new (&m_cache_coins_memory_resource) CCoinsMapMemoryResource();
+    ::new (&cacheCoins) CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &m_cache_coins_memory_resource);
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
     if (it != cacheCoins.end() && it->second.flags == 0) {
         cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+        ++m_counters.evictions;
         cacheCoins.erase(it);
     }
 }
@@ -260,18 +462,30 @@ const Coin& AccessByTxid(const CCoinsViewCache& view, const uint256& txid)
     return coinEmpty;
 }
 
+void CCoinsViewErrorCatcher::ReadError(const std::runtime_error& e) const {
+    for (auto f : m_err_callbacks) {
+        f();
+    }
+    LogPrintf("Error reading from database: %s\n", e.what());
+    // Starting the shutdown sequence and returning false to the caller would be
+    // interpreted as 'entry not found' (as opposed to unable to read data), and
+    // could lead to invalid interpretation. Just exit immediately, as we can't
+    // continue anyway, and all writes should be atomic.
+    std::abort();
+}
+
 bool CCoinsViewErrorCatcher::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     try {
         return CCoinsViewBacked::GetCoin(outpoint, coin);
     } catch(const std::runtime_error& e) {
-        for (auto f : m_err_callbacks) {
-            f();
-        }
-        LogPrintf("Error reading from database: %s\n", e.what());
-        // Starting the shutdown sequence and returning false to the caller would be
-        // interpreted as 'entry not found' (as opposed to unable to read data), and
-        // could lead to invalid interpretation. Just exit immediately, as we can't
-        // continue anyway, and all writes should be atomic.
-        std::abort();
+        ReadError(e);
+    }
+}
+
+void CCoinsViewErrorCatcher::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const {
+    try {
+        CCoinsViewBacked::GetCoins(outpoints, coins);
+    } catch(const std::runtime_error& e) {
+        ReadError(e);
     }
 }
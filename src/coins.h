@@ -12,13 +12,17 @@
 #include <crypto/siphash.h>
 #include <memusage.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
 #include <uint256.h>
 
 #include <assert.h>
 #include <stdint.h>
 
+#include <array>
 #include <functional>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 /**
  * A UTXO entry.
@@ -113,6 +117,7 @@ struct CCoinsCacheEntry
 {
     Coin coin; // The actual cached data.
     unsigned char flags;
+    bool accessed; // Looked up or modified since the last partial flush (see CCoinsViewCache::PartialFlush).
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
@@ -124,11 +129,27 @@ struct CCoinsCacheEntry
          */
     };
 
-    CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
+    CCoinsCacheEntry() : flags(0), accessed(true) {}
+    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0), accessed(true) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * PoolAllocator's MAX_BLOCK_SIZE_BYTES parameter here uses sizeof the data, and adds the size
+ * of 4 pointers. We do not know the exact node size used in the std::unordered_node implementation
+ * because it is implementation defined. Most implementations have an overhead of 1 or 2 pointers,
+ * so nodes can be connected in a linked list, and in some cases the hash value is stored as well.
+ * Using an additional sizeof(void*)*4 for MAX_BLOCK_SIZE_BYTES should thus be sufficient so that
+ * all implementations can allocate the nodes from the PoolAllocator.
+ */
+using CCoinsMap = std::unordered_map<COutPoint,
+                                     CCoinsCacheEntry,
+                                     SaltedOutpointHasher,
+                                     std::equal_to<COutPoint>,
+                                     PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                                                   sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4,
+                                                   alignof(void*)>>;
+
+using CCoinsMapMemoryResource = CCoinsMap::allocator_type::ResourceType;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -160,6 +181,13 @@ public:
      */
     virtual bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
 
+    /** Retrieve the Coins for many outpoints at once, which views can do faster
+     *  than one by one. coins is resized to the number of outpoints; coins[i]
+     *  is the unspent coin found for outpoints[i], or spent if there is none.
+     *  Views that cache don't add the coins to their cache.
+     */
+    virtual void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const;
+
     //! Just check whether a given outpoint is unspent.
     virtual bool HaveCoin(const COutPoint &outpoint) const;
 
@@ -196,6 +224,7 @@ protected:
 public:
     CCoinsViewBacked(CCoinsView *viewIn);
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
@@ -203,9 +232,76 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
+
+protected:
+    //! Fill in coins[i] from the base view for the outpoints with unknown[i] set.
+    void GetCoinsFromBase(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins, const std::vector<bool>& unknown) const;
 };
 
 
+/** Lookup and churn counters of a CCoinsViewCache */
+struct CCoinsCacheCounters
+{
+    //! Lookups answered from the cache, and those passed to the base view
+    uint64_t hits{0};
+    uint64_t misses{0};
+    //! Entries added to the cache, and those dropped by flushes and Uncache()
+    uint64_t insertions{0};
+    uint64_t evictions{0};
+};
+
+/**
+ * Estimates the reuse distance of coin lookups: how many distinct coins were
+ * accessed since the previous access to the same one. A lookup at distance d
+ * would hit an LRU cache of more than d coins, so the distribution tells how
+ * the hit rate depends on the cache size. Only the outpoints whose salted
+ * hash falls in a 1 in rate slice are followed, and their distances among
+ * each other are scaled up by the rate (spatial sampling, as in SHARDS).
+ */
+class CoinsReuseSampler
+{
+public:
+    //! Reuses are counted in buckets by the bit length of the distance.
+    static constexpr size_t BUCKETS = 40;
+
+    struct Stats {
+        uint32_t rate{0};
+        //! Sampled lookups of a coin that was not accessed within the last
+        //! max_tracked sampled coins (or ever)
+        uint64_t cold{0};
+        //! Sampled lookups by reuse distance: bucket b holds distances in [2^(b-1), 2^b)
+        std::array<uint64_t, BUCKETS> reuses{{}};
+        //! Largest distance that can be measured (larger ones count as cold)
+        uint64_t horizon{0};
+    };
+
+    CoinsReuseSampler(uint32_t rate, size_t max_tracked);
+
+    /** Record an access; lookups are counted, other accesses (e.g. adding the coin) only move it to the front. */
+    void Access(const COutPoint& outpoint, bool lookup)
+    {
+        if (m_hasher(outpoint) <= m_threshold) Sample(outpoint, lookup);
+    }
+
+    const Stats& GetStats() const { return m_stats; }
+
+private:
+    void Sample(const COutPoint& outpoint, bool lookup);
+    void Compact();
+
+    const SaltedOutpointHasher m_hasher;
+    const size_t m_threshold;
+    const size_t m_max_tracked;
+    Stats m_stats;
+
+    //! Time of the last access to each followed coin. Times index m_tree, a
+    //! Fenwick tree with a 1 at the last access time of every followed coin,
+    //! so that the distinct coins accessed since time t are counted in log time.
+    std::unordered_map<COutPoint, uint32_t, SaltedOutpointHasher> m_last_access;
+    std::vector<uint32_t> m_tree;
+    uint32_t m_now{0};
+};
+
 /** CCoinsView that adds a memory cache for transactions to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
 {
@@ -215,11 +311,16 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
+    mutable CCoinsMapMemoryResource m_cache_coins_memory_resource{};
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    mutable CCoinsCacheCounters m_counters;
+    //! Estimates reuse distances of the lookups, if enabled
+    mutable std::unique_ptr<CoinsReuseSampler> m_reuse_sampler;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -230,6 +331,7 @@ public:
 
     // Standard CCoinsView methods
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
@@ -263,6 +365,13 @@ public:
      */
     void AddCoin(const COutPoint& outpoint, Coin&& coin, bool potential_overwrite);
 
+    /**
+     * Cache a coin that was looked up in the backing view by someone else (e.g.
+     * a prefetching thread). Has no effect if the cache already has an entry for
+     * the outpoint, as that one is at least as recent.
+     */
+    void EmplaceCoinFromBase(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
@@ -277,6 +386,14 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base like Flush(), but
+     * keep the hot part of the cache: entries that were not accessed since the
+     * previous partial flush are evicted first, then others as needed, until the
+     * cache is estimated to fit in target_usage bytes. Whatever stays is clean.
+     */
+    bool PartialFlush(size_t target_usage);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -289,6 +406,12 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    const CCoinsCacheCounters& GetCounters() const { return m_counters; }
+
+    //! Start estimating the reuse distances of lookups (nullptr to stop).
+    void SetReuseSampler(std::unique_ptr<CoinsReuseSampler> sampler) { m_reuse_sampler = std::move(sampler); }
+    const CoinsReuseSampler* GetReuseSampler() const { return m_reuse_sampler.get(); }
+
     /**
      * Amount of palladiums coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -308,6 +431,16 @@ private:
      * memory usage.
      */
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
+
+    /**
+     * Replace cacheCoins and its memory resource with fresh, empty ones. The pool
+     * never returns memory to the system on its own, so without this a flushed
+     * cache would keep reporting (and holding) its peak usage.
+     */
+    void ReallocateCache();
+
+    //! Move the remaining entries into a freshly allocated map, releasing the pool chunks of evicted ones.
+    void CompactCache();
 };
 
 //! Utility function to add all of a transaction's outputs to a cache.
@@ -341,8 +474,12 @@ public:
     }
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const override;
 
 private:
+    //! Run the callbacks and exit on a read error.
+    [[noreturn]] void ReadError(const std::runtime_error& e) const;
+
     /** A list of callbacks to execute upon leveldb read error. */
     std::vector<std::function<void()>> m_err_callbacks;
 
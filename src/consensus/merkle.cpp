@@ -61,6 +61,32 @@ uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated) {
     return hashes[0];
 }
 
+std::vector<uint256> ComputeMerkleBranch(std::vector<uint256> hashes, uint32_t position) {
+    std::vector<uint256> branch;
+    while (hashes.size() > 1) {
+        if (hashes.size() & 1) {
+            hashes.push_back(hashes.back());
+        }
+        branch.push_back(hashes[position ^ 1]);
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+        position >>= 1;
+    }
+    return branch;
+}
+
+uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position) {
+    uint256 hash = leaf;
+    for (const uint256& sibling : branch) {
+        if (position & 1) {
+            hash = Hash(sibling.begin(), sibling.end(), hash.begin(), hash.end());
+        } else {
+            hash = Hash(hash.begin(), hash.end(), sibling.begin(), sibling.end());
+        }
+        position >>= 1;
+    }
+    return hash;
+}
 
 uint256 BlockMerkleRoot(const CBlock& block, bool* mutated)
 {
@@ -83,3 +109,12 @@ uint256 BlockWitnessMerkleRoot(const CBlock& block, bool* mutated)
     return ComputeMerkleRoot(std::move(leaves), mutated);
 }
 
+std::vector<uint256> BlockMerkleBranch(const CBlock& block, uint32_t position)
+{
+    std::vector<uint256> leaves;
+    leaves.resize(block.vtx.size());
+    for (size_t s = 0; s < block.vtx.size(); s++) {
+        leaves[s] = block.vtx[s]->GetHash();
+    }
+    return ComputeMerkleBranch(std::move(leaves), position);
+}
@@ -12,6 +12,16 @@
 
 uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated = nullptr);
 
+/*
+ * Compute the hashes needed to go from the leaf at position to the Merkle
+ * root of hashes; position must be within hashes. The branch does not
+ * depend on the leaf itself.
+ */
+std::vector<uint256> ComputeMerkleBranch(std::vector<uint256> hashes, uint32_t position);
+
+/* Compute the Merkle root from a leaf at position and its branch. */
+uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position);
+
 /*
  * Compute the Merkle root of the transactions in a block.
  * *mutated is set to true if a duplicated subtree was found.
@@ -24,4 +34,10 @@ uint256 BlockMerkleRoot(const CBlock& block, bool* mutated = nullptr);
  */
 uint256 BlockWitnessMerkleRoot(const CBlock& block, bool* mutated = nullptr);
 
+/*
+ * Compute the Merkle branch of the transaction at position in a block, e.g.
+ * of the coinbase for miners that only replace it.
+ */
+std::vector<uint256> BlockMerkleBranch(const CBlock& block, uint32_t position);
+
 #endif // PALLADIUM_CONSENSUS_MERKLE_H
@@ -7,6 +7,9 @@
 #include <primitives/transaction.h>
 #include <consensus/validation.h>
 
+#include <algorithm>
+#include <vector>
+
 bool CheckTransaction(const CTransaction& tx, TxValidationState& state)
 {
     // Basic checks that don't depend on any context
@@ -36,9 +39,16 @@ bool CheckTransaction(const CTransaction& tx, TxValidationState& state)
     // of a tx as spent, it does not check if the tx has duplicate inputs.
     // Failure to run this check will result in either a crash or an inflation bug, depending on the implementation of
     // the underlying coins database.
-    std::set<COutPoint> vInOutPoints;
-    for (const auto& txin : tx.vin) {
-        if (!vInOutPoints.insert(txin.prevout).second)
+    // The prevouts are sorted in a buffer kept per thread, so that checking a
+    // block's transactions does not allocate for each of them.
+    if (tx.vin.size() > 1) {
+        static thread_local std::vector<COutPoint> vInOutPoints;
+        vInOutPoints.clear();
+        for (const auto& txin : tx.vin) {
+            vInOutPoints.push_back(txin.prevout);
+        }
+        std::sort(vInOutPoints.begin(), vInOutPoints.end());
+        if (std::adjacent_find(vInOutPoints.begin(), vInOutPoints.end()) != vInOutPoints.end())
             return state.Invalid(TxValidationResult::TX_CONSENSUS, "bad-txns-inputs-duplicate");
     }
 
@@ -139,12 +139,11 @@ void ScriptToUniv(const CScript& script, UniValue& out, bool include_address)
     out.pushKV("asm", ScriptToAsmStr(script));
     out.pushKV("hex", HexStr(script.begin(), script.end()));
 
-    std::vector<std::vector<unsigned char>> solns;
-    txnouttype type = Solver(script, solns);
-    out.pushKV("type", GetTxnOutputType(type));
+    const SolvedScript solved(script);
+    out.pushKV("type", GetTxnOutputType(solved.type));
 
     CTxDestination address;
-    if (include_address && ExtractDestination(script, address) && type != TX_PUBKEY) {
+    if (include_address && ExtractDestination(solved, address) && solved.type != TX_PUBKEY) {
         out.pushKV("address", EncodeDestination(address));
     }
 }
@@ -7,71 +7,41 @@
 
 #include <crypto/common.h>
 #include <crypto/chacha20.h>
+#include <compat/cpuid.h>
 
+#include <algorithm>
+#include <assert.h>
 #include <string.h>
 
-constexpr static inline uint32_t rotl32(uint32_t v, int c) { return (v << c) | (v >> (32 - c)); }
-
-#define QUARTERROUND(a,b,c,d) \
-  a += b; d = rotl32(d ^ a, 16); \
-  c += d; b = rotl32(b ^ c, 12); \
-  a += b; d = rotl32(d ^ a, 8); \
-  c += d; b = rotl32(b ^ c, 7);
-
-static const unsigned char sigma[] = "expand 32-byte k";
-static const unsigned char tau[] = "expand 16-byte k";
-
-void ChaCha20::SetKey(const unsigned char* k, size_t keylen)
+namespace chacha20_sse41
 {
-    const unsigned char *constants;
-
-    input[4] = ReadLE32(k + 0);
-    input[5] = ReadLE32(k + 4);
-    input[6] = ReadLE32(k + 8);
-    input[7] = ReadLE32(k + 12);
-    if (keylen == 32) { /* recommended */
-        k += 16;
-        constants = sigma;
-    } else { /* keylen == 16 */
-        constants = tau;
-    }
-    input[8] = ReadLE32(k + 0);
-    input[9] = ReadLE32(k + 4);
-    input[10] = ReadLE32(k + 8);
-    input[11] = ReadLE32(k + 12);
-    input[0] = ReadLE32(constants + 0);
-    input[1] = ReadLE32(constants + 4);
-    input[2] = ReadLE32(constants + 8);
-    input[3] = ReadLE32(constants + 12);
-    input[12] = 0;
-    input[13] = 0;
-    input[14] = 0;
-    input[15] = 0;
+void Crypt_4way(const uint32_t* input, const unsigned char* m, unsigned char* c);
 }
 
-ChaCha20::ChaCha20()
+namespace chacha20_avx2
 {
-    memset(input, 0, sizeof(input));
+void Crypt_8way(const uint32_t* input, const unsigned char* m, unsigned char* c);
 }
 
-ChaCha20::ChaCha20(const unsigned char* k, size_t keylen)
+// Internal implementation code.
+namespace
 {
-    SetKey(k, keylen);
-}
+constexpr static inline uint32_t rotl32(uint32_t v, int c) { return (v << c) | (v >> (32 - c)); }
 
-void ChaCha20::SetIV(uint64_t iv)
-{
-    input[14] = iv;
-    input[15] = iv >> 32;
-}
+#define QUARTERROUND(a,b,c,d) \
+  a += b; d = rotl32(d ^ a, 16); \
+  c += d; b = rotl32(b ^ c, 12); \
+  a += b; d = rotl32(d ^ a, 8); \
+  c += d; b = rotl32(b ^ c, 7);
 
-void ChaCha20::Seek(uint64_t pos)
+const unsigned char sigma[] = "expand 32-byte k";
+const unsigned char tau[] = "expand 16-byte k";
+
+/// Internal scalar ChaCha20 implementation, one 64-byte block at a time.
+namespace chacha20
 {
-    input[12] = pos;
-    input[13] = pos >> 32;
-}
 
-void ChaCha20::Keystream(unsigned char* c, size_t bytes)
+void Keystream(uint32_t* input, unsigned char* c, size_t bytes)
 {
     uint32_t x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15;
     uint32_t j0, j1, j2, j3, j4, j5, j6, j7, j8, j9, j10, j11, j12, j13, j14, j15;
@@ -179,7 +149,7 @@ void ChaCha20::Keystream(unsigned char* c, size_t bytes)
     }
 }
 
-void ChaCha20::Crypt(const unsigned char* m, unsigned char* c, size_t bytes)
+void Crypt(uint32_t* input, const unsigned char* m, unsigned char* c, size_t bytes)
 {
     uint32_t x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, x10, x11, x12, x13, x14, x15;
     uint32_t j0, j1, j2, j3, j4, j5, j6, j7, j8, j9, j10, j11, j12, j13, j14, j15;
@@ -308,3 +278,180 @@ void ChaCha20::Crypt(const unsigned char* m, unsigned char* c, size_t bytes)
         m += 64;
     }
 }
+
+} // namespace chacha20
+
+/** Encipher (or, without m, output the keystream of) blocks starting at the block counter in input[12..13]. */
+typedef void (*CryptMultiType)(const uint32_t*, const unsigned char*, unsigned char*);
+
+CryptMultiType Crypt_4way = nullptr;
+CryptMultiType Crypt_8way = nullptr;
+
+/** Advance the 64-bit block counter in input[12..13]. */
+void AdvanceCounter(uint32_t* input, uint64_t blocks)
+{
+    const uint64_t pos = (input[12] | ((uint64_t)input[13] << 32)) + blocks;
+    input[12] = pos;
+    input[13] = pos >> 32;
+}
+
+/** Process as many whole groups of blocks as the multi-way versions allow, leaving the rest for the scalar code. */
+void CryptMultiBlock(uint32_t* input, const unsigned char*& m, unsigned char*& c, size_t& bytes)
+{
+    if (Crypt_8way) {
+        while (bytes >= 512) {
+            Crypt_8way(input, m, c);
+            AdvanceCounter(input, 8);
+            if (m) m += 512;
+            c += 512;
+            bytes -= 512;
+        }
+    }
+    if (Crypt_4way) {
+        while (bytes >= 256) {
+            Crypt_4way(input, m, c);
+            AdvanceCounter(input, 4);
+            if (m) m += 256;
+            c += 256;
+            bytes -= 256;
+        }
+    }
+}
+
+bool SelfTest()
+{
+    // The multi-way versions must agree with the scalar one on unaligned
+    // inputs, including when the low counter word wraps around.
+    uint32_t input[16];
+    for (int i = 0; i < 16; ++i) input[i] = 0x9e3779b9 * (i + 1);
+    input[12] = 0xfffffffd;
+    unsigned char data[513];
+    for (size_t i = 0; i < sizeof(data); ++i) data[i] = i * 0x3b + 0x5f;
+    unsigned char expected_stream[512], expected_crypt[512], out[512];
+    uint32_t scalar[16];
+    std::copy(input, input + 16, scalar);
+    chacha20::Keystream(scalar, expected_stream, 512);
+    std::copy(input, input + 16, scalar);
+    chacha20::Crypt(scalar, data + 1, expected_crypt, 512);
+
+    if (Crypt_4way) {
+        Crypt_4way(input, nullptr, out);
+        if (!std::equal(out, out + 256, expected_stream)) return false;
+        Crypt_4way(input, data + 1, out);
+        if (!std::equal(out, out + 256, expected_crypt)) return false;
+    }
+
+    if (Crypt_8way) {
+        Crypt_8way(input, nullptr, out);
+        if (!std::equal(out, out + 512, expected_stream)) return false;
+        Crypt_8way(input, data + 1, out);
+        if (!std::equal(out, out + 512, expected_crypt)) return false;
+    }
+    return true;
+}
+
+#if defined(USE_ASM) && defined(HAVE_GETCPUID)
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace
+
+void ChaCha20::SetKey(const unsigned char* k, size_t keylen)
+{
+    const unsigned char *constants;
+
+    input[4] = ReadLE32(k + 0);
+    input[5] = ReadLE32(k + 4);
+    input[6] = ReadLE32(k + 8);
+    input[7] = ReadLE32(k + 12);
+    if (keylen == 32) { /* recommended */
+        k += 16;
+        constants = sigma;
+    } else { /* keylen == 16 */
+        constants = tau;
+    }
+    input[8] = ReadLE32(k + 0);
+    input[9] = ReadLE32(k + 4);
+    input[10] = ReadLE32(k + 8);
+    input[11] = ReadLE32(k + 12);
+    input[0] = ReadLE32(constants + 0);
+    input[1] = ReadLE32(constants + 4);
+    input[2] = ReadLE32(constants + 8);
+    input[3] = ReadLE32(constants + 12);
+    input[12] = 0;
+    input[13] = 0;
+    input[14] = 0;
+    input[15] = 0;
+}
+
+ChaCha20::ChaCha20()
+{
+    memset(input, 0, sizeof(input));
+}
+
+ChaCha20::ChaCha20(const unsigned char* k, size_t keylen)
+{
+    SetKey(k, keylen);
+}
+
+void ChaCha20::SetIV(uint64_t iv)
+{
+    input[14] = iv;
+    input[15] = iv >> 32;
+}
+
+void ChaCha20::Seek(uint64_t pos)
+{
+    input[12] = pos;
+    input[13] = pos >> 32;
+}
+
+void ChaCha20::Keystream(unsigned char* c, size_t bytes)
+{
+    const unsigned char* m = nullptr;
+    CryptMultiBlock(input, m, c, bytes);
+    chacha20::Keystream(input, c, bytes);
+}
+
+void ChaCha20::Crypt(const unsigned char* m, unsigned char* c, size_t bytes)
+{
+    CryptMultiBlock(input, m, c, bytes);
+    chacha20::Crypt(input, m, c, bytes);
+}
+
+std::string ChaCha20AutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && !defined(BUILD_PALLADIUM_INTERNAL)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_sse4 = (ecx >> 19) & 1;
+    const bool have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    GetCPUID(7, 0, eax, ebx, ecx, edx);
+    const bool have_avx2 = (ebx >> 5) & 1;
+    (void)have_sse4;
+    (void)have_avx;
+    (void)have_avx2;
+#if defined(ENABLE_SSE41)
+    if (have_sse4) {
+        Crypt_4way = chacha20_sse41::Crypt_4way;
+        ret = "sse41(4way)";
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (have_avx && have_avx2) {
+        Crypt_8way = chacha20_avx2::Crypt_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A class for ChaCha20 256-bit stream cipher developed by Daniel J. Bernstein
     https://cr.yp.to/chacha/chacha-20080128.pdf */
@@ -31,4 +32,7 @@ public:
     void Crypt(const unsigned char* input, unsigned char* output, size_t bytes);
 };
 
+/** Select the fastest multi-block ChaCha20 implementation for this CPU, and return its name. */
+std::string ChaCha20AutoDetect();
+
 #endif // PALLADIUM_CRYPTO_CHACHA20_H
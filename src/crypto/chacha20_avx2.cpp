@@ -0,0 +1,102 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace chacha20_avx2 {
+namespace {
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline RotL(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - n)); }
+/** Rotations by whole bytes are a single byte shuffle. */
+__m256i inline RotL16(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, 2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13)); }
+__m256i inline RotL8(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14, 3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14)); }
+
+void inline __attribute__((always_inline)) QuarterRound(__m256i& a, __m256i& b, __m256i& c, __m256i& d)
+{
+    a = Add(a, b); d = RotL16(Xor(d, a));
+    c = Add(c, d); b = RotL(Xor(b, c), 12);
+    a = Add(a, b); d = RotL8(Xor(d, a));
+    c = Add(c, d); b = RotL(Xor(b, c), 7);
+}
+
+/** Transpose eight vectors holding word i of eight blocks into eight vectors holding words 0..7 of one block. */
+void inline __attribute__((always_inline)) Transpose(__m256i* v)
+{
+    __m256i t0 = _mm256_unpacklo_epi32(v[0], v[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(v[0], v[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(v[2], v[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(v[4], v[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(v[4], v[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(v[6], v[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(v[6], v[7]);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+    v[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    v[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    v[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    v[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    v[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    v[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    v[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    v[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+}
+
+void Crypt_8way(const uint32_t* input, const unsigned char* m, unsigned char* c)
+{
+    __m256i j[16];
+    for (int i = 0; i < 16; ++i) j[i] = _mm256_set1_epi32(input[i]);
+    // Block counters input[12..13] + 0..7, with the carry into the high word.
+    uint32_t lo[8], hi[8];
+    for (int i = 0; i < 8; ++i) {
+        lo[i] = input[12] + i;
+        hi[i] = input[13] + (lo[i] < input[12]);
+    }
+    j[12] = _mm256_loadu_si256((const __m256i*)lo);
+    j[13] = _mm256_loadu_si256((const __m256i*)hi);
+
+    __m256i x[16];
+    for (int i = 0; i < 16; ++i) x[i] = j[i];
+    for (int i = 20; i > 0; i -= 2) {
+        QuarterRound(x[0], x[4], x[8], x[12]);
+        QuarterRound(x[1], x[5], x[9], x[13]);
+        QuarterRound(x[2], x[6], x[10], x[14]);
+        QuarterRound(x[3], x[7], x[11], x[15]);
+        QuarterRound(x[0], x[5], x[10], x[15]);
+        QuarterRound(x[1], x[6], x[11], x[12]);
+        QuarterRound(x[2], x[7], x[8], x[13]);
+        QuarterRound(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; ++i) x[i] = Add(x[i], j[i]);
+
+    // x[0..7] now hold the first half of blocks 0..7 in order, x[8..15] the second half.
+    Transpose(x);
+    Transpose(x + 8);
+    for (int b = 0; b < 8; ++b) {
+        __m256i lo_half = x[b], hi_half = x[8 + b];
+        if (m) {
+            lo_half = Xor(lo_half, _mm256_loadu_si256((const __m256i*)(m + 64 * b)));
+            hi_half = Xor(hi_half, _mm256_loadu_si256((const __m256i*)(m + 64 * b + 32)));
+        }
+        _mm256_storeu_si256((__m256i*)(c + 64 * b), lo_half);
+        _mm256_storeu_si256((__m256i*)(c + 64 * b + 32), hi_half);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,83 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_SSE41
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace chacha20_sse41 {
+namespace {
+
+__m128i inline Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+__m128i inline Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+__m128i inline RotL(__m128i x, int n) { return _mm_or_si128(_mm_slli_epi32(x, n), _mm_srli_epi32(x, 32 - n)); }
+/** Rotations by whole bytes are a single byte shuffle. */
+__m128i inline RotL16(__m128i x) { return _mm_shuffle_epi8(x, _mm_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13)); }
+__m128i inline RotL8(__m128i x) { return _mm_shuffle_epi8(x, _mm_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14)); }
+
+void inline __attribute__((always_inline)) QuarterRound(__m128i& a, __m128i& b, __m128i& c, __m128i& d)
+{
+    a = Add(a, b); d = RotL16(Xor(d, a));
+    c = Add(c, d); b = RotL(Xor(b, c), 12);
+    a = Add(a, b); d = RotL8(Xor(d, a));
+    c = Add(c, d); b = RotL(Xor(b, c), 7);
+}
+
+/** Transpose four vectors holding word i of four blocks into four vectors holding words 0..3 of one block. */
+void inline __attribute__((always_inline)) Transpose(__m128i* v)
+{
+    __m128i t0 = _mm_unpacklo_epi32(v[0], v[1]);
+    __m128i t1 = _mm_unpackhi_epi32(v[0], v[1]);
+    __m128i t2 = _mm_unpacklo_epi32(v[2], v[3]);
+    __m128i t3 = _mm_unpackhi_epi32(v[2], v[3]);
+    v[0] = _mm_unpacklo_epi64(t0, t2);
+    v[1] = _mm_unpackhi_epi64(t0, t2);
+    v[2] = _mm_unpacklo_epi64(t1, t3);
+    v[3] = _mm_unpackhi_epi64(t1, t3);
+}
+
+}
+
+void Crypt_4way(const uint32_t* input, const unsigned char* m, unsigned char* c)
+{
+    __m128i j[16];
+    for (int i = 0; i < 16; ++i) j[i] = _mm_set1_epi32(input[i]);
+    // Block counters input[12..13] + 0..3, with the carry into the high word.
+    uint32_t lo[4], hi[4];
+    for (int i = 0; i < 4; ++i) {
+        lo[i] = input[12] + i;
+        hi[i] = input[13] + (lo[i] < input[12]);
+    }
+    j[12] = _mm_loadu_si128((const __m128i*)lo);
+    j[13] = _mm_loadu_si128((const __m128i*)hi);
+
+    __m128i x[16];
+    for (int i = 0; i < 16; ++i) x[i] = j[i];
+    for (int i = 20; i > 0; i -= 2) {
+        QuarterRound(x[0], x[4], x[8], x[12]);
+        QuarterRound(x[1], x[5], x[9], x[13]);
+        QuarterRound(x[2], x[6], x[10], x[14]);
+        QuarterRound(x[3], x[7], x[11], x[15]);
+        QuarterRound(x[0], x[5], x[10], x[15]);
+        QuarterRound(x[1], x[6], x[11], x[12]);
+        QuarterRound(x[2], x[7], x[8], x[13]);
+        QuarterRound(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; ++i) x[i] = Add(x[i], j[i]);
+
+    // After transposing, x[4 * k + b] holds words 4k..4k+3 of block b.
+    for (int k = 0; k < 4; ++k) Transpose(x + 4 * k);
+    for (int b = 0; b < 4; ++b) {
+        for (int k = 0; k < 4; ++k) {
+            __m128i out = x[4 * k + b];
+            if (m) out = Xor(out, _mm_loadu_si128((const __m128i*)(m + 64 * b + 16 * k)));
+            _mm_storeu_si128((__m128i*)(c + 64 * b + 16 * k), out);
+        }
+    }
+}
+
+}
+
+#endif
@@ -4,6 +4,7 @@
 
 #include <crypto/hmac_sha512.h>
 
+#include <algorithm>
 #include <string.h>
 
 CHMAC_SHA512::CHMAC_SHA512(const unsigned char* key, size_t keylen)
@@ -32,3 +33,16 @@ void CHMAC_SHA512::Finalize(unsigned char hash[OUTPUT_SIZE])
     inner.Finalize(temp);
     outer.Write(temp, 64).Finalize(hash);
 }
+
+void CHMAC_SHA512::FinalizeMany(const unsigned char* msgs, size_t len, size_t count, unsigned char* output) const
+{
+    unsigned char temp[16 * 64];
+    while (count) {
+        const size_t n = std::min<size_t>(count, 16);
+        inner.FinalizeMany(msgs, len, n, temp);
+        outer.FinalizeMany(temp, 64, n, output);
+        msgs += len * n;
+        output += OUTPUT_SIZE * n;
+        count -= n;
+    }
+}
@@ -27,6 +27,13 @@ public:
         return *this;
     }
     void Finalize(unsigned char hash[OUTPUT_SIZE]);
+    /** Compute the HMACs of count messages of len <= 111 bytes each, stored
+     *  consecutively at msgs, into count*64 bytes of output. Must be called
+     *  before anything is written. The key setup is shared by all messages,
+     *  and the remaining two SHA512 blocks of each are batched with
+     *  CSHA512::FinalizeMany.
+     */
+    void FinalizeMany(const unsigned char* msgs, size_t len, size_t count, unsigned char* output) const;
 };
 
 #endif // PALLADIUM_CRYPTO_HMAC_SHA512_H
@@ -2,14 +2,129 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-// Based on the public domain implementation by Andrew Moon
-// poly1305-donna-unrolled.c from https://github.com/floodyberry/poly1305-donna
+// Based on the public domain implementations by Andrew Moon
+// poly1305-donna-64.h and poly1305-donna-unrolled.c from https://github.com/floodyberry/poly1305-donna
 
 #include <crypto/common.h>
 #include <crypto/poly1305.h>
 
 #include <string.h>
 
+#if defined(__SIZEOF_INT128__)
+
+// With 64x64->128 bit multiplies, the accumulator fits in three 44/44/42-bit
+// limbs, which takes about half the multiplications of the 26-bit version.
+
+namespace {
+
+typedef unsigned __int128 uint128_t;
+
+/** Absorb whole 16-byte blocks of m into h. hibit is 1 << 40 (2^128) for full blocks and 0 for the padded final one. */
+void poly1305_blocks(uint64_t h[3], const uint64_t r[3], const unsigned char* m, size_t inlen, uint64_t hibit)
+{
+    const uint64_t r0 = r[0], r1 = r[1], r2 = r[2];
+    const uint64_t s1 = r1 * (5 << 2);
+    const uint64_t s2 = r2 * (5 << 2);
+    uint64_t h0 = h[0], h1 = h[1], h2 = h[2];
+    uint64_t c;
+
+    while (inlen >= 16) {
+        const uint64_t t0 = ReadLE64(m);
+        const uint64_t t1 = ReadLE64(m + 8);
+
+        h0 += t0 & 0xfffffffffff;
+        h1 += ((t0 >> 44) | (t1 << 20)) & 0xfffffffffff;
+        h2 += ((t1 >> 24) & 0x3ffffffffff) | hibit;
+
+        /* h *= r */
+        uint128_t d0 = (uint128_t)h0 * r0 + (uint128_t)h1 * s2 + (uint128_t)h2 * s1;
+        uint128_t d1 = (uint128_t)h0 * r1 + (uint128_t)h1 * r0 + (uint128_t)h2 * s2;
+        uint128_t d2 = (uint128_t)h0 * r2 + (uint128_t)h1 * r1 + (uint128_t)h2 * r0;
+
+        /* (partial) h %= p */
+                   c = (uint64_t)(d0 >> 44); h0 = (uint64_t)d0 & 0xfffffffffff;
+        d1 += c;   c = (uint64_t)(d1 >> 44); h1 = (uint64_t)d1 & 0xfffffffffff;
+        d2 += c;   c = (uint64_t)(d2 >> 42); h2 = (uint64_t)d2 & 0x3ffffffffff;
+        h0 += c * 5; c = h0 >> 44; h0 &= 0xfffffffffff;
+        h1 += c;
+
+        m += 16;
+        inlen -= 16;
+    }
+
+    h[0] = h0;
+    h[1] = h1;
+    h[2] = h2;
+}
+
+} // namespace
+
+void poly1305_auth(unsigned char out[POLY1305_TAGLEN], const unsigned char *m, size_t inlen, const unsigned char key[POLY1305_KEYLEN]) {
+    uint64_t t0, t1;
+    uint64_t r[3];
+    uint64_t h[3] = {0, 0, 0};
+    uint64_t h0, h1, h2, g0, g1, g2, c;
+
+    /* clamp key */
+    t0 = ReadLE64(key + 0);
+    t1 = ReadLE64(key + 8);
+    r[0] = t0 & 0xffc0fffffff;
+    r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+    r[2] = (t1 >> 24) & 0x00ffffffc0f;
+
+    /* full blocks */
+    poly1305_blocks(h, r, m, inlen, (uint64_t)1 << 40);
+    m += inlen & ~(size_t)15;
+    inlen &= 15;
+
+    /* final bytes */
+    if (inlen) {
+        unsigned char mp[16];
+        memcpy(mp, m, inlen);
+        mp[inlen] = 1;
+        memset(mp + inlen + 1, 0, 16 - inlen - 1);
+        poly1305_blocks(h, r, mp, 16, 0);
+    }
+
+    /* fully carry h */
+    h0 = h[0]; h1 = h[1]; h2 = h[2];
+                 c = (h1 >> 44); h1 &= 0xfffffffffff;
+    h2 += c;     c = (h2 >> 42); h2 &= 0x3ffffffffff;
+    h0 += c * 5; c = (h0 >> 44); h0 &= 0xfffffffffff;
+    h1 += c;     c = (h1 >> 44); h1 &= 0xfffffffffff;
+    h2 += c;     c = (h2 >> 42); h2 &= 0x3ffffffffff;
+    h0 += c * 5; c = (h0 >> 44); h0 &= 0xfffffffffff;
+    h1 += c;
+
+    /* compute h + -p */
+    g0 = h0 + 5; c = (g0 >> 44); g0 &= 0xfffffffffff;
+    g1 = h1 + c; c = (g1 >> 44); g1 &= 0xfffffffffff;
+    g2 = h2 + c - ((uint64_t)1 << 42);
+
+    /* select h if h < p, or h + -p if h >= p */
+    c = (g2 >> 63) - 1;
+    g0 &= c;
+    g1 &= c;
+    g2 &= c;
+    c = ~c;
+    h0 = (h0 & c) | g0;
+    h1 = (h1 & c) | g1;
+    h2 = (h2 & c) | g2;
+
+    /* h = (h + pad) */
+    t0 = ReadLE64(key + 16);
+    t1 = ReadLE64(key + 24);
+    h0 += (t0 & 0xfffffffffff);                         c = (h0 >> 44); h0 &= 0xfffffffffff;
+    h1 += (((t0 >> 44) | (t1 << 20)) & 0xfffffffffff) + c; c = (h1 >> 44); h1 &= 0xfffffffffff;
+    h2 += ((t1 >> 24) & 0x3ffffffffff) + c;                                   h2 &= 0x3ffffffffff;
+
+    /* mac = h % (2^128) */
+    WriteLE64(&out[0], h0 | (h1 << 44));
+    WriteLE64(&out[8], (h1 >> 20) | (h2 << 24));
+}
+
+#else
+
 #define mul32x32_64(a,b) ((uint64_t)(a) * (b))
 
 void poly1305_auth(unsigned char out[POLY1305_TAGLEN], const unsigned char *m, size_t inlen, const unsigned char key[POLY1305_KEYLEN]) {
@@ -139,3 +254,5 @@ poly1305_donna_finish:
     WriteLE32(&out[ 8], f2); f3 += (f2 >> 32);
     WriteLE32(&out[12], f3);
 }
+
+#endif
@@ -5,9 +5,22 @@
 #include <crypto/ripemd160.h>
 
 #include <crypto/common.h>
+#include <compat/cpuid.h>
 
+#include <algorithm>
+#include <assert.h>
 #include <string.h>
 
+namespace ripemd160_sse41
+{
+void Transform32_4way(unsigned char* out, const unsigned char* in);
+}
+
+namespace ripemd160_avx2
+{
+void Transform32_8way(unsigned char* out, const unsigned char* in);
+}
+
 // Internal implementation code.
 namespace
 {
@@ -233,8 +246,65 @@ void Transform(uint32_t* s, const unsigned char* chunk)
     s[4] = t + b1 + c2;
 }
 
+/** RIPEMD-160 of a 32-byte message, which fits in a single padded block. */
+void Transform32(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[5];
+    unsigned char buffer[64] = {
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0
+    };
+    memcpy(buffer, in, 32);
+    Initialize(s);
+    Transform(s, buffer);
+    WriteLE32(out, s[0]);
+    WriteLE32(out + 4, s[1]);
+    WriteLE32(out + 8, s[2]);
+    WriteLE32(out + 12, s[3]);
+    WriteLE32(out + 16, s[4]);
+}
+
 } // namespace ripemd160
 
+typedef void (*Transform32Type)(unsigned char*, const unsigned char*);
+
+Transform32Type Transform32_4way = nullptr;
+Transform32Type Transform32_8way = nullptr;
+
+bool SelfTest()
+{
+    // The multi-way versions must agree with the scalar one on unaligned inputs.
+    unsigned char data[257];
+    for (size_t i = 0; i < sizeof(data); ++i) data[i] = i * 0x9d + 0x17;
+    unsigned char expected[160];
+    for (int i = 0; i < 8; ++i) ripemd160::Transform32(expected + 20 * i, data + 1 + 32 * i);
+
+    if (Transform32_4way) {
+        unsigned char out[80];
+        Transform32_4way(out, data + 1);
+        if (!std::equal(out, out + 80, expected)) return false;
+    }
+
+    if (Transform32_8way) {
+        unsigned char out[160];
+        Transform32_8way(out, data + 1);
+        if (!std::equal(out, out + 160, expected)) return false;
+    }
+    return true;
+}
+
+#if defined(USE_ASM) && defined(HAVE_GETCPUID)
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
 } // namespace
 
 ////// RIPEMD160
@@ -290,3 +360,60 @@ CRIPEMD160& CRIPEMD160::Reset()
     ripemd160::Initialize(s);
     return *this;
 }
+
+void RIPEMD160_32(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (Transform32_8way) {
+        while (blocks >= 8) {
+            Transform32_8way(out, in);
+            out += 160;
+            in += 256;
+            blocks -= 8;
+        }
+    }
+    if (Transform32_4way) {
+        while (blocks >= 4) {
+            Transform32_4way(out, in);
+            out += 80;
+            in += 128;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        ripemd160::Transform32(out, in);
+        out += 20;
+        in += 32;
+        --blocks;
+    }
+}
+
+std::string RIPEMD160AutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && !defined(BUILD_PALLADIUM_INTERNAL)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_sse4 = (ecx >> 19) & 1;
+    const bool have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    GetCPUID(7, 0, eax, ebx, ecx, edx);
+    const bool have_avx2 = (ebx >> 5) & 1;
+    (void)have_sse4;
+    (void)have_avx;
+    (void)have_avx2;
+#if defined(ENABLE_SSE41)
+    if (have_sse4) {
+        Transform32_4way = ripemd160_sse41::Transform32_4way;
+        ret = "sse41(4way)";
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (have_avx && have_avx2) {
+        Transform32_8way = ripemd160_avx2::Transform32_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for RIPEMD-160. */
 class CRIPEMD160
@@ -25,4 +26,14 @@ public:
     CRIPEMD160& Reset();
 };
 
+/** Compute multiple RIPEMD-160's of 32-byte blobs, such as the SHA256 halves of Hash160.
+ *  output:  pointer to a blocks*20 byte output buffer
+ *  input:   pointer to a blocks*32 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ */
+void RIPEMD160_32(unsigned char* output, const unsigned char* input, size_t blocks);
+
+/** Select the fastest RIPEMD160_32 implementation for this CPU, and return its name. */
+std::string RIPEMD160AutoDetect();
+
 #endif // PALLADIUM_CRYPTO_RIPEMD160_H
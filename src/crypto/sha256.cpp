@@ -22,16 +22,23 @@ void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
 namespace sha256d64_sse41
 {
 void Transform_4way(unsigned char* out, const unsigned char* in);
+void TransformD80_4way(unsigned char* out, const unsigned char* in);
+void Transform33_4way(unsigned char* out, const unsigned char* in);
+void TransformMulti_4way(uint32_t* s, const unsigned char* const* chunks);
 }
 
 namespace sha256d64_avx2
 {
 void Transform_8way(unsigned char* out, const unsigned char* in);
+void TransformD80_8way(unsigned char* out, const unsigned char* in);
+void Transform33_8way(unsigned char* out, const unsigned char* in);
+void TransformMulti_8way(uint32_t* s, const unsigned char* const* chunks);
 }
 
 namespace sha256d64_shani
 {
 void Transform_2way(unsigned char* out, const unsigned char* in);
+void TransformD80_2way(unsigned char* out, const unsigned char* in);
 }
 
 namespace sha256_shani
@@ -416,6 +423,9 @@ void TransformD64(unsigned char* out, const unsigned char* in)
 
 typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
 typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+typedef void (*TransformD80Type)(unsigned char*, const unsigned char*);
+typedef void (*Transform33Type)(unsigned char*, const unsigned char*);
+typedef void (*TransformMultiType)(uint32_t*, const unsigned char* const*);
 
 template<TransformType tr>
 void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
@@ -456,11 +466,215 @@ void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
     WriteBE32(out + 28, s[7]);
 }
 
+template<TransformType tr>
+void TransformD80Wrapper(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    unsigned char buffer1[64] = {
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0x80
+    };
+    unsigned char buffer2[64] = {
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    memcpy(buffer1, in + 64, 16);
+    tr(s, buffer1, 1);
+    WriteBE32(buffer2 + 0, s[0]);
+    WriteBE32(buffer2 + 4, s[1]);
+    WriteBE32(buffer2 + 8, s[2]);
+    WriteBE32(buffer2 + 12, s[3]);
+    WriteBE32(buffer2 + 16, s[4]);
+    WriteBE32(buffer2 + 20, s[5]);
+    WriteBE32(buffer2 + 24, s[6]);
+    WriteBE32(buffer2 + 28, s[7]);
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    WriteBE32(out + 0, s[0]);
+    WriteBE32(out + 4, s[1]);
+    WriteBE32(out + 8, s[2]);
+    WriteBE32(out + 12, s[3]);
+    WriteBE32(out + 16, s[4]);
+    WriteBE32(out + 20, s[5]);
+    WriteBE32(out + 24, s[6]);
+    WriteBE32(out + 28, s[7]);
+}
+
+/** SHA256 of a 33-byte message, which fits in a single padded block. */
+template<TransformType tr>
+void Transform33Wrapper(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    unsigned char buffer[64] = {
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0x08
+    };
+    memcpy(buffer, in, 33);
+    sha256::Initialize(s);
+    tr(s, buffer, 1);
+    WriteBE32(out + 0, s[0]);
+    WriteBE32(out + 4, s[1]);
+    WriteBE32(out + 8, s[2]);
+    WriteBE32(out + 12, s[3]);
+    WriteBE32(out + 16, s[4]);
+    WriteBE32(out + 20, s[5]);
+    WriteBE32(out + 24, s[6]);
+    WriteBE32(out + 28, s[7]);
+}
+
 TransformType Transform = sha256::Transform;
 TransformD64Type TransformD64 = sha256::TransformD64;
 TransformD64Type TransformD64_2way = nullptr;
 TransformD64Type TransformD64_4way = nullptr;
 TransformD64Type TransformD64_8way = nullptr;
+TransformD80Type TransformD80 = TransformD80Wrapper<sha256::Transform>;
+TransformD80Type TransformD80_2way = nullptr;
+TransformD80Type TransformD80_4way = nullptr;
+TransformD80Type TransformD80_8way = nullptr;
+Transform33Type Transform33 = Transform33Wrapper<sha256::Transform>;
+Transform33Type Transform33_4way = nullptr;
+Transform33Type Transform33_8way = nullptr;
+TransformMultiType TransformMulti_4way = nullptr;
+TransformMultiType TransformMulti_8way = nullptr;
+
+/** Write the 32-byte hash held in state s. */
+void inline WriteState(unsigned char* out, const uint32_t* s)
+{
+    for (int i = 0; i < 8; ++i) WriteBE32(out + 4 * i, s[i]);
+}
+
+/** Double-SHA256 of a message of any length, hashing its full chunks in place. */
+void SHA256DOne(unsigned char* out, const unsigned char* in, size_t size)
+{
+    uint32_t s[8];
+    sha256::Initialize(s);
+    Transform(s, in, size / 64);
+    unsigned char buffer[128] = {0};
+    const size_t rem = size % 64;
+    const size_t tail = rem < 56 ? 64 : 128;
+    if (rem) memcpy(buffer, in + size - rem, rem);
+    buffer[rem] = 0x80;
+    WriteBE64(buffer + tail - 8, size << 3);
+    Transform(s, buffer, tail / 64);
+
+    memset(buffer, 0, 64);
+    WriteState(buffer, s);
+    buffer[32] = 0x80;
+    WriteBE64(buffer + 56, 256);
+    sha256::Initialize(s);
+    Transform(s, buffer, 1);
+    WriteState(out, s);
+}
+
+/** A message being double-hashed in one lane of a multi-way transform. */
+struct HashLane {
+    size_t index;
+    const unsigned char* data;
+    //! Bytes of data hashed in place: all its full 64-byte chunks.
+    size_t full;
+    size_t pos;
+    //! The padded tail of the message, then the padded first hash.
+    unsigned char pad[128];
+    size_t pad_blocks;
+    size_t pad_pos;
+    bool second;
+    bool active{false};
+
+    void Start(size_t i, const unsigned char* in, size_t size, uint32_t* s)
+    {
+        index = i;
+        data = in;
+        full = size - size % 64;
+        pos = 0;
+        const size_t rem = size - full;
+        pad_blocks = rem < 56 ? 1 : 2;
+        pad_pos = 0;
+        memset(pad, 0, sizeof(pad));
+        if (rem) memcpy(pad, in + full, rem);
+        pad[rem] = 0x80;
+        WriteBE64(pad + 64 * pad_blocks - 8, size << 3);
+        second = false;
+        active = true;
+        sha256::Initialize(s);
+    }
+
+    //! The next chunk to transform s with.
+    const unsigned char* Chunk() const { return pos < full ? data + pos : pad + 64 * pad_pos; }
+
+    //! Move past the chunk s was just transformed with. Returns true once s holds the double hash.
+    bool Next(uint32_t* s)
+    {
+        if (pos < full) {
+            pos += 64;
+            return false;
+        }
+        if (++pad_pos < pad_blocks) return false;
+        if (second) return true;
+        // The first hash is complete; continue with the hash of it.
+        memset(pad, 0, 64);
+        WriteState(pad, s);
+        pad[32] = 0x80;
+        WriteBE64(pad + 56, 256);
+        pad_blocks = 1;
+        pad_pos = 0;
+        second = true;
+        sha256::Initialize(s);
+        return false;
+    }
+};
+
+/**
+ * Double-SHA256 count >= N messages with an N-way transform. Every lane
+ * hashes its own message and picks up the next one as soon as it is done, so
+ * that lanes stay busy regardless of the message sizes.
+ */
+template<size_t N>
+void SHA256DManyWay(TransformMultiType tr, unsigned char* out, const unsigned char* const* in, const size_t* sizes, size_t count)
+{
+    static const unsigned char idle_chunk[64] = {0};
+    uint32_t s[8 * N] = {0};
+    HashLane lanes[N];
+    const unsigned char* chunks[N];
+    size_t next = 0;
+    size_t active = 0;
+    for (size_t i = 0; i < N && next < count; ++i, ++next, ++active) {
+        lanes[i].Start(next, in[next], sizes[next], s + 8 * i);
+    }
+    // Lanes are only left idle once all messages were started; when half of
+    // them are, the remaining messages are finished one at a time.
+    while (active > N / 2) {
+        for (size_t i = 0; i < N; ++i) chunks[i] = lanes[i].active ? lanes[i].Chunk() : idle_chunk;
+        tr(s, chunks);
+        for (size_t i = 0; i < N; ++i) {
+            HashLane& lane = lanes[i];
+            if (!lane.active || !lane.Next(s + 8 * i)) continue;
+            WriteState(out + 32 * lane.index, s + 8 * i);
+            if (next < count) {
+                lane.Start(next, in[next], sizes[next], s + 8 * i);
+                ++next;
+            } else {
+                lane.active = false;
+                --active;
+            }
+        }
+    }
+    for (size_t i = 0; i < N; ++i) {
+        HashLane& lane = lanes[i];
+        if (!lane.active) continue;
+        do {
+            Transform(s + 8 * i, lane.Chunk(), 1);
+        } while (!lane.Next(s + 8 * i));
+        WriteState(out + 32 * lane.index, s + 8 * i);
+    }
+}
 
 bool SelfTest() {
     // Input state (equal to the initial SHA256 state)
@@ -508,6 +722,26 @@ bool SelfTest() {
         0x6a, 0x46, 0x30, 0xa6, 0x89, 0x86, 0x23, 0xac, 0xf8, 0xa5, 0x15, 0xe9, 0x0a, 0xaa, 0x1e, 0x9a,
         0xd7, 0x93, 0x6b, 0x28, 0xe4, 0x3b, 0xfd, 0x59, 0xc6, 0xed, 0x7c, 0x5f, 0xa5, 0x41, 0xcb, 0x51
     };
+    // Expected output for each of the individual 8 80-byte messages under full double SHA256 (including padding),
+    // taken from the input above followed by its first 128 bytes again.
+    static const unsigned char result_d80[256] = {
+        0xe9, 0x82, 0xae, 0xd1, 0xa6, 0x27, 0x65, 0x01, 0xcd, 0x7d, 0x10, 0xaf, 0x74, 0x2a, 0xcb, 0x36,
+        0xd5, 0xcd, 0xa4, 0x06, 0x31, 0x8f, 0xd4, 0x98, 0x7e, 0x2e, 0x5e, 0x2a, 0x02, 0x16, 0x93, 0x2b,
+        0xd3, 0x59, 0x99, 0xe4, 0xee, 0x33, 0xc4, 0xad, 0xfd, 0x13, 0xf1, 0x25, 0xd8, 0xd2, 0x82, 0xd4,
+        0x8f, 0xfb, 0xc6, 0xa9, 0x89, 0xe5, 0xe8, 0x04, 0x28, 0xa7, 0xb2, 0x8a, 0xa3, 0x30, 0x90, 0xb0,
+        0xbd, 0x93, 0x41, 0x4b, 0xfc, 0xd2, 0xbe, 0x42, 0x95, 0xe7, 0x67, 0x15, 0xa2, 0x39, 0x5d, 0xe9,
+        0x25, 0x67, 0x5d, 0x57, 0x8d, 0x10, 0x3c, 0x11, 0xf5, 0xb6, 0x1d, 0xd6, 0x6d, 0x0b, 0x0d, 0x74,
+        0x44, 0x26, 0x8b, 0x8b, 0x88, 0x89, 0x31, 0x51, 0xb1, 0x51, 0x31, 0xf7, 0x67, 0x4c, 0x78, 0x15,
+        0x25, 0x08, 0xff, 0x0b, 0x4f, 0xfd, 0x0b, 0x3d, 0xef, 0x8a, 0x9c, 0x1d, 0x01, 0xcc, 0xaa, 0x79,
+        0xaa, 0xb0, 0x80, 0x33, 0x66, 0x2e, 0x50, 0x34, 0x59, 0x36, 0x5a, 0xd3, 0x79, 0x95, 0xc2, 0xf0,
+        0x00, 0x2b, 0x5e, 0x49, 0x16, 0xb2, 0xce, 0xe8, 0x42, 0x72, 0x40, 0x5a, 0x14, 0xec, 0x4c, 0xe8,
+        0x8b, 0x44, 0x60, 0xa3, 0x8e, 0x1a, 0x02, 0x9c, 0x3a, 0x70, 0xeb, 0x6d, 0x5d, 0x22, 0x21, 0x94,
+        0x9b, 0xa3, 0xfc, 0x1b, 0xb8, 0x65, 0x9b, 0x81, 0xd2, 0x49, 0x36, 0x6b, 0x7e, 0x7d, 0x43, 0xf5,
+        0x34, 0x30, 0xff, 0x61, 0x6f, 0x25, 0x96, 0x02, 0xf6, 0x1a, 0x96, 0xf3, 0x41, 0xdb, 0xd1, 0x39,
+        0x5d, 0x24, 0xc8, 0xbd, 0x17, 0x3a, 0x03, 0xb0, 0x7b, 0xb5, 0x97, 0x1d, 0xf8, 0x86, 0x51, 0x31,
+        0xcb, 0x68, 0x18, 0xf3, 0x06, 0x3a, 0xb6, 0x00, 0x0f, 0x8b, 0xb0, 0x29, 0x84, 0xb9, 0xb6, 0x62,
+        0xee, 0xb0, 0xb9, 0xfe, 0x8d, 0xf5, 0x8e, 0x31, 0xe0, 0x51, 0x17, 0x74, 0x62, 0xfa, 0xcb, 0x91
+    };
 
 
     // Test Transform() for 0 through 8 transformations.
@@ -544,6 +778,85 @@ bool SelfTest() {
         if (!std::equal(out, out + 256, result_d64)) return false;
     }
 
+    unsigned char data80[640];
+    std::copy(data + 1, data + 513, data80);
+    std::copy(data + 1, data + 129, data80 + 512);
+
+    // Test TransformD80
+    TransformD80(out, data80);
+    if (!std::equal(out, out + 32, result_d80)) return false;
+
+    // Test TransformD80_2way, if available.
+    if (TransformD80_2way) {
+        unsigned char out[64];
+        TransformD80_2way(out, data80);
+        if (!std::equal(out, out + 64, result_d80)) return false;
+    }
+
+    // Test TransformD80_4way, if available.
+    if (TransformD80_4way) {
+        unsigned char out[128];
+        TransformD80_4way(out, data80);
+        if (!std::equal(out, out + 128, result_d80)) return false;
+    }
+
+    // Test TransformD80_8way, if available.
+    if (TransformD80_8way) {
+        unsigned char out[256];
+        TransformD80_8way(out, data80);
+        if (!std::equal(out, out + 256, result_d80)) return false;
+    }
+
+    // Test Transform33 and its multi-way versions against a wrapper around
+    // the plain Transform tested above.
+    unsigned char result_33[256];
+    for (int i = 0; i < 8; ++i) {
+        Transform33Wrapper<sha256::Transform>(result_33 + 32 * i, data + 1 + 33 * i);
+        Transform33(out, data + 1 + 33 * i);
+        if (!std::equal(out, out + 32, result_33 + 32 * i)) return false;
+    }
+
+    // Test Transform33_4way, if available.
+    if (Transform33_4way) {
+        unsigned char out[128];
+        Transform33_4way(out, data + 1);
+        if (!std::equal(out, out + 128, result_33)) return false;
+    }
+
+    // Test Transform33_8way, if available.
+    if (Transform33_8way) {
+        unsigned char out[256];
+        Transform33_8way(out, data + 1);
+        if (!std::equal(out, out + 256, result_33)) return false;
+    }
+
+    // Test TransformMulti_4way and TransformMulti_8way, if available: lane i
+    // continues the state after i chunks of the input with the next one.
+    if (TransformMulti_4way) {
+        uint32_t states[32];
+        const unsigned char* chunks[4];
+        for (int i = 0; i < 4; ++i) {
+            std::copy(result[i], result[i] + 8, states + 8 * i);
+            chunks[i] = data + 1 + 64 * i;
+        }
+        TransformMulti_4way(states, chunks);
+        for (int i = 0; i < 4; ++i) {
+            if (!std::equal(states + 8 * i, states + 8 * i + 8, result[i + 1])) return false;
+        }
+    }
+    if (TransformMulti_8way) {
+        uint32_t states[64];
+        const unsigned char* chunks[8];
+        for (int i = 0; i < 8; ++i) {
+            std::copy(result[i], result[i] + 8, states + 8 * i);
+            chunks[i] = data + 1 + 64 * i;
+        }
+        TransformMulti_8way(states, chunks);
+        for (int i = 0; i < 8; ++i) {
+            if (!std::equal(states + 8 * i, states + 8 * i + 8, result[i + 1])) return false;
+        }
+    }
+
     return true;
 }
 
@@ -597,6 +910,9 @@ std::string SHA256AutoDetect()
         Transform = sha256_shani::Transform;
         TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
         TransformD64_2way = sha256d64_shani::Transform_2way;
+        TransformD80 = TransformD80Wrapper<sha256_shani::Transform>;
+        Transform33 = Transform33Wrapper<sha256_shani::Transform>;
+        TransformD80_2way = sha256d64_shani::TransformD80_2way;
         ret = "shani(1way,2way)";
         have_sse4 = false; // Disable SSE4/AVX2;
         have_avx2 = false;
@@ -607,10 +923,15 @@ std::string SHA256AutoDetect()
 #if defined(__x86_64__) || defined(__amd64__)
         Transform = sha256_sse4::Transform;
         TransformD64 = TransformD64Wrapper<sha256_sse4::Transform>;
+        TransformD80 = TransformD80Wrapper<sha256_sse4::Transform>;
+        Transform33 = Transform33Wrapper<sha256_sse4::Transform>;
         ret = "sse4(1way)";
 #endif
 #if defined(ENABLE_SSE41) && !defined(BUILD_PALLADIUM_INTERNAL)
         TransformD64_4way = sha256d64_sse41::Transform_4way;
+        TransformD80_4way = sha256d64_sse41::TransformD80_4way;
+        Transform33_4way = sha256d64_sse41::Transform33_4way;
+        TransformMulti_4way = sha256d64_sse41::TransformMulti_4way;
         ret += ",sse41(4way)";
 #endif
     }
@@ -618,6 +939,9 @@ std::string SHA256AutoDetect()
 #if defined(ENABLE_AVX2) && !defined(BUILD_PALLADIUM_INTERNAL)
     if (have_avx2 && have_avx && enabled_avx) {
         TransformD64_8way = sha256d64_avx2::Transform_8way;
+        TransformD80_8way = sha256d64_avx2::TransformD80_8way;
+        Transform33_8way = sha256d64_avx2::Transform33_8way;
+        TransformMulti_8way = sha256d64_avx2::TransformMulti_8way;
         ret += ",avx2(8way)";
     }
 #endif
@@ -717,3 +1041,72 @@ void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
         --blocks;
     }
 }
+
+void SHA256D80(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD80_8way) {
+        while (blocks >= 8) {
+            TransformD80_8way(out, in);
+            out += 256;
+            in += 640;
+            blocks -= 8;
+        }
+    }
+    if (TransformD80_4way) {
+        while (blocks >= 4) {
+            TransformD80_4way(out, in);
+            out += 128;
+            in += 320;
+            blocks -= 4;
+        }
+    }
+    if (TransformD80_2way) {
+        while (blocks >= 2) {
+            TransformD80_2way(out, in);
+            out += 64;
+            in += 160;
+            blocks -= 2;
+        }
+    }
+    while (blocks) {
+        TransformD80(out, in);
+        out += 32;
+        in += 80;
+        --blocks;
+    }
+}
+
+void SHA256_33(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (Transform33_8way) {
+        while (blocks >= 8) {
+            Transform33_8way(out, in);
+            out += 256;
+            in += 264;
+            blocks -= 8;
+        }
+    }
+    if (Transform33_4way) {
+        while (blocks >= 4) {
+            Transform33_4way(out, in);
+            out += 128;
+            in += 132;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        Transform33(out, in);
+        out += 32;
+        in += 33;
+        --blocks;
+    }
+}
+
+void SHA256DMany(unsigned char* out, const unsigned char* const* in, const size_t* sizes, size_t count)
+{
+    if (TransformMulti_8way && count >= 8) return SHA256DManyWay<8>(TransformMulti_8way, out, in, sizes, count);
+    if (TransformMulti_4way && count >= 4) return SHA256DManyWay<4>(TransformMulti_4way, out, in, sizes, count);
+    for (size_t i = 0; i < count; ++i) {
+        SHA256DOne(out + 32 * i, in[i], sizes[i]);
+    }
+}
@@ -38,4 +38,26 @@ std::string SHA256AutoDetect();
  */
 void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
 
+/** Compute multiple double-SHA256's of 80-byte blobs, such as serialized block headers.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*80 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ */
+void SHA256D80(unsigned char* output, const unsigned char* input, size_t blocks);
+
+/** Compute multiple (single) SHA256's of 33-byte blobs, such as compressed public keys.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*33 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ */
+void SHA256_33(unsigned char* output, const unsigned char* input, size_t blocks);
+
+/** Compute multiple double-SHA256's of messages of any length, such as serialized transactions.
+ *  output:  pointer to a count*32 byte output buffer
+ *  inputs:  pointers to the messages
+ *  sizes:   the length of each message
+ *  count:   the number of hashes to compute.
+ */
+void SHA256DMany(unsigned char* output, const unsigned char* const* inputs, const size_t* sizes, size_t count);
+
 #endif // PALLADIUM_CRYPTO_SHA256_H
@@ -5,9 +5,17 @@
 #include <crypto/sha512.h>
 
 #include <crypto/common.h>
+#include <compat/cpuid.h>
 
+#include <algorithm>
+#include <assert.h>
 #include <string.h>
 
+namespace sha512_avx2
+{
+void Transform_4way(uint64_t* s, const unsigned char* in);
+}
+
 // Internal implementation code.
 namespace
 {
@@ -146,8 +154,55 @@ void Transform(uint64_t* s, const unsigned char* chunk)
 
 } // namespace sha512
 
+/** Transform four states (4*8 words) with four consecutive chunks. */
+typedef void (*Transform4WayType)(uint64_t*, const unsigned char*);
+
+Transform4WayType Transform_4way = nullptr;
+
+bool SelfTest()
+{
+    if (!Transform_4way) return true;
+    // Some unaligned input and distinct states, checked against the scalar transform
+    unsigned char data[4 * 128 + 1];
+    for (size_t i = 0; i < sizeof(data); ++i) data[i] = i * 0x35 + 0x7b;
+    uint64_t states[32], expected[32];
+    for (int i = 0; i < 32; ++i) states[i] = expected[i] = 0x0123456789abcdefull * (i + 1);
+    for (int i = 0; i < 4; ++i) sha512::Transform(expected + 8 * i, data + 1 + 128 * i);
+    Transform_4way(states, data + 1);
+    return std::equal(states, states + 32, expected);
+}
+
+#if defined(USE_ASM) && defined(HAVE_GETCPUID)
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
 } // namespace
 
+std::string SHA512AutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_AVX2) && !defined(BUILD_PALLADIUM_INTERNAL)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    GetCPUID(7, 0, eax, ebx, ecx, edx);
+    const bool have_avx2 = (ebx >> 5) & 1;
+    if (have_avx && have_avx2) {
+        Transform_4way = sha512_avx2::Transform_4way;
+        ret = "avx2(4way)";
+    }
+#endif
+
+    assert(SelfTest());
+    return ret;
+}
+
 
 ////// SHA-512
 
@@ -205,3 +260,33 @@ CSHA512& CSHA512::Reset()
     sha512::Initialize(s);
     return *this;
 }
+
+void CSHA512::FinalizeMany(const unsigned char* tails, size_t len, size_t count, unsigned char* output) const
+{
+    assert(bytes % 128 == 0 && len <= 111);
+    // Every final block is its tail followed by the same padding and length
+    unsigned char blocks[4 * 128] = {0};
+    for (int i = 0; i < 4; ++i) {
+        blocks[128 * i + len] = 0x80;
+        WriteBE64(blocks + 128 * i + 120, (bytes + len) << 3);
+    }
+    uint64_t states[4 * 8];
+    while (count) {
+        const size_t n = std::min<size_t>(count, 4);
+        for (size_t i = 0; i < n; ++i) {
+            if (len) memcpy(blocks + 128 * i, tails + len * i, len);
+            std::copy(s, s + 8, states + 8 * i);
+        }
+        if (n == 4 && Transform_4way) {
+            Transform_4way(states, blocks);
+        } else {
+            for (size_t i = 0; i < n; ++i) sha512::Transform(states + 8 * i, blocks + 128 * i);
+        }
+        for (size_t i = 0; i < n * 8; ++i) {
+            WriteBE64(output + 8 * i, states[i]);
+        }
+        tails += len * n;
+        output += OUTPUT_SIZE * n;
+        count -= n;
+    }
+}
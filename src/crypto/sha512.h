@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-512. */
 class CSHA512
@@ -24,6 +25,17 @@ public:
     void Finalize(unsigned char hash[OUTPUT_SIZE]);
     CSHA512& Reset();
     uint64_t Size() const { return bytes; }
+
+    /** Finish count copies of this hasher into count*64 bytes of output, the
+     *  i-th one after also writing the len bytes at tails + i * len. Needs a
+     *  multiple of 128 bytes written so far and len <= 111, so that every copy
+     *  ends with a single block; those blocks are hashed four at a time when
+     *  the CPU allows (see SHA512AutoDetect).
+     */
+    void FinalizeMany(const unsigned char* tails, size_t len, size_t count, unsigned char* output) const;
 };
 
+/** Select the fastest multi-way SHA512 implementation for this CPU, and return its name. */
+std::string SHA512AutoDetect();
+
 #endif // PALLADIUM_CRYPTO_SHA512_H
@@ -0,0 +1,174 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include <crypto/common.h>
+
+namespace sha512_avx2 {
+namespace {
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z, __m256i w) { return Add(Add(x, y), Add(z, w)); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z, __m256i w, __m256i v) { return Add(Add(x, y, z), Add(w, v)); }
+__m256i inline Inc(__m256i& x, __m256i y, __m256i z, __m256i w) { x = Add(x, y, z, w); return x; }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+__m256i inline Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+__m256i inline And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+__m256i inline ShR(__m256i x, int n) { return _mm256_srli_epi64(x, n); }
+__m256i inline ShL(__m256i x, int n) { return _mm256_slli_epi64(x, n); }
+__m256i inline RotR(__m256i x, int n) { return Or(ShR(x, n), ShL(x, 64 - n)); }
+
+__m256i inline Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+__m256i inline Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m256i inline Sigma0(__m256i x) { return Xor(RotR(x, 28), RotR(x, 34), RotR(x, 39)); }
+__m256i inline Sigma1(__m256i x) { return Xor(RotR(x, 14), RotR(x, 18), RotR(x, 41)); }
+__m256i inline sigma0(__m256i x) { return Xor(RotR(x, 1), RotR(x, 8), ShR(x, 7)); }
+__m256i inline sigma1(__m256i x) { return Xor(RotR(x, 19), RotR(x, 61), ShR(x, 6)); }
+
+/** One round of SHA-512. */
+void inline __attribute__((always_inline)) Round(__m256i a, __m256i b, __m256i c, __m256i& d, __m256i e, __m256i f, __m256i g, __m256i& h, __m256i k, __m256i w)
+{
+    __m256i t1 = Add(h, Sigma1(e), Ch(e, f, g), k, w);
+    __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+    d = Add(d, t1);
+    h = Add(t1, t2);
+}
+
+/** Load a big-endian word from each of 4 consecutive 128-byte chunks (the first one in the lowest lane). */
+__m256i inline Read4(const unsigned char* chunk, int offset) {
+    return _mm256_set_epi64x(
+        ReadBE64(chunk + 384 + offset),
+        ReadBE64(chunk + 256 + offset),
+        ReadBE64(chunk + 128 + offset),
+        ReadBE64(chunk + 0 + offset)
+    );
+}
+
+/** Load word i of each of 4 consecutive states. */
+__m256i inline Load4(const uint64_t* s, int i) { return _mm256_set_epi64x(s[24 + i], s[16 + i], s[8 + i], s[i]); }
+
+/** Add v to word i of each of 4 consecutive states. */
+void inline Store4(uint64_t* s, int i, __m256i v) {
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256((__m256i*)lanes, v);
+    s[i] += lanes[0];
+    s[8 + i] += lanes[1];
+    s[16 + i] += lanes[2];
+    s[24 + i] += lanes[3];
+}
+
+}
+
+/** Perform one SHA-512 transformation on each of 4 states (4*8 words), processing 4 consecutive 128-byte chunks. */
+void Transform_4way(uint64_t* s, const unsigned char* in)
+{
+    __m256i a = Load4(s, 0), b = Load4(s, 1), c = Load4(s, 2), d = Load4(s, 3), e = Load4(s, 4), f = Load4(s, 5), g = Load4(s, 6), h = Load4(s, 7);
+    __m256i w0, w1, w2, w3, w4, w5, w6, w7, w8, w9, w10, w11, w12, w13, w14, w15;
+
+    Round(a, b, c, d, e, f, g, h, K(0x428a2f98d728ae22ull), w0 = Read4(in, 0));
+    Round(h, a, b, c, d, e, f, g, K(0x7137449123ef65cdull), w1 = Read4(in, 8));
+    Round(g, h, a, b, c, d, e, f, K(0xb5c0fbcfec4d3b2full), w2 = Read4(in, 16));
+    Round(f, g, h, a, b, c, d, e, K(0xe9b5dba58189dbbcull), w3 = Read4(in, 24));
+    Round(e, f, g, h, a, b, c, d, K(0x3956c25bf348b538ull), w4 = Read4(in, 32));
+    Round(d, e, f, g, h, a, b, c, K(0x59f111f1b605d019ull), w5 = Read4(in, 40));
+    Round(c, d, e, f, g, h, a, b, K(0x923f82a4af194f9bull), w6 = Read4(in, 48));
+    Round(b, c, d, e, f, g, h, a, K(0xab1c5ed5da6d8118ull), w7 = Read4(in, 56));
+    Round(a, b, c, d, e, f, g, h, K(0xd807aa98a3030242ull), w8 = Read4(in, 64));
+    Round(h, a, b, c, d, e, f, g, K(0x12835b0145706fbeull), w9 = Read4(in, 72));
+    Round(g, h, a, b, c, d, e, f, K(0x243185be4ee4b28cull), w10 = Read4(in, 80));
+    Round(f, g, h, a, b, c, d, e, K(0x550c7dc3d5ffb4e2ull), w11 = Read4(in, 88));
+    Round(e, f, g, h, a, b, c, d, K(0x72be5d74f27b896full), w12 = Read4(in, 96));
+    Round(d, e, f, g, h, a, b, c, K(0x80deb1fe3b1696b1ull), w13 = Read4(in, 104));
+    Round(c, d, e, f, g, h, a, b, K(0x9bdc06a725c71235ull), w14 = Read4(in, 112));
+    Round(b, c, d, e, f, g, h, a, K(0xc19bf174cf692694ull), w15 = Read4(in, 120));
+
+    Round(a, b, c, d, e, f, g, h, K(0xe49b69c19ef14ad2ull), Inc(w0, sigma1(w14), w9, sigma0(w1)));
+    Round(h, a, b, c, d, e, f, g, K(0xefbe4786384f25e3ull), Inc(w1, sigma1(w15), w10, sigma0(w2)));
+    Round(g, h, a, b, c, d, e, f, K(0x0fc19dc68b8cd5b5ull), Inc(w2, sigma1(w0), w11, sigma0(w3)));
+    Round(f, g, h, a, b, c, d, e, K(0x240ca1cc77ac9c65ull), Inc(w3, sigma1(w1), w12, sigma0(w4)));
+    Round(e, f, g, h, a, b, c, d, K(0x2de92c6f592b0275ull), Inc(w4, sigma1(w2), w13, sigma0(w5)));
+    Round(d, e, f, g, h, a, b, c, K(0x4a7484aa6ea6e483ull), Inc(w5, sigma1(w3), w14, sigma0(w6)));
+    Round(c, d, e, f, g, h, a, b, K(0x5cb0a9dcbd41fbd4ull), Inc(w6, sigma1(w4), w15, sigma0(w7)));
+    Round(b, c, d, e, f, g, h, a, K(0x76f988da831153b5ull), Inc(w7, sigma1(w5), w0, sigma0(w8)));
+    Round(a, b, c, d, e, f, g, h, K(0x983e5152ee66dfabull), Inc(w8, sigma1(w6), w1, sigma0(w9)));
+    Round(h, a, b, c, d, e, f, g, K(0xa831c66d2db43210ull), Inc(w9, sigma1(w7), w2, sigma0(w10)));
+    Round(g, h, a, b, c, d, e, f, K(0xb00327c898fb213full), Inc(w10, sigma1(w8), w3, sigma0(w11)));
+    Round(f, g, h, a, b, c, d, e, K(0xbf597fc7beef0ee4ull), Inc(w11, sigma1(w9), w4, sigma0(w12)));
+    Round(e, f, g, h, a, b, c, d, K(0xc6e00bf33da88fc2ull), Inc(w12, sigma1(w10), w5, sigma0(w13)));
+    Round(d, e, f, g, h, a, b, c, K(0xd5a79147930aa725ull), Inc(w13, sigma1(w11), w6, sigma0(w14)));
+    Round(c, d, e, f, g, h, a, b, K(0x06ca6351e003826full), Inc(w14, sigma1(w12), w7, sigma0(w15)));
+    Round(b, c, d, e, f, g, h, a, K(0x142929670a0e6e70ull), Inc(w15, sigma1(w13), w8, sigma0(w0)));
+
+    Round(a, b, c, d, e, f, g, h, K(0x27b70a8546d22ffcull), Inc(w0, sigma1(w14), w9, sigma0(w1)));
+    Round(h, a, b, c, d, e, f, g, K(0x2e1b21385c26c926ull), Inc(w1, sigma1(w15), w10, sigma0(w2)));
+    Round(g, h, a, b, c, d, e, f, K(0x4d2c6dfc5ac42aedull), Inc(w2, sigma1(w0), w11, sigma0(w3)));
+    Round(f, g, h, a, b, c, d, e, K(0x53380d139d95b3dfull), Inc(w3, sigma1(w1), w12, sigma0(w4)));
+    Round(e, f, g, h, a, b, c, d, K(0x650a73548baf63deull), Inc(w4, sigma1(w2), w13, sigma0(w5)));
+    Round(d, e, f, g, h, a, b, c, K(0x766a0abb3c77b2a8ull), Inc(w5, sigma1(w3), w14, sigma0(w6)));
+    Round(c, d, e, f, g, h, a, b, K(0x81c2c92e47edaee6ull), Inc(w6, sigma1(w4), w15, sigma0(w7)));
+    Round(b, c, d, e, f, g, h, a, K(0x92722c851482353bull), Inc(w7, sigma1(w5), w0, sigma0(w8)));
+    Round(a, b, c, d, e, f, g, h, K(0xa2bfe8a14cf10364ull), Inc(w8, sigma1(w6), w1, sigma0(w9)));
+    Round(h, a, b, c, d, e, f, g, K(0xa81a664bbc423001ull), Inc(w9, sigma1(w7), w2, sigma0(w10)));
+    Round(g, h, a, b, c, d, e, f, K(0xc24b8b70d0f89791ull), Inc(w10, sigma1(w8), w3, sigma0(w11)));
+    Round(f, g, h, a, b, c, d, e, K(0xc76c51a30654be30ull), Inc(w11, sigma1(w9), w4, sigma0(w12)));
+    Round(e, f, g, h, a, b, c, d, K(0xd192e819d6ef5218ull), Inc(w12, sigma1(w10), w5, sigma0(w13)));
+    Round(d, e, f, g, h, a, b, c, K(0xd69906245565a910ull), Inc(w13, sigma1(w11), w6, sigma0(w14)));
+    Round(c, d, e, f, g, h, a, b, K(0xf40e35855771202aull), Inc(w14, sigma1(w12), w7, sigma0(w15)));
+    Round(b, c, d, e, f, g, h, a, K(0x106aa07032bbd1b8ull), Inc(w15, sigma1(w13), w8, sigma0(w0)));
+
+    Round(a, b, c, d, e, f, g, h, K(0x19a4c116b8d2d0c8ull), Inc(w0, sigma1(w14), w9, sigma0(w1)));
+    Round(h, a, b, c, d, e, f, g, K(0x1e376c085141ab53ull), Inc(w1, sigma1(w15), w10, sigma0(w2)));
+    Round(g, h, a, b, c, d, e, f, K(0x2748774cdf8eeb99ull), Inc(w2, sigma1(w0), w11, sigma0(w3)));
+    Round(f, g, h, a, b, c, d, e, K(0x34b0bcb5e19b48a8ull), Inc(w3, sigma1(w1), w12, sigma0(w4)));
+    Round(e, f, g, h, a, b, c, d, K(0x391c0cb3c5c95a63ull), Inc(w4, sigma1(w2), w13, sigma0(w5)));
+    Round(d, e, f, g, h, a, b, c, K(0x4ed8aa4ae3418acbull), Inc(w5, sigma1(w3), w14, sigma0(w6)));
+    Round(c, d, e, f, g, h, a, b, K(0x5b9cca4f7763e373ull), Inc(w6, sigma1(w4), w15, sigma0(w7)));
+    Round(b, c, d, e, f, g, h, a, K(0x682e6ff3d6b2b8a3ull), Inc(w7, sigma1(w5), w0, sigma0(w8)));
+    Round(a, b, c, d, e, f, g, h, K(0x748f82ee5defb2fcull), Inc(w8, sigma1(w6), w1, sigma0(w9)));
+    Round(h, a, b, c, d, e, f, g, K(0x78a5636f43172f60ull), Inc(w9, sigma1(w7), w2, sigma0(w10)));
+    Round(g, h, a, b, c, d, e, f, K(0x84c87814a1f0ab72ull), Inc(w10, sigma1(w8), w3, sigma0(w11)));
+    Round(f, g, h, a, b, c, d, e, K(0x8cc702081a6439ecull), Inc(w11, sigma1(w9), w4, sigma0(w12)));
+    Round(e, f, g, h, a, b, c, d, K(0x90befffa23631e28ull), Inc(w12, sigma1(w10), w5, sigma0(w13)));
+    Round(d, e, f, g, h, a, b, c, K(0xa4506cebde82bde9ull), Inc(w13, sigma1(w11), w6, sigma0(w14)));
+    Round(c, d, e, f, g, h, a, b, K(0xbef9a3f7b2c67915ull), Inc(w14, sigma1(w12), w7, sigma0(w15)));
+    Round(b, c, d, e, f, g, h, a, K(0xc67178f2e372532bull), Inc(w15, sigma1(w13), w8, sigma0(w0)));
+
+    Round(a, b, c, d, e, f, g, h, K(0xca273eceea26619cull), Inc(w0, sigma1(w14), w9, sigma0(w1)));
+    Round(h, a, b, c, d, e, f, g, K(0xd186b8c721c0c207ull), Inc(w1, sigma1(w15), w10, sigma0(w2)));
+    Round(g, h, a, b, c, d, e, f, K(0xeada7dd6cde0eb1eull), Inc(w2, sigma1(w0), w11, sigma0(w3)));
+    Round(f, g, h, a, b, c, d, e, K(0xf57d4f7fee6ed178ull), Inc(w3, sigma1(w1), w12, sigma0(w4)));
+    Round(e, f, g, h, a, b, c, d, K(0x06f067aa72176fbaull), Inc(w4, sigma1(w2), w13, sigma0(w5)));
+    Round(d, e, f, g, h, a, b, c, K(0x0a637dc5a2c898a6ull), Inc(w5, sigma1(w3), w14, sigma0(w6)));
+    Round(c, d, e, f, g, h, a, b, K(0x113f9804bef90daeull), Inc(w6, sigma1(w4), w15, sigma0(w7)));
+    Round(b, c, d, e, f, g, h, a, K(0x1b710b35131c471bull), Inc(w7, sigma1(w5), w0, sigma0(w8)));
+    Round(a, b, c, d, e, f, g, h, K(0x28db77f523047d84ull), Inc(w8, sigma1(w6), w1, sigma0(w9)));
+    Round(h, a, b, c, d, e, f, g, K(0x32caab7b40c72493ull), Inc(w9, sigma1(w7), w2, sigma0(w10)));
+    Round(g, h, a, b, c, d, e, f, K(0x3c9ebe0a15c9bebcull), Inc(w10, sigma1(w8), w3, sigma0(w11)));
+    Round(f, g, h, a, b, c, d, e, K(0x431d67c49c100d4cull), Inc(w11, sigma1(w9), w4, sigma0(w12)));
+    Round(e, f, g, h, a, b, c, d, K(0x4cc5d4becb3e42b6ull), Inc(w12, sigma1(w10), w5, sigma0(w13)));
+    Round(d, e, f, g, h, a, b, c, K(0x597f299cfc657e2aull), Inc(w13, sigma1(w11), w6, sigma0(w14)));
+    Round(c, d, e, f, g, h, a, b, K(0x5fcb6fab3ad6faecull), Add(w14, sigma1(w12), w7, sigma0(w15)));
+    Round(b, c, d, e, f, g, h, a, K(0x6c44198c4a475817ull), Add(w15, sigma1(w13), w8, sigma0(w0)));
+
+    Store4(s, 0, a);
+    Store4(s, 1, b);
+    Store4(s, 2, c);
+    Store4(s, 3, d);
+    Store4(s, 4, e);
+    Store4(s, 5, f);
+    Store4(s, 6, g);
+    Store4(s, 7, h);
+}
+
+}
+
+#endif
@@ -4,6 +4,14 @@
 
 #include <crypto/siphash.h>
 
+#include <crypto/common.h>
+#include <compat/cpuid.h>
+
+namespace siphash_avx2
+{
+void SipHashUint256_4way(uint64_t k0, uint64_t k1, const uint256* const* vals, const uint64_t* tail, uint64_t* out);
+}
+
 #define ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
 
 #define SIPROUND do { \
@@ -171,3 +179,66 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
 }
+
+namespace {
+
+/** Hash four values; tail holds the final message word of each (length byte and extra data). */
+typedef void (*Hash4WayFn)(uint64_t k0, uint64_t k1, const uint256* const* vals, const uint64_t* tail, uint64_t* out);
+
+Hash4WayFn Hash4Way = nullptr;
+
+void BatchHash(uint64_t k0, uint64_t k1, const uint256* const* vals, const uint32_t* extras, uint64_t* out, size_t n)
+{
+    size_t i = 0;
+    if (Hash4Way) {
+        for (; i + 4 <= n; i += 4) {
+            uint64_t tail[4];
+            for (int j = 0; j < 4; ++j) {
+                tail[j] = extras ? ((((uint64_t)36) << 56) | extras[i + j]) : (((uint64_t)32) << 56);
+            }
+            Hash4Way(k0, k1, vals + i, tail, out + i);
+        }
+    }
+    for (; i < n; ++i) {
+        out[i] = extras ? SipHashUint256Extra(k0, k1, *vals[i], extras[i]) : SipHashUint256(k0, k1, *vals[i]);
+    }
+}
+
+#if defined(USE_ASM) && defined(HAVE_GETCPUID)
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace
+
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* const* vals, uint64_t* out, size_t n)
+{
+    BatchHash(k0, k1, vals, nullptr, out, n);
+}
+
+void SipHashUint256ExtraBatch(uint64_t k0, uint64_t k1, const uint256* const* vals, const uint32_t* extras, uint64_t* out, size_t n)
+{
+    BatchHash(k0, k1, vals, extras, out, n);
+}
+
+std::string SipHashAutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && defined(HAVE_GETCPUID) && defined(ENABLE_AVX2) && !defined(BUILD_PALLADIUM_INTERNAL)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    const bool have_avx = ((ecx >> 27) & 1) && ((ecx >> 28) & 1) && AVXEnabled();
+    GetCPUID(7, 0, eax, ebx, ecx, edx);
+    const bool have_avx2 = (ebx >> 5) & 1;
+    if (have_avx && have_avx2) {
+        Hash4Way = siphash_avx2::SipHashUint256_4way;
+        ret = "avx2(4way)";
+    }
+#endif
+    return ret;
+}
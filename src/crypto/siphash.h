@@ -6,6 +6,7 @@
 #define PALLADIUM_CRYPTO_SIPHASH_H
 
 #include <stdint.h>
+#include <string>
 
 #include <uint256.h>
 
@@ -44,4 +45,17 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** Compute out[i] = SipHashUint256(k0, k1, *vals[i]) for i < n.
+ *
+ *  Hashes four values at a time when a vectorized implementation is
+ *  available (see SipHashAutoDetect), so prefer it over a loop of
+ *  SipHashUint256 calls whenever many values are hashed with one key.
+ */
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256* const* vals, uint64_t* out, size_t n);
+/** Compute out[i] = SipHashUint256Extra(k0, k1, *vals[i], extras[i]) for i < n. */
+void SipHashUint256ExtraBatch(uint64_t k0, uint64_t k1, const uint256* const* vals, const uint32_t* extras, uint64_t* out, size_t n);
+
+/** Select the fastest batch SipHash implementation for this CPU, and return its name. */
+std::string SipHashAutoDetect();
+
 #endif // PALLADIUM_CRYPTO_SIPHASH_H
@@ -5,6 +5,8 @@
 #ifndef PALLADIUM_CUCKOOCACHE_H
 #define PALLADIUM_CUCKOOCACHE_H
 
+#include <support/allocators/largepage.h>
+
 #include <algorithm> // std::find
 #include <array>
 #include <atomic>
@@ -120,6 +122,7 @@ public:
  *
  *  Read Operations:
  *      - contains() for `erase=false`
+ *      - for_each_kept()
  *
  *  Read+Erase Operations:
  *      - contains() for `erase=true`
@@ -158,8 +161,8 @@ template <typename Element, typename Hash>
 class cache
 {
 private:
-    /** table stores all the elements */
-    std::vector<Element> table;
+    /** table stores all the elements, in huge pages with -largepages */
+    std::vector<Element, large_page_allocator<Element>> table;
 
     /** size stores the total available slots in the hash table */
     uint32_t size;
@@ -477,6 +480,20 @@ public:
             }
         return false;
     }
+
+    /** for_each_kept calls f on every element that is still in the table and
+     * has not been marked for garbage collection, e.g. to save the cache and
+     * insert() the elements again later.
+     *
+     * @param f a callable taking a const Element&
+     */
+    template <typename F>
+    void for_each_kept(F f) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                f(table[i]);
+    }
 };
 } // namespace CuckooCache
 
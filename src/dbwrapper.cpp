@@ -97,13 +97,57 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+DBProfile g_db_profile{DBProfile::DEFAULT};
+
+bool ParseDBProfile(const std::string& name, DBProfile& profile)
+{
+    if (name == "default") {
+        profile = DBProfile::DEFAULT;
+    } else if (name == "ssd") {
+        profile = DBProfile::SSD;
+    } else if (name == "hdd") {
+        profile = DBProfile::HDD;
+    } else if (name == "lowmem") {
+        profile = DBProfile::LOWMEM;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, bool compress)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
+    // The block cache and up to two write buffers, which may be held in memory
+    // simultaneously, share nCacheSize.
+    switch (g_db_profile) {
+    case DBProfile::DEFAULT:
+        options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
+        options.write_buffer_size = nCacheSize / 4;
+        break;
+    case DBProfile::SSD:
+        // Bigger memtables mean fewer level-0 files and compactions; random
+        // reads are cheap, so less block cache is needed
+        options.block_cache = leveldb::NewLRUCache(nCacheSize / 4);
+        options.write_buffer_size = nCacheSize * 3 / 8;
+        options.max_file_size = 32 << 20;
+        break;
+    case DBProfile::HDD:
+        // Large blocks and table files turn compaction into long sequential
+        // I/O and keep the number of seeks per lookup down
+        options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
+        options.write_buffer_size = nCacheSize / 4;
+        options.block_size = 64 << 10;
+        options.max_file_size = 64 << 20;
+        break;
+    case DBProfile::LOWMEM:
+        options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
+        options.write_buffer_size = std::min<size_t>(nCacheSize / 4, 1 << 20);
+        options.max_open_files = 64;
+        break;
+    }
     options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
+    options.compression = compress ? leveldb::kSnappyCompression : leveldb::kNoCompression;
     options.info_log = new CPalladiumLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -114,7 +158,7 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, bool compress)
     : m_name{path.stem().string()}
 {
     penv = nullptr;
@@ -122,7 +166,7 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, compress);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -238,8 +282,91 @@ bool CDBIterator::Valid() const { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
 void CDBIterator::Next() { piter->Next(); }
 
+size_t CDBIterator::ReadChunk(CDBChunk& chunk, size_t max_bytes, int key_prefix)
+{
+    chunk.clear();
+    chunk.m_data.reserve(max_bytes + DBWRAPPER_PREALLOC_VALUE_SIZE);
+    const std::vector<unsigned char>& obfuscate_key = dbwrapper_private::GetObfuscateKey(parent);
+    while (chunk.m_data.size() < max_bytes && piter->Valid()) {
+        const leveldb::Slice key = piter->key();
+        if (key_prefix >= 0 && (key.empty() || (unsigned char)key[0] != key_prefix)) break;
+        const leveldb::Slice value = piter->value();
+        const size_t pos = chunk.m_data.size();
+        chunk.m_data.insert(chunk.m_data.end(), key.data(), key.data() + key.size());
+        chunk.m_data.insert(chunk.m_data.end(), value.data(), value.data() + value.size());
+        dbwrapper_private::Xor(Span<unsigned char>(chunk.m_data.data() + pos + key.size(), value.size()), obfuscate_key);
+        chunk.m_entries.push_back(CDBChunk::Entry{pos, (uint32_t)key.size(), (uint32_t)value.size()});
+        piter->Next();
+    }
+    return chunk.size();
+}
+
+CDBChunkReader::CDBChunkReader(std::unique_ptr<CDBIterator> it, int key_prefix, size_t chunk_bytes)
+    : m_it(std::move(it)), m_key_prefix(key_prefix), m_chunk_bytes(chunk_bytes)
+{
+    m_thread = std::thread([this] { ThreadMain(); });
+}
+
+CDBChunkReader::~CDBChunkReader()
+{
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+}
+
+void CDBChunkReader::ThreadMain()
+{
+    bool end = false;
+    while (!end) {
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || !m_next_ready; });
+            if (m_stop) break;
+        }
+        end = m_it->ReadChunk(m_next, m_chunk_bytes, m_key_prefix) == 0;
+        {
+            LOCK(m_mutex);
+            m_next_ready = true;
+        }
+        m_cond.notify_all();
+    }
+    {
+        LOCK(m_mutex);
+        m_finished = true;
+    }
+    m_cond.notify_all();
+}
+
+const CDBChunk& CDBChunkReader::Next()
+{
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_next_ready || m_finished; });
+        if (m_next_ready) {
+            std::swap(m_current, m_next);
+            m_next_ready = false;
+        } else {
+            m_current.clear();
+        }
+    }
+    m_cond.notify_all();
+    return m_current;
+}
+
 namespace dbwrapper_private {
 
+void Xor(Span<unsigned char> data, const std::vector<unsigned char>& key)
+{
+    if (key.empty()) return;
+    for (size_t i = 0, j = 0; i < data.size(); ++i) {
+        data[i] ^= key[j++];
+        if (j == key.size()) j = 0;
+    }
+}
+
 void HandleError(const leveldb::Status& status)
 {
     if (status.ok())
@@ -15,8 +15,29 @@
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
+#include <condition_variable>
+#include <thread>
+
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
+//! Amount of key and value data CDBChunkReader reads ahead at a time
+static const size_t DBWRAPPER_CHUNK_SIZE = 1 << 20;
+
+/** LevelDB tuning profiles, selected with -dbprofile. */
+enum class DBProfile {
+    DEFAULT, //!< LevelDB defaults, half the cache as block cache
+    SSD,     //!< larger write buffers and table files, for fast random I/O
+    HDD,     //!< large tables and blocks, to cut seeks and compaction passes
+    LOWMEM,  //!< smaller buffers and fewer open files
+};
+
+static const char* const DEFAULT_DB_PROFILE = "default";
+
+/** Parse a -dbprofile name. Returns false if it is not known. */
+bool ParseDBProfile(const std::string& name, DBProfile& profile);
+
+/** The tuning profile for databases opened from now on. */
+extern DBProfile g_db_profile;
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -40,6 +61,9 @@ void HandleError(const leveldb::Status& status);
  */
 const std::vector<unsigned char>& GetObfuscateKey(const CDBWrapper &w);
 
+/** XOR data with the repeated key, as CDataStream::Xor does. */
+void Xor(Span<unsigned char> data, const std::vector<unsigned char>& key);
+
 };
 
 /** Batch of changes queued to be written to a CDBWrapper */
@@ -113,11 +137,73 @@ public:
     size_t SizeEstimate() const { return size_estimate; }
 };
 
+/**
+ * Raw keys and values of consecutive database entries, copied back to back
+ * into one buffer by CDBIterator::ReadChunk(). Values are already
+ * de-obfuscated, so entries can be deserialized straight from the buffer.
+ */
+class CDBChunk
+{
+    friend class CDBIterator;
+
+private:
+    struct Entry {
+        size_t pos;
+        uint32_t key_size;
+        uint32_t value_size;
+    };
+
+    //! Each entry's key, followed by its value
+    std::vector<unsigned char> m_data;
+    std::vector<Entry> m_entries;
+
+public:
+    size_t size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+    void clear()
+    {
+        m_data.clear();
+        m_entries.clear();
+    }
+
+    Span<const unsigned char> Key(size_t i) const
+    {
+        return Span<const unsigned char>(m_data.data() + m_entries[i].pos, m_entries[i].key_size);
+    }
+
+    Span<const unsigned char> Value(size_t i) const
+    {
+        return Span<const unsigned char>(m_data.data() + m_entries[i].pos + m_entries[i].key_size, m_entries[i].value_size);
+    }
+
+    template<typename K> bool GetKey(size_t i, K& key) const {
+        try {
+            SpanReader reader(SER_DISK, CLIENT_VERSION, Key(i));
+            reader >> key;
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+
+    template<typename V> bool GetValue(size_t i, V& value) const {
+        try {
+            SpanReader reader(SER_DISK, CLIENT_VERSION, Value(i));
+            reader >> value;
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+};
+
 class CDBIterator
 {
 private:
     const CDBWrapper &parent;
     leveldb::Iterator *piter;
+    //! De-obfuscated copy of the current value, reused across entries
+    std::vector<unsigned char> m_value_buf;
 
 public:
 
@@ -146,8 +232,9 @@ public:
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
         try {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            ssKey >> key;
+            // Keys are not obfuscated, so they are read in place.
+            SpanReader reader(SER_DISK, CLIENT_VERSION, Span<const uint8_t>((const uint8_t*)slKey.data(), slKey.size()));
+            reader >> key;
         } catch (const std::exception&) {
             return false;
         }
@@ -157,9 +244,10 @@ public:
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-            ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
-            ssValue >> value;
+            m_value_buf.assign(slValue.data(), slValue.data() + slValue.size());
+            dbwrapper_private::Xor(MakeSpan(m_value_buf), dbwrapper_private::GetObfuscateKey(parent));
+            SpanReader reader(SER_DISK, CLIENT_VERSION, Span<const uint8_t>(m_value_buf.data(), m_value_buf.size()));
+            reader >> value;
         } catch (const std::exception&) {
             return false;
         }
@@ -170,6 +258,49 @@ public:
         return piter->value().size();
     }
 
+    /**
+     * Copy the entries from the current one on into chunk, replacing its
+     * contents, until about max_bytes of keys and values have been read. With
+     * key_prefix set, stop before the first key not starting with that byte.
+     * The iterator is left on the first entry not read.
+     *
+     * @return The number of entries read, 0 at the end.
+     */
+    size_t ReadChunk(CDBChunk& chunk, size_t max_bytes, int key_prefix = -1);
+};
+
+/**
+ * Walks a database iterator on a background thread, reading one chunk of
+ * entries ahead of the consumer, so that LevelDB's block reads and
+ * decompression overlap with the processing of the entries already read.
+ */
+class CDBChunkReader
+{
+public:
+    /** Read from the position it is at, see CDBIterator::ReadChunk for key_prefix. */
+    explicit CDBChunkReader(std::unique_ptr<CDBIterator> it, int key_prefix = -1, size_t chunk_bytes = DBWRAPPER_CHUNK_SIZE);
+    ~CDBChunkReader();
+
+    /** Return the next chunk, valid until the next call. It is empty once all entries have been returned. */
+    const CDBChunk& Next();
+
+private:
+    void ThreadMain();
+
+    const std::unique_ptr<CDBIterator> m_it;
+    const int m_key_prefix;
+    const size_t m_chunk_bytes;
+    //! The chunk handed out by Next()
+    CDBChunk m_current;
+    //! The chunk being read, only touched by the consumer while m_next_ready
+    CDBChunk m_next;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_next_ready GUARDED_BY(m_mutex){false};
+    bool m_finished GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::thread m_thread;
 };
 
 class CDBWrapper
@@ -219,8 +350,10 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] compress    If true, Snappy compress new tables, when LevelDB is built
+     *                        with Snappy. Existing tables are readable either way.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, bool compress = false);
     ~CDBWrapper();
 
     CDBWrapper(const CDBWrapper&) = delete;
@@ -45,8 +45,12 @@ void DummyWalletInit::AddWalletOptions() const
         "-wallet=<path>",
         "-walletbroadcast",
         "-walletdir=<dir>",
+        "-walletformat=<format>",
+        "-walletlazytxcache=<n>",
         "-walletnotify=<cmd>",
+        "-walletunlocksample=<n>",
         "-walletrbf",
+        "-walletrouting",
         "-zapwallettxes=<mode>",
         "-dblogsize=<n>",
         "-flushwallet",
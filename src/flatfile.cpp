@@ -9,11 +9,13 @@
 #include <logging.h>
 #include <tinyformat.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 
-FlatFileSeq::FlatFileSeq(fs::path dir, const char* prefix, size_t chunk_size) :
+FlatFileSeq::FlatFileSeq(fs::path dir, const char* prefix, size_t chunk_size, fs::path cold_dir) :
     m_dir(std::move(dir)),
     m_prefix(prefix),
-    m_chunk_size(chunk_size)
+    m_chunk_size(chunk_size),
+    m_cold_dir(std::move(cold_dir))
 {
     if (chunk_size == 0) {
         throw std::invalid_argument("chunk_size must be positive");
@@ -25,9 +27,78 @@ std::string FlatFilePos::ToString() const
     return strprintf("FlatFilePos(nFile=%i, nPos=%i)", nFile, nPos);
 }
 
+fs::path FlatFileSeq::FileName(const fs::path& dir, const FlatFilePos& pos) const
+{
+    return dir / strprintf("%s%05u.dat", m_prefix, pos.nFile);
+}
+
 fs::path FlatFileSeq::FileName(const FlatFilePos& pos) const
 {
-    return m_dir / strprintf("%s%05u.dat", m_prefix, pos.nFile);
+    fs::path hot = FileName(m_dir, pos);
+    if (m_cold_dir.empty() || fs::exists(hot)) return hot;
+    // A moved file is in the cold directory before it is deleted from the hot one, so checking
+    // in this order always finds it.
+    fs::path cold = FileName(m_cold_dir, pos);
+    if (fs::exists(cold)) return cold;
+    // New files are created in the hot directory.
+    return hot;
+}
+
+bool FlatFileSeq::IsHot(const FlatFilePos& pos) const
+{
+    return fs::exists(FileName(m_dir, pos));
+}
+
+bool FlatFileSeq::CopyToCold(const FlatFilePos& pos) const
+{
+    assert(!m_cold_dir.empty());
+    const fs::path hot = FileName(m_dir, pos);
+    fs::path tmp = FileName(m_cold_dir, pos);
+    tmp += ".tmp";
+    try {
+        fs::create_directories(m_cold_dir);
+        fs::copy_file(hot, tmp, fs::copy_option::overwrite_if_exists);
+    } catch (const fs::filesystem_error& e) {
+        return error("%s: failed to copy %s to %s: %s", __func__, hot.string(), tmp.string(), e.what());
+    }
+    FILE* file = fsbridge::fopen(tmp, "rb+");
+    if (!file) {
+        return error("%s: failed to open %s", __func__, tmp.string());
+    }
+    const bool committed = FileCommit(file);
+    fclose(file);
+    if (!committed) {
+        return error("%s: failed to commit %s", __func__, tmp.string());
+    }
+    return true;
+}
+
+bool FlatFileSeq::CompleteMoveToCold(const FlatFilePos& pos) const
+{
+    fs::path tmp = FileName(m_cold_dir, pos);
+    tmp += ".tmp";
+    if (!RenameOver(tmp, FileName(m_cold_dir, pos))) {
+        return error("%s: failed to rename %s", __func__, tmp.string());
+    }
+    // Deleting the hot file may fail while it is open on some platforms. Both copies are
+    // identical, and the hot one keeps being used until it is moved again.
+    try {
+        fs::remove(FileName(m_dir, pos));
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("Unable to remove file %s: %s\n", FileName(m_dir, pos).string(), e.what());
+    }
+    return true;
+}
+
+void FlatFileSeq::AbortMoveToCold(const FlatFilePos& pos) const
+{
+    fs::path tmp = FileName(m_cold_dir, pos);
+    tmp += ".tmp";
+    try {
+        fs::remove(tmp);
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("Unable to remove file %s: %s\n", tmp.string(), e.what());
+    }
 }
 
 FILE* FlatFileSeq::Open(const FlatFilePos& pos, bool read_only)
@@ -96,3 +167,169 @@ bool FlatFileSeq::Flush(const FlatFilePos& pos, bool finalize)
     fclose(file);
     return true;
 }
+
+FlatFileWorker::~FlatFileWorker()
+{
+    Stop();
+}
+
+void FlatFileWorker::Start(const char* thread_name)
+{
+    LOCK(m_mutex);
+    if (m_running) return;
+    m_running = true;
+    m_stop = false;
+    m_thread = std::thread([this, thread_name] {
+        util::ThreadRename(thread_name);
+        ThreadMain();
+    });
+}
+
+bool FlatFileWorker::Stop()
+{
+    {
+        LOCK(m_mutex);
+        if (!m_running) return true;
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    m_thread.join();
+
+    LOCK(m_mutex);
+    m_running = false;
+    m_files.clear();
+    const bool ok = !m_failed;
+    m_failed = false;
+    return ok;
+}
+
+void FlatFileWorker::ThreadMain()
+{
+    WAIT_LOCK(m_mutex, lock);
+    while (true) {
+        m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || !m_jobs.empty(); });
+        // Queued jobs are finished before stopping.
+        if (m_jobs.empty()) return;
+        Job job = m_jobs.front();
+        m_jobs.pop_front();
+        m_busy = true;
+
+        bool ok = true;
+        size_t allocated = 0;
+        {
+            REVERSE_LOCK(lock);
+            switch (job.type) {
+            case Job::Type::ALLOCATE: {
+                // Not a failure if this does not work out: the writer allocates the space itself
+                // when it gets there.
+                bool out_of_space;
+                allocated = job.seq.Allocate(job.pos, job.alloc_size, out_of_space);
+                break;
+            }
+            case Job::Type::FLUSH:
+                ok = job.seq.Flush(job.pos, job.finalize);
+                break;
+            case Job::Type::REMOVE:
+                try {
+                    fs::remove(job.seq.FileName(job.pos));
+                } catch (const fs::filesystem_error& e) {
+                    LogPrintf("Unable to remove file %s: %s\n", job.seq.FileName(job.pos).string(), e.what());
+                }
+                break;
+            }
+        }
+
+        if (job.type == Job::Type::ALLOCATE) {
+            FileState& state = m_files[job.pos.nFile];
+            if (allocated != 0) state.allocated = std::max(state.allocated, job.pos.nPos + allocated);
+            state.allocating = false;
+        } else if (job.type == Job::Type::FLUSH && job.finalize) {
+            // The file was truncated, so what is allocated is again inferred from the write position.
+            FileState& state = m_files[job.pos.nFile];
+            if (--state.finalizing == 0 && !state.allocating) m_files.erase(job.pos.nFile);
+        } else if (job.type == Job::Type::REMOVE) {
+            m_files.erase(job.pos.nFile);
+        }
+        if (!ok) m_failed = true;
+        m_busy = false;
+        m_cond.notify_all();
+    }
+}
+
+size_t FlatFileWorker::Allocate(FlatFileSeq seq, const FlatFilePos& pos, size_t add_size, bool& out_of_space)
+{
+    out_of_space = false;
+    const size_t chunk_size = seq.ChunkSize();
+    const size_t end = pos.nPos + add_size;
+
+    WAIT_LOCK(m_mutex, lock);
+    if (!m_running) {
+        REVERSE_LOCK(lock);
+        return seq.Allocate(pos, add_size, out_of_space);
+    }
+
+    // Wait for queued jobs that would truncate or zero-fill the range being handed out.
+    m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+        auto it = m_files.find(pos.nFile);
+        if (it == m_files.end()) return true;
+        const FileState& state = it->second;
+        return state.finalizing == 0 && (!state.allocating || end <= state.allocating_from);
+    });
+
+    size_t bytes_allocated = 0;
+    FileState& state = m_files[pos.nFile];
+    if (end > state.allocated) {
+        {
+            REVERSE_LOCK(lock);
+            bytes_allocated = seq.Allocate(pos, add_size, out_of_space);
+        }
+        if (out_of_space) return 0;
+        state.allocated = std::max<size_t>(state.allocated, (end + chunk_size - 1) / chunk_size * chunk_size);
+    }
+
+    if (!state.allocating && state.allocated < end + chunk_size) {
+        state.allocating = true;
+        state.allocating_from = state.allocated;
+        m_jobs.push_back(Job{Job::Type::FLUSH, seq, FlatFilePos(pos.nFile, pos.nPos), 0, false});
+        m_jobs.push_back(Job{Job::Type::ALLOCATE, seq, FlatFilePos(pos.nFile, state.allocated), chunk_size, false});
+        bytes_allocated += chunk_size;
+        m_cond.notify_all();
+    }
+    return bytes_allocated;
+}
+
+bool FlatFileWorker::Flush(FlatFileSeq seq, const FlatFilePos& pos, bool finalize)
+{
+    {
+        LOCK(m_mutex);
+        if (m_running) {
+            if (finalize) ++m_files[pos.nFile].finalizing;
+            m_jobs.push_back(Job{Job::Type::FLUSH, seq, pos, 0, finalize});
+            m_cond.notify_all();
+            return true;
+        }
+    }
+    return seq.Flush(pos, finalize);
+}
+
+void FlatFileWorker::Remove(FlatFileSeq seq, const FlatFilePos& pos)
+{
+    {
+        LOCK(m_mutex);
+        if (m_running) {
+            m_jobs.push_back(Job{Job::Type::REMOVE, seq, pos, 0, false});
+            m_cond.notify_all();
+            return;
+        }
+    }
+    fs::remove(seq.FileName(pos));
+}
+
+bool FlatFileWorker::Sync()
+{
+    WAIT_LOCK(m_mutex, lock);
+    m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_jobs.empty() && !m_busy; });
+    const bool ok = !m_failed;
+    m_failed = false;
+    return ok;
+}
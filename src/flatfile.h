@@ -6,10 +6,15 @@
 #ifndef PALLADIUM_FLATFILE_H
 #define PALLADIUM_FLATFILE_H
 
+#include <condition_variable>
+#include <deque>
+#include <map>
 #include <string>
+#include <thread>
 
 #include <fs.h>
 #include <serialize.h>
+#include <sync.h>
 
 struct FlatFilePos
 {
@@ -48,6 +53,10 @@ struct FlatFilePos
 /**
  * FlatFileSeq represents a sequence of numbered files storing raw data. This class facilitates
  * access to and efficient management of these files.
+ *
+ * Files may be stored in two tiers: new files are created in the hot directory, and finished
+ * ones can be moved to an optional cold directory on cheaper storage. File names resolve to
+ * whichever directory holds the file, so reads are unaffected by the move.
  */
 class FlatFileSeq
 {
@@ -55,6 +64,9 @@ private:
     const fs::path m_dir;
     const char* const m_prefix;
     const size_t m_chunk_size;
+    const fs::path m_cold_dir;
+
+    fs::path FileName(const fs::path& dir, const FlatFilePos& pos) const;
 
 public:
     /**
@@ -63,12 +75,35 @@ public:
      * @param dir The base directory that all files live in.
      * @param prefix A short prefix given to all file names.
      * @param chunk_size Disk space is pre-allocated in multiples of this amount.
+     * @param cold_dir The directory files are moved to once they are no longer written, if any.
      */
-    FlatFileSeq(fs::path dir, const char* prefix, size_t chunk_size);
+    FlatFileSeq(fs::path dir, const char* prefix, size_t chunk_size, fs::path cold_dir = {});
+
+    /** Disk space is pre-allocated in multiples of this amount. */
+    size_t ChunkSize() const { return m_chunk_size; }
 
-    /** Get the name of the file at the given position. */
+    /** Get the name of the file at the given position, in the cold directory if it was moved there. */
     fs::path FileName(const FlatFilePos& pos) const;
 
+    /** Whether the file at the given position is in the hot directory. */
+    bool IsHot(const FlatFilePos& pos) const;
+
+    /**
+     * Copy the file at the given position from the hot directory to a temporary file in the cold
+     * directory and commit the copy to disk. Until CompleteMoveToCold, the file keeps being read
+     * from the hot directory.
+     */
+    bool CopyToCold(const FlatFilePos& pos) const;
+
+    /**
+     * Rename the copy made by CopyToCold into place, then delete the file from the hot directory.
+     * A complete copy of the file can be found at any point in between.
+     */
+    bool CompleteMoveToCold(const FlatFilePos& pos) const;
+
+    /** Delete the copy made by CopyToCold, leaving the file in the hot directory. */
+    void AbortMoveToCold(const FlatFilePos& pos) const;
+
     /** Open a handle to the file at the given position. */
     FILE* Open(const FlatFilePos& pos, bool read_only = false);
 
@@ -93,4 +128,82 @@ public:
     bool Flush(const FlatFilePos& pos, bool finalize = false);
 };
 
+/**
+ * Runs the slow parts of writing a FlatFileSeq on a background thread: pre-allocating the next
+ * chunk of a file before the writer gets there, committing files to disk, and deleting files that
+ * are no longer used. Jobs run one at a
+ * time in the order they were queued, so a commit also covers everything queued before it.
+ *
+ * The writer must get its space through Allocate(), which only hands out a range once no queued
+ * job could still truncate or zero-fill it. Before Start() and after Stop(), everything is done
+ * in the calling thread.
+ */
+class FlatFileWorker
+{
+public:
+    ~FlatFileWorker();
+
+    void Start(const char* thread_name);
+
+    /** Finish the queued jobs and stop the thread. Returns false if any of them failed since the last Sync(). */
+    bool Stop();
+
+    /**
+     * Make sure add_size bytes at pos are allocated, like FlatFileSeq::Allocate, only blocking if
+     * a queued pre-allocation has not covered them. Once the writer is within a chunk of the end
+     * of the allocated space, the next chunk is queued for pre-allocation, together with a commit
+     * of what was written before pos.
+     *
+     * @return The number of bytes allocated in the calling thread or queued for pre-allocation.
+     */
+    size_t Allocate(FlatFileSeq seq, const FlatFilePos& pos, size_t add_size, bool& out_of_space);
+
+    /**
+     * Queue a FlatFileSeq::Flush call.
+     *
+     * @return The result of the flush when it ran in the calling thread, true when it was queued.
+     */
+    bool Flush(FlatFileSeq seq, const FlatFilePos& pos, bool finalize = false);
+
+    /** Queue deletion of the file at pos. Nothing may be written to it afterwards. */
+    void Remove(FlatFileSeq seq, const FlatFilePos& pos);
+
+    /** Wait for all queued jobs. Returns false if any of them failed since the last call. */
+    bool Sync();
+
+private:
+    struct Job {
+        enum class Type { ALLOCATE, FLUSH, REMOVE };
+        Type type;
+        FlatFileSeq seq;
+        FlatFilePos pos;
+        //! Bytes to pre-allocate at pos
+        size_t alloc_size;
+        bool finalize;
+    };
+
+    struct FileState {
+        //! Space allocated by finished jobs, 0 if unknown
+        size_t allocated{0};
+        //! Start of the space a queued job is pre-allocating, if any
+        size_t allocating_from{0};
+        bool allocating{false};
+        //! Queued flushes that truncate the file
+        int finalizing{0};
+    };
+
+    void ThreadMain();
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Job> m_jobs GUARDED_BY(m_mutex);
+    std::map<int, FileState> m_files GUARDED_BY(m_mutex);
+    //! Whether the thread is running a job it already took off m_jobs
+    bool m_busy GUARDED_BY(m_mutex){false};
+    bool m_failed GUARDED_BY(m_mutex){false};
+    bool m_running GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::thread m_thread;
+};
+
 #endif // PALLADIUM_FLATFILE_H
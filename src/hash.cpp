@@ -5,6 +5,9 @@
 #include <hash.h>
 #include <crypto/common.h>
 #include <crypto/hmac_sha512.h>
+#include <support/cleanse.h>
+
+#include <algorithm>
 
 
 inline uint32_t ROTL32(uint32_t x, int8_t r)
@@ -68,6 +71,55 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
     return h1;
 }
 
+void MurmurHash3Multi(const uint32_t* seeds, size_t count, const unsigned char* data, size_t len, uint32_t* hashes)
+{
+    // Same as MurmurHash3 above, one lane per seed.
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+
+    for (size_t j = 0; j < count; ++j) hashes[j] = seeds[j];
+
+    const size_t nblocks = len / 4;
+    for (size_t i = 0; i < nblocks; ++i) {
+        uint32_t k1 = ReadLE32(data + i*4);
+
+        k1 *= c1;
+        k1 = ROTL32(k1, 15);
+        k1 *= c2;
+
+        for (size_t j = 0; j < count; ++j) {
+            uint32_t h1 = hashes[j] ^ k1;
+            h1 = ROTL32(h1, 13);
+            hashes[j] = h1 * 5 + 0xe6546b64;
+        }
+    }
+
+    const uint8_t* tail = data + nblocks * 4;
+    uint32_t k1 = 0;
+    switch (len & 3) {
+        case 3:
+            k1 ^= tail[2] << 16;
+        case 2:
+            k1 ^= tail[1] << 8;
+        case 1:
+            k1 ^= tail[0];
+            k1 *= c1;
+            k1 = ROTL32(k1, 15);
+            k1 *= c2;
+            for (size_t j = 0; j < count; ++j) hashes[j] ^= k1;
+    }
+
+    for (size_t j = 0; j < count; ++j) {
+        uint32_t h1 = hashes[j] ^ (uint32_t)len;
+        h1 ^= h1 >> 16;
+        h1 *= 0x85ebca6b;
+        h1 ^= h1 >> 13;
+        h1 *= 0xc2b2ae35;
+        h1 ^= h1 >> 16;
+        hashes[j] = h1;
+    }
+}
+
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64])
 {
     unsigned char num[4];
@@ -77,3 +129,40 @@ void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char he
     num[3] = (nChild >>  0) & 0xFF;
     CHMAC_SHA512(chainCode.begin(), chainCode.size()).Write(&header, 1).Write(data, 32).Write(num, 4).Finalize(output);
 }
+
+void BIP32HashMany(const ChainCode &chainCode, unsigned int first, size_t count, unsigned char header, const unsigned char data[32], unsigned char* output)
+{
+    static constexpr size_t MSG_SIZE = 37;
+    static constexpr size_t CHUNK = 64;
+    const CHMAC_SHA512 hmac(chainCode.begin(), chainCode.size());
+    unsigned char msgs[CHUNK * MSG_SIZE];
+    for (size_t i = 0; i < CHUNK; ++i) {
+        msgs[MSG_SIZE * i] = header;
+        memcpy(msgs + MSG_SIZE * i + 1, data, 32);
+    }
+    while (count) {
+        const size_t n = std::min(count, CHUNK);
+        for (size_t i = 0; i < n; ++i) {
+            WriteBE32(msgs + MSG_SIZE * i + 33, first++);
+        }
+        hmac.FinalizeMany(msgs, MSG_SIZE, n, output);
+        output += CHMAC_SHA512::OUTPUT_SIZE * n;
+        count -= n;
+    }
+    memory_cleanse(msgs, sizeof(msgs));
+}
+
+void Hash160Many(unsigned char* output, const unsigned char* input, size_t count)
+{
+    // Hash in chunks, so that the intermediate SHA256 hashes stay on the stack.
+    static constexpr size_t CHUNK = 64;
+    unsigned char sha[CHUNK * CSHA256::OUTPUT_SIZE];
+    while (count) {
+        const size_t n = std::min(count, CHUNK);
+        SHA256_33(sha, input, n);
+        RIPEMD160_32(output, sha, n);
+        input += n * 33;
+        output += n * CRIPEMD160::OUTPUT_SIZE;
+        count -= n;
+    }
+}
@@ -113,6 +113,15 @@ inline uint160 Hash160(const prevector<N, unsigned char>& vch)
     return Hash160(vch.begin(), vch.end());
 }
 
+/**
+ * Compute the 160-bit hashes of count consecutive 33-byte strings (such as
+ * compressed public keys) into output, count*20 bytes. Both the SHA256 and
+ * the RIPEMD160 steps hash four or eight strings at a time when the CPU
+ * allows (see SHA256AutoDetect and RIPEMD160AutoDetect), so prefer this over
+ * a loop of Hash160 calls when many keys are hashed at once.
+ */
+void Hash160Many(unsigned char* output, const unsigned char* input, size_t count);
+
 /** A writer stream (for serialization) that computes a 256-bit hash. */
 class CHashWriter
 {
@@ -202,6 +211,15 @@ uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
+/**
+ * MurmurHash3 of the same data under count seeds at once, into hashes. The
+ * mixing of each data block is shared by all seeds, and the seeds are
+ * updated in independent lanes that the compiler can vectorize.
+ */
+void MurmurHash3Multi(const uint32_t* seeds, size_t count, const unsigned char* data, size_t len, uint32_t* hashes);
+
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
+/** BIP32Hash of the count children first, first + 1, ... of one parent, into count*64 bytes of output. */
+void BIP32HashMany(const ChainCode &chainCode, unsigned int first, size_t count, unsigned char header, const unsigned char data[32], unsigned char* output);
 
 #endif // PALLADIUM_HASH_H
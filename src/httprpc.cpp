@@ -6,9 +6,12 @@
 
 #include <chainparams.h>
 #include <crypto/hmac_sha256.h>
+#include <crypto/sha256.h>
 #include <httpserver.h>
+#include <random.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
+#include <sync.h>
 #include <ui_interface.h>
 #include <util/strencodings.h>
 #include <util/system.h>
@@ -16,6 +19,7 @@
 #include <walletinitinterface.h>
 
 #include <algorithm>
+#include <array>
 #include <iterator>
 #include <map>
 #include <memory>
@@ -72,6 +76,54 @@ static std::unique_ptr<HTTPRPCTimerInterface> httpRPCTimerInterface;
 /* RPC Auth Whitelist */
 static std::map<std::string, std::set<std::string>> g_rpc_whitelist;
 static bool g_rpc_whitelist_default = false;
+/* Methods handled by the priority work queue (-rpcprioritymethod) */
+static std::set<std::string> g_rpc_priority_methods;
+
+/** Methods handled by the priority work queue unless -rpcprioritymethod is set. */
+static const char* const DEFAULT_RPC_PRIORITY_METHODS[] = {"getblocktemplate", "sendrawtransaction", "submitblock", "submitheader"};
+
+/**
+ * Find the method of a single JSON-RPC request without parsing all of it,
+ * which may be large, such as a submitblock call. Returns an empty string for
+ * batches and when no method name is found. A wrong guess only sends the
+ * request to another work queue, as it is fully parsed when it is handled.
+ */
+static std::string PeekJSONRPCMethod(Span<const char> body)
+{
+    static const std::string key = "\"method\"";
+    const char* const end = body.data() + body.size();
+    const char* pos = std::find_if(body.data(), end, [](char c) { return !IsSpace(c); });
+    if (pos == end || *pos != '{') return {};
+    while (true) {
+        pos = std::search(pos, end, key.begin(), key.end());
+        if (pos == end) return {};
+        // Skip the text inside another string, where the quotes are escaped.
+        const bool escaped = *(pos - 1) == '\\';
+        pos += key.size();
+        if (!escaped) break;
+    }
+    pos = std::find_if(pos, end, [](char c) { return !IsSpace(c); });
+    if (pos == end || *pos != ':') return {};
+    pos = std::find_if(pos + 1, end, [](char c) { return !IsSpace(c); });
+    if (pos == end || *pos != '"') return {};
+    const char* name_end = std::find(++pos, end, '"');
+    if (name_end == end) return {};
+    return std::string(pos, name_end);
+}
+
+/** Route calls of latency-critical methods to the priority work queue. */
+static std::string SelectRPCWorkQueue(HTTPRequest* req)
+{
+    if (g_rpc_priority_methods.empty()) return {};
+    return g_rpc_priority_methods.count(PeekJSONRPCMethod(req->PeekBody())) ? HTTP_QUEUE_PRIORITY : "";
+}
+
+/** Whether the client asked for replies in CBOR rather than JSON. */
+static bool WantsCBOR(const HTTPRequest* req)
+{
+    const std::pair<bool, std::string> accept = req->GetHeader("accept");
+    return accept.first && accept.second.find("application/cbor") != std::string::npos;
+}
 
 static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
@@ -84,12 +136,55 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
     else if (code == RPC_METHOD_NOT_FOUND)
         nStatus = HTTP_NOT_FOUND;
 
+    if (WantsCBOR(req)) {
+        req->WriteHeader("Content-Type", "application/cbor");
+        req->WriteReply(nStatus, JSONRPCReplyCBOR(NullUniValue, objError, id));
+        return;
+    }
+
     std::string strReply = JSONRPCReply(NullUniValue, objError, id);
 
     req->WriteHeader("Content-Type", "application/json");
     req->WriteReply(nStatus, strReply);
 }
 
+/** Replies larger than this are sent in chunks of about this size as they are serialized. */
+static const size_t RPC_REPLY_CHUNK_SIZE = 1 << 20;
+
+/**
+ * Send the reply to a single JSON-RPC call. The reply is the one JSONRPCReply
+ * makes, but a large result is handed to the HTTP server in pieces while it is
+ * serialized, so the whole reply never exists as one string. Clients asking
+ * for CBOR get the JSONRPCReplyCBOR encoding instead.
+ */
+static void JSONResultReply(HTTPRequest* req, const UniValue& result, const UniValue& id)
+{
+    if (WantsCBOR(req)) {
+        req->WriteHeader("Content-Type", "application/cbor");
+        req->WriteReply(HTTP_OK, JSONRPCReplyCBOR(result, NullUniValue, id));
+        return;
+    }
+
+    req->WriteHeader("Content-Type", "application/json");
+    bool chunked = false;
+    std::string strReply = "{\"result\":";
+    result.write(strReply, RPC_REPLY_CHUNK_SIZE, [&](std::string& chunk) {
+        if (!chunked) {
+            req->StartChunkedReply(HTTP_OK);
+            chunked = true;
+        }
+        req->WriteReplyChunk(std::move(chunk));
+        chunk.clear();
+    });
+    strReply += ",\"error\":null,\"id\":" + id.write() + "}\n";
+    if (!chunked) {
+        req->WriteReply(HTTP_OK, strReply);
+        return;
+    }
+    req->WriteReplyChunk(std::move(strReply));
+    req->EndChunkedReply();
+}
+
 //This function checks username and password against -rpcauth
 //entries from config file.
 static bool multiUserAuthorized(std::string strUserPass)
@@ -131,10 +226,71 @@ static bool multiUserAuthorized(std::string strUserPass)
     return false;
 }
 
-static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUsernameOut)
+/** Number of recently accepted Authorization headers remembered by RPCAuthCache */
+static const size_t RPC_AUTH_CACHE_SIZE = 16;
+
+/**
+ * Authorization headers that recently passed CheckRPCAuthorization, so that
+ * clients repeating the same credentials skip the base64 decoding and the
+ * HMAC of every -rpcauth entry. Headers are kept as hashes salted per run,
+ * and a lookup compares against every entry in constant time.
+ */
+class RPCAuthCache
+{
+public:
+    typedef std::array<unsigned char, CSHA256::OUTPUT_SIZE> Key;
+
+    void Reset()
+    {
+        LOCK(m_mutex);
+        GetStrongRandBytes(m_salt.data(), m_salt.size());
+        m_entries = {};
+        m_next = 0;
+    }
+
+    Key GetKey(const std::string& auth) const
+    {
+        LOCK(m_mutex);
+        Key key;
+        CSHA256().Write(m_salt.data(), m_salt.size()).Write(reinterpret_cast<const unsigned char*>(auth.data()), auth.size()).Finalize(key.data());
+        return key;
+    }
+
+    bool Find(const Key& key, std::string& user) const
+    {
+        LOCK(m_mutex);
+        const Entry* found = nullptr;
+        for (const Entry& entry : m_entries) {
+            if (TimingResistantEqual(entry.m_key, key) && entry.m_valid) found = &entry;
+        }
+        if (!found) return false;
+        user = found->m_user;
+        return true;
+    }
+
+    void Add(const Key& key, const std::string& user)
+    {
+        LOCK(m_mutex);
+        m_entries[m_next] = Entry{key, user, true};
+        m_next = (m_next + 1) % m_entries.size();
+    }
+
+private:
+    struct Entry {
+        Key m_key;
+        std::string m_user;
+        bool m_valid;
+    };
+
+    mutable Mutex m_mutex;
+    std::array<unsigned char, 32> m_salt GUARDED_BY(m_mutex);
+    std::array<Entry, RPC_AUTH_CACHE_SIZE> m_entries GUARDED_BY(m_mutex);
+    size_t m_next GUARDED_BY(m_mutex) {0};
+};
+static RPCAuthCache g_rpc_auth_cache;
+
+static bool CheckRPCAuthorization(const std::string& strAuth, std::string& strAuthUsernameOut)
 {
-    if (strRPCUserColonPass.empty()) // Belt-and-suspenders measure if InitRPCAuthentication was not called
-        return false;
     if (strAuth.substr(0, 6) != "Basic ")
         return false;
     std::string strUserPass64 = strAuth.substr(6);
@@ -151,6 +307,17 @@ static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUserna
     return multiUserAuthorized(strUserPass);
 }
 
+static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUsernameOut)
+{
+    if (strRPCUserColonPass.empty()) // Belt-and-suspenders measure if InitRPCAuthentication was not called
+        return false;
+    const RPCAuthCache::Key key = g_rpc_auth_cache.GetKey(strAuth);
+    if (g_rpc_auth_cache.Find(key, strAuthUsernameOut)) return true;
+    if (!CheckRPCAuthorization(strAuth, strAuthUsernameOut)) return false;
+    g_rpc_auth_cache.Add(key, strAuthUsernameOut);
+    return true;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -208,7 +375,8 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
             UniValue result = tableRPC.execute(jreq);
 
             // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            JSONResultReply(req, result, jreq.id);
+            return true;
 
         // array of requests
         } else if (valRequest.isArray()) {
@@ -247,6 +415,7 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 
 static bool InitRPCAuthentication()
 {
+    g_rpc_auth_cache.Reset();
     if (gArgs.GetArg("-rpcpassword", "") == "")
     {
         LogPrintf("No rpcpassword set - using random cookie authentication.\n");
@@ -294,9 +463,18 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    g_rpc_priority_methods.clear();
+    if (gArgs.IsArgSet("-rpcprioritymethod")) {
+        for (const std::string& method : gArgs.GetArgs("-rpcprioritymethod")) {
+            if (!method.empty()) g_rpc_priority_methods.insert(method);
+        }
+    } else {
+        g_rpc_priority_methods.insert(std::begin(DEFAULT_RPC_PRIORITY_METHODS), std::end(DEFAULT_RPC_PRIORITY_METHODS));
+    }
+
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, "", SelectRPCWorkQueue);
     if (g_wallet_init_interface.HasWalletSupport()) {
-        RegisterHTTPHandler("/wallet/", false, HTTPReq_JSONRPC);
+        RegisterHTTPHandler("/wallet/", false, HTTPReq_JSONRPC, "", SelectRPCWorkQueue);
     }
     struct event_base* eventBase = EventBase();
     assert(eventBase);
@@ -5,6 +5,7 @@
 #ifndef PALLADIUM_HTTPRPC_H
 #define PALLADIUM_HTTPRPC_H
 
+#include <stddef.h>
 
 /** Start HTTP RPC subsystem.
  * Precondition; HTTP and RPC has been started.
@@ -18,6 +19,9 @@ void InterruptHTTPRPC();
  */
 void StopHTTPRPC();
 
+/** Default for -restmaxutxos, the most outpoints a REST getutxos request may query */
+static const size_t DEFAULT_REST_MAX_UTXOS = 15;
+
 /** Start HTTP REST subsystem.
  * Precondition; HTTP and RPC has been started.
  */
@@ -30,4 +34,16 @@ void InterruptREST();
  */
 void StopREST();
 
+/** Default for -metrics */
+static const bool DEFAULT_METRICS_ENABLE = false;
+
+/** Start the HTTP /metrics endpoint.
+ * Precondition; HTTP has been started.
+ */
+void StartMetrics();
+/** Stop the HTTP /metrics endpoint.
+ * Precondition; HTTP has been stopped.
+ */
+void StopMetrics();
+
 #endif
@@ -14,7 +14,9 @@
 #include <shutdown.h>
 #include <sync.h>
 #include <ui_interface.h>
+#include <util/memory.h>
 
+#include <chrono>
 #include <deque>
 #include <memory>
 #include <stdio.h>
@@ -29,6 +31,8 @@
 #include <event2/bufferevent.h>
 #include <event2/util.h>
 #include <event2/keyvalq_struct.h>
+#include <event2/http.h>
+#include <event2/http_struct.h>
 
 #include <support/events.h>
 
@@ -42,6 +46,11 @@
 /** Maximum size of http request (request line + headers) */
 static const size_t MAX_HEADERS_SIZE = 8192;
 
+/** How long the event loop waits for room in a full work queue before rejecting a request */
+static const std::chrono::milliseconds MAX_WORK_QUEUE_WAIT{2000};
+
+constexpr size_t HTTPWorkQueueInfo::WAIT_HISTOGRAM_BUCKETS;
+
 /** HTTP request work item */
 class HTTPWorkItem final : public HTTPClosure
 {
@@ -64,6 +73,10 @@ private:
 
 /** Simple work queue for distributing work over multiple threads.
  * Work items are simply callable objects.
+ *
+ * When the queue is full, Enqueue waits for a worker to take an item rather
+ * than failing at once. As it is called from the event loop, that stops the
+ * server reading requests, which pushes back on the clients.
  */
 template <typename WorkItem>
 class WorkQueue
@@ -72,28 +85,38 @@ private:
     /** Mutex protects entire object */
     Mutex cs;
     std::condition_variable cond;
-    std::deque<std::unique_ptr<WorkItem>> queue;
+    std::condition_variable cond_space;
+    /** Items with the time (in microseconds) they were enqueued */
+    std::deque<std::pair<int64_t, std::unique_ptr<WorkItem>>> queue;
     bool running;
     size_t maxDepth;
+    HTTPWorkQueueInfo info;
 
 public:
     explicit WorkQueue(size_t _maxDepth) : running(true),
                                  maxDepth(_maxDepth)
     {
+        info.max_depth = maxDepth;
     }
     /** Precondition: worker threads have all stopped (they have been joined).
      */
     ~WorkQueue()
     {
     }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    /** Enqueue a work item, waiting up to max_wait for room */
+    bool Enqueue(WorkItem* item, std::chrono::milliseconds max_wait)
     {
-        LOCK(cs);
-        if (queue.size() >= maxDepth) {
+        WAIT_LOCK(cs, lock);
+        if (running && queue.size() >= maxDepth) {
+            ++info.delayed;
+            cond_space.wait_for(lock, max_wait, [this] { return !running || queue.size() < maxDepth; });
+        }
+        if (!running || queue.size() >= maxDepth) {
+            ++info.rejected;
             return false;
         }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
+        queue.emplace_back(GetTimeMicros(), std::unique_ptr<WorkItem>(item));
+        info.peak_depth = std::max(info.peak_depth, queue.size());
         cond.notify_one();
         return true;
     }
@@ -108,8 +131,15 @@ public:
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = std::move(queue.front());
+                const int64_t waited = GetTimeMicros() - queue.front().first;
+                size_t bucket = 0;
+                while (bucket + 1 < HTTPWorkQueueInfo::WAIT_HISTOGRAM_BUCKETS && waited >= HTTPWorkQueueInfo::WaitBucketLimit(bucket)) {
+                    ++bucket;
+                }
+                ++info.wait_histogram[bucket];
+                i = std::move(queue.front().second);
                 queue.pop_front();
+                cond_space.notify_one();
             }
             (*i)();
         }
@@ -120,18 +150,43 @@ public:
         LOCK(cs);
         running = false;
         cond.notify_all();
+        cond_space.notify_all();
+    }
+    /** Return the statistics of the queue */
+    HTTPWorkQueueInfo GetInfo()
+    {
+        LOCK(cs);
+        HTTPWorkQueueInfo ret = info;
+        ret.depth = queue.size();
+        return ret;
     }
 };
 
 struct HTTPPathHandler
 {
-    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler):
-        prefix(_prefix), exactMatch(_exactMatch), handler(_handler)
+    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler, std::string _queue, HTTPQueueSelector _selector):
+        prefix(_prefix), exactMatch(_exactMatch), handler(_handler), queue(_queue), selector(_selector)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    std::string queue;
+    HTTPQueueSelector selector;
+};
+
+/** Work queue with its own worker threads */
+struct HTTPWorkQueue
+{
+    HTTPWorkQueue(std::string _name, int _threads, size_t depth, std::string _depth_arg):
+        name(_name), threads(_threads), depth_arg(_depth_arg), queue(depth)
+    {
+    }
+    std::string name;
+    int threads;
+    //! The setting for the depth of the queue
+    std::string depth_arg;
+    WorkQueue<HTTPClosure> queue;
 };
 
 /** HTTP module state */
@@ -142,13 +197,24 @@ static struct event_base* eventBase = nullptr;
 static struct evhttp* eventHTTP = nullptr;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure>* workQueue = nullptr;
+//! Work queues for handling longer requests off the event loop thread. The
+//! first, unnamed one takes the requests not routed to another one.
+static std::vector<std::unique_ptr<HTTPWorkQueue>> g_work_queues;
 //! Handlers for (sub)paths
 static std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
 static std::vector<evhttp_bound_socket *> boundSockets;
 
+/** Find a work queue by name, or the default one if there is no such queue */
+static HTTPWorkQueue* FindWorkQueue(const std::string& name)
+{
+    if (g_work_queues.empty()) return nullptr;
+    for (const auto& queue : g_work_queues) {
+        if (queue->name == name) return queue.get();
+    }
+    return g_work_queues.front().get();
+}
+
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
 {
@@ -262,12 +328,16 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        std::string queue_name = i->selector ? i->selector(hreq.get()) : std::string();
+        if (queue_name.empty()) queue_name = i->queue;
+        HTTPWorkQueue* queue = FindWorkQueue(queue_name);
+        assert(queue);
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler));
-        assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        if (queue->queue.Enqueue(item.get(), MAX_WORK_QUEUE_WAIT))
             item.release(); /* if true, queue took ownership */
         else {
-            LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
+            LogPrintf("WARNING: request rejected because %shttp work queue depth exceeded, it can be increased with the %s= setting\n",
+                      queue->name.empty() ? "" : queue->name + " ", queue->depth_arg);
             item->req->WriteReply(HTTP_INTERNAL_SERVER_ERROR, "Work queue depth exceeded");
         }
     } else {
@@ -336,10 +406,10 @@ static bool HTTPBindAddresses(struct evhttp* http)
 }
 
 /** Simple wrapper to set thread name and run work queue */
-static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue, int worker_num)
+static void HTTPWorkQueueRun(HTTPWorkQueue* queue, int worker_num)
 {
-    util::ThreadRename(strprintf("httpworker.%i", worker_num));
-    queue->Run();
+    util::ThreadRename(queue->name.empty() ? strprintf("httpworker.%i", worker_num) : strprintf("http%s.%i", queue->name, worker_num));
+    queue->queue.Run();
 }
 
 /** libevent event log callback */
@@ -398,8 +468,22 @@ bool InitHTTPServer()
     LogPrint(BCLog::HTTP, "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)gArgs.GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    g_work_queues.push_back(MakeUnique<HTTPWorkQueue>("", std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L), workQueueDepth, "-rpcworkqueue"));
+
+    // Further queues keep requests routed to them from waiting behind others.
+    const int rest_threads = gArgs.GetArg("-restthreads", DEFAULT_HTTP_REST_THREADS);
+    if (rest_threads > 0) {
+        const int depth = std::max((long)gArgs.GetArg("-restworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
+        LogPrintf("HTTP: creating %s work queue of depth %d\n", HTTP_QUEUE_REST, depth);
+        g_work_queues.push_back(MakeUnique<HTTPWorkQueue>(HTTP_QUEUE_REST, rest_threads, depth, "-restworkqueue"));
+    }
+    const int priority_threads = gArgs.GetArg("-rpcprioritythreads", DEFAULT_HTTP_PRIORITY_THREADS);
+    if (priority_threads > 0) {
+        const int depth = std::max((long)gArgs.GetArg("-rpcpriorityworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
+        LogPrintf("HTTP: creating %s work queue of depth %d\n", HTTP_QUEUE_PRIORITY, depth);
+        g_work_queues.push_back(MakeUnique<HTTPWorkQueue>(HTTP_QUEUE_PRIORITY, priority_threads, depth, "-rpcpriorityworkqueue"));
+    }
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
     // transfer ownership to eventBase/HTTP via .release()
     eventBase = base_ctr.release();
     eventHTTP = http_ctr.release();
@@ -426,12 +510,15 @@ static std::vector<std::thread> g_thread_http_workers;
 void StartHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Starting HTTP server\n");
-    int rpcThreads = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
+    for (const auto& queue : g_work_queues) {
+        LogPrintf("HTTP: starting %d %sworker threads\n", queue->threads, queue->name.empty() ? "" : queue->name + " ");
+    }
     threadHTTP = std::thread(ThreadHTTP, eventBase);
 
-    for (int i = 0; i < rpcThreads; i++) {
-        g_thread_http_workers.emplace_back(HTTPWorkQueueRun, workQueue, i);
+    for (const auto& queue : g_work_queues) {
+        for (int i = 0; i < queue->threads; i++) {
+            g_thread_http_workers.emplace_back(HTTPWorkQueueRun, queue.get(), i);
+        }
     }
 }
 
@@ -442,21 +529,29 @@ void InterruptHTTPServer()
         // Reject requests on current connections
         evhttp_set_gencb(eventHTTP, http_reject_request_cb, nullptr);
     }
-    if (workQueue)
-        workQueue->Interrupt();
+    for (const auto& queue : g_work_queues) {
+        queue->queue.Interrupt();
+    }
+}
+
+bool GetHTTPWorkQueueInfo(HTTPWorkQueueInfo& info, const std::string& queue)
+{
+    HTTPWorkQueue* found = FindWorkQueue(queue);
+    if (!found || found->name != queue) return false;
+    info = found->queue.GetInfo();
+    return true;
 }
 
 void StopHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Stopping HTTP server\n");
-    if (workQueue) {
+    if (!g_work_queues.empty()) {
         LogPrint(BCLog::HTTP, "Waiting for HTTP worker threads to exit\n");
         for (auto& thread: g_thread_http_workers) {
             thread.join();
         }
         g_thread_http_workers.clear();
-        delete workQueue;
-        workQueue = nullptr;
+        g_work_queues.clear();
     }
     // Unlisten sockets, these are what make the event loop running, which means
     // that after this and all connections are closed the event loop will quit.
@@ -510,13 +605,16 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
-HTTPRequest::HTTPRequest(struct evhttp_request* _req, bool _replySent) : req(_req), replySent(_replySent)
+HTTPRequest::HTTPRequest(struct evhttp_request* _req, bool _replySent) : req(_req), replySent(_replySent), chunkedReplyStarted(false)
 {
 }
 
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (chunkedReplyStarted && !replySent) {
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndChunkedReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL_SERVER_ERROR, "Unhandled request");
@@ -535,6 +633,19 @@ std::pair<bool, std::string> HTTPRequest::GetHeader(const std::string& hdr) cons
         return std::make_pair(false, "");
 }
 
+Span<const char> HTTPRequest::PeekBody()
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return {};
+    size_t size = evbuffer_get_length(buf);
+    // Makes the buffer contiguous, so ReadBody() won't have to copy it again.
+    const char* data = (const char*)evbuffer_pullup(buf, size);
+    if (!data)
+        return {};
+    return Span<const char>(data, size);
+}
+
 std::string HTTPRequest::ReadBody()
 {
     struct evbuffer* buf = evhttp_request_get_input_buffer(req);
@@ -567,9 +678,43 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
  * Replies must be sent in the main loop in the main http thread,
  * this cannot be done from worker threads.
  */
+struct HTTPRequest::ReplyBuffer
+{
+    Mutex mutex;
+    std::condition_variable cond;
+    //! Bytes of chunks not yet handed to libevent
+    size_t queued GUARDED_BY(mutex){0};
+    //! Bytes in the output buffer of the connection when last looked at
+    size_t buffered GUARDED_BY(mutex){0};
+};
+
+/** Bytes waiting to be written to the connection of a request. Call from the event loop only. */
+static size_t ConnectionOutputLength(struct evhttp_request* req)
+{
+    evhttp_connection* conn = evhttp_request_get_connection(req);
+    if (!conn) return 0;
+    bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+    if (!bev) return 0;
+    return evbuffer_get_length(bufferevent_get_output(bev));
+}
+
+/** Re-enable reading from the socket once a reply was sent. This is the second part of the libevent workaround above. */
+static void ReenableReading(struct evhttp_request* req)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        evhttp_connection* conn = evhttp_request_get_connection(req);
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
-    assert(!replySent && req);
+    assert(!replySent && !chunkedReplyStarted && req);
     if (ShutdownRequested()) {
         WriteHeader("Connection", "close");
     }
@@ -580,19 +725,90 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
-            }
+        ReenableReading(req_copy);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+void HTTPRequest::StartChunkedReply(int nStatus)
+{
+    assert(!replySent && !chunkedReplyStarted && req);
+    if (ShutdownRequested() || req->major < 1 || (req->major == 1 && req->minor < 1)) {
+        // Without chunked encoding, the end of the body is the end of the connection.
+        WriteHeader("Connection", "close");
+    }
+    // The events below are handled in the order they are triggered.
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+        // The connection may already have failed; the chunk and end
+        // functions allow for that, but starting doesn't.
+        if (evhttp_request_get_connection(req_copy)) {
+            evhttp_send_reply_start(req_copy, nStatus, nullptr);
         }
     });
     ev->trigger(nullptr);
+    chunkedReplyStarted = true;
+    m_reply_buffer = std::make_shared<ReplyBuffer>();
+}
+
+void HTTPRequest::WriteReplyChunk(std::string chunk)
+{
+    assert(!replySent && chunkedReplyStarted && req);
+    if (chunk.empty()) return;
+    auto req_copy = req;
+    auto data = std::make_shared<std::string>(std::move(chunk));
+    auto state = m_reply_buffer;
+    {
+        LOCK(state->mutex);
+        state->queued += data->size();
+    }
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, data, state]{
+        struct evbuffer* evb = evbuffer_new();
+        evbuffer_add(evb, data->data(), data->size());
+        evhttp_send_reply_chunk(req_copy, evb);
+        evbuffer_free(evb);
+        const size_t buffered = ConnectionOutputLength(req_copy);
+        LOCK(state->mutex);
+        state->queued -= data->size();
+        state->buffered = buffered;
+        state->cond.notify_all();
+    });
+    ev->trigger(nullptr);
+}
+
+void HTTPRequest::WaitForReplySent(size_t max_buffered)
+{
+    assert(!replySent && chunkedReplyStarted && req);
+    auto req_copy = req;
+    auto state = m_reply_buffer;
+    WAIT_LOCK(state->mutex, lock);
+    while (state->queued + state->buffered > max_buffered && !ShutdownRequested()) {
+        // libevent doesn't tell when its output buffer drains, so look at it
+        // from the event loop every few milliseconds.
+        HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, state]{
+            const size_t buffered = ConnectionOutputLength(req_copy);
+            LOCK(state->mutex);
+            state->buffered = buffered;
+            state->cond.notify_all();
+        });
+        ev->trigger(nullptr);
+        state->cond.wait_for(lock, std::chrono::milliseconds(10), [&]() EXCLUSIVE_LOCKS_REQUIRED(state->mutex) {
+            return state->queued + state->buffered <= max_buffered;
+        });
+    }
+}
+
+void HTTPRequest::EndChunkedReply()
+{
+    assert(!replySent && chunkedReplyStarted && req);
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy]{
+        evhttp_send_reply_end(req_copy);
+        ReenableReading(req_copy);
+    });
+    ev->trigger(nullptr);
     replySent = true;
     req = nullptr; // transferred back to main thread
 }
@@ -637,10 +853,10 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod() const
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const std::string& queue, const HTTPQueueSelector& selector)
 {
     LogPrint(BCLog::HTTP, "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, queue, selector));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
@@ -5,12 +5,26 @@
 #ifndef PALLADIUM_HTTPSERVER_H
 #define PALLADIUM_HTTPSERVER_H
 
+#include <span.h>
+
+#include <array>
+#include <memory>
+#include <stdint.h>
 #include <string>
 #include <functional>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
+//! Default for -restthreads (0: REST requests share the RPC work queue)
+static const int DEFAULT_HTTP_REST_THREADS=0;
+//! Default for -rpcprioritythreads (0: no priority work queue)
+static const int DEFAULT_HTTP_PRIORITY_THREADS=1;
+
+//! Work queue of REST requests, if -restthreads is set
+static const char* const HTTP_QUEUE_REST = "rest";
+//! Work queue of latency-critical RPC calls, see -rpcprioritymethod
+static const char* const HTTP_QUEUE_PRIORITY = "priority";
 
 struct evhttp_request;
 struct event_base;
@@ -31,17 +45,53 @@ void InterruptHTTPServer();
 /** Stop HTTP server */
 void StopHTTPServer();
 
+/** Statistics of the queue of HTTP requests waiting for a worker thread */
+struct HTTPWorkQueueInfo
+{
+    static constexpr size_t WAIT_HISTOGRAM_BUCKETS = 6;
+    /** Upper limit (exclusive, in microseconds) of the wait times counted in a bucket but the last: 1 ms, 10 ms, ... */
+    static int64_t WaitBucketLimit(size_t bucket)
+    {
+        int64_t limit = 1000;
+        while (bucket--) limit *= 10;
+        return limit;
+    }
+
+    size_t depth{0};
+    size_t max_depth{0};
+    size_t peak_depth{0};
+    //! Requests that found the queue full and had to wait for room
+    uint64_t delayed{0};
+    //! Requests rejected because the queue stayed full
+    uint64_t rejected{0};
+    //! Number of requests by how long they waited in the queue
+    std::array<uint64_t, WAIT_HISTOGRAM_BUCKETS> wait_histogram{{}};
+};
+
+/**
+ * Get the statistics of an HTTP work queue, by default the one requests go
+ * to unless they are routed elsewhere; false if there is no such queue or the
+ * HTTP server isn't running.
+ */
+bool GetHTTPWorkQueueInfo(HTTPWorkQueueInfo& info, const std::string& queue = "");
+
 /** Change logging level for libevent. Removes BCLog::LIBEVENT from log categories if
  * libevent doesn't support debug logging.*/
 bool UpdateHTTPServerLogging(bool enable);
 
 /** Handler for requests to a certain HTTP path */
 typedef std::function<bool(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Picks the work queue of a request before it is queued; an empty name keeps the handler's queue.
+ * It runs on the event loop thread, so it has to be quick.
+ */
+typedef std::function<std::string(HTTPRequest* req)> HTTPQueueSelector;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Its requests are handled by the work queue named queue, or
+ * the one picked by selector, if that queue exists, and the default
+ * queue otherwise.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const std::string& queue = "", const HTTPQueueSelector& selector = nullptr);
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
@@ -58,6 +108,10 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    bool chunkedReplyStarted;
+    struct ReplyBuffer;
+    //! State of a chunked reply shared with the event loop
+    std::shared_ptr<ReplyBuffer> m_reply_buffer;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req, bool replySent = false);
@@ -89,6 +143,11 @@ public:
      */
     std::pair<bool, std::string> GetHeader(const std::string& hdr) const;
 
+    /**
+     * Look at the request body without consuming it, e.g. to route the request.
+     */
+    Span<const char> PeekBody();
+
     /**
      * Read request body.
      *
@@ -113,6 +172,38 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start an HTTP reply whose body is sent in pieces with WriteReplyChunk,
+     * so that it never has to be held as a whole. The body is sent with
+     * chunked transfer encoding, or to HTTP/1.0 clients up to the closing of
+     * the connection.
+     *
+     * @note Call this instead of WriteReply, after writing the headers. Finish
+     * the reply with EndChunkedReply.
+     */
+    void StartChunkedReply(int nStatus);
+
+    /**
+     * Send the next piece of the body of a reply started with StartChunkedReply.
+     */
+    void WriteReplyChunk(std::string chunk);
+
+    /**
+     * Wait until no more than max_buffered bytes of a reply started with
+     * StartChunkedReply are waiting to be sent to the client, so that a reply
+     * produced faster than the connection takes it isn't buffered whole.
+     * Returns early on shutdown.
+     */
+    void WaitForReplySent(size_t max_buffered);
+
+    /**
+     * Finish a reply started with StartChunkedReply.
+     *
+     * @note As with WriteReply, do not call any other HTTPRequest methods
+     * after calling this.
+     */
+    void EndChunkedReply();
 };
 
 /** Event handler closure.
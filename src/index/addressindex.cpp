@@ -0,0 +1,244 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <crypto/sha256.h>
+#include <index/addressindex.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores one entry per output of the active chain, except for unspendable ones
+ * and those of the genesis block. Keys have the type
+ * [DB_ADDRESS_OUTPUT, uint256 script hash, uint32 height (BE), uint256 txid, uint32 vout (BE)],
+ * so that all outputs paying to a script are adjacent and ordered by height. The value holds the
+ * amount and, once the output is spent, the spending txid, input index and height.
+ *
+ * Everything in the key of a spent output can be recovered from the undo data of the spending
+ * block, so spending an output and disconnecting a block are blind writes that don't need to read
+ * the database first.
+ */
+constexpr char DB_ADDRESS_OUTPUT = 'o';
+
+std::unique_ptr<AddressIndex> g_addressindex;
+
+namespace {
+
+struct DBOutputKey {
+    uint256 script_hash;
+    int height;
+    uint256 txid;
+    uint32_t vout;
+
+    DBOutputKey() : height(0), vout(0) {}
+    DBOutputKey(const uint256& script_hash_in, int height_in, const uint256& txid_in, uint32_t vout_in) :
+        script_hash(script_hash_in), height(height_in), txid(txid_in), vout(vout_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_ADDRESS_OUTPUT);
+        s << script_hash;
+        ser_writedata32be(s, height);
+        s << txid;
+        ser_writedata32be(s, vout);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_ADDRESS_OUTPUT) {
+            throw std::ios_base::failure("Invalid format for address index DB output key");
+        }
+        s >> script_hash;
+        height = ser_readdata32be(s);
+        s >> txid;
+        vout = ser_readdata32be(s);
+    }
+};
+
+struct DBVal {
+    CAmount value;
+    uint256 spent_txid;
+    uint32_t spent_vin;
+    int spent_height;
+
+    DBVal() : value(0), spent_vin(0), spent_height(-1) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << VARINT_MODE(value, VarIntMode::NONNEGATIVE_SIGNED);
+        bool spent = !spent_txid.IsNull();
+        s << spent;
+        if (spent) {
+            s << spent_txid << VARINT(spent_vin) << VARINT_MODE(spent_height, VarIntMode::NONNEGATIVE_SIGNED);
+        }
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s >> VARINT_MODE(value, VarIntMode::NONNEGATIVE_SIGNED);
+        bool spent;
+        s >> spent;
+        if (spent) {
+            s >> spent_txid >> VARINT(spent_vin) >> VARINT_MODE(spent_height, VarIntMode::NONNEGATIVE_SIGNED);
+        } else {
+            spent_txid.SetNull();
+            spent_vin = 0;
+            spent_height = -1;
+        }
+    }
+};
+
+}; // namespace
+
+/**
+ * Access to the address index database (indexes/addressindex/)
+ */
+class AddressIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false) :
+        BaseIndex::DB(GetDataDir() / "indexes" / "addressindex", n_cache_size, f_memory, f_wipe)
+    {}
+};
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<AddressIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+AddressIndex::~AddressIndex() {}
+
+uint256 AddressIndex::GetScriptHash(const CScript& script)
+{
+    uint256 hash;
+    CSHA256().Write(script.data(), script.size()).Finalize(hash.begin());
+    return hash;
+}
+
+bool AddressIndex::UpdateBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex, bool connect) const
+{
+    // Exclude genesis block transaction because outputs are not spendable.
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: undo data of block %s doesn't match the block", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    // Transactions may spend outputs created earlier in the same block, so when disconnecting go
+    // backwards to restore those outputs only after they have been erased.
+    for (size_t n = 0; n < block.vtx.size(); ++n) {
+        const size_t i = connect ? n : block.vtx.size() - 1 - n;
+        const CTransaction& tx = *block.vtx[i];
+
+        if (!connect) {
+            for (uint32_t j = 0; j < tx.vout.size(); ++j) {
+                if (tx.vout[j].scriptPubKey.IsUnspendable()) continue;
+                batch.Erase(DBOutputKey(GetScriptHash(tx.vout[j].scriptPubKey), pindex->nHeight, tx.GetHash(), j));
+            }
+        }
+
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+            if (tx_undo.vprevout.size() != tx.vin.size()) {
+                return error("%s: undo data of transaction %s doesn't match the transaction", __func__, tx.GetHash().ToString());
+            }
+            for (uint32_t j = 0; j < tx.vin.size(); ++j) {
+                const Coin& coin = tx_undo.vprevout[j];
+                const COutPoint& prevout = tx.vin[j].prevout;
+                DBVal value;
+                value.value = coin.out.nValue;
+                if (connect) {
+                    value.spent_txid = tx.GetHash();
+                    value.spent_vin = j;
+                    value.spent_height = pindex->nHeight;
+                }
+                batch.Write(DBOutputKey(GetScriptHash(coin.out.scriptPubKey), coin.nHeight, prevout.hash, prevout.n), value);
+            }
+        }
+
+        if (connect) {
+            for (uint32_t j = 0; j < tx.vout.size(); ++j) {
+                if (tx.vout[j].scriptPubKey.IsUnspendable()) continue;
+                DBVal value;
+                value.value = tx.vout[j].nValue;
+                batch.Write(DBOutputKey(GetScriptHash(tx.vout[j].scriptPubKey), pindex->nHeight, tx.GetHash(), j), value);
+            }
+        }
+    }
+    return true;
+}
+
+std::unique_ptr<BaseIndex::PreparedBlock> AddressIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
+{
+    auto prepared = MakeUnique<PreparedBatch>(*m_db);
+    if (!UpdateBlock(prepared->batch, block, pindex, /*connect=*/ true)) {
+        return nullptr;
+    }
+    return prepared;
+}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    return m_db->WriteBatch(static_cast<PreparedBatch&>(prepared).batch);
+}
+
+bool AddressIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // Revert the disconnected blocks in a single batch, so a failure leaves the index at current_tip.
+    CDBBatch batch(*m_db);
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            return error("%s: failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!UpdateBlock(batch, block, pindex, /*connect=*/ false)) {
+            return false;
+        }
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& AddressIndex::GetDB() const { return *m_db; }
+
+bool AddressIndex::FindOutputs(const uint256& script_hash, int start_height, int end_height, bool unspent_only,
+                               std::vector<AddressOutput>& outputs) const
+{
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    for (db_it->Seek(DBOutputKey(script_hash, std::max(start_height, 0), uint256(), 0)); db_it->Valid(); db_it->Next()) {
+        DBOutputKey key;
+        if (!db_it->GetKey(key) || key.script_hash != script_hash || key.height > end_height) {
+            break;
+        }
+
+        DBVal value;
+        if (!db_it->GetValue(value)) {
+            return error("%s: unable to read value in %s at output %s:%d",
+                         __func__, GetName(), key.txid.ToString(), key.vout);
+        }
+        if (unspent_only && !value.spent_txid.IsNull()) continue;
+
+        AddressOutput output;
+        output.txid = key.txid;
+        output.vout = key.vout;
+        output.height = key.height;
+        output.value = value.value;
+        output.spent_txid = value.spent_txid;
+        output.spent_vin = value.spent_vin;
+        output.spent_height = value.spent_height;
+        outputs.push_back(std::move(output));
+    }
+    return true;
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_INDEX_ADDRESSINDEX_H
+#define PALLADIUM_INDEX_ADDRESSINDEX_H
+
+#include <amount.h>
+#include <chain.h>
+#include <index/base.h>
+#include <script/script.h>
+#include <uint256.h>
+
+#include <limits>
+#include <vector>
+
+/** An output paying to an indexed script, and the input spending it if any. */
+struct AddressOutput {
+    uint256 txid;
+    uint32_t vout{0};
+    int height{0};
+    CAmount value{0};
+    //! Null while the output is unspent.
+    uint256 spent_txid;
+    uint32_t spent_vin{0};
+    int spent_height{-1};
+
+    bool IsSpent() const { return !spent_txid.IsNull(); }
+};
+
+/**
+ * AddressIndex is used to look up the outputs paying to a scriptPubKey,
+ * spent or not. The index is written to a LevelDB database with one entry per
+ * output, keyed by the SHA256 of the scriptPubKey followed by the height of
+ * the block creating the output, so an address's history is a range scan.
+ * Each entry is rewritten with the spending input once the output is spent,
+ * using the undo data of the spending block.
+ */
+class AddressIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+    /// Apply (or, when disconnecting, revert) the changes to the index for one block.
+    bool UpdateBlock(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex, bool connect) const;
+
+protected:
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "addressindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~AddressIndex() override;
+
+    /// The key an output script is indexed under.
+    static uint256 GetScriptHash(const CScript& script);
+
+    /// Look up the outputs paying to a script, ordered by the height of the
+    /// block creating them.
+    ///
+    /// @param[in]   script_hash  The hash of the scriptPubKey, see GetScriptHash.
+    /// @param[in]   start_height  Ignore outputs created below this height.
+    /// @param[in]   end_height  Ignore outputs created above this height.
+    /// @param[in]   unspent_only  Skip outputs that have been spent.
+    /// @param[out]  outputs  The outputs found are appended here.
+    /// @return  false if the database could not be read
+    bool FindOutputs(const uint256& script_hash, int start_height, int end_height, bool unspent_only,
+                     std::vector<AddressOutput>& outputs) const;
+    bool FindOutputs(const uint256& script_hash, std::vector<AddressOutput>& outputs) const
+    {
+        return FindOutputs(script_hash, 0, std::numeric_limits<int>::max(), false, outputs);
+    }
+};
+
+/// The global address index, used by the address RPCs. May be null.
+extern std::unique_ptr<AddressIndex> g_addressindex;
+
+#endif // PALLADIUM_INDEX_ADDRESSINDEX_H
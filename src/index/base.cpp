@@ -6,15 +6,26 @@
 #include <index/base.h>
 #include <shutdown.h>
 #include <tinyformat.h>
+#include <txdb.h>
 #include <ui_interface.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 #include <validation.h>
 #include <warnings.h>
 
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
+
 constexpr char DB_BEST_BLOCK = 'B';
 
 constexpr int64_t SYNC_LOG_INTERVAL = 30; // seconds
 constexpr int64_t SYNC_LOCATOR_WRITE_INTERVAL = 30; // seconds
+/** Number of blocks each sync thread may prepare ahead of the block being written. */
+constexpr size_t SYNC_BLOCKS_AHEAD_PER_THREAD = 8;
+
+std::atomic<int> g_index_sync_threads{DEFAULT_INDEX_SYNC_THREADS};
 
 template<typename... Args>
 static void FatalError(const char* fmt, const Args&... args)
@@ -29,7 +40,7 @@ static void FatalError(const char* fmt, const Args&... args)
 }
 
 BaseIndex::DB::DB(const fs::path& path, size_t n_cache_size, bool f_memory, bool f_wipe, bool f_obfuscate) :
-    CDBWrapper(path, n_cache_size, f_memory, f_wipe, f_obfuscate)
+    CDBWrapper(path, n_cache_size, f_memory, f_wipe, f_obfuscate, gArgs.GetBoolArg("-indexcompression", DEFAULT_INDEX_COMPRESSION))
 {}
 
 bool BaseIndex::DB::ReadBestBlock(CBlockLocator& locator) const
@@ -91,8 +102,71 @@ void BaseIndex::ThreadSync()
     if (!m_synced) {
         auto& consensus_params = Params().GetConsensus();
 
+        // Blocks are queued in chain order. The sync threads read and prepare them in any order,
+        // and this thread writes them from the front of the queue once they are done.
+        struct QueuedBlock {
+            explicit QueuedBlock(const CBlockIndex* pindex_in) : pindex(pindex_in) {}
+            const CBlockIndex* const pindex;
+            bool done{false};
+            bool read{false};
+            CBlock block;
+            std::unique_ptr<PreparedBlock> prepared;
+        };
+        Mutex queue_mutex;
+        std::condition_variable queue_cv;
+        std::deque<QueuedBlock> queue; // guarded by queue_mutex, only this thread adds or removes blocks
+        size_t queue_begin = 0;        // guarded by queue_mutex, number of blocks removed from the queue
+        size_t next_to_prepare = 0;    // guarded by queue_mutex
+        bool stop = false;             // guarded by queue_mutex
+        size_t in_flight = 0;          // the size of the queue, only used by this thread
+
+        auto prepare = [&](QueuedBlock& queued) {
+            queued.read = ReadBlockFromDisk(queued.block, queued.pindex, consensus_params);
+            if (queued.read) {
+                queued.prepared = PrepareBlock(queued.block, queued.pindex);
+            }
+        };
+
+        const int n_threads = std::max(0, std::min(g_index_sync_threads.load(), MAX_INDEX_SYNC_THREADS));
+        const size_t lookahead = n_threads > 0 ? n_threads * SYNC_BLOCKS_AHEAD_PER_THREAD : 1;
+        std::vector<std::thread> threads;
+        for (int i = 0; i < n_threads; ++i) {
+            threads.emplace_back([&, i] {
+                util::ThreadRename(strprintf("%s.%d", GetName(), i));
+                while (true) {
+                    QueuedBlock* queued;
+                    {
+                        WAIT_LOCK(queue_mutex, lock);
+                        queue_cv.wait(lock, [&] { return stop || next_to_prepare < queue_begin + queue.size(); });
+                        if (stop) return;
+                        // Other elements of a deque may be added and removed without invalidating
+                        // this reference, and this one is only removed once it is done.
+                        queued = &queue[next_to_prepare++ - queue_begin];
+                    }
+                    prepare(*queued);
+                    {
+                        LOCK(queue_mutex);
+                        queued->done = true;
+                    }
+                    queue_cv.notify_all();
+                }
+            });
+        }
+        struct StopThreads {
+            std::function<void()> join;
+            ~StopThreads() { join(); }
+        } stop_threads{[&] {
+            {
+                LOCK(queue_mutex);
+                stop = true;
+            }
+            queue_cv.notify_all();
+            for (std::thread& thread : threads) thread.join();
+        }};
+
         int64_t last_log_time = 0;
         int64_t last_locator_write_time = 0;
+        const CBlockIndex* pindex_queued = pindex;
         while (true) {
             if (m_interrupt) {
                 m_best_block_index = pindex;
@@ -103,49 +177,93 @@ void BaseIndex::ThreadSync()
                 return;
             }
 
+            std::vector<const CBlockIndex*> to_queue;
             {
                 LOCK(cs_main);
-                const CBlockIndex* pindex_next = NextSyncBlock(pindex);
-                if (!pindex_next) {
-                    m_best_block_index = pindex;
-                    m_synced = true;
-                    // No need to handle errors in Commit. See rationale above.
-                    Commit();
-                    break;
+                if (in_flight == 0) {
+                    const CBlockIndex* pindex_next = NextSyncBlock(pindex);
+                    if (!pindex_next) {
+                        m_best_block_index = pindex;
+                        m_synced = true;
+                        // No need to handle errors in Commit. See rationale above.
+                        Commit();
+                        break;
+                    }
+                    if (pindex_next->pprev != pindex && !Rewind(pindex, pindex_next->pprev)) {
+                        FatalError("%s: Failed to rewind index %s to a previous chain tip",
+                                   __func__, GetName());
+                        return;
+                    }
+                    pindex_queued = pindex_next;
+                    to_queue.push_back(pindex_next);
+                }
+                // Queue the following blocks of the active chain. If the last queued block has
+                // been reorganized out of it, stop until the index catches up with it and rewinds.
+                while (in_flight + to_queue.size() < lookahead) {
+                    const CBlockIndex* pindex_next = ::ChainActive().Next(pindex_queued);
+                    if (!pindex_next) break;
+                    pindex_queued = pindex_next;
+                    to_queue.push_back(pindex_next);
                 }
-                if (pindex_next->pprev != pindex && !Rewind(pindex, pindex_next->pprev)) {
-                    FatalError("%s: Failed to rewind index %s to a previous chain tip",
-                               __func__, GetName());
-                    return;
+            }
+            if (!to_queue.empty()) {
+                {
+                    LOCK(queue_mutex);
+                    for (const CBlockIndex* pindex_next : to_queue) {
+                        queue.emplace_back(pindex_next);
+                    }
+                }
+                in_flight += to_queue.size();
+                queue_cv.notify_all();
+            }
+
+            QueuedBlock* queued;
+            {
+                WAIT_LOCK(queue_mutex, lock);
+                if (threads.empty()) {
+                    ++next_to_prepare;
+                    queue.front().done = true;
+                } else {
+                    queue_cv.wait(lock, [&] { return queue.front().done; });
                 }
-                pindex = pindex_next;
+                queued = &queue.front();
+            }
+            if (threads.empty()) {
+                prepare(*queued);
             }
 
             int64_t current_time = GetTime();
             if (last_log_time + SYNC_LOG_INTERVAL < current_time) {
                 LogPrintf("Syncing %s with block chain from height %d\n",
-                          GetName(), pindex->nHeight);
+                          GetName(), queued->pindex->nHeight);
                 last_log_time = current_time;
             }
 
-            if (last_locator_write_time + SYNC_LOCATOR_WRITE_INTERVAL < current_time) {
+            if (pindex && last_locator_write_time + SYNC_LOCATOR_WRITE_INTERVAL < current_time) {
                 m_best_block_index = pindex;
                 last_locator_write_time = current_time;
                 // No need to handle errors in Commit. See rationale above.
                 Commit();
             }
 
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            if (!queued->read) {
                 FatalError("%s: Failed to read block %s from disk",
-                           __func__, pindex->GetBlockHash().ToString());
+                           __func__, queued->pindex->GetBlockHash().ToString());
                 return;
             }
-            if (!WriteBlock(block, pindex)) {
+            if (!queued->prepared || !WriteBlock(queued->block, queued->pindex, *queued->prepared)) {
                 FatalError("%s: Failed to write block %s to index database",
-                           __func__, pindex->GetBlockHash().ToString());
+                           __func__, queued->pindex->GetBlockHash().ToString());
                 return;
             }
+            pindex = queued->pindex;
+
+            {
+                LOCK(queue_mutex);
+                queue.pop_front();
+                ++queue_begin;
+            }
+            --in_flight;
         }
     }
 
@@ -221,7 +339,8 @@ void BaseIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const
         }
     }
 
-    if (WriteBlock(*block, pindex)) {
+    std::unique_ptr<PreparedBlock> prepared = PrepareBlock(*block, pindex);
+    if (prepared && WriteBlock(*block, pindex, *prepared)) {
         m_best_block_index = pindex;
     } else {
         FatalError("%s: Failed to write block %s to index",
@@ -9,10 +9,22 @@
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <threadinterrupt.h>
+#include <util/memory.h>
 #include <validationinterface.h>
 
+#include <atomic>
+#include <memory>
+
 class CBlockIndex;
 
+/** Maximum number of threads for -indexsyncthreads */
+static const int MAX_INDEX_SYNC_THREADS = 16;
+/** -indexsyncthreads default (number of threads preparing blocks during an index sync, 0 = none) */
+static const int DEFAULT_INDEX_SYNC_THREADS = 2;
+
+/** Number of threads preparing blocks ahead of the writer during the initial sync of an index. */
+extern std::atomic<int> g_index_sync_threads;
+
 /**
  * Base class for indices of blockchain data. This implements
  * CValidationInterface and ensures blocks are indexed sequentially according
@@ -20,6 +32,20 @@ class CBlockIndex;
  */
 class BaseIndex : public CValidationInterface
 {
+public:
+    /// The part of the work of indexing a block that doesn't depend on the
+    /// blocks before it, computed by PrepareBlock and consumed by WriteBlock.
+    struct PreparedBlock {
+        virtual ~PreparedBlock() {}
+    };
+
+    /// A block prepared as a batch of database writes, for indices that only
+    /// write keys independent of the earlier blocks.
+    struct PreparedBatch : public PreparedBlock {
+        explicit PreparedBatch(const CDBWrapper& db) : batch(db) {}
+        CDBBatch batch;
+    };
+
 protected:
     class DB : public CDBWrapper
     {
@@ -51,6 +77,9 @@ private:
     /// interrupted with m_interrupt. Once the index gets in sync, the m_synced
     /// flag is set and the BlockConnected ValidationInterface callback takes
     /// over and the sync thread exits.
+    ///
+    /// Blocks are read and prepared ahead of time by g_index_sync_threads
+    /// threads, while this thread writes them to the index in chain order.
     void ThreadSync();
 
     /// Write the current index state (eg. chain block locator and subclass-specific items) to disk.
@@ -64,6 +93,8 @@ private:
     bool Commit();
 
 protected:
+    std::string GetValidationQueueName() const override { return GetName(); }
+
     void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex) override;
 
     void ChainStateFlushed(const CBlockLocator& locator) override;
@@ -71,8 +102,19 @@ protected:
     /// Initialize internal state from the database and block index.
     virtual bool Init();
 
-    /// Write update index entries for a newly connected block.
-    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) { return true; }
+    /// Do the work of indexing a newly connected block that doesn't depend on
+    /// the blocks before it, such as reading its undo data or computing its
+    /// entries. During the initial sync this is called concurrently for the
+    /// blocks ahead of the one being written, so it must not modify the index.
+    /// Returns null on failure.
+    virtual std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
+    {
+        return MakeUnique<PreparedBlock>();
+    }
+
+    /// Write update index entries for a newly connected block. Called in
+    /// chain order, with the result of PrepareBlock for that block.
+    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) { return true; }
 
     /// Virtual method called internally by Commit that can be overridden to atomically
     /// commit more index state.
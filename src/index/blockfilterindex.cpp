@@ -5,6 +5,7 @@
 #include <map>
 
 #include <dbwrapper.h>
+#include <streams.h>
 #include <index/blockfilterindex.h>
 #include <util/system.h>
 #include <validation.h>
@@ -31,6 +32,8 @@ constexpr char DB_FILTER_POS = 'P';
 constexpr unsigned int MAX_FLTR_FILE_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for fltr?????.dat files */
 constexpr unsigned int FLTR_FILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** The buffer size for reading ranges of filters from fltr?????.dat files */
+constexpr unsigned int FLTR_READ_BUFFER_SIZE = 0x100000; // 1 MiB
 
 namespace {
 
@@ -126,6 +129,20 @@ bool BlockFilterIndex::Init()
         m_next_filter_pos.nFile = 0;
         m_next_filter_pos.nPos = 0;
     }
+
+    // Load the filter headers of every height into memory. Stale entries above the best block are
+    // harmless since cached headers are only used for the block hash they were computed for.
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    DBHeightKey key(0);
+    std::pair<uint256, DBVal> value;
+    for (db_it->Seek(key); db_it->Valid() && db_it->GetKey(key); db_it->Next()) {
+        if (!db_it->GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, GetName(), DB_BLOCK_HEIGHT, key.height);
+        }
+        CacheHeader(key.height, value.first, value.second.header);
+    }
+
     return BaseIndex::Init();
 }
 
@@ -166,6 +183,38 @@ bool BlockFilterIndex::ReadFilterFromDisk(const FlatFilePos& pos, BlockFilter& f
     return true;
 }
 
+bool BlockFilterIndex::ReadFiltersFromDisk(const std::vector<FlatFilePos>& positions,
+                                           std::vector<BlockFilter>& filters) const
+{
+    filters.resize(positions.size());
+    std::unique_ptr<CBufferedFile> filein;
+    int file_num = -1;
+    for (size_t i = 0; i < positions.size(); ++i) {
+        const FlatFilePos& pos = positions[i];
+        if (pos.nFile != file_num) {
+            FILE* file = m_filter_fileseq->Open(pos, true);
+            if (!file) return false;
+            filein = MakeUnique<CBufferedFile>(file, FLTR_READ_BUFFER_SIZE, 0, SER_DISK, CLIENT_VERSION);
+            file_num = pos.nFile;
+            if (!filein->Seek(pos.nPos)) return false;
+        } else if (filein->GetPos() != pos.nPos && !filein->Seek(pos.nPos)) {
+            return false;
+        }
+
+        uint256 block_hash;
+        std::vector<unsigned char> encoded_filter;
+        try {
+            *filein >> block_hash >> encoded_filter;
+            filters[i] = BlockFilter(GetFilterType(), block_hash, std::move(encoded_filter));
+        }
+        catch (const std::exception& e) {
+            return error("%s: Failed to deserialize block filter from disk: %s", __func__, e.what());
+        }
+    }
+
+    return true;
+}
+
 size_t BlockFilterIndex::WriteFilterToDisk(FlatFilePos& pos, const BlockFilter& filter)
 {
     assert(filter.GetFilterType() == GetFilterType());
@@ -212,16 +261,30 @@ size_t BlockFilterIndex::WriteFilterToDisk(FlatFilePos& pos, const BlockFilter&
     return data_size;
 }
 
-bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+namespace {
+struct PreparedFilter : public BaseIndex::PreparedBlock {
+    BlockFilter filter;
+};
+} // namespace
+
+std::unique_ptr<BaseIndex::PreparedBlock> BlockFilterIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
 {
     CBlockUndo block_undo;
-    uint256 prev_header;
+    if (pindex->nHeight > 0 && !UndoReadFromDisk(block_undo, pindex)) {
+        return nullptr;
+    }
 
-    if (pindex->nHeight > 0) {
-        if (!UndoReadFromDisk(block_undo, pindex)) {
-            return false;
-        }
+    auto prepared = MakeUnique<PreparedFilter>();
+    prepared->filter = BlockFilter(m_filter_type, block, block_undo);
+    return prepared;
+}
+
+bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    const BlockFilter& filter = static_cast<PreparedFilter&>(prepared).filter;
+    uint256 prev_header;
 
+    if (pindex->nHeight > 0 && !LookupCachedHeader(pindex->pprev, prev_header)) {
         std::pair<uint256, DBVal> read_out;
         if (!m_db->Read(DBHeightKey(pindex->nHeight - 1), read_out)) {
             return false;
@@ -236,8 +299,6 @@ bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex
         prev_header = read_out.second.header;
     }
 
-    BlockFilter filter(m_filter_type, block, block_undo);
-
     size_t bytes_written = WriteFilterToDisk(m_next_filter_pos, filter);
     if (bytes_written == 0) return false;
 
@@ -252,6 +313,7 @@ bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex
     }
 
     m_next_filter_pos.nPos += bytes_written;
+    CacheHeader(pindex->nHeight, value.first, value.second.header);
     return true;
 }
 
@@ -377,18 +439,74 @@ static bool LookupRange(CDBWrapper& db, const std::string& index_name, int start
     return true;
 }
 
+void BlockFilterIndex::CacheHeader(int height, const uint256& block_hash, const uint256& header)
+{
+    LOCK(m_cs_cache);
+    if (m_headers_cache.size() <= static_cast<size_t>(height)) {
+        m_headers_cache.resize(height + 1);
+    }
+    m_headers_cache[height] = std::make_pair(block_hash, header);
+}
+
+bool BlockFilterIndex::LookupCachedHeader(const CBlockIndex* block_index, uint256& header) const
+{
+    LOCK(m_cs_cache);
+    if (m_headers_cache.size() <= static_cast<size_t>(block_index->nHeight)) return false;
+    const auto& entry = m_headers_cache[block_index->nHeight];
+    if (entry.first != block_index->GetBlockHash()) return false;
+    header = entry.second;
+    return true;
+}
+
+void BlockFilterIndex::CacheFilter(const BlockFilter& filter) const
+{
+    auto it = m_filter_lru_map.find(filter.GetBlockHash());
+    if (it != m_filter_lru_map.end()) {
+        m_filter_lru.splice(m_filter_lru.begin(), m_filter_lru, it->second);
+        return;
+    }
+    m_filter_lru.push_front(filter);
+    m_filter_lru_map.emplace(filter.GetBlockHash(), m_filter_lru.begin());
+    if (m_filter_lru.size() > FILTER_CACHE_SIZE) {
+        m_filter_lru_map.erase(m_filter_lru.back().GetBlockHash());
+        m_filter_lru.pop_back();
+    }
+}
+
+bool BlockFilterIndex::LookupCachedFilter(const uint256& block_hash, BlockFilter& filter) const
+{
+    auto it = m_filter_lru_map.find(block_hash);
+    if (it == m_filter_lru_map.end()) return false;
+    m_filter_lru.splice(m_filter_lru.begin(), m_filter_lru, it->second);
+    filter = *it->second;
+    return true;
+}
+
 bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const
 {
+    if (WITH_LOCK(m_cs_cache, return LookupCachedFilter(block_index->GetBlockHash(), filter_out))) {
+        return true;
+    }
+
     DBVal entry;
     if (!LookupOne(*m_db, block_index, entry)) {
         return false;
     }
 
-    return ReadFilterFromDisk(entry.pos, filter_out);
+    if (!ReadFilterFromDisk(entry.pos, filter_out)) {
+        return false;
+    }
+    LOCK(m_cs_cache);
+    CacheFilter(filter_out);
+    return true;
 }
 
 bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const
 {
+    if (LookupCachedHeader(block_index, header_out)) {
+        return true;
+    }
+
     DBVal entry;
     if (!LookupOne(*m_db, block_index, entry)) {
         return false;
@@ -401,20 +519,40 @@ bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint25
 bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* stop_index,
                                          std::vector<BlockFilter>& filters_out) const
 {
+    // Serve the whole range from memory if it was asked for recently.
+    if (start_height >= 0 && start_height <= stop_index->nHeight) {
+        std::vector<BlockFilter> filters(stop_index->nHeight - start_height + 1);
+        LOCK(m_cs_cache);
+        bool cached = true;
+        for (const CBlockIndex* block_index = stop_index;
+             cached && block_index && block_index->nHeight >= start_height;
+             block_index = block_index->pprev) {
+            cached = LookupCachedFilter(block_index->GetBlockHash(), filters[block_index->nHeight - start_height]);
+        }
+        if (cached) {
+            filters_out = std::move(filters);
+            return true;
+        }
+    }
+
     std::vector<DBVal> entries;
     if (!LookupRange(*m_db, m_name, start_height, stop_index, entries)) {
         return false;
     }
 
-    filters_out.resize(entries.size());
-    auto filter_pos_it = filters_out.begin();
+    std::vector<FlatFilePos> positions;
+    positions.reserve(entries.size());
     for (const auto& entry : entries) {
-        if (!ReadFilterFromDisk(entry.pos, *filter_pos_it)) {
-            return false;
-        }
-        ++filter_pos_it;
+        positions.push_back(entry.pos);
+    }
+    if (!ReadFiltersFromDisk(positions, filters_out)) {
+        return false;
     }
 
+    LOCK(m_cs_cache);
+    for (const BlockFilter& filter : filters_out) {
+        CacheFilter(filter);
+    }
     return true;
 }
 
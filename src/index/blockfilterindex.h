@@ -9,13 +9,21 @@
 #include <chain.h>
 #include <flatfile.h>
 #include <index/base.h>
+#include <sync.h>
+
+#include <list>
+#include <map>
+
+/** Number of recently looked up filters kept in memory, as many as one BIP 157 getcfilters response. */
+static constexpr size_t FILTER_CACHE_SIZE = 1000;
 
 /**
  * BlockFilterIndex is used to store and retrieve block filters, hashes, and headers for a range of
  * blocks by height. An index is constructed for each supported filter type with its own database
  * (ie. filter data for different types are stored in separate databases).
  *
- * This index is used to serve BIP 157 net requests.
+ * This index is used to serve BIP 157 net requests. Light clients ask for the same ranges over and
+ * over, so the filter headers of the whole chain and an LRU of recent filters are kept in memory.
  */
 class BlockFilterIndex final : public BaseIndex
 {
@@ -27,15 +35,32 @@ private:
     FlatFilePos m_next_filter_pos;
     std::unique_ptr<FlatFileSeq> m_filter_fileseq;
 
+    mutable Mutex m_cs_cache;
+    /** Block hash and filter header of the block indexed at each height. The header of a block
+     *  never changes, so an entry is valid for any lookup of the same block hash. */
+    std::vector<std::pair<uint256, uint256>> m_headers_cache GUARDED_BY(m_cs_cache);
+    /** Recently looked up filters, most recent first, and where to find them by block hash. */
+    mutable std::list<BlockFilter> m_filter_lru GUARDED_BY(m_cs_cache);
+    mutable std::map<uint256, std::list<BlockFilter>::iterator> m_filter_lru_map GUARDED_BY(m_cs_cache);
+
     bool ReadFilterFromDisk(const FlatFilePos& pos, BlockFilter& filter) const;
+    /** Read filters in one pass over their files, seeking only between non-adjacent filters. */
+    bool ReadFiltersFromDisk(const std::vector<FlatFilePos>& positions, std::vector<BlockFilter>& filters) const;
     size_t WriteFilterToDisk(FlatFilePos& pos, const BlockFilter& filter);
 
+    void CacheHeader(int height, const uint256& block_hash, const uint256& header);
+    bool LookupCachedHeader(const CBlockIndex* block_index, uint256& header) const;
+    void CacheFilter(const BlockFilter& filter) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_cache);
+    bool LookupCachedFilter(const uint256& block_hash, BlockFilter& filter) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_cache);
+
 protected:
     bool Init() override;
 
     bool CommitInternal(CDBBatch& batch) override;
 
-    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
 
     bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
 
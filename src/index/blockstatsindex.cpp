@@ -0,0 +1,214 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/blockstatsindex.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores the statistics of each block together with the totals of the chain up
+ * to it. Those belonging to blocks on the active chain are indexed by height, and those belonging
+ * to blocks that have been reorganized out of the active chain are indexed by block hash, like in
+ * the block filter index.
+ *
+ * Keys for the height index have the type [DB_BLOCK_HEIGHT, uint32 (BE)], and keys for the hash
+ * index have the type [DB_BLOCK_HASH, uint256].
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+
+std::unique_ptr<BlockStatsIndex> g_block_stats_index;
+
+namespace {
+
+struct DBVal {
+    CBlockStats stats;
+    BlockStatsTotals totals;
+
+    SERIALIZE_METHODS(DBVal, obj) { READWRITE(obj.stats, obj.totals); }
+};
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for blockstats index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+struct DBHashKey {
+    uint256 hash;
+
+    explicit DBHashKey(const uint256& hash_in) : hash(hash_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        char prefix = DB_BLOCK_HASH;
+        READWRITE(prefix);
+        if (prefix != DB_BLOCK_HASH) {
+            throw std::ios_base::failure("Invalid format for blockstats index DB hash key");
+        }
+
+        READWRITE(hash);
+    }
+};
+
+/** The statistics of a block, which don't depend on the blocks before it. */
+struct PreparedStats : public BaseIndex::PreparedBlock {
+    CBlockStats stats;
+};
+
+}; // namespace
+
+BlockStatsIndex::BlockStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "blockstats";
+    fs::create_directories(path);
+
+    m_db = MakeUnique<BaseIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe);
+}
+
+static bool LookupOne(const CDBWrapper& db, const CBlockIndex* block_index, DBVal& result)
+{
+    // First check if the result is stored under the height index and the value there matches the
+    // block hash. This should be the case if the block is on the active chain.
+    std::pair<uint256, DBVal> read_out;
+    if (!db.Read(DBHeightKey(block_index->nHeight), read_out)) {
+        return false;
+    }
+    if (read_out.first == block_index->GetBlockHash()) {
+        result = std::move(read_out.second);
+        return true;
+    }
+
+    // If value at the height index corresponds to an different block, the result will be stored in
+    // the hash index.
+    return db.Read(DBHashKey(block_index->GetBlockHash()), result);
+}
+
+std::unique_ptr<BaseIndex::PreparedBlock> BlockStatsIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
+{
+    // The genesis block has no undo data, its coinbase doesn't spend anything.
+    CBlockUndo block_undo;
+    if (pindex->nHeight > 0 && !UndoReadFromDisk(block_undo, pindex)) {
+        error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+        return nullptr;
+    }
+
+    auto prepared = MakeUnique<PreparedStats>();
+    if (!ComputeBlockStats(block, block_undo, prepared->stats)) {
+        error("%s: undo data of block %s doesn't match the block", __func__, pindex->GetBlockHash().ToString());
+        return nullptr;
+    }
+    return prepared;
+}
+
+bool BlockStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    std::pair<uint256, DBVal> value;
+    value.first = pindex->GetBlockHash();
+    value.second.stats = static_cast<PreparedStats&>(prepared).stats;
+
+    if (pindex->nHeight > 0) {
+        std::pair<uint256, DBVal> read_out;
+        if (!m_db->Read(DBHeightKey(pindex->nHeight - 1), read_out)) {
+            return false;
+        }
+
+        uint256 expected_block_hash = pindex->pprev->GetBlockHash();
+        if (read_out.first != expected_block_hash) {
+            return error("%s: previous block statistics belong to unexpected block %s; expected %s",
+                         __func__, read_out.first.ToString(), expected_block_hash.ToString());
+        }
+        value.second.totals = read_out.second.totals;
+    }
+
+    const CBlockStats& stats = value.second.stats;
+    value.second.totals.total_fees += stats.totalfee;
+    value.second.totals.outputs_created += stats.outs;
+    value.second.totals.outputs_spent += stats.ins;
+
+    return m_db->Write(DBHeightKey(pindex->nHeight), value);
+}
+
+static bool CopyHeightIndexToHashIndex(CDBIterator& db_it, CDBBatch& batch,
+                                       const std::string& index_name,
+                                       int start_height, int stop_height)
+{
+    DBHeightKey key(start_height);
+    db_it.Seek(key);
+
+    for (int height = start_height; height <= stop_height; ++height) {
+        if (!db_it.GetKey(key) || key.height != height) {
+            return error("%s: unexpected key in %s: expected (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        std::pair<uint256, DBVal> value;
+        if (!db_it.GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        batch.Write(DBHashKey(value.first), std::move(value.second));
+
+        db_it.Next();
+    }
+    return true;
+}
+
+bool BlockStatsIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // During a reorg, we need to copy the statistics of the blocks that are getting disconnected
+    // from the height index to the hash index so we can still find them when the height index
+    // entries are overwritten.
+    CDBBatch batch(*m_db);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    if (!CopyHeightIndexToHashIndex(*db_it, batch, GetName(), new_tip->nHeight + 1, current_tip->nHeight)) {
+        return false;
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool BlockStatsIndex::LookUpStats(const CBlockIndex* block_index, CBlockStats& stats) const
+{
+    DBVal entry;
+    if (!LookupOne(*m_db, block_index, entry)) {
+        return false;
+    }
+    stats = entry.stats;
+    return true;
+}
+
+bool BlockStatsIndex::LookUpTotals(const CBlockIndex* block_index, BlockStatsTotals& totals) const
+{
+    DBVal entry;
+    if (!LookupOne(*m_db, block_index, entry)) {
+        return false;
+    }
+    totals = entry.totals;
+    return true;
+}
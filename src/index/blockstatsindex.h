@@ -0,0 +1,59 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_INDEX_BLOCKSTATSINDEX_H
+#define PALLADIUM_INDEX_BLOCKSTATSINDEX_H
+
+#include <amount.h>
+#include <chain.h>
+#include <index/base.h>
+#include <node/blockstats.h>
+
+/** Running totals of the active chain up to and including a block. */
+struct BlockStatsTotals
+{
+    CAmount total_fees{0};
+    uint64_t outputs_created{0};
+    uint64_t outputs_spent{0};
+
+    SERIALIZE_METHODS(BlockStatsTotals, obj) { READWRITE(obj.total_fees, obj.outputs_created, obj.outputs_spent); }
+};
+
+/**
+ * BlockStatsIndex stores the statistics getblockstats reports for each block,
+ * so that they are computed once from the block and its undo data rather than
+ * on every call. Each entry also holds the totals of the chain up to its block,
+ * so the totals of any window of blocks are the difference of two lookups.
+ */
+class BlockStatsIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+protected:
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "blockstatsindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit BlockStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Look up the statistics of a block.
+    bool LookUpStats(const CBlockIndex* block_index, CBlockStats& stats) const;
+
+    /// Look up the totals of the chain up to and including a block.
+    bool LookUpTotals(const CBlockIndex* block_index, BlockStatsTotals& totals) const;
+};
+
+/// The global block statistics index. May be null.
+extern std::unique_ptr<BlockStatsIndex> g_block_stats_index;
+
+#endif // PALLADIUM_INDEX_BLOCKSTATSINDEX_H
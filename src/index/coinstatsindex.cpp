@@ -0,0 +1,354 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <coins.h>
+#include <index/coinstatsindex.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores the statistics of the UTXO set after each block. Those belonging to
+ * blocks on the active chain are indexed by height, and those belonging to blocks that have been
+ * reorganized out of the active chain are indexed by block hash, like in the block filter index.
+ *
+ * Keys for the height index have the type [DB_BLOCK_HEIGHT, uint32 (BE)], and keys for the hash
+ * index have the type [DB_BLOCK_HASH, uint256]. The unfinalized MuHash of the UTXO set at the best
+ * block of the index is stored under the DB_MUHASH key, so that it can be updated incrementally.
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+constexpr char DB_MUHASH = 'M';
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+namespace {
+
+struct DBVal {
+    uint256 muhash;
+    uint64_t transaction_output_count;
+    uint64_t bogo_size;
+    CAmount total_amount;
+
+    DBVal() : transaction_output_count(0), bogo_size(0), total_amount(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(muhash);
+        READWRITE(transaction_output_count);
+        READWRITE(bogo_size);
+        READWRITE(total_amount);
+    }
+};
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for coinstats index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+struct DBHashKey {
+    uint256 hash;
+
+    explicit DBHashKey(const uint256& hash_in) : hash(hash_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        char prefix = DB_BLOCK_HASH;
+        READWRITE(prefix);
+        if (prefix != DB_BLOCK_HASH) {
+            throw std::ios_base::failure("Invalid format for coinstats index DB hash key");
+        }
+
+        READWRITE(hash);
+    }
+};
+
+/** The changes a block makes to the UTXO set. Since MuHash updates commute, they can be computed
+ * for many blocks in parallel and applied to the running state in chain order. */
+struct PreparedStats : public BaseIndex::PreparedBlock {
+    MuHash3072 muhash;
+    int64_t transaction_output_count{0};
+    int64_t bogo_size{0};
+    CAmount total_amount{0};
+};
+
+}; // namespace
+
+static bool ComputeBlockChanges(const CBlock& block, const CBlockIndex* pindex, PreparedStats& changes)
+{
+    // The outputs of the genesis block are not added to the UTXO set.
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: undo data of block %s doesn't match the block", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+
+        for (uint32_t j = 0; j < tx.vout.size(); ++j) {
+            const CTxOut& out = tx.vout[j];
+            if (out.scriptPubKey.IsUnspendable()) continue;
+
+            ApplyCoinHash(changes.muhash, COutPoint(tx.GetHash(), j), Coin(out, pindex->nHeight, tx.IsCoinBase()));
+            ++changes.transaction_output_count;
+            changes.bogo_size += GetBogoSize(out.scriptPubKey);
+            changes.total_amount += out.nValue;
+        }
+
+        if (tx.IsCoinBase()) continue;
+
+        const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+        if (tx_undo.vprevout.size() != tx.vin.size()) {
+            return error("%s: undo data of transaction %s doesn't match the transaction", __func__, tx.GetHash().ToString());
+        }
+        for (size_t j = 0; j < tx.vin.size(); ++j) {
+            const Coin& coin = tx_undo.vprevout[j];
+
+            RemoveCoinHash(changes.muhash, tx.vin[j].prevout, coin);
+            --changes.transaction_output_count;
+            changes.bogo_size -= GetBogoSize(coin.out.scriptPubKey);
+            changes.total_amount -= coin.out.nValue;
+        }
+    }
+    return true;
+}
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "coinstats";
+    fs::create_directories(path);
+
+    m_db = MakeUnique<BaseIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe);
+}
+
+static bool LookupOne(const CDBWrapper& db, const CBlockIndex* block_index, DBVal& result)
+{
+    // First check if the result is stored under the height index and the value there matches the
+    // block hash. This should be the case if the block is on the active chain.
+    std::pair<uint256, DBVal> read_out;
+    if (!db.Read(DBHeightKey(block_index->nHeight), read_out)) {
+        return false;
+    }
+    if (read_out.first == block_index->GetBlockHash()) {
+        result = std::move(read_out.second);
+        return true;
+    }
+
+    // If value at the height index corresponds to an different block, the result will be stored in
+    // the hash index.
+    return db.Read(DBHashKey(block_index->GetBlockHash()), result);
+}
+
+bool CoinStatsIndex::Init()
+{
+    if (!m_db->Read(DB_MUHASH, m_muhash)) {
+        // Check that the cause of the read failure is that the key does not exist. Any other errors
+        // indicate database corruption or a disk failure, and starting the index would cause
+        // further corruption.
+        if (m_db->Exists(DB_MUHASH)) {
+            return error("%s: Cannot read current %s state; index may be corrupted",
+                         __func__, GetName());
+        }
+    }
+
+    if (!BaseIndex::Init()) return false;
+
+    CBlockLocator locator;
+    if (!m_db->ReadBestBlock(locator) || locator.IsNull()) return true;
+
+    const CBlockIndex* best_block;
+    const CBlockIndex* fork;
+    {
+        LOCK(cs_main);
+        best_block = LookupBlockIndex(locator.vHave.front());
+        fork = FindForkInGlobalIndex(::ChainActive(), locator);
+    }
+    if (!best_block) {
+        return error("%s: best block of %s not found", __func__, GetName());
+    }
+
+    // Restore the running totals from the statistics of the best block.
+    DBVal entry;
+    if (!LookupOne(*m_db, best_block, entry)) {
+        return error("%s: Cannot read the statistics of the best block of %s; index may be corrupted",
+                     __func__, GetName());
+    }
+    m_transaction_output_count = entry.transaction_output_count;
+    m_bogo_size = entry.bogo_size;
+    m_total_amount = entry.total_amount;
+
+    // If the best block was reorganized out of the active chain while the index was not running,
+    // the index resumes from the fork point, so the running state has to be reverted to it.
+    if (fork != best_block) {
+        return RevertBlocks(best_block, fork);
+    }
+    return true;
+}
+
+bool CoinStatsIndex::CommitInternal(CDBBatch& batch)
+{
+    batch.Write(DB_MUHASH, m_muhash);
+    return BaseIndex::CommitInternal(batch);
+}
+
+std::unique_ptr<BaseIndex::PreparedBlock> CoinStatsIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
+{
+    auto prepared = MakeUnique<PreparedStats>();
+    if (!ComputeBlockChanges(block, pindex, *prepared)) {
+        return nullptr;
+    }
+    return prepared;
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    const PreparedStats& changes = static_cast<PreparedStats&>(prepared);
+
+    if (pindex->nHeight > 0) {
+        std::pair<uint256, DBVal> read_out;
+        if (!m_db->Read(DBHeightKey(pindex->nHeight - 1), read_out)) {
+            return false;
+        }
+
+        uint256 expected_block_hash = pindex->pprev->GetBlockHash();
+        if (read_out.first != expected_block_hash) {
+            return error("%s: previous block statistics belong to unexpected block %s; expected %s",
+                         __func__, read_out.first.ToString(), expected_block_hash.ToString());
+        }
+    }
+
+    m_muhash *= changes.muhash;
+    m_transaction_output_count += changes.transaction_output_count;
+    m_bogo_size += changes.bogo_size;
+    m_total_amount += changes.total_amount;
+
+    std::pair<uint256, DBVal> value;
+    value.first = pindex->GetBlockHash();
+    value.second.transaction_output_count = m_transaction_output_count;
+    value.second.bogo_size = m_bogo_size;
+    value.second.total_amount = m_total_amount;
+    // Finalizing leaves the value of the running MuHash unchanged.
+    m_muhash.Finalize(value.second.muhash);
+
+    return m_db->Write(DBHeightKey(pindex->nHeight), value);
+}
+
+static bool CopyHeightIndexToHashIndex(CDBIterator& db_it, CDBBatch& batch,
+                                       const std::string& index_name,
+                                       int start_height, int stop_height)
+{
+    DBHeightKey key(start_height);
+    db_it.Seek(key);
+
+    for (int height = start_height; height <= stop_height; ++height) {
+        if (!db_it.GetKey(key) || key.height != height) {
+            return error("%s: unexpected key in %s: expected (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        std::pair<uint256, DBVal> value;
+        if (!db_it.GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        batch.Write(DBHashKey(value.first), std::move(value.second));
+
+        db_it.Next();
+    }
+    return true;
+}
+
+bool CoinStatsIndex::RevertBlocks(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // During a reorg, we need to copy the statistics of the blocks that are getting disconnected
+    // from the height index to the hash index so we can still find them when the height index
+    // entries are overwritten.
+    CDBBatch batch(*m_db);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    if (!CopyHeightIndexToHashIndex(*db_it, batch, GetName(), new_tip->nHeight + 1, current_tip->nHeight)) {
+        return false;
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    // Undo the changes of the disconnected blocks, only updating the running state once they all
+    // have been read so that a failure leaves it at current_tip.
+    PreparedStats reverted;
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            return error("%s: failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        PreparedStats changes;
+        if (!ComputeBlockChanges(block, pindex, changes)) {
+            return false;
+        }
+        reverted.muhash *= changes.muhash;
+        reverted.transaction_output_count += changes.transaction_output_count;
+        reverted.bogo_size += changes.bogo_size;
+        reverted.total_amount += changes.total_amount;
+    }
+
+    m_muhash /= reverted.muhash;
+    m_transaction_output_count -= reverted.transaction_output_count;
+    m_bogo_size -= reverted.bogo_size;
+    m_total_amount -= reverted.total_amount;
+    return true;
+}
+
+bool CoinStatsIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    if (!RevertBlocks(current_tip, new_tip)) return false;
+
+    // The running MuHash gets written in Commit by the call to the BaseIndex::Rewind.
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex* block_index, CCoinsStats& coins_stats) const
+{
+    DBVal entry;
+    if (!LookupOne(*m_db, block_index, entry)) {
+        return false;
+    }
+
+    coins_stats = CCoinsStats();
+    coins_stats.nHeight = block_index->nHeight;
+    coins_stats.hashBlock = block_index->GetBlockHash();
+    coins_stats.hashSerialized = entry.muhash;
+    coins_stats.nTransactionOutputs = entry.transaction_output_count;
+    coins_stats.coins_count = entry.transaction_output_count;
+    coins_stats.nBogoSize = entry.bogo_size;
+    coins_stats.nTotalAmount = entry.total_amount;
+    return true;
+}
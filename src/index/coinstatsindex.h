@@ -0,0 +1,63 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_INDEX_COINSTATSINDEX_H
+#define PALLADIUM_INDEX_COINSTATSINDEX_H
+
+#include <amount.h>
+#include <chain.h>
+#include <crypto/muhash.h>
+#include <index/base.h>
+#include <node/coinstats.h>
+
+/**
+ * CoinStatsIndex maintains statistics on the UTXO set, so that they can be
+ * looked up for any block of the chain without scanning the coins database.
+ * The MuHash of the UTXO set is updated incrementally with the outputs
+ * created and spent by each block, and the statistics at each block are
+ * written to a LevelDB database.
+ */
+class CoinStatsIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+    /// The state of the UTXO set after the last block written.
+    MuHash3072 m_muhash;
+    uint64_t m_transaction_output_count{0};
+    uint64_t m_bogo_size{0};
+    CAmount m_total_amount{0};
+
+    /// Revert the running state to new_tip, an ancestor of current_tip, keeping
+    /// the statistics of the disconnected blocks available by block hash.
+    bool RevertBlocks(const CBlockIndex* current_tip, const CBlockIndex* new_tip);
+
+protected:
+    bool Init() override;
+
+    bool CommitInternal(CDBBatch& batch) override;
+
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "coinstatsindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Look up the statistics of the UTXO set after a block. Only the height,
+    /// best block, MuHash, output count, bogosize and total amount are set.
+    bool LookUpStats(const CBlockIndex* block_index, CCoinsStats& coins_stats) const;
+};
+
+/// The global UTXO set statistics index. May be null.
+extern std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+#endif // PALLADIUM_INDEX_COINSTATSINDEX_H
@@ -0,0 +1,194 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <index/disktxpos.h>
+#include <index/spentindex.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores one entry per input of the active chain. Keys have the type
+ * [DB_SPENT, uint64 txid prefix, uint32 vout (BE), CDiskTxPos (BE)]: the outpoint spent, truncated
+ * to the first 8 bytes of its txid, followed by the location of the spending transaction on disk.
+ * The value is the index of the spending input.
+ *
+ * Truncating the txid keeps the keys short, at the cost of prefix collisions between outpoints.
+ * Because the location of the spender is part of the key, colliding outpoints get separate entries,
+ * and a lookup reads each candidate transaction and checks that it really spends the outpoint.
+ */
+constexpr char DB_SPENT = 's';
+
+std::unique_ptr<SpentIndex> g_spentindex;
+
+namespace {
+
+struct DBSpentKey {
+    uint64_t txid_prefix;
+    uint32_t vout;
+    CDiskTxPos pos;
+
+    DBSpentKey() : txid_prefix(0), vout(0) {}
+    DBSpentKey(const COutPoint& outpoint, const CDiskTxPos& pos_in) :
+        txid_prefix(outpoint.hash.GetUint64(0)), vout(outpoint.n), pos(pos_in) {}
+
+    /// The smallest key for an outpoint, to seek to before the entries spending it.
+    static DBSpentKey First(const COutPoint& outpoint)
+    {
+        return DBSpentKey(outpoint, CDiskTxPos(FlatFilePos(0, 0), 0));
+    }
+
+    bool SameOutPoint(const DBSpentKey& other) const
+    {
+        return txid_prefix == other.txid_prefix && vout == other.vout;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_SPENT);
+        ser_writedata64(s, txid_prefix);
+        ser_writedata32be(s, vout);
+        ser_writedata32be(s, pos.nFile);
+        ser_writedata32be(s, pos.nPos);
+        ser_writedata32be(s, pos.nTxOffset);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_SPENT) {
+            throw std::ios_base::failure("Invalid format for spent index DB key");
+        }
+        txid_prefix = ser_readdata64(s);
+        vout = ser_readdata32be(s);
+        pos.nFile = ser_readdata32be(s);
+        pos.nPos = ser_readdata32be(s);
+        pos.nTxOffset = ser_readdata32be(s);
+    }
+};
+
+struct DBVal {
+    uint32_t vin;
+
+    DBVal() : vin(0) {}
+    explicit DBVal(uint32_t vin_in) : vin(vin_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(vin));
+    }
+};
+
+}; // namespace
+
+/**
+ * Access to the spent output index database (indexes/spentindex/)
+ */
+class SpentIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false) :
+        BaseIndex::DB(GetDataDir() / "indexes" / "spentindex", n_cache_size, f_memory, f_wipe)
+    {}
+
+    /// Add (or erase, when disconnecting) the entries for the inputs of a block.
+    void WriteInputs(CDBBatch& batch, const CBlock& block, const CBlockIndex* pindex, bool erase) const
+    {
+        CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+        for (const auto& tx : block.vtx) {
+            if (!tx->IsCoinBase()) {
+                for (uint32_t i = 0; i < tx->vin.size(); ++i) {
+                    DBSpentKey key(tx->vin[i].prevout, pos);
+                    if (erase) {
+                        batch.Erase(key);
+                    } else {
+                        batch.Write(key, DBVal(i));
+                    }
+                }
+            }
+            pos.nTxOffset += ::GetSerializeSize(*tx, CLIENT_VERSION);
+        }
+    }
+};
+
+SpentIndex::SpentIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<SpentIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+SpentIndex::~SpentIndex() {}
+
+std::unique_ptr<BaseIndex::PreparedBlock> SpentIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
+{
+    auto prepared = MakeUnique<PreparedBatch>(*m_db);
+    m_db->WriteInputs(prepared->batch, block, pindex, /*erase=*/ false);
+    return prepared;
+}
+
+bool SpentIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    return m_db->WriteBatch(static_cast<PreparedBatch&>(prepared).batch);
+}
+
+bool SpentIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    CDBBatch batch(*m_db);
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+            return error("%s: failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        m_db->WriteInputs(batch, block, pindex, /*erase=*/ true);
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& SpentIndex::GetDB() const { return *m_db; }
+
+bool SpentIndex::FindSpendingTx(const COutPoint& outpoint, uint256& block_hash, CTransactionRef& tx, uint32_t& vin) const
+{
+    const DBSpentKey first = DBSpentKey::First(outpoint);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+    for (db_it->Seek(first); db_it->Valid(); db_it->Next()) {
+        DBSpentKey key;
+        if (!db_it->GetKey(key) || !key.SameOutPoint(first)) {
+            break;
+        }
+        DBVal value;
+        if (!db_it->GetValue(value)) {
+            return error("%s: unable to read value in %s", __func__, GetName());
+        }
+
+        CAutoFile file(OpenBlockFile(key.pos, true), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            return error("%s: OpenBlockFile failed", __func__);
+        }
+        CBlockHeader header;
+        CTransactionRef candidate;
+        try {
+            file >> header;
+            if (fseek(file.Get(), key.pos.nTxOffset, SEEK_CUR)) {
+                return error("%s: fseek(...) failed", __func__);
+            }
+            file >> candidate;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        }
+
+        // Skip entries of other outpoints sharing the truncated txid.
+        if (value.vin < candidate->vin.size() && candidate->vin[value.vin].prevout == outpoint) {
+            block_hash = header.GetHash();
+            tx = std::move(candidate);
+            vin = value.vin;
+            return true;
+        }
+    }
+    return false;
+}
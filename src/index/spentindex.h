@@ -0,0 +1,56 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_INDEX_SPENTINDEX_H
+#define PALLADIUM_INDEX_SPENTINDEX_H
+
+#include <chain.h>
+#include <index/base.h>
+
+/**
+ * SpentIndex is used to look up the transaction spending an output of the
+ * blockchain. The index is written to a LevelDB database and records, for each
+ * input of the active chain, the filesystem location of the spending
+ * transaction under a truncated form of the outpoint it spends.
+ */
+class SpentIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "spentindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit SpentIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~SpentIndex() override;
+
+    /// Look up the transaction spending an output.
+    ///
+    /// @param[in]   outpoint  The output to look up.
+    /// @param[out]  block_hash  The hash of the block the spending transaction is found in.
+    /// @param[out]  tx  The spending transaction.
+    /// @param[out]  vin  The index of the input spending the output.
+    /// @return  true if a spending transaction is found, false otherwise
+    bool FindSpendingTx(const COutPoint& outpoint, uint256& block_hash, CTransactionRef& tx, uint32_t& vin) const;
+};
+
+/// The global spent output index, used by the getspendingtx RPC. May be null.
+extern std::unique_ptr<SpentIndex> g_spentindex;
+
+#endif // PALLADIUM_INDEX_SPENTINDEX_H
@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <index/disktxpos.h>
 #include <index/txindex.h>
 #include <shutdown.h>
 #include <ui_interface.h>
@@ -9,39 +10,18 @@
 #include <util/translation.h>
 #include <validation.h>
 
+#include <algorithm>
+#include <tuple>
+
 #include <boost/thread.hpp>
 
 constexpr char DB_BEST_BLOCK = 'B';
+constexpr char DB_BLOCK_TXIDS = 'b';
 constexpr char DB_TXINDEX = 't';
 constexpr char DB_TXINDEX_BLOCK = 'T';
 
 std::unique_ptr<TxIndex> g_txindex;
 
-struct CDiskTxPos : public FlatFilePos
-{
-    unsigned int nTxOffset; // after header
-
-    ADD_SERIALIZE_METHODS;
-
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITEAS(FlatFilePos, *this);
-        READWRITE(VARINT(nTxOffset));
-    }
-
-    CDiskTxPos(const FlatFilePos &blockIn, unsigned int nTxOffsetIn) : FlatFilePos(blockIn.nFile, blockIn.nPos), nTxOffset(nTxOffsetIn) {
-    }
-
-    CDiskTxPos() {
-        SetNull();
-    }
-
-    void SetNull() {
-        FlatFilePos::SetNull();
-        nTxOffset = 0;
-    }
-};
-
 /**
  * Access to the txindex database (indexes/txindex/)
  *
@@ -60,8 +40,15 @@ public:
     /// transaction hash is not indexed.
     bool ReadTxPos(const uint256& txid, CDiskTxPos& pos) const;
 
-    /// Write a batch of transaction positions to the DB.
-    bool WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos);
+    /// Read the disk locations of several transactions, null for those not indexed.
+    void ReadTxPos(const std::vector<uint256>& txids, std::vector<CDiskTxPos>& positions) const;
+
+    /// Write a batch of transaction positions to the DB, along with the txids of the block they
+    /// belong to.
+    bool WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos, const uint256& block_hash, const std::vector<uint256>& block_txids);
+
+    /// Read the txids of a block, in block order. Returns false if the block is not indexed.
+    bool ReadBlockTxids(const uint256& block_hash, std::vector<uint256>& txids) const;
 
     /// Migrate txindex data from the block tree DB, where it may be for older nodes that have not
     /// been upgraded yet to the new database.
@@ -77,15 +64,43 @@ bool TxIndex::DB::ReadTxPos(const uint256 &txid, CDiskTxPos& pos) const
     return Read(std::make_pair(DB_TXINDEX, txid), pos);
 }
 
-bool TxIndex::DB::WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos)
+void TxIndex::DB::ReadTxPos(const std::vector<uint256>& txids, std::vector<CDiskTxPos>& positions) const
+{
+    positions.assign(txids.size(), CDiskTxPos());
+
+    // Visit the keys in database order, so that the iterator only moves forward.
+    std::vector<size_t> order(txids.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return std::lexicographical_compare(txids[a].begin(), txids[a].end(), txids[b].begin(), txids[b].end());
+    });
+
+    std::unique_ptr<CDBIterator> cursor(const_cast<DB&>(*this).NewIterator());
+    for (size_t i : order) {
+        const auto key = std::make_pair(DB_TXINDEX, txids[i]);
+        cursor->Seek(key);
+        std::pair<char, uint256> found;
+        if (cursor->Valid() && cursor->GetKey(found) && found == key) {
+            cursor->GetValue(positions[i]);
+        }
+    }
+}
+
+bool TxIndex::DB::WriteTxs(const std::vector<std::pair<uint256, CDiskTxPos>>& v_pos, const uint256& block_hash, const std::vector<uint256>& block_txids)
 {
     CDBBatch batch(*this);
     for (const auto& tuple : v_pos) {
         batch.Write(std::make_pair(DB_TXINDEX, tuple.first), tuple.second);
     }
+    batch.Write(std::make_pair(DB_BLOCK_TXIDS, block_hash), block_txids);
     return WriteBatch(batch);
 }
 
+bool TxIndex::DB::ReadBlockTxids(const uint256& block_hash, std::vector<uint256>& txids) const
+{
+    return Read(std::make_pair(DB_BLOCK_TXIDS, block_hash), txids);
+}
+
 /*
  * Safely persist a transfer of data from the old txindex database to the new one, and compact the
  * range of keys updated. This is used internally by MigrateData.
@@ -151,52 +166,54 @@ bool TxIndex::DB::MigrateData(CBlockTreeDB& block_tree_db, const CBlockLocator&
 
     bool interrupted = false;
     std::unique_ptr<CDBIterator> cursor(block_tree_db.NewIterator());
-    for (cursor->Seek(begin_key); cursor->Valid(); cursor->Next()) {
-        boost::this_thread::interruption_point();
-        if (ShutdownRequested()) {
-            interrupted = true;
-            break;
-        }
+    cursor->Seek(begin_key);
+    // Read the records in chunks ahead of the copying below, up to the first key of another kind.
+    CDBChunkReader reader(std::move(cursor), DB_TXINDEX);
+    for (const CDBChunk* chunk = &reader.Next(); !chunk->empty() && !interrupted; chunk = &reader.Next()) {
+        for (size_t i = 0; i < chunk->size(); ++i) {
+            boost::this_thread::interruption_point();
+            if (ShutdownRequested()) {
+                interrupted = true;
+                break;
+            }
 
-        if (!cursor->GetKey(key)) {
-            return error("%s: cannot get key from valid cursor", __func__);
-        }
-        if (key.first != DB_TXINDEX) {
-            break;
-        }
+            if (!chunk->GetKey(i, key)) {
+                return error("%s: cannot get key from valid cursor", __func__);
+            }
 
-        // Log progress every 10%.
-        if (++count % 256 == 0) {
-            // Since txids are uniformly random and traversed in increasing order, the high 16 bits
-            // of the hash can be used to estimate the current progress.
-            const uint256& txid = key.second;
-            uint32_t high_nibble =
-                (static_cast<uint32_t>(*(txid.begin() + 0)) << 8) +
-                (static_cast<uint32_t>(*(txid.begin() + 1)) << 0);
-            int percentage_done = (int)(high_nibble * 100.0 / 65536.0 + 0.5);
-
-            uiInterface.ShowProgress(_("Upgrading txindex database").translated, percentage_done, true);
-            if (report_done < percentage_done/10) {
-                LogPrintf("Upgrading txindex database... [%d%%]\n", percentage_done);
-                report_done = percentage_done/10;
+            // Log progress every 10%.
+            if (++count % 256 == 0) {
+                // Since txids are uniformly random and traversed in increasing order, the high 16 bits
+                // of the hash can be used to estimate the current progress.
+                const uint256& txid = key.second;
+                uint32_t high_nibble =
+                    (static_cast<uint32_t>(*(txid.begin() + 0)) << 8) +
+                    (static_cast<uint32_t>(*(txid.begin() + 1)) << 0);
+                int percentage_done = (int)(high_nibble * 100.0 / 65536.0 + 0.5);
+
+                uiInterface.ShowProgress(_("Upgrading txindex database").translated, percentage_done, true);
+                if (report_done < percentage_done/10) {
+                    LogPrintf("Upgrading txindex database... [%d%%]\n", percentage_done);
+                    report_done = percentage_done/10;
+                }
             }
-        }
 
-        CDiskTxPos value;
-        if (!cursor->GetValue(value)) {
-            return error("%s: cannot parse txindex record", __func__);
-        }
-        batch_newdb.Write(key, value);
-        batch_olddb.Erase(key);
-
-        if (batch_newdb.SizeEstimate() > batch_size || batch_olddb.SizeEstimate() > batch_size) {
-            // NOTE: it's OK to delete the key pointed at by the current DB cursor while iterating
-            // because LevelDB iterators are guaranteed to provide a consistent view of the
-            // underlying data, like a lightweight snapshot.
-            WriteTxIndexMigrationBatches(*this, block_tree_db,
-                                         batch_newdb, batch_olddb,
-                                         prev_key, key);
-            prev_key = key;
+            CDiskTxPos value;
+            if (!chunk->GetValue(i, value)) {
+                return error("%s: cannot parse txindex record", __func__);
+            }
+            batch_newdb.Write(key, value);
+            batch_olddb.Erase(key);
+
+            if (batch_newdb.SizeEstimate() > batch_size || batch_olddb.SizeEstimate() > batch_size) {
+                // NOTE: it's OK to delete the key pointed at by the current DB cursor while iterating
+                // because LevelDB iterators are guaranteed to provide a consistent view of the
+                // underlying data, like a lightweight snapshot.
+                WriteTxIndexMigrationBatches(*this, block_tree_db,
+                                             batch_newdb, batch_olddb,
+                                             prev_key, key);
+                prev_key = key;
+            }
         }
     }
 
@@ -244,19 +261,39 @@ bool TxIndex::Init()
     return BaseIndex::Init();
 }
 
-bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+namespace {
+struct PreparedTxs : public BaseIndex::PreparedBlock {
+    std::vector<std::pair<uint256, CDiskTxPos>> v_pos;
+    std::vector<uint256> txids;
+};
+} // namespace
+
+std::unique_ptr<BaseIndex::PreparedBlock> TxIndex::PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const
 {
+    auto prepared = MakeUnique<PreparedTxs>();
+
+    // The txids of every block are kept, so that proofs can be built without reading the block.
+    prepared->txids.reserve(block.vtx.size());
+    for (const auto& tx : block.vtx) {
+        prepared->txids.push_back(tx->GetHash());
+    }
+
     // Exclude genesis block transaction because outputs are not spendable.
-    if (pindex->nHeight == 0) return true;
+    if (pindex->nHeight == 0) return prepared;
 
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
-    vPos.reserve(block.vtx.size());
+    prepared->v_pos.reserve(block.vtx.size());
     for (const auto& tx : block.vtx) {
-        vPos.emplace_back(tx->GetHash(), pos);
+        prepared->v_pos.emplace_back(tx->GetHash(), pos);
         pos.nTxOffset += ::GetSerializeSize(*tx, CLIENT_VERSION);
     }
-    return m_db->WriteTxs(vPos);
+    return prepared;
+}
+
+bool TxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared)
+{
+    const PreparedTxs& txs = static_cast<PreparedTxs&>(prepared);
+    return m_db->WriteTxs(txs.v_pos, pindex->GetBlockHash(), txs.txids);
 }
 
 BaseIndex::DB& TxIndex::GetDB() const { return *m_db; }
@@ -288,3 +325,88 @@ bool TxIndex::FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRe
     block_hash = header.GetHash();
     return true;
 }
+
+bool TxIndex::FindTxs(const std::vector<uint256>& tx_hashes, std::vector<uint256>& block_hashes, std::vector<CTransactionRef>& txs) const
+{
+    std::vector<CDiskTxPos> positions;
+    m_db->ReadTxPos(tx_hashes, positions);
+    block_hashes.assign(tx_hashes.size(), uint256());
+    txs.assign(tx_hashes.size(), nullptr);
+
+    // Read the transactions in the order they are stored on disk.
+    std::vector<size_t> order;
+    for (size_t i = 0; i < positions.size(); ++i) {
+        if (!positions[i].IsNull()) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        const CDiskTxPos& pa = positions[a];
+        const CDiskTxPos& pb = positions[b];
+        return std::tie(pa.nFile, pa.nPos, pa.nTxOffset) < std::tie(pb.nFile, pb.nPos, pb.nTxOffset);
+    });
+
+    // Open each block file once, and read the header of each block once.
+    for (size_t k = 0; k < order.size();) {
+        CAutoFile file(OpenBlockFile(positions[order[k]], true), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            return error("%s: OpenBlockFile failed", __func__);
+        }
+        const int file_num = positions[order[k]].nFile;
+        bool new_block = true;
+        long txs_begin = 0;
+        uint256 block_hash;
+        for (; k < order.size() && positions[order[k]].nFile == file_num; ++k) {
+            const size_t i = order[k];
+            const CDiskTxPos& pos = positions[i];
+            try {
+                if (new_block) {
+                    if (fseek(file.Get(), pos.nPos, SEEK_SET)) {
+                        return error("%s: fseek(...) failed", __func__);
+                    }
+                    CBlockHeader header;
+                    file >> header;
+                    block_hash = header.GetHash();
+                    txs_begin = ftell(file.Get());
+                }
+                if (fseek(file.Get(), txs_begin + pos.nTxOffset, SEEK_SET)) {
+                    return error("%s: fseek(...) failed", __func__);
+                }
+                file >> txs[i];
+            } catch (const std::exception& e) {
+                return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+            }
+            if (txs[i]->GetHash() != tx_hashes[i]) {
+                return error("%s: txid mismatch", __func__);
+            }
+            block_hashes[i] = block_hash;
+            new_block = k + 1 == order.size() || positions[order[k + 1]].nPos != pos.nPos;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<const MerkleTreeLevels> TxIndex::GetMerkleTreeLevels(const uint256& block_hash) const
+{
+    {
+        LOCK(m_merkle_cache_mutex);
+        for (auto it = m_merkle_cache.begin(); it != m_merkle_cache.end(); ++it) {
+            if (it->first == block_hash) {
+                // Keep the most recently used blocks at the front.
+                m_merkle_cache.splice(m_merkle_cache.begin(), m_merkle_cache, it);
+                return it->second;
+            }
+        }
+    }
+
+    std::vector<uint256> txids;
+    if (!m_db->ReadBlockTxids(block_hash, txids) || txids.empty()) {
+        return nullptr;
+    }
+    auto levels = std::make_shared<const MerkleTreeLevels>(ComputeMerkleTreeLevels(std::move(txids)));
+
+    LOCK(m_merkle_cache_mutex);
+    m_merkle_cache.emplace_front(block_hash, levels);
+    if (m_merkle_cache.size() > MERKLE_TREE_CACHE_BLOCKS) {
+        m_merkle_cache.pop_back();
+    }
+    return levels;
+}
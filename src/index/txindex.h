@@ -7,8 +7,16 @@
 
 #include <chain.h>
 #include <index/base.h>
+#include <merkleblock.h>
+#include <sync.h>
 #include <txdb.h>
 
+#include <list>
+#include <memory>
+
+/** Number of blocks whose merkle tree levels the txindex keeps in memory for proofs. */
+static constexpr size_t MERKLE_TREE_CACHE_BLOCKS = 16;
+
 /**
  * TxIndex is used to look up transactions included in the blockchain by hash.
  * The index is written to a LevelDB database and records the filesystem
@@ -22,11 +30,17 @@ protected:
 private:
     const std::unique_ptr<DB> m_db;
 
+    mutable Mutex m_merkle_cache_mutex;
+    /// Merkle tree levels of the blocks proofs were last built for, most recently used first.
+    mutable std::list<std::pair<uint256, std::shared_ptr<const MerkleTreeLevels>>> m_merkle_cache GUARDED_BY(m_merkle_cache_mutex);
+
 protected:
     /// Override base class init to migrate from old database.
     bool Init() override;
 
-    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+    std::unique_ptr<PreparedBlock> PrepareBlock(const CBlock& block, const CBlockIndex* pindex) const override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, PreparedBlock& prepared) override;
 
     BaseIndex::DB& GetDB() const override;
 
@@ -46,6 +60,23 @@ public:
     /// @param[out]  tx  The transaction itself.
     /// @return  true if transaction is found, false otherwise
     bool FindTx(const uint256& tx_hash, uint256& block_hash, CTransactionRef& tx) const;
+
+    /// Look up several transactions by hash. The index entries are read in key
+    /// order and the transactions in block file order, opening each block
+    /// file and reading each block header once.
+    ///
+    /// @param[in]   tx_hashes  The hashes of the transactions to be returned.
+    /// @param[out]  block_hashes  For each hash, the hash of the block the transaction is found in.
+    /// @param[out]  txs  For each hash, the transaction itself, or null if it is not found.
+    /// @return  false if there was an error reading the transactions found
+    bool FindTxs(const std::vector<uint256>& tx_hashes, std::vector<uint256>& block_hashes, std::vector<CTransactionRef>& txs) const;
+
+    /// Get the levels of the merkle tree of a block from its txids, which the index keeps for each
+    /// block it indexed, so that building a proof doesn't require reading the block.
+    ///
+    /// @param[in]   block_hash  The hash of the block.
+    /// @return  the merkle tree levels, or null if the txids of the block are not indexed
+    std::shared_ptr<const MerkleTreeLevels> GetMerkleTreeLevels(const uint256& block_hash) const;
 };
 
 /// The global transaction index, used in GetTransaction. May be null.
@@ -17,10 +17,18 @@
 #include <chainparams.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
+#include <crypto/chacha20.h>
+#include <crypto/ripemd160.h>
+#include <crypto/sha512.h>
+#include <crypto/siphash.h>
 #include <fs.h>
 #include <httprpc.h>
 #include <httpserver.h>
+#include <index/addressindex.h>
+#include <index/coinstatsindex.h>
 #include <index/blockfilterindex.h>
+#include <index/blockstatsindex.h>
+#include <index/spentindex.h>
 #include <index/txindex.h>
 #include <interfaces/chain.h>
 #include <key.h>
@@ -29,6 +37,7 @@
 #include <net_permissions.h>
 #include <net_processing.h>
 #include <netbase.h>
+#include <node/args_snapshot.h>
 #include <node/context.h>
 #include <policy/feerate.h>
 #include <policy/fees.h>
@@ -40,12 +49,16 @@
 #include <rpc/util.h>
 #include <scheduler.h>
 #include <script/sigcache.h>
+#include <script/sign.h>
 #include <script/standard.h>
 #include <shutdown.h>
+#include <support/lockedpool.h>
 #include <timedata.h>
 #include <torcontrol.h>
 #include <txdb.h>
 #include <txmempool.h>
+#include <txreconciliation.h>
+#include <udprelay.h>
 #include <ui_interface.h>
 #include <util/asmap.h>
 #include <util/moneystr.h>
@@ -167,6 +180,18 @@ void Interrupt(NodeContext& node)
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    if (g_addressindex) {
+        g_addressindex->Interrupt();
+    }
+    if (g_spentindex) {
+        g_spentindex->Interrupt();
+    }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Interrupt();
+    }
+    if (g_block_stats_index) {
+        g_block_stats_index->Interrupt();
+    }
     ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Interrupt(); });
 }
 
@@ -187,6 +212,7 @@ void Shutdown(NodeContext& node)
 
     StopHTTPRPC();
     StopREST();
+    StopMetrics();
     StopRPC();
     StopHTTPServer();
     for (const auto& client : node.chain_clients) {
@@ -203,7 +229,7 @@ void Shutdown(NodeContext& node)
     // * ProcessMessage locks cs_main and g_cs_orphans before indirectly calling ForEachNode which
     //   locks cs_vNodes.
     // * CConnman::Stop calls DeleteNode, which calls FinalizeNode, which locks cs_main and calls
-    //   EraseOrphansFor, which locks g_cs_orphans.
+    //   TxOrphanage::EraseForPeer with g_cs_orphans locked.
     //
     // Thus the implicit locking order requirement is: (1) cs_main, (2) g_cs_orphans, (3) cs_vNodes.
     if (node.connman) {
@@ -213,6 +239,8 @@ void Shutdown(NodeContext& node)
     }
 
     StopTorControl();
+    // No peers are left to queue blocks
+    StopBlockValidationThread();
 
     // After everything has been shut down, but before things get flushed, stop the
     // CScheduler/checkqueue threadGroup
@@ -222,6 +250,10 @@ void Shutdown(NodeContext& node)
 
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
+    if (node.block_template_cache) {
+        UnregisterValidationInterface(node.block_template_cache.get());
+        node.block_template_cache.reset();
+    }
     node.peer_logic.reset();
     node.connman.reset();
     node.banman.reset();
@@ -230,6 +262,10 @@ void Shutdown(NodeContext& node)
         DumpMempool(::mempool);
     }
 
+    if (gArgs.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        DumpSignatureCaches();
+    }
+
     if (fFeeEstimatesInitialized)
     {
         ::feeEstimator.FlushUnconfirmed();
@@ -252,6 +288,7 @@ void Shutdown(NodeContext& node)
             g_chainstate->ForceFlushStateToDisk();
         }
     }
+    StopBlockFileWorkers();
 
     // After there are no more peers/RPC left to give us new data which may generate
     // CValidationInterface callbacks, flush them...
@@ -262,6 +299,22 @@ void Shutdown(NodeContext& node)
         g_txindex->Stop();
         g_txindex.reset();
     }
+    if (g_addressindex) {
+        g_addressindex->Stop();
+        g_addressindex.reset();
+    }
+    if (g_spentindex) {
+        g_spentindex->Stop();
+        g_spentindex.reset();
+    }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Stop();
+        g_coin_stats_index.reset();
+    }
+    if (g_block_stats_index) {
+        g_block_stats_index->Stop();
+        g_block_stats_index.reset();
+    }
     ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Stop(); });
     DestroyAllBlockFilterIndexes();
 
@@ -276,6 +329,7 @@ void Shutdown(NodeContext& node)
         if (g_chainstate && g_chainstate->CanFlushToDisk()) {
             g_chainstate->ForceFlushStateToDisk();
             g_chainstate->ResetCoinsViews();
+            SaveBlockIndexImage();
         }
         pblocktree.reset();
     }
@@ -308,6 +362,7 @@ void Shutdown(NodeContext& node)
     }
 
     LogPrintf("%s: done\n", __func__);
+    LogInstance().StopAsync();
 }
 
 /**
@@ -381,50 +436,82 @@ void SetupServerArgs()
 #if HAVE_SYSTEM
     gArgs.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
+    gArgs.AddArg("-asyncblockfiles", strprintf("Pre-allocate block and undo file space ahead of the writer, commit written block data to disk and delete pruned files in background threads, so fsync stalls do not hold up block validation. The block index is still only written after the block data it refers to is on disk (default: %u)", DEFAULT_ASYNC_BLOCK_FILES), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-asyncblockvalidation", strprintf("Connect blocks received from peers on a thread of their own, so that other peers' messages are handled while a block is connected. Messages from the peer that sent the block still wait for it (default: %u)", DEFAULT_ASYNC_BLOCK_VALIDATION), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockscolddir=<dir>", "Specify directory to hold a blocks subdirectory the older *.dat files are moved to, typically on cheaper storage than -blocksdir. Reads find them in either directory (default: none)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksdir=<dir>", "Specify directory to hold blocks subdirectory for *.dat files (default: <datadir>)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockshotfiles=<n>", strprintf("With -blockscolddir, number of most recent block files kept in -blocksdir (minimum 1, default: %u)", DEFAULT_BLOCKS_HOT_FILES), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockcompress", strprintf("Store newly received blocks LZ4 compressed in the block files. Block files written this way cannot be read by versions without this option (default: %u)", DEFAULT_BLOCKCOMPRESS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockindeximage", strprintf("Write the block index to an image file at shutdown and load it from there at the next startup, instead of rebuilding it from the block tree database (default: %u)", DEFAULT_BLOCK_INDEX_IMAGE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockmmap", strprintf("Read finalized block files through read-only memory mappings instead of per-block file reads (default: %u)", DEFAULT_BLOCKMMAP), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #if HAVE_SYSTEM
     gArgs.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
     gArgs.AddArg("-blockreconstructionextratxn=<n>", strprintf("Extra transactions to keep in memory for compact block reconstructions (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksonly", strprintf("Whether to reject transactions from network peers. Automatic broadcast and rebroadcast of any transactions from inbound peers is disabled, unless '-whitelistforcerelay' is '1', in which case whitelisted peers' transactions will be relayed. RPC transactions are not affected. (default: %u)", DEFAULT_BLOCKSONLY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-chainstatecompression", strprintf("Snappy compress new tables of the chainstate database, if LevelDB is built with Snappy (default: %u)", DEFAULT_CHAINSTATE_COMPRESSION), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-chainstateshards=<n>", strprintf("Split a new chainstate database into <n> LevelDB instances by transaction hash, which are written to in parallel and compacted independently. An existing chainstate keeps its number of shards until -reindex-chainstate (1 to %d, default: %d)", MAX_CHAINSTATE_SHARDS, DEFAULT_CHAINSTATE_SHARDS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinsjournal", strprintf("Append each coins cache flush to a journal file next to the chainstate database before writing it to the database, so that an interrupted write is finished from the journal at startup instead of by replaying blocks. This also lets -dbbackgroundflush be used while pruning (default: %u)", DEFAULT_COINS_JOURNAL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinsreusesample=<n>", strprintf("Follow one in <n> coins looked up in the coins cache to estimate the hit rate other -dbcache sizes would have, shown by getcoinscacheinfo; 1000 is a good start (0 to disable, default: %u)", DEFAULT_COINS_REUSE_SAMPLE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-conf=<file>", strprintf("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)", PALLADIUM_CONF_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbbackgroundflush", strprintf("Write the UTXO set to disk in a background thread when the coins cache is flushed during normal operation, so block validation can continue meanwhile. Not used while pruning, unless -coinsjournal is set. Coins being written stay in memory until the write is done, so memory usage can briefly reach twice -dbcache (default: %u)", DEFAULT_DB_BACKGROUND_FLUSH), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbcache=<n>", strprintf("Maximum database cache size <n> MiB (%d to %d, default: %d). In addition, unused mempool memory is shared for this cache (see -maxmempool).", nMinDbCache, nMaxDbCache, nDefaultDbCache), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbcacheretain=<n>", strprintf("Percentage of -dbcache to keep filled with recently used coins when the coins cache is flushed during normal operation, instead of emptying it. Modified coins are written out either way (0 to %d, default: %d)", MAX_DBCACHE_RETAIN, DEFAULT_DBCACHE_RETAIN), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbprofile=<profile>", strprintf("LevelDB tuning of the chainstate and index databases: \"default\", \"ssd\" (larger write buffers and table files), \"hdd\" (larger blocks and table files, fewer compaction passes) or \"lowmem\" (small write buffers, fewer open files) (default: %s)", DEFAULT_DB_PROFILE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-indexcompression", strprintf("Snappy compress new tables of the block index and optional index databases, if LevelDB is built with Snappy (default: %u)", DEFAULT_INDEX_COMPRESSION), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-indexsyncthreads=<n>", strprintf("Number of threads that read and prepare blocks ahead of the database writes while an optional index catches up with the chain (0 to %d, default: %d)", MAX_INDEX_SYNC_THREADS, DEFAULT_INDEX_SYNC_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-largepages=<mode>", "Back the coins cache and the signature caches with huge pages to reduce TLB misses: \"thp\" (transparent huge pages, the default if no mode is given), \"hugetlb\" (pages reserved through vm.nr_hugepages, using transparent huge pages once they run out) or \"none\" (Linux only, default: none)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-largepagesnode=<n>", "With -largepages, prefer NUMA node <n> for the huge pages instead of the node of the thread that first uses them", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-loadblock=<file>", "Imports blocks from external file on startup", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-maxmempool=<n>", strprintf("Keep the transaction memory pool below <n> megabytes (default: %u)", DEFAULT_MAX_MEMPOOL_SIZE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-maxorphantx=<n>", strprintf("Keep at most <n> unconnectable transactions in memory (default: %u)", DEFAULT_MAX_ORPHAN_TRANSACTIONS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-maxorphanweight=<n>", strprintf("Keep unconnectable transactions of at most <n> weight units in total in memory, evicting those of the peers that sent the most first (default: %u)", DEFAULT_MAX_ORPHAN_WEIGHT), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-mempoolclusters", strprintf("Track clusters of related mempool transactions and use their chunk feerates for block assembly and eviction (default: %u)", DEFAULT_MEMPOOL_CLUSTERS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-mempoolexpiry=<n>", strprintf("Do not keep transactions in the mempool longer than <n> hours (default: %u)", DEFAULT_MEMPOOL_EXPIRY), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-parpipeline", strprintf("Overlap the UTXO updates of each block with the script checks of the block before it when connecting several blocks; if verification fails, the blocks are connected again one at a time (default: %u)", DEFAULT_SCRIPTCHECK_PIPELINE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-persistsigcache", strprintf("Whether to save the signature and script execution caches on shutdown and load them on startup, to avoid verifying the mempool and the next blocks again (default: %u)", DEFAULT_PERSIST_SIGCACHE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", PALLADIUM_PID_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
+    gArgs.AddArg("-prefetchthreads=<n>", strprintf("Number of threads that read the inputs of a block from the coin database in parallel before the block is connected (0 to %d, default: %d)", MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex, -addressindex, -spentindex, -coinstatsindex, -blockstatsindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-pruneheadroom=<n>", "When automatic pruning starts, delete block files until their size is this many MiB below the -prune target, so that pruning (and the full flush that comes with it) happens less often (default: 0 = just enough for the next block and undo file chunk)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-reorgcache=<n>", strprintf("Keep the last <n> connected blocks in memory with their undo data, so that disconnecting them in a reorg does not read from disk (0 to %u, default: %u)", MAX_REORG_CACHE_BLOCKS, DEFAULT_REORG_CACHE_BLOCKS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks. When in pruning mode or if blocks on disk might be corrupted, use full -reindex instead.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #ifndef WIN32
+    gArgs.AddArg("-schedulerthreads=<n>", strprintf("Number of threads running background tasks and validation notifications. Notifications for different subscribers (wallets, indexes, zmq, peers) run in parallel on up to this many threads (1 to %d, default: %d)", MAX_SCHEDULER_THREADS, DEFAULT_SCHEDULER_THREADS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-sysperms", "Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #else
     hidden_args.emplace_back("-sysperms");
 #endif
     gArgs.AddArg("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)", DEFAULT_TXINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-addressindex", strprintf("Maintain an index of the outputs paying to each address and of their spending transactions, used by the getaddresshistory, getaddressutxos and getaddressbalance rpc calls (default: %u)", DEFAULT_ADDRESSINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockstatsindex", strprintf("Maintain the statistics of each block and running totals of fees and outputs, used by the getblockstats, getblockstatsrange and getchaintxstats rpc calls (default: %u)", DEFAULT_BLOCKSTATSINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinstatsindex", strprintf("Maintain statistics on the UTXO set after each block, including its MuHash, used by the gettxoutsetinfo rpc call (default: %u)", DEFAULT_COINSTATSINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-spentindex", strprintf("Maintain an index of the transactions spending each output, used by the getspendingtx rpc call (default: %u)", DEFAULT_SPENTINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blockfilterindex=<type>",
                  strprintf("Maintain an index of compact filters by block (default: %s, values: %s).", DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()) +
                  " If <type> is not supplied or if <type> = 1, indexes for all known types are enabled.",
                  ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 
+    gArgs.AddArg("-adaptiveblockdownload", strprintf("Adapt the number of blocks requested at once from each peer (up to %d) to how fast it delivers them, and request the blocks of a stalling peer from others instead of disconnecting it, unless it stalls again (default: %u)", MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER, DEFAULT_ADAPTIVE_BLOCK_DOWNLOAD), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-addnode=<ip>", "Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info). This option can be specified multiple times to add multiple nodes.", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-asmap=<file>", strprintf("Specify asn mapping used for bucketing of the peers (default: %s). Relative paths will be prefixed by the net-specific datadir location.", DEFAULT_ASMAP_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-banscore=<n>", strprintf("Threshold for disconnecting and discouraging misbehaving peers (default: %u)", DEFAULT_BANSCORE_THRESHOLD), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-bantime=<n>", strprintf("Default duration (in seconds) of manually configured bans (default: %u)", DEFAULT_MISBEHAVING_BANTIME), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-bind=<addr>", "Bind to given address and always listen on it. Use [host]:port notation for IPv6", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-cmpctprefill=<n>", strprintf("Send up to <n> bytes of the transactions in a block that a high-bandwidth compact block peer likely lacks in full along with the block, saving a round trip (default: %u)", DEFAULT_CMPCT_PREFILL_BYTES), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-connect=<ip>", "Connect only to the specified node; -noconnect disables automatic connections (the rules for this peer are the same as for -addnode). This option can be specified multiple times to connect to multiple nodes.", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-discover", "Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-dns", strprintf("Allow DNS lookups for -addnode, -seednode and -connect (default: %u)", DEFAULT_NAME_LOOKUP), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
@@ -433,23 +520,32 @@ void SetupServerArgs()
     gArgs.AddArg("-forcednsseed", strprintf("Always query for peer addresses via DNS lookup (default: %u)", DEFAULT_FORCEDNSSEED), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-listen", "Accept connections from outside (default: 1 if no -proxy or -connect)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-listenonion", strprintf("Automatically create Tor hidden service (default: %d)", DEFAULT_LISTEN_ONION), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-blockservecache=<n>", strprintf("Keep up to <n> MiB of recently served blocks in memory to serve other peers requesting them, 0 = disabled (default: %u)", DEFAULT_BLOCK_SERVE_CACHE_MIB), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-maxcmpcthbpeers=<n>", strprintf("Ask up to <n> peers that recently sent us new blocks to announce blocks as compact blocks right away (high-bandwidth mode), 0 = none (default: %u)", DEFAULT_MAX_CMPCT_HB_PEERS), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-maxconnections=<n>", strprintf("Maintain at most <n> connections to peers (default: %u)", DEFAULT_MAX_PEER_CONNECTIONS), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-maxreceivebuffer=<n>", strprintf("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)", DEFAULT_MAXRECEIVEBUFFER), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-maxsendbuffer=<n>", strprintf("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)", DEFAULT_MAXSENDBUFFER), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-maxtimeadjustment", strprintf("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)", DEFAULT_MAX_TIME_ADJUSTMENT), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-maxuploadtarget=<n>", strprintf("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)", DEFAULT_MAX_UPLOAD_TARGET), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-msghandlerthreads=<n>", strprintf("Number of worker threads that read and send blocks requested by peers, with peers shared out among them, 0 = use the message handler thread (0 to %d, default: %d)", MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-netevents=<backend>", strprintf("Socket readiness notification backend to use, one of: %s (default: %s)", AvailableNetEventsModes(), NetEventsModeName(DEFAULT_NET_EVENTS)), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onion=<ip:port>", "Use separate SOCKS5 proxy to reach peers via Tor hidden services, set -noonion to disable (default: -proxy)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onlynet=<net>", "Make outgoing connections only through network <net> (ipv4, ipv6 or onion). Incoming connections are not affected by this option. This option can be specified multiple times to allow multiple networks.", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-maxbloomcpu=<n>", strprintf("Spend at most <n> milliseconds per second building filtered blocks (BIP37) for each peer, 0 = unlimited (default: %u)", DEFAULT_MAX_BLOOM_CPU_MS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-p2pcompression", strprintf("Offer peers to exchange block, headers, blocktxn and addr messages of at least %u bytes LZ4 compressed, and compress them for peers that offer it. Compression runs on the -msghandlerthreads workers, if any (default: %u)", MIN_COMPRESSED_MESSAGE_SIZE, DEFAULT_P2P_COMPRESSION), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-peerbloomfilters", strprintf("Support filtering of blocks and transaction with bloom filters (default: %u)", DEFAULT_PEERBLOOMFILTERS), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-permitbaremultisig", strprintf("Relay non-P2SH multisig (default: %u)", DEFAULT_PERMIT_BAREMULTISIG), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-port=<port>", strprintf("Listen for connections on <port> (default: %u, testnet: %u, regtest: %u)", defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort(), regtestChainParams->GetDefaultPort()), ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-proxy=<ip:port>", "Connect through SOCKS5 proxy, set -noproxy to disable (default: disabled)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-proxyrandomize", strprintf("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)", DEFAULT_PROXYRANDOMIZE), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-seednode=<ip>", "Connect to a node to retrieve peer addresses, and disconnect. This option can be specified multiple times to connect to multiple nodes.", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-sendcoalesce", strprintf("Send the messages generated for a peer in one go, rather than each as soon as it is queued (default: %u)", DEFAULT_SEND_COALESCE), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-timeout=<n>", strprintf("Specify connection timeout in milliseconds (minimum: 1, default: %d)", DEFAULT_CONNECT_TIMEOUT), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-peertimeout=<n>", strprintf("Specify p2p connection timeout in seconds. This option determines the amount of time a peer may be inactive before the connection to it is dropped. (minimum: 1, default: %d)", DEFAULT_PEER_CONNECT_TIMEOUT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-torcontrol=<ip>:<port>", strprintf("Tor control port to use if onion listening enabled (default: %s)", DEFAULT_TOR_CONTROL), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     gArgs.AddArg("-torpassword=<pass>", "Tor control port password (default: empty)", ArgsManager::ALLOW_ANY | ArgsManager::SENSITIVE, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-txreconciliation", strprintf("Offer peers to reconcile transaction announcements periodically instead of announcing every transaction to each of them. Transactions are still announced right away to a few outbound peers and to peers without support (default: %u)", DEFAULT_TXRECONCILIATION), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-udprelayport=<port>", strprintf("Exchange new blocks over UDP on <port> with peers given the udprelay permission, such as the nodes of other miners. 0 disables it (default: %u)", DEFAULT_UDPRELAY_PORT), ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
 #ifdef USE_UPNP
 #if USE_UPNP
     gArgs.AddArg("-upnp", "Use UPnP to map the listening port (default: 1 when listening and no -proxy)", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
@@ -464,7 +560,8 @@ void SetupServerArgs()
         "noban (do not ban for misbehavior), "
         "forcerelay (relay transactions that are already in the mempool; implies relay), "
         "relay (relay even in -blocksonly mode), "
-        "and mempool (allow requesting BIP35 mempool contents). "
+        "mempool (allow requesting BIP35 mempool contents), "
+        "and udprelay (exchange new blocks over UDP, see -udprelayport; not included in all). "
         "Specify multiple permissions separated by commas (default: noban,mempool,relay). Can be specified multiple times.", ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
 
     gArgs.AddArg("-whitelist=<[permissions@]IP address or network>", "Whitelist peers connecting from the given IP address (e.g. 1.2.3.4) or "
@@ -478,19 +575,31 @@ void SetupServerArgs()
     gArgs.AddArg("-zmqpubhashtx=<address>", "Enable publish hash transaction in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawblock=<address>", "Enable publish raw block in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawtx=<address>", "Enable publish raw transaction in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubtemplate=<address>", "Enable publish block template changes in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubmempoolhistogram=<address>", "Enable publish mempool fee histogram in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubsequence=<address>", "Enable publish hash block and tx sequence in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashblockhwm=<n>", strprintf("Set publish hash block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashtxhwm=<n>", strprintf("Set publish hash transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawblockhwm=<n>", strprintf("Set publish raw block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawtxhwm=<n>", strprintf("Set publish raw transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubtemplatehwm=<n>", strprintf("Set publish block template outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubmempoolhistogramhwm=<n>", strprintf("Set publish mempool fee histogram outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubsequencehwm=<n>", strprintf("Set publish hash sequence message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
 #else
     hidden_args.emplace_back("-zmqpubhashblock=<address>");
     hidden_args.emplace_back("-zmqpubhashtx=<address>");
     hidden_args.emplace_back("-zmqpubrawblock=<address>");
     hidden_args.emplace_back("-zmqpubrawtx=<address>");
+    hidden_args.emplace_back("-zmqpubtemplate=<address>");
+    hidden_args.emplace_back("-zmqpubmempoolhistogram=<address>");
+    hidden_args.emplace_back("-zmqpubsequence=<address>");
     hidden_args.emplace_back("-zmqpubhashblockhwm=<n>");
     hidden_args.emplace_back("-zmqpubhashtxhwm=<n>");
     hidden_args.emplace_back("-zmqpubrawblockhwm=<n>");
     hidden_args.emplace_back("-zmqpubrawtxhwm=<n>");
+    hidden_args.emplace_back("-zmqpubtemplatehwm=<n>");
+    hidden_args.emplace_back("-zmqpubmempoolhistogramhwm=<n>");
+    hidden_args.emplace_back("-zmqpubsequencehwm=<n>");
 #endif
 
     gArgs.AddArg("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
@@ -502,21 +611,26 @@ void SetupServerArgs()
         "and level 4 tries to reconnect the blocks, "
         "each level includes the checks of the previous levels "
         "(0-4, default: %u)", DEFAULT_CHECKLEVEL), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-asynccheckblocks", strprintf("Verify the -checkblocks blocks in the background once the node is started, and shut it down if they are corrupted. Levels 3 and 4 still hold up block validation while they run (default: %u)", DEFAULT_ASYNC_CHECKBLOCKS), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkblockindex", strprintf("Do a consistency check for the block tree, chainstate, and other validation data structures occasionally. (default: %u, regtest: %u)", defaultChainParams->DefaultConsistencyChecks(), regtestChainParams->DefaultConsistencyChecks()), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u, regtest: %u)", defaultChainParams->DefaultConsistencyChecks(), regtestChainParams->DefaultConsistencyChecks()), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkpoints", strprintf("Enable rejection of any forks from the known historical chain until block 295000 (default: %u)", DEFAULT_CHECKPOINTS_ENABLED), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-deprecatedrpc=<method>", "Allows deprecated RPC method(s) to be used", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-stopafterblockimport", strprintf("Stop running after importing blocks from disk (default: %u)", DEFAULT_STOPAFTERBLOCKIMPORT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-tipnotifyinterval=<n>", strprintf("During initial block download, deliver block and header tip notifications to the GUI, -blocknotify and block waiting RPCs at most once every <n> milliseconds, skipping the tips in between (0 to deliver every tip, default: %u)", DEFAULT_TIP_NOTIFY_INTERVAL), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-stopatheight", strprintf("Stop running after reaching the given height in the main chain (default: %u)", DEFAULT_STOPATHEIGHT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-limitancestorcount=<n>", strprintf("Do not accept transactions if number of in-mempool ancestors is <n> or more (default: %u)", DEFAULT_ANCESTOR_LIMIT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-limitclustercount=<n>", strprintf("Do not accept transactions if, with -mempoolclusters, they would join a cluster of <n> or more in-mempool transactions (default: %u)", DEFAULT_CLUSTER_LIMIT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-addrmantest", "Allows to test address relay on localhost", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-lockprofiling", strprintf("Record wait and hold times of every locking site, see getlockstats (default: %u)", DEFAULT_LOCKPROFILING), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-debug=<category>", "Output debugging information (default: -nodebug, supplying <category> is optional). "
         "If <category> is not supplied or if <category> = 1, output all debugging information. <category> can be: " + ListLogCategories() + ".", ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-debugexclude=<category>", strprintf("Exclude debugging information for a category. Can be used in conjunction with -debug=1 to output debug logs for all categories except one or more specified categories."), ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-logasync", strprintf("Write debug output on a background thread. Messages are dropped when the writer falls behind by more than %u MiB (default: %u)", MAX_LOGASYNC_BUFFER >> 20, DEFAULT_LOGASYNC), ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-logips", strprintf("Include IP addresses in debug output (default: %u)", DEFAULT_LOGIPS), ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-logtimestamps", strprintf("Prepend debug output with timestamp (default: %u)", DEFAULT_LOGTIMESTAMPS), ArgsManager::ALLOW_ANY, OptionsCategory::DEBUG_TEST);
 #ifdef HAVE_THREAD_LOCAL
@@ -549,14 +663,25 @@ void SetupServerArgs()
 
     gArgs.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-blocktemplateupdate=<n>", strprintf("Build getblocktemplate results by adding new mempool transactions to the previous template, and only assemble a template from scratch every <n> seconds or on a new tip (0 = always assemble from scratch, default: %d)", DEFAULT_BLOCK_TEMPLATE_UPDATE), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-genthreads=<n>", strprintf("Number of threads searching for a valid nonce in generatetoaddress and generatetodescriptor, e.g. on test networks with a high difficulty (0 = one per core, default: %d)", DEFAULT_GENTHREADS), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
 
+    gArgs.AddArg("-metrics", strprintf("Serve node statistics for Prometheus at /metrics on the RPC port, without authentication (default: %u)", DEFAULT_METRICS_ENABLE), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
+    gArgs.AddArg("-restmaxutxos=<n>", strprintf("Maximum number of outpoints a REST getutxos request may query (default: %u)", DEFAULT_REST_MAX_UTXOS), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
+    gArgs.AddArg("-restthreads=<n>", strprintf("Service REST requests with <n> threads of their own, so they don't wait behind RPC calls (0: share the RPC threads, default: %d)", DEFAULT_HTTP_REST_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
+    gArgs.AddArg("-restworkqueue=<n>", strprintf("Set the depth of the work queue of the -restthreads threads (default: %d)", DEFAULT_HTTP_WORKQUEUE), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcallowip=<ip>", "Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times", ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcauth=<userpw>", "Username and HMAC-SHA-256 hashed password for JSON-RPC connections. The field <userpw> comes in the format: <USERNAME>:<SALT>$<HASH>. A canonical python script is included in share/rpcauth. The client then connects normally using the rpcuser=<USERNAME>/rpcpassword=<PASSWORD> pair of arguments. This option can be specified multiple times", ArgsManager::ALLOW_ANY | ArgsManager::SENSITIVE, OptionsCategory::RPC);
+    gArgs.AddArg("-rpcbatchthreads=<n>", strprintf("Execute up to <n> calls of a JSON-RPC batch request at the same time. The replies keep the order of the calls either way (default: %d)", DEFAULT_RPC_BATCH_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcbind=<addr>[:port]", "Bind to given address to listen for JSON-RPC connections. Do not expose the RPC server to untrusted networks such as the public internet! This option is ignored unless -rpcallowip is also passed. Port is optional and overrides -rpcport. Use [host]:port notation for IPv6. This option can be specified multiple times (default: 127.0.0.1 and ::1 i.e., localhost)", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY | ArgsManager::SENSITIVE, OptionsCategory::RPC);
+    gArgs.AddArg("-rpccachesize=<n>", strprintf("Keep up to <n> MiB of results of getblock, getblockheader, getblockstats and getrawtransaction about blocks with at least %d confirmations, and answer repeated calls from them (default: %u)", RPC_CACHE_MIN_CONFIRMATIONS, DEFAULT_RPC_CACHE_SIZE), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpccookiefile=<loc>", "Location of the auth cookie. Relative paths will be prefixed by a net-specific datadir location. (default: data dir)", ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcpassword=<pw>", "Password for JSON-RPC connections", ArgsManager::ALLOW_ANY | ArgsManager::SENSITIVE, OptionsCategory::RPC);
+    gArgs.AddArg("-rpcprioritymethod=<method>", "Service calls of <method> by the -rpcprioritythreads threads. This option can be specified multiple times (default: getblocktemplate, sendrawtransaction, submitblock and submitheader)", ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
+    gArgs.AddArg("-rpcprioritythreads=<n>", strprintf("Set the number of threads to service calls of the -rpcprioritymethod methods, so they don't wait behind other calls (0: use the other RPC threads, default: %d)", DEFAULT_HTTP_PRIORITY_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
+    gArgs.AddArg("-rpcpriorityworkqueue=<n>", strprintf("Set the depth of the work queue of the -rpcprioritythreads threads (default: %d)", DEFAULT_HTTP_WORKQUEUE), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcport=<port>", strprintf("Listen for JSON-RPC connections on <port> (default: %u, testnet: %u, regtest: %u)", defaultBaseParams->RPCPort(), testnetBaseParams->RPCPort(), regtestBaseParams->RPCPort()), ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcserialversion", strprintf("Sets the serialization of raw transaction or block hex returned in non-verbose mode, non-segwit(0) or segwit(1) (default: %d)", DEFAULT_RPC_SERIALIZE_VERSION), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT), ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::RPC);
@@ -682,6 +807,16 @@ static void CleanupBlockRevFiles()
     }
 }
 
+/** Move older block files to -blockscolddir as the chain grows. */
+static void ThreadMigrateBlockFiles()
+{
+    util::ThreadRename("blkmigrate");
+    while (!ShutdownRequested()) {
+        MigrateColdBlockFiles();
+        boost::this_thread::sleep_for(boost::chrono::seconds{BLOCK_FILE_MIGRATION_INTERVAL.count()});
+    }
+}
+
 static void ThreadImport(std::vector<fs::path> vImportFiles)
 {
     const CChainParams& chainparams = Params();
@@ -775,6 +910,7 @@ static bool AppInitServers()
     if (!StartHTTPRPC())
         return false;
     if (gArgs.GetBoolArg("-rest", DEFAULT_REST_ENABLE)) StartREST();
+    if (gArgs.GetBoolArg("-metrics", DEFAULT_METRICS_ENABLE)) StartMetrics();
     StartHTTPServer();
     return true;
 }
@@ -960,6 +1096,18 @@ bool AppInitParameterInteraction()
         return InitError(strprintf(_("Specified blocks directory \"%s\" does not exist.").translated, gArgs.GetArg("-blocksdir", "")));
     }
 
+    if (gArgs.IsArgSet("-blockscolddir")) {
+        const fs::path cold_dir = fs::system_complete(gArgs.GetArg("-blockscolddir", ""));
+        if (!fs::is_directory(cold_dir)) {
+            return InitError(strprintf(_("Specified cold blocks directory \"%s\" does not exist.").translated, gArgs.GetArg("-blockscolddir", "")));
+        }
+        g_blocks_cold_dir = cold_dir / BaseParams().DataDir() / "blocks";
+        if (g_blocks_cold_dir == GetBlocksDir()) {
+            return InitError(_("-blockscolddir must not be the same directory as -blocksdir.").translated);
+        }
+        g_blocks_hot_files = std::max<int64_t>(1, gArgs.GetArg("-blockshotfiles", DEFAULT_BLOCKS_HOT_FILES));
+    }
+
     // parse and validate enabled filter types
     std::string blockfilterindex_value = gArgs.GetArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
     if (blockfilterindex_value == "" || blockfilterindex_value == "1") {
@@ -979,6 +1127,14 @@ bool AppInitParameterInteraction()
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex.").translated);
+        if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+            return InitError(_("Prune mode is incompatible with -addressindex.").translated);
+        if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))
+            return InitError(_("Prune mode is incompatible with -spentindex.").translated);
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX))
+            return InitError(_("Prune mode is incompatible with -coinstatsindex.").translated);
+        if (gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX))
+            return InitError(_("Prune mode is incompatible with -blockstatsindex.").translated);
         if (!g_enabled_filter_types.empty()) {
             return InitError(_("Prune mode is incompatible with -blockfilterindex.").translated);
         }
@@ -1038,8 +1194,51 @@ bool AppInitParameterInteraction()
     if (ratio != 0) {
         mempool.setSanityCheck(1.0 / ratio);
     }
+    {
+        LOCK(mempool.cs);
+        mempool.SetTrackClusters(gArgs.GetBoolArg("-mempoolclusters", DEFAULT_MEMPOOL_CLUSTERS));
+    }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    g_block_compress = gArgs.GetBoolArg("-blockcompress", DEFAULT_BLOCKCOMPRESS);
+    g_block_mmap = gArgs.GetBoolArg("-blockmmap", DEFAULT_BLOCKMMAP);
+    g_block_index_image = gArgs.GetBoolArg("-blockindeximage", DEFAULT_BLOCK_INDEX_IMAGE);
+    g_pipeline_script_checks = gArgs.GetBoolArg("-parpipeline", DEFAULT_SCRIPTCHECK_PIPELINE);
+    g_db_background_flush = gArgs.GetBoolArg("-dbbackgroundflush", DEFAULT_DB_BACKGROUND_FLUSH);
+    g_coins_journal = gArgs.GetBoolArg("-coinsjournal", DEFAULT_COINS_JOURNAL);
+    g_chainstate_shards = std::max(1, std::min<int>(gArgs.GetArg("-chainstateshards", DEFAULT_CHAINSTATE_SHARDS), MAX_CHAINSTATE_SHARDS));
+    if (!ParseDBProfile(gArgs.GetArg("-dbprofile", DEFAULT_DB_PROFILE), g_db_profile)) {
+        return InitError(strprintf(_("Unknown -dbprofile value %s.").translated, gArgs.GetArg("-dbprofile", DEFAULT_DB_PROFILE)));
+    }
+    g_dbcache_retain_percent = std::max(0, std::min<int>(gArgs.GetArg("-dbcacheretain", DEFAULT_DBCACHE_RETAIN), MAX_DBCACHE_RETAIN));
+    g_tip_notify_interval = std::max<int64_t>(0, gArgs.GetArg("-tipnotifyinterval", DEFAULT_TIP_NOTIFY_INTERVAL));
+    g_coins_reuse_sample = std::max<int64_t>(0, std::min<int64_t>(gArgs.GetArg("-coinsreusesample", DEFAULT_COINS_REUSE_SAMPLE), std::numeric_limits<uint32_t>::max()));
+    g_lock_profiling = gArgs.GetBoolArg("-lockprofiling", DEFAULT_LOCKPROFILING);
+
+    const std::string large_pages = gArgs.GetArg("-largepages", "none");
+    LargePageManager::Mode large_page_mode;
+    if (large_pages == "none" || large_pages == "0") {
+        large_page_mode = LargePageManager::Mode::NONE;
+    } else if (large_pages == "thp" || large_pages == "" || large_pages == "1") {
+        large_page_mode = LargePageManager::Mode::THP;
+    } else if (large_pages == "hugetlb") {
+        large_page_mode = LargePageManager::Mode::HUGETLB;
+    } else {
+        return InitError(strprintf(_("Unknown -largepages value %s.").translated, large_pages));
+    }
+    const int large_page_node = gArgs.GetArg("-largepagesnode", -1);
+    if (large_page_mode != LargePageManager::Mode::NONE || large_page_node >= 0) {
+        if (!LargePageManager::Supported()) {
+            return InitError(_("-largepages is only supported on Linux.").translated);
+        }
+        if (!LargePageManager::Instance().Configure(large_page_mode, large_page_node)) {
+            return InitError(strprintf(_("NUMA node %d given by -largepagesnode does not exist.").translated, large_page_node));
+        }
+        if (large_page_mode != LargePageManager::Mode::NONE) {
+            LogPrintf("Using %s huge pages for the coins cache and signature caches%s\n", large_pages == "hugetlb" ? "hugetlbfs" : "transparent",
+                large_page_node >= 0 ? strprintf(", preferring NUMA node %d", large_page_node) : "");
+        }
+    }
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1093,6 +1292,11 @@ bool AppInitParameterInteraction()
         LogPrintf("Prune configured to target %u MiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
         fPruneMode = true;
     }
+    const int64_t prune_headroom = gArgs.GetArg("-pruneheadroom", 0);
+    if (prune_headroom < 0) {
+        return InitError(_("Prune headroom cannot be configured with a negative value.").translated);
+    }
+    g_prune_headroom = (uint64_t)prune_headroom * 1024 * 1024;
 
     nConnectTimeout = gArgs.GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0) {
@@ -1162,6 +1366,8 @@ bool AppInitParameterInteraction()
 
     nMaxTipAge = gArgs.GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
+    ReloadArgsSnapshot(gArgs);
+
     return true;
 }
 
@@ -1185,6 +1391,14 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string siphash_algo = SipHashAutoDetect();
+    LogPrintf("Using the '%s' SipHash implementation\n", siphash_algo);
+    std::string ripemd160_algo = RIPEMD160AutoDetect();
+    LogPrintf("Using the '%s' RIPEMD160 implementation\n", ripemd160_algo);
+    std::string sha512_algo = SHA512AutoDetect();
+    LogPrintf("Using the '%s' SHA512 implementation\n", sha512_algo);
+    std::string chacha20_algo = ChaCha20AutoDetect();
+    LogPrintf("Using the '%s' ChaCha20 implementation\n", chacha20_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1230,6 +1444,9 @@ bool AppInitMain(NodeContext& node)
             return InitError(strprintf("Could not open debug log file %s",
                 LogInstance().m_file_path.string()));
     }
+    if (gArgs.GetBoolArg("-logasync", DEFAULT_LOGASYNC)) {
+        LogInstance().StartAsync();
+    }
 
     if (!LogInstance().m_log_timestamps)
         LogPrintf("Startup time: %s\n", FormatISO8601DateTime(GetTime()));
@@ -1288,6 +1505,9 @@ bool AppInitMain(NodeContext& node)
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    if (gArgs.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        LoadSignatureCaches();
+    }
 
     int script_threads = gArgs.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (script_threads <= 0) {
@@ -1305,22 +1525,48 @@ bool AppInitMain(NodeContext& node)
     LogPrintf("Script verification uses %d additional threads\n", script_threads);
     if (script_threads >= 1) {
         g_parallel_script_checks = true;
+        g_parallel_signing = true;
         for (int i = 0; i < script_threads; ++i) {
             threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
+            threadGroup.create_thread([i]() { return ThreadHeaderCheck(i); });
+            threadGroup.create_thread([i]() { return ThreadTxCheck(i); });
+            threadGroup.create_thread([i]() { return ThreadVerifyBlockCheck(i); });
+            threadGroup.create_thread([i]() { return ThreadSignInputs(i); });
         }
     }
 
+    const int prefetch_threads = std::max(0, std::min<int>(gArgs.GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS), MAX_PREFETCH_THREADS));
+    if (prefetch_threads >= 1) {
+        LogPrintf("Block input prefetching uses %d threads\n", prefetch_threads);
+        g_parallel_prefetch = true;
+        for (int i = 0; i < prefetch_threads; ++i) {
+            threadGroup.create_thread([i]() { return ThreadPrefetchCheck(i); });
+        }
+    }
+
+    if (gArgs.GetBoolArg("-asyncblockfiles", DEFAULT_ASYNC_BLOCK_FILES)) {
+        LogPrintf("Block files are allocated and committed in the background\n");
+        StartBlockFileWorkers();
+    }
+
     assert(!node.scheduler);
     node.scheduler = MakeUnique<CScheduler>();
 
-    // Start the lightweight task scheduler thread
+    // Start the lightweight task scheduler threads
     CScheduler::Function serviceLoop = [&node]{ node.scheduler->serviceQueue(); };
-    threadGroup.create_thread(std::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    const int scheduler_threads = std::max(1, std::min<int>(gArgs.GetArg("-schedulerthreads", DEFAULT_SCHEDULER_THREADS), MAX_SCHEDULER_THREADS));
+    for (int i = 0; i < scheduler_threads; ++i) {
+        threadGroup.create_thread(std::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    }
 
     // Gather some entropy once per minute.
     node.scheduler->scheduleEvery([]{
         RandAddPeriodic();
-    }, std::chrono::minutes{1});
+    }, std::chrono::minutes{1}, "randaddperiodic");
+
+    if (g_tip_notify_interval > 0) {
+        node.scheduler->scheduleEvery(FlushTipNotifications, std::chrono::milliseconds{g_tip_notify_interval}, "tipnotify");
+    }
 
     GetMainSignals().RegisterBackgroundSignalScheduler(*node.scheduler);
 
@@ -1379,6 +1625,12 @@ bool AppInitMain(NodeContext& node)
     node.peer_logic.reset(new PeerLogicValidation(node.connman.get(), node.banman.get(), *node.scheduler, *node.mempool));
     RegisterValidationInterface(node.peer_logic.get());
 
+    const int64_t block_template_update = gArgs.GetArg("-blocktemplateupdate", DEFAULT_BLOCK_TEMPLATE_UPDATE);
+    if (block_template_update > 0) {
+        node.block_template_cache = MakeUnique<BlockTemplateCache>(*node.mempool, chainparams, block_template_update);
+        RegisterValidationInterface(node.block_template_cache.get());
+    }
+
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
     for (const std::string& cmt : gArgs.GetArgs("-uacomment")) {
@@ -1504,6 +1756,10 @@ bool AppInitMain(NodeContext& node)
         nMaxOutboundLimit = gArgs.GetArg("-maxuploadtarget", DEFAULT_MAX_UPLOAD_TARGET)*1024*1024;
     }
 
+    SetMaxBloomCpu(std::max<int64_t>(gArgs.GetArg("-maxbloomcpu", DEFAULT_MAX_BLOOM_CPU_MS), 0) * 1000);
+    SetBlockServeCacheSize(std::max<int64_t>(gArgs.GetArg("-blockservecache", DEFAULT_BLOCK_SERVE_CACHE_MIB), 0) << 20);
+    SetReorgCacheSize(std::max<int64_t>(0, std::min<int64_t>(gArgs.GetArg("-reorgcache", DEFAULT_REORG_CACHE_BLOCKS), MAX_REORG_CACHE_BLOCKS)));
+
     // ********************************************************* Step 7: load block chain
 
     fReindex = gArgs.GetBoolArg("-reindex", false);
@@ -1517,6 +1773,10 @@ bool AppInitMain(NodeContext& node)
     nTotalCache -= nBlockTreeDBCache;
     int64_t nTxIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxTxIndexCache << 20 : 0);
     nTotalCache -= nTxIndexCache;
+    int64_t address_index_cache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) ? nMaxTxIndexCache << 20 : 0);
+    nTotalCache -= address_index_cache;
+    int64_t spent_index_cache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) ? nMaxTxIndexCache << 20 : 0);
+    nTotalCache -= spent_index_cache;
     int64_t filter_index_cache = 0;
     if (!g_enabled_filter_types.empty()) {
         size_t n_indexes = g_enabled_filter_types.size();
@@ -1534,6 +1794,12 @@ bool AppInitMain(NodeContext& node)
     if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
         LogPrintf("* Using %.1f MiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
     }
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        LogPrintf("* Using %.1f MiB for address index database\n", address_index_cache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+        LogPrintf("* Using %.1f MiB for spent output index database\n", spent_index_cache * (1.0 / 1024 / 1024));
+    }
     for (BlockFilterType filter_type : g_enabled_filter_types) {
         LogPrintf("* Using %.1f MiB for %s block filter index database\n",
                   filter_index_cache * (1.0 / 1024 / 1024), BlockFilterTypeName(filter_type));
@@ -1542,6 +1808,7 @@ bool AppInitMain(NodeContext& node)
     LogPrintf("* Using %.1f MiB for in-memory UTXO set (plus up to %.1f MiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
+    bool verify_in_background = false;
     while (!fLoaded && !ShutdownRequested()) {
         bool fReset = fReindex;
         std::string strLoadError;
@@ -1680,7 +1947,9 @@ bool AppInitMain(NodeContext& node)
                         break;
                     }
 
-                    if (!CVerifyDB().VerifyDB(chainparams, &::ChainstateActive().CoinsDB(), gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL),
+                    if (gArgs.GetBoolArg("-asynccheckblocks", DEFAULT_ASYNC_CHECKBLOCKS)) {
+                        verify_in_background = true;
+                    } else if (!CVerifyDB().VerifyDB(chainparams, &::ChainstateActive().CoinsDB(), gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL),
                                   gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
                         strLoadError = _("Corrupted block database detected").translated;
                         break;
@@ -1732,11 +2001,34 @@ bool AppInitMain(NodeContext& node)
     fFeeEstimatesInitialized = true;
 
     // ********************************************************* Step 8: start indexers
+    g_index_sync_threads = std::max(0, std::min<int>(gArgs.GetArg("-indexsyncthreads", DEFAULT_INDEX_SYNC_THREADS), MAX_INDEX_SYNC_THREADS));
     if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
         g_txindex = MakeUnique<TxIndex>(nTxIndexCache, false, fReindex);
         g_txindex->Start();
     }
 
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        g_addressindex = MakeUnique<AddressIndex>(address_index_cache, false, fReindex);
+        g_addressindex->Start();
+    }
+
+    if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+        g_spentindex = MakeUnique<SpentIndex>(spent_index_cache, false, fReindex);
+        g_spentindex->Start();
+    }
+
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        // The index holds a single small entry per block, so it doesn't get a share of -dbcache.
+        g_coin_stats_index = MakeUnique<CoinStatsIndex>(/* cache size */ 0, false, fReindex);
+        g_coin_stats_index->Start();
+    }
+
+    if (gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX)) {
+        // Like the coinstats index, it holds a single small entry per block.
+        g_block_stats_index = MakeUnique<BlockStatsIndex>(/* cache size */ 0, false, fReindex);
+        g_block_stats_index->Start();
+    }
+
     for (const auto& filter_type : g_enabled_filter_types) {
         InitBlockFilterIndex(filter_type, filter_index_cache, false, fReindex);
         GetBlockFilterIndex(filter_type)->Start();
@@ -1800,6 +2092,15 @@ bool AppInitMain(NodeContext& node)
 
     threadGroup.create_thread(std::bind(&ThreadImport, vImportFiles));
 
+    if (!g_blocks_cold_dir.empty()) {
+        threadGroup.create_thread(&ThreadMigrateBlockFiles);
+    }
+
+    if (gArgs.GetBoolArg("-asyncblockvalidation", DEFAULT_ASYNC_BLOCK_VALIDATION)) {
+        LogPrintf("Blocks from peers are connected on the block validation thread\n");
+        StartBlockValidationThread(chainparams);
+    }
+
     // Wait for genesis block to be processed
     {
         WAIT_LOCK(g_genesis_wait_mutex, lock);
@@ -1857,6 +2158,20 @@ bool AppInitMain(NodeContext& node)
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
     connOptions.m_peer_connect_timeout = peer_connect_timeout;
 
+    connOptions.m_send_coalesce = gArgs.GetBoolArg("-sendcoalesce", DEFAULT_SEND_COALESCE);
+    const int64_t udp_relay_port = gArgs.GetArg("-udprelayport", DEFAULT_UDPRELAY_PORT);
+    if (udp_relay_port < 0 || udp_relay_port > 65535) {
+        return InitError(strprintf(_("Invalid port specified in %s: '%s'").translated, "-udprelayport", gArgs.GetArg("-udprelayport", "")));
+    }
+    connOptions.m_udp_relay_port = udp_relay_port;
+    connOptions.m_msghandler_threads = std::max(0, std::min<int>(gArgs.GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS), MAX_MSGHANDLER_THREADS));
+    if (gArgs.IsArgSet("-netevents")) {
+        const std::string net_events = gArgs.GetArg("-netevents", "");
+        if (!ParseNetEventsMode(net_events, connOptions.m_net_events)) {
+            return InitError(strprintf(_("Unsupported -netevents backend '%s'. Available: %s").translated, net_events, AvailableNetEventsModes()));
+        }
+    }
+
     for (const std::string& strBind : gArgs.GetArgs("-bind")) {
         CService addrBind;
         if (!Lookup(strBind, addrBind, GetListenPort(), false)) {
@@ -1897,6 +2212,12 @@ bool AppInitMain(NodeContext& node)
     SetRPCWarmupFinished();
     uiInterface.InitMessage(_("Done loading").translated);
 
+    if (verify_in_background) {
+        const int check_level = gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL);
+        const int check_blocks = gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS);
+        threadGroup.create_thread([&chainparams, check_level, check_blocks] { ThreadVerifyDB(chainparams, check_level, check_blocks); });
+    }
+
     for (const auto& client : node.chain_clients) {
         client->start(*node.scheduler);
     }
@@ -1904,7 +2225,7 @@ bool AppInitMain(NodeContext& node)
     BanMan* banman = node.banman.get();
     node.scheduler->scheduleEvery([banman]{
         banman->DumpBanlist();
-    }, DUMP_BANS_INTERVAL);
+    }, DUMP_BANS_INTERVAL, "dumpbanlist");
 
     return true;
 }
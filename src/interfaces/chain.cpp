@@ -4,8 +4,10 @@
 
 #include <interfaces/chain.h>
 
+#include <blockfilter.h>
 #include <chain.h>
 #include <chainparams.h>
+#include <index/blockfilterindex.h>
 #include <interfaces/handler.h>
 #include <interfaces/wallet.h>
 #include <net.h>
@@ -154,11 +156,12 @@ public:
     explicit NotificationsProxy(std::shared_ptr<Chain::Notifications> notifications)
         : m_notifications(std::move(notifications)) {}
     virtual ~NotificationsProxy() = default;
-    void TransactionAddedToMempool(const CTransactionRef& tx) override
+    std::string GetValidationQueueName() const override { return "wallet"; }
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override
     {
         m_notifications->transactionAddedToMempool(tx);
     }
-    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason) override
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) override
     {
         m_notifications->transactionRemovedFromMempool(tx, reason);
     }
@@ -268,6 +271,33 @@ public:
         }
         return true;
     }
+    bool hasBlockFilterIndex(BlockFilterType filter_type) override
+    {
+        return GetBlockFilterIndex(filter_type) != nullptr;
+    }
+    bool blockFiltersMatchAny(BlockFilterType filter_type,
+        int start_height,
+        const uint256& stop_hash,
+        const GCSFilter::ElementSet& filter_set,
+        std::vector<bool>& matches) override
+    {
+        const BlockFilterIndex* index = GetBlockFilterIndex(filter_type);
+        if (!index) return false;
+        const CBlockIndex* stop_index;
+        {
+            LOCK(cs_main);
+            stop_index = LookupBlockIndex(stop_hash);
+        }
+        std::vector<BlockFilter> filters;
+        if (!stop_index || !index->LookupFilterRange(start_height, stop_index, filters)) return false;
+        std::vector<const GCSFilter*> gcs_filters;
+        gcs_filters.reserve(filters.size());
+        for (const BlockFilter& filter : filters) {
+            gcs_filters.push_back(&filter.GetFilter());
+        }
+        matches = GCSFilter::MatchAny(gcs_filters, filter_set);
+        return true;
+    }
     void findCoins(std::map<COutPoint, Coin>& coins) override { return FindCoins(m_node, coins); }
     double guessVerificationProgress(const uint256& block_hash) override
     {
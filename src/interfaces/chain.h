@@ -5,6 +5,7 @@
 #ifndef PALLADIUM_INTERFACES_CHAIN_H
 #define PALLADIUM_INTERFACES_CHAIN_H
 
+#include <blockfilter.h>             // For BlockFilterType and GCSFilter::ElementSet
 #include <optional.h>               // For Optional and nullopt
 #include <primitives/transaction.h> // For CTransactionRef
 
@@ -137,6 +138,18 @@ public:
         int64_t* time = nullptr,
         int64_t* max_time = nullptr) = 0;
 
+    //! Return whether a block filter index of the given type is running.
+    virtual bool hasBlockFilterIndex(BlockFilterType filter_type) = 0;
+
+    //! Test the filters of the blocks from start_height up to the block with
+    //! hash stop_hash against filter_set, setting one entry of matches per
+    //! block. Returns false if the filters are not all indexed yet.
+    virtual bool blockFiltersMatchAny(BlockFilterType filter_type,
+        int start_height,
+        const uint256& stop_hash,
+        const GCSFilter::ElementSet& filter_set,
+        std::vector<bool>& matches) = 0;
+
     //! Look up unspent output information. Returns coins in the mempool and in
     //! the current chain UTXO set. Iterates through all the keys in the map and
     //! populates the values.
@@ -290,15 +290,21 @@ public:
         }
         return {};
     }
-    std::vector<WalletTx> getWalletTxs() override
+    std::vector<WalletTx> getWalletTxs(int64_t& order_pos, size_t count) override
     {
         auto locked_chain = m_wallet->chain().lock();
         LOCK(m_wallet->cs_wallet);
         std::vector<WalletTx> result;
-        result.reserve(m_wallet->mapWallet.size());
-        for (const auto& entry : m_wallet->mapWallet) {
-            result.emplace_back(MakeWalletTx(*m_wallet, entry.second));
-        }
+        const int64_t max_order_pos = order_pos;
+        order_pos = -1;
+        m_wallet->ForEachOrderedTx(max_order_pos, nullptr, [&](const CWalletTx& wtx) EXCLUSIVE_LOCKS_REQUIRED(m_wallet->cs_wallet) {
+            if (result.size() == count) {
+                order_pos = wtx.nOrderPos;
+                return false;
+            }
+            result.emplace_back(MakeWalletTx(*m_wallet, wtx));
+            return true;
+        });
         return result;
     }
     bool tryGetTxStatus(const uint256& txid,
@@ -175,8 +175,10 @@ public:
     //! Get transaction information.
     virtual WalletTx getWalletTx(const uint256& txid) = 0;
 
-    //! Get list of all wallet transactions.
-    virtual std::vector<WalletTx> getWalletTxs() = 0;
+    //! Get up to count wallet transactions at order positions up to
+    //! order_pos, newest first, and set order_pos to where the next page
+    //! starts, or to -1 if there are no older transactions.
+    virtual std::vector<WalletTx> getWalletTxs(int64_t& order_pos, size_t count) = 0;
 
     //! Try to get updated status for a particular transaction, if possible without blocking.
     virtual bool tryGetTxStatus(const uint256& txid,
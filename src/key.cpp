@@ -298,6 +298,40 @@ bool CExtKey::Derive(CExtKey &out, unsigned int _nChild) const {
     return key.Derive(out.key, out.chaincode, _nChild, chaincode);
 }
 
+bool CExtKey::DeriveMany(std::vector<CExtKey>& out, unsigned int first, size_t count) const {
+    out.resize(count);
+    if (count == 0) return true;
+    assert(key.IsValid());
+    assert(key.IsCompressed());
+    const unsigned int last = first + (count - 1);
+    assert(last >= first && (first >> 31) == (last >> 31));
+    const CPubKey pubkey = key.GetPubKey();
+    const CKeyID id = pubkey.GetID();
+    std::vector<unsigned char, secure_allocator<unsigned char>> vout(64 * count);
+    if ((first >> 31) == 0) {
+        BIP32HashMany(chaincode, first, count, *pubkey.begin(), pubkey.begin() + 1, vout.data());
+    } else {
+        BIP32HashMany(chaincode, first, count, 0, key.begin(), vout.data());
+    }
+    bool ret = true;
+    std::vector<unsigned char, secure_allocator<unsigned char>> child_key(32);
+    for (size_t i = 0; i < count; ++i) {
+        CExtKey& child = out[i];
+        child.nDepth = nDepth + 1;
+        memcpy(&child.vchFingerprint[0], &id, 4);
+        child.nChild = first + i;
+        memcpy(child.chaincode.begin(), vout.data() + 64 * i + 32, 32);
+        memcpy(child_key.data(), key.begin(), 32);
+        if (secp256k1_ec_privkey_tweak_add(secp256k1_context_sign, child_key.data(), vout.data() + 64 * i)) {
+            child.key.Set(child_key.begin(), child_key.end(), true);
+        } else {
+            child.key = CKey();
+            ret = false;
+        }
+    }
+    return ret;
+}
+
 void CExtKey::SetSeed(const unsigned char *seed, unsigned int nSeedLen) {
     static const unsigned char hashkey[] = {'B','i','t','c','o','i','n',' ','s','e','e','d'};
     std::vector<unsigned char, secure_allocator<unsigned char>> vout(64);
@@ -160,6 +160,12 @@ struct CExtKey {
     void Encode(unsigned char code[BIP32_EXTKEY_SIZE]) const;
     void Decode(const unsigned char code[BIP32_EXTKEY_SIZE]);
     bool Derive(CExtKey& out, unsigned int nChild) const;
+    /** Derive the count children first, first + 1, ... into out, which is
+     *  like calling Derive for each of them, but computes the parent's
+     *  public key and fingerprint once and batches the HMACs. The children
+     *  must be all hardened or all not. Returns false if any derivation
+     *  failed, leaving that child's key invalid. */
+    bool DeriveMany(std::vector<CExtKey>& out, unsigned int first, size_t count) const;
     CExtPubKey Neuter() const;
     void SetSeed(const unsigned char* seed, unsigned int nSeedLen);
 };
@@ -7,10 +7,15 @@
 #include <util/threadnames.h>
 #include <util/time.h>
 
+#include <chrono>
 #include <mutex>
 
 const char * const DEFAULT_DEBUGLOGFILE = "debug.log";
 
+/** How long the asynchronous writer lets messages gather after the first one, unless this many bytes come in first */
+static constexpr std::chrono::milliseconds LOGASYNC_BATCH_INTERVAL{10};
+static constexpr size_t LOGASYNC_BATCH_SIZE = 64 << 10;
+
 BCLog::Logger& LogInstance()
 {
 /**
@@ -78,8 +83,76 @@ bool BCLog::Logger::StartLogging()
     return true;
 }
 
+void BCLog::Logger::StartAsync()
+{
+    std::lock_guard<std::mutex> scoped_lock(m_cs);
+    if (m_async) return;
+    m_async = true;
+    m_async_thread = std::thread(&BCLog::Logger::AsyncWriterThread, this);
+}
+
+void BCLog::Logger::FlushAsync()
+{
+    std::unique_lock<std::mutex> lock(m_cs);
+    const uint64_t queued = m_async_queued;
+    m_async_flush = true;
+    m_async_cond.notify_one();
+    m_async_written_cond.wait(lock, [&] { return !m_async || m_async_written >= queued; });
+}
+
+void BCLog::Logger::StopAsync()
+{
+    {
+        std::lock_guard<std::mutex> scoped_lock(m_cs);
+        if (!m_async) return;
+        m_async_stop = true;
+    }
+    m_async_cond.notify_one();
+    m_async_thread.join();
+    std::lock_guard<std::mutex> scoped_lock(m_cs);
+    m_async_stop = false;
+}
+
+void BCLog::Logger::AsyncWriterThread()
+{
+    util::ThreadRename("logger");
+    std::vector<std::string> batch;
+    std::string out;
+    std::unique_lock<std::mutex> lock(m_cs);
+    while (true) {
+        m_async_cond.wait(lock, [this] { return !m_async_queue.empty() || m_async_dropped > 0 || m_async_stop || m_async_flush; });
+        // Let more messages come in, so that they are written in one go.
+        m_async_cond.wait_for(lock, LOGASYNC_BATCH_INTERVAL, [this] { return m_async_queue_bytes >= LOGASYNC_BATCH_SIZE || m_async_stop || m_async_flush; });
+        m_async_flush = false;
+        if (m_async_stop && m_async_queue.empty() && m_async_dropped == 0) {
+            // Stopping. Later messages are written synchronously again.
+            m_async = false;
+            m_async_written_cond.notify_all();
+            return;
+        }
+        batch.swap(m_async_queue);
+        m_async_queue_bytes = 0;
+        const uint64_t dropped = m_async_dropped;
+        m_async_dropped = 0;
+        const uint64_t queued = m_async_queued;
+        lock.unlock();
+
+        // Write the whole batch at once, the file is unbuffered.
+        out.clear();
+        for (const std::string& str : batch) out += str;
+        if (dropped > 0) out += strprintf("[%u log messages dropped, the asynchronous log writer fell behind]\n", dropped);
+        if (!out.empty()) WriteOutputs(out);
+        batch.clear();
+
+        lock.lock();
+        m_async_written = queued;
+        m_async_written_cond.notify_all();
+    }
+}
+
 void BCLog::Logger::DisconnectTestLogger()
 {
+    StopAsync();
     std::lock_guard<std::mutex> scoped_lock(m_cs);
     m_buffering = true;
     if (m_fileout != nullptr) fclose(m_fileout);
@@ -221,7 +294,11 @@ std::string BCLog::Logger::LogTimestampStr(const std::string& str)
 
     if (m_started_new_line) {
         int64_t nTimeMicros = GetTimeMicros();
-        strStamped = FormatISO8601DateTime(nTimeMicros/1000000);
+        if (nTimeMicros / 1000000 != m_last_timestamp_secs) {
+            m_last_timestamp_secs = nTimeMicros / 1000000;
+            m_last_timestamp_str = FormatISO8601DateTime(m_last_timestamp_secs);
+        }
+        strStamped = m_last_timestamp_str;
         if (m_log_time_micros) {
             strStamped.pop_back();
             strStamped += strprintf(".%06dZ", nTimeMicros%1000000);
@@ -278,14 +355,37 @@ void BCLog::Logger::LogPrintStr(const std::string& str)
         return;
     }
 
+    for (const auto& cb : m_print_callbacks) {
+        cb(str_prefixed);
+    }
+
+    if (m_async) {
+        if (!m_print_to_console && !m_print_to_file) return;
+        if (m_async_queue_bytes + str_prefixed.size() > MAX_LOGASYNC_BUFFER) {
+            ++m_async_dropped;
+            return;
+        }
+        const size_t size = str_prefixed.size();
+        m_async_queue_bytes += size;
+        m_async_queue.push_back(std::move(str_prefixed));
+        ++m_async_queued;
+        // The writer takes the whole queue when it runs, so it only has to
+        // be woken for the first message and when a batch is full.
+        if (m_async_queue.size() == 1 || (m_async_queue_bytes >= LOGASYNC_BATCH_SIZE && m_async_queue_bytes - size < LOGASYNC_BATCH_SIZE)) {
+            m_async_cond.notify_one();
+        }
+        return;
+    }
+    WriteOutputs(str_prefixed);
+}
+
+void BCLog::Logger::WriteOutputs(const std::string& str)
+{
     if (m_print_to_console) {
         // print to console
-        fwrite(str_prefixed.data(), 1, str_prefixed.size(), stdout);
+        fwrite(str.data(), 1, str.size(), stdout);
         fflush(stdout);
     }
-    for (const auto& cb : m_print_callbacks) {
-        cb(str_prefixed);
-    }
     if (m_print_to_file) {
         assert(m_fileout != nullptr);
 
@@ -299,7 +399,7 @@ void BCLog::Logger::LogPrintStr(const std::string& str)
                 m_fileout = new_fileout;
             }
         }
-        FileWriteStr(str_prefixed, m_fileout);
+        FileWriteStr(str, m_fileout);
     }
 }
 
@@ -10,16 +10,21 @@
 #include <tinyformat.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <cstdint>
 #include <list>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS        = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
 static const bool DEFAULT_LOGTHREADNAMES = false;
+static const bool DEFAULT_LOGASYNC = false;
+/** Maximum size of the log messages waiting for the asynchronous writer, beyond which new messages are dropped */
+static const size_t MAX_LOGASYNC_BUFFER = 16 << 20;
 extern const char * const DEFAULT_DEBUGLOGFILE;
 
 extern bool fLogIPs;
@@ -76,11 +81,39 @@ namespace BCLog {
         /** Log categories bitfield. */
         std::atomic<uint32_t> m_categories{0};
 
+        /** Seconds part of the last timestamp, formatting it takes longer than writing the message */
+        int64_t m_last_timestamp_secs{-1};         // GUARDED_BY(m_cs)
+        std::string m_last_timestamp_str;          // GUARDED_BY(m_cs)
+
         std::string LogTimestampStr(const std::string& str);
 
         /** Slots that connect to the print signal */
         std::list<std::function<void(const std::string&)>> m_print_callbacks /* GUARDED_BY(m_cs) */ {};
 
+        /**
+         * Asynchronous writer state. While m_async is set, messages for the
+         * console and the log file are queued in m_async_queue and written
+         * by m_async_thread, so callers don't wait for the disk. The writer
+         * thread then owns m_fileout.
+         */
+        bool m_async{false};                       // GUARDED_BY(m_cs)
+        bool m_async_stop{false};                  // GUARDED_BY(m_cs)
+        bool m_async_flush{false};                 // GUARDED_BY(m_cs)
+        std::vector<std::string> m_async_queue;    // GUARDED_BY(m_cs)
+        size_t m_async_queue_bytes{0};             // GUARDED_BY(m_cs)
+        //! Messages dropped because the queue was full, since the writer last ran
+        uint64_t m_async_dropped{0};               // GUARDED_BY(m_cs)
+        //! Number of messages queued and written, to let FlushAsync() wait for the messages before it
+        uint64_t m_async_queued{0};                // GUARDED_BY(m_cs)
+        uint64_t m_async_written{0};               // GUARDED_BY(m_cs)
+        std::condition_variable m_async_cond;
+        std::condition_variable m_async_written_cond;
+        std::thread m_async_thread;
+
+        /** Write to the console and the log file */
+        void WriteOutputs(const std::string& str);
+        void AsyncWriterThread();
+
     public:
         bool m_print_to_console = false;
         bool m_print_to_file = false;
@@ -119,6 +152,19 @@ namespace BCLog {
 
         /** Start logging (and flush all buffered messages) */
         bool StartLogging();
+
+        /**
+         * Write to the console and the log file on a background thread. Log
+         * calls then only format and queue their message. When more than
+         * MAX_LOGASYNC_BUFFER bytes are waiting, messages are dropped and
+         * a note with their number is written instead.
+         */
+        void StartAsync();
+        /** Wait until all messages logged so far are written */
+        void FlushAsync();
+        /** Write the remaining messages and go back to writing synchronously */
+        void StopAsync();
+
         /** Only for testing */
         void DisconnectTestLogger();
 
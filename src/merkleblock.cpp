@@ -8,6 +8,7 @@
 #include <hash.h>
 #include <consensus/consensus.h>
 
+#include <algorithm>
 
 CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids)
 {
@@ -36,6 +37,25 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std:
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+MerkleTreeLevels ComputeMerkleTreeLevels(std::vector<uint256> txids)
+{
+    assert(!txids.empty());
+    MerkleTreeLevels levels;
+    levels.push_back(std::move(txids));
+    while (levels.back().size() > 1) {
+        const std::vector<uint256>& below = levels.back();
+        std::vector<uint256> level;
+        level.reserve((below.size() + 1) / 2);
+        for (size_t pos = 0; pos < below.size(); pos += 2) {
+            const uint256& left = below[pos];
+            const uint256& right = pos + 1 < below.size() ? below[pos + 1] : left;
+            level.push_back(Hash(left.begin(), left.end(), right.begin(), right.end()));
+        }
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+
 uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid) {
     //we can never have zero txs in a merkle block, we always need the coinbase tx
     //if we do not have this assert, we can hit a memory access violation when indexing into vTxid
@@ -74,6 +94,20 @@ void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const st
     }
 }
 
+void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const MerkleTreeLevels& levels, const std::vector<unsigned int>& matched_positions) {
+    // this node is the parent of a matched txid if one of them is in its range of leaves
+    const auto first_match = std::lower_bound(matched_positions.begin(), matched_positions.end(), pos << height);
+    const bool fParentOfMatch = first_match != matched_positions.end() && *first_match < ((pos + 1) << height);
+    vBits.push_back(fParentOfMatch);
+    if (height==0 || !fParentOfMatch) {
+        vHash.push_back(levels[height][pos]);
+    } else {
+        TraverseAndBuild(height-1, pos*2, levels, matched_positions);
+        if (pos*2+1 < CalcTreeWidth(height-1))
+            TraverseAndBuild(height-1, pos*2+1, levels, matched_positions);
+    }
+}
+
 uint256 CPartialMerkleTree::TraverseAndExtract(int height, unsigned int pos, unsigned int &nBitsUsed, unsigned int &nHashUsed, std::vector<uint256> &vMatch, std::vector<unsigned int> &vnIndex) {
     if (nBitsUsed >= vBits.size()) {
         // overflowed the bits array - failure
@@ -126,6 +160,11 @@ CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const
     TraverseAndBuild(nHeight, 0, vTxid, vMatch);
 }
 
+CPartialMerkleTree::CPartialMerkleTree(const MerkleTreeLevels& levels, const std::vector<unsigned int>& matched_positions) : nTransactions(levels.front().size()), fBad(false) {
+    // the top level holds the root only
+    TraverseAndBuild(levels.size() - 1, 0, levels, matched_positions);
+}
+
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
 
 uint256 CPartialMerkleTree::ExtractMatches(std::vector<uint256> &vMatch, std::vector<unsigned int> &vnIndex) {
@@ -13,6 +13,16 @@
 
 #include <vector>
 
+/**
+ * The hashes of all the nodes of the merkle tree of a block, by level from
+ * the txids up to the root. An odd node at the end of a level is paired with
+ * itself, as in the merkle root computation.
+ */
+using MerkleTreeLevels = std::vector<std::vector<uint256>>;
+
+/** Compute the levels of the merkle tree of a block with the given (at least one) txids. */
+MerkleTreeLevels ComputeMerkleTreeLevels(std::vector<uint256> txids);
+
 /** Data structure that represents a partial merkle tree.
  *
  * It represents a subset of the txid's of a known block, in a way that
@@ -73,6 +83,9 @@ protected:
     /** recursive function that traverses tree nodes, storing the data as bits and hashes */
     void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    /** same, taking the hashes from the levels of the full tree and the matches from their sorted positions */
+    void TraverseAndBuild(int height, unsigned int pos, const MerkleTreeLevels& levels, const std::vector<unsigned int>& matched_positions);
+
     /**
      * recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
      * it returns the hash of the respective node and its respective index.
@@ -107,6 +120,12 @@ public:
     /** Construct a partial merkle tree from a list of transaction ids, and a mask that selects a subset of them */
     CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    /**
+     * Construct a partial merkle tree from the levels of the full tree and the sorted positions of
+     * the matched txids. This only costs lookups along the paths to the matches, not any hashing.
+     */
+    CPartialMerkleTree(const MerkleTreeLevels& levels, const std::vector<unsigned int>& matched_positions);
+
     CPartialMerkleTree();
 
     /**
@@ -155,6 +174,10 @@ public:
     // Create from a CBlock, matching the txids in the set
     CMerkleBlock(const CBlock& block, const std::set<uint256>& txids) : CMerkleBlock(block, nullptr, &txids) { }
 
+    // Create from a block header and the merkle tree levels of the block, matching the txids at the sorted positions
+    CMerkleBlock(const CBlockHeader& block_header, const MerkleTreeLevels& levels, const std::vector<unsigned int>& matched_positions)
+        : header(block_header), txn(levels, matched_positions) { }
+
     CMerkleBlock() {}
 
     ADD_SERIALIZE_METHODS;
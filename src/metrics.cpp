@@ -0,0 +1,179 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <httprpc.h>
+#include <httpserver.h>
+#include <net.h>
+#include <node/context.h>
+#include <rpc/blockchain.h>
+#include <rpc/protocol.h>
+#include <script/sigcache.h>
+#include <sync.h>
+#include <tinyformat.h>
+#include <txmempool.h>
+#include <util/perfstats.h>
+#include <validation.h>
+
+#include <map>
+#include <string>
+
+// The /metrics endpoint serves node statistics in the Prometheus text
+// exposition format. Everything here comes from counters the node keeps up
+// to date anyway (TipSnapshot, the published coins cache figures, perf
+// histograms), so a scrape never takes cs_main; the mempool and peer figures
+// only take the mempool and node list locks.
+
+namespace {
+
+class MetricsWriter
+{
+public:
+    void Header(const std::string& name, const std::string& type, const std::string& help)
+    {
+        m_out += strprintf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    }
+
+    void Value(const std::string& name, const std::string& labels, const std::string& value)
+    {
+        m_out += name;
+        if (!labels.empty()) m_out += "{" + labels + "}";
+        m_out += " " + value + "\n";
+    }
+
+    void Metric(const std::string& name, const std::string& type, const std::string& help, int64_t value)
+    {
+        Header(name, type, help);
+        Value(name, "", strprintf("%d", value));
+    }
+
+    const std::string& str() const { return m_out; }
+
+private:
+    std::string m_out;
+};
+
+std::string Label(const std::string& key, const std::string& value)
+{
+    // Only message types and histogram names end up here; escape anyway.
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') escaped += '\\';
+        if (c == '\n') {
+            escaped += "\\n";
+            continue;
+        }
+        escaped += c;
+    }
+    return key + "=\"" + escaped + "\"";
+}
+
+std::string Seconds(int64_t micros)
+{
+    return strprintf("%d.%06d", micros / 1000000, micros % 1000000);
+}
+
+void WriteChainMetrics(MetricsWriter& out)
+{
+    const std::shared_ptr<const TipSnapshot> tip = GetTipSnapshot();
+    if (tip) {
+        out.Metric("palladium_chain_height", "gauge", "Height of the active chain tip", tip->height);
+        out.Metric("palladium_chain_header_height", "gauge", "Height of the best known header", tip->header_height);
+        out.Metric("palladium_chain_tip_time_seconds", "gauge", "Timestamp of the active chain tip", tip->block_time);
+        out.Metric("palladium_chain_tip_median_time_seconds", "gauge", "Median time past of the active chain tip", tip->median_time);
+    }
+
+    const CoinsCacheStats coins = GetCoinsCacheStats();
+    out.Metric("palladium_coins_cache_usage_bytes", "gauge", "Memory used by the coins cache", coins.usage);
+    out.Metric("palladium_coins_cache_limit_bytes", "gauge", "Coins cache size limit (-dbcache)", coins.max_usage);
+    out.Metric("palladium_coins_cache_entries", "gauge", "Coins held in the coins cache", coins.entries);
+    out.Metric("palladium_coins_cache_hits_total", "counter", "Coin lookups answered by the coins cache", coins.tip.hits);
+    out.Metric("palladium_coins_cache_misses_total", "counter", "Coin lookups the coins cache passed to the coin database", coins.tip.misses);
+    out.Metric("palladium_coins_cache_insertions_total", "counter", "Coins added to the coins cache", coins.tip.insertions);
+    out.Metric("palladium_coins_cache_evictions_total", "counter", "Coins dropped from the coins cache by flushes", coins.tip.evictions);
+    out.Metric("palladium_coins_db_reads_total", "counter", "Coins looked up in the coin database", coins.db_reads);
+    out.Metric("palladium_coins_db_found_total", "counter", "Coins looked up in the coin database that were there", coins.db_found);
+    out.Metric("palladium_coins_flushes_total", "counter", "Flushes of the coins cache to the coin database", coins.flushes);
+    out.Header("palladium_coins_last_flush_duration_seconds", "gauge", "Duration of the last coins cache flush");
+    out.Value("palladium_coins_last_flush_duration_seconds", "", Seconds(coins.last_flush_duration));
+
+    const SignatureCacheStats sigcache = GetSignatureCacheStats();
+    out.Metric("palladium_sigcache_contended_reads_total", "counter", "Signature cache lookups that waited for an insertion into the same shard", sigcache.contended_reads);
+    out.Metric("palladium_sigcache_contended_writes_total", "counter", "Signature cache insertions that waited for another thread using the same shard", sigcache.contended_writes);
+}
+
+void WriteMempoolMetrics(MetricsWriter& out, const CTxMemPool& pool)
+{
+    LOCK(pool.cs);
+    out.Metric("palladium_mempool_transactions", "gauge", "Transactions in the mempool", pool.size());
+    out.Metric("palladium_mempool_vsize_bytes", "gauge", "Sum of the virtual sizes of mempool transactions", pool.GetTotalTxSize());
+    out.Metric("palladium_mempool_usage_bytes", "gauge", "Memory used by the mempool", pool.DynamicMemoryUsage());
+    out.Metric("palladium_mempool_fees_satoshis", "gauge", "Sum of the fees of mempool transactions", pool.GetTotalFee());
+}
+
+void WriteNetMetrics(MetricsWriter& out, CConnman& connman)
+{
+    out.Header("palladium_peers", "gauge", "Connected peers");
+    out.Value("palladium_peers", Label("direction", "inbound"), strprintf("%d", connman.GetNodeCount(CConnman::CONNECTIONS_IN)));
+    out.Value("palladium_peers", Label("direction", "outbound"), strprintf("%d", connman.GetNodeCount(CConnman::CONNECTIONS_OUT)));
+
+    std::map<std::string, uint64_t> recv, sent;
+    connman.GetBytesPerMsgType(recv, sent);
+    out.Header("palladium_net_received_bytes_total", "counter", "Bytes received from peers, by message type");
+    for (const auto& type : recv) {
+        out.Value("palladium_net_received_bytes_total", Label("type", type.first), strprintf("%d", type.second));
+    }
+    out.Header("palladium_net_sent_bytes_total", "counter", "Bytes sent to peers, by message type");
+    for (const auto& type : sent) {
+        out.Value("palladium_net_sent_bytes_total", Label("type", type.first), strprintf("%d", type.second));
+    }
+}
+
+void WriteLatencyMetrics(MetricsWriter& out)
+{
+    const std::string name = "palladium_latency_seconds";
+    out.Header(name, "histogram", "Time spent on hot paths (see getperfstats)");
+    for (const auto& entry : perf::GetAllStats()) {
+        const perf::HistogramStats& stats = entry.second;
+        const std::string path = Label("path", entry.first);
+        // Prometheus buckets are cumulative; stop at the first one that holds everything.
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket + 1 < stats.buckets.size() && seen < stats.count; ++bucket) {
+            seen += stats.buckets[bucket];
+            out.Value(name + "_bucket", path + "," + Label("le", Seconds(perf::Histogram::BucketLimit(bucket))), strprintf("%d", seen));
+        }
+        out.Value(name + "_bucket", path + "," + Label("le", "+Inf"), strprintf("%d", stats.count));
+        out.Value(name + "_sum", path, Seconds(stats.total));
+        out.Value(name + "_count", path, strprintf("%d", stats.count));
+    }
+}
+
+bool metrics_handler(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (req->GetRequestMethod() != HTTPRequest::GET) {
+        req->WriteReply(HTTP_BAD_METHOD, "Only GET is supported\r\n");
+        return false;
+    }
+
+    MetricsWriter out;
+    WriteChainMetrics(out);
+    if (g_rpc_node && g_rpc_node->mempool) WriteMempoolMetrics(out, *g_rpc_node->mempool);
+    if (g_rpc_node && g_rpc_node->connman) WriteNetMetrics(out, *g_rpc_node->connman);
+    WriteLatencyMetrics(out);
+
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, out.str());
+    return true;
+}
+
+} // namespace
+
+void StartMetrics()
+{
+    RegisterHTTPHandler("/metrics", true, metrics_handler);
+}
+
+void StopMetrics()
+{
+    UnregisterHTTPHandler("/metrics", true);
+}
@@ -6,6 +6,7 @@
 #include <miner.h>
 
 #include <amount.h>
+#include <arith_uint256.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <coins.h>
@@ -13,15 +14,20 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <node/args_snapshot.h>
+#include <node/merkle.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <pow.h>
 #include <primitives/transaction.h>
+#include <shutdown.h>
 #include <timedata.h>
-#include <util/moneystr.h>
 #include <util/system.h>
 
 #include <algorithm>
+#include <array>
+#include <limits>
+#include <thread>
 #include <utility>
 
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
@@ -58,13 +64,8 @@ static BlockAssembler::Options DefaultOptions()
     // Block resource limits
     // If -blockmaxweight is not given, limit to DEFAULT_BLOCK_MAX_WEIGHT
     BlockAssembler::Options options;
-    options.nBlockMaxWeight = gArgs.GetArg("-blockmaxweight", DEFAULT_BLOCK_MAX_WEIGHT);
-    CAmount n = 0;
-    if (gArgs.IsArgSet("-blockmintxfee") && ParseMoney(gArgs.GetArg("-blockmintxfee", ""), n)) {
-        options.blockMinFeeRate = CFeeRate(n);
-    } else {
-        options.blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
-    }
+    options.nBlockMaxWeight = GetArgsSnapshot().block_max_weight;
+    options.blockMinFeeRate = GetArgsSnapshot().block_min_fee_rate;
     return options;
 }
 
@@ -85,8 +86,25 @@ void BlockAssembler::resetBlock()
     nFees = 0;
 }
 
-Optional<int64_t> BlockAssembler::m_last_block_num_txs{nullopt};
-Optional<int64_t> BlockAssembler::m_last_block_weight{nullopt};
+/** Set the coinbase of a template, paying the subsidy and nFees to scriptPubKeyIn. */
+static void FillCoinbase(CBlockTemplate& tmpl, const CScript& scriptPubKeyIn, const CBlockIndex* pindexPrev, CAmount nFees, const Consensus::Params& consensusParams)
+{
+    const int nHeight = pindexPrev->nHeight + 1;
+    CMutableTransaction coinbaseTx;
+    coinbaseTx.vin.resize(1);
+    coinbaseTx.vin[0].prevout.SetNull();
+    coinbaseTx.vout.resize(1);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, consensusParams);
+    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+    tmpl.block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    tmpl.vchCoinbaseCommitment = GenerateCoinbaseCommitment(tmpl.block, pindexPrev, consensusParams);
+    tmpl.vTxFees[0] = -nFees;
+    tmpl.vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*tmpl.block.vtx[0]);
+}
+
+std::atomic<int64_t> BlockAssembler::m_last_block_num_txs{-1};
+std::atomic<int64_t> BlockAssembler::m_last_block_weight{-1};
 
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
 {
@@ -136,24 +154,18 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    if (m_mempool.GetTrackClusters()) {
+        addChunks(nPackagesSelected);
+    } else {
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
     m_last_block_num_txs = nBlockTx;
     m_last_block_weight = nBlockWeight;
 
-    // Create coinbase transaction.
-    CMutableTransaction coinbaseTx;
-    coinbaseTx.vin.resize(1);
-    coinbaseTx.vin[0].prevout.SetNull();
-    coinbaseTx.vout.resize(1);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
-    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
-    pblocktemplate->vTxFees[0] = -nFees;
+    FillCoinbase(*pblocktemplate, scriptPubKeyIn, pindexPrev, nFees, chainparams.GetConsensus());
 
     LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
 
@@ -162,7 +174,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
     pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
     pblock->nNonce         = 0;
-    pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+    pblocktemplate->vCoinbaseMerkleBranch = ParallelBlockMerkleBranch(*pblock, 0);
 
     BlockValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
@@ -224,7 +236,7 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     nFees += iter->GetFee();
     inBlock.insert(iter);
 
-    bool fPrintPriority = gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
+    bool fPrintPriority = GetArgsSnapshot().print_priority;
     if (fPrintPriority) {
         LogPrintf("fee %s txid %s\n",
                   CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(),
@@ -424,7 +436,151 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
-void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
+void BlockAssembler::addChunks(int& nPackagesSelected)
+{
+    // Chunks of a cluster have decreasing feerates and each only depends on
+    // the ones before it, so they come out of the mempool in a valid order
+    // and nothing needs to be recomputed as transactions are added.
+    std::set<const CTxMemPool::Cluster*> failed_clusters;
+
+    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+    int64_t nConsecutiveFailed = 0;
+
+    const CTxMemPool::setChunks& chunks = m_mempool.GetChunksByFeerate();
+    for (auto it = chunks.rbegin(); it != chunks.rend(); ++it) {
+        const CTxMemPool::Chunk& chunk = **it;
+        if (chunk.fee < blockMinFeeRate.GetFee(chunk.size)) {
+            // Everything else we might consider has a lower fee rate
+            return;
+        }
+
+        // Later chunks of a cluster depend on the ones that did not make it in.
+        if (failed_clusters.count(chunk.cluster)) continue;
+
+        const CTxMemPool::setEntries package(chunk.txs.begin(), chunk.txs.end());
+        if (!TestPackage(chunk.size, chunk.sigop_cost) || !TestPackageTransactions(package)) {
+            failed_clusters.insert(chunk.cluster);
+            ++nConsecutiveFailed;
+            if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockWeight >
+                    nBlockMaxWeight - 4000) {
+                // Give up if we're close to full and haven't succeeded in a while
+                break;
+            }
+            continue;
+        }
+
+        nConsecutiveFailed = 0;
+        for (CTxMemPool::txiter iter : chunk.txs) {
+            AddToBlock(iter);
+        }
+        ++nPackagesSelected;
+    }
+}
+
+BlockTemplateCache::BlockTemplateCache(const CTxMemPool& mempool, const CChainParams& params, int64_t rebuild_interval)
+    : m_mempool(mempool), m_chainparams(params), m_options(DefaultOptions()), m_rebuild_interval(rebuild_interval) {}
+
+void BlockTemplateCache::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence)
+{
+    LOCK(m_mutex);
+    if (!m_template) return;
+    if (m_pending.size() >= MAX_PENDING) {
+        m_stale = true;
+        return;
+    }
+    m_pending.push_back(tx);
+}
+
+void BlockTemplateCache::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence)
+{
+    LOCK(m_mutex);
+    if (m_in_template.count(tx->GetHash())) m_stale = true;
+}
+
+bool BlockTemplateCache::Extend()
+{
+    // Notifications are delivered asynchronously, so a removal may not have
+    // been reported yet: check that the template is still all in the mempool.
+    for (const uint256& txid : m_in_template) {
+        if (!m_mempool.exists(txid)) return false;
+    }
+
+    CBlock& block = m_template->block;
+    const int nHeight = m_prev->nHeight + 1;
+    const int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                                    ? m_prev->GetMedianTimePast()
+                                    : block.GetBlockTime();
+    const bool fIncludeWitness = IsWitnessEnabled(m_prev, m_chainparams.GetConsensus());
+    const size_t num_txs = block.vtx.size();
+    for (const CTransactionRef& tx : m_pending) {
+        if (m_in_template.count(tx->GetHash())) continue;
+        Optional<CTxMemPool::txiter> it = m_mempool.GetIter(tx->GetHash());
+        if (!it) continue;
+        const CTxMemPool::txiter iter = *it;
+        // Same checks as addPackageTxs, for a package of one: everything else
+        // it depends on is already in the block.
+        bool parents_in_template = true;
+        for (const CTxMemPoolEntry& parent : iter->GetMemPoolParentsConst()) {
+            parents_in_template &= m_in_template.count(parent.GetTx().GetHash()) > 0;
+        }
+        if (!parents_in_template) continue;
+        if (iter->GetModifiedFee() < m_options.blockMinFeeRate.GetFee(iter->GetTxSize())) continue;
+        if (m_weight + WITNESS_SCALE_FACTOR * iter->GetTxSize() >= m_options.nBlockMaxWeight) continue;
+        if (m_sigops_cost + iter->GetSigOpCost() >= MAX_BLOCK_SIGOPS_COST) continue;
+        if (!IsFinalTx(iter->GetTx(), nHeight, nLockTimeCutoff)) continue;
+        if (!fIncludeWitness && iter->GetTx().HasWitness()) continue;
+
+        block.vtx.emplace_back(iter->GetSharedTx());
+        m_template->vTxFees.push_back(iter->GetFee());
+        m_template->vTxSigOpsCost.push_back(iter->GetSigOpCost());
+        m_weight += iter->GetTxWeight();
+        m_sigops_cost += iter->GetSigOpCost();
+        m_fees += iter->GetFee();
+        m_in_template.insert(tx->GetHash());
+    }
+    m_pending.clear();
+    FillCoinbase(*m_template, m_script, m_prev, m_fees, m_chainparams.GetConsensus());
+    if (block.vtx.size() != num_txs) m_template->vCoinbaseMerkleBranch = ParallelBlockMerkleBranch(block, 0);
+    UpdateTime(&block, m_chainparams.GetConsensus(), m_prev);
+    return true;
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateCache::GetTemplate(const CScript& scriptPubKeyIn)
+{
+    LOCK2(cs_main, m_mempool.cs);
+    LOCK(m_mutex);
+    int64_t nTimeStart = GetTimeMicros();
+    if (m_template && !m_stale && m_prev == ::ChainActive().Tip() && m_script == scriptPubKeyIn &&
+        GetTime() - m_assembled < m_rebuild_interval) {
+        const size_t num_pending = m_pending.size();
+        if (Extend()) {
+            LogPrint(BCLog::BENCH, "BlockTemplateCache: extended template with %u new transactions to %u: %.2fms\n", num_pending, m_template->block.vtx.size(), 0.001 * (GetTimeMicros() - nTimeStart));
+            return MakeUnique<CBlockTemplate>(*m_template);
+        }
+    }
+
+    m_template = BlockAssembler(m_mempool, m_chainparams, m_options).CreateNewBlock(scriptPubKeyIn);
+    m_prev = ::ChainActive().Tip();
+    m_script = scriptPubKeyIn;
+    m_assembled = GetTime();
+    m_stale = false;
+    m_pending.clear();
+    m_in_template.clear();
+    // Same accounting as BlockAssembler::resetBlock and AddToBlock.
+    m_weight = 4000;
+    m_sigops_cost = 400;
+    m_fees = -m_template->vTxFees[0];
+    for (size_t i = 1; i < m_template->block.vtx.size(); ++i) {
+        m_weight += GetTransactionWeight(*m_template->block.vtx[i]);
+        m_sigops_cost += m_template->vTxSigOpsCost[i];
+        m_in_template.insert(m_template->block.vtx[i]->GetHash());
+    }
+    return MakeUnique<CBlockTemplate>(*m_template);
+}
+
+constexpr size_t BlockTemplateCache::MAX_PENDING;
+
+void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce, const std::vector<uint256>* coinbase_merkle_branch)
 {
     // Update nExtraNonce
     static uint256 hashPrevBlock;
@@ -440,5 +596,75 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
-    pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
+    if (coinbase_merkle_branch) {
+        pblock->hashMerkleRoot = ComputeMerkleRootFromBranch(pblock->vtx[0]->GetHash(), *coinbase_merkle_branch, 0);
+    } else {
+        pblock->hashMerkleRoot = ParallelBlockMerkleRoot(*pblock);
+    }
+}
+
+//! Nonces tried on the calling thread before starting more threads, enough for easy targets like regtest's.
+static constexpr uint32_t GRIND_SERIAL_NONCES = 1 << 12;
+//! Nonces claimed by a grinding thread at a time.
+static constexpr uint32_t GRIND_CHUNK_NONCES = 1 << 16;
+//! Headers hashed together.
+static constexpr size_t GRIND_BATCH = 64;
+
+//! The first nonce in [begin, end) for which header meets target, or end.
+static uint32_t GrindNonceRange(const CBlockHeader& header, const arith_uint256& target, uint32_t begin, uint32_t end)
+{
+    std::array<CBlockHeader, GRIND_BATCH> batch;
+    batch.fill(header);
+    std::array<uint256, GRIND_BATCH> hashes;
+    for (uint32_t nonce = begin; nonce < end;) {
+        const size_t count = std::min<uint64_t>(GRIND_BATCH, end - nonce);
+        for (size_t i = 0; i < count; ++i) batch[i].nNonce = nonce + i;
+        HashHeaders(Span<const CBlockHeader>(batch.data(), count), hashes.data());
+        for (size_t i = 0; i < count; ++i) {
+            if (UintToArith256(hashes[i]) <= target) return nonce + i;
+        }
+        nonce += count;
+    }
+    return end;
+}
+
+bool GrindBlockNonce(CBlockHeader& header, const Consensus::Params& consensusParams, uint64_t& max_tries, int threads)
+{
+    const uint32_t start = header.nNonce;
+    const uint32_t end = start + std::min<uint64_t>(max_tries, std::numeric_limits<uint32_t>::max() - start);
+
+    bool negative, overflow;
+    arith_uint256 target;
+    target.SetCompact(header.nBits, &negative, &overflow);
+    uint32_t found = end;
+    if (!negative && target != 0 && !overflow && target <= UintToArith256(consensusParams.powLimit)) {
+        const uint32_t serial_end = std::min<uint64_t>(end, uint64_t{start} + GRIND_SERIAL_NONCES);
+        found = GrindNonceRange(header, target, start, serial_end);
+        if (found == serial_end && serial_end < end) {
+            // Chunks are claimed in order and those below a nonce already
+            // found are still finished, so the lowest matching nonce wins.
+            std::atomic<uint64_t> next{serial_end};
+            std::atomic<uint32_t> best{end};
+            auto grind = [&] {
+                while (!ShutdownRequested()) {
+                    const uint64_t begin = next.fetch_add(GRIND_CHUNK_NONCES);
+                    if (begin >= best.load()) return;
+                    const uint32_t chunk_end = std::min<uint64_t>(end, begin + GRIND_CHUNK_NONCES);
+                    const uint32_t nonce = GrindNonceRange(header, target, begin, chunk_end);
+                    if (nonce == chunk_end) continue;
+                    uint32_t prev = best.load();
+                    while (nonce < prev && !best.compare_exchange_weak(prev, nonce)) {}
+                    return;
+                }
+            };
+            std::vector<std::thread> workers;
+            for (int i = 1; i < threads; ++i) workers.emplace_back(grind);
+            grind();
+            for (std::thread& worker : workers) worker.join();
+            found = best.load();
+        }
+    }
+    max_tries -= found - start;
+    header.nNonce = found;
+    return found != end;
 }
@@ -6,13 +6,16 @@
 #ifndef PALLADIUM_MINER_H
 #define PALLADIUM_MINER_H
 
-#include <optional.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
 #include <validation.h>
+#include <validationinterface.h>
 
+#include <atomic>
 #include <memory>
 #include <stdint.h>
+#include <unordered_set>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -24,6 +27,10 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -blocktemplateupdate, in seconds (0 = always assemble templates from scratch) */
+static const int64_t DEFAULT_BLOCK_TEMPLATE_UPDATE = 0;
+/** Default for -genthreads, the threads searching nonces in generatetoaddress and generatetodescriptor (0 = one per core) */
+static const int DEFAULT_GENTHREADS = 1;
 
 struct CBlockTemplate
 {
@@ -31,6 +38,8 @@ struct CBlockTemplate
     std::vector<CAmount> vTxFees;
     std::vector<int64_t> vTxSigOpsCost;
     std::vector<unsigned char> vchCoinbaseCommitment;
+    //! Merkle branch of the coinbase, which doesn't depend on the coinbase itself.
+    std::vector<uint256> vCoinbaseMerkleBranch;
 };
 
 // Container for tracking updates to ancestor feerate as we include (parent)
@@ -84,7 +93,7 @@ struct CompareTxIterByAncestorCount {
     {
         if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
             return a->GetCountWithAncestors() < b->GetCountWithAncestors();
-        return CTxMemPool::CompareIteratorByHash()(a, b);
+        return CompareIteratorByHash()(a, b);
     }
 };
 
@@ -162,8 +171,9 @@ public:
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
 
-    static Optional<int64_t> m_last_block_num_txs;
-    static Optional<int64_t> m_last_block_weight;
+    //! Transaction count and weight of the last assembled block, -1 until one was assembled.
+    static std::atomic<int64_t> m_last_block_num_txs;
+    static std::atomic<int64_t> m_last_block_weight;
 
 private:
     // utility functions
@@ -177,6 +187,9 @@ private:
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
     void addPackageTxs(int& nPackagesSelected, int& nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+    /** Add the mempool's cluster chunks in feerate order, when the mempool
+      * tracks clusters. */
+    void addChunks(int& nPackagesSelected) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -199,8 +212,76 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 };
 
+/**
+ * Keeps the last block template assembled for getblocktemplate up to date
+ * cheaply: as long as the tip doesn't change and none of its transactions
+ * leave the mempool, a new template is the previous one plus the transactions
+ * that have entered the mempool since, appended in arrival order if their
+ * in-mempool parents are already in the template and they fit. That takes
+ * time in the number of new transactions rather than in the size of the
+ * mempool.
+ *
+ * Appending doesn't reconsider the order by feerate, so the template is
+ * assembled from scratch again once it is older than the rebuild interval.
+ */
+class BlockTemplateCache final : public CValidationInterface
+{
+public:
+    BlockTemplateCache(const CTxMemPool& mempool, const CChainParams& params, int64_t rebuild_interval);
+
+    /** Return a template paying to scriptPubKeyIn, as BlockAssembler::CreateNewBlock would. */
+    std::unique_ptr<CBlockTemplate> GetTemplate(const CScript& scriptPubKeyIn);
+
+protected:
+    std::string GetValidationQueueName() const override { return "miner"; }
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) override;
+
+private:
+    //! Don't queue more new transactions than this; assemble from scratch instead.
+    static constexpr size_t MAX_PENDING = 100000;
+
+    const CTxMemPool& m_mempool;
+    const CChainParams& m_chainparams;
+    const BlockAssembler::Options m_options;
+    const int64_t m_rebuild_interval;
+
+    Mutex m_mutex;
+    std::unique_ptr<CBlockTemplate> m_template GUARDED_BY(m_mutex);
+    //! Tip, coinbase script and time of the last full assembly.
+    const CBlockIndex* m_prev GUARDED_BY(m_mutex){nullptr};
+    CScript m_script GUARDED_BY(m_mutex);
+    int64_t m_assembled GUARDED_BY(m_mutex){0};
+    //! Set when a transaction in m_template has left the mempool.
+    bool m_stale GUARDED_BY(m_mutex){false};
+    std::unordered_set<uint256, SaltedTxidHasher> m_in_template GUARDED_BY(m_mutex);
+    //! Transactions added to the mempool and not yet considered for m_template.
+    std::vector<CTransactionRef> m_pending GUARDED_BY(m_mutex);
+    uint64_t m_weight GUARDED_BY(m_mutex){0};
+    int64_t m_sigops_cost GUARDED_BY(m_mutex){0};
+    CAmount m_fees GUARDED_BY(m_mutex){0};
+
+    /** Add the pending transactions that can go into m_template; false if m_template has to be assembled again. */
+    bool Extend() EXCLUSIVE_LOCKS_REQUIRED(m_mutex, cs_main, m_mempool.cs);
+};
+
 /** Modify the extranonce in a block */
-void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
+/**
+ * Modify the extranonce in a block. If the Merkle branch of the coinbase is
+ * given, only the path from the coinbase to the root is hashed again.
+ */
+void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce, const std::vector<uint256>* coinbase_merkle_branch = nullptr);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
+/**
+ * Search the nonces of header from its current nNonce up for one meeting its
+ * proof of work target, trying at most max_tries and leaving out the last
+ * nonce. Headers are hashed in batches with HashHeaders(); if the first few
+ * thousand nonces fail, the rest of the range is searched by up to threads
+ * threads claiming chunks of it, which finds the same nonce as one thread
+ * would. On success nNonce is the nonce found, otherwise the next one to try.
+ * max_tries is reduced by the number of nonces that failed.
+ */
+bool GrindBlockNonce(CBlockHeader& header, const Consensus::Params& consensusParams, uint64_t& max_tries, int threads);
+
 #endif // PALLADIUM_MINER_H
@@ -19,6 +19,8 @@
 #include <random.h>
 #include <scheduler.h>
 #include <ui_interface.h>
+#include <udprelay.h>
+#include <util/lz4.h>
 #include <util/strencodings.h>
 #include <util/translation.h>
 
@@ -32,6 +34,10 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/upnpcommands.h>
@@ -54,6 +60,18 @@ static constexpr int DNSSEEDS_TO_QUERY_AT_ONCE = 3;
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+/** Receive buffers kept for reuse per peer. */
+static constexpr size_t MAX_POOLED_RECV_BUFFERS = 4;
+/** Receive buffers with a larger allocation (e.g. for blocks) are freed rather than pooled. */
+static constexpr size_t MAX_POOLED_RECV_BUFFER_SIZE = 256 * 1024;
+/** Buffers returned to a receive buffer pool between two trims. */
+static constexpr unsigned int RECV_POOL_TRIM_INTERVAL = 1000;
+
+#ifndef WIN32
+/** Most send queue chunks passed to a single sendmsg() call, well below IOV_MAX (1024 on Linux, the BSDs and macOS). */
+static constexpr size_t MAX_SEND_IOVECS = 64;
+#endif
+
 // MSG_NOSIGNAL is not available on some platforms, if it doesn't exist define it as 0
 #if !defined(MSG_NOSIGNAL)
 #define MSG_NOSIGNAL 0
@@ -77,6 +95,9 @@ static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
+/** Set on peer worker threads, which queue the messages they push themselves. */
+static thread_local bool g_peer_worker_thread{false};
+
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_LOCALHOSTNONCE = 0xd93e69e2bbfa5735ULL; // SHA256("localhostnonce")[0:8]
 //
@@ -90,6 +111,31 @@ std::map<CNetAddr, LocalServiceInfo> mapLocalHost GUARDED_BY(cs_mapLocalHost);
 static bool vfLimited[NET_MAX] GUARDED_BY(cs_mapLocalHost) = {};
 std::string strSubVersion;
 
+SendPriority GetSendPriority(const std::string& msg_type)
+{
+    if (msg_type == NetMsgType::CMPCTBLOCK || msg_type == NetMsgType::BLOCKTXN ||
+        msg_type == NetMsgType::BLOCK || msg_type == NetMsgType::HEADERS) {
+        return SendPriority::BLOCK;
+    }
+    // Filtered blocks are followed by their transactions, so they stay in the same queue.
+    if (msg_type == NetMsgType::TX || msg_type == NetMsgType::INV || msg_type == NetMsgType::NOTFOUND ||
+        msg_type == NetMsgType::ADDR || msg_type == NetMsgType::MERKLEBLOCK ||
+        msg_type == NetMsgType::REQTXRCNCL || msg_type == NetMsgType::SKETCH || msg_type == NetMsgType::RECONCILDIFF) {
+        return SendPriority::TX;
+    }
+    return SendPriority::CONTROL;
+}
+
+std::string SendPriorityName(SendPriority priority)
+{
+    switch (priority) {
+    case SendPriority::BLOCK: return "block";
+    case SendPriority::CONTROL: return "control";
+    case SendPriority::TX: return "tx";
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
 void CConnman::AddOneShot(const std::string& strDest)
 {
     LOCK(cs_vOneShots);
@@ -498,7 +544,7 @@ void CNode::SetAddrLocal(const CService& addrLocalIn) {
 
 #undef X
 #define X(name) stats.name = name
-void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
+void CNode::copyStats(CNodeStats &stats, const Asmap &m_asmap)
 {
     stats.nodeid = this->GetId();
     X(nServices);
@@ -528,6 +574,9 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
         LOCK(cs_vSend);
         X(mapSendBytesPerMsgCmd);
         X(nSendBytes);
+        for (size_t i = 0; i < NUM_SEND_PRIORITIES; ++i) {
+            stats.m_send_queue_bytes[i] = m_send_queues[i].bytes;
+        }
     }
     {
         LOCK(cs_vRecv);
@@ -536,12 +585,23 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
     }
     X(m_legacyWhitelisted);
     X(m_permissionFlags);
+    X(m_compress_send);
+    X(m_compressed_bytes_sent);
+    X(m_uncompressed_bytes_sent);
+    X(m_compressed_bytes_recv);
+    X(m_uncompressed_bytes_recv);
     if (m_tx_relay != nullptr) {
         LOCK(m_tx_relay->cs_feeFilter);
         stats.minFeeFilter = m_tx_relay->minFeeFilter;
     } else {
         stats.minFeeFilter = 0;
     }
+    if (m_tx_relay != nullptr) {
+        LOCK(m_tx_relay->cs_tx_inventory);
+        stats.m_inv_known_bytes = m_tx_relay->filterInventoryKnown.DynamicMemoryUsage();
+    } else {
+        stats.m_inv_known_bytes = 0;
+    }
 
     // It is common for nodes with good ping times to suddenly become lagged,
     // due to a new block arriving or other large transfer.
@@ -565,6 +625,51 @@ void CNode::copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap)
 }
 #undef X
 
+/** Whether messages of this type are sent compressed to peers that support it. */
+static bool IsCompressibleMessageType(const std::string& command)
+{
+    return command == NetMsgType::BLOCK || command == NetMsgType::HEADERS || command == NetMsgType::BLOCKTXN || command == NetMsgType::ADDR;
+}
+
+/** Replace a "cmpr" message by the message it holds. Returns false if it is malformed. */
+static bool DecompressMessage(CNetMessage& msg)
+{
+    std::string command;
+    uint32_t size;
+    try {
+        msg.m_recv >> LIMITED_STRING(command, CMessageHeader::COMMAND_SIZE) >> size;
+    } catch (const std::ios_base::failure&) {
+        return false;
+    }
+    if (!IsCompressibleMessageType(command) || size > MAX_PROTOCOL_MESSAGE_LENGTH) return false;
+
+    std::vector<uint8_t> payload;
+    if (!LZ4Decompress(Span<const uint8_t>((const uint8_t*)msg.m_recv.data(), msg.m_recv.size()), size, payload)) return false;
+    msg.m_recv = CDataStream(payload, msg.m_recv.GetType(), msg.m_recv.GetVersion());
+    msg.m_command = command;
+    msg.m_message_size = size;
+    return true;
+}
+
+/** Wrap a message in a "cmpr" message, unless that does not make it smaller. */
+static bool CompressMessage(CSerializedNetMsg& msg)
+{
+    const Span<const unsigned char> payload = msg.Payload();
+    CSerializedNetMsg compressed;
+    compressed.command = NetMsgType::CMPR;
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, compressed.data, 0, msg.command, uint32_t(payload.size())};
+    const std::vector<uint8_t> block = LZ4Compress(payload);
+    if (compressed.data.size() + block.size() >= payload.size()) return false;
+    compressed.data.insert(compressed.data.end(), block.begin(), block.end());
+    msg = std::move(compressed);
+    return true;
+}
+
+static bool WantCompression(const CNode* pnode, const CSerializedNetMsg& msg)
+{
+    return pnode->m_compress_send && msg.Payload().size() >= MIN_COMPRESSED_MESSAGE_SIZE && IsCompressibleMessageType(msg.command);
+}
+
 bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete)
 {
     complete = false;
@@ -584,6 +689,16 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
             // decompose a transport agnostic CNetMessage from the deserializer
             CNetMessage msg = m_deserializer->GetMessage(Params().MessageStart(), nTimeMicros);
 
+            if (msg.m_command == NetMsgType::CMPR && m_compression_offered && msg.m_valid_header && msg.m_valid_checksum) {
+                const uint32_t compressed_size = msg.m_message_size;
+                if (!DecompressMessage(msg)) {
+                    LogPrint(BCLog::NET, "invalid compressed message from peer=%d\n", id);
+                    return false;
+                }
+                m_compressed_bytes_recv += compressed_size;
+                m_uncompressed_bytes_recv += msg.m_message_size;
+            }
+
             //store received bytes per message command
             //to prevent a memory DOS, only allow valid commands
             mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.m_command);
@@ -628,6 +743,54 @@ int CNode::GetSendVersion() const
     return nSendVersion;
 }
 
+CSerializeData RecvBufferPool::Get()
+{
+    LOCK(m_mutex);
+    ++m_in_use;
+    m_high_water = std::max(m_high_water, m_in_use);
+    if (m_buffers.empty()) return CSerializeData();
+    CSerializeData buffer = std::move(m_buffers.back());
+    m_buffers.pop_back();
+    m_pooled_bytes -= buffer.capacity();
+    return buffer;
+}
+
+void RecvBufferPool::Put(CSerializeData&& buffer)
+{
+    LOCK(m_mutex);
+    assert(m_in_use > 0);
+    --m_in_use;
+    if (buffer.capacity() > 0 && buffer.capacity() <= MAX_POOLED_RECV_BUFFER_SIZE && m_buffers.size() < MAX_POOLED_RECV_BUFFERS) {
+        buffer.clear();
+        m_pooled_bytes += buffer.capacity();
+        m_buffers.push_back(std::move(buffer));
+    }
+    if (++m_returned >= RECV_POOL_TRIM_INTERVAL) {
+        // Keep no more buffers around than were needed at once recently.
+        while (!m_buffers.empty() && m_buffers.size() + m_in_use > m_high_water) {
+            m_pooled_bytes -= m_buffers.back().capacity();
+            m_buffers.pop_back();
+        }
+        m_high_water = m_in_use;
+        m_returned = 0;
+    }
+}
+
+size_t RecvBufferPool::PooledBytes() const
+{
+    LOCK(m_mutex);
+    return m_pooled_bytes;
+}
+
+CNetMessage::~CNetMessage()
+{
+    if (m_recv_pool) {
+        CSerializeData buffer;
+        m_recv.SwapBuffer(buffer);
+        m_recv_pool->Put(std::move(buffer));
+    }
+}
+
 int V1TransportDeserializer::readHeader(const char *pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -654,6 +817,13 @@ int V1TransportDeserializer::readHeader(const char *pch, unsigned int nBytes)
         return -1;
     }
 
+    // The previous buffer left with its message: take a pooled one now
+    // rather than at Reset(), so that it can be the one just processed.
+    if (m_recv_pool && vRecv.capacity() == 0) {
+        CSerializeData buffer = m_recv_pool->Get();
+        vRecv.SwapBuffer(buffer);
+    }
+
     // switch state to reading message data
     in_data = true;
 
@@ -665,13 +835,16 @@ int V1TransportDeserializer::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
+    if (vRecv.capacity() < nDataPos + nCopy) {
         // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        // Grow geometrically so large messages are not moved once per 256 KiB.
+        const size_t grown = std::max<size_t>(2 * vRecv.capacity(), nDataPos + nCopy + 256 * 1024);
+        vRecv.reserve(std::min<size_t>(hdr.nMessageSize, grown));
     }
 
+    // Append rather than resize and overwrite, so the buffer is written once.
     hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    vRecv.write(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
@@ -688,6 +861,7 @@ const uint256& V1TransportDeserializer::GetMessageHash() const
 CNetMessage V1TransportDeserializer::GetMessage(const CMessageHeader::MessageStartChars& message_start, int64_t time) {
     // decompose a single CNetMessage from the TransportDeserializer
     CNetMessage msg(std::move(vRecv));
+    msg.m_recv_pool = m_recv_pool;
 
     // store state about valid header, netmagic and checksum
     msg.m_valid_header = hdr.IsValid(message_start);
@@ -720,10 +894,11 @@ CNetMessage V1TransportDeserializer::GetMessage(const CMessageHeader::MessageSta
 
 void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
     // create dbl-sha256 checksum
-    uint256 hash = Hash(msg.data.begin(), msg.data.end());
+    const Span<const unsigned char> payload = msg.Payload();
+    uint256 hash = Hash(payload.begin(), payload.end());
 
     // create header
-    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
+    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), payload.size());
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     // serialize header
@@ -733,31 +908,84 @@ void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vec
 
 size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend)
 {
-    auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
-    while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+    while (pnode->HasQueuedSends()) {
+        // Pick the chunks to send, in order: the rest of a partly sent
+        // message, then whole queues by priority. Messages are never
+        // interleaved, so a queue is only switched at a message boundary.
+        CSendChunk* chunks[MAX_SEND_IOVECS];
+        int queue_of[MAX_SEND_IOVECS];
+        size_t nChunks = 0;
+        std::array<size_t, NUM_SEND_PRIORITIES> taken{};
+        auto take = [&](int q, bool one_message) {
+            std::deque<CSendChunk>& queue = pnode->m_send_queues[q].chunks;
+            while (taken[q] < queue.size() && nChunks < MAX_SEND_IOVECS) {
+                CSendChunk& chunk = queue[taken[q]++];
+                chunks[nChunks] = &chunk;
+                queue_of[nChunks++] = q;
+                if (one_message && chunk.EndsMessage()) break;
+            }
+        };
+        if (pnode->m_send_in_progress >= 0) take(pnode->m_send_in_progress, /* one_message */ true);
+        for (size_t q = 0; q < NUM_SEND_PRIORITIES; ++q) take(q, /* one_message */ false);
+
+        assert(chunks[0]->size() > pnode->nSendOffset);
+        // Bytes handed to the socket in this call, across all gathered chunks.
+        size_t nAttempted = 0;
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            nAttempted = chunks[0]->size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(chunks[0]->data()) + pnode->nSendOffset, nAttempted, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Gather the queued chunks into a single sendmsg() call, so that
+            // small messages (and the headers of all messages) don't each
+            // cost a syscall and a TCP segment. The kernel takes as much as
+            // fits into the socket send buffer.
+            struct iovec iov[MAX_SEND_IOVECS];
+            size_t nOffset = pnode->nSendOffset;
+            for (size_t i = 0; i < nChunks; ++i) {
+                iov[i].iov_base = const_cast<unsigned char*>(chunks[i]->data()) + nOffset;
+                iov[i].iov_len = chunks[i]->size() - nOffset;
+                nAttempted += iov[i].iov_len;
+                nOffset = 0;
+            }
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nChunks;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Pop the chunks that were sent completely, in the order they were gathered.
+            size_t nRemaining = nBytes;
+            for (size_t i = 0; nRemaining > 0; ++i) {
+                CSendQueue& queue = pnode->m_send_queues[queue_of[i]];
+                const CSendChunk& chunk = queue.chunks.front();
+                const size_t nLeft = chunk.size() - pnode->nSendOffset;
+                pnode->m_send_in_progress = queue_of[i];
+                if (nRemaining < nLeft) {
+                    pnode->nSendOffset += nRemaining;
+                    break;
+                }
+                nRemaining -= nLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
-                // could not send full message; stop sending more
+                pnode->nSendSize -= chunk.size();
+                queue.bytes -= chunk.size();
+                if (chunk.EndsMessage()) pnode->m_send_in_progress = -1;
+                queue.chunks.pop_front();
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nAttempted) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -775,11 +1003,12 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    if (!pnode->HasQueuedSends()) {
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
+        // Everything queued during the version handshake is out now.
+        if (pnode->fSuccessfullyConnected) pnode->m_send_prioritized = true;
     }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
     return nSentSize;
 }
 
@@ -1075,6 +1304,16 @@ void CConnman::DisconnectNodes()
                 // remove from vNodes
                 vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
+                // keep its traffic in the per-message-type totals
+                {
+                    LOCK(pnode->cs_vRecv);
+                    for (const auto& cmd : pnode->mapRecvBytesPerMsgCmd) m_disconnected_recv_bytes[cmd.first] += cmd.second;
+                }
+                {
+                    LOCK(pnode->cs_vSend);
+                    for (const auto& cmd : pnode->mapSendBytesPerMsgCmd) m_disconnected_sent_bytes[cmd.first] += cmd.second;
+                }
+
                 // release outbound grant (if any)
                 pnode->grantOutbound.Release();
 
@@ -1185,7 +1424,7 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &s
             bool select_send;
             {
                 LOCK(pnode->cs_vSend);
-                select_send = !pnode->vSendMsg.empty();
+                select_send = pnode->HasQueuedSends();
             }
 
             LOCK(pnode->cs_hSocket);
@@ -1206,8 +1445,157 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &s
     return !recv_set.empty() || !send_set.empty() || !error_set.empty();
 }
 
+bool ParseNetEventsMode(const std::string& str, NetEventsMode& mode)
+{
 #ifdef USE_POLL
+    if (str == "poll") {
+        mode = NetEventsMode::POLL;
+        return true;
+    }
+#else
+    if (str == "select") {
+        mode = NetEventsMode::SELECT;
+        return true;
+    }
+#endif
+#ifdef USE_EPOLL
+    if (str == "epoll") {
+        mode = NetEventsMode::EPOLL;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string NetEventsModeName(NetEventsMode mode)
+{
+    switch (mode) {
+    case NetEventsMode::SELECT: return "select";
+    case NetEventsMode::POLL: return "poll";
+    case NetEventsMode::EPOLL: return "epoll";
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
+std::string AvailableNetEventsModes()
+{
+#ifdef USE_POLL
+    std::string modes = "poll";
+#else
+    std::string modes = "select";
+#endif
+#ifdef USE_EPOLL
+    modes += ", epoll";
+#endif
+    return modes;
+}
+
 void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+#ifdef USE_EPOLL
+    if (m_net_events == NetEventsMode::EPOLL && SocketEventsEpoll(recv_set, send_set, error_set)) return;
+#endif
+#ifdef USE_POLL
+    SocketEventsPoll(recv_set, send_set, error_set);
+#else
+    SocketEventsSelect(recv_set, send_set, error_set);
+#endif
+}
+
+#ifdef USE_EPOLL
+bool CConnman::SocketEventsEpoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+    if (m_epoll_fd == -1) {
+        m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll_fd == -1) {
+            LogPrintf("epoll_create1 failed (%s), falling back to poll\n", NetworkErrorString(errno));
+            m_net_events = NetEventsMode::POLL;
+            return false;
+        }
+    }
+
+    // Sockets stay registered across calls; only those whose wanted events
+    // changed (see GenerateSelectSet for the policy) need an epoll_ctl, and
+    // the kernel only reports the sockets that are ready.
+    const uint64_t generation = ++m_epoll_generation;
+    auto update = [&](SOCKET socket, NodeId owner, uint32_t events) {
+        struct epoll_event event{};
+        event.events = events;
+        event.data.fd = socket;
+        auto it = m_epoll_sockets.find(socket);
+        if (it != m_epoll_sockets.end() && it->second.owner == owner) {
+            it->second.generation = generation;
+            if (it->second.events == events) return;
+            if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, socket, &event) == 0) {
+                it->second.events = events;
+                return;
+            }
+        }
+        // New socket, or a socket number that was closed and reused since the
+        // last call. Closing a socket removes it from the epoll set already.
+        epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, socket, nullptr);
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, socket, &event) != 0) {
+            LogPrint(BCLog::NET, "epoll_ctl failed for socket %d: %s\n", socket, NetworkErrorString(errno));
+            m_epoll_sockets.erase(socket);
+            return;
+        }
+        m_epoll_sockets[socket] = EpollRegistration{owner, events, generation};
+    };
+
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        update(hListenSocket.socket, -1, EPOLLIN);
+    }
+    {
+        LOCK(cs_vNodes);
+        for (CNode* pnode : vNodes) {
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = pnode->HasQueuedSends();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+
+            // Errors and hangups are always reported, even with no events set.
+            update(pnode->hSocket, pnode->GetId(), select_send ? EPOLLOUT : select_recv ? EPOLLIN : 0);
+        }
+    }
+
+    for (auto it = m_epoll_sockets.begin(); it != m_epoll_sockets.end();) {
+        if (it->second.generation != generation) {
+            epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, it->first, nullptr);
+            it = m_epoll_sockets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (m_epoll_sockets.empty()) {
+        interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return true;
+    }
+
+    std::vector<struct epoll_event> events(m_epoll_sockets.size());
+    int ready = epoll_wait(m_epoll_fd, events.data(), events.size(), SELECT_TIMEOUT_MILLISECONDS);
+    if (ready < 0) return true;
+
+    if (interruptNet) return true;
+
+    for (int i = 0; i < ready; ++i) {
+        const SOCKET socket = events[i].data.fd;
+        if (events[i].events & EPOLLIN)               recv_set.insert(socket);
+        if (events[i].events & EPOLLOUT)              send_set.insert(socket);
+        if (events[i].events & (EPOLLERR|EPOLLHUP))   error_set.insert(socket);
+    }
+    return true;
+}
+#endif
+
+#ifdef USE_POLL
+void CConnman::SocketEventsPoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
     if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
@@ -1249,7 +1637,7 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
     }
 }
 #else
-void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+void CConnman::SocketEventsSelect(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
     if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
@@ -1582,8 +1970,34 @@ void StopMapPort()
 
 
 
+void CConnman::ThreadLoadAddresses()
+{
+    int64_t nStart = GetTimeMillis();
+    CAddrDB adb;
+    const bool loaded = adb.Read(addrman);
+    if (loaded) {
+        LogPrintf("Loaded %i addresses from peers.dat  %dms\n", addrman.size(), GetTimeMillis() - nStart);
+    } else {
+        addrman.Clear(); // Addrman can be in an inconsistent state after failure, reset it
+        LogPrintf("Invalid or missing peers.dat; recreating\n");
+    }
+    fAddressesInitialized = true;
+    if (!loaded) DumpAddresses();
+}
+
+bool CConnman::WaitForAddresses()
+{
+    while (!fAddressesInitialized) {
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(100))) return false;
+    }
+    return true;
+}
+
 void CConnman::ThreadDNSAddressSeed()
 {
+    // Whether seeds are needed right away depends on what peers.dat holds.
+    if (!WaitForAddresses()) return;
+
     FastRandomContext rng;
     std::vector<std::string> seeds = Params().DNSSeeds();
     Shuffle(seeds.begin(), seeds.end(), rng);
@@ -1664,6 +2078,9 @@ void CConnman::ThreadDNSAddressSeed()
 
 void CConnman::DumpAddresses()
 {
+    // Don't overwrite peers.dat before it has been read.
+    if (!fAddressesInitialized) return;
+
     int64_t nStart = GetTimeMillis();
 
     CAddrDB adb;
@@ -1744,6 +2161,10 @@ void CConnman::ThreadOpenConnections(const std::vector<std::string> connect)
         }
     }
 
+    // Addresses to connect to come from peers.dat; -addnode and inbound
+    // connections don't wait for it.
+    if (!WaitForAddresses()) return;
+
     // Initiate network connections
     int64_t nStart = GetTime();
 
@@ -1756,6 +2177,13 @@ void CConnman::ThreadOpenConnections(const std::vector<std::string> connect)
         if (!interruptNet.sleep_for(std::chrono::milliseconds(500)))
             return;
 
+        // Start at most one attempt per iteration, without waiting for the
+        // ones in progress, which may take up to nConnectTimeout each.
+        {
+            LOCK(m_dials_mutex);
+            if (m_dials.size() >= MAX_PARALLEL_DIALS) continue;
+        }
+
         CSemaphoreGrant grant(*semOutbound);
         if (interruptNet)
             return;
@@ -1781,6 +2209,19 @@ void CConnman::ThreadOpenConnections(const std::vector<std::string> connect)
         int nOutboundFullRelay = 0;
         int nOutboundBlockRelay = 0;
         std::set<std::vector<unsigned char> > setConnected;
+        {
+            // Attempts in progress count as connected. A made connection is
+            // added to vNodes before its attempt is dropped, so look here first.
+            LOCK(m_dials_mutex);
+            for (const OutboundDial& dial : m_dials) {
+                setConnected.insert(dial.m_addr.GetGroup(addrman.m_asmap));
+                if (dial.m_block_relay_only) {
+                    nOutboundBlockRelay++;
+                } else if (!dial.m_feeler) {
+                    nOutboundFullRelay++;
+                }
+            }
+        }
         {
             LOCK(cs_vNodes);
             for (const CNode* pnode : vNodes) {
@@ -1895,11 +2336,38 @@ void CConnman::ThreadOpenConnections(const std::vector<std::string> connect)
             // well for sanity.)
             bool block_relay_only = nOutboundBlockRelay < m_max_outbound_block_relay && !fFeeler && nOutboundFullRelay >= m_max_outbound_full_relay;
 
-            OpenNetworkConnection(addrConnect, (int)setConnected.size() >= std::min(nMaxConnections - 1, 2), &grant, nullptr, false, fFeeler, false, block_relay_only);
+            {
+                LOCK(m_dials_mutex);
+                m_dials.emplace_back(addrConnect, (int)setConnected.size() >= std::min(nMaxConnections - 1, 2), fFeeler, block_relay_only, grant);
+            }
+            m_dials_cv.notify_one();
         }
     }
 }
 
+void CConnman::ThreadDial()
+{
+    while (true) {
+        std::list<OutboundDial>::iterator dial;
+        {
+            WAIT_LOCK(m_dials_mutex, lock);
+            m_dials_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_dials_mutex) {
+                if (interruptNet) return true;
+                dial = std::find_if(m_dials.begin(), m_dials.end(), [](const OutboundDial& d) { return !d.m_started; });
+                return dial != m_dials.end();
+            });
+            if (interruptNet) return;
+            dial->m_started = true;
+        }
+
+        // Only this thread touches a started attempt, and the list keeps it in place.
+        OpenNetworkConnection(dial->m_addr, dial->m_count_failure, &dial->m_grant, nullptr, false, dial->m_feeler, false, dial->m_block_relay_only);
+
+        LOCK(m_dials_mutex);
+        m_dials.erase(dial);
+    }
+}
+
 std::vector<AddedNodeInfo> CConnman::GetAddedNodeInfo()
 {
     std::vector<AddedNodeInfo> ret;
@@ -2049,7 +2517,9 @@ void CConnman::ThreadMessageHandler()
             // Send messages
             {
                 LOCK(pnode->cs_sendProcessing);
+                if (m_send_coalesce) CorkSend(pnode);
                 m_msgproc->SendMessages(pnode);
+                if (m_send_coalesce) UncorkSend(pnode);
             }
 
             if (flagInterruptMsgProc)
@@ -2282,26 +2752,8 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         AddOneShot(strDest);
     }
 
-    if (clientInterface) {
-        clientInterface->InitMessage(_("Loading P2P addresses...").translated);
-    }
-    // Load addresses from peers.dat
-    int64_t nStart = GetTimeMillis();
-    {
-        CAddrDB adb;
-        if (adb.Read(addrman))
-            LogPrintf("Loaded %i addresses from peers.dat  %dms\n", addrman.size(), GetTimeMillis() - nStart);
-        else {
-            addrman.Clear(); // Addrman can be in an inconsistent state after failure, reset it
-            LogPrintf("Invalid or missing peers.dat; recreating\n");
-            DumpAddresses();
-        }
-    }
-
     uiInterface.InitMessage(_("Starting network threads...").translated);
 
-    fAddressesInitialized = true;
-
     if (semOutbound == nullptr) {
         // initialize semaphore
         semOutbound = MakeUnique<CSemaphore>(std::min(m_max_outbound, nMaxConnections));
@@ -2311,6 +2763,22 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         semAddnode = MakeUnique<CSemaphore>(nMaxAddnode);
     }
 
+    if (connOptions.m_udp_relay_port != 0) {
+        m_udp_relay = MakeUnique<UdpBlockRelay>(Params().MessageStart(), [this](NodeId id, std::vector<unsigned char>&& payload) {
+            if (!DeliverMessage(id, NetMsgType::CMPCTBLOCK, std::move(payload))) {
+                LogPrint(BCLog::NET, "dropped compact block received over UDP from peer=%d\n", id);
+            }
+        });
+        std::string error;
+        if (!m_udp_relay->Bind(connOptions.m_udp_relay_port, error)) {
+            if (clientInterface) {
+                clientInterface->ThreadSafeMessageBox(error, "", CClientUIInterface::MSG_ERROR);
+            }
+            m_udp_relay.reset();
+            return false;
+        }
+    }
+
     //
     // Start threads
     //
@@ -2324,6 +2792,10 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         fMsgProcWake = false;
     }
 
+    // Load addresses from peers.dat while the other threads already start
+    // connecting; the ones that need addrman wait for it.
+    threadLoadAddresses = std::thread(&TraceThread<std::function<void()> >, "addrload", std::function<void()>(std::bind(&CConnman::ThreadLoadAddresses, this)));
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2345,12 +2817,27 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     }
     if (connOptions.m_use_addrman_outgoing || !connOptions.m_specified_outgoing.empty())
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
+    if (connOptions.m_use_addrman_outgoing && connOptions.m_specified_outgoing.empty()) {
+        for (unsigned int i = 0; i < MAX_PARALLEL_DIALS; ++i) {
+            m_dial_threads.emplace_back([this, i] { TraceThread(strprintf("opencon.%i", i).c_str(), [this] { ThreadDial(); }); });
+        }
+    }
 
     // Process messages
     threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < m_msghandler_threads; ++i) {
+        m_peer_workers.emplace_back(MakeUnique<PeerWorker>());
+        PeerWorker& worker = *m_peer_workers.back();
+        worker.m_thread = std::thread([this, &worker, i] { TraceThread(strprintf("msgwork.%i", i).c_str(), [this, &worker] { ThreadPeerWorker(worker); }); });
+    }
+
+    // Receive blocks from -udprelayport
+    if (m_udp_relay) {
+        threadUdpRelay = std::thread(&TraceThread<std::function<void()> >, "udprelay", std::function<void()>([this] { m_udp_relay->ThreadReceive(interruptNet); }));
+    }
 
     // Dump network addresses
-    scheduler.scheduleEvery([this] { DumpAddresses(); }, DUMP_PEERS_INTERVAL);
+    scheduler.scheduleEvery([this] { DumpAddresses(); }, DUMP_PEERS_INTERVAL, "dumpaddresses");
 
     return true;
 }
@@ -2377,9 +2864,19 @@ void CConnman::Interrupt()
         flagInterruptMsgProc = true;
     }
     condMsgProc.notify_all();
+    for (const auto& worker : m_peer_workers) {
+        {
+            LOCK(worker->m_mutex);
+        }
+        worker->m_cv.notify_all();
+    }
 
     interruptNet();
     InterruptSocks5(true);
+    {
+        LOCK(m_dials_mutex);
+    }
+    m_dials_cv.notify_all();
 
     if (semOutbound) {
         for (int i=0; i<m_max_outbound; i++) {
@@ -2398,14 +2895,40 @@ void CConnman::StopThreads()
 {
     if (threadMessageHandler.joinable())
         threadMessageHandler.join();
+    for (const auto& worker : m_peer_workers) {
+        if (worker->m_thread.joinable())
+            worker->m_thread.join();
+        // Drop the references held by tasks that never ran
+        LOCK(worker->m_mutex);
+        for (auto& task : worker->m_tasks) {
+            --task.first->m_peer_tasks;
+            task.first->Release();
+        }
+        worker->m_tasks.clear();
+    }
+    m_peer_workers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
+    for (std::thread& thread : m_dial_threads) {
+        if (thread.joinable())
+            thread.join();
+    }
+    m_dial_threads.clear();
+    {
+        // Give back the outbound slots of attempts that never started
+        LOCK(m_dials_mutex);
+        m_dials.clear();
+    }
     if (threadOpenAddedConnections.joinable())
         threadOpenAddedConnections.join();
     if (threadDNSAddressSeed.joinable())
         threadDNSAddressSeed.join();
+    if (threadLoadAddresses.joinable())
+        threadLoadAddresses.join();
     if (threadSocketHandler.joinable())
         threadSocketHandler.join();
+    if (threadUdpRelay.joinable())
+        threadUdpRelay.join();
 }
 
 void CConnman::StopNodes()
@@ -2436,6 +2959,7 @@ void CConnman::StopNodes()
     vhListenSocket.clear();
     semOutbound.reset();
     semAddnode.reset();
+    m_udp_relay.reset();
 }
 
 void CConnman::DeleteNode(CNode* pnode)
@@ -2453,6 +2977,9 @@ CConnman::~CConnman()
 {
     Interrupt();
     Stop();
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) close(m_epoll_fd);
+#endif
 }
 
 size_t CConnman::GetAddressCount() const
@@ -2666,6 +3193,24 @@ uint64_t CConnman::GetOutboundTargetBytesLeft()
     return (nMaxOutboundTotalBytesSentInCycle >= nMaxOutboundLimit) ? 0 : nMaxOutboundLimit - nMaxOutboundTotalBytesSentInCycle;
 }
 
+size_t CConnman::GetRecvBufferMemory()
+{
+    size_t total = 0;
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes) {
+        total += pnode->m_recv_pool->PooledBytes();
+        {
+            LOCK(pnode->cs_vRecv);
+            total += pnode->m_deserializer->GetMemoryUsage();
+        }
+        LOCK(pnode->cs_vProcessMsg);
+        for (const CNetMessage& msg : pnode->vProcessMsg) {
+            total += msg.m_recv.capacity();
+        }
+    }
+    return total;
+}
+
 uint64_t CConnman::GetTotalBytesRecv()
 {
     LOCK(cs_totalBytesRecv);
@@ -2678,6 +3223,23 @@ uint64_t CConnman::GetTotalBytesSent()
     return nTotalBytesSent;
 }
 
+void CConnman::GetBytesPerMsgType(std::map<std::string, uint64_t>& recv, std::map<std::string, uint64_t>& sent)
+{
+    LOCK(cs_vNodes);
+    recv = m_disconnected_recv_bytes;
+    sent = m_disconnected_sent_bytes;
+    for (CNode* pnode : vNodes) {
+        {
+            LOCK(pnode->cs_vRecv);
+            for (const auto& cmd : pnode->mapRecvBytesPerMsgCmd) recv[cmd.first] += cmd.second;
+        }
+        {
+            LOCK(pnode->cs_vSend);
+            for (const auto& cmd : pnode->mapSendBytesPerMsgCmd) sent[cmd.first] += cmd.second;
+        }
+    }
+}
+
 ServiceFlags CConnman::GetLocalServices() const
 {
     return nLocalServices;
@@ -2727,7 +3289,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
         LogPrint(BCLog::NET, "Added connection peer=%d\n", id);
     }
 
-    m_deserializer = MakeUnique<V1TransportDeserializer>(V1TransportDeserializer(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+    m_deserializer = MakeUnique<V1TransportDeserializer>(V1TransportDeserializer(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION, m_recv_pool));
     m_serializer = MakeUnique<V1TransportSerializer>(V1TransportSerializer());
 }
 
@@ -2743,9 +3305,33 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    if (!g_peer_worker_thread && (pnode->m_deferred_sends > 0 || WantCompression(pnode, msg))) {
+        auto deferred = std::make_shared<CSerializedNetMsg>(std::move(msg));
+        ++pnode->m_deferred_sends;
+        if (PostPeerTask(pnode, [this, pnode, deferred] {
+                QueueMessage(pnode, std::move(*deferred));
+                --pnode->m_deferred_sends;
+            })) {
+            return;
+        }
+        --pnode->m_deferred_sends;
+        msg = std::move(*deferred);
+    }
+    QueueMessage(pnode, std::move(msg));
+}
+
+void CConnman::QueueMessage(CNode* pnode, CSerializedNetMsg&& msg)
+{
+    size_t nMessageSize = msg.Payload().size();
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command), nMessageSize, pnode->GetId());
 
+    const std::string command = msg.command;
+    if (WantCompression(pnode, msg) && CompressMessage(msg)) {
+        pnode->m_uncompressed_bytes_sent += nMessageSize;
+        nMessageSize = msg.Payload().size();
+        pnode->m_compressed_bytes_sent += nMessageSize;
+    }
+
     // make sure we use the appropriate network transport format
     std::vector<unsigned char> serializedHeader;
     pnode->m_serializer->prepareForTransport(msg, serializedHeader);
@@ -2754,17 +3340,28 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
-        bool optimisticSend(pnode->vSendMsg.empty());
+        bool optimisticSend(!pnode->HasQueuedSends() && !pnode->m_send_corked);
+        if (!pnode->m_send_prioritized && pnode->fSuccessfullyConnected && !pnode->HasQueuedSends()) {
+            pnode->m_send_prioritized = true;
+        }
+        CSendQueue& queue = pnode->m_send_queues[static_cast<size_t>(pnode->m_send_prioritized ? GetSendPriority(command) : SendPriority::CONTROL)];
 
         //log total amount of bytes per command
-        pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
+        pnode->mapSendBytesPerMsgCmd[command] += nTotalSize;
         pnode->nSendSize += nTotalSize;
+        queue.bytes += nTotalSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        queue.chunks.emplace_back(std::move(serializedHeader));
+        if (nMessageSize) {
+            if (msg.shared_owner) {
+                queue.chunks.emplace_back(std::move(msg.shared_owner), msg.shared_data);
+            } else {
+                queue.chunks.emplace_back(std::move(msg.data));
+            }
+        }
+        queue.chunks.back().SetEndsMessage();
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
@@ -2774,6 +3371,62 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         RecordBytesSent(nBytesSent);
 }
 
+void CConnman::CorkSend(CNode* pnode)
+{
+    LOCK(pnode->cs_vSend);
+    pnode->m_send_corked = true;
+}
+
+void CConnman::UncorkSend(CNode* pnode)
+{
+    size_t nBytesSent = 0;
+    {
+        LOCK(pnode->cs_vSend);
+        pnode->m_send_corked = false;
+        if (pnode->HasQueuedSends())
+            nBytesSent = SocketSendData(pnode);
+    }
+    if (nBytesSent)
+        RecordBytesSent(nBytesSent);
+}
+
+bool CConnman::PostPeerTask(CNode* pnode, std::function<void()> task)
+{
+    if (m_peer_workers.empty()) return false;
+
+    PeerWorker& worker = *m_peer_workers[pnode->GetId() % m_peer_workers.size()];
+    pnode->AddRef();
+    ++pnode->m_peer_tasks;
+    {
+        LOCK(worker.m_mutex);
+        worker.m_tasks.emplace_back(pnode, std::move(task));
+    }
+    worker.m_cv.notify_one();
+    return true;
+}
+
+void CConnman::ThreadPeerWorker(PeerWorker& worker)
+{
+    g_peer_worker_thread = true;
+    while (true) {
+        std::pair<CNode*, std::function<void()>> task;
+        {
+            WAIT_LOCK(worker.m_mutex, lock);
+            worker.m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(worker.m_mutex) { return flagInterruptMsgProc || !worker.m_tasks.empty(); });
+            if (flagInterruptMsgProc) return;
+            task = std::move(worker.m_tasks.front());
+            worker.m_tasks.pop_front();
+        }
+
+        CNode* pnode = task.first;
+        if (!pnode->fDisconnect) task.second();
+        --pnode->m_peer_tasks;
+        pnode->Release();
+        // The message handler skips peers with unfinished tasks
+        WakeMessageHandler();
+    }
+}
+
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
 {
     CNode* found = nullptr;
@@ -2787,6 +3440,28 @@ bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
     return found != nullptr && NodeFullyConnected(found) && func(found);
 }
 
+bool CConnman::DeliverMessage(NodeId id, const std::string& msg_type, std::vector<unsigned char>&& payload)
+{
+    return ForNode(id, [&](CNode* pnode) {
+        if (pnode->fDisconnect) return false;
+        CNetMessage msg(CDataStream(payload, SER_NETWORK, INIT_PROTO_VERSION));
+        msg.m_time = GetTimeMicros();
+        msg.m_valid_netmagic = msg.m_valid_header = msg.m_valid_checksum = true;
+        msg.m_command = msg_type;
+        msg.m_message_size = payload.size();
+        msg.m_raw_message_size = payload.size() + CMessageHeader::HEADER_SIZE;
+        {
+            LOCK(pnode->cs_vProcessMsg);
+            if (pnode->nProcessQueueSize > nReceiveFloodSize) return false;
+            pnode->nProcessQueueSize += msg.m_raw_message_size;
+            pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+            pnode->vProcessMsg.push_back(std::move(msg));
+        }
+        WakeMessageHandler();
+        return true;
+    });
+}
+
 int64_t CConnman::PoissonNextSendInbound(int64_t now, int average_interval_seconds)
 {
     if (m_next_send_inv_to_incoming < now) {
@@ -24,10 +24,13 @@
 #include <uint256.h>
 #include <threadinterrupt.h>
 
+#include <array>
 #include <atomic>
 #include <deque>
+#include <list>
 #include <stdint.h>
 #include <thread>
+#include <unordered_map>
 #include <memory>
 #include <condition_variable>
 
@@ -39,6 +42,7 @@
 class CScheduler;
 class CNode;
 class BanMan;
+class UdpBlockRelay;
 
 /** Default for -whitelistrelay. */
 static const bool DEFAULT_WHITELISTRELAY = true;
@@ -55,10 +59,19 @@ static const int FEELER_INTERVAL = 120;
 static const unsigned int MAX_INV_SZ = 50000;
 /** The maximum number of entries in a locator */
 static const unsigned int MAX_LOCATOR_SZ = 101;
+/** Bounds on the number of transactions a peer's known-inventory filter is sized for */
+static const unsigned int MIN_INVENTORY_KNOWN_ELEMENTS = 1000;
+static const unsigned int MAX_INVENTORY_KNOWN_ELEMENTS = 50000;
+/** How long a peer's known-inventory filter should at least remember a transaction */
+static constexpr std::chrono::seconds INVENTORY_KNOWN_MIN_AGE{std::chrono::hours{1}};
 /** The maximum number of new addresses to accumulate before announcing. */
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
 /** Maximum length of incoming protocol messages (no message over 4 MB is currently acceptable). */
 static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 4 * 1000 * 1000;
+/** Version of the message compression offered in "sendcmpr": "cmpr" messages holding LZ4 blocks */
+static const uint32_t P2P_COMPRESSION_VERSION = 1;
+/** Payloads of block, headers, blocktxn and addr messages from this size on are sent compressed to peers that support it */
+static const size_t MIN_COMPRESSED_MESSAGE_SIZE = 1024;
 /** Maximum length of the user agent string in `version` message */
 static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 /** Maximum number of automatic outgoing nodes over which we'll relay everything (blocks, tx, addrs, etc) */
@@ -67,6 +80,8 @@ static const int MAX_OUTBOUND_FULL_RELAY_CONNECTIONS = 20;
 static const int MAX_ADDNODE_CONNECTIONS = 20;
 /** Maximum number of block-relay-only outgoing connections */
 static const int MAX_BLOCKS_ONLY_CONNECTIONS = 2;
+/** Maximum number of automatic outgoing connection attempts in progress at once */
+static const unsigned int MAX_PARALLEL_DIALS = 8;
 /** -listen default */
 static const bool DEFAULT_LISTEN = true;
 /** -upnp default */
@@ -86,6 +101,31 @@ static const bool DEFAULT_BLOCKSONLY = false;
 /** -peertimeout default */
 static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
 
+/** Default for -msghandlerthreads: 0 = serve block requests on the message handler thread */
+static const int DEFAULT_MSGHANDLER_THREADS = 0;
+/** Maximum number of -msghandlerthreads */
+static const int MAX_MSGHANDLER_THREADS = 16;
+/** Default for -sendcoalesce: hold back sends while SendMessages runs for a peer, and send its messages together. */
+static const bool DEFAULT_SEND_COALESCE = true;
+
+/** Socket readiness notification backends, selected with -netevents */
+enum class NetEventsMode {
+    SELECT,
+    POLL,
+    EPOLL,
+};
+/** -netevents default: poll where it is usable, select elsewhere */
+#ifdef USE_POLL
+static const NetEventsMode DEFAULT_NET_EVENTS = NetEventsMode::POLL;
+#else
+static const NetEventsMode DEFAULT_NET_EVENTS = NetEventsMode::SELECT;
+#endif
+/** Parse a -netevents value, returning false if it is unknown or not available on this platform */
+bool ParseNetEventsMode(const std::string& str, NetEventsMode& mode);
+std::string NetEventsModeName(NetEventsMode mode);
+/** Comma separated list of the -netevents values available on this platform */
+std::string AvailableNetEventsModes();
+
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
@@ -114,6 +154,51 @@ struct CSerializedNetMsg
 
     std::vector<unsigned char> data;
     std::string command;
+
+    //! Payload borrowed from immutable memory kept alive by shared_owner (e.g.
+    //! a memory mapped block file), used instead of data when shared_owner is set.
+    std::shared_ptr<const void> shared_owner;
+    Span<const unsigned char> shared_data;
+
+    Span<const unsigned char> Payload() const { return shared_owner ? shared_data : MakeSpan(data); }
+};
+
+/** One entry of a node's send queue: owned bytes, or bytes borrowed from a CSerializedNetMsg shared payload. */
+class CSendChunk
+{
+    std::vector<unsigned char> m_owned;
+    std::shared_ptr<const void> m_owner;
+    Span<const unsigned char> m_borrowed;
+    bool m_ends_message{false};
+
+public:
+    explicit CSendChunk(std::vector<unsigned char>&& owned) : m_owned(std::move(owned)) {}
+    CSendChunk(std::shared_ptr<const void> owner, Span<const unsigned char> borrowed) : m_owner(std::move(owner)), m_borrowed(borrowed) {}
+
+    const unsigned char* data() const { return m_owner ? m_borrowed.data() : m_owned.data(); }
+    size_t size() const { return m_owner ? m_borrowed.size() : m_owned.size(); }
+    //! Whether this is the last chunk of a message, after which another queue may be sent from.
+    bool EndsMessage() const { return m_ends_message; }
+    void SetEndsMessage() { m_ends_message = true; }
+};
+
+/** Classes of a peer's send queue, sent from in this order. */
+enum class SendPriority : uint8_t {
+    BLOCK,   //!< Blocks, compact blocks and headers
+    CONTROL, //!< Everything not in another class
+    TX,      //!< Transaction and address relay
+};
+static constexpr size_t NUM_SEND_PRIORITIES = 3;
+
+/** Send queue class of a message type. */
+SendPriority GetSendPriority(const std::string& msg_type);
+/** Name of a send queue class, as shown by getpeerinfo. */
+std::string SendPriorityName(SendPriority priority);
+
+/** The messages of one send queue class, with their size. */
+struct CSendQueue {
+    std::deque<CSendChunk> chunks;
+    size_t bytes{0};
 };
 
 
@@ -146,6 +231,10 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        NetEventsMode m_net_events = DEFAULT_NET_EVENTS;
+        int m_msghandler_threads = DEFAULT_MSGHANDLER_THREADS;
+        bool m_send_coalesce = DEFAULT_SEND_COALESCE;
+        uint16_t m_udp_relay_port = 0;
         std::vector<std::string> vSeedNodes;
         std::vector<NetWhitelistPermissions> vWhitelistedRange;
         std::vector<NetWhitebindPermissions> vWhiteBinds;
@@ -153,7 +242,7 @@ public:
         bool m_use_addrman_outgoing = true;
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
-        std::vector<bool> m_asmap;
+        Asmap m_asmap;
     };
 
     void Init(const Options& connOptions) {
@@ -172,6 +261,9 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        m_net_events = connOptions.m_net_events;
+        m_msghandler_threads = connOptions.m_msghandler_threads;
+        m_send_coalesce = connOptions.m_send_coalesce;
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -205,8 +297,38 @@ public:
 
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
+    /**
+     * Run task on the peer worker thread that pnode is sharded to
+     * (-msghandlerthreads), keeping pnode referenced until it has run. Tasks
+     * for one peer run in order, and CNode::m_peer_tasks counts those not yet
+     * finished. Returns false, without running task, if there are no workers.
+     */
+    bool PostPeerTask(CNode* pnode, std::function<void()> task);
+
+    /**
+     * Hand a message that reached us outside of a peer's connection to the
+     * message handler, as if the peer had sent it. Returns false if the peer
+     * is gone or not fully connected, or its receive queue is full.
+     */
+    bool DeliverMessage(NodeId id, const std::string& msg_type, std::vector<unsigned char>&& payload);
+
+    /** The UDP block relay, if -udprelayport is set. */
+    UdpBlockRelay* GetUdpRelay() const { return m_udp_relay.get(); }
+
+    /**
+     * Queue a message for sending to a peer. Messages that are to be sent
+     * compressed are compressed on the peer's worker thread, if there is one,
+     * and the ones pushed after them are queued there too to keep them in order.
+     */
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
 
+    /**
+     * Queue the messages pushed to a peer from now on without trying to send
+     * them right away, until UncorkSend() sends them all at once.
+     */
+    void CorkSend(CNode* pnode);
+    void UncorkSend(CNode* pnode);
+
     template<typename Callable>
     void ForEachNode(Callable&& func)
     {
@@ -310,7 +432,11 @@ public:
     uint64_t GetMaxOutboundTimeLeftInCycle();
 
     uint64_t GetTotalBytesRecv();
+    //! Memory held by all peers' receive buffers, in use or pooled.
+    size_t GetRecvBufferMemory();
     uint64_t GetTotalBytesSent();
+    //! Bytes received and sent per message type, over all peers since startup.
+    void GetBytesPerMsgType(std::map<std::string, uint64_t>& recv, std::map<std::string, uint64_t>& sent);
 
     void SetBestHeight(int height);
     int GetBestHeight() const;
@@ -354,8 +480,19 @@ private:
     void InactivityCheck(CNode *pnode);
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#ifdef USE_POLL
+    void SocketEventsPoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#else
+    void SocketEventsSelect(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#endif
+#ifdef USE_EPOLL
+    bool SocketEventsEpoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#endif
     void SocketHandler();
     void ThreadSocketHandler();
+    void ThreadLoadAddresses();
+    //! Wait until peers.dat is loaded. Returns false if interrupted.
+    bool WaitForAddresses();
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress& ad) const;
@@ -398,6 +535,20 @@ private:
     // P2P timeout in seconds
     int64_t m_peer_connect_timeout;
 
+    /** Readiness backend used by SocketHandler. Only accessed by the socket handler thread after Init. */
+    NetEventsMode m_net_events{DEFAULT_NET_EVENTS};
+#ifdef USE_EPOLL
+    /** Registration of a socket in the epoll set. owner tells a reused socket number apart (-1 for listen sockets). */
+    struct EpollRegistration {
+        NodeId owner;
+        uint32_t events;
+        uint64_t generation;
+    };
+    int m_epoll_fd{-1};
+    uint64_t m_epoll_generation{0};
+    std::unordered_map<SOCKET, EpollRegistration> m_epoll_sockets;
+#endif
+
     // Whitelisted ranges. Any node connecting from these is automatically
     // whitelisted (as well as those connecting to whitelisted binds).
     std::vector<NetWhitelistPermissions> vWhitelistedRange;
@@ -407,7 +558,8 @@ private:
 
     std::vector<ListenSocket> vhListenSocket;
     std::atomic<bool> fNetworkActive{true};
-    bool fAddressesInitialized{false};
+    //! Set once peers.dat has been loaded (or recreated); addrman is not dumped before that.
+    std::atomic<bool> fAddressesInitialized{false};
     CAddrMan addrman;
     std::deque<std::string> vOneShots GUARDED_BY(cs_vOneShots);
     RecursiveMutex cs_vOneShots;
@@ -416,6 +568,9 @@ private:
     std::vector<CNode*> vNodes GUARDED_BY(cs_vNodes);
     std::list<CNode*> vNodesDisconnected;
     mutable RecursiveMutex cs_vNodes;
+    //! Per-message-type byte counts of peers no longer in vNodes.
+    std::map<std::string, uint64_t> m_disconnected_recv_bytes GUARDED_BY(cs_vNodes);
+    std::map<std::string, uint64_t> m_disconnected_sent_bytes GUARDED_BY(cs_vNodes);
     std::atomic<NodeId> nLastNodeId{0};
     unsigned int nPrevNodeCount{0};
 
@@ -465,11 +620,51 @@ private:
 
     CThreadInterrupt interruptNet;
 
+    std::thread threadLoadAddresses;
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
+    std::thread threadUdpRelay;
+
+    /** A peer worker thread and its queue of tasks, see PostPeerTask */
+    struct PeerWorker {
+        Mutex m_mutex;
+        std::condition_variable m_cv;
+        std::deque<std::pair<CNode*, std::function<void()>>> m_tasks GUARDED_BY(m_mutex);
+        std::thread m_thread;
+    };
+    int m_msghandler_threads{DEFAULT_MSGHANDLER_THREADS};
+    bool m_send_coalesce{DEFAULT_SEND_COALESCE};
+    std::vector<std::unique_ptr<PeerWorker>> m_peer_workers;
+    void ThreadPeerWorker(PeerWorker& worker);
+    /** Kept until the peers are finalized, which unregisters them from it */
+    std::unique_ptr<UdpBlockRelay> m_udp_relay;
+    /** Compress a message if the peer supports it, and add it to the peer's send queue. */
+    void QueueMessage(CNode* pnode, CSerializedNetMsg&& msg);
+
+    /** An automatic outgoing connection attempt, holding its outbound slot until it is made */
+    struct OutboundDial {
+        CAddress m_addr;
+        bool m_count_failure;
+        bool m_feeler;
+        bool m_block_relay_only;
+        CSemaphoreGrant m_grant;
+        bool m_started{false};
+
+        OutboundDial(const CAddress& addr, bool count_failure, bool feeler, bool block_relay_only, CSemaphoreGrant& grant)
+            : m_addr(addr), m_count_failure(count_failure), m_feeler(feeler), m_block_relay_only(block_relay_only)
+        {
+            grant.MoveTo(m_grant);
+        }
+    };
+    Mutex m_dials_mutex;
+    std::condition_variable m_dials_cv;
+    /** Attempts queued by ThreadOpenConnections or being made by a dial thread */
+    std::list<OutboundDial> m_dials GUARDED_BY(m_dials_mutex);
+    std::vector<std::thread> m_dial_threads;
+    void ThreadDial();
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of m_max_outbound_full_relay
@@ -590,6 +785,8 @@ public:
     int nStartingHeight;
     uint64_t nSendBytes;
     mapMsgCmdSize mapSendBytesPerMsgCmd;
+    // Bytes queued for sending in each send queue class
+    std::array<uint64_t, NUM_SEND_PRIORITIES> m_send_queue_bytes;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
     NetPermissionFlags m_permissionFlags;
@@ -598,6 +795,15 @@ public:
     int64_t m_ping_wait_usec;
     int64_t m_min_ping_usec;
     CAmount minFeeFilter;
+    // Memory used by the filter of transactions the peer knows about
+    size_t m_inv_known_bytes;
+    // Whether we send compressed messages to the peer
+    bool m_compress_send;
+    // Payload bytes of the messages sent and received compressed, on the wire and uncompressed
+    uint64_t m_compressed_bytes_sent;
+    uint64_t m_uncompressed_bytes_sent;
+    uint64_t m_compressed_bytes_recv;
+    uint64_t m_uncompressed_bytes_recv;
     // Our address, as reported by the peer
     std::string addrLocal;
     // Address of this peer
@@ -613,9 +819,36 @@ public:
  * Ideally it should only contain receive time, payload,
  * command and size.
  */
+/**
+ * Receive buffers of one peer, kept for reuse by its next messages so that
+ * most messages don't allocate. Buffers that grew past
+ * MAX_POOLED_RECV_BUFFER_SIZE are freed instead of pooled, and every
+ * RECV_POOL_TRIM_INTERVAL returns the pool is trimmed down to the most
+ * buffers that were in use at once since the previous trim.
+ */
+class RecvBufferPool
+{
+public:
+    //! An empty buffer, with a previously used allocation if there is one.
+    CSerializeData Get();
+    //! Return a buffer obtained from Get().
+    void Put(CSerializeData&& buffer);
+    //! Memory held by the pooled (unused) buffers.
+    size_t PooledBytes() const;
+
+private:
+    mutable Mutex m_mutex;
+    std::vector<CSerializeData> m_buffers GUARDED_BY(m_mutex);
+    size_t m_pooled_bytes GUARDED_BY(m_mutex){0};
+    size_t m_in_use GUARDED_BY(m_mutex){0};
+    size_t m_high_water GUARDED_BY(m_mutex){0};
+    unsigned int m_returned GUARDED_BY(m_mutex){0};
+};
+
 class CNetMessage {
 public:
     CDataStream m_recv;                  // received message data
+    std::shared_ptr<RecvBufferPool> m_recv_pool; // where m_recv's buffer goes back to, if any
     int64_t m_time = 0;                  // time (in microseconds) of message receipt.
     bool m_valid_netmagic = false;
     bool m_valid_header = false;
@@ -625,6 +858,9 @@ public:
     std::string m_command;
 
     CNetMessage(CDataStream&& recv_in) : m_recv(std::move(recv_in)) {}
+    CNetMessage(CNetMessage&&) = default;
+    CNetMessage& operator=(CNetMessage&&) = default;
+    ~CNetMessage();
 
     void SetVersion(int nVersionIn)
     {
@@ -646,6 +882,8 @@ public:
     virtual int Read(const char *data, unsigned int bytes) = 0;
     // decomposes a message from the context
     virtual CNetMessage GetMessage(const CMessageHeader::MessageStartChars& message_start, int64_t time) = 0;
+    // memory held by the buffer of the message being received
+    virtual size_t GetMemoryUsage() const = 0;
     virtual ~TransportDeserializer() {}
 };
 
@@ -658,6 +896,7 @@ private:
     CDataStream hdrbuf;             // partially received header
     CMessageHeader hdr;             // complete header
     CDataStream vRecv;              // received message data
+    std::shared_ptr<RecvBufferPool> m_recv_pool; // source of vRecv's buffers, if any
     unsigned int nHdrPos;
     unsigned int nDataPos;
 
@@ -678,7 +917,7 @@ private:
 
 public:
 
-    V1TransportDeserializer(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
+    V1TransportDeserializer(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn, std::shared_ptr<RecvBufferPool> recv_pool = nullptr) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn), m_recv_pool(std::move(recv_pool)) {
         Reset();
     }
 
@@ -699,6 +938,7 @@ public:
         return ret;
     }
     CNetMessage GetMessage(const CMessageHeader::MessageStartChars& message_start, int64_t time) override;
+    size_t GetMemoryUsage() const override { return vRecv.capacity(); }
 };
 
 /** The TransportSerializer prepares messages for the network transport
@@ -724,14 +964,32 @@ class CNode
 public:
     std::unique_ptr<TransportDeserializer> m_deserializer;
     std::unique_ptr<TransportSerializer> m_serializer;
+    //! Receive buffers reused across this peer's messages.
+    const std::shared_ptr<RecvBufferPool> m_recv_pool{std::make_shared<RecvBufferPool>()};
 
     // socket
     std::atomic<ServiceFlags> nServices{NODE_NONE};
     SOCKET hSocket GUARDED_BY(cs_hSocket);
-    size_t nSendSize{0}; // total size of all vSendMsg entries
-    size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
+    size_t nSendSize{0}; // total size of all send queue entries
+    size_t nSendOffset{0}; // offset inside the first chunk being sent already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    //! Send queues, by SendPriority. Messages are sent from the first non-empty one.
+    std::array<CSendQueue, NUM_SEND_PRIORITIES> m_send_queues GUARDED_BY(cs_vSend);
+    //! Queue whose first message has been partly sent, and is finished before anything else, or -1.
+    int m_send_in_progress GUARDED_BY(cs_vSend){-1};
+    //! Whether messages are queued by priority yet. Until the messages queued
+    //! during the version handshake are sent, everything is sent in order, so
+    //! that nothing overtakes our verack.
+    bool m_send_prioritized GUARDED_BY(cs_vSend){false};
+    bool HasQueuedSends() const EXCLUSIVE_LOCKS_REQUIRED(cs_vSend)
+    {
+        for (const CSendQueue& queue : m_send_queues) {
+            if (!queue.chunks.empty()) return true;
+        }
+        return false;
+    }
+    //! While set, PushMessage only queues; see CConnman::CorkSend().
+    bool m_send_corked GUARDED_BY(cs_vSend){false};
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -784,6 +1042,19 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
+    //! Tasks posted for this peer with CConnman::PostPeerTask, or blocks from it on the block validation thread, that have not finished yet
+    std::atomic<int> m_peer_tasks{0};
+    //! Whether we sent the peer "sendcmpr", so that it may send us compressed messages
+    std::atomic_bool m_compression_offered{false};
+    //! Whether the peer sent us "sendcmpr" and we compress messages to it
+    std::atomic_bool m_compress_send{false};
+    //! Messages pushed to this peer that wait to be queued on its worker thread, see CConnman::PushMessage
+    std::atomic<int> m_deferred_sends{0};
+    //! Payload bytes of the messages sent and received compressed, on the wire and uncompressed
+    std::atomic<uint64_t> m_compressed_bytes_sent{0};
+    std::atomic<uint64_t> m_uncompressed_bytes_sent{0};
+    std::atomic<uint64_t> m_compressed_bytes_recv{0};
+    std::atomic<uint64_t> m_uncompressed_bytes_recv{0};
 
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -817,9 +1088,12 @@ public:
         //    unless it loads a bloom filter.
         bool fRelayTxes GUARDED_BY(cs_filter){false};
         std::unique_ptr<CBloomFilter> pfilter PT_GUARDED_BY(cs_filter) GUARDED_BY(cs_filter);
+        // Time left for building this peer's filtered blocks (-maxbloomcpu), and when it was last topped up
+        int64_t m_bloom_cpu_budget GUARDED_BY(cs_filter){0};
+        int64_t m_bloom_cpu_refilled GUARDED_BY(cs_filter){0};
 
         mutable RecursiveMutex cs_tx_inventory;
-        CRollingBloomFilter filterInventoryKnown GUARDED_BY(cs_tx_inventory){50000, 0.000001};
+        CAdaptiveRollingBloomFilter filterInventoryKnown GUARDED_BY(cs_tx_inventory){MIN_INVENTORY_KNOWN_ELEMENTS, MAX_INVENTORY_KNOWN_ELEMENTS, 0.000001, INVENTORY_KNOWN_MIN_AGE};
         // Set of transaction ids we still have to announce.
         // They are sorted by the mempool before relay, so the order is not important.
         std::set<uint256> setInventoryTxToSend;
@@ -998,7 +1272,7 @@ public:
 
     void CloseSocketDisconnect();
 
-    void copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap);
+    void copyStats(CNodeStats &stats, const Asmap &m_asmap);
 
     ServiceFlags GetLocalServices() const
     {
@@ -22,6 +22,9 @@ enum NetPermissionFlags
     PF_NOBAN = (1U << 4),
     // Can query the mempool
     PF_MEMPOOL = (1U << 5),
+    // Exchange new blocks over UDP, if -udprelayport is set. Not part of "all":
+    // it makes us send datagrams to the peer's address.
+    PF_UDPRELAY = (1U << 6),
 
     // True if the user did not specifically set fine grained permissions
     PF_ISIMPLICIT = (1U << 31),
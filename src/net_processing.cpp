@@ -15,6 +15,7 @@
 #include <merkleblock.h>
 #include <netmessagemaker.h>
 #include <netbase.h>
+#include <node/args_snapshot.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <primitives/block.h>
@@ -24,20 +25,26 @@
 #include <scheduler.h>
 #include <tinyformat.h>
 #include <txmempool.h>
+#include <txorphanage.h>
+#include <txreconciliation.h>
+#include <udprelay.h>
+#include <txrequest.h>
+#include <util/memory.h>
+#include <util/perfstats.h>
 #include <util/system.h>
 #include <util/strencodings.h>
+#include <util/trace.h>
 
+#include <list>
 #include <memory>
+#include <tuple>
 #include <typeinfo>
+#include <unordered_map>
 
 #if defined(NDEBUG)
 # error "Palladium cannot be compiled without assertions."
 #endif
 
-/** Expiration time for orphan transactions in seconds */
-static constexpr int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
-/** Minimum time between orphan transactions expire time checks in seconds */
-static constexpr int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 /** How long to cache transactions in mapRelay for normal relay */
 static constexpr std::chrono::seconds RELAY_TX_CACHE_TIME{15 * 60};
 /** Headers download timeout expressed in microseconds
@@ -82,17 +89,6 @@ static_assert(INBOUND_PEER_TX_DELAY >= MAX_GETDATA_RANDOM_DELAY,
 static const unsigned int MAX_GETDATA_SZ = 1000;
 
 
-struct COrphanTx {
-    // When modifying, adapt the copy of this definition in tests/DoS_tests.
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-    size_t list_pos;
-};
-RecursiveMutex g_cs_orphans;
-std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
-
-void EraseOrphansFor(NodeId peer);
 
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="") EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -111,6 +107,13 @@ static constexpr unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_
 static constexpr unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
 static constexpr unsigned int MAX_FEEFILTER_CHANGE_DELAY = 5 * 60;
+/** Average time (in microseconds) from requesting a block to receiving it beyond which
+ *  -adaptiveblockdownload requests fewer blocks at once from a peer. Keeping it at the
+ *  stalling timeout lets a peer deliver the whole queue before it would be taken as stalling. */
+static constexpr int64_t ADAPTIVE_BLOCK_LATENCY_TARGET = 1000000 * BLOCK_STALLING_TIMEOUT;
+/** How long after entering our mempool a transaction not announced to a
+ *  high-bandwidth peer is still assumed to be missing there (-cmpctprefill). */
+static constexpr std::chrono::seconds CMPCT_PREFILL_RECENT_TX{60};
 
 // Internal stuff
 namespace {
@@ -155,12 +158,22 @@ namespace {
     RecursiveMutex g_cs_recent_confirmed_transactions;
     std::unique_ptr<CRollingBloomFilter> g_recent_confirmed_transactions GUARDED_BY(g_cs_recent_confirmed_transactions);
 
+    /** Transaction reconciliation state of our peers, if -txreconciliation is enabled. */
+    std::unique_ptr<TxReconciliationTracker> g_txreconciliation;
+
+    /** Whether the number of blocks requested from each peer is adapted to its download rate (-adaptiveblockdownload). */
+    bool g_adaptive_block_download = DEFAULT_ADAPTIVE_BLOCK_DOWNLOAD;
+
+    /** Whether we offer and accept compressed block, headers, blocktxn and addr messages (-p2pcompression). */
+    bool g_p2p_compression = DEFAULT_P2P_COMPRESSION;
+
     /** Blocks that are in flight, and that are in the queue to be downloaded. */
     struct QueuedBlock {
         uint256 hash;
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTimeRequested;                                  //!< When the block was requested (in microseconds).
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight GUARDED_BY(cs_main);
 
@@ -185,20 +198,21 @@ namespace {
     /** Expiration-time ordered list of (expire time, relay map entry) pairs. */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration GUARDED_BY(cs_main);
 
-    struct IteratorComparator
-    {
-        template<typename I>
-        bool operator()(const I& a, const I& b) const
-        {
-            return &(*a) < &(*b);
-        }
-    };
-    std::map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
+    /** Transactions we are missing the parents of. */
+    TxOrphanage g_orphanage;
 
-    std::vector<std::map<uint256, COrphanTx>::iterator> g_orphan_list GUARDED_BY(g_cs_orphans); //! For random eviction
+    /** Transaction announcements from all peers, see TxRequestTracker. */
+    TxRequestTracker g_txrequest GUARDED_BY(cs_main){GETDATA_TX_INTERVAL, TX_EXPIRY_INTERVAL};
 
     static size_t vExtraTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
     static std::vector<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUARDED_BY(g_cs_orphans);
+
+    /**
+     * Peers whose further messages wait until the block validation thread
+     * (-asyncblockvalidation) has processed a block they sent, by block hash.
+     */
+    Mutex g_cs_blocks_processing;
+    std::multimap<uint256, NodeId> g_blocks_processing GUARDED_BY(g_cs_blocks_processing);
 } // namespace
 
 namespace {
@@ -240,6 +254,18 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Number of blocks that may be in flight from this peer at once.
+    int m_blocks_in_transit_limit;
+    //! Blocks received while m_blocks_in_transit_limit was reached, since it last grew.
+    int m_blocks_received_at_limit;
+    //! Average time from requesting a block to receiving it (in microseconds), or 0.
+    int64_t m_block_latency;
+    //! Average rate at which blocks arrive while downloading from this peer (in bytes per second), or 0.
+    int64_t m_block_download_rate;
+    //! When the last requested block from this peer arrived (in microseconds), or 0.
+    int64_t m_last_block_received;
+    //! How often the blocks in flight from this peer were requested elsewhere because it stalled.
+    int m_block_stalls;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -292,69 +318,6 @@ struct CNodeState {
     //! Time of last new block announcement
     int64_t m_last_block_announcement;
 
-    /*
-     * State associated with transaction download.
-     *
-     * Tx download algorithm:
-     *
-     *   When inv comes in, queue up (process_time, txid) inside the peer's
-     *   CNodeState (m_tx_process_time) as long as m_tx_announced for the peer
-     *   isn't too big (MAX_PEER_TX_ANNOUNCEMENTS).
-     *
-     *   The process_time for a transaction is set to nNow for outbound peers,
-     *   nNow + 2 seconds for inbound peers. This is the time at which we'll
-     *   consider trying to request the transaction from the peer in
-     *   SendMessages(). The delay for inbound peers is to allow outbound peers
-     *   a chance to announce before we request from inbound peers, to prevent
-     *   an adversary from using inbound connections to blind us to a
-     *   transaction (InvBlock).
-     *
-     *   When we call SendMessages() for a given peer,
-     *   we will loop over the transactions in m_tx_process_time, looking
-     *   at the transactions whose process_time <= nNow. We'll request each
-     *   such transaction that we don't have already and that hasn't been
-     *   requested from another peer recently, up until we hit the
-     *   MAX_PEER_TX_IN_FLIGHT limit for the peer. Then we'll update
-     *   g_already_asked_for for each requested txid, storing the time of the
-     *   GETDATA request. We use g_already_asked_for to coordinate transaction
-     *   requests amongst our peers.
-     *
-     *   For transactions that we still need but we have already recently
-     *   requested from some other peer, we'll reinsert (process_time, txid)
-     *   back into the peer's m_tx_process_time at the point in the future at
-     *   which the most recent GETDATA request would time out (ie
-     *   GETDATA_TX_INTERVAL + the request time stored in g_already_asked_for).
-     *   We add an additional delay for inbound peers, again to prefer
-     *   attempting download from outbound peers first.
-     *   We also add an extra small random delay up to 2 seconds
-     *   to avoid biasing some peers over others. (e.g., due to fixed ordering
-     *   of peer processing in ThreadMessageHandler).
-     *
-     *   When we receive a transaction from a peer, we remove the txid from the
-     *   peer's m_tx_in_flight set and from their recently announced set
-     *   (m_tx_announced).  We also clear g_already_asked_for for that entry, so
-     *   that if somehow the transaction is not accepted but also not added to
-     *   the reject filter, then we will eventually redownload from other
-     *   peers.
-     */
-    struct TxDownloadState {
-        /* Track when to attempt download of announced transactions (process
-         * time in micros -> txid)
-         */
-        std::multimap<std::chrono::microseconds, uint256> m_tx_process_time;
-
-        //! Store all the transactions a peer has recently announced
-        std::set<uint256> m_tx_announced;
-
-        //! Store transactions which were requested by us, with timestamp
-        std::map<uint256, std::chrono::microseconds> m_tx_in_flight;
-
-        //! Periodically check for stuck getdata requests
-        std::chrono::microseconds m_check_expiry_timer{0};
-    };
-
-    TxDownloadState m_tx_download;
-
     //! Whether this peer is an inbound connection
     bool m_is_inbound;
 
@@ -379,6 +342,12 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        m_blocks_in_transit_limit = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+        m_blocks_received_at_limit = 0;
+        m_block_latency = 0;
+        m_block_download_rate = 0;
+        m_last_block_received = 0;
+        m_block_stalls = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
@@ -391,9 +360,6 @@ struct CNodeState {
     }
 };
 
-// Keeps track of the time (in microseconds) when transactions were requested last time
-limitedmap<uint256, std::chrono::microseconds> g_already_asked_for GUARDED_BY(cs_main)(MAX_INV_SZ);
-
 /** Map maintaining per-node state. */
 static std::map<NodeId, CNodeState> mapNodeState GUARDED_BY(cs_main);
 
@@ -463,6 +429,39 @@ static bool MarkBlockAsReceived(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs
     return false;
 }
 
+/**
+ * Update the download statistics of a peer that sent us a block we requested
+ * from it, and with -adaptiveblockdownload, the number of blocks to request
+ * from it at once: grow it while the peer keeps up with a full queue, shrink
+ * it when blocks take longer than ADAPTIVE_BLOCK_LATENCY_TARGET to arrive.
+ * Must be called before MarkBlockAsReceived.
+ */
+static void RecordBlockDownload(NodeId nodeid, const uint256& hash, size_t size) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid) return;
+    CNodeState* state = State(nodeid);
+    assert(state != nullptr);
+    const int64_t now = GetTimeMicros();
+    const int64_t requested = itInFlight->second.second->nTimeRequested;
+    const int64_t latency = std::max<int64_t>(now - requested, 1);
+    // Blocks queued behind another one only take the time since that one arrived.
+    const int64_t rate = size * 1000000 / std::max<int64_t>(now - std::max(requested, state->m_last_block_received), 1);
+    state->m_block_latency = state->m_block_latency ? (state->m_block_latency * 7 + latency) / 8 : latency;
+    state->m_block_download_rate = state->m_block_download_rate ? (state->m_block_download_rate * 7 + rate) / 8 : rate;
+    state->m_last_block_received = now;
+    if (!g_adaptive_block_download) return;
+
+    int& limit = state->m_blocks_in_transit_limit;
+    if (state->m_block_latency > ADAPTIVE_BLOCK_LATENCY_TARGET) {
+        limit = std::max(limit - 1, MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+        state->m_blocks_received_at_limit = 0;
+    } else if (state->nBlocksInFlight >= limit && ++state->m_blocks_received_at_limit >= 4) {
+        limit = std::min(limit + 1, MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+        state->m_blocks_received_at_limit = 0;
+    }
+}
+
 // returns false, still setting pit, if the block was already in flight from the same peer
 // pit will only be valid as long as the same cs_main lock is being held
 static bool MarkBlockAsInFlight(CTxMemPool& mempool, NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr, std::list<QueuedBlock>::iterator** pit = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
@@ -482,7 +481,7 @@ static bool MarkBlockAsInFlight(CTxMemPool& mempool, NodeId nodeid, const uint25
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -542,6 +541,8 @@ static void UpdateBlockAvailability(NodeId nodeid, const uint256 &hash) EXCLUSIV
 static void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid, CConnman* connman) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     AssertLockHeld(cs_main);
+    const size_t max_hb_peers = GetArgsSnapshot().max_cmpct_hb_peers;
+    if (max_hb_peers == 0) return;
     CNodeState* nodestate = State(nodeid);
     if (!nodestate || !nodestate->fSupportsDesiredCmpctVersion) {
         // Never ask from peers who can't provide witnesses.
@@ -555,12 +556,12 @@ static void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid, CConnman* connma
                 return;
             }
         }
-        connman->ForNode(nodeid, [connman](CNode* pfrom){
+        connman->ForNode(nodeid, [connman, max_hb_peers](CNode* pfrom){
             AssertLockHeld(cs_main);
             uint64_t nCMPCTBLOCKVersion = (pfrom->GetLocalServices() & NODE_WITNESS) ? 2 : 1;
-            if (lNodesAnnouncingHeaderAndIDs.size() >= 3) {
-                // As per BIP152, we only get 3 of our peers to announce
-                // blocks using compact encodings.
+            if (lNodesAnnouncingHeaderAndIDs.size() >= max_hb_peers) {
+                // As per BIP152, we only get a few (by default 3) of our peers
+                // to announce blocks using compact encodings.
                 connman->ForNode(lNodesAnnouncingHeaderAndIDs.front(), [connman, nCMPCTBLOCKVersion](CNode* pnodeStop){
                     AssertLockHeld(cs_main);
                     connman->PushMessage(pnodeStop, CNetMsgMaker(pnodeStop->GetSendVersion()).Make(NetMsgType::SENDCMPCT, /*fAnnounceUsingCMPCTBLOCK=*/false, nCMPCTBLOCKVersion));
@@ -687,34 +688,10 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
     }
 }
 
-void EraseTxRequest(const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    g_already_asked_for.erase(txid);
-}
-
-std::chrono::microseconds GetTxRequestTime(const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    auto it = g_already_asked_for.find(txid);
-    if (it != g_already_asked_for.end()) {
-        return it->second;
-    }
-    return {};
-}
-
-void UpdateTxRequestTime(const uint256& txid, std::chrono::microseconds request_time) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    auto it = g_already_asked_for.find(txid);
-    if (it == g_already_asked_for.end()) {
-        g_already_asked_for.insert(std::make_pair(txid, request_time));
-    } else {
-        g_already_asked_for.update(it, request_time);
-    }
-}
-
 std::chrono::microseconds CalculateTxGetDataTime(const uint256& txid, std::chrono::microseconds current_time, bool use_inbound_delay) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     std::chrono::microseconds process_time;
-    const auto last_request_time = GetTxRequestTime(txid);
+    const auto last_request_time = g_txrequest.GetRequestTime(txid);
     // First time requesting this tx
     if (last_request_time.count() == 0) {
         process_time = current_time;
@@ -730,23 +707,47 @@ std::chrono::microseconds CalculateTxGetDataTime(const uint256& txid, std::chron
     return process_time;
 }
 
-void RequestTx(CNodeState* state, const uint256& txid, std::chrono::microseconds current_time) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+/*
+ * Tx download algorithm:
+ *
+ *   When inv comes in, add the announcement to g_txrequest as long as the
+ *   peer doesn't have too many announcements (MAX_PEER_TX_ANNOUNCEMENTS)
+ *   already, to be considered for requesting at its process time.
+ *
+ *   The process_time for a transaction is set to nNow for outbound peers,
+ *   nNow + 2 seconds for inbound peers. The delay for inbound peers is to
+ *   allow outbound peers a chance to announce before we request from inbound
+ *   peers, to prevent an adversary from using inbound connections to blind
+ *   us to a transaction (InvBlock).
+ *
+ *   When we call SendMessages() for a given peer, we request the transactions
+ *   it announced whose process_time <= nNow, that we don't have already and
+ *   that haven't been requested from another peer recently, up until we hit
+ *   the MAX_PEER_TX_IN_FLIGHT limit for the peer. g_txrequest coordinates
+ *   requests amongst our peers: announcements of transactions we requested
+ *   from some other peer less than GETDATA_TX_INTERVAL ago are delayed until
+ *   that request would time out, plus the inbound delay and a small random
+ *   delay up to 2 seconds to avoid biasing some peers over others (e.g., due
+ *   to fixed ordering of peer processing in ThreadMessageHandler).
+ *
+ *   When we receive a transaction or a NOTFOUND from a peer, we drop its
+ *   announcement. Once we have the transaction, all announcements of it are
+ *   dropped. Requests that stay unanswered for TX_EXPIRY_INTERVAL are
+ *   dropped too, so that we resume downloading from a peer even if it was
+ *   unresponsive in the past.
+ */
+void RequestTx(NodeId nodeid, const uint256& txid, std::chrono::microseconds current_time) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
-    CNodeState::TxDownloadState& peer_download_state = state->m_tx_download;
-    if (peer_download_state.m_tx_announced.size() >= MAX_PEER_TX_ANNOUNCEMENTS ||
-            peer_download_state.m_tx_process_time.size() >= MAX_PEER_TX_ANNOUNCEMENTS ||
-            peer_download_state.m_tx_announced.count(txid)) {
-        // Too many queued announcements from this peer, or we already have
-        // this announcement
+    if (g_txrequest.Count(nodeid) >= MAX_PEER_TX_ANNOUNCEMENTS) {
+        // Too many queued announcements from this peer
         return;
     }
-    peer_download_state.m_tx_announced.insert(txid);
 
     // Calculate the time to try requesting this transaction. Use
     // fPreferredDownload as a proxy for outbound peers.
-    const auto process_time = CalculateTxGetDataTime(txid, current_time, !state->fPreferredDownload);
+    const auto process_time = CalculateTxGetDataTime(txid, current_time, !State(nodeid)->fPreferredDownload);
 
-    peer_download_state.m_tx_process_time.emplace(process_time, txid);
+    g_txrequest.ReceivedInv(nodeid, txid, process_time);
 }
 
 } // namespace
@@ -795,7 +796,10 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     for (const QueuedBlock& entry : state->vBlocksInFlight) {
         mapBlocksInFlight.erase(entry.hash);
     }
-    EraseOrphansFor(nodeid);
+    WITH_LOCK(g_cs_orphans, g_orphanage.EraseForPeer(nodeid));
+    g_txrequest.DisconnectedPeer(nodeid);
+    if (g_txreconciliation) g_txreconciliation->ForgetPeer(nodeid);
+    if (UdpBlockRelay* udp_relay = connman->GetUdpRelay()) udp_relay->ForgetPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -807,6 +811,7 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     if (mapNodeState.empty()) {
         // Do a consistency check after the last peer is removed.
         assert(mapBlocksInFlight.empty());
+        assert(g_txrequest.Size() == 0);
         assert(nPreferredDownload == 0);
         assert(nPeersWithValidatedDownloads == 0);
         assert(g_outbound_peers_with_protect_from_disconnect == 0);
@@ -826,12 +831,16 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.m_blocks_in_transit_limit = state->m_blocks_in_transit_limit;
+    stats.m_block_latency = state->m_block_latency;
+    stats.m_block_download_rate = state->m_block_download_rate;
+    stats.m_block_stalls = state->m_block_stalls;
     return true;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// mapOrphanTransactions
+// vExtraTxnForCompact
 //
 
 static void AddToCompactExtraTransactions(const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
@@ -845,123 +854,6 @@ static void AddToCompactExtraTransactions(const CTransactionRef& tx) EXCLUSIVE_L
     vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % max_extra_txn;
 }
 
-bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
-{
-    const uint256& hash = tx->GetHash();
-    if (mapOrphanTransactions.count(hash))
-        return false;
-
-    // Ignore big transactions, to avoid a
-    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
-    // large transaction with a missing parent then we assume
-    // it will rebroadcast it later, after the parent transaction(s)
-    // have been mined or received.
-    // 100 orphans, each of which is at most 100,000 bytes big is
-    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
-    unsigned int sz = GetTransactionWeight(*tx);
-    if (sz > MAX_STANDARD_TX_WEIGHT)
-    {
-        LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
-        return false;
-    }
-
-    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, g_orphan_list.size()});
-    assert(ret.second);
-    g_orphan_list.push_back(ret.first);
-    for (const CTxIn& txin : tx->vin) {
-        mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
-    }
-
-    AddToCompactExtraTransactions(tx);
-
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
-    return true;
-}
-
-int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
-{
-    std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end())
-        return 0;
-    for (const CTxIn& txin : it->second.tx->vin)
-    {
-        auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-        if (itPrev == mapOrphanTransactionsByPrev.end())
-            continue;
-        itPrev->second.erase(it);
-        if (itPrev->second.empty())
-            mapOrphanTransactionsByPrev.erase(itPrev);
-    }
-
-    size_t old_pos = it->second.list_pos;
-    assert(g_orphan_list[old_pos] == it);
-    if (old_pos + 1 != g_orphan_list.size()) {
-        // Unless we're deleting the last entry in g_orphan_list, move the last
-        // entry to the position we're deleting.
-        auto it_last = g_orphan_list.back();
-        g_orphan_list[old_pos] = it_last;
-        it_last->second.list_pos = old_pos;
-    }
-    g_orphan_list.pop_back();
-
-    mapOrphanTransactions.erase(it);
-    return 1;
-}
-
-void EraseOrphansFor(NodeId peer)
-{
-    LOCK(g_cs_orphans);
-    int nErased = 0;
-    std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end())
-    {
-        std::map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
-        }
-    }
-    if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased, peer);
-}
-
-
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
-{
-    LOCK(g_cs_orphans);
-
-    unsigned int nEvicted = 0;
-    static int64_t nNextSweep;
-    int64_t nNow = GetTime();
-    if (nNextSweep <= nNow) {
-        // Sweep out expired orphan pool entries:
-        int nErased = 0;
-        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
-        std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-        while (iter != mapOrphanTransactions.end())
-        {
-            std::map<uint256, COrphanTx>::iterator maybeErase = iter++;
-            if (maybeErase->second.nTimeExpire <= nNow) {
-                nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
-            } else {
-                nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
-            }
-        }
-        // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
-        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
-        if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
-    }
-    FastRandomContext rng;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
-    {
-        // Evict a random orphan:
-        size_t randompos = rng.randrange(g_orphan_list.size());
-        EraseOrphanTx(g_orphan_list[randompos]->first);
-        ++nEvicted;
-    }
-    return nEvicted;
-}
-
 /**
  * Increment peer's misbehavior score. If the new value surpasses banscore (specified on startup or by default), mark node to be discouraged, meaning the peer might be disconnected & added to the discouragement filter.
  */
@@ -1106,6 +998,7 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CS
     : connman(connmanIn),
       m_banman(banman),
       m_mempool(pool),
+      m_tx_inv_order(pool),
       m_stale_tip_check_time(0)
 {
     // Initialize global variables that cannot be constructed at startup.
@@ -1121,49 +1014,33 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CS
     // same probability that we have in the reject filter).
     g_recent_confirmed_transactions.reset(new CRollingBloomFilter(24000, 0.000001));
 
+    g_adaptive_block_download = gArgs.GetBoolArg("-adaptiveblockdownload", DEFAULT_ADAPTIVE_BLOCK_DOWNLOAD);
+    g_p2p_compression = gArgs.GetBoolArg("-p2pcompression", DEFAULT_P2P_COMPRESSION);
+
+    if (gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION)) {
+        g_txreconciliation = MakeUnique<TxReconciliationTracker>();
+    } else {
+        g_txreconciliation.reset();
+    }
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
     // don't want them to get out of sync due to drift in the scheduler, so we
     // combine them in one function and schedule at the quicker (peer-eviction)
     // timer.
     static_assert(EXTRA_PEER_CHECK_INTERVAL < STALE_CHECK_INTERVAL, "peer eviction timer should be less than stale tip check timer");
-    scheduler.scheduleEvery([this, consensusParams] { this->CheckForStaleTipAndEvictPeers(consensusParams); }, std::chrono::seconds{EXTRA_PEER_CHECK_INTERVAL});
+    scheduler.scheduleEvery([this, consensusParams] { this->CheckForStaleTipAndEvictPeers(consensusParams); }, std::chrono::seconds{EXTRA_PEER_CHECK_INTERVAL}, "staletipcheck");
 }
 
 /**
- * Evict orphan txn pool entries (EraseOrphanTx) based on a newly connected
+ * Evict orphan txn pool entries based on a newly connected
  * block. Also save the time of the last tip update.
  */
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex)
 {
     {
         LOCK(g_cs_orphans);
-
-        std::vector<uint256> vOrphanErase;
-
-        for (const CTransactionRef& ptx : pblock->vtx) {
-            const CTransaction& tx = *ptx;
-
-            // Which orphan pool entries must we evict?
-            for (const auto& txin : tx.vin) {
-                auto itByPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-                if (itByPrev == mapOrphanTransactionsByPrev.end()) continue;
-                for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
-                    const CTransaction& orphanTx = *(*mi)->second.tx;
-                    const uint256& orphanHash = orphanTx.GetHash();
-                    vOrphanErase.push_back(orphanHash);
-                }
-            }
-        }
-
-        // Erase orphan transactions included or precluded by this block
-        if (vOrphanErase.size()) {
-            int nErased = 0;
-            for (const uint256& orphanHash : vOrphanErase) {
-                nErased += EraseOrphanTx(orphanHash);
-            }
-            LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx included or conflicted by block\n", nErased);
-        }
+        g_orphanage.EraseForBlock(*pblock);
 
         g_last_tip_update = GetTime();
     }
@@ -1196,6 +1073,187 @@ static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_bloc
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
 
+namespace {
+/**
+ * Byte-bounded LRU of serialized (witness) blocks recently served to peers,
+ * shared across peers so that bursts of peers fetching the same blocks only
+ * read them from disk once. Sized by -blockservecache; disabled when zero.
+ */
+class BlockServeCache
+{
+    using Entry = std::pair<uint256, std::shared_ptr<const std::vector<unsigned char>>>;
+
+    mutable Mutex m_mutex;
+    size_t m_max_bytes GUARDED_BY(m_mutex){0};
+    size_t m_bytes GUARDED_BY(m_mutex){0};
+    std::list<Entry> m_lru GUARDED_BY(m_mutex);
+    std::unordered_map<uint256, std::list<Entry>::iterator, BlockHasher> m_index GUARDED_BY(m_mutex);
+    uint64_t m_hits GUARDED_BY(m_mutex){0};
+    uint64_t m_misses GUARDED_BY(m_mutex){0};
+
+    void Trim() EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        while (m_bytes > m_max_bytes && !m_lru.empty()) {
+            m_bytes -= m_lru.back().second->size();
+            m_index.erase(m_lru.back().first);
+            m_lru.pop_back();
+        }
+    }
+
+public:
+    void SetMaxBytes(size_t max_bytes)
+    {
+        LOCK(m_mutex);
+        m_max_bytes = max_bytes;
+        Trim();
+    }
+
+    bool Enabled() const
+    {
+        LOCK(m_mutex);
+        return m_max_bytes > 0;
+    }
+
+    std::shared_ptr<const std::vector<unsigned char>> Get(const uint256& hash)
+    {
+        LOCK(m_mutex);
+        if (m_max_bytes == 0) return nullptr;
+        auto it = m_index.find(hash);
+        if (it == m_index.end()) {
+            ++m_misses;
+            return nullptr;
+        }
+        ++m_hits;
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return it->second->second;
+    }
+
+    void Add(const uint256& hash, std::shared_ptr<const std::vector<unsigned char>> block)
+    {
+        LOCK(m_mutex);
+        if (block->size() > m_max_bytes || m_index.count(hash)) return;
+        m_bytes += block->size();
+        m_lru.emplace_front(hash, std::move(block));
+        m_index.emplace(hash, m_lru.begin());
+        Trim();
+    }
+
+    BlockServeCacheStats GetStats() const
+    {
+        LOCK(m_mutex);
+        BlockServeCacheStats stats;
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        stats.entries = m_lru.size();
+        stats.bytes = m_bytes;
+        stats.max_bytes = m_max_bytes;
+        return stats;
+    }
+};
+
+BlockServeCache g_block_serve_cache;
+
+/**
+ * Filtered blocks recently built for peers, by block and by the state of the
+ * filter they were matched against. Peers with the same filter (e.g. a wallet
+ * reconnecting, or asking again) get the cached result together with the
+ * filter as updated by the matching, instead of matching the block again.
+ */
+class FilteredBlockCache
+{
+    struct Entry {
+        uint256 block_hash;
+        uint256 filter_hash;
+        CMerkleBlock merkle_block;
+        CBloomFilter filter_after;
+    };
+
+    static constexpr size_t MAX_ENTRIES = 16;
+
+    Mutex m_mutex;
+    std::list<Entry> m_lru GUARDED_BY(m_mutex);
+
+public:
+    bool Get(const uint256& block_hash, const uint256& filter_hash, CMerkleBlock& merkle_block, CBloomFilter& filter_after)
+    {
+        LOCK(m_mutex);
+        for (auto it = m_lru.begin(); it != m_lru.end(); ++it) {
+            if (it->block_hash == block_hash && it->filter_hash == filter_hash) {
+                m_lru.splice(m_lru.begin(), m_lru, it);
+                merkle_block = it->merkle_block;
+                filter_after = it->filter_after;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Add(const uint256& block_hash, const uint256& filter_hash, const CMerkleBlock& merkle_block, const CBloomFilter& filter_after)
+    {
+        LOCK(m_mutex);
+        m_lru.push_front(Entry{block_hash, filter_hash, merkle_block, filter_after});
+        if (m_lru.size() > MAX_ENTRIES) m_lru.pop_back();
+    }
+};
+
+FilteredBlockCache g_filtered_block_cache;
+
+/** Microseconds per second each peer may spend on filtered blocks, 0 = unlimited. */
+std::atomic<int64_t> g_max_bloom_cpu{DEFAULT_MAX_BLOOM_CPU_MS * 1000};
+
+/**
+ * Top up a peer's filtered block budget for the time since the last call, up
+ * to one second's worth. Returns whether any of it is left.
+ */
+bool HasBloomCpuBudget(CNode::TxRelay& tx_relay) EXCLUSIVE_LOCKS_REQUIRED(tx_relay.cs_filter)
+{
+    const int64_t rate = g_max_bloom_cpu;
+    if (rate == 0) return true;
+    const int64_t now = GetTimeMicros();
+    const int64_t elapsed = std::min<int64_t>(std::max<int64_t>(now - tx_relay.m_bloom_cpu_refilled, 0), 1000000);
+    tx_relay.m_bloom_cpu_refilled = now;
+    tx_relay.m_bloom_cpu_budget = std::min(tx_relay.m_bloom_cpu_budget + elapsed * rate / 1000000, rate);
+    return tx_relay.m_bloom_cpu_budget > 0;
+}
+} // namespace
+
+void SetBlockServeCacheSize(size_t max_bytes)
+{
+    g_block_serve_cache.SetMaxBytes(max_bytes);
+}
+
+BlockServeCacheStats GetBlockServeCacheStats()
+{
+    return g_block_serve_cache.GetStats();
+}
+
+void SetMaxBloomCpu(int64_t micros_per_second)
+{
+    g_max_bloom_cpu = micros_per_second;
+}
+
+/**
+ * Compact block to announce to a high-bandwidth peer, with up to max_bytes of
+ * the transactions it likely lacks sent in full: those it hasn't announced to
+ * us nor we to it, and that aren't in our mempool or only entered it recently.
+ */
+static CBlockHeaderAndShortTxIDs PrefilledCompactBlock(const CBlock& block, bool fUseWTXID, CNode* pnode, const CTxMemPool& mempool, size_t max_bytes)
+{
+    if (max_bytes == 0 || pnode->m_tx_relay == nullptr) return CBlockHeaderAndShortTxIDs(block, fUseWTXID);
+    const auto recent = GetTime<std::chrono::seconds>() - CMPCT_PREFILL_RECENT_TX;
+    size_t prefilled_bytes = 0;
+    LOCK(pnode->m_tx_relay->cs_tx_inventory);
+    return CBlockHeaderAndShortTxIDs(block, fUseWTXID, [&](const CTransaction& tx) {
+        if (pnode->m_tx_relay->filterInventoryKnown.contains(tx.GetHash())) return false;
+        const TxMempoolInfo info = mempool.info(tx.GetHash());
+        if (info.tx && info.m_time < recent) return false;
+        const size_t size = GetSerializeSize(tx, PROTOCOL_VERSION);
+        if (prefilled_bytes + size > max_bytes) return false;
+        prefilled_bytes += size;
+        return true;
+    });
+}
+
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
  * to compatible peers.
@@ -1204,6 +1262,9 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
+    // The UDP relay does not depend on any peer state, so send it first.
+    if (UdpBlockRelay* udp_relay = connman->GetUdpRelay()) udp_relay->RelayBlock(*pcmpctblock);
+
     LOCK(cs_main);
 
     static int nHighestFastAnnounce = 0;
@@ -1222,7 +1283,8 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
+    const size_t max_prefill = GetArgsSnapshot().cmpct_prefill_bytes;
+    connman->ForEachNode([this, &pcmpctblock, &pblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock, max_prefill](CNode* pnode) {
         AssertLockHeld(cs_main);
 
         // TODO: Avoid the repeated-serialization here
@@ -1237,7 +1299,11 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            if (max_prefill == 0) {
+                connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            } else {
+                connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, PrefilledCompactBlock(*pblock, true, pnode, m_mempool, max_prefill)));
+            }
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1311,6 +1377,26 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const BlockValidatio
         mapBlockSource.erase(it);
 }
 
+void PeerLogicValidation::BlockProcessed(const std::shared_ptr<const CBlock>& block) {
+    std::vector<NodeId> waiting;
+    {
+        LOCK(g_cs_blocks_processing);
+        auto range = g_blocks_processing.equal_range(block->GetHash());
+        for (auto it = range.first; it != range.second; ++it) {
+            waiting.push_back(it->second);
+        }
+        g_blocks_processing.erase(range.first, range.second);
+    }
+    for (NodeId id : waiting) {
+        connman->ForNode(id, [](CNode* pnode) {
+            --pnode->m_peer_tasks;
+            return true;
+        });
+    }
+    // The message handler skips peers with unfinished tasks
+    if (!waiting.empty()) connman->WakeMessageHandler();
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // Messages
@@ -1337,7 +1423,7 @@ bool static AlreadyHave(const CInv& inv, const CTxMemPool& mempool) EXCLUSIVE_LO
 
             {
                 LOCK(g_cs_orphans);
-                if (mapOrphanTransactions.count(inv.hash)) return true;
+                if (g_orphanage.HaveTx(inv.hash)) return true;
             }
 
             {
@@ -1401,7 +1487,21 @@ static void RelayAddress(const CAddress& addr, bool fReachable, const CConnman&
     connman.ForEachNodeThen(std::move(sortfunc), std::move(pushfunc));
 }
 
-void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, const CInv& inv, CConnman* connman)
+/**
+ * Called when reading a block we decided to serve fails. cs_main is not held
+ * while reading, so the only acceptable cause is a concurrent prune.
+ */
+static void HandleBlockReadFailure(CNode* pfrom, const CBlockIndex* pindex) LOCKS_EXCLUDED(cs_main)
+{
+    LOCK(cs_main);
+    if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        assert(!"cannot load block from disk");
+    }
+    LogPrint(BCLog::NET, "Block %s was pruned before it could be sent, disconnect peer=%d\n", pindex->GetBlockHash().ToString(), pfrom->GetId());
+    pfrom->fDisconnect = true;
+}
+
+void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, const CInv& inv, CConnman* connman) LOCKS_EXCLUDED(cs_main)
 {
     bool send = false;
     std::shared_ptr<const CBlock> a_recent_block;
@@ -1438,121 +1538,162 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
         }
     }
 
-    LOCK(cs_main);
-    const CBlockIndex* pindex = LookupBlockIndex(inv.hash);
-    if (pindex) {
-        send = BlockRequestAllowed(pindex, consensusParams);
-        if (!send) {
-            LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
-        }
-    }
-    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    // disconnect node in case we have reached the outbound limit for serving historical blocks
-    // never disconnect whitelisted nodes
-    if (send && connman->OutboundTargetReached(true) && ( ((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->HasPermission(PF_NOBAN))
+    const CBlockIndex* pindex;
+    bool fPeerWantsWitness = false;
+    bool fSendCompact = false;
+    uint256 continue_tip;
     {
-        LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(inv.hash);
+        if (pindex) {
+            send = BlockRequestAllowed(pindex, consensusParams);
+            if (!send) {
+                LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+            }
+        }
+        // disconnect node in case we have reached the outbound limit for serving historical blocks
+        // never disconnect whitelisted nodes
+        if (send && connman->OutboundTargetReached(true) && ( ((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->HasPermission(PF_NOBAN))
+        {
+            LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
 
-        //disconnect node
-        pfrom->fDisconnect = true;
-        send = false;
-    }
-    // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
-    if (send && !pfrom->HasPermission(PF_NOBAN) && (
-            (((pfrom->GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom->GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (::ChainActive().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
-       )) {
-        LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom->GetId());
+            //disconnect node
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
+        if (send && !pfrom->HasPermission(PF_NOBAN) && (
+                (((pfrom->GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom->GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (::ChainActive().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
+           )) {
+            LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom->GetId());
 
-        //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
-        pfrom->fDisconnect = true;
-        send = false;
+            //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Pruned nodes may have deleted the block, so check whether
+        // it's available before trying to send.
+        if (!send || !(pindex->nStatus & BLOCK_HAVE_DATA)) return;
+
+        if (inv.type == MSG_CMPCT_BLOCK) {
+            // If a peer is asking for old blocks, we're almost guaranteed
+            // they won't have a useful mempool to match against a compact block,
+            // and we don't feel like constructing the object for them, so
+            // instead we respond with the full, non-compact block.
+            fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+            fSendCompact = CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH;
+        }
+        if (inv.hash == pfrom->hashContinue) {
+            continue_tip = ::ChainActive().Tip()->GetBlockHash();
+        }
+    } // release cs_main before reading and sending the block
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    std::shared_ptr<const CBlock> pblock;
+    if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
+        pblock = a_recent_block;
+    } else if (inv.type == MSG_WITNESS_BLOCK) {
+        // Fast-path: in this case it is possible to serve the block directly from disk,
+        // as the network format matches the format on disk. If the block file is
+        // mapped, queue a reference to the mapping instead of copying the block.
+        CSerializedNetMsg msg;
+        msg.command = NetMsgType::BLOCK;
+        MappedBlockData mapped;
+        std::shared_ptr<const std::vector<unsigned char>> cached = g_block_serve_cache.Get(pindex->GetBlockHash());
+        if (cached) {
+            msg.shared_data = MakeSpan(*cached);
+            msg.shared_owner = std::move(cached);
+        } else if (ReadMappedBlockFromDisk(mapped, pindex, chainparams.MessageStart())) {
+            msg.shared_owner = std::move(mapped.file);
+            msg.shared_data = mapped.data;
+        } else if (!ReadRawBlockFromDisk(msg.data, pindex, chainparams.MessageStart())) {
+            HandleBlockReadFailure(pfrom, pindex);
+            return;
+        } else if (g_block_serve_cache.Enabled()) {
+            auto block_data = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+            g_block_serve_cache.Add(pindex->GetBlockHash(), block_data);
+            msg.data.clear();
+            msg.shared_data = MakeSpan(*block_data);
+            msg.shared_owner = std::move(block_data);
+        }
+        connman->PushMessage(pfrom, std::move(msg));
+        // Don't set pblock as we've sent the block
+    } else {
+        // Send block from the serve cache if we can, otherwise from disk
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        std::shared_ptr<const std::vector<unsigned char>> cached = g_block_serve_cache.Get(pindex->GetBlockHash());
+        if (cached) {
+            UnserializeBlockHashed(SER_NETWORK, PROTOCOL_VERSION, MakeSpan(*cached), *pblockRead);
+        } else if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
+            HandleBlockReadFailure(pfrom, pindex);
+            return;
+        }
+        pblock = pblockRead;
     }
-    // Pruned nodes may have deleted the block, so check whether
-    // it's available before trying to send.
-    if (send && (pindex->nStatus & BLOCK_HAVE_DATA))
-    {
-        std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
-            pblock = a_recent_block;
-        } else if (inv.type == MSG_WITNESS_BLOCK) {
-            // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
-                assert(!"cannot load block from disk");
-            }
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
-            // Don't set pblock as we've sent the block
-        } else {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
-                assert(!"cannot load block from disk");
-            pblock = pblockRead;
-        }
-        if (pblock) {
-            if (inv.type == MSG_BLOCK)
-                connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-            else if (inv.type == MSG_WITNESS_BLOCK)
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
-            else if (inv.type == MSG_FILTERED_BLOCK)
-            {
-                bool sendMerkleBlock = false;
-                CMerkleBlock merkleBlock;
-                if (pfrom->m_tx_relay != nullptr) {
-                    LOCK(pfrom->m_tx_relay->cs_filter);
-                    if (pfrom->m_tx_relay->pfilter) {
-                        sendMerkleBlock = true;
-                        merkleBlock = CMerkleBlock(*pblock, *pfrom->m_tx_relay->pfilter);
+    if (pblock) {
+        if (inv.type == MSG_BLOCK)
+            connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
+        else if (inv.type == MSG_WITNESS_BLOCK)
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+        else if (inv.type == MSG_FILTERED_BLOCK)
+        {
+            bool sendMerkleBlock = false;
+            CMerkleBlock merkleBlock;
+            if (pfrom->m_tx_relay != nullptr) {
+                LOCK(pfrom->m_tx_relay->cs_filter);
+                if (pfrom->m_tx_relay->pfilter) {
+                    sendMerkleBlock = true;
+                    CBloomFilter& filter = *pfrom->m_tx_relay->pfilter;
+                    const int64_t start = GetTimeMicros();
+                    const uint256 filter_hash = SerializeHash(filter);
+                    if (!g_filtered_block_cache.Get(pindex->GetBlockHash(), filter_hash, merkleBlock, filter)) {
+                        merkleBlock = CMerkleBlock(*pblock, filter);
+                        g_filtered_block_cache.Add(pindex->GetBlockHash(), filter_hash, merkleBlock, filter);
                     }
+                    pfrom->m_tx_relay->m_bloom_cpu_budget -= GetTimeMicros() - start;
                 }
-                if (sendMerkleBlock) {
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                    // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                    // This avoids hurting performance by pointlessly requiring a round-trip
-                    // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                    // they must either disconnect and retry or request the full block.
-                    // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                    // however we MUST always provide at least what the remote peer needs
-                    typedef std::pair<unsigned int, uint256> PairType;
-                    for (PairType& pair : merkleBlock.vMatchedTxn)
-                        connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
-                }
-                // else
-                    // no response
             }
-            else if (inv.type == MSG_CMPCT_BLOCK)
-            {
-                // If a peer is asking for old blocks, we're almost guaranteed
-                // they won't have a useful mempool to match against a compact block,
-                // and we don't feel like constructing the object for them, so
-                // instead we respond with the full, non-compact block.
-                bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-                int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-                if (CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
-                    if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
-                        connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
-                    } else {
-                        CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                        connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                    }
+            if (sendMerkleBlock) {
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                // This avoids hurting performance by pointlessly requiring a round-trip
+                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                // they must either disconnect and retry or request the full block.
+                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                // however we MUST always provide at least what the remote peer needs
+                typedef std::pair<unsigned int, uint256> PairType;
+                for (PairType& pair : merkleBlock.vMatchedTxn)
+                    connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
+            }
+            // else
+                // no response
+        }
+        else if (inv.type == MSG_CMPCT_BLOCK)
+        {
+            int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+            if (fSendCompact) {
+                if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
+                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
                 } else {
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+                    CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
+                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                 }
+            } else {
+                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
             }
         }
+    }
 
-        // Trigger the peer node to send a getblocks request for the next batch of inventory
-        if (inv.hash == pfrom->hashContinue)
-        {
-            // Bypass PushInventory, this must send even if redundant,
-            // and we want it right after the last block so they don't
-            // wait for other stuff first.
-            std::vector<CInv> vInv;
-            vInv.push_back(CInv(MSG_BLOCK, ::ChainActive().Tip()->GetBlockHash()));
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
-            pfrom->hashContinue.SetNull();
-        }
+    // Trigger the peer node to send a getblocks request for the next batch of inventory
+    if (!continue_tip.IsNull())
+    {
+        // Bypass PushInventory, this must send even if redundant,
+        // and we want it right after the last block so they don't
+        // wait for other stuff first.
+        std::vector<CInv> vInv;
+        vInv.push_back(CInv(MSG_BLOCK, continue_tip));
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+        pfrom->hashContinue.SetNull();
     }
 }
 
@@ -1621,8 +1762,24 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
     // expensive to process.
     if (it != pfrom->vRecvGetData.end() && !pfrom->fPauseSend) {
         const CInv &inv = *it++;
-        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK) {
-            ProcessGetBlockData(pfrom, chainparams, inv, connman);
+        bool over_bloom_budget = false;
+        if (inv.type == MSG_FILTERED_BLOCK && pfrom->m_tx_relay != nullptr) {
+            LOCK(pfrom->m_tx_relay->cs_filter);
+            over_bloom_budget = !HasBloomCpuBudget(*pfrom->m_tx_relay);
+        }
+        if (over_bloom_budget) {
+            // Matching blocks against this peer's filter has used up its share
+            // of our CPU time (-maxbloomcpu), so let it ask again later.
+            LogPrint(BCLog::NET, "filtered block %s not served to peer=%d: bloom CPU budget used up\n", inv.hash.ToString(), pfrom->GetId());
+            vNotFound.push_back(inv);
+        } else if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK || inv.type == MSG_WITNESS_BLOCK) {
+            // Reading and sending the block can be slow, so hand it to the
+            // peer's worker thread if there are any (-msghandlerthreads).
+            const CChainParams* params = &chainparams;
+            const CInv block_inv = inv;
+            if (!connman->PostPeerTask(pfrom, [pfrom, params, block_inv, connman] { ProcessGetBlockData(pfrom, *params, block_inv, connman); })) {
+                ProcessGetBlockData(pfrom, chainparams, inv, connman);
+            }
         }
         // else: If the first item on the queue is an unknown type, we erase it
         // and continue processing the queue on the next call.
@@ -1683,6 +1840,17 @@ bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, CTxMemPool& m
         return true;
     }
 
+    // Hash the headers before taking cs_main.
+    uint256 hashLastBlock;
+    bool continuous = true;
+    for (const CBlockHeader& header : headers) {
+        if (!hashLastBlock.IsNull() && header.hashPrevBlock != hashLastBlock) {
+            continuous = false;
+            break;
+        }
+        hashLastBlock = header.GetHash();
+    }
+
     bool received_new_header = false;
     const CBlockIndex *pindexLast = nullptr;
     {
@@ -1716,13 +1884,9 @@ bool static ProcessHeadersMessage(CNode* pfrom, CConnman* connman, CTxMemPool& m
             return true;
         }
 
-        uint256 hashLastBlock;
-        for (const CBlockHeader& header : headers) {
-            if (!hashLastBlock.IsNull() && header.hashPrevBlock != hashLastBlock) {
-                Misbehaving(pfrom->GetId(), 20, "non-continuous headers sequence");
-                return false;
-            }
-            hashLastBlock = header.GetHash();
+        if (!continuous) {
+            Misbehaving(pfrom->GetId(), 20, "non-continuous headers sequence");
+            return false;
         }
 
         // If we don't have the last header, then they'll have given us
@@ -1865,12 +2029,11 @@ void static ProcessOrphanTx(CConnman* connman, CTxMemPool& mempool, std::set<uin
         const uint256 orphanHash = *orphan_work_set.begin();
         orphan_work_set.erase(orphan_work_set.begin());
 
-        auto orphan_it = mapOrphanTransactions.find(orphanHash);
-        if (orphan_it == mapOrphanTransactions.end()) continue;
-
-        const CTransactionRef porphanTx = orphan_it->second.tx;
+        CTransactionRef porphanTx;
+        NodeId fromPeer;
+        std::tie(porphanTx, fromPeer) = g_orphanage.GetTx(orphanHash);
+        if (!porphanTx) continue;
         const CTransaction& orphanTx = *porphanTx;
-        NodeId fromPeer = orphan_it->second.fromPeer;
         // Use a new TxValidationState because orphans come from different peers (and we call
         // MaybePunishNodeForTx based on the source peer from the orphan map, not based on the peer
         // that relayed the previous transaction).
@@ -1880,15 +2043,8 @@ void static ProcessOrphanTx(CConnman* connman, CTxMemPool& mempool, std::set<uin
         if (AcceptToMemoryPool(mempool, orphan_state, porphanTx, &removed_txn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
             LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
             RelayTransaction(orphanHash, *connman);
-            for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
-                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(orphanHash, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto& elem : it_by_prev->second) {
-                        orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
-            EraseOrphanTx(orphanHash);
+            g_orphanage.AddChildrenToWorkSet(orphanTx, orphan_work_set);
+            g_orphanage.EraseTx(orphanHash);
             done = true;
         } else if (orphan_state.GetResult() != TxValidationResult::TX_MISSING_INPUTS) {
             if (orphan_state.IsInvalid()) {
@@ -1908,13 +2064,55 @@ void static ProcessOrphanTx(CConnman* connman, CTxMemPool& mempool, std::set<uin
                 assert(recentRejects);
                 recentRejects->insert(orphanHash);
             }
-            EraseOrphanTx(orphanHash);
+            g_orphanage.EraseTx(orphanHash);
             done = true;
         }
         mempool.check(&::ChainstateActive().CoinsTip());
     }
 }
 
+/** Announce the transactions a reconciliation round found the peer to be missing. */
+static void PushReconciledInventory(CNode* pto, const std::vector<uint256>& txids, CConnman* connman, const CNetMsgMaker& msgMaker)
+{
+    if (pto->m_tx_relay == nullptr || txids.empty()) return;
+    std::vector<CInv> vInv;
+    vInv.reserve(std::min<size_t>(txids.size(), MAX_INV_SZ));
+    LOCK(pto->m_tx_relay->cs_tx_inventory);
+    for (const uint256& txid : txids) {
+        pto->m_tx_relay->filterInventoryKnown.insert(txid);
+        vInv.push_back(CInv(MSG_TX, txid));
+        if (vInv.size() == MAX_INV_SZ) {
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+            vInv.clear();
+        }
+    }
+    if (!vInv.empty()) connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+}
+
+/**
+ * Connect a block from pfrom that AcceptNewBlock has stored. If the block
+ * validation thread runs, the block is queued for it instead, and pfrom's
+ * next messages wait until PeerLogicValidation::BlockProcessed, so that the
+ * peer still sees them handled after its block, while other peers are
+ * served meanwhile.
+ */
+static void ActivateNewBlock(CNode* pfrom, const CChainParams& chainparams, const std::shared_ptr<const CBlock>& pblock)
+{
+    {
+        LOCK(g_cs_blocks_processing);
+        if (QueueBlockActivation(pblock)) {
+            g_blocks_processing.emplace(pblock->GetHash(), pfrom->GetId());
+            ++pfrom->m_peer_tasks;
+            return;
+        }
+    }
+
+    BlockValidationState state; // Only used to report errors, not invalidity - ignore it
+    if (!::ChainstateActive().ActivateBestChain(state, chainparams, pblock)) {
+        error("%s: ActivateBestChain failed (%s)", __func__, state.ToString());
+    }
+}
+
 bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CTxMemPool& mempool, CConnman* connman, BanMan* banman, const std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(msg_type), vRecv.size(), pfrom->GetId());
@@ -2010,6 +2208,27 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         if (pfrom->fInbound)
             PushNodeVersion(pfrom, connman, GetAdjustedTime());
 
+        // Offer to reconcile transaction announcements, before verack, to
+        // full-relay peers that want transactions.
+        if (g_txreconciliation && pfrom->m_tx_relay != nullptr && fRelay && g_relay_txes) {
+            const uint64_t recon_salt = g_txreconciliation->PreRegisterPeer(pfrom->GetId());
+            connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::SENDTXRCNCL, TXRECONCILIATION_VERSION, recon_salt));
+        }
+
+        // Offer to exchange blocks over UDP, before verack, to peers we were
+        // told to do so with.
+        UdpBlockRelay* udp_relay = connman->GetUdpRelay();
+        if (udp_relay && pfrom->HasPermission(PF_UDPRELAY)) {
+            const std::pair<uint64_t, uint64_t> udp_key = udp_relay->PreRegisterPeer(pfrom->GetId());
+            connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::SENDUDPRELAY, UDPRELAY_VERSION, udp_relay->GetPort(), udp_key.first, udp_key.second));
+        }
+
+        // Offer to receive compressed messages, before verack.
+        if (g_p2p_compression) {
+            pfrom->m_compression_offered = true;
+            connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::SENDCMPR, P2P_COMPRESSION_VERSION));
+        }
+
         connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERACK));
 
         pfrom->nServices = nServices;
@@ -2149,6 +2368,70 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         return true;
     }
 
+    if (msg_type == NetMsgType::SENDTXRCNCL) {
+        if (!g_txreconciliation) return true;
+        if (pfrom->fSuccessfullyConnected) {
+            LogPrint(BCLog::NET, "sendtxrcncl received after verack from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        uint32_t peer_recon_version;
+        uint64_t remote_salt;
+        vRecv >> peer_recon_version >> remote_salt;
+        switch (g_txreconciliation->RegisterPeer(pfrom->GetId(), pfrom->fInbound, peer_recon_version, remote_salt)) {
+        case ReconciliationRegisterResult::SUCCESS:
+            LogPrint(BCLog::NET, "reconciling transactions with peer=%d\n", pfrom->GetId());
+            break;
+        case ReconciliationRegisterResult::NOT_FOUND:
+            // We did not offer reconciliation to this peer.
+            break;
+        case ReconciliationRegisterResult::ALREADY_REGISTERED:
+        case ReconciliationRegisterResult::PROTOCOL_VIOLATION:
+            LogPrint(BCLog::NET, "invalid sendtxrcncl from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        return true;
+    }
+
+    if (msg_type == NetMsgType::SENDUDPRELAY) {
+        UdpBlockRelay* udp_relay = connman->GetUdpRelay();
+        if (!udp_relay) return true;
+        if (pfrom->fSuccessfullyConnected) {
+            LogPrint(BCLog::NET, "sendudprelay received after verack from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        uint8_t peer_udp_version;
+        uint16_t peer_udp_port;
+        uint64_t k0, k1;
+        vRecv >> peer_udp_version >> peer_udp_port >> k0 >> k1;
+        // Peers supporting a later version can still exchange ours.
+        if (peer_udp_version < UDPRELAY_VERSION || peer_udp_port == 0) return true;
+        // Datagrams go to the address of the connection, which the permission was granted to.
+        if (udp_relay->RegisterPeer(pfrom->GetId(), CService(pfrom->addr, peer_udp_port), k0, k1)) {
+            LogPrint(BCLog::NET, "exchanging blocks over UDP with peer=%d\n", pfrom->GetId());
+        }
+        return true;
+    }
+
+    if (msg_type == NetMsgType::SENDCMPR) {
+        if (!g_p2p_compression) return true;
+        if (pfrom->fSuccessfullyConnected) {
+            LogPrint(BCLog::NET, "sendcmpr received after verack from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        uint32_t peer_compression_version;
+        vRecv >> peer_compression_version;
+        // Peers supporting a later version can still receive ours.
+        if (peer_compression_version >= P2P_COMPRESSION_VERSION) {
+            LogPrint(BCLog::NET, "compressing messages to peer=%d\n", pfrom->GetId());
+            pfrom->m_compress_send = true;
+        }
+        return true;
+    }
+
     if (!pfrom->fSuccessfullyConnected) {
         // Must have a verack message before anything else
         LOCK(cs_main);
@@ -2293,7 +2576,7 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
                     pfrom->fDisconnect = true;
                     return true;
                 } else if (!fAlreadyHave && !fImporting && !fReindex && !::ChainstateActive().IsInitialBlockDownload()) {
-                    RequestTx(State(pfrom->GetId()), inv.hash, current_time);
+                    RequestTx(pfrom->GetId(), inv.hash, current_time);
                 }
             }
         }
@@ -2455,16 +2738,15 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
             return true;
         }
 
-        LOCK(cs_main);
         if (::ChainstateActive().IsInitialBlockDownload() && !pfrom->HasPermission(PF_NOBAN)) {
             LogPrint(BCLog::NET, "Ignoring getheaders from peer=%d because node is in initial block download\n", pfrom->GetId());
             return true;
         }
 
-        CNodeState *nodestate = State(pfrom->GetId());
         const CBlockIndex* pindex = nullptr;
         if (locator.IsNull())
         {
+            LOCK(cs_main);
             // If locator is null, return the hashStop block
             pindex = LookupBlockIndex(hashStop);
             if (!pindex) {
@@ -2476,23 +2758,45 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
                 return true;
             }
         }
-        else
-        {
-            // Find the last block the caller has in the main chain
-            pindex = FindForkInGlobalIndex(::ChainActive(), locator);
-            if (pindex)
-                pindex = ::ChainActive().Next(pindex);
-        }
 
-        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
-        std::vector<CBlock> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
-        LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->GetId());
-        for (; pindex; pindex = ::ChainActive().Next(pindex))
+        // The headers are copied out of the active chain's serialized headers,
+        // which include the 0x00 nTx count CBlockHeaders would leave out.
+        CSerializedNetMsg msg = msgMaker.Make(NetMsgType::HEADERS);
+        const CBlockIndex* best_header_sent;
         {
-            vHeaders.push_back(pindex->GetBlockHeader());
-            if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
-                break;
+            // Headers and the active chain are readable without cs_main, so
+            // serving them doesn't wait for block connection.
+            boost::shared_lock<boost::shared_mutex> lock(g_block_index_mutex);
+            if (!locator.IsNull()) {
+                // Find the last block the caller has in the main chain
+                pindex = FindForkInActiveChainShared(locator);
+                if (pindex)
+                    pindex = ::ChainActive().Next(pindex);
+            }
+
+            LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->GetId());
+            Span<const unsigned char> headers;
+            if (pindex && ::ChainActive().Contains(pindex)) {
+                // Send up to hashStop if it is further along the main chain, or up to the limit
+                int count = MAX_HEADERS_RESULTS;
+                const CBlockIndex* stop = hashStop.IsNull() ? nullptr : LookupBlockIndexShared(hashStop);
+                if (stop && stop->nHeight >= pindex->nHeight && ::ChainActive().Contains(stop)) {
+                    count = std::min(count, stop->nHeight - pindex->nHeight + 1);
+                }
+                headers = GetActiveChainHeaders(pindex->nHeight, count);
+                pindex = ::ChainActive()[pindex->nHeight + headers.size() / HEADERS_RECORD_SIZE - 1];
+            }
+            CVectorWriter writer(SER_NETWORK, PROTOCOL_VERSION, msg.data, 0);
+            if (headers.size()) {
+                WriteCompactSize(writer, headers.size() / HEADERS_RECORD_SIZE);
+                msg.data.insert(msg.data.end(), headers.begin(), headers.end());
+            } else if (pindex) {
+                // A single header off the main chain, for a null locator
+                writer << std::vector<CBlock>{CBlock(pindex->GetBlockHeader())};
+            } else {
+                WriteCompactSize(writer, 0);
+            }
+            best_header_sent = pindex ? pindex : ::ChainActive().Tip();
         }
         // pindex can be nullptr either if we sent ::ChainActive().Tip() OR
         // if our peer has ::ChainActive().Tip() (and thus we are sending an empty
@@ -2505,9 +2809,10 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         // resulted in the peer sending a headers request, which we respond to
         // without the new block. By resetting the BestHeaderSent, we ensure we
         // will re-announce the new block via headers (or compact blocks again)
-        // in the SendMessages logic.
-        nodestate->pindexBestHeaderSent = pindex ? pindex : ::ChainActive().Tip();
-        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+        // in the SendMessages logic. If the tip moved on since, the new
+        // one is announced the same way.
+        WITH_LOCK(cs_main, State(pfrom->GetId())->pindexBestHeaderSent = best_header_sent);
+        connman->PushMessage(pfrom, std::move(msg));
         return true;
     }
 
@@ -2533,25 +2838,16 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
 
         TxValidationState state;
 
-        CNodeState* nodestate = State(pfrom->GetId());
-        nodestate->m_tx_download.m_tx_announced.erase(inv.hash);
-        nodestate->m_tx_download.m_tx_in_flight.erase(inv.hash);
-        EraseTxRequest(inv.hash);
+        g_txrequest.ReceivedResponse(pfrom->GetId(), inv.hash);
 
         std::list<CTransactionRef> lRemovedTxn;
 
         if (!AlreadyHave(inv, mempool) &&
             AcceptToMemoryPool(mempool, state, ptx, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
             mempool.check(&::ChainstateActive().CoinsTip());
+            g_txrequest.ForgetTxHash(tx.GetHash());
             RelayTransaction(tx.GetHash(), *connman);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(inv.hash, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto& elem : it_by_prev->second) {
-                        pfrom->orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
+            g_orphanage.AddChildrenToWorkSet(tx, pfrom->orphan_work_set);
 
             pfrom->nLastTXTime = GetTime();
 
@@ -2579,13 +2875,16 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
                 for (const CTxIn& txin : tx.vin) {
                     CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
                     pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv, mempool)) RequestTx(State(pfrom->GetId()), _inv.hash, current_time);
+                    if (!AlreadyHave(_inv, mempool)) RequestTx(pfrom->GetId(), _inv.hash, current_time);
+                }
+                if (g_orphanage.AddTx(ptx, pfrom->GetId())) {
+                    AddToCompactExtraTransactions(ptx);
                 }
-                AddOrphanTx(ptx, pfrom->GetId());
 
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (see CVE-2012-3789)
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+                // DoS prevention: do not allow the orphan pool to grow unbounded (see CVE-2012-3789)
+                unsigned int nMaxOrphanTx = GetArgsSnapshot().max_orphan_tx;
+                size_t nMaxOrphanWeight = GetArgsSnapshot().max_orphan_weight;
+                unsigned int nEvicted = g_orphanage.LimitOrphans(nMaxOrphanTx, nMaxOrphanWeight);
                 if (nEvicted > 0) {
                     LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
                 }
@@ -2855,7 +3154,9 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
             // we have a chain with at least nMinimumChainWork), and we ignore
             // compact blocks with less work than our tip, it is safe to treat
             // reconstructed compact blocks as having been requested.
-            ProcessNewBlock(chainparams, pblock, /*fForceProcessing=*/true, &fNewBlock);
+            if (AcceptNewBlock(chainparams, pblock, /*fForceProcessing=*/true, &fNewBlock)) {
+                ActivateNewBlock(pfrom, chainparams, pblock);
+            }
             if (fNewBlock) {
                 pfrom->nLastBlockTime = GetTime();
             } else {
@@ -2945,7 +3246,9 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
             // disk-space attacks), but this should be safe due to the
             // protections in the compact block handler -- see related comment
             // in compact block optimistic reconstruction handling.
-            ProcessNewBlock(chainparams, pblock, /*fForceProcessing=*/true, &fNewBlock);
+            if (AcceptNewBlock(chainparams, pblock, /*fForceProcessing=*/true, &fNewBlock)) {
+                ActivateNewBlock(pfrom, chainparams, pblock);
+            }
             if (fNewBlock) {
                 pfrom->nLastBlockTime = GetTime();
             } else {
@@ -2991,7 +3294,8 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         }
 
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-        vRecv >> *pblock;
+        // Hash the transactions from the bytes received, rather than serializing them again
+        vRecv.ignore(UnserializeBlockHashed(vRecv.GetType(), vRecv.GetVersion(), Span<const uint8_t>((const uint8_t*)vRecv.data(), vRecv.size()), *pblock));
 
         LogPrint(BCLog::NET, "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom->GetId());
 
@@ -2999,6 +3303,7 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         const uint256 hash(pblock->GetHash());
         {
             LOCK(cs_main);
+            RecordBlockDownload(pfrom->GetId(), hash, GetSerializeSize(*pblock, PROTOCOL_VERSION));
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
             forceProcessing |= MarkBlockAsReceived(hash);
@@ -3008,7 +3313,9 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
             mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
         }
         bool fNewBlock = false;
-        ProcessNewBlock(chainparams, pblock, forceProcessing, &fNewBlock);
+        if (AcceptNewBlock(chainparams, pblock, forceProcessing, &fNewBlock)) {
+            ActivateNewBlock(pfrom, chainparams, pblock);
+        }
         if (fNewBlock) {
             pfrom->nLastBlockTime = GetTime();
         } else {
@@ -3226,25 +3533,64 @@ bool ProcessMessage(CNode* pfrom, const std::string& msg_type, CDataStream& vRec
         return true;
     }
 
+    if (msg_type == NetMsgType::REQTXRCNCL) {
+        if (!g_txreconciliation) return true;
+        uint32_t remote_set_size;
+        vRecv >> remote_set_size;
+        ReconSketch sketch;
+        if (!g_txreconciliation->HandleReconciliationRequest(pfrom->GetId(), remote_set_size, sketch)) {
+            LogPrint(BCLog::NET, "unexpected reqtxrcncl from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return true;
+        }
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SKETCH, sketch));
+        return true;
+    }
+
+    if (msg_type == NetMsgType::SKETCH) {
+        if (!g_txreconciliation) return true;
+        ReconSketch sketch;
+        vRecv >> sketch;
+        bool success;
+        std::vector<uint64_t> ask;
+        std::vector<uint256> announce;
+        if (!g_txreconciliation->HandleSketch(pfrom->GetId(), sketch, success, ask, announce)) {
+            LogPrint(BCLog::NET, "unexpected sketch from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return true;
+        }
+        LogPrint(BCLog::NET, "reconciliation with peer=%d %s: asking for %u, announcing %u\n", pfrom->GetId(), success ? "succeeded" : "failed", ask.size(), announce.size());
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, success, ask));
+        PushReconciledInventory(pfrom, announce, connman, msgMaker);
+        return true;
+    }
+
+    if (msg_type == NetMsgType::RECONCILDIFF) {
+        if (!g_txreconciliation) return true;
+        bool success;
+        std::vector<uint64_t> ask;
+        vRecv >> success >> ask;
+        std::vector<uint256> announce;
+        if (ask.size() > MAX_SKETCH_CELLS || !g_txreconciliation->HandleReconciliationDifference(pfrom->GetId(), success, ask, announce)) {
+            LogPrint(BCLog::NET, "unexpected reconcildiff from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return true;
+        }
+        PushReconciledInventory(pfrom, announce, connman, msgMaker);
+        return true;
+    }
+
     if (msg_type == NetMsgType::NOTFOUND) {
         // Remove the NOTFOUND transactions from the peer
         LOCK(cs_main);
-        CNodeState *state = State(pfrom->GetId());
         std::vector<CInv> vInv;
         vRecv >> vInv;
         if (vInv.size() <= MAX_PEER_TX_IN_FLIGHT + MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
             for (CInv &inv : vInv) {
                 if (inv.type == MSG_TX || inv.type == MSG_WITNESS_TX) {
-                    // If we receive a NOTFOUND message for a txid we requested, erase
-                    // it from our data structures for this peer.
-                    auto in_flight_it = state->m_tx_download.m_tx_in_flight.find(inv.hash);
-                    if (in_flight_it == state->m_tx_download.m_tx_in_flight.end()) {
-                        // Skip any further work if this is a spurious NOTFOUND
-                        // message.
-                        continue;
-                    }
-                    state->m_tx_download.m_tx_in_flight.erase(in_flight_it);
-                    state->m_tx_download.m_tx_announced.erase(inv.hash);
+                    // If we receive a NOTFOUND message for a txid the peer
+                    // announced, forget the announcement.
+                    g_txrequest.ReceivedResponse(pfrom->GetId(), inv.hash);
                 }
             }
         }
@@ -3284,6 +3630,23 @@ bool PeerLogicValidation::MaybeDiscourageAndDisconnect(CNode* pnode)
     return false;
 }
 
+/** Histogram of the time ProcessMessage() takes for messages of a type */
+static perf::Histogram& GetMessageHistogram(const std::string& msg_type)
+{
+    // Built once from the known message types, so that lookups take no lock
+    // and peers can't create histograms by sending made up types.
+    static const std::map<std::string, perf::Histogram*> histograms = [] {
+        std::map<std::string, perf::Histogram*> ret;
+        for (const std::string& type : getAllNetMessageTypes()) {
+            ret.emplace(type, &perf::GetHistogram("msg." + type));
+        }
+        return ret;
+    }();
+    static perf::Histogram& other = perf::GetHistogram("msg.other");
+    const auto it = histograms.find(msg_type);
+    return it == histograms.end() ? other : *it->second;
+}
+
 bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     const CChainParams& chainparams = Params();
@@ -3297,6 +3660,12 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     //
     bool fMoreWork = false;
 
+    // A block request is still being served, or a message to this peer is
+    // still being compressed, on a peer worker thread, or a block from this
+    // peer is still being connected on the block validation thread; wait for
+    // it so that responses stay in order. Either wakes us.
+    if (pfrom->m_peer_tasks > 0) return false;
+
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(pfrom, chainparams, connman, m_mempool, interruptMsgProc);
 
@@ -3363,9 +3732,11 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     }
 
     // Process message
+    TRACE3(net, inbound_message, pfrom->GetId(), msg_type.c_str(), nMessageSize);
     bool fRet = false;
     try
     {
+        perf::ScopedTimer timer(GetMessageHistogram(msg_type));
         fRet = ProcessMessage(pfrom, msg_type, vRecv, msg.m_time, chainparams, m_mempool, connman, m_banman, interruptMsgProc);
         if (interruptMsgProc)
             return false;
@@ -3522,25 +3893,6 @@ void PeerLogicValidation::CheckForStaleTipAndEvictPeers(const Consensus::Params
     }
 }
 
-namespace {
-class CompareInvMempoolOrder
-{
-    CTxMemPool *mp;
-public:
-    explicit CompareInvMempoolOrder(CTxMemPool *_mempool)
-    {
-        mp = _mempool;
-    }
-
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
-    {
-        /* As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
-    }
-};
-}
-
 bool PeerLogicValidation::SendMessages(CNode* pto)
 {
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -3727,15 +4079,16 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                             vHeaders.front().GetHash().ToString(), pto->GetId());
 
                     int nSendFlags = state.fWantsCmpctWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+                    const size_t max_prefill = GetArgsSnapshot().cmpct_prefill_bytes;
 
                     bool fGotBlockFromCache = false;
                     {
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
+                            if (max_prefill == 0 && (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock))
                                 connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
                             else {
-                                CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
+                                CBlockHeaderAndShortTxIDs cmpctblock(PrefilledCompactBlock(*most_recent_block, state.fWantsCmpctWitness, pto, m_mempool, max_prefill));
                                 connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                             }
                             fGotBlockFromCache = true;
@@ -3745,7 +4098,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                         CBlock block;
                         bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
                         assert(ret);
-                        CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
+                        CBlockHeaderAndShortTxIDs cmpctblock(PrefilledCompactBlock(block, state.fWantsCmpctWitness, pto, m_mempool, max_prefill));
                         connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                     }
                     state.pindexBestHeaderSent = pBestIndex;
@@ -3865,11 +4218,13 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
 
                 // Determine transactions to relay
                 if (fSendTrickle) {
-                    // Produce a vector with all candidates for sending
-                    std::vector<std::set<uint256>::iterator> vInvTx;
-                    vInvTx.reserve(pto->m_tx_relay->setInventoryTxToSend.size());
-                    for (std::set<uint256>::iterator it = pto->m_tx_relay->setInventoryTxToSend.begin(); it != pto->m_tx_relay->setInventoryTxToSend.end(); it++) {
-                        vInvTx.push_back(it);
+                    // Produce a vector with all candidates for sending, with their cached ordering data
+                    std::vector<TxInvOrder::Entry> vInvTx;
+                    std::vector<uint256> vMissing;
+                    m_tx_inv_order.GetEntries(pto->m_tx_relay->setInventoryTxToSend, current_time, vInvTx, vMissing);
+                    // Not in the mempool anymore? don't bother sending them.
+                    for (const uint256& hash : vMissing) {
+                        pto->m_tx_relay->setInventoryTxToSend.erase(hash);
                     }
                     CFeeRate filterrate;
                     {
@@ -3878,37 +4233,41 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                     }
                     // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
                     // A heap is used so that not all items need sorting if only a few are being sent.
-                    CompareInvMempoolOrder compareInvMempoolOrder(&m_mempool);
-                    std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                    // As std::make_heap produces a max-heap, we want the entries with the
+                    // fewest ancestors/highest fee to sort later.
+                    const auto compareInvOrder = [](const TxInvOrder::Entry& a, const TxInvOrder::Entry& b) { return TxInvOrder::Before(b, a); };
+                    std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvOrder);
                     // No reason to drain out at many times the network's capacity,
                     // especially since we have many peers and some will draw much shorter delays.
                     unsigned int nRelayedTransactions = 0;
                     LOCK(pto->m_tx_relay->cs_filter);
                     while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                         // Fetch the top element from the heap
-                        std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                        std::set<uint256>::iterator it = vInvTx.back();
+                        std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvOrder);
+                        const TxInvOrder::Entry entry = vInvTx.back();
                         vInvTx.pop_back();
-                        uint256 hash = *it;
+                        const uint256& hash = entry.txid;
                         // Remove it from the to-be-sent set
-                        pto->m_tx_relay->setInventoryTxToSend.erase(it);
+                        pto->m_tx_relay->setInventoryTxToSend.erase(hash);
                         // Check if not in the filter already
                         if (pto->m_tx_relay->filterInventoryKnown.contains(hash)) {
                             continue;
                         }
+                        // Peer told you to not send transactions at that feerate? Don't bother sending it.
+                        if (entry.fee < filterrate.GetFee(entry.vsize)) {
+                            continue;
+                        }
                         // Not in the mempool anymore? don't bother sending it.
                         auto txinfo = m_mempool.info(hash);
                         if (!txinfo.tx) {
                             continue;
                         }
-                        // Peer told you to not send transactions at that feerate? Don't bother sending it.
-                        if (txinfo.fee < filterrate.GetFee(txinfo.vsize)) {
-                            continue;
-                        }
                         if (pto->m_tx_relay->pfilter && !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
-                        // Send
-                        vInv.push_back(CInv(MSG_TX, hash));
-                        nRelayedTransactions++;
+                        // Send, unless it is left for reconciliation with the peer
+                        if (!g_txreconciliation || !g_txreconciliation->AddToSet(pto->GetId(), hash)) {
+                            vInv.push_back(CInv(MSG_TX, hash));
+                            nRelayedTransactions++;
+                        }
                         {
                             // Expire old relay messages
                             while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
@@ -3934,6 +4293,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         if (!vInv.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+        //
+        // Message: reqtxrcncl
+        //
+        uint32_t recon_set_size;
+        if (g_txreconciliation && g_txreconciliation->InitiateReconciliationRequest(pto->GetId(), current_time, recon_set_size)) {
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::REQTXRCNCL, recon_set_size));
+        }
+
         // Detect whether we're stalling
         current_time = GetTime<std::chrono::microseconds>();
         // nNow is the current system time (GetTimeMicros is not mockable) and
@@ -3943,9 +4310,21 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             // Stalling only triggers when the block download window cannot move. During normal steady state,
             // the download window should be much larger than the to-be-downloaded set of blocks, so disconnection
             // should only happen during initial block download.
-            LogPrintf("Peer=%d is stalling block download, disconnecting\n", pto->GetId());
-            pto->fDisconnect = true;
-            return true;
+            if (g_adaptive_block_download && state.m_blocks_in_transit_limit > MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER) {
+                // Give the peer's blocks to the others right away, and only disconnect
+                // it if it stalls again with the smallest queue.
+                LogPrintf("Peer=%d is stalling block download, requesting its %d blocks in flight elsewhere\n", pto->GetId(), state.nBlocksInFlight);
+                while (!state.vBlocksInFlight.empty()) {
+                    MarkBlockAsReceived(state.vBlocksInFlight.front().hash);
+                }
+                state.m_blocks_in_transit_limit = MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER;
+                state.m_blocks_received_at_limit = 0;
+                state.m_block_stalls++;
+            } else {
+                LogPrintf("Peer=%d is stalling block download, disconnecting\n", pto->GetId());
+                pto->fDisconnect = true;
+                return true;
+            }
         }
         // In case there is a block that has been in flight from this peer for 2 + 0.5 * N times the block interval
         // (with N the number of peers from which we're downloading validated blocks), disconnect due to timeout.
@@ -4002,10 +4381,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < state.m_blocks_in_transit_limit) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), state.m_blocks_in_transit_limit - state.nBlocksInFlight, vToDownload, staller, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -4030,57 +4409,33 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // were unresponsive in the past.
         // Eventually we should consider disconnecting peers, but this is
         // conservative.
-        if (state.m_tx_download.m_check_expiry_timer <= current_time) {
-            for (auto it=state.m_tx_download.m_tx_in_flight.begin(); it != state.m_tx_download.m_tx_in_flight.end();) {
-                if (it->second <= current_time - TX_EXPIRY_INTERVAL) {
-                    LogPrint(BCLog::NET, "timeout of inflight tx %s from peer=%d\n", it->first.ToString(), pto->GetId());
-                    state.m_tx_download.m_tx_announced.erase(it->first);
-                    state.m_tx_download.m_tx_in_flight.erase(it++);
-                } else {
-                    ++it;
-                }
-            }
-            // On average, we do this check every TX_EXPIRY_INTERVAL. Randomize
-            // so that we're not doing this for all peers at the same time.
-            state.m_tx_download.m_check_expiry_timer = current_time + TX_EXPIRY_INTERVAL / 2 + GetRandMicros(TX_EXPIRY_INTERVAL);
-        }
-
-        auto& tx_process_time = state.m_tx_download.m_tx_process_time;
-        while (!tx_process_time.empty() && tx_process_time.begin()->first <= current_time && state.m_tx_download.m_tx_in_flight.size() < MAX_PEER_TX_IN_FLIGHT) {
-            const uint256 txid = tx_process_time.begin()->second;
-            // Erase this entry from tx_process_time (it may be added back for
-            // processing at a later time, see below)
-            tx_process_time.erase(tx_process_time.begin());
+        std::vector<uint256> expired;
+        // Transactions in flight from someone else are queued up for after
+        // the download times out, with a slight delay for inbound peers, to
+        // prefer requests to outbound peers.
+        auto reschedule_delay = GetRandMicros(MAX_GETDATA_RANDOM_DELAY);
+        if (!state.fPreferredDownload) reschedule_delay += INBOUND_PEER_TX_DELAY;
+        const std::vector<uint256> requestable = g_txrequest.GetRequestable(pto->GetId(), current_time, MAX_PEER_TX_IN_FLIGHT, reschedule_delay, &expired);
+        for (const uint256& txid : expired) {
+            LogPrint(BCLog::NET, "timeout of inflight tx %s from peer=%d\n", txid.ToString(), pto->GetId());
+        }
+        for (const uint256& txid : requestable) {
             CInv inv(MSG_TX | GetFetchFlags(pto), txid);
             if (!AlreadyHave(inv, m_mempool)) {
-                // If this transaction was last requested more than 1 minute ago,
-                // then request.
-                const auto last_request_time = GetTxRequestTime(inv.hash);
-                if (last_request_time <= current_time - GETDATA_TX_INTERVAL) {
-                    LogPrint(BCLog::NET, "Requesting %s peer=%d\n", inv.ToString(), pto->GetId());
-                    vGetData.push_back(inv);
-                    if (vGetData.size() >= MAX_GETDATA_SZ) {
-                        connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
-                        vGetData.clear();
-                    }
-                    UpdateTxRequestTime(inv.hash, current_time);
-                    state.m_tx_download.m_tx_in_flight.emplace(inv.hash, current_time);
-                } else {
-                    // This transaction is in flight from someone else; queue
-                    // up processing to happen after the download times out
-                    // (with a slight delay for inbound peers, to prefer
-                    // requests to outbound peers).
-                    const auto next_process_time = CalculateTxGetDataTime(txid, current_time, !state.fPreferredDownload);
-                    tx_process_time.emplace(next_process_time, txid);
+                LogPrint(BCLog::NET, "Requesting %s peer=%d\n", inv.ToString(), pto->GetId());
+                vGetData.push_back(inv);
+                if (vGetData.size() >= MAX_GETDATA_SZ) {
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
+                    vGetData.clear();
                 }
+                g_txrequest.RequestedTx(pto->GetId(), txid, current_time);
             } else {
-                // We have already seen this transaction, no need to download.
-                state.m_tx_download.m_tx_announced.erase(inv.hash);
-                state.m_tx_download.m_tx_in_flight.erase(inv.hash);
+                // We have already seen this transaction, no need to download
+                // it from anyone.
+                g_txrequest.ForgetTxHash(txid);
             }
         }
 
-
         if (!vGetData.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::GETDATA, vGetData));
 
@@ -4088,9 +4443,9 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // Message: feefilter
         //
         // We don't want white listed peers to filter txs to us if we have -whitelistforcerelay
-        if (pto->m_tx_relay != nullptr && pto->nVersion >= FEEFILTER_VERSION && gArgs.GetBoolArg("-feefilter", DEFAULT_FEEFILTER) &&
+        if (pto->m_tx_relay != nullptr && pto->nVersion >= FEEFILTER_VERSION && GetArgsSnapshot().feefilter &&
             !pto->HasPermission(PF_FORCERELAY)) {
-            CAmount currentFilter = m_mempool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFeePerK();
+            CAmount currentFilter = m_mempool.GetMinFee(GetArgsSnapshot().max_mempool_bytes).GetFeePerK();
             int64_t timeNow = GetTimeMicros();
             if (timeNow > pto->m_tx_relay->nextSendTimeFeeFilter) {
                 static CFeeRate default_feerate(DEFAULT_MIN_RELAY_TX_FEE);
@@ -4114,15 +4469,3 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
     }
     return true;
 }
-
-class CNetProcessingCleanup
-{
-public:
-    CNetProcessingCleanup() {}
-    ~CNetProcessingCleanup() {
-        // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
-    }
-};
-static CNetProcessingCleanup instance_of_cnetprocessingcleanup;
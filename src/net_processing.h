@@ -9,30 +9,48 @@
 #include <consensus/params.h>
 #include <net.h>
 #include <sync.h>
+#include <txinvorder.h>
+#include <txorphanage.h>
 #include <validationinterface.h>
 
 class CTxMemPool;
 
 extern RecursiveMutex cs_main;
-extern RecursiveMutex g_cs_orphans;
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/** Default for -maxorphanweight, maximum total weight of orphan transactions kept in memory */
+static const unsigned int DEFAULT_MAX_ORPHAN_WEIGHT = 4000000;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 static const bool DEFAULT_PEERBLOOMFILTERS = false;
+/** Default for -maxbloomcpu, in milliseconds per second per peer (0 = unlimited) */
+static const unsigned int DEFAULT_MAX_BLOOM_CPU_MS = 100;
+/** Default for -blockservecache, in MiB (0 = disabled) */
+static const unsigned int DEFAULT_BLOCK_SERVE_CACHE_MIB = 0;
+/** Default for -maxcmpcthbpeers, the number of peers asked to announce blocks to us as compact blocks (as per BIP152) */
+static const unsigned int DEFAULT_MAX_CMPCT_HB_PEERS = 3;
+/** Default for -cmpctprefill, in bytes (0 = only prefill the coinbase) */
+static const unsigned int DEFAULT_CMPCT_PREFILL_BYTES = 0;
+/** Default for -adaptiveblockdownload */
+static const bool DEFAULT_ADAPTIVE_BLOCK_DOWNLOAD = false;
+/** Default for -p2pcompression */
+static const bool DEFAULT_P2P_COMPRESSION = false;
 
 class PeerLogicValidation final : public CValidationInterface, public NetEventsInterface {
 private:
     CConnman* const connman;
     BanMan* const m_banman;
     CTxMemPool& m_mempool;
+    //! Announcement order of transactions, shared by all peers
+    TxInvOrder m_tx_inv_order;
 
     bool MaybeDiscourageAndDisconnect(CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 public:
     PeerLogicValidation(CConnman* connman, BanMan* banman, CScheduler& scheduler, CTxMemPool& pool);
 
+    std::string GetValidationQueueName() const override { return "net"; }
     /**
      * Overridden from CValidationInterface.
      */
@@ -50,6 +68,10 @@ public:
      * Overridden from CValidationInterface.
      */
     void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) override;
+    /**
+     * Overridden from CValidationInterface.
+     */
+    void BlockProcessed(const std::shared_ptr<const CBlock>& block) override;
 
     /** Initialize a peer by adding it to mapNodeState and pushing a message requesting its version */
     void InitializeNode(CNode* pnode) override;
@@ -86,6 +108,10 @@ struct CNodeStateStats {
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
+    int m_blocks_in_transit_limit = 0;
+    int64_t m_block_latency = 0;
+    int64_t m_block_download_rate = 0;
+    int m_block_stalls = 0;
 };
 
 /** Get statistics from node state */
@@ -94,4 +120,19 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 /** Relay transaction to every node */
 void RelayTransaction(const uint256&, const CConnman& connman);
 
+struct BlockServeCacheStats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    size_t entries{0};
+    size_t bytes{0};
+    size_t max_bytes{0};
+};
+
+/** Set the byte limit of the recently-served block cache (0 disables it). */
+void SetBlockServeCacheSize(size_t max_bytes);
+BlockServeCacheStats GetBlockServeCacheStats();
+
+/** Set how many microseconds per second may be spent building each peer's filtered blocks (0 = unlimited). */
+void SetMaxBloomCpu(int64_t micros_per_second);
+
 #endif // PALLADIUM_NET_PROCESSING_H
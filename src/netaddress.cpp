@@ -443,33 +443,24 @@ uint32_t CNetAddr::GetNetClass() const {
     return net_class;
 }
 
-uint32_t CNetAddr::GetMappedAS(const std::vector<bool> &asmap) const {
+uint32_t CNetAddr::GetMappedAS(const Asmap &asmap) const {
     uint32_t net_class = GetNetClass();
     if (asmap.size() == 0 || (net_class != NET_IPV4 && net_class != NET_IPV6)) {
         return 0; // Indicates not found, safe because AS0 is reserved per RFC7607.
     }
-    std::vector<bool> ip_bits(128);
+    std::array<uint8_t, 16> ip_bytes;
     if (HasLinkedIPv4()) {
         // For lookup, treat as if it was just an IPv4 address (pchIPv4 prefix + IPv4 bits)
-        for (int8_t byte_i = 0; byte_i < 12; ++byte_i) {
-            for (uint8_t bit_i = 0; bit_i < 8; ++bit_i) {
-                ip_bits[byte_i * 8 + bit_i] = (pchIPv4[byte_i] >> (7 - bit_i)) & 1;
-            }
-        }
+        std::copy(std::begin(pchIPv4), std::end(pchIPv4), ip_bytes.begin());
         uint32_t ipv4 = GetLinkedIPv4();
-        for (int i = 0; i < 32; ++i) {
-            ip_bits[96 + i] = (ipv4 >> (31 - i)) & 1;
+        for (int i = 0; i < 4; ++i) {
+            ip_bytes[12 + i] = (ipv4 >> (24 - 8 * i)) & 0xFF;
         }
     } else {
         // Use all 128 bits of the IPv6 address otherwise
-        for (int8_t byte_i = 0; byte_i < 16; ++byte_i) {
-            uint8_t cur_byte = GetByte(15 - byte_i);
-            for (uint8_t bit_i = 0; bit_i < 8; ++bit_i) {
-                ip_bits[byte_i * 8 + bit_i] = (cur_byte >> (7 - bit_i)) & 1;
-            }
-        }
+        std::copy(std::begin(ip), std::end(ip), ip_bytes.begin());
     }
-    uint32_t mapped_as = Interpret(asmap, ip_bits);
+    uint32_t mapped_as = asmap.Lookup(ip_bytes);
     return mapped_as;
 }
 
@@ -483,7 +474,7 @@ uint32_t CNetAddr::GetMappedAS(const std::vector<bool> &asmap) const {
  * @note No two connections will be attempted to addresses with the same network
  *       group.
  */
-std::vector<unsigned char> CNetAddr::GetGroup(const std::vector<bool> &asmap) const
+std::vector<unsigned char> CNetAddr::GetGroup(const Asmap &asmap) const
 {
     std::vector<unsigned char> vchRet;
     uint32_t net_class = GetNetClass();
@@ -880,6 +871,19 @@ std::string CSubNet::ToString() const
     return network.ToString() + "/" + strNetmask;
 }
 
+int CSubNet::GetPrefixLength() const
+{
+    int n = 0;
+    for (; n < 16 && netmask[n] == 0xff; ++n) {}
+    if (n == 16) return 128;
+    const int bits = NetmaskBits(netmask[n]);
+    if (bits < 0) return -1;
+    for (int x = n + 1; x < 16; ++x) {
+        if (netmask[x] != 0x00) return -1;
+    }
+    return n * 8 + bits;
+}
+
 bool CSubNet::IsValid() const
 {
     return valid;
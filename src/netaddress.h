@@ -11,6 +11,7 @@
 
 #include <compat.h>
 #include <serialize.h>
+#include <util/asmap.h>
 
 #include <stdint.h>
 #include <string>
@@ -87,9 +88,9 @@ class CNetAddr
         // The AS on the BGP path to the node we use to diversify
         // peers in AddrMan bucketing based on the AS infrastructure.
         // The ip->AS mapping depends on how asmap is constructed.
-        uint32_t GetMappedAS(const std::vector<bool> &asmap) const;
+        uint32_t GetMappedAS(const Asmap &asmap) const;
 
-        std::vector<unsigned char> GetGroup(const std::vector<bool> &asmap) const;
+        std::vector<unsigned char> GetGroup(const Asmap &asmap) const;
         std::vector<unsigned char> GetAddrBytes() const { return {std::begin(ip), std::end(ip)}; }
         int GetReachabilityFrom(const CNetAddr *paddrPartner = nullptr) const;
 
@@ -130,6 +131,11 @@ class CSubNet
 
         bool Match(const CNetAddr &addr) const;
 
+        //! Network address, with the bits outside the netmask cleared
+        const CNetAddr& GetBaseAddress() const { return network; }
+        //! Number of leading 1-bits of the netmask over all 16 address bytes, or -1 if it has other 1-bits
+        int GetPrefixLength() const;
+
         std::string ToString() const;
         bool IsValid() const;
 
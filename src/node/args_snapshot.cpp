@@ -0,0 +1,69 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/args_snapshot.h>
+
+#include <miner.h>
+#include <net_processing.h>
+#include <policy/policy.h>
+#include <sync.h>
+#include <util/moneystr.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace {
+std::atomic<const ArgsSnapshot*> g_args_snapshot{nullptr};
+
+Mutex g_args_snapshots_mutex;
+//! Every snapshot published. Readers may still use an older one, and
+//! snapshots are only published at startup and in tests.
+std::vector<std::unique_ptr<const ArgsSnapshot>> g_args_snapshots GUARDED_BY(g_args_snapshots_mutex);
+} // namespace
+
+const ArgsSnapshot& GetArgsSnapshot()
+{
+    const ArgsSnapshot* snapshot = g_args_snapshot.load(std::memory_order_acquire);
+    if (snapshot == nullptr) {
+        ReloadArgsSnapshot(gArgs);
+        snapshot = g_args_snapshot.load(std::memory_order_acquire);
+    }
+    return *snapshot;
+}
+
+void ReloadArgsSnapshot(const ArgsManager& args)
+{
+    std::unique_ptr<ArgsSnapshot> snapshot = MakeUnique<ArgsSnapshot>();
+
+    snapshot->max_mempool_bytes = args.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+    snapshot->mempool_expiry = std::chrono::hours{args.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)};
+    snapshot->limit_ancestors = args.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+    snapshot->limit_ancestor_size = args.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+    snapshot->limit_descendants = args.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+    snapshot->limit_descendant_size = args.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+    snapshot->limit_cluster = args.GetArg("-limitclustercount", DEFAULT_CLUSTER_LIMIT);
+
+    snapshot->block_max_weight = args.GetArg("-blockmaxweight", DEFAULT_BLOCK_MAX_WEIGHT);
+    CAmount n = 0;
+    if (args.IsArgSet("-blockmintxfee") && ParseMoney(args.GetArg("-blockmintxfee", ""), n)) {
+        snapshot->block_min_fee_rate = CFeeRate(n);
+    } else {
+        snapshot->block_min_fee_rate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
+    }
+    snapshot->print_priority = args.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
+
+    snapshot->feefilter = args.GetBoolArg("-feefilter", DEFAULT_FEEFILTER);
+    snapshot->max_cmpct_hb_peers = std::max<int64_t>(0, args.GetArg("-maxcmpcthbpeers", DEFAULT_MAX_CMPCT_HB_PEERS));
+    snapshot->cmpct_prefill_bytes = std::max<int64_t>(0, args.GetArg("-cmpctprefill", DEFAULT_CMPCT_PREFILL_BYTES));
+    snapshot->max_orphan_tx = (unsigned int)std::max<int64_t>(0, args.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    snapshot->max_orphan_weight = std::max<int64_t>(0, args.GetArg("-maxorphanweight", DEFAULT_MAX_ORPHAN_WEIGHT));
+
+    LOCK(g_args_snapshots_mutex);
+    g_args_snapshot.store(snapshot.get(), std::memory_order_release);
+    g_args_snapshots.push_back(std::move(snapshot));
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_NODE_ARGS_SNAPSHOT_H
+#define PALLADIUM_NODE_ARGS_SNAPSHOT_H
+
+#include <policy/feerate.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+class ArgsManager;
+
+/**
+ * Options read for every transaction, block template or peer message,
+ * parsed once into typed fields instead of being looked up by name in
+ * gArgs, under its lock, on each use.
+ *
+ * A snapshot never changes. ReloadArgsSnapshot publishes a new one, which
+ * GetArgsSnapshot returns from then on with a single atomic load.
+ */
+struct ArgsSnapshot {
+    //! -maxmempool, in bytes
+    int64_t max_mempool_bytes;
+    //! -mempoolexpiry
+    std::chrono::hours mempool_expiry;
+    //! -limitancestorcount
+    size_t limit_ancestors;
+    //! -limitancestorsize, in bytes
+    size_t limit_ancestor_size;
+    //! -limitdescendantcount
+    size_t limit_descendants;
+    //! -limitdescendantsize, in bytes
+    size_t limit_descendant_size;
+    //! -limitclustercount
+    size_t limit_cluster;
+
+    //! -blockmaxweight
+    size_t block_max_weight;
+    //! -blockmintxfee
+    CFeeRate block_min_fee_rate;
+    //! -printpriority
+    bool print_priority;
+
+    //! -feefilter
+    bool feefilter;
+    //! -maxcmpcthbpeers
+    size_t max_cmpct_hb_peers;
+    //! -cmpctprefill
+    size_t cmpct_prefill_bytes;
+    //! -maxorphantx
+    unsigned int max_orphan_tx;
+    //! -maxorphanweight
+    size_t max_orphan_weight;
+};
+
+/** The current snapshot. The first call loads one from gArgs if none was published yet. */
+const ArgsSnapshot& GetArgsSnapshot();
+
+/** Parse the options from args into a new snapshot and publish it. */
+void ReloadArgsSnapshot(const ArgsManager& args);
+
+#endif // PALLADIUM_NODE_ARGS_SNAPSHOT_H
@@ -0,0 +1,144 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockindex_image.h>
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <crypto/common.h>
+#include <crypto/siphash.h>
+#include <util/mappedfile.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+const unsigned char IMAGE_MAGIC[4] = {'p', 'l', 'b', 'i'};
+const uint32_t IMAGE_VERSION = 1;
+//! Records written at a time
+const size_t IMAGE_WRITE_RECORDS = 4096;
+
+//! The records are checksummed to catch a corrupt image, not to authenticate it.
+CSipHasher ImageHasher() { return CSipHasher(0x626c6f636b696e64ULL, 0x6578696d61676573ULL); }
+
+void WriteRecord(unsigned char* out, const CBlockIndex& index, int32_t prev, int32_t skip)
+{
+    memcpy(out, index.GetBlockHash().begin(), 32);
+    WriteLE32(out + 32, prev);
+    WriteLE32(out + 36, skip);
+    WriteLE32(out + 40, index.nHeight);
+    WriteLE32(out + 44, index.nFile);
+    WriteLE32(out + 48, index.nDataPos);
+    WriteLE32(out + 52, index.nUndoPos);
+    memcpy(out + 56, ArithToUint256(index.nChainWork).begin(), 32);
+    WriteLE32(out + 88, index.nTx);
+    WriteLE32(out + 92, index.nStatus);
+    WriteLE32(out + 96, index.nVersion);
+    memcpy(out + 100, index.hashMerkleRoot.begin(), 32);
+    WriteLE32(out + 132, index.nTime);
+    WriteLE32(out + 136, index.nBits);
+    WriteLE32(out + 140, index.nNonce);
+}
+
+} // namespace
+
+bool WriteBlockIndexImage(const fs::path& path, uint64_t generation, const std::vector<const CBlockIndex*>& entries)
+{
+    std::unordered_map<const CBlockIndex*, int32_t> numbers;
+    numbers.reserve(entries.size());
+    const auto number = [&](const CBlockIndex* index) {
+        if (!index) return int32_t{-1};
+        const auto it = numbers.find(index);
+        assert(it != numbers.end());
+        return it->second;
+    };
+
+    const fs::path path_tmp = fs::path(path.string() + ".new");
+    FILE* file = fsbridge::fopen(path_tmp, "wb");
+    if (!file) return error("%s: Failed to open file %s", __func__, path_tmp.string());
+
+    // The header is written again once the checksum is known
+    unsigned char header[BLOCK_INDEX_IMAGE_HEADER_SIZE] = {};
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    CSipHasher hasher = ImageHasher();
+    std::vector<unsigned char> buffer;
+    for (size_t begin = 0; ok && begin < entries.size(); begin += IMAGE_WRITE_RECORDS) {
+        const size_t end = std::min(entries.size(), begin + IMAGE_WRITE_RECORDS);
+        buffer.resize((end - begin) * BLOCK_INDEX_IMAGE_RECORD_SIZE);
+        for (size_t i = begin; i < end; ++i) {
+            WriteRecord(buffer.data() + (i - begin) * BLOCK_INDEX_IMAGE_RECORD_SIZE, *entries[i], number(entries[i]->pprev), number(entries[i]->pskip));
+            numbers.emplace(entries[i], (int32_t)i);
+        }
+        hasher.Write(buffer.data(), buffer.size());
+        ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    }
+
+    memcpy(header, IMAGE_MAGIC, 4);
+    WriteLE32(header + 4, IMAGE_VERSION);
+    WriteLE64(header + 8, generation);
+    WriteLE64(header + 16, entries.size());
+    WriteLE64(header + 24, hasher.Finalize());
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), file) == sizeof(header) && FileCommit(file);
+    ok = fclose(file) == 0 && ok;
+    if (!ok || !RenameOver(path_tmp, path)) {
+        fs::remove(path_tmp);
+        return error("%s: Failed to write %s", __func__, path.string());
+    }
+    return true;
+}
+
+BlockIndexImage::BlockIndexImage(std::unique_ptr<MappedFile> file, size_t count) : m_file(std::move(file)), m_count(count) {}
+
+BlockIndexImage::~BlockIndexImage() {}
+
+std::unique_ptr<BlockIndexImage> BlockIndexImage::Open(const fs::path& path, uint64_t generation)
+{
+    boost::system::error_code ec;
+    const uint64_t file_size = fs::file_size(path, ec);
+    if (ec || file_size < BLOCK_INDEX_IMAGE_HEADER_SIZE) return nullptr;
+    std::unique_ptr<MappedFile> file = MappedFile::Open(path, file_size);
+    if (!file) return nullptr;
+
+    const unsigned char* header = file->data();
+    const uint64_t count = ReadLE64(header + 16);
+    if (memcmp(header, IMAGE_MAGIC, 4) != 0 || ReadLE32(header + 4) != IMAGE_VERSION || ReadLE64(header + 8) != generation ||
+        count > std::numeric_limits<int32_t>::max() || file_size != BLOCK_INDEX_IMAGE_HEADER_SIZE + count * BLOCK_INDEX_IMAGE_RECORD_SIZE) {
+        return nullptr;
+    }
+    CSipHasher hasher = ImageHasher();
+    hasher.Write(header + BLOCK_INDEX_IMAGE_HEADER_SIZE, count * BLOCK_INDEX_IMAGE_RECORD_SIZE);
+    if (hasher.Finalize() != ReadLE64(header + 24)) {
+        LogPrintf("Block index image %s is corrupt\n", path.string());
+        return nullptr;
+    }
+    return std::unique_ptr<BlockIndexImage>(new BlockIndexImage(std::move(file), count));
+}
+
+uint256 BlockIndexImage::Read(size_t i, CBlockIndex& index, int32_t& prev, int32_t& skip) const
+{
+    assert(i < m_count);
+    const unsigned char* in = m_file->data() + BLOCK_INDEX_IMAGE_HEADER_SIZE + i * BLOCK_INDEX_IMAGE_RECORD_SIZE;
+    uint256 hash, chain_work;
+    memcpy(hash.begin(), in, 32);
+    prev = ReadLE32(in + 32);
+    skip = ReadLE32(in + 36);
+    index.nHeight = ReadLE32(in + 40);
+    index.nFile = ReadLE32(in + 44);
+    index.nDataPos = ReadLE32(in + 48);
+    index.nUndoPos = ReadLE32(in + 52);
+    memcpy(chain_work.begin(), in + 56, 32);
+    index.nChainWork = UintToArith256(chain_work);
+    index.nTx = ReadLE32(in + 88);
+    index.nStatus = ReadLE32(in + 92);
+    index.nVersion = ReadLE32(in + 96);
+    memcpy(index.hashMerkleRoot.begin(), in + 100, 32);
+    index.nTime = ReadLE32(in + 132);
+    index.nBits = ReadLE32(in + 136);
+    index.nNonce = ReadLE32(in + 140);
+    return hash;
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_NODE_BLOCKINDEX_IMAGE_H
+#define PALLADIUM_NODE_BLOCKINDEX_IMAGE_H
+
+#include <fs.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class CBlockIndex;
+class MappedFile;
+
+/** Size of the header of a block index image. */
+static constexpr size_t BLOCK_INDEX_IMAGE_HEADER_SIZE = 32;
+/** Size of a block index entry in a block index image. */
+static constexpr size_t BLOCK_INDEX_IMAGE_RECORD_SIZE = 144;
+
+/**
+ * Write entries, parents before children, to a block index image at path
+ * tagged with generation. The image is a header followed by one fixed size
+ * record per entry, with the built fields of the entry (chain work, skip
+ * pointer, ...) and its parent and skip entries as record numbers. It is
+ * written to a temporary file first, so a crash leaves no partial image.
+ */
+bool WriteBlockIndexImage(const fs::path& path, uint64_t generation, const std::vector<const CBlockIndex*>& entries);
+
+/** A block index image mapped into memory, whose header and checksum were checked. */
+class BlockIndexImage
+{
+public:
+    /** Map the image at path. Returns nullptr if it is missing, corrupt or not of this generation. */
+    static std::unique_ptr<BlockIndexImage> Open(const fs::path& path, uint64_t generation);
+
+    ~BlockIndexImage();
+
+    size_t size() const { return m_count; }
+
+    /**
+     * Copy the fields of record i into index, except for phashBlock, pprev
+     * and pskip, whose hash and record numbers (-1 for none) are returned
+     * instead. Parents and skip entries precede the entries that refer to them.
+     */
+    uint256 Read(size_t i, CBlockIndex& index, int32_t& prev, int32_t& skip) const;
+
+private:
+    BlockIndexImage(std::unique_ptr<MappedFile> file, size_t count);
+
+    const std::unique_ptr<MappedFile> m_file;
+    const size_t m_count;
+};
+
+#endif // PALLADIUM_NODE_BLOCKINDEX_IMAGE_H
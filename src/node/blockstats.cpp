@@ -0,0 +1,146 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockstats.h>
+
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <undo.h>
+#include <version.h>
+
+#include <algorithm>
+
+// outpoint (needed for the utxo index) + nHeight + fCoinBase
+static constexpr size_t PER_UTXO_OVERHEAD = sizeof(COutPoint) + sizeof(uint32_t) + sizeof(bool);
+
+template<typename T>
+static T CalculateTruncatedMedian(std::vector<T>& scores)
+{
+    size_t size = scores.size();
+    if (size == 0) {
+        return 0;
+    }
+
+    std::sort(scores.begin(), scores.end());
+    if (size % 2 == 0) {
+        return (scores[size / 2 - 1] + scores[size / 2]) / 2;
+    } else {
+        return scores[size / 2];
+    }
+}
+
+void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight)
+{
+    if (scores.empty()) {
+        return;
+    }
+
+    std::sort(scores.begin(), scores.end());
+
+    // 10th, 25th, 50th, 75th, and 90th percentile weight units.
+    const double weights[NUM_GETBLOCKSTATS_PERCENTILES] = {
+        total_weight / 10.0, total_weight / 4.0, total_weight / 2.0, (total_weight * 3.0) / 4.0, (total_weight * 9.0) / 10.0
+    };
+
+    int64_t next_percentile_index = 0;
+    int64_t cumulative_weight = 0;
+    for (const auto& element : scores) {
+        cumulative_weight += element.second;
+        while (next_percentile_index < NUM_GETBLOCKSTATS_PERCENTILES && cumulative_weight >= weights[next_percentile_index]) {
+            result[next_percentile_index] = element.first;
+            ++next_percentile_index;
+        }
+    }
+
+    // Fill any remaining percentiles with the last value.
+    for (int64_t i = next_percentile_index; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
+        result[i] = scores.back().first;
+    }
+}
+
+bool ComputeBlockStats(const CBlock& block, const CBlockUndo& block_undo, CBlockStats& stats)
+{
+    if (block.vtx.empty() || block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return false;
+    }
+
+    stats = CBlockStats();
+    stats.txs = block.vtx.size();
+    CAmount minfee = MAX_MONEY;
+    CAmount minfeerate = MAX_MONEY;
+    int64_t mintxsize = MAX_BLOCK_SERIALIZED_SIZE;
+    std::vector<CAmount> fee_array;
+    std::vector<std::pair<CAmount, int64_t>> feerate_array;
+    std::vector<int64_t> txsize_array;
+
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+        stats.outs += tx.vout.size();
+
+        CAmount tx_total_out = 0;
+        for (const CTxOut& out : tx.vout) {
+            tx_total_out += out.nValue;
+            stats.utxo_size_inc += GetSerializeSize(out, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
+        }
+
+        if (tx.IsCoinBase()) {
+            continue;
+        }
+
+        stats.ins += tx.vin.size(); // Don't count coinbase's fake input
+        stats.total_out += tx_total_out; // Don't count coinbase reward
+
+        const int64_t tx_size = tx.GetTotalSize();
+        txsize_array.push_back(tx_size);
+        stats.maxtxsize = std::max(stats.maxtxsize, tx_size);
+        mintxsize = std::min(mintxsize, tx_size);
+        stats.total_size += tx_size;
+
+        const int64_t weight = GetTransactionWeight(tx);
+        stats.total_weight += weight;
+
+        if (tx.HasWitness()) {
+            ++stats.swtxs;
+            stats.swtotal_size += tx_size;
+            stats.swtotal_weight += weight;
+        }
+
+        const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+        if (tx_undo.vprevout.size() != tx.vin.size()) {
+            return false;
+        }
+        CAmount tx_total_in = 0;
+        for (const Coin& coin : tx_undo.vprevout) {
+            const CTxOut& prevoutput = coin.out;
+
+            tx_total_in += prevoutput.nValue;
+            stats.utxo_size_inc -= GetSerializeSize(prevoutput, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
+        }
+
+        const CAmount txfee = tx_total_in - tx_total_out;
+        if (!MoneyRange(txfee)) {
+            return false;
+        }
+        fee_array.push_back(txfee);
+        stats.maxfee = std::max(stats.maxfee, txfee);
+        minfee = std::min(minfee, txfee);
+        stats.totalfee += txfee;
+
+        // New feerate uses satoshis per virtual byte instead of per serialized byte
+        const CAmount feerate = weight ? (txfee * WITNESS_SCALE_FACTOR) / weight : 0;
+        feerate_array.emplace_back(feerate, weight);
+        stats.maxfeerate = std::max(stats.maxfeerate, feerate);
+        minfeerate = std::min(minfeerate, feerate);
+    }
+
+    stats.minfee = (minfee == MAX_MONEY) ? 0 : minfee;
+    stats.minfeerate = (minfeerate == MAX_MONEY) ? 0 : minfeerate;
+    stats.mintxsize = (mintxsize == MAX_BLOCK_SERIALIZED_SIZE) ? 0 : mintxsize;
+    stats.medianfee = CalculateTruncatedMedian(fee_array);
+    stats.mediantxsize = CalculateTruncatedMedian(txsize_array);
+    CalculatePercentilesByWeight(stats.feerate_percentiles, feerate_array, stats.total_weight);
+    return true;
+}
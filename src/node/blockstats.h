@@ -0,0 +1,76 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_NODE_BLOCKSTATS_H
+#define PALLADIUM_NODE_BLOCKSTATS_H
+
+#include <amount.h>
+#include <serialize.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+class CBlock;
+class CBlockUndo;
+
+static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
+
+/** Statistics of the transactions of a block, from which the results of getblockstats are derived. */
+struct CBlockStats
+{
+    //! Number of transactions, including the coinbase
+    int64_t txs{0};
+    //! Number of inputs, not counting the coinbase input
+    int64_t ins{0};
+    //! Number of outputs, including those of the coinbase
+    int64_t outs{0};
+
+    //! Fees and feerates (in satoshis per virtual byte) of the non-coinbase transactions, 0 if there are none
+    CAmount totalfee{0};
+    CAmount minfee{0};
+    CAmount maxfee{0};
+    CAmount medianfee{0};
+    CAmount minfeerate{0};
+    CAmount maxfeerate{0};
+    CAmount feerate_percentiles[NUM_GETBLOCKSTATS_PERCENTILES]{};
+
+    //! Sizes and weights of the non-coinbase transactions, 0 if there are none
+    int64_t total_size{0};
+    int64_t mintxsize{0};
+    int64_t maxtxsize{0};
+    int64_t mediantxsize{0};
+    int64_t total_weight{0};
+    int64_t swtxs{0};
+    int64_t swtotal_size{0};
+    int64_t swtotal_weight{0};
+
+    //! Amount of the outputs of the non-coinbase transactions
+    CAmount total_out{0};
+    //! Change of the size of the UTXO set (not discounting unspendable outputs)
+    int64_t utxo_size_inc{0};
+
+    SERIALIZE_METHODS(CBlockStats, obj)
+    {
+        READWRITE(obj.txs, obj.ins, obj.outs);
+        READWRITE(obj.totalfee, obj.minfee, obj.maxfee, obj.medianfee, obj.minfeerate, obj.maxfeerate);
+        for (int i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; ++i) {
+            READWRITE(obj.feerate_percentiles[i]);
+        }
+        READWRITE(obj.total_size, obj.mintxsize, obj.maxtxsize, obj.mediantxsize, obj.total_weight);
+        READWRITE(obj.swtxs, obj.swtotal_size, obj.swtotal_weight);
+        READWRITE(obj.total_out, obj.utxo_size_inc);
+    }
+};
+
+/**
+ * Compute the statistics of a block from the block and its undo data.
+ * Returns false if the undo data doesn't belong to the block.
+ */
+bool ComputeBlockStats(const CBlock& block, const CBlockUndo& block_undo, CBlockStats& stats);
+
+/** Used by getblockstats to get feerates at different percentiles by weight  */
+void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
+
+#endif // PALLADIUM_NODE_BLOCKSTATS_H
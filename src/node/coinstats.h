@@ -12,6 +12,16 @@
 #include <cstdint>
 
 class CCoinsView;
+class Coin;
+class COutPoint;
+class CScript;
+class MuHash3072;
+
+enum class CoinStatsHashType {
+    HASH_SERIALIZED,
+    MUHASH,
+    NONE,
+};
 
 struct CCoinsStats
 {
@@ -20,6 +30,7 @@ struct CCoinsStats
     uint64_t nTransactions{0};
     uint64_t nTransactionOutputs{0};
     uint64_t nBogoSize{0};
+    //! The hash of the UTXO set, of the type requested (null for CoinStatsHashType::NONE).
     uint256 hashSerialized{};
     uint64_t nDiskSize{0};
     CAmount nTotalAmount{0};
@@ -29,6 +40,13 @@ struct CCoinsStats
 };
 
 //! Calculate statistics about the unspent transaction output set
-bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats);
+bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, CoinStatsHashType hash_type = CoinStatsHashType::HASH_SERIALIZED);
+
+//! The contribution of an output to the bogosize of the UTXO set
+uint64_t GetBogoSize(const CScript& script_pub_key);
+
+//! Add a coin to, or remove it from, the MuHash of a UTXO set
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
 
 #endif // PALLADIUM_NODE_COINSTATS_H
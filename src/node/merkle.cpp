@@ -0,0 +1,143 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/merkle.h>
+
+#include <consensus/merkle.h>
+#include <crypto/sha256.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <thread>
+
+namespace {
+
+/**
+ * Hash the count nodes at nodes up exactly levels levels of the Merkle tree,
+ * leaving the subtree root in nodes[0]. Odd levels get their last node
+ * duplicated, so nodes needs room for one more hash when count is not a
+ * multiple of 2^levels. Unlike ComputeMerkleRoot(), a level of one node is
+ * hashed with itself too: in the whole tree it is the odd last node of a
+ * larger level. If branch is set, the hashes needed to go from the node
+ * at position to the subtree root are appended to it.
+ */
+void HashSubtree(uint256* nodes, size_t count, int levels, bool* mutated, uint32_t position, std::vector<uint256>* branch)
+{
+    bool mutation = false;
+    for (int level = 0; level < levels; ++level) {
+        if (mutated) {
+            for (size_t pos = 0; pos + 1 < count; pos += 2) {
+                if (nodes[pos] == nodes[pos + 1]) mutation = true;
+            }
+        }
+        if (count & 1) {
+            nodes[count] = nodes[count - 1];
+            ++count;
+        }
+        if (branch) branch->push_back(nodes[position ^ 1]);
+        SHA256D64(nodes[0].begin(), nodes[0].begin(), count / 2);
+        count /= 2;
+        position >>= 1;
+    }
+    if (mutated) *mutated = mutation;
+}
+
+/**
+ * Replace the leaves in hashes by the roots of subtrees of 2^levels leaves,
+ * hashed one per thread, and return levels; or return 0 and leave hashes
+ * alone if the tree is too small to be worth splitting. The subtree
+ * boundaries line up with the pairs of every level below them, and only
+ * the last subtree can have odd levels, so the roots are the nodes of the
+ * whole tree at that level.
+ */
+int HashSubtrees(std::vector<uint256>& hashes, bool* mutated, uint32_t position, std::vector<uint256>* branch)
+{
+    const size_t num_threads = std::min(std::max(GetNumCores(), 1), MAX_MERKLE_THREADS);
+    if (num_threads < 2 || hashes.size() < MIN_PARALLEL_MERKLE_LEAVES) return 0;
+    int levels = 0;
+    while ((size_t{1} << levels) * num_threads < hashes.size()) ++levels;
+    const size_t subtree_leaves = size_t{1} << levels;
+    const size_t num_subtrees = (hashes.size() + subtree_leaves - 1) / subtree_leaves;
+
+    // The last subtree may be partial; it gets hashed in a copy with room
+    // for the duplicated nodes, as they would overwrite the next subtree.
+    std::vector<uint256> last(hashes.begin() + (num_subtrees - 1) * subtree_leaves, hashes.end());
+    last.emplace_back();
+    std::vector<char> subtree_mutated(num_subtrees, 0);
+    auto hash_subtree = [&](size_t i) {
+        uint256* nodes = i + 1 == num_subtrees ? last.data() : &hashes[i * subtree_leaves];
+        const size_t count = i + 1 == num_subtrees ? last.size() - 1 : subtree_leaves;
+        const bool has_position = (position >> levels) == i;
+        bool subtree_mutation = false;
+        HashSubtree(nodes, count, levels, mutated ? &subtree_mutation : nullptr, position & (subtree_leaves - 1), has_position ? branch : nullptr);
+        subtree_mutated[i] = subtree_mutation;
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(num_subtrees - 1);
+    for (size_t i = 1; i < num_subtrees; ++i) {
+        threads.emplace_back(hash_subtree, i);
+    }
+    hash_subtree(0);
+    for (std::thread& thread : threads) thread.join();
+
+    for (size_t i = 0; i + 1 < num_subtrees; ++i) {
+        hashes[i] = hashes[i * subtree_leaves];
+    }
+    hashes[num_subtrees - 1] = last[0];
+    hashes.resize(num_subtrees);
+    if (mutated) *mutated = std::find(subtree_mutated.begin(), subtree_mutated.end(), 1) != subtree_mutated.end();
+    return levels;
+}
+
+std::vector<uint256> BlockLeaves(const CBlock& block)
+{
+    std::vector<uint256> leaves;
+    leaves.resize(block.vtx.size());
+    for (size_t s = 0; s < block.vtx.size(); s++) {
+        leaves[s] = block.vtx[s]->GetHash();
+    }
+    return leaves;
+}
+
+} // namespace
+
+uint256 ParallelMerkleRoot(std::vector<uint256> hashes, bool* mutated)
+{
+    bool mutation = false;
+    HashSubtrees(hashes, mutated ? &mutation : nullptr, 0, nullptr);
+    bool upper_mutation = false;
+    const uint256 root = ComputeMerkleRoot(std::move(hashes), mutated ? &upper_mutation : nullptr);
+    if (mutated) *mutated = mutation || upper_mutation;
+    return root;
+}
+
+std::vector<uint256> ParallelMerkleBranch(std::vector<uint256> hashes, uint32_t position)
+{
+    std::vector<uint256> branch;
+    const int levels = HashSubtrees(hashes, nullptr, position, &branch);
+    const std::vector<uint256> upper = ComputeMerkleBranch(std::move(hashes), position >> levels);
+    branch.insert(branch.end(), upper.begin(), upper.end());
+    return branch;
+}
+
+uint256 ParallelBlockMerkleRoot(const CBlock& block, bool* mutated)
+{
+    return ParallelMerkleRoot(BlockLeaves(block), mutated);
+}
+
+uint256 ParallelBlockWitnessMerkleRoot(const CBlock& block, bool* mutated)
+{
+    std::vector<uint256> leaves;
+    leaves.resize(block.vtx.size());
+    leaves[0].SetNull(); // The witness hash of the coinbase is 0.
+    for (size_t s = 1; s < block.vtx.size(); s++) {
+        leaves[s] = block.vtx[s]->GetWitnessHash();
+    }
+    return ParallelMerkleRoot(std::move(leaves), mutated);
+}
+
+std::vector<uint256> ParallelBlockMerkleBranch(const CBlock& block, uint32_t position)
+{
+    return ParallelMerkleBranch(BlockLeaves(block), position);
+}
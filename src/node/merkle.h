@@ -0,0 +1,34 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_NODE_MERKLE_H
+#define PALLADIUM_NODE_MERKLE_H
+
+#include <primitives/block.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <vector>
+
+/** Merkle trees with fewer leaves are computed on the calling thread. */
+static constexpr size_t MIN_PARALLEL_MERKLE_LEAVES = 4096;
+/** Maximum number of threads a Merkle tree is computed on. */
+static constexpr int MAX_MERKLE_THREADS = 8;
+
+/**
+ * The Merkle root of hashes, as ComputeMerkleRoot() computes it. Large trees
+ * are split in one subtree per thread, and only the levels above the
+ * subtree roots are computed on the calling thread.
+ */
+uint256 ParallelMerkleRoot(std::vector<uint256> hashes, bool* mutated = nullptr);
+
+/** The Merkle branch of the leaf at position, as ComputeMerkleBranch() computes it, likewise split across threads. */
+std::vector<uint256> ParallelMerkleBranch(std::vector<uint256> hashes, uint32_t position);
+
+/** BlockMerkleRoot(), BlockWitnessMerkleRoot() and BlockMerkleBranch() on top of the parallel computations. */
+uint256 ParallelBlockMerkleRoot(const CBlock& block, bool* mutated = nullptr);
+uint256 ParallelBlockWitnessMerkleRoot(const CBlock& block, bool* mutated = nullptr);
+std::vector<uint256> ParallelBlockMerkleBranch(const CBlock& block, uint32_t position);
+
+#endif // PALLADIUM_NODE_MERKLE_H
@@ -8,6 +8,7 @@
 #include <node/psbt.h>
 #include <policy/policy.h>
 #include <policy/settings.h>
+#include <script/sign.h>
 #include <tinyformat.h>
 
 #include <numeric>
@@ -22,6 +23,8 @@ PSBTAnalysis AnalyzePSBT(PartiallySignedTransaction psbtx)
     CAmount in_amt = 0;
 
     result.inputs.resize(psbtx.tx->vin.size());
+    // Inputs with a UTXO that are not final yet, to be analyzed once all are checked
+    std::vector<unsigned int> to_analyze;
 
     for (unsigned int i = 0; i < psbtx.tx->vin.size(); ++i) {
         PSBTInput& input = psbtx.inputs[i];
@@ -58,32 +61,38 @@ PSBTAnalysis AnalyzePSBT(PartiallySignedTransaction psbtx)
         // Check if it is final
         if (!utxo.IsNull() && !PSBTInputSigned(input)) {
             input_analysis.is_final = false;
-
-            // Figure out what is missing
-            SignatureData outdata;
-            bool complete = SignPSBTInput(DUMMY_SIGNING_PROVIDER, psbtx, i, 1, &outdata);
-
-            // Things are missing
-            if (!complete) {
-                input_analysis.missing_pubkeys = outdata.missing_pubkeys;
-                input_analysis.missing_redeem_script = outdata.missing_redeem_script;
-                input_analysis.missing_witness_script = outdata.missing_witness_script;
-                input_analysis.missing_sigs = outdata.missing_sigs;
-
-                // If we are only missing signatures and nothing else, then next is signer
-                if (outdata.missing_pubkeys.empty() && outdata.missing_redeem_script.IsNull() && outdata.missing_witness_script.IsNull() && !outdata.missing_sigs.empty()) {
-                    input_analysis.next = PSBTRole::SIGNER;
-                } else {
-                    input_analysis.next = PSBTRole::UPDATER;
-                }
-            } else {
-                input_analysis.next = PSBTRole::FINALIZER;
-            }
+            to_analyze.push_back(i);
         } else if (!utxo.IsNull()){
             input_analysis.is_final = true;
         }
     }
 
+    ForEachInputParallel(to_analyze.size(), [&](size_t n) {
+        const unsigned int i = to_analyze[n];
+        PSBTInputAnalysis& input_analysis = result.inputs[i];
+
+        // Figure out what is missing
+        SignatureData outdata;
+        bool complete = SignPSBTInput(DUMMY_SIGNING_PROVIDER, psbtx, i, 1, &outdata);
+
+        // Things are missing
+        if (!complete) {
+            input_analysis.missing_pubkeys = outdata.missing_pubkeys;
+            input_analysis.missing_redeem_script = outdata.missing_redeem_script;
+            input_analysis.missing_witness_script = outdata.missing_witness_script;
+            input_analysis.missing_sigs = outdata.missing_sigs;
+
+            // If we are only missing signatures and nothing else, then next is signer
+            if (outdata.missing_pubkeys.empty() && outdata.missing_redeem_script.IsNull() && outdata.missing_witness_script.IsNull() && !outdata.missing_sigs.empty()) {
+                input_analysis.next = PSBTRole::SIGNER;
+            } else {
+                input_analysis.next = PSBTRole::UPDATER;
+            }
+        } else {
+            input_analysis.next = PSBTRole::FINALIZER;
+        }
+    });
+
     // Calculate next role for PSBT by grabbing "minimum" PSBTInput next role
     result.next = PSBTRole::EXTRACTOR;
     for (unsigned int i = 0; i < psbtx.tx->vin.size(); ++i) {
@@ -115,13 +124,19 @@ PSBTAnalysis AnalyzePSBT(PartiallySignedTransaction psbtx)
         CMutableTransaction mtx(*psbtx.tx);
         CCoinsView view_dummy;
         CCoinsViewCache view(&view_dummy);
+
+        // Sign every input with dummy signatures, then put them together
+        std::vector<char> signed_inputs(psbtx.tx->vin.size());
+        ForEachInputParallel(signed_inputs.size(), [&](size_t i) {
+            signed_inputs[i] = SignPSBTInput(DUMMY_SIGNING_PROVIDER, psbtx, i, 1, nullptr, true);
+        });
         bool success = true;
 
         for (unsigned int i = 0; i < psbtx.tx->vin.size(); ++i) {
             PSBTInput& input = psbtx.inputs[i];
             Coin newcoin;
 
-            if (!SignPSBTInput(DUMMY_SIGNING_PROVIDER, psbtx, i, 1, nullptr, true) || !psbtx.GetInputUTXO(newcoin.out, i)) {
+            if (!signed_inputs[i] || !psbtx.GetInputUTXO(newcoin.out, i)) {
                 success = false;
                 break;
             } else {
@@ -83,3 +83,46 @@ TransactionError BroadcastTransaction(NodeContext& node, const CTransactionRef t
 
     return TransactionError::OK;
 }
+
+TransactionError BroadcastPackage(NodeContext& node, const std::vector<CTransactionRef>& package, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback)
+{
+    assert(node.connman);
+    assert(node.mempool);
+    std::promise<void> promise;
+
+    { // cs_main scope
+    LOCK(cs_main);
+    TxValidationState state;
+    uint256 failed_txid;
+    if (!AcceptPackageToMemoryPool(*node.mempool, state, package, failed_txid, max_tx_fee)) {
+        err_string = state.ToString();
+        if (!failed_txid.IsNull()) err_string = failed_txid.GetHex() + ": " + err_string;
+        if (state.IsInvalid()) {
+            if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
+                return TransactionError::MISSING_INPUTS;
+            }
+            return TransactionError::MEMPOOL_REJECTED;
+        } else {
+            return TransactionError::MEMPOOL_ERROR;
+        }
+    }
+
+    if (wait_callback) {
+        CallFunctionInValidationInterfaceQueue([&promise] {
+            promise.set_value();
+        });
+    }
+    } // cs_main
+
+    if (wait_callback) {
+        promise.get_future().wait();
+    }
+
+    if (relay) {
+        for (const CTransactionRef& tx : package) {
+            RelayTransaction(tx->GetHash(), *node.connman);
+        }
+    }
+
+    return TransactionError::OK;
+}
@@ -9,6 +9,8 @@
 #include <primitives/transaction.h>
 #include <util/error.h>
 
+#include <vector>
+
 struct NodeContext;
 
 /**
@@ -30,4 +32,22 @@ struct NodeContext;
  */
 NODISCARD TransactionError BroadcastTransaction(NodeContext& node, CTransactionRef tx, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback);
 
+/**
+ * Submit a package of transactions to the mempool as a unit and (optionally)
+ * relay each of them to all P2P peers. Either every transaction of the package
+ * is accepted or none is. The package must be sorted parents first.
+ *
+ * Same locking requirements as BroadcastTransaction.
+ *
+ * @param[in]  node reference to node context
+ * @param[in]  package the transactions to broadcast
+ * @param[out] err_string reference to std::string to fill with error string if available,
+ *             prefixed with the txid of the transaction that failed if the failure was specific to one
+ * @param[in]  max_tx_fee reject packages with total fees higher than this (if 0, accept any fee)
+ * @param[in]  relay flag if both mempool insertion and p2p relay are requested
+ * @param[in]  wait_callback wait until callbacks have been processed to avoid stale result due to a sequentially RPC.
+ * return error
+ */
+NODISCARD TransactionError BroadcastPackage(NodeContext& node, const std::vector<CTransactionRef>& package, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback);
+
 #endif // PALLADIUM_NODE_TRANSACTION_H
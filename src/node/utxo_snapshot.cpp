@@ -0,0 +1,157 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/utxo_snapshot.h>
+
+#include <clientversion.h>
+#include <coins.h>
+#include <hash.h>
+#include <logging.h>
+#include <shutdown.h>
+#include <streams.h>
+#include <tinyformat.h>
+#include <txdb.h>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+COutPoint SnapshotShardStart(int shard)
+{
+    uint256 txid;
+    *txid.begin() = shard * 256 / SNAPSHOT_SHARDS;
+    return COutPoint(txid, 0);
+}
+
+static bool WriteChunk(CAutoFile& file, SnapshotChunk& chunk, CDataStream& data)
+{
+    chunk.m_data.assign(data.begin(), data.end());
+    chunk.m_checksum = Hash(chunk.m_data.begin(), chunk.m_data.end());
+    try {
+        file << chunk;
+    } catch (const std::ios_base::failure&) {
+        return false;
+    }
+    chunk.m_coins_count = 0;
+    data.clear();
+    return true;
+}
+
+bool WriteSnapshotShard(CCoinsViewCursor& cursor, int shard, CAutoFile& file, uint64_t& coins_written,
+                        const std::function<bool()>& interrupt)
+{
+    const int end_byte = (shard + 1) * 256 / SNAPSHOT_SHARDS;
+    SnapshotChunk chunk;
+    CDataStream data(SER_DISK, CLIENT_VERSION);
+    COutPoint key;
+    Coin coin;
+    coins_written = 0;
+
+    for (; cursor.Valid(); cursor.Next()) {
+        if (coins_written % 5000 == 0 && interrupt()) return false;
+        if (!cursor.GetKey(key) || *key.hash.begin() >= end_byte) break;
+        if (!cursor.GetValue(coin)) continue;
+        data << key << coin;
+        ++chunk.m_coins_count;
+        ++coins_written;
+        if (data.size() >= SNAPSHOT_CHUNK_SIZE && !WriteChunk(file, chunk, data)) return false;
+    }
+    return chunk.m_coins_count == 0 || WriteChunk(file, chunk, data);
+}
+
+bool LoadSnapshotCoins(CBufferedFile& coins_file, const SnapshotMetadata& metadata, int base_height,
+                       CCoinsViewDB& coins_db, size_t cache_size, std::string& error)
+{
+    // While one batch is being written, the next one is read into the cache,
+    // so each of them gets half of the memory.
+    const size_t batch_size = std::max<size_t>(cache_size / 2, 1 << 20);
+    CCoinsViewBackgroundFlush flush_view(&coins_db, coins_db, /* background */ true);
+    CCoinsViewCache coins_cache(&flush_view);
+    coins_cache.SetBestBlock(metadata.m_base_blockhash);
+
+    SnapshotChunk chunk;
+    COutPoint outpoint;
+    Coin coin;
+    uint64_t coins_loaded = 0;
+    while (coins_loaded < metadata.m_coins_count) {
+        try {
+            coins_file >> chunk;
+        } catch (const std::ios_base::failure&) {
+            error = strprintf("bad snapshot format or truncated snapshot after deserializing %d coins", coins_loaded);
+            return false;
+        }
+        if (Hash(chunk.m_data.begin(), chunk.m_data.end()) != chunk.m_checksum) {
+            error = strprintf("checksum mismatch in snapshot chunk after %d coins", coins_loaded);
+            return false;
+        }
+        if (chunk.m_coins_count > metadata.m_coins_count - coins_loaded) {
+            error = strprintf("bad snapshot - coins left over after deserializing %d coins", coins_loaded);
+            return false;
+        }
+
+        CDataStream data(chunk.m_data, SER_DISK, CLIENT_VERSION);
+        for (uint32_t i = 0; i < chunk.m_coins_count; ++i) {
+            try {
+                data >> outpoint;
+                data >> coin;
+            } catch (const std::ios_base::failure&) {
+                error = strprintf("bad snapshot chunk after deserializing %d coins", coins_loaded);
+                return false;
+            }
+            if (coin.IsSpent() || coin.nHeight > (uint32_t)base_height ||
+                outpoint.n >= std::numeric_limits<decltype(outpoint.n)>::max()) {
+                error = strprintf("bad snapshot data after deserializing %d coins", coins_loaded);
+                return false;
+            }
+            try {
+                coins_cache.AddCoin(outpoint, std::move(coin), /* potential_overwrite */ false);
+            } catch (const std::logic_error&) {
+                error = strprintf("duplicate coin %s in snapshot", outpoint.ToString());
+                return false;
+            }
+            ++coins_loaded;
+            if (coins_loaded % 100000 == 0) {
+                LogPrintf("[snapshot] %d coins loaded (%.2f%%)\n",
+                    coins_loaded, 100.0 * coins_loaded / metadata.m_coins_count);
+            }
+        }
+        if (!data.empty()) {
+            error = strprintf("bad snapshot chunk after deserializing %d coins", coins_loaded);
+            return false;
+        }
+
+        if (ShutdownRequested()) {
+            error = "shutdown requested";
+            return false;
+        }
+        if (coins_cache.DynamicMemoryUsage() > batch_size) {
+            LogPrint(BCLog::COINDB, "[snapshot] flushing %d coins (%.2f MiB)\n",
+                coins_cache.GetCacheSize(), coins_cache.DynamicMemoryUsage() * (1.0 / 1048576.0));
+            if (!coins_cache.Flush()) {
+                error = "failed to write snapshot coins to disk";
+                return false;
+            }
+        }
+    }
+
+    // The metadata must account for every coin in the file.
+    bool out_of_coins = false;
+    try {
+        unsigned char extra;
+        coins_file >> extra;
+    } catch (const std::ios_base::failure&) {
+        out_of_coins = true;
+    }
+    if (!out_of_coins) {
+        error = strprintf("bad snapshot - coins left over after deserializing %d coins", coins_loaded);
+        return false;
+    }
+
+    if (!coins_cache.Flush() || !flush_view.Sync()) {
+        error = "failed to write snapshot coins to disk";
+        return false;
+    }
+    LogPrintf("[snapshot] loaded %d coins based on block %s\n", coins_loaded, metadata.m_base_blockhash.ToString());
+    return true;
+}
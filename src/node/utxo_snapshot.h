@@ -9,6 +9,16 @@
 #include <uint256.h>
 #include <serialize.h>
 
+#include <functional>
+#include <string>
+#include <vector>
+
+class CAutoFile;
+class CBufferedFile;
+class CCoinsViewCursor;
+class CCoinsViewDB;
+class COutPoint;
+
 //! Metadata describing a serialized version of a UTXO set from which an
 //! assumeutxo CChainState can be constructed.
 class SnapshotMetadata
@@ -47,4 +57,61 @@ public:
 
 };
 
+//! The coins of a snapshot follow its metadata in chunks of about this many bytes.
+static constexpr size_t SNAPSHOT_CHUNK_SIZE = 1 << 20;
+
+//! Number of outpoint ranges the coins of a snapshot are written in. Shard i
+//! holds the coins whose txid starts with a byte in
+//! [i * 256 / SNAPSHOT_SHARDS, (i + 1) * 256 / SNAPSHOT_SHARDS), so shards
+//! can be serialized in parallel while the file stays deterministic.
+static constexpr int SNAPSHOT_SHARDS = 16;
+
+//! A run of snapshot coins with a checksum, so that any chunk can be
+//! verified on its own.
+class SnapshotChunk
+{
+public:
+    //! The number of serialized outpoint and coin pairs in m_data.
+    uint32_t m_coins_count = 0;
+    std::vector<unsigned char> m_data;
+    //! SHA256d of m_data.
+    uint256 m_checksum;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(m_coins_count);
+        READWRITE(m_data);
+        READWRITE(m_checksum);
+    }
+};
+
+//! The first outpoint of a shard, to position a coins cursor at.
+COutPoint SnapshotShardStart(int shard);
+
+/**
+ * Write the coins of one shard as chunks, reading from a cursor positioned at
+ * SnapshotShardStart(shard).
+ *
+ * @param[in]   interrupt  Polled regularly; writing stops when it returns true.
+ * @param[out]  coins_written  The number of coins written.
+ * @return  false if interrupted or the file could not be written
+ */
+bool WriteSnapshotShard(CCoinsViewCursor& cursor, int shard, CAutoFile& file, uint64_t& coins_written,
+                        const std::function<bool()>& interrupt);
+
+/**
+ * Populate a coins database with the coins of a snapshot, read from coins_file
+ * right after its metadata. Coins are cached up to cache_size bytes and then
+ * written out in the background while the next batch is read.
+ *
+ * @param[in]   base_height  The height of the snapshot base block; no coin may be more recent.
+ * @param[out]  error  Why the snapshot was rejected, if it was.
+ * @return  false if the snapshot is malformed or the coins could not be written
+ */
+bool LoadSnapshotCoins(CBufferedFile& coins_file, const SnapshotMetadata& metadata, int base_height,
+                       CCoinsViewDB& coins_db, size_t cache_size, std::string& error);
+
 #endif // PALLADIUM_NODE_UTXO_SNAPSHOT_H
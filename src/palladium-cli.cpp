@@ -12,12 +12,15 @@
 #include <rpc/client.h>
 #include <rpc/protocol.h>
 #include <rpc/request.h>
+#include <util/memory.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 #include <util/translation.h>
 
+#include <deque>
 #include <functional>
 #include <memory>
+#include <sstream>
 #include <stdio.h>
 #include <tuple>
 
@@ -34,6 +37,7 @@ static const char DEFAULT_RPCCONNECT[] = "127.0.0.1";
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT=900;
 static const bool DEFAULT_NAMED=false;
 static const int CONTINUE_EXECUTION=-1;
+static const int DEFAULT_BATCH_PIPELINE=4;
 
 static void SetupCliArgs()
 {
@@ -44,11 +48,13 @@ static void SetupCliArgs()
     const auto regtestBaseParams = CreateBaseChainParams(CBaseChainParams::REGTEST);
 
     gArgs.AddArg("-version", "Print version and exit", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-batch", "Read requests from standard input, one per line, as a JSON-RPC request object or as a command with its arguments separated by spaces, and print each reply as one line of JSON in request order. The requests go over keep-alive connections, see -pipeline. Exit status is 1 if any request failed", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-conf=<file>", strprintf("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)", PALLADIUM_CONF_FILENAME), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-getinfo", "Get general information from the remote server. Note that unlike server-side RPC calls, the results of -getinfo is the result of multiple non-atomic requests. Some entries in the result may represent results from different states (e.g. wallet balance may be as of a different block from the chain state reported)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     SetupChainParamsBaseOptions();
     gArgs.AddArg("-named", strprintf("Pass named instead of positional arguments (default: %s)", DEFAULT_NAMED), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-pipeline=<n>", strprintf("With -batch, keep up to <n> requests in flight, each on its own keep-alive connection (default: %d)", DEFAULT_BATCH_PIPELINE), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-rpcclienttimeout=<n>", strprintf("Timeout in seconds during HTTP requests, or 0 for no timeout. (default: %d)", DEFAULT_HTTP_CLIENT_TIMEOUT), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-rpcconnect=<ip>", strprintf("Send commands to node running on <ip> (default: %s)", DEFAULT_RPCCONNECT), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-rpccookiefile=<loc>", "Location of the auth cookie. Relative paths will be prefixed by a net-specific datadir location. (default: data dir)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -298,48 +304,42 @@ public:
     }
 };
 
-static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, const std::vector<std::string>& args)
+/** Resolve -rpcconnect and -rpcport to the server's host and port */
+static void GetRPCHostPort(std::string& host, int& port)
 {
-    std::string host;
     // In preference order, we choose the following for the port:
     //     1. -rpcport
     //     2. port in -rpcconnect (ie following : in ipv4 or ]: in ipv6)
     //     3. default port for chain
-    int port = BaseParams().RPCPort();
+    port = BaseParams().RPCPort();
     SplitHostPort(gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT), port, host);
     port = gArgs.GetArg("-rpcport", port);
+}
 
-    // Obtain event base
-    raii_event_base base = obtain_event_base();
-
+static raii_evhttp_connection OpenRPCConnection(struct event_base* base, const std::string& host, int port)
+{
     // Synchronously look up hostname
-    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), host, port);
+    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base, host, port);
 
     // Set connection timeout
-    {
-        const int timeout = gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT);
-        if (timeout > 0) {
-            evhttp_connection_set_timeout(evcon.get(), timeout);
-        } else {
-            // Indefinite request timeouts are not possible in libevent-http, so we
-            // set the timeout to a very long time period instead.
+    const int timeout = gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT);
+    if (timeout > 0) {
+        evhttp_connection_set_timeout(evcon.get(), timeout);
+    } else {
+        // Indefinite request timeouts are not possible in libevent-http, so we
+        // set the timeout to a very long time period instead.
 
-            constexpr int YEAR_IN_SECONDS = 31556952; // Average length of year in Gregorian calendar
-            evhttp_connection_set_timeout(evcon.get(), 5 * YEAR_IN_SECONDS);
-        }
+        constexpr int YEAR_IN_SECONDS = 31556952; // Average length of year in Gregorian calendar
+        evhttp_connection_set_timeout(evcon.get(), 5 * YEAR_IN_SECONDS);
     }
+    return evcon;
+}
 
-    HTTPReply response;
-    raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
-    if (req == nullptr)
-        throw std::runtime_error("create http request failed");
-#if LIBEVENT_VERSION_NUMBER >= 0x02010300
-    evhttp_request_set_error_cb(req.get(), http_error_cb);
-#endif
-
-    // Get credentials
+/** The user:password pair to authenticate with; failedToGetAuthCookie is set if there is none */
+static std::string GetRPCUserColonPass(bool& failedToGetAuthCookie)
+{
     std::string strRPCUserColonPass;
-    bool failedToGetAuthCookie = false;
+    failedToGetAuthCookie = false;
     if (gArgs.GetArg("-rpcpassword", "") == "") {
         // Try fall back to cookie-based authentication if no password is provided
         if (!GetAuthCookie(&strRPCUserColonPass)) {
@@ -348,19 +348,12 @@ static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, co
     } else {
         strRPCUserColonPass = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
     }
+    return strRPCUserColonPass;
+}
 
-    struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
-    assert(output_headers);
-    evhttp_add_header(output_headers, "Host", host.c_str());
-    evhttp_add_header(output_headers, "Connection", "close");
-    evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
-
-    // Attach request data
-    std::string strRequest = rh->PrepareRequest(strMethod, args).write() + "\n";
-    struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
-    assert(output_buffer);
-    evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
-
+/** The HTTP endpoint for the requests, which depends on -rpcwallet */
+static std::string GetRPCEndpoint()
+{
     // check if we should use a special wallet endpoint
     std::string endpoint = "/";
     if (!gArgs.GetArgs("-rpcwallet").empty()) {
@@ -374,14 +367,42 @@ static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, co
             throw CConnectionFailed("uri-encode failed");
         }
     }
-    int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, endpoint.c_str());
+    return endpoint;
+}
+
+/** Send a POST request of body on evcon. cb is called with response when it is done. */
+static void SendRPCRequest(struct evhttp_connection* evcon, void (*cb)(struct evhttp_request*, void*), HTTPReply* response,
+                           const std::string& host, const std::string& strRPCUserColonPass, const std::string& endpoint,
+                           const std::string& body, bool keep_alive)
+{
+    raii_evhttp_request req = obtain_evhttp_request(cb, (void*)response);
+    if (req == nullptr)
+        throw std::runtime_error("create http request failed");
+#if LIBEVENT_VERSION_NUMBER >= 0x02010300
+    evhttp_request_set_error_cb(req.get(), http_error_cb);
+#endif
+
+    struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
+    assert(output_headers);
+    evhttp_add_header(output_headers, "Host", host.c_str());
+    evhttp_add_header(output_headers, "Connection", keep_alive ? "keep-alive" : "close");
+    evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
+
+    // Attach request data
+    struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
+    assert(output_buffer);
+    evbuffer_add(output_buffer, body.data(), body.size());
+
+    int r = evhttp_make_request(evcon, req.get(), EVHTTP_REQ_POST, endpoint.c_str());
     req.release(); // ownership moved to evcon in above call
     if (r != 0) {
         throw CConnectionFailed("send http request failed");
     }
+}
 
-    event_base_dispatch(base.get());
-
+/** Throw if the HTTP response is not a JSON-RPC reply; otherwise return it parsed. */
+static UniValue ParseRPCResponse(const HTTPReply& response, const std::string& host, int port, bool failedToGetAuthCookie)
+{
     if (response.status == 0) {
         std::string responseErrorMessage;
         if (response.error != -1) {
@@ -405,6 +426,30 @@ static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, co
     UniValue valReply(UniValue::VSTR);
     if (!valReply.read(response.body))
         throw std::runtime_error("couldn't parse reply from server");
+    return valReply;
+}
+
+static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, const std::vector<std::string>& args)
+{
+    std::string host;
+    int port;
+    GetRPCHostPort(host, port);
+
+    // Obtain event base
+    raii_event_base base = obtain_event_base();
+    raii_evhttp_connection evcon = OpenRPCConnection(base.get(), host, port);
+
+    // Get credentials
+    bool failedToGetAuthCookie;
+    const std::string strRPCUserColonPass = GetRPCUserColonPass(failedToGetAuthCookie);
+
+    HTTPReply response;
+    std::string strRequest = rh->PrepareRequest(strMethod, args).write() + "\n";
+    SendRPCRequest(evcon.get(), http_request_done, &response, host, strRPCUserColonPass, GetRPCEndpoint(), strRequest, /* keep_alive */ false);
+
+    event_base_dispatch(base.get());
+
+    const UniValue valReply = ParseRPCResponse(response, host, port, failedToGetAuthCookie);
     const UniValue reply = rh->ProcessReply(valReply);
     if (reply.empty())
         throw std::runtime_error("expected reply to have result, error and id properties");
@@ -412,6 +457,140 @@ static UniValue CallRPC(BaseRequestHandler *rh, const std::string& strMethod, co
     return reply;
 }
 
+/** A request of -batch, kept until its reply is printed */
+struct BatchEntry : public HTTPReply
+{
+    UniValue id;
+    /** Set by batch_request_done once the response is in */
+    bool done{false};
+    /** The connection it was sent on, or -1 once that is free again */
+    int connection{-1};
+    /** The reply to print */
+    UniValue reply;
+};
+
+static void batch_request_done(struct evhttp_request *req, void *ctx)
+{
+    http_request_done(req, ctx);
+    static_cast<BatchEntry*>(static_cast<HTTPReply*>(ctx))->done = true;
+}
+
+/** Turn a line of -batch input, either a JSON-RPC request object or a command
+ * line, into a request with the given id unless the object has its own. */
+static UniValue ParseBatchLine(const std::string& line, const UniValue& default_id)
+{
+    if (line[line.find_first_not_of(" \t")] == '{') {
+        UniValue request;
+        if (!request.read(line) || !request.isObject()) {
+            throw std::runtime_error("Parse error");
+        }
+        const UniValue& method = find_value(request, "method");
+        if (!method.isStr()) {
+            throw std::runtime_error("Method must be a string");
+        }
+        const UniValue& params = find_value(request, "params");
+        if (!params.isNull() && !params.isArray() && !params.isObject()) {
+            throw std::runtime_error("Params must be an array or object");
+        }
+        const UniValue& id = find_value(request, "id");
+        return JSONRPCRequestObj(method.get_str(), params, id.isNull() ? default_id : id);
+    }
+    std::istringstream words(line);
+    std::vector<std::string> args;
+    std::string word;
+    while (words >> word) {
+        args.push_back(word);
+    }
+    const std::string method = args[0];
+    args.erase(args.begin());
+    UniValue params = gArgs.GetBoolArg("-named", DEFAULT_NAMED) ? RPCConvertNamedValues(method, args) : RPCConvertValues(method, args);
+    return JSONRPCRequestObj(method, params, default_id);
+}
+
+/** Send the requests of standard input and print their replies in order (-batch) */
+static int BatchRPC()
+{
+    const size_t depth = std::max<int64_t>(1, gArgs.GetArg("-pipeline", DEFAULT_BATCH_PIPELINE));
+    std::string host;
+    int port;
+    GetRPCHostPort(host, port);
+    bool failedToGetAuthCookie;
+    const std::string strRPCUserColonPass = GetRPCUserColonPass(failedToGetAuthCookie);
+    const std::string endpoint = GetRPCEndpoint();
+
+    raii_event_base base = obtain_event_base();
+    // Requests in flight, and those done but waiting for the ones before them
+    std::deque<std::unique_ptr<BatchEntry>> window;
+    // Declared after window, so that they are freed first
+    std::vector<raii_evhttp_connection> connections;
+    std::vector<bool> busy;
+
+    int nRet = 0;
+    int line_number = 0;
+    bool eof = false;
+    while (true) {
+        while (!eof && window.size() < depth) {
+            std::string line;
+            if (!std::getline(std::cin, line)) {
+                eof = true;
+                break;
+            }
+            ++line_number;
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            std::unique_ptr<BatchEntry> entry = MakeUnique<BatchEntry>();
+            entry->id = line_number;
+            UniValue request;
+            try {
+                request = ParseBatchLine(line, entry->id);
+            } catch (const std::exception& e) {
+                entry->reply = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_PARSE_ERROR, strprintf("line %d: %s", line_number, e.what())), entry->id);
+                entry->done = true;
+            }
+            if (!entry->done) {
+                entry->id = find_value(request, "id");
+                // With at most depth - 1 requests in flight, one of depth connections is free
+                size_t c = 0;
+                while (c < connections.size() && busy[c]) ++c;
+                if (c == connections.size()) {
+                    connections.push_back(OpenRPCConnection(base.get(), host, port));
+                    busy.push_back(false);
+                }
+                SendRPCRequest(connections[c].get(), batch_request_done, entry.get(), host, strRPCUserColonPass, endpoint, request.write() + "\n", /* keep_alive */ true);
+                busy[c] = true;
+                entry->connection = c;
+            }
+            window.push_back(std::move(entry));
+        }
+
+        // Parse the responses that came in, freeing their connections
+        for (const auto& entry : window) {
+            if (entry->done && entry->connection >= 0) {
+                busy[entry->connection] = false;
+                entry->connection = -1;
+                entry->reply = ParseRPCResponse(*entry, host, port, failedToGetAuthCookie);
+                if (!entry->reply.isObject()) {
+                    throw std::runtime_error("expected reply to have result, error and id properties");
+                }
+            }
+        }
+        while (!window.empty() && window.front()->done) {
+            const UniValue& reply = window.front()->reply;
+            if (!find_value(reply, "error").isNull()) nRet = EXIT_FAILURE;
+            std::cout << reply.write() << "\n";
+            window.pop_front();
+        }
+        std::cout.flush();
+
+        if (window.empty()) {
+            if (eof) break;
+            continue;
+        }
+        // The first request is still in flight: wait for a response
+        event_base_loop(base.get(), EVLOOP_ONCE);
+    }
+    return nRet;
+}
+
 static int CommandLineRPC(int argc, char *argv[])
 {
     std::string strPrint;
@@ -466,6 +645,12 @@ static int CommandLineRPC(int argc, char *argv[])
                 fputc('\n', stdout);
             }
         }
+        if (gArgs.GetBoolArg("-batch", false)) {
+            if (!args.empty() || gArgs.GetBoolArg("-getinfo", false) || gArgs.GetBoolArg("-stdin", false)) {
+                throw std::runtime_error("-batch takes its requests from standard input and no other arguments, -getinfo or -stdin");
+            }
+            return BatchRPC();
+        }
         std::unique_ptr<BaseRequestHandler> rh;
         std::string method;
         if (gArgs.GetBoolArg("-getinfo", false)) {
@@ -25,14 +25,21 @@
 #include <util/translation.h>
 
 #include <functional>
+#include <iostream>
 #include <memory>
 #include <stdio.h>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
 
 static bool fCreateBlank;
-static std::map<std::string,UniValue> registers;
 static const int CONTINUE_EXECUTION=-1;
+static const int DEFAULT_BATCH_THREADS = 1;
+//! Lines of -batch input read and processed before their results are written
+static const size_t BATCH_LINES = 1024;
+
+//! JSON registers set by the commands of one transaction
+typedef std::map<std::string, UniValue> Registers;
 
 const std::function<std::string(const char*)> G_TRANSLATION_FUN = nullptr;
 
@@ -40,6 +47,9 @@ static void SetupPalladiumTxArgs()
 {
     SetupHelpOptions(gArgs);
 
+    gArgs.AddArg("-batch", "Read transactions from standard input, one per line: the hex-encoded transaction, or nothing with -create, followed by commands separated by spaces. "
+        "Registers only hold for the line that sets them. Write one result per line, in the same order, with \"error: \" and the reason for lines that fail.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-batchthreads=<n>", strprintf("Number of threads to process -batch lines on (0 = one per core, default: %d)", DEFAULT_BATCH_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-create", "Create new, empty TX.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-json", "Select JSON output", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-txid", "Output only the hex-encoded transaction id of the resultant transaction.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -103,6 +113,7 @@ static int AppInitRawTx(int argc, char* argv[])
         std::string strUsage = PACKAGE_NAME " palladium-tx utility version " + FormatFullVersion() + "\n\n" +
             "Usage:  palladium-tx [options] <hex-tx> [commands]  Update hex-encoded palladium transaction\n" +
             "or:     palladium-tx [options] -create [commands]   Create hex-encoded palladium transaction\n" +
+            "or:     palladium-tx [options] -batch [-create]     Update or create the transactions read from standard input\n" +
             "\n";
         strUsage += gArgs.GetHelpMessage();
 
@@ -117,7 +128,7 @@ static int AppInitRawTx(int argc, char* argv[])
     return CONTINUE_EXECUTION;
 }
 
-static void RegisterSetJson(const std::string& key, const std::string& rawJson)
+static void RegisterSetJson(Registers& registers, const std::string& key, const std::string& rawJson)
 {
     UniValue val;
     if (!val.read(rawJson)) {
@@ -128,7 +139,7 @@ static void RegisterSetJson(const std::string& key, const std::string& rawJson)
     registers[key] = val;
 }
 
-static void RegisterSet(const std::string& strInput)
+static void RegisterSet(Registers& registers, const std::string& strInput)
 {
     // separate NAME:VALUE in string
     size_t pos = strInput.find(':');
@@ -140,10 +151,10 @@ static void RegisterSet(const std::string& strInput)
     std::string key = strInput.substr(0, pos);
     std::string valStr = strInput.substr(pos + 1, std::string::npos);
 
-    RegisterSetJson(key, valStr);
+    RegisterSetJson(registers, key, valStr);
 }
 
-static void RegisterLoad(const std::string& strInput)
+static void RegisterLoad(Registers& registers, const std::string& strInput)
 {
     // separate NAME:FILENAME in string
     size_t pos = strInput.find(':');
@@ -181,7 +192,7 @@ static void RegisterLoad(const std::string& strInput)
     }
 
     // evaluate as JSON buffer register
-    RegisterSetJson(key, valStr);
+    RegisterSetJson(registers, key, valStr);
 }
 
 static CAmount ExtractAndValidateValue(const std::string& strValue)
@@ -542,7 +553,7 @@ static CAmount AmountFromValue(const UniValue& value)
     return amount;
 }
 
-static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
+static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr, Registers& registers)
 {
     int nHashType = SIGHASH_ALL;
 
@@ -658,6 +669,9 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
     tx = mergedTx;
 }
 
+//! Set while palladium-tx -batch holds the context shared by all of its transactions
+static bool g_ecc_shared = false;
+
 class Secp256k1Init
 {
     ECCVerifyHandle globalVerifyHandle;
@@ -672,9 +686,12 @@ public:
 };
 
 static void MutateTx(CMutableTransaction& tx, const std::string& command,
-                     const std::string& commandVal)
+                     const std::string& commandVal, Registers& registers)
 {
     std::unique_ptr<Secp256k1Init> ecc;
+    const auto start_ecc = [&ecc] {
+        if (!g_ecc_shared) ecc.reset(new Secp256k1Init());
+    };
 
     if (command == "nversion")
         MutateTxVersion(tx, commandVal);
@@ -694,10 +711,10 @@ static void MutateTx(CMutableTransaction& tx, const std::string& command,
     else if (command == "outaddr")
         MutateTxAddOutAddr(tx, commandVal);
     else if (command == "outpubkey") {
-        ecc.reset(new Secp256k1Init());
+        start_ecc();
         MutateTxAddOutPubKey(tx, commandVal);
     } else if (command == "outmultisig") {
-        ecc.reset(new Secp256k1Init());
+        start_ecc();
         MutateTxAddOutMultiSig(tx, commandVal);
     } else if (command == "outscript")
         MutateTxAddOutScript(tx, commandVal);
@@ -705,51 +722,51 @@ static void MutateTx(CMutableTransaction& tx, const std::string& command,
         MutateTxAddOutData(tx, commandVal);
 
     else if (command == "sign") {
-        ecc.reset(new Secp256k1Init());
-        MutateTxSign(tx, commandVal);
+        start_ecc();
+        MutateTxSign(tx, commandVal, registers);
     }
 
     else if (command == "load")
-        RegisterLoad(commandVal);
+        RegisterLoad(registers, commandVal);
 
     else if (command == "set")
-        RegisterSet(commandVal);
+        RegisterSet(registers, commandVal);
 
     else
         throw std::runtime_error("unknown command");
 }
 
-static void OutputTxJSON(const CTransaction& tx)
-{
-    UniValue entry(UniValue::VOBJ);
-    TxToUniv(tx, uint256(), entry);
-
-    std::string jsonOutput = entry.write(4);
-    tfm::format(std::cout, "%s\n", jsonOutput);
-}
-
-static void OutputTxHash(const CTransaction& tx)
+//! Apply a command given as COMMAND=VALUE, or just COMMAND
+static void MutateTxArg(CMutableTransaction& tx, const std::string& arg, Registers& registers)
 {
-    std::string strHexHash = tx.GetHash().GetHex(); // the hex-encoded transaction hash (aka the transaction id)
+    std::string key, value;
+    size_t eqpos = arg.find('=');
+    if (eqpos == std::string::npos)
+        key = arg;
+    else {
+        key = arg.substr(0, eqpos);
+        value = arg.substr(eqpos + 1);
+    }
 
-    tfm::format(std::cout, "%s\n", strHexHash);
+    MutateTx(tx, key, value, registers);
 }
 
-static void OutputTxHex(const CTransaction& tx)
+//! Format tx as selected by -json and -txid, on a single line if indent is 0
+static std::string FormatTx(const CTransaction& tx, int indent)
 {
-    std::string strHex = EncodeHexTx(tx);
-
-    tfm::format(std::cout, "%s\n", strHex);
+    if (gArgs.GetBoolArg("-json", false)) {
+        UniValue entry(UniValue::VOBJ);
+        TxToUniv(tx, uint256(), entry);
+        return entry.write(indent);
+    } else if (gArgs.GetBoolArg("-txid", false)) {
+        return tx.GetHash().GetHex(); // the hex-encoded transaction hash (aka the transaction id)
+    }
+    return EncodeHexTx(tx);
 }
 
 static void OutputTx(const CTransaction& tx)
 {
-    if (gArgs.GetBoolArg("-json", false))
-        OutputTxJSON(tx);
-    else if (gArgs.GetBoolArg("-txid", false))
-        OutputTxHash(tx);
-    else
-        OutputTxHex(tx);
+    tfm::format(std::cout, "%s\n", FormatTx(tx, 4));
 }
 
 static std::string readStdin()
@@ -772,6 +789,91 @@ static std::string readStdin()
     return ret;
 }
 
+//! Process one line of -batch input, returning the transaction or the error to write for it
+static std::string BatchRawTxLine(const std::string& line, bool& failed)
+{
+    std::vector<std::string> args;
+    const std::string trimmed = boost::algorithm::trim_copy(line);
+    if (!trimmed.empty()) {
+        boost::algorithm::split(args, trimmed, boost::algorithm::is_any_of(" \t"), boost::algorithm::token_compress_on);
+    }
+    try {
+        CMutableTransaction tx;
+        size_t startArg = 0;
+        if (!fCreateBlank) {
+            if (args.empty())
+                throw std::runtime_error("too few parameters");
+            if (!DecodeHexTx(tx, args[0], true))
+                throw std::runtime_error("invalid transaction encoding");
+            startArg = 1;
+        }
+
+        Registers registers;
+        for (size_t i = startArg; i < args.size(); i++) {
+            MutateTxArg(tx, args[i], registers);
+        }
+        failed = false;
+        return FormatTx(CTransaction(tx), 0);
+    } catch (const std::exception& e) {
+        failed = true;
+        return std::string("error: ") + e.what();
+    }
+}
+
+/**
+ * Process the transactions read from standard input, BATCH_LINES lines at a
+ * time spread over -batchthreads threads, sharing one secp256k1 context
+ * between all of them instead of starting one per command.
+ */
+static int BatchRawTx()
+{
+    int num_threads = gArgs.GetArg("-batchthreads", DEFAULT_BATCH_THREADS);
+    if (num_threads <= 0) num_threads = GetNumCores();
+    num_threads = std::max(1, num_threads);
+
+    Secp256k1Init ecc;
+    g_ecc_shared = true;
+
+    bool any_failed = false;
+    std::vector<std::string> lines;
+    std::string line;
+    while (true) {
+        lines.clear();
+        while (lines.size() < BATCH_LINES && std::getline(std::cin, line)) {
+            lines.push_back(std::move(line));
+        }
+        if (lines.empty()) break;
+
+        std::vector<std::string> results(lines.size());
+        std::vector<char> failed(lines.size());
+        const auto process_lines = [&](size_t first, size_t last) {
+            for (size_t i = first; i < last; ++i) {
+                bool line_failed;
+                results[i] = BatchRawTxLine(lines[i], line_failed);
+                failed[i] = line_failed;
+            }
+        };
+        const size_t chunk = (lines.size() + num_threads - 1) / num_threads;
+        std::vector<std::thread> threads;
+        for (size_t first = chunk; first < lines.size(); first += chunk) {
+            threads.emplace_back(process_lines, first, std::min(lines.size(), first + chunk));
+        }
+        process_lines(0, std::min(lines.size(), chunk));
+        for (std::thread& thread : threads) thread.join();
+
+        for (size_t i = 0; i < results.size(); ++i) {
+            tfm::format(std::cout, "%s\n", results[i]);
+            any_failed |= failed[i];
+        }
+        std::cout.flush();
+    }
+    g_ecc_shared = false;
+
+    if (std::cin.bad())
+        throw std::runtime_error("error reading stdin");
+    return any_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 static int CommandLineRawTx(int argc, char* argv[])
 {
     std::string strPrint;
@@ -784,6 +886,12 @@ static int CommandLineRawTx(int argc, char* argv[])
             argv++;
         }
 
+        if (gArgs.GetBoolArg("-batch", false)) {
+            if (argc > 1)
+                throw std::runtime_error("transactions and commands are read from standard input with -batch");
+            return BatchRawTx();
+        }
+
         CMutableTransaction tx;
         int startArg;
 
@@ -804,18 +912,9 @@ static int CommandLineRawTx(int argc, char* argv[])
         } else
             startArg = 1;
 
+        Registers registers;
         for (int i = startArg; i < argc; i++) {
-            std::string arg = argv[i];
-            std::string key, value;
-            size_t eqpos = arg.find('=');
-            if (eqpos == std::string::npos)
-                key = arg;
-            else {
-                key = arg.substr(0, eqpos);
-                value = arg.substr(eqpos + 1);
-            }
-
-            MutateTx(tx, key, value);
+            MutateTxArg(tx, argv[i], registers);
         }
 
         OutputTx(CTransaction(tx));
@@ -478,6 +478,11 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
     LOCK(m_cs_fee_estimator);
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
+        // Transactions from the current block aren't counted by any estimate yet.
+        if (pos->second.blockHeight < nBestSeenHeight) {
+            m_smart_fee_cache[0].clear();
+            m_smart_fee_cache[1].clear();
+        }
         feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
@@ -593,6 +598,8 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     // calls to removeTx (via processBlockTx) correctly calculate age
     // of unconfirmed txs to remove from tracking.
     nBestSeenHeight = nBlockHeight;
+    m_smart_fee_cache[0].clear();
+    m_smart_fee_cache[1].clear();
 
     // Update unconfirmed circular buffer
     feeStats->ClearCurrent(nBlockHeight);
@@ -791,14 +798,40 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
         feeCalc->returnedTarget = confTarget;
     }
 
-    double median = -1;
-    EstimationResult tempResult;
-
     // Return failure if trying to analyze a target we're not tracking
     if (confTarget <= 0 || (unsigned int)confTarget > longStats->GetMaxConfirms()) {
         return CFeeRate(0);  // error condition
     }
 
+    std::vector<Optional<SmartFeeEstimate>>& cache = m_smart_fee_cache[conservative];
+    if (cache.empty()) cache.resize(longStats->GetMaxConfirms());
+    Optional<SmartFeeEstimate>& estimate = cache[confTarget - 1];
+    if (!estimate) {
+        SmartFeeEstimate calculated;
+        calculated.calc.desiredTarget = confTarget;
+        calculated.calc.returnedTarget = confTarget;
+        calculated.feerate = calculateSmartFee(confTarget, calculated.calc, conservative);
+        estimate = calculated;
+    }
+    if (feeCalc) *feeCalc = estimate->calc;
+    return estimate->feerate;
+}
+
+std::vector<SmartFeeEstimate> CBlockPolicyEstimator::estimateSmartFeeTable(bool conservative) const
+{
+    LOCK(m_cs_fee_estimator);
+    std::vector<SmartFeeEstimate> table(longStats->GetMaxConfirms());
+    for (size_t i = 0; i < table.size(); ++i) {
+        table[i].feerate = estimateSmartFee(i + 1, &table[i].calc, conservative);
+    }
+    return table;
+}
+
+CFeeRate CBlockPolicyEstimator::calculateSmartFee(int confTarget, FeeCalculation& feeCalc, bool conservative) const
+{
+    double median = -1;
+    EstimationResult tempResult;
+
     // It's not possible to get reasonable estimates for confTarget of 1
     if (confTarget == 1) confTarget = 2;
 
@@ -806,7 +839,7 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     if ((unsigned int)confTarget > maxUsableEstimate) {
         confTarget = maxUsableEstimate;
     }
-    if (feeCalc) feeCalc->returnedTarget = confTarget;
+    feeCalc.returnedTarget = confTarget;
 
     if (confTarget <= 1) return CFeeRate(0); // error condition
 
@@ -822,36 +855,28 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
      * fluctuations lower our estimates by too much.
      */
     double halfEst = estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true, &tempResult);
-    if (feeCalc) {
-        feeCalc->est = tempResult;
-        feeCalc->reason = FeeReason::HALF_ESTIMATE;
-    }
+    feeCalc.est = tempResult;
+    feeCalc.reason = FeeReason::HALF_ESTIMATE;
     median = halfEst;
     double actualEst = estimateCombinedFee(confTarget, SUCCESS_PCT, true, &tempResult);
     if (actualEst > median) {
         median = actualEst;
-        if (feeCalc) {
-            feeCalc->est = tempResult;
-            feeCalc->reason = FeeReason::FULL_ESTIMATE;
-        }
+        feeCalc.est = tempResult;
+        feeCalc.reason = FeeReason::FULL_ESTIMATE;
     }
     double doubleEst = estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative, &tempResult);
     if (doubleEst > median) {
         median = doubleEst;
-        if (feeCalc) {
-            feeCalc->est = tempResult;
-            feeCalc->reason = FeeReason::DOUBLE_ESTIMATE;
-        }
+        feeCalc.est = tempResult;
+        feeCalc.reason = FeeReason::DOUBLE_ESTIMATE;
     }
 
     if (conservative || median == -1) {
         double consEst =  estimateConservativeFee(2 * confTarget, &tempResult);
         if (consEst > median) {
             median = consEst;
-            if (feeCalc) {
-                feeCalc->est = tempResult;
-                feeCalc->reason = FeeReason::CONSERVATIVE;
-            }
+            feeCalc.est = tempResult;
+            feeCalc.reason = FeeReason::CONSERVATIVE;
         }
     }
 
@@ -931,6 +956,8 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
 
             // Destroy old TxConfirmStats and point to new ones that already reference buckets and bucketMap
             feeStats = std::move(fileFeeStats);
+            m_smart_fee_cache[0].clear();
+            m_smart_fee_cache[1].clear();
             shortStats = std::move(fileShortStats);
             longStats = std::move(fileLongStats);
 
@@ -6,6 +6,7 @@
 #define PALLADIUM_POLICY_FEES_H
 
 #include <amount.h>
+#include <optional.h>
 #include <policy/feerate.h>
 #include <uint256.h>
 #include <random.h>
@@ -80,6 +81,12 @@ struct FeeCalculation
     int returnedTarget = 0;
 };
 
+struct SmartFeeEstimate
+{
+    CFeeRate feerate;
+    FeeCalculation calc;
+};
+
 /** \class CBlockPolicyEstimator
  * The BlockPolicyEstimator is used for estimating the feerate needed
  * for a transaction to be included in a block within a certain number of
@@ -204,6 +211,9 @@ public:
      */
     CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
 
+    /** estimateSmartFee for every target from 1 to the highest tracked; entry i is for target i + 1 */
+    std::vector<SmartFeeEstimate> estimateSmartFeeTable(bool conservative) const;
+
     /** Return a specific fee estimate calculation with a given success
      * threshold and time horizon, and optionally return detailed data about
      * calculation
@@ -251,9 +261,19 @@ private:
     std::vector<double> buckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap GUARDED_BY(m_cs_fee_estimator); // Map of bucket upper-bound to index into all vectors by bucket
 
+    /**
+     * estimateSmartFee results by target, economical ones first, computed on
+     * first use. They only change with the blocks processed and with
+     * transactions that have waited a block or more leaving the mempool, so
+     * callers asking for every target each block compute each just once.
+     */
+    mutable std::vector<Optional<SmartFeeEstimate>> m_smart_fee_cache[2] GUARDED_BY(m_cs_fee_estimator);
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 
+    /** Helper for estimateSmartFee, without the cache */
+    CFeeRate calculateSmartFee(int confTarget, FeeCalculation& feeCalc, bool conservative) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
     /** Helper for estimateSmartFee */
     double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
     /** Helper for estimateSmartFee */
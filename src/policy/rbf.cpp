@@ -26,7 +26,7 @@ RBFTransactionState IsRBFOptIn(const CTransaction& tx, const CTxMemPool& pool)
     // signaled for RBF if any unconfirmed parents have signaled.
     uint64_t noLimit = std::numeric_limits<uint64_t>::max();
     std::string dummy;
-    CTxMemPoolEntry entry = *pool.mapTx.find(tx.GetHash());
+    const CTxMemPoolEntry& entry = *pool.mapTx.find(tx.GetHash());
     pool.CalculateMemPoolAncestors(entry, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
 
     for (CTxMemPool::txiter it : setAncestors) {
@@ -36,3 +36,65 @@ RBFTransactionState IsRBFOptIn(const CTransaction& tx, const CTxMemPool& pool)
     }
     return RBFTransactionState::FINAL;
 }
+
+const RBFConflictCache::Descendants& RBFConflictCache::Get(const CTxMemPool& pool, CTxMemPool::txiter it)
+{
+    AssertLockHeld(pool.cs);
+    if (m_generation != pool.GetGeneration()) {
+        m_descendants.clear();
+        m_generation = pool.GetGeneration();
+    }
+    const uint256& hash = it->GetTx().GetHash();
+    auto found = m_descendants.find(hash);
+    if (found != m_descendants.end()) {
+        return found->second;
+    }
+    if (m_descendants.size() >= m_max_entries) {
+        m_descendants.clear();
+    }
+    Descendants& descendants = m_descendants[hash];
+    pool.CalculateDescendants(it, descendants.entries);
+    for (CTxMemPool::txiter descendant : descendants.entries) {
+        descendants.fees += descendant->GetModifiedFee();
+        descendants.size += descendant->GetTxSize();
+    }
+    return descendants;
+}
+
+bool GetEntriesForConflicts(const CTxMemPool& pool, const CTxMemPool::setEntries& iters_conflicting, uint64_t max_replaced,
+                            RBFConflictCache& cache, uint64_t& conflicting_count, CTxMemPool::setEntries& all_conflicting,
+                            CAmount& conflicting_fees, size_t& conflicting_size)
+{
+    AssertLockHeld(pool.cs);
+
+    // This potentially overestimates the number of actual descendants
+    // but we just want to be conservative to avoid doing too much
+    // work.
+    conflicting_count = 0;
+    for (CTxMemPool::txiter it : iters_conflicting) {
+        conflicting_count += it->GetCountWithDescendants();
+    }
+    if (conflicting_count > max_replaced) {
+        return false;
+    }
+
+    conflicting_fees = 0;
+    conflicting_size = 0;
+    for (CTxMemPool::txiter it : iters_conflicting) {
+        const RBFConflictCache::Descendants& descendants = cache.Get(pool, it);
+        if (all_conflicting.empty()) {
+            all_conflicting = descendants.entries;
+            conflicting_fees = descendants.fees;
+            conflicting_size = descendants.size;
+            continue;
+        }
+        // Conflicts may share descendants, which are only evicted once
+        for (CTxMemPool::txiter descendant : descendants.entries) {
+            if (all_conflicting.insert(descendant).second) {
+                conflicting_fees += descendant->GetModifiedFee();
+                conflicting_size += descendant->GetTxSize();
+            }
+        }
+    }
+    return true;
+}
@@ -7,6 +7,8 @@
 
 #include <txmempool.h>
 
+#include <unordered_map>
+
 enum class RBFTransactionState {
     UNKNOWN,
     REPLACEABLE_BIP125,
@@ -19,4 +21,43 @@ enum class RBFTransactionState {
 // as the sequence numbers of all in-mempool ancestors.
 RBFTransactionState IsRBFOptIn(const CTransaction& tx, const CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(pool.cs);
 
+/**
+ * The in-mempool descendants of transactions that replacements conflict
+ * with, including the transactions themselves, with their total modified
+ * fees and size. They are kept for as long as the mempool stays at the same
+ * generation, so that repeated attempts to replace the same transactions do
+ * not walk their descendants again.
+ */
+class RBFConflictCache
+{
+public:
+    struct Descendants {
+        CTxMemPool::setEntries entries;
+        CAmount fees{0};
+        size_t size{0};
+    };
+
+    /** Keep the descendants of at most max_entries transactions. */
+    explicit RBFConflictCache(size_t max_entries) : m_max_entries(max_entries) {}
+
+    /** The descendants of it, valid until the next call. */
+    const Descendants& Get(const CTxMemPool& pool, CTxMemPool::txiter it) EXCLUSIVE_LOCKS_REQUIRED(pool.cs);
+
+private:
+    const size_t m_max_entries;
+    uint64_t m_generation{0};
+    std::unordered_map<uint256, Descendants, SaltedTxidHasher> m_descendants;
+};
+
+/**
+ * Find the transactions that a replacement of iters_conflicting would evict.
+ * conflicting_count is set to an upper bound of their number; if that
+ * exceeds max_replaced, this returns false without looking any further.
+ * Otherwise they are added to all_conflicting, and conflicting_fees and
+ * conflicting_size are set to their total modified fees and size.
+ */
+bool GetEntriesForConflicts(const CTxMemPool& pool, const CTxMemPool::setEntries& iters_conflicting, uint64_t max_replaced,
+                            RBFConflictCache& cache, uint64_t& conflicting_count, CTxMemPool::setEntries& all_conflicting,
+                            CAmount& conflicting_fees, size_t& conflicting_size) EXCLUSIVE_LOCKS_REQUIRED(pool.cs);
+
 #endif // PALLADIUM_POLICY_RBF_H
@@ -8,8 +8,12 @@
 #include <arith_uint256.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <uint256.h>
 
+#include <deque>
+#include <vector>
+
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params& params)
 {
     assert(pindexLast != nullptr);
@@ -53,10 +57,227 @@ unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHead
     return CalculateNextWorkRequired(pindexLast, pindexFirst->GetBlockTime(), params);
 }
 
+namespace {
+
+/** Per-block contribution to the LWMA sums, for one block of the window. */
+struct LwmaEntry {
+    int64_t time;          //!< Header timestamp of the block
+    int64_t adjusted;      //!< Timestamp forced monotonic starting from the window start
+    int64_t solvetime;     //!< Clamped solvetime relative to the previous entry
+    uint32_t bits;         //!< nBits of the block
+    arith_uint256 target;  //!< target / (k * N), this block's term of the target sum
+};
+
+/**
+ * Rolling LWMA state for the N blocks ending at tip. Moving the window by one
+ * block only touches the entry entering and the entry leaving the window, so
+ * following the tip (one block connected or disconnected) is O(1).
+ */
+struct LwmaWindow {
+    const CBlockIndex* tip{nullptr};
+    const CBlockIndex* tip_prev{nullptr};
+    const Consensus::Params* params{nullptr};
+    int64_t height{0};
+    //! Header timestamp of the block just before the window (height - N)
+    int64_t start_time{0};
+    //! Entries for heights height - N + 1 .. height, oldest first
+    std::deque<LwmaEntry> entries;
+    //! Sum of solvetime * weight, with weights 1 .. N from oldest to newest
+    int64_t weighted_sum{0};
+    //! Sum of unweighted solvetimes
+    int64_t solvetime_sum{0};
+    arith_uint256 target_sum;
+    unsigned int result{0};
+    uint64_t last_used{0};
+
+    bool Matches(const CBlockIndex* pindex, const Consensus::Params& p) const
+    {
+        return tip == pindex && params == &p && height == pindex->nHeight &&
+            entries.back().time == pindex->GetBlockTime() && entries.back().bits == pindex->nBits;
+    }
+};
+
+LwmaEntry MakeLwmaEntry(const CBlockIndex* pindex, int64_t previous_adjusted, int64_t T, int64_t kN)
+{
+    LwmaEntry entry;
+    entry.time = pindex->GetBlockTime();
+    entry.adjusted = entry.time > previous_adjusted ? entry.time : previous_adjusted + 1;
+    entry.solvetime = std::min(6 * T, entry.adjusted - previous_adjusted);
+    entry.bits = pindex->nBits;
+    entry.target.SetCompact(pindex->nBits);
+    entry.target = entry.target / kN;
+    return entry;
+}
+
+/** Number of windows kept, so that e.g. header sync and the block template do not evict each other. */
+static constexpr size_t LWMA_CACHE_SLOTS = 4;
+
+Mutex g_lwma_mutex;
+LwmaWindow g_lwma_windows[LWMA_CACHE_SLOTS] GUARDED_BY(g_lwma_mutex);
+uint64_t g_lwma_use_counter GUARDED_BY(g_lwma_mutex) = 0;
+
+class LwmaCalculator
+{
+    const Consensus::Params& m_params;
+    const int64_t T;
+    const int64_t N;
+    const int64_t kN;
+    const arith_uint256 m_pow_limit;
+
+public:
+    explicit LwmaCalculator(const Consensus::Params& params)
+        : m_params(params), T(params.nPowTargetSpacingV2), N(LWMA_WINDOW),
+          kN(N * (N + 1) * T / 2 * N), m_pow_limit(UintToArith256(params.powLimit)) {}
+
+    void Finish(LwmaWindow& w) const
+    {
+        arith_uint256 nextTarget = w.weighted_sum * w.target_sum;
+        if (nextTarget > m_pow_limit) { nextTarget = m_pow_limit; }
+        w.result = nextTarget.GetCompact();
+    }
+
+    /** Recompute the full window ending at pindexLast (the fallback on a deep reorg or a cold cache). */
+    void Rebuild(LwmaWindow& w, const CBlockIndex* pindexLast) const
+    {
+        // Walk back through pprev once rather than doing a skiplist lookup per block.
+        std::vector<const CBlockIndex*> blocks(N);
+        const CBlockIndex* pindex = pindexLast;
+        for (int64_t i = N - 1; i >= 0; i--) {
+            blocks[i] = pindex;
+            pindex = pindex->pprev;
+        }
+        assert(pindex);
+
+        w.tip = pindexLast;
+        w.tip_prev = pindexLast->pprev;
+        w.params = &m_params;
+        w.height = pindexLast->nHeight;
+        w.start_time = pindex->GetBlockTime();
+        w.entries.clear();
+        w.weighted_sum = 0;
+        w.solvetime_sum = 0;
+        w.target_sum = 0;
+        int64_t previous_adjusted = w.start_time;
+        for (int64_t j = 1; j <= N; j++) {
+            w.entries.push_back(MakeLwmaEntry(blocks[j - 1], previous_adjusted, T, kN));
+            const LwmaEntry& entry = w.entries.back();
+            previous_adjusted = entry.adjusted;
+            w.weighted_sum += entry.solvetime * j;
+            w.solvetime_sum += entry.solvetime;
+            w.target_sum += entry.target;
+        }
+        Finish(w);
+    }
+
+    /** Move a window ending at pindexNew->pprev forward by one block. */
+    bool Advance(LwmaWindow& w, const CBlockIndex* pindexNew) const
+    {
+        // The new window starts at the raw timestamp of the block leaving
+        // the front. Its entries only stay valid if that block's timestamp
+        // was not pushed forward by the monotonicity rule.
+        const LwmaEntry& front = w.entries.front();
+        if (front.adjusted != front.time) return false;
+
+        LwmaEntry entry = MakeLwmaEntry(pindexNew, w.entries.back().adjusted, T, kN);
+        w.weighted_sum += N * entry.solvetime - w.solvetime_sum;
+        w.solvetime_sum += entry.solvetime - front.solvetime;
+        w.target_sum += entry.target;
+        w.target_sum -= front.target;
+        w.start_time = front.time;
+        w.entries.pop_front();
+        w.entries.push_back(entry);
+
+        w.tip = pindexNew;
+        w.tip_prev = pindexNew->pprev;
+        w.height = pindexNew->nHeight;
+        Finish(w);
+        return true;
+    }
+
+    /** Move a window ending at pindexLast's child back by one block, so it ends at pindexLast. */
+    bool Rewind(LwmaWindow& w, const CBlockIndex* pindexLast) const
+    {
+        const LwmaEntry& back = w.entries.back();
+        const LwmaEntry& new_back = w.entries[N - 2];
+        if (new_back.time != pindexLast->GetBlockTime() || new_back.bits != pindexLast->nBits) return false;
+
+        // The block re-entering at the front is the one the window currently starts at.
+        const CBlockIndex* pindexFront = pindexLast->GetAncestor(pindexLast->nHeight - N + 1);
+        assert(pindexFront && pindexFront->pprev);
+        const int64_t new_start_time = pindexFront->pprev->GetBlockTime();
+        LwmaEntry entry = MakeLwmaEntry(pindexFront, new_start_time, T, kN);
+        if (entry.adjusted != w.start_time) return false;
+
+        w.solvetime_sum -= back.solvetime;
+        w.weighted_sum += w.solvetime_sum - N * back.solvetime + entry.solvetime;
+        w.solvetime_sum += entry.solvetime;
+        w.target_sum -= back.target;
+        w.target_sum += entry.target;
+        w.start_time = new_start_time;
+        w.entries.pop_back();
+        w.entries.push_front(entry);
+
+        w.tip = pindexLast;
+        w.tip_prev = pindexLast->pprev;
+        w.height = pindexLast->nHeight;
+        Finish(w);
+        return true;
+    }
+};
+
+} // namespace
+
+void ResetLwmaCache()
+{
+    LOCK(g_lwma_mutex);
+    for (LwmaWindow& w : g_lwma_windows) {
+        w = LwmaWindow{};
+    }
+}
+
 unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexLast, const Consensus::Params& params)
+{
+    if (pindexLast->nHeight < LWMA_WINDOW) { return UintToArith256(params.powLimit).GetCompact(); }
+
+    const LwmaCalculator calc(params);
+    LOCK(g_lwma_mutex);
+    const uint64_t now = ++g_lwma_use_counter;
+
+    for (LwmaWindow& w : g_lwma_windows) {
+        if (w.tip && w.Matches(pindexLast, params)) {
+            w.last_used = now;
+            return w.result;
+        }
+    }
+    for (LwmaWindow& w : g_lwma_windows) {
+        if (w.tip && pindexLast->pprev && w.Matches(pindexLast->pprev, params)) {
+            if (!calc.Advance(w, pindexLast)) calc.Rebuild(w, pindexLast);
+            w.last_used = now;
+            return w.result;
+        }
+    }
+    for (LwmaWindow& w : g_lwma_windows) {
+        if (w.tip && w.tip_prev == pindexLast && w.params == &params && w.height == pindexLast->nHeight + 1 &&
+            pindexLast->nHeight >= LWMA_WINDOW) {
+            if (!calc.Rewind(w, pindexLast)) calc.Rebuild(w, pindexLast);
+            w.last_used = now;
+            return w.result;
+        }
+    }
+
+    LwmaWindow* lru = &g_lwma_windows[0];
+    for (LwmaWindow& w : g_lwma_windows) {
+        if (w.last_used < lru->last_used) lru = &w;
+    }
+    calc.Rebuild(*lru, pindexLast);
+    lru->last_used = now;
+    return lru->result;
+}
+
+unsigned int LwmaCalculateNextWorkRequiredUncached(const CBlockIndex* pindexLast, const Consensus::Params& params)
 {
     const int64_t T = params.nPowTargetSpacingV2;
-    const int64_t N = 240;
+    const int64_t N = LWMA_WINDOW;
     const int64_t k = N * (N + 1) * T / 2; // For T=120, 240, 600 use approx N=100, 75, 50
     const int64_t height = pindexLast->nHeight;
     const arith_uint256 powLimit = UintToArith256(params.powLimit);
@@ -16,7 +16,21 @@ class uint256;
 
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock, const Consensus::Params&);
 unsigned int CalculateNextWorkRequired(const CBlockIndex* pindexLast, int64_t nFirstBlockTime, const Consensus::Params&);
+
+/** Number of blocks in the LWMA difficulty window */
+static constexpr int64_t LWMA_WINDOW = 240;
+
+/**
+ * LWMA difficulty for the block following pindexLast. The weighted solvetime
+ * and target sums are kept as rolling state for recently used tips, so a tip
+ * that moved by one block is computed in O(1); anything else falls back to
+ * LwmaCalculateNextWorkRequiredUncached().
+ */
 unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexLast, const Consensus::Params&);
+/** LWMA difficulty computed by walking the full window, without touching the cache */
+unsigned int LwmaCalculateNextWorkRequiredUncached(const CBlockIndex* pindexLast, const Consensus::Params&);
+/** Drop all cached LWMA windows. Must be called before CBlockIndex entries are freed. */
+void ResetLwmaCache();
 
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckProofOfWork(uint256 hash, unsigned int nBits, const Consensus::Params&);
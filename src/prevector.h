@@ -15,6 +15,10 @@
 #include <type_traits>
 #include <utility>
 
+#ifdef ENABLE_PREVECTOR_POOL
+#include <support/prevectorpool.h>
+#endif
+
 /** Implements a drop-in replacement for std::vector<T> which stores up to N
  *  elements directly (without heap allocation). The types Size and Diff are
  *  used to store element counts, and can be any unsigned + signed type.
@@ -167,27 +171,57 @@ private:
     const T* indirect_ptr(difference_type pos) const { return reinterpret_cast<const T*>(_union.indirect) + pos; }
     bool is_direct() const { return _size <= N; }
 
+#ifdef ENABLE_PREVECTOR_POOL
+    /* Heap storage up to prevector_pool::MAX_POOLED_SIZE bytes comes from the
+        size-class pool, larger storage from malloc via the same calls. */
+    static char* allocate_indirect(size_t bytes) { return static_cast<char*>(prevector_pool::Allocate(bytes)); }
+    static void free_indirect(char* indirect, size_t bytes) { prevector_pool::Free(indirect, bytes); }
+    static char* reallocate_indirect(char* indirect, size_t old_bytes, size_t new_bytes, size_t used_bytes) {
+        if (prevector_pool::BlockSize(old_bytes) == prevector_pool::BlockSize(new_bytes)) return indirect;
+        if (old_bytes > prevector_pool::MAX_POOLED_SIZE && new_bytes > prevector_pool::MAX_POOLED_SIZE) {
+            char* new_indirect = static_cast<char*>(realloc(indirect, new_bytes));
+            assert(new_indirect);
+            return new_indirect;
+        }
+        char* new_indirect = allocate_indirect(new_bytes);
+        memcpy(new_indirect, indirect, used_bytes);
+        free_indirect(indirect, old_bytes);
+        return new_indirect;
+    }
+#else
+    /* FIXME: Because malloc/realloc here won't call new_handler if allocation fails, assert
+        success. These should instead use an allocator or new/delete so that handlers
+        are called as necessary, but performance would be slightly degraded by doing so. */
+    static char* allocate_indirect(size_t bytes) {
+        char* indirect = static_cast<char*>(malloc(bytes));
+        assert(indirect);
+        return indirect;
+    }
+    static void free_indirect(char* indirect, size_t) { free(indirect); }
+    static char* reallocate_indirect(char* indirect, size_t, size_t new_bytes, size_t) {
+        char* new_indirect = static_cast<char*>(realloc(indirect, new_bytes));
+        assert(new_indirect);
+        return new_indirect;
+    }
+#endif
+
     void change_capacity(size_type new_capacity) {
         if (new_capacity <= N) {
             if (!is_direct()) {
                 T* indirect = indirect_ptr(0);
+                size_t indirect_bytes = allocated_memory();
                 T* src = indirect;
                 T* dst = direct_ptr(0);
                 memcpy(dst, src, size() * sizeof(T));
-                free(indirect);
+                free_indirect(reinterpret_cast<char*>(indirect), indirect_bytes);
                 _size -= N + 1;
             }
         } else {
             if (!is_direct()) {
-                /* FIXME: Because malloc/realloc here won't call new_handler if allocation fails, assert
-                    success. These should instead use an allocator or new/delete so that handlers
-                    are called as necessary, but performance would be slightly degraded by doing so. */
-                _union.indirect = static_cast<char*>(realloc(_union.indirect, ((size_t)sizeof(T)) * new_capacity));
-                assert(_union.indirect);
+                _union.indirect = reallocate_indirect(_union.indirect, allocated_memory(), ((size_t)sizeof(T)) * new_capacity, size() * sizeof(T));
                 _union.capacity = new_capacity;
             } else {
-                char* new_indirect = static_cast<char*>(malloc(((size_t)sizeof(T)) * new_capacity));
-                assert(new_indirect);
+                char* new_indirect = allocate_indirect(((size_t)sizeof(T)) * new_capacity);
                 T* src = direct_ptr(0);
                 T* dst = reinterpret_cast<T*>(new_indirect);
                 memcpy(dst, src, size() * sizeof(T));
@@ -468,7 +502,7 @@ public:
             clear();
         }
         if (!is_direct()) {
-            free(_union.indirect);
+            free_indirect(_union.indirect, allocated_memory());
             _union.indirect = nullptr;
         }
     }
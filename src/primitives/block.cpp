@@ -5,14 +5,136 @@
 
 #include <primitives/block.h>
 
+#include <crypto/common.h>
+#include <crypto/sha256.h>
 #include <hash.h>
+#include <streams.h>
 #include <tinyformat.h>
 
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+constexpr size_t CBlockHeader::SERIALIZED_SIZE;
+
 uint256 CBlockHeader::GetHash() const
 {
     return SerializeHash(*this);
 }
 
+/** Serialized size of a block header */
+static constexpr size_t HEADER_SIZE = 80;
+/** Number of headers serialized and hashed per SHA256D80 call */
+static constexpr size_t HEADER_HASH_BATCH = 64;
+
+void HashHeaders(Span<const CBlockHeader> headers, uint256* out)
+{
+    unsigned char buffer[HEADER_HASH_BATCH * HEADER_SIZE];
+    unsigned char hashes[HEADER_HASH_BATCH * CSHA256::OUTPUT_SIZE];
+    size_t pos = 0;
+    const size_t count = headers.size();
+    while (pos < count) {
+        const size_t batch = std::min(HEADER_HASH_BATCH, count - pos);
+        for (size_t i = 0; i < batch; ++i) {
+            const CBlockHeader& header = headers[pos + i];
+            unsigned char* ptr = buffer + i * HEADER_SIZE;
+            WriteLE32(ptr, header.nVersion);
+            memcpy(ptr + 4, header.hashPrevBlock.begin(), 32);
+            memcpy(ptr + 36, header.hashMerkleRoot.begin(), 32);
+            WriteLE32(ptr + 68, header.nTime);
+            WriteLE32(ptr + 72, header.nBits);
+            WriteLE32(ptr + 76, header.nNonce);
+        }
+        SHA256D80(hashes, buffer, batch);
+        for (size_t i = 0; i < batch; ++i) {
+            memcpy(out[pos + i].begin(), hashes + i * CSHA256::OUTPUT_SIZE, CSHA256::OUTPUT_SIZE);
+        }
+        pos += batch;
+    }
+}
+
+/** Smallest serialized transaction: version, empty input and output counts, lock time */
+static constexpr size_t MIN_SERIALIZED_TX_SIZE = 10;
+
+size_t UnserializeBlockHashed(int type, int version, Span<const uint8_t> data, CBlock& block)
+{
+    block.SetNull();
+    SpanReader s(type, version, data);
+    s >> static_cast<CBlockHeader&>(block);
+    const uint64_t count = ReadCompactSize(s);
+    std::vector<CMutableTransaction> txs;
+    std::vector<Span<const uint8_t>> raw;
+    txs.reserve(std::min<uint64_t>(count, s.size() / MIN_SERIALIZED_TX_SIZE));
+    raw.reserve(txs.capacity());
+    for (uint64_t i = 0; i < count; ++i) {
+        const size_t start = data.size() - s.size();
+        txs.emplace_back(deserialize, s);
+        raw.push_back(data.subspan(start, data.size() - s.size() - start));
+    }
+
+    // The txid of a transaction with witness data is the hash of its
+    // serialization without it: the version, then the inputs and outputs
+    // between the marker/flag bytes and the witnesses, then the lock time.
+    // These are copied together; everything else is hashed in place.
+    std::vector<size_t> stripped_sizes(count, 0);
+    size_t stripped_total = 0;
+    std::vector<bool> hashed(count, false);
+    for (size_t i = 0; i < count; ++i) {
+        // Deserialization only accepts canonical encodings, so serializing a
+        // transaction again yields the bytes it was read from. Don't rely on
+        // the hashes of any that would not.
+        if (::GetSerializeSize(txs[i], version) != raw[i].size()) continue;
+        hashed[i] = true;
+        if (!txs[i].HasWitness()) continue;
+        stripped_sizes[i] = ::GetSerializeSize(txs[i], version | SERIALIZE_TRANSACTION_NO_WITNESS);
+        stripped_total += stripped_sizes[i];
+    }
+
+    // Txids of all transactions first, then the wtxids of those with witness data.
+    std::vector<unsigned char> stripped(stripped_total);
+    std::vector<const unsigned char*> inputs(count);
+    std::vector<size_t> sizes(count);
+    std::vector<size_t> witness_pos(count, 0);
+    size_t stripped_pos = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!hashed[i] || !stripped_sizes[i]) {
+            inputs[i] = raw[i].data();
+            sizes[i] = raw[i].size();
+            continue;
+        }
+        unsigned char* ptr = stripped.data() + stripped_pos;
+        const size_t body = stripped_sizes[i] - 8;
+        memcpy(ptr, raw[i].data(), 4);
+        memcpy(ptr + 4, raw[i].data() + 6, body);
+        memcpy(ptr + 4 + body, raw[i].data() + raw[i].size() - 4, 4);
+        inputs[i] = ptr;
+        sizes[i] = stripped_sizes[i];
+        stripped_pos += stripped_sizes[i];
+        witness_pos[i] = inputs.size();
+        inputs.push_back(raw[i].data());
+        sizes.push_back(raw[i].size());
+    }
+    std::vector<unsigned char> hashes(inputs.size() * CSHA256::OUTPUT_SIZE);
+    SHA256DMany(hashes.data(), inputs.data(), sizes.data(), inputs.size());
+
+    block.vtx.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!hashed[i]) {
+            block.vtx.push_back(MakeTransactionRef(std::move(txs[i])));
+            continue;
+        }
+        uint256 hash, witness_hash;
+        memcpy(hash.begin(), hashes.data() + i * CSHA256::OUTPUT_SIZE, CSHA256::OUTPUT_SIZE);
+        if (witness_pos[i]) {
+            memcpy(witness_hash.begin(), hashes.data() + witness_pos[i] * CSHA256::OUTPUT_SIZE, CSHA256::OUTPUT_SIZE);
+        } else {
+            witness_hash = hash;
+        }
+        block.vtx.push_back(std::make_shared<const CTransaction>(std::move(txs[i]), hash, witness_hash));
+    }
+    return data.size() - s.size();
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
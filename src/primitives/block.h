@@ -6,8 +6,10 @@
 #ifndef PALLADIUM_PRIMITIVES_BLOCK_H
 #define PALLADIUM_PRIMITIVES_BLOCK_H
 
+#include <crypto/common.h>
 #include <primitives/transaction.h>
 #include <serialize.h>
+#include <span.h>
 #include <uint256.h>
 
 /** Nodes collect new transactions into a block, hash them into a hash tree,
@@ -33,16 +35,35 @@ public:
         SetNull();
     }
 
-    ADD_SERIALIZE_METHODS;
+    //! Headers have a fixed size, so they are read and written (and hashed) in one piece.
+    static constexpr size_t SERIALIZED_SIZE = 4 + 32 + 32 + 4 + 4 + 4;
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(this->nVersion);
-        READWRITE(hashPrevBlock);
-        READWRITE(hashMerkleRoot);
-        READWRITE(nTime);
-        READWRITE(nBits);
-        READWRITE(nNonce);
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        unsigned char buf[SERIALIZED_SIZE];
+        WriteLE32(buf, nVersion);
+        memcpy(buf + 4, hashPrevBlock.begin(), 32);
+        memcpy(buf + 36, hashMerkleRoot.begin(), 32);
+        WriteLE32(buf + 68, nTime);
+        WriteLE32(buf + 72, nBits);
+        WriteLE32(buf + 76, nNonce);
+        s.write(CharCast(buf), sizeof(buf));
+    }
+
+    void Serialize(CSizeComputer& s) const { s.seek(SERIALIZED_SIZE); }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char buf[SERIALIZED_SIZE];
+        s.read(CharCast(buf), sizeof(buf));
+        nVersion = ReadLE32(buf);
+        memcpy(hashPrevBlock.begin(), buf + 4, 32);
+        memcpy(hashMerkleRoot.begin(), buf + 36, 32);
+        nTime = ReadLE32(buf + 68);
+        nBits = ReadLE32(buf + 72);
+        nNonce = ReadLE32(buf + 76);
     }
 
     void SetNull()
@@ -68,6 +89,13 @@ public:
     }
 };
 
+/**
+ * Compute the hashes of a batch of headers into out[0..headers.size()), which
+ * is equivalent to calling GetHash() on each but uses the multi-way SHA256D80
+ * implementations when available.
+ */
+void HashHeaders(Span<const CBlockHeader> headers, uint256* out);
+
 
 class CBlock : public CBlockHeader
 {
@@ -119,6 +147,15 @@ public:
     std::string ToString() const;
 };
 
+/**
+ * Deserialize a block from data, like SpanReader(type, version, data) >> block,
+ * but compute the txids and wtxids of its transactions from the bytes they
+ * were read from, in batches through the multi-way SHA256DMany, rather than
+ * by serializing each transaction again. Returns the number of bytes read.
+ * Throws std::ios_base::failure on malformed data, as deserialization does.
+ */
+size_t UnserializeBlockHashed(int type, int version, Span<const uint8_t> data, CBlock& block);
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
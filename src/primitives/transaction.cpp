@@ -11,6 +11,8 @@
 
 #include <assert.h>
 
+constexpr size_t COutPoint::SERIALIZED_SIZE;
+
 std::string COutPoint::ToString() const
 {
     return strprintf("COutPoint(%s, %u)", hash.ToString().substr(0,10), n);
@@ -77,10 +79,19 @@ uint256 CTransaction::ComputeWitnessHash() const
     return SerializeHash(*this, SER_GETHASH, 0);
 }
 
+unsigned int CTransaction::ComputeSize(int version) const
+{
+    // Serialize directly, as Serialize(CSizeComputer&) returns the cached sizes.
+    CSizeComputer s(version);
+    SerializeTransaction(*this, s);
+    return s.size();
+}
+
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
-CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash{}, m_witness_hash{} {}
-CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
-CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
+CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash{}, m_witness_hash{}, m_total_size{ComputeSize(PROTOCOL_VERSION)}, m_stripped_size{m_total_size} {}
+CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()}, m_total_size{ComputeSize(PROTOCOL_VERSION)}, m_stripped_size{HasWitness() ? ComputeSize(PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) : m_total_size} {}
+CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()}, m_total_size{ComputeSize(PROTOCOL_VERSION)}, m_stripped_size{HasWitness() ? ComputeSize(PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) : m_total_size} {}
+CTransaction::CTransaction(CMutableTransaction&& tx, const uint256& hash, const uint256& witness_hash) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{hash}, m_witness_hash{witness_hash}, m_total_size{ComputeSize(PROTOCOL_VERSION)}, m_stripped_size{HasWitness() ? ComputeSize(PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) : m_total_size} {}
 
 CAmount CTransaction::GetValueOut() const
 {
@@ -94,11 +105,6 @@ CAmount CTransaction::GetValueOut() const
     return nValueOut;
 }
 
-unsigned int CTransaction::GetTotalSize() const
-{
-    return ::GetSerializeSize(*this, PROTOCOL_VERSION);
-}
-
 std::string CTransaction::ToString() const
 {
     std::string str;
@@ -8,6 +8,7 @@
 
 #include <stdint.h>
 #include <amount.h>
+#include <crypto/common.h>
 #include <script/script.h>
 #include <serialize.h>
 #include <uint256.h>
@@ -26,12 +27,27 @@ public:
     COutPoint(): n(NULL_INDEX) { }
     COutPoint(const uint256& hashIn, uint32_t nIn): hash(hashIn), n(nIn) { }
 
-    ADD_SERIALIZE_METHODS;
+    //! Outpoints have a fixed size, so they are read and written in one piece.
+    static constexpr size_t SERIALIZED_SIZE = 32 + 4;
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITE(hash);
-        READWRITE(n);
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        unsigned char buf[SERIALIZED_SIZE];
+        memcpy(buf, hash.begin(), 32);
+        WriteLE32(buf + 32, n);
+        s.write(CharCast(buf), sizeof(buf));
+    }
+
+    void Serialize(CSizeComputer& s) const { s.seek(SERIALIZED_SIZE); }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        unsigned char buf[SERIALIZED_SIZE];
+        s.read(CharCast(buf), sizeof(buf));
+        memcpy(hash.begin(), buf, 32);
+        n = ReadLE32(buf + 32);
     }
 
     void SetNull() { hash.SetNull(); n = NULL_INDEX; }
@@ -293,9 +309,13 @@ private:
     /** Memory only. */
     const uint256 hash;
     const uint256 m_witness_hash;
+    /** Serialized sizes with and without witness data, as weight and fee rate computations use them repeatedly. */
+    const unsigned int m_total_size;
+    const unsigned int m_stripped_size;
 
     uint256 ComputeHash() const;
     uint256 ComputeWitnessHash() const;
+    unsigned int ComputeSize(int version) const;
 
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
@@ -304,12 +324,20 @@ public:
     /** Convert a CMutableTransaction into a CTransaction. */
     explicit CTransaction(const CMutableTransaction &tx);
     CTransaction(CMutableTransaction &&tx);
+    /** Convert a CMutableTransaction whose txid and wtxid the caller computed from its serialization.
+     *  The hashes are not checked. */
+    CTransaction(CMutableTransaction &&tx, const uint256& hash, const uint256& witness_hash);
 
     template <typename Stream>
     inline void Serialize(Stream& s) const {
         SerializeTransaction(*this, s);
     }
 
+    /** Computing the size of a transaction, also as part of a block, uses the cached sizes. */
+    inline void Serialize(CSizeComputer& s) const {
+        s.seek((s.GetVersion() & SERIALIZE_TRANSACTION_NO_WITNESS) ? m_stripped_size : m_total_size);
+    }
+
     /** This deserializing constructor is provided instead of an Unserialize method.
      *  Unserialize is not possible, since it would require overwriting const fields. */
     template <typename Stream>
@@ -332,7 +360,10 @@ public:
      * "Total Size" defined in BIP141 and BIP144.
      * @return Total transaction size in bytes
      */
-    unsigned int GetTotalSize() const;
+    unsigned int GetTotalSize() const { return m_total_size; }
+
+    /** Get the transaction size in bytes, excluding witness data. */
+    unsigned int GetStrippedSize() const { return m_stripped_size; }
 
     bool IsCoinBase() const
     {
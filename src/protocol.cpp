@@ -40,6 +40,13 @@ const char *SENDCMPCT="sendcmpct";
 const char *CMPCTBLOCK="cmpctblock";
 const char *GETBLOCKTXN="getblocktxn";
 const char *BLOCKTXN="blocktxn";
+const char *SENDTXRCNCL="sendtxrcncl";
+const char *REQTXRCNCL="reqtxrcncl";
+const char *SKETCH="sketch";
+const char *RECONCILDIFF="reconcildiff";
+const char *SENDCMPR="sendcmpr";
+const char *CMPR="cmpr";
+const char *SENDUDPRELAY="sendudprelay";
 } // namespace NetMsgType
 
 /** All known message types. Keep this in the same order as the list of
@@ -71,6 +78,13 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::CMPCTBLOCK,
     NetMsgType::GETBLOCKTXN,
     NetMsgType::BLOCKTXN,
+    NetMsgType::SENDTXRCNCL,
+    NetMsgType::REQTXRCNCL,
+    NetMsgType::SKETCH,
+    NetMsgType::RECONCILDIFF,
+    NetMsgType::SENDCMPR,
+    NetMsgType::CMPR,
+    NetMsgType::SENDUDPRELAY,
 };
 const static std::vector<std::string> allNetMessageTypesVec(allNetMessageTypes, allNetMessageTypes+ARRAYLEN(allNetMessageTypes));
 
@@ -234,6 +234,42 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Contains a 4-byte version number and an 8-byte salt.
+ * Sent before verack to offer reconciliation of transaction announcements.
+ */
+extern const char *SENDTXRCNCL;
+/**
+ * Contains the 4-byte size of the sender's reconciliation set.
+ * Peer should respond with a "sketch" message.
+ */
+extern const char *REQTXRCNCL;
+/**
+ * Contains a sketch of the sender's reconciliation set.
+ * Sent in response to a "reqtxrcncl" message.
+ */
+extern const char *SKETCH;
+/**
+ * Contains a 1-byte success flag and the short ids the sender is missing.
+ * Sent in response to a "sketch" message.
+ */
+extern const char *RECONCILDIFF;
+/**
+ * Contains a 4-byte compression version.
+ * Sent before verack to offer receiving "cmpr" messages.
+ */
+extern const char *SENDCMPR;
+/**
+ * Contains the command and 4-byte size of another message, followed by its
+ * payload compressed as an LZ4 block. Only sent to peers that sent "sendcmpr".
+ */
+extern const char *CMPR;
+/**
+ * Contains a 1-byte version number, the 2-byte UDP port of the sender and
+ * the two 8-byte halves of the key to authenticate its datagrams with.
+ * Sent before verack to offer exchanging blocks over UDP.
+ */
+extern const char *SENDUDPRELAY;
 };
 
 /* Get a vector of all valid message types (see above) */
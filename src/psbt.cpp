@@ -5,6 +5,8 @@
 #include <psbt.h>
 #include <util/strencodings.h>
 
+#include <algorithm>
+
 
 PartiallySignedTransaction::PartiallySignedTransaction(const CMutableTransaction& tx) : tx(tx)
 {
@@ -213,7 +215,7 @@ void UpdatePSBTOutput(const SigningProvider& provider, PartiallySignedTransactio
     psbt_out.FromSignatureData(sigdata);
 }
 
-bool SignPSBTInput(const SigningProvider& provider, PartiallySignedTransaction& psbt, int index, int sighash, SignatureData* out_sigdata, bool use_dummy)
+bool SignPSBTInput(const SigningProvider& provider, PartiallySignedTransaction& psbt, int index, int sighash, SignatureData* out_sigdata, bool use_dummy, const PrecomputedTransactionData* txdata)
 {
     PSBTInput& input = psbt.inputs.at(index);
     const CMutableTransaction& tx = *psbt.tx;
@@ -255,6 +257,9 @@ bool SignPSBTInput(const SigningProvider& provider, PartiallySignedTransaction&
     bool sig_complete;
     if (use_dummy) {
         sig_complete = ProduceSignature(provider, DUMMY_SIGNATURE_CREATOR, utxo.scriptPubKey, sigdata);
+    } else if (txdata) {
+        MutableTransactionSignatureCreator creator(&tx, index, utxo.nValue, *txdata, sighash);
+        sig_complete = ProduceSignature(provider, creator, utxo.scriptPubKey, sigdata);
     } else {
         MutableTransactionSignatureCreator creator(&tx, index, utxo.nValue, sighash);
         sig_complete = ProduceSignature(provider, creator, utxo.scriptPubKey, sigdata);
@@ -287,12 +292,12 @@ bool FinalizePSBT(PartiallySignedTransaction& psbtx)
     //   signature, but have not combined them yet (e.g. because the combiner that created this
     //   PartiallySignedTransaction did not understand them), this will combine them into a final
     //   script.
-    bool complete = true;
-    for (unsigned int i = 0; i < psbtx.tx->vin.size(); ++i) {
-        complete &= SignPSBTInput(DUMMY_SIGNING_PROVIDER, psbtx, i, SIGHASH_ALL);
-    }
+    std::vector<char> complete(psbtx.tx->vin.size());
+    ForEachInputParallel(complete.size(), [&](size_t i) {
+        complete[i] = SignPSBTInput(DUMMY_SIGNING_PROVIDER, psbtx, i, SIGHASH_ALL);
+    });
 
-    return complete;
+    return std::find(complete.begin(), complete.end(), 0) == complete.end();
 }
 
 bool FinalizeAndExtractPSBT(PartiallySignedTransaction& psbtx, CMutableTransaction& result)
@@ -313,13 +318,27 @@ bool FinalizeAndExtractPSBT(PartiallySignedTransaction& psbtx, CMutableTransacti
 
 TransactionError CombinePSBTs(PartiallySignedTransaction& out, const std::vector<PartiallySignedTransaction>& psbtxs)
 {
+    // Check that they all spend the same transaction first, hashing each once
+    const uint256 txid = psbtxs[0].tx->GetHash();
+    for (auto it = std::next(psbtxs.begin()); it != psbtxs.end(); ++it) {
+        if (it->tx->GetHash() != txid) {
+            return TransactionError::PSBT_MISMATCH;
+        }
+    }
+
     out = psbtxs[0]; // Copy the first one
 
-    // Merge
+    // Merge all of them into each input at once, rather than merging them in one by one
+    ForEachInputParallel(out.inputs.size(), [&](size_t i) {
+        for (auto it = std::next(psbtxs.begin()); it != psbtxs.end(); ++it) {
+            out.inputs[i].Merge(it->inputs[i]);
+        }
+    });
     for (auto it = std::next(psbtxs.begin()); it != psbtxs.end(); ++it) {
-        if (!out.Merge(*it)) {
-            return TransactionError::PSBT_MISMATCH;
+        for (unsigned int i = 0; i < out.outputs.size(); ++i) {
+            out.outputs[i].Merge(it->outputs[i]);
         }
+        out.unknown.insert(it->unknown.begin(), it->unknown.end());
     }
     return TransactionError::OK;
 }
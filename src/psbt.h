@@ -565,8 +565,11 @@ std::string PSBTRoleName(PSBTRole role);
 /** Checks whether a PSBTInput is already signed. */
 bool PSBTInputSigned(const PSBTInput& input);
 
-/** Signs a PSBTInput, verifying that all provided data matches what is being signed. */
-bool SignPSBTInput(const SigningProvider& provider, PartiallySignedTransaction& psbt, int index, int sighash = SIGHASH_ALL, SignatureData* out_sigdata = nullptr, bool use_dummy = false);
+/**
+ * Signs a PSBTInput, verifying that all provided data matches what is being signed.
+ * If set, txdata holds the signature hash midstates of the PSBT's transaction.
+ */
+bool SignPSBTInput(const SigningProvider& provider, PartiallySignedTransaction& psbt, int index, int sighash = SIGHASH_ALL, SignatureData* out_sigdata = nullptr, bool use_dummy = false, const PrecomputedTransactionData* txdata = nullptr);
 
 /** Updates a PSBTOutput with information from provider.
  *
@@ -276,6 +276,40 @@ bool CExtPubKey::Derive(CExtPubKey &out, unsigned int _nChild) const {
     return pubkey.Derive(out.pubkey, out.chaincode, _nChild, chaincode);
 }
 
+bool CExtPubKey::DeriveMany(std::vector<CExtPubKey>& out, unsigned int first, size_t count) const {
+    out.resize(count);
+    if (count == 0) return true;
+    assert(pubkey.IsValid());
+    assert(pubkey.size() == CPubKey::COMPRESSED_SIZE);
+    const unsigned int last = first + (count - 1);
+    assert(last >= first && (last >> 31) == 0);
+    const CKeyID id = pubkey.GetID();
+    std::vector<unsigned char> tweaks(64 * count);
+    BIP32HashMany(chaincode, first, count, *pubkey.begin(), pubkey.begin() + 1, tweaks.data());
+    secp256k1_pubkey parent;
+    assert(secp256k1_context_verify && "secp256k1_context_verify must be initialized to use CPubKey.");
+    const bool parsed = secp256k1_ec_pubkey_parse(secp256k1_context_verify, &parent, pubkey.begin(), pubkey.size());
+    bool ret = parsed;
+    for (size_t i = 0; i < count; ++i) {
+        CExtPubKey& child = out[i];
+        child.nDepth = nDepth + 1;
+        memcpy(&child.vchFingerprint[0], &id, 4);
+        child.nChild = first + i;
+        memcpy(child.chaincode.begin(), tweaks.data() + 64 * i + 32, 32);
+        secp256k1_pubkey tweaked = parent;
+        if (!parsed || !secp256k1_ec_pubkey_tweak_add(secp256k1_context_verify, &tweaked, tweaks.data() + 64 * i)) {
+            child.pubkey = CPubKey();
+            ret = false;
+            continue;
+        }
+        unsigned char pub[CPubKey::COMPRESSED_SIZE];
+        size_t publen = CPubKey::COMPRESSED_SIZE;
+        secp256k1_ec_pubkey_serialize(secp256k1_context_verify, pub, &publen, &tweaked, SECP256K1_EC_COMPRESSED);
+        child.pubkey.Set(pub, pub + publen);
+    }
+    return ret;
+}
+
 /* static */ bool CPubKey::CheckLowS(const std::vector<unsigned char>& vchSig) {
     secp256k1_ecdsa_signature sig;
     assert(secp256k1_context_verify && "secp256k1_context_verify must be initialized to use CPubKey.");
@@ -285,6 +319,30 @@ bool CExtPubKey::Derive(CExtPubKey &out, unsigned int _nChild) const {
     return (!secp256k1_ecdsa_signature_normalize(secp256k1_context_verify, nullptr, &sig));
 }
 
+std::vector<CKeyID> GetKeyIDs(const std::vector<CPubKey>& pubkeys)
+{
+    std::vector<CKeyID> ids(pubkeys.size());
+    std::vector<unsigned char> compressed;
+    std::vector<size_t> positions;
+    compressed.reserve(pubkeys.size() * CPubKey::COMPRESSED_SIZE);
+    for (size_t i = 0; i < pubkeys.size(); ++i) {
+        if (pubkeys[i].size() == CPubKey::COMPRESSED_SIZE) {
+            compressed.insert(compressed.end(), pubkeys[i].begin(), pubkeys[i].end());
+            positions.push_back(i);
+        } else {
+            ids[i] = pubkeys[i].GetID();
+        }
+    }
+    if (positions.empty()) return ids;
+    static_assert(sizeof(uint160) == CHash160::OUTPUT_SIZE, "uint160 vectors must be contiguous hashes");
+    std::vector<uint160> hashes(positions.size());
+    Hash160Many(hashes.front().begin(), compressed.data(), positions.size());
+    for (size_t i = 0; i < positions.size(); ++i) {
+        ids[positions[i]] = CKeyID(hashes[i]);
+    }
+    return ids;
+}
+
 /* static */ int ECCVerifyHandle::refcount = 0;
 
 ECCVerifyHandle::ECCVerifyHandle()
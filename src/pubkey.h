@@ -203,6 +203,9 @@ public:
     bool Derive(CPubKey& pubkeyChild, ChainCode &ccChild, unsigned int nChild, const ChainCode& cc) const;
 };
 
+/** The IDs of many public keys, equal to their GetID(). The compressed ones are hashed together with Hash160Many. */
+std::vector<CKeyID> GetKeyIDs(const std::vector<CPubKey>& pubkeys);
+
 struct CExtPubKey {
     unsigned char nDepth;
     unsigned char vchFingerprint[4];
@@ -222,6 +225,12 @@ struct CExtPubKey {
     void Encode(unsigned char code[BIP32_EXTKEY_SIZE]) const;
     void Decode(const unsigned char code[BIP32_EXTKEY_SIZE]);
     bool Derive(CExtPubKey& out, unsigned int nChild) const;
+    /** Derive the count (non-hardened) children first, first + 1, ... into
+     *  out, which is like calling Derive for each of them, but parses the
+     *  parent key and computes its fingerprint once and batches the HMACs.
+     *  Returns false if any derivation failed, leaving that child's key
+     *  invalid. */
+    bool DeriveMany(std::vector<CExtPubKey>& out, unsigned int first, size_t count) const;
 };
 
 /** Users of this module must hold an ECCVerifyHandle. The constructor and
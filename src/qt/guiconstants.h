@@ -39,6 +39,9 @@ static const bool DEFAULT_SPLASHSCREEN = true;
  */
 static const int TOOLTIP_WRAP_THRESHOLD = 80;
 
+/* Number of wallet transactions the transaction table loads at a time */
+static const int TRANSACTION_TABLE_PAGE_SIZE = 1000;
+
 /* Number of frames in spinner animation */
 #define SPINNER_FRAMES 36
 
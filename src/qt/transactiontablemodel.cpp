@@ -18,6 +18,7 @@
 #include <uint256.h>
 
 #include <algorithm>
+#include <limits>
 
 #include <QColor>
 #include <QDateTime>
@@ -64,25 +65,64 @@ public:
 
     TransactionTableModel *parent;
 
-    /* Local cache of wallet.
-     * As it is in the same order as the CWallet, by definition
-     * this is sorted by sha256.
+    /* Local cache of the wallet transactions loaded so far, newest first in
+     * pages of TRANSACTION_TABLE_PAGE_SIZE, sorted by hash.
      */
     QList<TransactionRecord> cachedWallet;
 
-    /* Query entire wallet anew from core.
+    /* Order position of the newest wallet transaction not loaded yet, or -1
+     * once all are.
+     */
+    int64_t nextOrderPos = -1;
+
+    /* Query the first page of the wallet anew from core.
      */
     void refreshWallet(interfaces::Wallet& wallet)
     {
         qDebug() << "TransactionTablePriv::refreshWallet";
         cachedWallet.clear();
-        {
-            for (const auto& wtx : wallet.getWalletTxs()) {
-                if (TransactionRecord::showTransaction()) {
-                    cachedWallet.append(TransactionRecord::decomposeTransaction(wtx));
-                }
+        nextOrderPos = std::numeric_limits<int64_t>::max();
+        for (const auto& wtx : wallet.getWalletTxs(nextOrderPos, TRANSACTION_TABLE_PAGE_SIZE)) {
+            if (TransactionRecord::showTransaction()) {
+                cachedWallet.append(TransactionRecord::decomposeTransaction(wtx));
             }
         }
+        std::stable_sort(cachedWallet.begin(), cachedWallet.end(), TxLessThan());
+    }
+
+    bool canFetchMore() const
+    {
+        return nextOrderPos >= 0;
+    }
+
+    /* Load the next page of older transactions, skipping those a notification
+       already added to the model.
+     */
+    void fetchMore(interfaces::Wallet& wallet)
+    {
+        if (!canFetchMore()) return;
+        qDebug() << "TransactionTablePriv::fetchMore: " + QString::number(nextOrderPos);
+        QList<TransactionRecord> toInsert;
+        for (const auto& wtx : wallet.getWalletTxs(nextOrderPos, TRANSACTION_TABLE_PAGE_SIZE)) {
+            if (TransactionRecord::showTransaction() &&
+                !std::binary_search(cachedWallet.begin(), cachedWallet.end(), wtx.tx->GetHash(), TxLessThan())) {
+                toInsert.append(TransactionRecord::decomposeTransaction(wtx));
+            }
+        }
+        std::stable_sort(toInsert.begin(), toInsert.end(), TxLessThan());
+
+        // Insert each run of records that goes between the same two rows at once
+        QList<TransactionRecord>::const_iterator it = toInsert.constBegin();
+        while (it != toInsert.constEnd()) {
+            int insert_idx = std::lower_bound(cachedWallet.begin(), cachedWallet.end(), it->hash, TxLessThan()) - cachedWallet.begin();
+            QList<TransactionRecord>::const_iterator end = insert_idx < cachedWallet.size() ?
+                std::lower_bound(it, toInsert.constEnd(), cachedWallet[insert_idx].hash, TxLessThan()) : toInsert.constEnd();
+            parent->beginInsertRows(QModelIndex(), insert_idx, insert_idx + (end - it) - 1);
+            for (; it != end; ++it) {
+                cachedWallet.insert(insert_idx++, *it);
+            }
+            parent->endInsertRows();
+        }
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -267,6 +307,16 @@ int TransactionTableModel::rowCount(const QModelIndex &parent) const
     return priv->size();
 }
 
+bool TransactionTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && priv->canFetchMore();
+}
+
+void TransactionTableModel::fetchMore(const QModelIndex &parent)
+{
+    if (!parent.isValid()) priv->fetchMore(walletModel->wallet());
+}
+
 int TransactionTableModel::columnCount(const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
@@ -6,6 +6,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <core_io.h>
+#include <httprpc.h>
 #include <httpserver.h>
 #include <index/txindex.h>
 #include <node/context.h>
@@ -14,6 +15,7 @@
 #include <rpc/blockchain.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
+#include <shutdown.h>
 #include <streams.h>
 #include <sync.h>
 #include <txmempool.h>
@@ -26,7 +28,11 @@
 
 #include <univalue.h>
 
-static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const long MAX_REST_BLOCKS = 100000; //allow a max of 100000 blocks to be streamed at once
+static const size_t MAX_REST_BLOCKS_BUFFERED = 4 << 20; //read ahead of the client by at most 4 MB
+
+//! Most outpoints a getutxos request may query, set from -restmaxutxos in StartREST()
+static size_t g_rest_max_utxos = DEFAULT_REST_MAX_UTXOS;
 
 enum class RetFormat {
     UNDEF,
@@ -285,6 +291,90 @@ static bool rest_block_notxdetails(HTTPRequest* req, const std::string& strURIPa
     return rest_block(req, strURIPart, false);
 }
 
+/** Read a block as the binary REST format serializes it, from a mapping of its file if possible */
+static bool ReadRESTBlock(const CBlockIndex* pindex, std::string& block_data)
+{
+    const CChainParams& params = Params();
+    if (RPCSerializationFlags() == 0) {
+        // Blocks are stored exactly as they are served
+        MappedBlockData mapped;
+        if (ReadMappedBlockFromDisk(mapped, pindex, params.MessageStart())) {
+            block_data.assign(mapped.data.begin(), mapped.data.end());
+            return true;
+        }
+        std::vector<uint8_t> raw;
+        if (!ReadRawBlockFromDisk(raw, pindex, params.MessageStart())) return false;
+        block_data.assign(raw.begin(), raw.end());
+        return true;
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, params.GetConsensus())) return false;
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    ssBlock << block;
+    block_data = ssBlock.str();
+    return true;
+}
+
+static bool rest_blocks(HTTPRequest* req,
+                        const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RetFormat::BINARY)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: bin)");
+
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No block count specified. Use /rest/blocks/<hash>/<count>.bin.");
+
+    std::string hashStr = path[0];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    long count = strtol(path[1].c_str(), nullptr, 10);
+    if (count < 1 || count > MAX_REST_BLOCKS)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+
+    std::vector<const CBlockIndex*> blocks;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(hash);
+        if (!pindex || !::ChainActive().Contains(pindex))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found in the active chain");
+        if (IsBlockPruned(pindex))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
+        blocks.reserve(std::min<long>(count, ::ChainActive().Height() - pindex->nHeight + 1));
+        while (pindex != nullptr && blocks.size() < (unsigned long)count) {
+            blocks.push_back(pindex);
+            pindex = ::ChainActive().Next(pindex);
+        }
+    }
+
+    // Stream the blocks one by one, reading the next only once the client has
+    // taken most of the ones before. A block that can't be read (because it
+    // was pruned meanwhile) ends the reply early.
+    req->WriteHeader("Content-Type", "application/octet-stream");
+    req->StartChunkedReply(HTTP_OK);
+    for (const CBlockIndex* pindex : blocks) {
+        req->WaitForReplySent(MAX_REST_BLOCKS_BUFFERED);
+        if (ShutdownRequested())
+            break;
+        std::string block_data;
+        if (!ReadRESTBlock(pindex, block_data)) {
+            LogPrintf("%s: failed to read block %s, ending reply early\n", __func__, pindex->GetBlockHash().ToString());
+            break;
+        }
+        req->WriteReplyChunk(std::move(block_data));
+    }
+    req->EndChunkedReply();
+    return true;
+}
+
 // A bit of a hack - dependency on a function defined in rpc/blockchain.cpp
 UniValue getblockchaininfo(const JSONRPCRequest& request);
 
@@ -503,8 +593,8 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     }
 
     // limit max outpoints
-    if (vOutPoints.size() > MAX_GETUTXOS_OUTPOINTS)
-        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", MAX_GETUTXOS_OUTPOINTS, vOutPoints.size()));
+    if (vOutPoints.size() > g_rest_max_utxos)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: max outpoints exceeded (max: %d, tried: %d)", g_rest_max_utxos, vOutPoints.size()));
 
     // check spentness and form a bitmap (as well as a JSON capable human-readable string representation)
     std::vector<unsigned char> bitmap;
@@ -514,11 +604,13 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     bitmap.resize((vOutPoints.size() + 7) / 8);
     {
         auto process_utxos = [&vOutPoints, &outs, &hits](const CCoinsView& view, const CTxMemPool& mempool) {
-            for (const COutPoint& vOutPoint : vOutPoints) {
-                Coin coin;
-                bool hit = !mempool.isSpent(vOutPoint) && view.GetCoin(vOutPoint, coin);
+            // look all outpoints up at once, which lets the database read them in key order
+            std::vector<Coin> coins;
+            view.GetCoins(vOutPoints, coins);
+            for (size_t i = 0; i < vOutPoints.size(); ++i) {
+                bool hit = !coins[i].IsSpent() && !mempool.isSpent(vOutPoints[i]);
                 hits.push_back(hit);
-                if (hit) outs.emplace_back(std::move(coin));
+                if (hit) outs.emplace_back(std::move(coins[i]));
             }
         };
 
@@ -653,6 +745,7 @@ static const struct {
       {"/rest/tx/", rest_tx},
       {"/rest/block/notxdetails/", rest_block_notxdetails},
       {"/rest/block/", rest_block_extended},
+      {"/rest/blocks/", rest_blocks},
       {"/rest/chaininfo", rest_chaininfo},
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
@@ -663,8 +756,9 @@ static const struct {
 
 void StartREST()
 {
+    g_rest_max_utxos = std::max<int64_t>(gArgs.GetArg("-restmaxutxos", DEFAULT_REST_MAX_UTXOS), 0);
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
-        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler, HTTP_QUEUE_REST);
 }
 
 void InterruptREST()
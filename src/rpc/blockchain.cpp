@@ -12,8 +12,15 @@
 #include <coins.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <crypto/siphash.h>
 #include <hash.h>
+#include <index/addressindex.h>
 #include <index/blockfilterindex.h>
+#include <index/blockstatsindex.h>
+#include <index/coinstatsindex.h>
+#include <index/spentindex.h>
+#include <key_io.h>
+#include <node/blockstats.h>
 #include <node/coinstats.h>
 #include <node/context.h>
 #include <node/utxo_snapshot.h>
@@ -21,6 +28,7 @@
 #include <policy/policy.h>
 #include <policy/rbf.h>
 #include <primitives/transaction.h>
+#include <random.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
@@ -31,6 +39,7 @@
 #include <undo.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 #include <validation.h>
 #include <validationinterface.h>
 #include <warnings.h>
@@ -39,9 +48,13 @@
 
 #include <univalue.h>
 
+#include <atomic>
 #include <condition_variable>
+#include <exception>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <unordered_set>
 
 struct CUpdatedBlock
 {
@@ -62,15 +75,45 @@ CTxMemPool& EnsureMemPool()
     return *g_rpc_node->mempool;
 }
 
+std::shared_ptr<const TipSnapshot> EnsureTipSnapshot()
+{
+    std::shared_ptr<const TipSnapshot> tip = GetTipSnapshot();
+    if (!tip) {
+        throw JSONRPCError(RPC_IN_WARMUP, "Chain tip not loaded yet");
+    }
+    return tip;
+}
+
+int GetBuriedBlockHeight(const uint256& hash)
+{
+    LOCK(cs_main);
+    const CBlockIndex* pindex = LookupBlockIndex(hash);
+    if (!pindex || !::ChainActive().Contains(pindex)) return -1;
+    if (::ChainActive().Height() - pindex->nHeight + 1 < RPC_CACHE_MIN_CONFIRMATIONS) return -1;
+    return pindex->nHeight;
+}
+
+void RefreshRPCConfirmations(UniValue& result, int height)
+{
+    if (result.isObject() && result.exists("confirmations")) {
+        result.pushKV("confirmations", EnsureTipSnapshot()->height - height + 1);
+    }
+}
+
 /* Calculate the difficulty for a given block index.
  */
 double GetDifficulty(const CBlockIndex* blockindex)
 {
     CHECK_NONFATAL(blockindex);
 
-    int nShift = (blockindex->nBits >> 24) & 0xff;
+    return GetDifficulty(blockindex->nBits);
+}
+
+double GetDifficulty(uint32_t bits)
+{
+    int nShift = (bits >> 24) & 0xff;
     double dDiff =
-        (double)0x0000ffff / (double)(blockindex->nBits & 0x00ffffff);
+        (double)0x0000ffff / (double)(bits & 0x00ffffff);
 
     while (nShift < 29)
     {
@@ -184,8 +227,7 @@ static UniValue getblockcount(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(cs_main);
-    return ::ChainActive().Height();
+    return EnsureTipSnapshot()->height;
 }
 
 static UniValue getbestblockhash(const JSONRPCRequest& request)
@@ -201,13 +243,31 @@ static UniValue getbestblockhash(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
+    return EnsureTipSnapshot()->hash.GetHex();
+}
+
+/** Forget the cached RPC results about blocks that the move from the previous tip to pindex disconnected. */
+static void ForgetReorganizedRPCResults(const CBlockIndex* pindex)
+{
+    CUpdatedBlock previous;
+    {
+        std::lock_guard<std::mutex> lock(cs_blockchange);
+        previous = latestblock;
+    }
+    if (previous.hash.IsNull()) return;
+    const CBlockIndex* ancestor = pindex->GetAncestor(previous.height);
+    if (ancestor && ancestor->GetBlockHash() == previous.hash) return;
+
     LOCK(cs_main);
-    return ::ChainActive().Tip()->GetBlockHash().GetHex();
+    const CBlockIndex* previous_tip = LookupBlockIndex(previous.hash);
+    // The entry for the fork point goes too, its nextblockhash changed
+    ForgetRPCCacheFrom(previous_tip ? LastCommonAncestor(previous_tip, pindex)->nHeight : 0);
 }
 
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
 {
     if(pindex) {
+        ForgetReorganizedRPCResults(pindex);
         std::lock_guard<std::mutex> lock(cs_blockchange);
         latestblock.hash = pindex->GetBlockHash();
         latestblock.height = pindex->nHeight;
@@ -403,37 +463,91 @@ static std::vector<RPCResult> MempoolEntryDescription() { return {
     RPCResult{RPCResult::Type::BOOL, "bip125-replaceable", "Whether this transaction could be replaced due to BIP125 (replace-by-fee)"},
 };}
 
-static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPoolEntry& e) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+namespace {
+/** What entryToJSON shows about a mempool entry, copied so that the JSON can be built without holding the mempool lock. */
+struct MempoolEntrySnapshot {
+    uint256 txid;
+    uint256 wtxid;
+    CAmount fee;
+    CAmount modified_fee;
+    size_t vsize;
+    size_t weight;
+    int64_t time;
+    unsigned int height;
+    uint64_t count_with_descendants;
+    uint64_t size_with_descendants;
+    CAmount mod_fees_with_descendants;
+    uint64_t count_with_ancestors;
+    uint64_t size_with_ancestors;
+    CAmount mod_fees_with_ancestors;
+    std::vector<uint256> depends;
+    std::vector<uint256> spent_by;
+    bool bip125_replaceable;
+};
+} // namespace
+
+static MempoolEntrySnapshot SnapshotEntry(const CTxMemPool& pool, const CTxMemPoolEntry& e) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
 {
     AssertLockHeld(pool.cs);
 
+    MempoolEntrySnapshot snapshot;
+    snapshot.txid = e.GetTx().GetHash();
+    snapshot.wtxid = pool.vTxHashes[e.vTxHashesIdx].first;
+    snapshot.fee = e.GetFee();
+    snapshot.modified_fee = e.GetModifiedFee();
+    snapshot.vsize = e.GetTxSize();
+    snapshot.weight = e.GetTxWeight();
+    snapshot.time = count_seconds(e.GetTime());
+    snapshot.height = e.GetHeight();
+    snapshot.count_with_descendants = e.GetCountWithDescendants();
+    snapshot.size_with_descendants = e.GetSizeWithDescendants();
+    snapshot.mod_fees_with_descendants = e.GetModFeesWithDescendants();
+    snapshot.count_with_ancestors = e.GetCountWithAncestors();
+    snapshot.size_with_ancestors = e.GetSizeWithAncestors();
+    snapshot.mod_fees_with_ancestors = e.GetModFeesWithAncestors();
+    for (const CTxMemPoolEntry& parent : e.GetMemPoolParentsConst()) {
+        snapshot.depends.push_back(parent.GetTx().GetHash());
+    }
+    for (const CTxMemPoolEntry& child : e.GetMemPoolChildrenConst()) {
+        snapshot.spent_by.push_back(child.GetTx().GetHash());
+    }
+
+    // Add opt-in RBF status
+    RBFTransactionState rbfState = IsRBFOptIn(e.GetTx(), pool);
+    if (rbfState == RBFTransactionState::UNKNOWN) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Transaction is not in mempool");
+    }
+    snapshot.bip125_replaceable = rbfState == RBFTransactionState::REPLACEABLE_BIP125;
+    return snapshot;
+}
+
+static void entryToJSON(UniValue& info, const MempoolEntrySnapshot& e)
+{
     UniValue fees(UniValue::VOBJ);
-    fees.pushKV("base", ValueFromAmount(e.GetFee()));
-    fees.pushKV("modified", ValueFromAmount(e.GetModifiedFee()));
-    fees.pushKV("ancestor", ValueFromAmount(e.GetModFeesWithAncestors()));
-    fees.pushKV("descendant", ValueFromAmount(e.GetModFeesWithDescendants()));
+    fees.pushKV("base", ValueFromAmount(e.fee));
+    fees.pushKV("modified", ValueFromAmount(e.modified_fee));
+    fees.pushKV("ancestor", ValueFromAmount(e.mod_fees_with_ancestors));
+    fees.pushKV("descendant", ValueFromAmount(e.mod_fees_with_descendants));
     info.pushKV("fees", fees);
 
-    info.pushKV("vsize", (int)e.GetTxSize());
-    if (IsDeprecatedRPCEnabled("size")) info.pushKV("size", (int)e.GetTxSize());
-    info.pushKV("weight", (int)e.GetTxWeight());
-    info.pushKV("fee", ValueFromAmount(e.GetFee()));
-    info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
-    info.pushKV("time", count_seconds(e.GetTime()));
-    info.pushKV("height", (int)e.GetHeight());
-    info.pushKV("descendantcount", e.GetCountWithDescendants());
-    info.pushKV("descendantsize", e.GetSizeWithDescendants());
-    info.pushKV("descendantfees", e.GetModFeesWithDescendants());
-    info.pushKV("ancestorcount", e.GetCountWithAncestors());
-    info.pushKV("ancestorsize", e.GetSizeWithAncestors());
-    info.pushKV("ancestorfees", e.GetModFeesWithAncestors());
-    info.pushKV("wtxid", pool.vTxHashes[e.vTxHashesIdx].first.ToString());
-    const CTransaction& tx = e.GetTx();
+    info.pushKV("vsize", (int)e.vsize);
+    if (IsDeprecatedRPCEnabled("size")) info.pushKV("size", (int)e.vsize);
+    info.pushKV("weight", (int)e.weight);
+    info.pushKV("fee", ValueFromAmount(e.fee));
+    info.pushKV("modifiedfee", ValueFromAmount(e.modified_fee));
+    info.pushKV("time", e.time);
+    info.pushKV("height", (int)e.height);
+    info.pushKV("descendantcount", e.count_with_descendants);
+    info.pushKV("descendantsize", e.size_with_descendants);
+    info.pushKV("descendantfees", e.mod_fees_with_descendants);
+    info.pushKV("ancestorcount", e.count_with_ancestors);
+    info.pushKV("ancestorsize", e.size_with_ancestors);
+    info.pushKV("ancestorfees", e.mod_fees_with_ancestors);
+    info.pushKV("wtxid", e.wtxid.ToString());
     std::set<std::string> setDepends;
-    for (const CTxIn& txin : tx.vin)
+    for (const uint256& parent : e.depends)
     {
-        if (pool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
+        setDepends.insert(parent.ToString());
     }
 
     UniValue depends(UniValue::VARR);
@@ -445,50 +559,66 @@ static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPool
     info.pushKV("depends", depends);
 
     UniValue spent(UniValue::VARR);
-    const CTxMemPool::txiter& it = pool.mapTx.find(tx.GetHash());
-    const CTxMemPool::setEntries& setChildren = pool.GetMemPoolChildren(it);
-    for (CTxMemPool::txiter childiter : setChildren) {
-        spent.push_back(childiter->GetTx().GetHash().ToString());
+    for (const uint256& child : e.spent_by) {
+        spent.push_back(child.ToString());
     }
 
     info.pushKV("spentby", spent);
+    info.pushKV("bip125-replaceable", e.bip125_replaceable);
+}
 
-    // Add opt-in RBF status
-    bool rbfStatus = false;
-    RBFTransactionState rbfState = IsRBFOptIn(tx, pool);
-    if (rbfState == RBFTransactionState::UNKNOWN) {
-        throw JSONRPCError(RPC_MISC_ERROR, "Transaction is not in mempool");
-    } else if (rbfState == RBFTransactionState::REPLACEABLE_BIP125) {
-        rbfStatus = true;
-    }
-
-    info.pushKV("bip125-replaceable", rbfStatus);
+/** Build the JSON of the given entries, which were copied out of the mempool with SnapshotEntry. */
+static UniValue EntriesToJSON(const std::vector<MempoolEntrySnapshot>& entries)
+{
+    UniValue o(UniValue::VOBJ);
+    for (const MempoolEntrySnapshot& e : entries) {
+        UniValue info(UniValue::VOBJ);
+        entryToJSON(info, e);
+        // Mempool has unique entries so there is no advantage in using
+        // UniValue::pushKV, which checks if the key already exists in O(N).
+        // UniValue::__pushKV is used instead which currently is O(1).
+        o.__pushKV(e.txid.ToString(), info);
+    }
+    return o;
 }
 
-UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose)
+UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose, bool include_mempool_sequence)
 {
     if (verbose) {
-        LOCK(pool.cs);
-        UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry& e : pool.mapTx) {
-            const uint256& hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            entryToJSON(pool, info, e);
-            // Mempool has unique entries so there is no advantage in using
-            // UniValue::pushKV, which checks if the key already exists in O(N).
-            // UniValue::__pushKV is used instead which currently is O(1).
-            o.__pushKV(hash.ToString(), info);
+        if (include_mempool_sequence) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbose results cannot contain mempool sequence values.");
         }
-        return o;
+        // Only copy the entries while holding the lock; turning them into
+        // JSON takes much longer, and would hold up transaction acceptance.
+        std::vector<MempoolEntrySnapshot> entries;
+        {
+            LOCK(pool.cs);
+            entries.reserve(pool.mapTx.size());
+            for (const CTxMemPoolEntry& e : pool.mapTx) {
+                entries.push_back(SnapshotEntry(pool, e));
+            }
+        }
+        return EntriesToJSON(entries);
     } else {
+        uint64_t mempool_sequence;
         std::vector<uint256> vtxid;
-        pool.queryHashes(vtxid);
+        {
+            LOCK(pool.cs);
+            pool.queryHashes(vtxid);
+            mempool_sequence = pool.GetSequence();
+        }
 
         UniValue a(UniValue::VARR);
         for (const uint256& hash : vtxid)
             a.push_back(hash.ToString());
 
-        return a;
+        if (!include_mempool_sequence) {
+            return a;
+        }
+        UniValue o(UniValue::VOBJ);
+        o.pushKV("txids", a);
+        o.pushKV("mempool_sequence", mempool_sequence);
+        return o;
     }
 }
 
@@ -499,6 +629,7 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
                 "\nHint: use getmempoolentry to fetch a specific transaction from the mempool.\n",
                 {
                     {"verbose", RPCArg::Type::BOOL, /* default */ "false", "True for a json object, false for array of transaction ids"},
+                    {"mempool_sequence", RPCArg::Type::BOOL, /* default */ "false", "If verbose=false, returns a json object with transaction list and mempool sequence number attached."},
                 },
                 {
                     RPCResult{"for verbose = false",
@@ -511,6 +642,15 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
                         {
                             {RPCResult::Type::OBJ_DYN, "transactionid", "", MempoolEntryDescription()},
                         }},
+                    RPCResult{"for verbose = false and mempool_sequence = true",
+                        RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::ARR, "txids", "",
+                            {
+                                {RPCResult::Type::STR_HEX, "", "The transaction id"},
+                            }},
+                            {RPCResult::Type::NUM, "mempool_sequence", "The mempool sequence value."},
+                        }},
                 },
                 RPCExamples{
                     HelpExampleCli("getrawmempool", "true")
@@ -522,7 +662,12 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
-    return MempoolToJSON(EnsureMemPool(), fVerbose);
+    bool include_mempool_sequence = false;
+    if (!request.params[1].isNull()) {
+        include_mempool_sequence = request.params[1].get_bool();
+    }
+
+    return MempoolToJSON(EnsureMemPool(), fVerbose, include_mempool_sequence);
 }
 
 static UniValue getmempoolancestors(const JSONRPCRequest& request)
@@ -553,35 +698,39 @@ static UniValue getmempoolancestors(const JSONRPCRequest& request)
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
     const CTxMemPool& mempool = EnsureMemPool();
-    LOCK(mempool.cs);
+    std::vector<uint256> ancestors;
+    std::vector<MempoolEntrySnapshot> entries;
+    {
+        LOCK(mempool.cs);
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
-    }
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        }
 
-    CTxMemPool::setEntries setAncestors;
-    uint64_t noLimit = std::numeric_limits<uint64_t>::max();
-    std::string dummy;
-    mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
+        CTxMemPool::setEntries setAncestors;
+        uint64_t noLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
+
+        for (CTxMemPool::txiter ancestorIt : setAncestors) {
+            if (fVerbose) {
+                entries.push_back(SnapshotEntry(mempool, *ancestorIt));
+            } else {
+                ancestors.push_back(ancestorIt->GetTx().GetHash());
+            }
+        }
+    }
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            o.push_back(ancestorIt->GetTx().GetHash().ToString());
+        for (const uint256& ancestor : ancestors) {
+            o.push_back(ancestor.ToString());
         }
 
         return o;
     } else {
-        UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            const CTxMemPoolEntry &e = *ancestorIt;
-            const uint256& _hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            entryToJSON(mempool, info, e);
-            o.pushKV(_hash.ToString(), info);
-        }
-        return o;
+        return EntriesToJSON(entries);
     }
 }
 
@@ -616,35 +765,39 @@ static UniValue getmempooldescendants(const JSONRPCRequest& request)
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
     const CTxMemPool& mempool = EnsureMemPool();
-    LOCK(mempool.cs);
+    std::vector<uint256> descendants;
+    std::vector<MempoolEntrySnapshot> entries;
+    {
+        LOCK(mempool.cs);
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
-    }
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        }
+
+        CTxMemPool::setEntries setDescendants;
+        mempool.CalculateDescendants(it, setDescendants);
+        // CTxMemPool::CalculateDescendants will include the given tx
+        setDescendants.erase(it);
 
-    CTxMemPool::setEntries setDescendants;
-    mempool.CalculateDescendants(it, setDescendants);
-    // CTxMemPool::CalculateDescendants will include the given tx
-    setDescendants.erase(it);
+        for (CTxMemPool::txiter descendantIt : setDescendants) {
+            if (fVerbose) {
+                entries.push_back(SnapshotEntry(mempool, *descendantIt));
+            } else {
+                descendants.push_back(descendantIt->GetTx().GetHash());
+            }
+        }
+    }
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            o.push_back(descendantIt->GetTx().GetHash().ToString());
+        for (const uint256& descendant : descendants) {
+            o.push_back(descendant.ToString());
         }
 
         return o;
     } else {
-        UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            const CTxMemPoolEntry &e = *descendantIt;
-            const uint256& _hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            entryToJSON(mempool, info, e);
-            o.pushKV(_hash.ToString(), info);
-        }
-        return o;
+        return EntriesToJSON(entries);
     }
 }
 
@@ -666,16 +819,19 @@ static UniValue getmempoolentry(const JSONRPCRequest& request)
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
     const CTxMemPool& mempool = EnsureMemPool();
-    LOCK(mempool.cs);
+    MempoolEntrySnapshot e;
+    {
+        LOCK(mempool.cs);
 
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it == mempool.mapTx.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
+        }
+        e = SnapshotEntry(mempool, *it);
     }
 
-    const CTxMemPoolEntry &e = *it;
     UniValue info(UniValue::VOBJ);
-    entryToJSON(mempool, info, e);
+    entryToJSON(info, e);
     return info;
 }
 
@@ -748,13 +904,11 @@ static UniValue getblockheader(const JSONRPCRequest& request)
     if (!request.params[1].isNull())
         fVerbose = request.params[1].get_bool();
 
-    const CBlockIndex* pblockindex;
-    const CBlockIndex* tip;
-    {
-        LOCK(cs_main);
-        pblockindex = LookupBlockIndex(hash);
-        tip = ::ChainActive().Tip();
-    }
+    // Everything a header shows is readable under g_block_index_mutex, so
+    // this doesn't wait for cs_main.
+    boost::shared_lock<boost::shared_mutex> lock(g_block_index_mutex);
+    const CBlockIndex* pblockindex = LookupBlockIndexShared(hash);
+    const CBlockIndex* tip = ::ChainActive().Tip();
 
     if (!pblockindex) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
@@ -952,48 +1106,124 @@ static UniValue pruneblockchain(const JSONRPCRequest& request)
     return uint64_t(block->nHeight);
 }
 
+static CoinStatsHashType ParseHashType(const UniValue& param)
+{
+    const std::string hash_type_input = param.isNull() ? "hash_serialized_2" : param.get_str();
+
+    if (hash_type_input == "hash_serialized_2") {
+        return CoinStatsHashType::HASH_SERIALIZED;
+    } else if (hash_type_input == "muhash") {
+        return CoinStatsHashType::MUHASH;
+    } else if (hash_type_input == "none") {
+        return CoinStatsHashType::NONE;
+    } else {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hash_type_input));
+    }
+}
+
 static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
             RPCHelpMan{"gettxoutsetinfo",
                 "\nReturns statistics about the unspent transaction output set.\n"
-                "Note this call may take some time.\n",
-                {},
+                "Note this call may take some time, unless the statistics are read from -coinstatsindex.\n",
+                {
+                    {"hash_type", RPCArg::Type::STR, /* default */ "hash_serialized_2", "Which UTXO set hash should be calculated. Options: 'hash_serialized_2' (the legacy algorithm), 'muhash', 'none'."},
+                    {"hash_or_height", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "The block hash or height of the target block, only available with coinstatsindex and a hash_type other than 'hash_serialized_2'.", "", {"", "string or numeric"}},
+                },
                 RPCResult{
                     RPCResult::Type::OBJ, "", "",
                     {
-                        {RPCResult::Type::NUM, "height", "The current block height (index)"},
-                        {RPCResult::Type::STR_HEX, "bestblock", "The hash of the block at the tip of the chain"},
-                        {RPCResult::Type::NUM, "transactions", "The number of transactions with unspent outputs"},
+                        {RPCResult::Type::NUM, "height", "The block height (index) of the returned statistics"},
+                        {RPCResult::Type::STR_HEX, "bestblock", "The hash of the block at which these statistics are calculated"},
+                        {RPCResult::Type::NUM, "transactions", "The number of transactions with unspent outputs (not available when coinstatsindex is used)"},
                         {RPCResult::Type::NUM, "txouts", "The number of unspent transaction outputs"},
                         {RPCResult::Type::NUM, "bogosize", "A meaningless metric for UTXO set size"},
-                        {RPCResult::Type::STR_HEX, "hash_serialized_2", "The serialized hash"},
-                        {RPCResult::Type::NUM, "disk_size", "The estimated size of the chainstate on disk"},
+                        {RPCResult::Type::STR_HEX, "hash_serialized_2", "The serialized hash (only present if 'hash_serialized_2' hash_type is chosen)"},
+                        {RPCResult::Type::STR_HEX, "muhash", "The serialized hash (only present if 'muhash' hash_type is chosen)"},
+                        {RPCResult::Type::NUM, "disk_size", "The estimated size of the chainstate on disk (not available when coinstatsindex is used)"},
                         {RPCResult::Type::STR_AMOUNT, "total_amount", "The total amount"},
                     }},
                 RPCExamples{
                     HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", R"("none")")
+            + HelpExampleCli("gettxoutsetinfo", R"("muhash" 1000)")
+            + HelpExampleCli("gettxoutsetinfo", R"("muhash" '"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09"')")
             + HelpExampleRpc("gettxoutsetinfo", "")
+            + HelpExampleRpc("gettxoutsetinfo", R"("none")")
+            + HelpExampleRpc("gettxoutsetinfo", R"("muhash", 1000)")
                 },
             }.Check(request);
 
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
-    ::ChainstateActive().ForceFlushStateToDisk();
+    const CoinStatsHashType hash_type = ParseHashType(request.params[0]);
+
+    // Statistics at a given block can only be read from the index, which only maintains the MuHash.
+    const CBlockIndex* pindex = nullptr;
+    if (!request.params[1].isNull()) {
+        if (!g_coin_stats_index) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Querying specific block heights requires coinstatsindex");
+        }
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_serialized_2 hash type cannot be queried for a specific block");
+        }
+
+        LOCK(cs_main);
+        if (request.params[1].isNum()) {
+            const int height = request.params[1].get_int();
+            const int current_tip = ::ChainActive().Height();
+            if (height < 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is negative", height));
+            }
+            if (height > current_tip) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d after current tip %d", height, current_tip));
+            }
+            pindex = ::ChainActive()[height];
+        } else {
+            pindex = LookupBlockIndex(ParseHashV(request.params[1], "hash_or_height"));
+            if (!pindex) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+            }
+        }
+    }
+
+    bool from_index = false;
+    if (g_coin_stats_index && hash_type != CoinStatsHashType::HASH_SERIALIZED) {
+        g_coin_stats_index->BlockUntilSyncedToCurrentChain();
+        const CBlockIndex* target = pindex ? pindex : WITH_LOCK(cs_main, return ::ChainActive().Tip());
+        from_index = g_coin_stats_index->LookUpStats(target, stats);
+        if (!from_index && pindex) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("Unable to read UTXO set statistics of block %s; coinstatsindex may not be synced yet", pindex->GetBlockHash().GetHex()));
+        }
+    }
 
-    CCoinsView* coins_view = WITH_LOCK(cs_main, return &ChainstateActive().CoinsDB());
-    if (GetUTXOStats(coins_view, stats)) {
-        ret.pushKV("height", (int64_t)stats.nHeight);
-        ret.pushKV("bestblock", stats.hashBlock.GetHex());
+    // Without the index, or while it is still syncing, compute the statistics from the chainstate.
+    if (!from_index) {
+        ::ChainstateActive().ForceFlushStateToDisk();
+
+        CCoinsView* coins_view = WITH_LOCK(cs_main, return &ChainstateActive().CoinsDB());
+        if (!GetUTXOStats(coins_view, stats, hash_type)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        }
+    }
+
+    ret.pushKV("height", (int64_t)stats.nHeight);
+    ret.pushKV("bestblock", stats.hashBlock.GetHex());
+    if (!from_index) {
         ret.pushKV("transactions", (int64_t)stats.nTransactions);
-        ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
-        ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+    }
+    ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
+    ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+    if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
         ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+    } else if (hash_type == CoinStatsHashType::MUHASH) {
+        ret.pushKV("muhash", stats.hashSerialized.GetHex());
+    }
+    if (!from_index) {
         ret.pushKV("disk_size", stats.nDiskSize);
-        ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
-    } else {
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
     }
+    ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
     return ret;
 }
 
@@ -1166,6 +1396,30 @@ static void BIP9SoftForkDescPushBack(UniValue& softforks, const std::string &nam
     softforks.pushKV(name, rv);
 }
 
+static Mutex g_softforks_mutex;
+//! The softforks object of getblockchaininfo, which only changes with the tip, and the tip it was made for.
+static UniValue g_softforks GUARDED_BY(g_softforks_mutex);
+static uint256 g_softforks_tip GUARDED_BY(g_softforks_mutex);
+
+static UniValue SoftForksDesc(const TipSnapshot& tip) LOCKS_EXCLUDED(g_softforks_mutex, cs_main)
+{
+    LOCK(g_softforks_mutex);
+    if (g_softforks_tip != tip.hash || g_softforks.isNull()) {
+        LOCK(cs_main);
+        const Consensus::Params& consensusParams = Params().GetConsensus();
+        UniValue softforks(UniValue::VOBJ);
+        BuriedForkDescPushBack(softforks, "bip34", consensusParams.BIP34Height);
+        BuriedForkDescPushBack(softforks, "bip66", consensusParams.BIP66Height);
+        BuriedForkDescPushBack(softforks, "bip65", consensusParams.BIP65Height);
+        BuriedForkDescPushBack(softforks, "csv", consensusParams.CSVHeight);
+        BuriedForkDescPushBack(softforks, "segwit", consensusParams.SegwitHeight);
+        BIP9SoftForkDescPushBack(softforks, "testdummy", consensusParams, Consensus::DEPLOYMENT_TESTDUMMY);
+        g_softforks = softforks;
+        g_softforks_tip = ::ChainActive().Tip()->GetBlockHash();
+    }
+    return g_softforks;
+}
+
 UniValue getblockchaininfo(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getblockchaininfo",
@@ -1213,6 +1467,13 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
                                 {RPCResult::Type::BOOL, "active", "true if the rules are enforced for the mempool and the next block"},
                             }},
                         }},
+                        {RPCResult::Type::OBJ, "reorgcache", "statistics of the cache of recently connected blocks and their undo data (see -reorgcache)",
+                        {
+                            {RPCResult::Type::NUM, "hits", "number of block and undo data reads for disconnecting blocks served from memory"},
+                            {RPCResult::Type::NUM, "misses", "number of such reads that went to disk"},
+                            {RPCResult::Type::NUM, "blocks", "number of blocks currently cached"},
+                            {RPCResult::Type::NUM, "maxblocks", "configured number of blocks (0 = disabled)"},
+                        }},
                         {RPCResult::Type::STR, "warnings", "any network and blockchain warnings"},
                     }},
                 RPCExamples{
@@ -1221,23 +1482,24 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(cs_main);
-
-    const CBlockIndex* tip = ::ChainActive().Tip();
+    // Everything but the prune height comes from the tip snapshot and caches,
+    // so that frequent polling doesn't contend with validation for cs_main.
+    const std::shared_ptr<const TipSnapshot> tip = EnsureTipSnapshot();
     UniValue obj(UniValue::VOBJ);
     obj.pushKV("chain",                 Params().NetworkIDString());
-    obj.pushKV("blocks",                (int)::ChainActive().Height());
-    obj.pushKV("headers",               pindexBestHeader ? pindexBestHeader->nHeight : -1);
-    obj.pushKV("bestblockhash",         tip->GetBlockHash().GetHex());
-    obj.pushKV("difficulty",            (double)GetDifficulty(tip));
-    obj.pushKV("mediantime",            (int64_t)tip->GetMedianTimePast());
-    obj.pushKV("verificationprogress",  GuessVerificationProgress(Params().TxData(), tip));
+    obj.pushKV("blocks",                tip->height);
+    obj.pushKV("headers",               tip->header_height);
+    obj.pushKV("bestblockhash",         tip->hash.GetHex());
+    obj.pushKV("difficulty",            GetDifficulty(tip->bits));
+    obj.pushKV("mediantime",            tip->median_time);
+    obj.pushKV("verificationprogress",  tip->VerificationProgress(Params().TxData()));
     obj.pushKV("initialblockdownload",  ::ChainstateActive().IsInitialBlockDownload());
-    obj.pushKV("chainwork",             tip->nChainWork.GetHex());
+    obj.pushKV("chainwork",             tip->chain_work.GetHex());
     obj.pushKV("size_on_disk",          CalculateCurrentUsage());
     obj.pushKV("pruned",                fPruneMode);
     if (fPruneMode) {
-        const CBlockIndex* block = tip;
+        LOCK(cs_main);
+        const CBlockIndex* block = ::ChainActive().Tip();
         CHECK_NONFATAL(block);
         while (block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA)) {
             block = block->pprev;
@@ -1253,15 +1515,15 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
         }
     }
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    UniValue softforks(UniValue::VOBJ);
-    BuriedForkDescPushBack(softforks, "bip34", consensusParams.BIP34Height);
-    BuriedForkDescPushBack(softforks, "bip66", consensusParams.BIP66Height);
-    BuriedForkDescPushBack(softforks, "bip65", consensusParams.BIP65Height);
-    BuriedForkDescPushBack(softforks, "csv", consensusParams.CSVHeight);
-    BuriedForkDescPushBack(softforks, "segwit", consensusParams.SegwitHeight);
-    BIP9SoftForkDescPushBack(softforks, "testdummy", consensusParams, Consensus::DEPLOYMENT_TESTDUMMY);
-    obj.pushKV("softforks",             softforks);
+    obj.pushKV("softforks",             SoftForksDesc(*tip));
+
+    const ReorgCacheStats reorg_cache = GetReorgCacheStats();
+    UniValue reorg_cache_obj(UniValue::VOBJ);
+    reorg_cache_obj.pushKV("hits", reorg_cache.hits);
+    reorg_cache_obj.pushKV("misses", reorg_cache.misses);
+    reorg_cache_obj.pushKV("blocks", (uint64_t)reorg_cache.blocks);
+    reorg_cache_obj.pushKV("maxblocks", (uint64_t)reorg_cache.max_blocks);
+    obj.pushKV("reorgcache", reorg_cache_obj);
 
     obj.pushKV("warnings", GetWarnings(false));
     return obj;
@@ -1379,7 +1641,7 @@ static UniValue getchaintips(const JSONRPCRequest& request)
     return res;
 }
 
-UniValue MempoolInfoToJSON(const CTxMemPool& pool)
+UniValue MempoolInfoToJSON(const CTxMemPool& pool, bool histogram)
 {
     // Make sure this call is atomic in the pool.
     LOCK(pool.cs);
@@ -1392,6 +1654,18 @@ UniValue MempoolInfoToJSON(const CTxMemPool& pool)
     ret.pushKV("maxmempool", (int64_t) maxmempool);
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(pool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
+    if (histogram) {
+        UniValue buckets(UniValue::VARR);
+        for (const FeeHistogramBucket& bucket : pool.GetFeeHistogram()) {
+            UniValue entry(UniValue::VOBJ);
+            entry.pushKV("feerate", ValueFromAmount(bucket.min_feerate.GetFeePerK()));
+            entry.pushKV("count", bucket.count);
+            entry.pushKV("vsize", bucket.vsize);
+            entry.pushKV("fees", ValueFromAmount(bucket.fees));
+            buckets.push_back(entry);
+        }
+        ret.pushKV("histogram", buckets);
+    }
 
     return ret;
 }
@@ -1400,7 +1674,9 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getmempoolinfo",
                 "\nReturns details on the active state of the TX memory pool.\n",
-                {},
+                {
+                    {"histogram", RPCArg::Type::BOOL, /* default */ "false", "Include a histogram of the transactions by fee rate"},
+                },
                 RPCResult{
                     RPCResult::Type::OBJ, "", "",
                     {
@@ -1411,14 +1687,152 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM, "maxmempool", "Maximum memory usage for the mempool"},
                         {RPCResult::Type::STR_AMOUNT, "mempoolminfee", "Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee"},
                         {RPCResult::Type::STR_AMOUNT, "minrelaytxfee", "Current minimum relay fee for transactions"},
+                        {RPCResult::Type::ARR, "histogram", /* optional */ true, "Transactions by fee rate, in ranges of roughly logarithmic size (only with histogram)",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR_AMOUNT, "feerate", "The lowest fee rate of the range in " + CURRENCY_UNIT + "/kB; the next range's is the end of it"},
+                                {RPCResult::Type::NUM, "count", "The number of transactions paying a fee rate in the range"},
+                                {RPCResult::Type::NUM, "vsize", "The sum of their virtual sizes"},
+                                {RPCResult::Type::STR_AMOUNT, "fees", "The sum of their fees (not including prioritisetransaction deltas)"},
+                            }},
+                        }},
                     }},
                 RPCExamples{
                     HelpExampleCli("getmempoolinfo", "")
-            + HelpExampleRpc("getmempoolinfo", "")
+            + HelpExampleCli("getmempoolinfo", "true")
+            + HelpExampleRpc("getmempoolinfo", "true")
+                },
+            }.Check(request);
+
+    const bool histogram = !request.params[0].isNull() && request.params[0].get_bool();
+    return MempoolInfoToJSON(EnsureMemPool(), histogram);
+}
+
+static UniValue getcoinscacheinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getcoinscacheinfo",
+                "\nReturns statistics of the UTXO set cache (-dbcache) and of the layers below it, as of the last\n"
+                "connected block or cache flush, for sizing the cache.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "usage", "Memory used by the cache, in bytes"},
+                        {RPCResult::Type::NUM, "maxusage", "Size limit of the cache, in bytes"},
+                        {RPCResult::Type::NUM, "entries", "Coins in the cache"},
+                        {RPCResult::Type::OBJ, "cache", "Counters of the cache",
+                        {
+                            {RPCResult::Type::NUM, "hits", "Lookups answered by the cache"},
+                            {RPCResult::Type::NUM, "misses", "Lookups passed to the layers below"},
+                            {RPCResult::Type::NUM, "hitrate", "Share of the lookups that were hits"},
+                            {RPCResult::Type::NUM, "insertions", "Coins added to the cache"},
+                            {RPCResult::Type::NUM, "evictions", "Coins dropped from the cache by flushes"},
+                        }},
+                        {RPCResult::Type::OBJ, "background", "Coins being written to the database in the background (-dbbackgroundflush)",
+                        {
+                            {RPCResult::Type::NUM, "hits", "Lookups answered by coins still being written"},
+                        }},
+                        {RPCResult::Type::OBJ, "database", "The coin database",
+                        {
+                            {RPCResult::Type::NUM, "reads", "Coins looked up, including by prefetching threads"},
+                            {RPCResult::Type::NUM, "found", "Coins looked up that were there"},
+                        }},
+                        {RPCResult::Type::OBJ, "flushes", "Writes of the cache to the database",
+                        {
+                            {RPCResult::Type::NUM, "count", "Number of flushes"},
+                            {RPCResult::Type::NUM, "partial", "Number of flushes that kept recently used coins (-dbcacheretain)"},
+                            {RPCResult::Type::NUM_TIME, "lasttime", "When the last flush finished, in " + UNIX_EPOCH_TIME},
+                            {RPCResult::Type::NUM, "lastduration", "Duration of the last flush, in seconds"},
+                            {RPCResult::Type::NUM, "lastentries", "Coins in the cache before the last flush"},
+                            {RPCResult::Type::NUM, "lastusage", "Memory used by the cache before the last flush, in bytes"},
+                            {RPCResult::Type::NUM, "lastentriesafter", "Coins left in the cache by the last flush"},
+                        }},
+                        {RPCResult::Type::OBJ, "reusedistance", /* optional */ true, "Estimated hit rates of other cache sizes, only with -coinsreusesample",
+                        {
+                            {RPCResult::Type::NUM, "samplerate", "One in this many coins is followed"},
+                            {RPCResult::Type::NUM, "samples", "Sampled lookups"},
+                            {RPCResult::Type::NUM, "horizon", "Largest cache size, in coins, the estimate covers"},
+                            {RPCResult::Type::ARR, "sizes", "",
+                            {
+                                {RPCResult::Type::OBJ, "", "",
+                                {
+                                    {RPCResult::Type::NUM, "entries", "Cache size, in coins"},
+                                    {RPCResult::Type::NUM, "usage", "Approximate memory of that many coins at the current usage per coin, in bytes"},
+                                    {RPCResult::Type::NUM, "hitrate", "Estimated share of lookups an LRU cache of this size would answer"},
+                                }},
+                            }},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getcoinscacheinfo", "")
+            + HelpExampleRpc("getcoinscacheinfo", "")
                 },
             }.Check(request);
 
-    return MempoolInfoToJSON(EnsureMemPool());
+    const CoinsCacheStats stats = GetCoinsCacheStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("usage", (uint64_t)stats.usage);
+    ret.pushKV("maxusage", (uint64_t)stats.max_usage);
+    ret.pushKV("entries", (uint64_t)stats.entries);
+
+    UniValue cache(UniValue::VOBJ);
+    const uint64_t lookups = stats.tip.hits + stats.tip.misses;
+    cache.pushKV("hits", stats.tip.hits);
+    cache.pushKV("misses", stats.tip.misses);
+    cache.pushKV("hitrate", lookups ? (double)stats.tip.hits / lookups : 0.0);
+    cache.pushKV("insertions", stats.tip.insertions);
+    cache.pushKV("evictions", stats.tip.evictions);
+    ret.pushKV("cache", cache);
+
+    UniValue background(UniValue::VOBJ);
+    background.pushKV("hits", stats.flushing_hits);
+    ret.pushKV("background", background);
+
+    UniValue database(UniValue::VOBJ);
+    database.pushKV("reads", stats.db_reads);
+    database.pushKV("found", stats.db_found);
+    ret.pushKV("database", database);
+
+    UniValue flushes(UniValue::VOBJ);
+    flushes.pushKV("count", stats.flushes);
+    flushes.pushKV("partial", stats.partial_flushes);
+    flushes.pushKV("lasttime", stats.last_flush_time);
+    flushes.pushKV("lastduration", stats.last_flush_duration / 1e6);
+    flushes.pushKV("lastentries", (uint64_t)stats.last_flush_entries);
+    flushes.pushKV("lastusage", (uint64_t)stats.last_flush_usage);
+    flushes.pushKV("lastentriesafter", (uint64_t)stats.last_flush_entries_after);
+    ret.pushKV("flushes", flushes);
+
+    if (stats.reuse) {
+        const CoinsReuseSampler::Stats& reuse = *stats.reuse;
+        uint64_t samples = reuse.cold;
+        size_t last_bucket = 0;
+        for (size_t bucket = 0; bucket < reuse.reuses.size(); ++bucket) {
+            samples += reuse.reuses[bucket];
+            if (reuse.reuses[bucket]) last_bucket = bucket;
+        }
+        UniValue distance(UniValue::VOBJ);
+        distance.pushKV("samplerate", (uint64_t)reuse.rate);
+        distance.pushKV("samples", samples);
+        distance.pushKV("horizon", reuse.horizon);
+        // Bucket b holds the reuses at distances below 2^b, which a cache of 2^b coins would answer.
+        UniValue sizes(UniValue::VARR);
+        uint64_t hits = 0;
+        for (size_t bucket = 0; samples > 0 && bucket <= last_bucket; ++bucket) {
+            hits += reuse.reuses[bucket];
+            const uint64_t entries = uint64_t{1} << bucket;
+            if (entries < reuse.rate) continue;
+            UniValue size(UniValue::VOBJ);
+            size.pushKV("entries", entries);
+            size.pushKV("usage", stats.entries ? (uint64_t)((double)stats.usage / stats.entries * entries) : 0);
+            size.pushKV("hitrate", (double)hits / samples);
+            sizes.push_back(size);
+        }
+        distance.pushKV("sizes", sizes);
+        ret.pushKV("reusedistance", distance);
+    }
+    return ret;
 }
 
 static UniValue preciousblock(const JSONRPCRequest& request)
@@ -1552,6 +1966,9 @@ static UniValue getchaintxstats(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM, "window_tx_count", "The number of transactions in the window. Only returned if \"window_block_count\" is > 0"},
                         {RPCResult::Type::NUM, "window_interval", "The elapsed time in the window in seconds. Only returned if \"window_block_count\" is > 0"},
                         {RPCResult::Type::NUM, "txrate", "The average rate of transactions per second in the window. Only returned if \"window_interval\" is > 0"},
+                        {RPCResult::Type::NUM, "window_total_fees", "The fees paid in the window, in satoshis. Only returned with -blockstatsindex and if \"window_block_count\" is > 0"},
+                        {RPCResult::Type::NUM, "window_outputs_created", "The number of outputs created in the window. Only returned with -blockstatsindex and if \"window_block_count\" is > 0"},
+                        {RPCResult::Type::NUM, "window_outputs_spent", "The number of outputs spent in the window. Only returned with -blockstatsindex and if \"window_block_count\" is > 0"},
                     }},
                 RPCExamples{
                     HelpExampleCli("getchaintxstats", "")
@@ -1605,71 +2022,142 @@ static UniValue getchaintxstats(const JSONRPCRequest& request)
         if (nTimeDiff > 0) {
             ret.pushKV("txrate", ((double)nTxDiff) / nTimeDiff);
         }
+        // The totals of the chain at both ends of the window give those of the window itself.
+        BlockStatsTotals totals_end, totals_past;
+        if (g_block_stats_index && g_block_stats_index->LookUpTotals(pindex, totals_end) && g_block_stats_index->LookUpTotals(pindexPast, totals_past)) {
+            ret.pushKV("window_total_fees", totals_end.total_fees - totals_past.total_fees);
+            ret.pushKV("window_outputs_created", totals_end.outputs_created - totals_past.outputs_created);
+            ret.pushKV("window_outputs_spent", totals_end.outputs_spent - totals_past.outputs_spent);
+        }
     }
 
     return ret;
 }
 
-template<typename T>
-static T CalculateTruncatedMedian(std::vector<T>& scores)
-{
-    size_t size = scores.size();
-    if (size == 0) {
-        return 0;
-    }
+//! Most blocks a getblockstatsrange call may cover
+static constexpr int MAX_BLOCK_STATS_RANGE = 10000;
+//! Most threads a getblockstatsrange call uses
+static constexpr size_t MAX_BLOCK_STATS_THREADS = 16;
 
-    std::sort(scores.begin(), scores.end());
-    if (size % 2 == 0) {
-        return (scores[size / 2 - 1] + scores[size / 2]) / 2;
-    } else {
-        return scores[size / 2];
-    }
+/** The fields of a getblockstats result. */
+static std::vector<RPCResult> BlockStatsFields()
+{
+    return {
+        {RPCResult::Type::NUM, "avgfee", "Average fee in the block"},
+        {RPCResult::Type::NUM, "avgfeerate", "Average feerate (in satoshis per virtual byte)"},
+        {RPCResult::Type::NUM, "avgtxsize", "Average transaction size"},
+        {RPCResult::Type::STR_HEX, "blockhash", "The block hash (to check for potential reorgs)"},
+        {RPCResult::Type::ARR_FIXED, "feerate_percentiles", "Feerates at the 10th, 25th, 50th, 75th, and 90th percentile weight unit (in satoshis per virtual byte)",
+        {
+            {RPCResult::Type::NUM, "10th_percentile_feerate", "The 10th percentile feerate"},
+            {RPCResult::Type::NUM, "25th_percentile_feerate", "The 25th percentile feerate"},
+            {RPCResult::Type::NUM, "50th_percentile_feerate", "The 50th percentile feerate"},
+            {RPCResult::Type::NUM, "75th_percentile_feerate", "The 75th percentile feerate"},
+            {RPCResult::Type::NUM, "90th_percentile_feerate", "The 90th percentile feerate"},
+        }},
+        {RPCResult::Type::NUM, "height", "The height of the block"},
+        {RPCResult::Type::NUM, "ins", "The number of inputs (excluding coinbase)"},
+        {RPCResult::Type::NUM, "maxfee", "Maximum fee in the block"},
+        {RPCResult::Type::NUM, "maxfeerate", "Maximum feerate (in satoshis per virtual byte)"},
+        {RPCResult::Type::NUM, "maxtxsize", "Maximum transaction size"},
+        {RPCResult::Type::NUM, "medianfee", "Truncated median fee in the block"},
+        {RPCResult::Type::NUM, "mediantime", "The block median time past"},
+        {RPCResult::Type::NUM, "mediantxsize", "Truncated median transaction size"},
+        {RPCResult::Type::NUM, "minfee", "Minimum fee in the block"},
+        {RPCResult::Type::NUM, "minfeerate", "Minimum feerate (in satoshis per virtual byte)"},
+        {RPCResult::Type::NUM, "mintxsize", "Minimum transaction size"},
+        {RPCResult::Type::NUM, "outs", "The number of outputs"},
+        {RPCResult::Type::NUM, "subsidy", "The block subsidy"},
+        {RPCResult::Type::NUM, "swtotal_size", "Total size of all segwit transactions"},
+        {RPCResult::Type::NUM, "swtotal_weight", "Total weight of all segwit transactions divided by segwit scale factor (4)"},
+        {RPCResult::Type::NUM, "swtxs", "The number of segwit transactions"},
+        {RPCResult::Type::NUM, "time", "The block time"},
+        {RPCResult::Type::NUM, "total_out", "Total amount in all outputs (excluding coinbase and thus reward [ie subsidy + totalfee])"},
+        {RPCResult::Type::NUM, "total_size", "Total size of all non-coinbase transactions"},
+        {RPCResult::Type::NUM, "total_weight", "Total weight of all non-coinbase transactions divided by segwit scale factor (4)"},
+        {RPCResult::Type::NUM, "totalfee", "The fee total"},
+        {RPCResult::Type::NUM, "txs", "The number of transactions (excluding coinbase)"},
+        {RPCResult::Type::NUM, "utxo_increase", "The increase/decrease in the number of unspent outputs"},
+        {RPCResult::Type::NUM, "utxo_size_inc", "The increase/decrease in size for the utxo index (not discounting op_return and similar)"},
+    };
 }
 
-void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight)
+/** Format the statistics of a block (all of them if stats is empty). */
+static UniValue BlockStatsToJSON(const CBlockIndex* pindex, const CBlockStats& block_stats, const std::set<std::string>& stats)
 {
-    if (scores.empty()) {
-        return;
-    }
+    const bool do_all = stats.size() == 0; // Return everything if nothing selected (default)
+    const int64_t txs = block_stats.txs;
 
-    std::sort(scores.begin(), scores.end());
+    UniValue feerates_res(UniValue::VARR);
+    for (int64_t i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
+        feerates_res.push_back(block_stats.feerate_percentiles[i]);
+    }
 
-    // 10th, 25th, 50th, 75th, and 90th percentile weight units.
-    const double weights[NUM_GETBLOCKSTATS_PERCENTILES] = {
-        total_weight / 10.0, total_weight / 4.0, total_weight / 2.0, (total_weight * 3.0) / 4.0, (total_weight * 9.0) / 10.0
-    };
+    UniValue ret_all(UniValue::VOBJ);
+    ret_all.pushKV("avgfee", (txs > 1) ? block_stats.totalfee / (txs - 1) : 0);
+    ret_all.pushKV("avgfeerate", block_stats.total_weight ? (block_stats.totalfee * WITNESS_SCALE_FACTOR) / block_stats.total_weight : 0); // Unit: sat/vbyte
+    ret_all.pushKV("avgtxsize", (txs > 1) ? block_stats.total_size / (txs - 1) : 0);
+    ret_all.pushKV("blockhash", pindex->GetBlockHash().GetHex());
+    ret_all.pushKV("feerate_percentiles", feerates_res);
+    ret_all.pushKV("height", (int64_t)pindex->nHeight);
+    ret_all.pushKV("ins", block_stats.ins);
+    ret_all.pushKV("maxfee", block_stats.maxfee);
+    ret_all.pushKV("maxfeerate", block_stats.maxfeerate);
+    ret_all.pushKV("maxtxsize", block_stats.maxtxsize);
+    ret_all.pushKV("medianfee", block_stats.medianfee);
+    ret_all.pushKV("mediantime", pindex->GetMedianTimePast());
+    ret_all.pushKV("mediantxsize", block_stats.mediantxsize);
+    ret_all.pushKV("minfee", block_stats.minfee);
+    ret_all.pushKV("minfeerate", block_stats.minfeerate);
+    ret_all.pushKV("mintxsize", block_stats.mintxsize);
+    ret_all.pushKV("outs", block_stats.outs);
+    ret_all.pushKV("subsidy", GetBlockSubsidy(pindex->nHeight, Params().GetConsensus()));
+    ret_all.pushKV("swtotal_size", block_stats.swtotal_size);
+    ret_all.pushKV("swtotal_weight", block_stats.swtotal_weight);
+    ret_all.pushKV("swtxs", block_stats.swtxs);
+    ret_all.pushKV("time", pindex->GetBlockTime());
+    ret_all.pushKV("total_out", block_stats.total_out);
+    ret_all.pushKV("total_size", block_stats.total_size);
+    ret_all.pushKV("total_weight", block_stats.total_weight);
+    ret_all.pushKV("totalfee", block_stats.totalfee);
+    ret_all.pushKV("txs", txs);
+    ret_all.pushKV("utxo_increase", block_stats.outs - block_stats.ins);
+    ret_all.pushKV("utxo_size_inc", block_stats.utxo_size_inc);
 
-    int64_t next_percentile_index = 0;
-    int64_t cumulative_weight = 0;
-    for (const auto& element : scores) {
-        cumulative_weight += element.second;
-        while (next_percentile_index < NUM_GETBLOCKSTATS_PERCENTILES && cumulative_weight >= weights[next_percentile_index]) {
-            result[next_percentile_index] = element.first;
-            ++next_percentile_index;
-        }
+    if (do_all) {
+        return ret_all;
     }
 
-    // Fill any remaining percentiles with the last value.
-    for (int64_t i = next_percentile_index; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
-        result[i] = scores.back().first;
+    UniValue ret(UniValue::VOBJ);
+    for (const std::string& stat : stats) {
+        const UniValue& value = ret_all[stat];
+        if (value.isNull()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid selected statistic %s", stat));
+        }
+        ret.pushKV(stat, value);
     }
+    return ret;
 }
 
-template<typename T>
-static inline bool SetHasKeys(const std::set<T>& set) {return false;}
-template<typename T, typename Tk, typename... Args>
-static inline bool SetHasKeys(const std::set<T>& set, const Tk& key, const Args&... args)
+/** Parse the stats argument of getblockstats. */
+static std::set<std::string> ParseBlockStatsSelection(const UniValue& param)
 {
-    return (set.count(key) != 0) || SetHasKeys(set, args...);
+    std::set<std::string> stats;
+    if (!param.isNull()) {
+        const UniValue stats_univalue = param.get_array();
+        for (unsigned int i = 0; i < stats_univalue.size(); i++) {
+            const std::string stat = stats_univalue[i].get_str();
+            stats.insert(stat);
+        }
+    }
+    return stats;
 }
 
-// outpoint (needed for the utxo index) + nHeight + fCoinBase
-static constexpr size_t PER_UTXO_OVERHEAD = sizeof(COutPoint) + sizeof(uint32_t) + sizeof(bool);
-
 static UniValue getblockstats(const JSONRPCRequest& request)
 {
     RPCHelpMan{"getblockstats",
                 "\nCompute per block statistics for a given window. All amounts are in satoshis.\n"
+                "The statistics are read from -blockstatsindex when it has them.\n"
                 "It won't work for some heights with pruning.\n",
                 {
                     {"hash_or_height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The block hash or height of the target block", "", {"", "string or numeric"}},
@@ -1680,46 +2168,7 @@ static UniValue getblockstats(const JSONRPCRequest& request)
                         },
                         "stats"},
                 },
-                RPCResult{
-            RPCResult::Type::OBJ, "", "",
-            {
-                {RPCResult::Type::NUM, "avgfee", "Average fee in the block"},
-                {RPCResult::Type::NUM, "avgfeerate", "Average feerate (in satoshis per virtual byte)"},
-                {RPCResult::Type::NUM, "avgtxsize", "Average transaction size"},
-                {RPCResult::Type::STR_HEX, "blockhash", "The block hash (to check for potential reorgs)"},
-                {RPCResult::Type::ARR_FIXED, "feerate_percentiles", "Feerates at the 10th, 25th, 50th, 75th, and 90th percentile weight unit (in satoshis per virtual byte)",
-                {
-                    {RPCResult::Type::NUM, "10th_percentile_feerate", "The 10th percentile feerate"},
-                    {RPCResult::Type::NUM, "25th_percentile_feerate", "The 25th percentile feerate"},
-                    {RPCResult::Type::NUM, "50th_percentile_feerate", "The 50th percentile feerate"},
-                    {RPCResult::Type::NUM, "75th_percentile_feerate", "The 75th percentile feerate"},
-                    {RPCResult::Type::NUM, "90th_percentile_feerate", "The 90th percentile feerate"},
-                }},
-                {RPCResult::Type::NUM, "height", "The height of the block"},
-                {RPCResult::Type::NUM, "ins", "The number of inputs (excluding coinbase)"},
-                {RPCResult::Type::NUM, "maxfee", "Maximum fee in the block"},
-                {RPCResult::Type::NUM, "maxfeerate", "Maximum feerate (in satoshis per virtual byte)"},
-                {RPCResult::Type::NUM, "maxtxsize", "Maximum transaction size"},
-                {RPCResult::Type::NUM, "medianfee", "Truncated median fee in the block"},
-                {RPCResult::Type::NUM, "mediantime", "The block median time past"},
-                {RPCResult::Type::NUM, "mediantxsize", "Truncated median transaction size"},
-                {RPCResult::Type::NUM, "minfee", "Minimum fee in the block"},
-                {RPCResult::Type::NUM, "minfeerate", "Minimum feerate (in satoshis per virtual byte)"},
-                {RPCResult::Type::NUM, "mintxsize", "Minimum transaction size"},
-                {RPCResult::Type::NUM, "outs", "The number of outputs"},
-                {RPCResult::Type::NUM, "subsidy", "The block subsidy"},
-                {RPCResult::Type::NUM, "swtotal_size", "Total size of all segwit transactions"},
-                {RPCResult::Type::NUM, "swtotal_weight", "Total weight of all segwit transactions divided by segwit scale factor (4)"},
-                {RPCResult::Type::NUM, "swtxs", "The number of segwit transactions"},
-                {RPCResult::Type::NUM, "time", "The block time"},
-                {RPCResult::Type::NUM, "total_out", "Total amount in all outputs (excluding coinbase and thus reward [ie subsidy + totalfee])"},
-                {RPCResult::Type::NUM, "total_size", "Total size of all non-coinbase transactions"},
-                {RPCResult::Type::NUM, "total_weight", "Total weight of all non-coinbase transactions divided by segwit scale factor (4)"},
-                {RPCResult::Type::NUM, "totalfee", "The fee total"},
-                {RPCResult::Type::NUM, "txs", "The number of transactions (excluding coinbase)"},
-                {RPCResult::Type::NUM, "utxo_increase", "The increase/decrease in the number of unspent outputs"},
-                {RPCResult::Type::NUM, "utxo_size_inc", "The increase/decrease in size for the utxo index (not discounting op_return and similar)"},
-            }},
+                RPCResult{RPCResult::Type::OBJ, "", "", BlockStatsFields()},
                 RPCExamples{
                     HelpExampleCli("getblockstats", "1000 '[\"minfeerate\",\"avgfeerate\"]'")
             + HelpExampleRpc("getblockstats", "1000 '[\"minfeerate\",\"avgfeerate\"]'")
@@ -1753,173 +2202,118 @@ static UniValue getblockstats(const JSONRPCRequest& request)
 
     CHECK_NONFATAL(pindex != nullptr);
 
-    std::set<std::string> stats;
-    if (!request.params[1].isNull()) {
-        const UniValue stats_univalue = request.params[1].get_array();
-        for (unsigned int i = 0; i < stats_univalue.size(); i++) {
-            const std::string stat = stats_univalue[i].get_str();
-            stats.insert(stat);
-        }
-    }
+    const std::set<std::string> stats = ParseBlockStatsSelection(request.params[1]);
 
-    const CBlock block = GetBlockChecked(pindex);
-    const CBlockUndo blockUndo = GetUndoChecked(pindex);
-
-    const bool do_all = stats.size() == 0; // Calculate everything if nothing selected (default)
-    const bool do_mediantxsize = do_all || stats.count("mediantxsize") != 0;
-    const bool do_medianfee = do_all || stats.count("medianfee") != 0;
-    const bool do_feerate_percentiles = do_all || stats.count("feerate_percentiles") != 0;
-    const bool loop_inputs = do_all || do_medianfee || do_feerate_percentiles ||
-        SetHasKeys(stats, "utxo_size_inc", "totalfee", "avgfee", "avgfeerate", "minfee", "maxfee", "minfeerate", "maxfeerate");
-    const bool loop_outputs = do_all || loop_inputs || stats.count("total_out");
-    const bool do_calculate_size = do_mediantxsize ||
-        SetHasKeys(stats, "total_size", "avgtxsize", "mintxsize", "maxtxsize", "swtotal_size");
-    const bool do_calculate_weight = do_all || SetHasKeys(stats, "total_weight", "avgfeerate", "swtotal_weight", "avgfeerate", "feerate_percentiles", "minfeerate", "maxfeerate");
-    const bool do_calculate_sw = do_all || SetHasKeys(stats, "swtxs", "swtotal_size", "swtotal_weight");
-
-    CAmount maxfee = 0;
-    CAmount maxfeerate = 0;
-    CAmount minfee = MAX_MONEY;
-    CAmount minfeerate = MAX_MONEY;
-    CAmount total_out = 0;
-    CAmount totalfee = 0;
-    int64_t inputs = 0;
-    int64_t maxtxsize = 0;
-    int64_t mintxsize = MAX_BLOCK_SERIALIZED_SIZE;
-    int64_t outputs = 0;
-    int64_t swtotal_size = 0;
-    int64_t swtotal_weight = 0;
-    int64_t swtxs = 0;
-    int64_t total_size = 0;
-    int64_t total_weight = 0;
-    int64_t utxo_size_inc = 0;
-    std::vector<CAmount> fee_array;
-    std::vector<std::pair<CAmount, int64_t>> feerate_array;
-    std::vector<int64_t> txsize_array;
-
-    for (size_t i = 0; i < block.vtx.size(); ++i) {
-        const auto& tx = block.vtx.at(i);
-        outputs += tx->vout.size();
-
-        CAmount tx_total_out = 0;
-        if (loop_outputs) {
-            for (const CTxOut& out : tx->vout) {
-                tx_total_out += out.nValue;
-                utxo_size_inc += GetSerializeSize(out, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
-            }
-        }
+    CBlockStats block_stats;
+    if (!g_block_stats_index || !g_block_stats_index->LookUpStats(pindex, block_stats)) {
+        const CBlock block = GetBlockChecked(pindex);
+        const CBlockUndo blockUndo = GetUndoChecked(pindex);
+        CHECK_NONFATAL(ComputeBlockStats(block, blockUndo, block_stats));
+    }
 
-        if (tx->IsCoinBase()) {
-            continue;
-        }
+    return BlockStatsToJSON(pindex, block_stats, stats);
+}
 
-        inputs += tx->vin.size(); // Don't count coinbase's fake input
-        total_out += tx_total_out; // Don't count coinbase reward
+static UniValue getblockstatsrange(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"getblockstatsrange",
+                "\nCompute the per block statistics of getblockstats for a range of heights of the active chain.\n"
+                "The blocks are read and evaluated on several threads at once. All amounts are in satoshis.\n"
+                "It won't work for some heights with pruning.\n",
+                {
+                    {"start", RPCArg::Type::NUM, RPCArg::Optional::NO, "The height of the first block"},
+                    {"end", RPCArg::Type::NUM, RPCArg::Optional::NO, strprintf("The height of the last block, at most %d blocks after start", MAX_BLOCK_STATS_RANGE - 1)},
+                    {"stats", RPCArg::Type::ARR, /* default */ "all values", "Values to plot (see getblockstats)",
+                        {
+                            {"height", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "Selected statistic"},
+                            {"time", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "Selected statistic"},
+                        },
+                        "stats"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "The statistics of each block, by increasing height",
+                    {
+                        {RPCResult::Type::OBJ, "", "", BlockStatsFields()},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getblockstatsrange", "1000 1999 '[\"height\",\"avgfeerate\"]'")
+            + HelpExampleRpc("getblockstatsrange", "1000, 1999, [\"height\",\"avgfeerate\"]")
+                },
+    }.Check(request);
 
-        int64_t tx_size = 0;
-        if (do_calculate_size) {
+    const int start = request.params[0].get_int();
+    const int end = request.params[1].get_int();
+    const std::set<std::string> stats = ParseBlockStatsSelection(request.params[2]);
 
-            tx_size = tx->GetTotalSize();
-            if (do_mediantxsize) {
-                txsize_array.push_back(tx_size);
-            }
-            maxtxsize = std::max(maxtxsize, tx_size);
-            mintxsize = std::min(mintxsize, tx_size);
-            total_size += tx_size;
+    std::vector<const CBlockIndex*> blocks;
+    {
+        LOCK(cs_main);
+        const int current_tip = ::ChainActive().Height();
+        if (start < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Start height %d is negative", start));
         }
-
-        int64_t weight = 0;
-        if (do_calculate_weight) {
-            weight = GetTransactionWeight(*tx);
-            total_weight += weight;
+        if (end < start) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("End height %d before start height %d", end, start));
         }
-
-        if (do_calculate_sw && tx->HasWitness()) {
-            ++swtxs;
-            swtotal_size += tx_size;
-            swtotal_weight += weight;
+        if (end > current_tip) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("End height %d after current tip %d", end, current_tip));
         }
-
-        if (loop_inputs) {
-            CAmount tx_total_in = 0;
-            const auto& txundo = blockUndo.vtxundo.at(i - 1);
-            for (const Coin& coin: txundo.vprevout) {
-                const CTxOut& prevoutput = coin.out;
-
-                tx_total_in += prevoutput.nValue;
-                utxo_size_inc -= GetSerializeSize(prevoutput, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
-            }
-
-            CAmount txfee = tx_total_in - tx_total_out;
-            CHECK_NONFATAL(MoneyRange(txfee));
-            if (do_medianfee) {
-                fee_array.push_back(txfee);
-            }
-            maxfee = std::max(maxfee, txfee);
-            minfee = std::min(minfee, txfee);
-            totalfee += txfee;
-
-            // New feerate uses satoshis per virtual byte instead of per serialized byte
-            CAmount feerate = weight ? (txfee * WITNESS_SCALE_FACTOR) / weight : 0;
-            if (do_feerate_percentiles) {
-                feerate_array.emplace_back(std::make_pair(feerate, weight));
-            }
-            maxfeerate = std::max(maxfeerate, feerate);
-            minfeerate = std::min(minfeerate, feerate);
+        if (end - start >= MAX_BLOCK_STATS_RANGE) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Range of %d blocks is larger than %d", end - start + 1, MAX_BLOCK_STATS_RANGE));
+        }
+        for (int height = start; height <= end; ++height) {
+            blocks.push_back(::ChainActive()[height]);
         }
     }
 
-    CAmount feerate_percentiles[NUM_GETBLOCKSTATS_PERCENTILES] = { 0 };
-    CalculatePercentilesByWeight(feerate_percentiles, feerate_array, total_weight);
-
-    UniValue feerates_res(UniValue::VARR);
-    for (int64_t i = 0; i < NUM_GETBLOCKSTATS_PERCENTILES; i++) {
-        feerates_res.push_back(feerate_percentiles[i]);
-    }
-
-    UniValue ret_all(UniValue::VOBJ);
-    ret_all.pushKV("avgfee", (block.vtx.size() > 1) ? totalfee / (block.vtx.size() - 1) : 0);
-    ret_all.pushKV("avgfeerate", total_weight ? (totalfee * WITNESS_SCALE_FACTOR) / total_weight : 0); // Unit: sat/vbyte
-    ret_all.pushKV("avgtxsize", (block.vtx.size() > 1) ? total_size / (block.vtx.size() - 1) : 0);
-    ret_all.pushKV("blockhash", pindex->GetBlockHash().GetHex());
-    ret_all.pushKV("feerate_percentiles", feerates_res);
-    ret_all.pushKV("height", (int64_t)pindex->nHeight);
-    ret_all.pushKV("ins", inputs);
-    ret_all.pushKV("maxfee", maxfee);
-    ret_all.pushKV("maxfeerate", maxfeerate);
-    ret_all.pushKV("maxtxsize", maxtxsize);
-    ret_all.pushKV("medianfee", CalculateTruncatedMedian(fee_array));
-    ret_all.pushKV("mediantime", pindex->GetMedianTimePast());
-    ret_all.pushKV("mediantxsize", CalculateTruncatedMedian(txsize_array));
-    ret_all.pushKV("minfee", (minfee == MAX_MONEY) ? 0 : minfee);
-    ret_all.pushKV("minfeerate", (minfeerate == MAX_MONEY) ? 0 : minfeerate);
-    ret_all.pushKV("mintxsize", mintxsize == MAX_BLOCK_SERIALIZED_SIZE ? 0 : mintxsize);
-    ret_all.pushKV("outs", outputs);
-    ret_all.pushKV("subsidy", GetBlockSubsidy(pindex->nHeight, Params().GetConsensus()));
-    ret_all.pushKV("swtotal_size", swtotal_size);
-    ret_all.pushKV("swtotal_weight", swtotal_weight);
-    ret_all.pushKV("swtxs", swtxs);
-    ret_all.pushKV("time", pindex->GetBlockTime());
-    ret_all.pushKV("total_out", total_out);
-    ret_all.pushKV("total_size", total_size);
-    ret_all.pushKV("total_weight", total_weight);
-    ret_all.pushKV("totalfee", totalfee);
-    ret_all.pushKV("txs", (int64_t)block.vtx.size());
-    ret_all.pushKV("utxo_increase", outputs - inputs);
-    ret_all.pushKV("utxo_size_inc", utxo_size_inc);
-
-    if (do_all) {
-        return ret_all;
-    }
-
-    UniValue ret(UniValue::VOBJ);
-    for (const std::string& stat : stats) {
-        const UniValue& value = ret_all[stat];
-        if (value.isNull()) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Invalid selected statistic %s", stat));
+    // Each thread, including this one, takes the next block that hasn't been
+    // started yet, reading it and its undo data without holding cs_main.
+    std::vector<UniValue> results(blocks.size());
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    auto worker = [&] {
+        for (size_t i = next++; i < blocks.size() && !failed; i = next++) {
+            try {
+                CBlockStats block_stats;
+                if (!g_block_stats_index || !g_block_stats_index->LookUpStats(blocks[i], block_stats)) {
+                    CBlock block;
+                    CBlockUndo blockUndo;
+                    if (WITH_LOCK(cs_main, return IsBlockPruned(blocks[i]))) {
+                        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Block %d not available (pruned data)", blocks[i]->nHeight));
+                    }
+                    if (!ReadBlockFromDisk(block, blocks[i], Params().GetConsensus())) {
+                        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Block %d not found on disk", blocks[i]->nHeight));
+                    }
+                    if (blocks[i]->nHeight > 0 && !UndoReadFromDisk(blockUndo, blocks[i])) {
+                        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Can't read undo data of block %d from disk", blocks[i]->nHeight));
+                    }
+                    CHECK_NONFATAL(ComputeBlockStats(block, blockUndo, block_stats));
+                }
+                results[i] = BlockStatsToJSON(blocks[i], block_stats, stats);
+            } catch (...) {
+                // Keep the first error, the other threads stop at their next block
+                if (!failed.exchange(true)) error = std::current_exception();
+            }
         }
-        ret.pushKV(stat, value);
-    }
+    };
+    const size_t num_threads = std::min<size_t>(std::max(GetNumCores(), 1), std::min<size_t>(blocks.size(), MAX_BLOCK_STATS_THREADS));
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back([&worker, i] {
+            util::ThreadRename(strprintf("blockstats.%i", i));
+            worker();
+        });
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (error) std::rethrow_exception(error);
+
+    UniValue ret(UniValue::VARR);
+    ret.push_backV(results);
     return ret;
 }
 
@@ -1948,14 +2342,51 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
-//! Search for a given set of pubkey scripts
-bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results) {
-    scan_progress = 0;
+//! Maximum number of threads scantxoutset splits the coins database between
+static constexpr int MAX_SCAN_THREADS = 16;
+
+//! Hashes scripts with a random SipHash key
+class ScriptHasher
+{
+private:
+    const uint64_t m_k0{GetRand(std::numeric_limits<uint64_t>::max())};
+    const uint64_t m_k1{GetRand(std::numeric_limits<uint64_t>::max())};
+
+public:
+    size_t operator()(const CScript& script) const
+    {
+        return CSipHasher(m_k0, m_k1).Write(script.data(), script.size()).Finalize();
+    }
+};
+
+using ScriptSet = std::unordered_set<CScript, ScriptHasher>;
+
+//! The first two bytes of a txid, which the coins database is sorted by
+static uint32_t TxidPrefix(const uint256& txid)
+{
+    return 0x100 * *txid.begin() + *(txid.begin() + 1);
+}
+
+//! Search a range of the coins database for a given set of pubkey scripts.
+//! The range starts at the cursor and ends before the first txid whose
+//! TxidPrefix() is end_prefix. The prefixes passed are added to
+//! scanned_prefixes, out of the 65536 of the whole database.
+bool FindScriptPubKey(std::atomic<int>& scan_progress, std::atomic<uint32_t>& scanned_prefixes, const std::atomic<bool>& should_abort,
+                      int64_t& count, CCoinsViewCursor* cursor, uint32_t start_prefix, uint32_t end_prefix,
+                      const ScriptSet& needles, std::map<COutPoint, Coin>& out_results)
+{
     count = 0;
+    uint32_t reported = start_prefix;
+    auto report = [&](uint32_t prefix) {
+        const uint32_t total = scanned_prefixes += prefix - reported;
+        reported = prefix;
+        scan_progress = (int)(total * 100.0 / 65536.0 + 0.5);
+    };
     while (cursor->Valid()) {
         COutPoint key;
         Coin coin;
         if (!cursor->GetKey(key) || !cursor->GetValue(coin)) return false;
+        if (TxidPrefix(key.hash) >= end_prefix) break;
         if (++count % 8192 == 0) {
             if (should_abort) {
                 // allow to abort the scan via the abort reference
@@ -1964,15 +2395,14 @@ bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>&
         }
         if (count % 256 == 0) {
             // update progress reference every 256 item
-            uint32_t high = 0x100 * *key.hash.begin() + *(key.hash.begin() + 1);
-            scan_progress = (int)(high * 100.0 / 65536.0 + 0.5);
+            report(TxidPrefix(key.hash));
         }
         if (needles.count(coin.out.scriptPubKey)) {
             out_results.emplace(key, coin);
         }
         cursor->Next();
     }
-    scan_progress = 100;
+    report(end_prefix);
     return true;
 }
 
@@ -2095,7 +2525,7 @@ UniValue scantxoutset(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_MISC_ERROR, "scanobjects argument is required for the start action");
         }
 
-        std::set<CScript> needles;
+        ScriptSet needles;
         std::map<CScript, std::string> descriptors;
         CAmount total_in = 0;
 
@@ -2116,18 +2546,58 @@ UniValue scantxoutset(const JSONRPCRequest& request)
         std::map<COutPoint, Coin> coins;
         g_should_abort_scan = false;
         g_scan_progress = 0;
-        int64_t count = 0;
-        std::unique_ptr<CCoinsViewCursor> pcursor;
+        // Each thread scans its own range of txid prefixes with its own cursor.
+        const int num_threads = std::max(1, std::min(GetNumCores(), MAX_SCAN_THREADS));
+        std::vector<std::unique_ptr<CCoinsViewCursor>> cursors(num_threads);
+        std::vector<uint32_t> range_starts(num_threads + 1);
         CBlockIndex* tip;
         {
             LOCK(cs_main);
             ::ChainstateActive().ForceFlushStateToDisk();
-            pcursor = std::unique_ptr<CCoinsViewCursor>(::ChainstateActive().CoinsDB().Cursor());
-            CHECK_NONFATAL(pcursor);
+            // Cursors iterate over the database as it was when they were
+            // created, so all of them see the same coins.
+            for (int i = 0; i <= num_threads; ++i) {
+                range_starts[i] = 65536 * i / num_threads;
+            }
+            for (int i = 0; i < num_threads; ++i) {
+                uint256 start;
+                *start.begin() = range_starts[i] >> 8;
+                *(start.begin() + 1) = range_starts[i] & 0xff;
+                cursors[i].reset(::ChainstateActive().CoinsDB().Cursor(COutPoint(start, 0)));
+                CHECK_NONFATAL(cursors[i]);
+            }
             tip = ::ChainActive().Tip();
             CHECK_NONFATAL(tip);
         }
-        bool res = FindScriptPubKey(g_scan_progress, g_should_abort_scan, count, pcursor.get(), needles, coins);
+        std::vector<int64_t> counts(num_threads, 0);
+        std::vector<std::map<COutPoint, Coin>> range_coins(num_threads);
+        std::atomic<uint32_t> scanned_prefixes{0};
+        std::atomic<bool> failed{false};
+        auto scan_range = [&](int i) {
+            if (!FindScriptPubKey(g_scan_progress, scanned_prefixes, g_should_abort_scan, counts[i], cursors[i].get(),
+                                  range_starts[i], range_starts[i + 1], needles, range_coins[i])) {
+                failed = true;
+            }
+            cursors[i].reset();
+        };
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads - 1);
+        for (int i = 1; i < num_threads; ++i) {
+            threads.emplace_back([&scan_range, i] {
+                util::ThreadRename(strprintf("scantxoutset.%i", i));
+                scan_range(i);
+            });
+        }
+        scan_range(0);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        const bool res = !failed;
+        int64_t count = 0;
+        for (int i = 0; i < num_threads; ++i) {
+            count += counts[i];
+            coins.insert(range_coins[i].begin(), range_coins[i].end());
+        }
         result.pushKV("success", res);
         result.pushKV("txouts", count);
         result.pushKV("height", tip->nHeight);
@@ -2158,6 +2628,240 @@ UniValue scantxoutset(const JSONRPCRequest& request)
     return result;
 }
 
+/** Return the address index after waiting for it to process the pending notifications. */
+static const AddressIndex& EnsureAddressIndex()
+{
+    if (!g_addressindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index is not enabled. Use -addressindex to enable it.");
+    }
+    if (!g_addressindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index is still in the process of being built.");
+    }
+    return *g_addressindex;
+}
+
+static uint256 ParseIndexedAddress(const UniValue& param)
+{
+    const CTxDestination dest = DecodeDestination(param.get_str());
+    if (!IsValidDestination(dest)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address: " + param.get_str());
+    }
+    return AddressIndex::GetScriptHash(GetScriptForDestination(dest));
+}
+
+static std::vector<AddressOutput> FindAddressOutputs(const JSONRPCRequest& request, int start_height, int end_height, bool unspent_only)
+{
+    const uint256 script_hash = ParseIndexedAddress(request.params[0]);
+    const AddressIndex& index = EnsureAddressIndex();
+    std::vector<AddressOutput> outputs;
+    if (!index.FindOutputs(script_hash, start_height, end_height, unspent_only, outputs)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the address index");
+    }
+    return outputs;
+}
+
+static UniValue getaddresshistory(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getaddresshistory",
+                "\nReturn the outputs of the active chain paying to an address, and the inputs spending them.\n"
+                "Requires -addressindex. Mempool transactions are not included.\n",
+                {
+                    {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "The address"},
+                    {"start_height", RPCArg::Type::NUM, /* default */ "0", "Ignore outputs created below this height"},
+                    {"end_height", RPCArg::Type::NUM, /* default */ "the tip height", "Ignore outputs created above this height"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "The outputs, ordered by the height of the block creating them",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR_HEX, "txid", "The transaction id"},
+                            {RPCResult::Type::NUM, "vout", "The output number"},
+                            {RPCResult::Type::NUM, "height", "The height of the block creating the output"},
+                            {RPCResult::Type::STR_AMOUNT, "amount", "The output value in " + CURRENCY_UNIT},
+                            {RPCResult::Type::OBJ, "spent", /* optional */ true, "Only if the output is spent",
+                            {
+                                {RPCResult::Type::STR_HEX, "txid", "The spending transaction id"},
+                                {RPCResult::Type::NUM, "vin", "The input number in the spending transaction"},
+                                {RPCResult::Type::NUM, "height", "The height of the block spending the output"},
+                            }},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getaddresshistory", "\"" + EXAMPLE_ADDRESS[0] + "\"") +
+                    HelpExampleCli("getaddresshistory", "\"" + EXAMPLE_ADDRESS[0] + "\" 1000 2000") +
+                    HelpExampleRpc("getaddresshistory", "\"" + EXAMPLE_ADDRESS[0] + "\", 1000, 2000")
+                }
+            }.Check(request);
+
+    const int start_height = request.params[1].isNull() ? 0 : request.params[1].get_int();
+    const int end_height = request.params[2].isNull() ? std::numeric_limits<int>::max() : request.params[2].get_int();
+    if (start_height < 0 || end_height < start_height) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const AddressOutput& output : FindAddressOutputs(request, start_height, end_height, /* unspent_only */ false)) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", output.txid.GetHex());
+        entry.pushKV("vout", (int64_t)output.vout);
+        entry.pushKV("height", output.height);
+        entry.pushKV("amount", ValueFromAmount(output.value));
+        if (output.IsSpent()) {
+            UniValue spent(UniValue::VOBJ);
+            spent.pushKV("txid", output.spent_txid.GetHex());
+            spent.pushKV("vin", (int64_t)output.spent_vin);
+            spent.pushKV("height", output.spent_height);
+            entry.pushKV("spent", spent);
+        }
+        result.push_back(entry);
+    }
+    return result;
+}
+
+static UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getaddressutxos",
+                "\nReturn the unspent outputs of the active chain paying to an address.\n"
+                "Requires -addressindex. Mempool transactions are not taken into account.\n",
+                {
+                    {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "The address"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "The unspent outputs, ordered by the height of the block creating them",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR_HEX, "txid", "The transaction id"},
+                            {RPCResult::Type::NUM, "vout", "The output number"},
+                            {RPCResult::Type::NUM, "height", "The height of the block creating the output"},
+                            {RPCResult::Type::STR_AMOUNT, "amount", "The output value in " + CURRENCY_UNIT},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getaddressutxos", "\"" + EXAMPLE_ADDRESS[0] + "\"") +
+                    HelpExampleRpc("getaddressutxos", "\"" + EXAMPLE_ADDRESS[0] + "\"")
+                }
+            }.Check(request);
+
+    UniValue result(UniValue::VARR);
+    for (const AddressOutput& output : FindAddressOutputs(request, 0, std::numeric_limits<int>::max(), /* unspent_only */ true)) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", output.txid.GetHex());
+        entry.pushKV("vout", (int64_t)output.vout);
+        entry.pushKV("height", output.height);
+        entry.pushKV("amount", ValueFromAmount(output.value));
+        result.push_back(entry);
+    }
+    return result;
+}
+
+static UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getaddressbalance",
+                "\nReturn the balance of an address in the active chain.\n"
+                "Requires -addressindex. Mempool transactions are not taken into account.\n",
+                {
+                    {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "The address"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::STR_AMOUNT, "balance", "The sum of the unspent outputs paying to the address"},
+                        {RPCResult::Type::STR_AMOUNT, "received", "The sum of all outputs paying to the address"},
+                        {RPCResult::Type::NUM, "utxos", "The number of unspent outputs"},
+                        {RPCResult::Type::NUM, "outputs", "The number of outputs"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getaddressbalance", "\"" + EXAMPLE_ADDRESS[0] + "\"") +
+                    HelpExampleRpc("getaddressbalance", "\"" + EXAMPLE_ADDRESS[0] + "\"")
+                }
+            }.Check(request);
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    int64_t utxos = 0;
+    const std::vector<AddressOutput> outputs = FindAddressOutputs(request, 0, std::numeric_limits<int>::max(), /* unspent_only */ false);
+    for (const AddressOutput& output : outputs) {
+        received += output.value;
+        if (!output.IsSpent()) {
+            balance += output.value;
+            ++utxos;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("balance", ValueFromAmount(balance));
+    result.pushKV("received", ValueFromAmount(received));
+    result.pushKV("utxos", utxos);
+    result.pushKV("outputs", (int64_t)outputs.size());
+    return result;
+}
+
+static UniValue getspendingtx(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getspendingtx",
+                "\nReturn the transaction of the active chain spending an output.\n"
+                "Requires -spentindex. Mempool transactions are not included.\n",
+                {
+                    {"txid", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The transaction id of the output"},
+                    {"n", RPCArg::Type::NUM, RPCArg::Optional::NO, "The output number"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::STR_HEX, "txid", "The spending transaction id"},
+                        {RPCResult::Type::NUM, "vin", "The input number in the spending transaction"},
+                        {RPCResult::Type::STR_HEX, "blockhash", "The hash of the block containing the spending transaction"},
+                        {RPCResult::Type::NUM, "height", "The height of that block"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getspendingtx", "\"mytxid\" 1") +
+                    HelpExampleRpc("getspendingtx", "\"mytxid\", 1")
+                }
+            }.Check(request);
+
+    const uint256 txid = ParseHashV(request.params[0], "txid");
+    const int n = request.params[1].get_int();
+    if (n < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid output number");
+    }
+
+    if (!g_spentindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent output index is not enabled. Use -spentindex to enable it.");
+    }
+    const bool index_ready = g_spentindex->BlockUntilSyncedToCurrentChain();
+
+    uint256 block_hash;
+    CTransactionRef tx;
+    uint32_t vin;
+    if (!g_spentindex->FindSpendingTx(COutPoint(txid, n), block_hash, tx, vin)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, index_ready ?
+            "No spending transaction found in the active chain" :
+            "No spending transaction found. The spent output index is still in the process of being built.");
+    }
+
+    int height = -1;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(block_hash);
+        if (pindex && ::ChainActive().Contains(pindex)) {
+            height = pindex->nHeight;
+        }
+    }
+    if (height < 0) {
+        // Entries of disconnected blocks are only removed once the index follows the reorg.
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No spending transaction found in the active chain");
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("txid", tx->GetHash().GetHex());
+    result.pushKV("vin", (int64_t)vin);
+    result.pushKV("blockhash", block_hash.GetHex());
+    result.pushKV("height", height);
+    return result;
+}
+
 static UniValue getblockfilter(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getblockfilter",
@@ -2243,7 +2947,7 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
 {
     RPCHelpMan{
         "dumptxoutset",
-        "\nWrite the serialized UTXO set to disk.\n",
+        "\nWrite the serialized UTXO set to disk, as checksummed chunks of coins.\n",
         {
             {"path",
                 RPCArg::Type::STR,
@@ -2277,20 +2981,18 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
             "move it out of the way first");
     }
 
-    FILE* file{fsbridge::fopen(temppath, "wb")};
-    CAutoFile afile{file, SER_DISK, CLIENT_VERSION};
-    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors(SNAPSHOT_SHARDS);
     CCoinsStats stats;
     CBlockIndex* tip;
 
     {
         // We need to lock cs_main to ensure that the coinsdb isn't written to
         // between (i) flushing coins cache to disk (coinsdb), (ii) getting stats
-        // based upon the coinsdb, and (iii) constructing a cursor to the
+        // based upon the coinsdb, and (iii) constructing the cursors to the
         // coinsdb for use below this block.
         //
         // Cursors returned by leveldb iterate over snapshots, so the contents
-        // of the pcursor will not be affected by simultaneous writes during
+        // of the cursors will not be affected by simultaneous writes during
         // use below this block.
         //
         // See discussion here:
@@ -2304,33 +3006,77 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
         }
 
-        pcursor = std::unique_ptr<CCoinsViewCursor>(::ChainstateActive().CoinsDB().Cursor());
+        for (int shard = 0; shard < SNAPSHOT_SHARDS; ++shard) {
+            cursors[shard].reset(::ChainstateActive().CoinsDB().Cursor(SnapshotShardStart(shard)));
+        }
         tip = LookupBlockIndex(stats.hashBlock);
         CHECK_NONFATAL(tip);
     }
 
-    SnapshotMetadata metadata{tip->GetBlockHash(), stats.coins_count, tip->nChainTx};
-
-    afile << metadata;
+    // Each shard is serialized to its own part file by a pool of threads, and
+    // the parts are then appended in order, so that the output does not depend
+    // on the number of threads.
+    auto part_path = [&](int shard) { return fs::path(temppath.string() + "." + std::to_string(shard)); };
+    std::vector<uint64_t> shard_coins(SNAPSHOT_SHARDS, 0);
+    std::atomic<int> next_shard{0};
+    std::atomic<bool> failed{false};
+    const auto interrupt = [&failed] { return failed || !IsRPCRunning(); };
+    auto worker = [&] {
+        for (int shard; (shard = next_shard++) < SNAPSHOT_SHARDS;) {
+            CAutoFile part{fsbridge::fopen(part_path(shard), "wb"), SER_DISK, CLIENT_VERSION};
+            if (part.IsNull() || !WriteSnapshotShard(*cursors[shard], shard, part, shard_coins[shard], interrupt)) {
+                failed = true;
+            }
+            cursors[shard].reset();
+        }
+    };
+    std::vector<std::thread> threads;
+    const int n_threads = std::max(1, std::min(GetNumCores(), SNAPSHOT_SHARDS));
+    for (int i = 1; i < n_threads; ++i) {
+        threads.emplace_back([&worker, i] {
+            util::ThreadRename(strprintf("dumptxoutset.%i", i));
+            worker();
+        });
+    }
+    worker();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
 
-    COutPoint key;
-    Coin coin;
-    unsigned int iter{0};
+    uint64_t coins_written = 0;
+    for (uint64_t count : shard_coins) coins_written += count;
+    if (!failed && coins_written != stats.coins_count) failed = true;
 
-    while (pcursor->Valid()) {
-        if (iter % 5000 == 0 && !IsRPCRunning()) {
-            throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+    SnapshotMetadata metadata{tip->GetBlockHash(), stats.coins_count, tip->nChainTx};
+    if (!failed) {
+        CAutoFile afile{fsbridge::fopen(temppath, "wb"), SER_DISK, CLIENT_VERSION};
+        failed = afile.IsNull();
+        try {
+            if (!failed) afile << metadata;
+        } catch (const std::ios_base::failure&) {
+            failed = true;
         }
-        ++iter;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            afile << key;
-            afile << coin;
+        std::vector<char> buffer(1 << 20);
+        for (int shard = 0; shard < SNAPSHOT_SHARDS && !failed; ++shard) {
+            CAutoFile part{fsbridge::fopen(part_path(shard), "rb"), SER_DISK, CLIENT_VERSION};
+            failed = part.IsNull();
+            size_t n_read;
+            while (!failed && (n_read = fread(buffer.data(), 1, buffer.size(), part.Get())) > 0) {
+                failed = fwrite(buffer.data(), 1, n_read, afile.Get()) != n_read;
+            }
         }
-
-        pcursor->Next();
+        if (!afile.IsNull() && fflush(afile.Get()) != 0) failed = true;
+    }
+    for (int shard = 0; shard < SNAPSHOT_SHARDS; ++shard) {
+        fs::remove(part_path(shard));
+    }
+    if (failed) {
+        fs::remove(temppath);
+        if (!IsRPCRunning()) {
+            throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+        }
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to write UTXO snapshot to " + temppath.string());
     }
-
-    afile.fclose();
     fs::rename(temppath, path);
 
     UniValue result(UniValue::VOBJ);
@@ -2341,6 +3087,98 @@ UniValue dumptxoutset(const JSONRPCRequest& request)
     return result;
 }
 
+static Mutex g_snapshot_load_mutex;
+
+static UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+    RPCHelpMan{
+        "loadtxoutset",
+        "\nLoad a serialized UTXO set written by dumptxoutset into a separate coins database (chainstate_snapshot),\n"
+        "and check it against its metadata. The active chainstate is left untouched.\n"
+        "The returned hash_serialized_2 should be compared with gettxoutsetinfo on a trusted node at base_height.\n",
+        {
+            {"path",
+                RPCArg::Type::STR,
+                RPCArg::Optional::NO,
+                /* default_val */ "",
+                "path to the snapshot file. If relative, will be prefixed by datadir."},
+        },
+        RPCResult{
+            RPCResult::Type::OBJ, "", "",
+                {
+                    {RPCResult::Type::NUM, "coins_loaded", "the number of coins loaded from the snapshot"},
+                    {RPCResult::Type::STR_HEX, "base_hash", "the hash of the base of the snapshot"},
+                    {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
+                    {RPCResult::Type::STR_HEX, "hash_serialized_2", "the serialized hash of the loaded UTXO set"},
+                    {RPCResult::Type::STR, "path", "the absolute path of the coins database the snapshot was loaded into"},
+                }
+        },
+        RPCExamples{
+            HelpExampleCli("loadtxoutset", "utxo.dat")
+        }
+    }.Check(request);
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    FILE* file{fsbridge::fopen(path, "rb")};
+    if (!file) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Couldn't open file " + path.string() + " for reading.");
+    }
+    // Coins are small, so read the file in large chunks rather than one field at a time.
+    CBufferedFile afile{file, 8 << 20, 0, SER_DISK, CLIENT_VERSION};
+
+    SnapshotMetadata metadata;
+    try {
+        afile >> metadata;
+    } catch (const std::ios_base::failure&) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Unable to parse snapshot metadata");
+    }
+
+    int base_height;
+    {
+        LOCK(::cs_main);
+        const CBlockIndex* base = LookupBlockIndex(metadata.m_base_blockhash);
+        if (!base) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown snapshot base block " + metadata.m_base_blockhash.ToString());
+        }
+        if (base->nChainTx != 0 && base->nChainTx != metadata.m_nchaintx) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf(
+                "Snapshot transaction count %d does not match the %d transactions up to its base block",
+                metadata.m_nchaintx, base->nChainTx));
+        }
+        base_height = base->nHeight;
+    }
+
+    // Only one snapshot database can be open at a time.
+    LOCK(g_snapshot_load_mutex);
+    const fs::path db_path = GetDataDir() / "chainstate_snapshot";
+    const size_t cache_size = std::max<int64_t>(gArgs.GetArg("-dbcache", nDefaultDbCache), nMinDbCache) << 20;
+    CCoinsStats stats;
+    {
+        CCoinsViewDB coins_db(db_path, nMaxCoinsDBCache << 20, /* fMemory */ false, /* fWipe */ true);
+        std::string error;
+        if (!LoadSnapshotCoins(afile, metadata, base_height, coins_db, cache_size, error)) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Unable to load UTXO snapshot: " + error);
+        }
+        if (!GetUTXOStats(&coins_db, stats)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read the loaded UTXO set");
+        }
+    }
+    // Duplicate coins written in separate batches only show up in the final count.
+    if (stats.coins_count != metadata.m_coins_count) {
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf(
+            "Unable to load UTXO snapshot: %d coins loaded but its metadata claims %d",
+            stats.coins_count, metadata.m_coins_count));
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("coins_loaded", stats.coins_count);
+    result.pushKV("base_hash", metadata.m_base_blockhash.ToString());
+    result.pushKV("base_height", base_height);
+    result.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+    result.pushKV("path", db_path.string());
+    return result;
+}
+
 void RegisterBlockchainRPCCommands(CRPCTable &t)
 {
 // clang-format off
@@ -2350,6 +3188,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
     { "blockchain",         "getblockstats",          &getblockstats,          {"hash_or_height", "stats"} },
+    { "blockchain",         "getblockstatsrange",     &getblockstatsrange,     {"start", "end", "stats"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
     { "blockchain",         "getblockcount",          &getblockcount,          {} },
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
@@ -2360,10 +3199,11 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getcoinscacheinfo",      &getcoinscacheinfo,      {} },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {"histogram"} },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose", "mempool_sequence"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type", "hash_or_height"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
@@ -2371,6 +3211,10 @@ static const CRPCCommand commands[] =
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
     { "blockchain",         "scantxoutset",           &scantxoutset,           {"action", "scanobjects"} },
     { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash", "filtertype"} },
+    { "blockchain",         "getaddresshistory",      &getaddresshistory,      {"address", "start_height", "end_height"} },
+    { "blockchain",         "getaddressutxos",        &getaddressutxos,        {"address"} },
+    { "blockchain",         "getaddressbalance",      &getaddressbalance,      {"address"} },
+    { "blockchain",         "getspendingtx",          &getspendingtx,          {"txid", "n"} },
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        {"blockhash"} },
@@ -2380,11 +3224,29 @@ static const CRPCCommand commands[] =
     { "hidden",             "waitforblockheight",     &waitforblockheight,     {"height","timeout"} },
     { "hidden",             "syncwithvalidationinterfacequeue", &syncwithvalidationinterfacequeue, {} },
     { "hidden",             "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "hidden",             "loadtxoutset",           &loadtxoutset,           {"path"} },
 };
 // clang-format on
 
     for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++)
         t.appendCommand(commands[vcidx].name, &commands[vcidx]);
+
+    const auto block_height = [](const JSONRPCRequest& request, const UniValue&) {
+        return GetBuriedBlockHeight(ParseHashV(request.params[0], "blockhash"));
+    };
+    RegisterRPCCacheable("getblock", {block_height, RefreshRPCConfirmations});
+    RegisterRPCCacheable("getblockheader", {block_height, RefreshRPCConfirmations});
+    RegisterRPCCacheable("getblockstats", {[](const JSONRPCRequest& request, const UniValue&) {
+        if (!request.params[0].isNum()) return GetBuriedBlockHeight(ParseHashV(request.params[0], "hash_or_height"));
+        uint256 hash;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pindex = ::ChainActive()[request.params[0].get_int()];
+            if (!pindex) return -1;
+            hash = pindex->GetBlockHash();
+        }
+        return GetBuriedBlockHeight(hash);
+    }, [](UniValue&, int) {}});
 }
 
 NodeContext* g_rpc_node = nullptr;
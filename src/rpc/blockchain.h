@@ -8,6 +8,7 @@
 #include <amount.h>
 #include <sync.h>
 
+#include <memory>
 #include <stdint.h>
 #include <vector>
 
@@ -17,9 +18,12 @@ class CBlock;
 class CBlockIndex;
 class CTxMemPool;
 class UniValue;
+class uint256;
 struct NodeContext;
+struct TipSnapshot;
 
-static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
+/** Results about blocks with fewer confirmations are not cached (see -rpccachesize) */
+static constexpr int RPC_CACHE_MIN_CONFIRMATIONS = 6;
 
 /**
  * Get the difficulty of the net wrt to the given block index.
@@ -28,6 +32,8 @@ static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
  * difficulty (4295032833 hashes).
  */
 double GetDifficulty(const CBlockIndex* blockindex);
+/** Get the difficulty of a block with the given nBits. */
+double GetDifficulty(uint32_t bits);
 
 /** Callback for when block tip changed. */
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
@@ -36,17 +42,14 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails = false) LOCKS_EXCLUDED(cs_main);
 
 /** Mempool information to JSON */
-UniValue MempoolInfoToJSON(const CTxMemPool& pool);
+UniValue MempoolInfoToJSON(const CTxMemPool& pool, bool histogram = false);
 
 /** Mempool to JSON */
-UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose = false);
+UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose = false, bool include_mempool_sequence = false);
 
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex) LOCKS_EXCLUDED(cs_main);
 
-/** Used by getblockstats to get feerates at different percentiles by weight  */
-void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
-
 //! Pointer to node state that needs to be declared as a global to be accessible
 //! RPC methods. Due to limitations of the RPC framework, there's currently no
 //! direct way to pass in state to RPC methods without globals.
@@ -54,4 +57,12 @@ extern NodeContext* g_rpc_node;
 
 CTxMemPool& EnsureMemPool();
 
+/** Return the latest snapshot of the chain tip, throwing if no tip is loaded yet. Doesn't take cs_main. */
+std::shared_ptr<const TipSnapshot> EnsureTipSnapshot();
+
+/** Height of the block if it is buried deeply enough in the active chain to cache RPC results about it, -1 otherwise. */
+int GetBuriedBlockHeight(const uint256& hash) LOCKS_EXCLUDED(cs_main);
+/** Update the confirmations of a cached RPC result about the block at height. */
+void RefreshRPCConfirmations(UniValue& result, int height);
+
 #endif
@@ -66,6 +66,10 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "listsinceblock", 1, "target_confirmations" },
     { "listsinceblock", 2, "include_watchonly" },
     { "listsinceblock", 3, "include_removed" },
+    { "sendbatch", 0, "payments" },
+    { "sendbatch", 1, "max_outputs" },
+    { "sendbatch", 3, "replaceable" },
+    { "sendbatch", 4, "conf_target" },
     { "sendmany", 1, "amounts" },
     { "sendmany", 2, "minconf" },
     { "sendmany", 4, "subtractfeefrom" },
@@ -89,6 +93,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "gettransaction", 1, "include_watchonly" },
     { "gettransaction", 2, "verbose" },
     { "getrawtransaction", 1, "verbose" },
+    { "getrawtransactions", 0, "txids" },
+    { "getrawtransactions", 1, "verbose" },
     { "createrawtransaction", 0, "inputs" },
     { "createrawtransaction", 1, "outputs" },
     { "createrawtransaction", 2, "locktime" },
@@ -102,6 +108,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "testmempoolaccept", 0, "rawtxs" },
     { "testmempoolaccept", 1, "allowhighfees" },
     { "testmempoolaccept", 1, "maxfeerate" },
+    { "submitpackage", 0, "rawtxs" },
+    { "submitpackage", 1, "maxfeerate" },
     { "combinerawtransaction", 0, "txs" },
     { "fundrawtransaction", 1, "options" },
     { "fundrawtransaction", 2, "iswitness" },
@@ -135,10 +143,18 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "verifychain", 0, "checklevel" },
     { "verifychain", 1, "nblocks" },
     { "getblockstats", 0, "hash_or_height" },
+    { "gettxoutsetinfo", 1, "hash_or_height" },
     { "getblockstats", 1, "stats" },
+    { "getblockstatsrange", 0, "start" },
+    { "getblockstatsrange", 1, "end" },
+    { "getblockstatsrange", 2, "stats" },
+    { "getaddresshistory", 1, "start_height" },
+    { "getaddresshistory", 2, "end_height" },
+    { "getspendingtx", 1, "n" },
     { "pruneblockchain", 0, "height" },
     { "keypoolrefill", 0, "newsize" },
     { "getrawmempool", 0, "verbose" },
+    { "getrawmempool", 1, "mempool_sequence" },
     { "estimatesmartfee", 0, "conf_target" },
     { "estimaterawfee", 0, "conf_target" },
     { "estimaterawfee", 1, "threshold" },
@@ -148,12 +164,15 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "setban", 3, "absolute" },
     { "setnetworkactive", 0, "state" },
     { "setwalletflag", 1, "value" },
+    { "getmempoolinfo", 0, "histogram" },
     { "getmempoolancestors", 1, "verbose" },
     { "getmempooldescendants", 1, "verbose" },
     { "bumpfee", 1, "options" },
     { "logging", 0, "include" },
     { "logging", 1, "exclude" },
     { "disconnectnode", 1, "nodeid" },
+    { "getlockstats", 1, "count" },
+    { "setlockprofiling", 0, "enable" },
     // Echo with conversion (For testing only)
     { "echojson", 0, "arg0" },
     { "echojson", 1, "arg1" },
@@ -7,6 +7,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <consensus/consensus.h>
+#include <consensus/merkle.h>
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
@@ -34,6 +35,8 @@
 #include <versionbitsinfo.h>
 #include <warnings.h>
 
+#include <algorithm>
+#include <deque>
 #include <memory>
 #include <stdint.h>
 
@@ -111,6 +114,8 @@ static UniValue generateBlocks(const CTxMemPool& mempool, const CScript& coinbas
         nHeight = ::ChainActive().Height();
         nHeightEnd = nHeight+nGenerate;
     }
+    int gen_threads = gArgs.GetArg("-genthreads", DEFAULT_GENTHREADS);
+    if (gen_threads <= 0) gen_threads = GetNumCores();
     unsigned int nExtraNonce = 0;
     UniValue blockHashes(UniValue::VARR);
     while (nHeight < nHeightEnd && !ShutdownRequested())
@@ -121,16 +126,13 @@ static UniValue generateBlocks(const CTxMemPool& mempool, const CScript& coinbas
         CBlock *pblock = &pblocktemplate->block;
         {
             LOCK(cs_main);
-            IncrementExtraNonce(pblock, ::ChainActive().Tip(), nExtraNonce);
+            IncrementExtraNonce(pblock, ::ChainActive().Tip(), nExtraNonce, &pblocktemplate->vCoinbaseMerkleBranch);
         }
-        while (nMaxTries > 0 && pblock->nNonce < std::numeric_limits<uint32_t>::max() && !CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus()) && !ShutdownRequested()) {
-            ++pblock->nNonce;
-            --nMaxTries;
-        }
-        if (nMaxTries == 0 || ShutdownRequested()) {
-            break;
-        }
-        if (pblock->nNonce == std::numeric_limits<uint32_t>::max()) {
+        if (!GrindBlockNonce(*pblock, Params().GetConsensus(), nMaxTries, gen_threads)) {
+            if (nMaxTries == 0 || ShutdownRequested()) {
+                break;
+            }
+            // Out of nonces, try again with the next extranonce
             continue;
         }
         std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
@@ -229,6 +231,11 @@ static UniValue generatetoaddress(const JSONRPCRequest& request)
     return generateBlocks(mempool, coinbase_script, nGenerate, nMaxTries);
 }
 
+static Mutex g_hashps_mutex;
+//! The networkhashps of getmininginfo, and the tip it was computed for.
+static UniValue g_hashps GUARDED_BY(g_hashps_mutex);
+static uint256 g_hashps_tip GUARDED_BY(g_hashps_mutex);
+
 static UniValue getmininginfo(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getmininginfo",
@@ -252,15 +259,26 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(cs_main);
     const CTxMemPool& mempool = EnsureMemPool();
+    const std::shared_ptr<const TipSnapshot> tip = EnsureTipSnapshot();
+    const int64_t last_block_weight = BlockAssembler::m_last_block_weight;
+    const int64_t last_block_num_txs = BlockAssembler::m_last_block_num_txs;
 
     UniValue obj(UniValue::VOBJ);
-    obj.pushKV("blocks",           (int)::ChainActive().Height());
-    if (BlockAssembler::m_last_block_weight) obj.pushKV("currentblockweight", *BlockAssembler::m_last_block_weight);
-    if (BlockAssembler::m_last_block_num_txs) obj.pushKV("currentblocktx", *BlockAssembler::m_last_block_num_txs);
-    obj.pushKV("difficulty",       (double)GetDifficulty(::ChainActive().Tip()));
-    obj.pushKV("networkhashps",    getnetworkhashps(request));
+    obj.pushKV("blocks",           tip->height);
+    if (last_block_weight >= 0) obj.pushKV("currentblockweight", last_block_weight);
+    if (last_block_num_txs >= 0) obj.pushKV("currentblocktx", last_block_num_txs);
+    obj.pushKV("difficulty",       GetDifficulty(tip->bits));
+    {
+        // The estimate only changes with the tip, so only recompute it (under cs_main) then
+        LOCK(g_hashps_mutex);
+        if (g_hashps_tip != tip->hash || g_hashps.isNull()) {
+            LOCK(cs_main);
+            g_hashps = getnetworkhashps(request);
+            g_hashps_tip = ::ChainActive().Tip()->GetBlockHash();
+        }
+        obj.pushKV("networkhashps", g_hashps);
+    }
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain",            Params().NetworkIDString());
     obj.pushKV("warnings",         GetWarnings(false));
@@ -332,6 +350,13 @@ static std::string gbt_vb_name(const Consensus::DeploymentPos pos) {
     return s;
 }
 
+/** Number of templates handed out with a coinbase branch that can still be submitted by workid. */
+static constexpr size_t MAX_COINBASE_BRANCH_WORK = 16;
+
+static Mutex cs_coinbase_branch_work;
+//! Templates by workid, oldest first. All are built on the same previous block.
+static std::deque<std::pair<std::string, std::shared_ptr<const CBlockTemplate>>> g_coinbase_branch_work GUARDED_BY(cs_coinbase_branch_work);
+
 static UniValue getblocktemplate(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getblocktemplate",
@@ -348,7 +373,7 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
                             {"mode", RPCArg::Type::STR, /* treat as named arg */ RPCArg::Optional::OMITTED_NAMED_ARG, "This must be set to \"template\", \"proposal\" (see BIP 23), or omitted"},
                             {"capabilities", RPCArg::Type::ARR, /* treat as named arg */ RPCArg::Optional::OMITTED_NAMED_ARG, "A list of strings",
                                 {
-                                    {"support", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "client side supported feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', 'serverlist', 'workid'"},
+                                    {"support", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "client side supported feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', 'serverlist', 'workid', 'coinbasebranch'"},
                                 },
                                 },
                             {"rules", RPCArg::Type::ARR, RPCArg::Optional::NO, "A list of strings",
@@ -411,6 +436,11 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM_TIME, "curtime", "current timestamp in " + UNIX_EPOCH_TIME},
                         {RPCResult::Type::STR, "bits", "compressed target of next block"},
                         {RPCResult::Type::NUM, "height", "The height of the next block"},
+                        {RPCResult::Type::ARR, "coinbasebranch", /* optional */ true, "Only with the 'coinbasebranch' capability: the Merkle branch of the coinbase transaction, from the bottom of the tree up",
+                            {
+                                {RPCResult::Type::STR_HEX, "", "hash encoded in little-endian hexadecimal"},
+                            }},
+                        {RPCResult::Type::STR, "workid", /* optional */ true, "Only with the 'coinbasebranch' capability: identifies the template for submitblockcoinbase"},
                     }},
                 RPCExamples{
                     HelpExampleCli("getblocktemplate", "'{\"rules\": [\"segwit\"]}'")
@@ -423,6 +453,7 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     std::string strMode = "template";
     UniValue lpval = NullUniValue;
     std::set<std::string> setClientRules;
+    std::set<std::string> setClientCaps;
     int64_t nMaxVersionPreVB = -1;
     if (!request.params[0].isNull())
     {
@@ -467,6 +498,13 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
             return BIP22ValidationResult(state);
         }
 
+        const UniValue& aClientCaps = find_value(oparam, "capabilities");
+        if (aClientCaps.isArray()) {
+            for (unsigned int i = 0; i < aClientCaps.size(); ++i) {
+                setClientCaps.insert(aClientCaps[i].get_str());
+            }
+        }
+
         const UniValue& aClientRules = find_value(oparam, "rules");
         if (aClientRules.isArray()) {
             for (unsigned int i = 0; i < aClientRules.size(); ++i) {
@@ -566,7 +604,11 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
 
         // Create new block
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(mempool, Params()).CreateNewBlock(scriptDummy);
+        if (g_rpc_node->block_template_cache) {
+            pblocktemplate = g_rpc_node->block_template_cache->GetTemplate(scriptDummy);
+        } else {
+            pblocktemplate = BlockAssembler(mempool, Params()).CreateNewBlock(scriptDummy);
+        }
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
@@ -584,7 +626,7 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     // NOTE: If at some point we support pre-segwit miners post-segwit-activation, this needs to take segwit support into consideration
     const bool fPreSegWit = (pindexPrev->nHeight + 1 < consensusParams.SegwitHeight);
 
-    UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal");
+    UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal"); aCaps.push_back("coinbasebranch");
 
     UniValue transactions(UniValue::VARR);
     std::map<uint256, int64_t> setTxIndex;
@@ -642,7 +684,7 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     UniValue vbavailable(UniValue::VOBJ);
     for (int j = 0; j < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; ++j) {
         Consensus::DeploymentPos pos = Consensus::DeploymentPos(j);
-        ThresholdState state = VersionBitsState(pindexPrev, consensusParams, pos, versionbitscache);
+        ThresholdState state = VersionBitsStateAfter(pindexPrev, consensusParams, pos);
         switch (state) {
             case ThresholdState::DEFINED:
             case ThresholdState::FAILED:
@@ -723,6 +765,31 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
         result.pushKV("default_witness_commitment", HexStr(pblocktemplate->vchCoinbaseCommitment.begin(), pblocktemplate->vchCoinbaseCommitment.end()));
     }
 
+    if (setClientCaps.count("coinbasebranch")) {
+        // The branch does not depend on the coinbase, so together with the
+        // dummy coinbase it commits to the whole template.
+        const std::vector<uint256>& branch = pblocktemplate->vCoinbaseMerkleBranch;
+        const std::string workid = ComputeMerkleRootFromBranch(pblock->vtx[0]->GetHash(), branch, 0).GetHex();
+        UniValue aBranch(UniValue::VARR);
+        for (const uint256& hash : branch) {
+            aBranch.push_back(hash.GetHex());
+        }
+        {
+            LOCK(cs_coinbase_branch_work);
+            if (!g_coinbase_branch_work.empty() && g_coinbase_branch_work.back().second->block.hashPrevBlock != pblock->hashPrevBlock) {
+                g_coinbase_branch_work.clear();
+            }
+            const bool known = std::any_of(g_coinbase_branch_work.begin(), g_coinbase_branch_work.end(),
+                [&](const std::pair<std::string, std::shared_ptr<const CBlockTemplate>>& work) { return work.first == workid; });
+            if (!known) {
+                if (g_coinbase_branch_work.size() >= MAX_COINBASE_BRANCH_WORK) g_coinbase_branch_work.pop_front();
+                g_coinbase_branch_work.emplace_back(workid, std::make_shared<const CBlockTemplate>(*pblocktemplate));
+            }
+        }
+        result.pushKV("coinbasebranch", aBranch);
+        result.pushKV("workid", workid);
+    }
+
     return result;
 }
 
@@ -744,6 +811,32 @@ protected:
     }
 };
 
+/** Process a block from submitblock or submitblockcoinbase and return the BIP22 result. */
+static UniValue SubmitBlock(const std::shared_ptr<CBlock>& blockptr)
+{
+    CBlock& block = *blockptr;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(block.hashPrevBlock);
+        if (pindex) {
+            UpdateUncommittedBlockStructures(block, pindex, Params().GetConsensus());
+        }
+    }
+
+    bool new_block;
+    auto sc = std::make_shared<submitblock_StateCatcher>(block.GetHash());
+    RegisterSharedValidationInterface(sc);
+    bool accepted = ProcessNewBlock(Params(), blockptr, /* fForceProcessing */ true, /* fNewBlock */ &new_block);
+    UnregisterSharedValidationInterface(sc);
+    if (!new_block && accepted) {
+        return "duplicate";
+    }
+    if (!sc->found) {
+        return "inconclusive";
+    }
+    return BIP22ValidationResult(sc->state);
+}
+
 static UniValue submitblock(const JSONRPCRequest& request)
 {
     // We allow 2 arguments for compliance with BIP22. Argument 2 is ignored.
@@ -785,26 +878,76 @@ static UniValue submitblock(const JSONRPCRequest& request)
         }
     }
 
+    return SubmitBlock(blockptr);
+}
+
+static UniValue submitblockcoinbase(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"submitblockcoinbase",
+                "\nAttempts to submit a new block to the network, given only its header and coinbase transaction.\n"
+                "The other transactions are taken from a template returned by getblocktemplate with the 'coinbasebranch' capability.\n",
+                {
+                    {"workid", RPCArg::Type::STR, RPCArg::Optional::NO, "the workid of the template"},
+                    {"header", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "the hex-encoded block header"},
+                    {"coinbasetxn", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "the hex-encoded coinbase transaction"},
+                },
+                RPCResult{RPCResult::Type::NONE, "", "Returns JSON Null when valid, a string according to BIP22 otherwise"},
+                RPCExamples{
+                    HelpExampleCli("submitblockcoinbase", "\"workid\" \"header\" \"coinbasetxn\"")
+            + HelpExampleRpc("submitblockcoinbase", "\"workid\", \"header\", \"coinbasetxn\"")
+                },
+            }.Check(request);
+
+    std::shared_ptr<const CBlockTemplate> work;
+    {
+        LOCK(cs_coinbase_branch_work);
+        for (const auto& entry : g_coinbase_branch_work) {
+            if (entry.first == request.params[0].get_str()) work = entry.second;
+        }
+    }
+    if (!work) {
+        return "stale-work";
+    }
+
+    CBlockHeader header;
+    if (!DecodeHexBlockHeader(header, request.params[1].get_str())) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block header decode failed");
+    }
+    CMutableTransaction coinbase;
+    if (!DecodeHexTx(coinbase, request.params[2].get_str())) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "TX decode failed");
+    }
+    if (!CTransaction(coinbase).IsCoinBase()) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block does not start with a coinbase");
+    }
+
+    std::shared_ptr<CBlock> blockptr = std::make_shared<CBlock>(header);
+    blockptr->vtx = work->block.vtx;
+    blockptr->vtx[0] = MakeTransactionRef(std::move(coinbase));
+
+    uint256 hash = blockptr->GetHash();
     {
         LOCK(cs_main);
-        const CBlockIndex* pindex = LookupBlockIndex(block.hashPrevBlock);
+        const CBlockIndex* pindex = LookupBlockIndex(hash);
         if (pindex) {
-            UpdateUncommittedBlockStructures(block, pindex, Params().GetConsensus());
+            if (pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+                return "duplicate";
+            }
+            if (pindex->nStatus & BLOCK_FAILED_MASK) {
+                return "duplicate-invalid";
+            }
         }
     }
 
-    bool new_block;
-    auto sc = std::make_shared<submitblock_StateCatcher>(block.GetHash());
-    RegisterSharedValidationInterface(sc);
-    bool accepted = ProcessNewBlock(Params(), blockptr, /* fForceProcessing */ true, /* fNewBlock */ &new_block);
-    UnregisterSharedValidationInterface(sc);
-    if (!new_block && accepted) {
-        return "duplicate";
+    // The branch kept with the template gives the Merkle root for this
+    // coinbase without hashing the whole tree, so a header that doesn't
+    // commit to it is rejected before the block is processed. Blocks that
+    // pass are still fully checked.
+    if (ComputeMerkleRootFromBranch(blockptr->vtx[0]->GetHash(), work->vCoinbaseMerkleBranch, 0) != blockptr->hashMerkleRoot) {
+        return "bad-txnmrklroot";
     }
-    if (!sc->found) {
-        return "inconclusive";
-    }
-    return BIP22ValidationResult(sc->state);
+
+    return SubmitBlock(blockptr);
 }
 
 static UniValue submitheader(const JSONRPCRequest& request)
@@ -908,6 +1051,55 @@ static UniValue estimatesmartfee(const JSONRPCRequest& request)
     return result;
 }
 
+static UniValue estimatesmartfeetable(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"estimatesmartfeetable",
+                "\nReturns what estimatesmartfee would for every confirmation target from 1 to the highest\n"
+                "one tracked, in one call. Estimates are kept between calls until a block or a transaction\n"
+                "leaving the mempool changes them.\n",
+                {
+                    {"estimate_mode", RPCArg::Type::STR, /* default */ "CONSERVATIVE", "The fee estimate mode, see estimatesmartfee"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::NUM, "target", "The confirmation target"},
+                            {RPCResult::Type::NUM, "feerate", /* optional */ true, "estimate fee rate in " + CURRENCY_UNIT + "/kB (only present if a feerate was found)"},
+                            {RPCResult::Type::NUM, "blocks", "block number where estimate was found, as for estimatesmartfee"},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("estimatesmartfeetable", "")
+            + HelpExampleRpc("estimatesmartfeetable", "\"ECONOMICAL\"")
+                },
+            }.Check(request);
+
+    RPCTypeCheck(request.params, {UniValue::VSTR});
+    bool conservative = true;
+    if (!request.params[0].isNull()) {
+        FeeEstimateMode fee_mode;
+        if (!FeeModeFromString(request.params[0].get_str(), fee_mode)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid estimate_mode parameter");
+        }
+        if (fee_mode == FeeEstimateMode::ECONOMICAL) conservative = false;
+    }
+
+    const std::vector<SmartFeeEstimate> table = ::feeEstimator.estimateSmartFeeTable(conservative);
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < table.size(); ++i) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("target", (int)i + 1);
+        if (table[i].feerate != CFeeRate(0)) {
+            entry.pushKV("feerate", ValueFromAmount(table[i].feerate.GetFeePerK()));
+        }
+        entry.pushKV("blocks", table[i].calc.returnedTarget);
+        result.push_back(entry);
+    }
+    return result;
+}
+
 static UniValue estimaterawfee(const JSONRPCRequest& request)
 {
             RPCHelpMan{"estimaterawfee",
@@ -1035,6 +1227,7 @@ static const CRPCCommand commands[] =
     { "mining",             "prioritisetransaction",  &prioritisetransaction,  {"txid","dummy","fee_delta"} },
     { "mining",             "getblocktemplate",       &getblocktemplate,       {"template_request"} },
     { "mining",             "submitblock",            &submitblock,            {"hexdata","dummy"} },
+    { "mining",             "submitblockcoinbase",    &submitblockcoinbase,    {"workid","header","coinbasetxn"} },
     { "mining",             "submitheader",           &submitheader,           {"hexdata"} },
 
 
@@ -1042,6 +1235,7 @@ static const CRPCCommand commands[] =
     { "generating",         "generatetodescriptor",   &generatetodescriptor,   {"num_blocks","descriptor","maxtries"} },
 
     { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode"} },
+    { "util",               "estimatesmartfeetable",  &estimatesmartfeetable,  {"estimate_mode"} },
 
     { "hidden",             "estimaterawfee",         &estimaterawfee,         {"conf_target", "threshold"} },
 };
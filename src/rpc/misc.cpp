@@ -12,11 +12,15 @@
 #include <rpc/util.h>
 #include <scheduler.h>
 #include <script/descriptor.h>
+#include <sync.h>
 #include <util/check.h>
 #include <util/message.h> // For MessageSign(), MessageVerify()
+#include <util/perfstats.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <validationinterface.h>
 
+#include <algorithm>
 #include <stdint.h>
 #include <tuple>
 #ifdef HAVE_MALLOC_INFO
@@ -229,21 +233,18 @@ UniValue deriveaddresses(const JSONRPCRequest& request)
 
     UniValue addresses(UniValue::VARR);
 
-    for (int i = range_begin; i <= range_end; ++i) {
-        FlatSigningProvider provider;
-        std::vector<CScript> scripts;
-        if (!desc->Expand(i, key_provider, scripts, provider)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Cannot derive script without private keys"));
-        }
-
-        for (const CScript &script : scripts) {
-            CTxDestination dest;
-            if (!ExtractDestination(script, dest)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Descriptor does not have a corresponding address"));
-            }
+    const auto expanded = ExpandDescriptorRange(*desc, range_begin, range_end, key_provider);
+    if (!expanded) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Cannot derive script without private keys"));
+    }
 
-            addresses.push_back(EncodeDestination(dest));
+    for (const CScript &script : expanded->scripts) {
+        CTxDestination dest;
+        if (!ExtractDestination(script, dest)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Descriptor does not have a corresponding address"));
         }
+
+        addresses.push_back(EncodeDestination(dest));
     }
 
     // This should not be possible, but an assert seems overkill:
@@ -411,6 +412,23 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCLargePageInfo()
+{
+    LargePageManager& manager = LargePageManager::Instance();
+    LargePageManager::Stats stats = manager.stats();
+    UniValue obj(UniValue::VOBJ);
+    switch (manager.GetMode()) {
+    case LargePageManager::Mode::NONE: obj.pushKV("mode", "none"); break;
+    case LargePageManager::Mode::THP: obj.pushKV("mode", "thp"); break;
+    case LargePageManager::Mode::HUGETLB: obj.pushKV("mode", "hugetlb"); break;
+    }
+    obj.pushKV("mapped", uint64_t(stats.mapped));
+    obj.pushKV("hugetlb", uint64_t(stats.hugetlb));
+    obj.pushKV("used", uint64_t(stats.used));
+    obj.pushKV("hugetlb_failures", uint64_t(stats.hugetlb_failures));
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -455,6 +473,14 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
                                 {RPCResult::Type::NUM, "chunks_used", "Number allocated chunks"},
                                 {RPCResult::Type::NUM, "chunks_free", "Number unused chunks"},
                             }},
+                            {RPCResult::Type::OBJ, "largepages", "Information about the huge pages of -largepages",
+                            {
+                                {RPCResult::Type::STR, "mode", "\"none\", \"thp\" or \"hugetlb\""},
+                                {RPCResult::Type::NUM, "mapped", "Number of bytes mapped"},
+                                {RPCResult::Type::NUM, "hugetlb", "Number of those bytes from the hugetlbfs reservation"},
+                                {RPCResult::Type::NUM, "used", "Number of bytes in use by the coins cache and signature caches"},
+                                {RPCResult::Type::NUM, "hugetlb_failures", "Number of mappings that fell back to transparent huge pages because the reservation was used up"},
+                            }},
                         }
                     },
                     RPCResult{"mode \"mallocinfo\"",
@@ -471,6 +497,7 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.pushKV("locked", RPCLockedMemoryInfo());
+        obj.pushKV("largepages", RPCLargePageInfo());
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -483,6 +510,278 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     }
 }
 
+static UniValue getvalidationqueueinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getvalidationqueueinfo",
+                "Returns the state of the queues delivering validation notifications (new blocks and transactions)\n"
+                "to wallets, indexes, zmq and the peer logic. Each queue delivers to its subscribers in order,\n"
+                "independently of the other queues.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::ARR, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                        {
+                            {RPCResult::Type::STR, "name", "The name of the queue"},
+                            {RPCResult::Type::NUM, "subscribers", "The number of subscribers using the queue"},
+                            {RPCResult::Type::NUM, "pending", "The number of notifications waiting to be delivered"},
+                            {RPCResult::Type::NUM, "processed", "The number of notifications delivered so far"},
+                            {RPCResult::Type::NUM, "avg_latency", "The average time notifications waited in the queue, in microseconds"},
+                            {RPCResult::Type::NUM, "max_latency", "The longest time a notification waited in the queue, in microseconds"},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getvalidationqueueinfo", "")
+            + HelpExampleRpc("getvalidationqueueinfo", "")
+                },
+            }.Check(request);
+
+    UniValue ret(UniValue::VARR);
+    for (const ValidationQueueStats& stats : GetMainSignals().GetQueueStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", stats.name);
+        obj.pushKV("subscribers", (uint64_t)stats.subscribers);
+        obj.pushKV("pending", (uint64_t)stats.pending);
+        obj.pushKV("processed", stats.processed);
+        obj.pushKV("avg_latency", stats.processed ? stats.total_latency / (int64_t)stats.processed : 0);
+        obj.pushKV("max_latency", stats.max_latency);
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+static UniValue getschedulerinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getschedulerinfo",
+                "Returns the state of the scheduler running periodic and background tasks (address and ban list\n"
+                "dumps, stale tip checks, validation notifications, ...). Tasks of the same name never run at the\n"
+                "same time; all other tasks share the scheduler threads.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "threads", "The number of threads running scheduler tasks"},
+                        {RPCResult::Type::ARR, "tasks", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR, "name", "The name of the task (\"other\" for unnamed tasks)"},
+                                {RPCResult::Type::NUM, "scheduled", "The number of runs waiting in the queue"},
+                                {RPCResult::Type::BOOL, "running", "Whether the task is running right now"},
+                                {RPCResult::Type::NUM, "runs", "The number of runs so far"},
+                                {RPCResult::Type::NUM, "total_time", "The total run time, in microseconds"},
+                                {RPCResult::Type::NUM, "avg_time", "The average run time, in microseconds"},
+                                {RPCResult::Type::NUM, "max_time", "The longest run time, in microseconds"},
+                                {RPCResult::Type::NUM, "avg_delay", "The average time runs started late, in microseconds"},
+                                {RPCResult::Type::NUM, "max_delay", "The longest time a run started late, in microseconds"},
+                                {RPCResult::Type::ARR, "runtime_histogram", "The number of runs that took less than 1 ms, 10 ms, 100 ms, 1 s, 10 s and longer",
+                                {
+                                    {RPCResult::Type::NUM, "", "The number of runs"},
+                                }},
+                            }},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getschedulerinfo", "")
+            + HelpExampleRpc("getschedulerinfo", "")
+                },
+            }.Check(request);
+
+    CHECK_NONFATAL(g_rpc_node);
+    CHECK_NONFATAL(g_rpc_node->scheduler);
+    const CScheduler& scheduler = *g_rpc_node->scheduler;
+
+    UniValue tasks(UniValue::VARR);
+    for (const auto& task : scheduler.GetTaskInfo()) {
+        const SchedulerTaskInfo& info = task.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", task.first.empty() ? "other" : task.first);
+        obj.pushKV("scheduled", (uint64_t)info.scheduled);
+        obj.pushKV("running", info.running);
+        obj.pushKV("runs", info.runs);
+        obj.pushKV("total_time", info.total_time);
+        obj.pushKV("avg_time", info.runs ? info.total_time / (int64_t)info.runs : 0);
+        obj.pushKV("max_time", info.max_time);
+        obj.pushKV("avg_delay", info.runs ? info.total_delay / (int64_t)info.runs : 0);
+        obj.pushKV("max_delay", info.max_delay);
+        UniValue histogram(UniValue::VARR);
+        for (uint64_t count : info.runtime_histogram) {
+            histogram.push_back(count);
+        }
+        obj.pushKV("runtime_histogram", histogram);
+        tasks.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("threads", scheduler.ThreadsServicingQueue());
+    ret.pushKV("tasks", tasks);
+    return ret;
+}
+
+static UniValue getperfstats(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getperfstats",
+                "Returns latency histograms of hot code paths: the steps of connecting blocks (connectblock.*,\n"
+                "connecttip.*), the stages of mempool acceptance (mempool.*) and the processing of each message\n"
+                "type (msg.*). Times are in microseconds. Percentiles are the upper limits of the buckets they fall in.\n",
+                {
+                    {"prefix", RPCArg::Type::STR, /* default */ "\"\"", "Only return the histograms whose names start with this"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ_DYN, "name", "The histogram of this name",
+                    {
+                        {RPCResult::Type::NUM, "count", "The number of samples"},
+                        {RPCResult::Type::NUM, "total", "The sum of the samples"},
+                        {RPCResult::Type::NUM, "avg", "The average sample"},
+                        {RPCResult::Type::NUM, "max", "The largest sample"},
+                        {RPCResult::Type::NUM, "p50", "The approximate median"},
+                        {RPCResult::Type::NUM, "p90", "The approximate 90th percentile"},
+                        {RPCResult::Type::NUM, "p99", "The approximate 99th percentile"},
+                        {RPCResult::Type::ARR, "histogram", "The number of samples under 1, 2, 4, 8, ... microseconds, up to the last non-empty bucket",
+                        {
+                            {RPCResult::Type::NUM, "", "The number of samples"},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getperfstats", "")
+            + HelpExampleCli("getperfstats", "\"connectblock.\"")
+            + HelpExampleRpc("getperfstats", "\"msg.\"")
+                },
+            }.Check(request);
+
+    const std::string prefix = request.params[0].isNull() ? "" : request.params[0].get_str();
+
+    UniValue ret(UniValue::VOBJ);
+    for (const auto& histogram : perf::GetAllStats()) {
+        if (histogram.first.compare(0, prefix.size(), prefix) != 0) continue;
+        const perf::HistogramStats& stats = histogram.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("count", stats.count);
+        obj.pushKV("total", stats.total);
+        obj.pushKV("avg", stats.count ? stats.total / (int64_t)stats.count : 0);
+        obj.pushKV("max", stats.max);
+        obj.pushKV("p50", stats.ApproxQuantile(0.5));
+        obj.pushKV("p90", stats.ApproxQuantile(0.9));
+        obj.pushKV("p99", stats.ApproxQuantile(0.99));
+        size_t used = stats.buckets.size();
+        while (used > 0 && stats.buckets[used - 1] == 0) --used;
+        UniValue buckets(UniValue::VARR);
+        for (size_t bucket = 0; bucket < used; ++bucket) {
+            buckets.push_back(stats.buckets[bucket]);
+        }
+        obj.pushKV("histogram", buckets);
+        ret.pushKV(histogram.first, obj);
+    }
+    return ret;
+}
+
+static UniValue getlockstats(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getlockstats",
+                "Returns the locking sites recorded by the lock profiler (see setlockprofiling and -lockprofiling),\n"
+                "most waited on first. Times are in microseconds. Waits only count the acquisitions that found the\n"
+                "lock taken; hold times count all of them.\n",
+                {
+                    {"lock", RPCArg::Type::STR, /* default */ "\"\"", "Only return the sites locking the mutex of this name (e.g. cs_main)"},
+                    {"count", RPCArg::Type::NUM, /* default */ "20", "The number of sites to return, 0 for all"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::BOOL, "enabled", "Whether lock profiling is on"},
+                        {RPCResult::Type::ARR, "sites", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR, "lock", "The name of the mutex"},
+                                {RPCResult::Type::STR, "site", "The file and line locking it"},
+                                {RPCResult::Type::NUM, "acquisitions", "The number of times it was locked there"},
+                                {RPCResult::Type::NUM, "contended", "The number of those that had to wait"},
+                                {RPCResult::Type::NUM, "wait", "The total wait"},
+                                {RPCResult::Type::NUM, "wait_max", "The longest wait"},
+                                {RPCResult::Type::NUM, "wait_p99", "The approximate 99th percentile of the waits"},
+                                {RPCResult::Type::NUM, "hold", "The total hold time"},
+                                {RPCResult::Type::NUM, "hold_max", "The longest hold time"},
+                                {RPCResult::Type::NUM, "hold_p99", "The approximate 99th percentile of the hold times"},
+                                {RPCResult::Type::OBJ_DYN, "threads", "The total wait by thread name",
+                                {
+                                    {RPCResult::Type::NUM, "thread", "The total wait of this thread"},
+                                }},
+                            }},
+                        }},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getlockstats", "")
+            + HelpExampleCli("getlockstats", "\"cs_main\" 5")
+            + HelpExampleRpc("getlockstats", "\"cs_main\", 5")
+                },
+            }.Check(request);
+
+    const std::string lock = request.params[0].isNull() ? "" : request.params[0].get_str();
+    const int count = request.params[1].isNull() ? 20 : request.params[1].get_int();
+    if (count < 0) throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+
+    // LOCK(::cs_main) and LOCK(cs_main) are the same lock.
+    const auto lock_name = [](const std::string& name) { return name.compare(0, 2, "::") == 0 ? name.substr(2) : name; };
+
+    std::vector<LockProfileStats> sites;
+    for (LockProfileStats& site : GetLockProfile()) {
+        if (lock.empty() || lock_name(site.name) == lock) sites.push_back(std::move(site));
+    }
+    std::sort(sites.begin(), sites.end(), [](const LockProfileStats& a, const LockProfileStats& b) {
+        return std::tie(b.wait.total, b.hold.total) < std::tie(a.wait.total, a.hold.total);
+    });
+    if (count > 0 && sites.size() > (size_t)count) sites.resize(count);
+
+    UniValue result(UniValue::VARR);
+    for (const LockProfileStats& site : sites) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("lock", lock_name(site.name));
+        obj.pushKV("site", strprintf("%s:%d", site.file, site.line));
+        obj.pushKV("acquisitions", site.hold.count);
+        obj.pushKV("contended", site.wait.count);
+        obj.pushKV("wait", site.wait.total);
+        obj.pushKV("wait_max", site.wait.max);
+        obj.pushKV("wait_p99", site.wait.ApproxQuantile(0.99));
+        obj.pushKV("hold", site.hold.total);
+        obj.pushKV("hold_max", site.hold.max);
+        obj.pushKV("hold_p99", site.hold.ApproxQuantile(0.99));
+        UniValue threads(UniValue::VOBJ);
+        for (const auto& thread : site.thread_wait) {
+            threads.pushKV(thread.first.empty() ? "unknown" : thread.first, thread.second);
+        }
+        obj.pushKV("threads", threads);
+        result.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("enabled", g_lock_profiling.load());
+    ret.pushKV("sites", result);
+    return ret;
+}
+
+static UniValue setlockprofiling(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"setlockprofiling",
+                "Switches the lock profiler on or off. Statistics recorded so far are kept.\n",
+                {
+                    {"enable", RPCArg::Type::BOOL, RPCArg::Optional::NO, "Whether to record locking statistics"},
+                },
+                RPCResult{RPCResult::Type::NONE, "", ""},
+                RPCExamples{
+                    HelpExampleCli("setlockprofiling", "true")
+            + HelpExampleRpc("setlockprofiling", "false")
+                },
+            }.Check(request);
+
+    g_lock_profiling = request.params[0].get_bool();
+    return NullUniValue;
+}
+
 static void EnableOrDisableLogCategories(UniValue cats, bool enable) {
     cats = cats.get_array();
     for (unsigned int i = 0; i < cats.size(); ++i) {
@@ -596,7 +895,12 @@ static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getmemoryinfo",          &getmemoryinfo,          {"mode"} },
+    { "control",            "getlockstats",           &getlockstats,           {"lock", "count"} },
+    { "control",            "getperfstats",           &getperfstats,           {"prefix"} },
+    { "control",            "getschedulerinfo",       &getschedulerinfo,       {} },
+    { "control",            "getvalidationqueueinfo", &getvalidationqueueinfo, {} },
     { "control",            "logging",                &logging,                {"include", "exclude"}},
+    { "control",            "setlockprofiling",       &setlockprofiling,       {"enable"} },
     { "util",               "validateaddress",        &validateaddress,        {"address"} },
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys","address_type"} },
     { "util",               "deriveaddresses",        &deriveaddresses,        {"descriptor", "range"} },
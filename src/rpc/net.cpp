@@ -116,8 +116,27 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                             {
                                 {RPCResult::Type::NUM, "n", "The heights of blocks we're currently asking from this peer"},
                             }},
+                            {RPCResult::Type::NUM, "inflight_limit", "The number of blocks we ask from this peer at once"},
+                            {RPCResult::Type::NUM, "block_latency", "Average time in seconds from requesting a block from this peer to receiving it (if available)"},
+                            {RPCResult::Type::NUM, "block_download_rate", "Average rate in bytes per second at which blocks arrive from this peer (if available)"},
+                            {RPCResult::Type::NUM, "block_stalls", "How often blocks in flight from this peer were requested from others because it stalled"},
                             {RPCResult::Type::BOOL, "whitelisted", "Whether the peer is whitelisted"},
                             {RPCResult::Type::NUM, "minfeefilter", "The minimum fee rate for transactions this peer accepts"},
+                            {RPCResult::Type::NUM, "inv_known_bytes", "Memory used to remember the transactions this peer knows about, in bytes"},
+                            {RPCResult::Type::OBJ, "compression", "Messages exchanged compressed with this peer (see -p2pcompression)",
+                            {
+                                {RPCResult::Type::BOOL, "sending", "Whether messages to this peer are sent compressed"},
+                                {RPCResult::Type::NUM, "bytessent", "Payload bytes of the messages sent compressed"},
+                                {RPCResult::Type::NUM, "bytessent_uncompressed", "Their payload bytes before compression"},
+                                {RPCResult::Type::NUM, "bytesrecv", "Payload bytes of the messages received compressed"},
+                                {RPCResult::Type::NUM, "bytesrecv_uncompressed", "Their payload bytes after decompression"},
+                            }},
+                            {RPCResult::Type::OBJ, "sendqueue", "Bytes queued for sending to this peer, by class. Blocks are sent first, then control messages, then transaction relay",
+                            {
+                                {RPCResult::Type::NUM, "block", "Blocks, compact blocks and headers"},
+                                {RPCResult::Type::NUM, "control", "Messages in neither of the other classes"},
+                                {RPCResult::Type::NUM, "tx", "Transactions, their announcements and addresses"},
+                            }},
                             {RPCResult::Type::OBJ_DYN, "bytessent_per_msg", "",
                             {
                                 {RPCResult::Type::NUM, "msg", "The total bytes sent aggregated by message type\n"
@@ -195,6 +214,12 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            obj.pushKV("inflight_limit", statestats.m_blocks_in_transit_limit);
+            if (statestats.m_block_latency) {
+                obj.pushKV("block_latency", ((double)statestats.m_block_latency) / 1e6);
+                obj.pushKV("block_download_rate", statestats.m_block_download_rate);
+            }
+            obj.pushKV("block_stalls", statestats.m_block_stalls);
         }
         obj.pushKV("whitelisted", stats.m_legacyWhitelisted);
         UniValue permissions(UniValue::VARR);
@@ -203,6 +228,19 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.pushKV("permissions", permissions);
         obj.pushKV("minfeefilter", ValueFromAmount(stats.minFeeFilter));
+        obj.pushKV("inv_known_bytes", (uint64_t)stats.m_inv_known_bytes);
+        UniValue compression(UniValue::VOBJ);
+        compression.pushKV("sending", stats.m_compress_send);
+        compression.pushKV("bytessent", stats.m_compressed_bytes_sent);
+        compression.pushKV("bytessent_uncompressed", stats.m_uncompressed_bytes_sent);
+        compression.pushKV("bytesrecv", stats.m_compressed_bytes_recv);
+        compression.pushKV("bytesrecv_uncompressed", stats.m_uncompressed_bytes_recv);
+        obj.pushKV("compression", compression);
+        UniValue send_queue(UniValue::VOBJ);
+        for (size_t i = 0; i < NUM_SEND_PRIORITIES; ++i) {
+            send_queue.pushKV(SendPriorityName(static_cast<SendPriority>(i)), stats.m_send_queue_bytes[i]);
+        }
+        obj.pushKV("sendqueue", send_queue);
 
         UniValue sendPerMsgCmd(UniValue::VOBJ);
         for (const auto& i : stats.mapSendBytesPerMsgCmd) {
@@ -401,6 +439,7 @@ static UniValue getnettotals(const JSONRPCRequest& request)
                        {RPCResult::Type::NUM, "totalbytesrecv", "Total bytes received"},
                        {RPCResult::Type::NUM, "totalbytessent", "Total bytes sent"},
                        {RPCResult::Type::NUM_TIME, "timemillis", "Current UNIX time in milliseconds"},
+                       {RPCResult::Type::NUM, "recvbuffermemory", "Memory held by peers' receive buffers, including the ones pooled for reuse, in bytes"},
                        {RPCResult::Type::OBJ, "uploadtarget", "",
                        {
                            {RPCResult::Type::NUM, "timeframe", "Length of the measuring timeframe in seconds"},
@@ -424,6 +463,7 @@ static UniValue getnettotals(const JSONRPCRequest& request)
     obj.pushKV("totalbytesrecv", g_rpc_node->connman->GetTotalBytesRecv());
     obj.pushKV("totalbytessent", g_rpc_node->connman->GetTotalBytesSent());
     obj.pushKV("timemillis", GetTimeMillis());
+    obj.pushKV("recvbuffermemory", (uint64_t)g_rpc_node->connman->GetRecvBufferMemory());
 
     UniValue outboundLimit(UniValue::VOBJ);
     outboundLimit.pushKV("timeframe", g_rpc_node->connman->GetMaxOutboundTimeframe());
@@ -499,6 +539,14 @@ static UniValue getnetworkinfo(const JSONRPCRequest& request)
                                 {RPCResult::Type::NUM, "score", "relative score"},
                             }},
                         }},
+                        {RPCResult::Type::OBJ, "blockservecache", "statistics of the recently-served block cache (see -blockservecache)",
+                        {
+                            {RPCResult::Type::NUM, "hits", "number of block requests served from the cache"},
+                            {RPCResult::Type::NUM, "misses", "number of block requests that had to read the block from disk"},
+                            {RPCResult::Type::NUM, "blocks", "number of blocks currently cached"},
+                            {RPCResult::Type::NUM, "bytes", "size of the cached blocks in bytes"},
+                            {RPCResult::Type::NUM, "maxbytes", "configured size limit in bytes (0 = disabled)"},
+                        }},
                         {RPCResult::Type::STR, "warnings", "any network and blockchain warnings"},
                     }
                 },
@@ -508,7 +556,6 @@ static UniValue getnetworkinfo(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(cs_main);
     UniValue obj(UniValue::VOBJ);
     obj.pushKV("version",       CLIENT_VERSION);
     obj.pushKV("subversion",    strSubVersion);
@@ -540,6 +587,14 @@ static UniValue getnetworkinfo(const JSONRPCRequest& request)
         }
     }
     obj.pushKV("localaddresses", localAddresses);
+    const BlockServeCacheStats serve_cache = GetBlockServeCacheStats();
+    UniValue serve_cache_obj(UniValue::VOBJ);
+    serve_cache_obj.pushKV("hits", serve_cache.hits);
+    serve_cache_obj.pushKV("misses", serve_cache.misses);
+    serve_cache_obj.pushKV("blocks", (uint64_t)serve_cache.entries);
+    serve_cache_obj.pushKV("bytes", (uint64_t)serve_cache.bytes);
+    serve_cache_obj.pushKV("maxbytes", (uint64_t)serve_cache.max_bytes);
+    obj.pushKV("blockservecache", serve_cache_obj);
     obj.pushKV("warnings",       GetWarnings(false));
     return obj;
 }
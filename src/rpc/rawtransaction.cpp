@@ -222,6 +222,90 @@ static UniValue getrawtransaction(const JSONRPCRequest& request)
     return result;
 }
 
+static UniValue getrawtransactions(const JSONRPCRequest& request)
+{
+    RPCHelpMan{
+                "getrawtransactions",
+                "\nReturn the raw transaction data of several transactions.\n"
+
+                "\nEach transaction is looked up in the mempool and, if -txindex is enabled, in the blockchain,\n"
+                "like getrawtransaction without a blockhash. Transactions found through the index are read in\n"
+                "the order they are stored on disk, which is much faster than calling getrawtransaction for each.\n",
+                {
+                    {"txids", RPCArg::Type::ARR, RPCArg::Optional::NO, "The transaction ids",
+                        {
+                            {"txid", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, "A transaction id"},
+                        },
+                    },
+                    {"verbose", RPCArg::Type::BOOL, /* default */ "false", "If false, return strings, otherwise return json objects"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "One entry per txid, in the same order, null if the transaction is not found",
+                    {
+                        {RPCResult::Type::ELISION, "", "The result of getrawtransaction for the txid"},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("getrawtransactions", "'[\"mytxid\",...]'")
+            + HelpExampleCli("getrawtransactions", "'[\"mytxid\",...]' true")
+            + HelpExampleRpc("getrawtransactions", "[\"mytxid\",...], true")
+                },
+    }.Check(request);
+
+    const UniValue& txids = request.params[0].get_array();
+    std::vector<uint256> hashes;
+    hashes.reserve(txids.size());
+    for (unsigned int i = 0; i < txids.size(); ++i) {
+        hashes.push_back(ParseHashV(txids[i], "txid"));
+    }
+
+    // Accept either a bool (true) or a num (>=1) to indicate verbose output.
+    bool fVerbose = false;
+    if (!request.params[1].isNull()) {
+        fVerbose = request.params[1].isNum() ? (request.params[1].get_int() != 0) : request.params[1].get_bool();
+    }
+
+    std::vector<CTransactionRef> txs(hashes.size());
+    std::vector<uint256> block_hashes(hashes.size());
+    // Look up the transactions not in the mempool in a single pass over the index.
+    std::vector<size_t> missing;
+    std::vector<uint256> missing_hashes;
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        txs[i] = mempool.get(hashes[i]);
+        if (!txs[i] && hashes[i] != Params().GenesisBlock().hashMerkleRoot) {
+            missing.push_back(i);
+            missing_hashes.push_back(hashes[i]);
+        }
+    }
+
+    if (g_txindex && !missing.empty()) {
+        g_txindex->BlockUntilSyncedToCurrentChain();
+        std::vector<uint256> found_blocks;
+        std::vector<CTransactionRef> found_txs;
+        if (!g_txindex->FindTxs(missing_hashes, found_blocks, found_txs)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the transactions from disk");
+        }
+        for (size_t j = 0; j < missing.size(); ++j) {
+            txs[missing[j]] = found_txs[j];
+            block_hashes[missing[j]] = found_blocks[j];
+        }
+    }
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        if (!txs[i]) {
+            result.push_back(NullUniValue);
+        } else if (!fVerbose) {
+            result.push_back(EncodeHexTx(*txs[i], RPCSerializationFlags()));
+        } else {
+            UniValue entry(UniValue::VOBJ);
+            TxToJSON(*txs[i], block_hashes[i], entry);
+            result.push_back(entry);
+        }
+    }
+    return result;
+}
+
 static UniValue gettxoutproof(const JSONRPCRequest& request)
 {
             RPCHelpMan{"gettxoutproof",
@@ -297,6 +381,23 @@ static UniValue gettxoutproof(const JSONRPCRequest& request)
         }
     }
 
+    CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+
+    // With txindex, the proof is built from the txids of the block instead of the block itself.
+    const std::shared_ptr<const MerkleTreeLevels> levels = g_txindex ? g_txindex->GetMerkleTreeLevels(pblockindex->GetBlockHash()) : nullptr;
+    if (levels && levels->back().front() == pblockindex->hashMerkleRoot) {
+        std::vector<unsigned int> matched_positions;
+        const std::vector<uint256>& block_txids = levels->front();
+        for (unsigned int i = 0; i < block_txids.size(); ++i) {
+            if (setTxids.count(block_txids[i])) matched_positions.push_back(i);
+        }
+        if (matched_positions.size() != setTxids.size())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Not all transactions found in specified or retrieved block");
+
+        ssMB << CMerkleBlock(pblockindex->GetBlockHeader(), *levels, matched_positions);
+        return HexStr(ssMB.begin(), ssMB.end());
+    }
+
     CBlock block;
     if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
@@ -308,7 +409,6 @@ static UniValue gettxoutproof(const JSONRPCRequest& request)
     if (ntxFound != setTxids.size())
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Not all transactions found in specified or retrieved block");
 
-    CDataStream ssMB(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
     CMerkleBlock mb(block, setTxids);
     ssMB << mb;
     std::string strHex = HexStr(ssMB.begin(), ssMB.end());
@@ -950,6 +1050,78 @@ static UniValue testmempoolaccept(const JSONRPCRequest& request)
     return result;
 }
 
+static UniValue submitpackage(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"submitpackage",
+                "\nSubmit a package of raw transactions (serialized, hex-encoded) to local node and network.\n"
+                "\nThe package is evaluated as a unit: a transaction that pays too little fee on its own is\n"
+                "accepted if the feerate of the whole package is high enough. Either all transactions are\n"
+                "accepted or none are. The package must be sorted so that parents come before their children,\n"
+                "and its transactions may not conflict with each other or with the mempool.\n",
+                {
+                    {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of hex strings of raw transactions, parents first.",
+                        {
+                            {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
+                        },
+                        },
+                    {"maxfeerate", RPCArg::Type::AMOUNT, /* default */ FormatMoney(DEFAULT_MAX_RAW_TX_FEE_RATE.GetFeePerK()),
+                        "Reject packages whose fee rate is higher than the specified value, expressed in " + CURRENCY_UNIT +
+                            "/kB.\nSet to 0 to accept any fee rate.\n"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "The transaction hashes of the package in hex",
+                    {
+                        {RPCResult::Type::STR_HEX, "", "The transaction hash in hex"},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("submitpackage", R"('["parenthex","childhex"]')") +
+                    HelpExampleRpc("submitpackage", "[\"parenthex\",\"childhex\"]")
+                },
+    }.Check(request);
+
+    RPCTypeCheck(request.params, {
+        UniValue::VARR,
+        UniValue::VNUM,
+    });
+
+    const UniValue& rawtxs = request.params[0].get_array();
+    if (rawtxs.size() == 0 || rawtxs.size() > MAX_PACKAGE_COUNT) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Array must contain between 1 and %u transactions", MAX_PACKAGE_COUNT));
+    }
+
+    std::vector<CTransactionRef> package;
+    package.reserve(rawtxs.size());
+    int64_t virtual_size = 0;
+    for (size_t i = 0; i < rawtxs.size(); ++i) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, rawtxs[i].get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        }
+        package.push_back(MakeTransactionRef(std::move(mtx)));
+        virtual_size += GetVirtualTransactionSize(*package.back());
+    }
+
+    CFeeRate max_raw_tx_fee_rate = DEFAULT_MAX_RAW_TX_FEE_RATE;
+    if (!request.params[1].isNull()) {
+        max_raw_tx_fee_rate = CFeeRate(AmountFromValue(request.params[1]));
+    }
+    CAmount max_raw_tx_fee = max_raw_tx_fee_rate.GetFee(virtual_size);
+
+    std::string err_string;
+    AssertLockNotHeld(cs_main);
+    const TransactionError err = BroadcastPackage(*g_rpc_node, package, err_string, max_raw_tx_fee, /*relay*/ true, /*wait_callback*/ true);
+    if (TransactionError::OK != err) {
+        throw JSONRPCTransactionError(err, err_string);
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const CTransactionRef& tx : package) {
+        result.push_back(tx->GetHash().GetHex());
+    }
+    return result;
+}
+
 static std::string WriteHDKeypath(std::vector<uint32_t>& keypath)
 {
     std::string keypath_str = "m";
@@ -1824,6 +1996,7 @@ static const CRPCCommand commands[] =
 { //  category              name                            actor (function)            argNames
   //  --------------------- ------------------------        -----------------------     ----------
     { "rawtransactions",    "getrawtransaction",            &getrawtransaction,         {"txid","verbose","blockhash"} },
+    { "rawtransactions",    "getrawtransactions",           &getrawtransactions,        {"txids","verbose"} },
     { "rawtransactions",    "createrawtransaction",         &createrawtransaction,      {"inputs","outputs","locktime","replaceable"} },
     { "rawtransactions",    "decoderawtransaction",         &decoderawtransaction,      {"hexstring","iswitness"} },
     { "rawtransactions",    "decodescript",                 &decodescript,              {"hexstring"} },
@@ -1831,6 +2004,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "combinerawtransaction",        &combinerawtransaction,     {"txs"} },
     { "rawtransactions",    "signrawtransactionwithkey",    &signrawtransactionwithkey, {"hexstring","privkeys","prevtxs","sighashtype"} },
     { "rawtransactions",    "testmempoolaccept",            &testmempoolaccept,         {"rawtxs","allowhighfees|maxfeerate"} },
+    { "rawtransactions",    "submitpackage",                &submitpackage,             {"rawtxs","maxfeerate"} },
     { "rawtransactions",    "decodepsbt",                   &decodepsbt,                {"psbt"} },
     { "rawtransactions",    "combinepsbt",                  &combinepsbt,               {"txs"} },
     { "rawtransactions",    "finalizepsbt",                 &finalizepsbt,              {"psbt", "extract"} },
@@ -1847,4 +2021,10 @@ static const CRPCCommand commands[] =
 
     for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++)
         t.appendCommand(commands[vcidx].name, &commands[vcidx]);
+
+    // Only confirmed transactions are cached, found in the given block or through -txindex
+    RegisterRPCCacheable("getrawtransaction", {[](const JSONRPCRequest& request, const UniValue& result) {
+        const UniValue& blockhash = result.isObject() ? find_value(result, "blockhash") : request.params[2];
+        return blockhash.isStr() ? GetBuriedBlockHeight(ParseHashV(blockhash, "blockhash")) : -1;
+    }, RefreshRPCConfirmations});
 }
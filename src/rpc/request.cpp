@@ -12,6 +12,11 @@
 #include <util/system.h>
 #include <util/strencodings.h>
 
+#include <limits>
+#include <locale>
+#include <sstream>
+#include <string.h>
+
 /**
  * JSON-RPC protocol.  Palladium speaks version 1.0 for maximum compatibility,
  * but uses JSON-RPC 1.1/2.0 standards for parts of the 1.0 standard that were
@@ -48,6 +53,178 @@ std::string JSONRPCReply(const UniValue& result, const UniValue& error, const Un
     return reply.write() + "\n";
 }
 
+namespace {
+
+enum CBORMajorType : uint8_t {
+    CBOR_UNSIGNED = 0,
+    CBOR_NEGATIVE = 1,
+    CBOR_BYTES = 2,
+    CBOR_TEXT = 3,
+    CBOR_ARRAY = 4,
+    CBOR_MAP = 5,
+    CBOR_TAG = 6,
+    CBOR_SIMPLE = 7,
+};
+
+const uint64_t CBOR_TAG_DECIMAL_FRACTION = 4;
+const uint64_t CBOR_TAG_EXPECT_BASE16 = 23;
+
+void WriteCBORHead(std::string& out, CBORMajorType major, uint64_t n)
+{
+    const char type = major << 5;
+    int size;
+    if (n < 24) {
+        out.push_back(type | n);
+        return;
+    } else if (n <= 0xff) {
+        out.push_back(type | 24);
+        size = 1;
+    } else if (n <= 0xffff) {
+        out.push_back(type | 25);
+        size = 2;
+    } else if (n <= 0xffffffff) {
+        out.push_back(type | 26);
+        size = 4;
+    } else {
+        out.push_back(type | 27);
+        size = 8;
+    }
+    for (int i = size - 1; i >= 0; --i) {
+        out.push_back((n >> (8 * i)) & 0xff);
+    }
+}
+
+void WriteCBORInt(std::string& out, bool negative, uint64_t magnitude)
+{
+    if (negative) {
+        WriteCBORHead(out, CBOR_NEGATIVE, magnitude - 1);
+    } else {
+        WriteCBORHead(out, CBOR_UNSIGNED, magnitude);
+    }
+}
+
+void WriteCBORText(std::string& out, const std::string& str)
+{
+    WriteCBORHead(out, CBOR_TEXT, str.size());
+    out += str;
+}
+
+bool IsLowerHex(const std::string& str)
+{
+    if (str.empty() || str.size() % 2) return false;
+    for (const char c : str) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    }
+    return true;
+}
+
+void WriteCBORNumber(std::string& out, const std::string& str)
+{
+    // Integers and plain decimals are encoded exactly; anything else (an
+    // exponent, too many digits) as a double.
+    bool negative = !str.empty() && str[0] == '-';
+    uint64_t mantissa = 0;
+    int frac_digits = -1;
+    bool exact = str.size() > (negative ? 1U : 0U);
+    for (size_t i = negative; exact && i < str.size(); ++i) {
+        const char c = str[i];
+        if (c == '.' && frac_digits < 0) {
+            frac_digits = 0;
+        } else if (c >= '0' && c <= '9' && mantissa <= (std::numeric_limits<uint64_t>::max() - (c - '0')) / 10) {
+            mantissa = mantissa * 10 + (c - '0');
+            if (frac_digits >= 0) ++frac_digits;
+        } else {
+            exact = false;
+        }
+    }
+    // Keep the sign of negative zero, and the digits of a fraction.
+    if (exact && negative && mantissa == 0) exact = false;
+    if (exact && frac_digits > 0) {
+        WriteCBORHead(out, CBOR_TAG, CBOR_TAG_DECIMAL_FRACTION);
+        WriteCBORHead(out, CBOR_ARRAY, 2);
+        WriteCBORInt(out, true, frac_digits);
+        WriteCBORInt(out, negative, mantissa);
+    } else if (exact && frac_digits < 0) {
+        WriteCBORInt(out, negative, mantissa);
+    } else {
+        std::istringstream stream(str);
+        stream.imbue(std::locale::classic());
+        double d = 0;
+        stream >> d;
+        uint64_t bits;
+        static_assert(sizeof(bits) == sizeof(d), "double must have 64 bits");
+        memcpy(&bits, &d, sizeof(bits));
+        out.push_back((CBOR_SIMPLE << 5) | 27);
+        for (int i = 7; i >= 0; --i) {
+            out.push_back((bits >> (8 * i)) & 0xff);
+        }
+    }
+}
+
+void WriteCBOR(std::string& out, const UniValue& value)
+{
+    switch (value.getType()) {
+    case UniValue::VNULL:
+        out.push_back((CBOR_SIMPLE << 5) | 22);
+        break;
+    case UniValue::VBOOL:
+        out.push_back((CBOR_SIMPLE << 5) | (value.get_bool() ? 21 : 20));
+        break;
+    case UniValue::VNUM:
+        WriteCBORNumber(out, value.getValStr());
+        break;
+    case UniValue::VSTR: {
+        const std::string& str = value.getValStr();
+        if (IsLowerHex(str)) {
+            WriteCBORHead(out, CBOR_TAG, CBOR_TAG_EXPECT_BASE16);
+            WriteCBORHead(out, CBOR_BYTES, str.size() / 2);
+            for (size_t i = 0; i < str.size(); i += 2) {
+                out.push_back((HexDigit(str[i]) << 4) | HexDigit(str[i + 1]));
+            }
+        } else {
+            WriteCBORText(out, str);
+        }
+        break;
+    }
+    case UniValue::VARR:
+        WriteCBORHead(out, CBOR_ARRAY, value.size());
+        for (const UniValue& item : value.getValues()) {
+            WriteCBOR(out, item);
+        }
+        break;
+    case UniValue::VOBJ:
+        WriteCBORHead(out, CBOR_MAP, value.size());
+        for (size_t i = 0; i < value.size(); ++i) {
+            WriteCBORText(out, value.getKeys()[i]);
+            WriteCBOR(out, value[i]);
+        }
+        break;
+    }
+}
+
+} // namespace
+
+std::string EncodeCBOR(const UniValue& value)
+{
+    std::string out;
+    WriteCBOR(out, value);
+    return out;
+}
+
+std::string JSONRPCReplyCBOR(const UniValue& result, const UniValue& error, const UniValue& id)
+{
+    // Same as JSONRPCReplyObj, without copying the result into a new object
+    std::string out;
+    WriteCBORHead(out, CBOR_MAP, 3);
+    WriteCBORText(out, "result");
+    WriteCBOR(out, error.isNull() ? result : NullUniValue);
+    WriteCBORText(out, "error");
+    WriteCBOR(out, error);
+    WriteCBORText(out, "id");
+    WriteCBOR(out, id);
+    return out;
+}
+
 UniValue JSONRPCError(int code, const std::string& message)
 {
     UniValue error(UniValue::VOBJ);
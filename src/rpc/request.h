@@ -13,6 +13,15 @@
 UniValue JSONRPCRequestObj(const std::string& strMethod, const UniValue& params, const UniValue& id);
 UniValue JSONRPCReplyObj(const UniValue& result, const UniValue& error, const UniValue& id);
 std::string JSONRPCReply(const UniValue& result, const UniValue& error, const UniValue& id);
+/**
+ * Encode a JSON value as CBOR (RFC 8949). Nonempty strings of lowercase hex
+ * digits become byte strings tagged for conversion to base16 (tag 23), and
+ * numbers with a fractional part decimal fractions (tag 4), so a decoder can
+ * restore exactly the JSON value.
+ */
+std::string EncodeCBOR(const UniValue& value);
+/** The reply JSONRPCReply would make, encoded with EncodeCBOR. */
+std::string JSONRPCReplyCBOR(const UniValue& result, const UniValue& error, const UniValue& id);
 UniValue JSONRPCError(int code, const std::string& message);
 
 /** Generate a new RPC authentication cookie and write it to disk */
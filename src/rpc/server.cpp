@@ -5,17 +5,22 @@
 
 #include <rpc/server.h>
 
+#include <httpserver.h>
 #include <rpc/util.h>
 #include <shutdown.h>
 #include <sync.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 
 #include <boost/signals2/signal.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 
+#include <atomic>
+#include <list>
 #include <memory> // for unique_ptr
+#include <thread>
 #include <unordered_map>
 
 static RecursiveMutex cs_rpcWarmup;
@@ -28,6 +33,128 @@ static RPCTimerInterface* timerInterface = nullptr;
 static Mutex g_deadline_timers_mutex;
 static std::map<std::string, std::unique_ptr<RPCTimerBase> > deadlineTimers GUARDED_BY(g_deadline_timers_mutex);
 static bool ExecuteCommand(const CRPCCommand& command, const JSONRPCRequest& request, UniValue& result, bool last_handler);
+static UniValue ExecuteCached(const std::vector<const CRPCCommand*>& commands, const RPCCacheable& cacheable, const JSONRPCRequest& request);
+
+/** Least recently used cache of results of RPCCacheable methods, bounded by -rpccachesize. */
+class RPCResultCache
+{
+public:
+    void SetMaxSize(size_t max_size)
+    {
+        LOCK(m_mutex);
+        m_max_size = max_size;
+        Trim();
+    }
+
+    bool Enabled() const
+    {
+        LOCK(m_mutex);
+        return m_max_size > 0;
+    }
+
+    //! Changes whenever results are forgotten, so that results computed before can be told apart.
+    uint64_t Generation() const
+    {
+        LOCK(m_mutex);
+        return m_generation;
+    }
+
+    bool Get(const std::string& key, UniValue& result, int& height)
+    {
+        LOCK(m_mutex);
+        const auto it = m_index.find(key);
+        if (it == m_index.end()) {
+            ++m_misses;
+            return false;
+        }
+        ++m_hits;
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        result = it->second->result;
+        height = it->second->height;
+        return true;
+    }
+
+    void Put(const std::string& key, const UniValue& result, int height, uint64_t generation)
+    {
+        LOCK(m_mutex);
+        if (generation != m_generation || m_index.count(key)) return;
+        const size_t size = 2 * key.size() + result.write().size() + sizeof(Entry);
+        if (size > m_max_size) return;
+        m_entries.push_front(Entry{key, result, height, size});
+        m_index.emplace(key, m_entries.begin());
+        m_size += size;
+        Trim();
+    }
+
+    void ForgetFrom(int height)
+    {
+        LOCK(m_mutex);
+        ++m_generation;
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            if (it->height >= height) {
+                m_size -= it->size;
+                m_index.erase(it->key);
+                it = m_entries.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    UniValue GetInfo() const
+    {
+        LOCK(m_mutex);
+        UniValue info(UniValue::VOBJ);
+        info.pushKV("entries", (uint64_t)m_entries.size());
+        info.pushKV("bytes", (uint64_t)m_size);
+        info.pushKV("max_bytes", (uint64_t)m_max_size);
+        info.pushKV("hits", m_hits);
+        info.pushKV("misses", m_misses);
+        return info;
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        UniValue result;
+        int height;
+        //! Estimated memory use
+        size_t size;
+    };
+
+    mutable Mutex m_mutex;
+    //! Most recently used first
+    std::list<Entry> m_entries GUARDED_BY(m_mutex);
+    std::unordered_map<std::string, std::list<Entry>::iterator> m_index GUARDED_BY(m_mutex);
+    size_t m_size GUARDED_BY(m_mutex){0};
+    size_t m_max_size GUARDED_BY(m_mutex){0};
+    uint64_t m_generation GUARDED_BY(m_mutex){0};
+    uint64_t m_hits GUARDED_BY(m_mutex){0};
+    uint64_t m_misses GUARDED_BY(m_mutex){0};
+
+    void Trim() EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        while (m_size > m_max_size) {
+            m_size -= m_entries.back().size;
+            m_index.erase(m_entries.back().key);
+            m_entries.pop_back();
+        }
+    }
+};
+
+static RPCResultCache g_rpc_result_cache;
+//! Filled in while the RPC tables are registered, before any call is executed.
+static std::map<std::string, RPCCacheable> g_rpc_cacheable;
+
+void RegisterRPCCacheable(const std::string& method, RPCCacheable cacheable)
+{
+    g_rpc_cacheable[method] = std::move(cacheable);
+}
+
+void ForgetRPCCacheFrom(int height)
+{
+    g_rpc_result_cache.ForgetFrom(height);
+}
 
 struct RPCCommandExecutionInfo
 {
@@ -210,6 +337,34 @@ static UniValue getrpcinfo(const JSONRPCRequest& request)
                             }},
                         }},
                         {RPCResult::Type::STR, "logpath", "The complete file path to the debug log"},
+                        {RPCResult::Type::OBJ, "work_queue", /* optional */ true, "The queue of HTTP requests waiting for a worker thread, unless routed to another queue",
+                        {
+                            {RPCResult::Type::NUM, "depth", "The number of requests in the queue"},
+                            {RPCResult::Type::NUM, "max_depth", "The number of requests the queue holds (-rpcworkqueue)"},
+                            {RPCResult::Type::NUM, "peak_depth", "The largest number of requests that were in the queue"},
+                            {RPCResult::Type::NUM, "delayed", "The number of requests that found the queue full and waited for room"},
+                            {RPCResult::Type::NUM, "rejected", "The number of requests rejected because the queue stayed full"},
+                            {RPCResult::Type::ARR, "wait_histogram", "The number of requests that waited in the queue for less than 1 ms, 10 ms, 100 ms, 1 s, 10 s, and longer",
+                            {
+                                {RPCResult::Type::NUM, "", "The number of requests"},
+                            }},
+                        }},
+                        {RPCResult::Type::OBJ, "priority_queue", /* optional */ true, "The queue of calls of the -rpcprioritymethod methods, with the same fields as work_queue (only present with -rpcprioritythreads)",
+                        {
+                            {RPCResult::Type::ELISION, "", ""},
+                        }},
+                        {RPCResult::Type::OBJ, "rest_queue", /* optional */ true, "The queue of REST requests, with the same fields as work_queue (only present with -restthreads)",
+                        {
+                            {RPCResult::Type::ELISION, "", ""},
+                        }},
+                        {RPCResult::Type::OBJ, "result_cache", /* optional */ true, "The cache of results about buried blocks (only present with -rpccachesize)",
+                        {
+                            {RPCResult::Type::NUM, "entries", "The number of cached results"},
+                            {RPCResult::Type::NUM, "bytes", "The estimated memory use of the cached results"},
+                            {RPCResult::Type::NUM, "max_bytes", "The size limit of the cache (-rpccachesize)"},
+                            {RPCResult::Type::NUM, "hits", "The number of calls answered from the cache"},
+                            {RPCResult::Type::NUM, "misses", "The number of calls of cacheable methods that had to be executed"},
+                        }},
                     }
                 },
                 RPCExamples{
@@ -233,6 +388,26 @@ static UniValue getrpcinfo(const JSONRPCRequest& request)
     UniValue log_path(UniValue::VSTR, path);
     result.pushKV("logpath", log_path);
 
+    for (const auto& queue : {std::make_pair("", "work_queue"), std::make_pair(HTTP_QUEUE_PRIORITY, "priority_queue"), std::make_pair(HTTP_QUEUE_REST, "rest_queue")}) {
+        HTTPWorkQueueInfo queue_info;
+        if (!GetHTTPWorkQueueInfo(queue_info, queue.first)) continue;
+        UniValue work_queue(UniValue::VOBJ);
+        work_queue.pushKV("depth", (uint64_t)queue_info.depth);
+        work_queue.pushKV("max_depth", (uint64_t)queue_info.max_depth);
+        work_queue.pushKV("peak_depth", (uint64_t)queue_info.peak_depth);
+        work_queue.pushKV("delayed", queue_info.delayed);
+        work_queue.pushKV("rejected", queue_info.rejected);
+        UniValue histogram(UniValue::VARR);
+        for (const uint64_t count : queue_info.wait_histogram) {
+            histogram.push_back(count);
+        }
+        work_queue.pushKV("wait_histogram", histogram);
+        result.pushKV(queue.second, work_queue);
+    }
+    if (g_rpc_result_cache.Enabled()) {
+        result.pushKV("result_cache", g_rpc_result_cache.GetInfo());
+    }
+
     return result;
 }
 
@@ -285,6 +460,7 @@ bool CRPCTable::removeCommand(const std::string& name, const CRPCCommand* pcmd)
 void StartRPC()
 {
     LogPrint(BCLog::RPC, "Starting RPC\n");
+    g_rpc_result_cache.SetMaxSize(std::max<int64_t>(gArgs.GetArg("-rpccachesize", DEFAULT_RPC_CACHE_SIZE), 0) << 20);
     g_rpc_running = true;
     g_rpcSignals.Started();
 }
@@ -362,9 +538,37 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
 
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
 {
+    const size_t num_threads = std::min<size_t>(std::max<int64_t>(gArgs.GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS), 1), vReq.size());
+    std::vector<UniValue> replies(vReq.size());
+    if (num_threads <= 1) {
+        for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
+            replies[reqIdx] = JSONRPCExecOne(jreq, vReq[reqIdx]);
+    } else {
+        // Each thread, including this one, takes the next call that hasn't
+        // been started yet. Replies go to the position of their call.
+        std::atomic<size_t> next{0};
+        auto worker = [&jreq, &vReq, &replies, &next] {
+            for (size_t reqIdx = next++; reqIdx < vReq.size(); reqIdx = next++) {
+                replies[reqIdx] = JSONRPCExecOne(jreq, vReq[reqIdx]);
+            }
+        };
+        std::vector<std::thread> threads;
+        threads.reserve(num_threads - 1);
+        for (size_t i = 1; i < num_threads; ++i) {
+            threads.emplace_back([&worker, i] {
+                util::ThreadRename(strprintf("rpcbatch.%i", i));
+                worker();
+            });
+        }
+        worker();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
     UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+    for (const UniValue& reply : replies)
+        ret.push_back(reply);
 
     return ret.write() + "\n";
 }
@@ -431,6 +635,10 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
     // Find method
     auto it = mapCommands.find(request.strMethod);
     if (it != mapCommands.end()) {
+        const auto cacheable = g_rpc_cacheable.find(request.strMethod);
+        if (cacheable != g_rpc_cacheable.end() && !it->second.empty() && g_rpc_result_cache.Enabled()) {
+            return ExecuteCached(it->second, cacheable->second, request);
+        }
         UniValue result;
         for (const auto& command : it->second) {
             if (ExecuteCommand(*command, request, result, &command == &it->second.back())) {
@@ -441,6 +649,30 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
     throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
 }
 
+/** Execute a method whose results may be in the result cache. */
+static UniValue ExecuteCached(const std::vector<const CRPCCommand*>& commands, const RPCCacheable& cacheable, const JSONRPCRequest& request)
+{
+    // Key on the positional parameters, so that calls with named parameters share the entries
+    const JSONRPCRequest positional = request.params.isObject() ? transformNamedArguments(request, commands.front()->argNames) : request;
+    const std::string key = request.strMethod + '\0' + positional.params.write();
+
+    UniValue result;
+    int height;
+    if (g_rpc_result_cache.Get(key, result, height)) {
+        cacheable.refresh(result, height);
+        return result;
+    }
+    const uint64_t generation = g_rpc_result_cache.Generation();
+    for (const auto& command : commands) {
+        if (ExecuteCommand(*command, positional, result, &command == &commands.back())) {
+            height = cacheable.height(positional, result);
+            if (height >= 0) g_rpc_result_cache.Put(key, result, height, generation);
+            return result;
+        }
+    }
+    throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+}
+
 static bool ExecuteCommand(const CRPCCommand& command, const JSONRPCRequest& request, UniValue& result, bool last_handler)
 {
     try
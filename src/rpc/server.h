@@ -17,6 +17,10 @@
 #include <univalue.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+/** Default for -rpcbatchthreads: execute the calls of a batch one after another */
+static const int DEFAULT_RPC_BATCH_THREADS = 1;
+/** Default for -rpccachesize, in MiB (0 = don't cache results) */
+static const int64_t DEFAULT_RPC_CACHE_SIZE = 0;
 
 class CRPCCommand;
 
@@ -83,6 +87,25 @@ void RPCRunLater(const std::string& name, std::function<void()> func, int64_t nS
 
 typedef UniValue(*rpcfn_type)(const JSONRPCRequest& jsonRequest);
 
+/**
+ * Describes a method whose results can be kept in the result cache
+ * (-rpccachesize), because they don't change any more once the block they are
+ * about is buried in the active chain. Results are cached by method and
+ * positional parameters.
+ */
+struct RPCCacheable
+{
+    //! Height of the active chain block a result is about, or -1 if it mustn't be cached.
+    std::function<int(const JSONRPCRequest& request, const UniValue& result)> height;
+    //! Bring a cached result about the block at height up to date with the tip, e.g. its confirmations.
+    std::function<void(UniValue& result, int height)> refresh;
+};
+
+/** Allow the results of method to be cached. */
+void RegisterRPCCacheable(const std::string& method, RPCCacheable cacheable);
+/** Drop the cached results about blocks at or above height, which a reorg replaced. */
+void ForgetRPCCacheFrom(int height);
+
 class CRPCCommand
 {
 public:
@@ -162,6 +185,11 @@ extern CRPCTable tableRPC;
 void StartRPC();
 void InterruptRPC();
 void StopRPC();
+/**
+ * Execute the calls of a batch request and return the replies in the same
+ * order. With -rpcbatchthreads above 1, up to that many calls of the batch run
+ * at the same time on threads started for the batch.
+ */
 std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq);
 
 // Retrieves any serialization flags requested in command line argument
@@ -7,10 +7,13 @@
 #include <rpc/util.h>
 #include <script/descriptor.h>
 #include <script/signingprovider.h>
+#include <sync.h>
 #include <tinyformat.h>
 #include <util/strencodings.h>
 #include <util/string.h>
+#include <util/system.h>
 
+#include <list>
 #include <tuple>
 
 const std::string UNIX_EPOCH_TIME = "UNIX epoch time";
@@ -783,6 +786,55 @@ std::pair<int64_t, int64_t> ParseDescriptorRange(const UniValue& value)
     return {low, high};
 }
 
+//! Most descriptor expansions kept by ExpandDescriptorRange
+static constexpr size_t MAX_EXPANDED_DESCRIPTORS = 16;
+//! Most scripts kept by ExpandDescriptorRange, over all its expansions
+static constexpr size_t MAX_EXPANDED_DESCRIPTOR_SCRIPTS = 200000;
+
+static Mutex g_expanded_descriptors_mutex;
+//! Recent expansions by descriptor and range, most recently used first
+static std::list<std::pair<std::string, std::shared_ptr<const ExpandedDescriptor>>> g_expanded_descriptors GUARDED_BY(g_expanded_descriptors_mutex);
+static size_t g_expanded_descriptor_scripts GUARDED_BY(g_expanded_descriptors_mutex) = 0;
+
+std::shared_ptr<const ExpandedDescriptor> ExpandDescriptorRange(const Descriptor& desc, int64_t begin, int64_t end, const FlatSigningProvider& provider)
+{
+    // Only public descriptors are kept, so that neither the key nor a later
+    // lookup without the private keys can reveal what they derive.
+    const bool cacheable = provider.keys.empty();
+    const std::string key = strprintf("%s/%d-%d", desc.ToString(), begin, end);
+    if (cacheable) {
+        LOCK(g_expanded_descriptors_mutex);
+        for (auto it = g_expanded_descriptors.begin(); it != g_expanded_descriptors.end(); ++it) {
+            if (it->first == key) {
+                g_expanded_descriptors.splice(g_expanded_descriptors.begin(), g_expanded_descriptors, it);
+                return it->second;
+            }
+        }
+    }
+
+    std::vector<std::vector<CScript>> scripts;
+    std::vector<FlatSigningProvider> providers;
+    if (!ExpandRange(desc, begin, end, provider, scripts, providers, std::max(1, GetNumCores()))) return nullptr;
+    auto expanded = std::make_shared<ExpandedDescriptor>();
+    for (size_t i = 0; i < scripts.size(); ++i) {
+        std::move(scripts[i].begin(), scripts[i].end(), std::back_inserter(expanded->scripts));
+        const FlatSigningProvider& p = providers[i];
+        expanded->provider.scripts.insert(p.scripts.begin(), p.scripts.end());
+        expanded->provider.pubkeys.insert(p.pubkeys.begin(), p.pubkeys.end());
+        expanded->provider.origins.insert(p.origins.begin(), p.origins.end());
+    }
+    if (cacheable && expanded->scripts.size() <= MAX_EXPANDED_DESCRIPTOR_SCRIPTS) {
+        LOCK(g_expanded_descriptors_mutex);
+        g_expanded_descriptors.emplace_front(key, expanded);
+        g_expanded_descriptor_scripts += expanded->scripts.size();
+        while (g_expanded_descriptors.size() > MAX_EXPANDED_DESCRIPTORS || g_expanded_descriptor_scripts > MAX_EXPANDED_DESCRIPTOR_SCRIPTS) {
+            g_expanded_descriptor_scripts -= g_expanded_descriptors.back().second->scripts.size();
+            g_expanded_descriptors.pop_back();
+        }
+    }
+    return expanded;
+}
+
 std::vector<CScript> EvalDescriptorStringOrObject(const UniValue& scanobject, FlatSigningProvider& provider)
 {
     std::string desc_str;
@@ -810,15 +862,12 @@ std::vector<CScript> EvalDescriptorStringOrObject(const UniValue& scanobject, Fl
         range.first = 0;
         range.second = 0;
     }
-    std::vector<CScript> ret;
-    for (int i = range.first; i <= range.second; ++i) {
-        std::vector<CScript> scripts;
-        if (!desc->Expand(i, provider, scripts, provider)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Cannot derive script without private keys: '%s'", desc_str));
-        }
-        std::move(scripts.begin(), scripts.end(), std::back_inserter(ret));
+    const auto expanded = ExpandDescriptorRange(*desc, range.first, range.second, provider);
+    if (!expanded) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, strprintf("Cannot derive script without private keys: '%s'", desc_str));
     }
-    return ret;
+    provider = Merge(provider, expanded->provider);
+    return expanded->scripts;
 }
 
 UniValue GetServicesNames(ServiceFlags services)
@@ -17,11 +17,14 @@
 #include <univalue.h>
 #include <util/check.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <boost/variant.hpp>
 
+struct Descriptor;
+
 /**
  * String used to describe UNIX epoch time in documentation, factored out to a
  * constant for consistency.
@@ -96,6 +99,21 @@ UniValue JSONRPCTransactionError(TransactionError terr, const std::string& err_s
 //! Parse a JSON range specified as int64, or [int64, int64]
 std::pair<int64_t, int64_t> ParseDescriptorRange(const UniValue& value);
 
+/** Scripts and solving data of a descriptor expanded over a range of positions */
+struct ExpandedDescriptor {
+    //! The scriptPubKeys of all positions, in position order
+    std::vector<CScript> scripts;
+    FlatSigningProvider provider;
+};
+
+/**
+ * Expand a descriptor from begin to end (inclusive) on several threads, see
+ * ExpandRange. Expansions of descriptors without private keys are kept for
+ * later calls with the same descriptor and range. Returns nullptr if a
+ * position could not be expanded.
+ */
+std::shared_ptr<const ExpandedDescriptor> ExpandDescriptorRange(const Descriptor& desc, int64_t begin, int64_t end, const FlatSigningProvider& provider);
+
 /** Evaluate a descriptor given as a string, or as a {"desc":...,"range":...} object, with default range of 1000. */
 std::vector<CScript> EvalDescriptorStringOrObject(const UniValue& scanobject, FlatSigningProvider& provider);
 
@@ -6,6 +6,7 @@
 
 #include <random.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <utility>
 
@@ -29,6 +30,7 @@ void CScheduler::serviceQueue()
     // when the thread is waiting or when the user's function
     // is called.
     while (!shouldStop()) {
+        std::string running_name;
         try {
             if (!shouldStop() && taskQueue.empty()) {
                 REVERSE_LOCK(lock);
@@ -53,16 +55,45 @@ void CScheduler::serviceQueue()
             if (shouldStop() || taskQueue.empty())
                 continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            // Take the first due task that no running task of the same name keeps
+            // back. If there is none, wait for a task to finish or for the next
+            // one to become due.
+            const std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+            auto it = taskQueue.begin();
+            while (it != taskQueue.end() && it->first <= now && m_running.count(it->second.name)) ++it;
+            if (it == taskQueue.end()) {
+                newTaskScheduled.wait(lock);
+                continue;
+            }
+            if (it->first > now) {
+                const std::chrono::system_clock::time_point timeToWaitFor = it->first;
+                newTaskScheduled.wait_until(lock, timeToWaitFor);
+                continue;
+            }
+
+            Task task = std::move(it->second);
+            const int64_t delay = std::chrono::duration_cast<std::chrono::microseconds>(now - it->first).count();
+            taskQueue.erase(it);
+            if (!task.name.empty()) {
+                running_name = task.name;
+                m_running.insert(running_name);
+            }
 
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
             {
                 // Unlock before calling f, so it can reschedule itself or another task
                 // without deadlocking:
                 REVERSE_LOCK(lock);
-                f();
+                task.f();
+            }
+            RecordRun(task.name, delay, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+            if (!running_name.empty()) {
+                m_running.erase(running_name);
+                // Tasks of the same name may be waiting for this one.
+                newTaskScheduled.notify_all();
             }
         } catch (...) {
+            if (!running_name.empty()) m_running.erase(running_name);
             --nThreadsServicingQueue;
             throw;
         }
@@ -83,11 +114,11 @@ void CScheduler::stop(bool drain)
     newTaskScheduled.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, std::chrono::system_clock::time_point t)
+void CScheduler::schedule(CScheduler::Function f, std::chrono::system_clock::time_point t, const std::string& name)
 {
     {
         LOCK(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueue.emplace(t, Task{std::move(f), name});
     }
     newTaskScheduled.notify_one();
 }
@@ -100,7 +131,7 @@ void CScheduler::MockForward(std::chrono::seconds delta_seconds)
         LOCK(newTaskMutex);
 
         // use temp_queue to maintain updated schedule
-        std::multimap<std::chrono::system_clock::time_point, Function> temp_queue;
+        std::multimap<std::chrono::system_clock::time_point, Task> temp_queue;
 
         for (const auto& element : taskQueue) {
             temp_queue.emplace_hint(temp_queue.cend(), element.first - delta_seconds, element.second);
@@ -114,15 +145,15 @@ void CScheduler::MockForward(std::chrono::seconds delta_seconds)
     newTaskScheduled.notify_one();
 }
 
-static void Repeat(CScheduler& s, CScheduler::Function f, std::chrono::milliseconds delta)
+static void Repeat(CScheduler& s, CScheduler::Function f, std::chrono::milliseconds delta, const std::string& name)
 {
     f();
-    s.scheduleFromNow([=, &s] { Repeat(s, f, delta); }, delta);
+    s.scheduleFromNow([=, &s] { Repeat(s, f, delta, name); }, delta, name);
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, std::chrono::milliseconds delta)
+void CScheduler::scheduleEvery(CScheduler::Function f, std::chrono::milliseconds delta, const std::string& name)
 {
-    scheduleFromNow([=] { Repeat(*this, f, delta); }, delta);
+    scheduleFromNow([=] { Repeat(*this, f, delta, name); }, delta, name);
 }
 
 size_t CScheduler::getQueueInfo(std::chrono::system_clock::time_point &first,
@@ -142,6 +173,40 @@ bool CScheduler::AreThreadsServicingQueue() const {
     return nThreadsServicingQueue;
 }
 
+int CScheduler::ThreadsServicingQueue() const
+{
+    LOCK(newTaskMutex);
+    return nThreadsServicingQueue;
+}
+
+void CScheduler::RecordRun(const std::string& name, int64_t delay, int64_t runtime)
+{
+    SchedulerTaskInfo& info = m_task_info[name];
+    ++info.runs;
+    info.total_time += runtime;
+    info.max_time = std::max(info.max_time, runtime);
+    info.total_delay += delay;
+    info.max_delay = std::max(info.max_delay, delay);
+    size_t bucket = 0;
+    while (bucket + 1 < SchedulerTaskInfo::RUNTIME_HISTOGRAM_BUCKETS && runtime >= SchedulerTaskInfo::RuntimeBucketLimit(bucket)) {
+        ++bucket;
+    }
+    ++info.runtime_histogram[bucket];
+}
+
+std::map<std::string, SchedulerTaskInfo> CScheduler::GetTaskInfo() const
+{
+    LOCK(newTaskMutex);
+    std::map<std::string, SchedulerTaskInfo> ret = m_task_info;
+    for (const auto& task : taskQueue) {
+        ++ret[task.second.name].scheduled;
+    }
+    for (const std::string& name : m_running) {
+        ret[name].running = true;
+    }
+    return ret;
+}
+
 
 void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
     {
@@ -152,7 +217,7 @@ void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
         if (m_are_callbacks_running) return;
         if (m_callbacks_pending.empty()) return;
     }
-    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this), std::chrono::system_clock::now());
+    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this), std::chrono::system_clock::now(), m_name);
 }
 
 void SingleThreadedSchedulerClient::ProcessQueue() {
@@ -10,10 +10,13 @@
 // boost::thread should be ported to std::thread
 // when we support C++11.
 //
+#include <array>
 #include <condition_variable>
 #include <functional>
 #include <list>
 #include <map>
+#include <set>
+#include <string>
 
 #include <sync.h>
 
@@ -35,6 +38,38 @@
 // delete s; // Must be done after thread is interrupted/joined.
 //
 
+/** Default number of threads servicing the node's scheduler, so that independent SingleThreadedSchedulerClients progress in parallel */
+static const int DEFAULT_SCHEDULER_THREADS = 4;
+/** Maximum number of scheduler threads */
+static const int MAX_SCHEDULER_THREADS = 16;
+
+/** Statistics of the scheduler tasks sharing a name, see CScheduler::GetTaskInfo() */
+struct SchedulerTaskInfo
+{
+    static constexpr size_t RUNTIME_HISTOGRAM_BUCKETS = 6;
+    /** Upper limit (exclusive, in microseconds) of the run times counted in a bucket but the last: 1 ms, 10 ms, ... */
+    static int64_t RuntimeBucketLimit(size_t bucket)
+    {
+        int64_t limit = 1000;
+        while (bucket--) limit *= 10;
+        return limit;
+    }
+
+    //! Number of runs waiting in the queue
+    size_t scheduled{0};
+    //! Whether a run is in progress
+    bool running{false};
+    uint64_t runs{0};
+    //! Sum and maximum of the run times, in microseconds
+    int64_t total_time{0};
+    int64_t max_time{0};
+    //! Sum and maximum of how late runs started (e.g. waiting for a free thread), in microseconds
+    int64_t total_delay{0};
+    int64_t max_delay{0};
+    //! Number of runs by how long they took
+    std::array<uint64_t, RUNTIME_HISTOGRAM_BUCKETS> runtime_histogram{{}};
+};
+
 class CScheduler
 {
 public:
@@ -43,13 +78,20 @@ public:
 
     typedef std::function<void()> Function;
 
-    // Call func at/after time t
-    void schedule(Function f, std::chrono::system_clock::time_point t);
+    /**
+     * Call func at/after time t.
+     *
+     * Tasks with the same non-empty name never run at the same time, even
+     * with several threads servicing the queue, and their run times are
+     * reported together by GetTaskInfo(). Unnamed tasks may run concurrently
+     * with anything and are reported under the empty name.
+     */
+    void schedule(Function f, std::chrono::system_clock::time_point t, const std::string& name = "");
 
     /** Call f once after the delta has passed */
-    void scheduleFromNow(Function f, std::chrono::milliseconds delta)
+    void scheduleFromNow(Function f, std::chrono::milliseconds delta, const std::string& name = "")
     {
-        schedule(std::move(f), std::chrono::system_clock::now() + delta);
+        schedule(std::move(f), std::chrono::system_clock::now() + delta, name);
     }
 
     /**
@@ -58,7 +100,7 @@ public:
      * The timing is not exact: Every time f is finished, it is rescheduled to run again after delta. If you need more
      * accurate scheduling, don't use this method.
      */
-    void scheduleEvery(Function f, std::chrono::milliseconds delta);
+    void scheduleEvery(Function f, std::chrono::milliseconds delta, const std::string& name = "");
 
     /**
      * Mock the scheduler to fast forward in time.
@@ -86,14 +128,30 @@ public:
     // Returns true if there are threads actively running in serviceQueue()
     bool AreThreadsServicingQueue() const;
 
+    /** Number of threads running serviceQueue() */
+    int ThreadsServicingQueue() const;
+
+    /** Statistics of the tasks scheduled so far, by name */
+    std::map<std::string, SchedulerTaskInfo> GetTaskInfo() const;
+
 private:
+    struct Task {
+        Function f;
+        std::string name;
+    };
+
     mutable Mutex newTaskMutex;
     std::condition_variable newTaskScheduled;
-    std::multimap<std::chrono::system_clock::time_point, Function> taskQueue GUARDED_BY(newTaskMutex);
+    std::multimap<std::chrono::system_clock::time_point, Task> taskQueue GUARDED_BY(newTaskMutex);
+    //! Names of the named tasks running right now
+    std::set<std::string> m_running GUARDED_BY(newTaskMutex);
+    std::map<std::string, SchedulerTaskInfo> m_task_info GUARDED_BY(newTaskMutex);
     int nThreadsServicingQueue GUARDED_BY(newTaskMutex){0};
     bool stopRequested GUARDED_BY(newTaskMutex){false};
     bool stopWhenEmpty GUARDED_BY(newTaskMutex){false};
     bool shouldStop() const EXCLUSIVE_LOCKS_REQUIRED(newTaskMutex) { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
+    //! Record a finished run of a task
+    void RecordRun(const std::string& name, int64_t delay, int64_t runtime) EXCLUSIVE_LOCKS_REQUIRED(newTaskMutex);
 };
 
 /**
@@ -109,6 +167,8 @@ private:
 class SingleThreadedSchedulerClient {
 private:
     CScheduler *m_pscheduler;
+    //! Name of the scheduler tasks processing the queue
+    const std::string m_name;
 
     RecursiveMutex m_cs_callbacks_pending;
     std::list<std::function<void ()>> m_callbacks_pending GUARDED_BY(m_cs_callbacks_pending);
@@ -118,7 +178,7 @@ private:
     void ProcessQueue();
 
 public:
-    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn) : m_pscheduler(pschedulerIn) {}
+    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn, std::string name = "") : m_pscheduler(pschedulerIn), m_name(std::move(name)) {}
 
     /**
      * Add a callback to be executed. Callbacks are executed serially
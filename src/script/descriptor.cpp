@@ -16,8 +16,11 @@
 #include <util/strencodings.h>
 #include <util/vector.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -1099,6 +1102,48 @@ std::unique_ptr<Descriptor> InferDescriptor(const CScript& script, const Signing
     return InferScript(script, ParseScriptContext::TOP, provider);
 }
 
+/** Fewest positions ExpandRange gives a thread of its own */
+static constexpr int MIN_EXPAND_POSITIONS_PER_THREAD = 64;
+
+bool ExpandRange(const Descriptor& desc, int begin, int end, const SigningProvider& provider, std::vector<std::vector<CScript>>& output_scripts, std::vector<FlatSigningProvider>& out, unsigned int num_threads)
+{
+    if (end < begin) return false;
+    const size_t count = (size_t)end - begin + 1;
+    output_scripts.assign(count, {});
+    out.assign(count, {});
+    DescriptorCache cache;
+    if (!desc.Expand(begin, provider, output_scripts[0], out[0], &cache)) return false;
+    if (count == 1) return true;
+
+    // Once the first position was expanded, the others are only read from it
+    // and the cache, so they can be expanded concurrently.
+    std::atomic<bool> from_cache{true};
+    const auto expand_positions = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last && from_cache; ++i) {
+            if (!desc.ExpandFromCache(begin + i, cache, output_scripts[i], out[i])) from_cache = false;
+        }
+    };
+    const size_t num_chunks = std::max<size_t>(1, std::min<size_t>(num_threads, (count - 1) / MIN_EXPAND_POSITIONS_PER_THREAD));
+    const size_t chunk_size = (count - 1 + num_chunks - 1) / num_chunks;
+    std::vector<std::thread> threads;
+    for (size_t first = 1 + chunk_size; first < count; first += chunk_size) {
+        threads.emplace_back(expand_positions, first, std::min(count, first + chunk_size));
+    }
+    expand_positions(1, std::min(count, 1 + chunk_size));
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (from_cache) return true;
+
+    // Hardened derivation: every position needs the private keys.
+    for (size_t i = 1; i < count; ++i) {
+        output_scripts[i].clear();
+        out[i] = FlatSigningProvider();
+        if (!desc.Expand(begin + i, provider, output_scripts[i], out[i])) return false;
+    }
+    return true;
+}
+
 void DescriptorCache::CacheParentExtPubKey(uint32_t key_exp_pos, const CExtPubKey& xpub)
 {
     m_parent_xpubs[key_exp_pos] = xpub;
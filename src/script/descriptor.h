@@ -155,4 +155,18 @@ std::string GetDescriptorChecksum(const std::string& descriptor);
  */
 std::unique_ptr<Descriptor> InferDescriptor(const CScript& script, const SigningProvider& provider);
 
+/** Expand a descriptor at every position from begin to end (inclusive).
+ *
+ * The first position is expanded with Expand(), and the key derivations it
+ * shares with the other positions are cached. The other positions are then
+ * expanded from that cache, split between up to num_threads threads. Ranges
+ * with hardened derivation steps cannot be expanded from the cache and are
+ * expanded on the calling thread.
+ *
+ * @param[out] output_scripts The expanded scriptPubKeys of each position.
+ * @param[out] out Scripts and public keys necessary for solving the scriptPubKeys of each position.
+ * @return false if a position could not be expanded.
+ */
+bool ExpandRange(const Descriptor& desc, int begin, int end, const SigningProvider& provider, std::vector<std::vector<CScript>>& output_scripts, std::vector<FlatSigningProvider>& out, unsigned int num_threads);
+
 #endif // PALLADIUM_SCRIPT_DESCRIPTOR_H
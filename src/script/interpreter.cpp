@@ -60,6 +60,49 @@ static inline void popstack(std::vector<valtype>& stack)
     stack.pop_back();
 }
 
+namespace {
+/**
+ * Buffers of the elements popped off the stacks while evaluating a script,
+ * reused for the elements pushed after them. Signatures, pubkeys and hashes
+ * mostly fit in a buffer freed earlier, so most pushes don't allocate.
+ */
+class StackBufferPool
+{
+    static constexpr size_t MAX_BUFFERS = 8;
+    valtype m_buffers[MAX_BUFFERS];
+    size_t m_count{0};
+
+public:
+    void Pop(std::vector<valtype>& stack)
+    {
+        if (stack.empty())
+            throw std::runtime_error("popstack(): stack empty");
+        if (m_count < MAX_BUFFERS && stack.back().capacity() > 0) {
+            m_buffers[m_count++].swap(stack.back());
+        }
+        stack.pop_back();
+    }
+
+    /** A buffer of the given size, reused if possible. */
+    valtype Take(size_t size)
+    {
+        valtype buffer;
+        if (m_count > 0) buffer.swap(m_buffers[--m_count]);
+        buffer.resize(size);
+        return buffer;
+    }
+
+    /** Push a copy of data, which may be an element of the stack itself. */
+    void Push(std::vector<valtype>& stack, const valtype& data)
+    {
+        valtype elem;
+        if (m_count > 0) elem.swap(m_buffers[--m_count]);
+        elem.assign(data.begin(), data.end());
+        stack.push_back(std::move(elem));
+    }
+};
+} // namespace
+
 bool static IsCompressedOrUncompressedPubKey(const valtype &vchPubKey) {
     if (vchPubKey.size() < CPubKey::COMPRESSED_SIZE) {
         //  Non-canonical public key: too short
@@ -342,8 +385,66 @@ public:
 };
 }
 
+/** Whether script is OP_DUP OP_HASH160 <20 bytes> OP_EQUALVERIFY OP_CHECKSIG. */
+static bool IsPayToPubKeyHash(const CScript& script)
+{
+    return script.size() == 25 &&
+           script[0] == OP_DUP &&
+           script[1] == OP_HASH160 &&
+           script[2] == 20 &&
+           script[23] == OP_EQUALVERIFY &&
+           script[24] == OP_CHECKSIG;
+}
+
+/**
+ * Evaluate a P2PKH script (also run for P2WPKH programs) without
+ * interpreting it opcode by opcode. Gives the same result, error and (on
+ * success) final stack as the generic interpreter for stacks of at least
+ * two elements with room for the OP_DUP.
+ */
+static bool EvalPayToPubKeyHash(std::vector<valtype>& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
+{
+    static const valtype vchFalse(0);
+    static const valtype vchTrue(1, 1);
+
+    const valtype& vchSig = stacktop(-2);
+    const valtype& vchPubKey = stacktop(-1);
+
+    // OP_DUP OP_HASH160 <hash> OP_EQUALVERIFY
+    unsigned char hash[CHash160::OUTPUT_SIZE];
+    CHash160().Write(vchPubKey.data(), vchPubKey.size()).Finalize(hash);
+    if (memcmp(hash, &script[3], sizeof(hash)) != 0)
+        return set_error(serror, SCRIPT_ERR_EQUALVERIFY);
+
+    // OP_CHECKSIG, with the whole script as scriptCode as it has no OP_CODESEPARATOR
+    CScript scriptCode(script.begin(), script.end());
+    if (sigversion == SigVersion::BASE) {
+        int found = FindAndDelete(scriptCode, CScript() << vchSig);
+        if (found > 0 && (flags & SCRIPT_VERIFY_CONST_SCRIPTCODE))
+            return set_error(serror, SCRIPT_ERR_SIG_FINDANDDELETE);
+    }
+    if (!CheckSignatureEncoding(vchSig, flags, serror) || !CheckPubKeyEncoding(vchPubKey, flags, sigversion, serror)) {
+        //serror is set
+        return false;
+    }
+    bool fSuccess = checker.CheckSig(vchSig, vchPubKey, scriptCode, sigversion);
+    if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size())
+        return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
+
+    stack.pop_back();
+    stack.pop_back();
+    stack.push_back(fSuccess ? vchTrue : vchFalse);
+    return set_success(serror);
+}
+
 bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript& script, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
 {
+    // With fewer elements the generic interpreter fails at a point that
+    // depends on the hash; with MAX_STACK_SIZE it fails at the OP_DUP.
+    if (!(flags & SCRIPT_NO_TEMPLATE_FAST_PATH) && IsPayToPubKeyHash(script) && stack.size() >= 2 && stack.size() < MAX_STACK_SIZE) {
+        return EvalPayToPubKeyHash(stack, script, flags, checker, sigversion, serror);
+    }
+
     static const CScriptNum bnZero(0);
     static const CScriptNum bnOne(1);
     // static const CScriptNum bnFalse(0);
@@ -359,6 +460,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
     valtype vchPushValue;
     ConditionStack vfExec;
     std::vector<valtype> altstack;
+    StackBufferPool pool;
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
     if (script.size() > MAX_SCRIPT_SIZE)
         return set_error(serror, SCRIPT_ERR_SCRIPT_SIZE);
@@ -408,7 +510,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 if (fRequireMinimal && !CheckMinimalPush(vchPushValue, opcode)) {
                     return set_error(serror, SCRIPT_ERR_MINIMALDATA);
                 }
-                stack.push_back(vchPushValue);
+                pool.Push(stack, vchPushValue);
             } else if (fExec || (OP_IF <= opcode && opcode <= OP_ENDIF))
             switch (opcode)
             {
@@ -548,7 +650,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         fValue = CastToBool(vch);
                         if (opcode == OP_NOTIF)
                             fValue = !fValue;
-                        popstack(stack);
+                        pool.Pop(stack);
                     }
                     vfExec.push_back(fValue);
                 }
@@ -578,7 +680,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     bool fValue = CastToBool(stacktop(-1));
                     if (fValue)
-                        popstack(stack);
+                        pool.Pop(stack);
                     else
                         return set_error(serror, SCRIPT_ERR_VERIFY);
                 }
@@ -598,8 +700,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    altstack.push_back(stacktop(-1));
-                    popstack(stack);
+                    altstack.push_back(std::move(stacktop(-1)));
+                    pool.Pop(stack);
                 }
                 break;
 
@@ -607,8 +709,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                 {
                     if (altstack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_ALTSTACK_OPERATION);
-                    stack.push_back(altstacktop(-1));
-                    popstack(altstack);
+                    stack.push_back(std::move(altstacktop(-1)));
+                    pool.Pop(altstack);
                 }
                 break;
 
@@ -617,8 +719,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- )
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    popstack(stack);
-                    popstack(stack);
+                    pool.Pop(stack);
+                    pool.Pop(stack);
                 }
                 break;
 
@@ -629,8 +731,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype vch1 = stacktop(-2);
                     valtype vch2 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(std::move(vch1));
+                    stack.push_back(std::move(vch2));
                 }
                 break;
 
@@ -642,9 +744,9 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     valtype vch1 = stacktop(-3);
                     valtype vch2 = stacktop(-2);
                     valtype vch3 = stacktop(-1);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
-                    stack.push_back(vch3);
+                    stack.push_back(std::move(vch1));
+                    stack.push_back(std::move(vch2));
+                    stack.push_back(std::move(vch3));
                 }
                 break;
 
@@ -655,8 +757,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype vch1 = stacktop(-4);
                     valtype vch2 = stacktop(-3);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(std::move(vch1));
+                    stack.push_back(std::move(vch2));
                 }
                 break;
 
@@ -665,11 +767,11 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 x3 x4 x5 x6 -- x3 x4 x5 x6 x1 x2)
                     if (stack.size() < 6)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch1 = stacktop(-6);
-                    valtype vch2 = stacktop(-5);
+                    valtype vch1 = std::move(stacktop(-6));
+                    valtype vch2 = std::move(stacktop(-5));
                     stack.erase(stack.end()-6, stack.end()-4);
-                    stack.push_back(vch1);
-                    stack.push_back(vch2);
+                    stack.push_back(std::move(vch1));
+                    stack.push_back(std::move(vch2));
                 }
                 break;
 
@@ -688,9 +790,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x - 0 | x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    if (CastToBool(vch))
-                        stack.push_back(vch);
+                    if (CastToBool(stacktop(-1)))
+                        pool.Push(stack, stacktop(-1));
                 }
                 break;
 
@@ -707,7 +808,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x -- )
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    popstack(stack);
+                    pool.Pop(stack);
                 }
                 break;
 
@@ -716,8 +817,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x -- x x)
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-1);
-                    stack.push_back(vch);
+                    pool.Push(stack, stacktop(-1));
                 }
                 break;
 
@@ -735,8 +835,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // (x1 x2 -- x1 x2 x1)
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-2);
-                    stack.push_back(vch);
+                    pool.Push(stack, stacktop(-2));
                 }
                 break;
 
@@ -748,13 +847,16 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     int n = CScriptNum(stacktop(-1), fRequireMinimal).getint();
-                    popstack(stack);
+                    pool.Pop(stack);
                     if (n < 0 || n >= (int)stack.size())
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
-                    valtype vch = stacktop(-n-1);
-                    if (opcode == OP_ROLL)
+                    if (opcode == OP_ROLL) {
+                        valtype vch = std::move(stacktop(-n-1));
                         stack.erase(stack.end()-n-1);
-                    stack.push_back(vch);
+                        stack.push_back(std::move(vch));
+                    } else {
+                        pool.Push(stack, stacktop(-n-1));
+                    }
                 }
                 break;
 
@@ -785,7 +887,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 2)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype vch = stacktop(-1);
-                    stack.insert(stack.end()-2, vch);
+                    stack.insert(stack.end()-2, std::move(vch));
                 }
                 break;
 
@@ -819,13 +921,13 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     // zero bytes after it (numerically, 0x01 == 0x0001 == 0x000001)
                     //if (opcode == OP_NOTEQUAL)
                     //    fEqual = !fEqual;
-                    popstack(stack);
-                    popstack(stack);
-                    stack.push_back(fEqual ? vchTrue : vchFalse);
+                    pool.Pop(stack);
+                    pool.Pop(stack);
+                    pool.Push(stack, fEqual ? vchTrue : vchFalse);
                     if (opcode == OP_EQUALVERIFY)
                     {
                         if (fEqual)
-                            popstack(stack);
+                            pool.Pop(stack);
                         else
                             return set_error(serror, SCRIPT_ERR_EQUALVERIFY);
                     }
@@ -857,7 +959,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     case OP_0NOTEQUAL:  bn = (bn != bnZero); break;
                     default:            assert(!"invalid opcode"); break;
                     }
-                    popstack(stack);
+                    pool.Pop(stack);
                     stack.push_back(bn.getvch());
                 }
                 break;
@@ -905,14 +1007,14 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     case OP_MAX:                 bn = (bn1 > bn2 ? bn1 : bn2); break;
                     default:                     assert(!"invalid opcode"); break;
                     }
-                    popstack(stack);
-                    popstack(stack);
+                    pool.Pop(stack);
+                    pool.Pop(stack);
                     stack.push_back(bn.getvch());
 
                     if (opcode == OP_NUMEQUALVERIFY)
                     {
                         if (CastToBool(stacktop(-1)))
-                            popstack(stack);
+                            pool.Pop(stack);
                         else
                             return set_error(serror, SCRIPT_ERR_NUMEQUALVERIFY);
                     }
@@ -928,10 +1030,10 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     CScriptNum bn2(stacktop(-2), fRequireMinimal);
                     CScriptNum bn3(stacktop(-1), fRequireMinimal);
                     bool fValue = (bn2 <= bn1 && bn1 < bn3);
-                    popstack(stack);
-                    popstack(stack);
-                    popstack(stack);
-                    stack.push_back(fValue ? vchTrue : vchFalse);
+                    pool.Pop(stack);
+                    pool.Pop(stack);
+                    pool.Pop(stack);
+                    pool.Push(stack, fValue ? vchTrue : vchFalse);
                 }
                 break;
 
@@ -949,7 +1051,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (stack.size() < 1)
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     valtype& vch = stacktop(-1);
-                    valtype vchHash((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
+                    valtype vchHash = pool.Take((opcode == OP_RIPEMD160 || opcode == OP_SHA1 || opcode == OP_HASH160) ? 20 : 32);
                     if (opcode == OP_RIPEMD160)
                         CRIPEMD160().Write(vch.data(), vch.size()).Finalize(vchHash.data());
                     else if (opcode == OP_SHA1)
@@ -960,8 +1062,8 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         CHash160().Write(vch.data(), vch.size()).Finalize(vchHash.data());
                     else if (opcode == OP_HASH256)
                         CHash256().Write(vch.data(), vch.size()).Finalize(vchHash.data());
-                    popstack(stack);
-                    stack.push_back(vchHash);
+                    pool.Pop(stack);
+                    stack.push_back(std::move(vchHash));
                 }
                 break;
 
@@ -1004,13 +1106,13 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                     if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size())
                         return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
 
-                    popstack(stack);
-                    popstack(stack);
-                    stack.push_back(fSuccess ? vchTrue : vchFalse);
+                    pool.Pop(stack);
+                    pool.Pop(stack);
+                    pool.Push(stack, fSuccess ? vchTrue : vchFalse);
                     if (opcode == OP_CHECKSIGVERIFY)
                     {
                         if (fSuccess)
-                            popstack(stack);
+                            pool.Pop(stack);
                         else
                             return set_error(serror, SCRIPT_ERR_CHECKSIGVERIFY);
                     }
@@ -1100,7 +1202,7 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                             return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
                         if (ikey2 > 0)
                             ikey2--;
-                        popstack(stack);
+                        pool.Pop(stack);
                     }
 
                     // A bug causes CHECKMULTISIG to consume one extra argument
@@ -1113,14 +1215,14 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         return set_error(serror, SCRIPT_ERR_INVALID_STACK_OPERATION);
                     if ((flags & SCRIPT_VERIFY_NULLDUMMY) && stacktop(-1).size())
                         return set_error(serror, SCRIPT_ERR_SIG_NULLDUMMY);
-                    popstack(stack);
+                    pool.Pop(stack);
 
-                    stack.push_back(fSuccess ? vchTrue : vchFalse);
+                    pool.Push(stack, fSuccess ? vchTrue : vchFalse);
 
                     if (opcode == OP_CHECKMULTISIGVERIFY)
                     {
                         if (fSuccess)
-                            popstack(stack);
+                            pool.Pop(stack);
                         else
                             return set_error(serror, SCRIPT_ERR_CHECKMULTISIGVERIFY);
                     }
@@ -1276,23 +1378,79 @@ uint256 GetOutputsHash(const T& txTo)
     return ss.GetHash();
 }
 
+/** Appends serialized data to a byte vector. */
+class ByteVectorWriter
+{
+    std::vector<unsigned char>& m_data;
+
+public:
+    explicit ByteVectorWriter(std::vector<unsigned char>& data) : m_data(data) {}
+
+    int GetType() const { return SER_GETHASH; }
+    int GetVersion() const { return 0; }
+
+    void write(const char* pch, size_t size)
+    {
+        m_data.insert(m_data.end(), (const unsigned char*)pch, (const unsigned char*)pch + size);
+    }
+
+    template<typename T>
+    ByteVectorWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+};
+
+/** Size of an input serialized for a legacy signature hash with its script blanked out. */
+constexpr size_t LEGACY_BLANK_INPUT_SIZE = 36 + 1 + 4;
+
+template <class T>
+bool HasLegacyInputs(const T& txTo)
+{
+    if (txTo.vin.size() < 2) return false;
+    for (const auto& txin : txTo.vin) {
+        if (!txin.scriptSig.empty()) return true;
+    }
+    return false;
+}
+
 } // namespace
 
 template <class T>
-PrecomputedTransactionData::PrecomputedTransactionData(const T& txTo)
+PrecomputedTransactionData::PrecomputedTransactionData(const T& txTo, bool force)
 {
-    // Cache is calculated only for transactions with witness
-    if (txTo.HasWitness()) {
+    // Cache is calculated only for transactions with witness, or on request
+    if (force || txTo.HasWitness()) {
         hashPrevouts = GetPrevoutHash(txTo);
         hashSequence = GetSequenceHash(txTo);
         hashOutputs = GetOutputsHash(txTo);
         ready = true;
     }
+
+    // A legacy SIGHASH_ALL signature hash covers the whole transaction with
+    // the scripts of all other inputs blanked out, so everything but the
+    // input being signed is the same for all inputs.
+    if (force || HasLegacyInputs(txTo)) {
+        CHashWriter prefix(SER_GETHASH, 0);
+        prefix << txTo.nVersion;
+        WriteCompactSize(prefix, txTo.vin.size());
+        m_legacy_prefixes.reserve(txTo.vin.size());
+        m_legacy_suffix.reserve(txTo.vin.size() * LEGACY_BLANK_INPUT_SIZE + ::GetSerializeSize(txTo.vout, PROTOCOL_VERSION) + 4);
+        ByteVectorWriter suffix(m_legacy_suffix);
+        for (const auto& txin : txTo.vin) {
+            m_legacy_prefixes.push_back(prefix);
+            suffix << txin.prevout << CScript() << txin.nSequence;
+            prefix.write((const char*)m_legacy_suffix.data() + m_legacy_suffix.size() - LEGACY_BLANK_INPUT_SIZE, LEGACY_BLANK_INPUT_SIZE);
+        }
+        suffix << txTo.vout << txTo.nLockTime;
+        m_legacy_ready = true;
+    }
 }
 
 // explicit instantiation
-template PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo);
-template PrecomputedTransactionData::PrecomputedTransactionData(const CMutableTransaction& txTo);
+template PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo, bool force);
+template PrecomputedTransactionData::PrecomputedTransactionData(const CMutableTransaction& txTo, bool force);
 
 template <class T>
 uint256 SignatureHash(const CScript& scriptCode, const T& txTo, unsigned int nIn, int nHashType, const CAmount& amount, SigVersion sigversion, const PrecomputedTransactionData* cache)
@@ -1356,6 +1514,19 @@ uint256 SignatureHash(const CScript& scriptCode, const T& txTo, unsigned int nIn
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer<T> txTmp(txTo, scriptCode, nIn, nHashType);
 
+    if (cache && cache->m_legacy_ready && !(nHashType & SIGHASH_ANYONECANPAY) && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        // Resume from the inputs before this one, then hash the inputs after
+        // it and the outputs as serialized once for all inputs.
+        CHashWriter ss = cache->m_legacy_prefixes[nIn];
+        ss << txTo.vin[nIn].prevout;
+        txTmp.SerializeScriptCode(ss);
+        ss << txTo.vin[nIn].nSequence;
+        const size_t suffix_start = (nIn + 1) * LEGACY_BLANK_INPUT_SIZE;
+        ss.write((const char*)cache->m_legacy_suffix.data() + suffix_start, cache->m_legacy_suffix.size() - suffix_start);
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -6,6 +6,7 @@
 #ifndef PALLADIUM_SCRIPT_INTERPRETER_H
 #define PALLADIUM_SCRIPT_INTERPRETER_H
 
+#include <hash.h>
 #include <script/script_error.h>
 #include <primitives/transaction.h>
 
@@ -114,6 +115,11 @@ enum
     // Making OP_CODESEPARATOR and FindAndDelete fail any non-segwit scripts
     //
     SCRIPT_VERIFY_CONST_SCRIPTCODE = (1U << 16),
+
+    // Evaluate standard script templates with the generic interpreter rather than their specialized
+    // paths (not a consensus or policy rule; used to cross-check the specialized paths)
+    //
+    SCRIPT_NO_TEMPLATE_FAST_PATH = (1U << 17),
 };
 
 bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror);
@@ -123,8 +129,16 @@ struct PrecomputedTransactionData
     uint256 hashPrevouts, hashSequence, hashOutputs;
     bool ready = false;
 
+    //! For legacy SIGHASH_ALL signature hashes: the hasher state before each input, and the
+    //! serialization of all inputs with blank scripts followed by the outputs and nLockTime.
+    std::vector<CHashWriter> m_legacy_prefixes;
+    std::vector<unsigned char> m_legacy_suffix;
+    bool m_legacy_ready = false;
+
+    //! Only computed for transactions with witness, unless forced, e.g. before signing them.
+    //! The legacy data is only computed for transactions spending several inputs with a scriptSig.
     template <class T>
-    explicit PrecomputedTransactionData(const T& tx);
+    explicit PrecomputedTransactionData(const T& tx, bool force = false);
 };
 
 enum class SigVersion
@@ -10,6 +10,12 @@
 #include <script/interpreter.h>
 #include <version.h>
 
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+
 namespace {
 
 /** A class that deserializes a single CTransaction one time. */
@@ -122,6 +128,56 @@ int palladiumconsensus_verify_script(const unsigned char *scriptPubKey, unsigned
     return ::verify_script(scriptPubKey, scriptPubKeyLen, am, txTo, txToLen, nIn, flags, err);
 }
 
+int palladiumconsensus_verify_transaction(const unsigned char *txTo, unsigned int txToLen,
+                                    const palladiumconsensus_spent_output *spentOutputs, unsigned int spentOutputsLen,
+                                    unsigned int flags, unsigned int nThreads, int *results, palladiumconsensus_error* err)
+{
+    if (!verify_flags(flags)) {
+        return set_error(err, palladiumconsensus_ERR_INVALID_FLAGS);
+    }
+    try {
+        TxInputStream stream(SER_NETWORK, PROTOCOL_VERSION, txTo, txToLen);
+        CTransaction tx(deserialize, stream);
+        if (GetSerializeSize(tx, PROTOCOL_VERSION) != txToLen)
+            return set_error(err, palladiumconsensus_ERR_TX_SIZE_MISMATCH);
+        if (spentOutputsLen != tx.vin.size() || spentOutputs == nullptr)
+            return set_error(err, palladiumconsensus_ERR_SPENT_OUTPUTS_MISMATCH);
+
+        // Regardless of the verification result, the tx did not error.
+        set_error(err, palladiumconsensus_ERR_OK);
+
+        const PrecomputedTransactionData txdata(tx);
+        std::vector<int> valid(tx.vin.size(), 0);
+        std::atomic<size_t> next_input{0};
+        const auto verify_inputs = [&]() {
+            for (size_t nIn = next_input++; nIn < tx.vin.size(); nIn = next_input++) {
+                const palladiumconsensus_spent_output& spent = spentOutputs[nIn];
+                valid[nIn] = VerifyScript(tx.vin[nIn].scriptSig, CScript(spent.scriptPubKey, spent.scriptPubKey + spent.scriptPubKeyLen), &tx.vin[nIn].scriptWitness, flags, TransactionSignatureChecker(&tx, nIn, spent.amount, txdata), nullptr);
+            }
+        };
+
+        // The calling thread verifies inputs too.
+        std::vector<std::thread> threads;
+        const size_t max_threads = std::min<size_t>(nThreads, tx.vin.size());
+        for (size_t i = 1; i < max_threads; ++i) {
+            try {
+                threads.emplace_back(verify_inputs);
+            } catch (const std::system_error&) {
+                break;
+            }
+        }
+        verify_inputs();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        if (results) std::copy(valid.begin(), valid.end(), results);
+        return std::all_of(valid.begin(), valid.end(), [](int ok) { return ok != 0; }) ? 1 : 0;
+    } catch (const std::exception&) {
+        return set_error(err, palladiumconsensus_ERR_TX_DESERIALIZE); // Error deserializing
+    }
+}
+
 unsigned int palladiumconsensus_version()
 {
     // Just use the API version for now
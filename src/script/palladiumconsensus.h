@@ -33,7 +33,7 @@
 extern "C" {
 #endif
 
-#define PALLADIUMCONSENSUS_API_VER 1
+#define PALLADIUMCONSENSUS_API_VER 2
 
 typedef enum palladiumconsensus_error_t
 {
@@ -43,6 +43,7 @@ typedef enum palladiumconsensus_error_t
     palladiumconsensus_ERR_TX_DESERIALIZE,
     palladiumconsensus_ERR_AMOUNT_REQUIRED,
     palladiumconsensus_ERR_INVALID_FLAGS,
+    palladiumconsensus_ERR_SPENT_OUTPUTS_MISMATCH,
 } palladiumconsensus_error;
 
 /** Script verification flags */
@@ -72,6 +73,25 @@ EXPORT_SYMBOL int palladiumconsensus_verify_script_with_amount(const unsigned ch
                                     const unsigned char *txTo        , unsigned int txToLen,
                                     unsigned int nIn, unsigned int flags, palladiumconsensus_error* err);
 
+/** An output spent by a transaction input */
+typedef struct palladiumconsensus_spent_output
+{
+    const unsigned char *scriptPubKey;
+    unsigned int scriptPubKeyLen;
+    int64_t amount;
+} palladiumconsensus_spent_output;
+
+/// Verifies all inputs of the serialized transaction pointed to by txTo, the
+/// transaction being deserialized and its signature hash data computed once.
+/// spentOutputs must hold one entry per input, in input order.
+/// If nThreads is above 1, the inputs are verified on up to that many threads.
+/// Returns 1 if every input is valid. If not nullptr, results must hold one
+/// entry per input and receives 1 or 0 for each of them.
+/// If not nullptr, err will contain an error/success code for the operation
+EXPORT_SYMBOL int palladiumconsensus_verify_transaction(const unsigned char *txTo, unsigned int txToLen,
+                                    const palladiumconsensus_spent_output *spentOutputs, unsigned int spentOutputsLen,
+                                    unsigned int flags, unsigned int nThreads, int *results, palladiumconsensus_error* err);
+
 EXPORT_SYMBOL unsigned int palladiumconsensus_version();
 
 #ifdef __cplusplus
@@ -11,22 +11,49 @@
 #include <util/system.h>
 
 #include <cuckoocache.h>
+
+#include <array>
+#include <atomic>
+
 #include <boost/thread.hpp>
 
 namespace {
+/** Independently locked parts of the signature cache. */
+constexpr size_t SIGCACHE_SHARDS = 16;
+
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
+ *
+ * CuckooCache needs insertions to be serialized with everything else, so
+ * the cache is split into shards with a lock each, and the script check
+ * threads that insert after every successful verification rarely wait for
+ * one another.
  */
 class CSignatureCache
 {
 private:
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+
+    //! Kept on their own cache lines, so that threads using different shards don't slow each other down.
+    struct alignas(64) Shard {
+        map_type setValid;
+        boost::shared_mutex cs_sigcache;
+        std::atomic<uint64_t> contended_reads{0};
+        std::atomic<uint64_t> contended_writes{0};
+    };
+
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
+    std::array<Shard, SIGCACHE_SHARDS> shards;
+
+    Shard& GetShard(const uint256& entry)
+    {
+        // The cuckoo hashes are mostly taken from the high bits of each
+        // 4-byte word, so use the low bits of one for the shard.
+        return shards[entry.begin()[28] % SIGCACHE_SHARDS];
+    }
 
 public:
     CSignatureCache()
@@ -43,18 +70,60 @@ public:
     bool
     Get(const uint256& entry, const bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        Shard& shard = GetShard(entry);
+        boost::shared_lock<boost::shared_mutex> lock(shard.cs_sigcache, boost::try_to_lock);
+        if (!lock.owns_lock()) {
+            ++shard.contended_reads;
+            lock.lock();
+        }
+        return shard.setValid.contains(entry, erase);
     }
 
-    void Set(uint256& entry)
+    void Set(const uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.insert(entry);
+        Shard& shard = GetShard(entry);
+        boost::unique_lock<boost::shared_mutex> lock(shard.cs_sigcache, boost::try_to_lock);
+        if (!lock.owns_lock()) {
+            ++shard.contended_writes;
+            lock.lock();
+        }
+        shard.setValid.insert(entry);
     }
+
     uint32_t setup_bytes(size_t n)
     {
-        return setValid.setup_bytes(n);
+        uint32_t elements = 0;
+        for (Shard& shard : shards) {
+            elements += shard.setValid.setup_bytes(n / SIGCACHE_SHARDS);
+        }
+        return elements;
+    }
+
+    void Dump(uint256& nonce_out, std::vector<uint256>& entries)
+    {
+        nonce_out = nonce;
+        for (Shard& shard : shards) {
+            boost::shared_lock<boost::shared_mutex> lock(shard.cs_sigcache);
+            shard.setValid.for_each_kept([&](const uint256& entry) { entries.push_back(entry); });
+        }
+    }
+
+    void Load(const uint256& nonce_in, const std::vector<uint256>& entries)
+    {
+        nonce = nonce_in;
+        for (const uint256& entry : entries) {
+            Set(entry);
+        }
+    }
+
+    SignatureCacheStats GetStats() const
+    {
+        SignatureCacheStats stats;
+        for (const Shard& shard : shards) {
+            stats.contended_reads += shard.contended_reads;
+            stats.contended_writes += shard.contended_writes;
+        }
+        return stats;
     }
 };
 
@@ -79,6 +148,21 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+void DumpSignatureCache(uint256& nonce, std::vector<uint256>& entries)
+{
+    signatureCache.Dump(nonce, entries);
+}
+
+void LoadSignatureCache(const uint256& nonce, const std::vector<uint256>& entries)
+{
+    signatureCache.Load(nonce, entries);
+}
+
+SignatureCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
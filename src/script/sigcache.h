@@ -18,6 +18,7 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
 class CPubKey;
+class uint256;
 
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
@@ -53,4 +54,23 @@ public:
 
 void InitSignatureCache();
 
+struct SignatureCacheStats {
+    //! Lookups that had to wait for an insertion into the same shard
+    uint64_t contended_reads{0};
+    //! Insertions that had to wait for another lookup or insertion into the same shard
+    uint64_t contended_writes{0};
+};
+
+SignatureCacheStats GetSignatureCacheStats();
+
+/** Copy out the nonce and the entries still in the signature cache, to save them to disk. */
+void DumpSignatureCache(uint256& nonce, std::vector<uint256>& entries);
+/**
+ * Restore entries saved by DumpSignatureCache. Entries are only meaningful
+ * together with the nonce they were computed with, so this replaces the
+ * current nonce: call it only right after InitSignatureCache, before anything
+ * has been added.
+ */
+void LoadSignatureCache(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // PALLADIUM_SCRIPT_SIGCACHE_H
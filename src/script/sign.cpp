@@ -5,16 +5,20 @@
 
 #include <script/sign.h>
 
+#include <checkqueue.h>
 #include <key.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <script/signingprovider.h>
 #include <script/standard.h>
+#include <tinyformat.h>
 #include <uint256.h>
+#include <util/threadnames.h>
 
 typedef std::vector<unsigned char> valtype;
 
-MutableTransactionSignatureCreator::MutableTransactionSignatureCreator(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn) : txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), checker(txTo, nIn, amountIn) {}
+MutableTransactionSignatureCreator::MutableTransactionSignatureCreator(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn) : txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), txdata(nullptr), checker(txTo, nIn, amountIn) {}
+MutableTransactionSignatureCreator::MutableTransactionSignatureCreator(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, const PrecomputedTransactionData& txdataIn, int nHashTypeIn) : txTo(txToIn), nIn(nInIn), nHashType(nHashTypeIn), amount(amountIn), txdata(&txdataIn), checker(txTo, nIn, amountIn, txdataIn) {}
 
 bool MutableTransactionSignatureCreator::CreateSig(const SigningProvider& provider, std::vector<unsigned char>& vchSig, const CKeyID& address, const CScript& scriptCode, SigVersion sigversion) const
 {
@@ -26,7 +30,7 @@ bool MutableTransactionSignatureCreator::CreateSig(const SigningProvider& provid
     if (sigversion == SigVersion::WITNESS_V0 && !key.IsCompressed())
         return false;
 
-    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion);
+    uint256 hash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion, txdata);
     if (!key.Sign(hash, vchSig))
         return false;
     vchSig.push_back((unsigned char)nHashType);
@@ -466,6 +470,62 @@ bool IsSegWitOutput(const SigningProvider& provider, const CScript& script)
     return false;
 }
 
+bool g_parallel_signing{false};
+
+namespace {
+/** Closure signing one input of a transaction. */
+class CSignInputCheck
+{
+private:
+    const std::function<void(size_t)>* m_sign_input{nullptr};
+    size_t m_index{0};
+
+public:
+    CSignInputCheck() {}
+    CSignInputCheck(const std::function<void(size_t)>* sign_input, size_t index) : m_sign_input(sign_input), m_index(index) {}
+
+    bool operator()()
+    {
+        (*m_sign_input)(m_index);
+        return true;
+    }
+
+    void swap(CSignInputCheck& check)
+    {
+        std::swap(m_sign_input, check.m_sign_input);
+        std::swap(m_index, check.m_index);
+    }
+};
+} // namespace
+
+static CCheckQueue<CSignInputCheck> signqueue(128);
+
+void ThreadSignInputs(int worker_num) {
+    util::ThreadRename(strprintf("signinp.%i", worker_num));
+    signqueue.Thread();
+}
+
+/** Number of inputs below which they are signed on the calling thread alone */
+static constexpr size_t MIN_PARALLEL_SIGN_INPUTS = 8;
+
+void ForEachInputParallel(size_t count, const std::function<void(size_t)>& sign_input)
+{
+    if (!g_parallel_signing || count < MIN_PARALLEL_SIGN_INPUTS) {
+        for (size_t i = 0; i < count; ++i) {
+            sign_input(i);
+        }
+        return;
+    }
+    CCheckQueueControl<CSignInputCheck> control(&signqueue);
+    std::vector<CSignInputCheck> checks;
+    checks.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        checks.emplace_back(&sign_input, i);
+    }
+    control.Add(checks);
+    control.Wait();
+}
+
 bool SignTransaction(CMutableTransaction& mtx, const SigningProvider* keystore, const std::map<COutPoint, Coin>& coins, int nHashType, std::map<int, std::string>& input_errors)
 {
     bool fHashSingle = ((nHashType & ~SIGHASH_ANYONECANPAY) == SIGHASH_SINGLE);
@@ -473,13 +533,20 @@ bool SignTransaction(CMutableTransaction& mtx, const SigningProvider* keystore,
     // Use CTransaction for the constant parts of the
     // transaction to avoid rehashing.
     const CTransaction txConst(mtx);
-    // Sign what we can:
-    for (unsigned int i = 0; i < mtx.vin.size(); i++) {
-        CTxIn& txin = mtx.vin[i];
+    // Signing only changes the parts of the transaction that the signature
+    // hashes don't commit to, so their midstates are shared by all inputs.
+    const PrecomputedTransactionData txdata(txConst, /* force */ true);
+
+    // Each input is signed against mtx as it is now, into its own copy and
+    // error, which are merged back once all inputs are done.
+    std::vector<CTxIn> vin(mtx.vin);
+    std::vector<std::string> errors(mtx.vin.size());
+    const std::function<void(size_t)> sign_input = [&](size_t i) {
+        CTxIn& txin = vin[i];
         auto coin = coins.find(txin.prevout);
         if (coin == coins.end() || coin->second.IsSpent()) {
-            input_errors[i] = "Input not found or already spent";
-            continue;
+            errors[i] = "Input not found or already spent";
+            return;
         }
         const CScript& prevPubKey = coin->second.out.scriptPubKey;
         const CAmount& amount = coin->second.out.nValue;
@@ -487,31 +554,40 @@ bool SignTransaction(CMutableTransaction& mtx, const SigningProvider* keystore,
         SignatureData sigdata = DataFromTransaction(mtx, i, coin->second.out);
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mtx.vout.size())) {
-            ProduceSignature(*keystore, MutableTransactionSignatureCreator(&mtx, i, amount, nHashType), prevPubKey, sigdata);
+            ProduceSignature(*keystore, MutableTransactionSignatureCreator(&mtx, i, amount, txdata, nHashType), prevPubKey, sigdata);
         }
 
         UpdateInput(txin, sigdata);
 
         // amount must be specified for valid segwit signature
         if (amount == MAX_MONEY && !txin.scriptWitness.IsNull()) {
-            input_errors[i] = "Missing amount";
-            continue;
+            errors[i] = "Missing amount";
+            return;
         }
 
         ScriptError serror = SCRIPT_ERR_OK;
-        if (!VerifyScript(txin.scriptSig, prevPubKey, &txin.scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&txConst, i, amount), &serror)) {
+        if (!VerifyScript(txin.scriptSig, prevPubKey, &txin.scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&txConst, i, amount, txdata), &serror)) {
             if (serror == SCRIPT_ERR_INVALID_STACK_OPERATION) {
                 // Unable to sign input and verification failed (possible attempt to partially sign).
-                input_errors[i] = "Unable to sign input, invalid stack size (possibly missing key)";
+                errors[i] = "Unable to sign input, invalid stack size (possibly missing key)";
             } else if (serror == SCRIPT_ERR_SIG_NULLFAIL) {
                 // Verification failed (possibly due to insufficient signatures).
-                input_errors[i] = "CHECK(MULTI)SIG failing with non-zero signature (possibly need more signatures)";
+                errors[i] = "CHECK(MULTI)SIG failing with non-zero signature (possibly need more signatures)";
             } else {
-                input_errors[i] = ScriptErrorString(serror);
+                errors[i] = ScriptErrorString(serror);
             }
-        } else {
+        }
+    };
+    // Sign what we can:
+    ForEachInputParallel(mtx.vin.size(), sign_input);
+
+    mtx.vin = std::move(vin);
+    for (unsigned int i = 0; i < errors.size(); i++) {
+        if (errors[i].empty()) {
             // If this input succeeds, make sure there is no error set for it
             input_errors.erase(i);
+        } else {
+            input_errors[i] = errors[i];
         }
     }
     return input_errors.empty();
@@ -13,6 +13,8 @@
 #include <script/keyorigin.h>
 #include <streams.h>
 
+#include <functional>
+
 class CKey;
 class CKeyID;
 class CScript;
@@ -38,10 +40,13 @@ class MutableTransactionSignatureCreator : public BaseSignatureCreator {
     unsigned int nIn;
     int nHashType;
     CAmount amount;
+    const PrecomputedTransactionData* txdata;
     const MutableTransactionSignatureChecker checker;
 
 public:
     MutableTransactionSignatureCreator(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, int nHashTypeIn = SIGHASH_ALL);
+    //! Compute the signature hashes with txdataIn, which must have been computed from txToIn
+    MutableTransactionSignatureCreator(const CMutableTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, const PrecomputedTransactionData& txdataIn, int nHashTypeIn = SIGHASH_ALL);
     const BaseSignatureChecker& Checker() const override { return checker; }
     bool CreateSig(const SigningProvider& provider, std::vector<unsigned char>& vchSig, const CKeyID& keyid, const CScript& scriptCode, SigVersion sigversion) const override;
 };
@@ -169,7 +174,20 @@ bool IsSolvable(const SigningProvider& provider, const CScript& script);
 /** Check whether a scriptPubKey is known to be segwit. */
 bool IsSegWitOutput(const SigningProvider& provider, const CScript& script);
 
-/** Sign the CMutableTransaction */
+/** Whether there are dedicated threads signing the inputs of large transactions in parallel. */
+extern bool g_parallel_signing;
+
+/** Run an instance of the input signing thread */
+void ThreadSignInputs(int worker_num);
+
+/**
+ * Call sign_input for each input index below count, spread over the input
+ * signing threads if there are enough inputs for it to pay off. sign_input
+ * must only modify the state of the input it is called for.
+ */
+void ForEachInputParallel(size_t count, const std::function<void(size_t)>& sign_input);
+
+/** Sign the CMutableTransaction, computing the signature hash midstates only once */
 bool SignTransaction(CMutableTransaction& mtx, const SigningProvider* provider, const std::map<COutPoint, Coin>& coins, int sighash, std::map<int, std::string>& input_errors);
 
 #endif // PALLADIUM_SCRIPT_SIGN_H
@@ -155,8 +155,13 @@ txnouttype Solver(const CScript& scriptPubKey, std::vector<std::vector<unsigned
 
 bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet)
 {
-    std::vector<valtype> vSolutions;
-    txnouttype whichType = Solver(scriptPubKey, vSolutions);
+    return ExtractDestination(SolvedScript(scriptPubKey), addressRet);
+}
+
+bool ExtractDestination(const SolvedScript& solved, CTxDestination& addressRet)
+{
+    const txnouttype whichType = solved.type;
+    const std::vector<valtype>& vSolutions = solved.solutions;
 
     if (whichType == TX_PUBKEY) {
         CPubKey pubKey(vSolutions[0]);
@@ -198,10 +203,17 @@ bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet)
 }
 
 bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<CTxDestination>& addressRet, int& nRequiredRet)
+{
+    const SolvedScript solved(scriptPubKey);
+    typeRet = solved.type;
+    return ExtractDestinations(solved, addressRet, nRequiredRet);
+}
+
+bool ExtractDestinations(const SolvedScript& solved, std::vector<CTxDestination>& addressRet, int& nRequiredRet)
 {
     addressRet.clear();
-    std::vector<valtype> vSolutions;
-    typeRet = Solver(scriptPubKey, vSolutions);
+    const txnouttype typeRet = solved.type;
+    const std::vector<valtype>& vSolutions = solved.solutions;
     if (typeRet == TX_NONSTANDARD) {
         return false;
     } else if (typeRet == TX_NULL_DATA) {
@@ -229,7 +241,7 @@ bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, std::
     {
         nRequiredRet = 1;
         CTxDestination address;
-        if (!ExtractDestination(scriptPubKey, address))
+        if (!ExtractDestination(solved, address))
            return false;
         addressRet.push_back(address);
     }
@@ -160,6 +160,18 @@ const char* GetTxnOutputType(txnouttype t);
  */
 txnouttype Solver(const CScript& scriptPubKey, std::vector<std::vector<unsigned char>>& vSolutionsRet);
 
+/**
+ * The result of Solver() for a scriptPubKey, so that checks and extractions
+ * on the same script do not parse it again.
+ */
+struct SolvedScript
+{
+    std::vector<std::vector<unsigned char>> solutions;
+    txnouttype type;
+
+    explicit SolvedScript(const CScript& scriptPubKey) : type(Solver(scriptPubKey, solutions)) {}
+};
+
 /**
  * Parse a standard scriptPubKey for the destination address. Assigns result to
  * the addressRet parameter and returns true if successful. For multisig
@@ -167,6 +179,7 @@ txnouttype Solver(const CScript& scriptPubKey, std::vector<std::vector<unsigned
  * P2PKH, P2SH, P2WPKH, and P2WSH scripts.
  */
 bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet);
+bool ExtractDestination(const SolvedScript& solved, CTxDestination& addressRet);
 
 /**
  * Parse a standard scriptPubKey with one or more destination addresses. For
@@ -180,6 +193,7 @@ bool ExtractDestination(const CScript& scriptPubKey, CTxDestination& addressRet)
  * CScript), and its use should be phased out.
  */
 bool ExtractDestinations(const CScript& scriptPubKey, txnouttype& typeRet, std::vector<CTxDestination>& addressRet, int& nRequiredRet);
+bool ExtractDestinations(const SolvedScript& solved, std::vector<CTxDestination>& addressRet, int& nRequiredRet);
 
 /**
  * Generate a Palladium scriptPubKey for the given CTxDestination. Returns a P2PKH
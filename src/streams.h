@@ -193,6 +193,56 @@ public:
     }
 };
 
+/** Minimal stream for reading from a borrowed span of bytes, e.g. a memory
+ * mapped file. The referenced memory must outlive the reader.
+ */
+class SpanReader
+{
+private:
+    const int m_type;
+    const int m_version;
+    Span<const uint8_t> m_data;
+
+public:
+    SpanReader(int type, int version, Span<const uint8_t> data)
+        : m_type(type), m_version(version), m_data(data) {}
+
+    template<typename T>
+    SpanReader& operator>>(T&& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return m_version; }
+    int GetType() const { return m_type; }
+
+    size_t size() const { return m_data.size(); }
+    bool empty() const { return m_data.size() == 0; }
+
+    void read(char* dst, size_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+
+        if (n > size()) {
+            throw std::ios_base::failure("SpanReader::read(): end of data");
+        }
+        memcpy(dst, m_data.data(), n);
+        m_data = m_data.subspan(n);
+    }
+
+    void ignore(size_t n)
+    {
+        if (n > size()) {
+            throw std::ios_base::failure("SpanReader::ignore(): end of data");
+        }
+        m_data = m_data.subspan(n);
+    }
+};
+
 /** Double ended buffer combining vector and stream-like interfaces.
  *
  * >> and << read and write unformatted data using the above serialization templates.
@@ -293,6 +343,7 @@ public:
     bool empty() const                               { return vch.size() == nReadPos; }
     void resize(size_type n, value_type c=0)         { vch.resize(n + nReadPos, c); }
     void reserve(size_type n)                        { vch.reserve(n + nReadPos); }
+    size_type capacity() const                       { return vch.capacity() - nReadPos; }
     const_reference operator[](size_type pos) const  { return vch[pos + nReadPos]; }
     reference operator[](size_type pos)              { return vch[pos + nReadPos]; }
     void clear()                                     { vch.clear(); nReadPos = 0; }
@@ -372,6 +423,13 @@ public:
         nReadPos = 0;
     }
 
+    //! Exchange the underlying buffer with another one (e.g. to reuse its allocation) and rewind.
+    void SwapBuffer(vector_type& other)
+    {
+        vch.swap(other);
+        nReadPos = 0;
+    }
+
     bool Rewind(size_type n)
     {
         // Rewind by n characters if the buffer hasn't been compacted yet
@@ -792,6 +850,16 @@ public:
         }
     }
 
+    //! skip a number of bytes
+    void ignore(size_t nSize) {
+        char data[4096];
+        while (nSize > 0) {
+            size_t nNow = std::min<size_t>(nSize, sizeof(data));
+            read(data, nNow);
+            nSize -= nNow;
+        }
+    }
+
     //! return the current reading position
     uint64_t GetPos() const {
         return nReadPos;
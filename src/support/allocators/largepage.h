@@ -0,0 +1,49 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_SUPPORT_ALLOCATORS_LARGEPAGE_H
+#define PALLADIUM_SUPPORT_ALLOCATORS_LARGEPAGE_H
+
+#include <support/lockedpool.h>
+
+#include <memory>
+
+//
+// Allocator that takes its memory from LargePageManager, for big, randomly
+// accessed tables that benefit from huge pages when -largepages is set.
+//
+template <typename T>
+struct large_page_allocator : public std::allocator<T> {
+    typedef std::allocator<T> base;
+    typedef typename base::size_type size_type;
+    typedef typename base::difference_type difference_type;
+    typedef typename base::pointer pointer;
+    typedef typename base::const_pointer const_pointer;
+    typedef typename base::reference reference;
+    typedef typename base::const_reference const_reference;
+    typedef typename base::value_type value_type;
+    large_page_allocator() noexcept {}
+    large_page_allocator(const large_page_allocator& a) noexcept : base(a) {}
+    template <typename U>
+    large_page_allocator(const large_page_allocator<U>& a) noexcept : base(a)
+    {
+    }
+    ~large_page_allocator() noexcept {}
+    template <typename _Other>
+    struct rebind {
+        typedef large_page_allocator<_Other> other;
+    };
+
+    T* allocate(std::size_t n, const void* hint = 0)
+    {
+        return static_cast<T*>(LargePageManager::Instance().Allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        LargePageManager::Instance().Free(p, sizeof(T) * n);
+    }
+};
+
+#endif // PALLADIUM_SUPPORT_ALLOCATORS_LARGEPAGE_H
@@ -0,0 +1,219 @@
+// Copyright (c) 2022 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_SUPPORT_ALLOCATORS_POOL_H
+#define PALLADIUM_SUPPORT_ALLOCATORS_POOL_H
+
+#include <support/lockedpool.h>
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <list>
+#include <new>
+#include <type_traits>
+
+/**
+ * A memory resource for node based containers such as std::unordered_map.
+ *
+ * Allocations of up to MAX_BLOCK_SIZE_BYTES are carved out of large chunks and
+ * recycled through one free list per rounded-up block size, so the hot path of
+ * node allocation and deallocation is a pointer swap instead of a trip through
+ * malloc. Larger or over-aligned requests (e.g. the bucket array of a big hash
+ * map) are forwarded to ::operator new.
+ *
+ * Chunks, and requests of LargePageManager::REGION_SIZE and more, come from
+ * LargePageManager, so they are backed by huge pages with -largepages.
+ *
+ * Memory is handed back to the system only when the resource is destroyed.
+ * Containers that shrink a lot should therefore be recreated together with
+ * their resource (see CCoinsViewCache::ReallocateCache).
+ *
+ * The first chunk is allocated lazily, so constructing a resource that is never
+ * used is free. Not thread safe.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource final
+{
+    static_assert(ALIGN_BYTES > 0, "ALIGN_BYTES must be nonzero");
+    static_assert((ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+
+    /** In-place linked list of free blocks, stored inside the freed memory. */
+    struct ListNode {
+        ListNode* m_next;
+
+        explicit ListNode(ListNode* next) : m_next(next) {}
+    };
+    static_assert(std::is_trivially_destructible<ListNode>::value, "ListNode must be trivially destructible");
+
+    /** Every block is a multiple of this size and aligned to it. */
+    static constexpr std::size_t ELEM_ALIGN_BYTES = ALIGN_BYTES > alignof(ListNode) ? ALIGN_BYTES : alignof(ListNode);
+    static_assert(ELEM_ALIGN_BYTES % alignof(ListNode) == 0, "ELEM_ALIGN_BYTES must be a multiple of alignof(ListNode)");
+    static_assert(ELEM_ALIGN_BYTES >= sizeof(ListNode), "ELEM_ALIGN_BYTES must be at least sizeof(ListNode)");
+    static_assert(ELEM_ALIGN_BYTES <= alignof(std::max_align_t), "chunks come from ::operator new and are only max_align_t aligned");
+
+    /** Size of each chunk requested from ::operator new. */
+    const std::size_t m_chunk_size_bytes;
+
+    /** All chunks allocated so far, released on destruction. */
+    std::list<void*> m_allocated_chunks;
+
+    /** Free list heads, indexed by block size in multiples of ELEM_ALIGN_BYTES. */
+    std::array<ListNode*, MAX_BLOCK_SIZE_BYTES / ELEM_ALIGN_BYTES + 1> m_free_lists;
+
+    /** Not yet handed out part of the most recent chunk. */
+    char* m_available_memory_it = nullptr;
+    char* m_available_memory_end = nullptr;
+
+    /** Number of ELEM_ALIGN_BYTES units needed to hold bytes; zero sized requests use one unit. */
+    static constexpr std::size_t NumElemAlignBytes(std::size_t bytes)
+    {
+        return (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + (bytes == 0);
+    }
+
+    static constexpr bool IsFreeListUsable(std::size_t bytes, std::size_t alignment)
+    {
+        return alignment <= ELEM_ALIGN_BYTES && bytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    void PlacementAddToList(void* p, ListNode*& node)
+    {
+        node = new (p) ListNode{node};
+    }
+
+    void AllocateChunk()
+    {
+        // Don't waste the tail of the current chunk: it is a whole number of
+        // ELEM_ALIGN_BYTES units, so it can go straight into a free list.
+        const std::size_t remaining_available_bytes = m_available_memory_end - m_available_memory_it;
+        if (remaining_available_bytes != 0) {
+            PlacementAddToList(m_available_memory_it, m_free_lists[remaining_available_bytes / ELEM_ALIGN_BYTES]);
+        }
+
+        void* storage = LargePageManager::Instance().Allocate(m_chunk_size_bytes);
+        m_allocated_chunks.push_back(storage);
+        m_available_memory_it = static_cast<char*>(storage);
+        m_available_memory_end = m_available_memory_it + m_chunk_size_bytes;
+    }
+
+public:
+    static constexpr std::size_t DEFAULT_CHUNK_SIZE_BYTES = 262144;
+
+    explicit PoolResource(std::size_t chunk_size_bytes)
+        : m_chunk_size_bytes(NumElemAlignBytes(chunk_size_bytes) * ELEM_ALIGN_BYTES)
+    {
+        assert(m_chunk_size_bytes >= MAX_BLOCK_SIZE_BYTES);
+        m_free_lists.fill(nullptr);
+    }
+
+    PoolResource() : PoolResource(DEFAULT_CHUNK_SIZE_BYTES) {}
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    ~PoolResource()
+    {
+        for (void* chunk : m_allocated_chunks) {
+            LargePageManager::Instance().Free(chunk, m_chunk_size_bytes);
+        }
+    }
+
+    void* Allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            assert(alignment <= alignof(std::max_align_t));
+            if (bytes >= LargePageManager::REGION_SIZE) return LargePageManager::Instance().Allocate(bytes);
+            return ::operator new(bytes);
+        }
+        const std::size_t num_alignments = NumElemAlignBytes(bytes);
+        ListNode*& free_list = m_free_lists[num_alignments];
+        if (free_list != nullptr) {
+            ListNode* node = free_list;
+            free_list = node->m_next;
+            return node;
+        }
+        const std::size_t round_bytes = num_alignments * ELEM_ALIGN_BYTES;
+        if (round_bytes > static_cast<std::size_t>(m_available_memory_end - m_available_memory_it)) {
+            AllocateChunk();
+        }
+        void* p = m_available_memory_it;
+        m_available_memory_it += round_bytes;
+        return p;
+    }
+
+    void Deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            if (bytes >= LargePageManager::REGION_SIZE) {
+                LargePageManager::Instance().Free(p, bytes);
+            } else {
+                ::operator delete(p);
+            }
+            return;
+        }
+        PlacementAddToList(p, m_free_lists[NumElemAlignBytes(bytes)]);
+    }
+
+    std::size_t NumAllocatedChunks() const { return m_allocated_chunks.size(); }
+    std::size_t ChunkSizeBytes() const { return m_chunk_size_bytes; }
+};
+
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+constexpr std::size_t PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>::ELEM_ALIGN_BYTES;
+
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+constexpr std::size_t PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>::DEFAULT_CHUNK_SIZE_BYTES;
+
+/**
+ * Standard library compatible allocator that gets its memory from a PoolResource.
+ * The resource must outlive every container using it.
+ */
+template <class T, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator(ResourceType* resource) noexcept : m_resource(resource) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : m_resource(other.resource()) {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(m_resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        m_resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType* resource() const noexcept { return m_resource; }
+
+private:
+    ResourceType* m_resource;
+};
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.resource() == b.resource();
+}
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // PALLADIUM_SUPPORT_ALLOCATORS_POOL_H
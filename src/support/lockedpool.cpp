@@ -22,7 +22,13 @@
 #include <unistd.h> // for sysconf
 #endif
 
+#ifdef __linux__
+#include <sys/syscall.h> // for SYS_mbind
+#endif
+
 #include <algorithm>
+#include <iterator>
+#include <string>
 #ifdef ARENA_DEBUG
 #include <iomanip>
 #include <iostream>
@@ -409,3 +415,194 @@ void LockedPoolManager::CreateInstance()
     static LockedPoolManager instance(std::move(allocator));
     LockedPoolManager::_instance = &instance;
 }
+
+/*******************************************************************************/
+// Implementation: LargePageManager
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+#define HAVE_LARGE_PAGES 1
+#endif
+
+/** Rounding of the requests carved out of shared regions */
+static const size_t LARGE_PAGE_BLOCK_ALIGN = 64;
+
+const size_t LargePageManager::REGION_SIZE;
+
+LargePageManager::LargePageManager()
+{
+}
+
+LargePageManager::~LargePageManager()
+{
+#ifdef HAVE_LARGE_PAGES
+    for (const auto& mapping : m_mappings) {
+        munmap(mapping.first, mapping.second.size);
+    }
+#endif
+}
+
+LargePageManager& LargePageManager::Instance()
+{
+    // Never destroyed, as coins caches and signature caches with static
+    // storage duration may still free memory during static destruction.
+    static LargePageManager* const instance = new LargePageManager();
+    return *instance;
+}
+
+bool LargePageManager::Supported()
+{
+#ifdef HAVE_LARGE_PAGES
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool LargePageManager::Configure(Mode mode, int numa_node)
+{
+    if (mode != Mode::NONE && !Supported()) return false;
+    if (numa_node >= 0) {
+#ifdef HAVE_LARGE_PAGES
+        // The node mask passed to mbind is a single unsigned long.
+        if (numa_node >= (int)(sizeof(unsigned long) * 8)) return false;
+        const std::string node_path = "/sys/devices/system/node/node" + std::to_string(numa_node);
+        if (access(node_path.c_str(), F_OK) != 0) return false;
+#else
+        return false;
+#endif
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_mode = mode;
+    m_numa_node = numa_node;
+    return true;
+}
+
+LargePageManager::Mode LargePageManager::GetMode() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_mode;
+}
+
+void* LargePageManager::Map(size_t size, bool& hugetlb)
+{
+    hugetlb = false;
+#ifdef HAVE_LARGE_PAGES
+    void* addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (m_mode == Mode::HUGETLB) {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_2MB
+        flags |= MAP_HUGE_2MB;
+#endif
+        addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if (addr == MAP_FAILED) {
+            ++m_stats.hugetlb_failures;
+        } else {
+            hugetlb = true;
+        }
+    }
+#endif
+    if (addr == MAP_FAILED) {
+        // Map one region more than needed and trim it to an aligned range,
+        // so that the kernel can back all of it with huge pages.
+        void* raw = mmap(nullptr, size + REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) return nullptr;
+        char* begin = static_cast<char*>(raw);
+        char* aligned = reinterpret_cast<char*>(align_up(reinterpret_cast<uintptr_t>(begin), REGION_SIZE));
+        if (aligned != begin) munmap(begin, aligned - begin);
+        if (aligned != begin + REGION_SIZE) munmap(aligned + size, begin + REGION_SIZE - aligned);
+        madvise(aligned, size, MADV_HUGEPAGE);
+        addr = aligned;
+    }
+#ifdef SYS_mbind
+    if (m_numa_node >= 0) {
+        // MPOL_PREFERRED from <linux/mempolicy.h>: use the node while it has
+        // free memory, rather than fail allocations as MPOL_BIND would.
+        static const int MPOL_PREFERRED_MODE = 1;
+        unsigned long node_mask = 1UL << m_numa_node;
+        syscall(SYS_mbind, addr, size, MPOL_PREFERRED_MODE, &node_mask, sizeof(node_mask) * 8 + 1, 0);
+    }
+#endif
+    m_stats.mapped += size;
+    if (hugetlb) m_stats.hugetlb += size;
+    return addr;
+#else
+    return nullptr;
+#endif
+}
+
+void* LargePageManager::Allocate(size_t size)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_mode == Mode::NONE) {
+        lock.unlock();
+        return ::operator new(size);
+    }
+    bool hugetlb;
+    if (size >= REGION_SIZE) {
+        const size_t mapping_size = align_up(size, REGION_SIZE);
+        void* addr = Map(mapping_size, hugetlb);
+        if (!addr) throw std::bad_alloc();
+        m_mappings.emplace(static_cast<char*>(addr), Mapping{mapping_size, false, hugetlb});
+        m_stats.used += mapping_size;
+        return addr;
+    }
+    const size_t block_size = align_up(std::max<size_t>(size, 1), LARGE_PAGE_BLOCK_ALIGN);
+    m_stats.used += block_size;
+    std::vector<void*>& free_blocks = m_free_blocks[block_size];
+    if (!free_blocks.empty()) {
+        void* block = free_blocks.back();
+        free_blocks.pop_back();
+        return block;
+    }
+    if (block_size > static_cast<size_t>(m_region_end - m_region_it)) {
+        void* region = Map(REGION_SIZE, hugetlb);
+        if (!region) {
+            m_stats.used -= block_size;
+            throw std::bad_alloc();
+        }
+        m_mappings.emplace(static_cast<char*>(region), Mapping{REGION_SIZE, true, hugetlb});
+        m_region_it = static_cast<char*>(region);
+        m_region_end = m_region_it + REGION_SIZE;
+    }
+    void* block = m_region_it;
+    m_region_it += block_size;
+    return block;
+}
+
+void LargePageManager::Free(void* ptr, size_t size)
+{
+    if (ptr == nullptr) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        char* addr = static_cast<char*>(ptr);
+        auto it = m_mappings.upper_bound(addr);
+        if (it != m_mappings.begin() && addr < std::prev(it)->first + std::prev(it)->second.size) {
+            --it;
+            if (it->second.shared) {
+                const size_t block_size = align_up(std::max<size_t>(size, 1), LARGE_PAGE_BLOCK_ALIGN);
+                m_free_blocks[block_size].push_back(ptr);
+                m_stats.used -= block_size;
+            } else {
+#ifdef HAVE_LARGE_PAGES
+                munmap(it->first, it->second.size);
+#endif
+                m_stats.mapped -= it->second.size;
+                if (it->second.hugetlb) m_stats.hugetlb -= it->second.size;
+                m_stats.used -= it->second.size;
+                m_mappings.erase(it);
+            }
+            return;
+        }
+    }
+    // Allocated while the mode was NONE
+    ::operator delete(ptr);
+}
+
+LargePageManager::Stats LargePageManager::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
@@ -11,6 +11,7 @@
 #include <mutex>
 #include <memory>
 #include <unordered_map>
+#include <vector>
 
 /**
  * OS-dependent allocation and deallocation of locked/pinned memory pages.
@@ -237,4 +238,95 @@ private:
     static std::once_flag init_flag;
 };
 
+/**
+ * Source of the large, long-lived allocations whose random access is bound
+ * by TLB misses: the chunks of the coins cache's PoolResource and the tables
+ * of the signature and script execution caches. Selected with -largepages,
+ * it maps them in huge-page aligned regions of REGION_SIZE bytes that are
+ * either advised for transparent huge pages or come from the hugetlbfs
+ * reservation, and optionally prefers one NUMA node for them.
+ *
+ * Requests smaller than REGION_SIZE are carved out of shared regions and
+ * recycled by size, so the many pool resources of short-lived coins views
+ * share huge pages instead of each reserving a region. Those regions are
+ * never returned to the system; larger requests get their own mapping,
+ * unmapped when freed. With Mode::NONE, or where the platform has no support,
+ * everything goes to ::operator new. Thread safe.
+ */
+class LargePageManager
+{
+public:
+    enum class Mode {
+        NONE,    //!< ::operator new
+        THP,     //!< transparent huge pages: madvise(MADV_HUGEPAGE) on huge-page aligned mappings
+        HUGETLB, //!< explicit huge pages: MAP_HUGETLB, falling back to THP when the reservation is used up
+    };
+
+    /** Size and alignment of the mappings, one 2 MiB huge page on x86-64 and arm64 */
+    static const size_t REGION_SIZE = 2 * 1024 * 1024;
+
+    /** Memory statistics. */
+    struct Stats
+    {
+        size_t mapped; //!< bytes mapped in total
+        size_t hugetlb; //!< of which from the hugetlbfs reservation
+        size_t used; //!< bytes of the mappings handed out
+        size_t hugetlb_failures; //!< mappings that fell back from HUGETLB to THP
+    };
+
+    LargePageManager();
+    ~LargePageManager();
+
+    LargePageManager(const LargePageManager&) = delete;
+    LargePageManager& operator=(const LargePageManager&) = delete;
+
+    /** Return the process-wide instance used by PoolResource and large_page_allocator */
+    static LargePageManager& Instance();
+
+    /** Whether huge pages can be used on this platform at all */
+    static bool Supported();
+
+    /** Back later allocations in the given way. numa_node < 0 leaves their
+     * placement to the kernel, which puts each page on the node of the thread
+     * that first touches it. Allocations made before keep their backing and
+     * are freed correctly. Returns false, changing nothing, if mode is not
+     * NONE and huge pages are unsupported, or numa_node is out of range.
+     */
+    bool Configure(Mode mode, int numa_node);
+
+    Mode GetMode() const;
+
+    /** Allocate size bytes with at least max_align_t alignment. Throws std::bad_alloc on failure. */
+    void* Allocate(size_t size);
+
+    /** Free memory from Allocate(size). Freeing the nullptr pointer has no effect. */
+    void Free(void* ptr, size_t size);
+
+    /** Get usage statistics */
+    Stats stats() const;
+
+private:
+    struct Mapping
+    {
+        size_t size;
+        bool shared; //!< a region requests are carved out of, rather than one request's own mapping
+        bool hugetlb; //!< from the hugetlbfs reservation
+    };
+
+    /** Map size bytes (a multiple of REGION_SIZE) according to m_mode, or return nullptr. */
+    void* Map(size_t size, bool& hugetlb);
+
+    Mode m_mode{Mode::NONE};
+    int m_numa_node{-1};
+    /** All mappings by base address, to tell them from ::operator new memory on Free */
+    std::map<char*, Mapping> m_mappings;
+    /** Freed blocks of the shared regions, by rounded size */
+    std::unordered_map<size_t, std::vector<void*>> m_free_blocks;
+    /** Not yet handed out part of the last shared region */
+    char* m_region_it{nullptr};
+    char* m_region_end{nullptr};
+    Stats m_stats{0, 0, 0, 0};
+    mutable std::mutex m_mutex;
+};
+
 #endif // PALLADIUM_SUPPORT_LOCKEDPOOL_H
@@ -0,0 +1,196 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/palladium-config.h>
+#endif
+
+#include <support/prevectorpool.h>
+
+#include <array>
+#include <assert.h>
+#include <atomic>
+#include <mutex>
+#include <stdlib.h>
+
+namespace prevector_pool {
+namespace {
+
+static constexpr size_t NUM_CLASSES = MAX_POOLED_SIZE / SIZE_CLASS_STEP;
+static constexpr size_t SLAB_SIZE = 1 << 16;
+//! Blocks moved between a thread's free lists and the shared ones at a time
+static constexpr size_t BATCH = 64;
+
+static_assert(MAX_POOLED_SIZE % SIZE_CLASS_STEP == 0, "the largest block must be a size class");
+static_assert(SIZE_CLASS_STEP % alignof(void*) == 0, "blocks must stay pointer aligned");
+
+//! Class c holds blocks of (c + 1) * SIZE_CLASS_STEP bytes.
+size_t SizeClass(size_t bytes) { return (bytes - 1) / SIZE_CLASS_STEP; }
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct FreeList {
+    FreeBlock* head{nullptr};
+    size_t count{0};
+
+    void Push(void* block)
+    {
+        FreeBlock* free_block = static_cast<FreeBlock*>(block);
+        free_block->next = head;
+        head = free_block;
+        ++count;
+    }
+
+    void* Pop()
+    {
+        FreeBlock* block = head;
+        head = block->next;
+        --count;
+        return block;
+    }
+
+    //! Move up to n blocks to another list
+    void MoveTo(FreeList& other, size_t n)
+    {
+        while (n-- > 0 && head) other.Push(Pop());
+    }
+};
+
+class SharedPool
+{
+public:
+    //! Move a batch of blocks of class c to list, carving new ones if needed
+    void Refill(size_t c, FreeList& list)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_lists[c].MoveTo(list, BATCH);
+        const size_t size = (c + 1) * SIZE_CLASS_STEP;
+        while (list.count < BATCH) {
+            if (m_slab_left < size) {
+                m_slab = static_cast<char*>(malloc(SLAB_SIZE));
+                assert(m_slab);
+                m_slab_left = SLAB_SIZE;
+                m_slab_memory.fetch_add(SLAB_SIZE, std::memory_order_relaxed);
+            }
+            list.Push(m_slab);
+            m_slab += size;
+            m_slab_left -= size;
+        }
+    }
+
+    void Release(size_t c, FreeList& list, size_t n)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        list.MoveTo(m_lists[c], n);
+    }
+
+    size_t SlabMemory() const { return m_slab_memory.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex m_mutex;
+    std::array<FreeList, NUM_CLASSES> m_lists;
+    //! The unused part of the last slab
+    char* m_slab{nullptr};
+    size_t m_slab_left{0};
+    std::atomic<size_t> m_slab_memory{0};
+};
+
+SharedPool& Shared()
+{
+    // Never destroyed: prevectors with static storage duration are freed
+    // at exit, after any destructor here would have run.
+    static SharedPool* const pool = new SharedPool();
+    return *pool;
+}
+
+#ifdef HAVE_THREAD_LOCAL
+struct ThreadCache {
+    std::array<FreeList, NUM_CLASSES> lists;
+    bool registered{false};
+    //! Set once the thread is exiting; from then on only the shared lists are used
+    bool exited{false};
+};
+
+//! Trivially destructible, so that it stays usable until the thread is gone
+thread_local ThreadCache g_cache;
+
+//! Hands the blocks of an exiting thread to the shared lists
+struct CacheFlusher {
+    ~CacheFlusher()
+    {
+        for (size_t c = 0; c < NUM_CLASSES; ++c) {
+            Shared().Release(c, g_cache.lists[c], g_cache.lists[c].count);
+        }
+        g_cache.exited = true;
+    }
+};
+thread_local CacheFlusher g_flusher;
+
+//! The calling thread's cache, or nullptr once the thread is exiting
+ThreadCache* Cache()
+{
+    if (g_cache.exited) return nullptr;
+    if (!g_cache.registered) {
+        // The first use of g_flusher constructs it and registers its destructor.
+        (void)&g_flusher;
+        g_cache.registered = true;
+    }
+    return &g_cache;
+}
+#endif
+
+} // namespace
+
+void* Allocate(size_t bytes)
+{
+    assert(bytes > 0);
+    if (bytes > MAX_POOLED_SIZE) {
+        void* block = malloc(bytes);
+        assert(block);
+        return block;
+    }
+    const size_t c = SizeClass(bytes);
+#ifdef HAVE_THREAD_LOCAL
+    if (ThreadCache* cache = Cache()) {
+        FreeList& list = cache->lists[c];
+        if (!list.head) Shared().Refill(c, list);
+        return list.Pop();
+    }
+#endif
+    FreeList list;
+    Shared().Refill(c, list);
+    void* block = list.Pop();
+    Shared().Release(c, list, list.count);
+    return block;
+}
+
+void Free(void* block, size_t bytes)
+{
+    if (!block) return;
+    if (bytes > MAX_POOLED_SIZE) {
+        free(block);
+        return;
+    }
+    const size_t c = SizeClass(bytes);
+#ifdef HAVE_THREAD_LOCAL
+    if (ThreadCache* cache = Cache()) {
+        FreeList& list = cache->lists[c];
+        list.Push(block);
+        if (list.count > 2 * BATCH) Shared().Release(c, list, BATCH);
+        return;
+    }
+#endif
+    FreeList list;
+    list.Push(block);
+    Shared().Release(c, list, 1);
+}
+
+size_t SlabMemory()
+{
+    return Shared().SlabMemory();
+}
+
+} // namespace prevector_pool
@@ -0,0 +1,46 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_SUPPORT_PREVECTORPOOL_H
+#define PALLADIUM_SUPPORT_PREVECTORPOOL_H
+
+#include <stddef.h>
+
+/**
+ * Size-class pool for the heap storage of prevectors that outgrow their
+ * inline buffer, mostly CScripts of 29 bytes and more (P2WSH and witness v1
+ * outputs, multisig and signature scripts). Blocks up to MAX_POOLED_SIZE
+ * bytes are carved out of 64 KiB slabs in classes of SIZE_CLASS_STEP bytes,
+ * without the per-allocation header and rounding of malloc, and freed
+ * blocks are kept on per-thread free lists for reuse, which exchange
+ * batches with shared lists. Slabs are never returned to the system.
+ *
+ * prevector uses the pool when built with -DENABLE_PREVECTOR_POOL
+ * (configure --enable-prevector-pool).
+ */
+namespace prevector_pool {
+
+/** Largest block served from the pool; larger ones come from malloc. */
+static constexpr size_t MAX_POOLED_SIZE = 128;
+/** Step between the block sizes of the pool. */
+static constexpr size_t SIZE_CLASS_STEP = 8;
+
+/** The size of the block Allocate(bytes) returns, which the caller may use in full. */
+constexpr size_t BlockSize(size_t bytes)
+{
+    return bytes <= MAX_POOLED_SIZE ? (bytes + SIZE_CLASS_STEP - 1) / SIZE_CLASS_STEP * SIZE_CLASS_STEP : bytes;
+}
+
+/** Allocate a block of BlockSize(bytes) bytes (bytes > 0). Never returns nullptr. */
+void* Allocate(size_t bytes);
+
+/** Free a block from Allocate(bytes), from any thread. bytes may be anything with the same BlockSize. */
+void Free(void* block, size_t bytes);
+
+/** Memory taken from the system for slabs so far, in bytes */
+size_t SlabMemory();
+
+} // namespace prevector_pool
+
+#endif // PALLADIUM_SUPPORT_PREVECTORPOOL_H
@@ -10,12 +10,15 @@
 #include <tinyformat.h>
 
 #include <logging.h>
+#include <util/memory.h>
 #include <util/strencodings.h>
 #include <util/threadnames.h>
 
 #include <map>
+#include <memory>
 #include <set>
 #include <system_error>
+#include <tuple>
 
 #ifdef DEBUG_LOCKCONTENTION
 #if !defined(HAVE_THREAD_LOCAL)
@@ -28,6 +31,102 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+std::atomic<bool> g_lock_profiling{false};
+
+struct LockProfileSite {
+    LockProfileSite(const char* name_in, const char* file_in, int line_in) : name(name_in), file(file_in), line(line_in) {}
+
+    const std::string name;
+    const std::string file;
+    const int line;
+    perf::Histogram wait;
+    perf::Histogram hold;
+    //! Only taken by contended acquisitions, which wait anyway
+    std::mutex thread_wait_mutex;
+    std::map<std::string, int64_t> thread_wait;
+};
+
+namespace {
+
+struct LockProfileRegistry {
+    //! A plain mutex, so that the profiler does not profile itself
+    std::mutex mutex;
+    std::map<std::tuple<std::string, int, std::string>, std::unique_ptr<LockProfileSite>> sites;
+};
+
+LockProfileRegistry& GetLockProfileRegistry()
+{
+    // Leaked, as locks may be taken during static destruction.
+    static LockProfileRegistry* registry{new LockProfileRegistry()};
+    return *registry;
+}
+
+} // namespace
+
+LockProfileSite* GetLockProfileSite(const char* name, const char* file, int line)
+{
+#ifdef HAVE_THREAD_LOCAL
+    // The same site always passes the same literals, so a pointer compare
+    // finds it again without taking the registry lock.
+    struct CacheEntry {
+        const char* name;
+        const char* file;
+        int line;
+        LockProfileSite* site;
+    };
+    static thread_local CacheEntry cache[256];
+    CacheEntry& entry = cache[(reinterpret_cast<uintptr_t>(file) / 8 + reinterpret_cast<uintptr_t>(name) / 8 + line) % 256];
+    if (entry.name == name && entry.file == file && entry.line == line) return entry.site;
+#endif
+    LockProfileRegistry& registry = GetLockProfileRegistry();
+    LockProfileSite* site;
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        std::unique_ptr<LockProfileSite>& slot = registry.sites[std::make_tuple(std::string(file), line, std::string(name))];
+        if (!slot) slot = MakeUnique<LockProfileSite>(name, file, line);
+        site = slot.get();
+    }
+#ifdef HAVE_THREAD_LOCAL
+    entry = CacheEntry{name, file, line, site};
+#endif
+    return site;
+}
+
+void RecordLockWait(LockProfileSite* site, int64_t micros)
+{
+    site->wait.Add(micros);
+    std::lock_guard<std::mutex> lock(site->thread_wait_mutex);
+    site->thread_wait[util::ThreadGetInternalName()] += micros;
+}
+
+void RecordLockHold(LockProfileSite* site, int64_t micros)
+{
+    site->hold.Add(micros);
+}
+
+std::vector<LockProfileStats> GetLockProfile()
+{
+    LockProfileRegistry& registry = GetLockProfileRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::vector<LockProfileStats> ret;
+    ret.reserve(registry.sites.size());
+    for (const auto& entry : registry.sites) {
+        LockProfileSite& site = *entry.second;
+        LockProfileStats stats;
+        stats.name = site.name;
+        stats.file = site.file;
+        stats.line = site.line;
+        stats.wait = site.wait.GetStats();
+        stats.hold = site.hold.GetStats();
+        {
+            std::lock_guard<std::mutex> thread_lock(site.thread_wait_mutex);
+            stats.thread_wait = site.thread_wait;
+        }
+        ret.push_back(std::move(stats));
+    }
+    return ret;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -8,11 +8,16 @@
 
 #include <threadsafety.h>
 #include <util/macros.h>
+#include <util/perfstats.h>
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <map>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <vector>
 
 ////////////////////////////////////////////////
 //                                            //
@@ -116,14 +121,64 @@ typedef AnnotatedMixin<std::mutex> Mutex;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Lock profiling records, for every LOCK()/TRY_LOCK()/WAIT_LOCK() site, how
+ * long acquiring the lock waited when it was contended and how long it was
+ * held. It is switched at runtime (-lockprofiling, setlockprofiling) and
+ * costs one relaxed atomic load per acquisition while off. Hold times of
+ * WAIT_LOCK sites include the condition variable waits in between.
+ */
+static const bool DEFAULT_LOCKPROFILING = false;
+extern std::atomic<bool> g_lock_profiling;
+
+struct LockProfileSite;
+//! Find or create the statistics of a locking site (cached per thread).
+LockProfileSite* GetLockProfileSite(const char* name, const char* file, int line);
+void RecordLockWait(LockProfileSite* site, int64_t micros);
+void RecordLockHold(LockProfileSite* site, int64_t micros);
+
+inline int64_t LockProfileClock()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct LockProfileStats {
+    std::string name;
+    std::string file;
+    int line;
+    //! Waits of the contended acquisitions, and hold times of all of them
+    perf::HistogramStats wait;
+    perf::HistogramStats hold;
+    //! Total wait, in microseconds, by the name of the waiting thread
+    std::map<std::string, int64_t> thread_wait;
+};
+
+/** Statistics of every locking site recorded since startup */
+std::vector<LockProfileStats> GetLockProfile();
+
 /** Wrapper around std::unique_lock style lock for Mutex. */
 template <typename Mutex, typename Base = typename Mutex::UniqueLock>
 class SCOPED_LOCKABLE UniqueLock : public Base
 {
 private:
+    //! Where this was locked, and when, if lock profiling was on then
+    LockProfileSite* m_profile_site{nullptr};
+    int64_t m_locked_at{0};
+
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()));
+        if (g_lock_profiling.load(std::memory_order_relaxed)) {
+            m_profile_site = GetLockProfileSite(pszName, pszFile, nLine);
+            m_locked_at = LockProfileClock();
+            if (!Base::try_lock()) {
+                const int64_t start = m_locked_at;
+                Base::lock();
+                m_locked_at = LockProfileClock();
+                RecordLockWait(m_profile_site, m_locked_at - start);
+            }
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!Base::try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -138,8 +193,12 @@ private:
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()), true);
         Base::try_lock();
-        if (!Base::owns_lock())
+        if (!Base::owns_lock()) {
             LeaveCritical();
+        } else if (g_lock_profiling.load(std::memory_order_relaxed)) {
+            m_profile_site = GetLockProfileSite(pszName, pszFile, nLine);
+            m_locked_at = LockProfileClock();
+        }
         return Base::owns_lock();
     }
 
@@ -165,8 +224,10 @@ public:
 
     ~UniqueLock() UNLOCK_FUNCTION()
     {
-        if (Base::owns_lock())
+        if (Base::owns_lock()) {
+            if (m_profile_site) RecordLockHold(m_profile_site, LockProfileClock() - m_locked_at);
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -186,6 +247,7 @@ public:
     public:
         explicit reverse_lock(UniqueLock& _lock, const char* _guardname, const char* _file, int _line) : lock(_lock), file(_file), line(_line) {
             CheckLastCritical((void*)lock.mutex(), lockname, _guardname, _file, _line);
+            if (lock.m_profile_site) RecordLockHold(lock.m_profile_site, LockProfileClock() - lock.m_locked_at);
             lock.unlock();
             LeaveCritical();
             lock.swap(templock);
@@ -195,6 +257,7 @@ public:
             templock.swap(lock);
             EnterCritical(lockname.c_str(), file.c_str(), line, (void*)lock.mutex());
             lock.lock();
+            if (lock.m_profile_site) lock.m_locked_at = LockProfileClock();
         }
 
      private:
@@ -0,0 +1,108 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/addressindex.h>
+#include <key.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(addressindex_initial_sync, TestChain100Setup)
+{
+    AddressIndex addressindex(1 << 20, true);
+
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const uint256 coinbase_hash = AddressIndex::GetScriptHash(coinbase_script);
+    std::vector<AddressOutput> outputs;
+
+    // Outputs should not be found in the index before it is started.
+    BOOST_CHECK(addressindex.FindOutputs(coinbase_hash, outputs));
+    BOOST_CHECK(outputs.empty());
+
+    addressindex.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!addressindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    // All coinbase outputs of the chain before the index started are found, in height order.
+    BOOST_CHECK(addressindex.FindOutputs(coinbase_hash, outputs));
+    BOOST_REQUIRE_EQUAL(outputs.size(), m_coinbase_txns.size());
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        BOOST_CHECK(outputs[i].txid == m_coinbase_txns[i]->GetHash());
+        BOOST_CHECK_EQUAL(outputs[i].vout, 0U);
+        BOOST_CHECK_EQUAL(outputs[i].height, static_cast<int>(i) + 1);
+        BOOST_CHECK_EQUAL(outputs[i].value, m_coinbase_txns[i]->vout[0].nValue);
+        BOOST_CHECK(!outputs[i].IsSpent());
+    }
+
+    // Height bounds are inclusive.
+    outputs.clear();
+    BOOST_CHECK(addressindex.FindOutputs(coinbase_hash, 10, 19, false, outputs));
+    BOOST_REQUIRE_EQUAL(outputs.size(), 10U);
+    BOOST_CHECK_EQUAL(outputs.front().height, 10);
+    BOOST_CHECK_EQUAL(outputs.back().height, 19);
+
+    // Spend the first coinbase to another script in a new block.
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript other_script = GetScriptForDestination(PKHash(key.GetPubKey()));
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = other_script;
+    std::vector<unsigned char> sig;
+    uint256 sighash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(sighash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << sig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, GetScriptForDestination(PKHash(coinbaseKey.GetPubKey())));
+    BOOST_REQUIRE_EQUAL(block.vtx.size(), 2U);
+    BOOST_CHECK(addressindex.BlockUntilSyncedToCurrentChain());
+    const int spend_height = static_cast<int>(m_coinbase_txns.size()) + 1;
+
+    outputs.clear();
+    BOOST_CHECK(addressindex.FindOutputs(coinbase_hash, 1, 1, false, outputs));
+    BOOST_REQUIRE_EQUAL(outputs.size(), 1U);
+    BOOST_CHECK(outputs[0].IsSpent());
+    BOOST_CHECK(outputs[0].spent_txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(outputs[0].spent_vin, 0U);
+    BOOST_CHECK_EQUAL(outputs[0].spent_height, spend_height);
+
+    outputs.clear();
+    BOOST_CHECK(addressindex.FindOutputs(coinbase_hash, 0, std::numeric_limits<int>::max(), true, outputs));
+    BOOST_CHECK_EQUAL(outputs.size(), m_coinbase_txns.size() - 1);
+
+    outputs.clear();
+    BOOST_CHECK(addressindex.FindOutputs(AddressIndex::GetScriptHash(other_script), outputs));
+    BOOST_REQUIRE_EQUAL(outputs.size(), 1U);
+    BOOST_CHECK(outputs[0].txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(outputs[0].height, spend_height);
+    BOOST_CHECK_EQUAL(outputs[0].value, 11 * CENT);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    addressindex.Stop();
+
+    // addressindex job may be scheduled, so stop scheduler before destructing
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
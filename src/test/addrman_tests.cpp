@@ -713,6 +713,43 @@ BOOST_AUTO_TEST_CASE(caddrinfo_get_new_bucket)
 
 }
 
+BOOST_AUTO_TEST_CASE(asmap_lookup)
+{
+    // The decoded program gives the same results as interpreting the bytecode,
+    // for asmap.raw and for random, mostly malformed, bytecode.
+    std::vector<std::vector<bool>> asmaps{FromBytes(asmap_raw, sizeof(asmap_raw) * 8), {}};
+    for (int i = 0; i < 100; ++i) {
+        std::vector<bool> bits(InsecureRandRange(200));
+        for (size_t j = 0; j < bits.size(); ++j) bits[j] = InsecureRandBool();
+        asmaps.push_back(bits);
+    }
+    for (const std::vector<bool>& bits : asmaps) {
+        const Asmap asmap(bits);
+        BOOST_CHECK(asmap.GetBits() == bits);
+        for (int i = 0; i < 200; ++i) {
+            std::array<uint8_t, 16> ip;
+            for (uint8_t& byte : ip) byte = InsecureRandBits(8);
+            if (i % 2 == 0) {
+                // IPv4 addresses in the ranges of asmap.raw
+                const uint8_t ipv4_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+                std::copy(std::begin(ipv4_prefix), std::end(ipv4_prefix), ip.begin());
+                ip[12] = i % 4 == 0 ? 250 : 101;
+                ip[13] = InsecureRandRange(10);
+            }
+            std::vector<bool> ip_bits(128);
+            for (int bit = 0; bit < 128; ++bit) {
+                ip_bits[bit] = (ip[bit / 8] >> (7 - bit % 8)) & 1;
+            }
+            BOOST_CHECK_EQUAL(asmap.Lookup(ip), Interpret(bits, ip_bits));
+        }
+    }
+
+    const Asmap asmap(FromBytes(asmap_raw, sizeof(asmap_raw) * 8));
+    BOOST_CHECK_EQUAL(ResolveIP("250.1.2.3").GetMappedAS(asmap), 1000U);
+    BOOST_CHECK_EQUAL(ResolveIP("101.4.2.3").GetMappedAS(asmap), 4U);
+    BOOST_CHECK_EQUAL(ResolveIP("::FFFF:0:6504:203").GetMappedAS(asmap), 4U);
+}
+
 BOOST_AUTO_TEST_CASE(addrman_serialization)
 {
     std::vector<bool> asmap1 = FromBytes(asmap_raw, sizeof(asmap_raw) * 8);
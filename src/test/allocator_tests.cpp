@@ -2,12 +2,15 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <memusage.h>
+#include <support/allocators/pool.h>
 #include <util/memory.h>
 #include <util/system.h>
 
 #include <test/util/setup_common.h>
 
 #include <memory>
+#include <unordered_map>
 
 #include <boost/test/unit_test.hpp>
 
@@ -233,4 +236,108 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(large_page_manager_tests)
+{
+    LargePageManager manager;
+    BOOST_CHECK(manager.GetMode() == LargePageManager::Mode::NONE);
+    // Memory from ::operator new, freed correctly even after the mode changes
+    void* plain = manager.Allocate(100);
+    BOOST_CHECK_EQUAL(manager.stats().mapped, 0U);
+    if (!LargePageManager::Supported()) {
+        BOOST_CHECK(!manager.Configure(LargePageManager::Mode::THP, -1));
+        manager.Free(plain, 100);
+        return;
+    }
+    BOOST_CHECK(!manager.Configure(LargePageManager::Mode::THP, 1000));
+    BOOST_CHECK(manager.Configure(LargePageManager::Mode::HUGETLB, -1));
+    manager.Free(plain, 100);
+
+    // Small requests share one region, large ones get their own aligned mapping.
+    // Without a hugetlbfs reservation both fall back to transparent huge pages.
+    char* a = static_cast<char*>(manager.Allocate(1000));
+    char* b = static_cast<char*>(manager.Allocate(1000));
+    char* big = static_cast<char*>(manager.Allocate(LargePageManager::REGION_SIZE + 1));
+    const LargePageManager::Stats stats = manager.stats();
+    BOOST_CHECK_EQUAL(stats.mapped, 3 * LargePageManager::REGION_SIZE);
+    BOOST_CHECK_EQUAL(stats.used, 2 * 1024 + 2 * LargePageManager::REGION_SIZE);
+    BOOST_CHECK_EQUAL(stats.mapped - stats.hugetlb > 0, stats.hugetlb_failures > 0);
+    BOOST_CHECK(b == a + 1024);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(a) % LargePageManager::REGION_SIZE, 0U);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(big) % LargePageManager::REGION_SIZE, 0U);
+    memset(a, 1, 2048);
+    memset(big, 2, LargePageManager::REGION_SIZE + 1);
+
+    // Freed small blocks are recycled by size, freed large mappings unmapped
+    manager.Free(a, 1000);
+    BOOST_CHECK(manager.Allocate(990) == a);
+    BOOST_CHECK(manager.Configure(LargePageManager::Mode::NONE, -1));
+    manager.Free(big, LargePageManager::REGION_SIZE + 1);
+    manager.Free(a, 990);
+    manager.Free(b, 1000);
+    BOOST_CHECK_EQUAL(manager.stats().mapped, LargePageManager::REGION_SIZE);
+    BOOST_CHECK_EQUAL(manager.stats().used, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(pool_resource_tests)
+{
+    PoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0U);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024U);
+
+    // Blocks are carved sequentially from the first chunk, rounded up to the alignment
+    char* a = static_cast<char*>(resource.Allocate(8, 8));
+    char* b = static_cast<char*>(resource.Allocate(5, 8));
+    char* c = static_cast<char*>(resource.Allocate(16, 8));
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK(b == a + 8);
+    BOOST_CHECK(c == b + 8);
+
+    // A freed block is recycled only for requests of the same rounded size
+    resource.Deallocate(b, 5, 8);
+    BOOST_CHECK(resource.Allocate(16, 8) == c + 16);
+    BOOST_CHECK(resource.Allocate(7, 8) == b);
+
+    // Oversized requests bypass the pool
+    void* big = resource.Allocate(65, 8);
+    BOOST_CHECK(big != nullptr);
+    resource.Deallocate(big, 65, 8);
+
+    // Exhausting a chunk allocates a new one and keeps the old tail usable
+    for (int i = 0; i < 20; ++i) {
+        resource.Allocate(64, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+    resource.Deallocate(a, 8, 8);
+    resource.Deallocate(c, 16, 8);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_unordered_map)
+{
+    using Map = std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                                   PoolAllocator<std::pair<const uint64_t, uint64_t>, sizeof(std::pair<const uint64_t, uint64_t>) + sizeof(void*) * 4, alignof(void*)>>;
+    Map::allocator_type::ResourceType resource(4096);
+    {
+        Map map{0, Map::hasher{}, Map::key_equal{}, &resource};
+        for (uint64_t i = 0; i < 1000; ++i) {
+            map[i] = i * i;
+        }
+        for (uint64_t i = 0; i < 1000; i += 2) {
+            map.erase(i);
+        }
+        BOOST_CHECK_EQUAL(map.size(), 500U);
+        for (uint64_t i = 1; i < 1000; i += 2) {
+            BOOST_CHECK_EQUAL(map.at(i), i * i);
+        }
+
+        // Freed nodes are reused, so refilling doesn't grow the pool
+        const size_t chunks = resource.NumAllocatedChunks();
+        BOOST_CHECK(chunks > 0);
+        for (uint64_t i = 0; i < 1000; i += 2) {
+            map[i] = i;
+        }
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), chunks);
+        BOOST_CHECK(memusage::DynamicUsage(map) >= chunks * resource.ChunkSizeBytes());
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
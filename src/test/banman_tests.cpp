@@ -0,0 +1,149 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <banman.h>
+#include <netbase.h>
+#include <test/util/setup_common.h>
+#include <util/system.h>
+#include <util/time.h>
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(banman_tests, BasicTestingSetup)
+
+static CNetAddr ResolveIP(const std::string& ip)
+{
+    CNetAddr addr;
+    LookupHost(ip, addr, false);
+    return addr;
+}
+
+static CSubNet ResolveSubNet(const std::string& subnet)
+{
+    CSubNet ret;
+    LookupSubNet(subnet, ret);
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(subnet_trie)
+{
+    SubNetTrie trie;
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("1.2.3.4")), 0);
+
+    BOOST_CHECK(trie.Insert(ResolveSubNet("1.2.3.4"), 1));
+    BOOST_CHECK(trie.Insert(ResolveSubNet("1.2.0.0/16"), 2));
+    BOOST_CHECK(trie.Insert(ResolveSubNet("1.3.0.0/16"), 3));
+    BOOST_CHECK(trie.Insert(ResolveSubNet("0.0.0.0/0"), 4));
+    BOOST_CHECK(trie.Insert(ResolveSubNet("2001:db8::/32"), 5));
+    BOOST_CHECK(trie.Insert(ResolveSubNet("2001:db8:1::/48"), 6));
+    BOOST_CHECK(trie.Insert(ResolveSubNet("::/0"), 1));
+    // Netmasks that are not a prefix are left to the caller
+    BOOST_CHECK(!trie.Insert(ResolveSubNet("1.2.3.4/255.0.255.0"), 7));
+    BOOST_CHECK_EQUAL(trie.Size(), 7U);
+
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("1.2.3.4")), 4);
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("9.9.9.9")), 4);
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("2001:db8:1::1")), 6);
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("2001:db8:2::1")), 5);
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("2001:db9::1")), 1);
+
+    // Replacing a value, and erasing subnets the others branch off from
+    BOOST_CHECK(trie.Insert(ResolveSubNet("1.2.3.4/32"), 9));
+    BOOST_CHECK_EQUAL(trie.Size(), 7U);
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("1.2.3.4")), 9);
+    BOOST_CHECK(trie.Erase(ResolveSubNet("0.0.0.0/0")));
+    BOOST_CHECK(!trie.Erase(ResolveSubNet("0.0.0.0/0")));
+    BOOST_CHECK(!trie.Erase(ResolveSubNet("1.2.3.0/24")));
+    BOOST_CHECK(trie.Erase(ResolveSubNet("::/0")));
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("9.9.9.9")), 0);
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("1.2.9.9")), 2);
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("1.3.9.9")), 3);
+    BOOST_CHECK(trie.Erase(ResolveSubNet("1.2.0.0/16")));
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("1.2.9.9")), 0);
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("1.2.3.4")), 9);
+    BOOST_CHECK_EQUAL(trie.Size(), 4U);
+
+    trie.Clear();
+    BOOST_CHECK_EQUAL(trie.Size(), 0U);
+    BOOST_CHECK_EQUAL(trie.GetMaxMatch(ResolveIP("1.2.3.4")), 0);
+}
+
+BOOST_AUTO_TEST_CASE(subnet_trie_random)
+{
+    // Compare against CSubNet::Match over random nested prefixes
+    SubNetTrie trie;
+    std::vector<std::pair<CSubNet, int64_t>> entries;
+    for (int i = 0; i < 200; ++i) {
+        const std::string ip = strprintf("10.%d.%d.%d", InsecureRandRange(4), InsecureRandRange(4), InsecureRandRange(4));
+        const CSubNet sub_net = ResolveSubNet(strprintf("%s/%d", ip, 8 + InsecureRandRange(25)));
+        const int64_t value = 1 + InsecureRandRange(1000);
+        BOOST_CHECK(trie.Insert(sub_net, value));
+        bool found = false;
+        for (auto& entry : entries) {
+            if (entry.first == sub_net) {
+                entry.second = value;
+                found = true;
+            }
+        }
+        if (!found) entries.emplace_back(sub_net, value);
+        if (InsecureRandBool() && !entries.empty()) {
+            const size_t pos = InsecureRandRange(entries.size());
+            BOOST_CHECK(trie.Erase(entries[pos].first));
+            entries.erase(entries.begin() + pos);
+        }
+        BOOST_CHECK_EQUAL(trie.Size(), entries.size());
+
+        const CNetAddr addr = ResolveIP(strprintf("10.%d.%d.%d", InsecureRandRange(4), InsecureRandRange(4), InsecureRandRange(4)));
+        int64_t expected = 0;
+        for (const auto& entry : entries) {
+            if (entry.first.Match(addr)) expected = std::max(expected, entry.second);
+        }
+        BOOST_CHECK_EQUAL(trie.GetMaxMatch(addr), expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(banman_subnets)
+{
+    BanMan banman(GetDataDir() / "banlist.dat", nullptr, DEFAULT_MISBEHAVING_BANTIME);
+    const int64_t now = GetTime();
+    SetMockTime(now);
+
+    banman.Ban(ResolveSubNet("1.2.0.0/16"), 100);
+    banman.Ban(ResolveIP("2a00:1450::1"), 200);
+    banman.Ban(ResolveSubNet("5.0.6.0/255.0.255.0"), 300);
+    BOOST_CHECK(banman.IsBanned(ResolveIP("1.2.3.4")));
+    BOOST_CHECK(!banman.IsBanned(ResolveIP("1.3.3.4")));
+    BOOST_CHECK(banman.IsBanned(ResolveIP("2a00:1450::1")));
+    BOOST_CHECK(!banman.IsBanned(ResolveIP("2a00:1450::2")));
+    BOOST_CHECK(banman.IsBanned(ResolveIP("5.9.6.9")));
+    BOOST_CHECK(!banman.IsBanned(ResolveIP("5.9.7.9")));
+
+    // A shorter ban does not replace a longer one
+    banman.Ban(ResolveSubNet("1.2.0.0/16"), 50);
+    SetMockTime(now + 101);
+    BOOST_CHECK(!banman.IsBanned(ResolveIP("1.2.3.4")));
+    BOOST_CHECK(banman.IsBanned(ResolveIP("2a00:1450::1")));
+
+    // Expired bans are swept
+    banmap_t banmap;
+    banman.GetBanned(banmap);
+    BOOST_CHECK_EQUAL(banmap.size(), 2U);
+    SetMockTime(now + 201);
+    banman.GetBanned(banmap);
+    BOOST_CHECK_EQUAL(banmap.size(), 1U);
+    BOOST_CHECK(banman.IsBanned(ResolveIP("5.9.6.9")));
+
+    BOOST_CHECK(banman.Unban(ResolveSubNet("5.0.6.0/255.0.255.0")));
+    BOOST_CHECK(!banman.Unban(ResolveSubNet("5.0.6.0/255.0.255.0")));
+    BOOST_CHECK(!banman.IsBanned(ResolveIP("5.9.6.9")));
+
+    banman.Ban(ResolveIP("1.2.3.4"), 100);
+    banman.ClearBanned();
+    BOOST_CHECK(!banman.IsBanned(ResolveIP("1.2.3.4")));
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -11,6 +11,7 @@
 #include <util/strencodings.h>
 #include <test/util/setup_common.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -116,6 +117,27 @@ static void RunTest(const TestVector &test) {
             BOOST_CHECK(pubkey.Derive(pubkeyNew2, derive.nChild));
             BOOST_CHECK(pubkeyNew == pubkeyNew2);
         }
+
+        // Batch derivation of this child and up to 8 siblings after it, as
+        // long as they are all normal or all hardened children
+        const size_t count = std::min<uint64_t>(9, uint64_t{derive.nChild | 0x7FFFFFFFU} - derive.nChild + 1);
+        std::vector<CExtKey> keys;
+        BOOST_CHECK(key.DeriveMany(keys, derive.nChild, count));
+        BOOST_CHECK_EQUAL(keys.size(), count);
+        BOOST_CHECK(keys[0] == keyNew);
+        for (unsigned int i = 1; i < keys.size(); ++i) {
+            CExtKey sibling;
+            BOOST_CHECK(key.Derive(sibling, derive.nChild + i));
+            BOOST_CHECK(keys[i] == sibling);
+        }
+        if (!(derive.nChild & 0x80000000)) {
+            std::vector<CExtPubKey> pubkeys;
+            BOOST_CHECK(pubkey.DeriveMany(pubkeys, derive.nChild, count));
+            BOOST_CHECK_EQUAL(pubkeys.size(), count);
+            for (unsigned int i = 0; i < pubkeys.size(); ++i) {
+                BOOST_CHECK(pubkeys[i] == keys[i].Neuter());
+            }
+        }
         key = keyNew;
         pubkey = pubkeyNew;
     }
@@ -258,6 +258,16 @@ BOOST_FIXTURE_TEST_CASE(blockfilter_index_initial_sync, BuildChainTestingSetup)
     BOOST_CHECK_EQUAL(filters.size(), tip->nHeight + 1);
     BOOST_CHECK_EQUAL(filter_hashes.size(), tip->nHeight + 1);
 
+    // Repeated range lookups are served from the filter cache.
+    std::vector<BlockFilter> cached_filters;
+    BOOST_CHECK(filter_index.LookupFilterRange(0, tip, cached_filters));
+    BOOST_CHECK_EQUAL(cached_filters.size(), filters.size());
+    for (size_t i = 0; i < filters.size(); ++i) {
+        BOOST_CHECK_EQUAL(filters[i].GetHash(), filter_hashes[i]);
+        BOOST_CHECK_EQUAL(cached_filters[i].GetBlockHash(), filters[i].GetBlockHash());
+        BOOST_CHECK(cached_filters[i].GetEncodedFilter() == filters[i].GetEncodedFilter());
+    }
+
     filters.clear();
     filter_hashes.clear();
 
@@ -39,6 +39,58 @@ BOOST_AUTO_TEST_CASE(gcsfilter_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(gcsfilter_batch_match_test)
+{
+    // Filters with different keys and coding parameters, each holding its own elements.
+    std::vector<GCSFilter> filters;
+    std::vector<GCSFilter::ElementSet> filter_elements;
+    for (int f = 0; f < 20; ++f) {
+        GCSFilter::ElementSet elements;
+        for (int i = 0; i < 50 * f; ++i) {
+            GCSFilter::Element element(32);
+            element[0] = f;
+            element[1] = i;
+            element[2] = i >> 8;
+            elements.insert(std::move(element));
+        }
+        filters.emplace_back(GCSFilter::Params(f, 1000 * f, 1 + f * 3, 1 << (1 + f)), elements);
+        filter_elements.push_back(std::move(elements));
+    }
+
+    std::vector<const GCSFilter*> filter_ptrs;
+    for (const GCSFilter& filter : filters) {
+        // Decoding the encoding again checks that it holds exactly N codes.
+        GCSFilter decoded(filter.GetParams(), filter.GetEncoded());
+        BOOST_CHECK_EQUAL(decoded.GetN(), filter.GetN());
+        filter_ptrs.push_back(&filter);
+    }
+
+    GCSFilter::ElementSet query;
+    for (int i = 0; i < 30; ++i) {
+        GCSFilter::Element element(32);
+        element[3] = i;
+        query.insert(std::move(element));
+    }
+    query.insert(*filter_elements[7].begin());
+    query.insert(*filter_elements[13].begin());
+
+    std::vector<bool> matches = GCSFilter::MatchAny(filter_ptrs, query);
+    BOOST_REQUIRE_EQUAL(matches.size(), filters.size());
+    for (size_t f = 0; f < filters.size(); ++f) {
+        BOOST_CHECK_EQUAL(matches[f], filters[f].MatchAny(query));
+    }
+    BOOST_CHECK(matches[7]);
+    BOOST_CHECK(matches[13]);
+    BOOST_CHECK(!matches[0]);
+
+    // Encodings with missing or excess data are rejected.
+    std::vector<unsigned char> encoded = filters[10].GetEncoded();
+    encoded.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter(filters[10].GetParams(), encoded), std::ios_base::failure);
+    encoded.resize(encoded.size() - 2);
+    BOOST_CHECK_THROW(GCSFilter(filters[10].GetParams(), encoded), std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
 {
     GCSFilter filter;
@@ -0,0 +1,105 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <index/blockstatsindex.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <undo.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockstatsindex_tests)
+
+static CBlockStats StatsFromDisk(const CBlockIndex* block_index)
+{
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, block_index, Params().GetConsensus()));
+    CBlockUndo block_undo;
+    BOOST_REQUIRE(UndoReadFromDisk(block_undo, block_index));
+    CBlockStats stats;
+    BOOST_REQUIRE(ComputeBlockStats(block, block_undo, stats));
+    return stats;
+}
+
+BOOST_FIXTURE_TEST_CASE(blockstatsindex_initial_sync, TestChain100Setup)
+{
+    BlockStatsIndex block_stats_index(1 << 20, true);
+
+    const CBlockIndex* block_index = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    CBlockStats index_stats;
+    BlockStatsTotals totals;
+
+    // Stats should not be found in the index before it is started.
+    BOOST_CHECK(!block_stats_index.LookUpStats(block_index, index_stats));
+
+    block_stats_index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!block_stats_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    // The chain only holds coinbase transactions with a single output each.
+    BOOST_REQUIRE(block_stats_index.LookUpStats(block_index, index_stats));
+    BOOST_CHECK(SerializeHash(index_stats) == SerializeHash(StatsFromDisk(block_index)));
+    BOOST_CHECK_EQUAL(index_stats.txs, 1);
+    BOOST_REQUIRE(block_stats_index.LookUpTotals(block_index, totals));
+    BOOST_CHECK_EQUAL(totals.outputs_created, (uint64_t)block_index->nHeight + 1);
+    BOOST_CHECK_EQUAL(totals.outputs_spent, 0U);
+    BOOST_CHECK_EQUAL(totals.total_fees, 0);
+
+    // Spend the first coinbase in a new block, paying a fee.
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    spend.vout[1].nValue = m_coinbase_txns[0]->vout[0].nValue - 11 * CENT - 1000;
+    spend.vout[1].scriptPubKey = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    std::vector<unsigned char> sig;
+    uint256 sighash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(sighash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << sig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, GetScriptForDestination(PKHash(coinbaseKey.GetPubKey())));
+    BOOST_REQUIRE_EQUAL(block.vtx.size(), 2U);
+    BOOST_CHECK(block_stats_index.BlockUntilSyncedToCurrentChain());
+
+    const CBlockIndex* new_block_index = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    BOOST_REQUIRE(new_block_index->GetBlockHash() == block.GetHash());
+    CBlockStats new_index_stats;
+    BOOST_REQUIRE(block_stats_index.LookUpStats(new_block_index, new_index_stats));
+    BOOST_CHECK(SerializeHash(new_index_stats) == SerializeHash(StatsFromDisk(new_block_index)));
+    BOOST_CHECK_EQUAL(new_index_stats.txs, 2);
+    BOOST_CHECK_EQUAL(new_index_stats.ins, 1);
+    BOOST_CHECK_EQUAL(new_index_stats.totalfee, 1000);
+
+    // The totals of the window between the two blocks are those of the new block.
+    BlockStatsTotals new_totals;
+    BOOST_REQUIRE(block_stats_index.LookUpTotals(new_block_index, new_totals));
+    BOOST_CHECK_EQUAL(new_totals.total_fees - totals.total_fees, 1000);
+    BOOST_CHECK_EQUAL(new_totals.outputs_created - totals.outputs_created, 3U);
+    BOOST_CHECK_EQUAL(new_totals.outputs_spent - totals.outputs_spent, 1U);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    block_stats_index.Stop();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include <bloom.h>
 
 #include <clientversion.h>
+#include <hash.h>
 #include <key.h>
 #include <key_io.h>
 #include <merkleblock.h>
@@ -175,6 +176,32 @@ BOOST_AUTO_TEST_CASE(bloom_match)
     BOOST_CHECK_MESSAGE(!filter.IsRelevantAndUpdate(tx), "Simple Bloom filter matched COutPoint for an output we didn't care about");
 }
 
+BOOST_AUTO_TEST_CASE(bloom_murmurhash3_multi)
+{
+    // Hashing under many seeds at once gives the same hashes as one at a time,
+    // for every tail length.
+    for (int i = 0; i < 100; ++i) {
+        const std::vector<unsigned char> data = g_insecure_rand_ctx.randbytes(InsecureRandRange(80));
+        uint32_t seeds[MAX_HASH_FUNCS], hashes[MAX_HASH_FUNCS];
+        const size_t count = 1 + InsecureRandRange(MAX_HASH_FUNCS);
+        for (size_t j = 0; j < count; ++j) seeds[j] = InsecureRand32();
+        MurmurHash3Multi(seeds, count, data.data(), data.size(), hashes);
+        for (size_t j = 0; j < count; ++j) {
+            BOOST_CHECK_EQUAL(hashes[j], MurmurHash3(seeds[j], data));
+        }
+    }
+
+    // Outpoints match the same bits as their network serialization.
+    CBloomFilter filter(100, 0.001, InsecureRand32(), BLOOM_UPDATE_ALL);
+    for (int i = 0; i < 100; ++i) {
+        const COutPoint outpoint(InsecureRand256(), InsecureRand32());
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << outpoint;
+        filter.insert(outpoint);
+        BOOST_CHECK(filter.contains(std::vector<unsigned char>(stream.begin(), stream.end())));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(merkle_block_1)
 {
     CBlock block = getBlock13b8a();
@@ -489,7 +516,7 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
             ++nHits;
     }
     // Expect about 100 hits
-    BOOST_CHECK_EQUAL(nHits, 75);
+    BOOST_CHECK_EQUAL(nHits, 80);
 
     BOOST_CHECK(rb1.contains(data[DATASIZE-1]));
     rb1.reset();
@@ -517,7 +544,7 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
             ++nHits;
     }
     // Expect about 5 false positives
-    BOOST_CHECK_EQUAL(nHits, 6);
+    BOOST_CHECK_EQUAL(nHits, 2);
 
     // last-1000-entry, 0.01% false positive:
     CRollingBloomFilter rb2(1000, 0.001);
@@ -531,4 +558,38 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(adaptive_rolling_bloom)
+{
+    int64_t now = 1000000;
+    SetMockTime(now);
+    CAdaptiveRollingBloomFilter filter(100, 800, 0.001, std::chrono::seconds{3600});
+    BOOST_CHECK_EQUAL(filter.capacity(), 100U);
+    const size_t small_usage = filter.DynamicMemoryUsage();
+
+    // Items inserted quickly grow the filter up to its maximum, without
+    // forgetting recent ones across resizes.
+    std::vector<uint256> items;
+    for (int i = 0; i < 2000; ++i) {
+        if (i >= 100) BOOST_CHECK(filter.contains(items[i - 100]));
+        items.push_back(InsecureRand256());
+        filter.insert(items.back());
+        BOOST_CHECK(filter.contains(items.back()));
+    }
+    BOOST_CHECK_EQUAL(filter.capacity(), 800U);
+    for (int i = 2000 - 800; i < 2000; ++i) {
+        BOOST_CHECK(filter.contains(items[i]));
+    }
+    BOOST_CHECK(filter.DynamicMemoryUsage() > 4 * small_usage);
+
+    // Items inserted slowly shrink it again, down to its minimum.
+    for (int i = 0; i < 2000; ++i) {
+        now += 600;
+        SetMockTime(now);
+        filter.insert(InsecureRand256());
+    }
+    BOOST_CHECK_EQUAL(filter.capacity(), 100U);
+    BOOST_CHECK(filter.DynamicMemoryUsage() < 2 * small_usage);
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -139,14 +139,19 @@ typedef CCheckQueue<FailingCheck> Failing_Queue;
 typedef CCheckQueue<UniqueCheck> Unique_Queue;
 typedef CCheckQueue<MemoryCheck> Memory_Queue;
 typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
+typedef CWorkStealingCheckQueue<FakeCheckCheckCompletion> Correct_Stealing_Queue;
+typedef CWorkStealingCheckQueue<FailingCheck> Failing_Stealing_Queue;
+typedef CWorkStealingCheckQueue<UniqueCheck> Unique_Stealing_Queue;
+typedef CWorkStealingCheckQueue<MemoryCheck> Memory_Stealing_Queue;
 
 
 /** This test case checks that the CCheckQueue works properly
  * with each specified size_t Checks pushed.
  */
+template <typename Queue = Correct_Queue>
 static void Correct_Queue_range(std::vector<size_t> range)
 {
-    auto small_queue = MakeUnique<Correct_Queue>(QUEUE_BATCH_SIZE);
+    auto small_queue = MakeUnique<Queue>(QUEUE_BATCH_SIZE);
     boost::thread_group tg;
     for (auto x = 0; x < SCRIPT_CHECK_THREADS; ++x) {
        tg.create_thread([&]{small_queue->Thread();});
@@ -156,7 +161,7 @@ static void Correct_Queue_range(std::vector<size_t> range)
     for (const size_t i : range) {
         size_t total = i;
         FakeCheckCheckCompletion::n_calls = 0;
-        CCheckQueueControl<FakeCheckCheckCompletion> control(small_queue.get());
+        CCheckQueueControl<FakeCheckCheckCompletion, Queue> control(small_queue.get());
         while (total) {
             vChecks.resize(std::min(total, (size_t) InsecureRandRange(10)));
             total -= vChecks.size();
@@ -379,6 +384,82 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_FrozenCleanup)
 }
 
 
+/** Test that the work stealing queue runs every check exactly once */
+BOOST_AUTO_TEST_CASE(test_WorkStealingCheckQueue_Correct)
+{
+    std::vector<size_t> range{0, 1, 100000};
+    for (size_t i = 2; i < 100000; i += std::max((size_t)1, (size_t)InsecureRandRange(std::min((size_t)1000, ((size_t)100000) - i))))
+        range.push_back(i);
+    Correct_Queue_range<Correct_Stealing_Queue>(range);
+
+    auto queue = MakeUnique<Unique_Stealing_Queue>(QUEUE_BATCH_SIZE);
+    boost::thread_group tg;
+    for (auto x = 0; x < SCRIPT_CHECK_THREADS; ++x) {
+        tg.create_thread([&]{queue->Thread();});
+    }
+    UniqueCheck::results.clear();
+    size_t total = 100000;
+    {
+        CCheckQueueControl<UniqueCheck, Unique_Stealing_Queue> control(queue.get());
+        while (total) {
+            size_t r = InsecureRandRange(10);
+            std::vector<UniqueCheck> vChecks;
+            for (size_t k = 0; k < r && total; k++)
+                vChecks.emplace_back(--total);
+            control.Add(vChecks);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(UniqueCheck::results.size(), 100000U);
+    for (size_t i = 0; i < 100000; ++i)
+        BOOST_REQUIRE_EQUAL(UniqueCheck::results.count(i), 1U);
+    UniqueCheck::results.clear();
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+/** Test that the work stealing queue catches failures, recovers from them and frees its checks */
+BOOST_AUTO_TEST_CASE(test_WorkStealingCheckQueue_Failure_Memory)
+{
+    auto fail_queue = MakeUnique<Failing_Stealing_Queue>(QUEUE_BATCH_SIZE);
+    auto memory_queue = MakeUnique<Memory_Stealing_Queue>(QUEUE_BATCH_SIZE);
+    boost::thread_group tg;
+    for (auto x = 0; x < SCRIPT_CHECK_THREADS; ++x) {
+        tg.create_thread([&]{fail_queue->Thread();});
+        tg.create_thread([&]{memory_queue->Thread();});
+    }
+    for (size_t i = 0; i < 1001; ++i) {
+        CCheckQueueControl<FailingCheck, Failing_Stealing_Queue> control(fail_queue.get());
+        size_t remaining = i;
+        while (remaining) {
+            size_t r = InsecureRandRange(10);
+            std::vector<FailingCheck> vChecks;
+            vChecks.reserve(r);
+            for (size_t k = 0; k < r && remaining; k++, remaining--)
+                vChecks.emplace_back(remaining == 1);
+            control.Add(vChecks);
+        }
+        BOOST_REQUIRE_EQUAL(control.Wait(), i == 0);
+    }
+    for (size_t i = 0; i < 1000; ++i) {
+        size_t total = i;
+        {
+            CCheckQueueControl<MemoryCheck, Memory_Stealing_Queue> control(memory_queue.get());
+            while (total) {
+                size_t r = InsecureRandRange(10);
+                std::vector<MemoryCheck> vChecks;
+                for (size_t k = 0; k < r && total; k++) {
+                    total--;
+                    vChecks.emplace_back(total == 0 || total == i || total == i/2);
+                }
+                control.Add(vChecks);
+            }
+        }
+        BOOST_REQUIRE_EQUAL(MemoryCheck::fake_allocated_memory, 0U);
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
 /** Test that CCheckQueueControl is threadsafe */
 BOOST_AUTO_TEST_CASE(test_CheckQueueControl_Locks)
 {
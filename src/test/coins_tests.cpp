@@ -8,6 +8,7 @@
 #include <script/standard.h>
 #include <streams.h>
 #include <test/util/setup_common.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <util/strencodings.h>
@@ -592,7 +593,8 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
 
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map{0, CCoinsMap::hasher{}, CCoinsMap::key_equal{}, &resource};
     InsertCoinsMapEntry(map, value, flags);
     BOOST_CHECK(view.BatchWrite(map, {}));
 }
@@ -861,4 +863,432 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_partial_flush)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+
+    std::vector<COutPoint> outpoints;
+    for (uint32_t i = 0; i < 10000; ++i) {
+        Coin coin;
+        coin.out.nValue = 1 + i;
+        coin.nHeight = 1;
+        outpoints.emplace_back(InsecureRand256(), i);
+        cache.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    cache.SetBestBlock(InsecureRand256());
+
+    // With room to spare, everything is written out and stays cached, clean.
+    BOOST_CHECK(cache.PartialFlush(cache.DynamicMemoryUsage()));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), outpoints.size());
+    for (const auto& entry : cache.map()) {
+        BOOST_CHECK_EQUAL(entry.second.flags, 0);
+    }
+    for (const COutPoint& outpoint : outpoints) {
+        Coin coin;
+        BOOST_CHECK(base.GetCoin(outpoint, coin) && !coin.IsSpent());
+    }
+    cache.SelfTest();
+
+    // Touch a few coins and spend a few others. Spent ones are written and
+    // dropped, untouched ones are evicted before the touched ones.
+    for (size_t i = 0; i < 100; ++i) {
+        cache.AccessCoin(outpoints[i]);
+    }
+    for (size_t i = 100; i < 110; ++i) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+    }
+    const size_t usage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(cache.PartialFlush(usage / 4));
+    BOOST_CHECK(cache.GetCacheSize() <= outpoints.size() / 4);
+    BOOST_CHECK(cache.GetCacheSize() >= outpoints.size() / 4 - 10);
+    BOOST_CHECK(cache.DynamicMemoryUsage() < usage / 2);
+    for (size_t i = 0; i < 100; ++i) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+    }
+    for (size_t i = 100; i < 110; ++i) {
+        Coin coin;
+        BOOST_CHECK(!cache.HaveCoinInCache(outpoints[i]));
+        BOOST_CHECK(!base.GetCoin(outpoints[i], coin) || coin.IsSpent());
+    }
+    for (const auto& entry : cache.map()) {
+        BOOST_CHECK_EQUAL(entry.second.flags, 0);
+    }
+    cache.SelfTest();
+
+    // Evicted coins are still available from the base.
+    for (size_t i = 110; i < outpoints.size(); ++i) {
+        BOOST_CHECK_EQUAL(cache.AccessCoin(outpoints[i]).out.nValue, 1 + (CAmount)i);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_emplace_from_base)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    const COutPoint outpoint(InsecureRand256(), 0);
+
+    Coin coin;
+    coin.out.nValue = 1;
+    coin.nHeight = 1;
+    cache.EmplaceCoinFromBase(outpoint, std::move(coin));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK_EQUAL(cache.map().at(outpoint).flags, 0);
+    cache.SelfTest();
+
+    // An existing entry is never replaced, even if it was spent meanwhile.
+    BOOST_CHECK(cache.SpendCoin(outpoint));
+    Coin stale;
+    stale.out.nValue = 1;
+    stale.nHeight = 1;
+    cache.EmplaceCoinFromBase(outpoint, std::move(stale));
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoint));
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_background_flush)
+{
+    CCoinsViewDB db(GetDataDir() / "background_flush", 1 << 20, /* fMemory */ true, /* fWipe */ false);
+    CCoinsViewBackgroundFlush flush_view(&db, db, /* background */ true);
+    CCoinsViewCache cache(&flush_view);
+
+    std::vector<COutPoint> outpoints;
+    for (uint32_t i = 0; i < 100; ++i) {
+        Coin coin;
+        coin.out.nValue = 1000 + i;
+        coin.nHeight = 1;
+        outpoints.emplace_back(InsecureRand256(), i);
+        cache.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    const uint256 first_block = InsecureRand256();
+    cache.SetBestBlock(first_block);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+
+    // Reads are served whether or not the background write has finished.
+    BOOST_CHECK(flush_view.GetBestBlock() == first_block);
+    for (uint32_t i = 0; i < outpoints.size(); ++i) {
+        BOOST_CHECK(cache.HaveCoin(outpoints[i]));
+        BOOST_CHECK_EQUAL(cache.AccessCoin(outpoints[i]).out.nValue, 1000 + i);
+    }
+
+    // Spend half of the coins while the next flush can still be outstanding.
+    for (uint32_t i = 0; i < outpoints.size(); i += 2) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+    }
+    const uint256 second_block = InsecureRand256();
+    cache.SetBestBlock(second_block);
+    BOOST_CHECK(cache.Flush());
+    for (uint32_t i = 0; i < outpoints.size(); ++i) {
+        BOOST_CHECK_EQUAL(flush_view.HaveCoin(outpoints[i]), i % 2 == 1);
+    }
+
+    // Once synced, the database itself is up to date.
+    BOOST_CHECK(flush_view.Sync());
+    BOOST_CHECK(db.GetBestBlock() == second_block);
+    for (uint32_t i = 0; i < outpoints.size(); ++i) {
+        Coin coin;
+        BOOST_CHECK_EQUAL(db.GetCoin(outpoints[i], coin), i % 2 == 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_journal)
+{
+    const fs::path journal = GetDataDir() / "coins.journal";
+    CCoinsViewDB db(GetDataDir() / "journal", 1 << 20, /* fMemory */ true, /* fWipe */ false);
+
+    // A journaled flush leaves no journal behind once the database is written.
+    {
+        CCoinsViewBackgroundFlush flush_view(&db, db, /* background */ false, journal);
+        CCoinsViewCache cache(&flush_view);
+        Coin coin;
+        coin.out.nValue = 1;
+        coin.nHeight = 1;
+        const COutPoint outpoint(InsecureRand256(), 0);
+        cache.AddCoin(outpoint, std::move(coin), false);
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK(!fs::exists(journal));
+        BOOST_CHECK(db.HaveCoin(outpoint));
+    }
+
+    // A journal whose write never reached the database is replayed into it.
+    CCoinsMapMemoryResource resource;
+    CCoinsMap coins{0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource};
+    std::vector<COutPoint> outpoints;
+    for (uint32_t i = 0; i < 100; ++i) {
+        outpoints.emplace_back(InsecureRand256(), i);
+        CCoinsCacheEntry& entry = coins[outpoints.back()];
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        // Every third entry spends a coin.
+        if (i % 3 == 0) continue;
+        entry.coin.out.nValue = 1000 + i;
+        entry.coin.nHeight = 2;
+    }
+    const uint256 prev_block = db.GetBestBlock();
+    const uint256 best_block = InsecureRand256();
+    BOOST_REQUIRE(WriteCoinsJournal(journal, coins, best_block, prev_block));
+
+    CCoinsMapMemoryResource read_resource;
+    CCoinsMap read{0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &read_resource};
+    uint256 read_best, read_prev;
+    BOOST_REQUIRE(ReadCoinsJournal(journal, read, read_best, read_prev));
+    BOOST_CHECK(read_best == best_block);
+    BOOST_CHECK(read_prev == prev_block);
+    BOOST_CHECK_EQUAL(read.size(), coins.size());
+
+    CCoinsViewBackgroundFlush flush_view(&db, db, /* background */ false, journal);
+    BOOST_CHECK(flush_view.ReplayJournal());
+    BOOST_CHECK(!fs::exists(journal));
+    BOOST_CHECK(db.GetBestBlock() == best_block);
+    for (uint32_t i = 0; i < outpoints.size(); ++i) {
+        Coin coin;
+        BOOST_CHECK_EQUAL(db.GetCoin(outpoints[i], coin), i % 3 != 0);
+        if (i % 3 != 0) BOOST_CHECK_EQUAL(coin.out.nValue, 1000 + i);
+    }
+
+    // Replaying a journal the database is already past is harmless.
+    BOOST_REQUIRE(WriteCoinsJournal(journal, coins, best_block, prev_block));
+    BOOST_CHECK(flush_view.ReplayJournal());
+    BOOST_CHECK(!fs::exists(journal));
+
+    // A journal starting elsewhere does not match the database.
+    BOOST_REQUIRE(WriteCoinsJournal(journal, coins, InsecureRand256(), InsecureRand256()));
+    BOOST_CHECK(!flush_view.ReplayJournal());
+
+    // Nor is a corrupted one applied.
+    BOOST_REQUIRE(WriteCoinsJournal(journal, coins, InsecureRand256(), best_block));
+    {
+        FILE* file = fsbridge::fopen(journal, "r+b");
+        BOOST_REQUIRE(file);
+        fseek(file, 100, SEEK_SET);
+        const int c = fgetc(file);
+        fseek(file, 100, SEEK_SET);
+        fputc(c ^ 1, file);
+        fclose(file);
+    }
+    BOOST_CHECK(!flush_view.ReplayJournal());
+    BOOST_CHECK(db.GetBestBlock() == best_block);
+    flush_view.DiscardJournal();
+    BOOST_CHECK(!fs::exists(journal));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_get_coins)
+{
+    CCoinsViewDB db(GetDataDir() / "get_coins", 1 << 20, /* fMemory */ true, /* fWipe */ false);
+    CCoinsViewCache flushed(&db);
+
+    // Coins in the database, some of them spent again in a cache on top.
+    std::vector<COutPoint> outpoints;
+    for (uint32_t i = 0; i < 200; ++i) {
+        Coin coin;
+        coin.out.nValue = 1000 + i;
+        coin.nHeight = 1;
+        outpoints.emplace_back(InsecureRand256(), i % 3);
+        flushed.AddCoin(outpoints.back(), std::move(coin), false);
+    }
+    flushed.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(flushed.Flush());
+
+    CCoinsViewCache cache(&db);
+    for (uint32_t i = 0; i < outpoints.size(); i += 5) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+    }
+    Coin added;
+    added.out.nValue = 7;
+    added.nHeight = 2;
+    outpoints.emplace_back(InsecureRand256(), 0);
+    cache.AddCoin(outpoints.back(), std::move(added), false);
+
+    // Outpoints that were never created, duplicates, and a neighbour of an existing coin.
+    for (int i = 0; i < 20; ++i) {
+        outpoints.emplace_back(InsecureRand256(), 0);
+        outpoints.push_back(outpoints[InsecureRandRange(outpoints.size())]);
+    }
+    outpoints.emplace_back(outpoints[1].hash, outpoints[1].n + 100);
+    Shuffle(outpoints.begin(), outpoints.end(), g_insecure_rand_ctx);
+
+    for (const CCoinsView* view : {static_cast<const CCoinsView*>(&db), static_cast<const CCoinsView*>(&cache)}) {
+        const size_t cached = cache.GetCacheSize();
+        std::vector<Coin> coins;
+        view->GetCoins(outpoints, coins);
+        // The bulk lookup doesn't fill the cache.
+        BOOST_CHECK_EQUAL(cache.GetCacheSize(), cached);
+        BOOST_CHECK_EQUAL(coins.size(), outpoints.size());
+        for (size_t i = 0; i < outpoints.size(); ++i) {
+            Coin coin;
+            const bool found = view->GetCoin(outpoints[i], coin);
+            BOOST_CHECK_EQUAL(!coins[i].IsSpent(), found);
+            if (found) {
+                BOOST_CHECK(coins[i].out == coin.out);
+                BOOST_CHECK_EQUAL(coins[i].nHeight, coin.nHeight);
+            }
+        }
+    }
+
+    std::vector<Coin> coins(3);
+    db.GetCoins({}, coins);
+    BOOST_CHECK(coins.empty());
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sharded_db)
+{
+    const fs::path path = GetDataDir() / "sharded";
+    std::map<COutPoint, Coin> expected;
+    {
+        CCoinsViewDB db(path, 1 << 20, /* fMemory */ false, /* fWipe */ true, /* shards */ 4);
+        BOOST_CHECK_EQUAL(db.ShardCount(), 4U);
+        CCoinsViewCache cache(&db);
+        for (uint32_t i = 0; i < 300; ++i) {
+            Coin coin;
+            coin.out.nValue = 1000 + i;
+            coin.nHeight = 1;
+            const COutPoint outpoint(InsecureRand256(), i % 3);
+            expected[outpoint] = coin;
+            cache.AddCoin(outpoint, std::move(coin), false);
+        }
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+
+        // Spend some of them again in a second flush.
+        for (auto it = expected.begin(); it != expected.end();) {
+            if (InsecureRandBool()) {
+                BOOST_CHECK(cache.SpendCoin(it->first));
+                it = expected.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        const uint256 best_block = InsecureRand256();
+        cache.SetBestBlock(best_block);
+        BOOST_CHECK(cache.Flush());
+        BOOST_CHECK(db.GetBestBlock() == best_block);
+        BOOST_CHECK(db.GetHeadBlocks().empty());
+    }
+
+    // The database keeps its shards when reopened with another setting.
+    CCoinsViewDB db(path, 1 << 20, /* fMemory */ false, /* fWipe */ false, /* shards */ 1);
+    BOOST_CHECK_EQUAL(db.ShardCount(), 4U);
+    for (const auto& entry : expected) {
+        Coin coin;
+        BOOST_CHECK(db.GetCoin(entry.first, coin));
+        BOOST_CHECK(coin.out == entry.second.out);
+    }
+
+    // Cursors walk the shards in key order, from any starting point.
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    auto it = expected.begin();
+    for (; cursor->Valid(); cursor->Next(), ++it) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(it != expected.end());
+        BOOST_CHECK(cursor->GetKey(key) && key == it->first);
+        BOOST_CHECK(cursor->GetValue(coin) && coin.out == it->second.out);
+    }
+    BOOST_CHECK(it == expected.end());
+
+    uint256 middle;
+    *middle.begin() = 0x80;
+    const COutPoint start(middle, 0);
+    cursor.reset(db.Cursor(start));
+    it = expected.lower_bound(start);
+    for (; cursor->Valid(); cursor->Next(), ++it) {
+        COutPoint key;
+        BOOST_REQUIRE(it != expected.end());
+        BOOST_CHECK(cursor->GetKey(key) && key == it->first);
+    }
+    BOOST_CHECK(it == expected.end());
+
+    // A wiped database uses the new setting.
+    CCoinsViewDB wiped(GetDataDir() / "sharded_wiped", 1 << 20, /* fMemory */ false, /* fWipe */ true, /* shards */ 2);
+    BOOST_CHECK_EQUAL(wiped.ShardCount(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_cache_counters)
+{
+    CCoinsViewTest base;
+    CCoinsViewCache cache(&base);
+    const COutPoint present(InsecureRand256(), 0);
+    const COutPoint absent(InsecureRand256(), 0);
+    Coin coin;
+    coin.out.nValue = 1;
+    cache.AddCoin(present, std::move(coin), false);
+    BOOST_CHECK_EQUAL(cache.GetCounters().hits, 0U);
+    BOOST_CHECK_EQUAL(cache.GetCounters().misses, 0U);
+    BOOST_CHECK_EQUAL(cache.GetCounters().insertions, 1U);
+
+    BOOST_CHECK(cache.HaveCoin(present));
+    BOOST_CHECK_EQUAL(cache.GetCounters().hits, 1U);
+    // Lookups of missing coins go to the base view every time.
+    BOOST_CHECK(!cache.HaveCoin(absent));
+    BOOST_CHECK(!cache.HaveCoin(absent));
+    BOOST_CHECK_EQUAL(cache.GetCounters().misses, 2U);
+
+    std::vector<Coin> coins;
+    cache.GetCoins({present, absent}, coins);
+    BOOST_CHECK_EQUAL(cache.GetCounters().hits, 2U);
+    BOOST_CHECK_EQUAL(cache.GetCounters().misses, 3U);
+
+    // Flushed coins are evicted, and reloaded on the next lookup.
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCounters().evictions, 1U);
+    BOOST_CHECK(cache.HaveCoin(present));
+    BOOST_CHECK_EQUAL(cache.GetCounters().misses, 4U);
+    BOOST_CHECK_EQUAL(cache.GetCounters().insertions, 2U);
+    cache.Uncache(present);
+    BOOST_CHECK_EQUAL(cache.GetCounters().evictions, 2U);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_reuse_sampler)
+{
+    const COutPoint a(InsecureRand256(), 0), b(InsecureRand256(), 0), c(InsecureRand256(), 0);
+    {
+        CoinsReuseSampler sampler(1, 100);
+        sampler.Access(a, true);
+        sampler.Access(b, true);
+        sampler.Access(c, false);
+        BOOST_CHECK_EQUAL(sampler.GetStats().cold, 2U);
+        // Two distinct coins since the last access to a, none since the last to a, one since c.
+        sampler.Access(a, true);
+        sampler.Access(a, true);
+        sampler.Access(c, true);
+        const CoinsReuseSampler::Stats& stats = sampler.GetStats();
+        BOOST_CHECK_EQUAL(stats.reuses[0], 1U);
+        BOOST_CHECK_EQUAL(stats.reuses[1], 1U);
+        BOOST_CHECK_EQUAL(stats.reuses[2], 1U);
+        BOOST_CHECK_EQUAL(stats.cold, 2U);
+        BOOST_CHECK_EQUAL(stats.horizon, 100U);
+    }
+    {
+        // When access times are renumbered, all but the 2 most recently
+        // accessed coins are forgotten, and their next access counts as cold.
+        CoinsReuseSampler sampler(1, 2);
+        for (const COutPoint& outpoint : {a, b, c, a, b, c}) sampler.Access(outpoint, true);
+        BOOST_CHECK_EQUAL(sampler.GetStats().cold, 4U);
+        BOOST_CHECK_EQUAL(sampler.GetStats().reuses[2], 2U);
+        sampler.Access(c, true);
+        BOOST_CHECK_EQUAL(sampler.GetStats().reuses[0], 1U);
+        sampler.Access(b, true);
+        BOOST_CHECK_EQUAL(sampler.GetStats().reuses[1], 1U);
+    }
+    {
+        // Only a slice of the outpoints is followed, and its distances are scaled up.
+        CoinsReuseSampler sampler(8, 1 << 14);
+        std::vector<COutPoint> outpoints;
+        for (int i = 0; i < 4000; ++i) outpoints.emplace_back(InsecureRand256(), 0);
+        for (int pass = 0; pass < 2; ++pass) {
+            for (const COutPoint& outpoint : outpoints) sampler.Access(outpoint, true);
+        }
+        const CoinsReuseSampler::Stats& stats = sampler.GetStats();
+        BOOST_CHECK(stats.cold > 300 && stats.cold < 700);
+        // Every followed coin comes back after about 4000 others.
+        uint64_t reuses = 0;
+        for (size_t bucket = 0; bucket < CoinsReuseSampler::BUCKETS; ++bucket) {
+            if (bucket < 11 || bucket > 13) BOOST_CHECK_EQUAL(stats.reuses[bucket], 0U);
+            reuses += stats.reuses[bucket];
+        }
+        BOOST_CHECK_EQUAL(reuses, stats.cold);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,114 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/coinstatsindex.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+static CCoinsStats ChainstateStats()
+{
+    ::ChainstateActive().ForceFlushStateToDisk();
+    CCoinsStats stats;
+    BOOST_REQUIRE(GetUTXOStats(&::ChainstateActive().CoinsDB(), stats, CoinStatsHashType::MUHASH));
+    return stats;
+}
+
+static void CheckStats(const CCoinsStats& index_stats, const CCoinsStats& chainstate_stats)
+{
+    BOOST_CHECK_EQUAL(index_stats.nHeight, chainstate_stats.nHeight);
+    BOOST_CHECK(index_stats.hashBlock == chainstate_stats.hashBlock);
+    BOOST_CHECK(index_stats.hashSerialized == chainstate_stats.hashSerialized);
+    BOOST_CHECK_EQUAL(index_stats.nTransactionOutputs, chainstate_stats.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(index_stats.nBogoSize, chainstate_stats.nBogoSize);
+    BOOST_CHECK_EQUAL(index_stats.nTotalAmount, chainstate_stats.nTotalAmount);
+}
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup)
+{
+    CoinStatsIndex coin_stats_index(1 << 20, true);
+
+    const CBlockIndex* block_index = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    CCoinsStats index_stats;
+
+    // Stats should not be found in the index before it is started.
+    BOOST_CHECK(!coin_stats_index.LookUpStats(block_index, index_stats));
+
+    // BlockUntilSyncedToCurrentChain should return false before the index is started.
+    BOOST_CHECK(!coin_stats_index.BlockUntilSyncedToCurrentChain());
+
+    coin_stats_index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!coin_stats_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    // The statistics of the tip match those computed from the chainstate.
+    const CCoinsStats tip_stats = ChainstateStats();
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(block_index, index_stats));
+    CheckStats(index_stats, tip_stats);
+    BOOST_CHECK_EQUAL(index_stats.nTransactionOutputs, m_coinbase_txns.size());
+
+    // The genesis block leaves the UTXO set empty.
+    CCoinsStats genesis_stats;
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(block_index->GetAncestor(0), genesis_stats));
+    BOOST_CHECK_EQUAL(genesis_stats.nTransactionOutputs, 0U);
+    BOOST_CHECK_EQUAL(genesis_stats.nTotalAmount, 0);
+    uint256 empty_hash;
+    MuHash3072().Finalize(empty_hash);
+    BOOST_CHECK(genesis_stats.hashSerialized == empty_hash);
+
+    // Spend the first coinbase in a new block, which the index picks up incrementally.
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    spend.vout[1].nValue = 0;
+    spend.vout[1].scriptPubKey = CScript() << OP_RETURN;
+    std::vector<unsigned char> sig;
+    uint256 sighash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(sighash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << sig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, GetScriptForDestination(PKHash(coinbaseKey.GetPubKey())));
+    BOOST_REQUIRE_EQUAL(block.vtx.size(), 2U);
+    BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+
+    const CBlockIndex* new_block_index = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    BOOST_REQUIRE(new_block_index->GetBlockHash() == block.GetHash());
+    CCoinsStats new_index_stats;
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(new_block_index, new_index_stats));
+    CheckStats(new_index_stats, ChainstateStats());
+    // One output spent, and one spendable output created besides the coinbase.
+    BOOST_CHECK_EQUAL(new_index_stats.nTransactionOutputs, index_stats.nTransactionOutputs + 1);
+
+    // The statistics of earlier blocks are unchanged.
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(block_index, index_stats));
+    CheckStats(index_stats, tip_stats);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    coin_stats_index.Stop();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -9,11 +9,15 @@
 #include <crypto/hkdf_sha256_32.h>
 #include <crypto/hmac_sha256.h>
 #include <crypto/hmac_sha512.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
 #include <crypto/sha512.h>
+#include <hash.h>
+#include <primitives/block.h>
 #include <random.h>
+#include <streams.h>
 #include <util/strencodings.h>
 #include <test/util/setup_common.h>
 
@@ -497,6 +501,36 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+BOOST_AUTO_TEST_CASE(chacha20_multiblock)
+{
+    // Long calls go through the multi-block versions where the CPU has them;
+    // block-sized calls always use the scalar code. Both must give the same
+    // output, for any length and also when the low counter word wraps around.
+    std::vector<unsigned char> key = ParseHex("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f");
+    std::vector<unsigned char> msg(64 * 21 + 37);
+    for (size_t i = 0; i < msg.size(); ++i) msg[i] = InsecureRandBits(8);
+    for (uint64_t seek : {uint64_t{0}, uint64_t{0xfffffffb}, uint64_t{0xfffffffffffffffe}}) {
+        for (size_t len : {0, 1, 64, 255, 256, 257, 511, 512, 513, 767, 768, 1024, 1280, 64 * 21 + 37}) {
+            ChaCha20 rng(key.data(), key.size());
+            rng.SetIV(0x0706050403020100ULL);
+            rng.Seek(seek);
+            ChaCha20 ref = rng;
+            std::vector<unsigned char> out(len), expected(len), stream(len + 64), expected_stream(len + 64);
+            rng.Crypt(msg.data(), out.data(), len);
+            for (size_t pos = 0; pos < len; pos += 64) {
+                ref.Crypt(msg.data() + pos, expected.data() + pos, std::min<size_t>(64, len - pos));
+            }
+            BOOST_CHECK(out == expected);
+            // Both continue from the same counter.
+            rng.Keystream(stream.data(), stream.size());
+            for (size_t pos = 0; pos < stream.size(); pos += 64) {
+                ref.Keystream(expected_stream.data() + pos, std::min<size_t>(64, stream.size() - pos));
+            }
+            BOOST_CHECK(stream == expected_stream);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(poly1305_testvector)
 {
     // RFC 7539, section 2.5.2.
@@ -750,4 +784,233 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(sha256d80)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[80 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 80 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 80 * j, 80).Finalize(out1 + 32 * j);
+        }
+        SHA256D80(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(hash160many)
+{
+    for (int i = 0; i <= 80; ++i) {
+        unsigned char in[33 * 80];
+        unsigned char sha1[32 * 80], sha2[32 * 80];
+        unsigned char out1[20 * 80], out2[20 * 80], out3[20 * 80];
+        for (int j = 0; j < 33 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CSHA256().Write(in + 33 * j, 33).Finalize(sha1 + 32 * j);
+            CRIPEMD160().Write(sha1 + 32 * j, 32).Finalize(out1 + 20 * j);
+        }
+        SHA256_33(sha2, in, i);
+        BOOST_CHECK(memcmp(sha1, sha2, 32 * i) == 0);
+        RIPEMD160_32(out2, sha1, i);
+        BOOST_CHECK(memcmp(out1, out2, 20 * i) == 0);
+        Hash160Many(out3, in, i);
+        BOOST_CHECK(memcmp(out1, out3, 20 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha512_finalize_many)
+{
+    for (size_t len : {0, 37, 64, 111}) {
+        for (int prefix_blocks : {0, 1, 2}) {
+            std::vector<unsigned char> prefix = g_insecure_rand_ctx.randbytes(128 * prefix_blocks);
+            std::vector<unsigned char> key = g_insecure_rand_ctx.randbytes(32);
+            CSHA512 sha;
+            sha.Write(prefix.data(), prefix.size());
+            const CHMAC_SHA512 hmac(key.data(), key.size());
+            for (int count = 0; count <= 11; ++count) {
+                std::vector<unsigned char> tails = g_insecure_rand_ctx.randbytes(len * count);
+                std::vector<unsigned char> out1(64 * count), out2(64 * count), out3(64 * count), out4(64 * count);
+                for (int i = 0; i < count; ++i) {
+                    CSHA512(sha).Write(tails.data() + len * i, len).Finalize(out1.data() + 64 * i);
+                    CHMAC_SHA512(key.data(), key.size()).Write(tails.data() + len * i, len).Finalize(out3.data() + 64 * i);
+                }
+                sha.FinalizeMany(tails.data(), len, count, out2.data());
+                BOOST_CHECK(out1 == out2);
+                hmac.FinalizeMany(tails.data(), len, count, out4.data());
+                BOOST_CHECK(out3 == out4);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(hash_headers)
+{
+    std::vector<CBlockHeader> headers(150);
+    for (CBlockHeader& header : headers) {
+        header.nVersion = InsecureRand32();
+        header.hashPrevBlock = InsecureRand256();
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = InsecureRand32();
+        header.nBits = InsecureRand32();
+        header.nNonce = InsecureRand32();
+    }
+    std::vector<uint256> hashes(headers.size());
+    HashHeaders(Span<const CBlockHeader>(headers.data(), headers.size()), hashes.data());
+    for (size_t i = 0; i < headers.size(); ++i) {
+        BOOST_CHECK(hashes[i] == headers[i].GetHash());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256d_many)
+{
+    // Message sizes around the chunk and padding boundaries, and larger ones.
+    std::vector<std::vector<unsigned char>> msgs;
+    for (size_t len : {0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 250, 1000, 5000}) {
+        msgs.push_back(g_insecure_rand_ctx.randbytes(len));
+    }
+    for (int i = 0; i < 40; ++i) {
+        msgs.push_back(g_insecure_rand_ctx.randbytes(InsecureRandRange(600)));
+    }
+    for (size_t count = 0; count <= msgs.size(); count += 1 + count / 4) {
+        std::vector<const unsigned char*> inputs;
+        std::vector<size_t> sizes;
+        std::vector<unsigned char> expected(32 * count), out(32 * count);
+        for (size_t i = 0; i < count; ++i) {
+            inputs.push_back(msgs[i].data());
+            sizes.push_back(msgs[i].size());
+            CHash256().Write(msgs[i].data(), msgs[i].size()).Finalize(expected.data() + 32 * i);
+        }
+        SHA256DMany(out.data(), inputs.data(), sizes.data(), count);
+        BOOST_CHECK(out == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(unserialize_block_hashed)
+{
+    CBlock block;
+    block.nVersion = InsecureRand32();
+    block.hashPrevBlock = InsecureRand256();
+    for (int i = 0; i < 30; ++i) {
+        CMutableTransaction tx;
+        tx.nLockTime = InsecureRand32();
+        for (int j = InsecureRandRange(3); j >= 0; --j) {
+            tx.vin.emplace_back(COutPoint(InsecureRand256(), InsecureRand32()));
+            tx.vin.back().scriptSig = CScript() << g_insecure_rand_ctx.randbytes(InsecureRandRange(100));
+            // Some transactions have witness data, some don't.
+            if (i % 3 == 0) tx.vin.back().scriptWitness.stack.push_back(g_insecure_rand_ctx.randbytes(InsecureRandRange(300)));
+        }
+        tx.vout.emplace_back(InsecureRand32(), CScript() << g_insecure_rand_ctx.randbytes(InsecureRandRange(50)));
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+
+    for (int version : {PROTOCOL_VERSION, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS}) {
+        CDataStream ss(SER_NETWORK, version);
+        ss << block;
+        const size_t size = ss.size();
+        ss << uint8_t{0};
+        CBlock read;
+        const Span<const uint8_t> data((const uint8_t*)ss.data(), ss.size());
+        BOOST_CHECK_EQUAL(UnserializeBlockHashed(SER_NETWORK, version, data, read), size);
+        BOOST_CHECK(read.GetHash() == block.GetHash());
+        BOOST_REQUIRE_EQUAL(read.vtx.size(), block.vtx.size());
+        for (size_t i = 0; i < block.vtx.size(); ++i) {
+            CMutableTransaction tx(*block.vtx[i]);
+            if (version & SERIALIZE_TRANSACTION_NO_WITNESS) {
+                for (CTxIn& in : tx.vin) in.scriptWitness.SetNull();
+            }
+            const CTransaction expected(tx);
+            BOOST_CHECK(*read.vtx[i] == expected);
+            BOOST_CHECK(read.vtx[i]->GetHash() == expected.GetHash());
+            BOOST_CHECK(read.vtx[i]->GetWitnessHash() == expected.GetWitnessHash());
+            BOOST_CHECK_EQUAL(read.vtx[i]->GetTotalSize(), expected.GetTotalSize());
+        }
+
+        // Truncated data fails like deserialization does.
+        BOOST_CHECK_THROW(UnserializeBlockHashed(SER_NETWORK, version, data.first(size - 5), read), std::ios_base::failure);
+    }
+}
+
+static MuHash3072 FromInt(unsigned char i) {
+    unsigned char tmp[32] = {i, 0};
+    return MuHash3072(tmp, sizeof(tmp));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    uint256 out;
+
+    // The result doesn't depend on the order of the operations.
+    for (int iter = 0; iter < 10; ++iter) {
+        uint256 res;
+        int table[4];
+        for (int i = 0; i < 4; ++i) {
+            table[i] = g_insecure_rand_ctx.randbits(3);
+        }
+        for (int order = 0; order < 4; ++order) {
+            MuHash3072 acc;
+            for (int i = 0; i < 4; ++i) {
+                int t = table[i ^ order];
+                if (t & 4) {
+                    acc /= FromInt(t & 3);
+                } else {
+                    acc *= FromInt(t & 3);
+                }
+            }
+            acc.Finalize(out);
+            if (order == 0) {
+                res = out;
+            } else {
+                BOOST_CHECK(res == out);
+            }
+        }
+
+        MuHash3072 x = FromInt(g_insecure_rand_ctx.randbits(4)); // x=X
+        MuHash3072 y = FromInt(g_insecure_rand_ctx.randbits(4)); // x=X, y=Y
+        MuHash3072 z; // x=X, y=Y, z=1
+        z *= x; // x=X, y=Y, z=X
+        z *= y; // x=X, y=Y, z=X*Y
+        y *= x; // x=X, y=Y*X, z=X*Y
+        z /= y; // x=X, y=Y*X, z=1
+        z.Finalize(out);
+
+        uint256 out2;
+        MuHash3072 a;
+        a.Finalize(out2);
+
+        BOOST_CHECK_EQUAL(out, out2);
+    }
+
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc /= FromInt(2);
+    acc.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+
+    // Inserting and removing raw data gives the same hash as multiplying and dividing by singletons.
+    MuHash3072 acc2 = FromInt(0);
+    unsigned char tmp[32] = {1, 0};
+    acc2.Insert(tmp, sizeof(tmp));
+    unsigned char tmp2[32] = {2, 0};
+    acc2.Remove(tmp2, sizeof(tmp2));
+    acc2.Finalize(out);
+    BOOST_CHECK_EQUAL(out, uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+
+    // The state survives serialization, including a pending denominator.
+    MuHash3072 acc3 = FromInt(0);
+    acc3 /= FromInt(2);
+    CDataStream ss(SER_DISK, 0);
+    ss << acc3;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 acc4;
+    ss >> acc4;
+    acc4 *= FromInt(1);
+    uint256 out2;
+    acc4.Finalize(out2);
+    BOOST_CHECK_EQUAL(out, out2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -363,4 +363,37 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that for_each_kept visits what is needed to refill a new cache: every
+ * element still in the table exactly once, except those marked for erasure.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each_kept)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    CuckooCache::cache<uint256, SignatureCacheHasher> set{};
+    set.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(1000);
+    for (uint256& hash : hashes) {
+        hash = InsecureRand256();
+        set.insert(hash);
+    }
+    for (size_t i = 0; i < hashes.size(); i += 2)
+        BOOST_CHECK(set.contains(hashes[i], true));
+
+    std::vector<uint256> kept;
+    set.for_each_kept([&](const uint256& e) { kept.push_back(e); });
+    std::sort(kept.begin(), kept.end());
+    std::vector<uint256> expected;
+    for (size_t i = 1; i < hashes.size(); i += 2)
+        expected.push_back(hashes[i]);
+    std::sort(expected.begin(), expected.end());
+    BOOST_CHECK(kept == expected);
+
+    CuckooCache::cache<uint256, SignatureCacheHasher> reloaded{};
+    reloaded.setup_bytes(1 << 20);
+    for (const uint256& e : kept)
+        reloaded.insert(e);
+    for (const uint256& e : expected)
+        BOOST_CHECK(reloaded.contains(e, false));
+}
+
 BOOST_AUTO_TEST_SUITE_END();
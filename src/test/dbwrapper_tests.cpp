@@ -199,6 +199,46 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_chunk_reader)
+{
+    for (const bool obfuscate : {false, true}) {
+        fs::path ph = GetDataDir() / (obfuscate ? "dbwrapper_chunks_obfuscate_true" : "dbwrapper_chunks_obfuscate_false");
+        CDBWrapper dbw(ph, (1 << 20), true, false, obfuscate);
+
+        std::map<std::pair<char, uint32_t>, uint256> in;
+        for (uint32_t i = 0; i < 1000; ++i) {
+            in[std::make_pair('c', i)] = InsecureRand256();
+            BOOST_CHECK(dbw.Write(std::make_pair('c', i), in[std::make_pair('c', i)]));
+        }
+        BOOST_CHECK(dbw.Write(std::make_pair('d', uint32_t{0}), InsecureRand256()));
+
+        // Small chunks, so that many are read ahead, and a prefix that stops before 'd'.
+        std::unique_ptr<CDBIterator> it(dbw.NewIterator());
+        it->Seek(std::make_pair('c', uint32_t{0}));
+        CDBChunkReader reader(std::move(it), 'c', 1000);
+        // Keys are little-endian, so the database order is not the map order;
+        // check that every entry is seen exactly once instead.
+        size_t chunks = 0;
+        for (const CDBChunk* chunk = &reader.Next(); !chunk->empty(); chunk = &reader.Next()) {
+            ++chunks;
+            for (size_t i = 0; i < chunk->size(); ++i) {
+                std::pair<char, uint32_t> key;
+                uint256 value;
+                BOOST_REQUIRE(chunk->GetKey(i, key));
+                BOOST_REQUIRE(chunk->GetValue(i, value));
+                auto expected = in.find(key);
+                BOOST_REQUIRE(expected != in.end());
+                BOOST_CHECK_EQUAL(value, expected->second);
+                in.erase(expected);
+            }
+        }
+        BOOST_CHECK(in.empty());
+        BOOST_CHECK(chunks > 1);
+        // Stays at the end.
+        BOOST_CHECK(reader.Next().empty());
+    }
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
@@ -410,5 +450,30 @@ BOOST_AUTO_TEST_CASE(unicodepath)
     BOOST_CHECK(fs::exists(lockPath));
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    DBProfile profile;
+    BOOST_CHECK(!ParseDBProfile("nvme", profile));
+    for (const std::string& name : {"default", "ssd", "hdd", "lowmem"}) {
+        BOOST_CHECK(ParseDBProfile(name, g_db_profile));
+        for (const bool compress : {false, true}) {
+            fs::path ph = GetDataDir() / ("dbwrapper_profile_" + name + (compress ? "_compressed" : ""));
+            {
+                CDBWrapper dbw(ph, (1 << 20), false, true, false, compress);
+                for (int i = 0; i < 1000; ++i) {
+                    BOOST_CHECK(dbw.Write(i, std::string(100, 'a' + i % 26)));
+                }
+            }
+            // Reopen under the default profile, without compression
+            g_db_profile = DBProfile::DEFAULT;
+            CDBWrapper dbw(ph, (1 << 20));
+            std::string res;
+            BOOST_CHECK(dbw.Read(999, res));
+            BOOST_CHECK_EQUAL(res, std::string(100, 'a' + 999 % 26));
+            BOOST_CHECK(ParseDBProfile(name, g_db_profile));
+        }
+    }
+    g_db_profile = DBProfile::DEFAULT;
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,12 +6,14 @@
 
 #include <banman.h>
 #include <chainparams.h>
+#include <consensus/validation.h>
 #include <net.h>
 #include <net_processing.h>
 #include <script/sign.h>
 #include <script/signingprovider.h>
 #include <script/standard.h>
 #include <serialize.h>
+#include <txorphanage.h>
 #include <util/memory.h>
 #include <util/string.h>
 #include <util/system.h>
@@ -42,17 +44,20 @@ struct CConnmanTest : public CConnman {
 };
 
 // Tests these internal-to-net_processing.cpp methods:
-extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
-extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
 extern void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="");
 
-struct COrphanTx {
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
+class TxOrphanageTest : public TxOrphanage
+{
+public:
+    CTransactionRef RandomOrphan() EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
+    {
+        std::map<uint256, OrphanTx>::iterator it;
+        it = m_orphans.lower_bound(InsecureRand256());
+        if (it == m_orphans.end())
+            it = m_orphans.begin();
+        return it->second.tx;
+    }
 };
-extern std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
 
 static CService ip(uint32_t i)
 {
@@ -103,8 +108,8 @@ BOOST_AUTO_TEST_CASE(outbound_slow_chain_eviction)
     }
     {
         LOCK2(cs_main, dummyNode1.cs_vSend);
-        BOOST_CHECK(dummyNode1.vSendMsg.size() > 0);
-        dummyNode1.vSendMsg.clear();
+        BOOST_CHECK(dummyNode1.HasQueuedSends());
+        for (CSendQueue& queue : dummyNode1.m_send_queues) queue.chunks.clear();
     }
 
     int64_t nStartTime = GetTime();
@@ -116,7 +121,7 @@ BOOST_AUTO_TEST_CASE(outbound_slow_chain_eviction)
     }
     {
         LOCK2(cs_main, dummyNode1.cs_vSend);
-        BOOST_CHECK(dummyNode1.vSendMsg.size() > 0);
+        BOOST_CHECK(dummyNode1.HasQueuedSends());
     }
     // Wait 3 more minutes
     SetMockTime(nStartTime+24*60);
@@ -350,18 +355,10 @@ BOOST_AUTO_TEST_CASE(DoS_bantime)
     peerLogic->FinalizeNode(dummyNode.GetId(), dummy);
 }
 
-static CTransactionRef RandomOrphan()
-{
-    std::map<uint256, COrphanTx>::iterator it;
-    LOCK2(cs_main, g_cs_orphans);
-    it = mapOrphanTransactions.lower_bound(InsecureRand256());
-    if (it == mapOrphanTransactions.end())
-        it = mapOrphanTransactions.begin();
-    return it->second.tx;
-}
-
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
 {
+    TxOrphanageTest orphanage;
+    LOCK(g_cs_orphans);
     CKey key;
     key.MakeNewKey(true);
     FillableSigningProvider keystore;
@@ -379,13 +376,13 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].scriptPubKey = GetScriptForDestination(PKHash(key.GetPubKey()));
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        orphanage.AddTx(MakeTransactionRef(tx), i);
     }
 
     // ... and 50 that depend on other orphans:
     for (int i = 0; i < 50; i++)
     {
-        CTransactionRef txPrev = RandomOrphan();
+        CTransactionRef txPrev = orphanage.RandomOrphan();
 
         CMutableTransaction tx;
         tx.vin.resize(1);
@@ -396,13 +393,13 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].scriptPubKey = GetScriptForDestination(PKHash(key.GetPubKey()));
         BOOST_CHECK(SignSignature(keystore, *txPrev, tx, 0, SIGHASH_ALL));
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        orphanage.AddTx(MakeTransactionRef(tx), i);
     }
 
     // This really-big orphan should be ignored:
     for (int i = 0; i < 10; i++)
     {
-        CTransactionRef txPrev = RandomOrphan();
+        CTransactionRef txPrev = orphanage.RandomOrphan();
 
         CMutableTransaction tx;
         tx.vout.resize(1);
@@ -420,25 +417,77 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         for (unsigned int j = 1; j < tx.vin.size(); j++)
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-        BOOST_CHECK(!AddOrphanTx(MakeTransactionRef(tx), i));
+        BOOST_CHECK(!orphanage.AddTx(MakeTransactionRef(tx), i));
     }
 
-    LOCK2(cs_main, g_cs_orphans);
-    // Test EraseOrphansFor:
+    // Test EraseForPeer:
     for (NodeId i = 0; i < 3; i++)
     {
-        size_t sizeBefore = mapOrphanTransactions.size();
-        EraseOrphansFor(i);
-        BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
-    }
-
-    // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
-    BOOST_CHECK(mapOrphanTransactions.empty());
+        size_t sizeBefore = orphanage.Size();
+        orphanage.EraseForPeer(i);
+        BOOST_CHECK(orphanage.Size() < sizeBefore);
+        BOOST_CHECK_EQUAL(orphanage.PeerWeight(i), 0U);
+    }
+
+    // Test LimitOrphans() function:
+    orphanage.LimitOrphans(40, std::numeric_limits<size_t>::max());
+    BOOST_CHECK(orphanage.Size() <= 40);
+    orphanage.LimitOrphans(10, std::numeric_limits<size_t>::max());
+    BOOST_CHECK(orphanage.Size() <= 10);
+    orphanage.LimitOrphans(0, std::numeric_limits<size_t>::max());
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+    BOOST_CHECK_EQUAL(orphanage.TotalWeight(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(orphanage_weight_limit)
+{
+    TxOrphanage orphanage;
+    LOCK(g_cs_orphans);
+    int64_t now = GetTime();
+    SetMockTime(now);
+
+    // Peer 0 sends ten orphans, peer 1 just two.
+    std::vector<CTransactionRef> orphans;
+    for (int i = 0; i < 12; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.hash = InsecureRand256();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        orphans.push_back(MakeTransactionRef(tx));
+        BOOST_CHECK(orphanage.AddTx(orphans.back(), i < 10 ? 0 : 1));
+        BOOST_CHECK(!orphanage.AddTx(orphans.back(), 1));
+        SetMockTime(++now);
+    }
+    const size_t weight = GetTransactionWeight(*orphans[0]);
+    BOOST_CHECK_EQUAL(orphanage.TotalWeight(), 12 * weight);
+    BOOST_CHECK_EQUAL(orphanage.PeerWeight(0), 10 * weight);
+    BOOST_CHECK_EQUAL(orphanage.PeerWeight(1), 2 * weight);
+    BOOST_CHECK(orphanage.GetTx(orphans[11]->GetHash()).second == 1);
+    BOOST_CHECK(!orphanage.GetTx(InsecureRand256()).first);
+
+    // Going over the weight limit evicts the oldest orphans of the peer that sent the most.
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(100, 8 * weight), 4U);
+    BOOST_CHECK_EQUAL(orphanage.PeerWeight(0), 6 * weight);
+    BOOST_CHECK_EQUAL(orphanage.PeerWeight(1), 2 * weight);
+    for (int i = 0; i < 12; i++) {
+        BOOST_CHECK_EQUAL(orphanage.HaveTx(orphans[i]->GetHash()), i >= 4);
+    }
+    // Once both weigh the same, either may lose one.
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(100, 3 * weight), 5U);
+    BOOST_CHECK_EQUAL(orphanage.PeerWeight(0) + orphanage.PeerWeight(1), 3 * weight);
+    BOOST_CHECK(orphanage.PeerWeight(0) <= 2 * weight);
+
+    // Orphans expire in the order they arrived.
+    SetMockTime(now + ORPHAN_TX_EXPIRE_TIME - 2);
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(100, 100 * weight), 0U);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 1U);
+    BOOST_CHECK(orphanage.HaveTx(orphans[11]->GetHash()));
+    SetMockTime(now + ORPHAN_TX_EXPIRE_TIME);
+    orphanage.LimitOrphans(100, 100 * weight);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+    BOOST_CHECK_EQUAL(orphanage.TotalWeight(), 0U);
+    SetMockTime(0);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -363,4 +363,33 @@ BOOST_AUTO_TEST_CASE(descriptor_test)
     CheckUnparsable("", "raw(Ü)#00000000", "Invalid characters in payload"); // Invalid chars
 }
 
+BOOST_AUTO_TEST_CASE(descriptor_expand_range)
+{
+    const std::vector<std::string> descs{
+        "wpkh(xpub661MyMwAqRbcFW31YEwpkMuc5THy2PSt5bDMsktWQcFF8syAmRUapSCGu8ED9W6oDMSgv6Zz8idoc4a6mr8BDzTJY47LJhkJ8UB7WEGuduB/1/*)",
+        "pkh(xprv9s21ZrQH143K31xYSDQpPDxsXRTUcvj2iNHm5NUtrGiGG5e2DtALGdso3pGz6ssrdK4PFmM8NSpSBHNqPqm55Qn3LqFtT2emdEXVYsCzC2U/2/*')",
+    };
+    for (const std::string& str : descs) {
+        FlatSigningProvider keys;
+        std::string error;
+        auto desc = Parse(str, keys, error);
+        BOOST_REQUIRE_MESSAGE(desc, error);
+
+        // Expanding in parallel gives the same scripts and keys as one position at a time.
+        std::vector<std::vector<CScript>> range_scripts;
+        std::vector<FlatSigningProvider> range_out;
+        BOOST_CHECK(ExpandRange(*desc, 10, 299, keys, range_scripts, range_out, 4));
+        BOOST_CHECK_EQUAL(range_scripts.size(), 290U);
+        BOOST_CHECK_EQUAL(range_out.size(), 290U);
+        for (int i = 10; i < 300; ++i) {
+            std::vector<CScript> scripts;
+            FlatSigningProvider out;
+            BOOST_CHECK(desc->Expand(i, keys, scripts, out));
+            BOOST_CHECK(scripts == range_scripts[i - 10]);
+            BOOST_CHECK(out.pubkeys == range_out[i - 10].pubkeys);
+            BOOST_CHECK(out.origins == range_out[i - 10].origins);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
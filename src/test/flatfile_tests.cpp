@@ -123,4 +123,70 @@ BOOST_AUTO_TEST_CASE(flatfile_flush)
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1);
 }
 
+BOOST_AUTO_TEST_CASE(flatfile_worker)
+{
+    const auto data_dir = GetDataDir();
+    FlatFileSeq seq(data_dir, "a", 100);
+    FlatFileWorker worker;
+    worker.Start("flatfile");
+
+    // The chunk being written is allocated right away, the next one in the background.
+    bool out_of_space;
+    BOOST_CHECK_EQUAL(worker.Allocate(seq, FlatFilePos(0, 0), 1, out_of_space), 200);
+    BOOST_CHECK(!out_of_space);
+    BOOST_CHECK(worker.Sync());
+    BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 0))), 200);
+
+    // Crossing into the pre-allocated chunk does not allocate in the calling thread.
+    BOOST_CHECK_EQUAL(worker.Allocate(seq, FlatFilePos(0, 99), 2, out_of_space), 100);
+    BOOST_CHECK(!out_of_space);
+    BOOST_CHECK(worker.Sync());
+    BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 0))), 300);
+
+    // Queued flushes run in order, after the pre-allocations before them.
+    BOOST_CHECK(worker.Flush(seq, FlatFilePos(0, 101)));
+    BOOST_CHECK(worker.Flush(seq, FlatFilePos(0, 101), true));
+    BOOST_CHECK(worker.Sync());
+    BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 0))), 101);
+
+    worker.Remove(seq, FlatFilePos(0, 0));
+    BOOST_CHECK(worker.Sync());
+    BOOST_CHECK(!fs::exists(seq.FileName(FlatFilePos(0, 0))));
+
+    // Once stopped, everything runs in the calling thread again.
+    BOOST_CHECK(worker.Stop());
+    BOOST_CHECK_EQUAL(worker.Allocate(seq, FlatFilePos(1, 0), 1, out_of_space), 100);
+    BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(1, 0))), 100);
+}
+
+BOOST_AUTO_TEST_CASE(flatfile_cold_tier)
+{
+    const auto data_dir = GetDataDir();
+    const auto cold_dir = data_dir / "cold";
+    fs::create_directories(cold_dir);
+    FlatFileSeq seq(data_dir, "a", 100, cold_dir);
+    const FlatFilePos pos(0, 0);
+
+    // New files are created in the hot directory.
+    BOOST_CHECK_EQUAL(seq.FileName(pos), data_dir / "a00000.dat");
+    bool out_of_space;
+    seq.Allocate(pos, 1, out_of_space);
+    BOOST_CHECK(seq.IsHot(pos));
+
+    // An aborted move leaves the file where it was.
+    BOOST_CHECK(seq.CopyToCold(pos));
+    seq.AbortMoveToCold(pos);
+    BOOST_CHECK(seq.IsHot(pos));
+    BOOST_CHECK(fs::is_empty(cold_dir));
+
+    // Once moved, the file is found in the cold directory.
+    BOOST_CHECK(seq.CopyToCold(pos));
+    BOOST_CHECK(seq.IsHot(pos));
+    BOOST_CHECK(seq.CompleteMoveToCold(pos));
+    BOOST_CHECK(!seq.IsHot(pos));
+    BOOST_CHECK_EQUAL(seq.FileName(pos), cold_dir / "a00000.dat");
+    BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(pos)), 100);
+    BOOST_CHECK(!fs::exists(data_dir / "a00000.dat"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 //
 #include <fs.h>
+#include <streams.h>
 #include <test/util/setup_common.h>
+#include <util/mappedfile.h>
 #include <util/system.h>
 
 #include <boost/test/unit_test.hpp>
@@ -54,4 +56,36 @@ BOOST_AUTO_TEST_CASE(fsbridge_fstream)
     }
 }
 
+BOOST_AUTO_TEST_CASE(mapped_file)
+{
+    fs::path tmpfile = GetDataDir() / "fs_tests_mapped";
+    {
+        fsbridge::ofstream file(tmpfile, std::ios_base::out | std::ios_base::binary);
+        file << "palladiumtests";
+    }
+
+    // Cannot map past the end of the file, or an empty range.
+    BOOST_CHECK(!MappedFile::Open(tmpfile, 15));
+    BOOST_CHECK(!MappedFile::Open(tmpfile, 0));
+    BOOST_CHECK(!MappedFile::Open(GetDataDir() / "fs_tests_missing", 1));
+
+    std::unique_ptr<MappedFile> mapped = MappedFile::Open(tmpfile, 9);
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(mapped->size(), 9U);
+    BOOST_CHECK_EQUAL(std::string((const char*)mapped->data(), mapped->size()), "palladium");
+
+    // The mapping survives removal of the file.
+    fs::remove(tmpfile);
+    SpanReader reader(SER_DISK, 0, mapped->GetSpan().subspan(6));
+    BOOST_CHECK_EQUAL(reader.size(), 3U);
+    uint8_t c;
+    reader >> c;
+    BOOST_CHECK_EQUAL(c, 'i');
+    uint16_t d;
+    reader >> d;
+    BOOST_CHECK_EQUAL(d, 'u' | ('m' << 8));
+    BOOST_CHECK(reader.empty());
+    BOOST_CHECK_THROW(reader >> c, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
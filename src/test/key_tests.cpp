@@ -220,4 +220,22 @@ BOOST_AUTO_TEST_CASE(key_key_negation)
     BOOST_CHECK(key.GetPubKey().data()[0] == 0x03);
 }
 
+BOOST_AUTO_TEST_CASE(key_ids)
+{
+    // A mix of compressed and uncompressed keys, so that the batch has gaps
+    std::vector<CPubKey> pubkeys;
+    for (int i = 0; i < 23; ++i) {
+        CKey key;
+        key.MakeNewKey(i % 5 != 3);
+        pubkeys.push_back(key.GetPubKey());
+    }
+    pubkeys.emplace_back();
+    std::vector<CKeyID> ids = GetKeyIDs(pubkeys);
+    BOOST_CHECK_EQUAL(ids.size(), pubkeys.size());
+    for (size_t i = 0; i < pubkeys.size(); ++i) {
+        BOOST_CHECK(ids[i] == pubkeys[i].GetID());
+    }
+    BOOST_CHECK(GetKeyIDs({}).empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
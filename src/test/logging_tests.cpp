@@ -5,8 +5,12 @@
 #include <logging.h>
 #include <logging/timer.h>
 #include <test/util/setup_common.h>
+#include <util/system.h>
 
 #include <chrono>
+#include <fstream>
+#include <thread>
+#include <vector>
 
 #include <boost/test/unit_test.hpp>
 
@@ -33,4 +37,57 @@ BOOST_AUTO_TEST_CASE(logging_timer)
     SetMockTime(0);
 }
 
+static std::vector<std::string> ReadLogLines(const fs::path& path)
+{
+    std::vector<std::string> lines;
+    std::ifstream file(path.string());
+    for (std::string line; std::getline(file, line);) {
+        if (!line.empty()) lines.push_back(line);
+    }
+    return lines;
+}
+
+BOOST_AUTO_TEST_CASE(logging_async)
+{
+    BCLog::Logger logger;
+    logger.m_print_to_file = true;
+    logger.m_log_timestamps = false;
+    logger.m_file_path = GetDataDir() / "async.log";
+    BOOST_CHECK(logger.StartLogging());
+    logger.LogPrintStr("before\n");
+    logger.StartAsync();
+
+    // Messages from each thread come out complete and in order.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&logger, t] {
+            for (int i = 0; i < 250; ++i) logger.LogPrintStr(strprintf("thread %d message %d\n", t, i));
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    logger.LogPrintStr("flushed\n");
+    logger.FlushAsync();
+    std::vector<std::string> lines = ReadLogLines(logger.m_file_path);
+    BOOST_CHECK_EQUAL(lines.size(), 1 + 1000 + 1U);
+    BOOST_CHECK_EQUAL(lines.front(), "before");
+    BOOST_CHECK_EQUAL(lines.back(), "flushed");
+    int next[4] = {0, 0, 0, 0};
+    for (size_t i = 1; i + 1 < lines.size(); ++i) {
+        int t, n;
+        BOOST_REQUIRE(sscanf(lines[i].c_str(), "thread %d message %d", &t, &n) == 2);
+        BOOST_REQUIRE(t >= 0 && t < 4);
+        BOOST_CHECK_EQUAL(n, next[t]++);
+    }
+
+    // Stopping writes what is left, later messages are written synchronously.
+    logger.LogPrintStr("last queued\n");
+    logger.StopAsync();
+    logger.LogPrintStr("synchronous\n");
+    lines = ReadLogLines(logger.m_file_path);
+    BOOST_REQUIRE_GE(lines.size(), 2U);
+    BOOST_CHECK_EQUAL(lines[lines.size() - 2], "last queued");
+    BOOST_CHECK_EQUAL(lines.back(), "synchronous");
+    logger.DisconnectTestLogger();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
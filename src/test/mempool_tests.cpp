@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <policy/policy.h>
+#include <policy/rbf.h>
 #include <txmempool.h>
 #include <util/system.h>
 #include <util/time.h>
@@ -537,7 +538,9 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
         pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
     pool.addUnchecked(entry.Fee(9000LL).FromTx(tx7));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // should maximize mempool size by only removing 5/7
+    // Halve the usage of the transactions, not of the hash index buckets, which stay allocated.
+    const size_t empty_usage = CTxMemPool().DynamicMemoryUsage();
+    pool.TrimToSize(empty_usage + (pool.DynamicMemoryUsage() - empty_usage) / 2); // should maximize mempool size by only removing 5/7
     BOOST_CHECK(pool.exists(tx4.GetHash()));
     BOOST_CHECK(!pool.exists(tx5.GetHash()));
     BOOST_CHECK(pool.exists(tx6.GetHash()));
@@ -788,4 +791,221 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolRemoveForBlockTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // [ta] <- [tb] <- [tc], and [ty] spending both tb and tx. The block
+    // confirms ta and tz, which spends the same output as tx.
+    CTransactionRef funding = make_tx(/* output_values */ {20 * COIN});
+    CTransactionRef ta = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef tb = make_tx(/* output_values */ {10 * COIN, 10 * COIN}, /* inputs */ {ta});
+    CTransactionRef tc = make_tx(/* output_values */ {10 * COIN}, /* inputs */ {tb}, /* input_indices */ {1});
+    CTransactionRef tx = make_tx(/* output_values */ {10 * COIN}, /* inputs */ {funding});
+    CTransactionRef ty = make_tx(/* output_values */ {10 * COIN}, /* inputs */ {tb, tx});
+    CMutableTransaction mtz(*tx);
+    mtz.vout[0].nValue = 9 * COIN;
+    CTransactionRef tz = MakeTransactionRef(mtz);
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(ta));
+    pool.addUnchecked(entry.Fee(2000LL).FromTx(tb));
+    pool.addUnchecked(entry.Fee(3000LL).FromTx(tc));
+    pool.addUnchecked(entry.Fee(4000LL).FromTx(tx));
+    pool.addUnchecked(entry.Fee(5000LL).FromTx(ty));
+    pool.PrioritiseTransaction(tx->GetHash(), 100);
+    BOOST_CHECK_EQUAL(pool.size(), 5U);
+
+    pool.removeForBlock({ta, tz}, 1);
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    BOOST_CHECK(pool.exists(tb->GetHash()));
+    BOOST_CHECK(pool.exists(tc->GetHash()));
+    CAmount delta = 0;
+    pool.ApplyDelta(tx->GetHash(), delta);
+    BOOST_CHECK_EQUAL(delta, 0);
+
+    const CTxMemPoolEntry& eb = *pool.mapTx.find(tb->GetHash());
+    const CTxMemPoolEntry& ec = *pool.mapTx.find(tc->GetHash());
+    BOOST_CHECK_EQUAL(eb.GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(eb.GetSizeWithAncestors(), (uint64_t)eb.GetTxSize());
+    BOOST_CHECK_EQUAL(eb.GetModFeesWithAncestors(), 2000);
+    BOOST_CHECK_EQUAL(eb.GetCountWithDescendants(), 2U);
+    BOOST_CHECK_EQUAL(eb.GetModFeesWithDescendants(), 5000);
+    BOOST_CHECK_EQUAL(ec.GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(ec.GetModFeesWithAncestors(), 5000);
+    BOOST_CHECK_EQUAL(ec.GetSizeWithAncestors(), (uint64_t)(eb.GetTxSize() + ec.GetTxSize()));
+    BOOST_CHECK(pool.mapTx.find(tb->GetHash())->GetMemPoolParentsConst().empty());
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tb->GetHash())->GetMemPoolChildrenConst().size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolClusterTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    pool.SetTrackClusters(true);
+    TestMemPoolEntryHelper entry;
+
+    // [ta] <- [tb], [ta] <- [td] and [tc] on its own.
+    CTransactionRef ta = make_tx(/* output_values */ {10 * COIN, 10 * COIN});
+    CTransactionRef tb = make_tx(/* output_values */ {10 * COIN}, /* inputs */ {ta}, /* input_indices */ {0});
+    CTransactionRef tc = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef td = make_tx(/* output_values */ {10 * COIN}, /* inputs */ {ta}, /* input_indices */ {1});
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(ta));
+    pool.addUnchecked(entry.Fee(30000LL).FromTx(tb));
+    pool.addUnchecked(entry.Fee(5000LL).FromTx(tc));
+    pool.addUnchecked(entry.Fee(100LL).FromTx(td));
+
+    // tb pays for ta, td comes last in its cluster.
+    std::vector<std::vector<uint256>> expected{{td->GetHash()}, {tc->GetHash()}, {ta->GetHash(), tb->GetHash()}};
+    std::vector<std::vector<uint256>> chunks;
+    for (const CTxMemPool::Chunk* chunk : pool.GetChunksByFeerate()) {
+        chunks.emplace_back();
+        for (CTxMemPool::txiter it : chunk->txs) chunks.back().push_back(it->GetTx().GetHash());
+    }
+    BOOST_CHECK(chunks == expected);
+    const CTxMemPool::Chunk& top = **pool.GetChunksByFeerate().rbegin();
+    BOOST_CHECK_EQUAL(top.fee, 31000);
+    BOOST_CHECK_EQUAL(top.size, GetVirtualTransactionSize(*ta) + GetVirtualTransactionSize(*tb));
+    BOOST_CHECK_EQUAL(top.cluster, (*pool.GetChunksByFeerate().begin())->cluster);
+
+    // Removing tb leaves ta as a chunk of its own, td still depends on it.
+    pool.removeRecursive(*tb, REMOVAL_REASON_DUMMY);
+    expected = {{td->GetHash()}, {ta->GetHash()}, {tc->GetHash()}};
+    chunks.clear();
+    for (const CTxMemPool::Chunk* chunk : pool.GetChunksByFeerate()) {
+        chunks.emplace_back();
+        for (CTxMemPool::txiter it : chunk->txs) chunks.back().push_back(it->GetTx().GetHash());
+    }
+    BOOST_CHECK(chunks == expected);
+
+    // Evicting the worst chunk removes td only.
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(pool.exists(ta->GetHash()));
+    BOOST_CHECK(!pool.exists(td->GetHash()));
+    BOOST_CHECK(pool.exists(tc->GetHash()));
+    BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), CFeeRate(100, GetVirtualTransactionSize(*td)).GetFeePerK() + 1000);
+
+    // Once ta is mined, its children fall apart into separate clusters.
+    pool.addUnchecked(entry.Fee(30000LL).FromTx(tb));
+    pool.addUnchecked(entry.Fee(100LL).FromTx(td));
+    BOOST_CHECK_EQUAL(pool.CalculateClusterSize({*pool.GetIter(tb->GetHash())}, 10), 3U);
+    BOOST_CHECK_EQUAL(pool.CalculateClusterSize({*pool.GetIter(tb->GetHash())}, 2), 2U);
+    pool.removeForBlock({ta}, 1);
+    BOOST_CHECK_EQUAL(pool.CalculateClusterSize({*pool.GetIter(tb->GetHash())}, 10), 1U);
+    const CTxMemPool::setChunks& split = pool.GetChunksByFeerate();
+    BOOST_CHECK_EQUAL(split.size(), 3U);
+    std::set<const CTxMemPool::Cluster*> clusters;
+    for (const CTxMemPool::Chunk* chunk : split) clusters.insert(chunk->cluster);
+    BOOST_CHECK_EQUAL(clusters.size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolFeeHistogramTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    std::vector<FeeHistogramBucket> histogram = pool.GetFeeHistogram();
+    BOOST_REQUIRE_EQUAL(histogram.size(), 46U);
+    BOOST_CHECK_EQUAL(histogram[0].min_feerate.GetFeePerK(), 0);
+    BOOST_CHECK_EQUAL(histogram[3].min_feerate.GetFeePerK(), 3000);
+    BOOST_CHECK_EQUAL(histogram.back().min_feerate.GetFeePerK(), 10000000);
+    for (const FeeHistogramBucket& bucket : histogram) BOOST_CHECK_EQUAL(bucket.count, 0U);
+
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < 4; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = COIN;
+        txs.push_back(MakeTransactionRef(tx));
+    }
+    const int64_t vsize = GetVirtualTransactionSize(*txs[0]);
+    pool.addUnchecked(entry.Fee(0).FromTx(txs[0]));
+    pool.addUnchecked(entry.Fee(3 * vsize).FromTx(txs[1]));
+    pool.addUnchecked(entry.Fee(3 * vsize - 1).FromTx(txs[2]));
+    pool.addUnchecked(entry.Fee(20000 * vsize).FromTx(txs[3]));
+
+    histogram = pool.GetFeeHistogram();
+    BOOST_CHECK_EQUAL(histogram[0].count, 1U);
+    BOOST_CHECK_EQUAL(histogram[2].count, 1U);
+    BOOST_CHECK_EQUAL(histogram[2].fees, 3 * vsize - 1);
+    BOOST_CHECK_EQUAL(histogram[3].count, 1U);
+    BOOST_CHECK_EQUAL(histogram[3].vsize, (uint64_t)vsize);
+    BOOST_CHECK_EQUAL(histogram[3].fees, 3 * vsize);
+    BOOST_CHECK_EQUAL(histogram.back().count, 1U);
+
+    pool.removeRecursive(*txs[1], REMOVAL_REASON_DUMMY);
+    histogram = pool.GetFeeHistogram();
+    BOOST_CHECK_EQUAL(histogram[3].count, 0U);
+    BOOST_CHECK_EQUAL(histogram[3].vsize, 0U);
+    BOOST_CHECK_EQUAL(histogram[3].fees, 0);
+    BOOST_CHECK_EQUAL(histogram[2].count, 1U);
+
+    pool.clear();
+    for (const FeeHistogramBucket& bucket : pool.GetFeeHistogram()) BOOST_CHECK_EQUAL(bucket.count, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolReplacementConflictsTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+    RBFConflictCache cache(10);
+
+    // Two parents, and a child spending both
+    std::vector<CTransactionRef> parents;
+    CMutableTransaction child;
+    for (int i = 0; i < 2; i++) {
+        CMutableTransaction parent;
+        parent.vin.resize(1);
+        parent.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        parent.vout.resize(1);
+        parent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        parent.vout[0].nValue = COIN;
+        parents.push_back(MakeTransactionRef(parent));
+        child.vin.emplace_back(COutPoint(parents.back()->GetHash(), 0));
+    }
+    child.vout.resize(1);
+    child.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    child.vout[0].nValue = COIN;
+    const uint64_t empty_generation = pool.GetGeneration();
+    pool.addUnchecked(entry.Fee(1000).FromTx(parents[0]));
+    pool.addUnchecked(entry.Fee(2000).FromTx(parents[1]));
+    pool.addUnchecked(entry.Fee(3000).FromTx(child));
+    BOOST_CHECK(pool.GetGeneration() != empty_generation);
+    const CTxMemPool::setEntries conflicts = pool.GetIterSet({parents[0]->GetHash(), parents[1]->GetHash()});
+    const size_t size = pool.mapTx.find(parents[0]->GetHash())->GetTxSize() + pool.mapTx.find(parents[1]->GetHash())->GetTxSize() +
+                        pool.mapTx.find(child.GetHash())->GetTxSize();
+
+    // The shared child is counted twice in the bound, but evicted once
+    CTxMemPool::setEntries all_conflicting;
+    uint64_t count;
+    CAmount fees;
+    size_t conflicting_size;
+    BOOST_CHECK(!GetEntriesForConflicts(pool, conflicts, 3, cache, count, all_conflicting, fees, conflicting_size));
+    BOOST_CHECK_EQUAL(count, 4U);
+    BOOST_CHECK(all_conflicting.empty());
+    BOOST_CHECK(GetEntriesForConflicts(pool, conflicts, 4, cache, count, all_conflicting, fees, conflicting_size));
+    BOOST_CHECK_EQUAL(all_conflicting.size(), 3U);
+    BOOST_CHECK_EQUAL(fees, 6000);
+    BOOST_CHECK_EQUAL(conflicting_size, size);
+
+    // Prioritisation changes the generation, so fees are not served stale
+    const uint64_t generation = pool.GetGeneration();
+    pool.PrioritiseTransaction(child.GetHash(), 500);
+    BOOST_CHECK(pool.GetGeneration() != generation);
+    all_conflicting.clear();
+    BOOST_CHECK(GetEntriesForConflicts(pool, conflicts, 4, cache, count, all_conflicting, fees, conflicting_size));
+    BOOST_CHECK_EQUAL(fees, 6500);
+
+    // So does removing the child
+    pool.removeRecursive(CTransaction(child), REMOVAL_REASON_DUMMY);
+    const RBFConflictCache::Descendants& descendants = cache.Get(pool, *conflicts.begin());
+    BOOST_CHECK_EQUAL(descendants.entries.size(), 1U);
+    BOOST_CHECK_EQUAL(descendants.fees, (*conflicts.begin())->GetModifiedFee());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
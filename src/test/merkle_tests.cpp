@@ -3,25 +3,13 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <consensus/merkle.h>
+#include <node/merkle.h>
 #include <test/util/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(merkle_tests, TestingSetup)
 
-static uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& vMerkleBranch, uint32_t nIndex) {
-    uint256 hash = leaf;
-    for (std::vector<uint256>::const_iterator it = vMerkleBranch.begin(); it != vMerkleBranch.end(); ++it) {
-        if (nIndex & 1) {
-            hash = Hash(it->begin(), it->end(), hash.begin(), hash.end());
-        } else {
-            hash = Hash(hash.begin(), hash.end(), it->begin(), it->end());
-        }
-        nIndex >>= 1;
-    }
-    return hash;
-}
-
 /* This implements a constant-space merkle root/path calculator, limited to 2^32 leaves. */
 static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot, bool* pmutated, uint32_t branchpos, std::vector<uint256>* pbranch) {
     if (pbranch) pbranch->clear();
@@ -110,20 +98,16 @@ static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot
     if (proot) *proot = h;
 }
 
-static std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position) {
-    std::vector<uint256> ret;
-    MerkleComputation(leaves, nullptr, nullptr, position, &ret);
-    return ret;
-}
-
-static std::vector<uint256> BlockMerkleBranch(const CBlock& block, uint32_t position)
+static std::vector<uint256> BlockMerkleBranchConstantSpace(const CBlock& block, uint32_t position)
 {
     std::vector<uint256> leaves;
     leaves.resize(block.vtx.size());
     for (size_t s = 0; s < block.vtx.size(); s++) {
         leaves[s] = block.vtx[s]->GetHash();
     }
-    return ComputeMerkleBranch(leaves, position);
+    std::vector<uint256> ret;
+    MerkleComputation(leaves, nullptr, nullptr, position, &ret);
+    return ret;
 }
 
 // Older version of the merkle root computation code, for comparison.
@@ -242,6 +226,7 @@ BOOST_AUTO_TEST_CASE(merkle_test)
                     std::vector<uint256> newBranch = BlockMerkleBranch(block, mtx);
                     std::vector<uint256> oldBranch = BlockGetMerkleBranch(block, merkleTree, mtx);
                     BOOST_CHECK(oldBranch == newBranch);
+                    BOOST_CHECK(BlockMerkleBranchConstantSpace(block, mtx) == newBranch);
                     BOOST_CHECK(ComputeMerkleRootFromBranch(block.vtx[mtx]->GetHash(), newBranch, mtx) == oldRoot);
                 }
             }
@@ -349,4 +334,28 @@ BOOST_AUTO_TEST_CASE(merkle_test_BlockWitness)
 
     BOOST_CHECK_EQUAL(merkleRootofHashes, blockWitness);
 }
+BOOST_AUTO_TEST_CASE(merkle_test_parallel)
+{
+    // Sizes around the threshold and the subtree boundaries, where the last
+    // subtree is partial or has a single leaf.
+    for (size_t num_leaves : {MIN_PARALLEL_MERKLE_LEAVES - 1, MIN_PARALLEL_MERKLE_LEAVES, MIN_PARALLEL_MERKLE_LEAVES + 1, size_t{5000}, size_t{8191}, size_t{8193}, size_t{12345}}) {
+        std::vector<uint256> leaves(num_leaves);
+        for (uint256& leaf : leaves) leaf = InsecureRand256();
+        for (int mutation = 0; mutation < 3; ++mutation) {
+            if (mutation == 1) leaves[1001] = leaves[1000];
+            if (mutation == 2) leaves[num_leaves - (num_leaves & 1 ? 2 : 1)] = leaves[num_leaves - (num_leaves & 1 ? 3 : 2)];
+            bool mutated, parallel_mutated;
+            const uint256 root = ComputeMerkleRoot(leaves, &mutated);
+            BOOST_CHECK_EQUAL(ParallelMerkleRoot(leaves, &parallel_mutated), root);
+            BOOST_CHECK_EQUAL(ParallelMerkleRoot(leaves), root);
+            BOOST_CHECK_EQUAL(parallel_mutated, mutated);
+            BOOST_CHECK_EQUAL(mutated, mutation > 0);
+        }
+        for (uint32_t position : {uint32_t{0}, uint32_t{1}, uint32_t(num_leaves / 2), uint32_t(num_leaves - 1)}) {
+            const std::vector<uint256> branch = ParallelMerkleBranch(leaves, position);
+            BOOST_CHECK(branch == ComputeMerkleBranch(leaves, position));
+            BOOST_CHECK_EQUAL(ComputeMerkleRootFromBranch(leaves[position], branch, position), ComputeMerkleRoot(leaves));
+        }
+    }
+}
 BOOST_AUTO_TEST_SUITE_END()
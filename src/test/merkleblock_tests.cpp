@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <merkleblock.h>
+#include <streams.h>
 #include <uint256.h>
 #include <test/util/setup_common.h>
 
@@ -75,4 +76,39 @@ BOOST_AUTO_TEST_CASE(merkleblock_construct_from_txids_not_found)
     BOOST_CHECK_EQUAL(vIndex.size(), 0U);
 }
 
+/**
+ * Create CMerkleBlocks from the merkle tree levels of a block, which must
+ * match those created from the block itself.
+ */
+BOOST_AUTO_TEST_CASE(merkleblock_construct_from_tree_levels)
+{
+    CBlock block = getBlock13b8a();
+
+    std::vector<uint256> block_txids;
+    for (const auto& tx : block.vtx) {
+        block_txids.push_back(tx->GetHash());
+    }
+    const MerkleTreeLevels levels = ComputeMerkleTreeLevels(block_txids);
+    BOOST_CHECK(levels.front() == block_txids);
+    BOOST_REQUIRE_EQUAL(levels.back().size(), 1U);
+    BOOST_CHECK_EQUAL(levels.back().front().GetHex(), block.hashMerkleRoot.GetHex());
+
+    for (const std::vector<unsigned int>& matched_positions : std::vector<std::vector<unsigned int>>{{}, {0}, {1, 8}, {0, 1, 2, 3, 4, 5, 6, 7, 8}, {8}}) {
+        std::set<uint256> txids;
+        for (unsigned int pos : matched_positions) {
+            txids.insert(block_txids.at(pos));
+        }
+        CDataStream from_block(SER_NETWORK, PROTOCOL_VERSION);
+        from_block << CMerkleBlock(block, txids);
+        CDataStream from_levels(SER_NETWORK, PROTOCOL_VERSION);
+        from_levels << CMerkleBlock(block.GetBlockHeader(), levels, matched_positions);
+        BOOST_CHECK(from_block.str() == from_levels.str());
+    }
+
+    // A block with a single transaction has the txid as its root.
+    const MerkleTreeLevels single = ComputeMerkleTreeLevels({block_txids[0]});
+    BOOST_REQUIRE_EQUAL(single.size(), 1U);
+    BOOST_CHECK(single[0][0] == block_txids[0]);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,8 +7,11 @@
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
+#include <consensus/validation.h>
 #include <miner.h>
 #include <policy/policy.h>
+#include <pow.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
@@ -16,6 +19,7 @@
 #include <util/system.h>
 #include <util/time.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <test/util/setup_common.h>
 
@@ -526,4 +530,104 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_FIXTURE_TEST_CASE(block_template_cache, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    BlockTemplateCache cache(*m_node.mempool, Params(), 3600);
+    RegisterValidationInterface(&cache);
+
+    const auto spend = [&](const CTransactionRef& prev, CAmount fee) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(prev->GetHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = prev->vout[0].nValue - fee;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        CTransactionRef ref = MakeTransactionRef(tx);
+        LOCK(cs_main);
+        TxValidationState state;
+        BOOST_CHECK(AcceptToMemoryPool(*m_node.mempool, state, ref, nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */));
+        return ref;
+    };
+    const auto check_valid = [&](const CBlockTemplate& tmpl) {
+        LOCK(cs_main);
+        BlockValidationState state;
+        BOOST_CHECK(TestBlockValidity(state, Params(), tmpl.block, ::ChainActive().Tip(), false, false));
+    };
+
+    // The first template is assembled from scratch, with nothing to include.
+    std::unique_ptr<CBlockTemplate> tmpl = cache.GetTemplate(scriptPubKey);
+    BOOST_CHECK_EQUAL(tmpl->block.vtx.size(), 1U);
+
+    // New transactions are appended in the order they arrived, with the
+    // coinbase collecting their fees.
+    CTransactionRef parent = spend(m_coinbase_txns[0], 1000);
+    CTransactionRef child = spend(parent, 2000);
+    SyncWithValidationInterfaceQueue();
+    tmpl = cache.GetTemplate(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(tmpl->block.vtx.size(), 3U);
+    BOOST_CHECK(tmpl->block.vtx[1]->GetHash() == parent->GetHash());
+    BOOST_CHECK(tmpl->block.vtx[2]->GetHash() == child->GetHash());
+    BOOST_CHECK_EQUAL(tmpl->vTxFees[0], -3000);
+    check_valid(*tmpl);
+
+    // Returned templates are copies: asking again gives the same block.
+    BOOST_CHECK(cache.GetTemplate(scriptPubKey)->block.GetHash() == tmpl->block.GetHash());
+
+    // Once a transaction in the template leaves the mempool the template is
+    // assembled again, even if the removal has not been reported yet.
+    {
+        LOCK(m_node.mempool->cs);
+        m_node.mempool->removeRecursive(*child, MemPoolRemovalReason::CONFLICT);
+    }
+    tmpl = cache.GetTemplate(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(tmpl->block.vtx.size(), 2U);
+    BOOST_CHECK(tmpl->block.vtx[1]->GetHash() == parent->GetHash());
+    check_valid(*tmpl);
+
+    SyncWithValidationInterfaceQueue();
+    UnregisterValidationInterface(&cache);
+}
+
+BOOST_AUTO_TEST_CASE(GrindBlockNonce_threads)
+{
+    // About one in 65536 hashes meets this target; the first nonce that does
+    // for this header is 97519, found by the threads a few chunks in.
+    const auto chain_params = CreateChainParams(CBaseChainParams::REGTEST);
+    const Consensus::Params& params = chain_params->GetConsensus();
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = uint256S("0xabcdef");
+    header.hashMerkleRoot = uint256S("0x123457");
+    header.nTime = 1600000000;
+    header.nBits = 0x1f00ffff;
+    header.nNonce = 0;
+
+    CBlockHeader serial = header;
+    uint64_t serial_tries = std::numeric_limits<uint64_t>::max();
+    BOOST_REQUIRE(GrindBlockNonce(serial, params, serial_tries, 1));
+    BOOST_CHECK(CheckProofOfWork(serial.GetHash(), serial.nBits, params));
+    BOOST_CHECK_EQUAL(serial_tries, std::numeric_limits<uint64_t>::max() - serial.nNonce);
+
+    // More threads find the same, lowest, nonce.
+    CBlockHeader parallel = header;
+    uint64_t parallel_tries = std::numeric_limits<uint64_t>::max();
+    BOOST_REQUIRE(GrindBlockNonce(parallel, params, parallel_tries, 4));
+    BOOST_CHECK_EQUAL(parallel.nNonce, serial.nNonce);
+    BOOST_CHECK_EQUAL(parallel_tries, serial_tries);
+
+    // Running out of tries just before it leaves nNonce at the next nonce to try.
+    CBlockHeader limited = header;
+    uint64_t limited_tries = serial.nNonce;
+    BOOST_CHECK(!GrindBlockNonce(limited, params, limited_tries, 4));
+    BOOST_CHECK_EQUAL(limited.nNonce, serial.nNonce);
+    BOOST_CHECK_EQUAL(limited_tries, 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
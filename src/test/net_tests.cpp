@@ -12,6 +12,7 @@
 #include <streams.h>
 #include <net.h>
 #include <netbase.h>
+#include <netmessagemaker.h>
 #include <chainparams.h>
 #include <util/memory.h>
 #include <util/system.h>
@@ -319,4 +320,224 @@ BOOST_AUTO_TEST_CASE(PoissonNextSend)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(serialized_msg_shared_payload)
+{
+    auto payload = std::make_shared<const std::vector<unsigned char>>(std::vector<unsigned char>{1, 2, 3, 4, 5});
+
+    CSerializedNetMsg owned;
+    owned.command = "block";
+    owned.data = *payload;
+
+    CSerializedNetMsg shared;
+    shared.command = "block";
+    shared.shared_owner = payload;
+    shared.shared_data = MakeSpan(*payload).subspan(1);
+    BOOST_CHECK(shared.Payload() == MakeSpan(*payload).subspan(1));
+    BOOST_CHECK(owned.Payload() == MakeSpan(*payload));
+
+    // The header of a borrowed payload covers only the borrowed bytes.
+    V1TransportSerializer serializer;
+    std::vector<unsigned char> owned_header, shared_header;
+    owned.data.erase(owned.data.begin());
+    serializer.prepareForTransport(owned, owned_header);
+    serializer.prepareForTransport(shared, shared_header);
+    BOOST_CHECK(owned_header == shared_header);
+
+    // Send queue chunks point into the shared memory without copying it.
+    CSendChunk chunk(shared.shared_owner, shared.shared_data);
+    BOOST_CHECK(chunk.data() == payload->data() + 1);
+    BOOST_CHECK_EQUAL(chunk.size(), 4U);
+}
+
+BOOST_AUTO_TEST_CASE(net_events_mode)
+{
+    NetEventsMode mode;
+    BOOST_CHECK(ParseNetEventsMode(NetEventsModeName(DEFAULT_NET_EVENTS), mode));
+    BOOST_CHECK(mode == DEFAULT_NET_EVENTS);
+    BOOST_CHECK(!ParseNetEventsMode("", mode));
+    BOOST_CHECK(!ParseNetEventsMode("kqueue", mode));
+#ifdef USE_POLL
+    BOOST_CHECK(!ParseNetEventsMode("select", mode));
+#endif
+#ifdef USE_EPOLL
+    BOOST_CHECK(ParseNetEventsMode("epoll", mode));
+    BOOST_CHECK(mode == NetEventsMode::EPOLL);
+    BOOST_CHECK(AvailableNetEventsModes().find("epoll") != std::string::npos);
+#else
+    BOOST_CHECK(!ParseNetEventsMode("epoll", mode));
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(v1_transport_chunked_message)
+{
+    // A message larger than the 256 KiB read-ahead, delivered in small pieces
+    std::vector<unsigned char> payload(700 * 1000);
+    for (size_t i = 0; i < payload.size(); ++i) payload[i] = i * 7;
+    CSerializedNetMsg ser_msg;
+    ser_msg.command = "block";
+    ser_msg.data = payload;
+    std::vector<unsigned char> header;
+    V1TransportSerializer().prepareForTransport(ser_msg, header);
+    std::vector<unsigned char> wire(header);
+    wire.insert(wire.end(), payload.begin(), payload.end());
+
+    V1TransportDeserializer deserializer(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    size_t pos = 0;
+    while (pos < wire.size()) {
+        const unsigned int chunk = std::min<size_t>(wire.size() - pos, 5000);
+        const char* pch = (const char*)wire.data() + pos;
+        unsigned int left = chunk;
+        while (left > 0) {
+            int ret = deserializer.Read(pch, left);
+            BOOST_REQUIRE(ret > 0);
+            pch += ret;
+            left -= ret;
+        }
+        pos += chunk;
+    }
+    BOOST_REQUIRE(deserializer.Complete());
+    CNetMessage msg = deserializer.GetMessage(Params().MessageStart(), 0);
+    BOOST_CHECK(msg.m_valid_checksum);
+    BOOST_REQUIRE_EQUAL(msg.m_recv.size(), payload.size());
+    BOOST_CHECK(memcmp(msg.m_recv.data(), payload.data(), payload.size()) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(recv_buffer_pool)
+{
+    RecvBufferPool pool;
+    CSerializeData buffer = pool.Get();
+    BOOST_CHECK_EQUAL(buffer.capacity(), 0U);
+    buffer.resize(1000);
+    const char* allocation = buffer.data();
+    const size_t capacity = buffer.capacity();
+    pool.Put(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.PooledBytes(), capacity);
+
+    // The allocation is handed out again, emptied.
+    buffer = pool.Get();
+    BOOST_CHECK(buffer.data() == allocation);
+    BOOST_CHECK(buffer.empty());
+    BOOST_CHECK_EQUAL(pool.PooledBytes(), 0U);
+
+    // Block-sized buffers are not kept.
+    buffer.resize(1000 * 1000);
+    pool.Put(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.PooledBytes(), 0U);
+
+    // After a burst of four buffers in use at once, the pool shrinks to the
+    // single buffer needed once the burst is over.
+    std::vector<CSerializeData> burst;
+    for (int i = 0; i < 4; ++i) {
+        burst.push_back(pool.Get());
+        burst.back().resize(1000);
+    }
+    for (CSerializeData& b : burst) pool.Put(std::move(b));
+    const size_t burst_bytes = pool.PooledBytes();
+    BOOST_CHECK(burst_bytes >= 4000);
+    for (int i = 0; i < 2000; ++i) {
+        buffer = pool.Get();
+        pool.Put(std::move(buffer));
+    }
+    BOOST_CHECK(pool.PooledBytes() > 0);
+    BOOST_CHECK(pool.PooledBytes() < burst_bytes / 2);
+
+    // Messages from a deserializer give their buffer back once processed.
+    auto shared_pool = std::make_shared<RecvBufferPool>();
+    V1TransportDeserializer deserializer(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION, shared_pool);
+    CSerializedNetMsg ser_msg;
+    ser_msg.command = "ping";
+    ser_msg.data = std::vector<unsigned char>(8, 1);
+    std::vector<unsigned char> wire;
+    V1TransportSerializer().prepareForTransport(ser_msg, wire);
+    wire.insert(wire.end(), ser_msg.data.begin(), ser_msg.data.end());
+    const char* first_data;
+    {
+        BOOST_CHECK_EQUAL(deserializer.Read((const char*)wire.data(), 24), 24);
+        BOOST_CHECK_EQUAL(deserializer.Read((const char*)wire.data() + 24, 8), 8);
+        BOOST_REQUIRE(deserializer.Complete());
+        CNetMessage msg = deserializer.GetMessage(Params().MessageStart(), 0);
+        BOOST_CHECK(msg.m_valid_checksum);
+        first_data = msg.m_recv.data();
+    }
+    BOOST_CHECK(shared_pool->PooledBytes() >= 8);
+    BOOST_CHECK_EQUAL(deserializer.Read((const char*)wire.data(), 24), 24);
+    BOOST_CHECK_EQUAL(deserializer.Read((const char*)wire.data() + 24, 8), 8);
+    BOOST_REQUIRE(deserializer.Complete());
+    CNetMessage msg = deserializer.GetMessage(Params().MessageStart(), 0);
+    BOOST_CHECK(msg.m_recv.data() == first_data);
+    BOOST_CHECK_EQUAL(shared_pool->PooledBytes(), 0U);
+}
+
+#ifndef WIN32
+/** Read what is waiting on a socket, and return the types of the complete messages in it. */
+static std::vector<std::string> ReceiveMessageTypes(int fd, std::vector<unsigned char>& buffer)
+{
+    unsigned char chunk[65536];
+    ssize_t n;
+    while ((n = recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT)) > 0) {
+        buffer.insert(buffer.end(), chunk, chunk + n);
+    }
+    std::vector<std::string> types;
+    while (buffer.size() >= CMessageHeader::HEADER_SIZE) {
+        const uint32_t size = ReadLE32(buffer.data() + CMessageHeader::MESSAGE_START_SIZE + CMessageHeader::COMMAND_SIZE);
+        if (buffer.size() < CMessageHeader::HEADER_SIZE + size) break;
+        const char* type = (const char*)buffer.data() + CMessageHeader::MESSAGE_START_SIZE;
+        types.emplace_back(type, strnlen(type, CMessageHeader::COMMAND_SIZE));
+        buffer.erase(buffer.begin(), buffer.begin() + CMessageHeader::HEADER_SIZE + size);
+    }
+    return types;
+}
+
+BOOST_AUTO_TEST_CASE(send_queue_priorities)
+{
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    CConnman connman(0x1337, 0x1337);
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CNode node(0, NODE_NETWORK, 0, fds[0], CAddress(CService(ipv4Addr, 7777), NODE_NETWORK), 0, 0, CAddress(), "", /* fInboundIn */ true);
+    const CNetMsgMaker msg_maker(INIT_PROTO_VERSION);
+    std::vector<unsigned char> received;
+
+    // During the version handshake, messages are sent in order.
+    connman.CorkSend(&node);
+    connman.PushMessage(&node, msg_maker.Make(NetMsgType::VERACK));
+    connman.PushMessage(&node, msg_maker.Make(NetMsgType::HEADERS, std::vector<unsigned char>(10)));
+    node.fSuccessfullyConnected = true;
+    connman.UncorkSend(&node);
+    BOOST_CHECK(ReceiveMessageTypes(fds[1], received) == std::vector<std::string>({NetMsgType::VERACK, NetMsgType::HEADERS}));
+
+    // Afterwards blocks overtake control messages, and those transaction relay.
+    connman.CorkSend(&node);
+    connman.PushMessage(&node, msg_maker.Make(NetMsgType::TX, std::vector<unsigned char>(100)));
+    connman.PushMessage(&node, msg_maker.Make(NetMsgType::PING, uint64_t{1}));
+    connman.PushMessage(&node, msg_maker.Make(NetMsgType::CMPCTBLOCK, std::vector<unsigned char>(200)));
+    connman.PushMessage(&node, msg_maker.Make(NetMsgType::INV, std::vector<unsigned char>(36)));
+    CNodeStats stats;
+    node.copyStats(stats, {});
+    BOOST_CHECK_EQUAL(stats.m_send_queue_bytes[size_t(SendPriority::BLOCK)], CMessageHeader::HEADER_SIZE + 201U);
+    BOOST_CHECK_EQUAL(stats.m_send_queue_bytes[size_t(SendPriority::CONTROL)], CMessageHeader::HEADER_SIZE + 8U);
+    BOOST_CHECK_EQUAL(stats.m_send_queue_bytes[size_t(SendPriority::TX)], 2 * CMessageHeader::HEADER_SIZE + 101U + 37U);
+    connman.UncorkSend(&node);
+    BOOST_CHECK(ReceiveMessageTypes(fds[1], received) == std::vector<std::string>({NetMsgType::CMPCTBLOCK, NetMsgType::PING, NetMsgType::TX, NetMsgType::INV}));
+
+    // A message that is partly sent is finished before a block is sent.
+    connman.PushMessage(&node, msg_maker.Make(NetMsgType::TX, std::vector<unsigned char>(4000000)));
+    {
+        LOCK(node.cs_vSend);
+        BOOST_REQUIRE(node.HasQueuedSends());
+        BOOST_CHECK_EQUAL(node.m_send_in_progress, int(SendPriority::TX));
+    }
+    connman.PushMessage(&node, msg_maker.Make(NetMsgType::CMPCTBLOCK, std::vector<unsigned char>(200)));
+    std::vector<std::string> types;
+    for (int i = 0; i < 1000 && types.size() < 2; ++i) {
+        for (const std::string& type : ReceiveMessageTypes(fds[1], received)) types.push_back(type);
+        connman.UncorkSend(&node);
+    }
+    BOOST_CHECK(types == std::vector<std::string>({NetMsgType::TX, NetMsgType::CMPCTBLOCK}));
+    BOOST_CHECK(received.empty());
+    close(fds[1]);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -391,6 +391,9 @@ BOOST_AUTO_TEST_CASE(netpermissions_test)
     BOOST_CHECK(error.empty());
     BOOST_CHECK_EQUAL(whitelistPermissions.m_subnet.ToString(), "1.2.3.4/32");
     BOOST_CHECK(NetWhitelistPermissions::TryParse("bloom,forcerelay,noban,relay,mempool@1.2.3.4/32", whitelistPermissions, error));
+    BOOST_CHECK(NetWhitelistPermissions::TryParse("udprelay,noban@1.2.3.4/32", whitelistPermissions, error));
+    BOOST_CHECK_EQUAL(whitelistPermissions.m_flags, PF_UDPRELAY | PF_NOBAN);
+    BOOST_CHECK(NetPermissions::ToStrings(PF_UDPRELAY) == std::vector<std::string>{"udprelay"});
 
     const auto strings = NetPermissions::ToStrings(PF_ALL);
     BOOST_CHECK_EQUAL(strings.size(), 5);
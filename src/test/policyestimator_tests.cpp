@@ -178,6 +178,21 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     for (int i = 2; i < 9; i++) { // At 9, the original estimate was already at the bottom (b/c scale = 2)
         BOOST_CHECK(feeEst.estimateFee(i).GetFeePerK() < origFeeEst[i-1] - deltaFee);
     }
+
+    // The table has the smart estimates of every target, which stay the same
+    // when asked again.
+    for (bool conservative : {false, true}) {
+        const std::vector<SmartFeeEstimate> table = feeEst.estimateSmartFeeTable(conservative);
+        BOOST_CHECK_EQUAL(table.size(), feeEst.HighestTargetTracked(FeeEstimateHorizon::LONG_HALFLIFE));
+        for (int i : {1, 2, 5, 25, 1008}) {
+            FeeCalculation feeCalc;
+            BOOST_CHECK(feeEst.estimateSmartFee(i, &feeCalc, conservative) == table[i - 1].feerate);
+            BOOST_CHECK_EQUAL(feeCalc.desiredTarget, i);
+            BOOST_CHECK_EQUAL(feeCalc.returnedTarget, table[i - 1].calc.returnedTarget);
+            BOOST_CHECK(feeCalc.reason == table[i - 1].calc.reason);
+        }
+        BOOST_CHECK(table[1].feerate != CFeeRate(0));
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -135,4 +135,54 @@ BOOST_AUTO_TEST_CASE(GetBlockProofEquivalentTime_test)
     }
 }
 
+static void BuildLwmaTestChain(std::vector<CBlockIndex>& blocks, CBlockIndex* fork_point, const Consensus::Params& params)
+{
+    const arith_uint256 pow_limit = UintToArith256(params.powLimit);
+    int64_t time = fork_point ? fork_point->GetBlockTime() : 1569211443;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        CBlockIndex* prev = i ? &blocks[i - 1] : fork_point;
+        blocks[i].pprev = prev;
+        blocks[i].nHeight = prev ? prev->nHeight + 1 : 0;
+        // Occasionally step the timestamp backwards to exercise the monotonic timestamp rule.
+        time += InsecureRandRange(10) == 0 ? -int64_t(InsecureRandRange(600)) : int64_t(InsecureRandRange(1000));
+        blocks[i].nTime = time;
+        blocks[i].nBits = arith_uint256(pow_limit >> InsecureRandRange(16)).GetCompact();
+        blocks[i].BuildSkip();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(lwma_incremental_matches_full_loop)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const Consensus::Params& params = chainParams->GetConsensus();
+    ResetLwmaCache();
+
+    std::vector<CBlockIndex> chain(2000);
+    BuildLwmaTestChain(chain, nullptr, params);
+    std::vector<CBlockIndex> fork(400);
+    BuildLwmaTestChain(fork, &chain[1500], params);
+
+    // Follow the tip forwards, then back again.
+    for (size_t i = 0; i < chain.size(); i++) {
+        BOOST_CHECK_EQUAL(LwmaCalculateNextWorkRequired(&chain[i], params), LwmaCalculateNextWorkRequiredUncached(&chain[i], params));
+    }
+    for (size_t i = chain.size(); i-- > 0;) {
+        BOOST_CHECK_EQUAL(LwmaCalculateNextWorkRequired(&chain[i], params), LwmaCalculateNextWorkRequiredUncached(&chain[i], params));
+    }
+
+    // Reorg onto the fork, interleaved with queries for the old tip.
+    for (size_t i = 0; i < fork.size(); i++) {
+        BOOST_CHECK_EQUAL(LwmaCalculateNextWorkRequired(&fork[i], params), LwmaCalculateNextWorkRequiredUncached(&fork[i], params));
+        BOOST_CHECK_EQUAL(LwmaCalculateNextWorkRequired(&chain.back(), params), LwmaCalculateNextWorkRequiredUncached(&chain.back(), params));
+    }
+
+    // Random jumps.
+    for (int j = 0; j < 500; j++) {
+        CBlockIndex* p = InsecureRandBool() ? &chain[InsecureRandRange(chain.size())] : &fork[InsecureRandRange(fork.size())];
+        BOOST_CHECK_EQUAL(LwmaCalculateNextWorkRequired(p, params), LwmaCalculateNextWorkRequiredUncached(p, params));
+    }
+
+    ResetLwmaCache();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,11 +8,15 @@
 #include <reverse_iterator.h>
 #include <serialize.h>
 #include <streams.h>
+#include <support/prevectorpool.h>
 
 #include <test/util/setup_common.h>
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <thread>
+
 BOOST_FIXTURE_TEST_SUITE(prevector_tests, TestingSetup)
 
 template<unsigned int N, typename T>
@@ -292,4 +296,66 @@ BOOST_AUTO_TEST_CASE(PrevectorTestInt)
     }
 }
 
+BOOST_AUTO_TEST_CASE(prevectorpool_blocks)
+{
+    BOOST_CHECK_EQUAL(prevector_pool::BlockSize(1), 8U);
+    BOOST_CHECK_EQUAL(prevector_pool::BlockSize(34), 40U);
+    BOOST_CHECK_EQUAL(prevector_pool::BlockSize(128), 128U);
+    BOOST_CHECK_EQUAL(prevector_pool::BlockSize(129), 129U);
+
+    // Blocks of every size, including the malloc ones above the largest
+    // class, are pointer aligned, writable in full and do not overlap.
+    std::vector<std::pair<unsigned char*, size_t>> blocks;
+    for (size_t round = 0; round < 3; ++round) {
+        for (size_t bytes = 1; bytes <= prevector_pool::MAX_POOLED_SIZE + 64; ++bytes) {
+            unsigned char* block = static_cast<unsigned char*>(prevector_pool::Allocate(bytes));
+            BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(block) % alignof(void*), 0U);
+            memset(block, blocks.size() & 0xff, prevector_pool::BlockSize(bytes));
+            blocks.emplace_back(block, bytes);
+        }
+    }
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const size_t size = prevector_pool::BlockSize(blocks[i].second);
+        BOOST_CHECK(std::all_of(blocks[i].first, blocks[i].first + size, [&](unsigned char c) { return c == (i & 0xff); }));
+    }
+    for (const auto& block : blocks) {
+        prevector_pool::Free(block.first, block.second);
+    }
+    prevector_pool::Free(nullptr, 8);
+}
+
+BOOST_AUTO_TEST_CASE(prevectorpool_threads)
+{
+    // Blocks allocated on one thread and freed on another, and the caches of
+    // threads that have exited, go back to use.
+    std::vector<std::pair<void*, size_t>> blocks;
+    std::thread producer([&] {
+        for (size_t i = 0; i < 100000; ++i) {
+            const size_t bytes = 34 + (i % 10) * 8;
+            void* block = prevector_pool::Allocate(bytes);
+            memset(block, 0xaa, prevector_pool::BlockSize(bytes));
+            blocks.emplace_back(block, bytes);
+        }
+    });
+    producer.join();
+    for (const auto& block : blocks) {
+        prevector_pool::Free(block.first, block.second);
+    }
+    const size_t slab_memory = prevector_pool::SlabMemory();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([] {
+            for (int round = 0; round < 10; ++round) {
+                std::vector<prevector<28, unsigned char>> scripts(1024);
+                for (auto& script : scripts) script.resize(34 + round * 8);
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    // The scripts of all four threads fit in the blocks freed before (which
+    // the build without the pool leaves alone); allow for a slab taken by
+    // another thread of the test setup in the meantime.
+    BOOST_CHECK_LE(prevector_pool::SlabMemory(), slab_memory + (1 << 16));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,12 +4,15 @@
 
 #include <rpc/server.h>
 #include <rpc/client.h>
+#include <rpc/request.h>
 #include <rpc/util.h>
 
 #include <core_io.h>
 #include <interfaces/chain.h>
+#include <node/blockstats.h>
 #include <node/context.h>
 #include <test/util/setup_common.h>
+#include <util/strencodings.h>
 #include <util/time.h>
 
 #include <boost/algorithm/string.hpp>
@@ -229,6 +232,38 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK_THROW(ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL"), std::runtime_error);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_encode_cbor)
+{
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(NullUniValue)), "f6");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue(true))), "f5");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue(false))), "f4");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue(0))), "00");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue(23))), "17");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue(24))), "1818");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue(1000))), "1903e8");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue(-1))), "20");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue(-1000))), "3903e7");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue(std::numeric_limits<uint64_t>::max()))), "1bffffffffffffffff");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue(std::numeric_limits<int64_t>::min()))), "3b7fffffffffffffff");
+    // Amounts keep their digits as decimal fractions
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(ValueFromAmount(100000))), "c482271a000186a0");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(ValueFromAmount(-1))), "c4822720");
+    // Other numbers become doubles
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(ParseNonRFCJSONValue("1.5e3"))), "fb4097700000000000");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(ParseNonRFCJSONValue("123456789012345678901"))), "fb441ac53a7e04bcda");
+    // Lowercase hex becomes tagged bytes, anything else stays text
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue("00ff"))), "d74200ff");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue("00FF"))), "6430304646");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue("abc"))), "63616263");
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(UniValue(""))), "60");
+
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("a", UniValue(UniValue::VARR));
+    obj.pushKV("b", 1);
+    BOOST_CHECK_EQUAL(HexStr(EncodeCBOR(obj)), "a2616180616201");
+    BOOST_CHECK_EQUAL(HexStr(JSONRPCReplyCBOR(UniValue(1), NullUniValue, UniValue("x"))), "a366726573756c7401656572726f72f66269646178");
+}
+
 BOOST_AUTO_TEST_CASE(rpc_ban)
 {
     BOOST_CHECK_NO_THROW(CallRPC(std::string("clearbanned")));
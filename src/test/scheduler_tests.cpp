@@ -9,6 +9,9 @@
 #include <boost/thread.hpp>
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+#include <future>
+
 BOOST_AUTO_TEST_SUITE(scheduler_tests)
 
 static void microTask(CScheduler& s, boost::mutex& mutex, int& counter, int delta, std::chrono::system_clock::time_point rescheduleTime)
@@ -201,4 +204,59 @@ BOOST_AUTO_TEST_CASE(mockforward)
     BOOST_CHECK(delta > 2*60 && delta < 3*60);
 }
 
+BOOST_AUTO_TEST_CASE(named_tasks)
+{
+    CScheduler scheduler;
+    boost::thread_group threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.create_thread(std::bind(&CScheduler::serviceQueue, &scheduler));
+    }
+
+    // Tasks of the same name never overlap, even with idle threads around.
+    std::atomic<int> in_flight{0};
+    std::atomic<bool> overlapped{false};
+    std::atomic<int> unnamed{0};
+    for (int i = 0; i < 20; ++i) {
+        scheduler.scheduleFromNow([&] {
+            if (++in_flight > 1) overlapped = true;
+            UninterruptibleSleep(std::chrono::milliseconds{1});
+            --in_flight;
+        }, std::chrono::milliseconds{0}, "serial");
+        scheduler.scheduleFromNow([&] { ++unnamed; }, std::chrono::milliseconds{0});
+    }
+
+    // A running task does not hold back tasks of another name.
+    std::promise<void> released;
+    std::future<void> released_future = released.get_future();
+    bool waited{false};
+    scheduler.scheduleFromNow([&] {
+        waited = released_future.wait_for(std::chrono::seconds{10}) == std::future_status::ready;
+    }, std::chrono::milliseconds{0}, "slow");
+    scheduler.scheduleFromNow([&] { released.set_value(); }, std::chrono::milliseconds{0}, "fast");
+
+    scheduler.stop(true);
+    threads.join_all();
+
+    BOOST_CHECK(!overlapped);
+    BOOST_CHECK_EQUAL(unnamed, 20);
+    BOOST_CHECK(waited);
+
+    const std::map<std::string, SchedulerTaskInfo> info = scheduler.GetTaskInfo();
+    BOOST_CHECK_EQUAL(info.size(), 4U);
+    const SchedulerTaskInfo& serial = info.at("serial");
+    BOOST_CHECK_EQUAL(serial.runs, 20U);
+    BOOST_CHECK_EQUAL(serial.scheduled, 0U);
+    BOOST_CHECK(!serial.running);
+    // Every run slept for at least a millisecond.
+    BOOST_CHECK_GE(serial.max_time, 1000);
+    BOOST_CHECK_GE(serial.total_time, 20 * 1000);
+    BOOST_CHECK_EQUAL(serial.runtime_histogram[0], 0U);
+    uint64_t histogram_runs = 0;
+    for (uint64_t count : serial.runtime_histogram) histogram_runs += count;
+    BOOST_CHECK_EQUAL(histogram_runs, 20U);
+    BOOST_CHECK_EQUAL(info.at("").runs, 20U);
+    BOOST_CHECK_EQUAL(info.at("slow").runs, 1U);
+    BOOST_CHECK_EQUAL(info.at("fast").runs, 1U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
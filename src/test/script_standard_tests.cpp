@@ -292,6 +292,19 @@ BOOST_AUTO_TEST_CASE(script_standard_ExtractDestinations)
     BOOST_CHECK(boost::get<PKHash>(&addresses[1]) &&
                 *boost::get<PKHash>(&addresses[1]) == PKHash(pubkeys[1]));
 
+    // Solved once, the multisig script gives the same results
+    {
+        const SolvedScript solved(s);
+        BOOST_CHECK_EQUAL(solved.type, TX_MULTISIG);
+        std::vector<CTxDestination> solved_addresses;
+        int solved_required;
+        BOOST_CHECK(ExtractDestinations(solved, solved_addresses, solved_required));
+        BOOST_CHECK(solved_addresses == addresses);
+        BOOST_CHECK_EQUAL(solved_required, nRequired);
+        CTxDestination address;
+        BOOST_CHECK(!ExtractDestination(solved, address));
+    }
+
     // TX_NULL_DATA
     s.clear();
     s << OP_RETURN << std::vector<unsigned char>({75});
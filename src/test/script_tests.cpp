@@ -6,6 +6,7 @@
 
 #include <core_io.h>
 #include <key.h>
+#include <policy/policy.h>
 #include <script/script.h>
 #include <script/script_error.h>
 #include <script/sign.h>
@@ -135,6 +136,9 @@ void DoTest(const CScript& scriptPubKey, const CScript& scriptSig, const CScript
     CMutableTransaction tx2 = tx;
     BOOST_CHECK_MESSAGE(VerifyScript(scriptSig, scriptPubKey, &scriptWitness, flags, MutableTransactionSignatureChecker(&tx, 0, txCredit.vout[0].nValue), &err) == expect, message);
     BOOST_CHECK_MESSAGE(err == scriptError, std::string(FormatScriptError(err)) + " where " + std::string(FormatScriptError((ScriptError_t)scriptError)) + " expected: " + message);
+    ScriptError err_generic;
+    BOOST_CHECK_MESSAGE(VerifyScript(scriptSig, scriptPubKey, &scriptWitness, flags | SCRIPT_NO_TEMPLATE_FAST_PATH, MutableTransactionSignatureChecker(&tx, 0, txCredit.vout[0].nValue), &err_generic) == expect, message + " (generic interpreter)");
+    BOOST_CHECK_MESSAGE(err_generic == err, message + " (generic interpreter)");
 
     // Verify that removing flags from a passing test or adding flags to a failing test does not change the result.
     for (int i = 0; i < 16; ++i) {
@@ -1163,6 +1167,72 @@ SignatureData CombineSignatures(const CTxOut& txout, const CMutableTransaction&
     return data;
 }
 
+BOOST_AUTO_TEST_CASE(script_p2pkh_fast_path)
+{
+    // P2PKH and P2WPKH spends give the same result, error and (on success)
+    // final stack with and without the specialized path.
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    const CScript p2pkh = GetScriptForDestination(PKHash(pubkey));
+    const CScript p2wpkh = GetScriptForDestination(WitnessV0KeyHash(PKHash(pubkey)));
+
+    const CTransaction tx_credit{BuildCreditingTransaction(p2pkh, 1)};
+    const CMutableTransaction tx_spend = BuildSpendingTransaction(CScript(), CScriptWitness(), tx_credit);
+    const MutableTransactionSignatureChecker checker(&tx_spend, 0, 1);
+    std::vector<unsigned char> sig, sig_witness;
+    BOOST_CHECK(key.Sign(SignatureHash(p2pkh, tx_spend, 0, SIGHASH_ALL, 1, SigVersion::BASE), sig));
+    sig.push_back(SIGHASH_ALL);
+    BOOST_CHECK(key.Sign(SignatureHash(p2pkh, tx_spend, 0, SIGHASH_ALL, 1, SigVersion::WITNESS_V0), sig_witness));
+    sig_witness.push_back(SIGHASH_ALL);
+    std::vector<unsigned char> bad_sig = sig;
+    bad_sig[10] ^= 1;
+    CKey other_key;
+    other_key.MakeNewKey(true);
+    const std::vector<unsigned char> other_pubkey = ToByteVector(other_key.GetPubKey());
+
+    std::vector<std::vector<std::vector<unsigned char>>> stacks = {
+        {sig, ToByteVector(pubkey)},
+        {bad_sig, ToByteVector(pubkey)},
+        {{}, ToByteVector(pubkey)},
+        {sig, other_pubkey},
+        {ToByteVector(pubkey)},
+        {{1}, sig, ToByteVector(pubkey)},
+        // FindAndDelete matches the pubkey hash push
+        {std::vector<unsigned char>(p2pkh.begin() + 3, p2pkh.begin() + 23), ToByteVector(pubkey)},
+    };
+    // A stack without room for OP_DUP
+    stacks.emplace_back(MAX_STACK_SIZE - 2, std::vector<unsigned char>{1});
+    stacks.back().push_back(sig);
+    stacks.back().push_back(ToByteVector(pubkey));
+
+    const unsigned int flag_sets[] = {0, SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_NULLFAIL, SCRIPT_VERIFY_CONST_SCRIPTCODE, STANDARD_SCRIPT_VERIFY_FLAGS};
+    for (const auto& stack : stacks) {
+        for (unsigned int flags : flag_sets) {
+            std::vector<std::vector<unsigned char>> fast = stack, generic = stack;
+            ScriptError err_fast, err_generic;
+            const bool ret_fast = EvalScript(fast, p2pkh, flags, checker, SigVersion::BASE, &err_fast);
+            const bool ret_generic = EvalScript(generic, p2pkh, flags | SCRIPT_NO_TEMPLATE_FAST_PATH, checker, SigVersion::BASE, &err_generic);
+            BOOST_CHECK_EQUAL(ret_fast, ret_generic);
+            BOOST_CHECK_EQUAL(err_fast, err_generic);
+            // Failed evaluations leave their stack in an unspecified state.
+            if (ret_generic) BOOST_CHECK(fast == generic);
+        }
+    }
+
+    // P2WPKH runs the same script under the witness sighash.
+    for (const std::vector<unsigned char>& witness_sig : {sig_witness, sig}) {
+        CScriptWitness witness;
+        witness.stack = {witness_sig, ToByteVector(pubkey)};
+        for (bool fast : {true, false}) {
+            const unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS | (fast ? 0 : SCRIPT_NO_TEMPLATE_FAST_PATH);
+            ScriptError err;
+            BOOST_CHECK_EQUAL(VerifyScript(CScript(), p2wpkh, &witness, flags, checker, &err), witness_sig == sig_witness);
+            BOOST_CHECK_EQUAL(err, witness_sig == sig_witness ? SCRIPT_ERR_OK : SCRIPT_ERR_SIG_NULLFAIL);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(script_combineSigs)
 {
     // Test the ProduceSignature's ability to combine signatures function
@@ -1628,5 +1698,41 @@ BOOST_AUTO_TEST_CASE(palladiumconsensus_verify_script_invalid_flags)
     BOOST_CHECK_EQUAL(err, palladiumconsensus_ERR_INVALID_FLAGS);
 }
 
+/* Test palladiumconsensus_verify_transaction reports each input, on any number of threads */
+BOOST_AUTO_TEST_CASE(palladiumconsensus_verify_transaction_results)
+{
+    const CScript valid_script = CScript() << OP_1;
+    const CScript invalid_script = CScript() << OP_0;
+
+    CMutableTransaction spendTx;
+    std::vector<palladiumconsensus_spent_output> spent;
+    for (int i = 0; i < 5; ++i) {
+        spendTx.vin.emplace_back(COutPoint(InsecureRand256(), i));
+        const CScript& script = i == 3 ? invalid_script : valid_script;
+        spent.push_back({script.data(), (unsigned int)script.size(), 1});
+    }
+    spendTx.vout.emplace_back(1, CScript());
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << spendTx;
+
+    for (unsigned int threads : {0, 1, 3, 8}) {
+        palladiumconsensus_error err;
+        std::vector<int> results(spent.size(), -1);
+        int result = palladiumconsensus_verify_transaction((const unsigned char*)&stream[0], stream.size(), spent.data(), spent.size(), palladiumconsensus_SCRIPT_FLAGS_VERIFY_ALL, threads, results.data(), &err);
+        BOOST_CHECK_EQUAL(result, 0);
+        BOOST_CHECK_EQUAL(err, palladiumconsensus_ERR_OK);
+        BOOST_CHECK(results == std::vector<int>({1, 1, 1, 0, 1}));
+    }
+
+    spent[3] = spent[0];
+    palladiumconsensus_error err;
+    BOOST_CHECK_EQUAL(palladiumconsensus_verify_transaction((const unsigned char*)&stream[0], stream.size(), spent.data(), spent.size(), palladiumconsensus_SCRIPT_FLAGS_VERIFY_ALL, 2, nullptr, &err), 1);
+    BOOST_CHECK_EQUAL(err, palladiumconsensus_ERR_OK);
+
+    BOOST_CHECK_EQUAL(palladiumconsensus_verify_transaction((const unsigned char*)&stream[0], stream.size(), spent.data(), spent.size() - 1, palladiumconsensus_SCRIPT_FLAGS_VERIFY_ALL, 2, nullptr, &err), 0);
+    BOOST_CHECK_EQUAL(err, palladiumconsensus_ERR_SPENT_OUTPUTS_MISMATCH);
+}
+
 #endif
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include <serialize.h>
 #include <streams.h>
 #include <hash.h>
+#include <primitives/block.h>
 #include <test/util/setup_common.h>
 #include <util/strencodings.h>
 
@@ -379,4 +380,43 @@ BOOST_AUTO_TEST_CASE(class_methods)
     BOOST_CHECK(methodtest3 == methodtest4);
 }
 
+BOOST_AUTO_TEST_CASE(fixed_size_types)
+{
+    // Headers and outpoints are written in one piece, in the same format as field by field.
+    CBlockHeader header;
+    header.nVersion = -0x1234567;
+    header.hashPrevBlock = InsecureRand256();
+    header.hashMerkleRoot = InsecureRand256();
+    header.nTime = 0x89abcdef;
+    header.nBits = 0x1d00ffff;
+    header.nNonce = 42;
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    CDataStream expected(SER_NETWORK, PROTOCOL_VERSION);
+    expected << header.nVersion << header.hashPrevBlock << header.hashMerkleRoot << header.nTime << header.nBits << header.nNonce;
+    BOOST_CHECK(ss.str() == expected.str());
+    BOOST_CHECK_EQUAL(GetSerializeSize(header, PROTOCOL_VERSION), CBlockHeader::SERIALIZED_SIZE);
+    BOOST_CHECK_EQUAL(ss.size(), CBlockHeader::SERIALIZED_SIZE);
+    CBlockHeader header2;
+    ss >> header2;
+    BOOST_CHECK_EQUAL(header2.GetHash(), header.GetHash());
+    BOOST_CHECK_EQUAL(header2.nVersion, header.nVersion);
+    BOOST_CHECK_EQUAL(header2.nNonce, header.nNonce);
+
+    const COutPoint outpoint(InsecureRand256(), 0xfedcba98);
+    ss << outpoint;
+    expected.clear();
+    expected << outpoint.hash << outpoint.n;
+    BOOST_CHECK(ss.str() == expected.str());
+    BOOST_CHECK_EQUAL(GetSerializeSize(outpoint, PROTOCOL_VERSION), COutPoint::SERIALIZED_SIZE);
+    COutPoint outpoint2;
+    ss >> outpoint2;
+    BOOST_CHECK(outpoint2 == outpoint);
+
+    // Truncated input is rejected as a whole.
+    expected.clear();
+    expected << outpoint.hash;
+    BOOST_CHECK_THROW(expected >> outpoint2, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,84 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/spentindex.h>
+#include <key.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <util/time.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(spentindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(spentindex_initial_sync, TestChain100Setup)
+{
+    SpentIndex spentindex(1 << 20, true);
+
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    auto spend = [&](const COutPoint& prevout) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 11 * CENT;
+        tx.vout[0].scriptPubKey = coinbase_script;
+        std::vector<unsigned char> sig;
+        uint256 sighash = SignatureHash(coinbase_script, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(sighash, sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << sig;
+        return tx;
+    };
+
+    // Spend a coinbase before the index is started, and one after.
+    const CMutableTransaction first = spend(COutPoint(m_coinbase_txns[0]->GetHash(), 0));
+    const CBlock first_block = CreateAndProcessBlock({first}, coinbase_script);
+
+    uint256 block_hash;
+    CTransactionRef tx;
+    uint32_t vin;
+    BOOST_CHECK(!spentindex.FindSpendingTx(first.vin[0].prevout, block_hash, tx, vin));
+
+    spentindex.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!spentindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    BOOST_REQUIRE(spentindex.FindSpendingTx(first.vin[0].prevout, block_hash, tx, vin));
+    BOOST_CHECK(tx->GetHash() == first.GetHash());
+    BOOST_CHECK(block_hash == first_block.GetHash());
+    BOOST_CHECK_EQUAL(vin, 0U);
+
+    // Unspent outputs, including one sharing the txid of a spent output, are not found.
+    BOOST_CHECK(!spentindex.FindSpendingTx(COutPoint(m_coinbase_txns[1]->GetHash(), 0), block_hash, tx, vin));
+    BOOST_CHECK(!spentindex.FindSpendingTx(COutPoint(m_coinbase_txns[0]->GetHash(), 1), block_hash, tx, vin));
+
+    // Check that spends in new blocks make it into the index.
+    const CMutableTransaction second = spend(COutPoint(m_coinbase_txns[1]->GetHash(), 0));
+    const CBlock second_block = CreateAndProcessBlock({second}, coinbase_script);
+    BOOST_CHECK(spentindex.BlockUntilSyncedToCurrentChain());
+    BOOST_REQUIRE(spentindex.FindSpendingTx(second.vin[0].prevout, block_hash, tx, vin));
+    BOOST_CHECK(tx->GetHash() == second.GetHash());
+    BOOST_CHECK(block_hash == second_block.GetHash());
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    spentindex.Stop();
+
+    // spentindex job may be scheduled, so stop scheduler before destructing
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <thread>
+
 namespace {
 template <typename MutexType>
 void TestPotentialDeadLockDetected(MutexType& mutex1, MutexType& mutex2)
@@ -27,6 +31,14 @@ void TestPotentialDeadLockDetected(MutexType& mutex1, MutexType& mutex2)
     BOOST_CHECK(!error_thrown);
     #endif
 }
+
+const LockProfileStats* FindLockSite(const std::vector<LockProfileStats>& sites, const std::string& name, int line)
+{
+    for (const LockProfileStats& site : sites) {
+        if (site.name == name && site.line == line) return &site;
+    }
+    return nullptr;
+}
 } // namespace
 
 BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
@@ -49,4 +61,53 @@ BOOST_AUTO_TEST_CASE(potential_deadlock_detected)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(lock_profiling)
+{
+    const bool prev = g_lock_profiling;
+    Mutex profiled_mutex;
+
+    // Nothing is recorded while profiling is off.
+    g_lock_profiling = false;
+    const int line_off = __LINE__ + 1;
+    { LOCK(profiled_mutex); }
+    BOOST_CHECK(!FindLockSite(GetLockProfile(), "profiled_mutex", line_off));
+
+    g_lock_profiling = true;
+    std::atomic<bool> locked{false};
+    const int line_holder = __LINE__ + 2;
+    std::thread holder([&] {
+        LOCK(profiled_mutex);
+        locked = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    });
+    while (!locked) std::this_thread::yield();
+    const int line_waiter = __LINE__ + 1;
+    { LOCK(profiled_mutex); }
+    holder.join();
+    const int line_try = __LINE__ + 1;
+    { TRY_LOCK(profiled_mutex, lock_acquired); BOOST_CHECK(static_cast<bool>(lock_acquired)); }
+    g_lock_profiling = prev;
+
+    const std::vector<LockProfileStats> sites = GetLockProfile();
+    const LockProfileStats* holder_site = FindLockSite(sites, "profiled_mutex", line_holder);
+    const LockProfileStats* waiter_site = FindLockSite(sites, "profiled_mutex", line_waiter);
+    const LockProfileStats* try_site = FindLockSite(sites, "profiled_mutex", line_try);
+    BOOST_REQUIRE(holder_site && waiter_site && try_site);
+    BOOST_CHECK(!FindLockSite(sites, "profiled_mutex", line_off));
+
+    BOOST_CHECK_EQUAL(holder_site->file, __FILE__);
+    BOOST_CHECK_EQUAL(holder_site->hold.count, 1U);
+    BOOST_CHECK_GE(holder_site->hold.total, 20000);
+    BOOST_CHECK_EQUAL(holder_site->wait.count, 0U);
+
+    BOOST_CHECK_EQUAL(waiter_site->hold.count, 1U);
+    BOOST_CHECK_EQUAL(waiter_site->wait.count, 1U);
+    BOOST_CHECK_GT(waiter_site->wait.total, 0);
+    BOOST_CHECK_EQUAL(waiter_site->thread_wait.size(), 1U);
+    BOOST_CHECK_EQUAL(waiter_site->thread_wait.begin()->second, waiter_site->wait.total);
+
+    BOOST_CHECK_EQUAL(try_site->hold.count, 1U);
+    BOOST_CHECK_EQUAL(try_site->wait.count, 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
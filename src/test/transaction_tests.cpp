@@ -12,9 +12,11 @@
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <key.h>
+#include <node/psbt.h>
 #include <validation.h>
 #include <policy/policy.h>
 #include <policy/settings.h>
+#include <psbt.h>
 #include <script/script.h>
 #include <script/sign.h>
 #include <script/signingprovider.h>
@@ -281,6 +283,39 @@ BOOST_AUTO_TEST_CASE(basic_transaction_tests)
     BOOST_CHECK_MESSAGE(!CheckTransaction(CTransaction(tx), state) || !state.IsValid(), "Transaction with duplicate txins should be invalid.");
 }
 
+BOOST_AUTO_TEST_CASE(cached_sizes)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(2);
+    mtx.vin[0].scriptSig = CScript() << OP_1 << std::vector<unsigned char>(100, 0x42);
+    mtx.vout.resize(3);
+    mtx.vout[1].scriptPubKey = CScript() << OP_RETURN << std::vector<unsigned char>(40, 0x17);
+    for (bool witness : {false, true}) {
+        if (witness) mtx.vin[1].scriptWitness.stack = {std::vector<unsigned char>(300, 1), {}};
+        const CTransaction tx(mtx);
+        const size_t total = GetSerializeSize(mtx, PROTOCOL_VERSION);
+        const size_t stripped = GetSerializeSize(mtx, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+        BOOST_CHECK_EQUAL(witness, total != stripped);
+        BOOST_CHECK_EQUAL(tx.GetTotalSize(), total);
+        BOOST_CHECK_EQUAL(tx.GetStrippedSize(), stripped);
+        BOOST_CHECK_EQUAL(GetSerializeSize(tx, PROTOCOL_VERSION), total);
+        BOOST_CHECK_EQUAL(GetSerializeSize(tx, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS), stripped);
+        BOOST_CHECK_EQUAL(GetTransactionWeight(tx), int64_t(stripped * (WITNESS_SCALE_FACTOR - 1) + total));
+
+        // Block sizes use the cached transaction sizes.
+        CBlock block;
+        block.vtx.push_back(MakeTransactionRef(mtx));
+        block.vtx.push_back(MakeTransactionRef(CMutableTransaction()));
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+        BOOST_CHECK_EQUAL(GetSerializeSize(block, PROTOCOL_VERSION), ss.size());
+        CDataStream ss_stripped(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+        ss_stripped << block;
+        BOOST_CHECK_EQUAL(GetSerializeSize(block, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS), ss_stripped.size());
+    }
+    BOOST_CHECK_EQUAL(CTransaction().GetTotalSize(), GetSerializeSize(CMutableTransaction(), PROTOCOL_VERSION));
+}
+
 BOOST_AUTO_TEST_CASE(test_Get)
 {
     FillableSigningProvider keystore;
@@ -458,6 +493,139 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction)
     threadGroup.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_parallel_sign_transaction)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    FillableSigningProvider keystore;
+    BOOST_CHECK(keystore.AddKeyPubKey(key, key.GetPubKey()));
+    const CKeyID hash = key.GetPubKey().GetID();
+    const CScript witness_script = CScript() << OP_0 << std::vector<unsigned char>(hash.begin(), hash.end());
+    const CScript legacy_script = GetScriptForDestination(PKHash(key.GetPubKey()));
+
+    // A transaction spending 100 witness and legacy outputs of which one is unknown
+    CMutableTransaction mtx;
+    std::map<COutPoint, Coin> coins;
+    uint256 prevId;
+    prevId.SetHex("0000000000000000000000000000000000000000000000000000000000000100");
+    for (uint32_t i = 0; i < 100; i++) {
+        mtx.vin.emplace_back(COutPoint(prevId, i));
+        if (i == 50) continue;
+        coins[mtx.vin.back().prevout] = Coin(CTxOut(1000, i % 2 ? witness_script : legacy_script), 1, false);
+    }
+    mtx.vout.emplace_back(99000, CScript() << OP_1);
+
+    std::map<int, std::string> input_errors;
+    CMutableTransaction sequential = mtx;
+    BOOST_CHECK(!SignTransaction(sequential, &keystore, coins, SIGHASH_ALL, input_errors));
+    BOOST_CHECK_EQUAL(input_errors.size(), 1U);
+    BOOST_CHECK_EQUAL(input_errors.count(50), 1U);
+
+    // Signing on the input signing threads gives the same, deterministic, signatures
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 4; i++) {
+        threadGroup.create_thread([i]() { return ThreadSignInputs(i); });
+    }
+    g_parallel_signing = true;
+    input_errors.clear();
+    CMutableTransaction parallel = mtx;
+    BOOST_CHECK(!SignTransaction(parallel, &keystore, coins, SIGHASH_ALL, input_errors));
+    g_parallel_signing = false;
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    BOOST_CHECK_EQUAL(input_errors.size(), 1U);
+    BOOST_CHECK_EQUAL(input_errors.count(50), 1U);
+    BOOST_CHECK(CTransaction(parallel) == CTransaction(sequential));
+    BOOST_CHECK(CTransaction(parallel).GetWitnessHash() == CTransaction(sequential).GetWitnessHash());
+    const CTransaction tx(parallel);
+    for (uint32_t i = 0; i < tx.vin.size(); i++) {
+        if (i == 50) continue;
+        const CTxOut& prevout = coins.at(tx.vin[i].prevout).out;
+        BOOST_CHECK(VerifyScript(tx.vin[i].scriptSig, prevout.scriptPubKey, &tx.vin[i].scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, i, prevout.nValue)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_parallel_psbt)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    FillableSigningProvider keystore;
+    BOOST_CHECK(keystore.AddKeyPubKey(key, key.GetPubKey()));
+    const CScript script = GetScriptForDestination(WitnessV0KeyHash(key.GetPubKey().GetID()));
+
+    // A PSBT spending 20 outputs, signed by three signers taking every third input, none signing input 7
+    CMutableTransaction mtx;
+    uint256 prevId;
+    prevId.SetHex("0000000000000000000000000000000000000000000000000000000000000100");
+    for (uint32_t i = 0; i < 20; i++) {
+        mtx.vin.emplace_back(COutPoint(prevId, i));
+    }
+    mtx.vout.emplace_back(19000, CScript() << OP_1);
+    PartiallySignedTransaction psbtx(mtx);
+    for (PSBTInput& input : psbtx.inputs) {
+        input.witness_utxo = CTxOut(1000, script);
+    }
+    psbtx.inputs[7].hd_keypaths.emplace(key.GetPubKey(), KeyOriginInfo());
+    std::vector<PartiallySignedTransaction> parts(3, psbtx);
+    for (uint32_t i = 0; i < 20; i++) {
+        if (i != 7) BOOST_CHECK(SignPSBTInput(keystore, parts[i % 3], i));
+    }
+
+    const auto process = [&](PartiallySignedTransaction& combined, PSBTAnalysis& analysis) {
+        BOOST_CHECK(CombinePSBTs(combined, parts) == TransactionError::OK);
+        analysis = AnalyzePSBT(combined);
+        BOOST_CHECK(!FinalizePSBT(combined));
+    };
+    PartiallySignedTransaction sequential;
+    PSBTAnalysis sequential_analysis;
+    process(sequential, sequential_analysis);
+
+    // Combining, analyzing and finalizing on the input signing threads gives the same result
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 4; i++) {
+        threadGroup.create_thread([i]() { return ThreadSignInputs(i); });
+    }
+    g_parallel_signing = true;
+    PartiallySignedTransaction parallel;
+    PSBTAnalysis parallel_analysis;
+    process(parallel, parallel_analysis);
+    g_parallel_signing = false;
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    for (const PSBTAnalysis& analysis : {sequential_analysis, parallel_analysis}) {
+        BOOST_CHECK(analysis.next == PSBTRole::SIGNER);
+        BOOST_CHECK_EQUAL(analysis.inputs.size(), 20U);
+        for (uint32_t i = 0; i < 20; i++) {
+            BOOST_CHECK(analysis.inputs[i].is_final == (i != 7));
+        }
+        BOOST_CHECK(analysis.inputs[7].next == PSBTRole::SIGNER);
+        BOOST_CHECK_EQUAL(analysis.inputs[7].missing_sigs.size(), 1U);
+        BOOST_CHECK_EQUAL(*analysis.fee, 1000);
+    }
+    BOOST_CHECK(parallel_analysis.estimated_vsize && parallel_analysis.estimated_vsize == sequential_analysis.estimated_vsize);
+    CDataStream ss_parallel(SER_NETWORK, PROTOCOL_VERSION), ss_sequential(SER_NETWORK, PROTOCOL_VERSION);
+    ss_parallel << parallel;
+    ss_sequential << sequential;
+    BOOST_CHECK(ss_parallel.str() == ss_sequential.str());
+
+    // Once the last input is signed the combined PSBT is final
+    BOOST_CHECK(SignPSBTInput(keystore, parallel, 7));
+    CMutableTransaction result;
+    BOOST_CHECK(FinalizeAndExtractPSBT(parallel, result));
+    const CTransaction tx(result);
+    for (uint32_t i = 0; i < tx.vin.size(); i++) {
+        BOOST_CHECK(VerifyScript(tx.vin[i].scriptSig, script, &tx.vin[i].scriptWitness, STANDARD_SCRIPT_VERIFY_FLAGS, TransactionSignatureChecker(&tx, i, 1000)));
+    }
+
+    // PSBTs of other transactions are not combined
+    mtx.vout[0].nValue = 18000;
+    parts.emplace_back(mtx);
+    PartiallySignedTransaction mismatched;
+    BOOST_CHECK(CombinePSBTs(mismatched, parts) == TransactionError::PSBT_MISMATCH);
+}
+
 SignatureData CombineSignatures(const CMutableTransaction& input1, const CMutableTransaction& input2, const CTransactionRef tx)
 {
     SignatureData sigdata;
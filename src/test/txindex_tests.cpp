@@ -4,9 +4,11 @@
 
 #include <chainparams.h>
 #include <index/txindex.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
 #include <test/util/setup_common.h>
 #include <util/time.h>
+#include <validation.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -67,6 +69,15 @@ BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup)
         }
     }
 
+    // The txids of every block are kept to build merkle proofs from.
+    for (const CBlockIndex* pindex = WITH_LOCK(cs_main, return ::ChainActive().Tip()); pindex; pindex = pindex->pprev) {
+        const auto levels = txindex.GetMerkleTreeLevels(pindex->GetBlockHash());
+        BOOST_REQUIRE(levels);
+        BOOST_CHECK_EQUAL(levels->front().size(), 1U);
+        BOOST_CHECK(levels->back().front() == pindex->hashMerkleRoot);
+    }
+    BOOST_CHECK(!txindex.GetMerkleTreeLevels(InsecureRand256()));
+
     // shutdown sequence (c.f. Shutdown() in init.cpp)
     txindex.Stop();
 
@@ -78,4 +89,111 @@ BOOST_FIXTURE_TEST_CASE(txindex_initial_sync, TestChain100Setup)
     // Rest of shutdown sequence and destructors happen in ~TestingSetup()
 }
 
+BOOST_FIXTURE_TEST_CASE(txindex_sync_threads, TestChain100Setup)
+{
+    // The initial sync gives the same index whether blocks are prepared in
+    // this thread or by several threads ahead of it.
+    for (int sync_threads : {0, 1, 3}) {
+        g_index_sync_threads = sync_threads;
+        TxIndex txindex(1 << 20, true);
+        txindex.Start();
+
+        constexpr int64_t timeout_ms = 10 * 1000;
+        int64_t time_start = GetTimeMillis();
+        while (!txindex.BlockUntilSyncedToCurrentChain()) {
+            BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+            UninterruptibleSleep(std::chrono::milliseconds{100});
+        }
+
+        CTransactionRef tx_disk;
+        uint256 block_hash;
+        for (const auto& txn : m_coinbase_txns) {
+            BOOST_CHECK(txindex.FindTx(txn->GetHash(), block_hash, tx_disk));
+        }
+        txindex.Stop();
+    }
+    g_index_sync_threads = DEFAULT_INDEX_SYNC_THREADS;
+
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_FIXTURE_TEST_CASE(txindex_find_txs, TestChain100Setup)
+{
+    TxIndex txindex(1 << 20, true);
+    txindex.Start();
+
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!txindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    // Mine a block with several transactions, so that some lookups share a block.
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    // Only the first coinbase is mature, so the other transactions spend the first one.
+    std::vector<CMutableTransaction> spends(3);
+    for (size_t i = 0; i < spends.size(); ++i) {
+        CMutableTransaction& spend = spends[i];
+        spend.nVersion = 1;
+        spend.vin.resize(1);
+        spend.vin[0].prevout = i == 0 ? COutPoint(m_coinbase_txns[0]->GetHash(), 0) : COutPoint(spends[0].GetHash(), i - 1);
+        spend.vout.resize(i == 0 ? 2 : 1);
+        for (CTxOut& out : spend.vout) {
+            out.nValue = 11 * CENT;
+            out.scriptPubKey = coinbase_script;
+        }
+        std::vector<unsigned char> sig;
+        uint256 sighash = SignatureHash(coinbase_script, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(sighash, sig));
+        sig.push_back((unsigned char)SIGHASH_ALL);
+        spend.vin[0].scriptSig << sig;
+    }
+    const CBlock block = CreateAndProcessBlock(spends, GetScriptForDestination(PKHash(coinbaseKey.GetPubKey())));
+    BOOST_REQUIRE_EQUAL(block.vtx.size(), spends.size() + 1);
+    BOOST_CHECK(txindex.BlockUntilSyncedToCurrentChain());
+
+    // Ask for transactions out of disk order, with a duplicate and unknown hashes.
+    std::vector<uint256> hashes;
+    for (const auto& txn : block.vtx) hashes.push_back(txn->GetHash());
+    for (auto it = m_coinbase_txns.rbegin(); it != m_coinbase_txns.rend(); ++it) hashes.push_back((*it)->GetHash());
+    hashes.push_back(block.vtx[2]->GetHash());
+    hashes.push_back(InsecureRand256());
+    hashes.push_back(Params().GenesisBlock().vtx[0]->GetHash());
+    std::swap(hashes[1], hashes[3]);
+
+    std::vector<uint256> block_hashes;
+    std::vector<CTransactionRef> txs;
+    BOOST_CHECK(txindex.FindTxs(hashes, block_hashes, txs));
+    BOOST_REQUIRE_EQUAL(txs.size(), hashes.size());
+    BOOST_REQUIRE_EQUAL(block_hashes.size(), hashes.size());
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        CTransactionRef tx_disk;
+        uint256 block_hash;
+        if (!txindex.FindTx(hashes[i], block_hash, tx_disk)) {
+            BOOST_CHECK(!txs[i]);
+            BOOST_CHECK(block_hashes[i].IsNull());
+        } else {
+            BOOST_REQUIRE(txs[i]);
+            BOOST_CHECK(txs[i]->GetHash() == hashes[i]);
+            BOOST_CHECK(block_hashes[i] == block_hash);
+        }
+    }
+    BOOST_CHECK(block_hashes[0] == block.GetHash());
+    BOOST_CHECK(!txs[hashes.size() - 2]);
+    BOOST_CHECK(!txs[hashes.size() - 1]);
+
+    // An empty request finds nothing.
+    BOOST_CHECK(txindex.FindTxs({}, block_hashes, txs));
+    BOOST_CHECK(txs.empty());
+
+    txindex.Stop();
+
+    m_node.scheduler->stop();
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,86 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txinvorder.h>
+
+#include <test/util/setup_common.h>
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txinvorder_tests, BasicTestingSetup)
+
+static CTransactionRef MakeTx(const COutPoint& prevout)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(prevout);
+    tx.vout.emplace_back(COIN, CScript() << OP_TRUE);
+    return MakeTransactionRef(tx);
+}
+
+BOOST_AUTO_TEST_CASE(announcement_order)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    // Three unrelated transactions, and a high fee child of the first one.
+    const CTransactionRef a = MakeTx(COutPoint(InsecureRand256(), 0));
+    const CTransactionRef b = MakeTx(COutPoint(a->GetHash(), 0));
+    const CTransactionRef c = MakeTx(COutPoint(InsecureRand256(), 0));
+    const CTransactionRef d = MakeTx(COutPoint(InsecureRand256(), 0));
+    {
+        LOCK2(cs_main, pool.cs);
+        pool.addUnchecked(entry.Fee(1000).FromTx(a));
+        pool.addUnchecked(entry.Fee(100000).FromTx(b));
+        pool.addUnchecked(entry.Fee(2000).FromTx(c));
+        pool.addUnchecked(entry.Fee(500).FromTx(d));
+    }
+
+    TxInvOrder order(pool, std::chrono::seconds{5});
+    const std::set<uint256> txids{a->GetHash(), b->GetHash(), c->GetHash(), d->GetHash()};
+    std::vector<TxInvOrder::Entry> entries;
+    std::vector<uint256> missing;
+    order.GetEntries(txids, std::chrono::seconds{100}, entries, missing);
+    BOOST_CHECK(missing.empty());
+    BOOST_REQUIRE_EQUAL(entries.size(), 4U);
+    BOOST_CHECK_EQUAL(order.Size(), 4U);
+
+    // The cached keys order the same way as the mempool does.
+    for (const auto& x : entries) {
+        for (const auto& y : entries) {
+            BOOST_CHECK_EQUAL(TxInvOrder::Before(x, y), pool.CompareDepthAndScore(x.txid, y.txid));
+        }
+    }
+    std::sort(entries.begin(), entries.end(), TxInvOrder::Before);
+    BOOST_CHECK(entries[0].txid == c->GetHash());
+    BOOST_CHECK(entries[1].txid == a->GetHash());
+    BOOST_CHECK(entries[2].txid == d->GetHash());
+    BOOST_CHECK(entries[3].txid == b->GetHash());
+    BOOST_CHECK_EQUAL(entries[3].ancestors, 2U);
+
+    // Cached entries are used until the interval ends, also after leaving the mempool.
+    {
+        LOCK(pool.cs);
+        pool.removeRecursive(*c, MemPoolRemovalReason::REPLACED);
+    }
+    const uint256 unknown = InsecureRand256();
+    entries.clear();
+    order.GetEntries({c->GetHash(), unknown}, std::chrono::seconds{104}, entries, missing);
+    BOOST_REQUIRE_EQUAL(entries.size(), 1U);
+    BOOST_CHECK(entries[0].txid == c->GetHash());
+    BOOST_REQUIRE_EQUAL(missing.size(), 1U);
+    BOOST_CHECK(missing[0] == unknown);
+
+    // After it, everything is read from the mempool again.
+    entries.clear();
+    missing.clear();
+    order.GetEntries({a->GetHash(), c->GetHash()}, std::chrono::seconds{105}, entries, missing);
+    BOOST_REQUIRE_EQUAL(entries.size(), 1U);
+    BOOST_CHECK(entries[0].txid == a->GetHash());
+    BOOST_REQUIRE_EQUAL(missing.size(), 1U);
+    BOOST_CHECK(missing[0] == c->GetHash());
+    BOOST_CHECK_EQUAL(order.Size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
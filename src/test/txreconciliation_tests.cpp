@@ -0,0 +1,149 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <streams.h>
+#include <test/util/setup_common.h>
+
+#include <algorithm>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sketch_decode)
+{
+    // Two sets sharing most of their ids, with 30 ids only in the first and 20 only in the second.
+    std::set<uint64_t> only_a, only_b;
+    ReconSketch a(ReconSketchCells(1050, 1020)), b(a.size());
+    BOOST_CHECK_EQUAL(a.size() % 4, 0U);
+    for (int i = 0; i < 1000; ++i) {
+        const uint64_t id = InsecureRandBits(64);
+        a.Add(id);
+        b.Add(id);
+    }
+    for (int i = 0; i < 30; ++i) {
+        const uint64_t id = InsecureRandBits(64);
+        only_a.insert(id);
+        a.Add(id);
+    }
+    for (int i = 0; i < 20; ++i) {
+        const uint64_t id = InsecureRandBits(64);
+        only_b.insert(id);
+        b.Add(id);
+    }
+
+    // Sketches survive serialization.
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << a;
+    ReconSketch difference;
+    ss >> difference;
+    BOOST_CHECK_EQUAL(difference.size(), a.size());
+
+    BOOST_REQUIRE(difference.Subtract(b));
+    std::vector<uint64_t> positive, negative;
+    BOOST_REQUIRE(difference.Decode(positive, negative));
+    BOOST_CHECK(std::set<uint64_t>(positive.begin(), positive.end()) == only_a);
+    BOOST_CHECK(std::set<uint64_t>(negative.begin(), negative.end()) == only_b);
+
+    // Sketches of different sizes can't be compared, and far too small ones don't decode.
+    BOOST_CHECK(!difference.Subtract(ReconSketch(a.size() + 4)));
+    ReconSketch small(24);
+    for (int i = 0; i < 100; ++i) small.Add(InsecureRandBits(64));
+    positive.clear();
+    negative.clear();
+    BOOST_CHECK(!small.Decode(positive, negative));
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_round)
+{
+    // Node A connected out to node B, which sees A as inbound.
+    TxReconciliationTracker tracker_a, tracker_b;
+    const NodeId peer_b = 0, peer_a = 1;
+    const uint64_t salt_a = tracker_a.PreRegisterPeer(peer_b);
+    const uint64_t salt_b = tracker_b.PreRegisterPeer(peer_a);
+    // The first outbound peers are flooded to, so use up those slots first.
+    for (NodeId id = 10; id < 10 + (NodeId)MAX_OUTBOUND_FLOOD_TO; ++id) {
+        tracker_a.PreRegisterPeer(id);
+        BOOST_CHECK(tracker_a.RegisterPeer(id, /* is_peer_inbound */ false, TXRECONCILIATION_VERSION, 1) == ReconciliationRegisterResult::SUCCESS);
+        BOOST_CHECK(!tracker_a.AddToSet(id, InsecureRand256()));
+    }
+    BOOST_CHECK(tracker_a.RegisterPeer(peer_b, /* is_peer_inbound */ false, TXRECONCILIATION_VERSION, salt_b) == ReconciliationRegisterResult::SUCCESS);
+    BOOST_CHECK(tracker_b.RegisterPeer(peer_a, /* is_peer_inbound */ true, TXRECONCILIATION_VERSION, salt_a) == ReconciliationRegisterResult::SUCCESS);
+    BOOST_CHECK(tracker_a.RegisterPeer(peer_b, false, TXRECONCILIATION_VERSION, salt_b) == ReconciliationRegisterResult::ALREADY_REGISTERED);
+    BOOST_CHECK(tracker_a.RegisterPeer(99, false, TXRECONCILIATION_VERSION, salt_b) == ReconciliationRegisterResult::NOT_FOUND);
+
+    std::vector<uint256> common, only_a, only_b;
+    for (int i = 0; i < 50; ++i) common.push_back(InsecureRand256());
+    for (int i = 0; i < 5; ++i) only_a.push_back(InsecureRand256());
+    for (int i = 0; i < 8; ++i) only_b.push_back(InsecureRand256());
+    for (const uint256& txid : common) {
+        BOOST_CHECK(tracker_a.AddToSet(peer_b, txid));
+        BOOST_CHECK(tracker_b.AddToSet(peer_a, txid));
+    }
+    for (const uint256& txid : only_a) BOOST_CHECK(tracker_a.AddToSet(peer_b, txid));
+    for (const uint256& txid : only_b) BOOST_CHECK(tracker_b.AddToSet(peer_a, txid));
+
+    // Only the outbound side asks, and not right after connecting.
+    uint32_t set_size;
+    std::chrono::microseconds now{GetTime<std::chrono::microseconds>()};
+    BOOST_CHECK(!tracker_b.InitiateReconciliationRequest(peer_a, now, set_size));
+    BOOST_CHECK(!tracker_a.InitiateReconciliationRequest(peer_b, now, set_size));
+    now += std::chrono::hours{1};
+    BOOST_REQUIRE(tracker_a.InitiateReconciliationRequest(peer_b, now, set_size));
+    BOOST_CHECK_EQUAL(set_size, common.size() + only_a.size());
+    BOOST_CHECK(!tracker_a.InitiateReconciliationRequest(peer_b, now + std::chrono::hours{1}, set_size));
+
+    ReconSketch sketch;
+    BOOST_CHECK(!tracker_a.HandleReconciliationRequest(peer_b, set_size, sketch));
+    BOOST_REQUIRE(tracker_b.HandleReconciliationRequest(peer_a, set_size, sketch));
+    BOOST_CHECK(!tracker_b.HandleReconciliationRequest(peer_a, set_size, sketch));
+
+    bool success;
+    std::vector<uint64_t> ask;
+    std::vector<uint256> announce_a;
+    BOOST_REQUIRE(tracker_a.HandleSketch(peer_b, sketch, success, ask, announce_a));
+    BOOST_CHECK(!tracker_a.HandleSketch(peer_b, sketch, success, ask, announce_a));
+    std::vector<uint256> announce_b;
+    BOOST_REQUIRE(tracker_b.HandleReconciliationDifference(peer_a, success, ask, announce_b));
+    BOOST_CHECK(!tracker_b.HandleReconciliationDifference(peer_a, success, ask, announce_b));
+
+    // Each side announces what the other lacks; in the rare case that the
+    // difference does not decode, that is its whole set.
+    std::set<uint256> expected_a(only_a.begin(), only_a.end()), expected_b(only_b.begin(), only_b.end());
+    if (success) {
+        BOOST_CHECK_EQUAL(ask.size(), only_b.size());
+    } else {
+        expected_a.insert(common.begin(), common.end());
+        expected_b.insert(common.begin(), common.end());
+    }
+    BOOST_CHECK(std::set<uint256>(announce_a.begin(), announce_a.end()) == expected_a);
+    BOOST_CHECK(std::set<uint256>(announce_b.begin(), announce_b.end()) == expected_b);
+
+    // An empty responder set gets an empty sketch, and the requester announces everything.
+    BOOST_CHECK(tracker_a.AddToSet(peer_b, only_a[0]));
+    now += std::chrono::hours{1};
+    BOOST_REQUIRE(tracker_a.InitiateReconciliationRequest(peer_b, now, set_size));
+    BOOST_REQUIRE(tracker_b.HandleReconciliationRequest(peer_a, set_size, sketch));
+    BOOST_CHECK_EQUAL(sketch.size(), 0U);
+    announce_a.clear();
+    BOOST_REQUIRE(tracker_a.HandleSketch(peer_b, sketch, success, ask, announce_a));
+    BOOST_CHECK(success);
+    BOOST_CHECK(ask.empty());
+    BOOST_CHECK(announce_a == std::vector<uint256>{only_a[0]});
+    announce_b.clear();
+    BOOST_REQUIRE(tracker_b.HandleReconciliationDifference(peer_a, success, ask, announce_b));
+    BOOST_CHECK(announce_b.empty());
+
+    // Forgotten peers free their flood slot for the next outbound peer.
+    tracker_a.ForgetPeer(10);
+    BOOST_CHECK(!tracker_a.IsPeerRegistered(10));
+    tracker_a.PreRegisterPeer(20);
+    BOOST_CHECK(tracker_a.RegisterPeer(20, false, TXRECONCILIATION_VERSION, 1) == ReconciliationRegisterResult::SUCCESS);
+    BOOST_CHECK(!tracker_a.AddToSet(20, InsecureRand256()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
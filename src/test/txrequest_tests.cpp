@@ -0,0 +1,95 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txrequest.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+using std::chrono::seconds;
+
+BOOST_FIXTURE_TEST_SUITE(txrequest_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(request_and_response)
+{
+    TxRequestTracker tracker(seconds{60}, seconds{600});
+    const std::chrono::microseconds now{seconds{1000}};
+    const uint256 tx1 = InsecureRand256(), tx2 = InsecureRand256(), tx3 = InsecureRand256();
+
+    BOOST_CHECK(tracker.ReceivedInv(0, tx1, now));
+    BOOST_CHECK(!tracker.ReceivedInv(0, tx1, now));
+    BOOST_CHECK(tracker.ReceivedInv(0, tx2, now + seconds{1}));
+    BOOST_CHECK(tracker.ReceivedInv(0, tx3, now + seconds{2}));
+    BOOST_CHECK_EQUAL(tracker.Count(0), 3U);
+
+    // Only due announcements are returned, oldest first, up to the in-flight limit.
+    BOOST_CHECK(tracker.GetRequestable(0, now - seconds{1}, 10, seconds{0}).empty());
+    BOOST_CHECK(tracker.GetRequestable(0, now + seconds{2}, 2, seconds{0}) == std::vector<uint256>({tx1, tx2}));
+    tracker.RequestedTx(0, tx1, now + seconds{2});
+    tracker.RequestedTx(0, tx2, now + seconds{2});
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(0), 2U);
+    BOOST_CHECK(tracker.GetRequestable(0, now + seconds{2}, 2, seconds{0}).empty());
+    BOOST_CHECK(tracker.GetRequestTime(tx1) == now + seconds{2});
+    BOOST_CHECK(tracker.GetRequestTime(tx3) == seconds{0});
+
+    // A response frees an in-flight slot.
+    tracker.ReceivedResponse(0, tx1);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(0), 1U);
+    BOOST_CHECK(tracker.GetRequestTime(tx1) == seconds{0});
+    BOOST_CHECK(tracker.GetRequestable(0, now + seconds{2}, 2, seconds{0}) == std::vector<uint256>({tx3}));
+
+    // Unanswered requests expire.
+    std::vector<uint256> expired;
+    BOOST_CHECK(tracker.GetRequestable(0, now + seconds{601}, 2, seconds{0}, &expired) == std::vector<uint256>({tx3}));
+    BOOST_CHECK(expired.empty());
+    expired.clear();
+    tracker.GetRequestable(0, now + seconds{602}, 2, seconds{0}, &expired);
+    BOOST_CHECK(expired == std::vector<uint256>({tx2}));
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(0), 0U);
+    BOOST_CHECK_EQUAL(tracker.Count(0), 1U);
+
+    tracker.DisconnectedPeer(0);
+    BOOST_CHECK_EQUAL(tracker.Count(0), 0U);
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(coordinate_peers)
+{
+    TxRequestTracker tracker(seconds{60}, seconds{600});
+    const std::chrono::microseconds now{seconds{1000}};
+    const uint256 txid = InsecureRand256();
+
+    for (NodeId peer = 0; peer < 125; ++peer) {
+        BOOST_CHECK(tracker.ReceivedInv(peer, txid, now));
+    }
+    BOOST_CHECK(tracker.GetRequestable(0, now, 100, seconds{0}) == std::vector<uint256>({txid}));
+    tracker.RequestedTx(0, txid, now);
+
+    // The other peers wait until the request could have timed out, plus the given delay.
+    BOOST_CHECK(tracker.GetRequestable(1, now + seconds{10}, 100, seconds{2}).empty());
+    BOOST_CHECK(tracker.GetRequestable(1, now + seconds{61}, 100, seconds{0}).empty());
+    BOOST_CHECK(tracker.GetRequestable(1, now + seconds{62}, 100, seconds{0}) == std::vector<uint256>({txid}));
+    BOOST_CHECK(tracker.GetRequestable(2, now + seconds{60}, 100, seconds{0}) == std::vector<uint256>({txid}));
+    tracker.RequestedTx(2, txid, now + seconds{60});
+    BOOST_CHECK(tracker.GetRequestTime(txid) == now + seconds{60});
+    BOOST_CHECK(tracker.GetRequestable(3, now + seconds{60}, 100, seconds{0}).empty());
+
+    // Once we have the transaction, no peer is asked for it anymore.
+    tracker.ForgetTxHash(txid);
+    BOOST_CHECK_EQUAL(tracker.Size(), 0U);
+    BOOST_CHECK_EQUAL(tracker.CountInFlight(0), 0U);
+    BOOST_CHECK(tracker.GetRequestable(4, now + seconds{1000}, 100, seconds{0}).empty());
+
+    // Disconnecting a peer only drops its own announcements.
+    BOOST_CHECK(tracker.ReceivedInv(0, txid, now));
+    BOOST_CHECK(tracker.ReceivedInv(1, txid, now));
+    tracker.RequestedTx(0, txid, now);
+    tracker.DisconnectedPeer(0);
+    BOOST_CHECK(tracker.GetRequestTime(txid) == seconds{0});
+    BOOST_CHECK(tracker.GetRequestable(1, now, 100, seconds{0}) == std::vector<uint256>({txid}));
+    BOOST_CHECK_EQUAL(tracker.Size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,147 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <udprelay.h>
+
+#include <chainparams.h>
+#include <netbase.h>
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(udprelay_tests, BasicTestingSetup)
+
+static Span<const unsigned char> AsSpan(const std::vector<unsigned char>& v)
+{
+    return Span<const unsigned char>(v.data(), v.size());
+}
+
+static std::vector<unsigned char> RandomPayload(size_t size)
+{
+    std::vector<unsigned char> payload(size);
+    for (auto& b : payload) b = InsecureRandBits(8);
+    return payload;
+}
+
+BOOST_AUTO_TEST_CASE(fec_round_trip)
+{
+    const size_t chunk_size = 64;
+    const std::vector<unsigned char> payload = RandomPayload(chunk_size * 10 + 17);
+    const auto chunks = FecEncode(AsSpan(payload), chunk_size);
+    // 11 data chunks, protected by three parity chunks.
+    BOOST_CHECK_EQUAL(chunks.size(), 14U);
+
+    // Everything received.
+    FecDecoder all(payload.size(), chunk_size);
+    for (size_t i = 0; i < chunks.size(); ++i) BOOST_CHECK(all.AddChunk(i, AsSpan(chunks[i])));
+    BOOST_REQUIRE(all.Complete());
+    BOOST_CHECK(all.GetPayload() == payload);
+
+    // One data chunk of every parity group lost, including the padded last one.
+    FecDecoder lossy(payload.size(), chunk_size);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        if (i == 0 || i == 8 || i == 10) continue;
+        BOOST_CHECK(!lossy.Complete());
+        BOOST_CHECK(lossy.AddChunk(i, AsSpan(chunks[i])));
+    }
+    BOOST_REQUIRE(lossy.Complete());
+    BOOST_CHECK(lossy.GetPayload() == payload);
+
+    // Two data chunks of the same group lost can't be repaired.
+    FecDecoder broken(payload.size(), chunk_size);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        if (i == 1 || i == 4) continue;
+        BOOST_CHECK(broken.AddChunk(i, AsSpan(chunks[i])));
+    }
+    BOOST_CHECK(!broken.Complete());
+
+    // Chunks that don't exist or have the wrong size are rejected.
+    BOOST_CHECK(!broken.AddChunk(chunks.size(), AsSpan(chunks[0])));
+    BOOST_CHECK(!broken.AddChunk(1, AsSpan(std::vector<unsigned char>(chunk_size - 1))));
+}
+
+BOOST_AUTO_TEST_CASE(packet_authentication)
+{
+    const auto& message_start = Params().MessageStart();
+    UdpRelayHeader header;
+    memcpy(header.message_start, message_start, CMessageHeader::MESSAGE_START_SIZE);
+    header.version = UDPRELAY_VERSION;
+    header.block_hash = InsecureRand256();
+    header.payload_size = 1000;
+    header.index = 3;
+    const std::vector<unsigned char> chunk = RandomPayload(UDPRELAY_CHUNK_SIZE);
+    std::vector<unsigned char> packet = MakeUdpRelayPacket(header, AsSpan(chunk), 1, 2);
+    BOOST_CHECK_EQUAL(packet.size(), MAX_UDPRELAY_PACKET_SIZE);
+
+    UdpRelayHeader parsed;
+    Span<const unsigned char> parsed_chunk;
+    BOOST_REQUIRE(ParseUdpRelayPacket(AsSpan(packet), message_start, 1, 2, parsed, parsed_chunk));
+    BOOST_CHECK(parsed.block_hash == header.block_hash);
+    BOOST_CHECK_EQUAL(parsed.payload_size, header.payload_size);
+    BOOST_CHECK_EQUAL(parsed.index, header.index);
+    BOOST_CHECK(std::vector<unsigned char>(parsed_chunk.begin(), parsed_chunk.end()) == chunk);
+
+    // The wrong key, a modified datagram or one for another network don't pass.
+    BOOST_CHECK(!ParseUdpRelayPacket(AsSpan(packet), message_start, 1, 3, parsed, parsed_chunk));
+    packet[UDPRELAY_HEADER_SIZE] ^= 1;
+    BOOST_CHECK(!ParseUdpRelayPacket(AsSpan(packet), message_start, 1, 2, parsed, parsed_chunk));
+    header.message_start[0] ^= 1;
+    BOOST_CHECK(!ParseUdpRelayPacket(AsSpan(MakeUdpRelayPacket(header, AsSpan(chunk), 1, 2)), message_start, 1, 2, parsed, parsed_chunk));
+}
+
+BOOST_AUTO_TEST_CASE(reassemble_from_peer)
+{
+    const auto& message_start = Params().MessageStart();
+    std::vector<std::pair<NodeId, std::vector<unsigned char>>> delivered;
+    UdpBlockRelay relay(message_start, [&](NodeId id, std::vector<unsigned char>&& payload) { delivered.emplace_back(id, std::move(payload)); });
+
+    const CService peer_addr = LookupNumeric("1.2.3.4", 9000);
+    const auto key = relay.PreRegisterPeer(7);
+    BOOST_CHECK(!relay.IsPeerRegistered(7));
+    BOOST_CHECK(relay.RegisterPeer(7, peer_addr, 11, 12));
+    BOOST_CHECK(!relay.RegisterPeer(7, peer_addr, 11, 12));
+    // A peer we did not offer the relay to.
+    BOOST_CHECK(!relay.RegisterPeer(8, peer_addr, 11, 12));
+
+    const std::vector<unsigned char> payload = RandomPayload(UDPRELAY_CHUNK_SIZE * 8 + 100);
+    const auto chunks = FecEncode(AsSpan(payload), UDPRELAY_CHUNK_SIZE);
+    UdpRelayHeader header;
+    memcpy(header.message_start, message_start, CMessageHeader::MESSAGE_START_SIZE);
+    header.version = UDPRELAY_VERSION;
+    header.block_hash = InsecureRand256();
+    header.payload_size = payload.size();
+
+    // Datagrams with the wrong key, or from another address, are ignored.
+    header.index = 0;
+    relay.ProcessPacket(peer_addr, AsSpan(MakeUdpRelayPacket(header, AsSpan(chunks[0]), 11, 12)));
+    relay.ProcessPacket(LookupNumeric("1.2.3.5", 9000), AsSpan(MakeUdpRelayPacket(header, AsSpan(chunks[0]), key.first, key.second)));
+
+    // The second data chunk is lost.
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        if (i == 1) continue;
+        header.index = i;
+        relay.ProcessPacket(peer_addr, AsSpan(MakeUdpRelayPacket(header, AsSpan(chunks[i]), key.first, key.second)));
+    }
+    BOOST_REQUIRE_EQUAL(delivered.size(), 1U);
+    BOOST_CHECK_EQUAL(delivered[0].first, 7);
+    BOOST_CHECK(delivered[0].second == payload);
+
+    // A completed block is not reassembled again.
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        header.index = i;
+        relay.ProcessPacket(peer_addr, AsSpan(MakeUdpRelayPacket(header, AsSpan(chunks[i]), key.first, key.second)));
+    }
+    BOOST_CHECK_EQUAL(delivered.size(), 1U);
+
+    // Nothing arrives from a peer that went away.
+    relay.ForgetPeer(7);
+    header.block_hash = InsecureRand256();
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        header.index = i;
+        relay.ProcessPacket(peer_addr, AsSpan(MakeUdpRelayPacket(header, AsSpan(chunks[i]), key.first, key.second)));
+    }
+    BOOST_CHECK_EQUAL(delivered.size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
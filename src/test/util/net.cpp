@@ -6,6 +6,7 @@
 
 #include <chainparams.h>
 #include <net.h>
+#include <random.h>
 
 void ConnmanTestMsg::NodeReceiveMsgBytes(CNode& node, const char* pch, unsigned int nBytes, bool& complete) const
 {
@@ -34,6 +35,17 @@ bool ConnmanTestMsg::ReceiveMsgFrom(CNode& node, CSerializedNetMsg& ser_msg) con
 
     bool complete;
     NodeReceiveMsgBytes(node, (const char*)ser_msg_header.data(), ser_msg_header.size(), complete);
-    NodeReceiveMsgBytes(node, (const char*)ser_msg.data.data(), ser_msg.data.size(), complete);
+    const Span<const unsigned char> payload = ser_msg.Payload();
+    NodeReceiveMsgBytes(node, (const char*)payload.data(), payload.size(), complete);
     return complete;
 }
+
+CNode* ConnmanTestMsg::AddInboundTestPeer(SOCKET socket, const CAddress& addr)
+{
+    const NodeId id = GetNewNodeId();
+    CNode* node = new CNode(id, nLocalServices, GetBestHeight(), socket, addr, CalculateKeyedNetGroup(addr), GetRand(std::numeric_limits<uint64_t>::max()), CAddress(), "", /* fInboundIn */ true);
+    node->AddRef();
+    m_msgproc->InitializeNode(node);
+    AddTestNode(*node);
+    return node;
+}
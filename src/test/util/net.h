@@ -23,6 +23,9 @@ struct ConnmanTestMsg : public CConnman {
         vNodes.clear();
     }
 
+    /** Add an inbound peer on a connected socket, as AcceptConnection does. The peer owns the socket. */
+    CNode* AddInboundTestPeer(SOCKET socket, const CAddress& addr);
+
     void ProcessMessagesOnce(CNode& node) { m_msgproc->ProcessMessages(&node, flagInterruptMsgProc); }
 
     void NodeReceiveMsgBytes(CNode& node, const char* pch, unsigned int nBytes, bool& complete) const;
@@ -9,7 +9,11 @@
 #include <consensus/consensus.h>
 #include <consensus/params.h>
 #include <consensus/validation.h>
+#include <crypto/chacha20.h>
+#include <crypto/ripemd160.h>
 #include <crypto/sha256.h>
+#include <crypto/sha512.h>
+#include <crypto/siphash.h>
 #include <init.h>
 #include <miner.h>
 #include <net.h>
@@ -76,6 +80,10 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName)
     InitLogging();
     LogInstance().StartLogging();
     SHA256AutoDetect();
+    SipHashAutoDetect();
+    RIPEMD160AutoDetect();
+    SHA512AutoDetect();
+    ChaCha20AutoDetect();
     ECC_Start();
     SetupEnvironment();
     SetupNetworking();
@@ -131,6 +139,8 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
     constexpr int script_check_threads = 2;
     for (int i = 0; i < script_check_threads; ++i) {
         threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
+        threadGroup.create_thread([i]() { return ThreadHeaderCheck(i); });
+        threadGroup.create_thread([i]() { return ThreadTxCheck(i); });
     }
     g_parallel_script_checks = true;
 
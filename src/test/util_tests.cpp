@@ -13,7 +13,9 @@
 #include <test/util/str.h>
 #include <uint256.h>
 #include <util/message.h> // For MessageSign(), MessageVerify(), MESSAGE_MAGIC
+#include <util/lz4.h>
 #include <util/moneystr.h>
+#include <util/perfstats.h>
 #include <util/strencodings.h>
 #include <util/string.h>
 #include <util/time.h>
@@ -89,6 +91,15 @@ BOOST_AUTO_TEST_CASE(util_ParseHex)
     // Stop parsing at invalid value
     result = ParseHex("1234 invalid 1234");
     BOOST_CHECK(result.size() == 2 && result[0] == 0x12 && result[1] == 0x34);
+
+    // Spaces and invalid values inside runs long enough for the vectorized path
+    result = ParseHex("0102030405060708090a0b0c0d0e0f10 1112131415161718191A1B1C1D1E1F20");
+    BOOST_CHECK_EQUAL(result.size(), 32U);
+    BOOST_CHECK(result[0] == 0x01 && result[15] == 0x10 && result[16] == 0x11 && result[25] == 0x1a && result[31] == 0x20);
+    result = ParseHex("0102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1fgg");
+    BOOST_CHECK_EQUAL(result.size(), 31U);
+    result = ParseHex(std::string("0102030405060708090a0b0c0d0e0f10\0" "1112131415161718191a1b1c1d1e1f", 63));
+    BOOST_CHECK_EQUAL(result.size(), 16U);
 }
 
 BOOST_AUTO_TEST_CASE(util_HexStr)
@@ -97,6 +108,10 @@ BOOST_AUTO_TEST_CASE(util_HexStr)
         HexStr(ParseHex_expected, ParseHex_expected + sizeof(ParseHex_expected)),
         "04678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5f");
 
+    const std::vector<unsigned char> expected_vec(ParseHex_expected, ParseHex_expected + sizeof(ParseHex_expected));
+    BOOST_CHECK_EQUAL(HexStr(expected_vec), HexStr(expected_vec.begin(), expected_vec.end()));
+    BOOST_CHECK_EQUAL(HexStr(expected_vec), HexStr(std::string(expected_vec.begin(), expected_vec.end())));
+
     BOOST_CHECK_EQUAL(
         HexStr(ParseHex_expected + sizeof(ParseHex_expected),
                ParseHex_expected + sizeof(ParseHex_expected)),
@@ -1250,6 +1265,10 @@ BOOST_AUTO_TEST_CASE(util_IsHex)
     BOOST_CHECK(!IsHex("eleven"));
     BOOST_CHECK(!IsHex("00xx00"));
     BOOST_CHECK(!IsHex("0x0000"));
+    BOOST_CHECK(IsHex("00112233445566778899aabbccddeeff00112233445566778899aabbccddeeff"));
+    BOOST_CHECK(!IsHex("00112233445566778899aabbccddeeff00112233445566778899aabbccddeef"));
+    BOOST_CHECK(!IsHex("00112233445566778899aabbccddeegf00112233445566778899aabbccddeeff"));
+    BOOST_CHECK(!IsHex("00112233445566778899aabbccddee\xff" "f00112233445566778899aabbccddeeff"));
 }
 
 BOOST_AUTO_TEST_CASE(util_IsHexNumber)
@@ -2161,4 +2180,83 @@ BOOST_AUTO_TEST_CASE(message_hash)
     BOOST_CHECK_NE(message_hash1, signature_hash);
 }
 
+BOOST_AUTO_TEST_CASE(lz4_roundtrip)
+{
+    std::vector<std::vector<uint8_t>> inputs;
+    inputs.emplace_back();
+    inputs.emplace_back(1, 0x42);
+    inputs.emplace_back(12, 0);
+    inputs.emplace_back(100000, 0xab);
+    std::vector<uint8_t> random(70000);
+    for (uint8_t& byte : random) byte = InsecureRandBits(8);
+    inputs.push_back(random);
+    // Repeats further apart than the largest offset, mixed with short ones
+    std::vector<uint8_t> mixed;
+    for (int i = 0; i < 4; ++i) {
+        mixed.insert(mixed.end(), random.begin(), random.end());
+        mixed.insert(mixed.end(), 300, i);
+    }
+    inputs.push_back(mixed);
+
+    for (const std::vector<uint8_t>& input : inputs) {
+        const std::vector<uint8_t> compressed = LZ4Compress(MakeSpan(input));
+        std::vector<uint8_t> output;
+        BOOST_CHECK(LZ4Decompress(MakeSpan(compressed), input.size(), output));
+        BOOST_CHECK(output == input);
+        // The size must match exactly
+        BOOST_CHECK(!LZ4Decompress(MakeSpan(compressed), input.size() + 1, output));
+        if (!input.empty()) BOOST_CHECK(!LZ4Decompress(MakeSpan(compressed), input.size() - 1, output));
+    }
+    BOOST_CHECK_LT(LZ4Compress(Span<const uint8_t>(inputs[3].data(), inputs[3].size())).size(), 1000U);
+
+    // Malformed input: truncated, or a match reaching before the start of the output
+    const std::vector<uint8_t> compressed = LZ4Compress(Span<const uint8_t>(mixed.data(), mixed.size()));
+    std::vector<uint8_t> output;
+    BOOST_CHECK(!LZ4Decompress(Span<const uint8_t>(compressed.data(), compressed.size() / 2), mixed.size(), output));
+    const std::vector<uint8_t> bad_offset{0x10, 0x61, 0x05, 0x00, 0x00};
+    BOOST_CHECK(!LZ4Decompress(MakeSpan(bad_offset), 10, output));
+}
+
+BOOST_AUTO_TEST_CASE(perfstats_histogram)
+{
+    perf::Histogram& histogram = perf::GetHistogram("test.util_tests");
+    BOOST_CHECK_EQUAL(&histogram, &perf::GetHistogram("test.util_tests"));
+
+    // Samples land in power-of-two buckets, negative ones count as zero.
+    for (int64_t micros : std::vector<int64_t>{-5, 0, 1, 2, 3, 4, 1000, 1000000000000}) histogram.Add(micros);
+    perf::HistogramStats stats = histogram.GetStats();
+    BOOST_CHECK_EQUAL(stats.count, 8U);
+    BOOST_CHECK_EQUAL(stats.total, 1 + 2 + 3 + 4 + 1000 + 1000000000000);
+    BOOST_CHECK_EQUAL(stats.max, 1000000000000);
+    BOOST_CHECK_EQUAL(stats.buckets[0], 2U);
+    BOOST_CHECK_EQUAL(stats.buckets[1], 1U);
+    BOOST_CHECK_EQUAL(stats.buckets[2], 2U);
+    BOOST_CHECK_EQUAL(stats.buckets[3], 1U);
+    BOOST_CHECK_EQUAL(stats.buckets[10], 1U);
+    BOOST_CHECK_EQUAL(stats.buckets[perf::Histogram::BUCKETS - 1], 1U);
+    BOOST_CHECK_EQUAL(stats.ApproxQuantile(0.5), 4);
+    BOOST_CHECK_EQUAL(stats.ApproxQuantile(0.8), 1024);
+    BOOST_CHECK_EQUAL(stats.ApproxQuantile(1), 1000000000000);
+
+    // Concurrent updates are all counted.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&histogram] {
+            for (int i = 0; i < 10000; ++i) {
+                PERF_TIME("test.util_tests.scoped");
+                histogram.Add(i % 100);
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    stats = histogram.GetStats();
+    BOOST_CHECK_EQUAL(stats.count, 8U + 40000U);
+    uint64_t bucket_sum = 0;
+    for (uint64_t count : stats.buckets) bucket_sum += count;
+    BOOST_CHECK_EQUAL(bucket_sum, stats.count);
+    const std::map<std::string, perf::HistogramStats> all = perf::GetAllStats();
+    BOOST_CHECK_EQUAL(all.at("test.util_tests").count, stats.count);
+    BOOST_CHECK_EQUAL(all.at("test.util_tests.scoped").count, 40000U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
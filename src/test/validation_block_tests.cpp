@@ -16,6 +16,7 @@
 #include <validation.h>
 #include <validationinterface.h>
 
+#include <atomic>
 #include <thread>
 
 static const std::vector<unsigned char> V_OP_TRUE{OP_TRUE};
@@ -214,6 +215,61 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
     BOOST_CHECK_EQUAL(sub->m_expected_tip, ::ChainActive().Tip()->GetBlockHash());
 }
 
+BOOST_AUTO_TEST_CASE(block_validation_thread)
+{
+    struct ProcessedSubscriber final : public CValidationInterface {
+        Mutex m_mutex;
+        std::condition_variable m_cv;
+        std::vector<uint256> m_processed GUARDED_BY(m_mutex);
+
+        void BlockProcessed(const std::shared_ptr<const CBlock>& block) override
+        {
+            {
+                LOCK(m_mutex);
+                m_processed.push_back(block->GetHash());
+            }
+            m_cv.notify_all();
+        }
+    };
+
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    std::vector<uint256> hashes;
+    uint256 prev_hash = Params().GenesisBlock().GetHash();
+    for (int i = 0; i < 10; i++) {
+        blocks.push_back(GoodBlock(prev_hash));
+        prev_hash = blocks.back()->GetHash();
+        hashes.push_back(prev_hash);
+    }
+
+    // Nothing is queued while the thread is not running
+    BOOST_CHECK(!QueueBlockActivation(blocks[0]));
+
+    auto sub = std::make_shared<ProcessedSubscriber>();
+    RegisterSharedValidationInterface(sub);
+    StartBlockValidationThread(Params());
+
+    // Blocks are stored right away, and connected on the thread in order
+    for (const auto& block : blocks) {
+        bool new_block{false};
+        BOOST_CHECK(AcceptNewBlock(Params(), block, true, &new_block));
+        BOOST_CHECK(new_block);
+        BOOST_CHECK(QueueBlockActivation(block));
+    }
+    {
+        WAIT_LOCK(sub->m_mutex, lock);
+        sub->m_cv.wait_for(lock, std::chrono::seconds{60}, [&]() EXCLUSIVE_LOCKS_REQUIRED(sub->m_mutex) { return sub->m_processed.size() == blocks.size(); });
+        BOOST_CHECK(sub->m_processed == hashes);
+    }
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(::ChainActive().Tip()->GetBlockHash(), hashes.back());
+    }
+
+    StopBlockValidationThread();
+    BOOST_CHECK(!QueueBlockActivation(blocks[0]));
+    UnregisterSharedValidationInterface(sub);
+}
+
 /**
  * Test that mempool updates happen atomically with reorgs.
  *
@@ -231,6 +287,79 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
  * or consistent with the chain state after the reorg, and not just consistent
  * with some intermediate state during the reorg.
  */
+BOOST_AUTO_TEST_CASE(processnewblockheaders_batch)
+{
+    // A batch large enough to be hashed on the header check threads
+    std::vector<CBlockHeader> headers;
+    uint256 prev_hash = Params().GenesisBlock().GetHash();
+    for (int i = 0; i < 100; i++) {
+        headers.push_back(GoodBlock(prev_hash)->GetBlockHeader());
+        prev_hash = headers.back().GetHash();
+    }
+
+    BlockValidationState state;
+    const CBlockIndex* pindex = nullptr;
+    BOOST_CHECK(ProcessNewBlockHeaders(headers, state, Params(), &pindex));
+    BOOST_REQUIRE(pindex);
+    BOOST_CHECK(pindex->GetBlockHash() == headers.back().GetHash());
+    BOOST_CHECK_EQUAL(pindex->nHeight, 100);
+
+    // A header extending the batch with invalid proof of work is rejected
+    // even when it is hashed in parallel with valid ones.
+    std::vector<CBlockHeader> bad_headers;
+    prev_hash = headers.back().GetHash();
+    for (int i = 0; i < 80; i++) {
+        bad_headers.push_back(GoodBlock(prev_hash)->GetBlockHeader());
+        prev_hash = bad_headers.back().GetHash();
+    }
+    CBlockHeader& bad = bad_headers[70];
+    while (CheckProofOfWork(bad.GetHash(), bad.nBits, Params().GetConsensus())) ++bad.nNonce;
+    BOOST_CHECK(!ProcessNewBlockHeaders(bad_headers, state, Params(), &pindex));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+    BOOST_CHECK_EQUAL(pindex->nHeight, 170);
+}
+
+BOOST_AUTO_TEST_CASE(block_index_shared_reads)
+{
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    uint256 prev_hash = Params().GenesisBlock().GetHash();
+    for (int i = 0; i < 20; i++) {
+        blocks.push_back(GoodBlock(prev_hash));
+        prev_hash = blocks.back()->GetHash();
+    }
+
+    // Read the header tree under the shared lock only while the blocks are
+    // connected; every entry and chain block seen must be consistent.
+    std::atomic<bool> done{false};
+    std::thread reader([&] {
+        const CBlockLocator genesis_locator(std::vector<uint256>{Params().GenesisBlock().GetHash()});
+        while (!done) {
+            boost::shared_lock<boost::shared_mutex> lock(g_block_index_mutex);
+            const CChain& chain = ::ChainActive();
+            BOOST_CHECK_EQUAL(FindForkInActiveChainShared(genesis_locator), chain.Genesis());
+            const CBlockIndex* tip = chain.Tip();
+            BOOST_CHECK_EQUAL(LookupBlockIndexShared(tip->GetBlockHash()), tip);
+            BOOST_CHECK(tip->pprev == nullptr || chain[tip->nHeight - 1] == tip->pprev);
+        }
+    });
+
+    bool ignored;
+    for (const auto& block : blocks) {
+        BOOST_CHECK(ProcessNewBlock(Params(), block, /* fForceProcessing */ true, &ignored));
+    }
+    done = true;
+    reader.join();
+
+    LOCK(cs_main);
+    const CBlockIndex* tip = ::ChainActive().Tip();
+    BOOST_CHECK_EQUAL(tip->GetBlockHash(), blocks.back()->GetHash());
+    BOOST_CHECK_EQUAL(LookupBlockIndexShared(blocks[5]->GetHash()), LookupBlockIndex(blocks[5]->GetHash()));
+    BOOST_CHECK(LookupBlockIndexShared(uint256()) == nullptr);
+    const CBlockLocator locator = ::ChainActive().GetLocator(LookupBlockIndex(blocks[10]->GetHash()));
+    BOOST_CHECK_EQUAL(FindForkInActiveChainShared(locator), FindForkInGlobalIndex(::ChainActive(), locator));
+    BOOST_CHECK_EQUAL(FindForkInActiveChainShared(locator)->nHeight, 11);
+}
+
 BOOST_AUTO_TEST_CASE(mempool_locks_reorg)
 {
     bool ignored;
@@ -81,63 +81,47 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
     print_view_mem_usage(view);
     BOOST_CHECK_EQUAL(view.DynamicMemoryUsage(), is_64_bit ? 32 : 16);
 
-    // We should be able to add COINS_UNTIL_CRITICAL coins to the cache before going CRITICAL.
-    // This is contingent not only on the dynamic memory usage of the Coins
-    // that we're adding (COIN_SIZE bytes per), but also on how much memory the
-    // cacheCoins (unordered_map) preallocates.
-    constexpr int COINS_UNTIL_CRITICAL{3};
-
-    for (int i{0}; i < COINS_UNTIL_CRITICAL; ++i) {
-        COutPoint res = add_coin(view);
-        print_view_mem_usage(view);
-        BOOST_CHECK_EQUAL(view.AccessCoin(res).DynamicMemoryUsage(), COIN_SIZE);
-        BOOST_CHECK_EQUAL(
-            chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0),
-            CoinsCacheSizeState::OK);
-    }
-
-    // Adding some additional coins will push us over the edge to CRITICAL.
-    for (int i{0}; i < 4; ++i) {
-        add_coin(view);
-        print_view_mem_usage(view);
-        if (chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0) ==
-            CoinsCacheSizeState::CRITICAL) {
-            break;
-        }
-    }
-
+    // The first coin makes the pool allocator reserve a whole chunk for
+    // cacheCoins, which immediately exceeds the tiny cache limit.
+    add_coin(view);
+    print_view_mem_usage(view);
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 0),
         CoinsCacheSizeState::CRITICAL);
 
+    const size_t chunk_usage = view.DynamicMemoryUsage();
+    BOOST_CHECK(chunk_usage > MAX_COINS_CACHE_BYTES);
+    BOOST_CHECK_EQUAL(
+        chainstate.GetCoinsCacheSizeState(tx_pool, chunk_usage * 2, /*max_mempool_size_bytes*/ 0),
+        CoinsCacheSizeState::OK);
+    BOOST_CHECK_EQUAL(
+        chainstate.GetCoinsCacheSizeState(tx_pool, chunk_usage, /*max_mempool_size_bytes*/ 0),
+        CoinsCacheSizeState::LARGE);
+    BOOST_CHECK_EQUAL(
+        chainstate.GetCoinsCacheSizeState(tx_pool, chunk_usage - 1, /*max_mempool_size_bytes*/ 0),
+        CoinsCacheSizeState::CRITICAL);
+
     // Passing non-zero max mempool usage should allow us more headroom.
     BOOST_CHECK_EQUAL(
-        chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 10),
+        chainstate.GetCoinsCacheSizeState(tx_pool, chunk_usage - 1, /*max_mempool_size_bytes*/ chunk_usage),
         CoinsCacheSizeState::OK);
 
-    for (int i{0}; i < 3; ++i) {
+    // Following coins are carved out of the same chunk, so usage only grows by
+    // their own heap data (and the occasional bucket array resize).
+    const size_t max_coins_cache_bytes = chunk_usage + 4 * COIN_SIZE;
+    for (int i{0}; i < 10; ++i) {
         add_coin(view);
         print_view_mem_usage(view);
-        BOOST_CHECK_EQUAL(
-            chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, /*max_mempool_size_bytes*/ 1 << 10),
-            CoinsCacheSizeState::OK);
+        BOOST_CHECK(view.DynamicMemoryUsage() < 2 * chunk_usage);
+        if (chainstate.GetCoinsCacheSizeState(tx_pool, max_coins_cache_bytes, /*max_mempool_size_bytes*/ 0) ==
+            CoinsCacheSizeState::CRITICAL) {
+            break;
+        }
     }
 
-    // Adding another coin with the additional mempool room will put us >90%
-    // but not yet critical.
-    add_coin(view);
-    print_view_mem_usage(view);
-
-    // Only perform these checks on 64 bit hosts; I haven't done the math for 32.
-    if (is_64_bit) {
-        float usage_percentage = (float)view.DynamicMemoryUsage() / (MAX_COINS_CACHE_BYTES + (1 << 10));
-        BOOST_TEST_MESSAGE("CoinsTip usage percentage: " << usage_percentage);
-        BOOST_CHECK(usage_percentage >= 0.9);
-        BOOST_CHECK(usage_percentage < 1);
-        BOOST_CHECK_EQUAL(
-            chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, 1 << 10),
-            CoinsCacheSizeState::LARGE);
-    }
+    BOOST_CHECK_EQUAL(
+        chainstate.GetCoinsCacheSizeState(tx_pool, max_coins_cache_bytes, /*max_mempool_size_bytes*/ 0),
+        CoinsCacheSizeState::CRITICAL);
 
     // Using the default max_* values permits way more coins to be added.
     for (int i{0}; i < 1000; ++i) {
@@ -147,20 +131,20 @@ BOOST_AUTO_TEST_CASE(getcoinscachesizestate)
             CoinsCacheSizeState::OK);
     }
 
-    // Flushing the view doesn't take us back to OK because cacheCoins has
-    // preallocated memory that doesn't get reclaimed even after flush.
-
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, 0),
         CoinsCacheSizeState::CRITICAL);
 
+    // Flushing the view releases the pool's chunks along with cacheCoins, so
+    // we're back to the usage of an empty cache.
     view.SetBestBlock(InsecureRand256());
     BOOST_CHECK(view.Flush());
     print_view_mem_usage(view);
 
+    BOOST_CHECK_EQUAL(view.DynamicMemoryUsage(), is_64_bit ? 32 : 16);
     BOOST_CHECK_EQUAL(
         chainstate.GetCoinsCacheSizeState(tx_pool, MAX_COINS_CACHE_BYTES, 0),
-        CoinsCacheSizeState::CRITICAL);
+        CoinsCacheSizeState::OK);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,11 +3,17 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <consensus/validation.h>
 #include <net.h>
+#include <node/args_snapshot.h>
+#include <policy/policy.h>
+#include <util/system.h>
 #include <validation.h>
 
 #include <test/util/setup_common.h>
 
+#include <univalue.h>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -74,4 +80,78 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+BOOST_AUTO_TEST_CASE(args_snapshot)
+{
+    const ArgsSnapshot& defaults = GetArgsSnapshot();
+    BOOST_CHECK_EQUAL(defaults.max_mempool_bytes, DEFAULT_MAX_MEMPOOL_SIZE * 1000000);
+    BOOST_CHECK_EQUAL(defaults.limit_ancestor_size, DEFAULT_ANCESTOR_SIZE_LIMIT * 1000);
+
+    ArgsManager args;
+    args.ForceSetArg("-maxmempool", "5");
+    args.ForceSetArg("-limitancestorcount", "3");
+    args.ForceSetArg("-blockmintxfee", "0.0002");
+    args.ForceSetArg("-maxorphantx", "-1");
+    ReloadArgsSnapshot(args);
+    const ArgsSnapshot& snapshot = GetArgsSnapshot();
+    BOOST_CHECK_EQUAL(snapshot.max_mempool_bytes, 5000000);
+    BOOST_CHECK_EQUAL(snapshot.limit_ancestors, 3U);
+    BOOST_CHECK(snapshot.block_min_fee_rate == CFeeRate(20000));
+    BOOST_CHECK_EQUAL(snapshot.max_orphan_tx, 0U);
+    // Earlier snapshots stay valid and unchanged
+    BOOST_CHECK_EQUAL(defaults.max_mempool_bytes, DEFAULT_MAX_MEMPOOL_SIZE * 1000000);
+
+    ReloadArgsSnapshot(gArgs);
+    BOOST_CHECK_EQUAL(GetArgsSnapshot().limit_ancestors, DEFAULT_ANCESTOR_LIMIT);
+}
+
+BOOST_AUTO_TEST_CASE(check_block_transactions)
+{
+    // Enough transactions to be checked in parallel
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    coinbase.vout.emplace_back(50 * COIN, CScript() << OP_TRUE);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (int i = 0; i < 200; ++i) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(InsecureRand256(), 0));
+        tx.vin.emplace_back(COutPoint(InsecureRand256(), 1));
+        tx.vout.emplace_back(COIN, CScript() << OP_CHECKSIG);
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    const Consensus::Params& params = Params().GetConsensus();
+    BlockValidationState state;
+    BOOST_CHECK(CheckBlock(block, state, params, false, false));
+
+    // The first invalid transaction is reported
+    CMutableTransaction dup(*block.vtx[150]);
+    dup.vin[1] = dup.vin[0];
+    block.vtx[150] = MakeTransactionRef(dup);
+    CMutableTransaction negative(*block.vtx[100]);
+    negative.vout[0].nValue = -1;
+    block.vtx[100] = MakeTransactionRef(negative);
+    BOOST_CHECK(!CheckBlock(block, state, params, false, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-vout-negative");
+
+    block.vtx[100] = MakeTransactionRef(CMutableTransaction(*block.vtx[101]));
+    state = BlockValidationState();
+    BOOST_CHECK(!CheckBlock(block, state, params, false, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-inputs-duplicate");
+
+    // Too many legacy sigops across the chunks
+    block.vtx[150] = block.vtx[149];
+    CMutableTransaction sigops(*block.vtx[1]);
+    sigops.vout[0].scriptPubKey = CScript();
+    for (int64_t i = 0; i < MAX_BLOCK_SIGOPS_COST / WITNESS_SCALE_FACTOR - 200; ++i) {
+        sigops.vout[0].scriptPubKey << OP_CHECKSIG;
+    }
+    block.vtx[1] = MakeTransactionRef(sigops);
+    state = BlockValidationState();
+    BOOST_CHECK(CheckBlock(block, state, params, false, false));
+    block.vtx[2] = MakeTransactionRef(sigops);
+    BOOST_CHECK(!CheckBlock(block, state, params, false, false));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-blk-sigops");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,8 +8,12 @@
 #include <scheduler.h>
 #include <test/util/setup_common.h>
 #include <util/check.h>
+#include <util/time.h>
 #include <validationinterface.h>
 
+#include <atomic>
+#include <future>
+
 BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, TestingSetup)
 
 struct TestSubscriberNoop final : public CValidationInterface {
@@ -91,4 +95,79 @@ BOOST_AUTO_TEST_CASE(unregister_all_during_call)
     BOOST_CHECK(destroyed);
 }
 
+class QueueTestInterface : public CValidationInterface
+{
+public:
+    QueueTestInterface(std::string queue_name, std::function<void()> on_call = nullptr)
+        : m_queue_name(std::move(queue_name)), m_on_call(std::move(on_call))
+    {
+    }
+    std::string GetValidationQueueName() const override { return m_queue_name; }
+    void ChainStateFlushed(const CBlockLocator& locator) override
+    {
+        ++m_calls;
+        if (m_on_call) m_on_call();
+    }
+    const std::string m_queue_name;
+    std::function<void()> m_on_call;
+    std::atomic<int> m_calls{0};
+};
+
+BOOST_AUTO_TEST_CASE(independent_queues)
+{
+    // With a second scheduler thread, a subscriber stuck in a callback only
+    // holds up its own queue.
+    std::thread extra_thread{[&] { m_node.scheduler->serviceQueue(); }};
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    auto slow = std::make_shared<QueueTestInterface>("slow", [released] { released.wait(); });
+    auto fast = std::make_shared<QueueTestInterface>("fast");
+    RegisterSharedValidationInterface(slow);
+    RegisterSharedValidationInterface(fast);
+
+    for (int i = 0; i < 3; ++i) GetMainSignals().ChainStateFlushed(CBlockLocator());
+    for (int i = 0; i < 10000 && fast->m_calls < 3; ++i) UninterruptibleSleep(std::chrono::milliseconds{1});
+    BOOST_CHECK_EQUAL(fast->m_calls, 3);
+    BOOST_CHECK_EQUAL(slow->m_calls, 1);
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(), 2U);
+
+    release.set_value();
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(slow->m_calls, 3);
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(), 0U);
+
+    size_t queues_seen = 0;
+    for (const ValidationQueueStats& stats : GetMainSignals().GetQueueStats()) {
+        if (stats.name != "slow" && stats.name != "fast") continue;
+        ++queues_seen;
+        BOOST_CHECK_EQUAL(stats.subscribers, 1U);
+        BOOST_CHECK_EQUAL(stats.pending, 0U);
+        BOOST_CHECK_EQUAL(stats.processed, 3U);
+        BOOST_CHECK(stats.max_latency >= 0);
+    }
+    BOOST_CHECK_EQUAL(queues_seen, 2U);
+
+    UnregisterSharedValidationInterface(slow);
+    UnregisterSharedValidationInterface(fast);
+
+    // Callbacks still queued when their subscriber unregisters are dropped.
+    std::promise<void> release_blocker;
+    std::shared_future<void> blocker_released = release_blocker.get_future().share();
+    auto blocker = std::make_shared<QueueTestInterface>("slow", [blocker_released] { blocker_released.wait(); });
+    auto dropped = std::make_shared<QueueTestInterface>("slow");
+    RegisterSharedValidationInterface(blocker);
+    RegisterSharedValidationInterface(dropped);
+    GetMainSignals().ChainStateFlushed(CBlockLocator());
+    for (int i = 0; i < 10000 && blocker->m_calls < 1; ++i) UninterruptibleSleep(std::chrono::milliseconds{1});
+    UnregisterSharedValidationInterface(dropped);
+    release_blocker.set_value();
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(blocker->m_calls, 1);
+    BOOST_CHECK_EQUAL(dropped->m_calls, 0);
+    UnregisterSharedValidationInterface(blocker);
+
+    m_node.scheduler->stop();
+    extra_thread.join();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -337,6 +337,13 @@ BOOST_AUTO_TEST_CASE(versionbits_computeblockversion)
     // After one period of setting the bit on each block, it should have locked in.
     // We keep setting the bit for one more period though, until activation.
     BOOST_CHECK((ComputeBlockVersion(lastBlock, mainnetParams) & (1<<bit)) != 0);
+    {
+        // The deployment states are memoized on the block index.
+        LOCK(cs_main);
+        BOOST_CHECK(lastBlock->nMemoized & BLOCK_MEMO_DEPLOYMENTS);
+        BOOST_CHECK(VersionBitsStateAfter(lastBlock, mainnetParams, Consensus::DEPLOYMENT_TESTDUMMY) == ThresholdState::LOCKED_IN);
+        BOOST_CHECK(VersionBitsState(lastBlock, mainnetParams, Consensus::DEPLOYMENT_TESTDUMMY, versionbitscache) == ThresholdState::LOCKED_IN);
+    }
 
     // Now check that we keep mining the block until the end of this period, and
     // then stop at the beginning of the next period.
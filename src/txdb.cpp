@@ -5,16 +5,22 @@
 
 #include <txdb.h>
 
+#include <hash.h>
 #include <pow.h>
 #include <random.h>
 #include <shutdown.h>
 #include <ui_interface.h>
 #include <uint256.h>
+#include <util/memory.h>
 #include <util/system.h>
+#include <util/threadnames.h>
+#include <util/time.h>
 #include <util/translation.h>
 #include <util/vector.h>
 
+#include <algorithm>
 #include <stdint.h>
+#include <thread>
 
 #include <boost/thread.hpp>
 
@@ -28,6 +34,8 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_INDEX_IMAGE = 'I';
+static const char DB_SHARD_COUNT = 'S';
 
 namespace {
 
@@ -53,16 +61,91 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe) : db(ldb_path, nCacheSize, fMemory, fWipe, true)
+CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe, int shards) : db(ldb_path, nCacheSize / shards, fMemory, fWipe, true, gArgs.GetBoolArg("-chainstatecompression", DEFAULT_CHAINSTATE_COMPRESSION))
 {
+    assert(shards >= 1 && shards <= MAX_CHAINSTATE_SHARDS);
+    const fs::path shards_path = ldb_path / "shards";
+    if (fWipe && !fMemory) fs::remove_all(shards_path);
+
+    // Coins can't move between shards without rebuilding the database, so an
+    // existing one keeps the number of shards it was created with.
+    int stored_shards;
+    if (!db.Read(DB_SHARD_COUNT, stored_shards)) {
+        stored_shards = GetBestBlock().IsNull() && GetHeadBlocks().empty() ? shards : 1;
+        if (stored_shards > 1) db.Write(DB_SHARD_COUNT, stored_shards, true);
+    }
+    if (stored_shards != shards) {
+        LogPrintf("The coin database at %s has %d shard(s), restart with -reindex-chainstate to use %d\n", ldb_path.string(), stored_shards, shards);
+    }
+    if (stored_shards < 1 || stored_shards > MAX_CHAINSTATE_SHARDS) {
+        throw std::runtime_error(strprintf("Unsupported number of coin database shards %d", stored_shards));
+    }
+    for (int i = 1; i < stored_shards; ++i) {
+        m_shards.push_back(MakeUnique<CDBWrapper>(shards_path / strprintf("%02d", i), nCacheSize / stored_shards, fMemory, fWipe, true, gArgs.GetBoolArg("-chainstatecompression", DEFAULT_CHAINSTATE_COMPRESSION)));
+    }
+}
+
+CDBWrapper& CCoinsViewDB::ShardDB(size_t shard) const
+{
+    /* Lookups and iterators only read from the databases, but LevelDB has no
+       const interface for them. */
+    return shard == 0 ? const_cast<CDBWrapper&>(db) : *m_shards[shard - 1];
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
-    return db.Read(CoinEntry(&outpoint), coin);
+    m_reads.fetch_add(1, std::memory_order_relaxed);
+    if (!ShardDB(ShardOf(outpoint)).Read(CoinEntry(&outpoint), coin)) return false;
+    m_reads_found.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void CCoinsViewDB::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const {
+    coins.assign(outpoints.size(), Coin());
+    if (outpoints.empty()) return;
+
+    std::vector<std::pair<std::string, size_t>> keys;
+    keys.reserve(outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        CDataStream key(SER_DISK, CLIENT_VERSION);
+        key << CoinEntry(&outpoints[i]);
+        keys.emplace_back(key.str(), i);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    // Shards hold consecutive key ranges, so each one's iterator is done with before the next is needed.
+    std::unique_ptr<CDBIterator> it;
+    size_t it_shard = 0;
+    uint64_t reads = 0, reads_found = 0;
+    for (size_t k = 0; k < keys.size(); ++k) {
+        const COutPoint& outpoint = outpoints[keys[k].second];
+        if (k > 0 && keys[k].first == keys[k - 1].first) {
+            coins[keys[k].second] = coins[keys[k - 1].second];
+            continue;
+        }
+        ++reads;
+        if (!it || it_shard != ShardOf(outpoint)) {
+            it_shard = ShardOf(outpoint);
+            it.reset(ShardDB(it_shard).NewIterator());
+        }
+        it->Seek(CoinEntry(&outpoint));
+        COutPoint found;
+        CoinEntry entry(&found);
+        if (it->Valid() && it->GetKey(entry) && entry.key == DB_COIN && found == outpoint) {
+            if (!it->GetValue(coins[keys[k].second])) {
+                throw std::runtime_error("Database read failure");
+            }
+            ++reads_found;
+        }
+    }
+    m_reads.fetch_add(reads, std::memory_order_relaxed);
+    m_reads_found.fetch_add(reads_found, std::memory_order_relaxed);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
-    return db.Exists(CoinEntry(&outpoint));
+    m_reads.fetch_add(1, std::memory_order_relaxed);
+    if (!ShardDB(ShardOf(outpoint)).Exists(CoinEntry(&outpoint))) return false;
+    m_reads_found.fetch_add(1, std::memory_order_relaxed);
+    return true;
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -81,6 +164,10 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, /* erase */ true);
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -97,6 +184,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             old_tip = old_heads[1];
         }
     }
+    if (!m_shards.empty()) return WriteShardedCoins(mapCoins, hashBlock, old_tip, erase);
 
     // In the first batch, mark the database as being in the middle of a
     // transition from old_tip to hashBlock.
@@ -116,7 +204,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         }
         count++;
         CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (erase) mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -141,12 +229,336 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+bool CCoinsViewDB::WriteShardedCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, const uint256 &old_tip, bool erase) {
+    // The shards can't be updated atomically together. The transition marker
+    // is synced before any of them is written, and cleared only after all of
+    // them are synced, so a crash in between leaves the same state as one
+    // during an unsharded write made of several batches: the marker tells
+    // ReplayBlocks which blocks to apply again.
+    CDBBatch marker(db);
+    marker.Erase(DB_BEST_BLOCK);
+    marker.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
+    if (!db.WriteBatch(marker, true)) return false;
+
+    std::vector<std::vector<CCoinsMap::const_iterator>> dirty(ShardCount());
+    size_t count = 0;
+    size_t changed = 0;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            dirty[ShardOf(it->first)].push_back(it);
+            changed++;
+        }
+        count++;
+    }
+
+    // Split the batch size limit between the shards, so memory use stays the same.
+    const size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize) / ShardCount();
+    std::vector<std::exception_ptr> errors(ShardCount());
+    std::vector<char> written(ShardCount(), false);
+    auto write_shard = [&](size_t shard) {
+        try {
+            CDBWrapper& shard_db = ShardDB(shard);
+            CDBBatch batch(shard_db);
+            for (const CCoinsMap::const_iterator& it : dirty[shard]) {
+                CoinEntry entry(&it->first);
+                if (it->second.coin.IsSpent())
+                    batch.Erase(entry);
+                else
+                    batch.Write(entry, it->second.coin);
+                if (batch.SizeEstimate() > batch_size) {
+                    shard_db.WriteBatch(batch);
+                    batch.Clear();
+                }
+            }
+            written[shard] = shard_db.WriteBatch(batch, true);
+        } catch (...) {
+            errors[shard] = std::current_exception();
+        }
+    };
+    const int64_t start = GetTimeMillis();
+    std::vector<std::thread> threads;
+    for (size_t shard = 1; shard < ShardCount(); ++shard) {
+        threads.emplace_back([&write_shard, shard] {
+            util::ThreadRename(strprintf("coinsshard.%u", shard));
+            write_shard(shard);
+        });
+    }
+    write_shard(0);
+    for (std::thread& thread : threads) thread.join();
+    for (const std::exception_ptr& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+    if (std::count(written.begin(), written.end(), false)) return false;
+    LogPrint(BCLog::COINDB, "Wrote %u changed transaction outputs to %u shards in %dms\n", (unsigned int)changed, ShardCount(), GetTimeMillis() - start);
+
+    int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
+    if (crash_simulate) {
+        static FastRandomContext rng;
+        if (rng.randrange(crash_simulate) == 0) {
+            LogPrintf("Simulating a crash. Goodbye.\n");
+            _Exit(0);
+        }
+    }
+    if (erase) mapCoins.clear();
+
+    CDBBatch done(db);
+    done.Erase(DB_HEAD_BLOCKS);
+    done.Write(DB_BEST_BLOCK, hashBlock);
+    bool ret = db.WriteBatch(done);
+    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    return ret;
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
-    return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
+    size_t size = db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
+    for (const auto& shard : m_shards) {
+        size += shard->EstimateSize(DB_COIN, (char)(DB_COIN+1));
+    }
+    return size;
+}
+
+//! Version of the coins journal format written by WriteCoinsJournal.
+static const uint32_t COINS_JOURNAL_VERSION = 1;
+
+bool WriteCoinsJournal(const fs::path& path, const CCoinsMap& coins, const uint256& best_block, const uint256& prev_block)
+{
+    const fs::path path_new = path.string() + ".new";
+    CAutoFile file(fsbridge::fopen(path_new, "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) return error("%s: failed to open %s", __func__, path_new.string());
+
+    // Entries are serialized in pieces of about a megabyte, which are hashed
+    // and appended to the file as they fill up.
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    CDataStream buf(SER_DISK, CLIENT_VERSION);
+    const auto write_buf = [&] {
+        hasher.write(buf.data(), buf.size());
+        file.write(buf.data(), buf.size());
+        buf.clear();
+    };
+    try {
+        uint64_t count = 0;
+        for (const auto& entry : coins) {
+            if (entry.second.flags & CCoinsCacheEntry::DIRTY) ++count;
+        }
+        buf << COINS_JOURNAL_VERSION << best_block << prev_block << count;
+        for (const auto& entry : coins) {
+            if (!(entry.second.flags & CCoinsCacheEntry::DIRTY)) continue;
+            const bool spent = entry.second.coin.IsSpent();
+            buf << entry.first << spent;
+            if (!spent) buf << entry.second.coin;
+            if (buf.size() >= (1 << 20)) write_buf();
+        }
+        write_buf();
+        file << hasher.GetHash();
+    } catch (const std::exception& e) {
+        return error("%s: failed to write %s: %s", __func__, path_new.string(), e.what());
+    }
+    if (!FileCommit(file.Get())) return error("%s: failed to commit %s", __func__, path_new.string());
+    file.fclose();
+    if (!RenameOver(path_new, path)) return error("%s: failed to rename %s", __func__, path_new.string());
+    return true;
+}
+
+bool ReadCoinsJournal(const fs::path& path, CCoinsMap& coins, uint256& best_block, uint256& prev_block)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) return error("%s: failed to open %s", __func__, path.string());
+    try {
+        CHashVerifier<CAutoFile> verifier(&file);
+        uint32_t version;
+        uint64_t count;
+        verifier >> version;
+        if (version != COINS_JOURNAL_VERSION) return error("%s: unknown version %u of %s", __func__, version, path.string());
+        verifier >> best_block >> prev_block >> count;
+        for (uint64_t i = 0; i < count; ++i) {
+            COutPoint outpoint;
+            bool spent;
+            verifier >> outpoint >> spent;
+            CCoinsCacheEntry& entry = coins[outpoint];
+            if (!spent) verifier >> entry.coin;
+            entry.flags = CCoinsCacheEntry::DIRTY;
+        }
+        uint256 hash;
+        file >> hash;
+        if (hash != verifier.GetHash()) return error("%s: checksum mismatch in %s", __func__, path.string());
+    } catch (const std::exception& e) {
+        return error("%s: failed to read %s: %s", __func__, path.string(), e.what());
+    }
+    return true;
+}
+
+CCoinsViewBackgroundFlush::CCoinsViewBackgroundFlush(CCoinsView* base, CCoinsViewDB& db, bool background, fs::path journal_path)
+    : CCoinsViewBacked(base), m_db(db), m_background(background), m_journal_path(std::move(journal_path)) {}
+
+CCoinsViewBackgroundFlush::~CCoinsViewBackgroundFlush()
+{
+    Sync();
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+bool CCoinsViewBackgroundFlush::GetCoin(const COutPoint &outpoint, Coin &coin) const
+{
+    {
+        LOCK(m_mutex);
+        if (m_frozen) {
+            CCoinsMap::const_iterator it = m_frozen->coins.find(outpoint);
+            if (it != m_frozen->coins.end()) {
+                ++m_hits;
+                coin = it->second.coin;
+                return !coin.IsSpent();
+            }
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+void CCoinsViewBackgroundFlush::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const
+{
+    coins.resize(outpoints.size());
+    std::vector<bool> unknown(outpoints.size(), true);
+    {
+        LOCK(m_mutex);
+        if (m_frozen) {
+            for (size_t i = 0; i < outpoints.size(); ++i) {
+                CCoinsMap::const_iterator it = m_frozen->coins.find(outpoints[i]);
+                if (it != m_frozen->coins.end()) {
+                    ++m_hits;
+                    coins[i] = it->second.coin;
+                    unknown[i] = false;
+                }
+            }
+        }
+    }
+    GetCoinsFromBase(outpoints, coins, unknown);
+}
+
+bool CCoinsViewBackgroundFlush::HaveCoin(const COutPoint &outpoint) const
+{
+    {
+        LOCK(m_mutex);
+        if (m_frozen) {
+            CCoinsMap::const_iterator it = m_frozen->coins.find(outpoint);
+            if (it != m_frozen->coins.end()) {
+                ++m_hits;
+                return !it->second.coin.IsSpent();
+            }
+        }
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint64_t CCoinsViewBackgroundFlush::GetHits() const
+{
+    LOCK(m_mutex);
+    return m_hits;
+}
+
+uint256 CCoinsViewBackgroundFlush::GetBestBlock() const
+{
+    {
+        LOCK(m_mutex);
+        if (m_frozen) return m_frozen->best_block;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundFlush::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock)
+{
+    if (!Sync()) return false;
+    if (!m_background && !HasJournal()) return base->BatchWrite(mapCoins, hashBlock);
+
+    // Only dirty entries need writing; clean ones already match the database.
+    std::unique_ptr<Generation> gen = MakeUnique<Generation>();
+    gen->best_block = hashBlock;
+    gen->coins.reserve(mapCoins.size());
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = mapCoins.erase(it)) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) continue;
+        CCoinsCacheEntry& entry = gen->coins[it->first];
+        entry.coin = std::move(it->second.coin);
+        entry.flags = CCoinsCacheEntry::DIRTY;
+    }
+
+    if (HasJournal()) {
+        const int64_t start = GetTimeMillis();
+        if (!WriteCoinsJournal(m_journal_path, gen->coins, hashBlock, m_db.GetBestBlock())) return false;
+        LogPrint(BCLog::COINDB, "Journaled %u coins in %dms\n", gen->coins.size(), GetTimeMillis() - start);
+    }
+    if (!m_background) {
+        if (!m_db.WriteCoins(gen->coins, hashBlock, /* erase */ true)) return false;
+        DiscardJournal();
+        return true;
+    }
+
+    Generation* frozen = gen.get();
+    {
+        LOCK(m_mutex);
+        m_frozen = std::move(gen);
+    }
+    m_thread = std::thread([this, frozen] {
+        util::ThreadRename("coinsflush");
+        const int64_t start = GetTimeMillis();
+        bool ok = false;
+        try {
+            ok = m_db.WriteCoins(frozen->coins, frozen->best_block, /* erase */ false);
+        } catch (const std::exception& e) {
+            LogPrintf("Background coins database write failed: %s\n", e.what());
+        }
+        LogPrint(BCLog::COINDB, "Background write of %u coins finished in %dms\n", frozen->coins.size(), GetTimeMillis() - start);
+        if (ok) DiscardJournal();
+        LOCK(m_mutex);
+        if (ok) {
+            m_frozen.reset();
+        } else {
+            // Keep serving the frozen coins; the node is shutting down anyway.
+            m_write_failed = true;
+        }
+    });
+    return true;
+}
+
+bool CCoinsViewBackgroundFlush::Sync()
+{
+    if (m_thread.joinable()) m_thread.join();
+    LOCK(m_mutex);
+    return !m_write_failed;
+}
+
+bool CCoinsViewBackgroundFlush::ReplayJournal()
+{
+    if (!HasJournal() || !fs::exists(m_journal_path)) return true;
+
+    Generation gen;
+    uint256 prev_block;
+    if (!ReadCoinsJournal(m_journal_path, gen.coins, gen.best_block, prev_block)) return false;
+
+    // The journal is written before the database write it describes starts,
+    // and removed once that write has finished, so the database is either
+    // still at the journal's starting point, part way through the write, or
+    // already done with it.
+    const uint256 db_best = m_db.GetBestBlock();
+    const std::vector<uint256> heads = m_db.GetHeadBlocks();
+    if (db_best != gen.best_block) {
+        if (db_best != prev_block && !(heads.size() == 2 && heads[0] == gen.best_block)) {
+            return error("%s: coins journal for %s does not match the coin database", __func__, gen.best_block.ToString());
+        }
+        LogPrintf("Replaying %u coins from the coins journal up to %s\n", gen.coins.size(), gen.best_block.ToString());
+        if (!m_db.WriteCoins(gen.coins, gen.best_block, /* erase */ true)) return false;
+    }
+    DiscardJournal();
+    return true;
+}
+
+void CCoinsViewBackgroundFlush::DiscardJournal()
+{
+    if (!HasJournal()) return;
+    try {
+        fs::remove(m_journal_path);
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("Unable to remove coins journal %s: %s\n", m_journal_path.string(), fsbridge::get_filesystem_error_message(e));
+    }
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, gArgs.GetBoolArg("-indexcompression", DEFAULT_INDEX_COMPRESSION)) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -170,20 +582,48 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    i->pcursor->Seek(DB_COIN);
-    // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
+    return Cursor(COutPoint(uint256(), 0));
+}
+
+CCoinsViewCursor *CCoinsViewDB::Cursor(const COutPoint& start) const
+{
+    // The coins of later shards all follow start, so their iterators start at their first coin.
+    const COutPoint first(uint256(), 0);
+    std::vector<std::unique_ptr<CDBIterator>> cursors;
+    for (size_t shard = ShardOf(start); shard < ShardCount(); ++shard) {
+        cursors.emplace_back(ShardDB(shard).NewIterator());
+        cursors.back()->Seek(CoinEntry(cursors.size() == 1 ? &start : &first));
+    }
+    return new CCoinsViewDBCursor(std::move(cursors), GetBestBlock());
+}
+
+CCoinsViewDBCursor::CCoinsViewDBCursor(std::vector<std::unique_ptr<CDBIterator>> shard_cursors, const uint256 &hashBlockIn)
+    : CCoinsViewCursor(hashBlockIn), m_shard_cursors(std::move(shard_cursors))
+{
+    NextChunk();
+    CacheKey();
+}
+
+void CCoinsViewDBCursor::NextChunk()
+{
+    m_chunk = m_reader ? &m_reader->Next() : nullptr;
+    while ((!m_chunk || m_chunk->size() == 0) && m_next_shard < m_shard_cursors.size()) {
+        // Only the shard being read has a reader thread.
+        m_reader.reset();
+        m_reader = MakeUnique<CDBChunkReader>(std::move(m_shard_cursors[m_next_shard++]), DB_COIN);
+        m_chunk = &m_reader->Next();
+    }
+    m_pos = 0;
+}
+
+void CCoinsViewDBCursor::CacheKey()
+{
+    CoinEntry entry(&keyTmp.second);
+    if (m_pos >= m_chunk->size() || !m_chunk->GetKey(m_pos, entry)) {
+        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
     } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+        keyTmp.first = entry.key;
     }
-    return i;
 }
 
 bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
@@ -198,12 +638,12 @@ bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 
 bool CCoinsViewDBCursor::GetValue(Coin &coin) const
 {
-    return pcursor->GetValue(coin);
+    return m_pos < m_chunk->size() && m_chunk->GetValue(m_pos, coin);
 }
 
 unsigned int CCoinsViewDBCursor::GetValueSize() const
 {
-    return pcursor->GetValueSize();
+    return m_pos < m_chunk->size() ? m_chunk->Value(m_pos).size() : 0;
 }
 
 bool CCoinsViewDBCursor::Valid() const
@@ -213,13 +653,10 @@ bool CCoinsViewDBCursor::Valid() const
 
 void CCoinsViewDBCursor::Next()
 {
-    pcursor->Next();
-    CoinEntry entry(&keyTmp.second);
-    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
-        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
-    } else {
-        keyTmp.first = entry.key;
+    if (m_pos < m_chunk->size() && ++m_pos == m_chunk->size()) {
+        NextChunk();
     }
+    CacheKey();
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -246,44 +683,95 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::WriteIndexImageGeneration(uint64_t generation) {
+    return Write(DB_INDEX_IMAGE, generation, true);
+}
+
+bool CBlockTreeDB::ReadIndexImageGeneration(uint64_t& generation) {
+    return Read(DB_INDEX_IMAGE, generation);
+}
+
+bool CBlockTreeDB::EraseIndexImageGeneration() {
+    return Erase(DB_INDEX_IMAGE, true);
+}
+
+//! Number of block index records read before their headers are checked together
+static constexpr size_t BLOCK_INDEX_LOAD_BATCH = 16384;
+//! Maximum number of threads checking block index headers
+static constexpr int MAX_BLOCK_INDEX_LOAD_THREADS = 8;
+//! Number of headers below which checking them is not worth starting threads
+static constexpr size_t MIN_PARALLEL_BLOCK_INDEX_CHECKS = 1024;
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
+    const size_t max_threads = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    std::vector<CDiskBlockIndex> batch;
+    std::vector<uint256> hashes;
+    std::vector<char> valid_pow;
+    batch.reserve(BLOCK_INDEX_LOAD_BATCH);
+
     // Load m_block_index
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        if (ShutdownRequested()) return false;
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
+    bool finished = false;
+    while (!finished) {
+        // Read the next batch of records; the cursor can only be walked by one thread
+        batch.clear();
+        while (batch.size() < BLOCK_INDEX_LOAD_BATCH) {
+            boost::this_thread::interruption_point();
+            if (ShutdownRequested()) return false;
+            std::pair<char, uint256> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+                finished = true;
+                break;
+            }
+            batch.emplace_back();
+            if (!pcursor->GetValue(batch.back())) {
                 return error("%s: failed to read value", __func__);
             }
-        } else {
-            break;
+            pcursor->Next();
+        }
+
+        // Hash the headers and check their proof of work, which dominates the
+        // cost of loading, in parallel
+        hashes.resize(batch.size());
+        valid_pow.resize(batch.size());
+        auto check_headers = [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                hashes[i] = batch[i].GetBlockHash();
+                valid_pow[i] = CheckProofOfWork(hashes[i], batch[i].nBits, consensusParams);
+            }
+        };
+        const size_t threads = batch.size() < MIN_PARALLEL_BLOCK_INDEX_CHECKS ? 1 : max_threads;
+        const size_t per_thread = (batch.size() + threads - 1) / threads;
+        std::vector<std::thread> workers;
+        for (size_t begin = per_thread; begin < batch.size(); begin += per_thread) {
+            workers.emplace_back(check_headers, begin, std::min(batch.size(), begin + per_thread));
+        }
+        check_headers(0, std::min(batch.size(), per_thread));
+        for (std::thread& worker : workers) worker.join();
+
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const CDiskBlockIndex& diskindex = batch[i];
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(hashes[i]);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+
+            if (!valid_pow[i])
+                return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
         }
     }
 
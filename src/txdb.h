@@ -9,10 +9,14 @@
 #include <coins.h>
 #include <dbwrapper.h>
 #include <chain.h>
+#include <fs.h>
 #include <primitives/block.h>
+#include <sync.h>
 
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -24,6 +28,16 @@ class uint256;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -chainstatecompression default
+static const bool DEFAULT_CHAINSTATE_COMPRESSION = false;
+//! -indexcompression default
+static const bool DEFAULT_INDEX_COMPRESSION = false;
+//! -coinsjournal default
+static const bool DEFAULT_COINS_JOURNAL = false;
+//! -chainstateshards default
+static const int DEFAULT_CHAINSTATE_SHARDS = 1;
+//! max. -chainstateshards
+static const int MAX_CHAINSTATE_SHARDS = 16;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -39,29 +53,137 @@ static const int64_t max_filter_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * The coins can be split over several LevelDB instances by the first byte of
+ * their txid, so that flushes write to them in parallel and each one compacts
+ * on its own. Shard 0 is the database at ldb_path, which also holds the best
+ * block and the number of shards; the others live in its shards/ directory.
+ * As every shard holds a consecutive range of outpoints, cursors walk the
+ * shards one after the other and still return coins in key order.
+ */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+    //! The shards after the first one, whose coins are in db.
+    std::vector<std::unique_ptr<CDBWrapper>> m_shards;
+    //! Coins looked up, and how many of them were found. Lookups may run in
+    //! prefetch threads concurrently.
+    mutable std::atomic<uint64_t> m_reads{0};
+    mutable std::atomic<uint64_t> m_reads_found{0};
 public:
     /**
      * @param[in] ldb_path    Location in the filesystem where leveldb data will be stored.
+     * @param[in] shards      Number of shards of a new database. An existing one keeps its own.
      */
-    explicit CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe);
+    explicit CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe, int shards = DEFAULT_CHAINSTATE_SHARDS);
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    //! Looks the outpoints up in key order with one iterator, so that nearby keys share disk reads.
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
+    //! A cursor positioned at the first coin whose outpoint is not below start.
+    CCoinsViewCursor *Cursor(const COutPoint& start) const;
+
+    //! Write the dirty entries of mapCoins, like BatchWrite(). With erase=false,
+    //! mapCoins is left untouched so it can keep answering lookups meanwhile.
+    bool WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase);
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    uint64_t GetReads() const { return m_reads.load(std::memory_order_relaxed); }
+    uint64_t GetReadsFound() const { return m_reads_found.load(std::memory_order_relaxed); }
+
+    size_t ShardCount() const { return m_shards.size() + 1; }
+
+private:
+    //! The shard holding the coin at outpoint.
+    size_t ShardOf(const COutPoint& outpoint) const { return *outpoint.hash.begin() * ShardCount() / 256; }
+    CDBWrapper& ShardDB(size_t shard) const;
+    //! Write the dirty entries of mapCoins to all shards in parallel.
+    bool WriteShardedCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, const uint256 &old_tip, bool erase);
+};
+
+/**
+ * CCoinsView between the coins cache and the coin database that can write
+ * flushed coins to the database in a background thread.
+ *
+ * When enabled, BatchWrite() moves the dirty entries into a frozen generation
+ * and returns as soon as that is done; a worker thread then writes the
+ * generation to the database. Until the write has finished, lookups are
+ * answered from the frozen generation first, so readers never see the database
+ * half way through an update. At most one generation is in flight: BatchWrite()
+ * waits for the previous write before starting another one.
+ *
+ * When disabled, writes go straight through to the base view.
+ *
+ * With a journal path, every generation is first appended to a journal file and
+ * synced before the database is touched. An interrupted database write is then
+ * finished from the journal by ReplayJournal() at startup, rather than by
+ * replaying blocks, which may have been pruned meanwhile.
+ */
+class CCoinsViewBackgroundFlush final : public CCoinsViewBacked
+{
+public:
+    CCoinsViewBackgroundFlush(CCoinsView* base, CCoinsViewDB& db, bool background, fs::path journal_path = {});
+    ~CCoinsViewBackgroundFlush();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+
+    //! Wait until no background write is in progress. Returns false if the last one failed.
+    bool Sync();
+
+    //! Whether generations are journaled before they are written to the database.
+    bool HasJournal() const { return !m_journal_path.empty(); }
+    //! Finish the database write recorded in a journal left behind by a crash, if
+    //! any. Returns false if the journal is corrupt or does not match the database.
+    bool ReplayJournal();
+    //! Delete the journal, e.g. because the database was wiped.
+    void DiscardJournal();
+
+    //! Lookups answered by coins that were still being written.
+    uint64_t GetHits() const;
+
+private:
+    struct Generation {
+        CCoinsMapMemoryResource resource;
+        CCoinsMap coins{0, SaltedOutpointHasher(), CCoinsMap::key_equal(), &resource};
+        uint256 best_block;
+    };
+
+    CCoinsViewDB& m_db;
+    const bool m_background;
+    const fs::path m_journal_path;
+
+    mutable Mutex m_mutex;
+    //! Coins being written by m_thread. Not modified until the write is done.
+    std::unique_ptr<Generation> m_frozen GUARDED_BY(m_mutex);
+    bool m_write_failed GUARDED_BY(m_mutex){false};
+    mutable uint64_t m_hits GUARDED_BY(m_mutex){0};
+    std::thread m_thread;
 };
 
+/**
+ * Write the dirty entries of coins to a coins journal at path, recording that
+ * they move the database from prev_block to best_block. The file is synced
+ * before it replaces any journal already at path.
+ */
+bool WriteCoinsJournal(const fs::path& path, const CCoinsMap& coins, const uint256& best_block, const uint256& prev_block);
+//! Read a journal written by WriteCoinsJournal(). Returns false if it is truncated or corrupt.
+bool ReadCoinsJournal(const fs::path& path, CCoinsMap& coins, uint256& best_block, uint256& prev_block);
+
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
 class CCoinsViewDBCursor: public CCoinsViewCursor
 {
@@ -76,9 +198,19 @@ public:
     void Next() override;
 
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
-    std::unique_ptr<CDBIterator> pcursor;
+    //! The iterators of consecutive shards are read one after the other, each from the
+    //! position it is at, in chunks read ahead in the background.
+    CCoinsViewDBCursor(std::vector<std::unique_ptr<CDBIterator>> shard_cursors, const uint256 &hashBlockIn);
+    void CacheKey();
+    //! Move to the next chunk, going on to the next shard once one is exhausted.
+    void NextChunk();
+
+    std::vector<std::unique_ptr<CDBIterator>> m_shard_cursors;
+    size_t m_next_shard{0};
+    std::unique_ptr<CDBChunkReader> m_reader;
+    //! The chunk with the current entry, and its index there
+    const CDBChunk* m_chunk;
+    size_t m_pos{0};
     std::pair<char, COutPoint> keyTmp;
 
     friend class CCoinsViewDB;
@@ -97,6 +229,10 @@ public:
     void ReadReindexing(bool &fReindexing);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    //! The generation of the block index image that matches the block index, if any
+    bool WriteIndexImageGeneration(uint64_t generation);
+    bool ReadIndexImageGeneration(uint64_t& generation);
+    bool EraseIndexImageGeneration();
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
@@ -0,0 +1,59 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txinvorder.h>
+
+bool TxInvOrder::Before(const Entry& a, const Entry& b)
+{
+    if (a.ancestors != b.ancestors) return a.ancestors < b.ancestors;
+    // As CompareTxMemPoolEntryByScore
+    const double f1 = (double)a.fee * b.vsize;
+    const double f2 = (double)b.fee * a.vsize;
+    if (f1 == f2) return b.txid < a.txid;
+    return f1 > f2;
+}
+
+TxInvOrder::TxInvOrder(CTxMemPool& mempool, std::chrono::microseconds refresh_interval)
+    : m_mempool(mempool), m_refresh_interval(refresh_interval)
+{
+}
+
+void TxInvOrder::GetEntries(const std::set<uint256>& txids, std::chrono::microseconds now, std::vector<Entry>& entries, std::vector<uint256>& missing)
+{
+    LOCK(m_mutex);
+    if (now >= m_next_refresh) {
+        m_entries.clear();
+        m_next_refresh = now + m_refresh_interval;
+    }
+
+    std::vector<uint256> uncached;
+    entries.reserve(entries.size() + txids.size());
+    for (const uint256& txid : txids) {
+        const auto it = m_entries.find(txid);
+        if (it == m_entries.end()) {
+            uncached.push_back(txid);
+        } else {
+            entries.push_back(it->second);
+        }
+    }
+    if (uncached.empty()) return;
+
+    LOCK(m_mempool.cs);
+    for (const uint256& txid : uncached) {
+        const auto it = m_mempool.mapTx.find(txid);
+        if (it == m_mempool.mapTx.end()) {
+            missing.push_back(txid);
+            continue;
+        }
+        const Entry entry{txid, it->GetCountWithAncestors(), it->GetFee(), (int32_t)it->GetTxSize()};
+        m_entries.emplace(txid, entry);
+        entries.push_back(entry);
+    }
+}
+
+size_t TxInvOrder::Size() const
+{
+    LOCK(m_mutex);
+    return m_entries.size();
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_TXINVORDER_H
+#define PALLADIUM_TXINVORDER_H
+
+#include <amount.h>
+#include <sync.h>
+#include <txmempool.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <set>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/** How long the ordering data of a transaction is reused before it is read from the mempool again. */
+static constexpr std::chrono::seconds TX_INV_ORDER_REFRESH_INTERVAL{5};
+
+/**
+ * Ordering data of the transactions announced to peers, shared by all of
+ * them.
+ *
+ * Transactions are announced topologically and by fee rate: fewest
+ * ancestors first, then highest fee rate. Comparing two transactions used to
+ * take the mempool lock and look both of them up, for every comparison of
+ * every peer's inventory. Instead, the ancestor count, fee and size of each
+ * transaction are read from the mempool once per refresh interval, under a
+ * single lock for all the transactions a peer has queued that were not read
+ * yet, and every peer orders its inventory on these cached keys. Keys may be
+ * up to one interval stale; only the order of announcements depends on them.
+ */
+class TxInvOrder
+{
+public:
+    struct Entry {
+        uint256 txid;
+        uint64_t ancestors;
+        CAmount fee;
+        int32_t vsize;
+    };
+
+    //! Whether a is announced before b, as CTxMemPool::CompareDepthAndScore.
+    static bool Before(const Entry& a, const Entry& b);
+
+    explicit TxInvOrder(CTxMemPool& mempool, std::chrono::microseconds refresh_interval = TX_INV_ORDER_REFRESH_INTERVAL);
+
+    /**
+     * Append the entries of txids to entries, in no particular order, and the
+     * txids that are no longer in the mempool to missing. The whole cache is
+     * dropped once per refresh interval.
+     */
+    void GetEntries(const std::set<uint256>& txids, std::chrono::microseconds now, std::vector<Entry>& entries, std::vector<uint256>& missing);
+
+    //! Number of transactions cached.
+    size_t Size() const;
+
+private:
+    CTxMemPool& m_mempool;
+    const std::chrono::microseconds m_refresh_interval;
+
+    mutable Mutex m_mutex;
+    std::unordered_map<uint256, Entry, SaltedTxidHasher> m_entries GUARDED_BY(m_mutex);
+    std::chrono::microseconds m_next_refresh GUARDED_BY(m_mutex){0};
+};
+
+#endif // PALLADIUM_TXINVORDER_H
@@ -19,11 +19,13 @@
 #include <util/time.h>
 #include <validationinterface.h>
 
+#include <algorithm>
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp)
-    : tx(_tx), nFee(_nFee), nTxWeight(GetTransactionWeight(*tx)), nUsageSize(RecursiveDynamicUsage(tx)), nTime(_nTime), entryHeight(_entryHeight),
-    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp), m_epoch(0)
+    : tx(_tx), nFee(_nFee), nTime(_nTime), sigOpCost(_sigOpsCost), nTxWeight(GetTransactionWeight(*tx)), nUsageSize(RecursiveDynamicUsage(tx)),
+    entryHeight(_entryHeight), spendsCoinbase(_spendsCoinbase), lockPoints(lp), m_epoch(0)
 {
     nCountWithDescendants = 1;
     nSizeWithDescendants = GetTxSize();
@@ -60,14 +62,16 @@ size_t CTxMemPoolEntry::GetTxSize() const
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
     setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    for (const CTxMemPoolEntry& child : updateIt->GetMemPoolChildrenConst()) {
+        stageEntries.insert(mapTx.iterator_to(child));
+    }
 
     while (!stageEntries.empty()) {
         const txiter cit = *stageEntries.begin();
         setAllDescendants.insert(cit);
         stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
-        for (txiter childEntry : setChildren) {
+        for (const CTxMemPoolEntry& child : cit->GetMemPoolChildrenConst()) {
+            const txiter childEntry = mapTx.iterator_to(child);
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
                 // We've already calculated this one, just add the entries for this set
@@ -107,6 +111,7 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
 void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashesToUpdate)
 {
     AssertLockHeld(cs);
+    NewGeneration();
     // For each entry in vHashesToUpdate, store the set of in-mempool, but not
     // in-vHashesToUpdate transactions, so that we don't have to recalculate
     // descendants when we come across a previously seen entry.
@@ -127,13 +132,14 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         if (it == mapTx.end()) {
             continue;
         }
-        auto iter = mapNextTx.lower_bound(COutPoint(hash, 0));
         // First calculate the children, and update setMemPoolChildren to
         // include them, and update their setMemPoolParents to include this tx.
         // we cache the in-mempool children to avoid duplicate updates
         {
             const auto epoch = GetFreshEpoch();
-            for (; iter != mapNextTx.end() && iter->first->hash == hash; ++iter) {
+            for (uint32_t i = 0; i < it->GetTx().vout.size(); i++) {
+                auto iter = mapNextTx.find(COutPoint(hash, i));
+                if (iter == mapNextTx.end()) continue;
                 const uint256 &childHash = iter->second->GetHash();
                 txiter childIter = mapTx.find(childHash);
                 assert(childIter != mapTx.end());
@@ -142,6 +148,7 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
                 if (!visited(childIter) && !setAlreadyIncluded.count(childHash)) {
                     UpdateChild(it, childIter, true);
                     UpdateParent(childIter, it, true);
+                    if (m_track_clusters) MergeClusters(it, childIter);
                 }
             }
         } // release epoch guard for UpdateForDescendants
@@ -156,8 +163,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 
     if (fSearchForParents) {
         // Get parents of this transaction that are in the mempool
-        // GetMemPoolParents() is only valid for entries in the mempool, so we
-        // iterate mapTx to find parents.
+        // The parents held by an entry are only valid for entries in the
+        // mempool, so we iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             Optional<txiter> piter = GetIter(tx.vin[i].prevout.hash);
             if (piter) {
@@ -171,8 +178,9 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
     } else {
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
-        txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (const CTxMemPoolEntry& parent : entry.GetMemPoolParentsConst()) {
+            parentHashes.insert(mapTx.iterator_to(parent));
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
@@ -195,8 +203,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             return false;
         }
 
-        const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
-        for (txiter phash : setMemPoolParents) {
+        for (const CTxMemPoolEntry& parent : stageit->GetMemPoolParentsConst()) {
+            const txiter phash = mapTx.iterator_to(parent);
             // If this is a new ancestor, add it.
             if (setAncestors.count(phash) == 0) {
                 parentHashes.insert(phash);
@@ -213,10 +221,9 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
-    for (txiter piter : parentIters) {
-        UpdateChild(piter, it, add);
+    for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+        UpdateChild(mapTx.iterator_to(parent), it, add);
     }
     const int64_t updateCount = (add ? 1 : -1);
     const int64_t updateSize = updateCount * it->GetTxSize();
@@ -242,33 +249,44 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
-    for (txiter updateIt : setMemPoolChildren) {
-        UpdateParent(updateIt, it, false);
+    for (const CTxMemPoolEntry& child : it->GetMemPoolChildrenConst()) {
+        UpdateParent(mapTx.iterator_to(child), it, false);
     }
 }
 
 void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
 {
     // For each entry, walk back all ancestors and decrement size associated with this
-    // transaction
+    // transaction. The changes are summed up per remaining transaction first,
+    // so that each of them is modified in mapTx once however many of its
+    // ancestors or descendants are removed together (e.g. by a block), and
+    // transactions that are being removed as well are not updated at all.
+    struct StateUpdate {
+        int64_t size{0};
+        CAmount fee{0};
+        int64_t count{0};
+        int64_t sigops{0};
+    };
+    std::map<txiter, StateUpdate, CompareIteratorByHash> ancestor_updates;
+    std::map<txiter, StateUpdate, CompareIteratorByHash> descendant_updates;
     const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
     if (updateDescendants) {
         // updateDescendants should be true whenever we're not recursively
         // removing a tx and all its descendants, eg when a transaction is
         // confirmed in a block.
-        // Here we only update statistics and not data in mapLinks (which
+        // Here we only update statistics and not the links between entries (which
         // we need to preserve until we're finished with all operations that
         // need to traverse the mempool).
         for (txiter removeIt : entriesToRemove) {
             setEntries setDescendants;
             CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
-            int64_t modifySize = -((int64_t)removeIt->GetTxSize());
-            CAmount modifyFee = -removeIt->GetModifiedFee();
-            int modifySigOps = -removeIt->GetSigOpCost();
             for (txiter dit : setDescendants) {
-                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
+                if (entriesToRemove.count(dit)) continue;
+                StateUpdate& update = ancestor_updates[dit];
+                update.size -= removeIt->GetTxSize();
+                update.fee -= removeIt->GetModifiedFee();
+                update.count -= 1;
+                update.sigops -= removeIt->GetSigOpCost();
             }
         }
     }
@@ -282,21 +300,36 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // should be a bit faster.
         // However, if we happen to be in the middle of processing a reorg, then
         // the mempool can be in an inconsistent state.  In this case, the set
-        // of ancestors reachable via mapLinks will be the same as the set of
+        // of ancestors reachable via the parent links will be the same as the set of
         // ancestors whose packages include this transaction, because when we
         // add a new transaction to the mempool in addUnchecked(), we assume it
         // has no children, and in the case of a reorg where that assumption is
         // false, the in-mempool children aren't linked to the in-block tx's
         // until UpdateTransactionsFromBlock() is called.
         // So if we're being called during a reorg, ie before
-        // UpdateTransactionsFromBlock() has been called, then mapLinks[] will
+        // UpdateTransactionsFromBlock() has been called, then the parent links will
         // differ from the set of mempool parents we'd calculate by searching,
-        // and it's important that we use the mapLinks[] notion of ancestor
+        // and it's important that we use the parent links' notion of ancestor
         // transactions as the set of things to update for removal.
         CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-        // Note that UpdateAncestorsOf severs the child links that point to
-        // removeIt in the entries for the parents of removeIt.
-        UpdateAncestorsOf(false, removeIt, setAncestors);
+        for (txiter ancestorIt : setAncestors) {
+            if (entriesToRemove.count(ancestorIt)) continue;
+            StateUpdate& update = descendant_updates[ancestorIt];
+            update.size -= removeIt->GetTxSize();
+            update.fee -= removeIt->GetModifiedFee();
+            update.count -= 1;
+        }
+        // Sever the child links that point to removeIt in the entries for
+        // the parents of removeIt.
+        for (const CTxMemPoolEntry& parent : removeIt->GetMemPoolParentsConst()) {
+            UpdateChild(mapTx.iterator_to(parent), removeIt, false);
+        }
+    }
+    for (const auto& update : ancestor_updates) {
+        mapTx.modify(update.first, update_ancestor_state(update.second.size, update.second.fee, update.second.count, update.second.sigops));
+    }
+    for (const auto& update : descendant_updates) {
+        mapTx.modify(update.first, update_descendant_state(update.second.size, update.second.fee, update.second.count));
     }
     // After updating all the ancestor sizes, we can now sever the link between each
     // transaction being removed and any mempool children (ie, update setMemPoolParents
@@ -326,6 +359,18 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
     assert(int(nSigOpCostWithAncestors) >= 0);
 }
 
+namespace {
+//! Lower ends of the fee histogram's ranges, in sat/vB
+const CAmount FEE_HISTOGRAM_BOUNDS[] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 12, 14, 17, 20, 25, 30, 40, 50, 60, 70, 80, 100,
+    120, 140, 170, 200, 250, 300, 400, 500, 600, 700, 800, 1000, 1200, 1400, 1700,
+    2000, 2500, 3000, 4000, 5000, 6000, 7000, 8000, 10000,
+};
+
+//! Last generation handed out to any mempool
+std::atomic<uint64_t> g_last_mempool_generation{0};
+} // namespace
+
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator)
     : nTransactionsUpdated(0), minerPolicyEstimator(estimator), m_epoch(0), m_has_epoch_guard(false)
 {
@@ -337,6 +382,11 @@ CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator)
     nCheckFrequency = 0;
 }
 
+void CTxMemPool::NewGeneration()
+{
+    m_generation = ++g_last_mempool_generation;
+}
+
 bool CTxMemPool::isSpent(const COutPoint& outpoint) const
 {
     LOCK(cs);
@@ -358,8 +408,8 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     // Add to memory pool without checking anything.
     // Used by AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
+    NewGeneration();
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -392,11 +442,22 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     for (const auto& pit : GetIterSet(setParentTransactions)) {
             UpdateParent(newit, pit, true);
     }
+    if (m_track_clusters) {
+        m_clusters.emplace_back();
+        m_clusters.back().txs.push_back(newit);
+        m_tx_clusters.emplace(newit, std::prev(m_clusters.end()));
+        MarkClusterDirty(std::prev(m_clusters.end()));
+        for (const CTxMemPoolEntry& parent : newit->GetMemPoolParentsConst()) {
+            MergeClusters(newit, mapTx.iterator_to(parent));
+        }
+    }
     UpdateAncestorsOf(true, newit, setAncestors);
     UpdateEntryForAncestors(newit, setAncestors);
 
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
+    m_total_fee += entry.GetFee();
+    UpdateFeeHistogram(entry, /* remove */ false);
     if (minerPolicyEstimator) {minerPolicyEstimator->processTransaction(entry, validFeeEstimate);}
 
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
@@ -405,12 +466,16 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
+    // Removals for a block take a sequence number as well, so that the
+    // notifications that follow the block are ordered after it.
+    const uint64_t mempool_sequence = GetAndIncrementSequence();
+    NewGeneration();
     if (reason != MemPoolRemovalReason::BLOCK) {
         // Notify clients that a transaction has been removed from the mempool
         // for any reason except being included in a block. Clients interested
         // in transactions included in blocks can subscribe to the BlockConnected
         // notification.
-        GetMainSignals().TransactionRemovedFromMempool(it->GetSharedTx(), reason);
+        GetMainSignals().TransactionRemovedFromMempool(it->GetSharedTx(), reason, mempool_sequence);
     }
 
     const uint256 hash = it->GetTx().GetHash();
@@ -427,9 +492,18 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
         vTxHashes.clear();
 
     totalTxSize -= it->GetTxSize();
+    m_total_fee -= it->GetFee();
+    UpdateFeeHistogram(*it, /* remove */ true);
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
-    mapLinks.erase(it);
+    cachedInnerUsage -= memusage::DynamicUsage(it->GetMemPoolParentsConst()) + memusage::DynamicUsage(it->GetMemPoolChildrenConst());
+    if (m_track_clusters) {
+        // The rest of the cluster may fall apart; RefreshClusters will split it.
+        const auto cluster_it = m_tx_clusters.find(it);
+        const auto cluster = cluster_it->second;
+        cluster->txs.erase(std::find(cluster->txs.begin(), cluster->txs.end(), it));
+        MarkClusterDirty(cluster);
+        m_tx_clusters.erase(cluster_it);
+    }
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
@@ -455,8 +529,8 @@ void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants
         setDescendants.insert(it);
         stage.erase(it);
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
-        for (txiter childiter : setChildren) {
+        for (const CTxMemPoolEntry& child : it->GetMemPoolChildrenConst()) {
+            const txiter childiter = mapTx.iterator_to(child);
             if (!setDescendants.count(childiter)) {
                 stage.insert(childiter);
             }
@@ -494,7 +568,7 @@ void CTxMemPool::removeRecursive(const CTransaction &origTx, MemPoolRemovalReaso
         RemoveStaged(setAllRemoves, false, reason);
 }
 
-void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags)
+void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags, bool only_invalid_lock_points)
 {
     // Remove transactions spending a coinbase which are now immature and no-longer-final transactions
     AssertLockHeld(cs);
@@ -503,6 +577,7 @@ void CTxMemPool::removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMem
         const CTransaction& tx = it->GetTx();
         LockPoints lp = it->GetLockPoints();
         bool validLP =  TestLockPointValidity(&lp);
+        if (validLP && only_invalid_lock_points) continue;
         if (!CheckFinalTx(tx, flags) || !CheckSequenceLocks(*this, tx, flags, &lp, validLP)) {
             // Note if CheckSequenceLocks fails the LockPoints may still be invalid
             // So it's critical that we remove the tx and not depend on the LockPoints.
@@ -565,32 +640,73 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     }
     // Before the txs in the new block have been removed from the mempool, update policy estimates
     if (minerPolicyEstimator) {minerPolicyEstimator->processBlock(nBlockHeight, entries);}
+
+    // Work out everything the block removes before changing any state, so
+    // that the remaining transactions are updated once for the whole block.
+    setEntries confirmed;
+    for (const CTxMemPoolEntry* entry : entries) {
+        confirmed.insert(mapTx.iterator_to(*entry));
+    }
+    setEntries conflicts;
     for (const auto& tx : vtx)
     {
-        txiter it = mapTx.find(tx->GetHash());
-        if (it != mapTx.end()) {
-            setEntries stage;
-            stage.insert(it);
-            RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
+        for (const CTxIn &txin : tx->vin) {
+            auto it = mapNextTx.find(txin.prevout);
+            if (it != mapNextTx.end() && *it->second != *tx) {
+                ClearPrioritisation(it->second->GetHash());
+                CalculateDescendants(mapTx.find(it->second->GetHash()), conflicts);
+            }
         }
-        removeConflicts(*tx);
         ClearPrioritisation(tx->GetHash());
     }
+
+    // Conflicts may descend from confirmed transactions, but not the other
+    // way around, so the confirmed ones go first.
+    RemoveStaged(confirmed, true, MemPoolRemovalReason::BLOCK);
+    RemoveStaged(conflicts, false, MemPoolRemovalReason::CONFLICT);
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = true;
 }
 
+void CTxMemPool::UpdateFeeHistogram(const CTxMemPoolEntry& entry, bool remove)
+{
+    const CAmount feerate = CFeeRate(entry.GetFee(), entry.GetTxSize()).GetFeePerK();
+    auto it = std::upper_bound(m_fee_histogram.begin(), m_fee_histogram.end(), feerate,
+        [](CAmount rate, const FeeHistogramBucket& bucket) { return rate < bucket.min_feerate.GetFeePerK(); });
+    if (it != m_fee_histogram.begin()) --it;
+    FeeHistogramBucket& totals = *it;
+    if (remove) {
+        totals.count--;
+        totals.vsize -= entry.GetTxSize();
+        totals.fees -= entry.GetFee();
+    } else {
+        totals.count++;
+        totals.vsize += entry.GetTxSize();
+        totals.fees += entry.GetFee();
+    }
+}
+
 void CTxMemPool::_clear()
 {
-    mapLinks.clear();
+    m_tx_clusters.clear();
+    m_chunks.clear();
+    m_dirty_clusters.clear();
+    m_clusters.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
+    m_total_fee = 0;
+    m_fee_histogram.clear();
+    for (const CAmount bound : FEE_HISTOGRAM_BOUNDS) {
+        m_fee_histogram.emplace_back();
+        m_fee_histogram.back().min_feerate = CFeeRate(bound * 1000);
+    }
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    NewGeneration();
 }
 
 void CTxMemPool::clear()
@@ -620,6 +736,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     LogPrint(BCLog::MEMPOOL, "Checking mempool with %u transactions and %u inputs\n", (unsigned int)mapTx.size(), (unsigned int)mapNextTx.size());
 
     uint64_t checkTotal = 0;
+    CAmount check_total_fee{0};
     uint64_t innerUsage = 0;
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
@@ -629,14 +746,12 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
         unsigned int i = 0;
         checkTotal += it->GetTxSize();
+        check_total_fee += it->GetFee();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
-        txlinksMap::const_iterator linksiter = mapLinks.find(it);
-        assert(linksiter != mapLinks.end());
-        const TxLinks &links = linksiter->second;
-        innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
+        innerUsage += memusage::DynamicUsage(it->GetMemPoolParentsConst()) + memusage::DynamicUsage(it->GetMemPoolChildrenConst());
         bool fDependsWait = false;
-        setEntries setParentCheck;
+        CTxMemPoolEntry::Parents setParentCheck;
         for (const CTxIn &txin : tx.vin) {
             // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
             indexed_transaction_set::const_iterator it2 = mapTx.find(txin.prevout.hash);
@@ -644,7 +759,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 const CTransaction& tx2 = it2->GetTx();
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
                 fDependsWait = true;
-                setParentCheck.insert(it2);
+                setParentCheck.insert(*it2);
             } else {
                 assert(pcoins->HaveCoin(txin.prevout));
             }
@@ -655,7 +770,19 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second == &tx);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        // Verify that the parents are the same, comparing the entries they
+        // point to (std::reference_wrapper has no operator==).
+        assert(setParentCheck.size() == it->GetMemPoolParentsConst().size());
+        assert(std::equal(setParentCheck.begin(), setParentCheck.end(), it->GetMemPoolParentsConst().begin(),
+            [](const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) { return &a == &b; }));
+        if (m_track_clusters) {
+            // Linked transactions are in the same cluster, which contains each of them once.
+            const auto cluster = m_tx_clusters.at(it);
+            assert(std::count(cluster->txs.begin(), cluster->txs.end(), it) == 1);
+            for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+                assert(m_tx_clusters.at(mapTx.iterator_to(parent)) == cluster);
+            }
+        }
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -678,17 +805,20 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(it->GetModFeesWithAncestors() == nFeesCheck);
 
         // Check children against mapNextTx
-        CTxMemPool::setEntries setChildrenCheck;
-        auto iter = mapNextTx.lower_bound(COutPoint(it->GetTx().GetHash(), 0));
+        CTxMemPoolEntry::Children setChildrenCheck;
         uint64_t child_sizes = 0;
-        for (; iter != mapNextTx.end() && iter->first->hash == it->GetTx().GetHash(); ++iter) {
+        for (uint32_t n = 0; n < tx.vout.size(); n++) {
+            auto iter = mapNextTx.find(COutPoint(tx.GetHash(), n));
+            if (iter == mapNextTx.end()) continue;
             txiter childit = mapTx.find(iter->second->GetHash());
             assert(childit != mapTx.end()); // mapNextTx points to in-mempool transactions
-            if (setChildrenCheck.insert(childit).second) {
+            if (setChildrenCheck.insert(*childit).second) {
                 child_sizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        assert(setChildrenCheck.size() == it->GetMemPoolChildrenConst().size());
+        assert(std::equal(setChildrenCheck.begin(), setChildrenCheck.end(), it->GetMemPoolChildrenConst().begin(),
+            [](const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) { return &a == &b; }));
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= child_sizes + it->GetTxSize());
@@ -720,7 +850,26 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(&tx == it->second);
     }
 
+    if (m_track_clusters) {
+        size_t cluster_txs = 0;
+        for (const Cluster& cluster : m_clusters) {
+            cluster_txs += cluster.txs.size();
+        }
+        assert(cluster_txs == mapTx.size());
+    }
+
     assert(totalTxSize == checkTotal);
+    assert(m_total_fee == check_total_fee);
+    uint64_t histogram_count{0}, histogram_vsize{0};
+    CAmount histogram_fees{0};
+    for (const FeeHistogramBucket& bucket : m_fee_histogram) {
+        histogram_count += bucket.count;
+        histogram_vsize += bucket.vsize;
+        histogram_fees += bucket.fees;
+    }
+    assert(histogram_count == mapTx.size());
+    assert(histogram_vsize == totalTxSize);
+    assert(histogram_fees == m_total_fee);
     assert(innerUsage == cachedInnerUsage);
 }
 
@@ -826,6 +975,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
         delta += nFeeDelta;
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
+            NewGeneration();
             mapTx.modify(it, update_fee_delta(delta));
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
@@ -842,6 +992,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
             for (txiter descendantIt : setDescendants) {
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
+            if (m_track_clusters) MarkClusterDirty(m_tx_clusters.at(it));
             ++nTransactionsUpdated;
         }
     }
@@ -910,13 +1061,61 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
             return false;
         }
     }
+    const auto it = m_temp_added.find(outpoint);
+    if (it != m_temp_added.end()) {
+        coin = it->second;
+        return true;
+    }
     return base->GetCoin(outpoint, coin);
 }
 
+void CCoinsViewMemPool::GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const {
+    // Answered from the mempool where GetCoin would be, the rest all at once from the base view
+    coins.resize(outpoints.size());
+    std::vector<bool> unknown(outpoints.size());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        const COutPoint& outpoint = outpoints[i];
+        CTransactionRef ptx = mempool.get(outpoint.hash);
+        if (ptx) {
+            if (outpoint.n < ptx->vout.size()) {
+                coins[i] = Coin(ptx->vout[outpoint.n], MEMPOOL_HEIGHT, false);
+            } else {
+                coins[i].Clear();
+            }
+            continue;
+        }
+        const auto it = m_temp_added.find(outpoint);
+        if (it != m_temp_added.end()) {
+            coins[i] = it->second;
+        } else {
+            unknown[i] = true;
+        }
+    }
+    GetCoinsFromBase(outpoints, coins, unknown);
+}
+
+void CCoinsViewMemPool::PackageAddTransaction(const CTransactionRef& tx)
+{
+    for (uint32_t n = 0; n < tx->vout.size(); ++n) {
+        m_temp_added.emplace(COutPoint(tx->GetHash(), n), Coin(tx->vout[n], MEMPOOL_HEIGHT, false));
+    }
+}
+
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    // Each entry of mapTx is one allocated node, holding the entry and the
+    // links of all four indexes. The hashed index also allocates one pointer
+    // per bucket, plus one for its end marker.
+    const size_t map_tx_usage = memusage::MallocUsage(sizeof(indexed_transaction_set::final_node_type)) * mapTx.size() +
+        memusage::MallocUsage(sizeof(void*) * (mapTx.bucket_count() + 1));
+    size_t cluster_usage = 0;
+    if (m_track_clusters) {
+        // Estimate each transaction to be in one cluster and one chunk vector,
+        // to avoid walking all clusters.
+        cluster_usage = memusage::MallocUsage(sizeof(Cluster) + 2 * sizeof(void*)) * m_clusters.size() + 2 * sizeof(txiter) * mapTx.size() +
+            sizeof(Chunk) * m_chunks.size() + memusage::DynamicUsage(m_chunks) + memusage::DynamicUsage(m_dirty_clusters) + memusage::DynamicUsage(m_tx_clusters);
+    }
+    return map_tx_usage + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage + cluster_usage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -955,40 +1154,24 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, bool validFeeEstimat
 
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
+    CTxMemPoolEntry::Children s;
+    if (add && entry->GetMemPoolChildren().insert(*child).second) {
         cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
+    } else if (!add && entry->GetMemPoolChildren().erase(*child)) {
         cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
     }
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
+    CTxMemPoolEntry::Parents s;
+    if (add && entry->GetMemPoolParents().insert(*parent).second) {
         cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
+    } else if (!add && entry->GetMemPoolParents().erase(*parent)) {
         cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
     }
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
-{
-    assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.parents;
-}
-
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
-{
-    assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.children;
-}
-
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
     LOCK(cs);
     if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
@@ -1027,19 +1210,31 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+        setEntries stage;
+        CFeeRate removed;
+        if (m_track_clusters) {
+            // The lowest feerate chunk is the last one of its cluster, so it
+            // has no descendants outside of it.
+            const Chunk& worst = **GetChunksByFeerate().begin();
+            removed = CFeeRate(worst.fee, worst.size);
+            for (txiter it : worst.txs) {
+                CalculateDescendants(it, stage);
+            }
+            assert(stage.size() == worst.txs.size());
+        } else {
+            indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+            removed = CFeeRate(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+            CalculateDescendants(mapTx.project<0>(it), stage);
+        }
 
         // We set the new mempool min fee to the feerate of the removed set, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
         // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
         // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
         removed += incrementalRelayFee;
         trackPackageRemoved(removed);
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
-        setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
@@ -1064,6 +1259,262 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     }
 }
 
+bool CTxMemPool::CompareChunkByFeerate::operator()(const Chunk* a, const Chunk* b) const
+{
+    // Avoid division by rewriting (a/b < c/d) as (a*d < c*b).
+    double f1 = (double)a->fee * b->size;
+    double f2 = (double)b->fee * a->size;
+    if (f1 != f2) {
+        return f1 < f2;
+    }
+    if (a->cluster != b->cluster) {
+        return std::less<const Cluster*>()(a->cluster, b->cluster);
+    }
+    return a->pos > b->pos;
+}
+
+void CTxMemPool::SetTrackClusters(bool track)
+{
+    AssertLockHeld(cs);
+    assert(mapTx.empty());
+    m_track_clusters = track;
+}
+
+void CTxMemPool::MarkClusterDirty(std::list<Cluster>::iterator cluster) const
+{
+    AssertLockHeld(cs);
+    if (cluster->dirty) return;
+    for (const Chunk& chunk : cluster->chunks) {
+        m_chunks.erase(&chunk);
+    }
+    cluster->chunks.clear();
+    cluster->dirty = true;
+    m_dirty_clusters.push_back(cluster);
+}
+
+void CTxMemPool::MergeClusters(txiter a, txiter b)
+{
+    AssertLockHeld(cs);
+    auto into = m_tx_clusters.at(a);
+    auto from = m_tx_clusters.at(b);
+    if (into == from) return;
+    if (into->txs.size() < from->txs.size()) std::swap(into, from);
+    for (txiter it : from->txs) {
+        m_tx_clusters.at(it) = into;
+        into->txs.push_back(it);
+    }
+    // Leave the empty cluster to RefreshClusters, m_dirty_clusters may refer to it.
+    from->txs.clear();
+    MarkClusterDirty(from);
+    MarkClusterDirty(into);
+}
+
+void CTxMemPool::RefreshClusters() const
+{
+    AssertLockHeld(cs);
+    for (const auto cluster : m_dirty_clusters) {
+        cluster->dirty = false;
+        if (cluster->txs.empty()) {
+            m_clusters.erase(cluster);
+            continue;
+        }
+        // Transactions may have been removed since the cluster was last
+        // linearized. Keep the first connected component in this cluster
+        // and move any others into new ones.
+        std::vector<txiter> txs;
+        txs.swap(cluster->txs);
+        std::vector<std::list<Cluster>::iterator> components;
+        const auto epoch = GetFreshEpoch();
+        for (txiter start : txs) {
+            if (visited(start)) continue;
+            if (components.empty()) {
+                components.push_back(cluster);
+            } else {
+                m_clusters.emplace_back();
+                components.push_back(std::prev(m_clusters.end()));
+            }
+            Cluster& component = *components.back();
+            std::vector<txiter> stack{start};
+            while (!stack.empty()) {
+                const txiter it = stack.back();
+                stack.pop_back();
+                component.txs.push_back(it);
+                m_tx_clusters.at(it) = components.back();
+                for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+                    const txiter parent_it = mapTx.iterator_to(parent);
+                    if (!visited(parent_it)) stack.push_back(parent_it);
+                }
+                for (const CTxMemPoolEntry& child : it->GetMemPoolChildrenConst()) {
+                    const txiter child_it = mapTx.iterator_to(child);
+                    if (!visited(child_it)) stack.push_back(child_it);
+                }
+            }
+        }
+        for (const auto component : components) {
+            LinearizeCluster(*component);
+            for (const Chunk& chunk : component->chunks) {
+                m_chunks.insert(&chunk);
+            }
+        }
+    }
+    m_dirty_clusters.clear();
+}
+
+void CTxMemPool::LinearizeCluster(Cluster& cluster) const
+{
+    AssertLockHeld(cs);
+    const size_t count = cluster.txs.size();
+
+    // Put the transactions in topological order, so that ancestors of a
+    // transaction always come before it.
+    std::map<txiter, size_t, CompareIteratorByHash> index;
+    for (size_t i = 0; i < count; ++i) {
+        index.emplace(cluster.txs[i], i);
+    }
+    std::vector<size_t> num_parents(count);
+    std::vector<std::vector<size_t>> children(count);
+    std::vector<size_t> order;
+    order.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        for (const CTxMemPoolEntry& parent : cluster.txs[i]->GetMemPoolParentsConst()) {
+            children[index.at(mapTx.iterator_to(parent))].push_back(i);
+            ++num_parents[i];
+        }
+        if (num_parents[i] == 0) order.push_back(i);
+    }
+    for (size_t k = 0; k < order.size(); ++k) {
+        for (size_t child : children[order[k]]) {
+            if (--num_parents[child] == 0) order.push_back(child);
+        }
+    }
+    assert(order.size() == count);
+    std::vector<txiter> txs(count);
+    std::vector<size_t> pos(count);
+    for (size_t k = 0; k < count; ++k) {
+        txs[k] = cluster.txs[order[k]];
+        pos[order[k]] = k;
+    }
+
+    // Ancestors within the cluster as bitsets over positions in txs, and the
+    // fee and size of each transaction together with its ancestors.
+    const size_t words = (count + 63) / 64;
+    std::vector<std::vector<uint64_t>> ancestors(count, std::vector<uint64_t>(words));
+    auto is_ancestor = [&](size_t k, size_t j) { return (ancestors[k][j / 64] >> (j % 64)) & 1; };
+    std::vector<CAmount> fee_with_ancestors(count);
+    std::vector<uint64_t> size_with_ancestors(count);
+    for (size_t k = 0; k < count; ++k) {
+        for (const CTxMemPoolEntry& parent : txs[k]->GetMemPoolParentsConst()) {
+            const size_t j = pos[index.at(mapTx.iterator_to(parent))];
+            for (size_t w = 0; w < words; ++w) {
+                ancestors[k][w] |= ancestors[j][w];
+            }
+            ancestors[k][j / 64] |= uint64_t{1} << (j % 64);
+        }
+        fee_with_ancestors[k] = txs[k]->GetModifiedFee();
+        size_with_ancestors[k] = txs[k]->GetTxSize();
+        for (size_t j = 0; j < k; ++j) {
+            if (is_ancestor(k, j)) {
+                fee_with_ancestors[k] += txs[j]->GetModifiedFee();
+                size_with_ancestors[k] += txs[j]->GetTxSize();
+            }
+        }
+    }
+
+    // Repeatedly pick the remaining transaction with the best feerate
+    // together with its remaining ancestors, like block assembly does.
+    std::vector<bool> done(count);
+    std::vector<size_t> linearization;
+    linearization.reserve(count);
+    while (linearization.size() < count) {
+        size_t best = count;
+        for (size_t k = 0; k < count; ++k) {
+            if (done[k]) continue;
+            if (best == count || (double)fee_with_ancestors[k] * size_with_ancestors[best] > (double)fee_with_ancestors[best] * size_with_ancestors[k]) {
+                best = k;
+            }
+        }
+        const size_t picked_begin = linearization.size();
+        for (size_t j = 0; j < best; ++j) {
+            if (!done[j] && is_ancestor(best, j)) linearization.push_back(j);
+        }
+        linearization.push_back(best);
+        for (size_t i = picked_begin; i < linearization.size(); ++i) {
+            done[linearization[i]] = true;
+        }
+        for (size_t k = 0; k < count; ++k) {
+            if (done[k]) continue;
+            for (size_t i = picked_begin; i < linearization.size(); ++i) {
+                const size_t j = linearization[i];
+                if (is_ancestor(k, j)) {
+                    fee_with_ancestors[k] -= txs[j]->GetModifiedFee();
+                    size_with_ancestors[k] -= txs[j]->GetTxSize();
+                }
+            }
+        }
+    }
+
+    // Group the linearization into chunks: merge each chunk into the one
+    // before it for as long as it has a higher feerate.
+    std::vector<Chunk>& chunks = cluster.chunks;
+    chunks.clear();
+    for (size_t k : linearization) {
+        chunks.emplace_back();
+        chunks.back().txs.push_back(txs[k]);
+        chunks.back().fee = txs[k]->GetModifiedFee();
+        chunks.back().size = txs[k]->GetTxSize();
+        chunks.back().sigop_cost = txs[k]->GetSigOpCost();
+        while (chunks.size() > 1) {
+            Chunk& last = chunks.back();
+            Chunk& prev = chunks[chunks.size() - 2];
+            if ((double)last.fee * prev.size <= (double)prev.fee * last.size) break;
+            prev.txs.insert(prev.txs.end(), last.txs.begin(), last.txs.end());
+            prev.fee += last.fee;
+            prev.size += last.size;
+            prev.sigop_cost += last.sigop_cost;
+            chunks.pop_back();
+        }
+    }
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        chunks[i].cluster = &cluster;
+        chunks[i].pos = i;
+    }
+}
+
+const CTxMemPool::setChunks& CTxMemPool::GetChunksByFeerate() const
+{
+    AssertLockHeld(cs);
+    assert(m_track_clusters);
+    RefreshClusters();
+    return m_chunks;
+}
+
+uint64_t CTxMemPool::CalculateClusterSize(const setEntries& entries, uint64_t limit) const
+{
+    AssertLockHeld(cs);
+    // Walk the links instead of reading the clusters, which may not have
+    // been split since transactions were removed.
+    uint64_t count = 0;
+    std::vector<txiter> stack;
+    const auto epoch = GetFreshEpoch();
+    for (txiter it : entries) {
+        if (!visited(it)) stack.push_back(it);
+    }
+    while (!stack.empty() && count < limit) {
+        const txiter it = stack.back();
+        stack.pop_back();
+        ++count;
+        for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+            const txiter parent_it = mapTx.iterator_to(parent);
+            if (!visited(parent_it)) stack.push_back(parent_it);
+        }
+        for (const CTxMemPoolEntry& child : it->GetMemPoolChildrenConst()) {
+            const txiter child_it = mapTx.iterator_to(child);
+            if (!visited(child_it)) stack.push_back(child_it);
+        }
+    }
+    return count;
+}
+
 uint64_t CTxMemPool::CalculateDescendantMaximum(txiter entry) const {
     // find parent with highest descendant count
     std::vector<txiter> candidates;
@@ -1074,12 +1525,12 @@ uint64_t CTxMemPool::CalculateDescendantMaximum(txiter entry) const {
         txiter candidate = candidates.back();
         candidates.pop_back();
         if (!counted.insert(candidate).second) continue;
-        const setEntries& parents = GetMemPoolParents(candidate);
+        const CTxMemPoolEntry::Parents& parents = candidate->GetMemPoolParentsConst();
         if (parents.size() == 0) {
             maximum = std::max(maximum, candidate->GetCountWithDescendants());
         } else {
-            for (txiter i : parents) {
-                candidates.push_back(i);
+            for (const CTxMemPoolEntry& i : parents) {
+                candidates.push_back(mapTx.iterator_to(i));
             }
         }
     }
@@ -7,6 +7,8 @@
 #define PALLADIUM_TXMEMPOOL_H
 
 #include <atomic>
+#include <functional>
+#include <list>
 #include <map>
 #include <set>
 #include <string>
@@ -49,6 +51,21 @@ struct LockPoints
     LockPoints() : height(0), time(0), maxInputBlock(nullptr) { }
 };
 
+struct CompareIteratorByHash {
+    // SFINAE for T where T is either a pointer type (e.g., a txiter) or a reference_wrapper<T>
+    // (e.g. a wrapped CTxMemPoolEntry&)
+    template <typename T>
+    bool operator()(const std::reference_wrapper<T>& a, const std::reference_wrapper<T>& b) const
+    {
+        return a.get().GetTx().GetHash() < b.get().GetTx().GetHash();
+    }
+    template <typename T>
+    bool operator()(const T& a, const T& b) const
+    {
+        return a->GetTx().GetHash() < b->GetTx().GetHash();
+    }
+};
+
 /** \class CTxMemPoolEntry
  *
  * CTxMemPoolEntry stores data about the corresponding transaction, as well
@@ -59,19 +76,31 @@ struct LockPoints
  * (nCountWithDescendants, nSizeWithDescendants, and nModFeesWithDescendants) for
  * all ancestors of the newly added transaction.
  *
+ * The entry also holds its in-mempool parents and children, so that walking
+ * the transaction graph doesn't need a lookup in a separate map. Fields are
+ * ordered to keep the padding between them small.
+ *
  */
 
 class CTxMemPoolEntry
 {
+public:
+    typedef std::reference_wrapper<const CTxMemPoolEntry> CTxMemPoolEntryRef;
+    // two aliases, should the types ever diverge
+    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash> Parents;
+    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash> Children;
+
 private:
     const CTransactionRef tx;
+    mutable Parents m_parents;
+    mutable Children m_children;
     const CAmount nFee;             //!< Cached to avoid expensive parent-transaction lookups
-    const size_t nTxWeight;         //!< ... and avoid recomputing tx weight (also used for GetTxSize())
-    const size_t nUsageSize;        //!< ... and total memory usage
     const int64_t nTime;            //!< Local time when entering the mempool
+    const int64_t sigOpCost;        //!< Total sigop cost
+    const int32_t nTxWeight;        //!< ... and avoid recomputing tx weight (also used for GetTxSize())
+    const uint32_t nUsageSize;      //!< ... and total memory usage
     const unsigned int entryHeight; //!< Chain height when entering the mempool
     const bool spendsCoinbase;      //!< keep track of transactions that spend a coinbase
-    const int64_t sigOpCost;        //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
 
@@ -127,6 +156,11 @@ public:
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
+    const Parents& GetMemPoolParentsConst() const { return m_parents; }
+    const Children& GetMemPoolChildrenConst() const { return m_children; }
+    Parents& GetMemPoolParents() const { return m_parents; }
+    Children& GetMemPoolChildren() const { return m_children; }
+
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
     mutable uint64_t m_epoch; //!< epoch when last touched, useful for graph algorithms
 };
@@ -342,6 +376,17 @@ struct TxMempoolInfo
     int64_t nFeeDelta;
 };
 
+/** Mempool transactions paying a fee rate in [min_feerate, the next bucket's min_feerate). */
+struct FeeHistogramBucket
+{
+    CFeeRate min_feerate;
+    uint64_t count{0};
+    //! Sum of the virtual sizes
+    uint64_t vsize{0};
+    //! Sum of the fees (NOT modified fees)
+    CAmount fees{0};
+};
+
 /** Reason why a transaction was removed from the mempool,
  * this is passed to the notification signal.
  */
@@ -395,8 +440,9 @@ public:
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
- * each CTxMemPoolEntry, we track the size and fees of all descendants.
+ * the set of in-mempool direct parents and direct children in each
+ * CTxMemPoolEntry.  Within each CTxMemPoolEntry, we also track the size and
+ * fees of all descendants.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
  * children (because any such children would be an orphan).  So in
@@ -428,7 +474,7 @@ public:
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * the parent and child links may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -439,6 +485,18 @@ public:
  * CalculateMemPoolAncestors() takes configurable limits that are designed to
  * prevent these calculations from being too CPU intensive.
  *
+ * Clusters:
+ *
+ * Optionally (SetTrackClusters()), the mempool also groups transactions into
+ * clusters, the connected components of the transaction graph. It linearizes
+ * each cluster: it orders the transactions so that every prefix is valid to
+ * mine, and groups them into chunks of decreasing feerate. Adding and
+ * removing transactions only marks their clusters dirty; dirty clusters are
+ * split and linearized again the next time the chunks are needed. Block
+ * assembly and TrimToSize() then read the chunk order instead of walking
+ * ancestor and descendant sets. Cluster sizes are bounded by policy
+ * (-limitclustercount), as linearization is quadratic in the cluster size.
+ *
  */
 class CTxMemPool
 {
@@ -449,6 +507,10 @@ private:
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
+    CAmount m_total_fee{0};    //!< sum of all mempool tx's fees (NOT modified fee)
+    std::vector<FeeHistogramBucket> m_fee_histogram GUARDED_BY(cs); //!< fee rate histogram, see GetFeeHistogram()
+    uint64_t m_sequence_number GUARDED_BY(cs){1}; //!< counts additions and removals, see GetSequence()
+    uint64_t m_generation GUARDED_BY(cs){0}; //!< changes with the entries, their links and fees, see GetGeneration()
 
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
@@ -457,6 +519,7 @@ private:
     mutable bool m_has_epoch_guard;
 
     void trackPackageRemoved(const CFeeRate& rate) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void NewGeneration() EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     bool m_is_loaded GUARDED_BY(cs){false};
 
@@ -523,34 +586,66 @@ public:
     using txiter = indexed_transaction_set::nth_index<0>::type::const_iterator;
     std::vector<std::pair<uint256, txiter>> vTxHashes GUARDED_BY(cs); //!< All tx witness hashes/entries in mapTx, in random order
 
-    struct CompareIteratorByHash {
-        bool operator()(const txiter &a, const txiter &b) const {
-            return a->GetTx().GetHash() < b->GetTx().GetHash();
-        }
-    };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
-    const setEntries & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
-private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
-    struct TxLinks {
-        setEntries parents;
-        setEntries children;
+    struct Cluster;
+
+    /**
+     * Consecutive transactions of a cluster's linearization. A chunk together
+     * with the chunks before it contains all its ancestors, so chunks can be
+     * mined in order and the last chunk can be evicted as a whole.
+     */
+    struct Chunk {
+        std::vector<txiter> txs;
+        CAmount fee{0};          //!< Sum of modified fees
+        uint64_t size{0};        //!< Sum of virtual sizes
+        int64_t sigop_cost{0};   //!< Sum of sigop costs
+        const Cluster* cluster{nullptr};
+        size_t pos{0};           //!< Position in the cluster's linearization
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    /** Sort chunks by increasing feerate; later chunks of a cluster sort first on ties. */
+    struct CompareChunkByFeerate {
+        bool operator()(const Chunk* a, const Chunk* b) const;
+    };
+    typedef std::set<const Chunk*, CompareChunkByFeerate> setChunks;
+
+    /** A connected component of the transaction graph, with its linearization cached. */
+    struct Cluster {
+        std::vector<txiter> txs;   //!< In no particular order
+        std::vector<Chunk> chunks; //!< Decreasing feerate; empty while dirty
+        bool dirty{false};
+    };
+private:
+    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    bool m_track_clusters GUARDED_BY(cs){false};
+    //! Clusters are linearized on demand, so these are mutable caches.
+    mutable std::list<Cluster> m_clusters GUARDED_BY(cs);
+    //! The cluster of each transaction. Clusters are split lazily, so until the next
+    //! RefreshClusters() one may also hold transactions no longer connected to the others.
+    mutable std::map<txiter, std::list<Cluster>::iterator, CompareIteratorByHash> m_tx_clusters GUARDED_BY(cs);
+    //! Clusters that were modified since they were last linearized.
+    mutable std::vector<std::list<Cluster>::iterator> m_dirty_clusters GUARDED_BY(cs);
+    //! The chunks of all clusters that are not dirty.
+    mutable setChunks m_chunks GUARDED_BY(cs);
+
+    void MarkClusterDirty(std::list<Cluster>::iterator cluster) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Put the clusters of a and b together, after a link between them was added. */
+    void MergeClusters(txiter a, txiter b) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Split dirty clusters into their connected components and linearize them again. */
+    void RefreshClusters() const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void LinearizeCluster(Cluster& cluster) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
 public:
-    indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
+    indirectunorderedmap<COutPoint, const CTransaction*, SaltedOutpointHasher> mapNextTx GUARDED_BY(cs);
     std::map<uint256, CAmount> mapDeltas;
 
     /** Create a new CTxMemPool.
@@ -577,7 +672,15 @@ public:
     void addUnchecked(const CTxMemPoolEntry& entry, setEntries& setAncestors, bool validFeeEstimate = true) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
 
     void removeRecursive(const CTransaction& tx, MemPoolRemovalReason reason) EXCLUSIVE_LOCKS_REQUIRED(cs);
-    void removeForReorg(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight, int flags) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
+    /**
+     * Remove the transactions that are no longer final, whose sequence locks
+     * are no longer met or that spend an immature coinbase at nMemPoolHeight.
+     * If the new tip is neither lower nor earlier than the one the mempool was
+     * consistent with, this can only happen to the transactions whose lock
+     * points were computed on a block that is no longer in the chain, and
+     * only_invalid_lock_points checks just those.
+     */
+    void removeForReorg(const CCoinsViewCache* pcoins, unsigned int nMemPoolHeight, int flags, bool only_invalid_lock_points = false) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
     void removeConflicts(const CTransaction& tx) EXCLUSIVE_LOCKS_REQUIRED(cs);
     void removeForBlock(const std::vector<CTransactionRef>& vtx, unsigned int nBlockHeight) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -636,7 +739,7 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
-     *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *    look up parents from the entry. Must be true for entries not in the mempool
      */
     bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString, bool fSearchForParents = true) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -659,6 +762,16 @@ public:
       */
     void TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** Start or stop keeping transactions grouped into linearized clusters. The mempool must be empty. */
+    void SetTrackClusters(bool track) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    bool GetTrackClusters() const EXCLUSIVE_LOCKS_REQUIRED(cs) { return m_track_clusters; }
+
+    /** The chunks of all clusters, lowest feerate first. Requires cluster tracking. */
+    const setChunks& GetChunksByFeerate() const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** Count the transactions in the clusters of the given entries, stopping at limit. */
+    uint64_t CalculateClusterSize(const setEntries& entries, uint64_t limit) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     /** Expire all transaction (and their dependencies) in the mempool older than time. Return the number of removed transactions. */
     int Expire(std::chrono::seconds time) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -686,6 +799,50 @@ public:
         return totalTxSize;
     }
 
+    CAmount GetTotalFee() const
+    {
+        LOCK(cs);
+        return m_total_fee;
+    }
+
+    /**
+     * Transactions by fee rate, in buckets of roughly logarithmic fee rate
+     * ranges from 1 sat/vB to 10000 sat/vB (the first one from 0). Kept up
+     * to date as transactions enter and leave, so this costs no more than
+     * a copy.
+     */
+    std::vector<FeeHistogramBucket> GetFeeHistogram() const
+    {
+        LOCK(cs);
+        return m_fee_histogram;
+    }
+
+    /**
+     * Sequence number of the next mempool addition or removal. Every one of
+     * them takes a number, and the validation interface notifications carry
+     * it, so that those can be ordered against a mempool snapshot.
+     */
+    uint64_t GetSequence() const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        return m_sequence_number;
+    }
+
+    uint64_t GetAndIncrementSequence() EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        return m_sequence_number++;
+    }
+
+    /**
+     * Identifies the current entries, their links and their modified fees,
+     * for caches derived from them. Unlike GetSequence() it is unique across
+     * all mempools, and it also changes on prioritisation and when
+     * UpdateTransactionsFromBlock() links entries.
+     */
+    uint64_t GetGeneration() const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        return m_generation;
+    }
+
     bool exists(const uint256& hash) const
     {
         LOCK(cs);
@@ -735,6 +892,8 @@ private:
      *  removal.
      */
     void removeUnchecked(txiter entry, MemPoolRemovalReason reason) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Count an entry in the fee histogram, or with remove stop counting it */
+    void UpdateFeeHistogram(const CTxMemPoolEntry& entry, bool remove) EXCLUSIVE_LOCKS_REQUIRED(cs);
 public:
     /** EpochGuard: RAII-style guard for using epoch-based graph traversal algorithms.
      *     When walking ancestors or descendants, we generally want to avoid
@@ -800,12 +959,17 @@ public:
  */
 class CCoinsViewMemPool : public CCoinsViewBacked
 {
+    /** Outputs of package transactions that are being validated, and not in the mempool yet. */
+    std::unordered_map<COutPoint, Coin, SaltedOutpointHasher> m_temp_added;
 protected:
     const CTxMemPool& mempool;
 
 public:
     CCoinsViewMemPool(CCoinsView* baseIn, const CTxMemPool& mempoolIn);
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    void GetCoins(const std::vector<COutPoint>& outpoints, std::vector<Coin>& coins) const override;
+    /** Make the outputs of a package transaction available, as if it were in the mempool. */
+    void PackageAddTransaction(const CTransactionRef& tx);
 };
 
 /**
@@ -856,6 +1020,9 @@ struct DisconnectedBlockTransactions {
 
     indexed_disconnected_transactions queuedTx;
     uint64_t cachedInnerUsage = 0;
+    // The tip before the first block was disconnected, which the mempool was
+    // consistent with.
+    const CBlockIndex* pindexOldTip = nullptr;
 
     // Estimate the overhead of queuedTx to be 6 pointers + an allocation, as
     // no exact formula for boost::multi_index_contained is implemented.
@@ -896,6 +1063,7 @@ struct DisconnectedBlockTransactions {
     {
         cachedInnerUsage = 0;
         queuedTx.clear();
+        pindexOldTip = nullptr;
     }
 };
 
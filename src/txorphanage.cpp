@@ -0,0 +1,181 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txorphanage.h>
+
+#include <consensus/validation.h>
+#include <logging.h>
+#include <policy/policy.h>
+#include <util/time.h>
+
+RecursiveMutex g_cs_orphans;
+
+bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
+{
+    AssertLockHeld(g_cs_orphans);
+    const uint256& hash = tx->GetHash();
+    if (m_orphans.count(hash))
+        return false;
+
+    // Ignore big transactions, to avoid a
+    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
+    // large transaction with a missing parent then we assume
+    // it will rebroadcast it later, after the parent transaction(s)
+    // have been mined or received.
+    unsigned int sz = GetTransactionWeight(*tx);
+    if (sz > MAX_STANDARD_TX_WEIGHT)
+    {
+        LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
+        return false;
+    }
+
+    const int64_t expire = GetTime() + ORPHAN_TX_EXPIRE_TIME;
+    auto ret = m_orphans.emplace(hash, OrphanTx{tx, peer, expire, sz});
+    assert(ret.second);
+    for (const CTxIn& txin : tx->vin) {
+        m_outpoint_to_orphans[txin.prevout].insert(ret.first);
+    }
+    m_by_time.emplace(expire, hash);
+    PeerOrphans& peer_orphans = m_peers[peer];
+    peer_orphans.by_time.emplace(expire, hash);
+    peer_orphans.weight += sz;
+    m_total_weight += sz;
+
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u weight %u)\n", hash.ToString(),
+             m_orphans.size(), m_outpoint_to_orphans.size(), m_total_weight);
+    return true;
+}
+
+bool TxOrphanage::HaveTx(const uint256& txid) const
+{
+    AssertLockHeld(g_cs_orphans);
+    return m_orphans.count(txid);
+}
+
+std::pair<CTransactionRef, NodeId> TxOrphanage::GetTx(const uint256& txid) const
+{
+    AssertLockHeld(g_cs_orphans);
+    const auto it = m_orphans.find(txid);
+    if (it == m_orphans.end()) return {nullptr, -1};
+    return {it->second.tx, it->second.fromPeer};
+}
+
+int TxOrphanage::EraseTx(const uint256& txid)
+{
+    AssertLockHeld(g_cs_orphans);
+    OrphanMap::iterator it = m_orphans.find(txid);
+    if (it == m_orphans.end())
+        return 0;
+    for (const CTxIn& txin : it->second.tx->vin)
+    {
+        auto itPrev = m_outpoint_to_orphans.find(txin.prevout);
+        if (itPrev == m_outpoint_to_orphans.end())
+            continue;
+        itPrev->second.erase(it);
+        if (itPrev->second.empty())
+            m_outpoint_to_orphans.erase(itPrev);
+    }
+
+    const std::pair<int64_t, uint256> time_key{it->second.nTimeExpire, txid};
+    m_by_time.erase(time_key);
+    auto peer = m_peers.find(it->second.fromPeer);
+    assert(peer != m_peers.end());
+    peer->second.by_time.erase(time_key);
+    peer->second.weight -= it->second.weight;
+    if (peer->second.by_time.empty()) m_peers.erase(peer);
+    m_total_weight -= it->second.weight;
+
+    m_orphans.erase(it);
+    return 1;
+}
+
+void TxOrphanage::EraseForPeer(NodeId peer)
+{
+    AssertLockHeld(g_cs_orphans);
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end()) return;
+    int nErased = 0;
+    // Erasing the last of the peer's orphans also drops its entry.
+    std::vector<uint256> txids;
+    txids.reserve(it->second.by_time.size());
+    for (const auto& entry : it->second.by_time) txids.push_back(entry.second);
+    for (const uint256& txid : txids) {
+        nErased += EraseTx(txid);
+    }
+    if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased, peer);
+}
+
+void TxOrphanage::EraseForBlock(const CBlock& block)
+{
+    AssertLockHeld(g_cs_orphans);
+    std::vector<uint256> vOrphanErase;
+
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
+
+        // Which orphan pool entries must we evict?
+        for (const auto& txin : tx.vin) {
+            auto itByPrev = m_outpoint_to_orphans.find(txin.prevout);
+            if (itByPrev == m_outpoint_to_orphans.end()) continue;
+            for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
+                vOrphanErase.push_back((*mi)->first);
+            }
+        }
+    }
+
+    // Erase orphan transactions included or precluded by this block
+    if (vOrphanErase.size()) {
+        int nErased = 0;
+        for (const uint256& orphanHash : vOrphanErase) {
+            nErased += EraseTx(orphanHash);
+        }
+        LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx included or conflicted by block\n", nErased);
+    }
+}
+
+unsigned int TxOrphanage::LimitOrphans(size_t max_orphans, size_t max_weight)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    // Orphans all live for the same time, so the expired ones are at the front.
+    int nErased = 0;
+    const int64_t nNow = GetTime();
+    while (!m_by_time.empty() && m_by_time.begin()->first <= nNow) {
+        nErased += EraseTx(m_by_time.begin()->second);
+    }
+    if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
+
+    unsigned int nEvicted = 0;
+    while (m_orphans.size() > max_orphans || m_total_weight > max_weight) {
+        // Evict the oldest orphan of the peer using the most weight.
+        auto heaviest = m_peers.begin();
+        for (auto it = m_peers.begin(); it != m_peers.end(); ++it) {
+            if (it->second.weight > heaviest->second.weight) heaviest = it;
+        }
+        EraseTx(heaviest->second.by_time.begin()->second);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+void TxOrphanage::AddChildrenToWorkSet(const CTransaction& tx, std::set<uint256>& orphan_work_set) const
+{
+    AssertLockHeld(g_cs_orphans);
+    const uint256& txid = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        auto it_by_prev = m_outpoint_to_orphans.find(COutPoint(txid, i));
+        if (it_by_prev != m_outpoint_to_orphans.end()) {
+            for (const auto& elem : it_by_prev->second) {
+                orphan_work_set.insert(elem->first);
+            }
+        }
+    }
+}
+
+size_t TxOrphanage::PeerWeight(NodeId peer) const
+{
+    AssertLockHeld(g_cs_orphans);
+    auto it = m_peers.find(peer);
+    return it == m_peers.end() ? 0 : it->second.weight;
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_TXORPHANAGE_H
+#define PALLADIUM_TXORPHANAGE_H
+
+#include <net.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+
+#include <map>
+#include <set>
+
+/** Guards orphan transactions and extra txs for compact blocks */
+extern RecursiveMutex g_cs_orphans;
+
+/** Expiration time for orphan transactions in seconds */
+static constexpr int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+
+/**
+ * Transactions we received without having their inputs (TX_MISSING_INPUTS),
+ * kept until their parents arrive.
+ *
+ * As orphans can't be told apart from transactions spending outputs that
+ * don't exist, the pool is bounded both in number and in total weight, and
+ * entries expire after ORPHAN_TX_EXPIRE_TIME. Orphans are indexed by expiry
+ * time, overall and per peer, so that expiring them and evicting the oldest
+ * orphan of the peer whose orphans weigh the most don't need a full scan. A
+ * peer flooding us with orphans thus mostly displaces its own.
+ */
+class TxOrphanage
+{
+public:
+    /** Add an orphan received from a peer. Returns false if it is already known or too large. */
+    bool AddTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+    bool HaveTx(const uint256& txid) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+    /** The orphan with the given txid and the peer it came from, or a null transaction. */
+    std::pair<CTransactionRef, NodeId> GetTx(const uint256& txid) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+    /** Erase an orphan. Returns the number of orphans erased (0 or 1). */
+    int EraseTx(const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+    /** Erase the orphans received from a peer (e.g. after it disconnected). */
+    void EraseForPeer(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+    /** Erase the orphans included in or conflicting with a block. */
+    void EraseForBlock(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+    /**
+     * Erase the expired orphans, then evict until at most max_orphans remain
+     * and they weigh at most max_weight in total. Returns the number of
+     * orphans evicted (not counting expired ones).
+     */
+    unsigned int LimitOrphans(size_t max_orphans, size_t max_weight) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+    /** Add the orphans spending outputs of tx to a peer's orphan work set. */
+    void AddChildrenToWorkSet(const CTransaction& tx, std::set<uint256>& orphan_work_set) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    size_t Size() const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) { return m_orphans.size(); }
+    size_t TotalWeight() const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) { return m_total_weight; }
+    /** Total weight of the orphans received from a peer. */
+    size_t PeerWeight(NodeId peer) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+protected:
+    struct OrphanTx {
+        CTransactionRef tx;
+        NodeId fromPeer;
+        int64_t nTimeExpire;
+        size_t weight;
+    };
+    typedef std::map<uint256, OrphanTx> OrphanMap;
+
+    struct IteratorComparator
+    {
+        template<typename I>
+        bool operator()(const I& a, const I& b) const
+        {
+            return &(*a) < &(*b);
+        }
+    };
+
+    //! Orphans by expiry time (and txid, to tell apart orphans expiring at the same time).
+    typedef std::set<std::pair<int64_t, uint256>> TimeIndex;
+
+    struct PeerOrphans {
+        size_t weight{0};
+        TimeIndex by_time;
+    };
+
+    OrphanMap m_orphans GUARDED_BY(g_cs_orphans);
+    std::map<COutPoint, std::set<OrphanMap::iterator, IteratorComparator>> m_outpoint_to_orphans GUARDED_BY(g_cs_orphans);
+    TimeIndex m_by_time GUARDED_BY(g_cs_orphans);
+    std::map<NodeId, PeerOrphans> m_peers GUARDED_BY(g_cs_orphans);
+    size_t m_total_weight GUARDED_BY(g_cs_orphans){0};
+};
+
+#endif // PALLADIUM_TXORPHANAGE_H
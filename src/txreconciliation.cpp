@@ -0,0 +1,280 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <crypto/siphash.h>
+#include <hash.h>
+#include <random.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+/** Tag hashed with both peers' salts into the short id key. */
+const std::string RECON_SALT_TAG{"Tx Relay Salting"};
+
+/** Cells each id is added to, one in each part of the table. */
+constexpr uint64_t SKETCH_HASHES = 4;
+
+/**
+ * Cells added on top of one and a half per id, so that small differences
+ * decode reliably too: failures stay below about half a percent.
+ */
+constexpr size_t SKETCH_EXTRA_CELLS = 24;
+
+uint64_t Mix(uint64_t x, uint64_t seed)
+{
+    x += seed * 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+uint32_t CellHash(uint64_t id)
+{
+    return Mix(id, 0);
+}
+
+bool IsPure(const ReconSketch::Cell& cell)
+{
+    return (cell.count == 1 || cell.count == -1) && CellHash(cell.key_sum) == cell.hash_sum;
+}
+
+bool IsEmpty(const ReconSketch::Cell& cell)
+{
+    return cell.count == 0 && cell.key_sum == 0 && cell.hash_sum == 0;
+}
+
+} // namespace
+
+ReconSketch::ReconSketch(size_t num_cells) : m_cells((num_cells + SKETCH_HASHES - 1) / SKETCH_HASHES * SKETCH_HASHES) {}
+
+void ReconSketch::Toggle(std::vector<Cell>& cells, uint64_t id, int32_t sign)
+{
+    const uint64_t part = cells.size() / SKETCH_HASHES;
+    if (part == 0) return;
+    const uint32_t hash = CellHash(id);
+    for (uint64_t i = 0; i < SKETCH_HASHES; ++i) {
+        Cell& cell = cells[i * part + ((Mix(id, i + 1) >> 32) * part >> 32)];
+        cell.count += sign;
+        cell.key_sum ^= id;
+        cell.hash_sum ^= hash;
+    }
+}
+
+void ReconSketch::Toggle(uint64_t id, int32_t sign)
+{
+    Toggle(m_cells, id, sign);
+}
+
+bool ReconSketch::Subtract(const ReconSketch& other)
+{
+    if (other.m_cells.size() != m_cells.size()) return false;
+    for (size_t i = 0; i < m_cells.size(); ++i) {
+        m_cells[i].count -= other.m_cells[i].count;
+        m_cells[i].key_sum ^= other.m_cells[i].key_sum;
+        m_cells[i].hash_sum ^= other.m_cells[i].hash_sum;
+    }
+    return true;
+}
+
+bool ReconSketch::Decode(std::vector<uint64_t>& positive, std::vector<uint64_t>& negative) const
+{
+    std::vector<Cell> cells = m_cells;
+    std::vector<size_t> pure;
+    for (size_t i = 0; i < cells.size(); ++i) {
+        if (IsPure(cells[i])) pure.push_back(i);
+    }
+    // Each decoded id empties at least one cell, so a well-formed sketch never
+    // yields more ids than it has cells.
+    size_t decoded = 0;
+    while (!pure.empty()) {
+        const Cell cell = cells[pure.back()];
+        pure.pop_back();
+        if (!IsPure(cell)) continue;
+        if (++decoded > cells.size()) return false;
+        (cell.count == 1 ? positive : negative).push_back(cell.key_sum);
+        Toggle(cells, cell.key_sum, -cell.count);
+        const uint64_t part = cells.size() / SKETCH_HASHES;
+        for (uint64_t i = 0; i < SKETCH_HASHES; ++i) {
+            const size_t pos = i * part + ((Mix(cell.key_sum, i + 1) >> 32) * part >> 32);
+            if (IsPure(cells[pos])) pure.push_back(pos);
+        }
+    }
+    return std::all_of(cells.begin(), cells.end(), IsEmpty);
+}
+
+size_t ReconSketchCells(size_t local_size, size_t remote_size)
+{
+    const size_t difference = std::max(local_size, remote_size) - std::min(local_size, remote_size) + std::min(local_size, remote_size) / 4;
+    return std::min(MAX_SKETCH_CELLS, difference * 3 / 2 + SKETCH_EXTRA_CELLS);
+}
+
+uint64_t TxReconciliationTracker::PeerState::ShortId(const uint256& txid) const
+{
+    return SipHashUint256(k0, k1, txid);
+}
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(NodeId peer_id)
+{
+    const uint64_t salt = GetRand(std::numeric_limits<uint64_t>::max());
+    LOCK(m_mutex);
+    m_local_salts[peer_id] = salt;
+    return salt;
+}
+
+ReconciliationRegisterResult TxReconciliationTracker::RegisterPeer(NodeId peer_id, bool is_peer_inbound, uint32_t peer_version, uint64_t remote_salt)
+{
+    LOCK(m_mutex);
+    if (m_states.count(peer_id)) return ReconciliationRegisterResult::ALREADY_REGISTERED;
+    auto salt = m_local_salts.find(peer_id);
+    if (salt == m_local_salts.end()) return ReconciliationRegisterResult::NOT_FOUND;
+    if (peer_version < 1) return ReconciliationRegisterResult::PROTOCOL_VIOLATION;
+
+    // Both sides derive the same key, whichever order the salts are in.
+    const uint256 key = (CHashWriter(SER_GETHASH, 0) << RECON_SALT_TAG << std::min(salt->second, remote_salt) << std::max(salt->second, remote_salt)).GetHash();
+    m_local_salts.erase(salt);
+
+    PeerState& state = m_states[peer_id];
+    state.k0 = key.GetUint64(0);
+    state.k1 = key.GetUint64(1);
+    state.we_initiate = !is_peer_inbound;
+    state.flood = !is_peer_inbound && m_outbound_flood < MAX_OUTBOUND_FLOOD_TO;
+    if (state.flood) ++m_outbound_flood;
+    return ReconciliationRegisterResult::SUCCESS;
+}
+
+void TxReconciliationTracker::ForgetPeer(NodeId peer_id)
+{
+    LOCK(m_mutex);
+    m_local_salts.erase(peer_id);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end()) return;
+    if (it->second.flood) --m_outbound_flood;
+    m_states.erase(it);
+}
+
+bool TxReconciliationTracker::IsPeerRegistered(NodeId peer_id) const
+{
+    LOCK(m_mutex);
+    return m_states.count(peer_id);
+}
+
+bool TxReconciliationTracker::AddToSet(NodeId peer_id, const uint256& txid)
+{
+    LOCK(m_mutex);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end()) return false;
+    PeerState& state = it->second;
+    if (state.flood || state.set.size() >= MAX_RECON_SET_SIZE) return false;
+    state.set.emplace(state.ShortId(txid), txid);
+    return true;
+}
+
+bool TxReconciliationTracker::InitiateReconciliationRequest(NodeId peer_id, std::chrono::microseconds now, uint32_t& set_size)
+{
+    LOCK(m_mutex);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end()) return false;
+    PeerState& state = it->second;
+    if (!state.we_initiate || state.awaiting_sketch) return false;
+    if (state.next_request == std::chrono::microseconds{0}) {
+        // Don't start right after connecting, when the sets are still empty.
+        state.next_request = PoissonNextSend(now, RECON_REQUEST_INTERVAL);
+        return false;
+    }
+    if (state.next_request > now) return false;
+    state.next_request = PoissonNextSend(now, RECON_REQUEST_INTERVAL);
+    state.awaiting_sketch = true;
+    set_size = state.set.size();
+    return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationRequest(NodeId peer_id, uint32_t remote_set_size, ReconSketch& sketch)
+{
+    LOCK(m_mutex);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end()) return false;
+    PeerState& state = it->second;
+    // A peer only asks again once it has answered our previous sketch.
+    if (state.we_initiate || state.sketch_sent) return false;
+
+    state.snapshot.swap(state.set);
+    state.set.clear();
+    state.sketch_sent = true;
+    // With nothing to tell, an empty sketch lets the peer announce its whole set.
+    if (state.snapshot.empty()) {
+        sketch = ReconSketch();
+        return true;
+    }
+    sketch = ReconSketch(ReconSketchCells(state.snapshot.size(), remote_set_size));
+    for (const auto& entry : state.snapshot) {
+        sketch.Add(entry.first);
+    }
+    return true;
+}
+
+bool TxReconciliationTracker::HandleSketch(NodeId peer_id, const ReconSketch& sketch, bool& success, std::vector<uint64_t>& ask, std::vector<uint256>& announce)
+{
+    LOCK(m_mutex);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end()) return false;
+    PeerState& state = it->second;
+    if (!state.we_initiate || !state.awaiting_sketch) return false;
+    if (sketch.size() > MAX_SKETCH_CELLS) return false;
+    state.awaiting_sketch = false;
+
+    success = true;
+    std::vector<uint64_t> local_missing;
+    if (sketch.size() > 0) {
+        ReconSketch difference = sketch;
+        ReconSketch local(sketch.size());
+        for (const auto& entry : state.set) {
+            local.Add(entry.first);
+        }
+        difference.Subtract(local);
+        std::vector<uint64_t> remote_missing;
+        success = difference.Decode(local_missing, remote_missing);
+        if (success) {
+            for (const uint64_t id : remote_missing) {
+                auto tx = state.set.find(id);
+                if (tx != state.set.end()) announce.push_back(tx->second);
+            }
+        }
+    }
+    if (success) {
+        ask = std::move(local_missing);
+        // With an empty sketch, everything we have is new to the peer.
+        if (sketch.size() == 0) {
+            for (const auto& entry : state.set) announce.push_back(entry.second);
+        }
+    } else {
+        for (const auto& entry : state.set) announce.push_back(entry.second);
+    }
+    state.set.clear();
+    return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationDifference(NodeId peer_id, bool success, const std::vector<uint64_t>& ask, std::vector<uint256>& announce)
+{
+    LOCK(m_mutex);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end()) return false;
+    PeerState& state = it->second;
+    if (state.we_initiate || !state.sketch_sent) return false;
+    state.sketch_sent = false;
+
+    if (success) {
+        for (const uint64_t id : ask) {
+            auto tx = state.snapshot.find(id);
+            if (tx != state.snapshot.end()) announce.push_back(tx->second);
+        }
+    } else {
+        for (const auto& entry : state.snapshot) announce.push_back(entry.second);
+    }
+    state.snapshot.clear();
+    return true;
+}
@@ -0,0 +1,158 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_TXRECONCILIATION_H
+#define PALLADIUM_TXRECONCILIATION_H
+
+#include <net.h>
+#include <serialize.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <map>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/** Version of the transaction reconciliation protocol we support. */
+static constexpr uint32_t TXRECONCILIATION_VERSION = 1;
+/** Default for -txreconciliation. */
+static constexpr bool DEFAULT_TXRECONCILIATION = false;
+/** Average delay between reconciliation requests to each outbound peer. */
+static constexpr std::chrono::seconds RECON_REQUEST_INTERVAL{8};
+/** Outbound reconciling peers that transactions are still flooded to. */
+static constexpr size_t MAX_OUTBOUND_FLOOD_TO = 2;
+/** Transactions queued for reconciliation with one peer, beyond which they are flooded. */
+static constexpr size_t MAX_RECON_SET_SIZE = 3000;
+/** Largest sketch a peer may send or be sent. */
+static constexpr size_t MAX_SKETCH_CELLS = 6000;
+
+/**
+ * Invertible Bloom lookup table over 64-bit short transaction ids.
+ *
+ * Every id is added to one cell in each of four equally sized parts of the
+ * table. Subtracting the sketch of one set from the sketch of another, built
+ * with the same number of cells, leaves exactly the ids in their symmetric
+ * difference, which can be recovered with high probability as long as it is
+ * not much larger than two thirds of the number of cells.
+ */
+class ReconSketch
+{
+public:
+    struct Cell {
+        int32_t count{0};
+        uint64_t key_sum{0};
+        uint32_t hash_sum{0};
+
+        SERIALIZE_METHODS(Cell, obj) { READWRITE(obj.count, obj.key_sum, obj.hash_sum); }
+    };
+
+    ReconSketch() = default;
+    //! A sketch of num_cells cells, rounded up to a multiple of four.
+    explicit ReconSketch(size_t num_cells);
+
+    size_t size() const { return m_cells.size(); }
+    void Add(uint64_t id) { Toggle(id, 1); }
+    //! Subtract another sketch with the same number of cells. Returns false if the sizes differ.
+    bool Subtract(const ReconSketch& other);
+    /**
+     * Recover the ids that were added more often than they were subtracted
+     * (positive) and the other way round (negative). Returns false if the
+     * difference is too large to be decoded.
+     */
+    bool Decode(std::vector<uint64_t>& positive, std::vector<uint64_t>& negative) const;
+
+    SERIALIZE_METHODS(ReconSketch, obj) { READWRITE(obj.m_cells); }
+
+private:
+    void Toggle(uint64_t id, int32_t sign);
+    static void Toggle(std::vector<Cell>& cells, uint64_t id, int32_t sign);
+
+    std::vector<Cell> m_cells;
+};
+
+/**
+ * Number of cells to sketch a set of local_size transactions with, when the
+ * peer holds remote_size: enough for the sizes to differ completely, plus an
+ * allowance for a quarter of the smaller set to be unknown to the other side.
+ */
+size_t ReconSketchCells(size_t local_size, size_t remote_size);
+
+enum class ReconciliationRegisterResult {
+    NOT_FOUND,
+    SUCCESS,
+    ALREADY_REGISTERED,
+    PROTOCOL_VIOLATION,
+};
+
+/**
+ * Keeps track of the transactions we would have announced to each peer that
+ * negotiated reconciliation (the sendtxrcncl message), and of the rounds in
+ * which they are exchanged:
+ *
+ * - We request reconciliation from outbound peers (reqtxrcncl with our set
+ *   size) and answer the requests of inbound peers with a sketch of our set.
+ * - The requester subtracts a sketch of its own set, sends the short ids it
+ *   is missing (reconcildiff) and announces the ones the responder lacks; the
+ *   responder announces the short ids asked for.
+ * - If the difference cannot be decoded, both sides announce their whole set.
+ *
+ * Transactions are still flooded to up to MAX_OUTBOUND_FLOOD_TO outbound
+ * reconciling peers, and to all peers that do not reconcile.
+ */
+class TxReconciliationTracker
+{
+public:
+    //! Pick our salt for a peer, to send in sendtxrcncl.
+    uint64_t PreRegisterPeer(NodeId peer_id);
+    //! Finish negotiating with a peer once its sendtxrcncl arrived.
+    ReconciliationRegisterResult RegisterPeer(NodeId peer_id, bool is_peer_inbound, uint32_t peer_version, uint64_t remote_salt);
+    void ForgetPeer(NodeId peer_id);
+    bool IsPeerRegistered(NodeId peer_id) const;
+
+    /**
+     * Queue a transaction for reconciliation with a peer, instead of
+     * announcing it. Returns false if it should be announced (flooded) to the
+     * peer right away instead.
+     */
+    bool AddToSet(NodeId peer_id, const uint256& txid);
+
+    //! Whether it is time to request reconciliation from a peer; if so, set_size is our set size to send.
+    bool InitiateReconciliationRequest(NodeId peer_id, std::chrono::microseconds now, uint32_t& set_size);
+    //! Answer a reconciliation request with a sketch. Returns false on a protocol violation.
+    bool HandleReconciliationRequest(NodeId peer_id, uint32_t remote_set_size, ReconSketch& sketch);
+    /**
+     * Compare a peer's sketch against our set. On success, ask holds the short
+     * ids to request from the peer; announce holds the transactions to
+     * announce to it either way. Returns false on a protocol violation.
+     */
+    bool HandleSketch(NodeId peer_id, const ReconSketch& sketch, bool& success, std::vector<uint64_t>& ask, std::vector<uint256>& announce);
+    //! Collect the transactions asked for after our sketch. Returns false on a protocol violation.
+    bool HandleReconciliationDifference(NodeId peer_id, bool success, const std::vector<uint64_t>& ask, std::vector<uint256>& announce);
+
+private:
+    struct PeerState {
+        uint64_t k0, k1;
+        bool we_initiate;
+        bool flood;
+        //! Transactions to reconcile, by short id.
+        std::map<uint64_t, uint256> set;
+        //! Our set as of the sketch we sent, until the peer's reconcildiff arrives.
+        std::map<uint64_t, uint256> snapshot;
+        bool sketch_sent{false};
+        bool awaiting_sketch{false};
+        std::chrono::microseconds next_request{0};
+
+        uint64_t ShortId(const uint256& txid) const;
+    };
+
+    mutable Mutex m_mutex;
+    //! Our salts for peers that have not sent sendtxrcncl yet.
+    std::unordered_map<NodeId, uint64_t> m_local_salts GUARDED_BY(m_mutex);
+    std::unordered_map<NodeId, PeerState> m_states GUARDED_BY(m_mutex);
+    size_t m_outbound_flood GUARDED_BY(m_mutex){0};
+};
+
+#endif // PALLADIUM_TXRECONCILIATION_H
@@ -0,0 +1,121 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txrequest.h>
+
+#include <assert.h>
+
+namespace {
+const uint256 TXID_MIN{};
+} // namespace
+
+template<typename Tag>
+void TxRequestTracker::Erase(typename Index::index<Tag>::type::iterator it)
+{
+    auto peer_it = m_peers.find(it->m_peer);
+    assert(peer_it != m_peers.end());
+    PeerInfo& info = peer_it->second;
+    if (it->m_state == State::REQUESTED) --info.m_requested;
+    if (--info.m_total == 0) m_peers.erase(peer_it);
+    m_index.get<Tag>().erase(it);
+}
+
+bool TxRequestTracker::ReceivedInv(NodeId peer, const uint256& txid, std::chrono::microseconds reqtime)
+{
+    if (!m_index.emplace(Announcement{txid, peer, State::DELAYED, reqtime}).second) return false;
+    ++m_peers[peer].m_total;
+    return true;
+}
+
+void TxRequestTracker::RequestedTx(NodeId peer, const uint256& txid, std::chrono::microseconds now)
+{
+    auto& index = m_index.get<ByPeerTxid>();
+    auto it = index.find(PeerTxidKey::result_type{peer, txid});
+    if (it == index.end() || it->m_state == State::REQUESTED) return;
+    index.modify(it, [now](Announcement& ann) {
+        ann.m_state = State::REQUESTED;
+        ann.m_time = now;
+    });
+    ++m_peers[peer].m_requested;
+}
+
+void TxRequestTracker::ReceivedResponse(NodeId peer, const uint256& txid)
+{
+    auto& index = m_index.get<ByPeerTxid>();
+    auto it = index.find(PeerTxidKey::result_type{peer, txid});
+    if (it != index.end()) Erase<ByPeerTxid>(it);
+}
+
+void TxRequestTracker::ForgetTxHash(const uint256& txid)
+{
+    auto& index = m_index.get<ByTxid>();
+    auto it = index.lower_bound(TxidKey::result_type{txid, State::DELAYED, std::chrono::microseconds::min()});
+    while (it != index.end() && it->m_txid == txid) {
+        Erase<ByTxid>(it++);
+    }
+}
+
+void TxRequestTracker::DisconnectedPeer(NodeId peer)
+{
+    auto& index = m_index.get<ByPeer>();
+    auto it = index.lower_bound(PeerKey::result_type{peer, State::DELAYED, std::chrono::microseconds::min(), TXID_MIN});
+    while (it != index.end() && it->m_peer == peer) {
+        Erase<ByPeer>(it++);
+    }
+}
+
+std::vector<uint256> TxRequestTracker::GetRequestable(NodeId peer, std::chrono::microseconds now, size_t max_in_flight,
+                                                      std::chrono::microseconds reschedule_delay, std::vector<uint256>* expired)
+{
+    std::vector<uint256> ret;
+    auto& index = m_index.get<ByPeer>();
+
+    // Requests are ordered by request time, so the expired ones come first.
+    auto it = index.lower_bound(PeerKey::result_type{peer, State::REQUESTED, std::chrono::microseconds::min(), TXID_MIN});
+    while (it != index.end() && it->m_peer == peer && it->m_state == State::REQUESTED && it->m_time <= now - m_expiry_interval) {
+        if (expired) expired->push_back(it->m_txid);
+        Erase<ByPeer>(it++);
+    }
+
+    const size_t in_flight = CountInFlight(peer);
+    if (in_flight >= max_in_flight) return ret;
+
+    it = index.lower_bound(PeerKey::result_type{peer, State::DELAYED, std::chrono::microseconds::min(), TXID_MIN});
+    while (it != index.end() && it->m_peer == peer && it->m_state == State::DELAYED && it->m_time <= now &&
+           in_flight + ret.size() < max_in_flight) {
+        const auto cur = it++;
+        const auto last_request = GetRequestTime(cur->m_txid);
+        if (last_request.count() == 0 || last_request <= now - m_request_interval) {
+            ret.push_back(cur->m_txid);
+        } else {
+            // In flight from another peer. The new time is after now, so this
+            // moves the announcement past the ones still to be visited.
+            const auto next_time = last_request + m_request_interval + reschedule_delay;
+            index.modify(cur, [next_time](Announcement& ann) { ann.m_time = next_time; });
+        }
+    }
+    return ret;
+}
+
+std::chrono::microseconds TxRequestTracker::GetRequestTime(const uint256& txid) const
+{
+    auto& index = m_index.get<ByTxid>();
+    auto it = index.lower_bound(TxidKey::result_type{txid, State::REQUESTED, std::chrono::microseconds::max()});
+    if (it == index.begin()) return {};
+    --it;
+    if (it->m_txid != txid || it->m_state != State::REQUESTED) return {};
+    return it->m_time;
+}
+
+size_t TxRequestTracker::Count(NodeId peer) const
+{
+    auto it = m_peers.find(peer);
+    return it == m_peers.end() ? 0 : it->second.m_total;
+}
+
+size_t TxRequestTracker::CountInFlight(NodeId peer) const
+{
+    auto it = m_peers.find(peer);
+    return it == m_peers.end() ? 0 : it->second.m_requested;
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_TXREQUEST_H
+#define PALLADIUM_TXREQUEST_H
+
+#include <net.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+
+/**
+ * Transaction announcements from all peers, tracked until the transaction is
+ * received, we give up on the peer, or the peer disconnects.
+ *
+ * Each (peer, txid) announcement is either delayed until a time at which we
+ * consider requesting it, or requested at a time after which it expires.
+ * Announcements are indexed by (peer, state, time) and by (txid, state, time),
+ * so that picking a peer's requestable announcements, expiring its requests,
+ * finding the last request of a transaction from any peer, forgetting a
+ * transaction and forgetting a disconnected peer each cost O(log n) per
+ * announcement involved, however many peers announced the same transactions.
+ *
+ * A transaction requested from one peer is not requested from another one
+ * until request_interval has passed since the last request. Announcements of
+ * it that become due in the meantime are delayed until then.
+ *
+ * The class does no locking of its own.
+ */
+class TxRequestTracker
+{
+public:
+    TxRequestTracker(std::chrono::microseconds request_interval, std::chrono::microseconds expiry_interval) :
+        m_request_interval(request_interval), m_expiry_interval(expiry_interval) {}
+
+    /**
+     * Add an announcement of txid by peer, to be considered for requesting at
+     * reqtime. Returns false if the peer already announced it.
+     */
+    bool ReceivedInv(NodeId peer, const uint256& txid, std::chrono::microseconds reqtime);
+    /** Mark an announcement returned by GetRequestable as requested at now. */
+    void RequestedTx(NodeId peer, const uint256& txid, std::chrono::microseconds now);
+    /** Drop a peer's announcement once it sent the transaction or a notfound for it. */
+    void ReceivedResponse(NodeId peer, const uint256& txid);
+    /** Drop all announcements of a transaction we no longer need. */
+    void ForgetTxHash(const uint256& txid);
+    /** Drop all announcements of a peer (e.g. after it disconnected). */
+    void DisconnectedPeer(NodeId peer);
+
+    /**
+     * Transactions to request from a peer now, oldest announcement first, so
+     * that at most max_in_flight are in flight from it afterwards.
+     *
+     * The peer's requests older than expiry_interval are dropped first, and
+     * their txids appended to expired if given. Due announcements of
+     * transactions requested from some peer within request_interval are
+     * delayed to reschedule_delay after that interval ends instead of being
+     * returned.
+     */
+    std::vector<uint256> GetRequestable(NodeId peer, std::chrono::microseconds now, size_t max_in_flight,
+                                        std::chrono::microseconds reschedule_delay, std::vector<uint256>* expired = nullptr);
+
+    /** Time of the last request of a transaction still in flight from any peer, or zero. */
+    std::chrono::microseconds GetRequestTime(const uint256& txid) const;
+
+    /** Number of announcements by a peer, requested or not. */
+    size_t Count(NodeId peer) const;
+    /** Number of transactions in flight from a peer. */
+    size_t CountInFlight(NodeId peer) const;
+    /** Number of announcements by all peers. */
+    size_t Size() const { return m_index.size(); }
+
+private:
+    enum class State : uint8_t {
+        //! Waiting until m_time before it may be requested.
+        DELAYED,
+        //! Requested at m_time.
+        REQUESTED,
+    };
+
+    struct Announcement {
+        uint256 m_txid;
+        NodeId m_peer;
+        State m_state;
+        std::chrono::microseconds m_time;
+    };
+
+    struct ByPeer {};
+    struct ByPeerTxid {};
+    struct ByTxid {};
+
+    //! (peer, state, time, txid): due and expired announcements of a peer, and all of them on disconnect.
+    struct PeerKey {
+        typedef std::tuple<NodeId, State, std::chrono::microseconds, const uint256&> result_type;
+        result_type operator()(const Announcement& ann) const { return result_type{ann.m_peer, ann.m_state, ann.m_time, ann.m_txid}; }
+    };
+    //! (peer, txid): a single announcement.
+    struct PeerTxidKey {
+        typedef std::tuple<NodeId, const uint256&> result_type;
+        result_type operator()(const Announcement& ann) const { return result_type{ann.m_peer, ann.m_txid}; }
+    };
+    //! (txid, state, time): all announcements of a transaction, the last request of it last.
+    struct TxidKey {
+        typedef std::tuple<const uint256&, State, std::chrono::microseconds> result_type;
+        result_type operator()(const Announcement& ann) const { return result_type{ann.m_txid, ann.m_state, ann.m_time}; }
+    };
+
+    typedef boost::multi_index_container<
+        Announcement,
+        boost::multi_index::indexed_by<
+            boost::multi_index::ordered_unique<boost::multi_index::tag<ByPeer>, PeerKey>,
+            boost::multi_index::ordered_unique<boost::multi_index::tag<ByPeerTxid>, PeerTxidKey>,
+            boost::multi_index::ordered_non_unique<boost::multi_index::tag<ByTxid>, TxidKey>
+        >
+    > Index;
+
+    struct PeerInfo {
+        size_t m_total{0};
+        size_t m_requested{0};
+    };
+
+    template<typename Tag>
+    void Erase(typename Index::index<Tag>::type::iterator it);
+
+    const std::chrono::microseconds m_request_interval;
+    const std::chrono::microseconds m_expiry_interval;
+    Index m_index;
+    std::unordered_map<NodeId, PeerInfo> m_peers;
+};
+
+#endif // PALLADIUM_TXREQUEST_H
@@ -0,0 +1,370 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <udprelay.h>
+
+#include <blockencodings.h>
+#include <crypto/common.h>
+#include <crypto/siphash.h>
+#include <logging.h>
+#include <netbase.h>
+#include <random.h>
+#include <streams.h>
+#include <util/time.h>
+#include <version.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <limits>
+#include <string.h>
+
+#ifdef USE_POLL
+#include <poll.h>
+#endif
+
+namespace {
+
+/** Receive buffer requested for the sockets, large enough for the burst of a full block. */
+constexpr int UDPRELAY_RECV_BUFFER = 8 * 1000 * 1000;
+
+size_t FecDataCount(size_t payload_size, size_t chunk_size)
+{
+    return std::max<size_t>(1, (payload_size + chunk_size - 1) / chunk_size);
+}
+
+} // namespace
+
+size_t FecParityCount(size_t data_count)
+{
+    return std::max<size_t>(1, (data_count + 3) / 4);
+}
+
+std::vector<std::vector<unsigned char>> FecEncode(Span<const unsigned char> payload, size_t chunk_size)
+{
+    const size_t payload_size = payload.size();
+    const size_t data_count = FecDataCount(payload_size, chunk_size);
+    const size_t parity_count = FecParityCount(data_count);
+    std::vector<std::vector<unsigned char>> chunks(data_count + parity_count, std::vector<unsigned char>(chunk_size, 0));
+    for (size_t i = 0; i < data_count; ++i) {
+        const size_t offset = i * chunk_size;
+        const size_t len = std::min(chunk_size, payload_size - std::min(offset, payload_size));
+        if (len > 0) memcpy(chunks[i].data(), payload.data() + offset, len);
+        std::vector<unsigned char>& parity = chunks[data_count + i % parity_count];
+        for (size_t b = 0; b < chunk_size; ++b) parity[b] ^= chunks[i][b];
+    }
+    return chunks;
+}
+
+FecDecoder::FecDecoder(size_t payload_size, size_t chunk_size)
+    : m_payload_size(payload_size),
+      m_chunk_size(chunk_size),
+      m_data_count(FecDataCount(payload_size, chunk_size)),
+      m_parity_count(FecParityCount(m_data_count)),
+      m_chunks(m_data_count + m_parity_count),
+      m_missing(m_parity_count, 0),
+      m_unrecoverable(0)
+{
+    for (size_t i = 0; i < m_data_count; ++i) ++m_missing[i % m_parity_count];
+    for (size_t group = 0; group < m_parity_count; ++group) {
+        if (!GroupRecoverable(group)) ++m_unrecoverable;
+    }
+}
+
+bool FecDecoder::GroupRecoverable(size_t group) const
+{
+    return m_missing[group] == 0 || (m_missing[group] == 1 && !m_chunks[m_data_count + group].empty());
+}
+
+bool FecDecoder::AddChunk(size_t index, Span<const unsigned char> chunk)
+{
+    if (index >= m_chunks.size() || chunk.size() != m_chunk_size) return false;
+    if (!m_chunks[index].empty()) return true;
+    const size_t group = index < m_data_count ? index % m_parity_count : index - m_data_count;
+    const bool was_recoverable = GroupRecoverable(group);
+    m_chunks[index].assign(chunk.begin(), chunk.end());
+    if (index < m_data_count) --m_missing[group];
+    if (!was_recoverable && GroupRecoverable(group)) --m_unrecoverable;
+    return true;
+}
+
+std::vector<unsigned char> FecDecoder::GetPayload() const
+{
+    assert(Complete());
+    std::vector<unsigned char> payload;
+    payload.reserve(m_data_count * m_chunk_size);
+    for (size_t i = 0; i < m_data_count; ++i) {
+        if (!m_chunks[i].empty()) {
+            payload.insert(payload.end(), m_chunks[i].begin(), m_chunks[i].end());
+            continue;
+        }
+        // The only chunk missing from its group: XOR the parity with the others.
+        const size_t group = i % m_parity_count;
+        std::vector<unsigned char> repaired = m_chunks[m_data_count + group];
+        for (size_t j = group; j < m_data_count; j += m_parity_count) {
+            if (j == i) continue;
+            for (size_t b = 0; b < m_chunk_size; ++b) repaired[b] ^= m_chunks[j][b];
+        }
+        payload.insert(payload.end(), repaired.begin(), repaired.end());
+    }
+    payload.resize(m_payload_size);
+    return payload;
+}
+
+std::vector<unsigned char> MakeUdpRelayPacket(const UdpRelayHeader& header, Span<const unsigned char> chunk, uint64_t k0, uint64_t k1)
+{
+    std::vector<unsigned char> packet;
+    packet.reserve(UDPRELAY_HEADER_SIZE + chunk.size() + 8);
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, packet, 0, header);
+    packet.insert(packet.end(), chunk.begin(), chunk.end());
+    const uint64_t mac = CSipHasher(k0, k1).Write(packet.data(), packet.size()).Finalize();
+    packet.resize(packet.size() + 8);
+    WriteLE64(packet.data() + packet.size() - 8, mac);
+    return packet;
+}
+
+bool ParseUdpRelayPacket(Span<const unsigned char> packet, const CMessageHeader::MessageStartChars& message_start, uint64_t k0, uint64_t k1, UdpRelayHeader& header, Span<const unsigned char>& chunk)
+{
+    if (packet.size() < UDPRELAY_HEADER_SIZE + 8 || packet.size() > MAX_UDPRELAY_PACKET_SIZE) return false;
+    const size_t mac_pos = packet.size() - 8;
+    if (CSipHasher(k0, k1).Write(packet.data(), mac_pos).Finalize() != ReadLE64(packet.data() + mac_pos)) return false;
+    SpanReader reader(SER_NETWORK, PROTOCOL_VERSION, packet.first(UDPRELAY_HEADER_SIZE));
+    reader >> header;
+    if (memcmp(header.message_start, message_start, CMessageHeader::MESSAGE_START_SIZE) != 0) return false;
+    if (header.version != UDPRELAY_VERSION) return false;
+    chunk = packet.subspan(UDPRELAY_HEADER_SIZE, mac_pos - UDPRELAY_HEADER_SIZE);
+    return true;
+}
+
+UdpBlockRelay::UdpBlockRelay(const CMessageHeader::MessageStartChars& message_start, DeliverFn deliver)
+    : m_deliver(std::move(deliver))
+{
+    memcpy(m_message_start, message_start, CMessageHeader::MESSAGE_START_SIZE);
+}
+
+UdpBlockRelay::~UdpBlockRelay()
+{
+    if (m_socket_v4 != INVALID_SOCKET) CloseSocket(m_socket_v4);
+    if (m_socket_v6 != INVALID_SOCKET) CloseSocket(m_socket_v6);
+}
+
+bool UdpBlockRelay::Bind(uint16_t port, std::string& error)
+{
+    int one = 1;
+    const CService binds[] = {CService(CNetAddr(in6addr_any), port), CService(CNetAddr(in_addr{INADDR_ANY}), port)};
+    for (const CService& bind_addr : binds) {
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        if (!bind_addr.GetSockAddr((struct sockaddr*)&sockaddr, &len)) continue;
+        SOCKET sock = socket(((struct sockaddr*)&sockaddr)->sa_family, SOCK_DGRAM, IPPROTO_UDP);
+        if (sock == INVALID_SOCKET) continue;
+        if (!IsSelectableSocket(sock) || !SetSocketNonBlocking(sock, true)) {
+            CloseSocket(sock);
+            continue;
+        }
+        if (bind_addr.IsIPv6()) {
+#ifdef IPV6_V6ONLY
+            setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (sockopt_arg_type)&one, sizeof(int));
+#endif
+        }
+        int recv_buffer = UDPRELAY_RECV_BUFFER;
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (sockopt_arg_type)&recv_buffer, sizeof(int));
+        if (::bind(sock, (struct sockaddr*)&sockaddr, len) == SOCKET_ERROR) {
+            error = strprintf("Unable to bind UDP block relay to %s (bind returned error %s)", bind_addr.ToString(), NetworkErrorString(WSAGetLastError()));
+            LogPrintf("%s\n", error);
+            CloseSocket(sock);
+            continue;
+        }
+        LogPrintf("UDP block relay bound to %s\n", bind_addr.ToString());
+        (bind_addr.IsIPv6() ? m_socket_v6 : m_socket_v4) = sock;
+    }
+    if (m_socket_v4 == INVALID_SOCKET && m_socket_v6 == INVALID_SOCKET) {
+        if (error.empty()) error = strprintf("Unable to open a UDP socket for block relay (socket returned error %s)", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    error.clear();
+    m_port = port;
+    return true;
+}
+
+void UdpBlockRelay::ThreadReceive(CThreadInterrupt& interrupt)
+{
+    const SOCKET sockets[] = {m_socket_v4, m_socket_v6};
+    std::vector<unsigned char> buf(MAX_UDPRELAY_PACKET_SIZE + 1);
+    while (!interrupt) {
+#ifdef USE_POLL
+        struct pollfd fds[2];
+        nfds_t nfds = 0;
+        for (SOCKET sock : sockets) {
+            if (sock == INVALID_SOCKET) continue;
+            fds[nfds].fd = sock;
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            ++nfds;
+        }
+        if (poll(fds, nfds, 50) <= 0) continue;
+#else
+        fd_set fdset;
+        FD_ZERO(&fdset);
+        SOCKET max_socket = 0;
+        for (SOCKET sock : sockets) {
+            if (sock == INVALID_SOCKET) continue;
+            FD_SET(sock, &fdset);
+            max_socket = std::max(max_socket, sock);
+        }
+        struct timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = 50 * 1000;
+        if (select(max_socket + 1, &fdset, nullptr, nullptr, &timeout) <= 0) continue;
+#endif
+        for (SOCKET sock : sockets) {
+            if (sock == INVALID_SOCKET) continue;
+            while (!interrupt) {
+                struct sockaddr_storage sockaddr;
+                socklen_t len = sizeof(sockaddr);
+                const int n = recvfrom(sock, (char*)buf.data(), buf.size(), 0, (struct sockaddr*)&sockaddr, &len);
+                if (n <= 0) break;
+                CService from;
+                if (!from.SetSockAddr((const struct sockaddr*)&sockaddr)) continue;
+                ProcessPacket(from, Span<const unsigned char>(buf.data(), n));
+            }
+        }
+    }
+}
+
+std::pair<uint64_t, uint64_t> UdpBlockRelay::PreRegisterPeer(NodeId peer_id)
+{
+    const std::pair<uint64_t, uint64_t> key{GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max())};
+    LOCK(m_mutex);
+    m_peers[peer_id].m_recv_key = key;
+    return key;
+}
+
+bool UdpBlockRelay::RegisterPeer(NodeId peer_id, const CService& endpoint, uint64_t k0, uint64_t k1)
+{
+    LOCK(m_mutex);
+    auto it = m_peers.find(peer_id);
+    if (it == m_peers.end() || it->second.m_registered) return false;
+    it->second.m_send_key = {k0, k1};
+    it->second.m_endpoint = endpoint;
+    it->second.m_registered = true;
+    return true;
+}
+
+void UdpBlockRelay::ForgetPeer(NodeId peer_id)
+{
+    LOCK(m_mutex);
+    m_peers.erase(peer_id);
+}
+
+bool UdpBlockRelay::IsPeerRegistered(NodeId peer_id) const
+{
+    LOCK(m_mutex);
+    auto it = m_peers.find(peer_id);
+    return it != m_peers.end() && it->second.m_registered;
+}
+
+void UdpBlockRelay::AddRecent(const uint256& hash, NodeId from, bool relayed)
+{
+    AssertLockHeld(m_mutex);
+    if (m_recent.size() >= UDPRELAY_RECENT_BLOCKS) m_recent.erase(m_recent.begin());
+    m_recent.push_back({hash, from, relayed});
+}
+
+void UdpBlockRelay::RelayBlock(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    const uint256 hash = cmpctblock.header.GetHash();
+    std::vector<std::pair<CService, std::pair<uint64_t, uint64_t>>> targets;
+    {
+        LOCK(m_mutex);
+        NodeId from = -1;
+        auto recent = std::find_if(m_recent.begin(), m_recent.end(), [&](const RecentBlock& r) { return r.hash == hash; });
+        if (recent != m_recent.end()) {
+            if (recent->relayed) return;
+            recent->relayed = true;
+            from = recent->from;
+        } else {
+            AddRecent(hash, from, /* relayed */ true);
+        }
+        for (const auto& entry : m_peers) {
+            if (entry.second.m_registered && entry.first != from) targets.emplace_back(entry.second.m_endpoint, entry.second.m_send_key);
+        }
+    }
+    if (targets.empty()) return;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    if (stream.size() > MAX_UDPRELAY_PAYLOAD) return;
+    const Span<const unsigned char> payload((const unsigned char*)stream.data(), stream.size());
+    const std::vector<std::vector<unsigned char>> chunks = FecEncode(payload, UDPRELAY_CHUNK_SIZE);
+
+    UdpRelayHeader header;
+    memcpy(header.message_start, m_message_start, CMessageHeader::MESSAGE_START_SIZE);
+    header.version = UDPRELAY_VERSION;
+    header.block_hash = hash;
+    header.payload_size = stream.size();
+    for (const auto& target : targets) {
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            header.index = i;
+            SendTo(target.first, MakeUdpRelayPacket(header, MakeSpan(chunks[i]), target.second.first, target.second.second));
+        }
+    }
+    LogPrint(BCLog::NET, "relayed block %s over UDP in %u datagrams to %u peers\n", hash.ToString(), chunks.size(), targets.size());
+}
+
+void UdpBlockRelay::SendTo(const CService& to, const std::vector<unsigned char>& packet)
+{
+    const SOCKET sock = to.IsIPv4() ? m_socket_v4 : m_socket_v6;
+    if (sock == INVALID_SOCKET) return;
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!to.GetSockAddr((struct sockaddr*)&sockaddr, &len)) return;
+    sendto(sock, (const char*)packet.data(), packet.size(), MSG_NOSIGNAL, (const struct sockaddr*)&sockaddr, len);
+}
+
+void UdpBlockRelay::ProcessPacket(const CService& from, Span<const unsigned char> packet)
+{
+    NodeId peer_id = -1;
+    std::vector<unsigned char> payload;
+    {
+        LOCK(m_mutex);
+        // The MAC is keyed per peer, so it tells which peer at this address sent it.
+        UdpRelayHeader header;
+        Span<const unsigned char> chunk;
+        Peer* peer = nullptr;
+        for (auto& entry : m_peers) {
+            if (!entry.second.m_registered || static_cast<const CNetAddr&>(entry.second.m_endpoint) != static_cast<const CNetAddr&>(from)) continue;
+            if (ParseUdpRelayPacket(packet, m_message_start, entry.second.m_recv_key.first, entry.second.m_recv_key.second, header, chunk)) {
+                peer_id = entry.first;
+                peer = &entry.second;
+                break;
+            }
+        }
+        if (peer == nullptr) return;
+        if (header.payload_size == 0 || header.payload_size > MAX_UDPRELAY_PAYLOAD) return;
+        if (std::any_of(m_recent.begin(), m_recent.end(), [&](const RecentBlock& r) { return r.hash == header.block_hash; })) return;
+
+        const auto now = GetTime<std::chrono::microseconds>();
+        auto it = peer->m_partial.find(header.block_hash);
+        if (it == peer->m_partial.end()) {
+            for (auto partial = peer->m_partial.begin(); partial != peer->m_partial.end();) {
+                if (partial->second.first + UDPRELAY_PARTIAL_TIMEOUT < now) {
+                    partial = peer->m_partial.erase(partial);
+                } else {
+                    ++partial;
+                }
+            }
+            if (peer->m_partial.size() >= MAX_UDPRELAY_PARTIAL_BLOCKS) return;
+            it = peer->m_partial.emplace(std::piecewise_construct, std::forward_as_tuple(header.block_hash),
+                                         std::forward_as_tuple(now, FecDecoder(header.payload_size, UDPRELAY_CHUNK_SIZE))).first;
+        }
+        FecDecoder& decoder = it->second.second;
+        if (decoder.PayloadSize() != header.payload_size || !decoder.AddChunk(header.index, chunk)) return;
+        if (!decoder.Complete()) return;
+        payload = decoder.GetPayload();
+        peer->m_partial.erase(it);
+        AddRecent(header.block_hash, peer_id, /* relayed */ false);
+        LogPrint(BCLog::NET, "reassembled block %s from UDP datagrams of peer=%d\n", header.block_hash.ToString(), peer_id);
+    }
+    m_deliver(peer_id, std::move(payload));
+}
@@ -0,0 +1,188 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_UDPRELAY_H
+#define PALLADIUM_UDPRELAY_H
+
+#include <compat.h>
+#include <netaddress.h>
+#include <protocol.h>
+#include <serialize.h>
+#include <span.h>
+#include <sync.h>
+#include <threadinterrupt.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class CBlockHeaderAndShortTxIDs;
+
+typedef int64_t NodeId;
+
+/** Version of the UDP block relay protocol we support. */
+static constexpr uint8_t UDPRELAY_VERSION = 1;
+/** Default for -udprelayport (0: disabled). */
+static constexpr uint16_t DEFAULT_UDPRELAY_PORT = 0;
+/** Payload bytes carried by each datagram, so that it fits the minimum IPv6 MTU. */
+static constexpr size_t UDPRELAY_CHUNK_SIZE = 1152;
+/** Largest compact block relayed or accepted over UDP. */
+static constexpr uint32_t MAX_UDPRELAY_PAYLOAD = 4 * 1000 * 1000;
+/** Blocks reassembled from one peer at the same time. */
+static constexpr size_t MAX_UDPRELAY_PARTIAL_BLOCKS = 4;
+/** Time after which a block that could not be reassembled is given up on. */
+static constexpr std::chrono::seconds UDPRELAY_PARTIAL_TIMEOUT{10};
+/** Recently relayed or received blocks, which are not sent or reassembled again. */
+static constexpr size_t UDPRELAY_RECENT_BLOCKS = 16;
+
+/** Number of parity chunks protecting data_count data chunks: one per four, at least one. */
+size_t FecParityCount(size_t data_count);
+
+/**
+ * Split payload into chunk_size data chunks, the last one zero padded,
+ * followed by FecParityCount() parity chunks. Parity chunk p is the XOR of
+ * the data chunks i with i % parity_count == p, so the payload survives any
+ * losses that leave at most one data chunk of each parity group missing.
+ */
+std::vector<std::vector<unsigned char>> FecEncode(Span<const unsigned char> payload, size_t chunk_size);
+
+/** Collects the chunks of one FecEncode()d payload and recovers it once enough of them arrived. */
+class FecDecoder
+{
+public:
+    FecDecoder(size_t payload_size, size_t chunk_size);
+
+    size_t PayloadSize() const { return m_payload_size; }
+    size_t DataCount() const { return m_data_count; }
+    size_t ParityCount() const { return m_parity_count; }
+    //! Add chunk number index. Returns false if there is no such chunk or it has the wrong size.
+    bool AddChunk(size_t index, Span<const unsigned char> chunk);
+    //! Whether the payload can be recovered from the chunks received so far.
+    bool Complete() const { return m_unrecoverable == 0; }
+    //! The payload, with missing data chunks repaired. Requires Complete().
+    std::vector<unsigned char> GetPayload() const;
+
+private:
+    bool GroupRecoverable(size_t group) const;
+
+    size_t m_payload_size;
+    size_t m_chunk_size;
+    size_t m_data_count;
+    size_t m_parity_count;
+    //! Received chunks, data first, empty while missing.
+    std::vector<std::vector<unsigned char>> m_chunks;
+    //! Data chunks still missing per parity group.
+    std::vector<size_t> m_missing;
+    //! Parity groups that miss more than their parity chunk can repair.
+    size_t m_unrecoverable;
+};
+
+/** Header of a UDP relay datagram. It is followed by one chunk and an 8-byte MAC over everything before it. */
+struct UdpRelayHeader {
+    CMessageHeader::MessageStartChars message_start;
+    uint8_t version;
+    uint256 block_hash;
+    uint32_t payload_size;
+    uint16_t index;
+
+    SERIALIZE_METHODS(UdpRelayHeader, obj) { READWRITE(obj.message_start, obj.version, obj.block_hash, obj.payload_size, obj.index); }
+};
+
+/** Serialized size of UdpRelayHeader. */
+static constexpr size_t UDPRELAY_HEADER_SIZE = 4 + 1 + 32 + 4 + 2;
+/** Largest datagram we send or accept. */
+static constexpr size_t MAX_UDPRELAY_PACKET_SIZE = UDPRELAY_HEADER_SIZE + UDPRELAY_CHUNK_SIZE + 8;
+
+/** Build the datagram carrying chunk index of a block, authenticated with the receiver's key. */
+std::vector<unsigned char> MakeUdpRelayPacket(const UdpRelayHeader& header, Span<const unsigned char> chunk, uint64_t k0, uint64_t k1);
+
+/**
+ * Check the MAC, network and version of a datagram and split it into its
+ * header and chunk. Returns false if it is malformed or was not meant for us.
+ */
+bool ParseUdpRelayPacket(Span<const unsigned char> packet, const CMessageHeader::MessageStartChars& message_start, uint64_t k0, uint64_t k1, UdpRelayHeader& header, Span<const unsigned char>& chunk);
+
+/**
+ * Low-latency relay of new blocks between peers that granted each other the
+ * udprelay permission, typically the nodes of cooperating miners.
+ *
+ * Compact blocks are sent as a burst of FEC protected datagrams instead of
+ * over the TCP connection, so a lost packet costs nothing as long as its
+ * parity group is otherwise complete, rather than a retransmission round
+ * trip. Both sides exchange their UDP port and a random key in a
+ * "sendudprelay" message before verack; every datagram is authenticated
+ * with the receiver's key, which also identifies the sending peer. A
+ * reassembled compact block is handed to the message handler as if it had
+ * arrived over the peer's connection, and missing transactions are fetched
+ * over TCP as usual.
+ */
+class UdpBlockRelay
+{
+public:
+    //! Called with the peer and serialized compact block of every block reassembled.
+    using DeliverFn = std::function<void(NodeId, std::vector<unsigned char>&&)>;
+
+    UdpBlockRelay(const CMessageHeader::MessageStartChars& message_start, DeliverFn deliver);
+    ~UdpBlockRelay();
+
+    //! Open the sockets on port. Returns false if neither IPv4 nor IPv6 could be bound.
+    bool Bind(uint16_t port, std::string& error);
+    uint16_t GetPort() const { return m_port; }
+    //! Receive datagrams until interrupted.
+    void ThreadReceive(CThreadInterrupt& interrupt);
+
+    //! Pick the key a peer is to authenticate its datagrams to us with.
+    std::pair<uint64_t, uint64_t> PreRegisterPeer(NodeId peer_id);
+    //! Exchange blocks with a peer after its sendudprelay arrived. Returns false if we did not offer it, or it was sent twice.
+    bool RegisterPeer(NodeId peer_id, const CService& endpoint, uint64_t k0, uint64_t k1);
+    void ForgetPeer(NodeId peer_id);
+    bool IsPeerRegistered(NodeId peer_id) const;
+
+    //! Send a new block to all registered peers, except the one it came from.
+    void RelayBlock(const CBlockHeaderAndShortTxIDs& cmpctblock);
+    //! Process one datagram received from the given address.
+    void ProcessPacket(const CService& from, Span<const unsigned char> packet);
+
+private:
+    struct Peer {
+        //! Key of the peer's datagrams to us.
+        std::pair<uint64_t, uint64_t> m_recv_key;
+        //! Key of our datagrams to the peer; unset until it sent sendudprelay.
+        std::pair<uint64_t, uint64_t> m_send_key;
+        CService m_endpoint;
+        bool m_registered{false};
+        //! Blocks being reassembled, with the time their first datagram arrived.
+        std::map<uint256, std::pair<std::chrono::microseconds, FecDecoder>> m_partial;
+    };
+
+    struct RecentBlock {
+        uint256 hash;
+        //! Peer the block was received from, -1 if not received over UDP.
+        NodeId from;
+        bool relayed;
+    };
+
+    void SendTo(const CService& to, const std::vector<unsigned char>& packet);
+    //! Remember a block, so that it is neither reassembled again nor relayed back to the peer it came from.
+    void AddRecent(const uint256& hash, NodeId from, bool relayed) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    CMessageHeader::MessageStartChars m_message_start;
+    const DeliverFn m_deliver;
+    SOCKET m_socket_v4{INVALID_SOCKET};
+    SOCKET m_socket_v6{INVALID_SOCKET};
+    uint16_t m_port{0};
+
+    mutable Mutex m_mutex;
+    std::unordered_map<NodeId, Peer> m_peers GUARDED_BY(m_mutex);
+    //! The last UDPRELAY_RECENT_BLOCKS blocks relayed or received, oldest first.
+    std::vector<RecentBlock> m_recent GUARDED_BY(m_mutex);
+};
+
+#endif // PALLADIUM_UDPRELAY_H
@@ -9,6 +9,7 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <functional>
 #include <string>
 #include <vector>
 #include <map>
@@ -144,6 +145,14 @@ public:
 
     std::string write(unsigned int prettyIndent = 0,
                       unsigned int indentLevel = 0) const;
+    // Serialize like write(), appending to s. Whenever s holds at least
+    // flushSize bytes between two elements, it is handed to flush, which
+    // must consume it (e.g. s.clear()), so large values can be written out
+    // in pieces instead of as one string.
+    void write(std::string& s, size_t flushSize,
+               const std::function<void(std::string&)>& flush,
+               unsigned int prettyIndent = 0,
+               unsigned int indentLevel = 0) const;
 
     bool read(const char *raw, size_t len);
     bool read(const char *raw) { return read(raw, strlen(raw)); }
@@ -158,8 +167,9 @@ private:
     std::vector<UniValue> values;
 
     bool findKey(const std::string& key, size_t& retIdx) const;
-    void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
-    void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const;
+    void writeValue(unsigned int prettyIndent, unsigned int indentLevel, std::string& s, size_t flushSize, const std::function<void(std::string&)>* flush) const;
+    void writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s, size_t flushSize, const std::function<void(std::string&)>* flush) const;
+    void writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s, size_t flushSize, const std::function<void(std::string&)>* flush) const;
 
 public:
     // Strict type-specific getters, these throw std::runtime_error if the
@@ -8,11 +8,8 @@
 #include "univalue.h"
 #include "univalue_escapes.h"
 
-static std::string json_escape(const std::string& inS)
+static void json_escape(const std::string& inS, std::string& outS)
 {
-    std::string outS;
-    outS.reserve(inS.size() * 2);
-
     for (unsigned int i = 0; i < inS.size(); i++) {
         unsigned char ch = inS[i];
         const char *escStr = escapes[ch];
@@ -22,8 +19,6 @@ static std::string json_escape(const std::string& inS)
         else
             outS += ch;
     }
-
-    return outS;
 }
 
 std::string UniValue::write(unsigned int prettyIndent,
@@ -31,7 +26,26 @@ std::string UniValue::write(unsigned int prettyIndent,
 {
     std::string s;
     s.reserve(1024);
+    writeValue(prettyIndent, indentLevel, s, 0, nullptr);
+    return s;
+}
+
+void UniValue::write(std::string& s, size_t flushSize,
+                     const std::function<void(std::string&)>& flush,
+                     unsigned int prettyIndent,
+                     unsigned int indentLevel) const
+{
+    writeValue(prettyIndent, indentLevel, s, flushSize, &flush);
+}
 
+static void maybeFlush(std::string& s, size_t flushSize, const std::function<void(std::string&)>* flush)
+{
+    if (flush && s.size() >= flushSize)
+        (*flush)(s);
+}
+
+void UniValue::writeValue(unsigned int prettyIndent, unsigned int indentLevel, std::string& s, size_t flushSize, const std::function<void(std::string&)>* flush) const
+{
     unsigned int modIndent = indentLevel;
     if (modIndent == 0)
         modIndent = 1;
@@ -41,13 +55,15 @@ std::string UniValue::write(unsigned int prettyIndent,
         s += "null";
         break;
     case VOBJ:
-        writeObject(prettyIndent, modIndent, s);
+        writeObject(prettyIndent, modIndent, s, flushSize, flush);
         break;
     case VARR:
-        writeArray(prettyIndent, modIndent, s);
+        writeArray(prettyIndent, modIndent, s, flushSize, flush);
         break;
     case VSTR:
-        s += "\"" + json_escape(val) + "\"";
+        s += "\"";
+        json_escape(val, s);
+        s += "\"";
         break;
     case VNUM:
         s += val;
@@ -56,8 +72,6 @@ std::string UniValue::write(unsigned int prettyIndent,
         s += (val == "1" ? "true" : "false");
         break;
     }
-
-    return s;
 }
 
 static void indentStr(unsigned int prettyIndent, unsigned int indentLevel, std::string& s)
@@ -65,7 +79,7 @@ static void indentStr(unsigned int prettyIndent, unsigned int indentLevel, std::
     s.append(prettyIndent * indentLevel, ' ');
 }
 
-void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const
+void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, std::string& s, size_t flushSize, const std::function<void(std::string&)>* flush) const
 {
     s += "[";
     if (prettyIndent)
@@ -74,12 +88,13 @@ void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, s
     for (unsigned int i = 0; i < values.size(); i++) {
         if (prettyIndent)
             indentStr(prettyIndent, indentLevel, s);
-        s += values[i].write(prettyIndent, indentLevel + 1);
+        values[i].writeValue(prettyIndent, indentLevel + 1, s, flushSize, flush);
         if (i != (values.size() - 1)) {
             s += ",";
         }
         if (prettyIndent)
             s += "\n";
+        maybeFlush(s, flushSize, flush);
     }
 
     if (prettyIndent)
@@ -87,7 +102,7 @@ void UniValue::writeArray(unsigned int prettyIndent, unsigned int indentLevel, s
     s += "]";
 }
 
-void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s) const
+void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel, std::string& s, size_t flushSize, const std::function<void(std::string&)>* flush) const
 {
     s += "{";
     if (prettyIndent)
@@ -96,18 +111,20 @@ void UniValue::writeObject(unsigned int prettyIndent, unsigned int indentLevel,
     for (unsigned int i = 0; i < keys.size(); i++) {
         if (prettyIndent)
             indentStr(prettyIndent, indentLevel, s);
-        s += "\"" + json_escape(keys[i]) + "\":";
+        s += "\"";
+        json_escape(keys[i], s);
+        s += "\":";
         if (prettyIndent)
             s += " ";
-        s += values.at(i).write(prettyIndent, indentLevel + 1);
+        values.at(i).writeValue(prettyIndent, indentLevel + 1, s, flushSize, flush);
         if (i != (values.size() - 1))
             s += ",";
         if (prettyIndent)
             s += "\n";
+        maybeFlush(s, flushSize, flush);
     }
 
     if (prettyIndent)
         indentStr(prettyIndent, indentLevel - 1, s);
     s += "}";
 }
-
@@ -393,6 +393,50 @@ BOOST_AUTO_TEST_CASE(univalue_readwrite)
     BOOST_CHECK(!v.read("{} 42"));
 }
 
+BOOST_AUTO_TEST_CASE(univalue_write_chunks)
+{
+    UniValue v;
+    BOOST_CHECK(v.read(json1));
+
+    // Writing in pieces gives the same output, for any piece size
+    for (size_t flushSize = 1; flushSize < 64; flushSize *= 2) {
+        for (unsigned int prettyIndent = 0; prettyIndent < 3; prettyIndent += 2) {
+            std::string out, pending;
+            unsigned int flushes = 0;
+            v.write(pending, flushSize, [&](std::string& s) {
+                BOOST_CHECK(s.size() >= flushSize);
+                out += s;
+                s.clear();
+                ++flushes;
+            }, prettyIndent);
+            out += pending;
+            BOOST_CHECK_EQUAL(out, v.write(prettyIndent));
+            BOOST_CHECK(flushes > 0);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(univalue_read_long_strings)
+{
+    // Strings are copied in runs of plain characters; check that whatever
+    // ends a run is handled at any offset into it.
+    UniValue v;
+    for (size_t len = 0; len < 20; ++len) {
+        const std::string plain(len, 'a');
+        BOOST_CHECK(v.read("[\"" + plain + "\"]"));
+        BOOST_CHECK_EQUAL(v[0].getValStr(), plain);
+        BOOST_CHECK(v.read("[\"" + plain + "\\n" + plain + "\"]"));
+        BOOST_CHECK_EQUAL(v[0].getValStr(), plain + "\n" + plain);
+        BOOST_CHECK(v.read("[\"" + plain + "\xc3\xa9" + plain + "\"]"));
+        BOOST_CHECK_EQUAL(v[0].getValStr(), plain + "\xc3\xa9" + plain);
+        BOOST_CHECK(!v.read("[\"" + plain + "\x01" + plain + "\"]"));
+        BOOST_CHECK(!v.read("[\"" + plain + "\xc3" + plain + "\"]"));
+        BOOST_CHECK(!v.read("[\"" + plain));
+        BOOST_CHECK(v.read("{\"" + plain + "\":\"" + plain + "\"}"));
+        BOOST_CHECK_EQUAL(v[plain].getValStr(), plain);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 int main (int argc, char *argv[])
@@ -403,6 +447,8 @@ int main (int argc, char *argv[])
     univalue_array();
     univalue_object();
     univalue_readwrite();
+    univalue_write_chunks();
+    univalue_read_long_strings();
     return 0;
 }
 
@@ -2,7 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <util/asmap.h>
+
 #include <vector>
+#include <unordered_map>
 #include <assert.h>
 #include <crypto/common.h>
 
@@ -101,3 +104,73 @@ uint32_t Interpret(const std::vector<bool> &asmap, const std::vector<bool> &ip)
     }
     return 0; // 0 is not a valid ASN
 }
+
+constexpr uint32_t Asmap::END;
+
+Asmap::Asmap(std::vector<bool> bits) : m_bits(std::move(bits))
+{
+    // Decode every instruction reachable from the start once, at the bit
+    // position Interpret would decode it at.
+    std::unordered_map<size_t, uint32_t> indexes;
+    std::vector<size_t> todo;
+    auto get_index = [&](size_t offset) -> uint32_t {
+        if (offset == m_bits.size()) return END;
+        auto inserted = indexes.emplace(offset, m_program.size());
+        if (inserted.second) {
+            m_program.emplace_back();
+            todo.push_back(offset);
+        }
+        return inserted.first->second;
+    };
+    get_index(0);
+
+    const std::vector<bool>::const_iterator endpos = m_bits.end();
+    while (!todo.empty()) {
+        const size_t offset = todo.back();
+        todo.pop_back();
+        const uint32_t index = indexes.at(offset);
+        std::vector<bool>::const_iterator pos = m_bits.begin() + offset;
+        Instruction ins{DecodeType(pos, endpos), 0, END, END};
+        if (ins.m_opcode == 0 || ins.m_opcode == 3) {
+            ins.m_arg = DecodeASN(pos, endpos);
+        } else if (ins.m_opcode == 1) {
+            const uint32_t jump = DecodeJump(pos, endpos);
+            if (jump < endpos - pos) ins.m_jump = get_index(pos - m_bits.begin() + jump);
+        } else if (ins.m_opcode == 2) {
+            ins.m_arg = DecodeMatch(pos, endpos);
+        }
+        if (ins.m_opcode >= 1 && ins.m_opcode <= 3) ins.m_next = get_index(pos - m_bits.begin());
+        m_program[index] = ins;
+    }
+}
+
+uint32_t Asmap::Lookup(const std::array<uint8_t, 16>& ip) const
+{
+    auto get_bit = [&ip](int bit) -> uint32_t { return (ip[bit >> 3] >> (7 - (bit & 7))) & 1; };
+    int bit = 0;
+    uint32_t default_asn = 0;
+    uint32_t index = m_program.empty() ? END : 0;
+    while (index != END) {
+        const Instruction& ins = m_program[index];
+        if (ins.m_opcode == 0) {
+            return ins.m_arg;
+        } else if (ins.m_opcode == 1) {
+            if (bit == 128) break;
+            index = get_bit(bit++) ? ins.m_jump : ins.m_next;
+        } else if (ins.m_opcode == 2) {
+            const uint32_t matchlen = CountBits(ins.m_arg) - 1;
+            for (uint32_t i = 0; i < matchlen && bit < 128; i++) {
+                if (get_bit(bit++) != ((ins.m_arg >> (matchlen - 1 - i)) & 1)) {
+                    return default_asn;
+                }
+            }
+            index = ins.m_next;
+        } else if (ins.m_opcode == 3) {
+            default_asn = ins.m_arg;
+            index = ins.m_next;
+        } else {
+            break;
+        }
+    }
+    return 0; // 0 is not a valid ASN
+}
@@ -5,6 +5,46 @@
 #ifndef PALLADIUM_UTIL_ASMAP_H
 #define PALLADIUM_UTIL_ASMAP_H
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
 uint32_t Interpret(const std::vector<bool> &asmap, const std::vector<bool> &ip);
 
+/**
+ * An asmap, decoded once into a program of instructions when it is set.
+ *
+ * Lookups follow the program instead of decoding the bytecode bit by bit
+ * from a std::vector<bool>, with the same result as Interpret.
+ */
+class Asmap
+{
+public:
+    Asmap() = default;
+    Asmap(std::vector<bool> bits);
+
+    const std::vector<bool>& GetBits() const { return m_bits; }
+    size_t size() const { return m_bits.size(); }
+
+    //! The ASN of a 128-bit address (IPv4 ones mapped into ::ffff:0:0/96), or 0
+    uint32_t Lookup(const std::array<uint8_t, 16>& ip) const;
+
+private:
+    struct Instruction {
+        //! Opcode as decoded, see Interpret
+        uint32_t m_opcode;
+        //! ASN or match bits
+        uint32_t m_arg;
+        //! Index of the instruction that follows, or END
+        uint32_t m_next;
+        //! Index of the instruction a jump goes to, or END if that is outside the asmap
+        uint32_t m_jump;
+    };
+    static constexpr uint32_t END = UINT32_MAX;
+
+    std::vector<bool> m_bits;
+    std::vector<Instruction> m_program;
+};
+
 #endif // PALLADIUM_UTIL_ASMAP_H
@@ -0,0 +1,129 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <util/lz4.h>
+
+#include <crypto/common.h>
+
+#include <algorithm>
+#include <array>
+#include <string.h>
+
+namespace {
+//! Shortest match the format can encode
+constexpr size_t MIN_MATCH = 4;
+//! The last bytes of a block are always literals
+constexpr size_t LAST_LITERALS = 5;
+//! The last match must start at least this many bytes before the end of the block
+constexpr size_t MF_LIMIT = 12;
+//! Matches are encoded with a 16-bit offset
+constexpr size_t MAX_OFFSET = 65535;
+constexpr int HASH_LOG = 12;
+
+void WriteLength(std::vector<uint8_t>& out, size_t len)
+{
+    while (len >= 255) {
+        out.push_back(255);
+        len -= 255;
+    }
+    out.push_back(len);
+}
+
+void WriteSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literal_len, size_t offset, size_t match_len)
+{
+    const size_t match_code = match_len - MIN_MATCH;
+    out.push_back((std::min<size_t>(literal_len, 15) << 4) | std::min<size_t>(match_code, 15));
+    if (literal_len >= 15) WriteLength(out, literal_len - 15);
+    out.insert(out.end(), literals, literals + literal_len);
+    out.push_back(offset & 0xff);
+    out.push_back(offset >> 8);
+    if (match_code >= 15) WriteLength(out, match_code - 15);
+}
+
+bool ReadLength(Span<const uint8_t> data, size_t& pos, size_t& len)
+{
+    uint8_t byte;
+    do {
+        if (pos >= data.size()) return false;
+        byte = data[pos++];
+        len += byte;
+    } while (byte == 255);
+    return true;
+}
+} // namespace
+
+std::vector<uint8_t> LZ4Compress(Span<const uint8_t> data)
+{
+    std::vector<uint8_t> out;
+    out.reserve(data.size() + data.size() / 255 + 16);
+    const uint8_t* src = data.data();
+    const size_t size = data.size();
+    size_t anchor = 0;
+
+    if (size > MF_LIMIT) {
+        // Positions (plus one, zero meaning none) of the last occurrence of each hashed 4-byte sequence
+        std::array<uint32_t, 1 << HASH_LOG> table{};
+        const size_t match_limit = size - LAST_LITERALS;
+        size_t pos = 0;
+        while (pos + MF_LIMIT <= size) {
+            const uint32_t sequence = ReadLE32(src + pos);
+            const uint32_t hash = (sequence * 2654435761U) >> (32 - HASH_LOG);
+            const size_t candidate = table[hash];
+            table[hash] = pos + 1;
+            if (candidate == 0 || pos - (candidate - 1) > MAX_OFFSET || ReadLE32(src + candidate - 1) != sequence) {
+                ++pos;
+                continue;
+            }
+            const size_t ref = candidate - 1;
+            size_t match_len = MIN_MATCH;
+            while (pos + match_len < match_limit && src[ref + match_len] == src[pos + match_len]) ++match_len;
+            WriteSequence(out, src + anchor, pos - anchor, pos - ref, match_len);
+            pos += match_len;
+            anchor = pos;
+        }
+    }
+
+    // Final sequence: literals only
+    const size_t literal_len = size - anchor;
+    out.push_back(std::min<size_t>(literal_len, 15) << 4);
+    if (literal_len >= 15) WriteLength(out, literal_len - 15);
+    out.insert(out.end(), src + anchor, src + size);
+    return out;
+}
+
+bool LZ4Decompress(Span<const uint8_t> data, size_t out_size, std::vector<uint8_t>& out)
+{
+    out.assign(out_size, 0);
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+    while (in_pos < data.size()) {
+        const uint8_t token = data[in_pos++];
+
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !ReadLength(data, in_pos, literal_len)) return false;
+        if (literal_len > data.size() - in_pos || literal_len > out_size - out_pos) return false;
+        if (literal_len > 0) memcpy(out.data() + out_pos, data.data() + in_pos, literal_len);
+        in_pos += literal_len;
+        out_pos += literal_len;
+
+        // The last sequence has no match
+        if (in_pos == data.size()) break;
+
+        if (data.size() - in_pos < 2) return false;
+        const size_t offset = data[in_pos] | (data[in_pos + 1] << 8);
+        in_pos += 2;
+        if (offset == 0 || offset > out_pos) return false;
+
+        size_t match_len = token & 15;
+        if (match_len == 15 && !ReadLength(data, in_pos, match_len)) return false;
+        match_len += MIN_MATCH;
+        if (match_len > out_size - out_pos) return false;
+        // Byte by byte, as the match may overlap the bytes it produces
+        for (size_t i = 0; i < match_len; ++i) {
+            out[out_pos + i] = out[out_pos - offset + i];
+        }
+        out_pos += match_len;
+    }
+    return out_pos == out_size;
+}
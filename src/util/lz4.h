@@ -0,0 +1,25 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_UTIL_LZ4_H
+#define PALLADIUM_UTIL_LZ4_H
+
+#include <span.h>
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Compress data into the LZ4 block format (a single block, without the frame
+ * header). The uncompressed size is not stored and must be kept by the caller.
+ */
+std::vector<uint8_t> LZ4Compress(Span<const uint8_t> data);
+
+/**
+ * Decompress an LZ4 block that expands to exactly out_size bytes. Returns false
+ * on malformed input, never reading or writing out of bounds.
+ */
+bool LZ4Decompress(Span<const uint8_t> data, size_t out_size, std::vector<uint8_t>& out);
+
+#endif // PALLADIUM_UTIL_LZ4_H
@@ -0,0 +1,61 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <util/mappedfile.h>
+
+#ifdef WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::unique_ptr<MappedFile> MappedFile::Open(const fs::path& path, size_t size)
+{
+    if (size == 0) return nullptr;
+#ifdef WIN32
+    HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || (uint64_t)file_size.QuadPart < size) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr) return nullptr;
+    void* addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    // The view keeps the mapping object alive.
+    CloseHandle(mapping);
+    if (addr == nullptr) return nullptr;
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < size) {
+        close(fd);
+        return nullptr;
+    }
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file.
+    close(fd);
+    if (addr == MAP_FAILED) return nullptr;
+#endif
+    return std::unique_ptr<MappedFile>(new MappedFile(static_cast<const uint8_t*>(addr), size));
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef WIN32
+    UnmapViewOfFile(m_data);
+#else
+    munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+}
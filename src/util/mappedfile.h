@@ -0,0 +1,41 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_UTIL_MAPPEDFILE_H
+#define PALLADIUM_UTIL_MAPPEDFILE_H
+
+#include <fs.h>
+#include <span.h>
+
+#include <memory>
+#include <stdint.h>
+
+/**
+ * A read-only memory mapping of the first `size` bytes of a file. The
+ * mapping stays valid for the lifetime of the object, even if the file is
+ * later unlinked, so it can be shared between readers via shared_ptr.
+ */
+class MappedFile
+{
+public:
+    /** Map `size` bytes of `path`. Returns nullptr if the file cannot be mapped. */
+    static std::unique_ptr<MappedFile> Open(const fs::path& path, size_t size);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    Span<const uint8_t> GetSpan() const { return Span<const uint8_t>(m_data, m_size); }
+
+private:
+    MappedFile(const uint8_t* data, size_t size) : m_data(data), m_size(size) {}
+
+    const uint8_t* m_data;
+    size_t m_size;
+};
+
+#endif // PALLADIUM_UTIL_MAPPEDFILE_H
@@ -0,0 +1,74 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <util/perfstats.h>
+
+#include <sync.h>
+#include <util/memory.h>
+
+#include <memory>
+
+namespace perf {
+namespace {
+
+struct Registry
+{
+    Mutex m_mutex;
+    std::map<std::string, std::unique_ptr<Histogram>> m_histograms GUARDED_BY(m_mutex);
+};
+
+Registry& GetRegistry()
+{
+    // Leaked like the logger, so that histograms used by static objects
+    // stay valid until the very end.
+    static Registry* g_registry{new Registry()};
+    return *g_registry;
+}
+
+} // namespace
+
+int64_t HistogramStats::ApproxQuantile(double q) const
+{
+    if (count == 0) return 0;
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket + 1 < buckets.size(); ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= q * count) return Histogram::BucketLimit(bucket);
+    }
+    return max;
+}
+
+HistogramStats Histogram::GetStats() const
+{
+    HistogramStats stats;
+    stats.count = m_count.load(std::memory_order_relaxed);
+    stats.total = m_total.load(std::memory_order_relaxed);
+    stats.max = m_max.load(std::memory_order_relaxed);
+    for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+        stats.buckets[bucket] = m_buckets[bucket].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+Histogram& GetHistogram(const std::string& name)
+{
+    Registry& registry = GetRegistry();
+    LOCK(registry.m_mutex);
+    std::unique_ptr<Histogram>& histogram = registry.m_histograms[name];
+    if (!histogram) histogram = MakeUnique<Histogram>();
+    return *histogram;
+}
+
+std::map<std::string, HistogramStats> GetAllStats()
+{
+    Registry& registry = GetRegistry();
+    LOCK(registry.m_mutex);
+    std::map<std::string, HistogramStats> ret;
+    for (const auto& histogram : registry.m_histograms) {
+        ret.emplace(histogram.first, histogram.second->GetStats());
+    }
+    return ret;
+}
+
+} // namespace perf
@@ -0,0 +1,97 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_UTIL_PERFSTATS_H
+#define PALLADIUM_UTIL_PERFSTATS_H
+
+#include <util/macros.h>
+#include <util/time.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace perf {
+
+struct HistogramStats
+{
+    uint64_t count{0};
+    //! Sum and maximum of the samples, in microseconds
+    int64_t total{0};
+    int64_t max{0};
+    std::array<uint64_t, 28> buckets{{}};
+
+    /** Upper limit of the bucket the q-quantile of the samples falls in, in microseconds */
+    int64_t ApproxQuantile(double q) const;
+};
+
+/**
+ * Latency histogram cheap enough to update on hot paths: updates are a
+ * few relaxed atomic operations, without locks. Bucket 0 counts samples
+ * under a microsecond, bucket i > 0 those of [2^(i-1), 2^i) microseconds,
+ * and the last bucket all longer ones.
+ */
+class Histogram
+{
+public:
+    static constexpr size_t BUCKETS = std::tuple_size<decltype(HistogramStats::buckets)>::value;
+
+    /** Upper limit (exclusive, in microseconds) of a bucket but the last */
+    static int64_t BucketLimit(size_t bucket) { return int64_t{1} << bucket; }
+
+    void Add(int64_t micros)
+    {
+        if (micros < 0) micros = 0;
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_total.fetch_add(micros, std::memory_order_relaxed);
+        int64_t max = m_max.load(std::memory_order_relaxed);
+        while (micros > max && !m_max.compare_exchange_weak(max, micros, std::memory_order_relaxed)) {}
+        size_t bucket = 0;
+        while (bucket + 1 < BUCKETS && micros >= BucketLimit(bucket)) ++bucket;
+        m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** Read the histogram. Concurrent updates may be partially included. */
+    HistogramStats GetStats() const;
+    int64_t Total() const { return m_total.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<int64_t> m_total{0};
+    std::atomic<int64_t> m_max{0};
+    std::array<std::atomic<uint64_t>, BUCKETS> m_buckets{};
+};
+
+/**
+ * Return the histogram of the given name, creating it on first use.
+ * Histograms are never destroyed, so the reference may be kept. This takes
+ * a lock; hot paths call it once and keep the reference (see PERF_TIME).
+ */
+Histogram& GetHistogram(const std::string& name);
+
+/** Statistics of all histograms, by name */
+std::map<std::string, HistogramStats> GetAllStats();
+
+/** Add the time from construction to destruction to a histogram */
+class ScopedTimer
+{
+public:
+    explicit ScopedTimer(Histogram& histogram) : m_histogram(histogram), m_start(GetTimeMicros()) {}
+    ~ScopedTimer() { m_histogram.Add(GetTimeMicros() - m_start); }
+
+private:
+    Histogram& m_histogram;
+    const int64_t m_start;
+};
+
+} // namespace perf
+
+/** Time the rest of the enclosing scope into the histogram of the given (constant) name */
+#define PERF_TIME(name)                                                                        \
+    static perf::Histogram& PASTE2(perf_histogram_, __LINE__) = perf::GetHistogram(name); \
+    perf::ScopedTimer PASTE2(perf_timer_, __LINE__)(PASTE2(perf_histogram_, __LINE__))
+
+#endif // PALLADIUM_UTIL_PERFSTATS_H
@@ -14,6 +14,10 @@
 #include <errno.h>
 #include <limits>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 static const std::string CHARS_ALPHA_NUM = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
 
 static const std::string SAFE_CHARS[] =
@@ -53,16 +57,66 @@ const signed char p_util_hexdigit[256] =
   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,
   -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, };
 
+const char HEX_PAIRS[513] =
+    "000102030405060708090a0b0c0d0e0f"
+    "101112131415161718191a1b1c1d1e1f"
+    "202122232425262728292a2b2c2d2e2f"
+    "303132333435363738393a3b3c3d3e3f"
+    "404142434445464748494a4b4c4d4e4f"
+    "505152535455565758595a5b5c5d5e5f"
+    "606162636465666768696a6b6c6d6e6f"
+    "707172737475767778797a7b7c7d7e7f"
+    "808182838485868788898a8b8c8d8e8f"
+    "909192939495969798999a9b9c9d9e9f"
+    "a0a1a2a3a4a5a6a7a8a9aaabacadaeaf"
+    "b0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+    "c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"
+    "d0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+    "e0e1e2e3e4e5e6e7e8e9eaebecedeeef"
+    "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
 signed char HexDigit(char c)
 {
     return p_util_hexdigit[(unsigned char)c];
 }
 
+#if defined(__SSE2__)
+/** Whether all 16 characters at p are hex digits. */
+static inline bool IsHex16(const char* p)
+{
+    const __m128i c = _mm_loadu_si128((const __m128i*)p);
+    // Characters above 0x7f compare as negative, so they are outside all ranges.
+    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    const __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    const __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    return _mm_movemask_epi8(_mm_or_si128(digit, alpha)) == 0xffff;
+}
+
+/** Decode 16 hex digits at p, which IsHex16 accepted, into 8 bytes at out. */
+static inline void DecodeHex16(unsigned char* out, const char* p)
+{
+    const __m128i c = _mm_loadu_si128((const __m128i*)p);
+    // '0'-'9' have 0x40 clear and their value in the low nibble; letters
+    // have 0x40 set and their value minus 9 in the low nibble.
+    const __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(_mm_and_si128(c, _mm_set1_epi8(0x40)), _mm_setzero_si128()), _mm_set1_epi8(9));
+    const __m128i v = _mm_add_epi8(_mm_and_si128(c, _mm_set1_epi8(0x0f)), letter);
+    // Each 16-bit lane holds the high nibble in its low byte and the low nibble in its high byte.
+    const __m128i bytes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00ff)), 4), _mm_srli_epi16(v, 8));
+    _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(bytes, bytes));
+}
+#endif
+
 bool IsHex(const std::string& str)
 {
-    for(std::string::const_iterator it(str.begin()); it != str.end(); ++it)
-    {
-        if (HexDigit(*it) < 0)
+    const char* p = str.data();
+    size_t len = str.size();
+#if defined(__SSE2__)
+    for (; len >= 16; p += 16, len -= 16) {
+        if (!IsHex16(p)) return false;
+    }
+#endif
+    for (; len > 0; ++p, --len) {
+        if (HexDigit(*p) < 0)
             return false;
     }
     return (str.size() > 0) && (str.size()%2 == 0);
@@ -81,12 +135,50 @@ bool IsHexNumber(const std::string& str)
     return (str.size() > starting_location);
 }
 
-std::vector<unsigned char> ParseHex(const char* psz)
+void HexEncode(char* out, const unsigned char* in, size_t len)
+{
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i letter = _mm_set1_epi8('a' - '0' - 10);
+    for (; len >= 16; in += 16, out += 32, len -= 16) {
+        const __m128i x = _mm_loadu_si128((const __m128i*)in);
+        const __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), mask);
+        const __m128i lo = _mm_and_si128(x, mask);
+        __m128i a = _mm_unpacklo_epi8(hi, lo);
+        __m128i b = _mm_unpackhi_epi8(hi, lo);
+        a = _mm_add_epi8(_mm_add_epi8(a, zero), _mm_and_si128(_mm_cmpgt_epi8(a, nine), letter));
+        b = _mm_add_epi8(_mm_add_epi8(b, zero), _mm_and_si128(_mm_cmpgt_epi8(b, nine), letter));
+        _mm_storeu_si128((__m128i*)out, a);
+        _mm_storeu_si128((__m128i*)(out + 16), b);
+    }
+#endif
+    for (; len > 0; ++in, --len) {
+        const char* pair = &HEX_PAIRS[2 * *in];
+        *out++ = pair[0];
+        *out++ = pair[1];
+    }
+}
+
+/** Decode the hex dump of len characters at psz, where psz[len] is a NUL. */
+static std::vector<unsigned char> ParseHex(const char* psz, size_t len)
 {
     // convert hex dump to vector
     std::vector<unsigned char> vch;
+    vch.reserve(len / 2);
+    const char* const end = psz + len;
     while (true)
     {
+#if defined(__SSE2__)
+        // Runs of digits without spaces, as most hex dumps are, decode 8 bytes at a time.
+        while (end - psz >= 16 && IsHex16(psz)) {
+            unsigned char bytes[8];
+            DecodeHex16(bytes, psz);
+            vch.insert(vch.end(), bytes, bytes + 8);
+            psz += 16;
+        }
+#endif
         while (IsSpace(*psz))
             psz++;
         signed char c = HexDigit(*psz++);
@@ -102,9 +194,14 @@ std::vector<unsigned char> ParseHex(const char* psz)
     return vch;
 }
 
+std::vector<unsigned char> ParseHex(const char* psz)
+{
+    return ParseHex(psz, strlen(psz));
+}
+
 std::vector<unsigned char> ParseHex(const std::string& str)
 {
-    return ParseHex(str.c_str());
+    return ParseHex(str.c_str(), str.size());
 }
 
 void SplitHostPort(std::string in, int &portOut, std::string &hostOut) {
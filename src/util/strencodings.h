@@ -119,28 +119,52 @@ NODISCARD bool ParseUInt64(const std::string& str, uint64_t *out);
  */
 NODISCARD bool ParseDouble(const std::string& str, double *out);
 
+/** The two lowercase hex digits of every byte value, indexed by 2 * byte. */
+extern const char HEX_PAIRS[513];
+
+/**
+ * Write the lowercase hex encoding of the len bytes at in to out, which must
+ * have room for 2 * len characters. Uses SSE2 where available.
+ */
+void HexEncode(char* out, const unsigned char* in, size_t len);
+
 template<typename T>
 std::string HexStr(const T itbegin, const T itend)
 {
-    std::string rv;
-    static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
-                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
-    rv.reserve(std::distance(itbegin, itend) * 2);
+    std::string rv(std::distance(itbegin, itend) * 2, '\0');
+    char* out = &rv[0];
     for(T it = itbegin; it < itend; ++it)
     {
-        unsigned char val = (unsigned char)(*it);
-        rv.push_back(hexmap[val>>4]);
-        rv.push_back(hexmap[val&15]);
+        const char* pair = &HEX_PAIRS[2 * (unsigned char)(*it)];
+        *out++ = pair[0];
+        *out++ = pair[1];
     }
     return rv;
 }
 
+inline std::string HexStr(const unsigned char* itbegin, const unsigned char* itend)
+{
+    std::string rv((itend - itbegin) * 2, '\0');
+    HexEncode(&rv[0], itbegin, itend - itbegin);
+    return rv;
+}
+
+inline std::string HexStr(unsigned char* itbegin, unsigned char* itend)
+{
+    return HexStr(const_cast<const unsigned char*>(itbegin), const_cast<const unsigned char*>(itend));
+}
+
 template<typename T>
 inline std::string HexStr(const T& vch)
 {
     return HexStr(vch.begin(), vch.end());
 }
 
+inline std::string HexStr(const std::vector<unsigned char>& vch)
+{
+    return HexStr(vch.data(), vch.data() + vch.size());
+}
+
 /**
  * Format a paragraph of text to a fixed width, adding spaces for
  * indentation to any added line.
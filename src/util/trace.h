@@ -0,0 +1,37 @@
+// Copyright (c) 2026 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_UTIL_TRACE_H
+#define PALLADIUM_UTIL_TRACE_H
+
+#if defined(HAVE_CONFIG_H)
+#include <config/palladium-config.h>
+#endif
+
+// Statically defined tracepoints (USDT) for eBPF and SystemTap, built in
+// with --enable-usdt. Without it they compile to nothing; with it, a
+// tracepoint with no tracer attached is a nop, but its arguments are still
+// evaluated, so keep them cheap.
+
+#ifdef ENABLE_TRACING
+
+#include <sys/sdt.h>
+
+#define TRACE(context, event) DTRACE_PROBE(context, event)
+#define TRACE1(context, event, a) DTRACE_PROBE1(context, event, a)
+#define TRACE2(context, event, a, b) DTRACE_PROBE2(context, event, a, b)
+#define TRACE3(context, event, a, b, c) DTRACE_PROBE3(context, event, a, b, c)
+#define TRACE4(context, event, a, b, c, d) DTRACE_PROBE4(context, event, a, b, c, d)
+
+#else
+
+#define TRACE(context, event)
+#define TRACE1(context, event, a)
+#define TRACE2(context, event, a, b)
+#define TRACE3(context, event, a, b, c)
+#define TRACE4(context, event, a, b, c, d)
+
+#endif
+
+#endif // PALLADIUM_UTIL_TRACE_H
@@ -21,8 +21,12 @@
 #include <index/txindex.h>
 #include <logging.h>
 #include <logging/timer.h>
+#include <node/args_snapshot.h>
+#include <node/blockindex_image.h>
+#include <node/merkle.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
+#include <policy/rbf.h>
 #include <policy/settings.h>
 #include <pow.h>
 #include <primitives/block.h>
@@ -39,15 +43,23 @@
 #include <ui_interface.h>
 #include <uint256.h>
 #include <undo.h>
+#include <util/lz4.h>
+#include <util/mappedfile.h>
 #include <util/moneystr.h>
+#include <util/perfstats.h>
 #include <util/rbf.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <util/trace.h>
 #include <util/translation.h>
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <deque>
+#include <list>
 #include <string>
+#include <thread>
+#include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -106,10 +118,26 @@ CChain& ChainActive() {
 RecursiveMutex cs_main;
 
 CBlockIndex *pindexBestHeader = nullptr;
+//! Latest TipSnapshot, only accessed through std::atomic_load and std::atomic_store.
+static std::shared_ptr<const TipSnapshot> g_tip_snapshot;
+
+static Mutex g_coins_cache_stats_mutex;
+static CoinsCacheStats g_coins_cache_stats GUARDED_BY(g_coins_cache_stats_mutex);
 Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 bool g_parallel_script_checks{false};
+bool g_pipeline_script_checks{DEFAULT_SCRIPTCHECK_PIPELINE};
+bool g_parallel_prefetch{false};
+bool g_block_mmap{DEFAULT_BLOCKMMAP};
+bool g_block_index_image{DEFAULT_BLOCK_INDEX_IMAGE};
+bool g_block_compress{DEFAULT_BLOCKCOMPRESS};
+bool g_db_background_flush{DEFAULT_DB_BACKGROUND_FLUSH};
+bool g_coins_journal{DEFAULT_COINS_JOURNAL};
+int g_chainstate_shards{DEFAULT_CHAINSTATE_SHARDS};
+int g_dbcache_retain_percent{DEFAULT_DBCACHE_RETAIN};
+uint32_t g_coins_reuse_sample{DEFAULT_COINS_REUSE_SAMPLE};
+int64_t g_tip_notify_interval{DEFAULT_TIP_NOTIFY_INTERVAL};
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
@@ -119,6 +147,9 @@ bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
+uint64_t g_prune_headroom = 0;
+fs::path g_blocks_cold_dir;
+int g_blocks_hot_files = DEFAULT_BLOCKS_HOT_FILES;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
 uint256 hashAssumeValid;
@@ -149,21 +180,24 @@ namespace {
     std::set<int> setDirtyFileInfo;
 } // anon namespace
 
-CBlockIndex* LookupBlockIndex(const uint256& hash)
+boost::shared_mutex g_block_index_mutex;
+
+namespace {
+
+// The caller holds either cs_main or g_block_index_mutex, which the analysis
+// can't express.
+CBlockIndex* FindBlockIndex(const uint256& hash) NO_THREAD_SAFETY_ANALYSIS
 {
-    AssertLockHeld(cs_main);
     BlockMap::const_iterator it = g_blockman.m_block_index.find(hash);
     return it == g_blockman.m_block_index.end() ? nullptr : it->second;
 }
 
-CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
+CBlockIndex* FindFork(const CChain& chain, const CBlockLocator& locator)
 {
-    AssertLockHeld(cs_main);
-
     // Find the latest block common to locator and chain - we expect that
     // locator.vHave is sorted descending by height.
     for (const uint256& hash : locator.vHave) {
-        CBlockIndex* pindex = LookupBlockIndex(hash);
+        CBlockIndex* pindex = FindBlockIndex(hash);
         if (pindex) {
             if (chain.Contains(pindex))
                 return pindex;
@@ -175,15 +209,80 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
     return chain.Genesis();
 }
 
+/**
+ * The headers of the active chain serialized as in a headers message, one
+ * HEADERS_RECORD_SIZE record per height, and the tip they were written for.
+ * Guarded by g_block_index_mutex.
+ */
+std::vector<unsigned char> g_active_headers;
+const CBlockIndex* g_active_headers_tip = nullptr;
+
+/** Rewrite the records of g_active_headers past the fork with its previous tip */
+void UpdateActiveHeaders(const CChain& chain)
+{
+    const CBlockIndex* fork = g_active_headers_tip ? chain.FindFork(g_active_headers_tip) : nullptr;
+    size_t height = fork ? fork->nHeight + 1 : 0;
+    g_active_headers.resize(height * HEADERS_RECORD_SIZE);
+    CVectorWriter writer(SER_NETWORK, PROTOCOL_VERSION, g_active_headers, g_active_headers.size());
+    for (; (int)height <= chain.Height(); ++height) {
+        writer << chain[height]->GetBlockHeader() << uint8_t{0};
+    }
+    g_active_headers_tip = chain.Tip();
+}
+
+/** Move the tip of the active chain, see g_block_index_mutex. */
+void SetChainTip(CChain& chain, CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    boost::unique_lock<boost::shared_mutex> lock(g_block_index_mutex);
+    chain.SetTip(pindex);
+    UpdateActiveHeaders(chain);
+}
+
+} // namespace
+
+CBlockIndex* LookupBlockIndex(const uint256& hash)
+{
+    AssertLockHeld(cs_main);
+    return FindBlockIndex(hash);
+}
+
+CBlockIndex* LookupBlockIndexShared(const uint256& hash)
+{
+    return FindBlockIndex(hash);
+}
+
+CBlockIndex* FindForkInActiveChainShared(const CBlockLocator& locator)
+{
+    return FindFork(::ChainActive(), locator);
+}
+
+Span<const unsigned char> GetActiveChainHeaders(int height, int count)
+{
+    const size_t records = g_active_headers.size() / HEADERS_RECORD_SIZE;
+    if (height < 0 || count <= 0 || (size_t)height >= records) return {};
+    count = std::min<size_t>(count, records - height);
+    return Span<const unsigned char>(g_active_headers.data() + height * HEADERS_RECORD_SIZE, count * HEADERS_RECORD_SIZE);
+}
+
+CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
+{
+    AssertLockHeld(cs_main);
+    return FindFork(chain, locator);
+}
+
 std::unique_ptr<CBlockTreeDB> pblocktree;
 
 // See definition for documentation
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
 static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
 bool CheckInputScripts(const CTransaction& tx, TxValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
+static bool RunScriptChecks(std::vector<CScriptCheck>& checks);
 static FILE* OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
+/** Background pre-allocation and commits of the block and undo files, if started. */
+static FlatFileWorker g_block_file_worker;
+static FlatFileWorker g_undo_file_worker;
 
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
@@ -235,7 +334,7 @@ bool TestLockPointValidity(const LockPoints* lp)
     return true;
 }
 
-bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp, bool useExistingLockPoints)
+bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp, bool useExistingLockPoints, const CCoinsView* coins_view)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(pool.cs);
@@ -262,12 +361,13 @@ bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flag
     else {
         // CoinsTip() contains the UTXO set for ::ChainActive().Tip()
         CCoinsViewMemPool viewMemPool(&::ChainstateActive().CoinsTip(), pool);
+        if (!coins_view) coins_view = &viewMemPool;
         std::vector<int> prevheights;
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
             Coin coin;
-            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
+            if (!coins_view->GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
             if (coin.nHeight == MEMPOOL_HEIGHT) {
@@ -336,6 +436,13 @@ static bool IsCurrentForFeeEstimation() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/**
+ * Re-add the transactions of disconnected blocks to the mempool, earliest
+ * first. Those not accepted have their in-mempool descendants removed.
+ * Returns the txids of those added.
+ */
+static std::vector<uint256> AcceptDisconnectedToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& txs) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs);
+
 /* Make mempool consistent after a reorg, by re-adding or recursively erasing
  * disconnected block transactions from the mempool, and also removing any
  * other transactions from the mempool that are no longer valid given the new
@@ -352,29 +459,23 @@ static bool IsCurrentForFeeEstimation() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool, bool fAddToMempool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs)
 {
     AssertLockHeld(cs_main);
-    std::vector<uint256> vHashUpdate;
+    const CBlockIndex* pindexOldTip = disconnectpool.pindexOldTip;
     // disconnectpool's insertion_order index sorts the entries from
     // oldest to newest, but the oldest entry will be the last tx from the
     // latest mined block that was disconnected.
     // Iterate disconnectpool in reverse, so that we add transactions
     // back to the mempool starting with the earliest transaction that had
     // been previously seen in a block.
-    auto it = disconnectpool.queuedTx.get<insertion_order>().rbegin();
-    while (it != disconnectpool.queuedTx.get<insertion_order>().rend()) {
-        // ignore validation errors in resurrected transactions
-        TxValidationState stateDummy;
-        if (!fAddToMempool || (*it)->IsCoinBase() ||
-            !AcceptToMemoryPool(mempool, stateDummy, *it,
-                                nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */)) {
-            // If the transaction doesn't make it in to the mempool, remove any
-            // transactions that depend on it (which would now be orphans).
-            mempool.removeRecursive(**it, MemPoolRemovalReason::REORG);
-        } else if (mempool.exists((*it)->GetHash())) {
-            vHashUpdate.push_back((*it)->GetHash());
+    const std::vector<CTransactionRef> txs(disconnectpool.queuedTx.get<insertion_order>().rbegin(), disconnectpool.queuedTx.get<insertion_order>().rend());
+    disconnectpool.clear();
+    std::vector<uint256> vHashUpdate;
+    if (fAddToMempool) {
+        vHashUpdate = AcceptDisconnectedToMemoryPool(mempool, txs);
+    } else {
+        for (const CTransactionRef& tx : txs) {
+            mempool.removeRecursive(*tx, MemPoolRemovalReason::REORG);
         }
-        ++it;
     }
-    disconnectpool.queuedTx.clear();
     // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
     // no in-mempool children, which is generally not true when adding
     // previously-confirmed transactions back to the mempool.
@@ -382,10 +483,14 @@ static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool,
     // the disconnectpool that were added back and cleans up the mempool state.
     mempool.UpdateTransactionsFromBlock(vHashUpdate);
 
-    // We also need to remove any now-immature transactions
-    mempool.removeForReorg(&::ChainstateActive().CoinsTip(), ::ChainActive().Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
+    // We also need to remove any now-immature transactions. Unless the tip
+    // went back in height or time, only the transactions whose inputs were
+    // confirmed in a disconnected block need to be checked again.
+    const CBlockIndex* tip = ::ChainActive().Tip();
+    const bool only_invalid_lock_points = pindexOldTip && tip->nHeight >= pindexOldTip->nHeight && tip->GetMedianTimePast() >= pindexOldTip->GetMedianTimePast();
+    mempool.removeForReorg(&::ChainstateActive().CoinsTip(), tip->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS, only_invalid_lock_points);
     // Re-limit mempool size, in case we added any transactions
-    LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, std::chrono::hours{gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
+    LimitMempoolSize(mempool, GetArgsSnapshot().max_mempool_bytes, GetArgsSnapshot().mempool_expiry);
 }
 
 // Used to avoid mempool polluting consensus critical paths if CCoinsViewMempool
@@ -425,16 +530,23 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, TxValidationS
     return CheckInputScripts(tx, state, view, flags, /* cacheSigStore = */ true, /* cacheFullSciptStore = */ true, txdata);
 }
 
+/** Number of inputs from which a transaction's policy script checks use the script check threads */
+static constexpr size_t MIN_PARALLEL_POLICY_SCRIPT_CHECKS = 4;
+
+/** Descendants of the transactions replacements conflicted with, for the current mempool generation */
+static RBFConflictCache g_rbf_conflict_cache GUARDED_BY(cs_main){1000};
+
 namespace {
 
 class MemPoolAccept
 {
 public:
     MemPoolAccept(CTxMemPool& mempool) : m_pool(mempool), m_view(&m_dummy), m_viewmempool(&::ChainstateActive().CoinsTip(), m_pool),
-        m_limit_ancestors(gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT)),
-        m_limit_ancestor_size(gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000),
-        m_limit_descendants(gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT)),
-        m_limit_descendant_size(gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000) {}
+        m_limit_ancestors(GetArgsSnapshot().limit_ancestors),
+        m_limit_ancestor_size(GetArgsSnapshot().limit_ancestor_size),
+        m_limit_descendants(GetArgsSnapshot().limit_descendants),
+        m_limit_descendant_size(GetArgsSnapshot().limit_descendant_size),
+        m_limit_cluster(GetArgsSnapshot().limit_cluster) {}
 
     // We put the arguments we're handed into a struct, so we can pass them
     // around easier.
@@ -454,11 +566,20 @@ public:
          */
         std::vector<COutPoint>& m_coins_to_uncache;
         const bool m_test_accept;
+        /** Whether the feerate is checked for the whole package, instead of for each transaction. */
+        const bool m_package_feerates;
     };
 
     // Single transaction acceptance
     bool AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    // Acceptance of a sorted package whose transactions may depend on each other
+    bool AcceptPackage(const std::vector<CTransactionRef>& package, ATMPArgs& args, uint256& failed_txid) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    // Acceptance of the transactions of disconnected blocks one after the
+    // other, reusing the coins looked up for the earlier ones
+    std::vector<uint256> AcceptDisconnectedTransactions(const std::vector<CTransactionRef>& txs, int64_t accept_time) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
+
 private:
     // All the intermediate state that gets passed between the various levels
     // of checking a given transaction.
@@ -502,7 +623,7 @@ private:
     // Compare a package's feerate against minimum allowed.
     bool CheckFeeRate(size_t package_size, CAmount package_fee, TxValidationState& state)
     {
-        CAmount mempoolRejectFee = m_pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(package_size);
+        CAmount mempoolRejectFee = m_pool.GetMinFee(GetArgsSnapshot().max_mempool_bytes).GetFee(package_size);
         if (mempoolRejectFee > 0 && package_fee < mempoolRejectFee) {
             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool min fee not met", strprintf("%d < %d", package_fee, mempoolRejectFee));
         }
@@ -526,6 +647,7 @@ private:
     // in-mempool conflicts; see below).
     size_t m_limit_descendants;
     size_t m_limit_descendant_size;
+    const size_t m_limit_cluster;
 };
 
 bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
@@ -655,9 +777,9 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     // Only accept BIP68 sequence locked transactions that can be mined in the next
     // block; we don't want our mempool filled up with transactions that can't
     // be mined yet.
-    // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
-    // CoinsViewCache instead of create its own
-    if (!CheckSequenceLocks(m_pool, tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+    // Must keep pool.cs for this, as m_viewmempool reads the mempool. It also
+    // has the outputs of any package transactions before this one.
+    if (!CheckSequenceLocks(m_pool, tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp, false, &m_viewmempool))
         return state.Invalid(TxValidationResult::TX_PREMATURE_SPEND, "non-BIP68-final");
 
     CAmount nFees = 0;
@@ -699,8 +821,8 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
                 strprintf("%d", nSigOpsCost));
 
     // No transactions are allowed below minRelayTxFee except from disconnected
-    // blocks
-    if (!bypass_limits && !CheckFeeRate(nSize, nModifiedFees, state)) return false;
+    // blocks, unless the feerate of their package is checked instead
+    if (!bypass_limits && !args.m_package_feerates && !CheckFeeRate(nSize, nModifiedFees, state)) return false;
 
     if (nAbsurdFee && nFees > nAbsurdFee)
         return state.Invalid(TxValidationResult::TX_NOT_STANDARD,
@@ -781,6 +903,13 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         }
     }
 
+    // The transaction joins the clusters of all its ancestors. Conflicts that
+    // would be replaced are still counted, which only makes this stricter.
+    if (m_pool.GetTrackClusters() && m_pool.CalculateClusterSize(setAncestors, m_limit_cluster) >= m_limit_cluster) {
+        return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "too-large-mempool-cluster",
+                strprintf("exceeds cluster limit of %u transactions", m_limit_cluster));
+    }
+
     // Check if it's economically rational to mine this transaction rather
     // than the ones it replaces.
     nConflictingFees = 0;
@@ -795,7 +924,7 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     {
         CFeeRate newFeeRate(nModifiedFees, nSize);
         std::set<uint256> setConflictsParents;
-        const int maxDescendantsToVisit = 100;
+        const uint64_t maxDescendantsToVisit = 100;
         for (const auto& mi : setIterConflicting) {
             // Don't allow the replacement to reduce the feerate of the
             // mempool.
@@ -825,23 +954,12 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
             {
                 setConflictsParents.insert(txin.prevout.hash);
             }
-
-            nConflictingCount += mi->GetCountWithDescendants();
         }
-        // This potentially overestimates the number of actual descendants
-        // but we just want to be conservative to avoid doing too much
-        // work.
-        if (nConflictingCount <= maxDescendantsToVisit) {
-            // If not too many to replace, then calculate the set of
-            // transactions that would have to be evicted
-            for (CTxMemPool::txiter it : setIterConflicting) {
-                m_pool.CalculateDescendants(it, allConflicting);
-            }
-            for (CTxMemPool::txiter it : allConflicting) {
-                nConflictingFees += it->GetModifiedFee();
-                nConflictingSize += it->GetTxSize();
-            }
-        } else {
+        // If not too many to replace, then find the set of transactions
+        // that would have to be evicted. Their descendants are cached until
+        // the mempool changes, for replacement storms.
+        if (!GetEntriesForConflicts(m_pool, setIterConflicting, maxDescendantsToVisit, g_rbf_conflict_cache,
+                                    nConflictingCount, allConflicting, nConflictingFees, nConflictingSize)) {
             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "too many potential replacements",
                     strprintf("rejecting replacement %s; too many potential replacements (%d > %d)\n",
                         hash.ToString(),
@@ -908,6 +1026,16 @@ bool MemPoolAccept::PolicyScriptChecks(ATMPArgs& args, Workspace& ws, Precompute
 
     // Check input scripts and signatures.
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+    // The inputs of larger transactions are verified on the script check
+    // threads first. These only tell whether all checks passed, so on a
+    // failure the scripts are run again below to find out why; the
+    // signatures that were fine are then served from the cache.
+    if (g_parallel_script_checks && tx.vin.size() >= MIN_PARALLEL_POLICY_SCRIPT_CHECKS) {
+        std::vector<CScriptCheck> checks;
+        if (CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata, &checks) && RunScriptChecks(checks)) {
+            return true;
+        }
+    }
     if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
         // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
         // need to turn both off, and compare against just turning off CLEANSTACK
@@ -990,14 +1118,15 @@ bool MemPoolAccept::Finalize(ATMPArgs& args, Workspace& ws)
     // - it's not being re-added during a reorg which bypasses typical mempool fee limits
     // - the node is not behind
     // - the transaction is not dependent on any other transactions in the mempool
-    bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation() && m_pool.HasNoInputsOf(tx);
+    bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && !args.m_package_feerates && IsCurrentForFeeEstimation() && m_pool.HasNoInputsOf(tx);
 
     // Store transaction in memory
     m_pool.addUnchecked(*entry, setAncestors, validForFeeEstimation);
 
-    // trim mempool and check if tx was trimmed
-    if (!bypass_limits) {
-        LimitMempoolSize(m_pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, std::chrono::hours{gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
+    // trim mempool and check if tx was trimmed; packages are trimmed once
+    // they have been added as a whole
+    if (!bypass_limits && !args.m_package_feerates) {
+        LimitMempoolSize(m_pool, GetArgsSnapshot().max_mempool_bytes, GetArgsSnapshot().mempool_expiry);
         if (!m_pool.exists(hash))
             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
     }
@@ -1011,7 +1140,10 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
 
     Workspace workspace(ptx);
 
-    if (!PreChecks(args, workspace)) return false;
+    {
+        PERF_TIME("mempool.prechecks");
+        if (!PreChecks(args, workspace)) return false;
+    }
 
     // Only compute the precomputed transaction data if we need to verify
     // scripts (ie, other policy checks pass). We perform the inexpensive
@@ -1019,20 +1151,195 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
     // checks pass, to mitigate CPU exhaustion denial-of-service attacks.
     PrecomputedTransactionData txdata(*ptx);
 
-    if (!PolicyScriptChecks(args, workspace, txdata)) return false;
+    {
+        PERF_TIME("mempool.policy_script_checks");
+        if (!PolicyScriptChecks(args, workspace, txdata)) return false;
+    }
 
-    if (!ConsensusScriptChecks(args, workspace, txdata)) return false;
+    {
+        PERF_TIME("mempool.consensus_script_checks");
+        if (!ConsensusScriptChecks(args, workspace, txdata)) return false;
+    }
 
     // Tx was accepted, but not added
     if (args.m_test_accept) return true;
 
-    if (!Finalize(args, workspace)) return false;
+    {
+        PERF_TIME("mempool.finalize");
+        if (!Finalize(args, workspace)) return false;
+    }
+
+    GetMainSignals().TransactionAddedToMempool(ptx, m_pool.GetAndIncrementSequence());
+
+    return true;
+}
+
+bool MemPoolAccept::AcceptPackage(const std::vector<CTransactionRef>& package, ATMPArgs& args, uint256& failed_txid)
+{
+    AssertLockHeld(cs_main);
+    LOCK(m_pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+    TxValidationState& state = args.m_state;
+
+    // Transactions already in the mempool are skipped; the others are
+    // checked in order, each seeing the outputs of the ones before it.
+    std::list<Workspace> workspaces;
+    uint64_t package_size = 0;
+    CAmount package_fees = 0;
+    CAmount package_modified_fees = 0;
+    for (const CTransactionRef& ptx : package) {
+        if (m_pool.exists(ptx->GetHash())) continue;
+        workspaces.emplace_back(ptx);
+        Workspace& ws = workspaces.back();
+        if (!PreChecks(args, ws)) {
+            failed_txid = ws.m_hash;
+            return false;
+        }
+        if (!ws.m_conflicts.empty()) {
+            failed_txid = ws.m_hash;
+            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "package-txn-mempool-conflict");
+        }
+        m_viewmempool.PackageAddTransaction(ws.m_ptx);
+        package_size += ws.m_entry->GetTxSize();
+        package_fees += ws.m_entry->GetFee();
+        package_modified_fees += ws.m_modified_fees;
+    }
+    if (workspaces.empty()) return true;
+
+    if (!args.m_bypass_limits && !CheckFeeRate(package_size, package_modified_fees, state)) return false;
+
+    if (args.m_absurd_fee && package_fees > args.m_absurd_fee) {
+        return state.Invalid(TxValidationResult::TX_NOT_STANDARD,
+                "absurdly-high-fee", strprintf("%d > %d", package_fees, args.m_absurd_fee));
+    }
+
+    // PreChecks() did not see the parents within the package. For the
+    // ancestor and descendant limits, treat the package as one transaction
+    // that joins all of its in-mempool ancestors.
+    CTxMemPool::setEntries ancestors;
+    for (const Workspace& ws : workspaces) {
+        ancestors.insert(ws.m_ancestors.begin(), ws.m_ancestors.end());
+    }
+    uint64_t ancestors_size = package_size;
+    for (CTxMemPool::txiter it : ancestors) {
+        ancestors_size += it->GetTxSize();
+        if (it->GetCountWithDescendants() + workspaces.size() > m_limit_descendants ||
+                it->GetSizeWithDescendants() + package_size > m_limit_descendant_size) {
+            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "package-too-long-mempool-chain",
+                    strprintf("too many descendants for tx %s", it->GetTx().GetHash().ToString()));
+        }
+    }
+    if (ancestors.size() + workspaces.size() > m_limit_ancestors || ancestors_size > m_limit_ancestor_size) {
+        return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "package-too-long-mempool-chain", "too many unconfirmed ancestors");
+    }
+    if (m_pool.GetTrackClusters() && m_pool.CalculateClusterSize(ancestors, m_limit_cluster) + workspaces.size() > m_limit_cluster) {
+        return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "too-large-mempool-cluster",
+                strprintf("exceeds cluster limit of %u transactions", m_limit_cluster));
+    }
+
+    // Verify the scripts of the whole package on the script check threads at
+    // once. Only if that fails is each transaction checked on its own, to
+    // find out which one is invalid.
+    std::list<PrecomputedTransactionData> txdata;
+    for (const Workspace& ws : workspaces) {
+        txdata.emplace_back(*ws.m_ptx);
+    }
+    bool scripts_checked = false;
+    if (g_parallel_script_checks) {
+        std::vector<CScriptCheck> checks;
+        auto td = txdata.begin();
+        for (const Workspace& ws : workspaces) {
+            TxValidationState state_dummy;
+            CheckInputScripts(*ws.m_ptx, state_dummy, m_view, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, *td++, &checks);
+        }
+        scripts_checked = RunScriptChecks(checks);
+    }
+    if (!scripts_checked) {
+        auto td = txdata.begin();
+        for (Workspace& ws : workspaces) {
+            if (!PolicyScriptChecks(args, ws, *td++)) {
+                failed_txid = ws.m_hash;
+                return false;
+            }
+        }
+    }
+
+    // Consensus script checks need the inputs to be in the mempool already.
+    if (args.m_test_accept) return true;
 
-    GetMainSignals().TransactionAddedToMempool(ptx);
+    // Take out what was added of the package if it does not make it in as a
+    // whole, so that no transaction stays for less than the minimum feerate.
+    auto remove_added = [&] {
+        for (const Workspace& ws : workspaces) {
+            m_pool.removeRecursive(*ws.m_ptx, MemPoolRemovalReason::SIZELIMIT);
+        }
+    };
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    auto td = txdata.begin();
+    for (Workspace& ws : workspaces) {
+        // The ancestors within the package are in the mempool by now.
+        std::string dummy;
+        ws.m_ancestors.clear();
+        m_pool.CalculateMemPoolAncestors(*ws.m_entry, ws.m_ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy);
+        if (!ConsensusScriptChecks(args, ws, *td++) || !Finalize(args, ws)) {
+            failed_txid = ws.m_hash;
+            remove_added();
+            return false;
+        }
+    }
 
+    if (!args.m_bypass_limits) {
+        LimitMempoolSize(m_pool, GetArgsSnapshot().max_mempool_bytes, GetArgsSnapshot().mempool_expiry);
+    }
+    for (const Workspace& ws : workspaces) {
+        if (!m_pool.exists(ws.m_hash)) {
+            failed_txid = ws.m_hash;
+            remove_added();
+            return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
+        }
+    }
+    for (const Workspace& ws : workspaces) {
+        GetMainSignals().TransactionAddedToMempool(ws.m_ptx, m_pool.GetAndIncrementSequence());
+    }
     return true;
 }
 
+std::vector<uint256> MemPoolAccept::AcceptDisconnectedTransactions(const std::vector<CTransactionRef>& txs, int64_t accept_time)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(m_pool.cs);
+    const CChainParams& chainparams = Params();
+    const CAmount nAbsurdFee = 0;
+    const size_t limit_descendants = m_limit_descendants;
+    const size_t limit_descendant_size = m_limit_descendant_size;
+    std::vector<uint256> added;
+    for (const CTransactionRef& ptx : txs) {
+        // ignore validation errors in resurrected transactions
+        TxValidationState state_dummy;
+        std::vector<COutPoint> coins_to_uncache;
+        std::list<CTransactionRef> replaced;
+        ATMPArgs args { chainparams, state_dummy, accept_time, &replaced, true /* bypass_limits */, nAbsurdFee, coins_to_uncache, false /* test_accept */, false /* package_feerates */ };
+        if (ptx->IsCoinBase() || !AcceptSingleTransaction(ptx, args)) {
+            // If the transaction doesn't make it in to the mempool, remove any
+            // transactions that depend on it (which would now be orphans).
+            m_pool.removeRecursive(*ptx, MemPoolRemovalReason::REORG);
+            for (const COutPoint& hashTx : coins_to_uncache)
+                ::ChainstateActive().CoinsTip().Uncache(hashTx);
+        } else if (m_pool.exists(ptx->GetHash())) {
+            added.push_back(ptx->GetHash());
+        }
+        // Later transactions must not find the outputs of replaced ones in m_view
+        for (const CTransactionRef& tx : replaced) {
+            for (size_t n = 0; n < tx->vout.size(); ++n) {
+                m_view.Uncache(COutPoint(tx->GetHash(), n));
+            }
+        }
+        // PreChecks() raises these for a replacement
+        m_limit_descendants = limit_descendants;
+        m_limit_descendant_size = limit_descendant_size;
+    }
+    return added;
+}
+
 } // anon namespace
 
 /** (try to) add transaction to memory pool with a specified acceptance time **/
@@ -1041,7 +1348,7 @@ static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPo
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     std::vector<COutPoint> coins_to_uncache;
-    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept };
+    MemPoolAccept::ATMPArgs args { chainparams, state, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept, false /* package_feerates */ };
     bool res = MemPoolAccept(pool).AcceptSingleTransaction(tx, args);
     if (!res) {
         // Remove coins that were not present in the coins cache before calling ATMPW;
@@ -1066,6 +1373,68 @@ bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTrans
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
 }
 
+/** Context-free checks of a package: its size, and that it is sorted and without duplicates or conflicts. */
+static bool CheckPackage(const std::vector<CTransactionRef>& package, TxValidationState& state)
+{
+    if (package.size() > MAX_PACKAGE_COUNT) {
+        return state.Invalid(TxValidationResult::TX_NOT_STANDARD, "package-too-many-transactions");
+    }
+    int64_t package_size = 0;
+    std::set<uint256> later_txids;
+    for (const CTransactionRef& tx : package) {
+        package_size += GetVirtualTransactionSize(*tx);
+        later_txids.insert(tx->GetHash());
+    }
+    if (later_txids.size() != package.size()) {
+        return state.Invalid(TxValidationResult::TX_NOT_STANDARD, "package-contains-duplicates");
+    }
+    if (package_size > MAX_PACKAGE_SIZE * 1000) {
+        return state.Invalid(TxValidationResult::TX_NOT_STANDARD, "package-too-large");
+    }
+    std::set<COutPoint> spent;
+    for (const CTransactionRef& tx : package) {
+        later_txids.erase(tx->GetHash());
+        for (const CTxIn& txin : tx->vin) {
+            if (later_txids.count(txin.prevout.hash)) {
+                return state.Invalid(TxValidationResult::TX_NOT_STANDARD, "package-not-sorted");
+            }
+            if (!spent.insert(txin.prevout).second) {
+                return state.Invalid(TxValidationResult::TX_CONSENSUS, "conflict-in-package");
+            }
+        }
+    }
+    return true;
+}
+
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, TxValidationState& state, const std::vector<CTransactionRef>& package,
+                               uint256& failed_txid, const CAmount nAbsurdFee)
+{
+    failed_txid.SetNull();
+    if (!CheckPackage(package, state)) return false;
+
+    const CChainParams& chainparams = Params();
+    std::vector<COutPoint> coins_to_uncache;
+    MemPoolAccept::ATMPArgs args { chainparams, state, GetTime(), nullptr /* plTxnReplaced */, false /* bypass_limits */, nAbsurdFee, coins_to_uncache, false /* test_accept */, true /* package_feerates */ };
+    bool res = MemPoolAccept(pool).AcceptPackage(package, args, failed_txid);
+    if (!res) {
+        // As in AcceptToMemoryPoolWithTime
+        for (const COutPoint& hashTx : coins_to_uncache)
+            ::ChainstateActive().CoinsTip().Uncache(hashTx);
+    }
+    BlockValidationState state_dummy;
+    ::ChainstateActive().FlushStateToDisk(chainparams, state_dummy, FlushStateMode::PERIODIC);
+    return res;
+}
+
+static std::vector<uint256> AcceptDisconnectedToMemoryPool(CTxMemPool& pool, const std::vector<CTransactionRef>& txs)
+{
+    const std::vector<uint256> added = MemPoolAccept(pool).AcceptDisconnectedTransactions(txs, GetTime());
+    // As in AcceptToMemoryPoolWithTime, once for all of them
+    BlockValidationState state_dummy;
+    ::ChainstateActive().FlushStateToDisk(Params(), state_dummy, FlushStateMode::PERIODIC);
+    return added;
+}
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
  * If blockIndex is provided, the transaction is fetched from the corresponding block.
@@ -1110,7 +1479,38 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
 // CBlock and CBlockIndex
 //
 
-static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessageHeader::MessageStartChars& messageStart)
+//! Set in the size field of a block file record holding a compressed block (-blockcompress)
+static constexpr uint32_t BLOCK_RECORD_COMPRESSED = 0x80000000;
+
+/**
+ * Compress a block for storage. The record payload is the serialized size of
+ * the block followed by its LZ4 compressed serialization. Returns an empty
+ * payload if compression does not make the block smaller.
+ */
+static std::vector<uint8_t> CompressBlockRecord(const CBlock& block, unsigned int block_size)
+{
+    std::vector<uint8_t> serialized;
+    serialized.reserve(block_size);
+    CVectorWriter(SER_DISK, CLIENT_VERSION, serialized, 0, block);
+    const std::vector<uint8_t> compressed = LZ4Compress(Span<const uint8_t>(serialized.data(), serialized.size()));
+    if (compressed.size() + 4 >= serialized.size()) return {};
+
+    std::vector<uint8_t> payload(4);
+    WriteLE32(payload.data(), serialized.size());
+    payload.insert(payload.end(), compressed.begin(), compressed.end());
+    return payload;
+}
+
+/** Recover the serialized block from the payload of a compressed record. */
+static bool DecompressBlockRecord(Span<const uint8_t> payload, std::vector<uint8_t>& block)
+{
+    if (payload.size() < 4) return false;
+    const uint32_t block_size = ReadLE32(payload.data());
+    if (block_size > MAX_SIZE) return false;
+    return LZ4Decompress(payload.subspan(4), block_size, block);
+}
+
+static bool WriteBlockToDisk(const CBlock& block, const std::vector<uint8_t>& compressed, FlatFilePos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
@@ -1118,7 +1518,7 @@ static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessa
         return error("WriteBlockToDisk: OpenBlockFile failed");
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(block, fileout.GetVersion());
+    unsigned int nSize = compressed.empty() ? GetSerializeSize(block, fileout.GetVersion()) : (compressed.size() | BLOCK_RECORD_COMPRESSED);
     fileout << messageStart << nSize;
 
     // Write block
@@ -1126,26 +1526,127 @@ static bool WriteBlockToDisk(const CBlock& block, FlatFilePos& pos, const CMessa
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    if (compressed.empty()) {
+        fileout << block;
+    } else {
+        fileout.write((const char*)compressed.data(), compressed.size());
+    }
+
+    return true;
+}
+
+namespace {
+/**
+ * LRU of read-only mappings of finalized block files, used by -blockmmap.
+ * The file currently being appended to is never mapped.
+ */
+class BlockFileMapCache
+{
+    static constexpr size_t MAX_MAPPED_FILES = 64;
+
+    Mutex m_mutex;
+    std::list<std::pair<int, std::shared_ptr<const MappedFile>>> m_files GUARDED_BY(m_mutex);
+
+public:
+    std::shared_ptr<const MappedFile> Get(int file)
+    {
+        {
+            LOCK(m_mutex);
+            for (auto it = m_files.begin(); it != m_files.end(); ++it) {
+                if (it->first == file) {
+                    m_files.splice(m_files.begin(), m_files, it);
+                    return it->second;
+                }
+            }
+        }
+
+        unsigned int size;
+        {
+            LOCK(cs_LastBlockFile);
+            if (file < 0 || file >= nLastBlockFile || (size_t)file >= vinfoBlockFile.size()) return nullptr;
+            size = vinfoBlockFile[file].nSize;
+        }
+        std::shared_ptr<const MappedFile> mapped = MappedFile::Open(BlockFileSeq().FileName(FlatFilePos(file, 0)), size);
+        if (!mapped) return nullptr;
+
+        LOCK(m_mutex);
+        for (const auto& entry : m_files) {
+            if (entry.first == file) return entry.second;
+        }
+        m_files.emplace_front(file, mapped);
+        if (m_files.size() > MAX_MAPPED_FILES) m_files.pop_back();
+        return mapped;
+    }
+
+    void Evict(int file)
+    {
+        LOCK(m_mutex);
+        m_files.remove_if([file](const std::pair<int, std::shared_ptr<const MappedFile>>& entry) { return entry.first == file; });
+    }
+
+    void Clear()
+    {
+        LOCK(m_mutex);
+        m_files.clear();
+    }
+};
+
+BlockFileMapCache g_block_file_maps;
+} // namespace
 
+bool ReadMappedBlockFromDisk(MappedBlockData& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
+{
+    block = MappedBlockData();
+    if (!g_block_mmap || pos.IsNull() || pos.nPos < 8) return false;
+
+    std::shared_ptr<const MappedFile> file = g_block_file_maps.Get(pos.nFile);
+    if (!file || pos.nPos > file->size()) return false;
+
+    // Meta header: network magic followed by the serialized block size.
+    const uint8_t* meta = file->data() + pos.nPos - 8;
+    if (memcmp(meta, message_start, CMessageHeader::MESSAGE_START_SIZE)) return false;
+    const uint32_t blk_size = ReadLE32(meta + CMessageHeader::MESSAGE_START_SIZE);
+    // Compressed blocks are decompressed by ReadRawBlockFromDisk
+    if (blk_size & BLOCK_RECORD_COMPRESSED) return false;
+    if (blk_size > MAX_SIZE || blk_size > file->size() - pos.nPos) return false;
+
+    block.data = file->GetSpan().subspan(pos.nPos, blk_size);
+    block.file = std::move(file);
     return true;
 }
 
+bool ReadMappedBlockFromDisk(MappedBlockData& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    FlatFilePos block_pos;
+    {
+        LOCK(cs_main);
+        block_pos = pindex->GetBlockPos();
+    }
+
+    return ReadMappedBlockFromDisk(block, block_pos, message_start);
+}
+
 bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    // Deserialize from memory: either the block file mapping, or the raw
+    // block read with a single fread, rather than one fread per field.
+    MappedBlockData mapped;
+    std::vector<uint8_t> block_data;
+    Span<const uint8_t> data;
+    if (ReadMappedBlockFromDisk(mapped, pos, Params().MessageStart())) {
+        data = mapped.data;
+    } else if (ReadRawBlockFromDisk(block_data, pos, Params().MessageStart())) {
+        data = Span<const uint8_t>(block_data.data(), block_data.size());
+    } else {
+        return error("ReadBlockFromDisk: failed to read block at %s", pos.ToString());
+    }
 
-    // Read block
     try {
-        filein >> block;
-    }
-    catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        UnserializeBlockHashed(SER_DISK, CLIENT_VERSION, data, block);
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
     }
 
     // Check the header
@@ -1173,6 +1674,12 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
+    MappedBlockData mapped;
+    if (ReadMappedBlockFromDisk(mapped, pos, message_start)) {
+        block.assign(mapped.data.begin(), mapped.data.end());
+        return true;
+    }
+
     FlatFilePos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
@@ -1192,6 +1699,8 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, c
                     HexStr(message_start, message_start + CMessageHeader::MESSAGE_START_SIZE));
         }
 
+        const bool compressed = blk_size & BLOCK_RECORD_COMPRESSED;
+        blk_size &= ~BLOCK_RECORD_COMPRESSED;
         if (blk_size > MAX_SIZE) {
             return error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__, pos.ToString(),
                     blk_size, MAX_SIZE);
@@ -1199,6 +1708,13 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, c
 
         block.resize(blk_size); // Zeroing of memory is intentional here
         filein.read((char*)block.data(), blk_size);
+        if (compressed) {
+            std::vector<uint8_t> payload;
+            payload.swap(block);
+            if (!DecompressBlockRecord(Span<const uint8_t>(payload.data(), payload.size()), block)) {
+                return error("%s: Failed to decompress block at %s", __func__, pos.ToString());
+            }
+        }
     } catch(const std::exception& e) {
         return error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
     }
@@ -1235,12 +1751,21 @@ CoinsViews::CoinsViews(
     size_t cache_size_bytes,
     bool in_memory,
     bool should_wipe) : m_dbview(
-                            GetDataDir() / ldb_name, cache_size_bytes, in_memory, should_wipe),
-                        m_catcherview(&m_dbview) {}
+                            GetDataDir() / ldb_name, cache_size_bytes, in_memory, should_wipe, g_chainstate_shards),
+                        m_catcherview(&m_dbview),
+                        m_flushview(&m_catcherview, m_dbview, g_db_background_flush,
+                            g_coins_journal && !in_memory ? GetDataDir() / (ldb_name + ".journal") : fs::path())
+{
+    // A journal left over from before the wipe would not match the new database.
+    if (should_wipe) m_flushview.DiscardJournal();
+}
 
 void CoinsViews::InitCache()
 {
-    m_cacheview = MakeUnique<CCoinsViewCache>(&m_catcherview);
+    m_cacheview = MakeUnique<CCoinsViewCache>(&m_flushview);
+    if (g_coins_reuse_sample > 0) {
+        m_cacheview->SetReuseSampler(MakeUnique<CoinsReuseSampler>(g_coins_reuse_sample, COINS_REUSE_MAX_TRACKED));
+    }
 }
 
 // NOTE: for now m_blockman is set to a global, but this will be changed
@@ -1298,6 +1823,11 @@ BlockMap& BlockIndex()
     return g_blockman.m_block_index;
 }
 
+CBlockIndex* InsertBlockIndex(const uint256& hash)
+{
+    return g_blockman.InsertBlockIndex(hash);
+}
+
 static void AlertNotify(const std::string& strMessage)
 {
     uiInterface.NotifyAlertChanged();
@@ -1678,40 +2208,165 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
-/** Undo the effects of this block (with given index) on the UTXO set represented by coins.
- *  When FAILED is returned, view is left in an indeterminate state. */
-DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
+namespace {
+/**
+ * The blocks and undo data of the most recently connected blocks, so that
+ * disconnecting them again in a short reorg reads neither from disk.
+ *
+ * Entries are kept in connection order and the oldest is dropped once there
+ * are more than the configured number. The block index entries they are keyed
+ * by stay put until the block index is unloaded, which clears the cache.
+ */
+class ReorgCache
 {
-    bool fClean = true;
+private:
+    struct Entry {
+        const CBlockIndex* pindex;
+        std::shared_ptr<const CBlock> block;
+        std::shared_ptr<const CBlockUndo> undo;
+    };
 
-    CBlockUndo blockUndo;
-    if (!UndoReadFromDisk(blockUndo, pindex)) {
-        error("DisconnectBlock(): failure reading undo data");
-        return DISCONNECT_FAILED;
+    mutable Mutex m_mutex;
+    std::deque<Entry> m_entries GUARDED_BY(m_mutex);
+    size_t m_max_blocks GUARDED_BY(m_mutex){DEFAULT_REORG_CACHE_BLOCKS};
+    uint64_t m_hits GUARDED_BY(m_mutex){0};
+    uint64_t m_misses GUARDED_BY(m_mutex){0};
+
+    Entry* Find(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        // Lookups are nearly always for the newest entries.
+        for (auto it = m_entries.rbegin(); it != m_entries.rend(); ++it) {
+            if (it->pindex == pindex) return &*it;
+        }
+        return nullptr;
     }
 
-    if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
-        error("DisconnectBlock(): block and undo data inconsistent");
-        return DISCONNECT_FAILED;
+    Entry* Insert(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        if (m_max_blocks == 0) return nullptr;
+        if (Entry* entry = Find(pindex)) return entry;
+        m_entries.push_back(Entry{pindex, nullptr, nullptr});
+        while (m_entries.size() > m_max_blocks) m_entries.pop_front();
+        return &m_entries.back();
     }
 
-    // undo transactions in reverse order
-    for (int i = block.vtx.size() - 1; i >= 0; i--) {
-        const CTransaction &tx = *(block.vtx[i]);
-        uint256 hash = tx.GetHash();
-        bool is_coinbase = tx.IsCoinBase();
+public:
+    void SetMaxBlocks(size_t max_blocks)
+    {
+        LOCK(m_mutex);
+        m_max_blocks = max_blocks;
+        while (m_entries.size() > m_max_blocks) m_entries.pop_front();
+    }
 
-        // Check that all outputs are available and match the outputs in the block itself
-        // exactly.
-        for (size_t o = 0; o < tx.vout.size(); o++) {
-            if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
-                COutPoint out(hash, o);
-                Coin coin;
-                bool is_spent = view.SpendCoin(out, &coin);
-                if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight || is_coinbase != coin.fCoinBase) {
-                    fClean = false; // transaction output mismatch
-                }
-            }
+    void AddBlock(const CBlockIndex* pindex, std::shared_ptr<const CBlock> block)
+    {
+        LOCK(m_mutex);
+        if (Entry* entry = Insert(pindex)) entry->block = std::move(block);
+    }
+
+    void AddUndo(const CBlockIndex* pindex, CBlockUndo&& undo)
+    {
+        LOCK(m_mutex);
+        if (Entry* entry = Insert(pindex)) entry->undo = std::make_shared<const CBlockUndo>(std::move(undo));
+    }
+
+    std::shared_ptr<const CBlock> GetBlock(const CBlockIndex* pindex)
+    {
+        LOCK(m_mutex);
+        const Entry* entry = Find(pindex);
+        if (!entry || !entry->block) {
+            ++m_misses;
+            return nullptr;
+        }
+        ++m_hits;
+        return entry->block;
+    }
+
+    //! Copies the undo data, as disconnecting moves the coins out of them.
+    bool GetUndo(const CBlockIndex* pindex, CBlockUndo& undo)
+    {
+        LOCK(m_mutex);
+        const Entry* entry = Find(pindex);
+        if (!entry || !entry->undo) {
+            ++m_misses;
+            return false;
+        }
+        ++m_hits;
+        undo = *entry->undo;
+        return true;
+    }
+
+    ReorgCacheStats Stats() const
+    {
+        LOCK(m_mutex);
+        ReorgCacheStats stats;
+        stats.hits = m_hits;
+        stats.misses = m_misses;
+        stats.blocks = m_entries.size();
+        stats.max_blocks = m_max_blocks;
+        return stats;
+    }
+
+    void Clear()
+    {
+        LOCK(m_mutex);
+        m_entries.clear();
+    }
+};
+
+ReorgCache g_reorg_cache;
+} // namespace
+
+void SetReorgCacheSize(size_t max_blocks)
+{
+    g_reorg_cache.SetMaxBlocks(max_blocks);
+}
+
+CoinsCacheStats GetCoinsCacheStats()
+{
+    LOCK(g_coins_cache_stats_mutex);
+    return g_coins_cache_stats;
+}
+
+ReorgCacheStats GetReorgCacheStats()
+{
+    return g_reorg_cache.Stats();
+}
+
+/** Undo the effects of this block (with given index) on the UTXO set represented by coins.
+ *  When FAILED is returned, view is left in an indeterminate state. */
+DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, bool use_reorg_cache)
+{
+    bool fClean = true;
+
+    CBlockUndo blockUndo;
+    if (!(use_reorg_cache && g_reorg_cache.GetUndo(pindex, blockUndo)) && !UndoReadFromDisk(blockUndo, pindex)) {
+        error("DisconnectBlock(): failure reading undo data");
+        return DISCONNECT_FAILED;
+    }
+
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
+        error("DisconnectBlock(): block and undo data inconsistent");
+        return DISCONNECT_FAILED;
+    }
+
+    // undo transactions in reverse order
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction &tx = *(block.vtx[i]);
+        uint256 hash = tx.GetHash();
+        bool is_coinbase = tx.IsCoinBase();
+
+        // Check that all outputs are available and match the outputs in the block itself
+        // exactly.
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
+                COutPoint out(hash, o);
+                Coin coin;
+                bool is_spent = view.SpendCoin(out, &coin);
+                if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight || is_coinbase != coin.fCoinBase) {
+                    fClean = false; // transaction output mismatch
+                }
+            }
         }
 
         // restore inputs
@@ -1745,13 +2400,38 @@ void static FlushBlockFile(bool fFinalize = false)
     FlatFilePos undo_pos_old(nLastBlockFile, vinfoBlockFile[nLastBlockFile].nUndoSize);
 
     bool status = true;
-    status &= BlockFileSeq().Flush(block_pos_old, fFinalize);
-    status &= UndoFileSeq().Flush(undo_pos_old, fFinalize);
+    status &= g_block_file_worker.Flush(BlockFileSeq(), block_pos_old, fFinalize);
+    status &= g_undo_file_worker.Flush(UndoFileSeq(), undo_pos_old, fFinalize);
     if (!status) {
         AbortNode("Flushing block file to disk failed. This is likely the result of an I/O error.");
     }
 }
 
+/** Wait for the block and undo file work queued in the background. */
+static bool SyncBlockFiles()
+{
+    bool status = true;
+    status &= g_block_file_worker.Sync();
+    status &= g_undo_file_worker.Sync();
+    return status;
+}
+
+void StartBlockFileWorkers()
+{
+    g_block_file_worker.Start("blkfile");
+    g_undo_file_worker.Start("revfile");
+}
+
+void StopBlockFileWorkers()
+{
+    bool status = true;
+    status &= g_block_file_worker.Stop();
+    status &= g_undo_file_worker.Stop();
+    if (!status) {
+        LogPrintf("%s: Flushing block file to disk failed\n", __func__);
+    }
+}
+
 static bool FindUndoPos(BlockValidationState &state, int nFile, FlatFilePos &pos, unsigned int nAddSize);
 
 static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationState& state, CBlockIndex* pindex, const CChainParams& chainparams)
@@ -1780,15 +2460,270 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+/** Run checks on the script check threads and wait for them. */
+static bool RunScriptChecks(std::vector<CScriptCheck>& checks)
+{
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(checks);
+    return control.Wait();
+}
+
+/** Script checks of several blocks being connected back to back, verified together. */
+struct ScriptCheckPipeline {
+    //! Precomputed data the queued checks point into, one vector per block.
+    std::list<std::vector<PrecomputedTransactionData>> txdata;
+    //! Declared last so it is destroyed (and waits for the checks) first.
+    CCheckQueueControl<CScriptCheck> control{&scriptcheckqueue};
+};
+
+namespace {
+/** Closure computing the hashes of a chunk of a headers batch. */
+class CHeaderHashCheck
+{
+private:
+    Span<const CBlockHeader> m_headers;
+    uint256* m_hashes{nullptr};
+
+public:
+    CHeaderHashCheck() {}
+    CHeaderHashCheck(Span<const CBlockHeader> headers, uint256* hashes) : m_headers(headers), m_hashes(hashes) {}
+
+    bool operator()()
+    {
+        HashHeaders(m_headers, m_hashes);
+        return true;
+    }
+
+    void swap(CHeaderHashCheck& check)
+    {
+        std::swap(m_headers, check.m_headers);
+        std::swap(m_hashes, check.m_hashes);
+    }
+};
+} // namespace
+
+static CCheckQueue<CHeaderHashCheck> headercheckqueue(128);
+
+void ThreadHeaderCheck(int worker_num) {
+    util::ThreadRename(strprintf("headerch.%i", worker_num));
+    headercheckqueue.Thread();
+}
+
+/** Number of headers hashed by one header check job */
+static constexpr size_t HEADER_HASH_CHUNK = 64;
+
+/**
+ * Compute the hash of each header. This is independent of any chain state, so
+ * it runs without cs_main and, for batches spanning several chunks, in
+ * parallel on the header check threads.
+ */
+static std::vector<uint256> HashBlockHeaders(const std::vector<CBlockHeader>& headers) LOCKS_EXCLUDED(cs_main)
+{
+    std::vector<uint256> hashes(headers.size());
+    if (g_parallel_script_checks && headers.size() > HEADER_HASH_CHUNK) {
+        CCheckQueueControl<CHeaderHashCheck> control(&headercheckqueue);
+        std::vector<CHeaderHashCheck> checks;
+        for (size_t pos = 0; pos < headers.size(); pos += HEADER_HASH_CHUNK) {
+            const size_t count = std::min(HEADER_HASH_CHUNK, headers.size() - pos);
+            checks.emplace_back(Span<const CBlockHeader>(headers.data() + pos, count), hashes.data() + pos);
+        }
+        control.Add(checks);
+        control.Wait();
+    } else {
+        HashHeaders(MakeSpan(headers), hashes.data());
+    }
+    return hashes;
+}
+
+namespace {
+/** Closure running the context-free checks of a chunk of a block's transactions. */
+class CTxCheck
+{
+private:
+    Span<const CTransactionRef> m_txs;
+    unsigned int* m_sigops{nullptr};
+
+public:
+    CTxCheck() {}
+    CTxCheck(Span<const CTransactionRef> txs, unsigned int* sigops) : m_txs(txs), m_sigops(sigops) {}
+
+    bool operator()()
+    {
+        // The reason is not kept; a failing block is checked again serially
+        // to report its first invalid transaction.
+        TxValidationState state;
+        for (const CTransactionRef& tx : m_txs) {
+            if (!CheckTransaction(*tx, state)) return false;
+            *m_sigops += GetLegacySigOpCount(*tx);
+        }
+        return true;
+    }
+
+    void swap(CTxCheck& check)
+    {
+        std::swap(m_txs, check.m_txs);
+        std::swap(m_sigops, check.m_sigops);
+    }
+};
+} // namespace
+
+static CCheckQueue<CTxCheck> txcheckqueue(128);
+
+void ThreadTxCheck(int worker_num) {
+    util::ThreadRename(strprintf("txcheck.%i", worker_num));
+    txcheckqueue.Thread();
+}
+
+/** Number of transactions checked by one transaction check job */
+static constexpr size_t TX_CHECK_CHUNK = 64;
+
+/**
+ * Run CheckTransaction on every transaction of a block and count their legacy
+ * sigops in the same pass. Blocks spanning several chunks are checked on the
+ * transaction check threads.
+ */
+static bool CheckBlockTransactions(const CBlock& block, BlockValidationState& state, unsigned int& sigops)
+{
+    sigops = 0;
+    if (g_parallel_script_checks && block.vtx.size() > TX_CHECK_CHUNK) {
+        std::vector<unsigned int> chunk_sigops((block.vtx.size() + TX_CHECK_CHUNK - 1) / TX_CHECK_CHUNK, 0);
+        bool all_ok;
+        {
+            CCheckQueueControl<CTxCheck> control(&txcheckqueue);
+            std::vector<CTxCheck> checks;
+            for (size_t pos = 0; pos < block.vtx.size(); pos += TX_CHECK_CHUNK) {
+                const size_t count = std::min(TX_CHECK_CHUNK, block.vtx.size() - pos);
+                checks.emplace_back(Span<const CTransactionRef>(block.vtx.data() + pos, count), &chunk_sigops[pos / TX_CHECK_CHUNK]);
+            }
+            control.Add(checks);
+            all_ok = control.Wait();
+        }
+        if (all_ok) {
+            for (unsigned int count : chunk_sigops) sigops += count;
+            return true;
+        }
+        sigops = 0;
+    }
+
+    // Must check for duplicate inputs (see CVE-2018-17144)
+    for (const auto& tx : block.vtx) {
+        TxValidationState tx_state;
+        if (!CheckTransaction(*tx, tx_state)) {
+            // CheckBlock() does context-free validation checks. The only
+            // possible failures are consensus failures.
+            assert(tx_state.GetResult() == TxValidationResult::TX_CONSENSUS);
+            return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, tx_state.GetRejectReason(),
+                                 strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), tx_state.GetDebugMessage()));
+        }
+        sigops += GetLegacySigOpCount(*tx);
+    }
+    return true;
+}
+
+namespace {
+/** Closure looking up a chunk of a block's inputs in the coin database. */
+class CCoinsPrefetchCheck
+{
+private:
+    const CCoinsView* m_view{nullptr};
+    Span<const COutPoint> m_outpoints;
+    Coin* m_coins{nullptr};
+
+public:
+    CCoinsPrefetchCheck() {}
+    CCoinsPrefetchCheck(const CCoinsView* view, Span<const COutPoint> outpoints, Coin* coins) : m_view(view), m_outpoints(outpoints), m_coins(coins) {}
+
+    bool operator()()
+    {
+        for (size_t i = 0; i < m_outpoints.size(); ++i) {
+            // A miss leaves the coin spent, which tells the caller to skip it.
+            m_view->GetCoin(m_outpoints[i], m_coins[i]);
+        }
+        return true;
+    }
+
+    void swap(CCoinsPrefetchCheck& check)
+    {
+        std::swap(m_view, check.m_view);
+        std::swap(m_outpoints, check.m_outpoints);
+        std::swap(m_coins, check.m_coins);
+    }
+};
+} // namespace
+
+static CCheckQueue<CCoinsPrefetchCheck> prefetchqueue(128);
+
+void ThreadPrefetchCheck(int worker_num) {
+    util::ThreadRename(strprintf("prefetch.%i", worker_num));
+    prefetchqueue.Thread();
+}
+
+/** Number of inputs looked up by one prefetch job */
+static constexpr size_t PREFETCH_CHUNK = 16;
+
+void CChainState::PrefetchInputs(const CBlock& block)
+{
+    if (!g_parallel_prefetch) return;
+
+    // Outputs created by the block itself can't be in the database yet.
+    std::unordered_set<uint256, SaltedTxidHasher> block_txids;
+    for (const auto& tx : block.vtx) {
+        block_txids.insert(tx->GetHash());
+    }
+    std::vector<COutPoint> outpoints;
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase()) continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (block_txids.count(txin.prevout.hash) || CoinsTip().HaveCoinInCache(txin.prevout)) continue;
+            outpoints.push_back(txin.prevout);
+        }
+    }
+    // A single chunk would be looked up by this thread alone anyway.
+    if (outpoints.size() <= PREFETCH_CHUNK) return;
+
+    // Look the inputs up below the cache, whose lookups (unlike the cache's)
+    // are safe to do concurrently.
+    const CCoinsView* db_view = &m_coins_views->m_flushview;
+    std::vector<Coin> coins(outpoints.size());
+    {
+        CCheckQueueControl<CCoinsPrefetchCheck> control(&prefetchqueue);
+        std::vector<CCoinsPrefetchCheck> checks;
+        for (size_t pos = 0; pos < outpoints.size(); pos += PREFETCH_CHUNK) {
+            const size_t count = std::min(PREFETCH_CHUNK, outpoints.size() - pos);
+            checks.emplace_back(db_view, Span<const COutPoint>(outpoints.data() + pos, count), coins.data() + pos);
+        }
+        control.Add(checks);
+        control.Wait();
+    }
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (!coins[i].IsSpent()) {
+            CoinsTip().EmplaceCoinFromBase(outpoints[i], std::move(coins[i]));
+        }
+    }
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
+ThresholdState VersionBitsStateAfter(const CBlockIndex* pindexPrev, const Consensus::Params& params, Consensus::DeploymentPos pos)
+{
+    AssertLockHeld(cs_main);
+    if (pindexPrev == nullptr) return VersionBitsState(pindexPrev, params, pos, versionbitscache);
+    if (!(pindexPrev->nMemoized & BLOCK_MEMO_DEPLOYMENTS)) {
+        for (int i = 0; i < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; i++) {
+            pindexPrev->nChildDeploymentStates[i] = static_cast<uint8_t>(VersionBitsState(pindexPrev, params, static_cast<Consensus::DeploymentPos>(i), versionbitscache));
+        }
+        pindexPrev->nMemoized |= BLOCK_MEMO_DEPLOYMENTS;
+    }
+    return static_cast<ThresholdState>(pindexPrev->nChildDeploymentStates[pos]);
+}
+
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
 {
     LOCK(cs_main);
     int32_t nVersion = VERSIONBITS_TOP_BITS;
 
     for (int i = 0; i < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; i++) {
-        ThresholdState state = VersionBitsState(pindexPrev, params, static_cast<Consensus::DeploymentPos>(i), versionbitscache);
+        ThresholdState state = VersionBitsStateAfter(pindexPrev, params, static_cast<Consensus::DeploymentPos>(i));
         if (state == ThresholdState::LOCKED_IN || state == ThresholdState::STARTED) {
             nVersion |= VersionBitsMask(params, static_cast<Consensus::DeploymentPos>(i));
         }
@@ -1833,7 +2768,7 @@ static bool IsScriptWitnessEnabled(const Consensus::Params& params)
     return params.SegwitHeight != std::numeric_limits<int>::max();
 }
 
-static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+static unsigned int ComputeBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     AssertLockHeld(cs_main);
 
     unsigned int flags = SCRIPT_VERIFY_NONE;
@@ -1879,22 +2814,48 @@ static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consens
     return flags;
 }
 
+static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    AssertLockHeld(cs_main);
+    // The flags depend on the block hash, so only blocks in the block index are memoized.
+    if (pindex->phashBlock == nullptr) return ComputeBlockScriptFlags(pindex, consensusparams);
+    if (!(pindex->nMemoized & BLOCK_MEMO_SCRIPT_FLAGS)) {
+        pindex->nScriptFlags = ComputeBlockScriptFlags(pindex, consensusparams);
+        pindex->nMemoized |= BLOCK_MEMO_SCRIPT_FLAGS;
+    }
+    return pindex->nScriptFlags;
+}
+
+/**
+ * Evaluate the script flags of a new block index entry and the deployment
+ * states of its children, so that connecting it, building templates on it and
+ * reporting its softforks need not walk the versionbits caches again.
+ */
+static void MemoizeBlockIndex(const CBlockIndex* pindex, const Consensus::Params& consensusparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    GetBlockScriptFlags(pindex, consensusparams);
+    VersionBitsStateAfter(pindex, consensusparams, static_cast<Consensus::DeploymentPos>(0));
+}
+
 
 
-static int64_t nTimeCheck = 0;
-static int64_t nTimeForks = 0;
-static int64_t nTimeVerify = 0;
-static int64_t nTimeConnect = 0;
-static int64_t nTimeIndex = 0;
-static int64_t nTimeCallbacks = 0;
-static int64_t nTimeTotal = 0;
+// Time spent in the steps of connecting blocks, reported by getperfstats
+// and, summed up, by -debug=bench.
+static perf::Histogram& g_perf_connect_check = perf::GetHistogram("connectblock.sanity_checks");
+static perf::Histogram& g_perf_connect_forks = perf::GetHistogram("connectblock.fork_checks");
+static perf::Histogram& g_perf_connect_inputs = perf::GetHistogram("connectblock.fetch_inputs");
+static perf::Histogram& g_perf_connect_update = perf::GetHistogram("connectblock.update_coins");
+static perf::Histogram& g_perf_connect_txs = perf::GetHistogram("connectblock.connect_txs");
+static perf::Histogram& g_perf_connect_verify = perf::GetHistogram("connectblock.verify");
+static perf::Histogram& g_perf_connect_index = perf::GetHistogram("connectblock.index_writing");
+static perf::Histogram& g_perf_connect_callbacks = perf::GetHistogram("connectblock.callbacks");
+static perf::Histogram& g_perf_connect_total = perf::GetHistogram("connecttip.total");
 static int64_t nBlocksTotal = 0;
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, ScriptCheckPipeline* pipeline)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
@@ -1969,8 +2930,8 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
         }
     }
 
-    int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
-    LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime1 - nTimeStart), nTimeCheck * MICRO, nTimeCheck * MILLI / nBlocksTotal);
+    int64_t nTime1 = GetTimeMicros(); g_perf_connect_check.Add(nTime1 - nTimeStart);
+    LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime1 - nTimeStart), g_perf_connect_check.Total() * MICRO, g_perf_connect_check.Total() * MILLI / nBlocksTotal);
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
     // unless those are already completely spent.
@@ -2071,19 +3032,25 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     // Get the script flags for this block
     unsigned int flags = GetBlockScriptFlags(pindex, chainparams.GetConsensus());
 
-    int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
-    LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
+    int64_t nTime2 = GetTimeMicros(); g_perf_connect_forks.Add(nTime2 - nTime1);
+    LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), g_perf_connect_forks.Total() * MICRO, g_perf_connect_forks.Total() * MILLI / nBlocksTotal);
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && g_parallel_script_checks ? &scriptcheckqueue : nullptr);
+    assert(!pipeline || (g_parallel_script_checks && !fJustCheck));
+    CCheckQueueControl<CScriptCheck> block_control(fScriptChecks && g_parallel_script_checks && !pipeline ? &scriptcheckqueue : nullptr);
+    CCheckQueueControl<CScriptCheck>& control = pipeline ? pipeline->control : block_control;
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
+    int64_t time_inputs = 0;
+    int64_t time_update_coins = 0;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
-    std::vector<PrecomputedTransactionData> txdata;
+    std::vector<PrecomputedTransactionData> block_txdata;
+    if (pipeline) pipeline->txdata.emplace_back();
+    std::vector<PrecomputedTransactionData>& txdata = pipeline ? pipeline->txdata.back() : block_txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
@@ -2093,6 +3060,7 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
 
         if (!tx.IsCoinBase())
         {
+            const int64_t time_inputs_start = GetTimeMicros();
             CAmount txfee = 0;
             TxValidationState tx_state;
             if (!Consensus::CheckTxInputs(tx, tx_state, view, pindex->nHeight, txfee)) {
@@ -2114,6 +3082,7 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
             for (size_t j = 0; j < tx.vin.size(); j++) {
                 prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
             }
+            time_inputs += GetTimeMicros() - time_inputs_start;
 
             if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
                 LogPrintf("ERROR: %s: contains a non-BIP68-final transaction\n", __func__);
@@ -2151,10 +3120,15 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
         }
+        const int64_t time_update_start = GetTimeMicros();
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
+        time_update_coins += GetTimeMicros() - time_update_start;
     }
-    int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
-    LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
+    g_perf_connect_inputs.Add(time_inputs);
+    g_perf_connect_update.Add(time_update_coins);
+    int64_t nTime3 = GetTimeMicros(); g_perf_connect_txs.Add(nTime3 - nTime2);
+    LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), g_perf_connect_txs.Total() * MICRO, g_perf_connect_txs.Total() * MILLI / nBlocksTotal);
+    LogPrint(BCLog::BENCH, "        - Fetch inputs: %.2fms, update coins: %.2fms\n", MILLI * time_inputs, MILLI * time_update_coins);
 
     CAmount blockReward = nFees + GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus());
     if (block.vtx[0]->GetValueOut() > blockReward) {
@@ -2162,20 +3136,21 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
         return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-cb-amount");
     }
 
-    if (!control.Wait()) {
+    if (!pipeline && !control.Wait()) {
         LogPrintf("ERROR: %s: CheckQueue failed\n", __func__);
         return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "block-validation-failed");
     }
-    int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
-    LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
+    int64_t nTime4 = GetTimeMicros(); g_perf_connect_verify.Add(nTime4 - nTime2);
+    LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), g_perf_connect_verify.Total() * MICRO, g_perf_connect_verify.Total() * MILLI / nBlocksTotal);
 
     if (fJustCheck)
         return true;
 
     if (!WriteUndoDataForBlock(blockundo, state, pindex, chainparams))
         return false;
+    g_reorg_cache.AddUndo(pindex, std::move(blockundo));
 
-    if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+    if (!pipeline && !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
         setDirtyBlockIndex.insert(pindex);
     }
@@ -2184,11 +3159,11 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
-    int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime4;
-    LogPrint(BCLog::BENCH, "    - Index writing: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime5 - nTime4), nTimeIndex * MICRO, nTimeIndex * MILLI / nBlocksTotal);
+    int64_t nTime5 = GetTimeMicros(); g_perf_connect_index.Add(nTime5 - nTime4);
+    LogPrint(BCLog::BENCH, "    - Index writing: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime5 - nTime4), g_perf_connect_index.Total() * MICRO, g_perf_connect_index.Total() * MILLI / nBlocksTotal);
 
-    int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
-    LogPrint(BCLog::BENCH, "    - Callbacks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime6 - nTime5), nTimeCallbacks * MICRO, nTimeCallbacks * MILLI / nBlocksTotal);
+    int64_t nTime6 = GetTimeMicros(); g_perf_connect_callbacks.Add(nTime6 - nTime5);
+    LogPrint(BCLog::BENCH, "    - Callbacks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime6 - nTime5), g_perf_connect_callbacks.Total() * MICRO, g_perf_connect_callbacks.Total() * MILLI / nBlocksTotal);
 
     return true;
 }
@@ -2198,7 +3173,7 @@ CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(const CTxMemPool& tx_poo
     return this->GetCoinsCacheSizeState(
         tx_pool,
         nCoinCacheUsage,
-        gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+        GetArgsSnapshot().max_mempool_bytes);
 }
 
 CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(
@@ -2225,6 +3200,27 @@ CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(
     return CoinsCacheSizeState::OK;
 }
 
+static perf::Histogram& g_perf_flush_coins = perf::GetHistogram("flushstate.coins");
+
+void CChainState::PublishCoinsCacheStats()
+{
+    LOCK(g_coins_cache_stats_mutex);
+    CoinsCacheStats& stats = g_coins_cache_stats;
+    const CCoinsViewCache& tip = CoinsTip();
+    stats.usage = tip.DynamicMemoryUsage();
+    stats.max_usage = nCoinCacheUsage;
+    stats.entries = tip.GetCacheSize();
+    stats.tip = tip.GetCounters();
+    stats.flushing_hits = m_coins_views->m_flushview.GetHits();
+    stats.db_reads = CoinsDB().GetReads();
+    stats.db_found = CoinsDB().GetReadsFound();
+    if (tip.GetReuseSampler()) {
+        stats.reuse = tip.GetReuseSampler()->GetStats();
+    } else {
+        stats.reuse = nullopt;
+    }
+}
+
 bool CChainState::FlushStateToDisk(
     const CChainParams& chainparams,
     BlockValidationState &state,
@@ -2240,6 +3236,7 @@ bool CChainState::FlushStateToDisk(
 
     const size_t coins_count = CoinsTip().GetCacheSize();
     const size_t coins_mem_usage = CoinsTip().DynamicMemoryUsage();
+    PublishCoinsCacheStats();
 
     try {
     {
@@ -2295,6 +3292,9 @@ bool CChainState::FlushStateToDisk(
 
                 // First make sure all block and undo data is flushed to disk.
                 FlushBlockFile();
+                if (!SyncBlockFiles()) {
+                    return AbortNode(state, "Flushing block file to disk failed. This is likely the result of an I/O error.");
+                }
             }
 
             // Then update all block file information (which may refer to block and undo files).
@@ -2339,7 +3339,31 @@ bool CChainState::FlushStateToDisk(
                 return AbortNode(state, "Disk space is too low!", _("Error: Disk space is too low!").translated, CClientUIInterface::MSG_NOPREFIX);
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!CoinsTip().Flush())
+            // Unless we are asked to write everything out (e.g. at shutdown),
+            // keep the recently used part of the cache warm if configured to.
+            const bool partial = mode != FlushStateMode::ALWAYS && g_dbcache_retain_percent > 0;
+            const int64_t flush_start = GetTimeMicros();
+            if (!(partial ? CoinsTip().PartialFlush(nCoinCacheUsage / 100 * g_dbcache_retain_percent) : CoinsTip().Flush()))
+                return AbortNode(state, "Failed to write to coin database");
+            const int64_t flush_duration = GetTimeMicros() - flush_start;
+            g_perf_flush_coins.Add(flush_duration);
+            {
+                LOCK(g_coins_cache_stats_mutex);
+                ++g_coins_cache_stats.flushes;
+                if (partial) ++g_coins_cache_stats.partial_flushes;
+                g_coins_cache_stats.last_flush_time = GetTime();
+                g_coins_cache_stats.last_flush_duration = flush_duration;
+                g_coins_cache_stats.last_flush_entries = coins_count;
+                g_coins_cache_stats.last_flush_usage = coins_mem_usage;
+                g_coins_cache_stats.last_flush_entries_after = CoinsTip().GetCacheSize();
+            }
+            PublishCoinsCacheStats();
+            // A background write may only be left running when nothing depends
+            // on the database being up to date: callers of ALWAYS read it
+            // directly or shut down, and pruning could otherwise delete blocks
+            // needed to replay an interrupted write, unless it is journaled.
+            CCoinsViewBackgroundFlush& flushview = m_coins_views->m_flushview;
+            if ((mode == FlushStateMode::ALWAYS || (fPruneMode && !flushview.HasJournal())) && !flushview.Sync())
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
             full_flush_completed = true;
@@ -2390,6 +3414,25 @@ static void AppendWarning(std::string& res, const std::string& warn)
     res += warn;
 }
 
+/** Publish a new TipSnapshot of the active chain tip and best header. */
+static void PublishTipSnapshot() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const CBlockIndex* tip = ::ChainActive().Tip();
+    std::shared_ptr<TipSnapshot> snapshot;
+    if (tip) {
+        snapshot = std::make_shared<TipSnapshot>();
+        snapshot->height = tip->nHeight;
+        snapshot->hash = tip->GetBlockHash();
+        snapshot->bits = tip->nBits;
+        snapshot->median_time = tip->GetMedianTimePast();
+        snapshot->block_time = tip->GetBlockTime();
+        snapshot->chain_work = ArithToUint256(tip->nChainWork);
+        snapshot->chain_tx = tip->nChainTx;
+        snapshot->header_height = pindexBestHeader ? pindexBestHeader->nHeight : -1;
+    }
+    std::atomic_store(&g_tip_snapshot, std::shared_ptr<const TipSnapshot>(std::move(snapshot)));
+}
+
 /** Check warning conditions and do some notifications on new chain tip set. */
 void static UpdateTip(const CBlockIndex* pindexNew, const CChainParams& chainParams)
     EXCLUSIVE_LOCKS_REQUIRED(::cs_main)
@@ -2402,6 +3445,7 @@ void static UpdateTip(const CBlockIndex* pindexNew, const CChainParams& chainPar
         g_best_block = pindexNew->GetBlockHash();
         g_best_block_cv.notify_all();
     }
+    PublishTipSnapshot();
 
     std::string warningMessages;
     if (!::ChainstateActive().IsInitialBlockDownload())
@@ -2454,17 +3498,21 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
 {
     CBlockIndex *pindexDelete = m_chain.Tip();
     assert(pindexDelete);
-    // Read block from disk.
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-    CBlock& block = *pblock;
-    if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
-        return error("DisconnectTip(): Failed to read block");
+    // Read block from disk, unless it was connected recently.
+    std::shared_ptr<const CBlock> pblock = g_reorg_cache.GetBlock(pindexDelete);
+    if (!pblock) {
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, pindexDelete, chainparams.GetConsensus()))
+            return error("DisconnectTip(): Failed to read block");
+        pblock = std::move(pblockRead);
+    }
+    const CBlock& block = *pblock;
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
     {
         CCoinsViewCache view(&CoinsTip());
         assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
+        if (DisconnectBlock(block, pindexDelete, view, /* use_reorg_cache */ true) != DISCONNECT_OK)
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
@@ -2475,6 +3523,7 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
         return false;
 
     if (disconnectpool) {
+        if (!disconnectpool->pindexOldTip) disconnectpool->pindexOldTip = pindexDelete;
         // Save transactions to re-add to mempool at end of reorg
         for (auto it = block.vtx.rbegin(); it != block.vtx.rend(); ++it) {
             disconnectpool->addTransaction(*it);
@@ -2487,7 +3536,7 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
         }
     }
 
-    m_chain.SetTip(pindexDelete->pprev);
+    SetChainTip(m_chain, pindexDelete->pprev);
 
     UpdateTip(pindexDelete->pprev, chainparams);
     // Let wallets know transactions went from 1-confirmed to
@@ -2496,11 +3545,11 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
     return true;
 }
 
-static int64_t nTimeReadFromDisk = 0;
-static int64_t nTimeConnectTotal = 0;
-static int64_t nTimeFlush = 0;
-static int64_t nTimeChainState = 0;
-static int64_t nTimePostConnect = 0;
+static perf::Histogram& g_perf_tip_read = perf::GetHistogram("connecttip.read_block");
+static perf::Histogram& g_perf_tip_connect = perf::GetHistogram("connecttip.connect_block");
+static perf::Histogram& g_perf_tip_flush = perf::GetHistogram("connecttip.flush_coins");
+static perf::Histogram& g_perf_tip_chainstate = perf::GetHistogram("connecttip.write_chainstate");
+static perf::Histogram& g_perf_tip_postconnect = perf::GetHistogram("connecttip.postprocess");
 
 struct PerBlockConnectTrace {
     CBlockIndex* pindex = nullptr;
@@ -2564,10 +3613,11 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     }
     const CBlock& blockConnecting = *pthisBlock;
     // Apply the block atomically to the chain state.
-    int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
+    int64_t nTime2 = GetTimeMicros(); g_perf_tip_read.Add(nTime2 - nTime1);
     int64_t nTime3;
-    LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, g_perf_tip_read.Total() * MICRO);
     {
+        PrefetchInputs(blockConnecting);
         CCoinsViewCache view(&CoinsTip());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
         GetMainSignals().BlockChecked(blockConnecting, state);
@@ -2576,34 +3626,109 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
                 InvalidBlockFound(pindexNew, state);
             return error("%s: ConnectBlock %s failed, %s", __func__, pindexNew->GetBlockHash().ToString(), state.ToString());
         }
-        nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
+        nTime3 = GetTimeMicros(); g_perf_tip_connect.Add(nTime3 - nTime2);
         assert(nBlocksTotal > 0);
-        LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
+        LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, g_perf_tip_connect.Total() * MICRO, g_perf_tip_connect.Total() * MILLI / nBlocksTotal);
         bool flushed = view.Flush();
         assert(flushed);
     }
-    int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
-    LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
+    int64_t nTime4 = GetTimeMicros(); g_perf_tip_flush.Add(nTime4 - nTime3);
+    LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, g_perf_tip_flush.Total() * MICRO, g_perf_tip_flush.Total() * MILLI / nBlocksTotal);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED))
         return false;
-    int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
-    LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, nTimeChainState * MICRO, nTimeChainState * MILLI / nBlocksTotal);
+    int64_t nTime5 = GetTimeMicros(); g_perf_tip_chainstate.Add(nTime5 - nTime4);
+    LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, g_perf_tip_chainstate.Total() * MICRO, g_perf_tip_chainstate.Total() * MILLI / nBlocksTotal);
     // Remove conflicting transactions from the mempool.;
     mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
     disconnectpool.removeForBlock(blockConnecting.vtx);
     // Update m_chain & related variables.
-    m_chain.SetTip(pindexNew);
+    SetChainTip(m_chain, pindexNew);
     UpdateTip(pindexNew, chainparams);
 
-    int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
-    LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
-    LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
+    int64_t nTime6 = GetTimeMicros(); g_perf_tip_postconnect.Add(nTime6 - nTime5); g_perf_connect_total.Add(nTime6 - nTime1);
+    LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, g_perf_tip_postconnect.Total() * MICRO, g_perf_tip_postconnect.Total() * MILLI / nBlocksTotal);
+    LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, g_perf_connect_total.Total() * MICRO, g_perf_connect_total.Total() * MILLI / nBlocksTotal);
+    TRACE3(validation, block_connected, pindexNew->nHeight, blockConnecting.vtx.size(), nTime6 - nTime1);
 
+    g_reorg_cache.AddBlock(pindexNew, pthisBlock);
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
     return true;
 }
 
+/**
+ * Connect consecutive blocks with their script checks pooled in one
+ * ScriptCheckPipeline, so that the UTXO updates of each block overlap with the
+ * script checks of the ones before it. Each block's coins changes go to a view
+ * stacked on the previous block's, and nothing is committed until all checks
+ * have passed. The blocks are then committed one by one, as ConnectTip would.
+ *
+ * Returns false without having connected anything if one of the blocks turns
+ * out to be invalid, with state left valid: which block failed is unknown, so
+ * the caller is to connect them one at a time. Also returns false, with state
+ * set, on a system error.
+ */
+bool CChainState::ConnectTipsPipelined(BlockValidationState& state, const CChainParams& chainparams, const std::vector<CBlockIndex*>& blocks, const std::shared_ptr<const CBlock>& pblock_last, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool)
+{
+    assert(blocks.front()->pprev == m_chain.Tip());
+    int64_t nTime1 = GetTimeMicros();
+    // The queued checks point into these blocks, so they must outlive the pipeline.
+    std::vector<std::shared_ptr<const CBlock>> connecting;
+    std::vector<std::unique_ptr<CCoinsViewCache>> views;
+    ScriptCheckPipeline pipeline;
+    for (CBlockIndex* pindex : blocks) {
+        if (pindex == blocks.back() && pblock_last) {
+            connecting.push_back(pblock_last);
+        } else {
+            std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*pblockNew, pindex, chainparams.GetConsensus()))
+                return AbortNode(state, "Failed to read block");
+            connecting.push_back(std::move(pblockNew));
+        }
+        if (views.empty()) PrefetchInputs(*connecting.back());
+        views.push_back(MakeUnique<CCoinsViewCache>(views.empty() ? &CoinsTip() : views.back().get()));
+        if (!ConnectBlock(*connecting.back(), state, pindex, *views.back(), chainparams, false, &pipeline)) {
+            if (state.IsInvalid()) {
+                LogPrint(BCLog::VALIDATION, "%s: block %s failed (%s), connecting blocks one at a time\n", __func__, pindex->GetBlockHash().ToString(), state.ToString());
+                state = BlockValidationState();
+            }
+            return false;
+        }
+    }
+    if (!pipeline.control.Wait()) {
+        LogPrint(BCLog::VALIDATION, "%s: script checks failed, connecting blocks one at a time\n", __func__);
+        return false;
+    }
+    int64_t nTime2 = GetTimeMicros();
+    LogPrint(BCLog::BENCH, "  - Connect %u blocks pipelined: %.2fms\n", (unsigned)blocks.size(), (nTime2 - nTime1) * MILLI);
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        CBlockIndex* pindexNew = blocks[i];
+        const CBlock& blockConnecting = *connecting[i];
+        if (!pindexNew->IsValid(BLOCK_VALID_SCRIPTS)) {
+            pindexNew->RaiseValidity(BLOCK_VALID_SCRIPTS);
+            setDirtyBlockIndex.insert(pindexNew);
+        }
+        GetMainSignals().BlockChecked(blockConnecting, state);
+        // The views below this block's are empty by now, so this moves exactly
+        // its changes into CoinsTip().
+        for (size_t j = i + 1; j-- > 0;) {
+            bool flushed = views[j]->Flush();
+            assert(flushed);
+        }
+        if (!FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED))
+            return false;
+        mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
+        disconnectpool.removeForBlock(blockConnecting.vtx);
+        SetChainTip(m_chain, pindexNew);
+        UpdateTip(pindexNew, chainparams);
+        g_reorg_cache.AddBlock(pindexNew, connecting[i]);
+        connectTrace.BlockConnected(pindexNew, connecting[i]);
+    }
+    LogPrint(BCLog::BENCH, "- Connect %u blocks pipelined, total: %.2fms\n", (unsigned)blocks.size(), (GetTimeMicros() - nTime1) * MILLI);
+    return true;
+}
+
 /**
  * Return the tip of the chain with the most work in it, that isn't
  * known to be invalid (it's however far from certain to be valid).
@@ -2724,7 +3849,26 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
         nHeight = nTargetHeight;
 
         // Connect new blocks.
-        for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
+        for (auto it = vpindexToConnect.rbegin(); it != vpindexToConnect.rend(); ++it) {
+            CBlockIndex *pindexConnect = *it;
+            // Connect this block together with the next one if we can. If that
+            // fails on a consensus rule, fall through to connecting them one by
+            // one to find out which is invalid.
+            if (g_pipeline_script_checks && g_parallel_script_checks && pindexConnect->pprev && std::next(it) != vpindexToConnect.rend()) {
+                CBlockIndex *pindexNext = *std::next(it);
+                if (ConnectTipsPipelined(state, chainparams, {pindexConnect, pindexNext}, pindexNext == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
+                    ++it;
+                    PruneBlockIndexCandidates();
+                    if (!pindexOldTip || m_chain.Tip()->nChainWork > pindexOldTip->nChainWork) {
+                        fContinue = false;
+                        break;
+                    }
+                    continue;
+                } else if (state.IsError()) {
+                    UpdateMempoolForReorg(disconnectpool, false);
+                    return false;
+                }
+            }
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
@@ -2769,24 +3913,89 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
     return true;
 }
 
-static bool NotifyHeaderTip() LOCKS_EXCLUDED(cs_main) {
-    bool fNotify = false;
-    bool fInitialBlockDownload = false;
-    static CBlockIndex* pindexHeaderOld = nullptr;
-    CBlockIndex* pindexHeader = nullptr;
-    {
-        LOCK(cs_main);
-        pindexHeader = pindexBestHeader;
+namespace {
+/**
+ * Coalesces the block or header tip notifications to the UI. During initial
+ * block download, a tip is only delivered if g_tip_notify_interval has passed
+ * since the last one. Otherwise it is held back, replacing any held back
+ * before it, until a later tip or FlushTipNotifications delivers it. Tips
+ * outside initial block download are always delivered.
+ */
+class TipNotifier
+{
+public:
+    typedef void (CClientUIInterface::*NotifyFn)(bool, const CBlockIndex*);
 
-        if (pindexHeader != pindexHeaderOld) {
-            fNotify = true;
-            fInitialBlockDownload = ::ChainstateActive().IsInitialBlockDownload();
-            pindexHeaderOld = pindexHeader;
+    explicit TipNotifier(NotifyFn notify) : m_notify(notify) {}
+
+    void Notify(bool initial_download, const CBlockIndex* tip)
+    {
+        {
+            LOCK(m_mutex);
+            const int64_t now = GetTimeMillis();
+            if (initial_download && now - m_last_notify < g_tip_notify_interval) {
+                m_held_back = tip;
+                return;
+            }
+            m_held_back = nullptr;
+            m_last_notify = now;
+        }
+        (uiInterface.*m_notify)(initial_download, tip);
+    }
+
+    void Flush()
+    {
+        const CBlockIndex* tip;
+        {
+            LOCK(m_mutex);
+            const int64_t now = GetTimeMillis();
+            if (!m_held_back || now - m_last_notify < g_tip_notify_interval) return;
+            tip = m_held_back;
+            m_held_back = nullptr;
+            m_last_notify = now;
+        }
+        (uiInterface.*m_notify)(true, tip);
+    }
+
+private:
+    const NotifyFn m_notify;
+    Mutex m_mutex;
+    const CBlockIndex* m_held_back GUARDED_BY(m_mutex){nullptr};
+    int64_t m_last_notify GUARDED_BY(m_mutex){0};
+};
+
+TipNotifier g_block_tip_notifier{&CClientUIInterface::NotifyBlockTip};
+TipNotifier g_header_tip_notifier{&CClientUIInterface::NotifyHeaderTip};
+} // namespace
+
+void FlushTipNotifications()
+{
+    {
+        // Block tips are delivered under cs_main, so that they arrive in the order they were connected
+        TRY_LOCK(cs_main, locked);
+        if (locked) g_block_tip_notifier.Flush();
+    }
+    g_header_tip_notifier.Flush();
+}
+
+static bool NotifyHeaderTip() LOCKS_EXCLUDED(cs_main) {
+    bool fNotify = false;
+    bool fInitialBlockDownload = false;
+    static CBlockIndex* pindexHeaderOld = nullptr;
+    CBlockIndex* pindexHeader = nullptr;
+    {
+        LOCK(cs_main);
+        pindexHeader = pindexBestHeader;
+
+        if (pindexHeader != pindexHeaderOld) {
+            fNotify = true;
+            fInitialBlockDownload = ::ChainstateActive().IsInitialBlockDownload();
+            pindexHeaderOld = pindexHeader;
         }
     }
     // Send block tip changed notifications without cs_main
     if (fNotify) {
-        uiInterface.NotifyHeaderTip(fInitialBlockDownload, pindexHeader);
+        g_header_tip_notifier.Notify(fInitialBlockDownload, pindexHeader);
     }
     return fNotify;
 }
@@ -2874,8 +4083,8 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
                 // Notify ValidationInterface subscribers
                 GetMainSignals().UpdatedBlockTip(pindexNewTip, pindexFork, fInitialDownload);
 
-                // Always notify the UI if a new block tip was connected
-                uiInterface.NotifyBlockTip(fInitialDownload, pindexNewTip);
+                // Always notify the UI if a new block tip was connected, coalesced during initial block download
+                g_block_tip_notifier.Notify(fInitialDownload, pindexNewTip);
             }
         }
         // When we reach this point, we switched to a new tip (stored in pindexNewTip).
@@ -2957,20 +4166,18 @@ bool CChainState::InvalidateBlock(BlockValidationState& state, const CChainParam
 
     {
         LOCK(cs_main);
-        for (const auto& entry : m_blockman.m_block_index) {
-            CBlockIndex *candidate = entry.second;
-            // We don't need to put anything in our active chain into the
-            // multimap, because those candidates will be found and considered
-            // as we disconnect.
-            // Instead, consider only non-active-chain blocks that have at
-            // least as much work as where we expect the new tip to end up.
-            if (!m_chain.Contains(candidate) &&
-                    !CBlockIndexWorkComparator()(candidate, pindex->pprev) &&
-                    candidate->IsValid(BLOCK_VALID_TRANSACTIONS) &&
-                    candidate->HaveTxsDownloaded()) {
+        // We don't need to put anything in our active chain into the
+        // multimap, because those candidates will be found and considered
+        // as we disconnect.
+        // Instead, consider only non-active-chain blocks that have at
+        // least as much work as where we expect the new tip to end up.
+        m_blockman.ForEachBlockWithMoreWork(pindex->pprev, [&](CBlockIndex* candidate) {
+            if (m_chain.Contains(candidate)) return false;
+            if (candidate->IsValid(BLOCK_VALID_TRANSACTIONS) && candidate->HaveTxsDownloaded()) {
                 candidate_blocks_by_work.insert(std::make_pair(candidate->nChainWork, candidate));
             }
-        }
+            return true;
+        });
     }
 
     // Disconnect (descendants of) pindex, and mark them invalid.
@@ -3051,22 +4258,21 @@ bool CChainState::InvalidateBlock(BlockValidationState& state, const CChainParam
         // setBlockIndexCandidates may have missed entries. This would
         // technically be an inconsistency in the block index, but if we clean
         // it up here, this should be an essentially unobservable error.
-        // Loop back over all block index entries and add any missing entries
-        // to setBlockIndexCandidates.
-        BlockMap::iterator it = m_blockman.m_block_index.begin();
-        while (it != m_blockman.m_block_index.end()) {
-            if (it->second->IsValid(BLOCK_VALID_TRANSACTIONS) && it->second->HaveTxsDownloaded() && !setBlockIndexCandidates.value_comp()(it->second, m_chain.Tip())) {
-                setBlockIndexCandidates.insert(it->second);
+        // Loop back over the block index entries with at least as much work as
+        // the tip and add any missing entries to setBlockIndexCandidates.
+        m_blockman.ForEachBlockWithMoreWork(m_chain.Tip(), [&](CBlockIndex* candidate) {
+            if (candidate->IsValid(BLOCK_VALID_TRANSACTIONS) && candidate->HaveTxsDownloaded()) {
+                setBlockIndexCandidates.insert(candidate);
             }
-            it++;
-        }
+            return true;
+        });
 
         InvalidChainFound(to_mark_failed);
     }
 
     // Only notify about a new block tip if the active chain was modified.
     if (pindex_was_in_chain) {
-        uiInterface.NotifyBlockTip(IsInitialBlockDownload(), to_mark_failed->pprev);
+        g_block_tip_notifier.Notify(IsInitialBlockDownload(), to_mark_failed->pprev);
     }
     return true;
 }
@@ -3080,22 +4286,24 @@ void CChainState::ResetBlockFailureFlags(CBlockIndex *pindex) {
 
     int nHeight = pindex->nHeight;
 
-    // Remove the invalidity flag from this block and all its descendants.
-    BlockMap::iterator it = m_blockman.m_block_index.begin();
-    while (it != m_blockman.m_block_index.end()) {
-        if (!it->second->IsValid() && it->second->GetAncestor(nHeight) == pindex) {
-            it->second->nStatus &= ~BLOCK_FAILED_MASK;
-            setDirtyBlockIndex.insert(it->second);
-            if (it->second->IsValid(BLOCK_VALID_TRANSACTIONS) && it->second->HaveTxsDownloaded() && setBlockIndexCandidates.value_comp()(m_chain.Tip(), it->second)) {
-                setBlockIndexCandidates.insert(it->second);
+    // Remove the invalidity flag from this block and all its descendants,
+    // walking back to it from the leaves that descend from it.
+    std::set<CBlockIndex*> visited;
+    for (CBlockIndex* leaf : m_blockman.m_leaves) {
+        if (leaf->GetAncestor(nHeight) != pindex) continue;
+        for (CBlockIndex* block = leaf; block->nHeight >= nHeight && visited.insert(block).second; block = block->pprev) {
+            if (block->IsValid()) continue;
+            block->nStatus &= ~BLOCK_FAILED_MASK;
+            setDirtyBlockIndex.insert(block);
+            if (block->IsValid(BLOCK_VALID_TRANSACTIONS) && block->HaveTxsDownloaded() && setBlockIndexCandidates.value_comp()(m_chain.Tip(), block)) {
+                setBlockIndexCandidates.insert(block);
             }
-            if (it->second == pindexBestInvalid) {
+            if (block == pindexBestInvalid) {
                 // Reset invalid block marker if it was pointing to one of those.
                 pindexBestInvalid = nullptr;
             }
-            m_blockman.m_failed_blocks.erase(it->second);
+            m_blockman.m_failed_blocks.erase(block);
         }
-        it++;
     }
 
     // Remove the invalidity flag from all ancestors too.
@@ -3124,13 +4332,11 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = m_block_arena.Emplace(CBlockIndex(block));
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = m_block_index.find(block.hashPrevBlock);
     if (miPrev != m_block_index.end())
     {
@@ -3140,9 +4346,19 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
     }
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
+    {
+        // Shared readers may find the entry from here on.
+        boost::unique_lock<boost::shared_mutex> lock(g_block_index_mutex);
+        BlockMap::iterator mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
+        pindexNew->phashBlock = &((*mi).first);
+    }
     pindexNew->RaiseValidity(BLOCK_VALID_TREE);
-    if (pindexBestHeader == nullptr || pindexBestHeader->nChainWork < pindexNew->nChainWork)
+    if (pindexNew->pprev) m_leaves.erase(pindexNew->pprev);
+    m_leaves.insert(pindexNew);
+    if (pindexBestHeader == nullptr || pindexBestHeader->nChainWork < pindexNew->nChainWork) {
         pindexBestHeader = pindexNew;
+        PublishTipSnapshot();
+    }
 
     setDirtyBlockIndex.insert(pindexNew);
 
@@ -3152,7 +4368,10 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pindexNew, const FlatFilePos& pos, const Consensus::Params& consensusParams)
 {
-    pindexNew->nTx = block.vtx.size();
+    {
+        boost::unique_lock<boost::shared_mutex> lock(g_block_index_mutex);
+        pindexNew->nTx = block.vtx.size();
+    }
     pindexNew->nChainTx = 0;
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
@@ -3232,7 +4451,7 @@ static bool FindBlockPos(FlatFilePos &pos, unsigned int nAddSize, unsigned int n
 
     if (!fKnown) {
         bool out_of_space;
-        size_t bytes_allocated = BlockFileSeq().Allocate(pos, nAddSize, out_of_space);
+        size_t bytes_allocated = g_block_file_worker.Allocate(BlockFileSeq(), pos, nAddSize, out_of_space);
         if (out_of_space) {
             return AbortNode("Disk space is too low!", _("Error: Disk space is too low!").translated, CClientUIInterface::MSG_NOPREFIX);
         }
@@ -3256,7 +4475,7 @@ static bool FindUndoPos(BlockValidationState &state, int nFile, FlatFilePos &pos
     setDirtyFileInfo.insert(nFile);
 
     bool out_of_space;
-    size_t bytes_allocated = UndoFileSeq().Allocate(pos, nAddSize, out_of_space);
+    size_t bytes_allocated = g_undo_file_worker.Allocate(UndoFileSeq(), pos, nAddSize, out_of_space);
     if (out_of_space) {
         return AbortNode(state, "Disk space is too low!", _("Error: Disk space is too low!").translated, CClientUIInterface::MSG_NOPREFIX);
     }
@@ -3267,15 +4486,20 @@ static bool FindUndoPos(BlockValidationState &state, int nFile, FlatFilePos &pos
     return true;
 }
 
-static bool CheckBlockHeader(const CBlockHeader& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
+static bool CheckBlockHeader(const CBlockHeader& block, const uint256& hash, BlockValidationState& state, const Consensus::Params& consensusParams)
 {
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+    if (!CheckProofOfWork(hash, block.nBits, consensusParams))
         return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "high-hash", "proof of work failed");
 
     return true;
 }
 
+static bool CheckBlockHeader(const CBlockHeader& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
+{
+    return !fCheckPOW || CheckBlockHeader(block, block.GetHash(), state, consensusParams);
+}
+
 bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     // These are checks that are independent of context.
@@ -3291,7 +4515,7 @@ bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensu
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
-        uint256 hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
+        uint256 hashMerkleRoot2 = ParallelBlockMerkleRoot(block, &mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
             return state.Invalid(BlockValidationResult::BLOCK_MUTATED, "bad-txnmrklroot", "hashMerkleRoot mismatch");
 
@@ -3320,22 +4544,9 @@ bool CheckBlock(const CBlock& block, BlockValidationState& state, const Consensu
             return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-cb-multiple", "more than one coinbase");
 
     // Check transactions
-    // Must check for duplicate inputs (see CVE-2018-17144)
-    for (const auto& tx : block.vtx) {
-        TxValidationState tx_state;
-        if (!CheckTransaction(*tx, tx_state)) {
-            // CheckBlock() does context-free validation checks. The only
-            // possible failures are consensus failures.
-            assert(tx_state.GetResult() == TxValidationResult::TX_CONSENSUS);
-            return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, tx_state.GetRejectReason(),
-                                 strprintf("Transaction check failed (tx hash %s) %s", tx->GetHash().ToString(), tx_state.GetDebugMessage()));
-        }
-    }
     unsigned int nSigOps = 0;
-    for (const auto& tx : block.vtx)
-    {
-        nSigOps += GetLegacySigOpCount(*tx);
-    }
+    if (!CheckBlockTransactions(block, state, nSigOps))
+        return false;
     if (nSigOps * WITNESS_SCALE_FACTOR > MAX_BLOCK_SIGOPS_COST)
         return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-blk-sigops", "out-of-bounds SigOpCount");
 
@@ -3383,7 +4594,7 @@ std::vector<unsigned char> GenerateCoinbaseCommitment(CBlock& block, const CBloc
     std::vector<unsigned char> ret(32, 0x00);
     if (consensusParams.SegwitHeight != std::numeric_limits<int>::max()) {
         if (commitpos == -1) {
-            uint256 witnessroot = BlockWitnessMerkleRoot(block, nullptr);
+            uint256 witnessroot = ParallelBlockWitnessMerkleRoot(block, nullptr);
             CHash256().Write(witnessroot.begin(), 32).Write(ret.data(), 32).Finalize(witnessroot.begin());
             CTxOut out;
             out.nValue = 0;
@@ -3522,7 +4733,7 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
         int commitpos = GetWitnessCommitmentIndex(block);
         if (commitpos != -1) {
             bool malleated = false;
-            uint256 hashWitness = BlockWitnessMerkleRoot(block, &malleated);
+            uint256 hashWitness = ParallelBlockWitnessMerkleRoot(block, &malleated);
             // The malleation check is ignored; as the transaction tree itself
             // already does not permit it, it is impossible to trigger in the
             // witness tree.
@@ -3559,11 +4770,11 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
     return true;
 }
 
-bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, const uint256* known_hash)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    uint256 hash = known_hash ? *known_hash : block.GetHash();
     BlockMap::iterator miSelf = m_block_index.find(hash);
     CBlockIndex *pindex = nullptr;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -3579,7 +4790,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, hash, state, chainparams.GetConsensus()))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), state.ToString());
 
         // Get prev block index
@@ -3636,8 +4847,10 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
             }
         }
     }
-    if (pindex == nullptr)
+    if (pindex == nullptr) {
         pindex = AddToBlockIndex(block);
+        MemoizeBlockIndex(pindex, chainparams.GetConsensus());
+    }
 
     if (ppindex)
         *ppindex = pindex;
@@ -3648,11 +4861,14 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationS
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, BlockValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
+    // Hashing is the expensive, context-free part of header validation; do it
+    // for the whole batch before the sequential contextual checks.
+    const std::vector<uint256> hashes = HashBlockHeaders(headers);
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); ++i) {
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            bool accepted = g_blockman.AcceptBlockHeader(header, state, chainparams, &pindex);
+            bool accepted = g_blockman.AcceptBlockHeader(headers[i], state, chainparams, &pindex, &hashes[i]);
             ::ChainstateActive().CheckBlockIndex(chainparams.GetConsensus());
 
             if (!accepted) {
@@ -3674,6 +4890,11 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, BlockValid
 /** Store block on disk. If dbp is non-nullptr, the file is known to already reside on disk */
 static FlatFilePos SaveBlockToDisk(const CBlock& block, int nHeight, const CChainParams& chainparams, const FlatFilePos* dbp) {
     unsigned int nBlockSize = ::GetSerializeSize(block, CLIENT_VERSION);
+    std::vector<uint8_t> compressed;
+    if (dbp == nullptr && g_block_compress) {
+        compressed = CompressBlockRecord(block, nBlockSize);
+        if (!compressed.empty()) nBlockSize = compressed.size();
+    }
     FlatFilePos blockPos;
     if (dbp != nullptr)
         blockPos = *dbp;
@@ -3682,7 +4903,7 @@ static FlatFilePos SaveBlockToDisk(const CBlock& block, int nHeight, const CChai
         return FlatFilePos();
     }
     if (dbp == nullptr) {
-        if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart())) {
+        if (!WriteBlockToDisk(block, compressed, blockPos, chainparams.MessageStart())) {
             AbortNode("Failed to write block");
             return FlatFilePos();
         }
@@ -3773,7 +4994,7 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, Block
     return true;
 }
 
-bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool *fNewBlock)
+bool AcceptNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool *fNewBlock)
 {
     AssertLockNotHeld(cs_main);
 
@@ -3800,6 +5021,12 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
     }
 
     NotifyHeaderTip();
+    return true;
+}
+
+bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool *fNewBlock)
+{
+    if (!AcceptNewBlock(chainparams, pblock, fForceProcessing, fNewBlock)) return false;
 
     BlockValidationState state; // Only used to report errors, not invalidity - ignore it
     if (!::ChainstateActive().ActivateBestChain(state, chainparams, pblock))
@@ -3808,6 +5035,102 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
     return true;
 }
 
+namespace {
+/**
+ * Connects accepted blocks on a thread of its own, so that whoever received
+ * them can go on meanwhile. Blocks are handled in the order they were queued.
+ */
+class BlockValidationThread
+{
+public:
+    void Start(const CChainParams& chainparams)
+    {
+        LOCK(m_mutex);
+        if (m_running) return;
+        m_running = true;
+        m_stop = false;
+        m_thread = std::thread([this, &chainparams] {
+            util::ThreadRename("blockval");
+            ThreadMain(chainparams);
+        });
+    }
+
+    void Stop()
+    {
+        {
+            LOCK(m_mutex);
+            if (!m_running) return;
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_thread.join();
+
+        LOCK(m_mutex);
+        m_running = false;
+        if (!m_blocks.empty()) {
+            LogPrintf("%s: %u queued blocks left for the next activation\n", __func__, m_blocks.size());
+            m_blocks.clear();
+        }
+    }
+
+    bool Push(const std::shared_ptr<const CBlock>& pblock)
+    {
+        {
+            LOCK(m_mutex);
+            if (!m_running || m_stop) return false;
+            m_blocks.push_back(pblock);
+        }
+        m_cond.notify_one();
+        return true;
+    }
+
+private:
+    void ThreadMain(const CChainParams& chainparams)
+    {
+        while (true) {
+            std::shared_ptr<const CBlock> pblock;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || !m_blocks.empty(); });
+                if (m_stop) return;
+                pblock = std::move(m_blocks.front());
+                m_blocks.pop_front();
+            }
+
+            BlockValidationState state; // Only used to report errors, not invalidity - ignore it
+            if (!::ChainstateActive().ActivateBestChain(state, chainparams, pblock)) {
+                error("%s: ActivateBestChain failed (%s)", __func__, state.ToString());
+            }
+            GetMainSignals().BlockProcessed(pblock);
+        }
+    }
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<std::shared_ptr<const CBlock>> m_blocks GUARDED_BY(m_mutex);
+    bool m_running GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::thread m_thread;
+};
+
+BlockValidationThread g_block_validation_thread;
+} // namespace
+
+void StartBlockValidationThread(const CChainParams& chainparams)
+{
+    g_block_validation_thread.Start(chainparams);
+}
+
+void StopBlockValidationThread()
+{
+    g_block_validation_thread.Stop();
+}
+
+bool QueueBlockActivation(const std::shared_ptr<const CBlock>& pblock)
+{
+    return g_block_validation_thread.Push(pblock);
+}
+
 bool TestBlockValidity(BlockValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot)
 {
     AssertLockHeld(cs_main);
@@ -3849,14 +5172,15 @@ uint64_t CalculateCurrentUsage()
     return retval;
 }
 
-/* Prune a block file (modify associated database entries)*/
-void PruneOneBlockFile(const int fileNumber)
+/* Prune block files (modify associated database entries) in one pass over the block index */
+void PruneBlockFiles(const std::set<int>& file_numbers)
 {
     LOCK(cs_LastBlockFile);
+    if (file_numbers.empty()) return;
 
     for (const auto& entry : g_blockman.m_block_index) {
         CBlockIndex* pindex = entry.second;
-        if (pindex->nFile == fileNumber) {
+        if ((pindex->nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO)) && file_numbers.count(pindex->nFile)) {
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
             pindex->nStatus &= ~BLOCK_HAVE_UNDO;
             pindex->nFile = 0;
@@ -3879,8 +5203,15 @@ void PruneOneBlockFile(const int fileNumber)
         }
     }
 
-    vinfoBlockFile[fileNumber].SetNull();
-    setDirtyFileInfo.insert(fileNumber);
+    for (const int file_number : file_numbers) {
+        vinfoBlockFile[file_number].SetNull();
+        setDirtyFileInfo.insert(file_number);
+    }
+}
+
+void PruneOneBlockFile(const int fileNumber)
+{
+    PruneBlockFiles({fileNumber});
 }
 
 
@@ -3888,12 +5219,69 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         FlatFilePos pos(*it, 0);
-        fs::remove(BlockFileSeq().FileName(pos));
-        fs::remove(UndoFileSeq().FileName(pos));
+        g_block_file_maps.Evict(*it);
+        // Queued on the block file workers if they are running; the block
+        // index no longer refers to these files, so nothing waits for them.
+        g_block_file_worker.Remove(BlockFileSeq(), pos);
+        g_undo_file_worker.Remove(UndoFileSeq(), pos);
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
     }
 }
 
+void MigrateColdBlockFiles()
+{
+    if (g_blocks_cold_dir.empty() || fImporting || fReindex) return;
+
+    const FlatFileSeq block_seq = BlockFileSeq();
+    const FlatFileSeq undo_seq = UndoFileSeq();
+    // Files before this one have been moved or pruned already.
+    static int next_file = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        const FlatFilePos pos(next_file, 0);
+        unsigned int undo_size;
+        {
+            // Undo data is written while holding cs_main, so none is half written to the file now.
+            LOCK2(cs_main, cs_LastBlockFile);
+            if (next_file > nLastBlockFile - g_blocks_hot_files) return;
+            undo_size = vinfoBlockFile[next_file].nUndoSize;
+            if (vinfoBlockFile[next_file].nSize == 0) {
+                ++next_file;
+                continue;
+            }
+        }
+        const bool move_block = block_seq.IsHot(pos);
+        const bool move_undo = undo_seq.IsHot(pos);
+        if (!move_block && !move_undo) {
+            ++next_file;
+            continue;
+        }
+
+        bool copied = (!move_block || block_seq.CopyToCold(pos)) && (!move_undo || undo_seq.CopyToCold(pos));
+        {
+            LOCK2(cs_main, cs_LastBlockFile);
+            // Blocks of an older file can still be connected, writing their undo data to it, and
+            // the file may have been pruned meanwhile. The copy is retried on the next run in the
+            // first case and dropped in the second.
+            const CBlockFileInfo& info = vinfoBlockFile[next_file];
+            if (copied && info.nSize != 0 && info.nUndoSize == undo_size) {
+                g_block_file_maps.Evict(next_file);
+                if (move_block) copied &= block_seq.CompleteMoveToCold(pos);
+                if (move_undo) copied &= undo_seq.CompleteMoveToCold(pos);
+                if (copied) {
+                    LogPrintf("Moved blk/rev (%05u) to %s\n", next_file, g_blocks_cold_dir.string());
+                    ++next_file;
+                    continue;
+                }
+            }
+        }
+        if (move_block) block_seq.AbortMoveToCold(pos);
+        if (move_undo) undo_seq.AbortMoveToCold(pos);
+        return;
+    }
+}
+
 /* Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain */
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight)
 {
@@ -3909,10 +5297,10 @@ static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPr
     for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
         if (vinfoBlockFile[fileNumber].nSize == 0 || vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
             continue;
-        PruneOneBlockFile(fileNumber);
         setFilesToPrune.insert(fileNumber);
         count++;
     }
+    PruneBlockFiles(setFilesToPrune);
     LogPrintf("Prune (Manual): prune_height=%d removed %d blk/rev pairs\n", nLastBlockWeCanPrune, count);
 }
 
@@ -3970,6 +5358,9 @@ static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfte
             // Since this is only relevant during IBD, we use a fixed 10%
             nBuffer += nPruneTarget / 10;
         }
+        // Once pruning, go down to the configured headroom below the target,
+        // so that the next prune event (and its full flush) is further away.
+        nBuffer = std::max(nBuffer, g_prune_headroom);
 
         for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
             nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
@@ -3984,12 +5375,12 @@ static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfte
             if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
                 continue;
 
-            PruneOneBlockFile(fileNumber);
             // Queue up the files for removal
             setFilesToPrune.insert(fileNumber);
             nCurrentUsage -= nBytesToPrune;
             count++;
         }
+        PruneBlockFiles(setFilesToPrune);
     }
 
     LogPrint(BCLog::PRUNE, "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
@@ -4000,12 +5391,12 @@ static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfte
 
 static FlatFileSeq BlockFileSeq()
 {
-    return FlatFileSeq(GetBlocksDir(), "blk", BLOCKFILE_CHUNK_SIZE);
+    return FlatFileSeq(GetBlocksDir(), "blk", BLOCKFILE_CHUNK_SIZE, g_blocks_cold_dir);
 }
 
 static FlatFileSeq UndoFileSeq()
 {
-    return FlatFileSeq(GetBlocksDir(), "rev", UNDOFILE_CHUNK_SIZE);
+    return FlatFileSeq(GetBlocksDir(), "rev", UNDOFILE_CHUNK_SIZE, g_blocks_cold_dir);
 }
 
 FILE* OpenBlockFile(const FlatFilePos &pos, bool fReadOnly) {
@@ -4022,6 +5413,19 @@ fs::path GetBlockPosFilename(const FlatFilePos &pos)
     return BlockFileSeq().FileName(pos);
 }
 
+void BlockManager::ForEachBlockWithMoreWork(const CBlockIndex* pindex, const std::function<bool(CBlockIndex*)>& fn)
+{
+    AssertLockHeld(cs_main);
+    // Work decreases towards the ancestors, so each leaf leads back to a run
+    // of such entries, and those already visited from another leaf end it.
+    std::set<CBlockIndex*> visited;
+    for (CBlockIndex* leaf : m_leaves) {
+        for (CBlockIndex* block = leaf; block && !CBlockIndexWorkComparator()(block, pindex) && visited.insert(block).second; block = block->pprev) {
+            if (!fn(block)) break;
+        }
+    }
+}
+
 CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
 {
     AssertLockHeld(cs_main);
@@ -4034,8 +5438,10 @@ CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
     if (mi != m_block_index.end())
         return (*mi).second;
 
-    // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    // Create new. This is only used while loading the index, before anything
+    // reads it under g_block_index_mutex, so the entry may be filled in later.
+    CBlockIndex* pindexNew = m_block_arena.Emplace(CBlockIndex());
+    boost::unique_lock<boost::shared_mutex> lock(g_block_index_mutex);
     mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -4047,23 +5453,48 @@ bool BlockManager::LoadBlockIndex(
     CBlockTreeDB& blocktree,
     std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
-        return false;
-
-    // Calculate nChainWork
+    // The image has nChainWork and the skip pointers built already
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(m_block_index.size());
-    for (const std::pair<const uint256, CBlockIndex*>& item : m_block_index)
-    {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+    const bool from_image = LoadBlockIndexImage(blocktree, vSortedByHeight);
+    if (!from_image) {
+        if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
+            return false;
+
+        // Calculate nChainWork
+        vSortedByHeight.reserve(m_block_index.size());
+        for (const std::pair<const uint256, CBlockIndex*>& item : m_block_index)
+        {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        }
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
+
+        // The entries were created in the hash order of the database. Copy them
+        // into a new arena in height order, so that walks along a chain touch
+        // neighbouring memory, and point the map and pprev links at the copies.
+        BlockIndexArena sorted_arena;
+        for (std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
+            CBlockIndex* pindex = sorted_arena.Emplace(*item.second);
+            m_block_index.find(pindex->GetBlockHash())->second = pindex;
+            item.second = pindex;
+        }
+        m_leaves.clear();
+        for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
+            CBlockIndex* pindex = item.second;
+            if (pindex->pprev) {
+                pindex->pprev = m_block_index.find(pindex->pprev->GetBlockHash())->second;
+                m_leaves.erase(pindex->pprev);
+            }
+            m_leaves.insert(pindex);
+        }
+        m_block_arena = std::move(sorted_arena);
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
+
     for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
     {
         if (ShutdownRequested()) return false;
         CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        if (!from_image) pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
@@ -4088,7 +5519,7 @@ bool BlockManager::LoadBlockIndex(
         }
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
-        if (pindex->pprev)
+        if (pindex->pprev && !from_image)
             pindex->BuildSkip();
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
@@ -4097,15 +5528,77 @@ bool BlockManager::LoadBlockIndex(
     return true;
 }
 
+static fs::path BlockIndexImagePath()
+{
+    return GetDataDir() / "blocks" / "index.img";
+}
+
+bool BlockManager::LoadBlockIndexImage(CBlockTreeDB& blocktree, std::vector<std::pair<int, CBlockIndex*>>& sorted_by_height)
+{
+    uint64_t generation;
+    if (!g_block_index_image || !blocktree.ReadIndexImageGeneration(generation)) return false;
+    if (!blocktree.EraseIndexImageGeneration()) return false;
+    std::unique_ptr<BlockIndexImage> image = BlockIndexImage::Open(BlockIndexImagePath(), generation);
+    if (!image) return false;
+
+    sorted_by_height.reserve(image->size());
+    boost::unique_lock<boost::shared_mutex> lock(g_block_index_mutex);
+    for (size_t i = 0; i < image->size(); ++i) {
+        CBlockIndex index;
+        int32_t prev, skip;
+        const uint256 hash = image->Read(i, index, prev, skip);
+        CBlockIndex* pindex = m_block_arena.Emplace(index);
+        const auto inserted = m_block_index.emplace(hash, pindex);
+        if (prev >= (int32_t)i || skip >= (int32_t)i || !inserted.second) {
+            LogPrintf("Block index image %s is inconsistent, loading the block index database instead\n", BlockIndexImagePath().string());
+            sorted_by_height.clear();
+            m_leaves.clear();
+            m_block_index.clear();
+            m_block_arena.Clear();
+            return false;
+        }
+        pindex->phashBlock = &inserted.first->first;
+        pindex->pprev = prev < 0 ? nullptr : sorted_by_height[prev].second;
+        pindex->pskip = skip < 0 ? nullptr : sorted_by_height[skip].second;
+        if (pindex->pprev) m_leaves.erase(pindex->pprev);
+        m_leaves.insert(pindex);
+        sorted_by_height.emplace_back(pindex->nHeight, pindex);
+    }
+    LogPrintf("Loaded %u block index entries from %s\n", sorted_by_height.size(), BlockIndexImagePath().string());
+    return true;
+}
+
+void SaveBlockIndexImage()
+{
+    AssertLockHeld(cs_main);
+    if (!g_block_index_image || !pblocktree || g_blockman.m_block_index.empty()) return;
+    if (!setDirtyBlockIndex.empty() || !setDirtyFileInfo.empty()) {
+        LogPrintf("%s: The block index is not flushed, not writing its image\n", __func__);
+        return;
+    }
+    std::vector<const CBlockIndex*> entries;
+    entries.reserve(g_blockman.m_block_index.size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : g_blockman.m_block_index) {
+        entries.push_back(item.second);
+    }
+    // Parents and skip entries come first, as they are lower
+    std::sort(entries.begin(), entries.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nHeight < b->nHeight; });
+    const uint64_t generation = GetRand(std::numeric_limits<uint64_t>::max());
+    if (WriteBlockIndexImage(BlockIndexImagePath(), generation, entries) && pblocktree->WriteIndexImageGeneration(generation)) {
+        LogPrintf("Wrote %u block index entries to %s\n", entries.size(), BlockIndexImagePath().string());
+    }
+}
+
 void BlockManager::Unload() {
     m_failed_blocks.clear();
     m_blocks_unlinked.clear();
+    m_leaves.clear();
 
-    for (const BlockMap::value_type& entry : m_block_index) {
-        delete entry.second;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(g_block_index_mutex);
+        m_block_index.clear();
     }
-
-    m_block_index.clear();
+    m_block_arena.Clear();
 }
 
 bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
@@ -4178,8 +5671,9 @@ bool CChainState::LoadChainTip(const CChainParams& chainparams)
     if (!pindex) {
         return false;
     }
-    m_chain.SetTip(pindex);
+    SetChainTip(m_chain, pindex);
     PruneBlockIndexCandidates();
+    PublishTipSnapshot();
 
     tip = m_chain.Tip();
     LogPrintf("Loaded best chain: hashBestChain=%s height=%d date=%s progress=%f\n",
@@ -4200,82 +5694,194 @@ CVerifyDB::~CVerifyDB()
     uiInterface.ShowProgress("", 100, false);
 }
 
-bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
+namespace {
+/** Closure reading a block and its undo data for VerifyDB, and running the check levels 0 to 2 on them. */
+class CVerifyBlockCheck
 {
-    LOCK(cs_main);
-    if (::ChainActive().Tip() == nullptr || ::ChainActive().Tip()->pprev == nullptr)
+private:
+    const CBlockIndex* m_index{nullptr};
+    CBlock* m_block{nullptr};
+    std::string* m_error{nullptr};
+    const Consensus::Params* m_params{nullptr};
+    int m_check_level{0};
+
+public:
+    CVerifyBlockCheck() {}
+    CVerifyBlockCheck(const CBlockIndex* index, CBlock* block, std::string* error, const Consensus::Params& params, int check_level) :
+        m_index(index), m_block(block), m_error(error), m_params(&params), m_check_level(check_level) {}
+
+    bool operator()()
+    {
+        // check level 0: read from disk
+        if (!ReadBlockFromDisk(*m_block, m_index, *m_params)) {
+            *m_error = strprintf("ReadBlockFromDisk failed at %d, hash=%s", m_index->nHeight, m_index->GetBlockHash().ToString());
+            return false;
+        }
+        // check level 1: verify block validity
+        BlockValidationState state;
+        if (m_check_level >= 1 && !CheckBlock(*m_block, state, *m_params)) {
+            *m_error = strprintf("found bad block at %d, hash=%s (%s)", m_index->nHeight, m_index->GetBlockHash().ToString(), state.ToString());
+            return false;
+        }
+        // check level 2: verify undo validity
+        if (m_check_level >= 2 && !m_index->GetUndoPos().IsNull()) {
+            CBlockUndo undo;
+            if (!UndoReadFromDisk(undo, m_index)) {
+                *m_error = strprintf("found bad undo data at %d, hash=%s", m_index->nHeight, m_index->GetBlockHash().ToString());
+                return false;
+            }
+        }
         return true;
+    }
+
+    void swap(CVerifyBlockCheck& check)
+    {
+        std::swap(m_index, check.m_index);
+        std::swap(m_block, check.m_block);
+        std::swap(m_error, check.m_error);
+        std::swap(m_params, check.m_params);
+        std::swap(m_check_level, check.m_check_level);
+    }
+};
+} // namespace
+
+static CCheckQueue<CVerifyBlockCheck> verifyblockqueue(1);
+
+void ThreadVerifyBlockCheck(int worker_num) {
+    util::ThreadRename(strprintf("verifyblk.%i", worker_num));
+    verifyblockqueue.Thread();
+}
+
+/** Number of blocks VerifyDB reads and checks at once */
+static constexpr size_t VERIFYDB_BATCH = 16;
+
+/**
+ * Read and check (levels 0 to 2) a batch of blocks, in parallel on the block
+ * verification threads if there are several. On failure, error is set to the
+ * failure of the first block that failed in the batch.
+ */
+static bool VerifyBlockBatch(const std::vector<const CBlockIndex*>& batch, std::vector<CBlock>& blocks, const Consensus::Params& params, int nCheckLevel, std::string& error)
+{
+    blocks.assign(batch.size(), CBlock());
+    std::vector<std::string> errors(batch.size());
+    if (g_parallel_script_checks && batch.size() > 1) {
+        std::vector<CVerifyBlockCheck> checks;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            checks.emplace_back(batch[i], &blocks[i], &errors[i], params, nCheckLevel);
+        }
+        CCheckQueueControl<CVerifyBlockCheck> control(&verifyblockqueue);
+        control.Add(checks);
+        if (control.Wait()) return true;
+    } else {
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!CVerifyBlockCheck(batch[i], &blocks[i], &errors[i], params, nCheckLevel)()) break;
+        }
+    }
+    for (const std::string& batch_error : errors) {
+        if (!batch_error.empty()) {
+            error = batch_error;
+            return false;
+        }
+    }
+    return true;
+}
 
-    // Verify blocks in the best chain
-    if (nCheckDepth <= 0 || nCheckDepth > ::ChainActive().Height())
-        nCheckDepth = ::ChainActive().Height();
+bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
+{
     nCheckLevel = std::max(0, std::min(4, nCheckLevel));
+    // Levels 0 to 2 only read the blocks, so unless a coins view on top of
+    // the tip is checked too, the chain may move on meanwhile.
+    if (nCheckLevel >= 3) {
+        LOCK(cs_main);
+        return VerifyBlocks(chainparams, coinsview, nCheckLevel, nCheckDepth);
+    }
+    return VerifyBlocks(chainparams, coinsview, nCheckLevel, nCheckDepth);
+}
+
+bool CVerifyDB::VerifyBlocks(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
+{
+    // Blocks to verify, from the tip backwards
+    std::vector<const CBlockIndex*> to_check;
+    CBlockIndex* pindex;
+    int chain_height;
+    {
+        LOCK(cs_main);
+        if (::ChainActive().Tip() == nullptr || ::ChainActive().Tip()->pprev == nullptr)
+            return true;
+
+        // Verify blocks in the best chain
+        chain_height = ::ChainActive().Height();
+        if (nCheckDepth <= 0 || nCheckDepth > chain_height)
+            nCheckDepth = chain_height;
+        for (pindex = ::ChainActive().Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
+            if (pindex->nHeight <= chain_height - nCheckDepth)
+                break;
+            if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                // If pruning, only go back as far as we have data.
+                LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
+                break;
+            }
+            to_check.push_back(pindex);
+        }
+    }
     LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
     CCoinsViewCache coins(coinsview);
-    CBlockIndex* pindex;
-    CBlockIndex* pindexFailure = nullptr;
+    const CBlockIndex* pindexFailure = nullptr;
     int nGoodTransactions = 0;
     BlockValidationState state;
     int reportDone = 0;
     LogPrintf("[0%%]..."); /* Continued */
-    for (pindex = ::ChainActive().Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
+    std::vector<CBlock> blocks;
+    for (size_t pos = 0; pos < to_check.size(); pos += VERIFYDB_BATCH) {
         boost::this_thread::interruption_point();
-        const int percentageDone = std::max(1, std::min(99, (int)(((double)(::ChainActive().Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
-        if (reportDone < percentageDone/10) {
-            // report every 10% step
-            LogPrintf("[%d%%]...", percentageDone); /* Continued */
-            reportDone = percentageDone/10;
-        }
-        uiInterface.ShowProgress(_("Verifying blocks...").translated, percentageDone, false);
-        if (pindex->nHeight <= ::ChainActive().Height()-nCheckDepth)
-            break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
-            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
-            break;
-        }
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
-            return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
-                         pindex->nHeight, pindex->GetBlockHash().ToString(), state.ToString());
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            if (!pindex->GetUndoPos().IsNull()) {
-                if (!UndoReadFromDisk(undo, pindex)) {
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-                }
+        const std::vector<const CBlockIndex*> batch(to_check.begin() + pos, to_check.begin() + std::min(pos + VERIFYDB_BATCH, to_check.size()));
+        std::string batch_error;
+        if (!VerifyBlockBatch(batch, blocks, chainparams.GetConsensus(), nCheckLevel, batch_error)) {
+            if (nCheckLevel < 3 && fPruneMode && WITH_LOCK(cs_main, return !(batch.back()->nStatus & BLOCK_HAVE_DATA))) {
+                // Pruned while it was being read, which only happens while
+                // verifying in the background.
+                LogPrintf("VerifyDB(): block verification stopping (pruning, no data)\n");
+                break;
             }
+            return error("VerifyDB(): *** %s", batch_error);
         }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && (coins.DynamicMemoryUsage() + ::ChainstateActive().CoinsTip().DynamicMemoryUsage()) <= nCoinCacheUsage) {
-            assert(coins.GetBestBlock() == pindex->GetBlockHash());
-            DisconnectResult res = ::ChainstateActive().DisconnectBlock(block, pindex, coins);
-            if (res == DISCONNECT_FAILED) {
-                return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const CBlockIndex* checked = batch[i];
+            const int percentageDone = std::max(1, std::min(99, (int)(((double)(chain_height - checked->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
+            if (reportDone < percentageDone/10) {
+                // report every 10% step
+                LogPrintf("[%d%%]...", percentageDone); /* Continued */
+                reportDone = percentageDone/10;
             }
-            if (res == DISCONNECT_UNCLEAN) {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            } else {
-                nGoodTransactions += block.vtx.size();
+            uiInterface.ShowProgress(_("Verifying blocks...").translated, percentageDone, false);
+            // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
+            if (nCheckLevel >= 3 && (coins.DynamicMemoryUsage() + ::ChainstateActive().CoinsTip().DynamicMemoryUsage()) <= nCoinCacheUsage) {
+                AssertLockHeld(cs_main);
+                assert(coins.GetBestBlock() == checked->GetBlockHash());
+                DisconnectResult res = ::ChainstateActive().DisconnectBlock(blocks[i], checked, coins);
+                if (res == DISCONNECT_FAILED) {
+                    return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", checked->nHeight, checked->GetBlockHash().ToString());
+                }
+                if (res == DISCONNECT_UNCLEAN) {
+                    nGoodTransactions = 0;
+                    pindexFailure = checked;
+                } else {
+                    nGoodTransactions += blocks[i].vtx.size();
+                }
             }
+            if (ShutdownRequested())
+                return true;
         }
-        if (ShutdownRequested())
-            return true;
     }
     if (pindexFailure)
-        return error("VerifyDB(): *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", ::ChainActive().Height() - pindexFailure->nHeight + 1, nGoodTransactions);
+        return error("VerifyDB(): *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", chain_height - pindexFailure->nHeight + 1, nGoodTransactions);
 
     // store block count as we move pindex at check level >= 4
-    int block_count = ::ChainActive().Height() - pindex->nHeight;
+    int block_count = chain_height - pindex->nHeight;
 
     // check level 4: try reconnecting blocks
     if (nCheckLevel >= 4) {
+        AssertLockHeld(cs_main);
         while (pindex != ::ChainActive().Tip()) {
             boost::this_thread::interruption_point();
             const int percentageDone = std::max(1, std::min(99, 100 - (int)(((double)(::ChainActive().Height() - pindex->nHeight)) / (double)nCheckDepth * 50)));
@@ -4300,6 +5906,16 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     return true;
 }
 
+void ThreadVerifyDB(const CChainParams& chainparams, int nCheckLevel, int nCheckDepth)
+{
+    util::ThreadRename("verifydb");
+    LogPrintf("Verifying blocks in the background\n");
+    CCoinsView* coinsview = WITH_LOCK(cs_main, return &::ChainstateActive().CoinsTip());
+    if (!CVerifyDB().VerifyDB(chainparams, coinsview, nCheckLevel, nCheckDepth) && !ShutdownRequested()) {
+        AbortNode("Corrupted block database detected by the background block verification", _("Corrupted block database detected").translated);
+    }
+}
+
 /** Apply the effects of a block on the utxo cache, ignoring that it may already have been applied. */
 bool CChainState::RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params)
 {
@@ -4325,6 +5941,10 @@ bool CChainState::ReplayBlocks(const CChainParams& params)
 {
     LOCK(cs_main);
 
+    // An interrupted write that was journaled is finished from the journal,
+    // without needing the blocks.
+    if (!m_coins_views->m_flushview.ReplayJournal()) return error("ReplayBlocks(): unable to replay the coins journal");
+
     CCoinsView& db = this->CoinsDB();
     CCoinsViewCache cache(&db);
 
@@ -4403,7 +6023,10 @@ void CChainState::EraseBlockData(CBlockIndex* index)
     index->nDataPos = 0;
     index->nUndoPos = 0;
     // Remove various other things
-    index->nTx = 0;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(g_block_index_mutex);
+        index->nTx = 0;
+    }
     index->nChainTx = 0;
     index->nSequenceId = 0;
     // Make sure it gets written.
@@ -4548,10 +6171,14 @@ void CChainState::UnloadBlockIndex() {
 void UnloadBlockIndex()
 {
     LOCK(cs_main);
-    ::ChainActive().SetTip(nullptr);
+    SetChainTip(::ChainActive(), nullptr);
     g_blockman.Unload();
+    ResetLwmaCache();
+    g_block_file_maps.Clear();
+    g_reorg_cache.Clear();
     pindexBestInvalid = nullptr;
     pindexBestHeader = nullptr;
+    PublishTipSnapshot();
     mempool.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
@@ -4618,6 +6245,89 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return ::ChainstateActive().LoadGenesisBlock(chainparams);
 }
 
+namespace {
+//! A block found in a block file by LoadExternalBlockFile
+struct ImportedBlock {
+    //! position of the serialized block in the file, and where it ends according to its size field
+    uint64_t pos;
+    uint64_t end_pos;
+    //! where to resume scanning if the block cannot be parsed (one byte past its magic bytes)
+    uint64_t rewind_pos;
+    //! where scanning continues after the parsed block
+    uint64_t next_pos{0};
+    //! whether data is a compressed record payload (-blockcompress)
+    bool compressed{false};
+    std::vector<unsigned char> data;
+    std::shared_ptr<CBlock> block;
+    uint256 hash;
+    std::string error;
+};
+
+//! Maximum number of block file bytes read ahead into one batch of LoadExternalBlockFile
+static constexpr size_t IMPORT_BATCH_BYTES = 2 * MAX_BLOCK_SERIALIZED_SIZE;
+//! Maximum number of blocks in one batch of LoadExternalBlockFile
+static constexpr size_t IMPORT_BATCH_BLOCKS = 1024;
+//! Maximum number of threads parsing blocks for LoadExternalBlockFile
+static constexpr int MAX_IMPORT_PARSE_THREADS = 8;
+
+/** Parse blocks read by LoadExternalBlockFile, hash them and run their context-free checks. */
+void ParseImportedBlocks(std::vector<ImportedBlock>& batch, size_t begin, size_t end, const Consensus::Params& consensus_params)
+{
+    for (size_t i = begin; i < end; ++i) {
+        ImportedBlock& entry = batch[i];
+        try {
+            entry.block = std::make_shared<CBlock>();
+            if (entry.compressed) {
+                std::vector<unsigned char> payload;
+                payload.swap(entry.data);
+                if (!DecompressBlockRecord(Span<const uint8_t>(payload.data(), payload.size()), entry.data)) {
+                    throw std::ios_base::failure("Failed to decompress block");
+                }
+            }
+            VectorReader reader(SER_DISK, CLIENT_VERSION, entry.data, 0);
+            reader >> *entry.block;
+            // a compressed record ends with its payload, whatever the block consumed
+            entry.next_pos = entry.compressed ? entry.end_pos : entry.end_pos - reader.size();
+            entry.hash = entry.block->GetHash();
+            // Sets fChecked on success, so AcceptBlock does not repeat the merkle
+            // root and transaction checks; on failure AcceptBlock reports the error
+            BlockValidationState state;
+            CheckBlock(*entry.block, state, consensus_params);
+        } catch (const std::exception& e) {
+            entry.block.reset();
+            entry.error = e.what();
+        }
+        entry.data.clear();
+        entry.data.shrink_to_fit();
+    }
+}
+
+//! Threads parsing the next batch of LoadExternalBlockFile, joined also when the current batch throws
+class ImportParsers
+{
+    std::vector<std::thread> m_threads;
+
+public:
+    ~ImportParsers() { Join(); }
+
+    void Start(std::vector<ImportedBlock>& batch, size_t threads, bool use_caller, const Consensus::Params& consensus_params)
+    {
+        const size_t per_thread = (batch.size() + threads - 1) / std::max<size_t>(threads, 1);
+        size_t begin = use_caller ? per_thread : 0;
+        for (; begin < batch.size(); begin += per_thread) {
+            m_threads.emplace_back(ParseImportedBlocks, std::ref(batch), begin, std::min(batch.size(), begin + per_thread), std::cref(consensus_params));
+        }
+        if (use_caller) ParseImportedBlocks(batch, 0, std::min(batch.size(), per_thread), consensus_params);
+    }
+
+    void Join()
+    {
+        for (std::thread& thread : m_threads) thread.join();
+        m_threads.clear();
+    }
+};
+} // namespace
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
@@ -4629,108 +6339,179 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
-
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+        bool scan_done = false;
+
+        // Find the next blocks in the file and copy them out, without parsing them
+        auto read_batch = [&](std::vector<ImportedBlock>& batch) {
+            batch.clear();
+            // Resuming after a rewind may need to go back further than the buffer allows
+            if (!blkdat.SetPos(nRewind) && !blkdat.Seek(nRewind)) {
+                scan_done = true;
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                uint256 hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                                block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+            size_t batch_bytes = 0;
+            while (!scan_done && !blkdat.eof() && batch.size() < IMPORT_BATCH_BLOCKS && batch_bytes < IMPORT_BATCH_BYTES) {
+                boost::this_thread::interruption_point();
+
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                bool compressed = false;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    blkdat.FindByte(chainparams.MessageStart()[0]);
+                    nRewind = blkdat.GetPos()+1;
+                    blkdat >> buf;
+                    if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
                         continue;
-                    }
+                    // read size
+                    blkdat >> nSize;
+                    compressed = nSize & BLOCK_RECORD_COMPRESSED;
+                    nSize &= ~BLOCK_RECORD_COMPRESSED;
+                    if (nSize < (compressed ? 5 : 80) || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    scan_done = true;
+                    break;
+                }
+                try {
+                    // read block
+                    ImportedBlock entry;
+                    entry.pos = blkdat.GetPos();
+                    entry.end_pos = entry.pos + nSize;
+                    entry.rewind_pos = nRewind;
+                    entry.compressed = compressed;
+                    blkdat.SetLimit(entry.end_pos);
+                    entry.data.resize(nSize);
+                    blkdat.read((char*)entry.data.data(), nSize);
+                    nRewind = blkdat.GetPos();
+                    batch_bytes += nSize;
+                    batch.push_back(std::move(entry));
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                }
+            }
+        };
 
-                    // process in case the block isn't known yet
-                    CBlockIndex* pindex = LookupBlockIndex(hash);
-                    if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
-                      BlockValidationState state;
-                      if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
-                          nLoaded++;
-                      }
-                      if (state.IsError()) {
-                          break;
-                      }
-                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                      LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
-                    }
+        // Blocks are read in batches. While one batch is accepted in file order
+        // on this thread, the next one is parsed and checked by worker threads.
+        const size_t parse_threads = std::max(1, std::min(GetNumCores(), MAX_IMPORT_PARSE_THREADS));
+        std::vector<ImportedBlock> batch;
+        read_batch(batch);
+        {
+            ImportParsers parsers;
+            parsers.Start(batch, parse_threads, true, chainparams.GetConsensus());
+        }
+        bool abort = false;
+        while (!batch.empty() && !abort) {
+            std::vector<ImportedBlock> next;
+            ImportParsers parsers;
+            read_batch(next);
+            parsers.Start(next, parse_threads, false, chainparams.GetConsensus());
+
+            bool rewound = false;
+            for (ImportedBlock& entry : batch) {
+                if (rewound || abort) break;
+                if (!entry.block) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, entry.error);
+                    // look for the next block right after the magic bytes of this one
+                    nRewind = entry.rewind_pos;
+                    rewound = true;
+                    break;
+                }
+                if (entry.next_pos != entry.end_pos) {
+                    // the block ended before its size field says; the data after it
+                    // is scanned again, so the next batch was read past it
+                    nRewind = entry.next_pos;
+                    rewound = true;
                 }
+                try {
+                    if (dbp)
+                        dbp->nPos = entry.pos;
+                    std::shared_ptr<CBlock> pblock = entry.block;
+                    CBlock& block = *pblock;
+                    const uint256& hash = entry.hash;
+                    {
+                        LOCK(cs_main);
+                        // detect out of order blocks, and store them for later
+                        if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
+                            LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                                    block.hashPrevBlock.ToString());
+                            if (dbp)
+                                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                            continue;
+                        }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    BlockValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
+                        // process in case the block isn't known yet
+                        CBlockIndex* pindex = LookupBlockIndex(hash);
+                        if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+                          BlockValidationState state;
+                          if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
+                              nLoaded++;
+                          }
+                          if (state.IsError()) {
+                              abort = true;
+                              break;
+                          }
+                        } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+                          LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+                        }
+                    }
+
+                    // Activate the genesis block so normal node progress can continue
+                    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+                        BlockValidationState state;
+                        if (!ActivateBestChain(state, chainparams)) {
+                            abort = true;
+                            break;
+                        }
                     }
-                }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
-                        {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            BlockValidationState dummy;
-                            if (::ChainstateActive().AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
+                    NotifyHeaderTip();
+
+                    // Recursively process earlier encountered successors of this block
+                    std::deque<uint256> queue;
+                    queue.push_back(hash);
+                    while (!queue.empty()) {
+                        uint256 head = queue.front();
+                        queue.pop_front();
+                        std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                        while (range.first != range.second) {
+                            std::multimap<uint256, FlatFilePos>::iterator it = range.first;
+                            std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+                            if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
                             {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
+                                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                                        head.ToString());
+                                LOCK(cs_main);
+                                BlockValidationState dummy;
+                                if (::ChainstateActive().AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
+                                {
+                                    nLoaded++;
+                                    queue.push_back(pblockrecursive->GetHash());
+                                }
                             }
+                            range.first++;
+                            mapBlocksUnknownParent.erase(it);
+                            NotifyHeaderTip();
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
                     }
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+            parsers.Join();
+
+            if (rewound) {
+                // the next batch was read from the wrong position
+                scan_done = false;
+                read_batch(next);
+                ImportParsers reparse;
+                reparse.Start(next, parse_threads, true, chainparams.GetConsensus());
+            }
+            batch = std::move(next);
         }
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
@@ -4875,6 +6656,7 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
             }
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
+        assert((forward.count(pindex) == 0) == (m_blockman.m_leaves.count(pindex) == 1)); // The leaves are the entries without children.
         // End: actual consistency checks.
 
         // Try descending into the first subnode.
@@ -4939,7 +6721,7 @@ CBlockFileInfo* GetBlockFileInfo(size_t n)
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos)
 {
     LOCK(cs_main);
-    return VersionBitsState(::ChainActive().Tip(), params, pos, versionbitscache);
+    return VersionBitsStateAfter(::ChainActive().Tip(), params, pos);
 }
 
 BIP9Stats VersionBitsTipStatistics(const Consensus::Params& params, Consensus::DeploymentPos pos)
@@ -4954,7 +6736,45 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(::ChainActive().Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_CHUNKS = 1;
+/**
+ * mempool.dat version 2 stores the transactions as chunks: a compact size
+ * record count followed by that many records, ended by an empty chunk. As in
+ * version 1, parents are always stored before their children.
+ */
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+/** Number of transactions per chunk, and the largest chunk that is read. */
+static const uint64_t MEMPOOL_DUMP_CHUNK_SIZE = 1000;
+
+/**
+ * Verify the signatures of a chunk of transactions read from mempool.dat on
+ * the script check threads, so that accepting them one by one afterwards
+ * mostly hits the signature cache. Transactions whose inputs cannot be found
+ * are left to AcceptToMemoryPool, and so are any failures.
+ */
+static void PrevalidateMempoolTransactions(CTxMemPool& pool, const std::vector<CTransactionRef>& txs) LOCKS_EXCLUDED(cs_main)
+{
+    if (!g_parallel_script_checks || txs.empty()) return;
+
+    // The queued checks point into txdata, so it must not be reallocated.
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(txs.size());
+    std::vector<CScriptCheck> checks;
+    {
+        LOCK2(cs_main, pool.cs);
+        CCoinsViewMemPool view_mempool(&::ChainstateActive().CoinsTip(), pool);
+        CCoinsViewCache view(&view_mempool);
+        for (const CTransactionRef& tx : txs) {
+            if (tx->IsCoinBase() || !view.HaveInputs(*tx)) continue;
+            txdata.emplace_back(*tx);
+            TxValidationState state;
+            CheckInputScripts(*tx, state, view, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheSigStore */, false /* cacheFullScriptStore */, txdata.back(), &checks);
+            // Later transactions of the chunk may spend this one.
+            AddCoins(view, *tx, MEMPOOL_HEIGHT, true);
+        }
+    }
+    RunScriptChecks(checks);
+}
 
 bool LoadMempool(CTxMemPool& pool)
 {
@@ -4976,47 +6796,80 @@ bool LoadMempool(CTxMemPool& pool)
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_NO_CHUNKS) {
             return false;
         }
-        uint64_t num;
-        file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        uint64_t num = 0;
+        if (version == MEMPOOL_DUMP_VERSION_NO_CHUNKS) {
+            file >> num;
+        }
+        std::vector<CTransactionRef> txs;
+        std::vector<int64_t> times;
+        while (true) {
+            // Version 1 files are read in chunks of the same size.
+            uint64_t chunk_size;
+            if (version == MEMPOOL_DUMP_VERSION_NO_CHUNKS) {
+                chunk_size = std::min(num, MEMPOOL_DUMP_CHUNK_SIZE);
+                num -= chunk_size;
+            } else {
+                chunk_size = ReadCompactSize(file);
+                if (chunk_size > MEMPOOL_DUMP_CHUNK_SIZE) {
+                    throw std::ios_base::failure("chunk too large");
+                }
             }
-            TxValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetHash())) {
-                        ++already_there;
+            if (chunk_size == 0) break;
+
+            txs.clear();
+            times.clear();
+            std::vector<CTransactionRef> unexpired;
+            while (chunk_size--) {
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+
+                CAmount amountdelta = nFeeDelta;
+                if (amountdelta) {
+                    pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                }
+                if (nTime + nExpiryTimeout > nNow) {
+                    unexpired.push_back(tx);
+                }
+                txs.push_back(std::move(tx));
+                times.push_back(nTime);
+            }
+            PrevalidateMempoolTransactions(pool, unexpired);
+
+            for (size_t i = 0; i < txs.size(); ++i) {
+                const CTransactionRef& tx = txs[i];
+                const int64_t nTime = times[i];
+                TxValidationState state;
+                if (nTime + nExpiryTimeout > nNow) {
+                    LOCK(cs_main);
+                    AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nTime,
+                                               nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
+                                               false /* test_accept */);
+                    if (state.IsValid()) {
+                        ++count;
                     } else {
-                        ++failed;
+                        // mempool may contain the transaction already, e.g. from
+                        // wallet(s) having loaded it while we were processing
+                        // mempool transactions; consider these as valid, instead of
+                        // failed, but mark them as 'already there'
+                        if (pool.exists(tx->GetHash())) {
+                            ++already_there;
+                        } else {
+                            ++failed;
+                        }
                     }
+                } else {
+                    ++expired;
                 }
-            } else {
-                ++expired;
+                if (ShutdownRequested())
+                    return false;
             }
-            if (ShutdownRequested())
-                return false;
         }
         std::map<uint256, CAmount> mapDeltas;
         file >> mapDeltas;
@@ -5048,6 +6901,7 @@ bool DumpMempool(const CTxMemPool& pool)
         for (const auto &i : pool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
+        // Sorted by ancestor count, so parents come before their children.
         vinfo = pool.infoAll();
     }
 
@@ -5064,13 +6918,17 @@ bool DumpMempool(const CTxMemPool& pool)
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
 
-        file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << int64_t{count_seconds(i.m_time)};
-            file << int64_t{i.nFeeDelta};
-            mapDeltas.erase(i.tx->GetHash());
+        for (size_t pos = 0; pos < vinfo.size(); pos += MEMPOOL_DUMP_CHUNK_SIZE) {
+            const size_t chunk_end = std::min<size_t>(pos + MEMPOOL_DUMP_CHUNK_SIZE, vinfo.size());
+            WriteCompactSize(file, chunk_end - pos);
+            for (size_t i = pos; i < chunk_end; ++i) {
+                file << *(vinfo[i].tx);
+                file << int64_t{count_seconds(vinfo[i].m_time)};
+                file << int64_t{vinfo[i].nFeeDelta};
+                mapDeltas.erase(vinfo[i].tx->GetHash());
+            }
         }
+        WriteCompactSize(file, 0);
 
         file << mapDeltas;
         if (!FileCommit(file.Get()))
@@ -5086,35 +6944,115 @@ bool DumpMempool(const CTxMemPool& pool)
     return true;
 }
 
+static const uint64_t SIGCACHE_DUMP_VERSION = 1;
+
+//! Set once the caches have been loaded, so a node that failed to start doesn't overwrite the file with empty caches.
+static std::atomic<bool> g_signature_caches_loaded{false};
+
+bool LoadSignatureCaches()
+{
+    g_signature_caches_loaded = true;
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 sig_nonce, script_nonce;
+    std::vector<uint256> sig_entries, script_entries;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SIGCACHE_DUMP_VERSION) {
+            return false;
+        }
+        file >> sig_nonce >> sig_entries;
+        file >> script_nonce >> script_entries;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LoadSignatureCache(sig_nonce, sig_entries);
+    {
+        LOCK(cs_main);
+        scriptExecutionCacheNonce = script_nonce;
+        for (const uint256& entry : script_entries) {
+            scriptExecutionCache.insert(entry);
+        }
+    }
+    LogPrintf("Imported signature cache from disk: %u signature and %u script execution entries\n", sig_entries.size(), script_entries.size());
+    return true;
+}
+
+bool DumpSignatureCaches()
+{
+    if (!g_signature_caches_loaded) return false;
+    int64_t start = GetTimeMicros();
+
+    uint256 sig_nonce, script_nonce;
+    std::vector<uint256> sig_entries, script_entries;
+    DumpSignatureCache(sig_nonce, sig_entries);
+    {
+        LOCK(cs_main);
+        script_nonce = scriptExecutionCacheNonce;
+        scriptExecutionCache.for_each_kept([&](const uint256& entry) { script_entries.push_back(entry); });
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << SIGCACHE_DUMP_VERSION;
+        file << sig_nonce << sig_entries;
+        file << script_nonce << script_entries;
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped signature cache: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 //! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
-double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
-    if (pindex == nullptr)
-        return 0.0;
-
+static double GuessVerificationProgress(const ChainTxData& data, unsigned int chain_tx, int64_t block_time) {
     int64_t nNow = time(nullptr);
 
     double fTxTotal;
 
-    if (pindex->nChainTx <= data.nTxCount) {
+    if (chain_tx <= data.nTxCount) {
         fTxTotal = data.nTxCount + (nNow - data.nTime) * data.dTxRate;
     } else {
-        fTxTotal = pindex->nChainTx + (nNow - pindex->GetBlockTime()) * data.dTxRate;
+        fTxTotal = chain_tx + (nNow - block_time) * data.dTxRate;
     }
 
-    return std::min<double>(pindex->nChainTx / fTxTotal, 1.0);
+    return std::min<double>(chain_tx / fTxTotal, 1.0);
 }
 
-class CMainCleanup
+double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
+    if (pindex == nullptr)
+        return 0.0;
+
+    return GuessVerificationProgress(data, pindex->nChainTx, pindex->GetBlockTime());
+}
+
+double TipSnapshot::VerificationProgress(const ChainTxData& data) const {
+    return GuessVerificationProgress(data, chain_tx, block_time);
+}
+
+std::shared_ptr<const TipSnapshot> GetTipSnapshot()
 {
-public:
-    CMainCleanup() {}
-    ~CMainCleanup() {
-        // block headers
-        BlockMap::iterator it1 = g_blockman.m_block_index.begin();
-        for (; it1 != g_blockman.m_block_index.end(); it1++)
-            delete (*it1).second;
-        g_blockman.m_block_index.clear();
-    }
-};
-static CMainCleanup instance_of_cmaincleanup;
+    return std::atomic_load(&g_tip_snapshot);
+}
@@ -14,6 +14,7 @@
 #include <coins.h>
 #include <crypto/common.h> // for ReadLE64
 #include <fs.h>
+#include <optional.h>
 #include <policy/feerate.h>
 #include <protocol.h> // For CMessageHeader::MessageStartChars
 #include <script/script_error.h>
@@ -22,8 +23,11 @@
 #include <txdb.h>
 #include <versionbits.h>
 #include <serialize.h>
+#include <span.h>
 
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
@@ -31,6 +35,8 @@
 #include <utility>
 #include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
+
 class CChainState;
 class BlockValidationState;
 class CBlockIndex;
@@ -42,6 +48,7 @@ class CConnman;
 class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
+class MappedFile;
 class TxValidationState;
 struct ChainTxData;
 
@@ -59,6 +66,10 @@ static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 /** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
+/** Default for -limitclustercount, max number of transactions in a mempool cluster */
+static const unsigned int DEFAULT_CLUSTER_LIMIT = 64;
+/** Default for -mempoolclusters */
+static const bool DEFAULT_MEMPOOL_CLUSTERS = false;
 /**
  * An extra transaction can be added to a package, as long as it only has one
  * ancestor and is no larger than this. Not really any reason to make this
@@ -77,11 +88,21 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
 /** Maximum number of dedicated script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 15;
+static const int MAX_SCRIPTCHECK_THREADS = 127;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Default for -parpipeline */
+static const bool DEFAULT_SCRIPTCHECK_PIPELINE = false;
+/** Maximum number of dedicated input prefetching threads allowed */
+static const int MAX_PREFETCH_THREADS = 16;
+/** -prefetchthreads default (number of input prefetching threads, 0 = disabled) */
+static const int DEFAULT_PREFETCH_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Range of the number of blocks that can be in transit from a single peer with -adaptiveblockdownload.
+ *  Eight peers at the maximum still fill only half of the block download window. */
+static const int MIN_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 64;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -112,12 +133,38 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_COINSTATSINDEX = false;
+static const bool DEFAULT_BLOCKSTATSINDEX = false;
 static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIGCACHE = false;
 /** Default for using fee filter */
 static const bool DEFAULT_FEEFILTER = true;
+/** Default for -blockmmap */
+static const bool DEFAULT_BLOCKMMAP = false;
+/** Default for -blockindeximage */
+static const bool DEFAULT_BLOCK_INDEX_IMAGE = false;
+static const bool DEFAULT_BLOCKCOMPRESS = false;
+static const bool DEFAULT_DB_BACKGROUND_FLUSH = false;
+/** Default for -reorgcache, the number of recently connected blocks kept in memory with their undo data */
+static const unsigned int DEFAULT_REORG_CACHE_BLOCKS = 6;
+static const unsigned int MAX_REORG_CACHE_BLOCKS = 1000;
+/** Default for -asyncblockvalidation */
+static const bool DEFAULT_ASYNC_BLOCK_VALIDATION = false;
+/** Default for -asyncblockfiles */
+static const bool DEFAULT_ASYNC_BLOCK_FILES = false;
+/** Default for -dbcacheretain, the percentage of the coins cache kept after a flush */
+static const int DEFAULT_DBCACHE_RETAIN = 0;
+/** Default for -coinsreusesample */
+static const uint32_t DEFAULT_COINS_REUSE_SAMPLE = 0;
+/** Most coins followed by the -coinsreusesample estimator */
+static const size_t COINS_REUSE_MAX_TRACKED = 1 << 14;
+static const int MAX_DBCACHE_RETAIN = 90;
 
 /** Maximum number of headers to announce when relaying blocks with headers message.*/
 static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
@@ -127,6 +174,8 @@ static const int MAX_UNCONNECTING_HEADERS = 10;
 
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
+/** Default for -tipnotifyinterval, in milliseconds */
+static const int64_t DEFAULT_TIP_NOTIFY_INTERVAL = 250;
 
 struct BlockHasher
 {
@@ -149,6 +198,28 @@ extern std::atomic_bool fReindex;
  * False indicates all script checking is done on the main threadMessageHandler thread.
  */
 extern bool g_parallel_script_checks;
+/** Whether consecutive blocks are connected with their script checks overlapping (-parpipeline). */
+extern bool g_pipeline_script_checks;
+/** Whether there are dedicated threads reading block inputs from the coin database ahead of ConnectBlock. */
+extern bool g_parallel_prefetch;
+/** Whether finalized block files are read through cached memory mappings (-blockmmap). */
+extern bool g_block_mmap;
+/** Whether the block index is written to an image at shutdown and loaded from it at startup (-blockindeximage). */
+extern bool g_block_index_image;
+/** Whether newly stored blocks are LZ4 compressed in the block files (-blockcompress). */
+extern bool g_block_compress;
+/** Whether full coins cache flushes are written to the coin database in a background thread. */
+extern bool g_db_background_flush;
+/** Whether coins cache flushes are journaled before they are written to the coin database. */
+extern bool g_coins_journal;
+/** Number of LevelDB instances a new coin database is split into (-chainstateshards). */
+extern int g_chainstate_shards;
+/** Percentage of the coins cache size limit that flushes keep filled with recently used coins. */
+extern int g_dbcache_retain_percent;
+/** Follow one in this many coins to estimate lookup reuse distances in the coins cache (-coinsreusesample, 0 to disable). */
+extern uint32_t g_coins_reuse_sample;
+/** Least milliseconds between block or header tip notifications to the UI during initial block download (-tipnotifyinterval, 0 to notify every tip). */
+extern int64_t g_tip_notify_interval;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -174,6 +245,16 @@ extern bool fHavePruned;
 extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
+/** Number of bytes below nPruneTarget that automatic pruning deletes down to (-pruneheadroom). */
+extern uint64_t g_prune_headroom;
+/** Directory older block and undo files are moved to (-blockscolddir), empty if they all stay in the blocks directory. */
+extern fs::path g_blocks_cold_dir;
+/** Number of most recent block files kept in the blocks directory when -blockscolddir is set (-blockshotfiles). */
+extern int g_blocks_hot_files;
+/** Default for -blockshotfiles */
+static const int DEFAULT_BLOCKS_HOT_FILES = 16;
+/** Time between runs of the block file migration to -blockscolddir */
+static constexpr std::chrono::seconds BLOCK_FILE_MIGRATION_INTERVAL{60};
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of ::ChainActive().Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 /** Minimum blocks required to signal NODE_NETWORK_LIMITED */
@@ -181,6 +262,8 @@ static const unsigned int NODE_NETWORK_LIMITED_MIN_BLOCKS = 288;
 
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Default for -asynccheckblocks */
+static const bool DEFAULT_ASYNC_CHECKBLOCKS = false;
 
 // Require that user allocate at least 550 MiB for block & undo files (blk???.dat and rev???.dat)
 // At 1MB per block, 288 blocks = 288MB.
@@ -214,6 +297,28 @@ static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
  */
 bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool* fNewBlock) LOCKS_EXCLUDED(cs_main);
 
+/**
+ * The first half of ProcessNewBlock: check a new block and store it to disk,
+ * without trying to connect it. BlockChecked is called if it is refused.
+ *
+ * @returns     If the block was accepted, which ActivateBestChain should follow
+ */
+bool AcceptNewBlock(const CChainParams& chainparams, const std::shared_ptr<const CBlock> pblock, bool fForceProcessing, bool* fNewBlock) LOCKS_EXCLUDED(cs_main);
+
+/** Start the thread connecting the blocks passed to QueueBlockActivation (-asyncblockvalidation) */
+void StartBlockValidationThread(const CChainParams& chainparams);
+/**
+ * Stop the block validation thread. Blocks still queued are on disk already,
+ * so the next ActivateBestChain, at the latest the one at startup, connects them.
+ */
+void StopBlockValidationThread();
+/**
+ * Queue a block accepted with AcceptNewBlock for ActivateBestChain on the
+ * block validation thread, which signals BlockProcessed once it is done.
+ * Returns false, without queueing it, if the thread is not running.
+ */
+bool QueueBlockActivation(const std::shared_ptr<const CBlock>& pblock);
+
 /**
  * Process incoming block headers.
  *
@@ -231,6 +336,8 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, BlockValidat
 FILE* OpenBlockFile(const FlatFilePos &pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 fs::path GetBlockPosFilename(const FlatFilePos &pos);
+/** Deliver the latest block and header tips held back by -tipnotifyinterval, if the interval has passed. Called periodically by the scheduler. */
+void FlushTipNotifications() LOCKS_EXCLUDED(cs_main);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos *dbp = nullptr);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
@@ -240,8 +347,22 @@ bool LoadGenesisBlock(const CChainParams& chainparams);
 bool LoadBlockIndex(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 /** Unload database information */
 void UnloadBlockIndex();
+/** Write the flushed block index to the image the next LoadBlockIndex starts from, if -blockindeximage is set */
+void SaveBlockIndexImage() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/** Run an instance of the header hashing thread, used to hash batches of headers in parallel */
+void ThreadHeaderCheck(int worker_num);
+/** Run an instance of the transaction checking thread, used to check the transactions of large blocks in parallel */
+void ThreadTxCheck(int worker_num);
+/** Run an instance of the block verification thread, used to read and check blocks in parallel in VerifyDB */
+void ThreadVerifyBlockCheck(int worker_num);
+/** Run an instance of the input prefetching thread */
+void ThreadPrefetchCheck(int worker_num);
+/** Start the threads pre-allocating and committing block and undo files in the background (-asyncblockfiles) */
+void StartBlockFileWorkers();
+/** Finish the queued block and undo file work and stop its threads */
+void StopBlockFileWorkers();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, const Consensus::Params& params, uint256& hashBlock, const CBlockIndex* const blockIndex = nullptr);
 /**
@@ -256,28 +377,128 @@ CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
 /** Guess verification progress (as a fraction between 0.0=genesis and 1.0=current tip). */
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex* pindex);
 
+/**
+ * The active chain tip, copied out of the block index each time it changes so
+ * that RPCs polled at a high rate can report it without taking cs_main.
+ */
+struct TipSnapshot {
+    int height;
+    uint256 hash;
+    uint32_t bits;
+    int64_t median_time;
+    int64_t block_time;
+    uint256 chain_work;
+    unsigned int chain_tx;
+    //! Height of the best known header, -1 if there is none
+    int header_height;
+
+    /** GuessVerificationProgress for the tip, at the current time. */
+    double VerificationProgress(const ChainTxData& data) const;
+};
+
+/** Return the latest snapshot of the active chain tip, or nullptr while no tip is loaded. */
+std::shared_ptr<const TipSnapshot> GetTipSnapshot();
+
+struct ReorgCacheStats {
+    uint64_t hits{0};
+    uint64_t misses{0};
+    size_t blocks{0};
+    size_t max_blocks{0};
+};
+
+/** Set how many recently connected blocks are kept in memory with their undo data (0 disables it). */
+void SetReorgCacheSize(size_t max_blocks);
+/** Hits and misses of block and undo reads when disconnecting blocks, and the reorg cache size. */
+ReorgCacheStats GetReorgCacheStats();
+
+struct CoinsCacheStats {
+    //! Memory used by the coins tip cache and its limit (-dbcache), in bytes
+    size_t usage{0};
+    size_t max_usage{0};
+    size_t entries{0};
+    //! Counters of the coins tip cache
+    CCoinsCacheCounters tip;
+    //! Lookups the tip passed down that were answered by coins still being
+    //! written in the background
+    uint64_t flushing_hits{0};
+    //! Coins looked up in the database, and how many of them were there
+    uint64_t db_reads{0};
+    uint64_t db_found{0};
+
+    //! Flushes of the coins cache to the database, and how many kept part of it (-dbcacheretain)
+    uint64_t flushes{0};
+    uint64_t partial_flushes{0};
+    //! The last flush: when it ended, how long it took (in microseconds), and
+    //! the cache entries and memory before and the entries after it
+    int64_t last_flush_time{0};
+    int64_t last_flush_duration{0};
+    size_t last_flush_entries{0};
+    size_t last_flush_usage{0};
+    size_t last_flush_entries_after{0};
+
+    //! Reuse distances of the tip's lookups, if -coinsreusesample is set
+    Optional<CoinsReuseSampler::Stats> reuse;
+};
+
+/**
+ * Coins cache figures as of the last FlushStateToDisk (which runs after
+ * every connected block), readable without taking cs_main.
+ */
+CoinsCacheStats GetCoinsCacheStats();
+
 /** Calculate the amount of disk space the block & undo files currently use */
 uint64_t CalculateCurrentUsage();
 
+/**
+ *  Mark block files as pruned, in one pass over the block index.
+ */
+void PruneBlockFiles(const std::set<int>& file_numbers) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /**
  *  Mark one block file as pruned.
  */
 void PruneOneBlockFile(const int fileNumber) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /**
- *  Actually unlink the specified files
+ *  Actually unlink the specified files, in the background if the block file workers are running
  */
 void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 
 /** Prune block files up to a given height */
 void PruneBlockFilesManual(int nManualPruneHeight);
 
+/**
+ * Move the block and undo files older than the g_blocks_hot_files most recent ones to
+ * g_blocks_cold_dir. Files are copied without holding cs_main, and only switched over if no undo
+ * data was written to them meanwhile. Throws boost::thread_interrupted when interrupted.
+ */
+void MigrateColdBlockFiles() LOCKS_EXCLUDED(cs_main);
+
 /** (try to) add transaction to memory pool
  * plTxnReplaced will be appended to with all transactions replaced from mempool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, TxValidationState &state, const CTransactionRef &tx,
                         std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept=false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** Maximum number of transactions in a package */
+static const unsigned int MAX_PACKAGE_COUNT = 25;
+/** Maximum total virtual size of a package, in kilobytes */
+static const unsigned int MAX_PACKAGE_SIZE = 101;
+
+/**
+ * (try to) add a package of transactions to memory pool together.
+ * The package must be sorted so that parents come before their children, and
+ * transactions in it may depend on each other. Instead of each transaction's
+ * own feerate, the feerate of the package (those of its transactions which
+ * are not in the mempool yet) must meet the minimum, so a child can pay for
+ * its parents. Packages with mempool conflicts are rejected. nAbsurdFee
+ * applies to the package's total fee. If a transaction fails, failed_txid is
+ * set to its hash and nothing is added; it is left null for failures of the
+ * package as a whole.
+ **/
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, TxValidationState& state, const std::vector<CTransactionRef>& package,
+                               uint256& failed_txid, const CAmount nAbsurdFee) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Get the BIP9 state for a given deployment at the current tip. */
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos);
 
@@ -315,10 +536,12 @@ bool TestLockPointValidity(const LockPoints* lp) EXCLUSIVE_LOCKS_REQUIRED(cs_mai
  * of the block needed for calculation or skips the calculation and uses the LockPoints
  * passed in for evaluation.
  * The LockPoints should not be considered valid if CheckSequenceLocks returns false.
+ * The inputs are looked up in coins_view if given, or else in the mempool and
+ * the UTXO set.
  *
  * See consensus/consensus.h for flag definitions.
  */
-bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp = nullptr, bool useExistingLockPoints = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+bool CheckSequenceLocks(const CTxMemPool& pool, const CTransaction& tx, int flags, LockPoints* lp = nullptr, bool useExistingLockPoints = false, const CCoinsView* coins_view = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /**
  * Closure representing one script verification
@@ -365,6 +588,21 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 
+/** Serialized block borrowed from a memory mapped block file. */
+struct MappedBlockData {
+    //! Keeps the mapping alive while data is in use
+    std::shared_ptr<const MappedFile> file;
+    Span<const uint8_t> data;
+};
+
+/**
+ * Get the serialized block at pos directly from a mapping of its block file,
+ * without copying. Returns false if -blockmmap is off or the block is not in a
+ * finalized file; callers should then fall back to ReadRawBlockFromDisk.
+ */
+bool ReadMappedBlockFromDisk(MappedBlockData& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
+bool ReadMappedBlockFromDisk(MappedBlockData& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
 /** Functions for validating blocks and updating the block tree */
@@ -396,14 +634,54 @@ class CVerifyDB {
 public:
     CVerifyDB();
     ~CVerifyDB();
+    /** Verify the last nCheckDepth blocks. Only levels 3 and 4 hold cs_main for the whole check. */
     bool VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth);
+
+private:
+    bool VerifyBlocks(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth);
 };
 
+/** Run VerifyDB on the coins tip once the node is started (-asynccheckblocks), shutting it down if it fails */
+void ThreadVerifyDB(const CChainParams& chainparams, int nCheckLevel, int nCheckDepth);
+
 CBlockIndex* LookupBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * Reader-writer lock over the shape of the header tree: the entries of
+ * BlockIndex(), the blocks of the active chain and the transaction counts
+ * of block index entries. Everything changing those holds cs_main and
+ * takes this exclusively for the change itself, so code holding cs_main
+ * needs nothing more. Code that only serves headers can instead take it
+ * shared, and read those and the fields entries never change after
+ * insertion (the header, height, chain work, pprev) without waiting for
+ * block connection; other fields (nStatus, nFile, ...) still need cs_main.
+ *
+ * Lock order: cs_main before g_block_index_mutex. Never wait for cs_main
+ * while holding it.
+ */
+extern boost::shared_mutex g_block_index_mutex;
+
+/** LookupBlockIndex for callers holding g_block_index_mutex rather than cs_main */
+CBlockIndex* LookupBlockIndexShared(const uint256& hash);
+
+/** FindForkInGlobalIndex on the active chain, for callers holding g_block_index_mutex rather than cs_main */
+CBlockIndex* FindForkInActiveChainShared(const CBlockLocator& locator);
+
+/** Size of a header in a headers message: the header and a zero transaction count */
+static constexpr size_t HEADERS_RECORD_SIZE = CBlockHeader::SERIALIZED_SIZE + 1;
+
+/**
+ * The headers of up to count blocks of the active chain from the given
+ * height on, serialized back to back as in a headers message. They are kept
+ * serialized as the tip moves, so replying to getheaders is a copy rather
+ * than building and serializing a CBlock per header. The caller holds
+ * g_block_index_mutex, which the returned span is only valid under.
+ */
+Span<const unsigned char> GetActiveChainHeaders(int height, int count);
+
 enum DisconnectResult
 {
     DISCONNECT_OK,      // All good.
@@ -412,6 +690,7 @@ enum DisconnectResult
 };
 
 class ConnectTrace;
+struct ScriptCheckPipeline;
 
 /** @see CChainState::FlushStateToDisk */
 enum class FlushStateMode {
@@ -433,7 +712,44 @@ struct CBlockIndexWorkComparator
  * This data is used mostly in `CChainState` - information about, e.g.,
  * candidate tips is not maintained here.
  */
+/**
+ * Chunked storage for the block index entries of a BlockManager. Entries are
+ * allocated CHUNK_SIZE at a time and only freed together, so pointers to them
+ * stay valid, and entries created one after another (headers arriving in
+ * height order, or the index laid out again by LoadBlockIndex) sit next to each
+ * other in memory for pprev and skip list walks.
+ */
+class BlockIndexArena
+{
+    static constexpr size_t CHUNK_SIZE = 4096;
+    std::vector<std::unique_ptr<CBlockIndex[]>> m_chunks;
+    size_t m_chunk_used{CHUNK_SIZE};
+
+public:
+    /** Allocate a new entry holding a copy of index. */
+    CBlockIndex* Emplace(const CBlockIndex& index)
+    {
+        if (m_chunk_used == CHUNK_SIZE) {
+            m_chunks.emplace_back(new CBlockIndex[CHUNK_SIZE]);
+            m_chunk_used = 0;
+        }
+        CBlockIndex* entry = &m_chunks.back()[m_chunk_used++];
+        *entry = index;
+        return entry;
+    }
+
+    /** Free all entries. */
+    void Clear()
+    {
+        m_chunks.clear();
+        m_chunk_used = CHUNK_SIZE;
+    }
+};
+
 class BlockManager {
+    /** Owns the entries of m_block_index. */
+    BlockIndexArena m_block_arena GUARDED_BY(cs_main);
+
 public:
     BlockMap m_block_index GUARDED_BY(cs_main);
 
@@ -463,6 +779,14 @@ public:
      */
     std::multimap<CBlockIndex*, CBlockIndex*> m_blocks_unlinked;
 
+    /**
+     * The entries of m_block_index without children: the tips of the active
+     * chain and of every fork. Every entry is an ancestor of one, so the
+     * descendants of a block, or the blocks with more work than it, are found
+     * by walking back from the leaves rather than over all of m_block_index.
+     */
+    std::set<CBlockIndex*> m_leaves;
+
     /**
      * Load the blocktree off disk and into memory. Populate certain metadata
      * per index entry (nStatus, nChainWork, nTimeMax, etc.) as well as peripheral
@@ -484,15 +808,34 @@ public:
     /** Create a new block index entry for a given block hash */
     CBlockIndex* InsertBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Build m_block_index from the block index image, if there is one that
+     * was written with the block tree database as it is now, adding the
+     * entries to sorted_by_height in height order. The image only matches
+     * until the database changes, so its generation is erased from the
+     * database first.
+     */
+    bool LoadBlockIndexImage(CBlockTreeDB& blocktree, std::vector<std::pair<int, CBlockIndex*>>& sorted_by_height) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    /**
+     * Call fn once for every entry with at least as much work as pindex, by
+     * CBlockIndexWorkComparator, walking back from m_leaves. If fn returns
+     * false, the ancestors of the entry are not walked to from it.
+     */
+    void ForEachBlockWithMoreWork(const CBlockIndex* pindex, const std::function<bool(CBlockIndex*)>& fn) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to m_block_index.
+     * If known_hash is set, it must be the header's hash and is used instead of
+     * hashing the header again.
      */
     bool AcceptBlockHeader(
         const CBlockHeader& block,
         BlockValidationState& state,
         const CChainParams& chainparams,
-        CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+        CBlockIndex** ppindex,
+        const uint256* known_hash = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
 /**
@@ -514,6 +857,10 @@ public:
     //! This view wraps access to the leveldb instance and handles read errors gracefully.
     CCoinsViewErrorCatcher m_catcherview GUARDED_BY(cs_main);
 
+    //! This view optionally writes flushed coins to m_dbview in the background, serving them
+    //! from memory until the write is done.
+    CCoinsViewBackgroundFlush m_flushview GUARDED_BY(cs_main);
+
     //! This is the top layer of the cache hierarchy - it keeps as many coins in memory as
     //! can fit per the dbcache setting.
     std::unique_ptr<CCoinsViewCache> m_cacheview GUARDED_BY(cs_main);
@@ -696,9 +1043,16 @@ public:
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const FlatFilePos* dbp, bool* fNewBlock) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Block (dis)connection on a given view:
-    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
+    //! With use_reorg_cache, the undo data are taken from the reorg cache if it has them.
+    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, bool use_reorg_cache = false);
+    /**
+     * With a pipeline, the block's script checks are added to it instead of
+     * being waited for, and the block is not marked BLOCK_VALID_SCRIPTS: the
+     * caller does that once the pipeline's checks have passed.
+     */
     bool ConnectBlock(const CBlock& block, BlockValidationState& state, CBlockIndex* pindex,
-                      CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+                      CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false,
+                      ScriptCheckPipeline* pipeline = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Apply the effects of a block disconnection on the UTXO set.
     bool DisconnectTip(BlockValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions* disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
@@ -743,7 +1097,10 @@ public:
 
 private:
     bool ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
+    //! Load the inputs of block that are not cached yet into CoinsTip(), reading them in parallel.
+    void PrefetchInputs(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     bool ConnectTip(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
+    bool ConnectTipsPipelined(BlockValidationState& state, const CChainParams& chainparams, const std::vector<CBlockIndex*>& blocks, const std::shared_ptr<const CBlock>& pblock_last, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
 
     void InvalidBlockFound(CBlockIndex *pindex, const BlockValidationState &state) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     CBlockIndex* FindMostWorkChain() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -753,6 +1110,9 @@ private:
 
     //! Mark a block as not having block data
     void EraseBlockData(CBlockIndex* index) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    //! Copy the coins cache figures out for GetCoinsCacheStats().
+    void PublishCoinsCacheStats() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
 /** Mark a block as precious and reorganize.
@@ -777,6 +1137,9 @@ CChain& ChainActive();
 /** @returns the global block index map. */
 BlockMap& BlockIndex();
 
+/** Create a new entry for a given block hash in the global block index map. */
+CBlockIndex* InsertBlockIndex(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 // Most often ::ChainstateActive() should be used instead of this, but some code
 // may not be able to assume that this has been initialized yet and so must use it
 // directly, e.g. init.cpp.
@@ -794,6 +1157,9 @@ int GetSpendHeight(const CCoinsViewCache& inputs);
 
 extern VersionBitsCache versionbitscache;
 
+/** Versionbits state of a deployment for a block building on pindexPrev, memoized on pindexPrev. */
+ThresholdState VersionBitsStateAfter(const CBlockIndex* pindexPrev, const Consensus::Params& params, Consensus::DeploymentPos pos) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /**
  * Determine what nVersion a new block should use.
  */
@@ -808,6 +1174,12 @@ bool DumpMempool(const CTxMemPool& pool);
 /** Load the mempool from disk. */
 bool LoadMempool(CTxMemPool& pool);
 
+/** Dump the signature and script execution caches to disk. */
+bool DumpSignatureCaches();
+
+/** Load the signature and script execution caches from disk. Must run before any validation. */
+bool LoadSignatureCaches();
+
 //! Check whether the block associated with this index entry is pruned or not.
 inline bool IsBlockPruned(const CBlockIndex* pblockindex)
 {
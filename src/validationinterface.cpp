@@ -11,8 +11,13 @@
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <scheduler.h>
+#include <util/memory.h>
+#include <util/time.h>
 
+#include <algorithm>
+#include <atomic>
 #include <future>
+#include <map>
 #include <unordered_map>
 #include <utility>
 
@@ -22,31 +27,87 @@
 //! A std::unordered_map is used to track what callbacks are currently
 //! registered, and a std::list is to used to store the callbacks that are
 //! currently registered as well as any callbacks that are just unregistered
-//! and about to be deleted when they are done executing.
+//! and about to be deleted when they are done executing or no longer have
+//! background callbacks queued for them.
+//!
+//! Background callbacks run on one queue per subscriber name, so that
+//! subscribers on different queues make progress independently. Queues are
+//! kept until the instance is destroyed, as the scheduler holds pointers to
+//! them, and there are only a handful of names.
 struct MainSignalsInstance {
 private:
     Mutex m_mutex;
+    //! A background queue. The counters are guarded by m_mutex.
+    struct Queue {
+        SingleThreadedSchedulerClient client;
+        size_t subscribers = 0;
+        uint64_t processed = 0;
+        int64_t total_latency = 0;
+        int64_t max_latency = 0;
+        Queue(CScheduler* scheduler, const std::string& name) : client(scheduler, "validation:" + name) {}
+    };
     //! List entries consist of a callback pointer and reference count. The
-    //! count is equal to the number of current executions of that entry, plus 1
-    //! if it's registered. It cannot be 0 because that would imply it is
-    //! unregistered and also not being executed (so shouldn't exist).
-    struct ListEntry { std::shared_ptr<CValidationInterface> callbacks; int count = 1; };
+    //! count is equal to the number of current executions and queued
+    //! background callbacks of that entry, plus 1 if it's registered. It
+    //! cannot be 0 because that would imply it is unregistered and also not
+    //! being executed (so shouldn't exist).
+    struct ListEntry { std::shared_ptr<CValidationInterface> callbacks; int count = 1; bool registered = true; Queue* queue = nullptr; };
     std::list<ListEntry> m_list GUARDED_BY(m_mutex);
     std::unordered_map<CValidationInterface*, std::list<ListEntry>::iterator> m_map GUARDED_BY(m_mutex);
+    std::map<std::string, std::unique_ptr<Queue>> m_queues GUARDED_BY(m_mutex);
+    CScheduler* const m_scheduler;
 
-public:
-    // We are not allowed to assume the scheduler only runs in one thread,
-    // but must ensure all callbacks happen in-order, so we end up creating
-    // our own queue here :(
-    SingleThreadedSchedulerClient m_schedulerClient;
+    Queue* GetQueue(const std::string& name) EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        auto& queue = m_queues[name];
+        if (!queue) queue = MakeUnique<Queue>(m_scheduler, name);
+        return queue.get();
+    }
+
+    void Release(std::list<ListEntry>::iterator it) EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        if (!--it->count) m_list.erase(it);
+    }
+
+    void Unregister(std::list<ListEntry>::iterator it) EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        it->registered = false;
+        --it->queue->subscribers;
+        Release(it);
+    }
+
+    void Run(std::list<ListEntry>::iterator it, const std::function<void(CValidationInterface&)>& f, int64_t enqueued) LOCKS_EXCLUDED(m_mutex)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        Queue& queue = *it->queue;
+        const int64_t latency = GetTimeMicros() - enqueued;
+        ++queue.processed;
+        queue.total_latency += latency;
+        queue.max_latency = std::max(queue.max_latency, latency);
+        if (it->registered) {
+            REVERSE_LOCK(lock);
+            f(*it->callbacks);
+        }
+        Release(it);
+    }
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+public:
+    explicit MainSignalsInstance(CScheduler *pscheduler) : m_scheduler(pscheduler)
+    {
+        LOCK(m_mutex);
+        GetQueue("default");
+    }
 
     void Register(std::shared_ptr<CValidationInterface> callbacks)
     {
+        const std::string queue_name = callbacks->GetValidationQueueName();
         LOCK(m_mutex);
         auto inserted = m_map.emplace(callbacks.get(), m_list.end());
-        if (inserted.second) inserted.first->second = m_list.emplace(m_list.end());
+        if (inserted.second) {
+            inserted.first->second = m_list.emplace(m_list.end());
+            inserted.first->second->queue = GetQueue(queue_name);
+            ++inserted.first->second->queue->subscribers;
+        }
         inserted.first->second->callbacks = std::move(callbacks);
     }
 
@@ -55,20 +116,20 @@ public:
         LOCK(m_mutex);
         auto it = m_map.find(callbacks);
         if (it != m_map.end()) {
-            if (!--it->second->count) m_list.erase(it->second);
+            Unregister(it->second);
             m_map.erase(it);
         }
     }
 
     //! Clear unregisters every previously registered callback, erasing every
     //! map entry. After this call, the list may still contain callbacks that
-    //! are currently executing, but it will be cleared when they are done
-    //! executing.
+    //! are currently executing or queued, but it will be cleared when they
+    //! are done.
     void Clear()
     {
         LOCK(m_mutex);
         for (const auto& entry : m_map) {
-            if (!--entry.second->count) m_list.erase(entry.second);
+            Unregister(entry.second);
         }
         m_map.clear();
     }
@@ -77,6 +138,10 @@ public:
     {
         WAIT_LOCK(m_mutex, lock);
         for (auto it = m_list.begin(); it != m_list.end();) {
+            if (!it->registered) {
+                ++it;
+                continue;
+            }
             ++it->count;
             {
                 REVERSE_LOCK(lock);
@@ -85,6 +150,69 @@ public:
             it = --it->count ? std::next(it) : m_list.erase(it);
         }
     }
+
+    //! Queue f for every registered subscriber, on the subscriber's queue.
+    void Enqueue(std::function<void(CValidationInterface&)> f)
+    {
+        LOCK(m_mutex);
+        const int64_t now = GetTimeMicros();
+        for (auto it = m_list.begin(); it != m_list.end(); ++it) {
+            if (!it->registered) continue;
+            ++it->count;
+            it->queue->client.AddToProcessQueue([this, it, f, now] { Run(it, f, now); });
+        }
+    }
+
+    //! Call func once every queue has run the callbacks queued before it.
+    void CallAfterQueued(std::function<void()> func)
+    {
+        LOCK(m_mutex);
+        auto remaining = std::make_shared<std::atomic<size_t>>(m_queues.size());
+        auto shared_func = std::make_shared<std::function<void()>>(std::move(func));
+        for (const auto& queue : m_queues) {
+            queue.second->client.AddToProcessQueue([remaining, shared_func] {
+                if (--*remaining == 0) (*shared_func)();
+            });
+        }
+    }
+
+    void EmptyQueues()
+    {
+        // Callbacks don't queue further callbacks, so one pass is enough.
+        std::vector<Queue*> queues;
+        {
+            LOCK(m_mutex);
+            for (const auto& queue : m_queues) queues.push_back(queue.second.get());
+        }
+        for (Queue* queue : queues) queue->client.EmptyQueue();
+    }
+
+    size_t CallbacksPending()
+    {
+        LOCK(m_mutex);
+        size_t pending = 0;
+        for (const auto& queue : m_queues) {
+            pending = std::max(pending, queue.second->client.CallbacksPending());
+        }
+        return pending;
+    }
+
+    std::vector<ValidationQueueStats> GetQueueStats()
+    {
+        LOCK(m_mutex);
+        std::vector<ValidationQueueStats> ret;
+        for (const auto& queue : m_queues) {
+            ValidationQueueStats stats;
+            stats.name = queue.first;
+            stats.subscribers = queue.second->subscribers;
+            stats.pending = queue.second->client.CallbacksPending();
+            stats.processed = queue.second->processed;
+            stats.total_latency = queue.second->total_latency;
+            stats.max_latency = queue.second->max_latency;
+            ret.push_back(std::move(stats));
+        }
+        return ret;
+    }
 };
 
 static CMainSignals g_signals;
@@ -100,13 +228,18 @@ void CMainSignals::UnregisterBackgroundSignalScheduler() {
 
 void CMainSignals::FlushBackgroundCallbacks() {
     if (m_internals) {
-        m_internals->m_schedulerClient.EmptyQueue();
+        m_internals->EmptyQueues();
     }
 }
 
 size_t CMainSignals::CallbacksPending() {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    return m_internals->CallbacksPending();
+}
+
+std::vector<ValidationQueueStats> CMainSignals::GetQueueStats() {
+    if (!m_internals) return {};
+    return m_internals->GetQueueStats();
 }
 
 CMainSignals& GetMainSignals()
@@ -146,7 +279,7 @@ void UnregisterAllValidationInterfaces() {
 }
 
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func) {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    g_signals.m_internals->CallAfterQueued(std::move(func));
 }
 
 void SyncWithValidationInterfaceQueue() {
@@ -163,14 +296,15 @@ void SyncWithValidationInterfaceQueue() {
 // evaluating arguments when logging is not enabled.
 //
 // NOTE: The lambda captures all local variables by value.
-#define ENQUEUE_AND_LOG_EVENT(event, fmt, name, ...)           \
-    do {                                                       \
-        auto local_name = (name);                              \
-        LOG_EVENT("Enqueuing " fmt, local_name, __VA_ARGS__);  \
-        m_internals->m_schedulerClient.AddToProcessQueue([=] { \
-            LOG_EVENT(fmt, local_name, __VA_ARGS__);           \
-            event();                                           \
-        });                                                    \
+#define ENQUEUE_AND_LOG_EVENT(event, fmt, name, ...)                                  \
+    do {                                                                              \
+        auto local_name = (name);                                                     \
+        LOG_EVENT("Enqueuing " fmt, local_name, __VA_ARGS__);                         \
+        m_internals->Enqueue([=](CValidationInterface& callbacks) {                   \
+            LOG_EVENT(fmt " (queue %s)", local_name, __VA_ARGS__,                     \
+                      callbacks.GetValidationQueueName());                            \
+            event(callbacks);                                                         \
+        });                                                                           \
     } while (0)
 
 #define LOG_EVENT(fmt, ...) \
@@ -181,8 +315,8 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
     // the chain actually updates. One way to ensure this is for the caller to invoke this signal
     // in the same critical section where the chain is updated
 
-    auto event = [pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload); });
+    auto event = [pindexNew, pindexFork, fInitialDownload](CValidationInterface& callbacks) {
+        callbacks.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: new block hash=%s fork block hash=%s (in IBD=%s)", __func__,
                           pindexNew->GetBlockHash().ToString(),
@@ -190,18 +324,18 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
                           fInitialDownload);
 }
 
-void CMainSignals::TransactionAddedToMempool(const CTransactionRef& tx) {
-    auto event = [tx, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.TransactionAddedToMempool(tx); });
+void CMainSignals::TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) {
+    auto event = [tx, mempool_sequence](CValidationInterface& callbacks) {
+        callbacks.TransactionAddedToMempool(tx, mempool_sequence);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: txid=%s wtxid=%s", __func__,
                           tx->GetHash().ToString(),
                           tx->GetWitnessHash().ToString());
 }
 
-void CMainSignals::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason) {
-    auto event = [tx, reason, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.TransactionRemovedFromMempool(tx, reason); });
+void CMainSignals::TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) {
+    auto event = [tx, reason, mempool_sequence](CValidationInterface& callbacks) {
+        callbacks.TransactionRemovedFromMempool(tx, reason, mempool_sequence);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: txid=%s wtxid=%s", __func__,
                           tx->GetHash().ToString(),
@@ -209,8 +343,8 @@ void CMainSignals::TransactionRemovedFromMempool(const CTransactionRef& tx, MemP
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex) {
-    auto event = [pblock, pindex, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.BlockConnected(pblock, pindex); });
+    auto event = [pblock, pindex](CValidationInterface& callbacks) {
+        callbacks.BlockConnected(pblock, pindex);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s block height=%d", __func__,
                           pblock->GetHash().ToString(),
@@ -219,8 +353,8 @@ void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, c
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex)
 {
-    auto event = [pblock, pindex, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.BlockDisconnected(pblock, pindex); });
+    auto event = [pblock, pindex](CValidationInterface& callbacks) {
+        callbacks.BlockDisconnected(pblock, pindex);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s block height=%d", __func__,
                           pblock->GetHash().ToString(),
@@ -228,8 +362,8 @@ void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock
 }
 
 void CMainSignals::ChainStateFlushed(const CBlockLocator &locator) {
-    auto event = [locator, this] {
-        m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.ChainStateFlushed(locator); });
+    auto event = [locator](CValidationInterface& callbacks) {
+        callbacks.ChainStateFlushed(locator);
     };
     ENQUEUE_AND_LOG_EVENT(event, "%s: block hash=%s", __func__,
                           locator.IsNull() ? "null" : locator.vHave.front().ToString());
@@ -245,3 +379,8 @@ void CMainSignals::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared
     LOG_EVENT("%s: block hash=%s", __func__, block->GetHash().ToString());
     m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.NewPoWValidBlock(pindex, block); });
 }
+
+void CMainSignals::BlockProcessed(const std::shared_ptr<const CBlock>& block) {
+    LOG_EVENT("%s: block hash=%s", __func__, block->GetHash().ToString());
+    m_internals->Iterate([&](CValidationInterface& callbacks) { callbacks.BlockProcessed(block); });
+}
@@ -11,6 +11,8 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 extern RecursiveMutex cs_main;
 class BlockValidationState;
@@ -74,8 +76,16 @@ void SyncWithValidationInterfaceQueue() LOCKS_EXCLUDED(cs_main);
  * the BlockConnected() callback without worrying about explicit
  * synchronization. No ordering should be assumed across
  * ValidationInterface() subscribers.
+ *
+ * Background callbacks run on per-subscriber queues, named by
+ * GetValidationQueueName(), so that a slow subscriber only delays the
+ * subscribers sharing its queue.
  */
 class CValidationInterface {
+public:
+    /** Name of the queue this subscriber's background callbacks run on. Subscribers with the same name share a queue. */
+    virtual std::string GetValidationQueueName() const { return "default"; }
+
 protected:
     /**
      * Protected destructor so that instances can only be deleted by derived classes.
@@ -94,10 +104,12 @@ protected:
     virtual void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) {}
     /**
      * Notifies listeners of a transaction having been added to mempool.
+     * mempool_sequence is the mempool sequence number of the addition (see
+     * CTxMemPool::GetSequence()).
      *
      * Called on a background thread.
      */
-    virtual void TransactionAddedToMempool(const CTransactionRef& tx) {}
+    virtual void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) {}
     /**
      * Notifies listeners of a transaction leaving mempool.
      *
@@ -128,9 +140,11 @@ protected:
      * - BlockConnected(A)
      * - BlockConnected(B)
      *
+     * mempool_sequence is the mempool sequence number of the removal.
+     *
      * Called on a background thread.
      */
-    virtual void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason) {}
+    virtual void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) {}
     /**
      * Notifies listeners of a block being connected.
      * Provides a vector of transactions evicted from the mempool as a result.
@@ -172,9 +186,31 @@ protected:
      * Notifies listeners that a block which builds directly on our current tip
      * has been received and connected to the headers tree, though not validated yet */
     virtual void NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) {};
+    /**
+     * Notifies listeners that the block validation thread has finished the
+     * ActivateBestChain call for a block passed to QueueBlockActivation,
+     * whether or not the block was connected.
+     *
+     * Called on the block validation thread.
+     */
+    virtual void BlockProcessed(const std::shared_ptr<const CBlock>& block) {}
     friend class CMainSignals;
 };
 
+/** Statistics of one background notification queue, see CMainSignals::GetQueueStats(). */
+struct ValidationQueueStats {
+    std::string name;
+    //! Number of registered subscribers using the queue
+    size_t subscribers{0};
+    //! Number of callbacks waiting to run
+    size_t pending{0};
+    //! Number of callbacks run so far
+    uint64_t processed{0};
+    //! Sum and maximum of the time callbacks waited in the queue, in microseconds
+    int64_t total_latency{0};
+    int64_t max_latency{0};
+};
+
 struct MainSignalsInstance;
 class CMainSignals {
 private:
@@ -193,17 +229,20 @@ public:
     /** Call any remaining callbacks on the calling thread */
     void FlushBackgroundCallbacks();
 
+    /** Number of callbacks waiting to run on the most backlogged queue */
     size_t CallbacksPending();
-
+    /** Statistics of every background notification queue */
+    std::vector<ValidationQueueStats> GetQueueStats();
 
     void UpdatedBlockTip(const CBlockIndex *, const CBlockIndex *, bool fInitialDownload);
-    void TransactionAddedToMempool(const CTransactionRef&);
-    void TransactionRemovedFromMempool(const CTransactionRef&, MemPoolRemovalReason);
+    void TransactionAddedToMempool(const CTransactionRef&, uint64_t mempool_sequence);
+    void TransactionRemovedFromMempool(const CTransactionRef&, MemPoolRemovalReason, uint64_t mempool_sequence);
     void BlockConnected(const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex);
     void BlockDisconnected(const std::shared_ptr<const CBlock> &, const CBlockIndex* pindex);
     void ChainStateFlushed(const CBlockLocator &);
     void BlockChecked(const CBlock&, const BlockValidationState&);
     void NewPoWValidBlock(const CBlockIndex *, const std::shared_ptr<const CBlock>&);
+    void BlockProcessed(const std::shared_ptr<const CBlock>&);
 };
 
 CMainSignals& GetMainSignals();
@@ -46,7 +46,8 @@ struct {
  *
  * @param const std::vector<CInputCoin>& utxo_pool The set of UTXOs that we are choosing from.
  *        These UTXOs will be sorted in descending order by effective value and the CInputCoins'
- *        values are their effective values.
+ *        values are their effective values. Those worth more than the upper bound of the range
+ *        on their own are removed.
  * @param const CAmount& target_value This is the value that we want to select. It is the lower
  *        bound of the range.
  * @param const CAmount& cost_of_change This is the cost of creating and spending a change output.
@@ -81,8 +82,27 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
         return false;
     }
 
-    // Sort the utxo_pool
-    std::sort(utxo_pool.begin(), utxo_pool.end(), descending);
+    // Sort the utxo_pool, unless it comes sorted already, as it does from
+    // SelectCoinsMinConf when all inputs have the same size
+    if (!std::is_sorted(utxo_pool.begin(), utxo_pool.end(), descending)) {
+        std::sort(utxo_pool.begin(), utxo_pool.end(), descending);
+    }
+
+    // Any selection including a utxo worth more than the upper bound of the
+    // range is out of range, so drop them instead of exploring each of their
+    // inclusion branches.
+    auto in_range = std::partition_point(utxo_pool.begin(), utxo_pool.end(), [&](const OutputGroup& utxo) {
+        return utxo.effective_value > actual_target + cost_of_change;
+    });
+    if (in_range != utxo_pool.begin()) {
+        for (auto it = utxo_pool.begin(); it != in_range; ++it) {
+            curr_available_value -= it->effective_value;
+        }
+        utxo_pool.erase(utxo_pool.begin(), in_range);
+        if (utxo_pool.empty() || curr_available_value < actual_target) {
+            return false;
+        }
+    }
 
     CAmount curr_waste = 0;
     std::vector<bool> best_selection;
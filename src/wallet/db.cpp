@@ -4,10 +4,18 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/palladium-config.h>
+#endif
+
 #include <wallet/db.h>
 
 #include <util/strencodings.h>
 #include <util/translation.h>
+#include <wallet/walletutil.h>
+#ifdef USE_SQLITE
+#include <wallet/sqlite.h>
+#endif
 
 #include <stdint.h>
 
@@ -75,6 +83,9 @@ bool IsWalletLoaded(const fs::path& wallet_path)
     fs::path env_directory;
     std::string database_filename;
     SplitWalletPath(wallet_path, env_directory, database_filename);
+#ifdef USE_SQLITE
+    if (IsSQLiteDatabaseLoaded(env_directory / database_filename)) return true;
+#endif
     LOCK(cs_db);
     auto env = g_dbenvs.find(env_directory.string());
     if (env == g_dbenvs.end()) return false;
@@ -90,6 +101,13 @@ fs::path WalletDataFilePath(const fs::path& wallet_path)
     return env_directory / database_filename;
 }
 
+bool IsSQLiteWallet(const fs::path& wallet_path)
+{
+    const fs::path data_file = WalletDataFilePath(wallet_path);
+    if (fs::exists(data_file)) return IsSQLiteFile(data_file);
+    return gArgs.GetArg("-walletformat", DEFAULT_WALLET_FORMAT) == "sqlite";
+}
+
 /**
  * @param[in] wallet_path Path to wallet directory. Or (for backwards compatibility only) a path to a berkeley btree data file inside a wallet directory.
  * @param[out] database_filename Filename of berkeley btree data file inside the wallet directory.
@@ -120,6 +138,7 @@ void BerkeleyEnvironment::Close()
     if (!fDbEnvInit)
         return;
 
+    StopFlushThread();
     fDbEnvInit = false;
 
     for (auto& db : m_databases) {
@@ -235,9 +254,85 @@ bool BerkeleyEnvironment::Open(bool retry)
 
     fDbEnvInit = true;
     fMockDb = false;
+    {
+        LOCK(m_flush_mutex);
+        m_flush_running = true;
+        m_flush_stop = false;
+    }
+    m_flush_thread = std::thread(&TraceThread<std::function<void()>>, "walletflush", std::function<void()>(std::bind(&BerkeleyEnvironment::FlushThread, this)));
     return true;
 }
 
+void BerkeleyEnvironment::FlushThread()
+{
+    WAIT_LOCK(m_flush_mutex, lock);
+    while (true) {
+        m_flush_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_flush_mutex) {
+            return m_flush_stop || m_checkpoint_pending || m_sync_requested != m_sync_done;
+        });
+        const uint64_t sync_target = m_sync_requested;
+        const bool sync = sync_target != m_sync_done;
+        const bool checkpoint = m_checkpoint_pending;
+        const bool force = m_checkpoint_force;
+        m_checkpoint_pending = m_checkpoint_force = false;
+        // Serve the syncs still waiting before stopping
+        if (m_flush_stop && !sync) break;
+
+        bool ok = true;
+        {
+            REVERSE_LOCK(lock);
+            if (sync) ok = dbenv->log_flush(nullptr) == 0;
+            if (checkpoint) {
+                dbenv->txn_checkpoint(force ? 0 : gArgs.GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024, force ? 0 : 1, 0);
+            }
+        }
+        if (sync) {
+            m_sync_done = sync_target;
+            m_sync_ok = ok;
+            m_flush_cv.notify_all();
+        }
+    }
+}
+
+void BerkeleyEnvironment::StopFlushThread()
+{
+    if (!m_flush_thread.joinable()) return;
+    {
+        LOCK(m_flush_mutex);
+        m_flush_running = false;
+        m_flush_stop = true;
+    }
+    m_flush_cv.notify_all();
+    m_flush_thread.join();
+}
+
+void BerkeleyEnvironment::RequestCheckpoint(bool force)
+{
+    {
+        LOCK(m_flush_mutex);
+        if (m_flush_running) {
+            m_checkpoint_pending = true;
+            m_checkpoint_force |= force;
+            m_flush_cv.notify_all();
+            return;
+        }
+    }
+    if (fMockDb) {
+        dbenv->txn_checkpoint(force ? 0 : gArgs.GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024, force ? 0 : 1, 0);
+    }
+}
+
+bool BerkeleyEnvironment::SyncLog()
+{
+    WAIT_LOCK(m_flush_mutex, lock);
+    // Mock environments keep their log in memory, and closed ones were checkpointed first
+    if (!m_flush_running) return true;
+    const uint64_t ticket = ++m_sync_requested;
+    m_flush_cv.notify_all();
+    m_flush_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_flush_mutex) { return m_sync_done >= ticket; });
+    return m_sync_ok;
+}
+
 //! Construct an in-memory mock Berkeley environment for testing
 BerkeleyEnvironment::BerkeleyEnvironment()
 {
@@ -514,7 +609,7 @@ void BerkeleyEnvironment::CheckpointLSN(const std::string& strFile)
 }
 
 
-BerkeleyBatch::BerkeleyBatch(BerkeleyDatabase& database, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr)
+BerkeleyBatch::BerkeleyBatch(BerkeleyDatabase& database, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr), m_cursor(nullptr)
 {
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
     fFlushOnClose = fFlushOnCloseIn;
@@ -598,25 +693,17 @@ void BerkeleyBatch::Flush()
     if (activeTxn)
         return;
 
-    // Flush database activity from memory pool to disk log
-    unsigned int nMinutes = 0;
-    if (fReadOnly)
-        nMinutes = 1;
-
+    // Flush database activity from memory pool to disk log, unconditionally after writes
     if (env) { // env is nullptr for dummy databases (i.e. in tests). Don't actually flush if env is nullptr so we don't segfault
-        env->dbenv->txn_checkpoint(nMinutes ? gArgs.GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024 : 0, nMinutes, 0);
+        env->RequestCheckpoint(!fReadOnly);
     }
 }
 
-void BerkeleyDatabase::IncrementUpdateCounter()
-{
-    ++nUpdateCounter;
-}
-
 void BerkeleyBatch::Close()
 {
     if (!pdb)
         return;
+    CloseCursor();
     if (activeTxn)
         activeTxn->abort();
     activeTxn = nullptr;
@@ -707,17 +794,17 @@ bool BerkeleyBatch::Rewrite(BerkeleyDatabase& database, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
-                    if (pcursor)
+                    if (db.StartCursor())
                         while (fSuccess) {
                             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
                             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-                            int ret1 = db.ReadAtCursor(pcursor, ssKey, ssValue);
-                            if (ret1 == DB_NOTFOUND) {
-                                pcursor->close();
+                            bool complete;
+                            bool ret1 = db.ReadAtCursor(ssKey, ssValue, complete);
+                            if (complete) {
+                                db.CloseCursor();
                                 break;
-                            } else if (ret1 != 0) {
-                                pcursor->close();
+                            } else if (!ret1) {
+                                db.CloseCursor();
                                 fSuccess = false;
                                 break;
                             }
@@ -851,6 +938,31 @@ bool BerkeleyDatabase::Rewrite(const char* pszSkip)
     return BerkeleyBatch::Rewrite(*this, pszSkip);
 }
 
+bool BerkeleyDatabase::PeriodicFlush()
+{
+    if (!IsDummy() && !env->IsMock()) {
+        // Leave the database open and checkpoint it in the background, rather than closing
+        // it to detach the data file from the log while batches wait for cs_db. The data
+        // file is still made self contained when the wallet is flushed on unload or shutdown.
+        env->RequestCheckpoint(true);
+        return true;
+    }
+    return BerkeleyBatch::PeriodicFlush(*this);
+}
+
+bool BerkeleyDatabase::Sync()
+{
+    if (IsDummy()) {
+        return true;
+    }
+    return env->SyncLog();
+}
+
+std::unique_ptr<DatabaseBatch> BerkeleyDatabase::MakeBatch(const char* mode, bool flush_on_close)
+{
+    return MakeUnique<BerkeleyBatch>(*this, mode, flush_on_close);
+}
+
 bool BerkeleyDatabase::Backup(const std::string& strDest) const
 {
     if (IsDummy()) {
@@ -917,3 +1029,151 @@ void BerkeleyDatabase::ReloadDbEnv()
         env->ReloadDbEnv();
     }
 }
+
+bool BerkeleyBatch::StartCursor()
+{
+    assert(!m_cursor);
+    if (!pdb)
+        return false;
+    int ret = pdb->cursor(nullptr, &m_cursor, 0);
+    return ret == 0;
+}
+
+bool BerkeleyBatch::ReadAtCursor(CDataStream& ssKey, CDataStream& ssValue, bool& complete)
+{
+    complete = false;
+    if (m_cursor == nullptr) return false;
+    // Read at cursor
+    SafeDbt datKey;
+    SafeDbt datValue;
+    int ret = m_cursor->get(datKey, datValue, DB_NEXT);
+    if (ret == DB_NOTFOUND) {
+        complete = true;
+    }
+    if (ret != 0)
+        return false;
+    else if (datKey.get_data() == nullptr || datValue.get_data() == nullptr)
+        return false;
+
+    // Convert to streams
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    ssKey.write((char*)datKey.get_data(), datKey.get_size());
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    ssValue.write((char*)datValue.get_data(), datValue.get_size());
+    return true;
+}
+
+void BerkeleyBatch::CloseCursor()
+{
+    if (!m_cursor) return;
+    m_cursor->close();
+    m_cursor = nullptr;
+}
+
+bool BerkeleyBatch::TxnBegin()
+{
+    if (!pdb || activeTxn)
+        return false;
+    DbTxn* ptxn = env->TxnBegin();
+    if (!ptxn)
+        return false;
+    activeTxn = ptxn;
+    return true;
+}
+
+bool BerkeleyBatch::TxnCommit()
+{
+    if (!pdb || !activeTxn)
+        return false;
+    int ret = activeTxn->commit(0);
+    activeTxn = nullptr;
+    return (ret == 0);
+}
+
+bool BerkeleyBatch::TxnAbort()
+{
+    if (!pdb || !activeTxn)
+        return false;
+    int ret = activeTxn->abort();
+    activeTxn = nullptr;
+    return (ret == 0);
+}
+
+bool BerkeleyBatch::ReadKey(CDataStream&& key, CDataStream& value)
+{
+    if (!pdb)
+        return false;
+
+    SafeDbt datKey(key.data(), key.size());
+
+    SafeDbt datValue;
+    int ret = pdb->get(activeTxn, datKey, datValue, 0);
+    if (ret == 0 && datValue.get_data() != nullptr) {
+        value.write((char*)datValue.get_data(), datValue.get_size());
+        return true;
+    }
+    return false;
+}
+
+bool BerkeleyBatch::WriteKey(CDataStream&& key, CDataStream&& value, bool overwrite)
+{
+    if (!pdb)
+        return true;
+    if (fReadOnly)
+        assert(!"Write called on database in read-only mode");
+
+    SafeDbt datKey(key.data(), key.size());
+
+    SafeDbt datValue(value.data(), value.size());
+
+    int ret = pdb->put(activeTxn, datKey, datValue, (overwrite ? 0 : DB_NOOVERWRITE));
+    return (ret == 0);
+}
+
+bool BerkeleyBatch::EraseKey(CDataStream&& key)
+{
+    if (!pdb)
+        return false;
+    if (fReadOnly)
+        assert(!"Erase called on database in read-only mode");
+
+    SafeDbt datKey(key.data(), key.size());
+
+    int ret = pdb->del(activeTxn, datKey, 0);
+    return (ret == 0 || ret == DB_NOTFOUND);
+}
+
+bool BerkeleyBatch::HasKey(CDataStream&& key)
+{
+    if (!pdb)
+        return false;
+
+    SafeDbt datKey(key.data(), key.size());
+
+    int ret = pdb->exists(activeTxn, datKey, 0);
+    return ret == 0;
+}
+
+std::unique_ptr<WalletDatabase> WalletDatabase::Create(const fs::path& path)
+{
+#ifdef USE_SQLITE
+    if (IsSQLiteWallet(path)) {
+        const fs::path data_file = WalletDataFilePath(path);
+        return MakeUnique<SQLiteDatabase>(data_file.parent_path(), data_file);
+    }
+#endif
+    std::string filename;
+    return MakeUnique<BerkeleyDatabase>(GetWalletEnv(path, filename), std::move(filename));
+}
+
+std::unique_ptr<WalletDatabase> WalletDatabase::CreateDummy()
+{
+    return MakeUnique<BerkeleyDatabase>();
+}
+
+std::unique_ptr<WalletDatabase> WalletDatabase::CreateMock()
+{
+    return MakeUnique<BerkeleyDatabase>(std::make_shared<BerkeleyEnvironment>(), "");
+}
@@ -3,6 +3,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/palladium-config.h>
+#endif
+
 #include <init.h>
 #include <interfaces/chain.h>
 #include <net.h>
@@ -13,6 +17,7 @@
 #include <util/system.h>
 #include <util/translation.h>
 #include <wallet/coincontrol.h>
+#include <wallet/db.h>
 #include <wallet/wallet.h>
 #include <walletinitinterface.h>
 
@@ -61,10 +66,18 @@ void WalletInit::AddWalletOptions() const
     gArgs.AddArg("-wallet=<path>", "Specify wallet database path. Can be specified multiple times to load multiple wallets. Path is interpreted relative to <walletdir> if it is not absolute, and will be created if it does not exist (as a directory containing a wallet.dat file and log files). For backwards compatibility this will also accept names of existing data files in <walletdir>.)", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::WALLET);
     gArgs.AddArg("-walletbroadcast",  strprintf("Make the wallet broadcast transactions (default: %u)", DEFAULT_WALLETBROADCAST), ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
     gArgs.AddArg("-walletdir=<dir>", "Specify directory to hold wallets (default: <datadir>/wallets if it exists, otherwise <datadir>)", ArgsManager::ALLOW_ANY | ArgsManager::NETWORK_ONLY, OptionsCategory::WALLET);
+#ifdef USE_SQLITE
+    gArgs.AddArg("-walletformat=<format>", strprintf("Database format of wallets created without an existing data file, \"bdb\" or \"sqlite\". Existing wallets keep their format (default: %s)", DEFAULT_WALLET_FORMAT), ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
+#else
+    gArgs.AddHiddenArgs({"-walletformat=<format>"});
+#endif
+    gArgs.AddArg("-walletlazytxcache=<n>", strprintf("Keep only unspent and recent transactions of each wallet in memory, reading older spent ones from the database when they are needed and caching up to <n> of them (default: %u, keep all transactions in memory)", DEFAULT_WALLET_LAZY_TX_CACHE), ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
 #if HAVE_SYSTEM
     gArgs.AddArg("-walletnotify=<cmd>", "Execute command when a wallet transaction changes. %s in cmd is replaced by TxID and %w is replaced by wallet name. %w is not currently implemented on windows. On systems where %w is supported, it should NOT be quoted because this would break shell escaping used to invoke the command.", ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
 #endif
+    gArgs.AddArg("-walletunlocksample=<n>", strprintf("Check only <n> randomly chosen keys when an encrypted wallet is first unlocked, verifying the others when they are first used (default: %u, check every key)", DEFAULT_WALLET_UNLOCK_SAMPLE), ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
     gArgs.AddArg("-walletrbf", strprintf("Send transactions with full-RBF opt-in enabled (RPC only, default: %u)", DEFAULT_WALLET_RBF), ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
+    gArgs.AddArg("-walletrouting", strprintf("Deliver block and mempool transactions to the loaded wallets through one shared index of their scripts and transactions, so that each wallet only processes the transactions involving it (default: %u)", DEFAULT_WALLET_ROUTING), ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
     gArgs.AddArg("-zapwallettxes=<mode>", "Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup"
                                " (1 = keep tx meta data e.g. payment request information, 2 = drop tx meta data)", ArgsManager::ALLOW_ANY, OptionsCategory::WALLET);
 
@@ -122,6 +135,16 @@ bool WalletInit::ParameterInteraction() const
         }
     }
 
+    const std::string wallet_format = gArgs.GetArg("-walletformat", DEFAULT_WALLET_FORMAT);
+    if (wallet_format != "bdb" && wallet_format != "sqlite") {
+        return InitError(strprintf("Unknown -walletformat '%s'", wallet_format));
+    }
+#ifndef USE_SQLITE
+    if (wallet_format == "sqlite") {
+        return InitError("-walletformat=sqlite is not available, palladium was compiled without SQLite support");
+    }
+#endif
+
     if (gArgs.GetBoolArg("-sysperms", false))
         return InitError("-sysperms is not allowed in combination with enabled wallet functionality");
 
@@ -91,9 +91,10 @@ void StartWallets(CScheduler& scheduler)
         pwallet->postInitProcess();
     }
 
-    // Schedule periodic wallet flushes and tx rebroadcasts
-    scheduler.scheduleEvery(MaybeCompactWalletDB, std::chrono::milliseconds{500});
-    scheduler.scheduleEvery(MaybeResendWalletTxs, std::chrono::milliseconds{1000});
+    // Schedule periodic wallet flushes, tx rebroadcasts and paging out of old txs
+    scheduler.scheduleEvery(MaybeCompactWalletDB, std::chrono::milliseconds{500}, "walletcompact");
+    scheduler.scheduleEvery(MaybeResendWalletTxs, std::chrono::milliseconds{1000}, "walletresend");
+    scheduler.scheduleEvery(MaybePageOutWalletTxs, std::chrono::minutes{1}, "walletpageout");
 }
 
 void FlushWallets()
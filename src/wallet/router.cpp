@@ -0,0 +1,289 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/router.h>
+
+#include <crypto/siphash.h>
+#include <interfaces/chain.h>
+#include <interfaces/handler.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <sync.h>
+#include <wallet/wallet.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/signals2/connection.hpp>
+
+namespace {
+
+class WalletRouter : public interfaces::Chain::Notifications, public std::enable_shared_from_this<WalletRouter>
+{
+public:
+    void Register(interfaces::Chain& chain, const std::shared_ptr<CWallet>& wallet);
+    void Unregister(const CWallet* wallet);
+
+    void transactionAddedToMempool(const CTransactionRef& tx) override;
+    void transactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason) override;
+    void blockConnected(const CBlock& block, int height) override;
+    void blockDisconnected(const CBlock& block, int height) override;
+    void updatedBlockTip() override;
+    void chainStateFlushed(const CBlockLocator& locator) override;
+
+private:
+    //! Wallets by salted hashes of scripts or txids. A collision only routes a transaction to a wallet in vain.
+    typedef std::unordered_multimap<uint64_t, CWallet*> WalletMap;
+
+    struct Registration {
+        std::shared_ptr<CWallet> wallet;
+        std::vector<boost::signals2::connection> connections;
+    };
+
+    uint64_t ScriptKey(const CScript& script) const
+    {
+        return CSipHasher(m_k0, m_k1).Write(script.data(), script.size()).Finalize();
+    }
+    uint64_t TxidKey(const uint256& txid) const { return SipHashUint256(m_k0, m_k1, txid); }
+
+    static void Add(WalletMap& map, uint64_t key, CWallet* wallet);
+    static void Find(const WalletMap& map, uint64_t key, std::vector<CWallet*>& wallets);
+    void AddScript(CWallet* wallet, const CScript& script);
+    void AddTxids(CWallet* wallet, const std::vector<uint256>& txids);
+
+    //! The wallets tx pays to, spends from or conflicts with, also looking up its inputs in block_txids if given
+    std::vector<CWallet*> Route(const CTransaction& tx, const WalletMap* block_txids) const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    //! The indexes of the transactions of a block routed to each wallet
+    std::map<CWallet*, std::vector<size_t>> RouteBlock(const CBlock& block) const;
+    std::vector<std::shared_ptr<CWallet>> GetWallets() const;
+
+    const uint64_t m_k0{GetRand(std::numeric_limits<uint64_t>::max())};
+    const uint64_t m_k1{GetRand(std::numeric_limits<uint64_t>::max())};
+
+    mutable Mutex m_mutex;
+    std::vector<Registration> m_registrations GUARDED_BY(m_mutex);
+    WalletMap m_scripts GUARDED_BY(m_mutex);
+    WalletMap m_txids GUARDED_BY(m_mutex);
+    std::unique_ptr<interfaces::Handler> m_handler GUARDED_BY(m_mutex);
+};
+
+void WalletRouter::Add(WalletMap& map, uint64_t key, CWallet* wallet)
+{
+    const auto range = map.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == wallet) return;
+    }
+    map.emplace(key, wallet);
+}
+
+void WalletRouter::Find(const WalletMap& map, uint64_t key, std::vector<CWallet*>& wallets)
+{
+    const auto range = map.equal_range(key);
+    for (auto it = range.first; it != range.second; ++it) {
+        wallets.push_back(it->second);
+    }
+}
+
+void WalletRouter::AddScript(CWallet* wallet, const CScript& script)
+{
+    const uint64_t key = ScriptKey(script);
+    LOCK(m_mutex);
+    Add(m_scripts, key, wallet);
+}
+
+void WalletRouter::AddTxids(CWallet* wallet, const std::vector<uint256>& txids)
+{
+    LOCK(m_mutex);
+    for (const uint256& txid : txids) {
+        Add(m_txids, TxidKey(txid), wallet);
+    }
+}
+
+void WalletRouter::Register(interfaces::Chain& chain, const std::shared_ptr<CWallet>& wallet)
+{
+    CWallet* const pwallet = wallet.get();
+    Registration registration{wallet, {}};
+
+    // Connect first, so that nothing added while the current state is copied is missed
+    for (ScriptPubKeyMan* spk_man : pwallet->GetAllScriptPubKeyMans()) {
+        registration.connections.push_back(spk_man->NotifyScriptPubKeyAdded.connect([this, pwallet](const CScript& script) {
+            AddScript(pwallet, script);
+        }));
+    }
+    registration.connections.push_back(pwallet->NotifyTransactionChanged.connect([this](CWallet* wallet, const uint256& hash, ChangeType status) {
+        if (status != CT_NEW) return;
+        std::vector<uint256> txids{hash};
+        {
+            LOCK(wallet->cs_wallet);
+            const CWalletTx* wtx = wallet->GetWalletTx(hash);
+            if (!wtx) return;
+            for (const CTxIn& txin : wtx->tx->vin) {
+                txids.push_back(txin.prevout.hash);
+            }
+        }
+        AddTxids(wallet, txids);
+    }));
+
+    for (ScriptPubKeyMan* spk_man : pwallet->GetAllScriptPubKeyMans()) {
+        for (const CScript& script : spk_man->GetCandidateScriptPubKeys()) {
+            AddScript(pwallet, script);
+        }
+    }
+    std::vector<uint256> txids;
+    {
+        LOCK(pwallet->cs_wallet);
+        txids = pwallet->GetRoutingTxids();
+    }
+    AddTxids(pwallet, txids);
+
+    LOCK(m_mutex);
+    m_registrations.push_back(std::move(registration));
+    if (!m_handler) m_handler = chain.handleNotifications(shared_from_this());
+}
+
+void WalletRouter::Unregister(const CWallet* wallet)
+{
+    std::vector<boost::signals2::connection> connections;
+    std::unique_ptr<interfaces::Handler> handler;
+    {
+        LOCK(m_mutex);
+        auto it = std::find_if(m_registrations.begin(), m_registrations.end(), [&](const Registration& registration) {
+            return registration.wallet.get() == wallet;
+        });
+        if (it == m_registrations.end()) return;
+        connections = std::move(it->connections);
+        m_registrations.erase(it);
+        for (WalletMap* map : {&m_scripts, &m_txids}) {
+            for (auto entry = map->begin(); entry != map->end();) {
+                entry = entry->second == wallet ? map->erase(entry) : std::next(entry);
+            }
+        }
+        if (m_registrations.empty()) handler = std::move(m_handler);
+    }
+    for (boost::signals2::connection& connection : connections) {
+        connection.disconnect();
+    }
+    if (handler) handler->disconnect();
+}
+
+std::vector<CWallet*> WalletRouter::Route(const CTransaction& tx, const WalletMap* block_txids) const
+{
+    AssertLockHeld(m_mutex);
+    std::vector<CWallet*> wallets;
+    for (const CTxOut& txout : tx.vout) {
+        Find(m_scripts, ScriptKey(txout.scriptPubKey), wallets);
+    }
+    // Already in a wallet, or spending from or in conflict with a wallet transaction
+    Find(m_txids, TxidKey(tx.GetHash()), wallets);
+    for (const CTxIn& txin : tx.vin) {
+        const uint64_t key = TxidKey(txin.prevout.hash);
+        Find(m_txids, key, wallets);
+        if (block_txids) Find(*block_txids, key, wallets);
+    }
+    std::sort(wallets.begin(), wallets.end());
+    wallets.erase(std::unique(wallets.begin(), wallets.end()), wallets.end());
+    return wallets;
+}
+
+std::map<CWallet*, std::vector<size_t>> WalletRouter::RouteBlock(const CBlock& block) const
+{
+    std::map<CWallet*, std::vector<size_t>> routed;
+    // Transactions routed earlier in the block, which the wallets have not added yet
+    WalletMap block_txids;
+    LOCK(m_mutex);
+    for (size_t index = 0; index < block.vtx.size(); ++index) {
+        const CTransaction& tx = *block.vtx[index];
+        for (CWallet* wallet : Route(tx, &block_txids)) {
+            routed[wallet].push_back(index);
+            block_txids.emplace(TxidKey(tx.GetHash()), wallet);
+        }
+    }
+    return routed;
+}
+
+std::vector<std::shared_ptr<CWallet>> WalletRouter::GetWallets() const
+{
+    LOCK(m_mutex);
+    std::vector<std::shared_ptr<CWallet>> wallets;
+    for (const Registration& registration : m_registrations) {
+        wallets.push_back(registration.wallet);
+    }
+    return wallets;
+}
+
+void WalletRouter::transactionAddedToMempool(const CTransactionRef& tx)
+{
+    const std::vector<std::shared_ptr<CWallet>> wallets = GetWallets();
+    std::vector<CWallet*> routed;
+    {
+        LOCK(m_mutex);
+        routed = Route(*tx, nullptr);
+    }
+    for (const auto& wallet : wallets) {
+        if (std::binary_search(routed.begin(), routed.end(), wallet.get())) wallet->transactionAddedToMempool(tx);
+    }
+}
+
+void WalletRouter::transactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason)
+{
+    const std::vector<std::shared_ptr<CWallet>> wallets = GetWallets();
+    std::vector<CWallet*> routed;
+    {
+        LOCK(m_mutex);
+        routed = Route(*tx, nullptr);
+    }
+    for (const auto& wallet : wallets) {
+        if (std::binary_search(routed.begin(), routed.end(), wallet.get())) wallet->transactionRemovedFromMempool(tx, reason);
+    }
+}
+
+void WalletRouter::blockConnected(const CBlock& block, int height)
+{
+    const std::vector<std::shared_ptr<CWallet>> wallets = GetWallets();
+    const auto routed = RouteBlock(block);
+    const std::vector<size_t> none;
+    // Every wallet keeps track of the last block processed
+    for (const auto& wallet : wallets) {
+        const auto it = routed.find(wallet.get());
+        wallet->blockConnected(block, height, it == routed.end() ? none : it->second);
+    }
+}
+
+void WalletRouter::blockDisconnected(const CBlock& block, int height)
+{
+    const std::vector<std::shared_ptr<CWallet>> wallets = GetWallets();
+    const auto routed = RouteBlock(block);
+    const std::vector<size_t> none;
+    for (const auto& wallet : wallets) {
+        const auto it = routed.find(wallet.get());
+        wallet->blockDisconnected(block, height, it == routed.end() ? none : it->second);
+    }
+}
+
+void WalletRouter::updatedBlockTip()
+{
+    for (const auto& wallet : GetWallets()) {
+        wallet->updatedBlockTip();
+    }
+}
+
+void WalletRouter::chainStateFlushed(const CBlockLocator& locator)
+{
+    for (const auto& wallet : GetWallets()) {
+        wallet->chainStateFlushed(locator);
+    }
+}
+
+} // namespace
+
+std::unique_ptr<interfaces::Handler> HandleRoutedNotifications(interfaces::Chain& chain, const std::shared_ptr<CWallet>& wallet)
+{
+    static const std::shared_ptr<WalletRouter> router = std::make_shared<WalletRouter>();
+    router->Register(chain, wallet);
+    const CWallet* const pwallet = wallet.get();
+    return interfaces::MakeHandler([pwallet] { router->Unregister(pwallet); });
+}
@@ -0,0 +1,35 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_WALLET_ROUTER_H
+#define PALLADIUM_WALLET_ROUTER_H
+
+#include <memory>
+
+class CWallet;
+
+namespace interfaces {
+class Chain;
+class Handler;
+} // namespace interfaces
+
+/**
+ * Register a wallet for chain notifications through a router shared by all
+ * wallets registered this way (-walletrouting), instead of for the
+ * notifications of its own.
+ *
+ * The router keeps the candidate scriptPubKeys of every wallet (see
+ * ScriptPubKeyMan::GetCandidateScriptPubKeys), the txids of their
+ * transactions and the txids those spend, and only passes a wallet the
+ * transactions of a block or the mempool that pay to one of its scripts or
+ * spend from or conflict with one of its transactions. With many wallets
+ * loaded, connecting a block then costs a lookup per transaction plus the
+ * work of the wallets the transactions involve, rather than every wallet
+ * checking every transaction.
+ *
+ * Disconnecting the returned handler unregisters the wallet.
+ */
+std::unique_ptr<interfaces::Handler> HandleRoutedNotifications(interfaces::Chain& chain, const std::shared_ptr<CWallet>& wallet);
+
+#endif // PALLADIUM_WALLET_ROUTER_H
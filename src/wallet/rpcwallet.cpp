@@ -17,6 +17,7 @@
 #include <rpc/util.h>
 #include <script/descriptor.h>
 #include <script/sign.h>
+#include <streams.h>
 #include <util/bip32.h>
 #include <util/fees.h>
 #include <util/message.h> // For MessageSign()
@@ -625,17 +626,16 @@ static UniValue getreceivedbyaddress(const JSONRPCRequest& request)
 
     // Tally
     CAmount nAmount = 0;
-    for (const std::pair<const uint256, CWalletTx>& pairWtx : pwallet->mapWallet) {
-        const CWalletTx& wtx = pairWtx.second;
+    pwallet->ForEachWalletTx([&](const CWalletTx& wtx) {
         if (wtx.IsCoinBase() || !locked_chain->checkFinalTx(*wtx.tx)) {
-            continue;
+            return;
         }
 
         for (const CTxOut& txout : wtx.tx->vout)
             if (txout.scriptPubKey == scriptPubKey)
                 if (wtx.GetDepthInMainChain() >= nMinDepth)
                     nAmount += txout.nValue;
-    }
+    });
 
     return  ValueFromAmount(nAmount);
 }
@@ -689,10 +689,9 @@ static UniValue getreceivedbylabel(const JSONRPCRequest& request)
 
     // Tally
     CAmount nAmount = 0;
-    for (const std::pair<const uint256, CWalletTx>& pairWtx : pwallet->mapWallet) {
-        const CWalletTx& wtx = pairWtx.second;
+    pwallet->ForEachWalletTx([&](const CWalletTx& wtx) {
         if (wtx.IsCoinBase() || !locked_chain->checkFinalTx(*wtx.tx)) {
-            continue;
+            return;
         }
 
         for (const CTxOut& txout : wtx.tx->vout)
@@ -703,7 +702,7 @@ static UniValue getreceivedbylabel(const JSONRPCRequest& request)
                     nAmount += txout.nValue;
             }
         }
-    }
+    });
 
     return ValueFromAmount(nAmount);
 }
@@ -929,6 +928,144 @@ static UniValue sendmany(const JSONRPCRequest& request)
     return tx->GetHash().GetHex();
 }
 
+//! Default number of payments sendbatch puts in each transaction
+static const unsigned int DEFAULT_SENDBATCH_MAX_OUTPUTS = 500;
+
+static UniValue sendbatch(const JSONRPCRequest& request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    CWallet* const pwallet = wallet.get();
+
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+    RPCHelpMan{"sendbatch",
+                "\nSend a batch of payments, split into as many transactions as needed. The available coins\n"
+                "are listed once for the whole batch and the transactions are stored in a single wallet database write.\n"
+                "Either all transactions are created and broadcast, or none is." +
+        HELP_REQUIRING_PASSPHRASE,
+                {
+                    {"payments", RPCArg::Type::ARR, RPCArg::Optional::NO, "The payments, an address may be paid more than once",
+                        {
+                            {"", RPCArg::Type::OBJ, RPCArg::Optional::OMITTED, "",
+                                {
+                                    {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "The palladium address to send to"},
+                                    {"amount", RPCArg::Type::AMOUNT, RPCArg::Optional::NO, "The amount in " + CURRENCY_UNIT + " to send"},
+                                },
+                            },
+                        },
+                    },
+                    {"max_outputs", RPCArg::Type::NUM, /* default */ strprintf("%u", DEFAULT_SENDBATCH_MAX_OUTPUTS), "The maximum number of payments in each transaction"},
+                    {"comment", RPCArg::Type::STR, RPCArg::Optional::OMITTED_NAMED_ARG, "A comment stored with each of the transactions"},
+                    {"replaceable", RPCArg::Type::BOOL, /* default */ "wallet default", "Allow the transactions to be replaced by transactions with higher fees via BIP 125"},
+                    {"conf_target", RPCArg::Type::NUM, /* default */ "wallet default", "Confirmation target (in blocks)"},
+                    {"estimate_mode", RPCArg::Type::STR, /* default */ "UNSET", "The fee estimate mode, must be one of:\n"
+            "       \"UNSET\"\n"
+            "       \"ECONOMICAL\"\n"
+            "       \"CONSERVATIVE\""},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "The transaction ids, in the order the payments were split",
+                    {
+                        {RPCResult::Type::STR_HEX, "txid", "The transaction id"},
+                    }
+                },
+                RPCExamples{
+            "\nSend two payments in one transaction:\n"
+            + HelpExampleCli("sendbatch", "\"[{\\\"address\\\":\\\"" + EXAMPLE_ADDRESS[0] + "\\\",\\\"amount\\\":0.01},{\\\"address\\\":\\\"" + EXAMPLE_ADDRESS[1] + "\\\",\\\"amount\\\":0.02}]\"") +
+            "\nSend them in a transaction each:\n"
+            + HelpExampleCli("sendbatch", "\"[{\\\"address\\\":\\\"" + EXAMPLE_ADDRESS[0] + "\\\",\\\"amount\\\":0.01},{\\\"address\\\":\\\"" + EXAMPLE_ADDRESS[1] + "\\\",\\\"amount\\\":0.02}]\" 1") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("sendbatch", "[{\"address\":\"" + EXAMPLE_ADDRESS[0] + "\",\"amount\":0.01},{\"address\":\"" + EXAMPLE_ADDRESS[1] + "\",\"amount\":0.02}], 500")
+                },
+    }.Check(request);
+
+    // Make sure the results are valid at least up to the most recent block
+    // the user could have gotten from another RPC command prior to now
+    pwallet->BlockUntilSyncedToCurrentChain();
+
+    auto locked_chain = pwallet->chain().lock();
+    LOCK(pwallet->cs_wallet);
+
+    const UniValue& payments = request.params[0].get_array();
+    if (payments.empty()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, payments must not be empty");
+    }
+
+    int max_outputs = DEFAULT_SENDBATCH_MAX_OUTPUTS;
+    if (!request.params[1].isNull()) {
+        max_outputs = request.params[1].get_int();
+        if (max_outputs <= 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, max_outputs must be positive");
+        }
+    }
+
+    mapValue_t mapValue;
+    if (!request.params[2].isNull() && !request.params[2].get_str().empty())
+        mapValue["comment"] = request.params[2].get_str();
+
+    CCoinControl coin_control;
+    if (!request.params[3].isNull()) {
+        coin_control.m_signal_bip125_rbf = request.params[3].get_bool();
+    }
+
+    if (!request.params[4].isNull()) {
+        coin_control.m_confirm_target = ParseConfirmTarget(request.params[4], pwallet->chain().estimateMaxBlocks());
+    }
+
+    if (!request.params[5].isNull()) {
+        if (!FeeModeFromString(request.params[5].get_str(), coin_control.m_fee_mode)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid estimate_mode parameter");
+        }
+    }
+
+    std::vector<CRecipient> recipients;
+    for (unsigned int idx = 0; idx < payments.size(); idx++) {
+        const UniValue& payment = payments[idx].get_obj();
+        RPCTypeCheckObj(payment,
+            {
+                {"address", UniValueType(UniValue::VSTR)},
+                {"amount", UniValueType()}, // will be checked below
+            });
+
+        const std::string& address = find_value(payment, "address").get_str();
+        CTxDestination dest = DecodeDestination(address);
+        if (!IsValidDestination(dest)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string("Invalid Palladium address: ") + address);
+        }
+
+        CAmount nAmount = AmountFromValue(find_value(payment, "amount"));
+        if (nAmount <= 0)
+            throw JSONRPCError(RPC_TYPE_ERROR, "Invalid amount for send");
+
+        recipients.push_back({GetScriptForDestination(dest), nAmount, false /* fSubtractFeeFromAmount */});
+    }
+
+    EnsureWalletIsUnlocked(pwallet);
+
+    // Shuffle the payments, then split them into transactions
+    std::shuffle(recipients.begin(), recipients.end(), FastRandomContext());
+    std::vector<std::vector<CRecipient>> vecSends;
+    for (size_t i = 0; i < recipients.size(); i += max_outputs) {
+        vecSends.emplace_back(recipients.begin() + i, recipients.begin() + std::min(recipients.size(), i + max_outputs));
+    }
+
+    // Send
+    std::string strFailReason;
+    std::vector<CTransactionRef> txs;
+    if (!pwallet->CreateTransactions(*locked_chain, vecSends, txs, strFailReason, coin_control)) {
+        throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, strFailReason);
+    }
+    pwallet->CommitTransactions(txs, mapValue);
+
+    UniValue result(UniValue::VARR);
+    for (const CTransactionRef& tx : txs) {
+        result.push_back(tx->GetHash().GetHex());
+    }
+    return result;
+}
+
 static UniValue addmultisigaddress(const JSONRPCRequest& request)
 {
     std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
@@ -1055,16 +1192,14 @@ static UniValue ListReceived(interfaces::Chain::Lock& locked_chain, const CWalle
 
     // Tally
     std::map<CTxDestination, tallyitem> mapTally;
-    for (const std::pair<const uint256, CWalletTx>& pairWtx : pwallet->mapWallet) {
-        const CWalletTx& wtx = pairWtx.second;
-
+    pwallet->ForEachWalletTx([&](const CWalletTx& wtx) {
         if (wtx.IsCoinBase() || !locked_chain.checkFinalTx(*wtx.tx)) {
-            continue;
+            return;
         }
 
         int nDepth = wtx.GetDepthInMainChain();
         if (nDepth < nMinDepth)
-            continue;
+            return;
 
         for (const CTxOut& txout : wtx.tx->vout)
         {
@@ -1087,7 +1222,7 @@ static UniValue ListReceived(interfaces::Chain::Lock& locked_chain, const CWalle
             if (mine & ISMINE_WATCH_ONLY)
                 item.fIsWatchonly = true;
         }
-    }
+    });
 
     // Reply
     UniValue ret(UniValue::VARR);
@@ -1386,6 +1521,48 @@ static const std::vector<RPCResult> TransactionDescriptionString()
                "may be unknown for unconfirmed transactions not in the mempool"}};
 }
 
+/**
+ * Where listtransactions continues: at the transaction with order position
+ * order_pos, after the first entries of it ListTransactions returns. Cursors
+ * are passed around hex encoded, so that callers treat them as opaque.
+ */
+struct TxListCursor {
+    int64_t order_pos;
+    uint32_t entries;
+
+    TxListCursor(int64_t order_pos_in = std::numeric_limits<int64_t>::max(), uint32_t entries_in = 0) : order_pos(order_pos_in), entries(entries_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(order_pos);
+        READWRITE(entries);
+    }
+};
+
+static std::string EncodeTxListCursor(const TxListCursor& cursor)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cursor;
+    return HexStr(stream.begin(), stream.end());
+}
+
+static TxListCursor DecodeTxListCursor(const std::string& str)
+{
+    TxListCursor cursor;
+    if (str.empty()) return cursor;
+    if (!IsHex(str)) throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    CDataStream stream(ParseHex(str), SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        stream >> cursor;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    if (!stream.empty()) throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    return cursor;
+}
+
 UniValue listtransactions(const JSONRPCRequest& request)
 {
     std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
@@ -1397,15 +1574,20 @@ UniValue listtransactions(const JSONRPCRequest& request)
 
             RPCHelpMan{"listtransactions",
                 "\nIf a label name is provided, this will return only incoming transactions paying to addresses with the specified label.\n"
-                "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions.\n",
+                "\nReturns up to 'count' most recent transactions skipping the first 'from' transactions.\n"
+                "\nIf a cursor is given, an object is returned instead, with the next_cursor to pass to list the\n"
+                "older transactions. Paging with cursors only visits the transactions on each page, whereas 'skip'\n"
+                "visits all the skipped ones.\n",
                 {
                     {"label", RPCArg::Type::STR, RPCArg::Optional::OMITTED_NAMED_ARG, "If set, should be a valid label name to return only incoming transactions\n"
             "              with the specified label, or \"*\" to disable filtering and return all transactions."},
                     {"count", RPCArg::Type::NUM, /* default */ "10", "The number of transactions to return"},
                     {"skip", RPCArg::Type::NUM, /* default */ "0", "The number of transactions to skip"},
                     {"include_watchonly", RPCArg::Type::BOOL, /* default */ "true for watch-only wallets, otherwise false", "Include transactions to watch-only addresses (see 'importaddress')"},
+                    {"cursor", RPCArg::Type::STR, RPCArg::Optional::OMITTED_NAMED_ARG, "The next_cursor of a previous call to continue after its transactions, or \"\" to start with the most recent ones"},
                 },
-                RPCResult{
+                {
+                    RPCResult{"without cursor",
                     RPCResult::Type::ARR, "", "",
                     {
                         {RPCResult::Type::OBJ, "", "", Cat(Cat<std::vector<RPCResult>>(
@@ -1430,13 +1612,24 @@ UniValue listtransactions(const JSONRPCRequest& request)
                             {RPCResult::Type::BOOL, "abandoned", "'true' if the transaction has been abandoned (inputs are respendable). Only available for the \n"
                                  "'send' category of transactions."},
                         })},
-                    }
+                    }},
+                    RPCResult{"with cursor",
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::ARR, "transactions", "The transactions, as without cursor",
+                        {
+                            {RPCResult::Type::ELISION, "", ""},
+                        }},
+                        {RPCResult::Type::STR, "next_cursor", /* optional */ true, "Cursor to list the older transactions, if there may be any"},
+                    }},
                 },
                 RPCExamples{
             "\nList the most recent 10 transactions in the systems\n"
             + HelpExampleCli("listtransactions", "") +
             "\nList transactions 100 to 120\n"
             + HelpExampleCli("listtransactions", "\"*\" 20 100") +
+            "\nList the most recent 20 transactions and a cursor to list the 20 before them\n"
+            + HelpExampleCli("listtransactions", "\"*\" 20 0 false \"\"") +
             "\nAs a JSON-RPC call\n"
             + HelpExampleRpc("listtransactions", "\"*\", 20, 100")
                 },
@@ -1469,22 +1662,34 @@ UniValue listtransactions(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
     if (nFrom < 0)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative from");
+    const bool with_cursor = !request.params[4].isNull();
+    const TxListCursor cursor = with_cursor ? DecodeTxListCursor(request.params[4].get_str()) : TxListCursor{};
 
     UniValue ret(UniValue::VARR);
+    Optional<TxListCursor> next_cursor;
 
     {
         auto locked_chain = pwallet->chain().lock();
         LOCK(pwallet->cs_wallet);
 
-        const CWallet::TxItems & txOrdered = pwallet->wtxOrdered;
-
-        // iterate backwards until we have nCount items to return:
-        for (CWallet::TxItems::const_reverse_iterator it = txOrdered.rbegin(); it != txOrdered.rend(); ++it)
-        {
-            CWalletTx *const pwtx = (*it).second;
-            ListTransactions(*locked_chain, pwallet, *pwtx, 0, true, ret, filter, filter_label);
-            if ((int)ret.size() >= (nCount+nFrom)) break;
-        }
+        // iterate backwards from the cursor until we have nCount items to return
+        const size_t limit = (size_t)nCount + nFrom;
+        pwallet->ForEachOrderedTx(cursor.order_pos, filter_label, [&](const CWalletTx& wtx) {
+            if (ret.size() >= limit) {
+                next_cursor = TxListCursor{wtx.nOrderPos, 0};
+                return false;
+            }
+            UniValue entries(UniValue::VARR);
+            ListTransactions(*locked_chain, pwallet, wtx, 0, true, entries, filter, filter_label);
+            for (size_t i = wtx.nOrderPos == cursor.order_pos ? cursor.entries : 0; i < entries.size(); ++i) {
+                if (ret.size() >= limit) {
+                    next_cursor = TxListCursor{wtx.nOrderPos, (uint32_t)i};
+                    return false;
+                }
+                ret.push_back(entries[i]);
+            }
+            return true;
+        });
     }
 
     // ret is newest to oldest
@@ -1497,7 +1702,12 @@ UniValue listtransactions(const JSONRPCRequest& request)
     const std::vector<UniValue>& txs = ret.getValues();
     UniValue result{UniValue::VARR};
     result.push_backV({ txs.rend() - nFrom - nCount, txs.rend() - nFrom }); // Return oldest to newest
-    return result;
+    if (!with_cursor) return result;
+
+    UniValue page(UniValue::VOBJ);
+    page.pushKV("transactions", result);
+    if (next_cursor) page.pushKV("next_cursor", EncodeTxListCursor(*next_cursor));
+    return page;
 }
 
 static UniValue listsinceblock(const JSONRPCRequest& request)
@@ -1603,12 +1813,18 @@ static UniValue listsinceblock(const JSONRPCRequest& request)
 
     UniValue transactions(UniValue::VARR);
 
-    for (const std::pair<const uint256, CWalletTx>& pairWtx : pwallet->mapWallet) {
-        CWalletTx tx = pairWtx.second;
-
+    auto list_tx = [&](const CWalletTx& tx) {
         if (depth == -1 || abs(tx.GetDepthInMainChain()) < depth) {
             ListTransactions(*locked_chain, pwallet, tx, 0, true, transactions, filter, nullptr /* filter_label */);
         }
+    };
+    if (depth == -1 || depth > PAGE_OUT_MIN_DEPTH) {
+        pwallet->ForEachWalletTx(list_tx);
+    } else {
+        // Paged out transactions are too deep to be listed
+        for (const std::pair<const uint256, CWalletTx>& pairWtx : pwallet->mapWallet) {
+            list_tx(pairWtx.second);
+        }
     }
 
     // when a reorg'd block is requested, we also list any relevant transactions
@@ -1620,11 +1836,11 @@ static UniValue listsinceblock(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
         }
         for (const CTransactionRef& tx : block.vtx) {
-            auto it = pwallet->mapWallet.find(tx->GetHash());
-            if (it != pwallet->mapWallet.end()) {
+            const CWalletTx* wtx = pwallet->GetWalletTx(tx->GetHash());
+            if (wtx) {
                 // We want all transactions regardless of confirmation count to appear here,
                 // even negative confirmation ones, hence the big negative.
-                ListTransactions(*locked_chain, pwallet, it->second, -100000000, true, removed, filter, nullptr /* filter_label */);
+                ListTransactions(*locked_chain, pwallet, *wtx, -100000000, true, removed, filter, nullptr /* filter_label */);
             }
         }
         blockId = block.hashPrevBlock;
@@ -1723,11 +1939,11 @@ static UniValue gettransaction(const JSONRPCRequest& request)
     bool verbose = request.params[2].isNull() ? false : request.params[2].get_bool();
 
     UniValue entry(UniValue::VOBJ);
-    auto it = pwallet->mapWallet.find(hash);
-    if (it == pwallet->mapWallet.end()) {
+    const CWalletTx* pwtx = pwallet->GetWalletTx(hash);
+    if (!pwtx) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid or non-wallet transaction id");
     }
-    const CWalletTx& wtx = it->second;
+    const CWalletTx& wtx = *pwtx;
 
     CAmount nCredit = wtx.GetCredit(filter);
     CAmount nDebit = wtx.GetDebit(filter);
@@ -2487,7 +2703,7 @@ static UniValue getwalletinfo(const JSONRPCRequest& request)
     obj.pushKV("balance", ValueFromAmount(bal.m_mine_trusted));
     obj.pushKV("unconfirmed_balance", ValueFromAmount(bal.m_mine_untrusted_pending));
     obj.pushKV("immature_balance", ValueFromAmount(bal.m_mine_immature));
-    obj.pushKV("txcount",       (int)pwallet->mapWallet.size());
+    obj.pushKV("txcount",       (int)pwallet->GetTxCount());
     obj.pushKV("keypoololdest", pwallet->GetOldestKeyPoolTime());
     obj.pushKV("keypoolsize", (int64_t)kpExternalSize);
 
@@ -3613,13 +3829,14 @@ public:
     void ProcessSubScript(const CScript& subscript, UniValue& obj) const
     {
         // Always present: script type and redeemscript
-        std::vector<std::vector<unsigned char>> solutions_data;
-        txnouttype which_type = Solver(subscript, solutions_data);
+        const SolvedScript solved(subscript);
+        const std::vector<std::vector<unsigned char>>& solutions_data = solved.solutions;
+        const txnouttype which_type = solved.type;
         obj.pushKV("script", GetTxnOutputType(which_type));
         obj.pushKV("hex", HexStr(subscript.begin(), subscript.end()));
 
         CTxDestination embedded;
-        if (ExtractDestination(subscript, embedded)) {
+        if (ExtractDestination(solved, embedded)) {
             // Only when the script corresponds to an address.
             UniValue subobj(UniValue::VOBJ);
             UniValue detail = DescribeAddress(embedded);
@@ -3901,10 +4118,10 @@ static UniValue getaddressesbylabel(const JSONRPCRequest& request)
     // Find all addresses that have the given label
     UniValue ret(UniValue::VOBJ);
     std::set<std::string> addresses;
-    for (const std::pair<const CTxDestination, CAddressBookData>& item : pwallet->m_address_book) {
-        if (item.second.IsChange()) continue;
-        if (item.second.GetLabel() == label) {
-            std::string address = EncodeDestination(item.first);
+    const auto label_addresses = pwallet->m_label_addresses.find(label);
+    if (label_addresses != pwallet->m_label_addresses.end()) {
+        for (const CTxDestination& dest : label_addresses->second) {
+            std::string address = EncodeDestination(dest);
             // CWallet::m_address_book is not expected to contain duplicate
             // address strings, but build a separate set as a precaution just in
             // case it does.
@@ -3914,7 +4131,7 @@ static UniValue getaddressesbylabel(const JSONRPCRequest& request)
             // and since duplicate addresses are unexpected (checked with
             // std::set in O(log(N))), UniValue::__pushKV is used instead,
             // which currently is O(1).
-            ret.__pushKV(address, AddressBookDataToJSON(item.second, false));
+            ret.__pushKV(address, AddressBookDataToJSON(pwallet->m_address_book.at(dest), false));
         }
     }
 
@@ -4302,7 +4519,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "listreceivedbyaddress",            &listreceivedbyaddress,         {"minconf","include_empty","include_watchonly","address_filter"} },
     { "wallet",             "listreceivedbylabel",              &listreceivedbylabel,           {"minconf","include_empty","include_watchonly"} },
     { "wallet",             "listsinceblock",                   &listsinceblock,                {"blockhash","target_confirmations","include_watchonly","include_removed"} },
-    { "wallet",             "listtransactions",                 &listtransactions,              {"label|dummy","count","skip","include_watchonly"} },
+    { "wallet",             "listtransactions",                 &listtransactions,              {"label|dummy","count","skip","include_watchonly","cursor"} },
     { "wallet",             "listunspent",                      &listunspent,                   {"minconf","maxconf","addresses","include_unsafe","query_options"} },
     { "wallet",             "listwalletdir",                    &listwalletdir,                 {} },
     { "wallet",             "listwallets",                      &listwallets,                   {} },
@@ -4310,6 +4527,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "lockunspent",                      &lockunspent,                   {"unlock","transactions"} },
     { "wallet",             "removeprunedfunds",                &removeprunedfunds,             {"txid"} },
     { "wallet",             "rescanblockchain",                 &rescanblockchain,              {"start_height", "stop_height"} },
+    { "wallet",             "sendbatch",                        &sendbatch,                     {"payments","max_outputs","comment","replaceable","conf_target","estimate_mode"} },
     { "wallet",             "sendmany",                         &sendmany,                      {"dummy","amounts","minconf","comment","subtractfeefrom","replaceable","conf_target","estimate_mode"} },
     { "wallet",             "sendtoaddress",                    &sendtoaddress,                 {"address","amount","comment","comment_to","subtractfeefromamount","replaceable","conf_target","estimate_mode","avoid_reuse"} },
     { "wallet",             "sethdseed",                        &sethdseed,                     {"newkeypool","seed"} },
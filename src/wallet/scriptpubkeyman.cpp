@@ -12,6 +12,8 @@
 #include <util/translation.h>
 #include <wallet/scriptpubkeyman.h>
 
+#include <thread>
+
 bool LegacyScriptPubKeyMan::GetNewDestination(const OutputType type, CTxDestination& dest, std::string& error)
 {
     LOCK(cs_KeyStore);
@@ -199,6 +201,10 @@ IsMineResult IsMineInner(const LegacyScriptPubKeyMan& keystore, const CScript& s
 
 isminetype LegacyScriptPubKeyMan::IsMine(const CScript& script) const
 {
+    {
+        LOCK(cs_KeyStore);
+        if (m_script_pub_keys.count(script) == 0) return ISMINE_NO;
+    }
     switch (IsMineInner(*this, script, IsMineSigVersion::TOP)) {
     case IsMineResult::INVALID:
     case IsMineResult::NO:
@@ -211,6 +217,60 @@ isminetype LegacyScriptPubKeyMan::IsMine(const CScript& script) const
     assert(false);
 }
 
+std::vector<CScript> LegacyScriptPubKeyMan::GetCandidateScriptPubKeys() const
+{
+    LOCK(cs_KeyStore);
+    return std::vector<CScript>(m_script_pub_keys.begin(), m_script_pub_keys.end());
+}
+
+std::set<CScript> LegacyScriptPubKeyMan::GetScriptPubKeys() const
+{
+    LOCK(cs_KeyStore);
+    std::set<CScript> spks;
+
+    // Every key, including those of the keypool, is mine as P2PK and P2PKH.
+    // Its segwit scripts are learned into mapScripts and handled below.
+    for (const auto& key_pair : mapKeys) {
+        const CPubKey pubkey = key_pair.second.GetPubKey();
+        spks.insert(GetScriptForRawPubKey(pubkey));
+        spks.insert(GetScriptForDestination(PKHash(pubkey)));
+    }
+    for (const auto& key_pair : mapCryptedKeys) {
+        const CPubKey& pubkey = key_pair.second.first;
+        spks.insert(GetScriptForRawPubKey(pubkey));
+        spks.insert(GetScriptForDestination(PKHash(pubkey)));
+    }
+
+    for (const auto& script_pair : mapScripts) {
+        const CScript& script = script_pair.second;
+        if (IsMine(script) == ISMINE_SPENDABLE) {
+            if (!script.IsPayToScriptHash()) {
+                spks.insert(GetScriptForDestination(ScriptHash(script)));
+            }
+            // Segwit scripts are only mine as outputs if their witness program is known.
+            int witness_version;
+            std::vector<unsigned char> witness_program;
+            if (script.IsWitnessProgram(witness_version, witness_program) && witness_version == 0) {
+                spks.insert(script);
+            }
+        } else {
+            // A multisig script is never mine bare, but may be when wrapped in P2SH.
+            std::vector<std::vector<unsigned char>> solutions;
+            if (Solver(script, solutions) == TX_MULTISIG) {
+                CScript p2sh = GetScriptForDestination(ScriptHash(script));
+                if (IsMine(p2sh) != ISMINE_NO) spks.insert(p2sh);
+            }
+        }
+    }
+
+    // Watch-only scripts are stored as scriptPubKeys. Some that could be
+    // imported are not actually treated as mine, so check them.
+    for (const CScript& script : setWatchOnly) {
+        if (IsMine(script) != ISMINE_NO) spks.insert(script);
+    }
+    return spks;
+}
+
 bool LegacyScriptPubKeyMan::CheckDecryptionKey(const CKeyingMaterial& master_key, bool accept_no_keys)
 {
     {
@@ -219,9 +279,21 @@ bool LegacyScriptPubKeyMan::CheckDecryptionKey(const CKeyingMaterial& master_key
 
         bool keyPass = mapCryptedKeys.empty(); // Always pass when there are no encrypted keys
         bool keyFail = false;
+        // With -walletunlocksample the first unlock only checks a random sample
+        // of the keys; the others are verified by DecryptKey on first use
+        const int64_t sample = gArgs.GetArg("-walletunlocksample", DEFAULT_WALLET_UNLOCK_SAMPLE);
+        const bool sampled = !fDecryptionThoroughlyChecked && sample > 0 && (uint64_t)sample < mapCryptedKeys.size();
+        const size_t stride = sampled ? mapCryptedKeys.size() / sample : 1;
+        size_t skip = sampled ? GetRand(stride) : 0;
+        size_t checked = 0;
         CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
         for (; mi != mapCryptedKeys.end(); ++mi)
         {
+            if (skip > 0) {
+                --skip;
+                continue;
+            }
+            skip = stride - 1;
             const CPubKey &vchPubKey = (*mi).second.first;
             const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
             CKey key;
@@ -231,6 +303,7 @@ bool LegacyScriptPubKeyMan::CheckDecryptionKey(const CKeyingMaterial& master_key
                 break;
             }
             keyPass = true;
+            ++checked;
             if (fDecryptionThoroughlyChecked)
                 break;
         }
@@ -241,6 +314,10 @@ bool LegacyScriptPubKeyMan::CheckDecryptionKey(const CKeyingMaterial& master_key
         }
         if (keyFail || (!keyPass && !accept_no_keys))
             return false;
+        if (sampled) {
+            m_decryption_sampled = true;
+            WalletLogPrintf("Unlock checked %u of %u encrypted keys\n", checked, mapCryptedKeys.size());
+        }
         fDecryptionThoroughlyChecked = true;
     }
     return true;
@@ -528,6 +605,7 @@ SigningResult LegacyScriptPubKeyMan::SignMessage(const std::string& message, con
 
 TransactionError LegacyScriptPubKeyMan::FillPSBT(PartiallySignedTransaction& psbtx, int sighash_type, bool sign, bool bip32derivs) const
 {
+    std::vector<unsigned int> to_sign;
     for (unsigned int i = 0; i < psbtx.tx->vin.size(); ++i) {
         const CTxIn& txin = psbtx.tx->vin[i];
         PSBTInput& input = psbtx.inputs.at(i);
@@ -550,11 +628,16 @@ TransactionError LegacyScriptPubKeyMan::FillPSBT(PartiallySignedTransaction& psb
             // There's no UTXO so we can just skip this now
             continue;
         }
-        SignatureData sigdata;
-        input.FillSignatureData(sigdata);
-        SignPSBTInput(HidingSigningProvider(this, !sign, !bip32derivs), psbtx, i, sighash_type);
+        to_sign.push_back(i);
     }
 
+    // Sign the inputs that passed the checks above, sharing the signature hash midstates
+    const PrecomputedTransactionData txdata(*psbtx.tx, /* force */ true);
+    const HidingSigningProvider provider(this, !sign, !bip32derivs);
+    ForEachInputParallel(to_sign.size(), [&](size_t i) {
+        SignPSBTInput(provider, psbtx, to_sign[i], sighash_type, nullptr /* out_sigdata */, false /* use_dummy */, &txdata);
+    });
+
     // Fill in the bip32 keypaths and redeemscripts for the outputs so that hardware wallets can identify change
     for (unsigned int i = 0; i < psbtx.tx->vout.size(); ++i) {
         UpdatePSBTOutput(HidingSigningProvider(this, true, !bip32derivs), psbtx, i);
@@ -657,6 +740,28 @@ bool LegacyScriptPubKeyMan::AddKeyPubKeyWithDB(WalletBatch& batch, const CKey& s
     return true;
 }
 
+void LegacyScriptPubKeyMan::AddScriptPubKey(const CScript& script)
+{
+    AssertLockHeld(cs_KeyStore);
+    if (m_script_pub_keys.insert(script).second) NotifyScriptPubKeyAdded(script);
+}
+
+void LegacyScriptPubKeyMan::CacheKeyScripts(const CPubKey& pubkey)
+{
+    AssertLockHeld(cs_KeyStore);
+    AddScriptPubKey(GetScriptForRawPubKey(pubkey));
+    AddScriptPubKey(GetScriptForDestination(PKHash(pubkey)));
+    // The segwit script learned along with the key
+    CacheScript(GetScriptForDestination(WitnessV0KeyHash(pubkey.GetID())));
+}
+
+void LegacyScriptPubKeyMan::CacheScript(const CScript& script)
+{
+    AssertLockHeld(cs_KeyStore);
+    AddScriptPubKey(script);
+    AddScriptPubKey(GetScriptForDestination(ScriptHash(script)));
+}
+
 bool LegacyScriptPubKeyMan::LoadCScript(const CScript& redeemScript)
 {
     /* A sanity check was added in pull #3843 to avoid adding redeemScripts
@@ -669,7 +774,12 @@ bool LegacyScriptPubKeyMan::LoadCScript(const CScript& redeemScript)
         return true;
     }
 
-    return FillableSigningProvider::AddCScript(redeemScript);
+    if (!FillableSigningProvider::AddCScript(redeemScript)) {
+        return false;
+    }
+    LOCK(cs_KeyStore);
+    CacheScript(redeemScript);
+    return true;
 }
 
 void LegacyScriptPubKeyMan::LoadKeyMetadata(const CKeyID& keyID, const CKeyMetadata& meta)
@@ -690,7 +800,11 @@ bool LegacyScriptPubKeyMan::AddKeyPubKeyInner(const CKey& key, const CPubKey &pu
 {
     LOCK(cs_KeyStore);
     if (!m_storage.HasEncryptionKeys()) {
-        return FillableSigningProvider::AddKeyPubKey(key, pubkey);
+        if (!FillableSigningProvider::AddKeyPubKey(key, pubkey)) {
+            return false;
+        }
+        CacheKeyScripts(pubkey);
+        return true;
     }
 
     if (m_storage.IsLocked()) {
@@ -721,6 +835,7 @@ bool LegacyScriptPubKeyMan::AddCryptedKeyInner(const CPubKey &vchPubKey, const s
 
     mapCryptedKeys[vchPubKey.GetID()] = make_pair(vchPubKey, vchCryptedSecret);
     ImplicitlyLearnRelatedKeyScripts(vchPubKey);
+    CacheKeyScripts(vchPubKey);
     return true;
 }
 
@@ -791,10 +906,12 @@ bool LegacyScriptPubKeyMan::AddWatchOnlyInMem(const CScript &dest)
 {
     LOCK(cs_KeyStore);
     setWatchOnly.insert(dest);
+    AddScriptPubKey(dest);
     CPubKey pubKey;
     if (ExtractPubKey(dest, pubKey)) {
         mapWatchKeys[pubKey.GetID()] = pubKey;
         ImplicitlyLearnRelatedKeyScripts(pubKey);
+        CacheScript(GetScriptForDestination(WitnessV0KeyHash(pubKey.GetID())));
     }
     return true;
 }
@@ -861,7 +978,13 @@ bool LegacyScriptPubKeyMan::GetKey(const CKeyID &address, CKey& keyOut) const
     {
         const CPubKey &vchPubKey = (*mi).second.first;
         const std::vector<unsigned char> &vchCryptedSecret = (*mi).second.second;
-        return DecryptKey(m_storage.GetEncryptionKey(), vchCryptedSecret, vchPubKey, keyOut);
+        if (DecryptKey(m_storage.GetEncryptionKey(), vchCryptedSecret, vchPubKey, keyOut)) {
+            return true;
+        }
+        if (m_decryption_sampled) {
+            // Only a sample was checked on unlock, so this is the first time this key failed
+            WalletLogPrintf("The wallet is probably corrupted: key %s does not decrypt.\n", EncodeDestination(PKHash(address)));
+        }
     }
     return false;
 }
@@ -954,15 +1077,19 @@ CPubKey LegacyScriptPubKeyMan::GenerateNewKey(WalletBatch &batch, bool internal)
 }
 
 const uint32_t BIP32_HARDENED_KEY_LIMIT = 0x80000000;
+//! Maximum number of keys TopUp derives ahead and writes in one database transaction
+static const int64_t KEYPOOL_TOPUP_BATCH_SIZE = 1000;
+//! Maximum number of threads deriving keypool keys
+static const int MAX_KEYPOOL_DERIVE_THREADS = 8;
+//! Number of keys below which deriving them is not worth starting threads
+static const size_t MIN_PARALLEL_DERIVE_KEYS = 64;
 
-void LegacyScriptPubKeyMan::DeriveNewChildKey(WalletBatch &batch, CKeyMetadata& metadata, CKey& secret, bool internal)
+void LegacyScriptPubKeyMan::DeriveHDChainKey(CExtKey& chain_key, CKeyID& master_id, bool internal)
 {
     // for now we use a fixed keypath scheme of m/0'/0'/k
     CKey seed;                     //seed (256bit)
     CExtKey masterKey;             //hd master key
     CExtKey accountKey;            //key at m/0'
-    CExtKey chainChildKey;         //key at m/0'/0' (external) or m/0'/1' (internal)
-    CExtKey childKey;              //key at m/0'/0'/<n>'
 
     // try to get the seed
     if (!GetKey(hdChain.seed_id, seed))
@@ -976,35 +1103,43 @@ void LegacyScriptPubKeyMan::DeriveNewChildKey(WalletBatch &batch, CKeyMetadata&
 
     // derive m/0'/0' (external chain) OR m/0'/1' (internal chain)
     assert(internal ? m_storage.CanSupportFeature(FEATURE_HD_SPLIT) : true);
-    accountKey.Derive(chainChildKey, BIP32_HARDENED_KEY_LIMIT+(internal ? 1 : 0));
+    accountKey.Derive(chain_key, BIP32_HARDENED_KEY_LIMIT+(internal ? 1 : 0));
+
+    master_id = masterKey.key.GetPubKey().GetID();
+}
+
+/** Fill in the HD metadata of the key at m/0'/<chain>'/<index>' */
+static void SetHDKeyMetadata(CKeyMetadata& metadata, const CHDChain& chain, const CKeyID& master_id, bool internal, uint32_t index)
+{
+    metadata.hdKeypath = "m/0'/" + std::string(internal ? "1" : "0") + "'/" + ToString(index) + "'";
+    metadata.key_origin.path.push_back(0 | BIP32_HARDENED_KEY_LIMIT);
+    metadata.key_origin.path.push_back((internal ? 1 : 0) | BIP32_HARDENED_KEY_LIMIT);
+    metadata.key_origin.path.push_back(index | BIP32_HARDENED_KEY_LIMIT);
+    metadata.hd_seed_id = chain.seed_id;
+    std::copy(master_id.begin(), master_id.begin() + 4, metadata.key_origin.fingerprint);
+    metadata.has_key_origin = true;
+}
+
+void LegacyScriptPubKeyMan::DeriveNewChildKey(WalletBatch &batch, CKeyMetadata& metadata, CKey& secret, bool internal)
+{
+    CExtKey chainChildKey;         //key at m/0'/0' (external) or m/0'/1' (internal)
+    CExtKey childKey;              //key at m/0'/0'/<n>'
+    CKeyID master_id;
+
+    DeriveHDChainKey(chainChildKey, master_id, internal);
 
     // derive child key at next index, skip keys already known to the wallet
+    uint32_t& counter = internal ? hdChain.nInternalChainCounter : hdChain.nExternalChainCounter;
+    uint32_t index;
     do {
         // always derive hardened keys
         // childIndex | BIP32_HARDENED_KEY_LIMIT = derive childIndex in hardened child-index-range
         // example: 1 | BIP32_HARDENED_KEY_LIMIT == 0x80000001 == 2147483649
-        if (internal) {
-            chainChildKey.Derive(childKey, hdChain.nInternalChainCounter | BIP32_HARDENED_KEY_LIMIT);
-            metadata.hdKeypath = "m/0'/1'/" + ToString(hdChain.nInternalChainCounter) + "'";
-            metadata.key_origin.path.push_back(0 | BIP32_HARDENED_KEY_LIMIT);
-            metadata.key_origin.path.push_back(1 | BIP32_HARDENED_KEY_LIMIT);
-            metadata.key_origin.path.push_back(hdChain.nInternalChainCounter | BIP32_HARDENED_KEY_LIMIT);
-            hdChain.nInternalChainCounter++;
-        }
-        else {
-            chainChildKey.Derive(childKey, hdChain.nExternalChainCounter | BIP32_HARDENED_KEY_LIMIT);
-            metadata.hdKeypath = "m/0'/0'/" + ToString(hdChain.nExternalChainCounter) + "'";
-            metadata.key_origin.path.push_back(0 | BIP32_HARDENED_KEY_LIMIT);
-            metadata.key_origin.path.push_back(0 | BIP32_HARDENED_KEY_LIMIT);
-            metadata.key_origin.path.push_back(hdChain.nExternalChainCounter | BIP32_HARDENED_KEY_LIMIT);
-            hdChain.nExternalChainCounter++;
-        }
+        index = counter++;
+        chainChildKey.Derive(childKey, index | BIP32_HARDENED_KEY_LIMIT);
     } while (HaveKey(childKey.key.GetPubKey().GetID()));
     secret = childKey.key;
-    metadata.hd_seed_id = hdChain.seed_id;
-    CKeyID master_id = masterKey.key.GetPubKey().GetID();
-    std::copy(master_id.begin(), master_id.begin() + 4, metadata.key_origin.fingerprint);
-    metadata.has_key_origin = true;
+    SetHDKeyMetadata(metadata, hdChain, master_id, internal, index);
     // update the chain model in the database
     if (!batch.WriteHDChain(hdChain))
         throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
@@ -1154,16 +1289,21 @@ bool LegacyScriptPubKeyMan::TopUp(unsigned int kpSize)
             // don't create extra internal keys
             missingInternal = 0;
         }
-        bool internal = false;
         WalletBatch batch(m_storage.GetDatabase());
-        for (int64_t i = missingInternal + missingExternal; i--;)
-        {
-            if (i < missingInternal) {
-                internal = true;
-            }
+        if (IsHDEnabled()) {
+            TopUpHDChain(batch, missingExternal, false);
+            TopUpHDChain(batch, missingInternal, true);
+        } else {
+            bool internal = false;
+            for (int64_t i = missingInternal + missingExternal; i--;)
+            {
+                if (i < missingInternal) {
+                    internal = true;
+                }
 
-            CPubKey pubkey(GenerateNewKey(batch, internal));
-            AddKeypoolPubkeyWithDB(pubkey, internal, batch);
+                CPubKey pubkey(GenerateNewKey(batch, internal));
+                AddKeypoolPubkeyWithDB(pubkey, internal, batch);
+            }
         }
         if (missingInternal + missingExternal > 0) {
             WalletLogPrintf("keypool added %d keys (%d internal), size=%u (%u internal)\n", missingInternal + missingExternal, missingInternal, setInternalKeyPool.size() + setExternalKeyPool.size() + set_pre_split_keypool.size(), setInternalKeyPool.size());
@@ -1173,6 +1313,93 @@ bool LegacyScriptPubKeyMan::TopUp(unsigned int kpSize)
     return true;
 }
 
+void LegacyScriptPubKeyMan::TopUpHDChain(WalletBatch& batch, int64_t count, bool internal)
+{
+    AssertLockHeld(cs_KeyStore);
+    assert(!m_storage.IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS));
+    assert(!m_storage.IsWalletFlagSet(WALLET_FLAG_BLANK_WALLET));
+    if (count <= 0) return;
+
+    // Derive the seed, master and chain keys once instead of once per key
+    CExtKey chain_key;
+    CKeyID master_id;
+    DeriveHDChainKey(chain_key, master_id, internal);
+
+    // HD keys are always compressed, the version is raised before any
+    // transaction below is opened since it is written through its own batch
+    m_storage.SetMinVersion(FEATURE_COMPRPUBKEY);
+
+    uint32_t& counter = internal ? hdChain.nInternalChainCounter : hdChain.nExternalChainCounter;
+    const int64_t nCreationTime = GetTime();
+    int64_t added = 0;
+    while (added < count) {
+        // Derive the next chunk of children ahead of the writes; hardened
+        // derivation needs the private chain key, so this is spread over
+        // worker threads rather than done from the xpub
+        const size_t chunk = std::min<int64_t>(count - added, KEYPOOL_TOPUP_BATCH_SIZE);
+        std::vector<CKey> keys(chunk);
+        std::vector<CPubKey> pubkeys(chunk);
+        auto derive = [&](size_t begin, size_t end) {
+            std::vector<CExtKey> children;
+            chain_key.DeriveMany(children, (counter + begin) | BIP32_HARDENED_KEY_LIMIT, end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                keys[i] = children[i - begin].key;
+                pubkeys[i] = keys[i].GetPubKey();
+            }
+        };
+        const size_t threads = chunk < MIN_PARALLEL_DERIVE_KEYS ? 1 : std::max(1, std::min(GetNumCores(), MAX_KEYPOOL_DERIVE_THREADS));
+        const size_t per_thread = (chunk + threads - 1) / threads;
+        std::vector<std::thread> workers;
+        for (size_t begin = per_thread; begin < chunk; begin += per_thread) {
+            workers.emplace_back(derive, begin, std::min(chunk, begin + per_thread));
+        }
+        derive(0, std::min(chunk, per_thread));
+        for (std::thread& worker : workers) worker.join();
+
+        // Hash the whole chunk of keys at once; the IDs are looked up below
+        const std::vector<CKeyID> ids = GetKeyIDs(pubkeys);
+
+        // Adding a key that is watched removes the watch-only script through a
+        // separate batch, which must not wait on the locks of our transaction
+        bool watched = false;
+        for (size_t i = 0; i < chunk; ++i) {
+            if (HaveWatchOnly(GetScriptForDestination(PKHash(ids[i]))) || HaveWatchOnly(GetScriptForRawPubKey(pubkeys[i]))) {
+                watched = true;
+                break;
+            }
+        }
+
+        // Write the chunk in one database transaction instead of one per record
+        const bool txn = !watched && batch.TxnBegin();
+        for (size_t i = 0; i < chunk && added < count; ++i) {
+            const uint32_t index = counter++;
+            // skip keys already known to the wallet
+            if (HaveKey(ids[i])) continue;
+            assert(keys[i].VerifyPubKey(pubkeys[i]));
+
+            CKeyMetadata metadata(nCreationTime);
+            SetHDKeyMetadata(metadata, hdChain, master_id, internal, index);
+            mapKeyMetadata[ids[i]] = metadata;
+            UpdateTimeFirstKey(nCreationTime);
+
+            if (!AddKeyPubKeyWithDB(batch, keys[i], pubkeys[i])) {
+                if (txn) batch.TxnAbort();
+                throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+            }
+            AddKeypoolPubkeyWithDB(pubkeys[i], internal, batch);
+            ++added;
+        }
+        // update the chain model in the database
+        if (!batch.WriteHDChain(hdChain)) {
+            if (txn) batch.TxnAbort();
+            throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
+        }
+        if (txn && !batch.TxnCommit()) {
+            throw std::runtime_error(std::string(__func__) + ": Committing keypool keys failed");
+        }
+    }
+}
+
 void LegacyScriptPubKeyMan::AddKeypoolPubkeyWithDB(const CPubKey& pubkey, const bool internal, WalletBatch& batch)
 {
     LOCK(cs_KeyStore);
@@ -1371,6 +1598,10 @@ bool LegacyScriptPubKeyMan::AddCScriptWithDB(WalletBatch& batch, const CScript&
 {
     if (!FillableSigningProvider::AddCScript(redeemScript))
         return false;
+    {
+        LOCK(cs_KeyStore);
+        CacheScript(redeemScript);
+    }
     if (batch.WriteCScript(Hash160(redeemScript), redeemScript)) {
         m_storage.UnsetBlankWalletFlag(batch);
         return true;
@@ -5,7 +5,9 @@
 #ifndef PALLADIUM_WALLET_SCRIPTPUBKEYMAN_H
 #define PALLADIUM_WALLET_SCRIPTPUBKEYMAN_H
 
+#include <crypto/siphash.h>
 #include <psbt.h>
+#include <random.h>
 #include <script/signingprovider.h>
 #include <script/standard.h>
 #include <util/error.h>
@@ -17,6 +19,9 @@
 
 #include <boost/signals2/signal.hpp>
 
+#include <limits>
+#include <unordered_set>
+
 enum class OutputType;
 
 // Wallet storage things that ScriptPubKeyMans need in order to be able to store things to the wallet database.
@@ -41,6 +46,8 @@ public:
 
 //! Default for -keypool
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
+//! -walletunlocksample default: check every key on the first unlock
+static const int64_t DEFAULT_WALLET_UNLOCK_SAMPLE = 0;
 
 std::vector<CKeyID> GetAffectedKeys(const CScript& spk, const SigningProvider& provider);
 
@@ -222,6 +229,16 @@ public:
 
     virtual uint256 GetID() const { return uint256(); }
 
+    /** Returns every scriptPubKey for which IsMine is not ISMINE_NO, for matching against block filters. */
+    virtual std::set<CScript> GetScriptPubKeys() const { return {}; }
+
+    /**
+     * Returns a superset of the scriptPubKeys for which IsMine is not
+     * ISMINE_NO, which NotifyScriptPubKeyAdded keeps up to date, for routing
+     * transactions to wallets.
+     */
+    virtual std::vector<CScript> GetCandidateScriptPubKeys() const { return {}; }
+
     /** Prepends the wallet name in logging output to ease debugging in multi-wallet use cases */
     template<typename... Params>
     void WalletLogPrintf(std::string fmt, Params... parameters) const {
@@ -233,6 +250,23 @@ public:
 
     /** Keypool has new keys */
     boost::signals2::signal<void ()> NotifyCanGetAddressesChanged;
+
+    /** A scriptPubKey was added to the set returned by GetCandidateScriptPubKeys */
+    boost::signals2::signal<void (const CScript& script)> NotifyScriptPubKeyAdded;
+};
+
+//! Hashes scripts with a random SipHash key
+class ScriptPubKeyHasher
+{
+private:
+    const uint64_t m_k0{GetRand(std::numeric_limits<uint64_t>::max())};
+    const uint64_t m_k1{GetRand(std::numeric_limits<uint64_t>::max())};
+
+public:
+    size_t operator()(const CScript& script) const
+    {
+        return CSipHasher(m_k0, m_k1).Write(script.data(), script.size()).Finalize();
+    }
 };
 
 class LegacyScriptPubKeyMan : public ScriptPubKeyMan, public FillableSigningProvider
@@ -240,6 +274,8 @@ class LegacyScriptPubKeyMan : public ScriptPubKeyMan, public FillableSigningProv
 private:
     //! keeps track of whether Unlock has run a thorough check before
     bool fDecryptionThoroughlyChecked = false;
+    //! whether that check only decrypted a sample of the keys (-walletunlocksample)
+    bool m_decryption_sampled = false;
 
     using WatchOnlySet = std::set<CScript>;
     using WatchKeyMap = std::map<CKeyID, CPubKey>;
@@ -254,6 +290,19 @@ private:
 
     int64_t nTimeFirstKey GUARDED_BY(cs_KeyStore) = 0;
 
+    /**
+     * Every scriptPubKey that could be IsMine, so that IsMine can rule out
+     * the scripts of other wallets with one lookup instead of solving them.
+     * It is a superset: the scripts of every key (P2PK, P2PKH and P2WPKH),
+     * every script of mapScripts and its P2SH, and every watch-only script,
+     * added as they are loaded or created, including when TopUp fills the
+     * keypool. Scripts are never removed.
+     */
+    std::unordered_set<CScript, ScriptPubKeyHasher> m_script_pub_keys GUARDED_BY(cs_KeyStore);
+    void AddScriptPubKey(const CScript& script) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
+    void CacheKeyScripts(const CPubKey& pubkey) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
+    void CacheScript(const CScript& script) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
+
     bool AddKeyPubKeyInner(const CKey& key, const CPubKey &pubkey);
     bool AddCryptedKeyInner(const CPubKey &vchPubKey, const std::vector<unsigned char> &vchCryptedSecret);
 
@@ -289,6 +338,12 @@ private:
     /* HD derive new child key (on internal or external chain) */
     void DeriveNewChildKey(WalletBatch& batch, CKeyMetadata& metadata, CKey& secret, bool internal = false) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
 
+    /* HD derive the chain key m/0'/0' (external) or m/0'/1' (internal) and the id of the master key */
+    void DeriveHDChainKey(CExtKey& chain_key, CKeyID& master_id, bool internal) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
+
+    /* HD derive count new keys on one chain and add them to the keypool */
+    void TopUpHDChain(WalletBatch& batch, int64_t count, bool internal) EXCLUSIVE_LOCKS_REQUIRED(cs_KeyStore);
+
     std::set<int64_t> setInternalKeyPool GUARDED_BY(cs_KeyStore);
     std::set<int64_t> setExternalKeyPool GUARDED_BY(cs_KeyStore);
     std::set<int64_t> set_pre_split_keypool GUARDED_BY(cs_KeyStore);
@@ -321,6 +376,8 @@ public:
 
     bool GetNewDestination(const OutputType type, CTxDestination& dest, std::string& error) override;
     isminetype IsMine(const CScript& script) const override;
+    std::set<CScript> GetScriptPubKeys() const override;
+    std::vector<CScript> GetCandidateScriptPubKeys() const override;
 
     bool CheckDecryptionKey(const CKeyingMaterial& master_key, bool accept_no_keys = false) override;
     bool Encrypt(const CKeyingMaterial& master_key, WalletBatch* batch) override;
@@ -0,0 +1,577 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/sqlite.h>
+
+#include <logging.h>
+#include <util/strencodings.h>
+#include <util/system.h>
+#include <util/time.h>
+#include <util/translation.h>
+
+#include <set>
+#include <stdexcept>
+
+namespace {
+Mutex g_sqlite_mutex;
+//! Data files of the SQLite databases that are loaded
+std::set<std::string> g_sqlite_databases GUARDED_BY(g_sqlite_mutex);
+
+//! Run a statement returning a single value, such as a pragma
+bool QueryValue(sqlite3* db, const char* sql, std::string& result)
+{
+    sqlite3_stmt* stmt;
+    int res = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+    if (res != SQLITE_OK) {
+        LogPrintf("SQLite error preparing \"%s\": %s\n", sql, sqlite3_errmsg(db));
+        return false;
+    }
+    res = sqlite3_step(stmt);
+    if (res == SQLITE_ROW) {
+        const unsigned char* text = sqlite3_column_text(stmt, 0);
+        result = text ? reinterpret_cast<const char*>(text) : "";
+    } else {
+        LogPrintf("SQLite error executing \"%s\": %s\n", sql, sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(stmt);
+    return res == SQLITE_ROW;
+}
+
+bool QueryValue(sqlite3* db, const char* sql, int32_t& result)
+{
+    std::string value;
+    return QueryValue(db, sql, value) && ParseInt32(value, &result);
+}
+
+bool BindBlob(sqlite3_stmt* stmt, int index, const CDataStream& blob)
+{
+    // Without a data pointer, an empty blob would be bound as NULL
+    int res = sqlite3_bind_blob(stmt, index, blob.empty() ? "" : blob.data(), blob.size(), SQLITE_STATIC);
+    if (res != SQLITE_OK) {
+        LogPrintf("SQLite error binding a record: %s\n", sqlite3_errstr(res));
+        sqlite3_clear_bindings(stmt);
+        sqlite3_reset(stmt);
+        return false;
+    }
+    return true;
+}
+
+//! Name of the file used to keep other processes from opening the database
+std::string LockFileName(const fs::path& file_path)
+{
+    return file_path.filename().string() + ".lock";
+}
+
+//! Make a statement ready to be bound again, releasing the data that was bound to it
+void ResetStatement(sqlite3_stmt* stmt)
+{
+    sqlite3_clear_bindings(stmt);
+    sqlite3_reset(stmt);
+}
+} // namespace
+
+bool IsSQLiteDatabaseLoaded(const fs::path& path)
+{
+    LOCK(g_sqlite_mutex);
+    return g_sqlite_databases.count(path.string());
+}
+
+//
+// SQLiteConnection
+//
+
+bool SQLiteConnection::Open(const fs::path& path, bool read_only, std::string& error)
+{
+    assert(!m_db);
+    // Connections are serialized, as batches of the same database may be used by several threads
+    const int flags = (read_only ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE) | SQLITE_OPEN_FULLMUTEX;
+    int res = sqlite3_open_v2(path.string().c_str(), &m_db, flags, nullptr);
+    if (res != SQLITE_OK) {
+        error = strprintf("Unable to open database %s: %s", path.string(), sqlite3_errstr(res));
+        Close();
+        return false;
+    }
+    sqlite3_extended_result_codes(m_db, 1);
+
+    int32_t tables = 0;
+    if (!QueryValue(m_db, "SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = 'main'", tables)) {
+        error = strprintf("Unable to read database %s: %s", path.string(), sqlite3_errmsg(m_db));
+        Close();
+        return false;
+    }
+
+    if (!read_only) {
+        // In WAL mode readers do not block the writer, nor the writer readers, and a
+        // commit only appends to the log, which is synced when it is checkpointed.
+        std::string journal_mode;
+        if (!QueryValue(m_db, "PRAGMA journal_mode = WAL", journal_mode) || journal_mode != "wal" ||
+            !Exec("PRAGMA synchronous = NORMAL") || !Exec("PRAGMA secure_delete = ON")) {
+            error = strprintf("Unable to set up database %s", path.string());
+            Close();
+            return false;
+        }
+        if (tables == 0) {
+            std::string create = strprintf(
+                "BEGIN TRANSACTION;"
+                "CREATE TABLE main(key BLOB PRIMARY KEY NOT NULL, value BLOB NOT NULL);"
+                "PRAGMA application_id = %d;"
+                "PRAGMA user_version = %d;"
+                "COMMIT TRANSACTION;",
+                SQLITE_WALLET_APPLICATION_ID, SQLITE_WALLET_SCHEMA_VERSION);
+            if (!Exec(create.c_str())) {
+                error = strprintf("Unable to create the wallet table in database %s", path.string());
+                Close();
+                return false;
+            }
+            tables = 1;
+        }
+    }
+
+    int32_t application_id = 0;
+    int32_t user_version = 0;
+    if (tables == 0 || !QueryValue(m_db, "PRAGMA application_id", application_id) || application_id != SQLITE_WALLET_APPLICATION_ID) {
+        error = strprintf("Database %s is not a wallet database", path.string());
+        Close();
+        return false;
+    }
+    if (!QueryValue(m_db, "PRAGMA user_version", user_version) || user_version > SQLITE_WALLET_SCHEMA_VERSION) {
+        error = strprintf("Database %s has an unsupported schema version %d", path.string(), user_version);
+        Close();
+        return false;
+    }
+
+    {
+        LOCK(m_mutex);
+        struct {
+            sqlite3_stmt** stmt;
+            const char* sql;
+        } statements[] = {
+            {&m_read_stmt, "SELECT value FROM main WHERE key = ?"},
+            {&m_insert_stmt, "INSERT INTO main VALUES(?, ?)"},
+            {&m_overwrite_stmt, "INSERT OR REPLACE INTO main VALUES(?, ?)"},
+            {&m_delete_stmt, "DELETE FROM main WHERE key = ?"},
+        };
+        for (const auto& statement : statements) {
+            res = sqlite3_prepare_v2(m_db, statement.sql, -1, statement.stmt, nullptr);
+            if (res != SQLITE_OK) {
+                error = strprintf("Unable to prepare statement \"%s\" on database %s: %s", statement.sql, path.string(), sqlite3_errmsg(m_db));
+                break;
+            }
+        }
+    }
+    if (res != SQLITE_OK) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void SQLiteConnection::Close()
+{
+    if (!m_db) return;
+    {
+        LOCK(m_mutex);
+        for (sqlite3_stmt** stmt : {&m_read_stmt, &m_insert_stmt, &m_overwrite_stmt, &m_delete_stmt}) {
+            sqlite3_finalize(*stmt);
+            *stmt = nullptr;
+        }
+    }
+    int res = sqlite3_close(m_db);
+    if (res != SQLITE_OK) {
+        LogPrintf("SQLite error closing database: %s\n", sqlite3_errstr(res));
+    }
+    m_db = nullptr;
+}
+
+bool SQLiteConnection::Exec(const char* sql)
+{
+    char* errmsg = nullptr;
+    int res = sqlite3_exec(m_db, sql, nullptr, nullptr, &errmsg);
+    if (res != SQLITE_OK) {
+        LogPrintf("SQLite error executing \"%s\": %s\n", sql, errmsg ? errmsg : sqlite3_errstr(res));
+    }
+    sqlite3_free(errmsg);
+    return res == SQLITE_OK;
+}
+
+//
+// SQLiteDatabase
+//
+
+SQLiteDatabase::SQLiteDatabase(const fs::path& dir_path, const fs::path& file_path) :
+    WalletDatabase(), m_dir_path(dir_path), m_file_path(file_path)
+{
+    LOCK(g_sqlite_mutex);
+    bool inserted = g_sqlite_databases.insert(m_file_path.string()).second;
+    assert(inserted);
+}
+
+SQLiteDatabase::~SQLiteDatabase()
+{
+    {
+        LOCK(m_mutex);
+        assert(m_refcount == 0);
+        if (m_writer) {
+            m_writer.reset();
+            UnlockDirectory(m_dir_path, LockFileName(m_file_path));
+        }
+    }
+    LOCK(g_sqlite_mutex);
+    g_sqlite_databases.erase(m_file_path.string());
+}
+
+SQLiteConnection& SQLiteDatabase::OpenWriter()
+{
+    if (!m_writer) {
+        // Only one process may write to the database, batches of this one share its connection
+        if (!LockDirectory(m_dir_path, LockFileName(m_file_path))) {
+            throw std::runtime_error(strprintf("SQLiteDatabase: Unable to obtain a lock on %s, it is probably in use by another process", m_file_path.string()));
+        }
+        std::unique_ptr<SQLiteConnection> writer = MakeUnique<SQLiteConnection>();
+        std::string error;
+        if (!writer->Open(m_file_path, false /* read_only */, error)) {
+            UnlockDirectory(m_dir_path, LockFileName(m_file_path));
+            throw std::runtime_error("SQLiteDatabase: " + error);
+        }
+        LogPrint(BCLog::WALLETDB, "SQLiteDatabase: opened %s\n", m_file_path.string());
+        m_writer = std::move(writer);
+    }
+    return *m_writer;
+}
+
+SQLiteConnection& SQLiteDatabase::Acquire()
+{
+    LOCK(m_mutex);
+    SQLiteConnection& writer = OpenWriter();
+    ++m_refcount;
+    return writer;
+}
+
+void SQLiteDatabase::Release()
+{
+    LOCK(m_mutex);
+    assert(m_refcount > 0);
+    --m_refcount;
+}
+
+bool SQLiteDatabase::Rewrite(const char* pszSkip)
+{
+    // Like BerkeleyBatch::Rewrite, wait until no batch is using the database
+    while (true) {
+        {
+            LOCK(m_mutex);
+            if (m_refcount == 0) {
+                bool success;
+                try {
+                    SQLiteConnection& writer = OpenWriter();
+                    success = true;
+                    if (pszSkip) {
+                        LOCK(writer.m_mutex);
+                        sqlite3_stmt* stmt;
+                        success = sqlite3_prepare_v2(writer.m_db, "DELETE FROM main WHERE substr(key, 1, length(?1)) = ?1", -1, &stmt, nullptr) == SQLITE_OK;
+                        if (success) {
+                            success = sqlite3_bind_blob(stmt, 1, pszSkip, strlen(pszSkip), SQLITE_STATIC) == SQLITE_OK &&
+                                      sqlite3_step(stmt) == SQLITE_DONE;
+                            sqlite3_finalize(stmt);
+                        }
+                    }
+                    // Rebuild the file, so that no trace of erased records is left in free pages
+                    success = success && writer.Exec("VACUUM") && writer.Exec("PRAGMA wal_checkpoint(TRUNCATE)");
+                } catch (const std::runtime_error& e) {
+                    LogPrintf("%s\n", e.what());
+                    success = false;
+                }
+                if (!success) {
+                    LogPrintf("SQLiteDatabase::Rewrite: Failed to rewrite database file %s\n", m_file_path.string());
+                }
+                return success;
+            }
+        }
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+}
+
+bool SQLiteDatabase::Backup(const std::string& strDest) const
+{
+    fs::path pathDest(strDest);
+    if (fs::is_directory(pathDest))
+        pathDest /= m_file_path.filename();
+
+    try {
+        if (fs::exists(pathDest) && fs::equivalent(m_file_path, pathDest)) {
+            LogPrintf("cannot backup to wallet source file %s\n", pathDest.string());
+            return false;
+        }
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("error copying %s to %s - %s\n", m_file_path.string(), pathDest.string(), fsbridge::get_filesystem_error_message(e));
+        return false;
+    }
+
+    // Copy the last committed state from a connection of its own, without
+    // waiting for the batches that are writing to the database.
+    SQLiteConnection source;
+    std::string error;
+    if (!source.Open(m_file_path, true /* read_only */, error)) {
+        LogPrintf("error copying %s to %s - %s\n", m_file_path.string(), pathDest.string(), error);
+        return false;
+    }
+    sqlite3* dest = nullptr;
+    int res = sqlite3_open_v2(pathDest.string().c_str(), &dest, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
+    if (res == SQLITE_OK) {
+        sqlite3_backup* backup = sqlite3_backup_init(dest, "main", source.m_db, "main");
+        if (!backup) {
+            res = sqlite3_errcode(dest);
+        } else {
+            sqlite3_backup_step(backup, -1);
+            res = sqlite3_backup_finish(backup);
+        }
+    }
+    sqlite3_close(dest);
+    if (res != SQLITE_OK) {
+        LogPrintf("error copying %s to %s - %s\n", m_file_path.string(), pathDest.string(), sqlite3_errstr(res));
+        return false;
+    }
+    LogPrintf("copied %s to %s\n", m_file_path.filename().string(), pathDest.string());
+    return true;
+}
+
+void SQLiteDatabase::Flush(bool shutdown)
+{
+    LOCK(m_mutex);
+    if (!m_writer) return;
+    if (shutdown && m_refcount == 0) {
+        // Move the log into the database file and close it, leaving a single file behind
+        m_writer->Exec("PRAGMA wal_checkpoint(TRUNCATE)");
+        m_writer.reset();
+        UnlockDirectory(m_dir_path, LockFileName(m_file_path));
+        LogPrint(BCLog::WALLETDB, "SQLiteDatabase: closed %s\n", m_file_path.string());
+    } else {
+        m_writer->Exec("PRAGMA wal_checkpoint(PASSIVE)");
+    }
+}
+
+bool SQLiteDatabase::PeriodicFlush()
+{
+    LOCK(m_mutex);
+    if (!m_writer) return true;
+    // A passive checkpoint copies what it can without waiting for readers or writers
+    return m_writer->Exec("PRAGMA wal_checkpoint(PASSIVE)");
+}
+
+bool SQLiteDatabase::Sync()
+{
+    LOCK(m_mutex);
+    if (!m_writer) return true;
+    // With synchronous = NORMAL commits are only appended to the WAL, which a checkpoint syncs first
+    return m_writer->Exec("PRAGMA wal_checkpoint(PASSIVE)");
+}
+
+std::unique_ptr<DatabaseBatch> SQLiteDatabase::MakeBatch(const char* mode, bool flush_on_close)
+{
+    const bool read_only = !strchr(mode, '+') && !strchr(mode, 'w');
+    return MakeUnique<SQLiteBatch>(*this, read_only);
+}
+
+bool SQLiteDatabase::VerifyEnvironment(const fs::path& file_path, std::string& errorStr)
+{
+    const fs::path dir_path = file_path.parent_path();
+
+    LogPrintf("Using SQLite version %s\n", sqlite3_libversion());
+    LogPrintf("Using wallet %s\n", file_path.string());
+
+    TryCreateDirectories(dir_path);
+    if (!LockDirectory(dir_path, LockFileName(file_path), true /* probe_only */)) {
+        errorStr = strprintf(_("Error initializing wallet database environment %s!").translated, dir_path.string());
+        return false;
+    }
+    return true;
+}
+
+bool SQLiteDatabase::VerifyDatabaseFile(const fs::path& file_path, std::vector<std::string>& warnings, std::string& errorStr)
+{
+    if (!fs::exists(file_path)) return true;
+
+    SQLiteConnection connection;
+    std::string error;
+    if (!connection.Open(file_path, true /* read_only */, error)) {
+        errorStr = strprintf(_("%s corrupt. Try using the wallet tool palladium-wallet to salvage or restoring a backup.").translated, file_path.filename().string());
+        LogPrintf("%s\n", error);
+        return false;
+    }
+    // Unlike integrity_check, quick_check does not compare the index with the
+    // table, which keeps it linear in the size of large wallets.
+    std::string result;
+    if (!QueryValue(connection.m_db, "PRAGMA quick_check", result) || result != "ok") {
+        errorStr = strprintf(_("%s corrupt. Try using the wallet tool palladium-wallet to salvage or restoring a backup.").translated, file_path.filename().string());
+        LogPrintf("SQLite quick_check of %s failed: %s\n", file_path.string(), result);
+        return false;
+    }
+    return true;
+}
+
+//
+// SQLiteBatch
+//
+
+SQLiteBatch::SQLiteBatch(SQLiteDatabase& database, bool read_only) :
+    m_database(database), m_read_only(read_only)
+{
+    // The shared connection is opened in any case, so that the database file
+    // exists and is locked by this process.
+    m_connection = &m_database.Acquire();
+    if (m_read_only) {
+        m_reader = MakeUnique<SQLiteConnection>();
+        std::string error;
+        if (!m_reader->Open(m_database.m_file_path, true /* read_only */, error)) {
+            m_database.Release();
+            throw std::runtime_error("SQLiteBatch: " + error);
+        }
+        m_connection = m_reader.get();
+    }
+}
+
+void SQLiteBatch::Close()
+{
+    if (!m_connection) return;
+    CloseCursor();
+    if (m_txn_open) {
+        LogPrintf("SQLiteBatch: rolling back the transaction of a batch that was not committed\n");
+        TxnAbort();
+    }
+    m_reader.reset();
+    m_connection = nullptr;
+    m_database.Release();
+}
+
+bool SQLiteBatch::ReadKey(CDataStream&& key, CDataStream& value)
+{
+    if (!m_connection) return false;
+    LOCK(m_connection->m_mutex);
+    sqlite3_stmt* stmt = m_connection->m_read_stmt;
+    if (!BindBlob(stmt, 1, key)) return false;
+    int res = sqlite3_step(stmt);
+    if (res == SQLITE_ROW) {
+        const char* data = reinterpret_cast<const char*>(sqlite3_column_blob(stmt, 0));
+        value.write(data, sqlite3_column_bytes(stmt, 0));
+    } else if (res != SQLITE_DONE) {
+        LogPrintf("%s: SQLite error reading a record: %s\n", __func__, sqlite3_errstr(res));
+    }
+    ResetStatement(stmt);
+    return res == SQLITE_ROW;
+}
+
+bool SQLiteBatch::WriteKey(CDataStream&& key, CDataStream&& value, bool overwrite)
+{
+    if (!m_connection) return false;
+    if (m_read_only)
+        assert(!"Write called on database in read-only mode");
+
+    LOCK(m_connection->m_mutex);
+    sqlite3_stmt* stmt = overwrite ? m_connection->m_overwrite_stmt : m_connection->m_insert_stmt;
+    if (!BindBlob(stmt, 1, key) || !BindBlob(stmt, 2, value)) return false;
+    int res = sqlite3_step(stmt);
+    // Without overwrite, an existing record is a primary key constraint violation
+    if (res != SQLITE_DONE && (overwrite || (res & 0xff) != SQLITE_CONSTRAINT)) {
+        LogPrintf("%s: SQLite error writing a record: %s\n", __func__, sqlite3_errstr(res));
+    }
+    ResetStatement(stmt);
+    return res == SQLITE_DONE;
+}
+
+bool SQLiteBatch::EraseKey(CDataStream&& key)
+{
+    if (!m_connection) return false;
+    if (m_read_only)
+        assert(!"Erase called on database in read-only mode");
+
+    LOCK(m_connection->m_mutex);
+    sqlite3_stmt* stmt = m_connection->m_delete_stmt;
+    if (!BindBlob(stmt, 1, key)) return false;
+    int res = sqlite3_step(stmt);
+    if (res != SQLITE_DONE) {
+        LogPrintf("%s: SQLite error erasing a record: %s\n", __func__, sqlite3_errstr(res));
+    }
+    ResetStatement(stmt);
+    return res == SQLITE_DONE;
+}
+
+bool SQLiteBatch::HasKey(CDataStream&& key)
+{
+    if (!m_connection) return false;
+    LOCK(m_connection->m_mutex);
+    sqlite3_stmt* stmt = m_connection->m_read_stmt;
+    if (!BindBlob(stmt, 1, key)) return false;
+    int res = sqlite3_step(stmt);
+    ResetStatement(stmt);
+    return res == SQLITE_ROW;
+}
+
+bool SQLiteBatch::StartCursor()
+{
+    assert(!m_cursor_stmt);
+    if (!m_connection) return false;
+    int res = sqlite3_prepare_v2(m_connection->m_db, "SELECT key, value FROM main", -1, &m_cursor_stmt, nullptr);
+    if (res != SQLITE_OK) {
+        LogPrintf("%s: SQLite error preparing the cursor: %s\n", __func__, sqlite3_errstr(res));
+        m_cursor_stmt = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool SQLiteBatch::ReadAtCursor(CDataStream& ssKey, CDataStream& ssValue, bool& complete)
+{
+    complete = false;
+    if (!m_cursor_stmt) return false;
+
+    int res = sqlite3_step(m_cursor_stmt);
+    if (res == SQLITE_DONE) {
+        complete = true;
+        return false;
+    }
+    if (res != SQLITE_ROW) {
+        LogPrintf("%s: SQLite error reading at the cursor: %s\n", __func__, sqlite3_errstr(res));
+        return false;
+    }
+
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    ssKey.write(reinterpret_cast<const char*>(sqlite3_column_blob(m_cursor_stmt, 0)), sqlite3_column_bytes(m_cursor_stmt, 0));
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    ssValue.write(reinterpret_cast<const char*>(sqlite3_column_blob(m_cursor_stmt, 1)), sqlite3_column_bytes(m_cursor_stmt, 1));
+    return true;
+}
+
+void SQLiteBatch::CloseCursor()
+{
+    sqlite3_finalize(m_cursor_stmt);
+    m_cursor_stmt = nullptr;
+}
+
+bool SQLiteBatch::TxnBegin()
+{
+    if (!m_connection || m_txn_open) return false;
+    m_txn_open = m_connection->Exec("BEGIN TRANSACTION");
+    return m_txn_open;
+}
+
+bool SQLiteBatch::TxnCommit()
+{
+    if (!m_connection || !m_txn_open) return false;
+    m_txn_open = false;
+    if (!m_connection->Exec("COMMIT TRANSACTION")) {
+        // A transaction that fails to commit is still open
+        m_connection->Exec("ROLLBACK TRANSACTION");
+        return false;
+    }
+    return true;
+}
+
+bool SQLiteBatch::TxnAbort()
+{
+    if (!m_connection || !m_txn_open) return false;
+    m_txn_open = false;
+    return m_connection->Exec("ROLLBACK TRANSACTION");
+}
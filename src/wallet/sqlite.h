@@ -0,0 +1,134 @@
+// Copyright (c) 2020 The Palladium Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PALLADIUM_WALLET_SQLITE_H
+#define PALLADIUM_WALLET_SQLITE_H
+
+#include <sync.h>
+#include <wallet/db.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+/** Identifies the database file as a palladium wallet (PRAGMA application_id) */
+static const int32_t SQLITE_WALLET_APPLICATION_ID = 0x706c6d77; // "plmw"
+/** Version of the wallet table layout (PRAGMA user_version) */
+static const int32_t SQLITE_WALLET_SCHEMA_VERSION = 0;
+
+/** Return whether an SQLite wallet database at path is loaded in this process. */
+bool IsSQLiteDatabaseLoaded(const fs::path& path);
+
+/** A connection to an SQLite wallet database, with the statements used to
+ * access its records prepared once when it is opened. */
+class SQLiteConnection
+{
+public:
+    sqlite3* m_db{nullptr};
+
+    /** Serializes use of the prepared statements, which may be shared by batches on several threads */
+    Mutex m_mutex;
+    sqlite3_stmt* m_read_stmt GUARDED_BY(m_mutex){nullptr};
+    sqlite3_stmt* m_insert_stmt GUARDED_BY(m_mutex){nullptr};
+    sqlite3_stmt* m_overwrite_stmt GUARDED_BY(m_mutex){nullptr};
+    sqlite3_stmt* m_delete_stmt GUARDED_BY(m_mutex){nullptr};
+
+    SQLiteConnection() {}
+    ~SQLiteConnection() { Close(); }
+
+    SQLiteConnection(const SQLiteConnection&) = delete;
+    SQLiteConnection& operator=(const SQLiteConnection&) = delete;
+
+    /** Open the database file, creating it with the wallet table if it does not exist unless read_only is set. */
+    bool Open(const fs::path& path, bool read_only, std::string& error);
+    void Close();
+
+    /** Execute one or more statements that do not return rows. */
+    bool Exec(const char* sql);
+};
+
+/** An instance of this class represents one SQLite wallet database file.
+ *
+ * All writes go through a single connection that is opened on first use and
+ * shared by the batches of this database. The database is kept in WAL mode, so
+ * read-only batches open connections of their own that read the last committed
+ * state without waiting for writers or checkpoints.
+ */
+class SQLiteDatabase : public WalletDatabase
+{
+    friend class SQLiteBatch;
+
+private:
+    const fs::path m_dir_path;
+    const fs::path m_file_path;
+
+    Mutex m_mutex;
+    std::unique_ptr<SQLiteConnection> m_writer GUARDED_BY(m_mutex);
+    /** Number of batches currently open */
+    int m_refcount GUARDED_BY(m_mutex){0};
+
+    /** Return the shared connection, opening the database first if needed. Throws std::runtime_error on failure. */
+    SQLiteConnection& OpenWriter() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    /** Register a new batch, returning the shared connection. */
+    SQLiteConnection& Acquire();
+    void Release();
+
+public:
+    SQLiteDatabase(const fs::path& dir_path, const fs::path& file_path);
+    ~SQLiteDatabase() override;
+
+    bool Rewrite(const char* pszSkip=nullptr) override;
+    bool Backup(const std::string& strDest) const override;
+    void Flush(bool shutdown) override;
+    bool PeriodicFlush() override;
+    bool Sync() override;
+    void ReloadDbEnv() override {}
+    std::unique_ptr<DatabaseBatch> MakeBatch(const char* mode = "r+", bool flush_on_close = true) override;
+
+    /* verifies that the database can be opened by this process */
+    static bool VerifyEnvironment(const fs::path& file_path, std::string& errorStr);
+    /* verifies the database file */
+    static bool VerifyDatabaseFile(const fs::path& file_path, std::vector<std::string>& warnings, std::string& errorStr);
+};
+
+/** RAII class that provides access to an SQLite database */
+class SQLiteBatch : public DatabaseBatch
+{
+private:
+    SQLiteDatabase& m_database;
+    /** Connection of a read-only batch, only used by it */
+    std::unique_ptr<SQLiteConnection> m_reader;
+    /** Connection used by this batch: m_reader or the database's shared one */
+    SQLiteConnection* m_connection{nullptr};
+    bool m_read_only;
+    bool m_txn_open{false};
+    sqlite3_stmt* m_cursor_stmt{nullptr};
+
+    bool ReadKey(CDataStream&& key, CDataStream& value) override;
+    bool WriteKey(CDataStream&& key, CDataStream&& value, bool overwrite = true) override;
+    bool EraseKey(CDataStream&& key) override;
+    bool HasKey(CDataStream&& key) override;
+
+public:
+    /** Open a batch, throwing std::runtime_error if the database cannot be opened. */
+    SQLiteBatch(SQLiteDatabase& database, bool read_only);
+    ~SQLiteBatch() override { Close(); }
+
+    /* No-op: WAL frames are checkpointed into the database file as they accumulate */
+    void Flush() override {}
+    void Close() override;
+
+    bool StartCursor() override;
+    bool ReadAtCursor(CDataStream& ssKey, CDataStream& ssValue, bool& complete) override;
+    void CloseCursor() override;
+
+    bool TxnBegin() override;
+    bool TxnCommit() override;
+    bool TxnAbort() override;
+};
+
+#endif // PALLADIUM_WALLET_SQLITE_H
@@ -2,6 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/palladium-config.h>
+#endif
+
 #include <memory>
 
 #include <boost/test/unit_test.hpp>
@@ -9,6 +13,10 @@
 #include <fs.h>
 #include <test/util/setup_common.h>
 #include <wallet/db.h>
+#include <wallet/walletutil.h>
+#ifdef USE_SQLITE
+#include <wallet/sqlite.h>
+#endif
 
 
 BOOST_FIXTURE_TEST_SUITE(db_tests, BasicTestingSetup)
@@ -69,4 +77,62 @@ BOOST_AUTO_TEST_CASE(getwalletenv_g_dbenvs_free_instance)
     BOOST_CHECK(env_2_a == env_2_b);
 }
 
+#ifdef USE_SQLITE
+BOOST_AUTO_TEST_CASE(sqlite_batch)
+{
+    const fs::path dir = GetDataDir() / "sqlite_batch";
+    fs::create_directories(dir);
+    const fs::path file = dir / "wallet.dat";
+    {
+        SQLiteDatabase database(dir, file);
+        BOOST_CHECK(IsSQLiteDatabaseLoaded(file));
+
+        std::unique_ptr<DatabaseBatch> batch = database.MakeBatch();
+        int value;
+        BOOST_CHECK(batch->Write(std::string("a"), 1));
+        BOOST_CHECK(!batch->Write(std::string("a"), 2, /* fOverwrite */ false));
+        BOOST_CHECK(batch->Read(std::string("a"), value) && value == 1);
+        BOOST_CHECK(batch->Write(std::string("a"), 3));
+        BOOST_CHECK(batch->Read(std::string("a"), value) && value == 3);
+        BOOST_CHECK(batch->Erase(std::string("a")) && !batch->Exists(std::string("a")));
+
+        // Read-only batches do not see what has not been committed yet
+        BOOST_CHECK(batch->TxnBegin());
+        for (int i = 0; i < 10; ++i) {
+            BOOST_CHECK(batch->Write(std::make_pair(std::string("pool"), i), i));
+        }
+        BOOST_CHECK(!database.MakeBatch("r")->Exists(std::make_pair(std::string("pool"), 0)));
+        BOOST_CHECK(batch->TxnCommit());
+        BOOST_CHECK(database.MakeBatch("r")->Exists(std::make_pair(std::string("pool"), 0)));
+
+        BOOST_CHECK(batch->TxnBegin());
+        BOOST_CHECK(batch->Write(std::string("b"), 1));
+        BOOST_CHECK(batch->TxnAbort());
+        BOOST_CHECK(!batch->Exists(std::string("b")));
+
+        BOOST_CHECK(batch->StartCursor());
+        CDataStream key(SER_DISK, CLIENT_VERSION);
+        CDataStream data(SER_DISK, CLIENT_VERSION);
+        bool complete;
+        int records = 0;
+        while (batch->ReadAtCursor(key, data, complete)) ++records;
+        BOOST_CHECK(complete);
+        BOOST_CHECK_EQUAL(records, 10);
+        batch->CloseCursor();
+        batch.reset();
+
+        // Rewrite drops the records with the skipped prefix
+        BOOST_CHECK(database.Rewrite("\x04pool"));
+        BOOST_CHECK(!database.MakeBatch()->Exists(std::make_pair(std::string("pool"), 0)));
+        database.Flush(true);
+    }
+    BOOST_CHECK(!IsSQLiteDatabaseLoaded(file));
+    BOOST_CHECK(IsSQLiteFile(file));
+
+    std::string error;
+    std::vector<std::string> warnings;
+    BOOST_CHECK(SQLiteDatabase::VerifyDatabaseFile(file, warnings, error));
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -40,4 +40,49 @@ BOOST_AUTO_TEST_CASE(CanProvide)
     BOOST_CHECK(keyman.CanProvide(p2sh_script, data));
 }
 
+// Test that topping up the keypool of an HD wallet in batches derives the same
+// keys, paths and chain counters as deriving one key at a time.
+BOOST_AUTO_TEST_CASE(TopUpHDChainMatchesSequentialDerivation)
+{
+    NodeContext node;
+    std::unique_ptr<interfaces::Chain> chain = interfaces::MakeChain(node);
+    CKey seed;
+    seed.MakeNewKey(true);
+
+    CWallet batched_wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+    CWallet serial_wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+    for (CWallet* wallet : {&batched_wallet, &serial_wallet}) {
+        LOCK(wallet->cs_wallet);
+        wallet->SetMinVersion(FEATURE_LATEST);
+        LegacyScriptPubKeyMan& keyman = *wallet->GetOrCreateLegacyScriptPubKeyMan();
+        keyman.SetHDSeed(keyman.DeriveNewSeed(seed));
+    }
+    LegacyScriptPubKeyMan& batched = *batched_wallet.GetLegacyScriptPubKeyMan();
+    LegacyScriptPubKeyMan& serial = *serial_wallet.GetLegacyScriptPubKeyMan();
+
+    const unsigned int size = 150;
+    BOOST_CHECK(batched.TopUp(size));
+
+    std::set<CKeyID> serial_keys;
+    {
+        LOCK(serial.cs_KeyStore);
+        WalletBatch batch(serial_wallet.GetDatabase());
+        for (bool internal : {false, true}) {
+            for (unsigned int i = 0; i < size; ++i) {
+                serial_keys.insert(serial.GenerateNewKey(batch, internal).GetID());
+            }
+        }
+    }
+
+    LOCK(batched.cs_KeyStore);
+    LOCK(serial.cs_KeyStore);
+    BOOST_CHECK_EQUAL(batched.GetAllReserveKeys().size(), 2 * size);
+    for (const auto& entry : batched.GetAllReserveKeys()) {
+        BOOST_CHECK(serial_keys.count(entry.first));
+        BOOST_CHECK_EQUAL(batched.mapKeyMetadata.at(entry.first).hdKeypath, serial.mapKeyMetadata.at(entry.first).hdKeypath);
+    }
+    BOOST_CHECK_EQUAL(batched.GetHDChain().nExternalChainCounter, serial.GetHDChain().nExternalChainCounter);
+    BOOST_CHECK_EQUAL(batched.GetHDChain().nInternalChainCounter, serial.GetHDChain().nInternalChainCounter);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
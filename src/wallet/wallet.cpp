@@ -28,12 +28,20 @@
 #include <util/fees.h>
 #include <util/moneystr.h>
 #include <util/rbf.h>
+#include <util/threadnames.h>
 #include <util/translation.h>
 #include <wallet/coincontrol.h>
 #include <wallet/fees.h>
+#include <wallet/router.h>
 
 #include <algorithm>
 #include <assert.h>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -278,10 +286,229 @@ const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
     LOCK(cs_wallet);
     std::map<uint256, CWalletTx>::const_iterator it = mapWallet.find(hash);
     if (it == mapWallet.end())
-        return nullptr;
+        return GetPagedOutTx(hash);
     return &(it->second);
 }
 
+bool CWallet::ReadPagedOutTx(WalletBatch& batch, const uint256& hash, const PagedOutTx& paged, CWalletTx& wtx) const
+{
+    if (!batch.ReadTx(hash, wtx)) {
+        WalletLogPrintf("Unable to read paged out transaction %s\n", hash.ToString());
+        return false;
+    }
+    // The block height is not stored with the transaction, it is looked up when the wallet is loaded
+    wtx.m_confirm.block_height = paged.block_height;
+    return true;
+}
+
+const CWalletTx* CWallet::GetPagedOutTx(const uint256& hash) const
+{
+    AssertLockHeld(cs_wallet);
+    auto paged = m_paged_out.find(hash);
+    if (paged == m_paged_out.end()) return nullptr;
+
+    auto cached = m_paged_lru_map.find(hash);
+    if (cached != m_paged_lru_map.end()) {
+        m_paged_lru.splice(m_paged_lru.begin(), m_paged_lru, cached->second);
+        return &*cached->second;
+    }
+    // Entries are only evicted by PageOutTransactions, so that the returned
+    // pointer stays valid while cs_wallet is held.
+    m_paged_lru.emplace_front(this, MakeTransactionRef());
+    WalletBatch batch(*database);
+    if (!ReadPagedOutTx(batch, hash, paged->second, m_paged_lru.front())) {
+        m_paged_lru.pop_front();
+        return nullptr;
+    }
+    m_paged_lru_map.emplace(hash, m_paged_lru.begin());
+    return &m_paged_lru.front();
+}
+
+bool CWallet::CanPageOut(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+    if (wtx.GetDepthInMainChain() < PAGE_OUT_MIN_DEPTH || wtx.IsImmatureCoinBase()) return false;
+
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i) {
+        if (IsMine(wtx.tx->vout[i]) == ISMINE_NO) continue;
+        bool spent_deep = false;
+        const auto range = mapTxSpends.equal_range(COutPoint(hash, i));
+        for (auto it = range.first; it != range.second && !spent_deep; ++it) {
+            auto mit = mapWallet.find(it->second);
+            if (mit == mapWallet.end()) {
+                spent_deep = m_paged_out.count(it->second) > 0;
+            } else {
+                spent_deep = mit->second.GetDepthInMainChain() >= PAGE_OUT_MIN_DEPTH;
+            }
+        }
+        if (!spent_deep) return false;
+    }
+    return true;
+}
+
+void CWallet::PageOutTransactions()
+{
+    AssertLockHeld(cs_wallet);
+    if (m_paged_cache_size == 0) return;
+
+    while (m_paged_lru.size() > m_paged_cache_size) {
+        m_paged_lru_map.erase(m_paged_lru.back().GetHash());
+        m_paged_lru.pop_back();
+    }
+
+    std::vector<uint256> page_out;
+    for (const auto& entry : mapWallet) {
+        if (CanPageOut(entry.second)) page_out.push_back(entry.first);
+    }
+    for (const uint256& hash : page_out) {
+        auto it = mapWallet.find(hash);
+        const CWalletTx& wtx = it->second;
+        m_paged_out.emplace(hash, PagedOutTx{wtx.nOrderPos, wtx.m_confirm.block_height});
+        m_paged_out_ordered.emplace(wtx.nOrderPos, hash);
+        wtxOrdered.erase(wtx.m_it_wtxOrdered);
+        mapWallet.erase(it);
+        MarkUnspentDirty(hash);
+    }
+    if (!page_out.empty()) {
+        WalletLogPrintf("Paged out %u spent transactions, %u paged out and %u in memory\n",
+            page_out.size(), m_paged_out.size(), mapWallet.size());
+    }
+}
+
+bool CWallet::PageInTransaction(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet);
+    auto paged = m_paged_out.find(hash);
+    if (paged == m_paged_out.end()) return false;
+
+    CWalletTx wtx(this, MakeTransactionRef());
+    WalletBatch batch(*database);
+    if (!ReadPagedOutTx(batch, hash, paged->second, wtx)) return false;
+
+    const auto range = m_paged_out_ordered.equal_range(paged->second.order_pos);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second == hash) {
+            m_paged_out_ordered.erase(it);
+            break;
+        }
+    }
+    m_paged_out.erase(paged);
+    auto cached = m_paged_lru_map.find(hash);
+    if (cached != m_paged_lru_map.end()) {
+        m_paged_lru.erase(cached->second);
+        m_paged_lru_map.erase(cached);
+    }
+
+    // Its spends were never removed from mapTxSpends
+    CWalletTx& inserted = mapWallet.emplace(hash, wtx).first->second;
+    inserted.m_it_wtxOrdered = wtxOrdered.insert(std::make_pair(inserted.nOrderPos, &inserted));
+    MarkUnspentDirty(hash);
+    return true;
+}
+
+void CWallet::ForEachWalletTx(const std::function<void(const CWalletTx&)>& fn) const
+{
+    AssertLockHeld(cs_wallet);
+    for (const auto& entry : mapWallet) {
+        fn(entry.second);
+    }
+    if (m_paged_out.empty()) return;
+
+    WalletBatch batch(*database, "r");
+    for (const auto& entry : m_paged_out) {
+        CWalletTx wtx(this, MakeTransactionRef());
+        if (ReadPagedOutTx(batch, entry.first, entry.second, wtx)) fn(wtx);
+    }
+}
+
+std::vector<uint256> CWallet::GetRoutingTxids() const
+{
+    AssertLockHeld(cs_wallet);
+    std::vector<uint256> txids;
+    txids.reserve(mapWallet.size() + m_paged_out.size());
+    for (const auto& entry : mapWallet) txids.push_back(entry.first);
+    for (const auto& entry : m_paged_out) txids.push_back(entry.first);
+    // Spends of paged out transactions are kept too
+    for (const auto& spend : mapTxSpends) {
+        if (txids.empty() || txids.back() != spend.first.hash) txids.push_back(spend.first.hash);
+    }
+    return txids;
+}
+
+void CWallet::AddToDestTxOrder(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+    for (const CTxOut& txout : wtx.tx->vout) {
+        CTxDestination dest;
+        if (IsMine(txout) != ISMINE_NO && ExtractDestination(txout.scriptPubKey, dest)) {
+            m_dest_tx_order[dest].insert(wtx.nOrderPos);
+        }
+    }
+}
+
+void CWallet::ForEachOrderedTx(int64_t max_order_pos, const std::string* label, const std::function<bool(const CWalletTx&)>& fn) const
+{
+    AssertLockHeld(cs_wallet);
+    if (!label) {
+        // Merge in the paged out transactions, which are read back as they are reached
+        TxItems::const_reverse_iterator it(wtxOrdered.upper_bound(max_order_pos));
+        std::multimap<int64_t, uint256>::const_reverse_iterator paged_it(m_paged_out_ordered.upper_bound(max_order_pos));
+        while (it != wtxOrdered.rend() || paged_it != m_paged_out_ordered.rend()) {
+            const CWalletTx* wtx;
+            if (paged_it == m_paged_out_ordered.rend() || (it != wtxOrdered.rend() && it->first >= paged_it->first)) {
+                wtx = (it++)->second;
+            } else {
+                wtx = GetPagedOutTx((paged_it++)->second);
+                if (!wtx) continue;
+            }
+            if (!fn(*wtx)) return;
+        }
+        return;
+    }
+
+    if (!m_dest_tx_order_built) {
+        m_dest_tx_order.clear();
+        ForEachWalletTx([this](const CWalletTx& wtx) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet) { AddToDestTxOrder(wtx); });
+        m_dest_tx_order_built = true;
+    }
+
+    // Merge the order positions of all addresses with the label, newest first
+    typedef std::set<int64_t>::const_reverse_iterator PosIt;
+    const auto newer = [](const std::pair<PosIt, PosIt>& a, const std::pair<PosIt, PosIt>& b) { return *a.first < *b.first; };
+    std::priority_queue<std::pair<PosIt, PosIt>, std::vector<std::pair<PosIt, PosIt>>, decltype(newer)> heads(newer);
+    const auto label_addresses = m_label_addresses.find(*label);
+    if (label_addresses == m_label_addresses.end()) return;
+    for (const CTxDestination& dest : label_addresses->second) {
+        const auto positions = m_dest_tx_order.find(dest);
+        if (positions == m_dest_tx_order.end()) continue;
+        PosIt begin(positions->second.upper_bound(max_order_pos));
+        if (begin != positions->second.rend()) heads.emplace(begin, positions->second.rend());
+    }
+    int64_t last_pos = std::numeric_limits<int64_t>::max();
+    bool first = true;
+    while (!heads.empty()) {
+        auto head = heads.top();
+        heads.pop();
+        const int64_t pos = *head.first;
+        if (++head.first != head.second) heads.push(head);
+        // A transaction paying to several addresses with the label is visited once
+        if (!first && pos == last_pos) continue;
+        first = false;
+        last_pos = pos;
+
+        const CWalletTx* wtx = nullptr;
+        const auto it = wtxOrdered.find(pos);
+        if (it != wtxOrdered.end()) {
+            wtx = it->second;
+        } else {
+            const auto paged = m_paged_out_ordered.find(pos);
+            if (paged != m_paged_out_ordered.end()) wtx = GetPagedOutTx(paged->second);
+        }
+        if (wtx && !fn(*wtx)) return;
+    }
+}
+
 void CWallet::UpgradeKeyMetadata()
 {
     if (IsLocked() || IsWalletFlagSet(WALLET_FLAG_KEY_ORIGIN_METADATA)) {
@@ -452,7 +679,10 @@ void CWallet::SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator> ran
     int nMinOrderPos = std::numeric_limits<int>::max();
     const CWalletTx* copyFrom = nullptr;
     for (TxSpends::iterator it = range.first; it != range.second; ++it) {
-        const CWalletTx* wtx = &mapWallet.at(it->second);
+        // Paged out spenders keep their metadata
+        auto mit = mapWallet.find(it->second);
+        if (mit == mapWallet.end()) continue;
+        const CWalletTx* wtx = &mit->second;
         if (wtx->nOrderPos < nMinOrderPos) {
             nMinOrderPos = wtx->nOrderPos;
             copyFrom = wtx;
@@ -466,8 +696,9 @@ void CWallet::SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator> ran
     // Now copy data from copyFrom to rest:
     for (TxSpends::iterator it = range.first; it != range.second; ++it)
     {
-        const uint256& hash = it->second;
-        CWalletTx* copyTo = &mapWallet.at(hash);
+        auto mit = mapWallet.find(it->second);
+        if (mit == mapWallet.end()) continue;
+        CWalletTx* copyTo = &mit->second;
         if (copyFrom == copyTo) continue;
         assert(copyFrom && "Oldest wallet transaction in range assumed to have been found.");
         if (!copyFrom->IsEquivalentTo(*copyTo)) continue;
@@ -500,6 +731,8 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
             int depth = mit->second.GetDepthInMainChain();
             if (depth > 0  || (depth == 0 && !mit->second.isAbandoned()))
                 return true; // Spent
+        } else if (m_paged_out.count(wtxid)) {
+            return true; // Spent deep in the chain
         }
     }
     return false;
@@ -508,6 +741,7 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(std::make_pair(outpoint, wtxid));
+    MarkUnspentDirty(outpoint.hash);
 
     setLockedCoins.erase(outpoint);
 
@@ -517,6 +751,48 @@ void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 }
 
 
+void CWallet::MarkUnspentDirty(const uint256& txid) const
+{
+    LOCK(m_unspent_dirty_mutex);
+    if (!m_unspent_rebuild) m_unspent_dirty.insert(txid);
+}
+
+void CWallet::UpdateUnspent() const
+{
+    AssertLockHeld(cs_wallet);
+    std::set<uint256> dirty;
+    bool rebuild;
+    {
+        LOCK(m_unspent_dirty_mutex);
+        dirty.swap(m_unspent_dirty);
+        rebuild = m_unspent_rebuild;
+        m_unspent_rebuild = false;
+    }
+
+    auto refresh = [this](const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet) {
+        m_unspent.erase(m_unspent.lower_bound(COutPoint(txid, 0)),
+                        m_unspent.lower_bound(COutPoint(txid, COutPoint::NULL_INDEX)));
+        auto it = mapWallet.find(txid);
+        if (it == mapWallet.end()) return;
+        const CWalletTx& wtx = it->second;
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i) {
+            if (IsMine(wtx.tx->vout[i]) == ISMINE_NO) continue;
+            if (IsSpent(txid, i) && !wtx.IsCoinBase()) continue;
+            m_unspent.emplace(txid, i);
+        }
+    };
+    if (rebuild) {
+        m_unspent.clear();
+        for (const auto& entry : mapWallet) {
+            refresh(entry.first);
+        }
+    } else {
+        for (const uint256& txid : dirty) {
+            refresh(txid);
+        }
+    }
+}
+
 void CWallet::AddToSpends(const uint256& wtxid)
 {
     auto it = mapWallet.find(wtxid);
@@ -658,7 +934,7 @@ DBErrors CWallet::ReorderTransactions()
             nOrderPos = nOrderPosNext++;
             nOrderPosOffsets.push_back(nOrderPos);
 
-            if (!batch.WriteTx(*pwtx))
+            if (!batch.WriteTxBulk(*pwtx))
                 return DBErrors::LOAD_FAIL;
         }
         else
@@ -676,10 +952,12 @@ DBErrors CWallet::ReorderTransactions()
                 continue;
 
             // Since we're changing the order, write it back
-            if (!batch.WriteTx(*pwtx))
+            if (!batch.WriteTxBulk(*pwtx))
                 return DBErrors::LOAD_FAIL;
         }
     }
+    if (!batch.CommitBulk())
+        return DBErrors::LOAD_FAIL;
     batch.WriteOrderPosNext(nOrderPosNext);
 
     return DBErrors::LOAD_OK;
@@ -703,7 +981,16 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& item : mapWallet)
             item.second.MarkDirty();
+        m_paged_lru.clear();
+        m_paged_lru_map.clear();
+        // What is ours may have changed
+        m_dest_tx_order.clear();
+        m_dest_tx_order_built = false;
+        m_groupings_built = false;
     }
+    LOCK(m_unspent_dirty_mutex);
+    m_unspent_dirty.clear();
+    m_unspent_rebuild = true;
 }
 
 bool CWallet::MarkReplaced(const uint256& originalHash, const uint256& newHash)
@@ -789,8 +1076,15 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     LOCK(cs_wallet);
 
     WalletBatch batch(*database, "r+", fFlushOnClose);
+    return AddToWallet(batch, wtxIn);
+}
+
+bool CWallet::AddToWallet(WalletBatch& batch, const CWalletTx& wtxIn)
+{
+    LOCK(cs_wallet);
 
     uint256 hash = wtxIn.GetHash();
+    PageInTransaction(hash);
 
     if (IsWalletFlagSet(WALLET_FLAG_AVOID_REUSE)) {
         // Mark used destinations
@@ -815,6 +1109,18 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         wtx.m_it_wtxOrdered = wtxOrdered.insert(std::make_pair(wtx.nOrderPos, &wtx));
         wtx.nTimeSmart = ComputeTimeSmart(wtx);
         AddToSpends(hash);
+        if (m_dest_tx_order_built) AddToDestTxOrder(wtx);
+        if (m_groupings_built) {
+            AddToGroupings(wtx);
+            // Wallet transactions spending this one now have inputs that are ours
+            for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i) {
+                const auto range = mapTxSpends.equal_range(COutPoint(hash, i));
+                for (auto it = range.first; it != range.second; ++it) {
+                    const CWalletTx* spender = GetWalletTx(it->second);
+                    if (spender) AddToGroupings(*spender);
+                }
+            }
+        }
     }
 
     bool fUpdated = false;
@@ -945,7 +1251,12 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, CWalletTx::Co
             }
         }
 
-        bool fExisted = mapWallet.count(tx.GetHash()) != 0;
+        const auto paged = m_paged_out.find(tx.GetHash());
+        if (paged != m_paged_out.end() && confirm.status == CWalletTx::CONFIRMED && confirm.block_height == paged->second.block_height) {
+            // Seen again in the block it was paged out with, e.g. by a rescan, so there is nothing to update
+            return fUpdate;
+        }
+        bool fExisted = mapWallet.count(tx.GetHash()) != 0 || paged != m_paged_out.end();
         if (fExisted && !fUpdate) return false;
         if (fExisted || IsMine(tx) || IsFromMe(tx))
         {
@@ -1072,6 +1383,8 @@ void CWallet::MarkConflicted(const uint256& hashBlock, int conflicting_height, c
         uint256 now = *todo.begin();
         todo.erase(now);
         done.insert(now);
+        // Only a reorg this deep can conflict paged out transactions
+        PageInTransaction(now);
         auto it = mapWallet.find(now);
         assert(it != mapWallet.end());
         CWalletTx& wtx = it->second;
@@ -1160,6 +1473,13 @@ void CWallet::transactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRe
 }
 
 void CWallet::blockConnected(const CBlock& block, int height)
+{
+    std::vector<size_t> tx_indexes(block.vtx.size());
+    std::iota(tx_indexes.begin(), tx_indexes.end(), 0);
+    blockConnected(block, height, tx_indexes);
+}
+
+void CWallet::blockConnected(const CBlock& block, int height, const std::vector<size_t>& tx_indexes)
 {
     const uint256& block_hash = block.GetHash();
     auto locked_chain = chain().lock();
@@ -1167,13 +1487,20 @@ void CWallet::blockConnected(const CBlock& block, int height)
 
     m_last_block_processed_height = height;
     m_last_block_processed = block_hash;
-    for (size_t index = 0; index < block.vtx.size(); index++) {
+    for (size_t index : tx_indexes) {
         SyncTransaction(block.vtx[index], {CWalletTx::Status::CONFIRMED, height, block_hash, (int)index});
         transactionRemovedFromMempool(block.vtx[index], MemPoolRemovalReason::BLOCK);
     }
 }
 
 void CWallet::blockDisconnected(const CBlock& block, int height)
+{
+    std::vector<size_t> tx_indexes(block.vtx.size());
+    std::iota(tx_indexes.begin(), tx_indexes.end(), 0);
+    blockDisconnected(block, height, tx_indexes);
+}
+
+void CWallet::blockDisconnected(const CBlock& block, int height, const std::vector<size_t>& tx_indexes)
 {
     auto locked_chain = chain().lock();
     LOCK(cs_wallet);
@@ -1184,8 +1511,8 @@ void CWallet::blockDisconnected(const CBlock& block, int height)
     // future with a stickier abandoned state or even removing abandontransaction call.
     m_last_block_processed_height = height - 1;
     m_last_block_processed = block.hashPrevBlock;
-    for (const CTransactionRef& ptx : block.vtx) {
-        SyncTransaction(ptx, {CWalletTx::Status::UNCONFIRMED, /* block height */ 0, /* block hash */ {}, /* index */ 0});
+    for (size_t index : tx_indexes) {
+        SyncTransaction(block.vtx[index], {CWalletTx::Status::UNCONFIRMED, /* block height */ 0, /* block hash */ {}, /* index */ 0});
     }
 }
 
@@ -1210,12 +1537,9 @@ isminetype CWallet::IsMine(const CTxIn &txin) const
 {
     {
         LOCK(cs_wallet);
-        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
-        if (mi != mapWallet.end())
-        {
-            const CWalletTx& prev = (*mi).second;
-            if (txin.prevout.n < prev.tx->vout.size())
-                return IsMine(prev.tx->vout[txin.prevout.n]);
+        const CWalletTx* prev = GetWalletTx(txin.prevout.hash);
+        if (prev && txin.prevout.n < prev->tx->vout.size()) {
+            return IsMine(prev->tx->vout[txin.prevout.n]);
         }
     }
     return ISMINE_NO;
@@ -1227,13 +1551,10 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
 {
     {
         LOCK(cs_wallet);
-        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
-        if (mi != mapWallet.end())
-        {
-            const CWalletTx& prev = (*mi).second;
-            if (txin.prevout.n < prev.tx->vout.size())
-                if (IsMine(prev.tx->vout[txin.prevout.n]) & filter)
-                    return prev.tx->vout[txin.prevout.n].nValue;
+        const CWalletTx* prev = GetWalletTx(txin.prevout.hash);
+        if (prev && txin.prevout.n < prev->tx->vout.size()) {
+            if (IsMine(prev->tx->vout[txin.prevout.n]) & filter)
+                return prev->tx->vout[txin.prevout.n].nValue;
         }
     }
     return 0;
@@ -1331,11 +1652,11 @@ bool CWallet::IsAllFromMe(const CTransaction& tx, const isminefilter& filter) co
 
     for (const CTxIn& txin : tx.vin)
     {
-        auto mi = mapWallet.find(txin.prevout.hash);
-        if (mi == mapWallet.end())
+        const CWalletTx* wtx_prev = GetWalletTx(txin.prevout.hash);
+        if (!wtx_prev)
             return false; // any unknown inputs can't be from us
 
-        const CWalletTx& prev = (*mi).second;
+        const CWalletTx& prev = *wtx_prev;
 
         if (txin.prevout.n >= prev.tx->vout.size())
             return false; // invalid input!
@@ -1573,6 +1894,15 @@ int CalculateMaximumSignedInputSize(const CTxOut& txout, const CWallet* wallet,
 void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
                            std::list<COutputEntry>& listSent, CAmount& nFee, const isminefilter& filter) const
 {
+    const uint64_t address_book_generation = pwallet->m_address_book_generation;
+    auto cached = m_output_entries.find(filter);
+    if (cached != m_output_entries.end() && cached->second.address_book_generation == address_book_generation) {
+        listReceived = cached->second.received;
+        listSent = cached->second.sent;
+        nFee = cached->second.fee;
+        return;
+    }
+
     nFee = 0;
     listReceived.clear();
     listSent.clear();
@@ -1623,6 +1953,7 @@ void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
             listReceived.push_back(output);
     }
 
+    m_output_entries[filter] = CachedOutputEntries{listReceived, listSent, nFee, address_book_generation};
 }
 
 /**
@@ -1681,6 +2012,246 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
  * the main chain after to the addition of any new keys you want to detect
  * transactions for.
  */
+namespace {
+//! Number of blocks whose filters are matched at once during a rescan
+static constexpr int RESCAN_FILTER_BATCH = 500;
+//! Maximum number of blocks read ahead of the one being scanned
+static constexpr int RESCAN_READ_AHEAD = 16;
+//! Maximum number of threads reading blocks during a rescan
+static constexpr int MAX_RESCAN_READ_THREADS = 4;
+
+/**
+ * Provides the blocks of a rescan in chain order. When a basic block filter
+ * index is available, blocks whose filter matches none of the wallet's
+ * scriptPubKeys are skipped without being read; the others are read and
+ * deserialized on worker threads ahead of the block being scanned.
+ *
+ * Since the filters cover the outputs of a block and the outputs spent by it,
+ * a skipped block can neither pay to nor spend from the wallet. It may still
+ * hold a transaction conflicting with a wallet transaction through an input
+ * that isn't the wallet's, which a filtered rescan doesn't detect.
+ */
+class RescanBlockReader
+{
+public:
+    enum class Result {
+        NOT_INVOLVED, //!< The block filter rules out any wallet transaction
+        READ,         //!< The block was read
+        NOT_FOUND,    //!< The block is not available, e.g. pruned
+    };
+
+    RescanBlockReader(const CWallet& wallet, interfaces::Chain& chain, const uint256& stop_block)
+        : m_wallet(wallet), m_chain(chain), m_stop_block(stop_block),
+          m_use_filters(chain.hasBlockFilterIndex(BlockFilterType::BASIC))
+    {
+        if (m_use_filters) LoadFilterSet();
+        const int threads = std::max(1, std::min(GetNumCores(), MAX_RESCAN_READ_THREADS));
+        for (int i = 0; i < threads; ++i) {
+            m_threads.emplace_back([this, i] {
+                util::ThreadRename(strprintf("rescan.%i", i));
+                ThreadRead();
+            });
+        }
+    }
+
+    ~RescanBlockReader()
+    {
+        {
+            LOCK(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    /** Get the block at a height of the chain being scanned. Blocks must be asked for in order. */
+    Result Get(int height, const uint256& block_hash, CBlock& block)
+    {
+        bool planned;
+        {
+            LOCK(m_mutex);
+            planned = height >= m_batch_start && height < m_batch_start + (int)m_batch.size() &&
+                      m_batch[height - m_batch_start].hash == block_hash;
+        }
+        if (!planned) Plan(height, block_hash);
+
+        WAIT_LOCK(m_mutex, lock);
+        const size_t index = height - m_batch_start;
+        m_current = index;
+        Entry& entry = m_batch[index];
+        if (!entry.match) return Result::NOT_INVOLVED;
+        Schedule();
+        m_read_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return entry.done; });
+        --m_in_flight;
+        const bool found = entry.found;
+        block = std::move(entry.block);
+        entry.block.SetNull();
+        m_current = index + 1;
+        Schedule();
+        return found ? Result::READ : Result::NOT_FOUND;
+    }
+
+    /**
+     * Match the blocks not scanned yet again if the wallet has learned new
+     * scriptPubKeys, e.g. when its keypool was topped up.
+     */
+    void UpdateFilterSet()
+    {
+        if (!m_use_filters) return;
+        const size_t old_size = m_filter_set.size();
+        LoadFilterSet();
+        if (m_filter_set.size() == old_size) return;
+
+        int start_height;
+        uint256 stop_hash;
+        {
+            LOCK(m_mutex);
+            if (m_current >= m_batch.size()) return;
+            start_height = m_batch_start + m_current;
+            stop_hash = m_batch.back().hash;
+        }
+        std::vector<bool> matches;
+        if (!m_chain.blockFiltersMatchAny(BlockFilterType::BASIC, start_height, stop_hash, m_filter_set, matches)) {
+            matches.clear();
+        }
+
+        LOCK(m_mutex);
+        if (start_height != m_batch_start + (int)m_current) return;
+        for (size_t i = m_current; i < m_batch.size(); ++i) {
+            const size_t offset = i - m_current;
+            // The filter set only grows, so blocks that matched keep matching.
+            if (offset >= matches.size() || matches[offset]) m_batch[i].match = true;
+        }
+        m_next_read = m_current;
+        Schedule();
+    }
+
+private:
+    struct Entry {
+        uint256 hash;
+        bool match{true};
+        bool queued{false};
+        bool done{false};
+        bool found{false};
+        CBlock block;
+    };
+
+    const CWallet& m_wallet;
+    interfaces::Chain& m_chain;
+    const uint256 m_stop_block;
+    const bool m_use_filters;
+    //! The scriptPubKeys of the wallet, only accessed by the scanning thread
+    GCSFilter::ElementSet m_filter_set;
+
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_read_cv;
+    std::vector<std::thread> m_threads;
+    bool m_stop GUARDED_BY(m_mutex){false};
+    //! Blocks from height m_batch_start on
+    std::vector<Entry> m_batch GUARDED_BY(m_mutex);
+    int m_batch_start GUARDED_BY(m_mutex){-1};
+    //! Incremented when a new batch is planned, so that reads of the previous one are dropped
+    uint64_t m_generation GUARDED_BY(m_mutex){0};
+    //! Indexes of m_batch to read
+    std::deque<size_t> m_queue GUARDED_BY(m_mutex);
+    //! Index of the entry being scanned, and of the next one to consider reading
+    size_t m_current GUARDED_BY(m_mutex){0};
+    size_t m_next_read GUARDED_BY(m_mutex){0};
+    //! Number of blocks queued or read but not scanned yet
+    int m_in_flight GUARDED_BY(m_mutex){0};
+
+    void LoadFilterSet()
+    {
+        LOCK(m_wallet.cs_wallet);
+        for (const ScriptPubKeyMan* spk_man : m_wallet.GetAllScriptPubKeyMans()) {
+            for (const CScript& script : spk_man->GetScriptPubKeys()) {
+                m_filter_set.emplace(script.begin(), script.end());
+            }
+        }
+    }
+
+    /** Set up a batch of blocks starting at height, and match them against the block filters. */
+    void Plan(int height, const uint256& block_hash)
+    {
+        std::vector<uint256> hashes{block_hash};
+        {
+            auto locked_chain = m_chain.lock();
+            const Optional<int> tip_height = locked_chain->getHeight();
+            if (block_hash != m_stop_block && tip_height && locked_chain->getBlockHeight(block_hash) == height) {
+                const int end_height = std::min(*tip_height, height + RESCAN_FILTER_BATCH - 1);
+                for (int h = height + 1; h <= end_height; ++h) {
+                    hashes.push_back(locked_chain->getBlockHash(h));
+                    if (hashes.back() == m_stop_block) break;
+                }
+            }
+        }
+        std::vector<bool> matches;
+        if (m_use_filters && !m_chain.blockFiltersMatchAny(BlockFilterType::BASIC, height, hashes.back(), m_filter_set, matches)) {
+            matches.clear();
+        }
+
+        LOCK(m_mutex);
+        ++m_generation;
+        m_queue.clear();
+        m_batch.clear();
+        m_batch.resize(hashes.size());
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            m_batch[i].hash = hashes[i];
+            if (i < matches.size()) m_batch[i].match = matches[i];
+        }
+        m_batch_start = height;
+        m_current = 0;
+        m_next_read = 0;
+        m_in_flight = 0;
+    }
+
+    /** Queue matching blocks for reading, up to RESCAN_READ_AHEAD of them. */
+    void Schedule() EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        bool queued = false;
+        m_next_read = std::max(m_next_read, m_current);
+        while (m_next_read < m_batch.size() && m_in_flight < RESCAN_READ_AHEAD) {
+            Entry& entry = m_batch[m_next_read++];
+            if (!entry.match || entry.queued) continue;
+            entry.queued = true;
+            m_queue.push_back(m_next_read - 1);
+            ++m_in_flight;
+            queued = true;
+        }
+        if (queued) m_cv.notify_all();
+    }
+
+    void ThreadRead()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (true) {
+            m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || !m_queue.empty(); });
+            if (m_stop) return;
+            const size_t index = m_queue.front();
+            m_queue.pop_front();
+            const uint64_t generation = m_generation;
+            const uint256 hash = m_batch[index].hash;
+
+            CBlock block;
+            bool found;
+            {
+                REVERSE_LOCK(lock);
+                found = m_chain.findBlock(hash, &block) && !block.IsNull();
+            }
+            if (generation != m_generation) continue;
+            Entry& entry = m_batch[index];
+            entry.done = true;
+            entry.found = found;
+            entry.block = std::move(block);
+            m_read_cv.notify_all();
+        }
+    }
+};
+} // namespace
+
 CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_block, const uint256& stop_block, const WalletRescanReserver& reserver, bool fUpdate)
 {
     int64_t nNow = GetTime();
@@ -1710,6 +2281,7 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
         progress_end = chain().guessVerificationProgress(stop_block.IsNull() ? tip_hash : stop_block);
     }
     double progress_current = progress_begin;
+    RescanBlockReader reader(*this, chain(), stop_block);
     while (block_height && !fAbortRescan && !chain().shutdownRequested()) {
         m_scanning_progress = (progress_current - progress_begin) / (progress_end - progress_begin);
         if (*block_height % 100 == 0 && progress_end - progress_begin > 0.0) {
@@ -1721,7 +2293,11 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
         }
 
         CBlock block;
-        if (chain().findBlock(block_hash, &block) && !block.IsNull()) {
+        const RescanBlockReader::Result read = reader.Get(*block_height, block_hash, block);
+        if (read == RescanBlockReader::Result::NOT_INVOLVED) {
+            result.last_scanned_block = block_hash;
+            result.last_scanned_height = *block_height;
+        } else if (read == RescanBlockReader::Result::READ) {
             auto locked_chain = chain().lock();
             LOCK(cs_wallet);
             if (!locked_chain->getBlockHeight(block_hash)) {
@@ -1733,9 +2309,12 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
                 result.status = ScanResult::FAILURE;
                 break;
             }
+            const size_t wallet_size = mapWallet.size();
             for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
                 SyncTransaction(block.vtx[posInBlock], {CWalletTx::Status::CONFIRMED, *block_height, block_hash, (int)posInBlock}, fUpdate);
             }
+            // New transactions may have used keys from the keypool and topped it up.
+            if (mapWallet.size() != wallet_size) reader.UpdateFilterSet();
             // scan succeeded, record block as most recent successfully scanned
             result.last_scanned_block = block_hash;
             result.last_scanned_height = *block_height;
@@ -1998,6 +2577,18 @@ bool CWalletTx::IsTrusted(interfaces::Chain::Lock& locked_chain, std::set<uint25
     return true;
 }
 
+void CWalletTx::MarkDirty()
+{
+    m_amounts[DEBIT].Reset();
+    m_amounts[CREDIT].Reset();
+    m_amounts[IMMATURE_CREDIT].Reset();
+    m_amounts[AVAILABLE_CREDIT].Reset();
+    fChangeCached = false;
+    m_output_entries.clear();
+    m_is_cache_empty = true;
+    if (pwallet) pwallet->MarkUnspentDirty(GetHash());
+}
+
 bool CWalletTx::IsEquivalentTo(const CWalletTx& _tx) const
 {
         CMutableTransaction tx1 {*this->tx};
@@ -2065,6 +2656,14 @@ void MaybeResendWalletTxs()
     }
 }
 
+void MaybePageOutWalletTxs()
+{
+    for (const std::shared_ptr<CWallet>& pwallet : GetWallets()) {
+        LOCK(pwallet->cs_wallet);
+        pwallet->PageOutTransactions();
+    }
+}
+
 
 /** @defgroup Actions
  *
@@ -2079,10 +2678,14 @@ CWallet::Balance CWallet::GetBalance(const int min_depth, bool avoid_reuse) cons
     {
         auto locked_chain = chain().lock();
         LOCK(cs_wallet);
+        UpdateUnspent();
         std::set<uint256> trusted_parents;
-        for (const auto& entry : mapWallet)
+        // Only transactions with unspent outputs can contribute to the balance.
+        for (auto it = m_unspent.begin(); it != m_unspent.end(); it = m_unspent.lower_bound(COutPoint(it->hash, COutPoint::NULL_INDEX)))
         {
-            const CWalletTx& wtx = entry.second;
+            auto wtx_it = mapWallet.find(it->hash);
+            if (wtx_it == mapWallet.end()) continue;
+            const CWalletTx& wtx = wtx_it->second;
             const bool is_trusted{wtx.IsTrusted(*locked_chain, trusted_parents)};
             const int tx_depth{wtx.GetDepthInMainChain()};
             const CAmount tx_credit_mine{wtx.GetAvailableCredit(/* fUseCache */ true, ISMINE_SPENDABLE | reuse_filter)};
@@ -2130,11 +2733,20 @@ void CWallet::AvailableCoins(interfaces::Chain::Lock& locked_chain, std::vector<
     const int min_depth = {coinControl ? coinControl->m_min_depth : DEFAULT_MIN_DEPTH};
     const int max_depth = {coinControl ? coinControl->m_max_depth : DEFAULT_MAX_DEPTH};
 
+    UpdateUnspent();
     std::set<uint256> trusted_parents;
-    for (const auto& entry : mapWallet)
+    auto unspent_it = m_unspent.begin();
+    while (unspent_it != m_unspent.end())
     {
-        const uint256& wtxid = entry.first;
-        const CWalletTx& wtx = entry.second;
+        // Visit the unspent outputs one transaction at a time.
+        const uint256 wtxid = unspent_it->hash;
+        const auto outputs_begin = unspent_it;
+        const auto outputs_end = m_unspent.lower_bound(COutPoint(wtxid, COutPoint::NULL_INDEX));
+        unspent_it = outputs_end;
+
+        auto wtx_it = mapWallet.find(wtxid);
+        if (wtx_it == mapWallet.end()) continue;
+        const CWalletTx& wtx = wtx_it->second;
 
         if (!locked_chain.checkFinalTx(*wtx.tx)) {
             continue;
@@ -2193,14 +2805,15 @@ void CWallet::AvailableCoins(interfaces::Chain::Lock& locked_chain, std::vector<
             continue;
         }
 
-        for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        for (auto output = outputs_begin; output != outputs_end; ++output) {
+            const unsigned int i = output->n;
             if (wtx.tx->vout[i].nValue < nMinimumAmount || wtx.tx->vout[i].nValue > nMaximumAmount)
                 continue;
 
-            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(entry.first, i)))
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(*output))
                 continue;
 
-            if (IsLockedCoin(entry.first, i))
+            if (IsLockedCoin(wtxid, i))
                 continue;
 
             if (IsSpent(wtxid, i))
@@ -2298,7 +2911,7 @@ const CTxOut& CWallet::FindNonChangeParentOutput(const CTransaction& tx, int out
     return ptx->vout[n];
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, std::vector<OutputGroup> groups,
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, const std::vector<OutputGroup>& groups,
                                  std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used) const
 {
     setCoinsRet.clear();
@@ -2316,9 +2929,10 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibil
         CAmount cost_of_change = GetDiscardRate(*this).GetFee(coin_selection_params.change_spend_size) + coin_selection_params.effective_fee.GetFee(coin_selection_params.change_output_size);
 
         // Filter by the min conf specs and add to utxo_pool and calculate effective value
-        for (OutputGroup& group : groups) {
-            if (!group.EligibleForSpending(eligibility_filter)) continue;
+        for (const OutputGroup& eligible_group : groups) {
+            if (!eligible_group.EligibleForSpending(eligibility_filter)) continue;
 
+            OutputGroup group = eligible_group;
             group.fee = 0;
             group.long_term_fee = 0;
             group.effective_value = 0;
@@ -2339,7 +2953,7 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibil
                     it = group.Discard(coin);
                 }
             }
-            if (group.effective_value > 0) utxo_pool.push_back(group);
+            if (group.effective_value > 0) utxo_pool.push_back(std::move(group));
         }
         // Calculate the fees for things that aren't inputs
         CAmount not_input_fees = coin_selection_params.effective_fee.GetFee(coin_selection_params.tx_noinputs_size);
@@ -2429,6 +3043,11 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
         Shuffle(vCoins.begin(), vCoins.end(), FastRandomContext());
     }
     std::vector<OutputGroup> groups = GroupOutputs(vCoins, !coin_control.m_avoid_partial_spends);
+    // Sort the groups by value once for all the attempts below, so that BnB
+    // does not have to sort its pool again each time
+    std::sort(groups.begin(), groups.end(), [](const OutputGroup& a, const OutputGroup& b) {
+        return a.m_value > b.m_value;
+    });
 
     unsigned int limit_ancestor_count;
     unsigned int limit_descendant_count;
@@ -2759,6 +3378,44 @@ OutputType CWallet::TransactionChangeType(OutputType change_type, const std::vec
 
 bool CWallet::CreateTransaction(interfaces::Chain::Lock& locked_chain, const std::vector<CRecipient>& vecSend, CTransactionRef& tx, CAmount& nFeeRet,
                          int& nChangePosInOut, std::string& strFailReason, const CCoinControl& coin_control, bool sign)
+{
+    return CreateTransactionInternal(locked_chain, vecSend, tx, nFeeRet, nChangePosInOut, strFailReason, coin_control, sign, nullptr);
+}
+
+bool CWallet::CreateTransactions(interfaces::Chain::Lock& locked_chain, const std::vector<std::vector<CRecipient>>& vecSends, std::vector<CTransactionRef>& txs,
+                         std::string& strFailReason, const CCoinControl& coin_control)
+{
+    // The available coins point into mapWallet, which must not change until all transactions are created
+    LOCK(cs_wallet);
+    txs.clear();
+
+    std::vector<COutput> available_coins;
+    AvailableCoins(locked_chain, available_coins, true, &coin_control, 1, MAX_MONEY, MAX_MONEY, 0);
+
+    std::vector<CTransactionRef> created;
+    for (const std::vector<CRecipient>& vecSend : vecSends) {
+        CTransactionRef tx;
+        CAmount fee;
+        int change_pos = -1;
+        if (!CreateTransactionInternal(locked_chain, vecSend, tx, fee, change_pos, strFailReason, coin_control, true, &available_coins)) {
+            return false;
+        }
+
+        std::set<COutPoint> spent;
+        for (const CTxIn& txin : tx->vin) {
+            spent.insert(txin.prevout);
+        }
+        available_coins.erase(std::remove_if(available_coins.begin(), available_coins.end(), [&](const COutput& output) {
+            return spent.count(COutPoint(output.tx->GetHash(), output.i)) > 0;
+        }), available_coins.end());
+        created.push_back(std::move(tx));
+    }
+    txs = std::move(created);
+    return true;
+}
+
+bool CWallet::CreateTransactionInternal(interfaces::Chain::Lock& locked_chain, const std::vector<CRecipient>& vecSend, CTransactionRef& tx, CAmount& nFeeRet,
+                         int& nChangePosInOut, std::string& strFailReason, const CCoinControl& coin_control, bool sign, const std::vector<COutput>* available_coins)
 {
     CAmount nValue = 0;
     const OutputType change_type = TransactionChangeType(coin_control.m_change_type ? *coin_control.m_change_type : m_default_change_type, vecSend);
@@ -2795,8 +3452,11 @@ bool CWallet::CreateTransaction(interfaces::Chain::Lock& locked_chain, const std
         auto locked_chain = chain().lock();
         LOCK(cs_wallet);
         {
-            std::vector<COutput> vAvailableCoins;
-            AvailableCoins(*locked_chain, vAvailableCoins, true, &coin_control, 1, MAX_MONEY, MAX_MONEY, 0);
+            std::vector<COutput> vListedCoins;
+            if (!available_coins) {
+                AvailableCoins(*locked_chain, vListedCoins, true, &coin_control, 1, MAX_MONEY, MAX_MONEY, 0);
+            }
+            const std::vector<COutput>& vAvailableCoins = available_coins ? *available_coins : vListedCoins;
             CoinSelectionParams coin_selection_params; // Parameters for coin selection, init with dummy
 
             // Create change script that will be used if we need change
@@ -3125,17 +3785,60 @@ void CWallet::CommitTransaction(CTransactionRef tx, mapValue_t mapValue, std::ve
     // otherwise just for transaction history.
     AddToWallet(wtxNew);
 
+    // Don't relay a transaction the wallet could forget about on a crash
+    if (!database->Sync()) {
+        WalletLogPrintf("CommitTransaction(): Unable to sync the wallet database\n");
+    }
+
+    RelayCommittedTransaction(wtxNew.GetHash());
+}
+
+void CWallet::CommitTransactions(const std::vector<CTransactionRef>& txs, const mapValue_t& mapValue)
+{
+    auto locked_chain = chain().lock();
+    LOCK(cs_wallet);
+
+    {
+        WalletBatch batch(*database);
+        // Without a database transaction, e.g. for dummy databases, each record is written on its own
+        const bool txn = batch.TxnBegin();
+        for (const CTransactionRef& tx : txs) {
+            CWalletTx wtxNew(this, tx);
+            wtxNew.mapValue = mapValue;
+            wtxNew.fTimeReceivedIsTxTime = true;
+            wtxNew.fFromMe = true;
+
+            WalletLogPrintf("CommitTransactions:\n%s", wtxNew.tx->ToString()); /* Continued */
+            AddToWallet(batch, wtxNew);
+        }
+        if (txn && !batch.TxnCommit()) {
+            WalletLogPrintf("CommitTransactions(): Unable to commit the transactions to the wallet database\n");
+        }
+    }
+    if (!database->Sync()) {
+        WalletLogPrintf("CommitTransactions(): Unable to sync the wallet database\n");
+    }
+
+    for (const CTransactionRef& tx : txs) {
+        RelayCommittedTransaction(tx->GetHash());
+    }
+}
+
+void CWallet::RelayCommittedTransaction(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet);
+
+    // Get the inserted-CWalletTx from mapWallet so that the
+    // fInMempool flag is cached properly
+    CWalletTx& wtx = mapWallet.at(hash);
+
     // Notify that old coins are spent
-    for (const CTxIn& txin : wtxNew.tx->vin) {
+    for (const CTxIn& txin : wtx.tx->vin) {
         CWalletTx &coin = mapWallet.at(txin.prevout.hash);
         coin.BindWallet(this);
         NotifyTransactionChanged(this, coin.GetHash(), CT_UPDATED);
     }
 
-    // Get the inserted-CWalletTx from mapWallet so that the
-    // fInMempool flag is cached properly
-    CWalletTx& wtx = mapWallet.at(wtxNew.GetHash());
-
     if (!fBroadcastTransactions) {
         // Don't submit tx to the mempool
         return;
@@ -3192,6 +3895,9 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
         mapWallet.erase(it);
         NotifyTransactionChanged(this, hash, CT_DELETED);
     }
+    m_dest_tx_order.clear();
+    m_dest_tx_order_built = false;
+    m_groupings_built = false;
 
     if (nZapSelectTxRet == DBErrors::NEED_REWRITE)
     {
@@ -3237,7 +3943,7 @@ bool CWallet::SetAddressBookWithDB(WalletBatch& batch, const CTxDestination& add
         LOCK(cs_wallet);
         std::map<CTxDestination, CAddressBookData>::iterator mi = m_address_book.find(address);
         fUpdated = (mi != m_address_book.end() && !mi->second.IsChange());
-        m_address_book[address].SetLabel(strName);
+        SetAddressLabel(address, strName);
         if (!strPurpose.empty()) /* update purpose only if requested */
             m_address_book[address].purpose = strPurpose;
     }
@@ -3248,6 +3954,38 @@ bool CWallet::SetAddressBookWithDB(WalletBatch& batch, const CTxDestination& add
     return batch.WriteName(EncodeDestination(address), strName);
 }
 
+void CWallet::SetAddressLabel(const CTxDestination& dest, const std::string& label)
+{
+    AssertLockHeld(cs_wallet);
+    auto it = m_address_book.find(dest);
+    if (it == m_address_book.end()) {
+        it = m_address_book.emplace(dest, CAddressBookData()).first;
+    }
+    if (it->second.IsChange()) {
+        // No longer change, so no longer grouped with the inputs it was change for
+        ++m_address_book_generation;
+        if (m_grouped_change.count(dest)) m_groupings_built = false;
+    } else {
+        const auto old = m_label_addresses.find(it->second.GetLabel());
+        if (old != m_label_addresses.end() && old->second.erase(dest) && old->second.empty()) m_label_addresses.erase(old);
+    }
+    it->second.SetLabel(label);
+    m_label_addresses[label].insert(dest);
+}
+
+void CWallet::EraseAddressBookEntry(const CTxDestination& dest)
+{
+    AssertLockHeld(cs_wallet);
+    const auto it = m_address_book.find(dest);
+    if (it == m_address_book.end()) return;
+    if (!it->second.IsChange()) {
+        const auto label = m_label_addresses.find(it->second.GetLabel());
+        if (label != m_label_addresses.end() && label->second.erase(dest) && label->second.empty()) m_label_addresses.erase(label);
+    }
+    m_address_book.erase(it);
+    ++m_address_book_generation;
+}
+
 bool CWallet::SetAddressBook(const CTxDestination& address, const std::string& strName, const std::string& strPurpose)
 {
     WalletBatch batch(*database);
@@ -3273,7 +4011,7 @@ bool CWallet::DelAddressBook(const CTxDestination& address)
         {
             WalletBatch(*database).EraseDestData(strAddress, item.first);
         }
-        m_address_book.erase(address);
+        EraseAddressBookEntry(address);
     }
 
     NotifyAddressBookChanged(this, address, "", IsMine(address) != ISMINE_NO, "", CT_DELETED);
@@ -3412,112 +4150,97 @@ std::map<CTxDestination, CAmount> CWallet::GetAddressBalances(interfaces::Chain:
     return balances;
 }
 
-std::set< std::set<CTxDestination> > CWallet::GetAddressGroupings() const
+const CTxDestination& CWallet::FindGroupingRoot(const CTxDestination& dest) const
 {
     AssertLockHeld(cs_wallet);
-    std::set< std::set<CTxDestination> > groupings;
-    std::set<CTxDestination> grouping;
+    auto it = m_grouping_parent.emplace(dest, dest).first;
+    while (!(it->second == it->first)) {
+        // Path halving: point every other destination on the way at its grandparent
+        const auto parent = m_grouping_parent.find(it->second);
+        it->second = parent->second;
+        it = m_grouping_parent.find(it->second);
+    }
+    return it->first;
+}
 
-    for (const auto& walletEntry : mapWallet)
+void CWallet::AddToGroupings(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+    std::vector<CTxDestination> grouping;
+    if (wtx.tx->vin.size() > 0)
     {
-        const CWalletTx& wtx = walletEntry.second;
-
-        if (wtx.tx->vin.size() > 0)
+        // group all input addresses with each other
+        for (const CTxIn& txin : wtx.tx->vin)
         {
-            bool any_mine = false;
-            // group all input addresses with each other
-            for (const CTxIn& txin : wtx.tx->vin)
-            {
-                CTxDestination address;
-                if(!IsMine(txin)) /* If this input isn't mine, ignore it */
-                    continue;
-                if(!ExtractDestination(mapWallet.at(txin.prevout.hash).tx->vout[txin.prevout.n].scriptPubKey, address))
-                    continue;
-                grouping.insert(address);
-                any_mine = true;
-            }
+            CTxDestination address;
+            if(!IsMine(txin)) /* If this input isn't mine, ignore it */
+                continue;
+            if(!ExtractDestination(GetWalletTx(txin.prevout.hash)->tx->vout[txin.prevout.n].scriptPubKey, address))
+                continue;
+            grouping.push_back(address);
+        }
 
-            // group change with input addresses
-            if (any_mine)
-            {
-               for (const CTxOut& txout : wtx.tx->vout)
-                   if (IsChange(txout))
-                   {
-                       CTxDestination txoutAddr;
-                       if(!ExtractDestination(txout.scriptPubKey, txoutAddr))
-                           continue;
-                       grouping.insert(txoutAddr);
-                   }
-            }
-            if (grouping.size() > 0)
-            {
-                groupings.insert(grouping);
-                grouping.clear();
-            }
+        // group change with input addresses
+        if (!grouping.empty())
+        {
+            for (const CTxOut& txout : wtx.tx->vout)
+                if (IsChange(txout))
+                {
+                    CTxDestination txoutAddr;
+                    if(!ExtractDestination(txout.scriptPubKey, txoutAddr))
+                        continue;
+                    grouping.push_back(txoutAddr);
+                    m_grouped_change.insert(txoutAddr);
+                }
         }
+    }
 
-        // group lone addrs by themselves
-        for (const auto& txout : wtx.tx->vout)
-            if (IsMine(txout))
-            {
-                CTxDestination address;
-                if(!ExtractDestination(txout.scriptPubKey, address))
-                    continue;
-                grouping.insert(address);
-                groupings.insert(grouping);
-                grouping.clear();
-            }
+    for (size_t i = 1; i < grouping.size(); ++i) {
+        const CTxDestination root = FindGroupingRoot(grouping[0]);
+        const CTxDestination& other = FindGroupingRoot(grouping[i]);
+        if (!(other == root)) m_grouping_parent[other] = root;
     }
+    if (!grouping.empty()) FindGroupingRoot(grouping[0]);
 
-    std::set< std::set<CTxDestination>* > uniqueGroupings; // a set of pointers to groups of addresses
-    std::map< CTxDestination, std::set<CTxDestination>* > setmap;  // map addresses to the unique group containing it
-    for (std::set<CTxDestination> _grouping : groupings)
-    {
-        // make a set of all the groups hit by this new group
-        std::set< std::set<CTxDestination>* > hits;
-        std::map< CTxDestination, std::set<CTxDestination>* >::iterator it;
-        for (const CTxDestination& address : _grouping)
-            if ((it = setmap.find(address)) != setmap.end())
-                hits.insert((*it).second);
-
-        // merge all hit groups into a new single group and delete old groups
-        std::set<CTxDestination>* merged = new std::set<CTxDestination>(_grouping);
-        for (std::set<CTxDestination>* hit : hits)
+    // group lone addrs by themselves
+    for (const auto& txout : wtx.tx->vout)
+        if (IsMine(txout))
         {
-            merged->insert(hit->begin(), hit->end());
-            uniqueGroupings.erase(hit);
-            delete hit;
+            CTxDestination address;
+            if(!ExtractDestination(txout.scriptPubKey, address))
+                continue;
+            FindGroupingRoot(address);
         }
-        uniqueGroupings.insert(merged);
+}
 
-        // update setmap
-        for (const CTxDestination& element : *merged)
-            setmap[element] = merged;
+std::set< std::set<CTxDestination> > CWallet::GetAddressGroupings() const
+{
+    AssertLockHeld(cs_wallet);
+    if (!m_groupings_built) {
+        m_grouping_parent.clear();
+        m_grouped_change.clear();
+        ForEachWalletTx([this](const CWalletTx& wtx) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet) { AddToGroupings(wtx); });
+        m_groupings_built = true;
     }
 
-    std::set< std::set<CTxDestination> > ret;
-    for (const std::set<CTxDestination>* uniqueGrouping : uniqueGroupings)
-    {
-        ret.insert(*uniqueGrouping);
-        delete uniqueGrouping;
+    std::map<CTxDestination, std::set<CTxDestination>> groupings;
+    for (const auto& entry : m_grouping_parent) {
+        groupings[FindGroupingRoot(entry.first)].insert(entry.first);
     }
 
+    std::set< std::set<CTxDestination> > ret;
+    for (auto& grouping : groupings) {
+        ret.insert(std::move(grouping.second));
+    }
     return ret;
 }
 
 std::set<CTxDestination> CWallet::GetLabelAddresses(const std::string& label) const
 {
     LOCK(cs_wallet);
-    std::set<CTxDestination> result;
-    for (const std::pair<const CTxDestination, CAddressBookData>& item : m_address_book)
-    {
-        if (item.second.IsChange()) continue;
-        const CTxDestination& address = item.first;
-        const std::string& strName = item.second.GetLabel();
-        if (strName == label)
-            result.insert(address);
-    }
-    return result;
+    const auto it = m_label_addresses.find(label);
+    if (it == m_label_addresses.end()) return {};
+    return it->second;
 }
 
 bool ReserveDestination::GetReservedDestination(CTxDestination& dest, bool internal)
@@ -4034,6 +4757,10 @@ std::shared_ptr<CWallet> CWallet::CreateWalletFromFile(interfaces::Chain& chain,
     walletInstance->m_confirm_target = gArgs.GetArg("-txconfirmtarget", DEFAULT_TX_CONFIRM_TARGET);
     walletInstance->m_spend_zero_conf_change = gArgs.GetBoolArg("-spendzeroconfchange", DEFAULT_SPEND_ZEROCONF_CHANGE);
     walletInstance->m_signal_rbf = gArgs.GetBoolArg("-walletrbf", DEFAULT_WALLET_RBF);
+    {
+        LOCK(walletInstance->cs_wallet);
+        walletInstance->m_paged_cache_size = std::max<int64_t>(gArgs.GetArg("-walletlazytxcache", DEFAULT_WALLET_LAZY_TX_CACHE), 0);
+    }
 
     walletInstance->WalletLogPrintf("Wallet completed loading in %15dms\n", GetTimeMillis() - nStart);
 
@@ -4136,6 +4863,12 @@ std::shared_ptr<CWallet> CWallet::CreateWalletFromFile(interfaces::Chain& chain,
         }
     }
 
+    {
+        // Only now that the rescan is done are the transactions' depths final
+        LOCK(walletInstance->cs_wallet);
+        walletInstance->PageOutTransactions();
+    }
+
     {
         LOCK(cs_wallets);
         for (auto& load_wallet : g_load_wallet_fns) {
@@ -4144,13 +4877,18 @@ std::shared_ptr<CWallet> CWallet::CreateWalletFromFile(interfaces::Chain& chain,
     }
 
     // Register with the validation interface. It's ok to do this after rescan since we're still holding locked_chain.
-    walletInstance->m_chain_notifications_handler = walletInstance->chain().handleNotifications(walletInstance);
+    if (gArgs.GetBoolArg("-walletrouting", DEFAULT_WALLET_ROUTING)) {
+        walletInstance->m_chain_notifications_handler = HandleRoutedNotifications(walletInstance->chain(), walletInstance);
+    } else {
+        walletInstance->m_chain_notifications_handler = walletInstance->chain().handleNotifications(walletInstance);
+    }
 
     walletInstance->SetBroadcastTransactions(gArgs.GetBoolArg("-walletbroadcast", DEFAULT_WALLETBROADCAST));
 
     {
         walletInstance->WalletLogPrintf("setKeyPool.size() = %u\n",      walletInstance->GetKeyPoolSize());
         walletInstance->WalletLogPrintf("mapWallet.size() = %u\n",       walletInstance->mapWallet.size());
+        walletInstance->WalletLogPrintf("m_paged_out.size() = %u\n",     walletInstance->m_paged_out.size());
         walletInstance->WalletLogPrintf("m_address_book.size() = %u\n",  walletInstance->m_address_book.size());
     }
 
@@ -4232,8 +4970,12 @@ std::vector<OutputGroup> CWallet::GroupOutputs(const std::vector<COutput>& outpu
         if (output.fSpendable) {
             CInputCoin input_coin = output.GetInputCoin();
 
-            size_t ancestors, descendants;
-            chain().getTransactionAncestry(output.tx->GetHash(), ancestors, descendants);
+            // Confirmed transactions are not in the mempool, so only look up
+            // the ancestry of unconfirmed ones
+            size_t ancestors = 0, descendants = 0;
+            if (output.nDepth <= 0) {
+                chain().getTransactionAncestry(output.tx->GetHash(), ancestors, descendants);
+            }
             if (!single_coin && ExtractDestination(output.tx->tx->vout[output.i].scriptPubKey, dst)) {
                 // Limit output groups to no more than 10 entries, to protect
                 // against inadvertently creating a too-large transaction
@@ -27,6 +27,8 @@
 
 #include <algorithm>
 #include <atomic>
+#include <functional>
+#include <list>
 #include <map>
 #include <memory>
 #include <set>
@@ -83,6 +85,12 @@ static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 6;
 static const bool DEFAULT_WALLET_RBF = false;
 static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
+//! -walletlazytxcache default: keep all transactions in memory
+static const unsigned int DEFAULT_WALLET_LAZY_TX_CACHE = 0;
+//! -walletrouting default
+static const bool DEFAULT_WALLET_ROUTING = false;
+//! Depth at which spent transactions and their spenders may be paged out of memory
+static const int PAGE_OUT_MIN_DEPTH = 100;
 //! -maxtxfee default
 constexpr CAmount DEFAULT_TRANSACTION_MAXFEE{COIN / 10};
 //! Discourage users to set fees higher than this amount (in satoshis) per kB
@@ -335,6 +343,14 @@ public:
     mutable bool fChangeCached;
     mutable bool fInMempool;
     mutable CAmount nChangeCached;
+    //! GetAmounts results by filter, for the address book generation they were computed at
+    struct CachedOutputEntries {
+        std::list<COutputEntry> received;
+        std::list<COutputEntry> sent;
+        CAmount fee;
+        uint64_t address_book_generation;
+    };
+    mutable std::map<isminefilter, CachedOutputEntries> m_output_entries;
 
     CWalletTx(const CWallet* pwalletIn, CTransactionRef arg)
         : tx(std::move(arg))
@@ -451,15 +467,7 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        m_amounts[DEBIT].Reset();
-        m_amounts[CREDIT].Reset();
-        m_amounts[IMMATURE_CREDIT].Reset();
-        m_amounts[AVAILABLE_CREDIT].Reset();
-        fChangeCached = false;
-        m_is_cache_empty = true;
-    }
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -652,6 +660,39 @@ private:
     void AddToSpends(const COutPoint& outpoint, const uint256& wtxid) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     void AddToSpends(const uint256& wtxid) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
+    /**
+     * The outputs of wallet transactions that are mine and unspent, or belong to an immature
+     * coinbase, so that AvailableCoins and GetBalance don't have to walk all of mapWallet. It may
+     * hold outputs that have been spent since, which readers still filter out, but never misses
+     * one they would count.
+     *
+     * It is updated lazily: transactions whose outputs may have changed state are queued by
+     * MarkUnspentDirty (called by CWalletTx::MarkDirty and AddToSpends) and refreshed by
+     * UpdateUnspent before each read.
+     */
+    mutable std::set<COutPoint> m_unspent GUARDED_BY(cs_wallet);
+    mutable Mutex m_unspent_dirty_mutex;
+    mutable std::set<uint256> m_unspent_dirty GUARDED_BY(m_unspent_dirty_mutex);
+    //! Whether m_unspent must be rebuilt from all of mapWallet, initially and after MarkDirty().
+    mutable bool m_unspent_rebuild GUARDED_BY(m_unspent_dirty_mutex){true};
+    void UpdateUnspent() const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    //! CreateTransaction selecting from available_coins instead of listing them, if it is set.
+    bool CreateTransactionInternal(interfaces::Chain::Lock& locked_chain, const std::vector<CRecipient>& vecSend, CTransactionRef& tx, CAmount& nFeeRet, int& nChangePosInOut,
+                                   std::string& strFailReason, const CCoinControl& coin_control, bool sign, const std::vector<COutput>* available_coins);
+    //! Notify that the coins spent by a newly committed transaction changed, and broadcast it.
+    void RelayCommittedTransaction(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    /** What is kept in memory of a transaction paged out of mapWallet */
+    struct PagedOutTx {
+        int64_t order_pos;
+        int block_height;
+    };
+    //! Whether wtx and the transactions spending its outputs are deep enough for it to be paged out.
+    bool CanPageOut(const CWalletTx& wtx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    bool ReadPagedOutTx(WalletBatch& batch, const uint256& hash, const PagedOutTx& paged, CWalletTx& wtx) const;
+    const CWalletTx* GetPagedOutTx(const uint256& hash) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
     /**
      * Add a transaction to the wallet, or update it.  pIndex and posInBlock should
      * be set when the transaction was known to be included in a block.  When
@@ -781,10 +822,75 @@ public:
     typedef std::multimap<int64_t, CWalletTx*> TxItems;
     TxItems wtxOrdered;
 
+    /**
+     * Transactions that were moved out of mapWallet by PageOutTransactions and
+     * are only read back from the database when they are looked up. Their
+     * entries in mapTxSpends are kept.
+     */
+    std::map<uint256, PagedOutTx> m_paged_out GUARDED_BY(cs_wallet);
+    //! The txids of m_paged_out by order position, to be merged with wtxOrdered
+    std::multimap<int64_t, uint256> m_paged_out_ordered GUARDED_BY(cs_wallet);
+    //! Paged out transactions read back by GetWalletTx, most recently used first
+    mutable std::list<CWalletTx> m_paged_lru GUARDED_BY(cs_wallet);
+    mutable std::map<uint256, std::list<CWalletTx>::iterator> m_paged_lru_map GUARDED_BY(cs_wallet);
+    /**
+     * Order positions of the transactions with an output of ours to each
+     * destination, so that the transactions of a label can be listed without
+     * walking the wallet. Built on first use by ForEachOrderedTx, then kept
+     * up to date by AddToWallet until MarkDirty or ZapSelectTx discard it.
+     */
+    mutable std::map<CTxDestination, std::set<int64_t>> m_dest_tx_order GUARDED_BY(cs_wallet);
+    mutable bool m_dest_tx_order_built GUARDED_BY(cs_wallet){false};
+    void AddToDestTxOrder(const CWalletTx& wtx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    //! The union-find of GetAddressGroupings: each destination's parent, roots being their own
+    mutable std::map<CTxDestination, CTxDestination> m_grouping_parent GUARDED_BY(cs_wallet);
+    //! Destinations grouped as change, whose grouping is wrong once they are labelled
+    mutable std::set<CTxDestination> m_grouped_change GUARDED_BY(cs_wallet);
+    mutable bool m_groupings_built GUARDED_BY(cs_wallet){false};
+    const CTxDestination& FindGroupingRoot(const CTxDestination& dest) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    void AddToGroupings(const CWalletTx& wtx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! Number of paged out transactions m_paged_lru may hold, 0 to keep all transactions in mapWallet
+    size_t m_paged_cache_size GUARDED_BY(cs_wallet){DEFAULT_WALLET_LAZY_TX_CACHE};
+
+    /**
+     * Move the transactions that only matter to the wallet history out of
+     * mapWallet: those confirmed at least PAGE_OUT_MIN_DEPTH blocks deep whose
+     * outputs are all spent by transactions that are as deep. Also shrinks
+     * m_paged_lru back to m_paged_cache_size, which invalidates pointers
+     * returned by GetWalletTx for paged out transactions, so that they must not
+     * be used once cs_wallet is released.
+     */
+    void PageOutTransactions() EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! Move a paged out transaction back into mapWallet, e.g. before updating it.
+    bool PageInTransaction(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! Call fn for every wallet transaction, reading paged out ones from the database without caching them.
+    void ForEachWalletTx(const std::function<void(const CWalletTx&)>& fn) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /**
+     * Call fn for the wallet transactions at order positions up to
+     * max_order_pos, newest first, until it returns false. Paged out
+     * transactions are read back as they are reached. If label is given, only
+     * transactions with an output of ours to an address with that label are
+     * visited, found through m_dest_tx_order rather than by walking the wallet.
+     */
+    void ForEachOrderedTx(int64_t max_order_pos, const std::string* label, const std::function<bool(const CWalletTx&)>& fn) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! The txids of the wallet transactions, including paged out ones, and of the transactions they spend from
+    std::vector<uint256> GetRoutingTxids() const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! Number of wallet transactions, including paged out ones
+    size_t GetTxCount() const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet) { AssertLockHeld(cs_wallet); return mapWallet.size() + m_paged_out.size(); }
+
     int64_t nOrderPosNext GUARDED_BY(cs_wallet) = 0;
     uint64_t nAccountingEntryNumber = 0;
 
     std::map<CTxDestination, CAddressBookData> m_address_book GUARDED_BY(cs_wallet);
+    //! Bumped whenever an address book entry gains or loses its label, which changes what IsChange returns
+    std::atomic<uint64_t> m_address_book_generation{0};
+    //! The labelled destinations of m_address_book by label
+    std::map<std::string, std::set<CTxDestination>> m_label_addresses GUARDED_BY(cs_wallet);
+    //! Set the label of an address book entry, creating it if needed, and keep the indexes by label up to date.
+    void SetAddressLabel(const CTxDestination& dest, const std::string& label) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! Remove an address book entry, and keep the indexes by label up to date.
+    void EraseAddressBookEntry(const CTxDestination& dest) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     const CAddressBookData* FindAddressBookEntry(const CTxDestination&, bool allow_change = false) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     std::set<COutPoint> setLockedCoins GUARDED_BY(cs_wallet);
@@ -795,6 +901,7 @@ public:
     /** Interface for accessing chain state. */
     interfaces::Chain& chain() const { assert(m_chain); return *m_chain; }
 
+    /** Look up a wallet transaction, reading it from the database if it was paged out. */
     const CWalletTx* GetWalletTx(const uint256& hash) const;
 
     //! check whether we are allowed to upgrade (or already support) to the named feature
@@ -821,7 +928,7 @@ public:
      * completion the coin set and corresponding actual target value is
      * assembled
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, std::vector<OutputGroup> groups,
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibilityFilter& eligibility_filter, const std::vector<OutputGroup>& groups,
         std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CoinSelectionParams& coin_selection_params, bool& bnb_used) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
@@ -886,11 +993,18 @@ public:
     DBErrors ReorderTransactions();
 
     void MarkDirty();
+    //! Queue a transaction for its outputs to be refreshed in the set of unspent outputs.
+    void MarkUnspentDirty(const uint256& txid) const;
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
+    //! Add or update a transaction like AddToWallet, writing it with an existing batch.
+    bool AddToWallet(WalletBatch& batch, const CWalletTx& wtxIn);
     void LoadToWallet(CWalletTx& wtxIn) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     void transactionAddedToMempool(const CTransactionRef& tx) override;
     void blockConnected(const CBlock& block, int height) override;
+    //! Process a connected block, syncing only the transactions at tx_indexes (see HandleRoutedNotifications).
+    void blockConnected(const CBlock& block, int height, const std::vector<size_t>& tx_indexes);
     void blockDisconnected(const CBlock& block, int height) override;
+    void blockDisconnected(const CBlock& block, int height, const std::vector<size_t>& tx_indexes);
     void updatedBlockTip() override;
     int64_t RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update);
 
@@ -974,6 +1088,23 @@ public:
      */
     void CommitTransaction(CTransactionRef tx, mapValue_t mapValue, std::vector<std::pair<std::string, std::string>> orderForm);
 
+    /**
+     * Create one transaction for each set of recipients in vecSends, like
+     * CreateTransaction, but listing the available coins only once. The coins
+     * spent by a transaction are not used by the ones that follow. Fails
+     * without returning any transaction if one of them cannot be created.
+     */
+    bool CreateTransactions(interfaces::Chain::Lock& locked_chain, const std::vector<std::vector<CRecipient>>& vecSends, std::vector<CTransactionRef>& txs,
+                            std::string& strFailReason, const CCoinControl& coin_control);
+    /**
+     * Add transactions created by CreateTransactions to the wallet in a single
+     * database transaction, then submit them to the mempool in order.
+     *
+     * @param[in] txs The transactions to be broadcast.
+     * @param[in] mapValue key-values to be set on each of the transactions.
+     */
+    void CommitTransactions(const std::vector<CTransactionRef>& txs, const mapValue_t& mapValue);
+
     bool DummySignTx(CMutableTransaction &txNew, const std::set<CTxOut> &txouts, bool use_max_sig = false) const
     {
         std::vector<CTxOut> v_txouts(txouts.size());
@@ -1011,6 +1142,13 @@ public:
 
     int64_t GetOldestKeyPoolTime() const;
 
+    /**
+     * Destinations that are likely to belong to the same owner, because they
+     * were spent together or one received the change of the others. Kept in
+     * a union-find over all destinations, which is built on first use and then
+     * extended as transactions are added. It is rebuilt after MarkDirty,
+     * ZapSelectTx, or once an address that received change gets a label.
+     */
     std::set<std::set<CTxDestination>> GetAddressGroupings() const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     std::map<CTxDestination, CAmount> GetAddressBalances(interfaces::Chain::Lock& locked_chain) const;
 
@@ -1233,6 +1371,12 @@ public:
  */
 void MaybeResendWalletTxs();
 
+/**
+ * Called periodically by the schedule thread. Pages out the transactions of wallets
+ * loaded with -walletlazytxcache that became deep enough since and trims their caches.
+ */
+void MaybePageOutWalletTxs();
+
 /** RAII object to check and reserve a wallet rescan */
 class WalletRescanReserver
 {
@@ -3,6 +3,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/palladium-config.h>
+#endif
+
 #include <wallet/walletdb.h>
 
 #include <fs.h>
@@ -13,6 +17,9 @@
 #include <util/system.h>
 #include <util/time.h>
 #include <wallet/wallet.h>
+#ifdef USE_SQLITE
+#include <wallet/sqlite.h>
+#endif
 
 #include <atomic>
 #include <string>
@@ -76,6 +83,32 @@ bool WalletBatch::WriteTx(const CWalletTx& wtx)
     return WriteIC(std::make_pair(DBKeys::TX, wtx.GetHash()), wtx);
 }
 
+bool WalletBatch::ReadTx(const uint256& hash, CWalletTx& wtx)
+{
+    return m_batch->Read(std::make_pair(DBKeys::TX, hash), wtx);
+}
+
+bool WalletBatch::WriteTxBulk(const CWalletTx& wtx)
+{
+    if (m_bulk_records == 0) {
+        // Without a transaction, e.g. on a dummy database, records are written one by one
+        m_bulk_txn = m_batch->TxnBegin();
+    }
+    if (!WriteTx(wtx)) return false;
+    if (++m_bulk_records == BULK_WRITE_RECORDS) {
+        return CommitBulk();
+    }
+    return true;
+}
+
+bool WalletBatch::CommitBulk()
+{
+    const bool commit = m_bulk_records > 0 && m_bulk_txn;
+    m_bulk_records = 0;
+    m_bulk_txn = false;
+    return !commit || m_batch->TxnCommit();
+}
+
 bool WalletBatch::EraseTx(uint256 hash)
 {
     return EraseIC(std::make_pair(DBKeys::TX, hash));
@@ -150,8 +183,8 @@ bool WalletBatch::WriteBestBlock(const CBlockLocator& locator)
 
 bool WalletBatch::ReadBestBlock(CBlockLocator& locator)
 {
-    if (m_batch.Read(DBKeys::BESTBLOCK, locator) && !locator.vHave.empty()) return true;
-    return m_batch.Read(DBKeys::BESTBLOCK_NOMERKLE, locator);
+    if (m_batch->Read(DBKeys::BESTBLOCK, locator) && !locator.vHave.empty()) return true;
+    return m_batch->Read(DBKeys::BESTBLOCK_NOMERKLE, locator);
 }
 
 bool WalletBatch::WriteOrderPosNext(int64_t nOrderPosNext)
@@ -161,7 +194,7 @@ bool WalletBatch::WriteOrderPosNext(int64_t nOrderPosNext)
 
 bool WalletBatch::ReadPool(int64_t nPool, CKeyPool& keypool)
 {
-    return m_batch.Read(std::make_pair(DBKeys::POOL, nPool), keypool);
+    return m_batch->Read(std::make_pair(DBKeys::POOL, nPool), keypool);
 }
 
 bool WalletBatch::WritePool(int64_t nPool, const CKeyPool& keypool)
@@ -208,7 +241,7 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             ssKey >> strAddress;
             std::string label;
             ssValue >> label;
-            pwallet->m_address_book[DecodeDestination(strAddress)].SetLabel(label);
+            pwallet->SetAddressLabel(DecodeDestination(strAddress), label);
         } else if (strType == DBKeys::PURPOSE) {
             std::string strAddress;
             ssKey >> strAddress;
@@ -438,15 +471,14 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
     LOCK(pwallet->cs_wallet);
     try {
         int nMinVersion = 0;
-        if (m_batch.Read(DBKeys::MINVERSION, nMinVersion)) {
+        if (m_batch->Read(DBKeys::MINVERSION, nMinVersion)) {
             if (nMinVersion > FEATURE_LATEST)
                 return DBErrors::TOO_NEW;
             pwallet->LoadMinVersion(nMinVersion);
         }
 
         // Get cursor
-        Dbc* pcursor = m_batch.GetCursor();
-        if (!pcursor)
+        if (!m_batch->StartCursor())
         {
             pwallet->WalletLogPrintf("Error getting wallet database cursor\n");
             return DBErrors::CORRUPT;
@@ -457,10 +489,11 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
             // Read next record
             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = m_batch.ReadAtCursor(pcursor, ssKey, ssValue);
-            if (ret == DB_NOTFOUND)
+            bool complete;
+            bool ret = m_batch->ReadAtCursor(ssKey, ssValue, complete);
+            if (complete)
                 break;
-            else if (ret != 0)
+            else if (!ret)
             {
                 pwallet->WalletLogPrintf("Error reading next record from wallet database\n");
                 return DBErrors::CORRUPT;
@@ -488,7 +521,7 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
             if (!strErr.empty())
                 pwallet->WalletLogPrintf("%s\n", strErr);
         }
-        pcursor->close();
+        m_batch->CloseCursor();
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -507,7 +540,7 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
 
     // Last client version to open this wallet, was previously the file version number
     int last_client = CLIENT_VERSION;
-    m_batch.Read(DBKeys::VERSION, last_client);
+    m_batch->Read(DBKeys::VERSION, last_client);
 
     int wallet_version = pwallet->GetVersion();
     pwallet->WalletLogPrintf("Wallet File Version = %d\n", wallet_version > 0 ? wallet_version : last_client);
@@ -525,14 +558,15 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
     }
 
     for (const uint256& hash : wss.vWalletUpgrade)
-        WriteTx(pwallet->mapWallet.at(hash));
+        WriteTxBulk(pwallet->mapWallet.at(hash));
+    CommitBulk();
 
     // Rewrite encrypted wallets of versions 0.4.0 and 0.5.0rc:
     if (wss.fIsEncrypted && (last_client == 40000 || last_client == 50000))
         return DBErrors::NEED_REWRITE;
 
     if (last_client < CLIENT_VERSION) // Update
-        m_batch.Write(DBKeys::VERSION, CLIENT_VERSION);
+        m_batch->Write(DBKeys::VERSION, CLIENT_VERSION);
 
     if (wss.fAnyUnordered)
         result = pwallet->ReorderTransactions();
@@ -554,14 +588,13 @@ DBErrors WalletBatch::FindWalletTx(std::vector<uint256>& vTxHash, std::vector<CW
 
     try {
         int nMinVersion = 0;
-        if (m_batch.Read(DBKeys::MINVERSION, nMinVersion)) {
+        if (m_batch->Read(DBKeys::MINVERSION, nMinVersion)) {
             if (nMinVersion > FEATURE_LATEST)
                 return DBErrors::TOO_NEW;
         }
 
         // Get cursor
-        Dbc* pcursor = m_batch.GetCursor();
-        if (!pcursor)
+        if (!m_batch->StartCursor())
         {
             LogPrintf("Error getting wallet database cursor\n");
             return DBErrors::CORRUPT;
@@ -572,10 +605,11 @@ DBErrors WalletBatch::FindWalletTx(std::vector<uint256>& vTxHash, std::vector<CW
             // Read next record
             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
             CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-            int ret = m_batch.ReadAtCursor(pcursor, ssKey, ssValue);
-            if (ret == DB_NOTFOUND)
+            bool complete;
+            bool ret = m_batch->ReadAtCursor(ssKey, ssValue, complete);
+            if (complete)
                 break;
-            else if (ret != 0)
+            else if (!ret)
             {
                 LogPrintf("Error reading next record from wallet database\n");
                 return DBErrors::CORRUPT;
@@ -594,7 +628,7 @@ DBErrors WalletBatch::FindWalletTx(std::vector<uint256>& vTxHash, std::vector<CW
                 vWtx.push_back(wtx);
             }
         }
-        pcursor->close();
+        m_batch->CloseCursor();
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -682,7 +716,7 @@ void MaybeCompactWalletDB()
         }
 
         if (dbh.nLastFlushed != nUpdateCounter && GetTime() - dbh.nLastWalletUpdate >= 2) {
-            if (BerkeleyBatch::PeriodicFlush(dbh)) {
+            if (dbh.PeriodicFlush()) {
                 dbh.nLastFlushed = nUpdateCounter;
             }
         }
@@ -696,6 +730,10 @@ void MaybeCompactWalletDB()
 //
 bool WalletBatch::Recover(const fs::path& wallet_path, void *callbackDataIn, bool (*recoverKVcallback)(void* callbackData, CDataStream ssKey, CDataStream ssValue), std::string& out_backup_filename)
 {
+    if (IsSQLiteWallet(wallet_path)) {
+        LogPrintf("Salvaging is only supported for Berkeley DB wallets, not %s\n", wallet_path.string());
+        return false;
+    }
     return BerkeleyBatch::Recover(wallet_path, callbackDataIn, recoverKVcallback, out_backup_filename);
 }
 
@@ -732,11 +770,27 @@ bool WalletBatch::RecoverKeysOnlyFilter(void *callbackData, CDataStream ssKey, C
 
 bool WalletBatch::VerifyEnvironment(const fs::path& wallet_path, std::string& errorStr)
 {
+    if (IsSQLiteWallet(wallet_path)) {
+#ifdef USE_SQLITE
+        return SQLiteDatabase::VerifyEnvironment(WalletDataFilePath(wallet_path), errorStr);
+#else
+        errorStr = strprintf("Wallet %s is an SQLite database, but palladium was compiled without SQLite support", wallet_path.string());
+        return false;
+#endif
+    }
     return BerkeleyBatch::VerifyEnvironment(wallet_path, errorStr);
 }
 
 bool WalletBatch::VerifyDatabaseFile(const fs::path& wallet_path, std::vector<std::string>& warnings, std::string& errorStr)
 {
+    if (IsSQLiteWallet(wallet_path)) {
+#ifdef USE_SQLITE
+        return SQLiteDatabase::VerifyDatabaseFile(WalletDataFilePath(wallet_path), warnings, errorStr);
+#else
+        errorStr = strprintf("Wallet %s is an SQLite database, but palladium was compiled without SQLite support", wallet_path.string());
+        return false;
+#endif
+    }
     return BerkeleyBatch::VerifyDatabaseFile(wallet_path, warnings, errorStr, WalletBatch::Recover);
 }
 
@@ -763,15 +817,15 @@ bool WalletBatch::WriteWalletFlags(const uint64_t flags)
 
 bool WalletBatch::TxnBegin()
 {
-    return m_batch.TxnBegin();
+    return m_batch->TxnBegin();
 }
 
 bool WalletBatch::TxnCommit()
 {
-    return m_batch.TxnCommit();
+    return m_batch->TxnCommit();
 }
 
 bool WalletBatch::TxnAbort()
 {
-    return m_batch.TxnAbort();
+    return m_batch->TxnAbort();
 }
@@ -21,10 +21,13 @@
  * - WalletBatch is an abstract modifier object for the wallet database, and encapsulates a database
  *   batch update as well as methods to act on the database. It should be agnostic to the database implementation.
  *
+ * - WalletDatabase and DatabaseBatch are the interfaces each database backend implements.
+ *
  * The following classes are implementation specific:
  * - BerkeleyEnvironment is an environment in which the database exists.
  * - BerkeleyDatabase represents a wallet database.
  * - BerkeleyBatch is a low-level database batch update.
+ * - SQLiteDatabase and SQLiteBatch are their counterparts for the SQLite backend.
  */
 
 static const bool DEFAULT_FLUSHWALLET = true;
@@ -38,9 +41,6 @@ class CWalletTx;
 class uint160;
 class uint256;
 
-/** Backend-agnostic database type. */
-using WalletDatabase = BerkeleyDatabase;
-
 /** Error statuses for the wallet database */
 enum class DBErrors
 {
@@ -169,7 +169,8 @@ public:
  * Opens the database and provides read and write access to it. Each read and write is its own transaction.
  * Multiple operation transactions can be started using TxnBegin() and committed using TxnCommit()
  * Otherwise the transaction will be committed when the object goes out of scope.
- * Optionally (on by default) it will flush to disk on close.
+ * Optionally (on by default) it will have the database flushed to disk in the background on close;
+ * WalletDatabase::Sync waits for that.
  * Every 1000 writes will automatically trigger a flush to disk.
  */
 class WalletBatch
@@ -178,12 +179,12 @@ private:
     template <typename K, typename T>
     bool WriteIC(const K& key, const T& value, bool fOverwrite = true)
     {
-        if (!m_batch.Write(key, value, fOverwrite)) {
+        if (!m_batch->Write(key, value, fOverwrite)) {
             return false;
         }
         m_database.IncrementUpdateCounter();
         if (m_database.nUpdateCounter % 1000 == 0) {
-            m_batch.Flush();
+            m_batch->Flush();
         }
         return true;
     }
@@ -191,19 +192,19 @@ private:
     template <typename K>
     bool EraseIC(const K& key)
     {
-        if (!m_batch.Erase(key)) {
+        if (!m_batch->Erase(key)) {
             return false;
         }
         m_database.IncrementUpdateCounter();
         if (m_database.nUpdateCounter % 1000 == 0) {
-            m_batch.Flush();
+            m_batch->Flush();
         }
         return true;
     }
 
 public:
     explicit WalletBatch(WalletDatabase& database, const char* pszMode = "r+", bool _fFlushOnClose = true) :
-        m_batch(database, pszMode, _fFlushOnClose),
+        m_batch(database.MakeBatch(pszMode, _fFlushOnClose)),
         m_database(database)
     {
     }
@@ -217,6 +218,13 @@ public:
     bool ErasePurpose(const std::string& strAddress);
 
     bool WriteTx(const CWalletTx& wtx);
+    //! Read back a transaction written by WriteTx into wtx, which must be bound to its wallet.
+    bool ReadTx(const uint256& hash, CWalletTx& wtx);
+    /** Write a transaction as part of a bulk update, which commits the records in
+     * database transactions of up to BULK_WRITE_RECORDS each. The last one is
+     * committed by CommitBulk, or aborted if the batch is closed first. */
+    bool WriteTxBulk(const CWalletTx& wtx);
+    bool CommitBulk();
     bool EraseTx(uint256 hash);
 
     bool WriteKeyMetadata(const CKeyMetadata& meta, const CPubKey& pubkey, const bool overwrite);
@@ -273,8 +281,14 @@ public:
     //! Abort current transaction
     bool TxnAbort();
 private:
-    BerkeleyBatch m_batch;
+    //! Bounds the database transactions of bulk updates, which Berkeley DB holds page locks for
+    static const unsigned int BULK_WRITE_RECORDS = 1000;
+
+    std::unique_ptr<DatabaseBatch> m_batch;
     WalletDatabase& m_database;
+    //! Records written in the bulk transaction that is open, if any
+    unsigned int m_bulk_records{0};
+    bool m_bulk_txn{false};
 };
 
 //! Compacts BDB state so that wallet.dat is self-contained (if there are changes)
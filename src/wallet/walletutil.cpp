@@ -7,6 +7,8 @@
 #include <logging.h>
 #include <util/system.h>
 
+#include <string.h>
+
 fs::path GetWalletDir()
 {
     fs::path path;
@@ -54,6 +56,26 @@ static bool IsBerkeleyBtree(const fs::path& path)
     return data == 0x00053162 || data == 0x62310500;
 }
 
+bool IsSQLiteFile(const fs::path& path)
+{
+    if (!fs::exists(path)) return false;
+
+    // An SQLite database is made of pages of at least 512 bytes.
+    boost::system::error_code ec;
+    auto size = fs::file_size(path, ec);
+    if (ec) LogPrintf("%s: %s %s\n", __func__, ec.message(), path.string());
+    if (size < 512) return false;
+
+    fsbridge::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    // The file starts with this string, including its terminating null character.
+    static const char SQLITE_MAGIC[] = "SQLite format 3";
+    char magic[sizeof(SQLITE_MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    return file && memcmp(magic, SQLITE_MAGIC, sizeof(magic)) == 0;
+}
+
 std::vector<fs::path> ListWalletDir()
 {
     const fs::path wallet_dir = GetWalletDir();
@@ -71,10 +93,10 @@ std::vector<fs::path> ListWalletDir()
         // This can be replaced by boost::filesystem::lexically_relative once boost is bumped to 1.60.
         const fs::path path = it->path().string().substr(offset);
 
-        if (it->status().type() == fs::directory_file && IsBerkeleyBtree(it->path() / "wallet.dat")) {
-            // Found a directory which contains wallet.dat btree file, add it as a wallet.
+        if (it->status().type() == fs::directory_file && (IsBerkeleyBtree(it->path() / "wallet.dat") || IsSQLiteFile(it->path() / "wallet.dat"))) {
+            // Found a directory which contains a wallet.dat btree or SQLite file, add it as a wallet.
             paths.emplace_back(path);
-        } else if (it.level() == 0 && it->symlink_status().type() == fs::regular_file && IsBerkeleyBtree(it->path())) {
+        } else if (it.level() == 0 && it->symlink_status().type() == fs::regular_file && (IsBerkeleyBtree(it->path()) || IsSQLiteFile(it->path()))) {
             if (it->path().filename() == "wallet.dat") {
                 // Found top-level wallet.dat btree file, add top level directory ""
                 // as a wallet.
@@ -63,6 +63,9 @@ fs::path GetWalletDir();
 //! Get wallets in wallet directory.
 std::vector<fs::path> ListWalletDir();
 
+//! Return whether the file at path is an SQLite database, judging by its header.
+bool IsSQLiteFile(const fs::path& path);
+
 //! The WalletLocation class provides wallet information.
 class WalletLocation final
 {
@@ -7,7 +7,11 @@
 
 #include <zmq/zmqconfig.h>
 
+#include <memory>
+
+class CBlock;
 class CBlockIndex;
+enum class MemPoolRemovalReason;
 class CZMQAbstractNotifier;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
@@ -41,7 +45,14 @@ public:
     virtual void Shutdown() = 0;
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
+    /** Notify a new tip, with the block itself if it is still in memory (block may be null). */
+    virtual bool NotifyTip(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    // Notifications for the mempool and chain changes, one by one (not just the tip)
+    virtual bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence);
+    virtual bool NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason, uint64_t mempool_sequence);
+    virtual bool NotifyBlockConnect(const CBlockIndex *pindex);
+    virtual bool NotifyBlockDisconnect(const CBlockIndex *pindex);
 
 protected:
     void *psocket;
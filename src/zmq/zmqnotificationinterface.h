@@ -25,7 +25,9 @@ protected:
     void Shutdown();
 
     // CValidationInterface
-    void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    std::string GetValidationQueueName() const override { return "zmq"; }
+    void TransactionAddedToMempool(const CTransactionRef& tx, uint64_t mempool_sequence) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason, uint64_t mempool_sequence) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexDisconnected) override;
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
@@ -35,6 +37,8 @@ private:
 
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+    //! Last block connected, handed to the notifiers if it becomes the tip
+    std::shared_ptr<const CBlock> m_last_connected;
 };
 
 extern CZMQNotificationInterface* g_zmq_notification_interface;
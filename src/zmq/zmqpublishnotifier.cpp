@@ -4,11 +4,20 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <miner.h>
+#include <script/script.h>
 #include <streams.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
 #include <util/system.h>
 #include <rpc/server.h>
+#include <sync.h>
+#include <util/memory.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <thread>
 
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
@@ -16,48 +25,174 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_TEMPLATE  = "template";
+static const char *MSG_MEMPOOLHISTOGRAM = "mempoolhistogram";
+static const char *MSG_SEQUENCE  = "sequence";
 
-// Internal function to send multipart message
-static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
+// Release a message payload once ZMQ is done with it
+static void zmq_free_payload(void* /*data*/, void* hint)
 {
-    va_list args;
-    va_start(args, size);
+    delete static_cast<std::vector<unsigned char>*>(hint);
+}
 
-    while (1)
+// Internal function to send one part of a multipart message
+static bool zmq_send_part(void *sock, zmq_msg_t& msg, bool more)
+{
+    if (zmq_msg_send(&msg, sock, more ? ZMQ_SNDMORE : 0) == -1)
     {
-        zmq_msg_t msg;
+        zmqError("Unable to send ZMQ msg");
+        zmq_msg_close(&msg);
+        return false;
+    }
+    return true;
+}
 
-        int rc = zmq_msg_init_size(&msg, size);
-        if (rc != 0)
+// Internal function to send a copy of a small buffer as one part of a multipart message
+static bool zmq_send_copy(void *sock, const void* data, size_t size, bool more)
+{
+    zmq_msg_t msg;
+    if (zmq_msg_init_size(&msg, size) != 0)
+    {
+        zmqError("Unable to initialize ZMQ msg");
+        return false;
+    }
+    memcpy(zmq_msg_data(&msg), data, size);
+    return zmq_send_part(sock, msg, more);
+}
+
+// Internal function to send multipart message: the command, the payload
+// (owned by ZMQ from here on, so large blocks are not copied again) and the
+// sequence number
+static bool zmq_send_multipart(void *sock, const char* command, std::unique_ptr<std::vector<unsigned char>> payload, uint32_t sequence)
+{
+    if (!zmq_send_copy(sock, command, strlen(command), true)) return false;
+
+    zmq_msg_t msg;
+    std::vector<unsigned char>* data = payload.release();
+    if (zmq_msg_init_data(&msg, data->data(), data->size(), zmq_free_payload, data) != 0)
+    {
+        zmqError("Unable to initialize ZMQ msg");
+        delete data;
+        return false;
+    }
+    if (!zmq_send_part(sock, msg, true)) return false;
+
+    unsigned char msgseq[sizeof(uint32_t)];
+    WriteLE32(&msgseq[0], sequence);
+    return zmq_send_copy(sock, msgseq, sizeof(msgseq), false);
+}
+
+namespace {
+
+/**
+ * Sends the messages of all publish notifiers on a thread of its own, so that
+ * slow subscribers or a full socket never hold up the validation interface
+ * callbacks. Sockets are closed on this thread as well, after the messages
+ * queued for them.
+ */
+class ZMQPublisher
+{
+public:
+    void Start()
+    {
+        LOCK(m_mutex);
+        assert(!m_thread.joinable());
+        m_stop = false;
+        m_thread = std::thread(&TraceThread<std::function<void()>>, "zmqpub", std::function<void()>(std::bind(&ZMQPublisher::ThreadPublish, this)));
+    }
+
+    void Stop()
+    {
         {
-            zmqError("Unable to initialize ZMQ msg");
-            va_end(args);
-            return -1;
+            LOCK(m_mutex);
+            if (!m_thread.joinable()) return;
+            m_stop = true;
         }
+        m_cond.notify_one();
+        m_thread.join();
+    }
 
-        void *buf = zmq_msg_data(&msg);
-        memcpy(buf, data, size);
+    void Publish(void* socket, std::atomic<size_t>& queued, const char* command, std::unique_ptr<std::vector<unsigned char>> data, uint32_t sequence)
+    {
+        ++queued;
+        Push({socket, &queued, command, std::move(data), sequence});
+    }
 
-        data = va_arg(args, const void*);
+    void Close(void* socket)
+    {
+        Push({socket, nullptr, nullptr, nullptr, 0});
+    }
 
-        rc = zmq_msg_send(&msg, sock, data ? ZMQ_SNDMORE : 0);
-        if (rc == -1)
+private:
+    struct Message
+    {
+        void* socket;
+        std::atomic<size_t>* queued; //!< null to close the socket
+        const char* command;
+        std::unique_ptr<std::vector<unsigned char>> data;
+        uint32_t sequence;
+    };
+
+    void Push(Message&& message)
+    {
         {
-            zmqError("Unable to send ZMQ msg");
-            zmq_msg_close(&msg);
-            va_end(args);
-            return -1;
+            LOCK(m_mutex);
+            if (m_thread.joinable()) {
+                m_queue.push_back(std::move(message));
+                m_cond.notify_one();
+                return;
+            }
         }
+        // Before Start and after Stop there is nobody else to touch the sockets.
+        Handle(message);
+    }
 
-        zmq_msg_close(&msg);
-
-        if (!data)
-            break;
+    static void Handle(Message& message)
+    {
+        if (!message.queued) {
+            int linger = 0;
+            zmq_setsockopt(message.socket, ZMQ_LINGER, &linger, sizeof(linger));
+            zmq_close(message.socket);
+            return;
+        }
+        zmq_send_multipart(message.socket, message.command, std::move(message.data), message.sequence);
+        --*message.queued;
+    }
 
-        size = va_arg(args, size_t);
+    void ThreadPublish()
+    {
+        while (true) {
+            Message message;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+                if (m_queue.empty()) return;
+                message = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            Handle(message);
+        }
     }
-    va_end(args);
-    return 0;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Message> m_queue GUARDED_BY(m_mutex);
+    bool m_stop GUARDED_BY(m_mutex) {false};
+    std::thread m_thread;
+};
+
+ZMQPublisher g_publisher;
+
+} // namespace
+
+void CZMQAbstractPublishNotifier::StartPublisher()
+{
+    g_publisher.Start();
+}
+
+void CZMQAbstractPublishNotifier::StopPublisher()
+{
+    g_publisher.Stop();
 }
 
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
@@ -133,26 +268,33 @@ void CZMQAbstractPublishNotifier::Shutdown()
     if (count == 1)
     {
         LogPrint(BCLog::ZMQ, "zmq: Close socket at address %s\n", address);
-        int linger = 0;
-        zmq_setsockopt(psocket, ZMQ_LINGER, &linger, sizeof(linger));
-        zmq_close(psocket);
+        g_publisher.Close(psocket);
     }
 
     psocket = nullptr;
 }
 
 bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+{
+    const unsigned char* begin = static_cast<const unsigned char*>(data);
+    return SendMessage(command, MakeUnique<std::vector<unsigned char>>(begin, begin + size));
+}
+
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, std::unique_ptr<std::vector<unsigned char>> data)
 {
     assert(psocket);
 
-    /* send three parts, command & data & a LE 4byte sequence number */
-    unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), nullptr);
-    if (rc == -1)
-        return false;
+    if (outbound_message_high_water_mark > 0 && m_queued >= (size_t)outbound_message_high_water_mark)
+    {
+        // Skip the sequence number, so that subscribers notice the loss.
+        LogPrint(BCLog::ZMQ, "zmq: Dropping %s message %u, %u messages already queued\n", command, nSequence, m_queued.load());
+    }
+    else
+    {
+        g_publisher.Publish(psocket, m_queued, command, std::move(data), nSequence);
+    }
 
-    /* increment memory only sequence number after sending */
+    /* increment memory only sequence number after queueing */
     nSequence++;
 
     return true;
@@ -179,24 +321,36 @@ bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
 }
 
 bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+{
+    return NotifyTip(pindex, nullptr);
+}
+
+bool CZMQPublishRawBlockNotifier::NotifyTip(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    std::unique_ptr<std::vector<unsigned char>> data = MakeUnique<std::vector<unsigned char>>();
+    CVectorWriter writer(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), *data, 0);
+    if (block)
+    {
+        // The block just connected, no need to read it back from disk.
+        writer << *block;
+    }
+    else
     {
+        const Consensus::Params& consensusParams = Params().GetConsensus();
         LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
+        CBlock block_from_disk;
+        if(!ReadBlockFromDisk(block_from_disk, pindex, consensusParams))
         {
             zmqError("Can't read block from disk");
             return false;
         }
 
-        ss << block;
+        writer << block_from_disk;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return SendMessage(MSG_RAWBLOCK, std::move(data));
 }
 
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
@@ -207,3 +361,126 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+constexpr int64_t CZMQPublishTemplateNotifier::MIN_TEMPLATE_INTERVAL;
+
+bool CZMQPublishTemplateNotifier::NotifyBlock(const CBlockIndex *pindex)
+{
+    return PublishTemplate(/* new_tip */ true);
+}
+
+bool CZMQPublishTemplateNotifier::NotifyTransaction(const CTransaction &transaction)
+{
+    // This is also called for the transactions of connected blocks; those are
+    // covered by the NotifyBlock that follows.
+    if (m_txids.count(transaction.GetHash()) || GetTime() < m_last_publish + MIN_TEMPLATE_INTERVAL) return true;
+    {
+        LOCK(cs_main);
+        if (::ChainstateActive().IsInitialBlockDownload() || ::ChainActive().Tip()->GetBlockHash() != m_prev_hash) return true;
+    }
+    return PublishTemplate(/* new_tip */ false);
+}
+
+bool CZMQPublishTemplateNotifier::PublishTemplate(bool new_tip)
+{
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    try {
+        pblocktemplate = BlockAssembler(::mempool, Params()).CreateNewBlock(CScript() << OP_TRUE);
+    } catch (const std::runtime_error& e) {
+        // Keep the notifier alive, the next tip or transaction may succeed.
+        LogPrint(BCLog::ZMQ, "zmq: Unable to create block template: %s\n", e.what());
+        return true;
+    }
+    const CBlock& block = pblocktemplate->block;
+    const CAmount coinbase_value = block.vtx[0]->vout[0].nValue;
+    m_last_publish = GetTime();
+    if (!new_tip && coinbase_value <= m_coinbase_value) return true;
+
+    std::set<uint256> txids;
+    std::vector<uint256> added;
+    for (size_t i = 1; i < block.vtx.size(); ++i) {
+        const uint256& txid = block.vtx[i]->GetHash();
+        txids.insert(txid);
+        if (!m_txids.count(txid)) added.push_back(txid);
+    }
+    std::vector<uint256> removed;
+    for (const uint256& txid : m_txids) {
+        if (!txids.count(txid)) removed.push_back(txid);
+    }
+    m_prev_hash = block.hashPrevBlock;
+    m_coinbase_value = coinbase_value;
+    m_txids.swap(txids);
+
+    LogPrint(BCLog::ZMQ, "zmq: Publish template on %s (%d added, %d removed)\n", m_prev_hash.GetHex(), added.size(), removed.size());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << m_prev_hash << coinbase_value << added << removed;
+    return SendMessage(MSG_TEMPLATE, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishMempoolHistogramNotifier::NotifyBlock(const CBlockIndex *pindex)
+{
+    const std::vector<FeeHistogramBucket> histogram = ::mempool.GetFeeHistogram();
+    LogPrint(BCLog::ZMQ, "zmq: Publish mempool histogram on %s\n", pindex->GetBlockHash().GetHex());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << pindex->GetBlockHash();
+    WriteCompactSize(ss, histogram.size());
+    for (const FeeHistogramBucket& bucket : histogram) {
+        ss << bucket.min_feerate.GetFeePerK() << bucket.count << bucket.vsize << bucket.fees;
+    }
+    return SendMessage(MSG_MEMPOOLHISTOGRAM, &(*ss.begin()), ss.size());
+}
+
+// Stable codes for the removal reasons in sequence messages, see doc/zmq.md
+static char RemovalReasonCode(MemPoolRemovalReason reason)
+{
+    switch (reason) {
+    case MemPoolRemovalReason::EXPIRY: return 0;
+    case MemPoolRemovalReason::SIZELIMIT: return 1;
+    case MemPoolRemovalReason::REORG: return 2;
+    case MemPoolRemovalReason::BLOCK: return 3;
+    case MemPoolRemovalReason::CONFLICT: return 4;
+    case MemPoolRemovalReason::REPLACED: return 5;
+    } // no default case, so the compiler can warn about missing cases
+    assert(false);
+}
+
+bool CZMQPublishSequenceNotifier::SendSequenceMessage(const uint256& hash, char label, const uint64_t* mempool_sequence, const char* reason)
+{
+    unsigned char data[sizeof(uint256) + 1 + sizeof(uint64_t) + 1];
+    size_t size = 0;
+    for (unsigned int i = 0; i < sizeof(uint256); i++)
+        data[size++] = hash.begin()[sizeof(uint256) - 1 - i];
+    data[size++] = label;
+    if (mempool_sequence)
+    {
+        WriteLE64(&data[size], *mempool_sequence);
+        size += sizeof(uint64_t);
+    }
+    if (reason) data[size++] = *reason;
+    return SendMessage(MSG_SEQUENCE, data, size);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockConnect(const CBlockIndex *pindex)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block connect %s\n", pindex->GetBlockHash().GetHex());
+    return SendSequenceMessage(pindex->GetBlockHash(), 'C');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnect(const CBlockIndex *pindex)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence block disconnect %s\n", pindex->GetBlockHash().GetHex());
+    return SendSequenceMessage(pindex->GetBlockHash(), 'D');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence mempool acceptance %s\n", transaction.GetHash().GetHex());
+    return SendSequenceMessage(transaction.GetHash(), 'A', &mempool_sequence);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason, uint64_t mempool_sequence)
+{
+    LogPrint(BCLog::ZMQ, "zmq: Publish sequence mempool removal %s\n", transaction.GetHash().GetHex());
+    const char code = RemovalReasonCode(reason);
+    return SendSequenceMessage(transaction.GetHash(), 'R', &mempool_sequence, &code);
+}
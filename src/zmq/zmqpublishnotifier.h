@@ -5,24 +5,41 @@
 #ifndef PALLADIUM_ZMQ_ZMQPUBLISHNOTIFIER_H
 #define PALLADIUM_ZMQ_ZMQPUBLISHNOTIFIER_H
 
+#include <amount.h>
+#include <uint256.h>
 #include <zmq/zmqabstractnotifier.h>
 
+#include <atomic>
+#include <memory>
+#include <set>
+#include <vector>
+
 class CBlockIndex;
 
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
     uint32_t nSequence {0U}; //!< upcounting per message sequence number
+    std::atomic<size_t> m_queued {0U}; //!< messages waiting for the publisher thread
 
 public:
 
-    /* send zmq multipart message
+    /* queue zmq multipart message for the publisher thread
        parts:
           * command
           * data
           * message sequence number
+       A message is dropped (its sequence number skipped) when the
+       notifier already has its high water mark of messages queued.
     */
     bool SendMessage(const char *command, const void* data, size_t size);
+    /* as above, handing the serialized data over to ZMQ without a copy */
+    bool SendMessage(const char *command, std::unique_ptr<std::vector<unsigned char>> data);
+
+    /* start and stop the thread that sends the queued messages; stopping
+       sends (or drops, if the socket is full) whatever is still queued */
+    static void StartPublisher();
+    static void StopPublisher();
 
     bool Initialize(void *pcontext) override;
     void Shutdown() override;
@@ -44,6 +61,7 @@ class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
     bool NotifyBlock(const CBlockIndex *pindex) override;
+    bool NotifyTip(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& block) override;
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -52,4 +70,57 @@ public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+/**
+ * Publishes how the block template changed: on every new tip, and when new
+ * mempool transactions raised the coinbase value (at most once per
+ * MIN_TEMPLATE_INTERVAL). Miners can follow it instead of long polling
+ * getblocktemplate.
+ */
+class CZMQPublishTemplateNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    static constexpr int64_t MIN_TEMPLATE_INTERVAL{1};
+
+    bool NotifyBlock(const CBlockIndex *pindex) override;
+    bool NotifyTransaction(const CTransaction &transaction) override;
+
+private:
+    /** Assemble a new template and publish its difference to the previous one. */
+    bool PublishTemplate(bool new_tip);
+
+    uint256 m_prev_hash;
+    CAmount m_coinbase_value{0};
+    std::set<uint256> m_txids;
+    int64_t m_last_publish{0};
+};
+
+/**
+ * Publishes the mempool fee histogram (see getmempoolinfo) on every new tip,
+ * once the block's transactions have left the mempool.
+ */
+class CZMQPublishMempoolHistogramNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlock(const CBlockIndex *pindex) override;
+};
+
+/**
+ * Publishes every change to the mempool and the chain, one message each, so
+ * that subscribers can mirror the mempool: blocks connected and
+ * disconnected, and transactions added and removed (with the mempool
+ * sequence number and, for removals, the reason). getrawmempool returns the
+ * sequence number of its snapshot to sync up against.
+ */
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnect(const CBlockIndex *pindex) override;
+    bool NotifyBlockDisconnect(const CBlockIndex *pindex) override;
+    bool NotifyTransactionAcceptance(const CTransaction &transaction, uint64_t mempool_sequence) override;
+    bool NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason, uint64_t mempool_sequence) override;
+
+private:
+    bool SendSequenceMessage(const uint256& hash, char label, const uint64_t* mempool_sequence = nullptr, const char* reason = nullptr);
+};
+
 #endif // PALLADIUM_ZMQ_ZMQPUBLISHNOTIFIER_H
@@ -20,6 +20,8 @@ class AbortNodeTest(PalladiumTestFramework):
         self.setup_clean_chain = True
         self.num_nodes = 2
         self.rpc_timeout = 240
+        # Disconnecting must read the undo data from disk, not the reorg cache
+        self.extra_args = [["-reorgcache=0"], []]
 
     def setup_network(self):
         self.setup_nodes()
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test loading the block index from the image written at shutdown (-blockindeximage)."""
+import os
+
+from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import assert_equal
+
+
+class BlockIndexImageTest(PalladiumTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        self.extra_args = [["-blockindeximage"]]
+
+    def chain_state(self):
+        node = self.nodes[0]
+        return node.getbestblockhash(), sorted(node.getchaintips(), key=lambda tip: tip["hash"])
+
+    def run_test(self):
+        node = self.nodes[0]
+        image = os.path.join(node.datadir, "regtest", "blocks", "index.img")
+
+        self.log.info("Build a chain with an invalidated fork")
+        node.generate(50)
+        fork = node.getblockhash(40)
+        node.invalidateblock(fork)
+        node.generatetoaddress(15, ADDRESS_BCRT1_UNSPENDABLE)
+        node.reconsiderblock(fork)
+        state = self.chain_state()
+        assert_equal(len(state[1]), 2)
+
+        self.log.info("The block index is loaded from the image after a restart")
+        with node.assert_debug_log(["Loaded 66 block index entries from"]):
+            self.restart_node(0)
+        assert os.path.isfile(image)
+        assert_equal(self.chain_state(), state)
+        node.generate(1)
+        state = self.chain_state()
+
+        self.log.info("A corrupt image is ignored")
+        self.stop_node(0)
+        with open(image, "r+b") as f:
+            f.seek(100)
+            f.write(b"\xff" * 8)
+        with node.assert_debug_log(["is corrupt"], unexpected_msgs=["block index entries from"]):
+            self.start_node(0)
+        assert_equal(self.chain_state(), state)
+
+        self.log.info("An image of an earlier generation is ignored")
+        self.stop_node(0)
+        with open(image, "rb") as f:
+            old_image = f.read()
+        self.start_node(0)
+        node.generate(1)
+        state = self.chain_state()
+        self.stop_node(0)
+        with open(image, "wb") as f:
+            f.write(old_image)
+        with node.assert_debug_log([], unexpected_msgs=["block index entries from"]):
+            self.start_node(0)
+        assert_equal(self.chain_state(), state)
+
+
+if __name__ == '__main__':
+    BlockIndexImageTest().main()
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test coinstatsindex and the gettxoutsetinfo RPC with hash_type and hash_or_height."""
+
+from decimal import Decimal
+
+from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    wait_until,
+)
+
+
+def index_fields(info):
+    """The fields of gettxoutsetinfo that the index provides."""
+    return {k: v for k, v in info.items() if k not in ('transactions', 'disk_size')}
+
+
+class CoinStatsIndexTest(PalladiumTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-coinstatsindex"], []]
+
+    def sync_index(self, node):
+        wait_until(lambda: 'transactions' not in node.gettxoutsetinfo('muhash'))
+
+    def run_test(self):
+        index_node, node = self.nodes
+        self.sync_index(index_node)
+
+        self.log.info("The index gives the same statistics as a scan of the chainstate")
+        info = index_node.gettxoutsetinfo('muhash')
+        assert 'transactions' not in info and 'disk_size' not in info
+        scan = node.gettxoutsetinfo('muhash')
+        assert_equal(info, index_fields(scan))
+        assert_equal(index_fields(index_node.gettxoutsetinfo('none')), {k: v for k, v in info.items() if k != 'muhash'})
+        assert_equal(index_node.gettxoutsetinfo()['hash_serialized_2'], node.gettxoutsetinfo()['hash_serialized_2'])
+
+        self.log.info("Bad arguments are rejected")
+        assert_raises_rpc_error(-8, "foo is not a valid hash_type", index_node.gettxoutsetinfo, "foo")
+        assert_raises_rpc_error(-8, "Querying specific block heights requires coinstatsindex", node.gettxoutsetinfo, "muhash", 10)
+        assert_raises_rpc_error(-8, "hash_serialized_2 hash type cannot be queried for a specific block", index_node.gettxoutsetinfo, "hash_serialized_2", 10)
+        assert_raises_rpc_error(-8, "Target block height 1000 after current tip", index_node.gettxoutsetinfo, "muhash", 1000)
+        assert_raises_rpc_error(-5, "Block not found", index_node.gettxoutsetinfo, "muhash", "00" * 32)
+
+        self.log.info("Spending an output updates the statistics, earlier blocks keep theirs")
+        height = index_node.getblockcount()
+        key = index_node.get_deterministic_priv_key()
+        coinbase = index_node.getblock(index_node.getblockhash(1), 2)['tx'][0]
+        amount = coinbase['vout'][0]['value'] - Decimal('0.001')
+        rawtx = index_node.createrawtransaction([{'txid': coinbase['txid'], 'vout': 0}], [{ADDRESS_BCRT1_UNSPENDABLE: amount}, {'data': '00'}])
+        signed = index_node.signrawtransactionwithkey(rawtx, [key.key], [{
+            'txid': coinbase['txid'],
+            'vout': 0,
+            'scriptPubKey': coinbase['vout'][0]['scriptPubKey']['hex'],
+            'amount': coinbase['vout'][0]['value'],
+        }])
+        index_node.sendrawtransaction(signed['hex'])
+        block = index_node.generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+        self.sync_all()
+        self.sync_index(index_node)
+        new_info = index_node.gettxoutsetinfo('muhash')
+        assert_equal(new_info, index_fields(node.gettxoutsetinfo('muhash')))
+        assert_equal(new_info['height'], height + 1)
+        # The coinbase and the payment are added, the spent coinbase and the OP_RETURN output are not counted
+        assert_equal(new_info['txouts'], info['txouts'] + 1)
+        assert_equal(index_node.gettxoutsetinfo('muhash', height), info)
+        assert_equal(index_node.gettxoutsetinfo('muhash', info['bestblock']), info)
+        assert_equal(index_node.gettxoutsetinfo(hash_type='muhash', hash_or_height=block), new_info)
+
+        self.log.info("A reorg reverts the statistics, and those of the stale block stay available")
+        index_node.invalidateblock(block)
+        node.invalidateblock(block)
+        assert_equal(index_node.gettxoutsetinfo('muhash'), info)
+        self.sync_index(index_node)
+        index_node.generatetoaddress(2, key.address)
+        self.sync_all()
+        self.sync_index(index_node)
+        reorg_info = index_node.gettxoutsetinfo('muhash')
+        assert_equal(reorg_info, index_fields(node.gettxoutsetinfo('muhash')))
+        assert_equal(reorg_info['height'], height + 2)
+        assert_equal(index_node.gettxoutsetinfo('muhash', block), new_info)
+
+        self.log.info("The index persists across restarts")
+        self.restart_node(0, extra_args=["-coinstatsindex"])
+        self.sync_index(self.nodes[0])
+        assert_equal(self.nodes[0].gettxoutsetinfo('muhash'), reorg_info)
+        assert_equal(self.nodes[0].gettxoutsetinfo('muhash', height), info)
+
+
+if __name__ == '__main__':
+    CoinStatsIndexTest().main()
@@ -135,6 +135,14 @@ def check_smart_estimates(node, fees_seen):
         else:
             assert_greater_than_or_equal(i + 1, e["blocks"])
 
+    # The table holds the same estimates for every target.
+    table = node.estimatesmartfeetable()
+    assert_equal(len(table), 1008)
+    for i, e in enumerate(all_smart_estimates):
+        assert_equal(table[i], dict(e, target=i + 1))
+    for i, e in [(i, node.estimatesmartfee(i, "ECONOMICAL")) for i in (1, 6, 25)]:
+        assert_equal(node.estimatesmartfeetable("ECONOMICAL")[i - 1], dict(e, target=i))
+
 def check_estimates(node, fees_seen):
     check_raw_estimates(node, fees_seen)
     check_smart_estimates(node, fees_seen)
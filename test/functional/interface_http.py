@@ -104,6 +104,20 @@ class HTTPBasicsTest (PalladiumTestFramework):
         out1 = conn.getresponse()
         assert_equal(out1.status, http.client.BAD_REQUEST)
 
+        # Check that a large reply is streamed in chunks on a connection that stays open
+        big = 'x' * 3000000
+        conn = http.client.HTTPConnection(urlNode2.hostname, urlNode2.port)
+        conn.connect()
+        conn.request('POST', '/', '{"method": "echo", "params": ["%s"], "id": 1}' % big, headers)
+        out1 = conn.getresponse()
+        assert_equal(out1.status, http.client.OK)
+        assert_equal(out1.getheader('Transfer-Encoding'), 'chunked')
+        assert_equal(out1.read(), ('{"result":["%s"],"error":null,"id":1}\n' % big).encode())
+        conn.request('POST', '/', '{"method": "getbestblockhash"}', headers)
+        out1 = conn.getresponse().read()
+        assert b'"error":null' in out1
+        conn.close()
+
 
 if __name__ == '__main__':
     HTTPBasicsTest ().main ()
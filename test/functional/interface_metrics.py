@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+# Copyright (c) 2026 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the /metrics endpoint."""
+
+import http.client
+import urllib.parse
+
+from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+    assert_greater_than_or_equal,
+    disconnect_nodes,
+)
+
+
+def parse_metrics(text):
+    """Map each sample (name with labels) to its value."""
+    samples = {}
+    for line in text.splitlines():
+        if not line or line.startswith('#'):
+            continue
+        name, value = line.rsplit(' ', 1)
+        samples[name] = float(value)
+    return samples
+
+
+class MetricsTest(PalladiumTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [["-metrics"], []]
+
+    def get_metrics(self, node, status=200):
+        url = urllib.parse.urlparse(node.url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request('GET', '/metrics')
+        resp = conn.getresponse()
+        assert_equal(resp.status, status)
+        return resp.read().decode('utf-8')
+
+    def run_test(self):
+        self.log.info("Check /metrics is not served without -metrics")
+        self.get_metrics(self.nodes[1], status=404)
+
+        self.log.info("Check chain and coins cache metrics")
+        self.nodes[0].generatetoaddress(10, ADDRESS_BCRT1_UNSPENDABLE)
+        self.sync_all()
+        metrics = parse_metrics(self.get_metrics(self.nodes[0]))
+        assert_equal(metrics['palladium_chain_height'], 10)
+        assert_equal(metrics['palladium_chain_header_height'], 10)
+        assert_equal(metrics['palladium_chain_tip_time_seconds'], self.nodes[0].getblockheader(self.nodes[0].getbestblockhash())['time'])
+        assert_greater_than(metrics['palladium_coins_cache_usage_bytes'], 0)
+        assert_greater_than(metrics['palladium_coins_cache_limit_bytes'], metrics['palladium_coins_cache_usage_bytes'])
+        assert_greater_than_or_equal(metrics['palladium_sigcache_contended_writes_total'], 0)
+
+        self.log.info("Check mempool metrics")
+        mempoolinfo = self.nodes[0].getmempoolinfo()
+        assert_equal(metrics['palladium_mempool_transactions'], mempoolinfo['size'])
+        assert_equal(metrics['palladium_mempool_vsize_bytes'], mempoolinfo['bytes'])
+        assert_equal(metrics['palladium_mempool_fees_satoshis'], 0)
+
+        self.log.info("Check per-message-type traffic metrics")
+        assert_equal(metrics['palladium_peers{direction="inbound"}'] + metrics['palladium_peers{direction="outbound"}'], 1)
+        peer = self.nodes[0].getpeerinfo()[0]
+        assert_greater_than(metrics['palladium_net_sent_bytes_total{type="version"}'], 0)
+        assert_greater_than(metrics['palladium_net_received_bytes_total{type="version"}'], 0)
+        assert_equal(metrics['palladium_net_received_bytes_total{type="version"}'], peer['bytesrecv_per_msg']['version'])
+
+        self.log.info("Check traffic of disconnected peers is kept")
+        sent_version = metrics['palladium_net_sent_bytes_total{type="version"}']
+        disconnect_nodes(self.nodes[0], 1)
+        metrics = parse_metrics(self.get_metrics(self.nodes[0]))
+        assert_equal(metrics['palladium_peers{direction="inbound"}'] + metrics['palladium_peers{direction="outbound"}'], 0)
+        assert_greater_than_or_equal(metrics['palladium_net_sent_bytes_total{type="version"}'], sent_version)
+
+        self.log.info("Check latency histograms")
+        count = metrics['palladium_latency_seconds_count{path="connecttip.total"}']
+        assert_greater_than(count, 9)
+        assert_equal(metrics['palladium_latency_seconds_bucket{path="connecttip.total",le="+Inf"}'], count)
+
+
+if __name__ == '__main__':
+    MetricsTest().main()
@@ -3,6 +3,9 @@
 # Distributed under the MIT software license, see the accompanying
 # file COPYING or http://www.opensource.org/licenses/mit-license.php.
 """Test palladium-cli"""
+import json
+import subprocess
+
 from test_framework.test_framework import PalladiumTestFramework
 from test_framework.util import assert_equal, assert_raises_process_error, get_auth_cookie
 
@@ -48,6 +51,32 @@ class TestPalladiumCli(PalladiumTestFramework):
         self.log.info("Test connecting with non-existing RPC cookie file")
         assert_raises_process_error(1, "Could not locate RPC credentials", self.nodes[0].cli('-rpccookiefile=does-not-exist', '-rpcpassword=').echo)
 
+        self.log.info("Test -batch")
+        requests = '\n'.join([
+            'getblockcount',
+            '',
+            '{"method": "echo", "params": ["a", 1], "id": "mine"}',
+            '{"method": 5}',
+            'getblockhash 0',
+            'getblockhash 1000',
+        ] + ['echo %d' % i for i in range(20)])
+        cli = self.nodes[0].cli
+        for pipeline in (1, 8):
+            # The exit status is 1 as some requests fail, with all replies printed in order
+            process = subprocess.run([cli.binary, '-datadir=' + cli.datadir, '-batch', '-pipeline=%d' % pipeline],
+                                     input=requests, stdout=subprocess.PIPE, universal_newlines=True)
+            assert_equal(process.returncode, 1)
+            replies = [json.loads(line) for line in process.stdout.splitlines()]
+            assert_equal([reply['id'] for reply in replies[:5]], [1, 'mine', 4, 5, 6])
+            assert_equal(replies[0]['result'], 0)
+            assert_equal(replies[1]['result'], ['a', 1])
+            assert_equal(replies[2]['error']['code'], -32700)
+            assert_equal(replies[3]['result'], self.nodes[0].getblockhash(0))
+            assert_equal(replies[4]['error']['code'], -8)
+            assert_equal([reply['result'] for reply in replies[5:]], [[str(i)] for i in range(20)])
+        assert_equal(self.nodes[0].cli('-batch', input='echo x\n').send_cli(), {'result': ['x'], 'error': None, 'id': 1})
+        assert_raises_process_error(1, "-batch takes its requests from standard input", self.nodes[0].cli('-batch').echo)
+
         self.log.info("Make sure that -getinfo with arguments fails")
         assert_raises_process_error(1, "-getinfo takes no arguments", self.nodes[0].cli('-getinfo').help)
 
@@ -281,6 +281,20 @@ class RESTTest (PalladiumTestFramework):
         json_obj = self.test_rest_request("/headers/5/{}".format(bb_hash))
         assert_equal(len(json_obj), 5)  # now we should have 5 header objects
 
+        self.log.info("Test the /blocks URI")
+        height = self.nodes[0].getblock(bb_hash)['height']
+        def raw_blocks(first, last):
+            return b''.join(hex_str_to_bytes(self.nodes[0].getblock(self.nodes[0].getblockhash(h), 0)) for h in range(first, last + 1))
+        response = self.test_rest_request("/blocks/{}/3".format(bb_hash), req_type=ReqType.BIN, ret_type=RetType.OBJ)
+        assert_equal(response.getheader('content-type'), 'application/octet-stream')
+        assert_equal(response.read(), raw_blocks(height, height + 2))
+        # The reply ends at the tip
+        assert_equal(self.test_rest_request("/blocks/{}/100".format(bb_hash), req_type=ReqType.BIN, ret_type=RetType.BYTES),
+                     raw_blocks(height, self.nodes[0].getblockcount()))
+        self.test_rest_request("/blocks/{}/0".format(bb_hash), req_type=ReqType.BIN, status=400, ret_type=RetType.OBJ)
+        self.test_rest_request("/blocks/{}/3".format(bb_hash), status=404, ret_type=RetType.OBJ)
+        self.test_rest_request("/blocks/{}/3".format('0' * 64), req_type=ReqType.BIN, status=404, ret_type=RetType.OBJ)
+
         self.log.info("Test tx inclusion in the /mempool and /block URIs")
 
         # Make 3 tx and mine them on node 1
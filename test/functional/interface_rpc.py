@@ -4,10 +4,18 @@
 # file COPYING or http://www.opensource.org/licenses/mit-license.php.
 """Tests some generic aspects of the RPC interface."""
 
+from decimal import Decimal
+import http.client
+import json
 import os
-from test_framework.authproxy import JSONRPCException
+import struct
+import threading
+import time
+import urllib.parse
+
+from test_framework.authproxy import AuthServiceProxy, JSONRPCException
 from test_framework.test_framework import PalladiumTestFramework
-from test_framework.util import assert_equal, assert_greater_than_or_equal
+from test_framework.util import assert_equal, assert_greater_than, assert_greater_than_or_equal, assert_raises_rpc_error, str_to_b64str
 
 def expect_http_status(expected_http_status, expected_rpc_code,
                        fcn, *args):
@@ -18,6 +26,46 @@ def expect_http_status(expected_http_status, expected_rpc_code,
         assert_equal(exc.error["code"], expected_rpc_code)
         assert_equal(exc.http_status, expected_http_status)
 
+def decode_cbor(data, pos=0):
+    """Decode the CBOR value at data[pos:] into what the JSON reply would parse to; return it and the next position."""
+    major, info = data[pos] >> 5, data[pos] & 0x1f
+    pos += 1
+    if major == 7:
+        if info == 27:
+            return Decimal(repr(struct.unpack('>d', data[pos:pos + 8])[0])), pos + 8
+        return {20: False, 21: True, 22: None}[info], pos
+    n = info
+    if info >= 24:
+        size = 1 << (info - 24)
+        n = int.from_bytes(data[pos:pos + size], 'big')
+        pos += size
+    if major == 0:
+        return n, pos
+    if major == 1:
+        return -1 - n, pos
+    if major == 2:
+        return data[pos:pos + n], pos + n
+    if major == 3:
+        return data[pos:pos + n].decode(), pos + n
+    if major == 4:
+        items = []
+        for _ in range(n):
+            item, pos = decode_cbor(data, pos)
+            items.append(item)
+        return items, pos
+    if major == 5:
+        obj = {}
+        for _ in range(n):
+            key, pos = decode_cbor(data, pos)
+            obj[key], pos = decode_cbor(data, pos)
+        return obj, pos
+    assert_equal(major, 6)
+    value, pos = decode_cbor(data, pos)
+    if n == 4:  # decimal fraction
+        return Decimal(value[1]).scaleb(value[0]), pos
+    assert_equal(n, 23)  # bytes expected as hex
+    return value.hex(), pos
+
 class RPCInterfaceTest(PalladiumTestFramework):
     def set_test_params(self):
         self.num_nodes = 1
@@ -34,6 +82,59 @@ class RPCInterfaceTest(PalladiumTestFramework):
         assert_equal(command['method'], 'getrpcinfo')
         assert_greater_than_or_equal(command['duration'], 0)
         assert_equal(info['logpath'], os.path.join(self.nodes[0].datadir, self.chain, 'debug.log'))
+        assert_equal(info['work_queue']['depth'], 0)
+        assert_equal(info['work_queue']['max_depth'], 16)
+        assert_equal(info['work_queue']['rejected'], 0)
+        assert_equal(len(info['work_queue']['wait_histogram']), 6)
+        assert_equal(info['priority_queue']['max_depth'], 16)
+        assert 'rest_queue' not in info
+
+    def test_work_queue_backpressure(self):
+        self.log.info("Testing that requests wait for room in a full work queue...")
+
+        self.restart_node(0, extra_args=["-rpcthreads=1", "-rpcworkqueue=1"])
+        results = []
+
+        def wait_for_block():
+            rpc = AuthServiceProxy(self.nodes[0].url, timeout=60)
+            results.append(rpc.waitfornewblock(300))
+
+        threads = [threading.Thread(target=wait_for_block) for _ in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        assert_equal(len(results), 4)
+
+        info = self.nodes[0].getrpcinfo()['work_queue']
+        assert_equal(info['max_depth'], 1)
+        assert_equal(info['peak_depth'], 1)
+        assert_equal(info['rejected'], 0)
+        assert_greater_than_or_equal(info['delayed'], 1)
+        assert_greater_than_or_equal(sum(info['wait_histogram']), 5)
+        self.restart_node(0)
+
+    def test_priority_queue(self):
+        self.log.info("Testing that priority methods don't wait behind other calls...")
+
+        self.restart_node(0, extra_args=["-rpcthreads=1", "-rpcworkqueue=1"])
+
+        def wait_for_block():
+            rpc = AuthServiceProxy(self.nodes[0].url, timeout=60)
+            rpc.waitfornewblock(10000)
+
+        # Keep the only RPC worker thread busy and its queue full.
+        threads = [threading.Thread(target=wait_for_block) for _ in range(2)]
+        for thread in threads:
+            thread.start()
+        time.sleep(1)
+        start = time.time()
+        assert_raises_rpc_error(-22, "TX decode failed", self.nodes[0].sendrawtransaction, "00")
+        assert_greater_than(5, time.time() - start)
+        for thread in threads:
+            thread.join()
+        assert_equal(self.nodes[0].getrpcinfo()['priority_queue']['rejected'], 0)
+        self.restart_node(0)
 
     def test_batch_request(self):
         self.log.info("Testing basic JSON-RPC batch request...")
@@ -61,16 +162,78 @@ class RPCInterfaceTest(PalladiumTestFramework):
         assert_equal(result_by_id[3]['error'], None)
         assert result_by_id[3]['result'] is not None
 
+    def test_parallel_batch_request(self):
+        self.log.info("Testing JSON-RPC batch request executed on several threads...")
+
+        self.restart_node(0, extra_args=["-rpcbatchthreads=4"])
+        best_hash = self.nodes[0].getbestblockhash()
+        calls = []
+        for i in range(50):
+            if i % 5 == 0:
+                calls.append({"method": "invalidmethod", "id": i})
+            else:
+                calls.append({"method": "getblockheader", "params": [best_hash], "id": i})
+        results = self.nodes[0].batch(calls)
+
+        # Replies are in the order of the calls
+        assert_equal([res["id"] for res in results], list(range(50)))
+        for res in results:
+            if res["id"] % 5 == 0:
+                assert_equal(res['error']['code'], -32601)
+            else:
+                assert_equal(res['error'], None)
+                assert_equal(res['result']['hash'], best_hash)
+        self.restart_node(0)
+
     def test_http_status_codes(self):
         self.log.info("Testing HTTP status codes for JSON-RPC requests...")
 
         expect_http_status(404, -32601, self.nodes[0].invalidmethod)
         expect_http_status(500, -8, self.nodes[0].getblockhash, 42)
 
+    def test_cbor_replies(self):
+        self.log.info("Testing JSON-RPC replies in CBOR...")
+
+        node = self.nodes[0]
+        url = urllib.parse.urlparse(node.url)
+        headers = {
+            "Authorization": "Basic " + str_to_b64str(url.username + ":" + url.password),
+            "Accept": "application/cbor",
+        }
+
+        def call(method, params):
+            conn = http.client.HTTPConnection(url.hostname, url.port)
+            conn.request('POST', '/', json.dumps({"method": method, "params": params, "id": 1}), headers)
+            response = conn.getresponse()
+            assert_equal(response.getheader('Content-Type'), 'application/cbor')
+            body = response.read()
+            reply, end = decode_cbor(body)
+            assert_equal(end, len(body))
+            return response.status, reply, len(body)
+
+        best_hash = node.getbestblockhash()
+        status, reply, size = call("getblock", [best_hash, 2])
+        assert_equal(status, 200)
+        assert_equal(reply, {"result": node.getblock(best_hash, 2), "error": None, "id": 1})
+
+        # Hex goes over the wire as bytes
+        status, reply, size = call("getblock", [best_hash, 0])
+        assert_equal(reply["result"], node.getblock(best_hash, 0))
+        assert size < len(reply["result"]) // 2 + 32
+
+        status, reply, size = call("invalidmethod", [])
+        assert_equal(status, 404)
+        assert_equal(reply["result"], None)
+        assert_equal(reply["error"]["code"], -32601)
+
     def run_test(self):
         self.test_getrpcinfo()
+        self.test_work_queue_backpressure()
+        self.test_priority_queue()
         self.test_batch_request()
+        self.test_parallel_batch_request()
         self.test_http_status_codes()
+        self.test_cbor_replies()
 
 
 if __name__ == '__main__':
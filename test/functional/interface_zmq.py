@@ -7,8 +7,8 @@ import struct
 
 from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
 from test_framework.test_framework import PalladiumTestFramework
-from test_framework.messages import CTransaction, hash256
-from test_framework.util import assert_equal, connect_nodes
+from test_framework.messages import CTransaction, deser_compact_size, hash256
+from test_framework.util import assert_equal, connect_nodes, satoshi_round
 from io import BytesIO
 from time import sleep
 
@@ -48,6 +48,9 @@ class ZMQTest (PalladiumTestFramework):
         try:
             self.test_basic()
             self.test_reorg()
+            self.test_template()
+            self.test_mempool_histogram()
+            self.test_sequence()
         finally:
             # Destroy the ZMQ context.
             self.log.debug("Destroying ZMQ context")
@@ -156,5 +159,153 @@ class ZMQTest (PalladiumTestFramework):
         # Should receive nodes[1] tip
         assert_equal(self.nodes[1].getbestblockhash(), hashblock.receive().hex())
 
+    def test_template(self):
+        import zmq
+        address = 'tcp://127.0.0.1:28334'
+        socket = self.ctx.socket(zmq.SUB)
+        socket.set(zmq.RCVTIMEO, 60000)
+        template = ZMQSubscriber(socket, b'template')
+
+        self.restart_node(0, ['-zmqpub%s=%s' % (template.topic.decode(), address)])
+        connect_nodes(self.nodes[0], 1)
+        socket.connect(address)
+        # Relax so that the subscriber is ready before publishing zmq messages
+        sleep(0.2)
+
+        def receive_template():
+            body = BytesIO(template.receive())
+            prev_hash = body.read(32)[::-1].hex()
+            coinbase_value = struct.unpack('<q', body.read(8))[0]
+            added = [body.read(32)[::-1].hex() for _ in range(deser_compact_size(body))]
+            removed = [body.read(32)[::-1].hex() for _ in range(deser_compact_size(body))]
+            return prev_hash, coinbase_value, added, removed
+
+        self.log.info("A new tip publishes the template built on it")
+        tip = self.nodes[0].generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+        prev_hash, coinbase_value, added, removed = receive_template()
+        assert_equal(prev_hash, tip)
+        assert_equal(coinbase_value, self.nodes[0].getblocktemplate({"rules": ["segwit"]})["coinbasevalue"])
+        assert_equal((added, removed), ([], []))
+
+        if self.is_wallet_compiled():
+            self.log.info("Fees from a new transaction publish the added txid")
+            # Leave the rate limit behind
+            sleep(1.1)
+            payment_txid = self.nodes[1].sendtoaddress(self.nodes[0].getnewaddress(), 1.0)
+            self.sync_all()
+            prev_hash, new_coinbase_value, added, removed = receive_template()
+            assert_equal(prev_hash, tip)
+            assert new_coinbase_value > coinbase_value
+            assert_equal((added, removed), ([payment_txid], []))
+
+            self.log.info("Mining it publishes the txid as removed")
+            tip = self.nodes[0].generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+            prev_hash, coinbase_value, added, removed = receive_template()
+            assert_equal(prev_hash, tip)
+            assert_equal((added, removed), ([], [payment_txid]))
+
+    def test_mempool_histogram(self):
+        import zmq
+        address = 'tcp://127.0.0.1:28335'
+        socket = self.ctx.socket(zmq.SUB)
+        socket.set(zmq.RCVTIMEO, 60000)
+        histogram = ZMQSubscriber(socket, b'mempoolhistogram')
+
+        self.restart_node(0, ['-zmqpub%s=%s' % (histogram.topic.decode(), address)])
+        connect_nodes(self.nodes[0], 1)
+        socket.connect(address)
+        # Relax so that the subscriber is ready before publishing zmq messages
+        sleep(0.2)
+
+        def receive_histogram():
+            body = BytesIO(histogram.receive())
+            block_hash = body.read(32)[::-1].hex()
+            buckets = [struct.unpack('<qQQq', body.read(32)) for _ in range(deser_compact_size(body))]
+            return block_hash, buckets
+
+        txid = None
+        if self.is_wallet_compiled():
+            # Keep the transaction out of the next block
+            txid = self.nodes[1].sendtoaddress(self.nodes[1].getnewaddress(), 1.0)
+            self.sync_mempools()
+            self.nodes[0].prioritisetransaction(txid=txid, fee_delta=-10**8)
+
+        self.log.info("A new tip publishes the mempool fee histogram")
+        tip = self.nodes[0].generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+        block_hash, buckets = receive_histogram()
+        assert_equal(block_hash, tip)
+        expected = self.nodes[0].getmempoolinfo(True)['histogram']
+        assert_equal(len(buckets), len(expected))
+        for (min_feerate, count, vsize, fees), bucket in zip(buckets, expected):
+            assert_equal(satoshi_round(min_feerate / 1e8), bucket['feerate'])
+            assert_equal((count, vsize, satoshi_round(fees / 1e8)), (bucket['count'], bucket['vsize'], bucket['fees']))
+        assert_equal(sum(count for _, count, _, _ in buckets), 1 if txid else 0)
+        if txid:
+            entry = self.nodes[0].getmempoolentry(txid)
+            assert_equal(sum(vsize for _, _, vsize, _ in buckets), entry['vsize'])
+            assert_equal(satoshi_round(sum(fees for _, _, _, fees in buckets) / 1e8), entry['fees']['base'])
+
+    def test_sequence(self):
+        import zmq
+        address = 'tcp://127.0.0.1:28336'
+        socket = self.ctx.socket(zmq.SUB)
+        socket.set(zmq.RCVTIMEO, 60000)
+        seq = ZMQSubscriber(socket, b'sequence')
+
+        self.restart_node(0, ['-zmqpub%s=%s' % (seq.topic.decode(), address)])
+        connect_nodes(self.nodes[0], 1)
+        socket.connect(address)
+        # Relax so that the subscriber is ready before publishing zmq messages
+        sleep(0.2)
+
+        def receive_sequence():
+            body = seq.receive()
+            hash = body[:32][::-1].hex()
+            label = chr(body[32])
+            mempool_sequence = None if len(body) == 33 else struct.unpack('<Q', body[33:41])[0]
+            reason = None if len(body) <= 41 else body[41]
+            if label in "CD":
+                assert_equal(len(body), 33)
+            else:
+                assert_equal(len(body), 41 if label == "A" else 42)
+            return hash, label, mempool_sequence, reason
+
+        self.log.info("Blocks connected and disconnected are published")
+        tip = self.nodes[0].generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+        assert_equal(receive_sequence(), (tip, 'C', None, None))
+        self.sync_all()
+
+        if not self.is_wallet_compiled():
+            return
+
+        self.log.info("Mempool additions carry the mempool sequence of getrawmempool")
+        start = self.nodes[0].getrawmempool(False, True)
+        assert_equal(start['txids'], [])
+        txid = self.nodes[1].sendtoaddress(address=self.nodes[0].getnewaddress(), amount=1.0, replaceable=True)
+        self.sync_mempools()
+        assert_equal(receive_sequence(), (txid, 'A', start['mempool_sequence'], None))
+        mempool = self.nodes[0].getrawmempool(False, True)
+        assert_equal(mempool, {'txids': [txid], 'mempool_sequence': start['mempool_sequence'] + 1})
+
+        self.log.info("Replacements publish the removal with its reason")
+        bump_txid = self.nodes[1].bumpfee(txid)['txid']
+        self.sync_mempools()
+        # MemPoolRemovalReason REPLACED
+        assert_equal(receive_sequence(), (txid, 'R', mempool['mempool_sequence'], 5))
+        assert_equal(receive_sequence(), (bump_txid, 'A', mempool['mempool_sequence'] + 1, None))
+
+        self.log.info("Transactions leaving for a block only take a mempool sequence")
+        tip = self.nodes[0].generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+        assert_equal(receive_sequence(), (tip, 'C', None, None))
+        mempool = self.nodes[0].getrawmempool(False, True)
+        assert_equal(mempool, {'txids': [], 'mempool_sequence': start['mempool_sequence'] + 4})
+
+        self.log.info("A disconnected block returns its transactions to the mempool")
+        self.nodes[0].invalidateblock(tip)
+        assert_equal(receive_sequence(), (tip, 'D', None, None))
+        assert_equal(receive_sequence(), (bump_txid, 'A', mempool['mempool_sequence'], None))
+        self.nodes[0].reconsiderblock(tip)
+        assert_equal(receive_sequence(), (tip, 'C', None, None))
+
 if __name__ == '__main__':
     ZMQTest().main()
@@ -6,7 +6,9 @@
 
 - getmininginfo
 - getblocktemplate proposal mode
-- submitblock"""
+- getblocktemplate coinbasebranch capability
+- submitblock
+- submitblockcoinbase"""
 
 import copy
 from decimal import Decimal
@@ -18,7 +20,11 @@ from test_framework.blocktools import (
 from test_framework.messages import (
     CBlock,
     CBlockHeader,
-    BLOCK_HEADER_SIZE
+    CTxOut,
+    BLOCK_HEADER_SIZE,
+    hash256,
+    ser_uint256,
+    uint256_from_str,
 )
 from test_framework.mininode import (
     P2PDataStore,
@@ -246,6 +252,41 @@ class MiningTest(PalladiumTestFramework):
         node.submitheader(hexdata=CBlockHeader(bad_block_root).serialize().hex())
         assert_equal(node.submitblock(hexdata=block.serialize().hex()), 'duplicate')  # valid
 
+        self.log.info("getblocktemplate: Test coinbasebranch capability")
+        priv_key = node.get_deterministic_priv_key()
+        spend_txid = node.getblock(node.getblockhash(1))['tx'][0]
+        spend_value = node.getrawtransaction(spend_txid, True, node.getblockhash(1))['vout'][0]['value']
+        raw_tx = node.createrawtransaction([{'txid': spend_txid, 'vout': 0}], {priv_key.address: spend_value - Decimal('0.001')})
+        txid = node.sendrawtransaction(node.signrawtransactionwithkey(raw_tx, [priv_key.key])['hex'])
+        tmpl = node.getblocktemplate({'rules': ['segwit'], 'capabilities': ['coinbasebranch']})
+        assert 'coinbasebranch' in tmpl['capabilities']
+        assert_equal(tmpl['coinbasebranch'], [txid])
+
+        coinbase_tx = create_coinbase(height=int(tmpl['height']))
+        coinbase_tx.vout.append(CTxOut(0, bytes.fromhex(tmpl['default_witness_commitment'])))
+        coinbase_tx.rehash()
+        merkle_root = ser_uint256(coinbase_tx.sha256)
+        for branch_hash in tmpl['coinbasebranch']:
+            merkle_root = hash256(merkle_root + bytes.fromhex(branch_hash)[::-1])
+        block = CBlock()
+        block.nVersion = tmpl['version']
+        block.hashPrevBlock = int(tmpl['previousblockhash'], 16)
+        block.hashMerkleRoot = uint256_from_str(merkle_root)
+        block.nTime = tmpl['curtime']
+        block.nBits = int(tmpl['bits'], 16)
+        block.solve()
+
+        self.log.info("submitblockcoinbase: Test submission against a template")
+        header = CBlockHeader(block).serialize().hex()
+        assert_equal(node.submitblockcoinbase('00' * 32, header, coinbase_tx.serialize().hex()), 'stale-work')
+        bad_header = CBlockHeader(block)
+        bad_header.hashMerkleRoot += 1
+        assert_equal(node.submitblockcoinbase(tmpl['workid'], bad_header.serialize().hex(), coinbase_tx.serialize().hex()), 'bad-txnmrklroot')
+        assert_equal(node.submitblockcoinbase(tmpl['workid'], header, coinbase_tx.serialize().hex()), None)
+        assert_equal(node.getbestblockhash(), block.hash)
+        assert_equal(node.getblock(block.hash)['tx'], [coinbase_tx.hash, txid])
+        assert_equal(node.submitblockcoinbase(tmpl['workid'], header, coinbase_tx.serialize().hex()), 'duplicate')
+
 
 if __name__ == '__main__':
     MiningTest().main()
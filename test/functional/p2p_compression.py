@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test compressed block and headers messages (-p2pcompression).
+
+Node 0 compresses on its peer worker threads, node 1 on its message handler
+thread, and node 2 does not support compression.
+"""
+
+from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
+from test_framework.messages import msg_sendcmpr
+from test_framework.mininode import P2PInterface
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_greater_than,
+    connect_nodes,
+)
+
+
+class P2PCompressionTest(PalladiumTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 3
+        self.extra_args = [["-p2pcompression", "-msghandlerthreads=2"], ["-p2pcompression"], []]
+
+    def setup_network(self):
+        self.setup_nodes()
+
+    def run_test(self):
+        self.log.info("Check that compression is offered before verack")
+        peer = self.nodes[0].add_p2p_connection(P2PInterface())
+        assert_equal(peer.message_count["sendcmpr"], 1)
+        peer_nocmpr = self.nodes[2].add_p2p_connection(P2PInterface())
+        assert_equal(peer_nocmpr.message_count["sendcmpr"], 0)
+
+        self.log.info("Check that sendcmpr after verack gets the peer disconnected")
+        with self.nodes[0].assert_debug_log(["sendcmpr received after verack"]):
+            peer.send_message(msg_sendcmpr(version=1))
+            peer.wait_for_disconnect()
+        for node in self.nodes:
+            node.disconnect_p2ps()
+
+        self.log.info("Sync headers compressed between nodes that both offer it")
+        self.nodes[0].generatetoaddress(200, ADDRESS_BCRT1_UNSPENDABLE)
+        connect_nodes(self.nodes[1], 0)
+        self.sync_blocks(self.nodes[0:2])
+        sender = self.nodes[0].getpeerinfo()[0]["compression"]
+        assert sender["sending"]
+        assert_greater_than(sender["bytessent"], 0)
+        assert_greater_than(sender["bytessent_uncompressed"], sender["bytessent"])
+        receiver = self.nodes[1].getpeerinfo()[0]["compression"]
+        assert_equal(receiver["bytesrecv"], sender["bytessent"])
+        assert_equal(receiver["bytesrecv_uncompressed"], sender["bytessent_uncompressed"])
+
+        self.log.info("Sync uncompressed with a node that does not offer it")
+        connect_nodes(self.nodes[2], 0)
+        self.sync_blocks()
+        info = [p["compression"] for p in self.nodes[0].getpeerinfo() if not p["compression"]["sending"]]
+        assert_equal(len(info), 1)
+        assert_equal(info[0]["bytessent"], 0)
+        assert_equal(info[0]["bytesrecv"], 0)
+
+
+if __name__ == '__main__':
+    P2PCompressionTest().main()
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test transaction relay by reconciliation (-txreconciliation).
+
+Nodes are connected 0 -> 1 -> 2 (outbound), so transactions created on node 2
+only reach node 1 and node 0 through reconciliation rounds requested by the
+outbound side, while transactions created on node 0 are still flooded to the
+first outbound peers.
+"""
+
+from test_framework.messages import msg_sendtxrcncl
+from test_framework.mininode import P2PInterface
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import assert_equal
+
+
+class P2PTxReconciliation(PalladiumTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+        self.extra_args = [["-txreconciliation"]] * self.num_nodes
+
+    def skip_test_if_missing_module(self):
+        self.skip_if_no_wallet()
+
+    def run_test(self):
+        self.log.info("Check that reconciliation is offered before verack")
+        peer = self.nodes[0].add_p2p_connection(P2PInterface())
+        assert_equal(peer.message_count["sendtxrcncl"], 1)
+
+        self.log.info("Check that sendtxrcncl after verack gets the peer disconnected")
+        with self.nodes[0].assert_debug_log(["sendtxrcncl received after verack"]):
+            peer.send_message(msg_sendtxrcncl(version=1, salt=1))
+            peer.wait_for_disconnect()
+        self.nodes[0].disconnect_p2ps()
+
+        self.log.info("Check that transactions are reconciled towards inbound peers")
+        with self.nodes[1].assert_debug_log(["reconciliation with peer=", "succeeded"], timeout=60):
+            txid = self.nodes[2].sendtoaddress(self.nodes[0].getnewaddress(), 1)
+            self.sync_mempools(timeout=120)
+            assert txid in self.nodes[0].getrawmempool()
+
+        self.log.info("Check that transactions are still flooded to outbound peers")
+        txid = self.nodes[0].sendtoaddress(self.nodes[2].getnewaddress(), 1)
+        self.sync_mempools(timeout=120)
+        assert txid in self.nodes[2].getrawmempool()
+
+
+if __name__ == '__main__':
+    P2PTxReconciliation().main()
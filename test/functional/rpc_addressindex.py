@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the address index RPCs getaddresshistory, getaddressutxos and getaddressbalance."""
+
+from decimal import Decimal
+
+from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
+from test_framework.authproxy import JSONRPCException
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    wait_until,
+)
+
+
+class AddressIndexTest(PalladiumTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-addressindex"], []]
+
+    def sync_index(self, node):
+        def synced():
+            try:
+                node.getaddressbalance(ADDRESS_BCRT1_UNSPENDABLE)
+                return True
+            except JSONRPCException:
+                return False
+        wait_until(synced)
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.sync_index(node)
+
+        self.log.info("The RPCs fail without -addressindex or with a bad address")
+        assert_raises_rpc_error(-1, "Address index is not enabled", self.nodes[1].getaddressbalance, ADDRESS_BCRT1_UNSPENDABLE)
+        assert_raises_rpc_error(-5, "Invalid address", node.getaddressutxos, "notanaddress")
+        assert_raises_rpc_error(-8, "Invalid height range", node.getaddresshistory, ADDRESS_BCRT1_UNSPENDABLE, 10, 5)
+
+        self.log.info("Coinbase outputs of the cached chain are indexed")
+        key = node.get_deterministic_priv_key()
+        coinbase = node.getblock(node.getblockhash(1), 2)['tx'][0]
+        assert_equal(coinbase['vout'][0]['scriptPubKey']['addresses'], [key.address])
+        history = node.getaddresshistory(key.address)
+        mined = [h for h in range(1, node.getblockcount() + 1) if node.getblock(node.getblockhash(h), 2)['tx'][0]['vout'][0]['scriptPubKey']['addresses'] == [key.address]]
+        assert_equal([entry['height'] for entry in history], mined)
+        assert_equal(history[0], {'txid': coinbase['txid'], 'vout': 0, 'height': 1, 'amount': coinbase['vout'][0]['value']})
+        balance = node.getaddressbalance(key.address)
+        assert_equal(balance['utxos'], len(mined))
+        assert_equal(balance['balance'], balance['received'])
+        assert_equal(node.getaddresshistory(key.address, 2, 10), [entry for entry in history if 2 <= entry['height'] <= 10])
+        assert_equal(node.getaddresshistory(key.address, 1, 1), [history[0]])
+
+        self.log.info("Spending an output records the spending input")
+        amount = coinbase['vout'][0]['value'] - Decimal('0.001')
+        rawtx = node.createrawtransaction([{'txid': coinbase['txid'], 'vout': 0}], [{ADDRESS_BCRT1_UNSPENDABLE: amount}])
+        signed = node.signrawtransactionwithkey(rawtx, [key.key], [{
+            'txid': coinbase['txid'],
+            'vout': 0,
+            'scriptPubKey': coinbase['vout'][0]['scriptPubKey']['hex'],
+            'amount': coinbase['vout'][0]['value'],
+        }])
+        txid = node.sendrawtransaction(signed['hex'])
+        assert_equal(node.getaddressutxos(ADDRESS_BCRT1_UNSPENDABLE), [])
+        block = node.generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+        height = node.getblockcount()
+        self.sync_index(node)
+
+        spent = node.getaddresshistory(key.address, 1, 1)[0]
+        assert_equal(spent['spent'], {'txid': txid, 'vin': 0, 'height': height})
+        assert_equal(len(node.getaddressutxos(key.address)), len(mined) - 1)
+        new_balance = node.getaddressbalance(key.address)
+        assert_equal(new_balance['balance'], balance['balance'] - coinbase['vout'][0]['value'])
+        assert_equal(new_balance['received'], balance['received'])
+        utxos = node.getaddressutxos(ADDRESS_BCRT1_UNSPENDABLE)
+        assert_equal([(u['txid'], u['height']) for u in utxos if u['txid'] == txid], [(txid, height)])
+        assert_equal(len(utxos), 2)
+
+        self.log.info("A reorg reverts the changes of the disconnected blocks")
+        node.invalidateblock(block)
+        node.prioritisetransaction(txid, 0, -10**8)
+        node.generatetoaddress(1, key.address)
+        self.sync_index(node)
+        assert_equal(node.getaddresshistory(key.address, 1, 1), [history[0]])
+        assert_equal(node.getaddressbalance(ADDRESS_BCRT1_UNSPENDABLE)['outputs'], 0)
+        assert_equal(node.getaddressbalance(key.address)['utxos'], len(mined) + 1)
+        node.reconsiderblock(block)
+        node.generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)
+        self.sync_index(node)
+        assert_equal(node.getaddresshistory(key.address, 1, 1), [spent])
+        new_balance = node.getaddressbalance(key.address)
+
+        self.log.info("The index persists across restarts")
+        self.restart_node(0, extra_args=["-addressindex"])
+        self.sync_index(self.nodes[0])
+        assert_equal(self.nodes[0].getaddressbalance(key.address), new_balance)
+
+
+if __name__ == '__main__':
+    AddressIndexTest().main()
@@ -53,17 +53,30 @@ class BlockchainTest(PalladiumTestFramework):
 
     def run_test(self):
         self.mine_chain()
-        self.restart_node(0, extra_args=['-stopatheight=207', '-prune=1'])  # Set extra args with pruning after rescan is complete
+        self.restart_node(0, extra_args=['-stopatheight=207', '-prune=1', '-coinsreusesample=1'])  # Set extra args with pruning after rescan is complete
 
         self._test_getblockchaininfo()
         self._test_getchaintxstats()
         self._test_gettxoutsetinfo()
         self._test_getblockheader()
         self._test_getdifficulty()
+        self._test_getblockstatsrange()
         self._test_getnetworkhashps()
+        self._test_tip_snapshot()
+        self._test_reorgcache()
+        self._test_getcoinscacheinfo()
         self._test_stopatheight()
         self._test_waitforblockheight()
         assert self.nodes[0].verifychain(4, 0)
+        assert self.nodes[0].verifychain(2, 0)
+        self._test_asynccheckblocks()
+
+    def _test_asynccheckblocks(self):
+        self.log.info("Test verifying blocks in the background at startup")
+        expected_msgs = ["Verifying blocks in the background", "No coin database inconsistencies in last 100 blocks"]
+        with self.nodes[0].assert_debug_log(expected_msgs, timeout=30):
+            self.restart_node(0, extra_args=["-asynccheckblocks", "-checkblocks=100", "-checklevel=3"])
+        assert_equal(self.nodes[0].getblockcount(), 207)
 
     def mine_chain(self):
         self.log.info('Create some old blocks')
@@ -87,6 +100,7 @@ class BlockchainTest(PalladiumTestFramework):
             'initialblockdownload',
             'mediantime',
             'pruned',
+            'reorgcache',
             'size_on_disk',
             'softforks',
             'verificationprogress',
@@ -112,7 +126,7 @@ class BlockchainTest(PalladiumTestFramework):
         # should have exact keys
         assert_equal(sorted(res.keys()), keys)
 
-        self.restart_node(0, ['-stopatheight=207', '-prune=550'])
+        self.restart_node(0, ['-stopatheight=207', '-prune=550', '-coinsreusesample=1'])
         res = self.nodes[0].getblockchaininfo()
         # result should have these additional pruning keys if prune=550
         assert_equal(sorted(res.keys()), sorted(['pruneheight', 'automatic_pruning', 'prune_target_size'] + keys))
@@ -275,11 +289,95 @@ class BlockchainTest(PalladiumTestFramework):
         # binary => decimal => binary math is why we do this check
         assert abs(difficulty * 2**31 - 1) < 0.0001
 
+    def _test_getblockstatsrange(self):
+        self.log.info("Test getblockstatsrange")
+        node = self.nodes[0]
+        stats = node.getblockstatsrange(1, 200)
+        assert_equal(len(stats), 200)
+        for height in [1, 57, 200]:
+            assert_equal(stats[height - 1], node.getblockstats(height))
+        assert_equal(node.getblockstatsrange(start=10, end=12, stats=['height', 'txs']),
+                     [{'height': h, 'txs': 1} for h in range(10, 13)])
+        assert_equal(node.getblockstatsrange(0, 0)[0]['height'], 0)
+
+        assert_raises_rpc_error(-8, 'Start height -1 is negative', node.getblockstatsrange, -1, 10)
+        assert_raises_rpc_error(-8, 'End height 9 before start height 10', node.getblockstatsrange, 10, 9)
+        assert_raises_rpc_error(-8, 'End height 201 after current tip 200', node.getblockstatsrange, 1, 201)
+        assert_raises_rpc_error(-8, 'Invalid selected statistic aaa', node.getblockstatsrange, 1, 200, ['aaa'])
+
     def _test_getnetworkhashps(self):
         hashes_per_second = self.nodes[0].getnetworkhashps()
         # This should be 2 hashes every 10 minutes or 1/300
         assert abs(hashes_per_second * 300 - 1) < 0.0001
 
+    def _test_tip_snapshot(self):
+        self.log.info("Test that the node state RPCs follow the tip when it moves back and forth")
+        node = self.nodes[0]
+        tip = node.getbestblockhash()
+        prev = node.getblockheader(tip)['previousblockhash']
+        info = node.getblockchaininfo()
+        hashps = node.getmininginfo()['networkhashps']
+
+        node.invalidateblock(tip)
+        assert_equal(node.getblockcount(), 199)
+        assert_equal(node.getbestblockhash(), prev)
+        res = node.getblockchaininfo()
+        assert_equal((res['blocks'], res['bestblockhash']), (199, prev))
+        assert_equal(res['mediantime'], node.getblockheader(prev)['mediantime'])
+        assert_equal(res['chainwork'], node.getblockheader(prev)['chainwork'])
+        assert_equal(res['softforks']['testdummy']['bip9']['statistics']['elapsed'], 56)
+        assert_equal(node.getmininginfo()['blocks'], 199)
+
+        node.reconsiderblock(tip)
+        assert_equal(node.getblockcount(), 200)
+        assert_equal(node.getblockchaininfo()['softforks'], info['softforks'])
+        assert_equal(node.getmininginfo()['networkhashps'], hashps)
+
+    def _test_reorgcache(self):
+        self.log.info("Test that disconnecting a recently connected block reads it from the reorg cache")
+        node = self.nodes[0]
+        tip = node.getbestblockhash()
+        before = node.getblockchaininfo()['reorgcache']
+        assert_equal(before['maxblocks'], 6)
+        # The tip was reconnected last by _test_tip_snapshot, so its block and undo data are cached.
+        assert_greater_than_or_equal(before['blocks'], 1)
+
+        node.invalidateblock(tip)
+        after = node.getblockchaininfo()['reorgcache']
+        assert_equal(after['hits'], before['hits'] + 2)
+        assert_equal(after['misses'], before['misses'])
+
+        node.reconsiderblock(tip)
+        assert_equal(node.getbestblockhash(), tip)
+
+    def _test_getcoinscacheinfo(self):
+        self.log.info("Test getcoinscacheinfo")
+        node = self.nodes[0]
+        before = node.getcoinscacheinfo()
+        # Reconnecting blocks in the previous tests looked coins up.
+        assert_greater_than(before['cache']['hits'] + before['cache']['misses'], 0)
+        assert_greater_than(before['cache']['insertions'], 0)
+        assert_greater_than_or_equal(before['database']['reads'], before['database']['found'])
+
+        # gettxoutsetinfo flushes the whole cache first.
+        node.gettxoutsetinfo()
+        after = node.getcoinscacheinfo()
+        assert_equal(after['flushes']['count'], before['flushes']['count'] + 1)
+        assert_equal(after['flushes']['partial'], before['flushes']['partial'])
+        assert_equal(after['flushes']['lastentriesafter'], 0)
+        assert_equal(after['cache']['evictions'], before['cache']['evictions'] + after['flushes']['lastentries'])
+        assert_equal(after['entries'], 0)
+        assert_greater_than(after['flushes']['lasttime'], 0)
+
+        reuse = after['reusedistance']
+        assert_equal(reuse['samplerate'], 1)
+        assert_greater_than(reuse['samples'], 0)
+        entries = [size['entries'] for size in reuse['sizes']]
+        hitrates = [size['hitrate'] for size in reuse['sizes']]
+        assert_equal(entries, sorted(entries))
+        assert_equal(hitrates, sorted(hitrates))
+        assert all(0 <= hitrate <= 1 for hitrate in hitrates)
+
     def _test_stopatheight(self):
         assert_equal(self.nodes[0].getblockcount(), 200)
         self.nodes[0].generatetoaddress(6, self.nodes[0].get_deterministic_priv_key().address)
@@ -41,7 +41,10 @@ class DumptxoutsetTest(PalladiumTestFramework):
             digest = hashlib.sha256(f.read()).hexdigest()
             # UTXO snapshot hash should be deterministic based on mocked time.
             assert_equal(
-                digest, 'be032e5f248264ba08e11099ac09dbd001f6f87ffc68bf0f87043d8146d50664')
+                digest, 'a3a98e81f72a2e2fe5a140dee097f0c8f910a2019ff52467b6f34eb6b38273b4')
+
+        # The per-shard part files are cleaned up.
+        assert_equal(list(expected_path.parent.glob(FILENAME + '.incomplete*')), [])
 
         # Specifying a path to an existing file will fail.
         assert_raises_rpc_error(
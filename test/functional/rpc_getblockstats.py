@@ -10,6 +10,7 @@ from test_framework.test_framework import PalladiumTestFramework
 from test_framework.util import (
     assert_equal,
     assert_raises_rpc_error,
+    wait_until,
 )
 import json
 import os
@@ -160,6 +161,17 @@ class GetblockstatsTest(PalladiumTestFramework):
         assert_raises_rpc_error(-1, 'getblockstats hash_or_height ( stats )', self.nodes[0].getblockstats, '00', 1, 2)
         assert_raises_rpc_error(-1, 'getblockstats hash_or_height ( stats )', self.nodes[0].getblockstats)
 
+        self.log.info('Checking the statistics read from -blockstatsindex')
+        self.restart_node(0, extra_args=['-blockstatsindex'])
+        tip_hash = self.expected_stats[self.max_stat_pos]['blockhash']
+        wait_until(lambda: 'window_total_fees' in self.nodes[0].getchaintxstats(self.max_stat_pos + 1, tip_hash))
+        for i in range(self.max_stat_pos+1):
+            assert_equal(self.nodes[0].getblockstats(hash_or_height=self.start_height + i), self.expected_stats[i])
+        chain_stats = self.nodes[0].getchaintxstats(self.max_stat_pos + 1, tip_hash)
+        assert_equal(chain_stats['window_total_fees'], sum(s['totalfee'] for s in self.expected_stats))
+        assert_equal(chain_stats['window_outputs_created'], sum(s['outs'] for s in self.expected_stats))
+        assert_equal(chain_stats['window_outputs_spent'], sum(s['ins'] for s in self.expected_stats))
+
 
 if __name__ == '__main__':
     GetblockstatsTest().main()
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test loading UTXO snapshots with `loadtxoutset`.
+"""
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error, connect_nodes
+
+import os
+from pathlib import Path
+
+
+class LoadtxoutsetTest(PalladiumTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+
+    def setup_network(self):
+        self.setup_nodes()
+
+    def run_test(self):
+        node, other = self.nodes
+        node.generate(110)
+
+        dump = node.dumptxoutset('txoutset.dat')
+        snapshot = Path(dump['path'])
+        expected = node.gettxoutsetinfo()
+
+        self.log.info("A snapshot of an unknown block is rejected")
+        assert_raises_rpc_error(-5, 'Unknown snapshot base block', other.loadtxoutset, str(snapshot))
+
+        self.log.info("Load the snapshot on a node that knows its base block")
+        connect_nodes(node, 1)
+        self.sync_blocks()
+        out = other.loadtxoutset(str(snapshot))
+        assert_equal(out['coins_loaded'], dump['coins_written'])
+        assert_equal(out['base_hash'], dump['base_hash'])
+        assert_equal(out['base_height'], 110)
+        assert_equal(out['hash_serialized_2'], expected['hash_serialized_2'])
+        assert_equal(out['path'], str(Path(other.datadir) / self.chain / 'chainstate_snapshot'))
+        # The active chainstate is not affected.
+        assert_equal(other.gettxoutsetinfo()['hash_serialized_2'], expected['hash_serialized_2'])
+
+        self.log.info("Loading again replaces the previous snapshot database")
+        assert_equal(other.loadtxoutset(str(snapshot)), out)
+
+        self.log.info("Malformed snapshots are rejected")
+        data = snapshot.read_bytes()
+        bad = Path(other.datadir) / self.chain / 'bad.dat'
+        bad.write_bytes(data[:len(data) // 2])
+        assert_raises_rpc_error(-1, 'truncated snapshot', other.loadtxoutset, str(bad))
+        bad.write_bytes(data + b'\x00')
+        assert_raises_rpc_error(-1, 'coins left over', other.loadtxoutset, str(bad))
+        corrupt = bytearray(data)
+        corrupt[100] ^= 1
+        bad.write_bytes(bytes(corrupt))
+        assert_raises_rpc_error(-1, 'checksum mismatch', other.loadtxoutset, str(bad))
+        bad.write_bytes(data[:10])
+        assert_raises_rpc_error(-22, 'Unable to parse snapshot metadata', other.loadtxoutset, str(bad))
+        assert_raises_rpc_error(-8, "Couldn't open file", other.loadtxoutset, 'missing.dat')
+        os.remove(str(bad))
+
+
+if __name__ == '__main__':
+    LoadtxoutsetTest().main()
@@ -3,6 +3,7 @@
 # Distributed under the MIT software license, see the accompanying
 # file COPYING or http://www.opensource.org/licenses/mit-license.php.
 """Test RPC misc output."""
+import platform
 import xml.etree.ElementTree as ET
 
 from test_framework.test_framework import PalladiumTestFramework
@@ -41,6 +42,9 @@ class RpcMiscTest(PalladiumTestFramework):
         assert_greater_than(memory['chunks_used'], 0)
         assert_greater_than(memory['chunks_free'], 0)
         assert_equal(memory['used'] + memory['free'], memory['total'])
+        largepages = node.getmemoryinfo()['largepages']
+        assert_equal(largepages['mode'], 'none')
+        assert_equal(largepages['mapped'], 0)
 
         self.log.info("test mallocinfo")
         try:
@@ -54,6 +58,52 @@ class RpcMiscTest(PalladiumTestFramework):
 
         assert_raises_rpc_error(-8, "unknown mode foobar", node.getmemoryinfo, mode="foobar")
 
+        self.log.info("test getvalidationqueueinfo")
+        node.generate(1)
+        node.syncwithvalidationinterfacequeue()
+        queues = {queue['name']: queue for queue in node.getvalidationqueueinfo()}
+        assert 'default' in queues
+        assert_equal(queues['net']['subscribers'], 1)
+        assert_greater_than(queues['net']['processed'], 0)
+        assert_greater_than_or_equal(queues['net']['max_latency'], queues['net']['avg_latency'])
+        for queue in queues.values():
+            assert_equal(queue['pending'], 0)
+
+        self.log.info("test getschedulerinfo")
+        info = node.getschedulerinfo()
+        assert_equal(info['threads'], 4)
+        tasks = {task['name']: task for task in info['tasks']}
+        assert_equal(tasks['staletipcheck']['scheduled'], 1)
+        assert_equal(tasks['dumpaddresses']['scheduled'], 1)
+        assert_greater_than(tasks['validation:net']['runs'], 0)
+        assert_equal(sum(tasks['validation:net']['runtime_histogram']), tasks['validation:net']['runs'])
+        assert_greater_than_or_equal(tasks['validation:net']['max_time'], tasks['validation:net']['avg_time'])
+
+        self.log.info("test getperfstats")
+        stats = node.getperfstats()
+        assert_greater_than(stats['connecttip.total']['count'], 0)
+        assert_equal(sum(stats['connecttip.total']['histogram']), stats['connecttip.total']['count'])
+        assert_greater_than_or_equal(stats['connecttip.total']['max'], stats['connecttip.total']['avg'])
+        connectblock = node.getperfstats('connectblock.')
+        assert 'connectblock.verify' in connectblock
+        assert all(name.startswith('connectblock.') for name in connectblock)
+
+        self.log.info("test getlockstats")
+        assert_equal(node.getlockstats(), {'enabled': False, 'sites': []})
+        node.setlockprofiling(True)
+        node.getblockchaininfo()
+        lockstats = node.getlockstats('cs_main', 0)
+        assert_equal(lockstats['enabled'], True)
+        assert_greater_than(len(lockstats['sites']), 0)
+        for site in lockstats['sites']:
+            assert_equal(site['lock'], 'cs_main')
+            assert_greater_than_or_equal(site['acquisitions'], site['contended'])
+            assert_greater_than_or_equal(site['hold'], site['hold_max'])
+        assert_equal(len(node.getlockstats('', 1)['sites']), 1)
+        assert_raises_rpc_error(-8, "Negative count", node.getlockstats, '', -1)
+        node.setlockprofiling(False)
+        assert_equal(node.getlockstats()['enabled'], False)
+
         self.log.info("test logging")
         assert_equal(node.logging()['qt'], True)
         node.logging(exclude=['qt'])
@@ -61,6 +111,18 @@ class RpcMiscTest(PalladiumTestFramework):
         node.logging(include=['qt'])
         assert_equal(node.logging()['qt'], True)
 
+        self.log.info("test -largepages")
+        if platform.system() == 'Linux':
+            self.restart_node(0, ['-largepages=thp'])
+            largepages = self.nodes[0].getmemoryinfo()['largepages']
+            assert_equal(largepages['mode'], 'thp')
+            # At least the signature cache tables are in huge-page mappings
+            assert_greater_than(largepages['used'], 0)
+            assert_greater_than_or_equal(largepages['mapped'], largepages['used'])
+        self.stop_node(0)
+        self.nodes[0].assert_start_raises_init_error(['-largepages=foo'], 'Error: Unknown -largepages value foo.')
+        self.start_node(0)
+
 
 if __name__ == '__main__':
     RpcMiscTest().main()
@@ -16,6 +16,7 @@ from test_framework.util import (
     assert_greater_than,
     assert_raises_rpc_error,
     connect_nodes,
+    disconnect_nodes,
     p2p_port,
     wait_until,
 )
@@ -23,7 +24,11 @@ from test_framework.mininode import P2PInterface
 import test_framework.messages
 from test_framework.messages import (
     CAddress,
+    CInv,
     msg_addr,
+    msg_getdata,
+    MSG_BLOCK,
+    MSG_WITNESS_FLAG,
     NODE_NETWORK,
     NODE_WITNESS,
 )
@@ -44,7 +49,7 @@ class NetTest(PalladiumTestFramework):
     def set_test_params(self):
         self.setup_clean_chain = True
         self.num_nodes = 2
-        self.extra_args = [["-minrelaytxfee=0.00001000"],["-minrelaytxfee=0.00000500"]]
+        self.extra_args = [["-minrelaytxfee=0.00001000", "-blockservecache=1"],["-minrelaytxfee=0.00000500"]]
         self.supports_cli = False
 
     def run_test(self):
@@ -58,6 +63,7 @@ class NetTest(PalladiumTestFramework):
         self._test_getaddednodeinfo()
         self._test_getpeerinfo()
         self._test_getnodeaddresses()
+        self._test_blockservecache()
 
     def _test_connection_count(self):
         # connect_nodes connects each node to the other
@@ -80,6 +86,8 @@ class NetTest(PalladiumTestFramework):
         assert_greater_than_or_equal(net_totals_after['totalbytesrecv'], peers_recv)
         assert_greater_than_or_equal(peers_sent, net_totals_before['totalbytessent'])
         assert_greater_than_or_equal(net_totals_after['totalbytessent'], peers_sent)
+        # Both peers have received messages, so they hold receive buffers.
+        assert_greater_than(net_totals_after['recvbuffermemory'], 0)
 
         # test getnettotals and getpeerinfo by doing a ping
         # the bytes sent/received should change
@@ -138,6 +146,10 @@ class NetTest(PalladiumTestFramework):
         # check the `servicesnames` field
         for info in peer_info:
             assert_net_servicesnames(int(info[0]["services"], 0x10), info[0]["servicesnames"])
+        # without -adaptiveblockdownload, the fixed number of blocks is requested at once
+        for info in peer_info:
+            assert_equal(info[0]['inflight_limit'], 16)
+            assert_equal(info[0]['block_stalls'], 0)
 
     def _test_getnodeaddresses(self):
         self.nodes[0].add_p2p_connection(P2PInterface())
@@ -174,5 +186,28 @@ class NetTest(PalladiumTestFramework):
         node_addresses = self.nodes[0].getnodeaddresses(LARGE_REQUEST_COUNT)
         assert_greater_than(LARGE_REQUEST_COUNT, len(node_addresses))
 
+    def _test_blockservecache(self):
+        self.log.info("Test the recently-served block cache counters")
+        cache = self.nodes[0].getnetworkinfo()['blockservecache']
+        assert_equal(cache['maxbytes'], 1 << 20)
+        assert_equal(self.nodes[1].getnetworkinfo()['blockservecache']['maxbytes'], 0)
+
+        # Keep node1 from fetching blocks so only our requests are counted
+        disconnect_nodes(self.nodes[0], 1)
+        # The tip is served from the most recent block, so request its parent
+        blockhash = self.nodes[0].generatetoaddress(2, self.nodes[0].get_deterministic_priv_key().address)[0]
+        peer = self.nodes[0].add_p2p_connection(P2PInterface())
+        for _ in range(2):
+            peer.last_message.pop("block", None)
+            peer.send_message(msg_getdata([CInv(MSG_BLOCK | MSG_WITNESS_FLAG, int(blockhash, 16))]))
+            peer.wait_for_block(int(blockhash, 16))
+
+        cache = self.nodes[0].getnetworkinfo()['blockservecache']
+        assert_equal(cache['hits'], 1)
+        assert_equal(cache['misses'], 1)
+        assert_equal(cache['blocks'], 1)
+        assert_greater_than(cache['bytes'], 0)
+        self.nodes[0].disconnect_p2ps()
+
 if __name__ == '__main__':
     NetTest().main()
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test submitting packages of transactions with submitpackage."""
+
+from decimal import Decimal
+
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+
+
+class RPCPackagesTest(PalladiumTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = False
+
+    def spend(self, prevout, amount):
+        """Return the signed hex of a transaction spending prevout ({txid, vout, scriptPubKey, amount}) to amount"""
+        node = self.nodes[0]
+        key = node.get_deterministic_priv_key()
+        rawtx = node.createrawtransaction(
+            inputs=[{'txid': prevout['txid'], 'vout': prevout['vout']}],
+            outputs=[{key.address: amount}],
+        )
+        signed = node.signrawtransactionwithkey(
+            hexstring=rawtx,
+            privkeys=[key.key],
+            prevtxs=[{
+                'txid': prevout['txid'],
+                'vout': prevout['vout'],
+                'scriptPubKey': prevout['scriptPubKey'],
+                'amount': prevout['amount'],
+            }],
+        )
+        assert signed['complete']
+        return signed['hex']
+
+    def coinbase_prevout(self, height):
+        coinbase = self.nodes[0].getblock(self.nodes[0].getblockhash(height), 2)['tx'][0]
+        return {
+            'txid': coinbase['txid'],
+            'vout': 0,
+            'scriptPubKey': coinbase['vout'][0]['scriptPubKey']['hex'],
+            'amount': coinbase['vout'][0]['value'],
+        }
+
+    def child_of(self, parent_hex, amount):
+        parent = self.nodes[0].decoderawtransaction(parent_hex)
+        return self.spend({
+            'txid': parent['txid'],
+            'vout': 0,
+            'scriptPubKey': parent['vout'][0]['scriptPubKey']['hex'],
+            'amount': parent['vout'][0]['value'],
+        }, amount)
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        self.log.info('Should not accept garbage or empty packages')
+        assert_raises_rpc_error(-8, 'Array must contain between 1 and 25 transactions', lambda: node.submitpackage([]))
+        assert_raises_rpc_error(-22, 'TX decode failed for transaction 0', lambda: node.submitpackage(['ff00baar']))
+
+        self.log.info('A parent below the minimum relay feerate is accepted with a child paying for it')
+        prevout = self.coinbase_prevout(1)
+        parent = self.spend(prevout, prevout['amount'] - Decimal('0.00000010'))
+        child = self.child_of(parent, prevout['amount'] - Decimal('0.00100000'))
+        parent_txid = node.decoderawtransaction(parent)['txid']
+        child_txid = node.decoderawtransaction(child)['txid']
+        assert_equal(node.testmempoolaccept([parent])[0]['reject-reason'], 'min relay fee not met')
+        assert_raises_rpc_error(-26, 'min relay fee not met', lambda: node.sendrawtransaction(parent))
+
+        self.log.info('A package must be sorted parents first')
+        assert_raises_rpc_error(-26, 'package-not-sorted', lambda: node.submitpackage([child, parent]))
+        self.log.info('A package must not contain duplicates')
+        assert_raises_rpc_error(-26, 'package-contains-duplicates', lambda: node.submitpackage([parent, parent]))
+        assert_equal(node.getmempoolinfo()['size'], 0)
+
+        assert_equal(node.submitpackage([parent, child]), [parent_txid, child_txid])
+        assert_equal(sorted(node.getrawmempool()), sorted([parent_txid, child_txid]))
+        assert_equal(node.getmempoolentry(parent_txid)['descendantcount'], 2)
+
+        self.log.info('A package whose total feerate is too low is rejected and leaves the mempool untouched')
+        prevout = self.coinbase_prevout(2)
+        parent = self.spend(prevout, prevout['amount'] - Decimal('0.00000010'))
+        child = self.child_of(parent, prevout['amount'] - Decimal('0.00000020'))
+        assert_raises_rpc_error(-26, 'min relay fee not met', lambda: node.submitpackage([parent, child]))
+        assert_equal(node.getmempoolinfo()['size'], 2)
+
+        self.log.info('A package whose transactions conflict with each other is rejected')
+        first = self.spend(prevout, prevout['amount'] - Decimal('0.001'))
+        second = self.spend(prevout, prevout['amount'] - Decimal('0.002'))
+        assert_raises_rpc_error(-26, 'conflict-in-package', lambda: node.submitpackage([first, second]))
+
+        self.log.info('A package conflicting with the mempool is rejected')
+        node.sendrawtransaction(first)
+        assert_raises_rpc_error(-26, 'txn-mempool-conflict', lambda: node.submitpackage([second]))
+
+        self.log.info('A package with a transaction already in the mempool only adds the rest')
+        child = self.child_of(first, prevout['amount'] - Decimal('0.002'))
+        child_txid = node.decoderawtransaction(child)['txid']
+        assert_equal(node.submitpackage([first, child])[1], child_txid)
+        assert_equal(node.getmempoolinfo()['size'], 4)
+
+        self.log.info('Package transactions are mined like any other')
+        node.generate(1)
+        assert_equal(node.getmempoolinfo()['size'], 0)
+
+
+if __name__ == '__main__':
+    RPCPackagesTest().main()
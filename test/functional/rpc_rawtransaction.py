@@ -243,6 +243,26 @@ class RawTransactionsTest(PalladiumTestFramework):
         self.nodes[0].reconsiderblock(block1)
         assert_equal(self.nodes[0].getbestblockhash(), block2)
 
+        ######################
+        # getrawtransactions #
+        ######################
+
+        # Confirmed, mempool and unknown transactions, with a duplicate
+        mempool_tx = self.nodes[2].sendtoaddress(self.nodes[1].getnewaddress(), 1)
+        self.sync_all()
+        coinbase = self.nodes[0].getblock(block2)['tx'][0]
+        unknown = "00" * 32
+        txids = [coinbase, tx, mempool_tx, unknown, tx]
+        gottxs = self.nodes[0].getrawtransactions(txids)
+        assert_equal(gottxs, [self.nodes[0].getrawtransaction(coinbase), self.nodes[0].getrawtransaction(tx), self.nodes[0].getrawtransaction(mempool_tx), None, self.nodes[0].getrawtransaction(tx)])
+        gottxs = self.nodes[0].getrawtransactions(txids, True)
+        assert_equal([t['blockhash'] if t and 'blockhash' in t else None for t in gottxs], [block2, block1, None, None, block1])
+        assert_equal(gottxs[1], self.nodes[0].getrawtransaction(tx, True))
+        assert_equal(self.nodes[0].getrawtransactions([]), [])
+        assert_raises_rpc_error(-8, "txid must be of length 64", self.nodes[0].getrawtransactions, ["abcd1234"])
+        self.nodes[2].generate(1)
+        self.sync_all()
+
         #########################
         # RAW TX MULTISIG TESTS #
         #########################
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the cache of results about buried blocks (-rpccachesize)."""
+
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import assert_equal
+
+
+class RPCResultCacheTest(PalladiumTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [['-rpccachesize=1']]
+
+    def cache_info(self):
+        return self.nodes[0].getrpcinfo()['result_cache']
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generatetoaddress(20, node.get_deterministic_priv_key().address)
+        assert_equal(self.cache_info()['entries'], 0)
+
+        self.log.info('Results about buried blocks are answered from the cache')
+        buried = node.getblockhash(10)
+        block = node.getblock(buried)
+        assert_equal(self.cache_info()['entries'], 1)
+        assert_equal(node.getblock(buried), block)
+        assert_equal(node.getblock(blockhash=buried), block)
+        assert_equal(self.cache_info()['hits'], 2)
+        assert_equal(node.getblockheader(buried)['confirmations'], 11)
+        stats = node.getblockstats(10)
+        assert_equal(node.getblockstats(10), stats)
+        coinbase = node.getrawtransaction(block['tx'][0], True, buried)
+        assert_equal(node.getrawtransaction(block['tx'][0], True, buried), coinbase)
+        assert_equal(self.cache_info()['entries'], 4)
+        assert_equal(self.cache_info()['hits'], 4)
+
+        self.log.info('Results about recent blocks are not cached')
+        node.getblock(node.getblockhash(16))
+        node.getblock(node.getbestblockhash())
+        assert_equal(self.cache_info()['entries'], 4)
+
+        self.log.info('Cached results follow the tip')
+        node.generatetoaddress(1, node.get_deterministic_priv_key().address)
+        assert_equal(node.getblock(buried)['confirmations'], 12)
+        assert_equal(node.getrawtransaction(block['tx'][0], True, buried)['confirmations'], 12)
+
+        self.log.info('A reorg drops the results about the blocks it disconnected')
+        fork = node.getblockhash(8)
+        node.invalidateblock(fork)
+        assert_equal(self.cache_info()['entries'], 0)
+        assert_equal(node.getblock(buried)['confirmations'], -1)
+        node.reconsiderblock(fork)
+        assert_equal(node.getblock(buried), dict(block, confirmations=12))
+
+        self.log.info('The cache stays within its size limit')
+        for height in range(1, 16):
+            node.getblock(node.getblockhash(height), 2)
+        info = self.cache_info()
+        assert info['bytes'] <= info['max_bytes']
+        assert_equal(info['max_bytes'], 1 << 20)
+
+
+if __name__ == '__main__':
+    RPCResultCacheTest().main()
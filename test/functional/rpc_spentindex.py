@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test looking up the transaction spending an output with getspendingtx."""
+
+from decimal import Decimal
+
+from test_framework.address import ADDRESS_BCRT1_UNSPENDABLE
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    wait_until,
+)
+
+
+class SpentIndexTest(PalladiumTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.extra_args = [["-spentindex"], []]
+
+    def run_test(self):
+        node = self.nodes[0]
+        key = node.get_deterministic_priv_key()
+        coinbase = node.getblock(node.getblockhash(1), 2)['tx'][0]
+
+        self.log.info("getspendingtx fails without -spentindex or for unspent outputs")
+        assert_raises_rpc_error(-1, "Spent output index is not enabled", self.nodes[1].getspendingtx, coinbase['txid'], 0)
+        wait_until(lambda: 'still in the process' not in self.lookup_error(coinbase['txid'], 0))
+        assert_raises_rpc_error(-5, "No spending transaction found in the active chain", node.getspendingtx, coinbase['txid'], 0)
+        assert_raises_rpc_error(-8, "Invalid output number", node.getspendingtx, coinbase['txid'], -1)
+
+        self.log.info("A spent output is found once its spender is mined")
+        rawtx = node.createrawtransaction([{'txid': coinbase['txid'], 'vout': 0}], [{ADDRESS_BCRT1_UNSPENDABLE: coinbase['vout'][0]['value'] - Decimal('0.001')}])
+        signed = node.signrawtransactionwithkey(rawtx, [key.key], [{
+            'txid': coinbase['txid'],
+            'vout': 0,
+            'scriptPubKey': coinbase['vout'][0]['scriptPubKey']['hex'],
+            'amount': coinbase['vout'][0]['value'],
+        }])
+        txid = node.sendrawtransaction(signed['hex'])
+        assert_raises_rpc_error(-5, "No spending transaction found", node.getspendingtx, coinbase['txid'], 0)
+        block = node.generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)[0]
+        node.syncwithvalidationinterfacequeue()
+        expected = {'txid': txid, 'vin': 0, 'blockhash': block, 'height': node.getblockcount()}
+        assert_equal(node.getspendingtx(coinbase['txid'], 0), expected)
+        assert_raises_rpc_error(-5, "No spending transaction found", node.getspendingtx, coinbase['txid'], 1)
+
+        self.log.info("Spends of disconnected blocks are not returned")
+        node.invalidateblock(block)
+        assert_raises_rpc_error(-5, "No spending transaction found in the active chain", node.getspendingtx, coinbase['txid'], 0)
+        node.prioritisetransaction(txid, 0, -10**8)
+        node.generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)
+        node.syncwithvalidationinterfacequeue()
+        assert_raises_rpc_error(-5, "No spending transaction found in the active chain", node.getspendingtx, coinbase['txid'], 0)
+        node.reconsiderblock(block)
+        node.generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)
+        node.syncwithvalidationinterfacequeue()
+        assert_equal(node.getspendingtx(coinbase['txid'], 0), expected)
+
+        self.log.info("The index persists across restarts")
+        self.restart_node(0, extra_args=["-spentindex"])
+        assert_equal(self.nodes[0].getspendingtx(coinbase['txid'], 0), expected)
+
+    def lookup_error(self, txid, n):
+        try:
+            self.nodes[0].getspendingtx(txid, n)
+            return ''
+        except Exception as e:
+            return str(e)
+
+
+if __name__ == '__main__':
+    SpentIndexTest().main()
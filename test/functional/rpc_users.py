@@ -84,6 +84,9 @@ class HTTPBasicsTest(PalladiumTestFramework):
         self.log.info('Wrong...')
         assert_equal(401, call_with_auth(node, user+'wrong', password+'wrong').status)
 
+        self.log.info('Correct again, from the authorization cache...')
+        assert_equal(200, call_with_auth(node, user, password).status)
+
     def run_test(self):
 
         ##################################################
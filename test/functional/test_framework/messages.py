@@ -1497,3 +1497,42 @@ class msg_no_witness_blocktxn(msg_blocktxn):
 
     def serialize(self):
         return self.block_transactions.serialize(with_witness=False)
+
+
+class msg_sendtxrcncl:
+    __slots__ = ("version", "salt")
+    command = b"sendtxrcncl"
+
+    def __init__(self, version=1, salt=0):
+        self.version = version
+        self.salt = salt
+
+    def deserialize(self, f):
+        self.version = struct.unpack("<I", f.read(4))[0]
+        self.salt = struct.unpack("<Q", f.read(8))[0]
+
+    def serialize(self):
+        r = b""
+        r += struct.pack("<I", self.version)
+        r += struct.pack("<Q", self.salt)
+        return r
+
+    def __repr__(self):
+        return "msg_sendtxrcncl(version=%i, salt=%x)" % (self.version, self.salt)
+
+
+class msg_sendcmpr:
+    __slots__ = ("version",)
+    command = b"sendcmpr"
+
+    def __init__(self, version=1):
+        self.version = version
+
+    def deserialize(self, f):
+        self.version = struct.unpack("<I", f.read(4))[0]
+
+    def serialize(self):
+        return struct.pack("<I", self.version)
+
+    def __repr__(self):
+        return "msg_sendcmpr(version=%i)" % self.version
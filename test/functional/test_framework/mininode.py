@@ -46,7 +46,9 @@ from test_framework.messages import (
     msg_ping,
     msg_pong,
     msg_sendcmpct,
+    msg_sendcmpr,
     msg_sendheaders,
+    msg_sendtxrcncl,
     msg_tx,
     MSG_TX,
     MSG_TYPE_MASK,
@@ -82,7 +84,9 @@ MESSAGEMAP = {
     b"ping": msg_ping,
     b"pong": msg_pong,
     b"sendcmpct": msg_sendcmpct,
+    b"sendcmpr": msg_sendcmpr,
     b"sendheaders": msg_sendheaders,
+    b"sendtxrcncl": msg_sendtxrcncl,
     b"tx": msg_tx,
     b"verack": msg_verack,
     b"version": msg_version,
@@ -341,7 +345,9 @@ class P2PInterface(P2PConnection):
     def on_pong(self, message): pass
     def on_reject(self, message): pass
     def on_sendcmpct(self, message): pass
+    def on_sendcmpr(self, message): pass
     def on_sendheaders(self, message): pass
+    def on_sendtxrcncl(self, message): pass
     def on_tx(self, message): pass
 
     def on_inv(self, message):
@@ -102,10 +102,13 @@ BASE_SCRIPTS = [
     'wallet_abandonconflict.py',
     'feature_csv_activation.py',
     'rpc_rawtransaction.py',
+    'rpc_packages.py',
+    'rpc_result_cache.py',
     'wallet_address_types.py',
     'feature_bip68_sequence.py',
     'p2p_feefilter.py',
     'feature_reindex.py',
+    'feature_blockindex_image.py',
     'feature_abortnode.py',
     # vv Tests less than 30s vv
     'wallet_keypool_topup.py',
@@ -120,12 +123,14 @@ BASE_SCRIPTS = [
     'rpc_getchaintips.py',
     'rpc_misc.py',
     'interface_rest.py',
+    'interface_metrics.py',
     'mempool_spend_coinbase.py',
     'wallet_avoidreuse.py',
     'mempool_reorg.py',
     'mempool_persist.py',
     'wallet_multiwallet.py',
     'wallet_multiwallet.py --usecli',
+    'wallet_routing.py',
     'wallet_createwallet.py',
     'wallet_createwallet.py --usecli',
     'wallet_watchonly.py',
@@ -152,6 +157,8 @@ BASE_SCRIPTS = [
     'p2p_filter.py',
     'rpc_setban.py',
     'p2p_blocksonly.py',
+    'p2p_txrecon.py',
+    'p2p_compression.py',
     'mining_prioritisetransaction.py',
     'p2p_invalid_locator.py',
     'p2p_invalid_block.py',
@@ -164,6 +171,9 @@ BASE_SCRIPTS = [
     'wallet_txn_clone.py --mineblock',
     'feature_notifications.py',
     'rpc_getblockfilter.py',
+    'rpc_addressindex.py',
+    'rpc_spentindex.py',
+    'feature_coinstatsindex.py',
     'rpc_invalidateblock.py',
     'feature_rbf.py',
     'mempool_packages.py',
@@ -175,6 +185,7 @@ BASE_SCRIPTS = [
     'p2p_leak_tx.py',
     'rpc_signmessage.py',
     'wallet_balance.py',
+    'wallet_sendbatch.py',
     'feature_nulldummy.py',
     'mempool_accept.py',
     'mempool_expiry.py',
@@ -196,6 +207,7 @@ BASE_SCRIPTS = [
     'wallet_resendwallettransactions.py',
     'wallet_fallbackfee.py',
     'rpc_dumptxoutset.py',
+    'rpc_loadtxoutset.py',
     'feature_minchainwork.py',
     'rpc_estimatefee.py',
     'rpc_getblockstats.py',
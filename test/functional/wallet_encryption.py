@@ -84,6 +84,15 @@ class WalletEncryptionTest(PalladiumTestFramework):
         actual_time = self.nodes[0].getwalletinfo()['unlocked_until']
         assert_greater_than_or_equal(actual_time, expected_time)
         assert_greater_than(expected_time + 5, actual_time) # 5 second buffer
+        self.nodes[0].walletlock()
+
+        # Test unlocking with only a sample of the keys checked
+        self.restart_node(0, extra_args=['-walletunlocksample=10'])
+        with self.nodes[0].assert_debug_log(expected_msgs=['Unlock checked']):
+            self.nodes[0].walletpassphrase(passphrase2, 10)
+        assert_equal(privkey, self.nodes[0].dumpprivkey(address))
+        self.nodes[0].walletlock()
+        assert_raises_rpc_error(-14, "wallet passphrase entered was incorrect", self.nodes[0].walletpassphrase, passphrase, 10)
 
 if __name__ == '__main__':
     WalletEncryptionTest().main()
@@ -11,6 +11,7 @@ from test_framework.test_framework import PalladiumTestFramework
 from test_framework.util import (
     assert_array_result,
     assert_equal,
+    assert_raises_rpc_error,
     hex_str_to_bytes,
 )
 
@@ -103,6 +104,7 @@ class ListTransactionsTest(PalladiumTestFramework):
                             {"txid": txid, "label": "watchonly"})
 
         self.run_rbf_opt_in_test()
+        self.run_cursor_test()
 
     # Check that the opt-in-rbf flag works properly, for sent and received
     # transactions.
@@ -206,5 +208,42 @@ class ListTransactionsTest(PalladiumTestFramework):
         assert_equal(self.nodes[0].gettransaction(txid_3b)["bip125-replaceable"], "no")
         assert_equal(self.nodes[0].gettransaction(txid_4)["bip125-replaceable"], "unknown")
 
+    def run_cursor_test(self):
+        self.log.info("Test paging with cursors")
+        node = self.nodes[1]
+        all_txs = node.listtransactions(count=1000)
+        for page_size in [1, 2, 3, 5]:
+            paged = []
+            page = node.listtransactions("*", page_size, 0, False, "")
+            while True:
+                assert len(page["transactions"]) <= page_size
+                # Each page is oldest to newest, and older than the one before
+                paged = page["transactions"] + paged
+                if "next_cursor" not in page:
+                    break
+                page = node.listtransactions("*", page_size, 0, False, page["next_cursor"])
+            assert_equal(paged, all_txs)
+
+        # skip applies after the cursor
+        page = node.listtransactions("*", 2, 0, False, "")
+        assert_equal(node.listtransactions("*", 2, 1, False, page["next_cursor"])["transactions"], all_txs[-5:-3])
+
+        self.log.info("Test paging a label with cursors")
+        address = node.getnewaddress("paged")
+        txids = [self.nodes[0].sendtoaddress(address, 0.01 * (i + 1)) for i in range(5)]
+        self.sync_all()
+        labelled = node.listtransactions(label="paged", count=100)
+        assert_equal([tx["txid"] for tx in labelled], txids)
+        page = node.listtransactions("paged", 2, 0, False, "")
+        assert_equal(page["transactions"], labelled[-2:])
+        page = node.listtransactions("paged", 2, 0, False, page["next_cursor"])
+        assert_equal(page["transactions"], labelled[-4:-2])
+        page = node.listtransactions("paged", 2, 0, False, page["next_cursor"])
+        assert_equal(page["transactions"], labelled[:1])
+        assert "next_cursor" not in page
+
+        assert_raises_rpc_error(-8, "Invalid cursor", node.listtransactions, "*", 10, 0, False, "zz")
+        assert_raises_rpc_error(-8, "Invalid cursor", node.listtransactions, "*", 10, 0, False, "00")
+
 if __name__ == '__main__':
     ListTransactionsTest().main()
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test that wallets loaded with -walletrouting see the transactions involving them."""
+from decimal import Decimal
+
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import (
+    assert_equal,
+    connect_nodes,
+    disconnect_nodes,
+)
+
+
+class WalletRoutingTest(PalladiumTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [["-walletrouting"], []]
+
+    def skip_test_if_missing_module(self):
+        self.skip_if_no_wallet()
+
+    def run_test(self):
+        node, miner = self.nodes
+        for name in ["w1", "w2", "w3"]:
+            node.createwallet(name)
+        funder = node.get_wallet_rpc("")
+        w1, w2, w3 = [node.get_wallet_rpc(name) for name in ["w1", "w2", "w3"]]
+        miner.generate(101)
+        funder.generate(101)
+        self.sync_all()
+
+        self.log.info("Mempool and block transactions reach the wallets they pay to")
+        txid = funder.sendtoaddress(w1.getnewaddress(), 10)
+        assert_equal(w1.getbalances()["mine"]["untrusted_pending"], 10)
+        assert_equal(w1.gettransaction(txid)["confirmations"], 0)
+        assert_equal(len(w2.listtransactions()), 0)
+        funder.generate(1)
+        assert_equal(w1.getbalance(), 10)
+        assert_equal(w1.gettransaction(txid)["confirmations"], 1)
+        assert_equal(len(w3.listtransactions()), 0)
+
+        self.log.info("Spends from a wallet are seen by that wallet")
+        w1.sendtoaddress(w2.getnewaddress(), 1)
+        funder.generate(1)
+        assert_equal(w2.getbalance(), 1)
+        assert w1.getbalance() < 9
+        assert_equal(len(w1.listtransactions()), 2)
+        assert_equal(len(w3.listtransactions()), 0)
+
+        self.log.info("A spend of a wallet output in the block that created it is routed")
+        address = w3.getnewaddress()
+        miner.importprivkey(w3.dumpprivkey(address))
+        self.sync_all()
+        disconnect_nodes(node, 1)
+        txid = miner.sendtoaddress(address, 3)
+        vout = next(out["n"] for out in miner.decoderawtransaction(miner.gettransaction(txid)["hex"])["vout"] if out["value"] == 3)
+        raw = miner.createrawtransaction([{"txid": txid, "vout": vout}], {miner.getnewaddress(): Decimal("2.999")})
+        spend = miner.sendrawtransaction(miner.signrawtransactionwithwallet(raw)["hex"])
+        miner.generate(1)
+        connect_nodes(node, 1)
+        self.sync_blocks()
+        assert_equal(w3.gettransaction(txid)["confirmations"], 1)
+        assert_equal(w3.gettransaction(spend)["confirmations"], 1)
+        assert_equal(w3.getbalance(), 0)
+
+        self.log.info("Unloading and loading wallets keeps routing the others")
+        node.unloadwallet("w1")
+        funder.sendtoaddress(w2.getnewaddress(), 1)
+        funder.generate(1)
+        assert_equal(w2.getbalance(), 2)
+        node.loadwallet("w1")
+        w1 = node.get_wallet_rpc("w1")
+        balance = w1.getbalance()
+        funder.sendtoaddress(w1.getnewaddress(), 1)
+        funder.generate(1)
+        assert_equal(w1.getbalance(), balance + 1)
+
+
+if __name__ == '__main__':
+    WalletRoutingTest().main()
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Palladium Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test sending a batch of payments with sendbatch."""
+
+from decimal import Decimal
+
+from test_framework.test_framework import PalladiumTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+
+
+class SendBatchTest(PalladiumTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+
+    def skip_test_if_missing_module(self):
+        self.skip_if_no_wallet()
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(101)
+        self.sync_all()
+
+        self.log.info("Payments are split into transactions of at most max_outputs")
+        address = self.nodes[1].getnewaddress()
+        payments = [{'address': self.nodes[1].getnewaddress(), 'amount': Decimal('0.1') * (i + 1)} for i in range(5)]
+        payments.append({'address': address, 'amount': Decimal('1')})
+        payments.append({'address': address, 'amount': Decimal('2')})
+        txids = node.sendbatch(payments, 3, "payout")
+        assert_equal(len(txids), 3)
+        self.sync_mempools()
+        outputs = 0
+        for txid in txids:
+            tx = node.gettransaction(txid)
+            assert_equal(tx['comment'], "payout")
+            outputs += len(tx['details'])
+        assert_equal(outputs, len(payments))
+
+        self.log.info("The transactions of a batch do not spend the same coins")
+        spent = [(vin['txid'], vin['vout']) for txid in txids for vin in node.getrawtransaction(txid, True)['vin']]
+        assert_equal(len(spent), len(set(spent)))
+
+        node.generate(1)
+        self.sync_all()
+        assert_equal(self.nodes[1].getreceivedbyaddress(address), Decimal('3'))
+        assert_equal(self.nodes[1].getbalance(), sum(p['amount'] for p in payments))
+
+        self.log.info("Nothing is sent if one of the transactions cannot be funded")
+        balance = node.getbalance()
+        assert_raises_rpc_error(-6, "Insufficient funds", node.sendbatch, [{'address': address, 'amount': balance - 1}, {'address': address, 'amount': 2}], 1)
+        assert_equal(node.getrawmempool(), [])
+
+        self.log.info("Invalid payments are rejected")
+        assert_raises_rpc_error(-8, "payments must not be empty", node.sendbatch, [])
+        assert_raises_rpc_error(-8, "max_outputs must be positive", node.sendbatch, payments, 0)
+        assert_raises_rpc_error(-5, "Invalid Palladium address", node.sendbatch, [{'address': 'notanaddress', 'amount': 1}])
+        assert_raises_rpc_error(-3, "Invalid amount for send", node.sendbatch, [{'address': address, 'amount': 0}])
+
+
+if __name__ == '__main__':
+    SendBatchTest().main()